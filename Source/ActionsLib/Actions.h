@@ -21,6 +21,8 @@ using namespace Microsoft::MSR::CNTK; // TODO: we should not have this in a head
 template <class ConfigRecordType, typename ElemType>
 void DoTrain(const ConfigRecordType& config);
 template <typename ElemType>
+void DoTrainBenchmark(const ConfigParameters& config);
+template <typename ElemType>
 void DoAdapt(const ConfigParameters& config);
 template <typename ElemType>
 void DoEdit(const ConfigParameters& config);
@@ -32,13 +34,23 @@ template <typename ElemType>
 void DoCrossValidate(const ConfigParameters& config);
 template <typename ElemType>
 void DoWriteOutput(const ConfigParameters& config);
+template <typename ElemType>
+void DoBeamSearch(const ConfigParameters& config);
 
 // misc (OtherActions.cpp)
 template <typename ElemType>
 void DoCreateLabelMap(const ConfigParameters& config);
 template <typename ElemType>
+void DoConvertToBinaryChunks(const ConfigParameters& config);
+template <typename ElemType>
+void DoConvertImageRecords(const ConfigParameters& config);
+template <typename ElemType>
+void DoReaderBenchmark(const ConfigParameters& config);
+template <typename ElemType>
 void DoParameterSVD(const ConfigParameters& config);
 template <typename ElemType>
+void DoPruneWeights(const ConfigParameters& config);
+template <typename ElemType>
 void DoWriteWordAndClassInfo(const ConfigParameters& config);
 template <typename ElemType>
 void DoTopologyPlot(const ConfigParameters& config);
@@ -48,3 +60,5 @@ template <typename ElemType>
 void DoConvertFromDbn(const ConfigParameters& config);
 template<typename ElemType>
 void DoExportToDbn(const ConfigParameters& config);
+template <typename ElemType>
+void DoExportForInference(const ConfigParameters& config);
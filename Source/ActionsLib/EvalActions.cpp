@@ -17,9 +17,12 @@
 #include "Config.h"
 #include "SimpleEvaluator.h"
 #include "SimpleOutputWriter.h"
+#include "BeamSearchDecoder.h"
 #include "BestGpu.h"
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
+#include "TimerUtility.h"
+#include "MPIWrapper.h"
 
 #include <string>
 #include <chrono>
@@ -65,9 +68,10 @@ static void DoEvalBase(const ConfigParameters& config, IDataReader<ElemType>& re
         evalNodeNamesVector.push_back(evalNodeNames[i]);
     }
 
-    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath, ComputationNetworkOptions(config));
 
-    SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
+    // with parallelEval (or parallelTrain), each MPI worker evaluates its share of the data
+    SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel, g_mpi);
     eval.Evaluate(&reader, evalNodeNamesVector, mbSize[0], epochSize);
 }
 
@@ -145,9 +149,9 @@ void DoCrossValidate(const ConfigParameters& config)
         }
 
         cvModels.push_back(cvModelPath);
-        auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPath);
+        auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPath, ComputationNetworkOptions(config));
 
-        SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
+        SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel, g_mpi);
 
         fprintf(stderr, "model %ls --> \n", cvModelPath.c_str());
         auto evalErrors = eval.Evaluate(&cvDataReader, evalNodeNamesVector, mbSize[0], epochSize);
@@ -225,6 +229,7 @@ void DoWriteOutput(const ConfigParameters& config)
     // Note this is required since the user might specify OutputNodeNames in the config, so don't use CreateFromFile,
 	// instead we build the network ourselves.
     auto net = make_shared<ComputationNetwork>(deviceId);
+    net->SetOptions(ComputationNetworkOptions(config));
     net->Read<ElemType>(modelPath);
 
     if (outputNodeNames.size() > 0)
@@ -238,10 +243,13 @@ void DoWriteOutput(const ConfigParameters& config)
     }
     net->CompileNetwork();
 
-    SimpleOutputWriter<ElemType> writer(net, 1);
+    // with parallelEval (or parallelTrain), each MPI worker writes its share of the data into its own shard
+    SimpleOutputWriter<ElemType> writer(net, 1, g_mpi);
 
     if (config.Exists("writer"))
     {
+        if ((g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1))
+            InvalidArgument("write command: Distributed output is only supported with 'outputPath', not with a 'writer'.");
         ConfigParameters writerConfig(config(L"writer"));
         bool bWriterUnittest = writerConfig(L"unittest", "false");
         DataWriter<ElemType> testDataWriter(writerConfig);
@@ -263,7 +271,10 @@ void DoWriteOutput(const ConfigParameters& config)
                 else if (type == "category") formattingOptions.isCategoryLabel = true;
                 else                         InvalidArgument("write: type must be 'real' or 'category'");
                 if (formattingOptions.isCategoryLabel)
+                {
                     formattingOptions.labelMappingFile = (wstring)formatConfig(L"labelMappingFile", L"");
+                    formattingOptions.nBest = formatConfig(L"nBest", formattingOptions.nBest);
+                }
             }
             formattingOptions.transpose        = formatConfig(L"transpose",        formattingOptions.transpose);
             formattingOptions.prologue         = formatConfig(L"prologue",         formattingOptions.prologue);
@@ -283,3 +294,106 @@ void DoWriteOutput(const ConfigParameters& config)
 
 template void DoWriteOutput<float>(const ConfigParameters& config);
 template void DoWriteOutput<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoBeamSearch() - implements CNTK "beamSearch" command
+// Decodes a recurrent model that is fed its previous output token (see BeamSearchDecoder.h), for each prompt in
+// 'promptFile' (one per line, tokens separated by spaces; an empty line decodes without prompt), or once without prompt.
+// With a 'labelMappingFile', tokens are words, else indices. Writes the 'nBest' best hypotheses of each prompt to
+// 'outputPath' (or stdout), one line each: the score, a tab, and the tokens.
+// ===========================================================================
+
+template <typename ElemType>
+void DoBeamSearch(const ConfigParameters& config)
+{
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    wstring modelPath = config(L"modelPath");
+    wstring inputNodeName = config(L"inputNodeName");
+    wstring outputNodeName = config(L"outputNodeName");
+    size_t beamSize = config(L"beamSize", (size_t) 5);
+    size_t maxLength = config(L"maxLength", (size_t) 100);
+    size_t nBest = config(L"nBest", (size_t) 1);
+    size_t numParallelPrompts = config(L"numParallelPrompts", (size_t) 16);
+    bool normalize = config(L"normalize", true);
+    wstring promptFile = config(L"promptFile", L"");
+    wstring labelMappingFile = config(L"labelMappingFile", L"");
+    wstring outputPath = config(L"outputPath", L"-");
+
+    vector<string> labels;
+    map<string, size_t> labelIndices;
+    if (!labelMappingFile.empty())
+    {
+        File::LoadLabelFile(labelMappingFile, labels);
+        for (size_t i = 0; i < labels.size(); i++)
+            labelIndices[labels[i]] = i;
+    }
+    auto tokenFromString = [&](const string& s) -> size_t
+    {
+        if (labels.empty())
+            return (size_t) atoi(s.c_str());
+        auto iter = labelIndices.find(s);
+        if (iter == labelIndices.end())
+            InvalidArgument("beamSearch: Token '%s' is not in the labelMappingFile.", s.c_str());
+        return iter->second;
+    };
+    // start and end token are given as indices, or as words if there is a label mapping
+    size_t startToken = tokenFromString(config(L"startToken", "0"));
+    size_t endToken = tokenFromString(config(L"endToken", "1"));
+
+    vector<vector<size_t>> prompts;
+    if (!promptFile.empty())
+    {
+        File file(promptFile, fileOptionsRead | fileOptionsText);
+        string line;
+        while (!file.IsEOF())
+        {
+            file.GetLine(line);
+            if (line.empty() && file.IsEOF())
+                break;
+            vector<size_t> prompt;
+            for (const auto& token : msra::strfun::split(line, " \t"))
+                prompt.push_back(tokenFromString(token));
+            prompts.push_back(prompt);
+        }
+    }
+    else
+        prompts.push_back(vector<size_t>());
+
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath, ComputationNetworkOptions(config));
+    BeamSearchDecoder<ElemType> decoder(net, inputNodeName, outputNodeName, beamSize, maxLength, startToken, endToken, normalize);
+
+    if (outputPath != L"-")
+        File::MakeIntermediateDirs(outputPath);
+    File output(outputPath, fileOptionsWrite | fileOptionsText);
+    FILE* f = output;
+    numParallelPrompts = max(numParallelPrompts, (size_t) 1);
+    size_t numTokens = 0;
+    Timer timer;
+    timer.Start();
+    for (size_t first = 0; first < prompts.size(); first += numParallelPrompts)
+    {
+        vector<vector<size_t>> batch(prompts.begin() + first, prompts.begin() + min(first + numParallelPrompts, prompts.size()));
+        auto results = decoder.Decode(batch);
+        for (const auto& hypotheses : results)
+        {
+            for (size_t i = 0; i < hypotheses.size() && i < nBest; i++)
+            {
+                string line = msra::strfun::strprintf("%.6f\t", hypotheses[i].m_score);
+                for (size_t j = 0; j < hypotheses[i].m_tokens.size(); j++)
+                {
+                    size_t token = hypotheses[i].m_tokens[j];
+                    line += (j > 0 ? " " : "") + (token < labels.size() ? labels[token] : msra::strfun::strprintf("%d", (int) token));
+                }
+                fprintfOrDie(f, "%s\n", line.c_str());
+            }
+            if (!hypotheses.empty())
+                numTokens += hypotheses[0].m_tokens.size();
+        }
+    }
+    timer.Stop();
+    fprintf(stderr, "beamSearch: Decoded %d prompts (%d tokens in the best hypotheses) in %.3f seconds.\n",
+            (int) prompts.size(), (int) numTokens, timer.ElapsedSeconds());
+}
+
+template void DoBeamSearch<float>(const ConfigParameters& config);
+template void DoBeamSearch<double>(const ConfigParameters& config);
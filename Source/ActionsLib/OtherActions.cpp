@@ -15,6 +15,9 @@
 #include "Config.h"
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
+#include "BinaryChunkFormat.h"
+#include "DataReader.h"
+#include "BestGpu.h"
 
 #include <string>
 #include <chrono>
@@ -117,6 +120,531 @@ void DoCreateLabelMap(const ConfigParameters& config)
 template void DoCreateLabelMap<float>(const ConfigParameters& config);
 template void DoCreateLabelMap<double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoConvertToBinaryChunks() - implements CNTK "convertToBinaryChunks" command
+// ===========================================================================
+
+// Writes sequences into the binary chunked container (see BinaryChunkFormat.h).
+// Sequences are collected into chunks of roughly chunkSizeInBytes; the file and stream headers are only known
+// at the end (stream dimensions and storage types come from the first minibatch), so they are written last.
+template <typename ElemType>
+class BinaryChunkFileWriter
+{
+public:
+    BinaryChunkFileWriter(const wstring& path, const vector<wstring>& streamNames, size_t chunkSizeInBytes)
+        : m_chunkSizeInBytes(chunkSizeInBytes), m_numberOfSequences(0), m_numberOfSamples(0), m_numberOfSamplesInChunk(0)
+    {
+        m_headerSize = sizeof(BinaryChunkFileHeader);
+        for (const auto& name : streamNames)
+        {
+            m_names.push_back(msra::strfun::utf8(name));
+            m_headerSize += sizeof(BinaryChunkStreamHeader) + BinaryChunkAlign(m_names.back().size());
+        }
+        m_dimensions.resize(m_names.size(), 0);
+        m_isSparse.resize(m_names.size(), false);
+
+        m_file = fopenOrDie(path, L"wb");
+        vector<char> placeholder(m_headerSize, 0);
+        fwriteOrDie(placeholder, m_file);
+        m_offset = m_headerSize;
+    }
+
+    void SetStreamLayout(size_t streamIndex, size_t dimension, bool isSparse)
+    {
+        m_dimensions[streamIndex] = dimension;
+        m_isSparse[streamIndex] = isSparse;
+    }
+
+    // 'data' holds the frames of each stream densely, column-major
+    void AddSequence(size_t numberOfSamples, const vector<vector<ElemType>>& data)
+    {
+        assert(data.size() == m_names.size());
+        m_records.push_back(numberOfSamples);
+        for (size_t i = 0; i < m_names.size(); i++)
+        {
+            m_records.push_back(m_payload.size());
+            if (m_isSparse[i])
+                AppendSparse(numberOfSamples, m_dimensions[i], data[i]);
+            else
+                Append(data[i].data(), data[i].size() * sizeof(ElemType));
+        }
+        m_numberOfSamplesInChunk += numberOfSamples;
+
+        if (m_records.size() * sizeof(uint64_t) + m_payload.size() >= m_chunkSizeInBytes)
+            FlushChunk();
+    }
+
+    void Close()
+    {
+        FlushChunk();
+
+        BinaryChunkFileHeader header;
+        header.m_magic = BinaryChunkFileMagic;
+        header.m_version = BinaryChunkFileVersion;
+        header.m_numberOfStreams = (uint32_t) m_names.size();
+        header.m_numberOfChunks = m_chunkTable.size();
+        header.m_numberOfSequences = m_numberOfSequences;
+        header.m_numberOfSamples = m_numberOfSamples;
+        header.m_chunkTableOffset = m_offset;
+        fwriteOrDie(m_chunkTable, m_file);
+
+        fseekOrDie(m_file, 0);
+        fwriteOrDie(&header, sizeof(header), 1, m_file);
+        for (size_t i = 0; i < m_names.size(); i++)
+        {
+            BinaryChunkStreamHeader streamHeader;
+            streamHeader.m_storageType = m_isSparse[i] ? BinaryChunkStorageType::sparse_csc : BinaryChunkStorageType::dense;
+            streamHeader.m_elementType = sizeof(ElemType) == sizeof(float) ? BinaryChunkElementType::tfloat : BinaryChunkElementType::tdouble;
+            streamHeader.m_sampleDimension = m_dimensions[i];
+            streamHeader.m_nameLength = (uint32_t) m_names[i].size();
+            streamHeader.m_reserved = 0;
+            fwriteOrDie(&streamHeader, sizeof(streamHeader), 1, m_file);
+            vector<char> name(BinaryChunkAlign(m_names[i].size()), 0);
+            std::copy(m_names[i].begin(), m_names[i].end(), name.begin());
+            fwriteOrDie(name, m_file);
+        }
+        fcloseOrDie(m_file);
+        m_file = nullptr;
+    }
+
+    ~BinaryChunkFileWriter()
+    {
+        if (m_file)
+            fclose(m_file);
+    }
+
+    size_t GetNumberOfSequences() const { return m_numberOfSequences + m_records.size() / (1 + m_names.size()); }
+    size_t GetNumberOfChunks() const { return m_chunkTable.size(); }
+
+private:
+    void Append(const void* data, size_t size)
+    {
+        const char* bytes = reinterpret_cast<const char*>(data);
+        m_payload.insert(m_payload.end(), bytes, bytes + size);
+        m_payload.resize(BinaryChunkAlign(m_payload.size()), 0);
+    }
+
+    void AppendSparse(size_t numberOfSamples, size_t dimension, const vector<ElemType>& dense)
+    {
+        vector<uint32_t> indices(1, 0); // column starts, followed by the row indices
+        vector<ElemType> values;
+        vector<uint32_t> rows;
+        for (size_t j = 0; j < numberOfSamples; j++)
+        {
+            for (size_t i = 0; i < dimension; i++)
+            {
+                ElemType value = dense[j * dimension + i];
+                if (value != 0)
+                {
+                    rows.push_back((uint32_t) i);
+                    values.push_back(value);
+                }
+            }
+            indices.push_back((uint32_t) rows.size());
+        }
+        indices.insert(indices.end(), rows.begin(), rows.end());
+        Append(indices.data(), indices.size() * sizeof(uint32_t));
+        Append(values.data(), values.size() * sizeof(ElemType));
+    }
+
+    void FlushChunk()
+    {
+        const size_t recordSize = BinaryChunkSequenceRecordSize(m_names.size()) / sizeof(uint64_t);
+        const size_t numberOfSequences = m_records.size() / recordSize;
+        if (numberOfSequences == 0)
+            return;
+
+        // stream offsets are relative to the start of the chunk, i.e. they include the sequence records
+        const size_t recordsSize = m_records.size() * sizeof(uint64_t);
+        for (size_t i = 0; i < m_records.size(); i += recordSize)
+        {
+            for (size_t j = 1; j < recordSize; j++)
+                m_records[i + j] += recordsSize;
+        }
+
+        BinaryChunkDescriptor chunk;
+        chunk.m_offset = m_offset;
+        chunk.m_size = recordsSize + m_payload.size();
+        chunk.m_numberOfSequences = numberOfSequences;
+        chunk.m_numberOfSamples = m_numberOfSamplesInChunk;
+        m_chunkTable.push_back(chunk);
+
+        fwriteOrDie(m_records, m_file);
+        fwriteOrDie(m_payload, m_file);
+        m_offset += chunk.m_size;
+        m_numberOfSequences += numberOfSequences;
+        m_numberOfSamples += m_numberOfSamplesInChunk;
+
+        m_records.clear();
+        m_payload.clear();
+        m_numberOfSamplesInChunk = 0;
+    }
+
+    FILE* m_file;
+    vector<string> m_names;
+    vector<size_t> m_dimensions;
+    vector<bool> m_isSparse;
+    size_t m_chunkSizeInBytes;
+    size_t m_headerSize;
+    uint64_t m_offset;            // current end of the file
+    vector<uint64_t> m_records;   // sequence records of the current chunk, stream offsets relative to m_payload
+    vector<char> m_payload;       // stream data of the current chunk
+    vector<BinaryChunkDescriptor> m_chunkTable;
+    uint64_t m_numberOfSequences; // in flushed chunks
+    uint64_t m_numberOfSamples;   // in flushed chunks
+    size_t m_numberOfSamplesInChunk;
+};
+
+// the posteriors softmax(z / T) of the 'numCols' columns of teacher logits 'z', of which only the 'topK' largest of each
+// column are kept (renormalized; 0 = all), so that the stream of soft targets stays sparse
+template <typename ElemType>
+static void ComputeTeacherSoftTargets(const ElemType* z, size_t dim, size_t numCols, double temperature, size_t topK, vector<ElemType>& targets)
+{
+    if (topK == 0 || topK > dim)
+        topK = dim;
+    targets.assign(dim * numCols, 0);
+    vector<double> posteriors(dim);
+    vector<size_t> order(dim);
+    for (size_t j = 0; j < numCols; j++)
+    {
+        const ElemType* column = z + j * dim;
+        double maxLogit = *max_element(column, column + dim) / temperature;
+        double sum = 0;
+        for (size_t i = 0; i < dim; i++)
+            sum += posteriors[i] = exp(column[i] / temperature - maxLogit);
+        for (size_t i = 0; i < dim; i++)
+            order[i] = i;
+        partial_sort(order.begin(), order.begin() + topK, order.end(), [&posteriors](size_t a, size_t b) { return posteriors[a] > posteriors[b]; });
+        double kept = 0;
+        for (size_t k = 0; k < topK; k++)
+            kept += posteriors[order[k]];
+        for (size_t k = 0; k < topK; k++)
+            targets[j * dim + order[k]] = (ElemType) (posteriors[order[k]] / kept);
+    }
+}
+
+// Reads the data of an arbitrary reader once and stores it in the binary chunked container,
+// which the BinaryChunkReader can then read without any parsing. Sequences are reassembled from the minibatch layouts,
+// so sequences that the reader splits across minibatches (truncated BPTT) are stored in one piece.
+// Sparse reader outputs are stored in the sparse_csc format.
+// For knowledge distillation, a teacher model ('teacherModelPath', whose inputs are named as the reader's) can be run
+// on the data once here: its softened posteriors softmax(z / teacherTemperature) of the logits z ('teacherOutputNodeName'),
+// cut to the 'teacherTopK' largest per frame, are stored as the extra sparse stream 'teacherStreamName', to be read as
+// the soft targets of a DistillationCrossEntropyWithSoftmax criterion, so the teacher does not run during training.
+template <typename ElemType>
+void DoConvertToBinaryChunks(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    wstring outputPath = config(L"outputPath");
+    size_t minibatchSize = config(L"minibatchSize", "2048");
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", "33554432");
+    int traceLevel = config(L"traceLevel", "0");
+
+    vector<wstring> streamNames;
+    vector<wstring> labelNames;
+    GetFileConfigNames(readerConfig, streamNames, labelNames);
+    streamNames.insert(streamNames.end(), labelNames.begin(), labelNames.end());
+    if (streamNames.empty())
+        RuntimeError("convertToBinaryChunks: the reader does not define any inputs");
+
+    // setup minibatch matrices
+    vector<shared_ptr<Matrix<ElemType>>> streamMatrices;
+    std::map<std::wstring, Matrix<ElemType>*> matrices;
+    for (const auto& name : streamNames)
+    {
+        streamMatrices.push_back(make_shared<Matrix<ElemType>>(CPUDEVICE));
+        matrices[name] = streamMatrices.back().get();
+    }
+    const size_t numReaderStreams = streamNames.size();
+
+    // optional teacher model for the soft targets
+    wstring teacherModelPath = config(L"teacherModelPath", L"");
+    size_t teacherTopK = config(L"teacherTopK", "10");
+    double teacherTemperature = config(L"teacherTemperature", "1");
+    ComputationNetworkPtr teacherNet;
+    ComputationNodeBasePtr teacherOutput;
+    vector<ComputationNodeBasePtr> teacherInputs;
+    vector<size_t> teacherInputStreams; // [teacher input] index of the reader stream
+    if (!teacherModelPath.empty())
+    {
+        if (teacherTemperature <= 0)
+            InvalidArgument("convertToBinaryChunks: teacherTemperature must be positive.");
+        wstring teacherOutputNodeName = config(L"teacherOutputNodeName");
+        teacherNet = make_shared<ComputationNetwork>(DeviceFromConfig(config));
+        teacherNet->Read<ElemType>(teacherModelPath);
+        teacherOutput = teacherNet->GetNodeFromName(teacherOutputNodeName);
+        teacherNet->CompileNetwork();
+        teacherNet->AllocateAllMatrices({}, {teacherOutput}, nullptr);
+        for (const auto& node : teacherNet->InputNodes(teacherOutput))
+        {
+            auto iter = find(streamNames.begin(), streamNames.end(), node->NodeName());
+            if (iter == streamNames.end())
+                RuntimeError("convertToBinaryChunks: the teacher input '%ls' is not an input of the reader", node->NodeName().c_str());
+            teacherInputs.push_back(node);
+            teacherInputStreams.push_back(iter - streamNames.begin());
+        }
+        teacherNet->StartEvaluateMinibatchLoop(teacherOutput);
+        streamNames.push_back(config(L"teacherStreamName", L"teacherTargets"));
+        fprintf(stderr, "convertToBinaryChunks: storing the top %d posteriors of '%ls' at temperature %.8g as stream '%ls'\n",
+                (int) teacherTopK, teacherOutputNodeName.c_str(), teacherTemperature, streamNames.back().c_str());
+    }
+
+    fprintf(stderr, "convertToBinaryChunks: writing '%ls'\n", outputPath.c_str());
+    auto start = std::chrono::system_clock::now();
+
+    DataReader<ElemType> dataReader(readerConfig);
+    BinaryChunkFileWriter<ElemType> writer(outputPath, streamNames, chunkSizeInBytes);
+    auto pMBLayout = make_shared<MBLayout>();
+    vector<vector<vector<ElemType>>> pending; // [parallel sequence][stream] frames of sequences that continue in the next minibatch
+    vector<size_t> pendingSamples;
+    bool first = true;
+
+    dataReader.StartMinibatchLoop(minibatchSize, 0, requestDataSize);
+    while (dataReader.GetMinibatch(matrices))
+    {
+        dataReader.CopyMBLayoutTo(pMBLayout);
+
+        // bring all streams into dense column-major CPU arrays
+        vector<vector<ElemType>> columns(streamNames.size());
+        vector<size_t> dimensions(streamNames.size());
+        for (size_t i = 0; i < numReaderStreams; i++)
+        {
+            Matrix<ElemType> dense(CPUDEVICE);
+            dense.SetValue(*streamMatrices[i]);
+            bool isSparse = dense.GetMatrixType() == MatrixType::SPARSE;
+            if (isSparse)
+                dense.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, true);
+            dimensions[i] = dense.GetNumRows();
+            if (first)
+                writer.SetStreamLayout(i, dimensions[i], isSparse);
+            unique_ptr<ElemType[]> data(dense.CopyToArray());
+            columns[i].assign(data.get(), data.get() + dense.GetNumElements());
+        }
+
+        if (teacherNet)
+        {
+            for (size_t k = 0; k < teacherInputs.size(); k++)
+            {
+                auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(teacherInputs[k]);
+                node->Value().SetValue(Matrix<ElemType>(*streamMatrices[teacherInputStreams[k]], node->GetDeviceId()));
+                node->NotifyFunctionValuesMBSizeModified();
+            }
+            dataReader.CopyMBLayoutTo(teacherNet->GetMBLayoutPtr());
+            teacherNet->DetermineActualMBSizeFromFeatures();
+            ComputationNetwork::BumpEvalTimeStamp(teacherInputs);
+            teacherNet->ForwardProp(teacherOutput);
+
+            const auto& logits = dynamic_pointer_cast<ComputationNode<ElemType>>(teacherOutput)->Value();
+            unique_ptr<ElemType[]> z(logits.CopyToArray());
+            dimensions[numReaderStreams] = logits.GetNumRows();
+            if (first)
+                writer.SetStreamLayout(numReaderStreams, dimensions[numReaderStreams], true);
+            ComputeTeacherSoftTargets(z.get(), logits.GetNumRows(), logits.GetNumCols(), teacherTemperature, teacherTopK, columns[numReaderStreams]);
+        }
+        first = false;
+
+        const size_t numParallelSequences = pMBLayout->GetNumParallelSequences();
+        const size_t numTimeSteps = pMBLayout->GetNumTimeSteps();
+        pending.resize(numParallelSequences, vector<vector<ElemType>>(streamNames.size()));
+        pendingSamples.resize(numParallelSequences, 0);
+        for (const auto& seq : pMBLayout->GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+
+            if (seq.tBegin >= 0 && pendingSamples[seq.s] > 0)
+                RuntimeError("convertToBinaryChunks: a new sequence started before the previous one on the same parallel sequence ended");
+
+            size_t tBegin = (size_t) max(seq.tBegin, (ptrdiff_t) 0);
+            size_t tEnd = min(seq.tEnd, numTimeSteps);
+            for (size_t t = tBegin; t < tEnd; t++)
+            {
+                size_t column = t * numParallelSequences + seq.s;
+                for (size_t i = 0; i < streamNames.size(); i++)
+                {
+                    const ElemType* frame = columns[i].data() + column * dimensions[i];
+                    pending[seq.s][i].insert(pending[seq.s][i].end(), frame, frame + dimensions[i]);
+                }
+            }
+            pendingSamples[seq.s] += tEnd - tBegin;
+
+            if (seq.tEnd <= numTimeSteps) // the sequence ends in this minibatch
+            {
+                writer.AddSequence(pendingSamples[seq.s], pending[seq.s]);
+                for (auto& stream : pending[seq.s])
+                    stream.clear();
+                pendingSamples[seq.s] = 0;
+            }
+        }
+
+        if (traceLevel > 1)
+            fprintf(stderr, "."); // progress meter
+    }
+    writer.Close();
+
+    auto end = std::chrono::system_clock::now();
+    fprintf(stderr, "\nconvertToBinaryChunks: wrote %d sequences in %d chunks in %.3f seconds\n",
+            (int) writer.GetNumberOfSequences(), (int) writer.GetNumberOfChunks(),
+            (float) (std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000);
+}
+
+template void DoConvertToBinaryChunks<float>(const ConfigParameters& config);
+template void DoConvertToBinaryChunks<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoConvertImageRecords() - implements CNTK "convertImageRecords" command
+// ===========================================================================
+
+// Writes the images of the map file of an ImageReader, decoded and scaled down so that their shorter side is 'shorterSide',
+// to an image record file (see ImageRecordFormat.h) at 'outputPath', for the ImageReader to read instead (recordFile=...).
+// The images are stored as 'encoding' = raw (uint8 values) or re-encoded as jpg ('quality') or png, in chunks of about
+// 'chunkSizeInBytes' for the randomizer. The conversion needs the image decoder, so the reader plugin does it.
+typedef void (*ConvertImageRecordsProc)(const ConfigParameters& config);
+
+template <typename ElemType>
+void DoConvertImageRecords(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    Plugin plugin;
+    auto convert = (ConvertImageRecordsProc) plugin.Load(readerConfig(L"readerType", L"ImageReader"), "ConvertImageRecords");
+    auto start = std::chrono::system_clock::now();
+    convert(config);
+    auto end = std::chrono::system_clock::now();
+    fprintf(stderr, "convertImageRecords: done in %.3f seconds\n",
+            (float) (std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000);
+}
+
+template void DoConvertImageRecords<float>(const ConfigParameters& config);
+template void DoConvertImageRecords<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoReaderBenchmark() - implements CNTK "readerBenchmark" command
+// ===========================================================================
+
+// Drains the configured reader for 'numEpochs' epochs without a network, to tell whether the reader keeps up with
+// the training: samples, sequences and bytes delivered per second, the latency of GetMinibatch(), and the counters
+// of the reader pipeline (IDataReader::GetStatistics(): time per stage, e.g. deserialize and each transform, and memory).
+// The inputs are the feature and label sections of the reader config (those with 'width' for images), or 'inputs';
+// those in 'sparseInputs' are read into sparse matrices. The matrices are on 'deviceId', so the copy to the GPU is included.
+template <typename ElemType>
+void DoReaderBenchmark(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    readerConfig.Insert("traceLevel", config(L"traceLevel", "0"));
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    size_t minibatchSize = config(L"minibatchSize", "256");
+    size_t epochSize = config(L"epochSize", "0");
+    if (epochSize == 0)
+        epochSize = requestDataSize;
+    size_t numEpochs = config(L"numEpochs", "1");
+    int traceLevel = config(L"traceLevel", "0");
+
+    vector<wstring> streamNames;
+    ConfigArray inputs = config(L"inputs", "");
+    for (int i = 0; i < inputs.size(); i++)
+        streamNames.push_back(inputs[i]);
+    if (streamNames.empty())
+    {
+        vector<wstring> labelNames, imageNames;
+        GetFileConfigNames(readerConfig, streamNames, labelNames);
+        FindConfigNames(readerConfig, "width", imageNames);
+        streamNames.insert(streamNames.end(), labelNames.begin(), labelNames.end());
+        for (const auto& name : imageNames)
+        {
+            if (find(streamNames.begin(), streamNames.end(), name) == streamNames.end())
+                streamNames.push_back(name);
+        }
+    }
+    if (streamNames.empty())
+        RuntimeError("readerBenchmark: the reader does not define any inputs; specify them as 'inputs'");
+    set<wstring> sparseInputs;
+    ConfigArray sparseInputsConfig = config(L"sparseInputs", "");
+    for (int i = 0; i < sparseInputsConfig.size(); i++)
+        sparseInputs.insert(sparseInputsConfig[i]);
+
+    vector<shared_ptr<Matrix<ElemType>>> streamMatrices;
+    std::map<std::wstring, Matrix<ElemType>*> matrices;
+    for (const auto& name : streamNames)
+    {
+        if (sparseInputs.find(name) != sparseInputs.end())
+            streamMatrices.push_back(make_shared<Matrix<ElemType>>(0, 0, deviceId, MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC));
+        else
+            streamMatrices.push_back(make_shared<Matrix<ElemType>>(deviceId));
+        matrices[name] = streamMatrices.back().get();
+    }
+
+    DataReader<ElemType> dataReader(readerConfig);
+    auto pMBLayout = make_shared<MBLayout>();
+    for (size_t epoch = 0; epoch < numEpochs; epoch++)
+    {
+        size_t numMinibatches = 0, numSamples = 0, numSequences = 0;
+        double bytes = 0, maxLatency = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        dataReader.StartMinibatchLoop(minibatchSize, epoch, epochSize);
+        for (;;)
+        {
+            auto begin = std::chrono::high_resolution_clock::now();
+            if (!dataReader.GetMinibatch(matrices))
+                break;
+            maxLatency = max(maxLatency, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count());
+
+            dataReader.CopyMBLayoutTo(pMBLayout);
+            numMinibatches++;
+            numSamples += pMBLayout->GetActualNumSamples();
+            for (const auto& seq : pMBLayout->GetAllSequences())
+            {
+                if (seq.seqId != GAP_SEQUENCE_ID && seq.tBegin >= 0) // count each sequence in the minibatch where it starts
+                    numSequences++;
+            }
+            for (const auto& matrix : streamMatrices)
+            {
+                if (matrix->GetMatrixType() == MatrixType::SPARSE)
+                    bytes += (double) matrix->NzCount() * (sizeof(ElemType) + sizeof(CPUSPARSE_INDEX_TYPE)) + (matrix->GetNumCols() + 1) * sizeof(CPUSPARSE_INDEX_TYPE);
+                else
+                    bytes += (double) matrix->GetNumElements() * sizeof(ElemType);
+            }
+            if (traceLevel > 1 && numMinibatches % 100 == 0)
+                fprintf(stderr, "."); // progress meter
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if (numMinibatches == 0 || seconds <= 0)
+            RuntimeError("readerBenchmark: epoch %d: the reader did not deliver any data", (int) epoch + 1);
+
+        fprintf(stderr, "\nreaderBenchmark: epoch %d: %d minibatches, %d samples, %d sequences, %.1f MB in %.3f seconds\n",
+                (int) epoch + 1, (int) numMinibatches, (int) numSamples, (int) numSequences, bytes / 1e6, seconds);
+        fprintf(stderr, "readerBenchmark: %.1f samples/s, %.1f sequences/s, %.1f MB/s, %.1f minibatches/s; GetMinibatch() latency %.3f ms mean, %.3f ms max\n",
+                numSamples / seconds, numSequences / seconds, bytes / 1e6 / seconds, numMinibatches / seconds,
+                1e3 * seconds / numMinibatches, 1e3 * maxLatency);
+    }
+
+    // the pipeline counters, accumulated over all epochs
+    std::map<std::string, double> stats;
+    dataReader.GetStatistics(stats);
+    if (stats.empty())
+        fprintf(stderr, "readerBenchmark: the reader provides no statistics\n");
+    for (const auto& stat : stats)
+    {
+        const string& key = stat.first;
+        if (key.compare(0, 6, "stage:") == 0 && key.size() > 8 && key.compare(key.size() - 8, 8, ":seconds") == 0)
+        {
+            const string stage = key.substr(6, key.size() - 14);
+            const double calls = stats["stage:" + stage + ":calls"];
+            fprintf(stderr, "readerBenchmark: stage %-20s %10.3f seconds %10.0f calls %10.4f ms/call\n",
+                    stage.c_str(), stat.second, calls, calls > 0 ? 1e3 * stat.second / calls : 0.0);
+        }
+        else if (key.compare(0, 6, "stage:") != 0)
+        {
+            if (key.size() > 5 && key.compare(key.size() - 5, 5, "Bytes") == 0)
+                fprintf(stderr, "readerBenchmark: %-26s %10.1f MB\n", key.c_str(), stat.second / 1e6);
+            else
+                fprintf(stderr, "readerBenchmark: %-26s %10.0f\n", key.c_str(), stat.second);
+        }
+    }
+}
+
+template void DoReaderBenchmark<float>(const ConfigParameters& config);
+template void DoReaderBenchmark<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoParameterSVD() - implements CNTK "SVD" command
 // ===========================================================================
@@ -137,6 +665,12 @@ template void DoCreateLabelMap<double>(const ConfigParameters& config);
 //                  3)  KeepRatio           -- how many percentage of energy we want to keep
 //                  4)  AlignedSize         -- the resultant number of signular values is aligned to e.g., 32 or 64
 //                  5)  ParameterName       -- name (regex) of the parameter node we want to perform a SVD decomposition
+//          and optionally:
+//                  6)  SVDMethod           -- "full" (default): LAPACK SVD; "randomized": truncated SVD whose matrix products
+//                                             run on SVDDeviceId (KeepRatio then refers to the sum of squared singular values)
+//                  7)  SVDDeviceId         -- device for the randomized SVD, default -1 (CPU)
+//                  8)  SVDThreads          -- number of parameters decomposed concurrently, default 0 (one per core)
+//                  9)  PowerIterations, Oversampling -- of the randomized SVD, default 2 and 10
 //
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -197,10 +731,21 @@ void DoParameterSVD(const ConfigParameters& config)
         return;
     }
 
+    ComputationNetwork::ParameterSVDOptions options;
+    wstring svdMethod = config(L"SVDMethod", L"full");
+    if (svdMethod == L"randomized")
+        options.m_randomized = true;
+    else if (svdMethod != L"full")
+        InvalidArgument("DoParameterSVD: Invalid SVDMethod '%ls'. Must be 'full' or 'randomized'.", svdMethod.c_str());
+    options.m_deviceId = config(L"SVDDeviceId", (int) CPUDEVICE);
+    options.m_numThreads = config(L"SVDThreads", (size_t) 0);
+    options.m_numPowerIterations = config(L"PowerIterations", (size_t) 2);
+    options.m_oversampling = config(L"Oversampling", (size_t) 10);
+
     ComputationNetwork net(deviceID);
     net.Load<ElemType>(modelPath);
 
-    net.PerformSVDecomposition<ElemType>(svdconfig, AlignedSize);
+    net.PerformSVDecomposition<ElemType>(svdconfig, AlignedSize, options);
     if (!outputmodelPath.empty())
         net.Save(outputmodelPath);
 }
@@ -208,6 +753,52 @@ void DoParameterSVD(const ConfigParameters& config)
 template void DoParameterSVD<float>(const ConfigParameters& config);
 template void DoParameterSVD<double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoPruneWeights() - implements CNTK "prune" command
+// ===========================================================================
+
+//////////////////////////////////////////////////////////////////////////
+//  for action prune
+//      An action "prune" sets the smallest weights of an existing model to zero, for serving:
+//          1.  Each Learnable Parameter matrix whose name matches with the user specified regex, and which is the
+//              left operand of a Times, is divided into blocks of consecutive rows of a column; the blocks of
+//              the smallest L2 norm are zeroed until the target sparsity is reached;
+//          2.  Its Times nodes are replaced by SparseWeightTimes nodes, which multiply with the weights in
+//              sparse format (and do not train them).
+//
+//      To use this command,
+//          user need to specify:
+//                  1)  modelPath           -- path to the existing model
+//                  2)  outputmodelPath     -- where to write the pruned model
+//                  3)  sparsity            -- the fraction of weights to be zero, e.g. 0.9
+//                  4)  blockSize           -- rows per block; 1 for plain magnitude pruning, 4 or 8 for SIMD-friendly blocks
+//                  5)  NodeNameRegex       -- name (regex) of the parameter nodes to prune; empty for all
+//
+//////////////////////////////////////////////////////////////////////////
+template <typename ElemType>
+void DoPruneWeights(const ConfigParameters& config)
+{
+    DEVICEID_TYPE deviceID = -1; // use CPU for pruning
+    wstring modelPath = config(L"modelPath");
+    wstring outputmodelPath = config(L"outputmodelPath");
+    double sparsity = config(L"sparsity", "0.9");
+    size_t blockSize = config(L"blockSize", "1");
+    wstring nodeNameRegex = config(L"NodeNameRegex", L"");
+
+    if (modelPath.empty())
+        InvalidArgument("DoPruneWeights: modelPath is empty.");
+
+    ComputationNetwork net(deviceID);
+    net.Load<ElemType>(modelPath);
+
+    net.PruneWeights<ElemType>(nodeNameRegex, sparsity, blockSize);
+    if (!outputmodelPath.empty())
+        net.Save(outputmodelPath);
+}
+
+template void DoPruneWeights<float>(const ConfigParameters& config);
+template void DoPruneWeights<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoWriteWordAndClassInfo() - implements CNTK "writeWordAndClass" command
 // ===========================================================================
@@ -69,7 +69,40 @@ void DoExportToDbn(const ConfigParameters& config)
     net->SaveToDbnFile<ElemType>(net, dbnModelPath);
 }
 
+// ===========================================================================
+// DoExportForInference() - implements CNTK "exportInference" command
+// ===========================================================================
+
+// writes a model's forward computation in the format of the inference runtime (see InferenceRuntime.h)
+template <typename ElemType>
+void DoExportForInference(const ConfigParameters& config)
+{
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+
+    const wstring modelPath = config(L"modelPath");
+    const wstring inferenceModelPath = config(L"inferenceModelPath");
+    ConfigArray outputNodeNames = config(L"outputNodeNames", "");
+
+    auto net = make_shared<ComputationNetwork>(deviceId);
+    net->Read<ElemType>(modelPath);
+    if (outputNodeNames.size() > 0)
+    {
+        net->OutputNodes().clear();
+        for (int i = 0; i < outputNodeNames.size(); ++i)
+            net->OutputNodes().emplace_back(net->GetNodeFromName(outputNodeNames[i]));
+    }
+    net->CompileNetwork();
+
+    // fold normalizations into weights and bypass Dropout, so that fewer operations are exported
+    if (config(L"optimizeForInference", true))
+        net->OptimizeForInference<ElemType>();
+
+    net->ExportForInference<ElemType>(inferenceModelPath, vector<ComputationNodeBasePtr>());
+}
+
 template void DoConvertFromDbn<float>(const ConfigParameters& config);
 template void DoConvertFromDbn<double>(const ConfigParameters& config);
 template void DoExportToDbn<float>(const ConfigParameters& config);
 template void DoExportToDbn<double>(const ConfigParameters& config);
+template void DoExportForInference<float>(const ConfigParameters& config);
+template void DoExportForInference<double>(const ConfigParameters& config);
@@ -0,0 +1,270 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// SyntheticDataReader.cpp -- an in-memory reader of random data, for measuring training throughput without I/O
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "SyntheticDataReader.h"
+#include "Config.h"
+#include "ScriptableObjects.h"
+#include "MatrixQuantizerImpl.h" // for MatrixComputeStreamEvent
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+SyntheticDataReader<ElemType>::SyntheticDataReader()
+    : m_epochSize(0),
+      m_sequenceLength(0),
+      m_truncated(false),
+      m_numParallelSequences(1),
+      m_numDistinctMinibatches(4),
+      m_warmupMinibatches(0),
+      m_mbSize(0),
+      m_subsetNum(0),
+      m_numSubsets(1),
+      m_epochSamples(0),
+      m_epochSamplesRead(0),
+      m_numMinibatchesRead(0),
+      m_timeStep(0),
+      m_pMBLayout(make_shared<MBLayout>()),
+      m_measuring(false),
+      m_measuredSamples(0),
+      m_measuredSeconds(0)
+{
+}
+
+template <class ElemType>
+template <class ConfigRecordType>
+void SyntheticDataReader<ElemType>::InitFromConfig(const ConfigRecordType& config)
+{
+    m_epochSize = config(L"epochSize", (size_t) 1000000);
+    m_sequenceLength = config(L"sequenceLength", (size_t) 0);
+    m_truncated = config(L"truncated", false);
+    m_numParallelSequences = config(L"numParallelSequences", (size_t) 1);
+    size_t numDistinctMinibatches = config(L"numDistinctMinibatches", (size_t) 4);
+    m_numDistinctMinibatches = max(numDistinctMinibatches, (size_t) 1);
+    m_warmupMinibatches = config(L"warmupMinibatches", (size_t) 10);
+    size_t randomSeed = config(L"randomSeed", (size_t) 1);
+    m_randomGenerator.seed((unsigned long) randomSeed);
+    if (m_truncated && (m_sequenceLength == 0))
+        InvalidArgument("SyntheticDataReader: In truncated mode, 'sequenceLength' must be given.");
+    if (m_truncated && (m_numParallelSequences == 0))
+        InvalidArgument("SyntheticDataReader: 'numParallelSequences' must be at least 1.");
+
+    vector<wstring> names;
+    FindConfigNames(config, "dim", names);
+    if (names.empty())
+        InvalidArgument("SyntheticDataReader: No stream; each input needs a section with a 'dim'.");
+    for (const auto& name : names)
+    {
+        const ConfigRecordType& streamConfig = config(name);
+        Stream stream;
+        stream.m_name = name;
+        stream.m_dim = streamConfig(L"dim");
+        wstring kind = streamConfig(L"type", L"dense");
+        if (EqualCI(kind, L"dense"))
+            stream.m_kind = StreamKind::dense;
+        else if (EqualCI(kind, L"oneHot"))
+            stream.m_kind = StreamKind::oneHot;
+        else if (EqualCI(kind, L"sparse"))
+            stream.m_kind = StreamKind::sparse;
+        else
+            InvalidArgument("SyntheticDataReader: Invalid type '%ls' of stream '%ls'; must be 'dense', 'oneHot' or 'sparse'.", kind.c_str(), name.c_str());
+        size_t nnz = streamConfig(L"nnz", (size_t) 1);
+        stream.m_nnz = stream.m_kind == StreamKind::sparse ? nnz : 1;
+        if ((stream.m_dim == 0) || (stream.m_nnz == 0) || (stream.m_nnz > stream.m_dim))
+            InvalidArgument("SyntheticDataReader: Stream '%ls' must have 0 < nnz <= dim.", name.c_str());
+        stream.m_numCols = 0;
+        stream.m_isSparse = false;
+        m_streams.push_back(stream);
+    }
+
+    InitLayout();
+}
+
+template <class ElemType>
+typename SyntheticDataReader<ElemType>::Stream* SyntheticDataReader<ElemType>::FindStream(const wstring& name)
+{
+    for (auto& stream : m_streams)
+    {
+        if (stream.m_name == name)
+            return &stream;
+    }
+    return nullptr;
+}
+
+// -----------------------------------------------------------------------
+// minibatch loop
+// -----------------------------------------------------------------------
+
+// this worker's share of 'n' frames or sequences
+static size_t ShareOf(size_t n, size_t subsetNum, size_t numSubsets)
+{
+    return max(n / numSubsets + (subsetNum < n % numSubsets ? 1 : 0), (size_t) 1);
+}
+
+template <class ElemType>
+void SyntheticDataReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_t /*epoch*/, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
+{
+    m_mbSize = mbSize;
+    m_subsetNum = subsetNum;
+    m_numSubsets = numSubsets;
+    m_epochSamples = requestedEpochSamples == requestDataSize ? m_epochSize : requestedEpochSamples;
+    m_epochSamplesRead = 0;
+    InitLayout();
+}
+
+// sets up the MBLayout of the minibatches of this loop; in truncated mode, it is updated for each minibatch
+template <class ElemType>
+void SyntheticDataReader<ElemType>::InitLayout()
+{
+    const size_t mbSize = max(m_mbSize, (size_t) 1);
+    if (m_truncated)
+    {
+        m_pMBLayout->Init(ShareOf(m_numParallelSequences, m_subsetNum, m_numSubsets), mbSize);
+    }
+    else if (m_sequenceLength > 0)
+    {
+        const size_t numSequences = ShareOf(max(mbSize / m_sequenceLength, (size_t) 1), m_subsetNum, m_numSubsets);
+        m_pMBLayout->Init(numSequences, m_sequenceLength);
+        for (size_t s = 0; s < numSequences; s++)
+            m_pMBLayout->AddSequence(NEW_SEQUENCE_ID, s, 0, m_sequenceLength);
+    }
+    else
+    {
+        m_pMBLayout->InitAsFrameMode(ShareOf(mbSize, m_subsetNum, m_numSubsets));
+    }
+}
+
+template <class ElemType>
+void SyntheticDataReader<ElemType>::SynchronizeDevice(DEVICEID_TYPE deviceId)
+{
+    if (deviceId >= 0)
+    {
+        unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+        mainStreamSyncEvent->SynchronizeEvent();
+    }
+}
+
+template <class ElemType>
+bool SyntheticDataReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    const DEVICEID_TYPE deviceId = matrices.empty() ? CPUDEVICE : (DEVICEID_TYPE) matrices.begin()->second->GetDeviceId();
+
+    // The training has processed all minibatches handed out so far once it asks for the next one.
+    if (DataEnd())
+    {
+        if (m_measuring)
+        {
+            SynchronizeDevice(deviceId);
+            m_timer.Stop();
+            m_measuredSeconds += m_timer.ElapsedSeconds();
+            m_measuring = false;
+        }
+        return false;
+    }
+    if (!m_measuring && (m_numMinibatchesRead >= m_warmupMinibatches))
+    {
+        SynchronizeDevice(deviceId);
+        m_timer.Restart();
+        m_measuring = true;
+    }
+
+    // in truncated mode, each parallel sequence continues where it left off, and the sequences start at staggered times
+    if (m_truncated)
+    {
+        const size_t numParallelSequences = m_pMBLayout->GetNumParallelSequences();
+        const size_t numTimeSteps = m_pMBLayout->GetNumTimeSteps();
+        m_pMBLayout->Init(numParallelSequences, numTimeSteps);
+        for (size_t s = 0; s < numParallelSequences; s++)
+        {
+            const size_t phase = (m_timeStep + s * m_sequenceLength / numParallelSequences) % m_sequenceLength;
+            for (ptrdiff_t begin = -(ptrdiff_t) phase; begin < (ptrdiff_t) numTimeSteps; begin += m_sequenceLength)
+                m_pMBLayout->AddSequence(NEW_SEQUENCE_ID, s, begin, begin + m_sequenceLength);
+        }
+        m_timeStep += numTimeSteps;
+    }
+
+    const size_t numCols = m_pMBLayout->GetNumCols();
+    const size_t k = m_numMinibatchesRead % m_numDistinctMinibatches;
+    for (auto& iter : matrices)
+    {
+        Stream* stream = FindStream(iter.first);
+        if (!stream)
+            InvalidArgument("SyntheticDataReader: No stream for input '%ls'.", iter.first.c_str());
+        Matrix<ElemType>& matrix = *iter.second;
+        const bool isSparse = matrix.GetMatrixType() == MatrixType::SPARSE;
+        if ((stream->m_numCols != numCols) || (stream->m_isSparse != isSparse))
+            Generate(*stream, numCols, isSparse);
+        if (isSparse)
+            matrix.SetMatrixFromCSCFormat(stream->m_colStarts[k].data(), stream->m_rowIndices[k].data(), stream->m_values[k].data(),
+                                          stream->m_values[k].size(), stream->m_dim, numCols);
+        else
+            matrix.SetValue(stream->m_dim, numCols, matrix.GetDeviceId(), stream->m_values[k].data(), matrixFlagNormal);
+    }
+
+    // all workers together read the full minibatch
+    const size_t numSamples = m_pMBLayout->GetActualNumSamples();
+    m_epochSamplesRead += m_truncated ? m_numParallelSequences * m_pMBLayout->GetNumTimeSteps() :
+                          m_sequenceLength > 0 ? max(m_mbSize / m_sequenceLength, (size_t) 1) * m_sequenceLength : max(m_mbSize, (size_t) 1);
+    m_numMinibatchesRead++;
+    if (m_measuring)
+        m_measuredSamples += numSamples;
+    return true;
+}
+
+// generates the distinct minibatches of a stream; kept until the number of columns or the format changes
+template <class ElemType>
+void SyntheticDataReader<ElemType>::Generate(Stream& stream, size_t numCols, bool isSparse)
+{
+    stream.m_numCols = numCols;
+    stream.m_isSparse = isSparse;
+    stream.m_values.assign(m_numDistinctMinibatches, vector<ElemType>());
+    stream.m_rowIndices.assign(m_numDistinctMinibatches, vector<CPUSPARSE_INDEX_TYPE>());
+    stream.m_colStarts.assign(m_numDistinctMinibatches, vector<CPUSPARSE_INDEX_TYPE>());
+
+    // the non-zero rows of a sample: one in each of 'nnz' equal bands, hence distinct and ascending
+    const size_t nnz = stream.m_kind == StreamKind::dense ? stream.m_dim : stream.m_nnz;
+    const size_t band = stream.m_dim / nnz;
+    uniform_real_distribution<double> value(-1, 1);
+    for (size_t k = 0; k < m_numDistinctMinibatches; k++)
+    {
+        auto& values = stream.m_values[k];
+        auto& rowIndices = stream.m_rowIndices[k];
+        auto& colStarts = stream.m_colStarts[k];
+        if (!isSparse)
+            values.assign(stream.m_dim * numCols, 0);
+        for (size_t j = 0; j < numCols; j++)
+        {
+            if (isSparse)
+                colStarts.push_back((CPUSPARSE_INDEX_TYPE) rowIndices.size());
+            for (size_t i = 0; i < nnz; i++)
+            {
+                const size_t row = band == 1 ? i : i * band + m_randomGenerator() % band;
+                const ElemType v = stream.m_kind == StreamKind::dense ? (ElemType) value(m_randomGenerator) : 1;
+                if (isSparse)
+                {
+                    rowIndices.push_back((CPUSPARSE_INDEX_TYPE) row);
+                    values.push_back(v);
+                }
+                else
+                    values[j * stream.m_dim + row] = v;
+            }
+        }
+        if (isSparse)
+            colStarts.push_back((CPUSPARSE_INDEX_TYPE) rowIndices.size());
+    }
+}
+
+template class SyntheticDataReader<float>;
+template class SyntheticDataReader<double>;
+} } }
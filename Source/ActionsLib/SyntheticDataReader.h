@@ -0,0 +1,155 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// SyntheticDataReader.h -- an in-memory reader of random data, for measuring training throughput without I/O
+//
+// Every subsection of the reader config that has a 'dim' is a stream, which feeds the input node of that name:
+//
+//     reader = [
+//         epochSize = 1000000              # used if SGD does not specify one
+//         sequenceLength = 0               # 0: frame mode; else all sequences have this length
+//         truncated = false                # true: 'numParallelSequences' endless streams, minibatchSize time steps each (truncated BPTT)
+//         numParallelSequences = 32        # only if truncated
+//         warmupMinibatches = 10           # excluded from the measurement
+//         features = [ dim = 363 ]                          # dense, uniform in [-1, 1]
+//         labels   = [ dim = 9304 ; type = "oneHot" ]       # one 1 per sample, e.g. class labels or word input
+//         words    = [ dim = 50000 ; type = "sparse" ; nnz = 20 ]  # 'nnz' random ones per sample, e.g. bag of words
+//     ]
+//
+// A stream is written in sparse (CSC) format into a sparse input matrix, and in dense format otherwise.
+// The data of a few distinct minibatches is generated when it is first requested and then cycled, so that producing
+// a minibatch costs no more than copying it into the input matrix (and to the GPU).
+// Distributed reading is supported: each worker gets its share of the frames resp. parallel sequences of each minibatch.
+//
+// The reader measures the throughput of the training that pulls from it: the time from the first GetMinibatch() after
+// the warm-up to the GetMinibatch() that ends the epoch, over all epochs, with the GPU synchronized at both ends.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "DataReader.h"
+#include "TimerUtility.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class SyntheticDataReader : public IDataReader<ElemType>
+{
+public:
+    SyntheticDataReader();
+
+    template <class ConfigRecordType>
+    void InitFromConfig(const ConfigRecordType& config);
+    virtual void Init(const ConfigParameters& config) override
+    {
+        InitFromConfig(config);
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord& config) override
+    {
+        InitFromConfig(config);
+    }
+    virtual void Destroy() override
+    {
+        delete this;
+    }
+
+    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override
+    {
+        StartDistributedMinibatchLoop(mbSize, epoch, 0, 1, requestedEpochSamples);
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return true;
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override;
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override;
+    virtual bool DataEnd() override
+    {
+        return m_epochSamplesRead >= m_epochSamples;
+    }
+
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_pMBLayout->GetNumParallelSequences();
+    }
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        pMBLayout->CopyFrom(m_pMBLayout);
+    }
+    virtual bool CanReadFor(wstring nodeName) override
+    {
+        return FindStream(nodeName) != nullptr;
+    }
+
+    // the measurement, of this worker only
+    size_t GetMeasuredSamples() const
+    {
+        return m_measuredSamples;
+    }
+    double GetMeasuredSeconds() const
+    {
+        return m_measuredSeconds;
+    }
+
+protected:
+    virtual ~SyntheticDataReader() { }
+
+private:
+    enum class StreamKind
+    {
+        dense,
+        oneHot,
+        sparse
+    };
+
+    struct Stream
+    {
+        std::wstring m_name;
+        size_t m_dim;
+        StreamKind m_kind;
+        size_t m_nnz; // per sample, for 'sparse'
+
+        // the distinct minibatches, generated for m_numCols columns in either format
+        size_t m_numCols;
+        bool m_isSparse;
+        std::vector<std::vector<ElemType>> m_values; // [minibatch] dense values, or the values of the non-zero elements
+        std::vector<std::vector<CPUSPARSE_INDEX_TYPE>> m_rowIndices;
+        std::vector<std::vector<CPUSPARSE_INDEX_TYPE>> m_colStarts;
+    };
+
+    Stream* FindStream(const std::wstring& name);
+    void Generate(Stream& stream, size_t numCols, bool isSparse);
+    void InitLayout();
+    void SynchronizeDevice(DEVICEID_TYPE deviceId);
+
+    std::vector<Stream> m_streams;
+    size_t m_epochSize;
+    size_t m_sequenceLength;
+    bool m_truncated;
+    size_t m_numParallelSequences; // in total; this worker gets its share
+    size_t m_numDistinctMinibatches;
+    size_t m_warmupMinibatches;
+    std::mt19937 m_randomGenerator;
+
+    // the current minibatch loop
+    size_t m_mbSize;
+    size_t m_subsetNum;
+    size_t m_numSubsets;
+    size_t m_epochSamples;
+    size_t m_epochSamplesRead; // by all workers
+    size_t m_numMinibatchesRead; // since Init(), for the warm-up and for cycling through the distinct minibatches
+    size_t m_timeStep;           // in truncated mode, of the first frame of the minibatch on each stream
+    MBLayoutPtr m_pMBLayout;
+
+    // the measurement
+    Timer m_timer;
+    bool m_measuring;
+    size_t m_measuredSamples;
+    double m_measuredSeconds;
+};
+} } }
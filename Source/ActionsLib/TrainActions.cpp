@@ -19,6 +19,9 @@
 #include "SynchronousExecutionEngine.h"
 #include "ModelEditLanguage.h"
 #include "SGD.h"
+#include "MPIWrapper.h"
+#include "fileutil.h"
+#include "SyntheticDataReader.h"
 #include "Config.h"
 #include "SimpleEvaluator.h"
 #include "SimpleOutputWriter.h"
@@ -93,16 +96,142 @@ shared_ptr<C> CreateObject(const ConfigParameters& config, const wchar_t* id)
     return make_shared<C>(readerConfig);                           // old CNTK config specifies a dictionary which then must be explicitly instantiated
 }
 
+// ---------------------------------------------------------------------------
+// network cache -- networks built from a description are kept in 'networkCacheDir', so that later runs with the same
+// description load them instead of running the network builder
+// ---------------------------------------------------------------------------
+
+// The key of a cache entry is the network description as text: the builder section of the config, the NDL files it
+// refers to, the precision, and the model-format version. The input dimensions are part of the description. A cached
+// network has the initial parameter values of the run that built it, which are those of any run, since the random
+// initialization follows from the description. Files included by BrainScript code are not part of the key, nor are
+// networks from a BrainScript 'createNetwork' lambda, which are not cached.
+
+static void AppendConfigValueKey(const ScriptableObjects::ConfigValuePtr& value, std::wstring& key);
+
+static std::wstring BuilderConfigKey(const ConfigParameters& config, const wchar_t* id)
+{
+    const std::string& text = config(id); // the unparsed text of the section
+    return msra::strfun::utf16(text);
+}
+
+static std::wstring BuilderConfigKey(const ScriptableObjects::IConfigRecord& config, const wchar_t* id)
+{
+    std::wstring key;
+    AppendConfigValueKey(config[id], key);
+    return key;
+}
+
+static void AppendFileContentsKey(const std::wstring& path, std::wstring& key)
+{
+    FILE* f = fopenOrDie(path, L"rb");
+    std::string contents;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        contents.append(buffer, n);
+    fcloseOrDie(f);
+    key += L"\n" + path + L"=" + msra::strfun::utf16(contents);
+}
+
+// returns an empty key if the network of this config cannot be cached
 template <class ConfigRecordType, typename ElemType>
-void DoTrain(const ConfigRecordType& config)
+static std::wstring NetworkDescriptionKey(const ConfigRecordType& config)
 {
-    bool makeMode = config(L"makeMode", true);
-    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    if (config.Exists(L"createNetwork"))
+        return std::wstring();
 
-    // determine the network-creation function
-    // We have several ways to create that network.
+    std::wstring key = msra::strfun::wstrprintf(L"modelVersion=%d\nprecision=%ls\n", (int) CURRENT_CNTK_MODEL_VERSION, ElemTypeName<ElemType>());
+    for (const wchar_t* id : {L"SimpleNetworkBuilder", L"NDLNetworkBuilder", L"BrainScriptNetworkBuilder", L"ExperimentalNetworkBuilder"})
+    {
+        if (!config.Exists(id))
+            continue;
+        key += std::wstring(id) + L"=" + BuilderConfigKey(config, id);
+        if (std::wstring(id) == L"NDLNetworkBuilder")
+        {
+            const ConfigRecordType& ndlNetworkBuilderConfig(config(L"NDLNetworkBuilder"));
+            std::wstring networkDescription = ndlNetworkBuilderConfig(L"networkDescription", L"");
+            std::wstring ndlMacros = ndlNetworkBuilderConfig(L"ndlMacros", L"");
+            if (!networkDescription.empty())
+                AppendFileContentsKey(networkDescription, key);
+            for (const auto& path : msra::strfun::split(ndlMacros, L"+"))
+                AppendFileContentsKey(path, key);
+        }
+        return key;
+    }
+    return std::wstring();
+}
+
+static std::wstring NetworkCacheEntryPath(const std::wstring& networkCacheDir, const std::wstring& key)
+{
+    // 64-bit FNV-1a of the key names the entry; the key itself is stored next to the model, to rule out collisions
+    unsigned long long hash = 14695981039346656037ull;
+    for (wchar_t c : key)
+        hash = (hash ^ (unsigned long long) c) * 1099511628211ull;
+    return msra::strfun::wstrprintf(L"%ls/%016llx", networkCacheDir.c_str(), hash);
+}
+
+static bool NetworkCacheEntryMatches(const std::wstring& entryPath, const std::wstring& key)
+{
+    if (!fexists(entryPath + L".key") || !fexists(entryPath + L".net"))
+        return false;
+    File fstream(entryPath + L".key", FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    std::wstring cachedKey;
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BNetworkCache");
+    fstream >> cachedKey;
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ENetworkCache");
+    return cachedKey == key;
+}
+
+// saves the network and then its key, so that an entry whose key exists is complete
+static void SaveNetworkCacheEntry(const ComputationNetworkPtr& net, const std::wstring& entryPath, const std::wstring& key)
+{
+    if ((g_mpi != nullptr) && !g_mpi->IsMainNode())
+        return;
+    File::MakeIntermediateDirs(entryPath + L".net");
+    net->Save(entryPath + L".net");
+    {
+        File fstream(entryPath + L".key.tmp", FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BNetworkCache");
+        fstream << key;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ENetworkCache");
+        fstream.Flush();
+    }
+    renameOrDie(entryPath + L".key.tmp", entryPath + L".key");
+    fprintf(stderr, "Saved the network to the network cache as %ls.net.\n", entryPath.c_str());
+}
+
+// determine the network-creation function of a training config
+// We have several ways to create that network.
+// With 'networkCacheDir', a network that was built from the same description before is loaded from there instead.
+template <class ConfigRecordType, typename ElemType>
+static function<ComputationNetworkPtr(DEVICEID_TYPE)> GetNetworkFactory(const ConfigRecordType& config, DEVICEID_TYPE deviceId)
+{
     function<ComputationNetworkPtr(DEVICEID_TYPE)> createNetworkFn;
 
+    // (checked before a builder is created, since creating one already parses the description)
+    std::wstring networkCacheDir = config(L"networkCacheDir", L"");
+    std::wstring cacheKey;
+    std::wstring cacheEntryPath;
+    if (!networkCacheDir.empty())
+    {
+        cacheKey = NetworkDescriptionKey<ConfigRecordType, ElemType>(config);
+        if (cacheKey.empty())
+            fprintf(stderr, "networkCacheDir: Networks from a 'createNetwork' lambda are not cached.\n");
+        else
+        {
+            cacheEntryPath = NetworkCacheEntryPath(networkCacheDir, cacheKey);
+            if (NetworkCacheEntryMatches(cacheEntryPath, cacheKey))
+            {
+                fprintf(stderr, "Found the network in the network cache as %ls.net.\n", cacheEntryPath.c_str());
+                return [cacheEntryPath](DEVICEID_TYPE deviceId)
+                {
+                    return ComputationNetwork::CreateFromFile<ElemType>(deviceId, cacheEntryPath + L".net");
+                };
+            }
+        }
+    }
+
     if (config.Exists(L"createNetwork"))
     {
         createNetworkFn = GetCreateNetworkFn(config); // (we need a separate function needed due to template code)
@@ -155,6 +284,83 @@ void DoTrain(const ConfigRecordType& config)
         RuntimeError("No network builder found in the config file. NDLNetworkBuilder or SimpleNetworkBuilde must be specified");
     }
 
+    if (!cacheEntryPath.empty())
+    {
+        auto buildNetworkFn = createNetworkFn;
+        createNetworkFn = [buildNetworkFn, cacheEntryPath, cacheKey](DEVICEID_TYPE deviceId)
+        {
+            auto net = buildNetworkFn(deviceId);
+            SaveNetworkCacheEntry(net, cacheEntryPath, cacheKey);
+            return net;
+        };
+    }
+    return createNetworkFn;
+}
+
+// ---------------------------------------------------------------------------
+// ReaderConfigKey() -- the reader configuration as text, which identifies the training data for SGD's PreCompute cache
+// ---------------------------------------------------------------------------
+
+static std::wstring ReaderConfigKey(const ConfigParameters& config)
+{
+    const std::string& readerConfig = config(L"reader"); // the unparsed text of the section
+    return msra::strfun::utf16(readerConfig);
+}
+
+static void AppendConfigValueKey(const ScriptableObjects::ConfigValuePtr& value, std::wstring& key)
+{
+    using namespace ScriptableObjects;
+    if (value.Is<String>())
+        key += L"\"" + (const std::wstring&) value + L"\"";
+    else if (value.Is<Double>())
+        key += msra::strfun::wstrprintf(L"%.17g", (double) value);
+    else if (value.Is<Bool>())
+        key += (bool) value ? L"true" : L"false";
+    else if (value.Is<IConfigRecord>())
+    {
+        const auto& record = value.AsRef<IConfigRecord>();
+        auto ids = record.GetMemberIds();
+        sort(ids.begin(), ids.end());
+        key += L"[";
+        for (const auto& id : ids)
+        {
+            key += id + L"=";
+            AppendConfigValueKey(record[id], key);
+            key += L";";
+        }
+        key += L"]";
+    }
+    else if (value.Is<ScriptableObjects::ConfigArray>())
+    {
+        const auto& array = value.AsRef<ScriptableObjects::ConfigArray>();
+        auto range = array.GetIndexRange();
+        key += L"(";
+        for (int i = range.first; i <= range.second; i++)
+        {
+            AppendConfigValueKey(array.At(i), key);
+            key += L":";
+        }
+        key += L")";
+    }
+    else
+        key += msra::strfun::utf16(value.TypeName()); // e.g. lambdas, not distinguished beyond their type
+}
+
+static std::wstring ReaderConfigKey(const ScriptableObjects::IConfigRecord& config)
+{
+    std::wstring key;
+    AppendConfigValueKey(config[L"reader"], key);
+    return key;
+}
+
+template <class ConfigRecordType, typename ElemType>
+void DoTrain(const ConfigRecordType& config)
+{
+    bool makeMode = config(L"makeMode", true);
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+
+    auto createNetworkFn = GetNetworkFactory<ConfigRecordType, ElemType>(config, deviceId);
+
     auto dataReader = CreateObject<DataReader<ElemType>>(config, L"reader");
 
     shared_ptr<DataReader<ElemType>> cvDataReader;
@@ -172,6 +378,7 @@ void DoTrain(const ConfigRecordType& config)
         optimizer = make_shared<SGD<ElemType>>(configSGD);
     }
 
+    optimizer->SetPreComputeCacheKey(ReaderConfigKey(config));
     optimizer->Train(createNetworkFn, deviceId, dataReader.get(), cvDataReader.get(), makeMode);
 }
 
@@ -210,6 +417,65 @@ template void DoTrain<ScriptableObjects::IConfigRecord, double>(const Scriptable
 template void DoTrain<ConfigParameters, float>(const ConfigParameters& config);
 template void DoTrain<ConfigParameters, double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoTrainBenchmark() - implements CNTK "benchmark" command
+// ===========================================================================
+
+// Trains the network of the config like "train", but from a SyntheticDataReader configured by the 'reader' section,
+// and reports the steady-state training throughput over all workers. See SyntheticDataReader.h for the reader config.
+// Scaling is measured by running the same config under mpiexec with 1..N workers (one GPU each), with the
+// ParallelTrain section of SGD selecting the parallelization (e.g. data-parallel SGD with 1-bit quantization).
+// If 'resultFile' is given, a line "name  precision  workers  samples  seconds  samplesPerSecond" is appended to it.
+template <typename ElemType>
+void DoTrainBenchmark(const ConfigParameters& config)
+{
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    auto createNetworkFn = GetNetworkFactory<ConfigParameters, ElemType>(config, deviceId);
+
+    ConfigParameters readerConfig(config(L"reader"));
+    shared_ptr<SyntheticDataReader<ElemType>> dataReader(new SyntheticDataReader<ElemType>(), [](SyntheticDataReader<ElemType>* p)
+                                                         {
+                                                             p->Destroy();
+                                                         });
+    dataReader->Init(readerConfig);
+
+    const ConfigParameters& configSGD(config(L"SGD"));
+    auto optimizer = make_shared<SGD<ElemType>>(configSGD);
+    optimizer->Train(createNetworkFn, deviceId, dataReader.get(), nullptr, /*makeMode=*/false); // always train from scratch
+
+    // The workers run in lockstep, so the throughput of all is their total number of samples over their mean time.
+    vector<double> measured = {(double) dataReader->GetMeasuredSamples(), dataReader->GetMeasuredSeconds()};
+    size_t numWorkers = 1;
+    if ((g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1))
+    {
+        g_mpi->AllReduce(measured);
+        numWorkers = g_mpi->NumNodesInUse();
+    }
+    const double samples = measured[0];
+    const double seconds = measured[1] / numWorkers;
+    if (seconds <= 0)
+        RuntimeError("DoTrainBenchmark: Nothing was measured; the training must be longer than the reader's 'warmupMinibatches'.");
+    const double samplesPerSecond = samples / seconds;
+
+    if ((g_mpi == nullptr) || g_mpi->IsMainNode())
+    {
+        fprintf(stderr, "\nBenchmark: %.0f samples in %.3f seconds = %.1f samples per second (%d workers, %.1f per worker)\n",
+                samples, seconds, samplesPerSecond, (int) numWorkers, samplesPerSecond / numWorkers);
+        wstring resultFile = config(L"resultFile", L"");
+        if (!resultFile.empty())
+        {
+            string name = config(L"benchmarkName", config.ConfigName().c_str());
+            FILE* f = fopenOrDie(resultFile, L"a");
+            fprintf(f, "%s\t%s\t%d\t%.0f\t%.6g\t%.6g\n", name.c_str(), sizeof(ElemType) == sizeof(float) ? "float" : "double",
+                    (int) numWorkers, samples, seconds, samplesPerSecond);
+            fcloseOrDie(f);
+        }
+    }
+}
+
+template void DoTrainBenchmark<float>(const ConfigParameters& config);
+template void DoTrainBenchmark<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoAdapt() - implements CNTK "adapt" command
 // ===========================================================================
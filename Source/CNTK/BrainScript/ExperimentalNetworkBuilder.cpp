@@ -29,6 +29,10 @@ wstring standardFunctions =
 wstring commonMacros =
     L"BFF(in, rows, cols) = [ B = Parameter(rows, 1, init = 'fixedValue', value = 0) ; W = Parameter(rows, cols) ; z = W*in+B ] \n"
     L"SBFF(in, rows, cols) = [ Eh = Sigmoid(BFF(in, rows, cols).z) ] \n "
+    // recurrent layers on the fused cells; 'h' is the output sequence
+    L"LSTMLayer(in, inDim, outDim, reverse = false) = [ W = Parameter(4*outDim, inDim) ; R = Parameter(4*outDim, outDim) ; b = Parameter(4*outDim, 1, init = 'fixedValue', value = 0) ; P = Parameter(3*outDim, 1, init = 'fixedValue', value = 0) ; h = PeepholeLSTMCell(W, R, b, P, in, reverse = reverse) ] \n"
+    L"LSTMPLayer(in, inDim, cellDim, outDim, reverse = false) = [ W = Parameter(4*cellDim, inDim) ; R = Parameter(4*cellDim, outDim) ; b = Parameter(4*cellDim, 1, init = 'fixedValue', value = 0) ; P = Parameter(3*cellDim, 1, init = 'fixedValue', value = 0) ; Wp = Parameter(outDim, cellDim) ; h = ProjectedLSTMCell(W, R, b, P, Wp, in, reverse = reverse) ] \n"
+    L"GRULayer(in, inDim, outDim, reverse = false) = [ W = Parameter(3*outDim, inDim) ; R = Parameter(3*outDim, outDim) ; b = Parameter(3*outDim, 1, init = 'fixedValue', value = 0) ; h = GRUCell(W, R, b, in, reverse = reverse) ] \n"
     L"MeanVarNorm(feat) = PerDimMeanVarNormalization(feat, Mean(feat), InvStdDev(feat)) \n"
     L"LogPrior(labels) = Log(Mean(labels)) \n";
 
@@ -57,8 +61,11 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     L"SplitDimension(x, dim, N) = ReshapeDimension(x, dim, 0:N) \n"
     L"Logistic(label, probability, tag='') = new ComputationNode [ operation = 'Logistic' ; inputs = (label : probability) /*plus the function args*/ ]\n"
     L"WeightedLogistic(label, probability, instanceWeight, tag='') = new ComputationNode [ operation = 'Logistic' ; inputs = (label : probability : instanceWeight) /*plus the function args*/ ]\n"
+    L"SampledSoftmaxCrossEntropy(labels, input, weights, numSamples = 1024, proposal = 'logUniform', tag='') = new ComputationNode [ operation = 'SampledSoftmaxCrossEntropy' ; inputs = (labels : input : weights) /*plus the function args*/ ]\n"
+    L"DistillationCrossEntropyWithSoftmax(softTargets, z, temperature = 1, tag='') = new ComputationNode [ operation = 'DistillationCrossEntropyWithSoftmax' ; inputs = (softTargets : z) /*plus the function args*/ ]\n"
+    L"NCEBasedCrossEntropyWithSoftmax(labels, input, weights, bias, numNoiseSamples = 100, noiseDistribution = 'logUniform', tag='') = new ComputationNode [ operation = 'NCEBasedCrossEntropyWithSoftmax' ; inputs = (labels : input : weights : bias) /*plus the function args*/ ]\n"
     L"ReconcileMBLayout(dataInput, layoutInput, tag='') = new ComputationNode [ operation = 'ReconcileMBLayout' ; inputs = (dataInput : layoutInput) /*plus the function args*/ ]\n"
-    L"Convolution(weightNode, inputValueNode, kernelWidth, kernelHeight, outputChannels, horizontalSubsample, verticalSubsample, zeroPadding = false, maxTempMemSizeInSamples = 0, imageLayout='CHW', tag='') = new ComputationNode [ operation = 'Convolution' ; inputs = (weightNode : inputValueNode) /*plus the function args*/ ]\n"
+    L"Convolution(weightNode, inputValueNode, kernelWidth, kernelHeight, outputChannels, horizontalSubsample, verticalSubsample, zeroPadding = false, maxTempMemSizeInSamples = 0, groups = 1, imageLayout='CHW', tag='') = new ComputationNode [ operation = 'Convolution' ; inputs = (weightNode : inputValueNode) /*plus the function args*/ ]\n"
     L"MaxPooling(input, windowWidth, windowHeight, horizontalSubsample, verticalSubsample, imageLayout='CHW', tag='') = new ComputationNode [ operation = 'MaxPooling' ; inputs = input /*plus the function args*/ ]\n"
     L"AveragePooling(input, windowWidth, windowHeight, horizontalSubsample, verticalSubsample, imageLayout='CHW', tag='') = new ComputationNode [ operation = 'AveragePooling' ; inputs = input /*plus the function args*/ ]\n"
     // TODO: define DelayedValue, with negative delay for future; cannot do this yet, need to be able to say something like delay = -(^.delay)
@@ -66,15 +73,19 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     L"ColumnwiseCrossProduct = KhatriRaoProduct // deprecated \n" // TODO: should it be deprecated? It is described as easier to understand in the CNTKBook.
     L"ClassificationError = ErrorPrediction \n"
     L"Delay = PastValue \n" // TODO: should it allow negative offsets and an if test here?
-    L"BatchNormalization(input, scale, bias, runMean, runInvStdDev, eval, spatial, expAvgFactor = 1.0, epsilon = 0.00001, useCntkEngine = true, imageLayout='CHW', tag='') = new ComputationNode [ operation = 'BatchNormalization' ; inputs = (input : scale : bias : runMean : runInvStdDev) /*plus the function args*/ ]\n"
+    L"BatchNormalization(input, scale, bias, runMean, runInvStdDev, eval, spatial, expAvgFactor = 1.0, epsilon = 0.00001, useCntkEngine = true, imageLayout='CHW', fuseReLU = false, tag='') = new ComputationNode [ operation = 'BatchNormalization' ; inputs = (input : scale : bias : runMean : runInvStdDev) /*plus the function args*/ ]\n"
+    L"LSTMCell(W, R, b, input, reverse = false, tag='') = new ComputationNode [ operation = 'LSTMCell' ; inputs = (W : R : b : input) ; peepholes = false ; projection = false /*plus the function args*/ ]\n"
+    L"PeepholeLSTMCell(W, R, b, P, input, reverse = false, tag='') = new ComputationNode [ operation = 'LSTMCell' ; inputs = (W : R : b : input : P) ; peepholes = true ; projection = false /*plus the function args*/ ]\n"
+    L"ProjectedLSTMCell(W, R, b, P, Wp, input, reverse = false, tag='') = new ComputationNode [ operation = 'LSTMCell' ; inputs = (W : R : b : input : P : Wp) ; peepholes = true ; projection = true /*plus the function args*/ ]\n"
+    L"GRUCell(W, R, b, input, reverse = false, tag='') = new ComputationNode [ operation = 'GRUCell' ; inputs = (W : R : b : input) /*plus the function args*/ ]\n"
+    L"Attention(query, keys, values, causal = false, scale = 0, tag='') = new ComputationNode [ operation = 'Attention' ; inputs = (query : keys : values) /*plus the function args*/ ]\n"
+    L"BidirectionalLSTMCell(Wf, Rf, bf, Wb, Rb, bb, input, tag='') = RowStack((LSTMCell(Wf, Rf, bf, input) : LSTMCell(Wb, Rb, bb, input, reverse = true)), tag=tag)\n"
 // standard nodes. We use macros to define these strings.
 #define UnaryStandardNode(Op, a) L## #Op L"(" L## #a L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = " L## #a L" /*plus the function args*/ ]\n"
 #define BinaryStandardNode(Op, a, b) L## #Op L"(" L## #a L", " L## #b L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L") /*plus the function args*/ ]\n"
 #define TernaryStandardNode(Op, a, b, c) L## #Op L"(" L## #a L", " L## #b L", " L## #c L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L" : " L## #c L") /*plus the function args*/ ]\n"
 #define QuaternaryStandardNode(Op, a, b, c, d) L## #Op L"(" L## #a L", " L## #b L", " L## #c L", " L## #d L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L" : " L## #c L" : " L## #d L") /*plus the function args*/ ]\n"
-#ifdef COMING_SOON
     TernaryStandardNode(CRF, labelVectorSequence, positionDependenScoreVectorSequence, transitionScores) // TODO: better names
-#endif
     QuaternaryStandardNode(ClassBasedCrossEntropyWithSoftmax, labelClassDescriptorVectorSequence, mainInputInfo, mainWeight, classLogProbsBeforeSoftmax)
     // BUGBUG: the commented-out ones are not mentioned in the CNTK book, nor are their parameters documented in the source code
     BinaryStandardNode(ColumnElementTimes, aVectorSequence, anotherVectorSequence)
@@ -97,6 +108,7 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     UnaryStandardNode(Log, x)
     UnaryStandardNode(LogSoftmax, z)
     //BinaryStandardNode(LookupTableNode)
+    TernaryStandardNode(LowRankTimes, leftFactor, rightFactor, rightMatrix)
     UnaryStandardNode(MatrixL1Reg, matrix)
     UnaryStandardNode(MatrixL2Reg, matrix)
     // BUGBUG: CNTKBook also mentions L1Norm and L2Norm
@@ -109,11 +121,10 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     UnaryStandardNode(RectifiedLinear, z)
     //BinaryStandardNode(RowElementTimesNode)
     BinaryStandardNode(Scale, scalarScalingFactor, matrix)
-#ifdef COMING_SOON
-    //BinaryStandardNode(SequenceDecoderNode)
-#endif
+    TernaryStandardNode(SequenceDecoderNode, labelVectorSequence, positionDependenScoreVectorSequence, transitionScores)
     UnaryStandardNode(Sigmoid, z)
     UnaryStandardNode(Softmax, z)
+    BinaryStandardNode(SparseWeightTimes, leftMatrix, rightMatrix)
     UnaryStandardNode(Hardmax, z)
     BinaryStandardNode(SquareError, aMatrix, anotherMatrix)
     UnaryStandardNode(SumColumnElements, z)
@@ -20,6 +20,9 @@
 #include "ModelEditLanguage.h"
 #include "CPUMatrix.h" // used for SetNumThreads()
 #include "CommonMatrix.h"
+#include "CUDACachingMemAllocator.h"
+#include "Instrumentation.h"
+#include "CuDnnConvolutionEngine.h" // for CuDnnAlgorithmCache and ConvolutionEngineSelection
 #include "SGD.h"
 #include "MPIWrapper.h"
 #include "Config.h"
@@ -227,6 +230,14 @@ void DoCommands(const ConfigParameters& config)
                 std::cerr << "CNTKCommandTrainEnd: " + command[i] << endl;
                 fullEpochsOffset += GetMaxEpochs(commandParams);
             }
+            else if (action[j] == "benchmark")
+            {
+                DoTrainBenchmark<ElemType>(commandParams);
+            }
+            else if (action[j] == "readerBenchmark")
+            {
+                DoReaderBenchmark<ElemType>(commandParams);
+            }
             else if (action[j] == "adapt")
             {
                 DoAdapt<ElemType>(commandParams);
@@ -247,6 +258,10 @@ void DoCommands(const ConfigParameters& config)
             {
                 DoWriteOutput<ElemType>(commandParams);
             }
+            else if (action[j] == "beamSearch")
+            {
+                DoBeamSearch<ElemType>(commandParams);
+            }
             else if (action[j] == "devtest")
             {
                 TestCn<ElemType>(config); // for "devtest" action pass the root config instead
@@ -263,10 +278,22 @@ void DoCommands(const ConfigParameters& config)
             {
                 DoExportToDbn<ElemType>(commandParams);
             }
+            else if (action[j] == "exportInference")
+            {
+                DoExportForInference<ElemType>(commandParams);
+            }
             else if (action[j] == "createLabelMap")
             {
                 DoCreateLabelMap<ElemType>(commandParams);
             }
+            else if (action[j] == "convertToBinaryChunks")
+            {
+                DoConvertToBinaryChunks<ElemType>(commandParams);
+            }
+            else if (action[j] == "convertImageRecords")
+            {
+                DoConvertImageRecords<ElemType>(commandParams);
+            }
             else if (action[j] == "writeWordAndClass")
             {
                 DoWriteWordAndClassInfo<ElemType>(commandParams);
@@ -279,6 +306,10 @@ void DoCommands(const ConfigParameters& config)
             {
                 DoParameterSVD<ElemType>(commandParams);
             }
+            else if (action[j] == "prune")
+            {
+                DoPruneWeights<ElemType>(commandParams);
+            }
             else
             {
                 RuntimeError("unknown action: %s  in command set: %s", action[j].c_str(), command[i].c_str());
@@ -443,15 +474,30 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     if (config.Find(L"type"))
         InvalidArgument("Legacy name 'type' no longer allowed. Use 'precision'.");
 
-    // parallel training
+    // parallel training, and distributed evaluation (eval, cv, and write actions)
     g_mpi = nullptr;
     bool paralleltrain = config(L"parallelTrain", false);
-    if (paralleltrain)
-        g_mpi = new MPIWrapper();
+    bool parallelEval = config(L"parallelEval", false);
+    if (paralleltrain || parallelEval)
+        g_mpi = new MPIWrapper(config(L"mpiProgressThread", false));
 
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
 
+    // counters and NVTX ranges, see Instrumentation.h
+    Instrumentation::SetRangesEnabled(config(L"nvtxRanges", true));
+    double instrumentationDumpPeriod = config(L"instrumentationDumpPeriod", 0.0);
+    if (instrumentationDumpPeriod > 0)
+    {
+        wstring instrumentationFile = config(L"instrumentationFile", L"");
+        Instrumentation::StartPeriodicDump(instrumentationDumpPeriod, instrumentationFile);
+    }
+
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
+    TracingGPUMemoryAllocator::SetCachingEnabled(config(L"cacheGPUMemoryAllocations", false));
+    TracingGPUMemoryAllocator::SetManagedMemoryEnabled(config(L"managedGPUMemory", false));
+    CPUMemoryPlacement::Set(config(L"cpuMemoryPlacement", "none"));
+    CuDnnAlgorithmCache::SetFile(config(L"cudnnAlgorithmCacheFile", L""));
+    ConvolutionEngineSelection::SetCuDnnForHWC(config(L"cudnnForHWC", false));
 
     // logging
     wstring logpath = config(L"stderr", L"");
@@ -460,7 +506,7 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         logpath += L"_actions"; // TODO: for old CNTK, this was a concatenation of all action names, which we no longer know
         logpath += L".log";     // TODO: why do we need to append this here?
 
-        if (paralleltrain)
+        if (paralleltrain || parallelEval)
             logpath += msra::strfun::wstrprintf(L"rank%d", (int) g_mpi->CurrentNodeRank());
 
         RedirectStdErr(logpath);
@@ -508,6 +554,13 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         fprintf(fp, "successfully finished at %s on %s\n", TimeDateStamp().c_str(), GetHostName().c_str());
         fcloseOrDie(fp);
     }
+    if (TracingGPUMemoryAllocator::IsCachingEnabled())
+        CUDACachingMemAllocator::PrintStatisticsForAllDevices();
+    if (instrumentationDumpPeriod > 0)
+    {
+        Instrumentation::StopPeriodicDump();
+        Instrumentation::Print(stderr, "at the end");
+    }
     fprintf(stderr, "COMPLETED\n"), fflush(stderr);
 
     delete g_mpi;
@@ -530,17 +583,32 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[]) // called from wmain which is
     wstring DoneFile = config(L"DoneFile", L"");
     ConfigArray command = config(L"command", "train");
 
-    // paralleltrain training
+    // paralleltrain training, and distributed evaluation (eval, cv, and write actions)
     g_mpi = nullptr;
     bool paralleltrain = config(L"parallelTrain", "false");
-    if (paralleltrain)
+    bool parallelEval = config(L"parallelEval", "false");
+    if (paralleltrain || parallelEval)
     {
-        g_mpi = new MPIWrapper();
+        g_mpi = new MPIWrapper(config(L"mpiProgressThread", false));
     }
 
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
 
+    // counters and NVTX ranges, see Instrumentation.h
+    Instrumentation::SetRangesEnabled(config(L"nvtxRanges", true));
+    double instrumentationDumpPeriod = config(L"instrumentationDumpPeriod", 0.0);
+    if (instrumentationDumpPeriod > 0)
+    {
+        wstring instrumentationFile = config(L"instrumentationFile", L"");
+        Instrumentation::StartPeriodicDump(instrumentationDumpPeriod, instrumentationFile);
+    }
+
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
+    TracingGPUMemoryAllocator::SetCachingEnabled(config(L"cacheGPUMemoryAllocations", false));
+    TracingGPUMemoryAllocator::SetManagedMemoryEnabled(config(L"managedGPUMemory", false));
+    CPUMemoryPlacement::Set(config(L"cpuMemoryPlacement", "none"));
+    CuDnnAlgorithmCache::SetFile(config(L"cudnnAlgorithmCacheFile", L""));
+    ConvolutionEngineSelection::SetCuDnnForHWC(config(L"cudnnForHWC", false));
 
     if (logpath != L"")
     {
@@ -551,7 +619,7 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[]) // called from wmain which is
         }
         logpath += L".log";
 
-        if (paralleltrain)
+        if (paralleltrain || parallelEval)
         {
             std::wostringstream oss;
             oss << g_mpi->CurrentNodeRank();
@@ -624,6 +692,13 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[]) // called from wmain which is
         fprintf(fp, "successfully finished at %s on %s\n", TimeDateStamp().c_str(), GetHostName().c_str());
         fcloseOrDie(fp);
     }
+    if (TracingGPUMemoryAllocator::IsCachingEnabled())
+        CUDACachingMemAllocator::PrintStatisticsForAllDevices();
+    if (instrumentationDumpPeriod > 0)
+    {
+        Instrumentation::StopPeriodicDump();
+        Instrumentation::Print(stderr, "at the end");
+    }
     fprintf(stderr, "COMPLETED\n"), fflush(stderr);
 
     delete g_mpi;
@@ -58,6 +58,7 @@ enum MELProperty
     melPropEvaluation,
     melPropOutput,
     melPropRecurrent,
+    melPropRecompute,
     melPropBatchNormMode
 };
 
@@ -220,6 +221,20 @@ void MELScript<ElemType>::CallFunction(const std::string& p_name, const ConfigPa
         ProcessNDLScript(netNdl, ndlPassAll, true);
         netNdl->cn->SaveEdited(fileName);
     }
+    else if (EqualInsensitive(name, "OptimizeForInference"))
+    {
+        size_t numFixedParams = 1, numOptionalParams = 0;
+        if (params.size() > numFixedParams + numOptionalParams || params.size() < numFixedParams)
+            RuntimeError("Invalid number of parameters. Valid parameters: OptimizeForInference(modelName).");
+
+        std::string modelName = params[0];
+        NetNdl<ElemType>* netNdl = &m_mapNameToNetNdl[modelName];
+        if (netNdl->cn == NULL)
+            RuntimeError("OptimizeForInference can only be called after a network has been setup, no active model named %s.", modelName.c_str());
+
+        ProcessNDLScript(netNdl, ndlPassAll, true);
+        netNdl->cn->template OptimizeForInference<ElemType>();
+    }
     else if (EqualInsensitive(name, "SetDefaultModel"))
     {
         size_t numFixedParams = 1, numOptionalParams = 0;
@@ -443,6 +458,10 @@ void MELScript<ElemType>::CallFunction(const std::string& p_name, const ConfigPa
         {
             prop = melPropRecurrent;
         }
+        else if (EqualInsensitive(propName, "recompute"))
+        {
+            prop = melPropRecompute;
+        }
         else
         {
             RuntimeError("Invalid property, %s, is not supported", propName.c_str());
@@ -500,6 +519,11 @@ void MELScript<ElemType>::CallFunction(const std::string& p_name, const ConfigPa
                 // what to do here?
                 break;
             }
+            case melPropRecompute:
+            {
+                node->SetRecompute(params[2]);
+                break;
+            }
             case melPropBatchNormMode:
             {
                 if (node->OperationName() != OperationNameOf(BatchNormalizationNode))
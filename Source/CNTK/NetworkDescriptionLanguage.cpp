@@ -149,11 +149,10 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
 
     wstring nodeType = msra::strfun::utf16(p_nodeType);
     bool ret = false;
-    if (EqualInsensitive(nodeType, OperationNameOf(AveragePoolingNode))) ret = true;
+    if (EqualInsensitive(nodeType, OperationNameOf(AttentionNode))) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(AveragePoolingNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(BatchNormalizationNode))) ret = true;
-#ifdef COMING_SOON
     else if (EqualInsensitive(nodeType, OperationNameOf(CRFNode), L"CRF")) ret = true;
-#endif
     else if (EqualInsensitive(nodeType, OperationNameOf(ClassBasedCrossEntropyWithSoftmaxNode), L"CBCEWithSM")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(ConvolutionNode), L"Convolve")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CosDistanceNode), L"CosDist")) ret = true;
@@ -161,6 +160,7 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
     else if (EqualInsensitive(nodeType, OperationNameOf(CosineNode), L"Cos")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CrossEntropyNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CrossEntropyWithSoftmaxNode), L"CEWithSM")) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(DistillationCrossEntropyWithSoftmaxNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(DiagTimesNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(DiagonalNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(DropoutNode))) ret = true;
@@ -169,9 +169,8 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
     else if (EqualInsensitive(nodeType, OperationNameOf(ErrorPredictionNode), L"ClassificationError")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(ExpNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(FutureValueNode))) ret = true;
-#ifdef COMING_SOON
     else if (EqualInsensitive(nodeType, OperationNameOf(GMMLogLikelihoodNode), L"GMMLL")) ret = true;
-#endif
+    else if (EqualInsensitive(nodeType, OperationNameOf(GRUCellNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(HardmaxNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(InputValue), L"Input")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(InvStdDevNode))) ret = true;
@@ -181,12 +180,15 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
     else if (EqualInsensitive(nodeType, OperationNameOf(LogSoftmaxNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(LogisticNode), L"Logistic")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(LookupTableNode))) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(LowRankTimesNode))) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(LSTMCellNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MatrixL1RegNode), L"L1Reg")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MatrixL2RegNode), L"L2Reg")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MaxPoolingNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MeanNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MinusNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(NegateNode))) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(NoiseContrastiveEstimationNode), L"NoiseContrastiveEstimation")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(PastValueNode), L"Delay")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(PerDimMeanVarDeNormalizationNode), L"PerDimMVDeNorm")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(PerDimMeanVarNormalizationNode), L"PerDimMVNorm")) ret = true;
@@ -196,13 +198,13 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
     else if (EqualInsensitive(nodeType, OperationNameOf(RowRepeatNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(RowSliceNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(RowStackNode))) ret = true;
-#ifdef COMING_SOON
-    else if (EqualInsensitive(nodeType, OperationNameOf(SequenceDecoderNode), L"SEWithSM")) ret = true;
-#endif
+    else if (EqualInsensitive(nodeType, OperationNameOf(SequenceDecoderNode), L"SequenceDecoder")) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(SampledSoftmaxCrossEntropyNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SequenceWithSoftmaxNode), L"SEWithSM")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SigmoidNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SoftmaxNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SparseInputValue), L"SparseInput")) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(SparseWeightTimesNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SquareErrorNode), L"SE")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SumColumnElementsNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(SumElementsNode))) ret = true;
@@ -437,7 +437,7 @@ ComputationNetworkPtr SimpleNetworkBuilder<ElemType>::BuildConditionalLSTMNetwor
         }
         else
         {
-            LogicError("BuildClassLSTMNetworkFromDescription: LSTMNode cannot take sparse input. Need to project sparse input to continuous vector using LookupTable. Suggest using setups below\n layerSizes=$VOCABSIZE$:100:$HIDDIM$:$VOCABSIZE$ \nto have 100 dimension projection, and lookupTableOrder=1\n to project to a single window. To use larger context window, set lookupTableOrder=3 for example with width-3 context window.\n ");
+            LogicError("BuildClassLSTMNetworkFromDescription: LSTM layers cannot take sparse input. Need to project sparse input to continuous vector using LookupTable. Suggest using setups below\n layerSizes=$VOCABSIZE$:100:$HIDDIM$:$VOCABSIZE$ \nto have 100 dimension projection, and lookupTableOrder=1\n to project to a single window. To use larger context window, set lookupTableOrder=3 for example with width-3 context window.\n ");
         }
 
         int recur_idx = 0;
@@ -446,7 +446,6 @@ ComputationNetworkPtr SimpleNetworkBuilder<ElemType>::BuildConditionalLSTMNetwor
         {
             //           output = (ComputationNodePtr)BuildLSTMNodeComponent(randomSeed, 0, m_layerSizes[offset] * (offset ? m_lookupTableOrder : 1), m_layerSizes[offset + 1], input);
             output = (ComputationNodePtr) BuildLSTMComponent(randomSeed, 0, m_layerSizes[offset] * (offset ? m_lookupTableOrder : 1), m_layerSizes[offset + 1], input);
-            // previously used function. now uses LSTMNode which is correct and fast
             input = output;
             for (int i = 1 + offset; i < numHiddenLayers; i++)
             {
@@ -782,6 +781,11 @@ shared_ptr<ComputationNode<ElemType>> /*ComputationNodePtr*/ SimpleNetworkBuilde
 template <class ElemType>
 shared_ptr<ComputationNode<ElemType>> /*ComputationNodePtr*/ SimpleNetworkBuilder<ElemType>::BuildLSTMComponent(unsigned long& randomSeed, size_t iLayer, size_t inputDim, size_t outputDim, ComputationNodePtr inputObs)
 {
+    // the fused cells implement the standard gates only, and start each sequence from 0
+    if (m_rnnCell != RecurrentCellKind::Nodes && !m_constInputGateValue && !m_constForgetGateValue && !m_constOutputGateValue &&
+        m_nonLinearFunctions[0] == OperationNameOf(SigmoidNode) && m_defaultHiddenActivity == 0)
+        return BuildRecurrentCellComponent(randomSeed, iLayer, inputDim, outputDim, inputObs);
+
     ComputationNetworkBuilder<ElemType> builder(*m_net);
 
     size_t numHiddenLayers = m_layerSizes.size() - 2;
@@ -949,6 +953,48 @@ shared_ptr<ComputationNode<ElemType>> /*ComputationNodePtr*/ SimpleNetworkBuilde
     return output;
 }
 
+// the same layer as BuildLSTMComponent() as a single LSTMCellNode (with peepholes) or GRUCellNode
+// The cell starts each sequence from 0, so it is only used when m_defaultHiddenActivity is 0.
+template <class ElemType>
+shared_ptr<ComputationNode<ElemType>> SimpleNetworkBuilder<ElemType>::BuildRecurrentCellComponent(unsigned long& randomSeed, size_t iLayer, size_t inputDim, size_t outputDim, ComputationNodePtr input)
+{
+    ComputationNetworkBuilder<ElemType> builder(*m_net);
+
+    const bool gru = m_rnnCell == RecurrentCellKind::GRU;
+    const wchar_t* prefix = gru ? L"GRU" : L"LSTM";
+    const size_t numGates = gru ? 3 : 4;
+
+    ComputationNodePtr W = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"%lsW%d", prefix, iLayer), numGates * outputDim, inputDim);
+    m_net->InitLearnableParameters(W, m_uniformInit, randomSeed++, m_initValueScale);
+    ComputationNodePtr R = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"%lsR%d", prefix, iLayer), numGates * outputDim, outputDim);
+    m_net->InitLearnableParameters(R, m_uniformInit, randomSeed++, m_initValueScale);
+
+    // the gate biases as in BuildLSTMComponent(); the gates of the LSTM are stacked as [input; forget; output; cell candidate]
+    ComputationNodePtr b = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"%lsb%d", prefix, iLayer), numGates * outputDim, 1);
+    std::vector<ElemType> bias(numGates * outputDim, 0);
+    if (!gru)
+    {
+        std::fill(bias.begin(), bias.begin() + outputDim, m_inputGateInitVal);
+        std::fill(bias.begin() + outputDim, bias.begin() + 2 * outputDim, m_forgetGateInitVal);
+        std::fill(bias.begin() + 2 * outputDim, bias.begin() + 3 * outputDim, m_outputGateInitVal);
+    }
+    b->Value().SetValue(numGates * outputDim, 1, b->Value().GetDeviceId(), bias.data());
+
+    ComputationNodePtr output;
+    if (gru)
+        output = builder.GRUCell(W, R, b, input, false, msra::strfun::wstrprintf(L"GRUCell%d", iLayer));
+    else
+    {
+        ComputationNodePtr P = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"LSTMP%d", iLayer), 3 * outputDim, 1);
+        m_net->InitLearnableParameters(P, m_uniformInit, randomSeed++, m_initValueScale);
+        output = builder.LSTMCell(W, R, b, input, false, true, false, P, nullptr, msra::strfun::wstrprintf(L"LSTMCell%d", iLayer));
+    }
+
+    if (m_addDropoutNodes)
+        output = builder.Dropout(output);
+    return output;
+}
+
 #ifdef COMING_SOON
 
 template <class ElemType>
@@ -1094,7 +1140,7 @@ ComputationNetworkPtr SimpleNetworkBuilder<ElemType>::BuildClassLSTMNetworkFromD
         }
         else
         {
-            LogicError("BuildClassLSTMNetworkFromDescription: LSTMNode cannot take sparse input. Need to project sparse input to continuous vector using LookupTable. Suggest using setups below\n layerSizes=$VOCABSIZE$:100:$HIDDIM$:$VOCABSIZE$ \nto have 100 dimension projection, and lookupTableOrder=1\n to project to a single window. To use larger context window, set lookupTableOrder=3 for example with width-3 context window.\n ");
+            LogicError("BuildClassLSTMNetworkFromDescription: LSTM layers cannot take sparse input. Need to project sparse input to continuous vector using LookupTable. Suggest using setups below\n layerSizes=$VOCABSIZE$:100:$HIDDIM$:$VOCABSIZE$ \nto have 100 dimension projection, and lookupTableOrder=1\n to project to a single window. To use larger context window, set lookupTableOrder=3 for example with width-3 context window.\n ");
         }
 
         int recur_idx = 0;
@@ -1103,7 +1149,6 @@ ComputationNetworkPtr SimpleNetworkBuilder<ElemType>::BuildClassLSTMNetworkFromD
         {
             //                output = (ComputationNodePtr)BuildLSTMNodeComponent(randomSeed, 0, m_layerSizes[offset] * (offset ? m_lookupTableOrder : 1), m_layerSizes[offset + 1], input);
             output = (ComputationNodePtr) BuildLSTMComponent(randomSeed, 0, m_layerSizes[offset] * (offset ? m_lookupTableOrder : 1), m_layerSizes[offset + 1], input);
-            // previously used function. now uses LSTMNode which is correct and fast
             input = output;
             for (int i = 1 + offset; i < numHiddenLayers; i++)
             {
@@ -1256,7 +1301,6 @@ ComputationNetworkPtr SimpleNetworkBuilder<ElemType>::BuildLSTMNetworkFromDescri
 
             // output = (ComputationNodePtr)BuildLSTMNodeComponent(randomSeed, 0, m_layerSizes[offset] * (offset ? m_lookupTableOrder : 1), m_layerSizes[offset + 1], input);
             output = (ComputationNodePtr) BuildLSTMComponent(randomSeed, 0, m_layerSizes[offset] * (offset ? m_lookupTableOrder : 1), m_layerSizes[offset + 1], input);
-            // previously used function. now uses LSTMNode which is correct and fast
             input = output;
             outputFromEachLayer[offset + 1] = input;
 
@@ -1686,12 +1730,10 @@ shared_ptr<ComputationNode<ElemType>> SimpleNetworkBuilder<ElemType>::AddTrainAn
             tinput = builder.Times(matrix, input);
         output = builder.Logistic(label, tinput, (trainNodeName == L"") ? L"Logistic" : trainNodeName);
         break;
-#ifdef COMING_SOON
     case TrainingCriterion::CRF:
         assert(trans != nullptr);
         output = builder.CRF(label, input, trans, (trainNodeName == L"") ? L"CRF" : trainNodeName);
         break;
-#endif
     case TrainingCriterion::ClassCrossEntropyWithSoftmax:
         output = builder.ClassCrossEntropyWithSoftmax(label, input, matrix, clspostprob, (trainNodeName == L"") ? L"ClassCrossEntropyWithSoftmax" : trainNodeName);
         break;
@@ -1743,14 +1785,12 @@ shared_ptr<ComputationNode<ElemType>> SimpleNetworkBuilder<ElemType>::AddTrainAn
                 tinput = builder.Times(matrix, input);
             output = builder.ErrorPrediction(label, tinput, (evalNodeName == L"") ? L"EvalErrorPrediction" : evalNodeName);
             break;
-#ifdef COMING_SOON
         case EvalCriterion::CRF:
             assert(trans != nullptr);
             if (matrix != nullptr && tinput == input)
                 tinput = builder.Times(matrix, input);
             output = builder.CRF(label, tinput, trans, (evalNodeName == L"") ? L"EvalCRF" : evalNodeName);
             break;
-#endif
         default:
             LogicError("Unsupported training criterion.");
         }
@@ -1792,4 +1832,12 @@ EvalCriterion ParseEvalCriterionString(wstring s)
     else LogicError("evalCriterion: Invalid trainingCriterion value. Valid values are (errorPrediction | crossEntropyWithSoftmax | squareError | logistic | sequenceWithSoftmax)");
 }
 
+RecurrentCellKind ParseRecurrentCellKindString(wstring s)
+{
+    if      (EqualCI(s, L"lstm"))  return RecurrentCellKind::LSTM;
+    else if (EqualCI(s, L"gru"))   return RecurrentCellKind::GRU;
+    else if (EqualCI(s, L"nodes")) return RecurrentCellKind::Nodes;
+    else InvalidArgument("rnnCell: Invalid rnnCell value. Valid values are (lstm | gru | nodes)");
+}
+
 } } }
@@ -73,8 +73,17 @@ enum class EvalCriterion : int
     SequenceWithSoftmax
 };
 
+// how the LSTM layers of the recurrent network kinds are built; the fused cells require defaultHiddenActivity=0, otherwise Nodes is used
+enum class RecurrentCellKind : int
+{
+    LSTM,  // fused LSTMCellNode with peepholes
+    GRU,   // fused GRUCellNode
+    Nodes  // separate Times, Plus, Sigmoid, ... and PastValue nodes for each gate
+};
+
 TrainingCriterion ParseTrainingCriterionString(wstring s);
 EvalCriterion ParseEvalCriterionString(wstring s);
+RecurrentCellKind ParseRecurrentCellKindString(wstring s);
 
 template <class ElemType>
 class SimpleNetworkBuilder
@@ -160,6 +169,7 @@ public:
         m_forgetGateInitVal = config("forgetGateInitVal", "-1");
         m_inputGateInitVal = config("inputGateInitVal", "-1");
         m_outputGateInitVal = config("outputGateInitVal", "-1");
+        m_rnnCell = ParseRecurrentCellKindString(config("rnnCell", "lstm"));
 
         m_sparse_input = config("sparseinput", "false");
 
@@ -257,6 +267,7 @@ protected:
     // mulitply used components
     ComputationNodePtr BuildLSTMComponent(unsigned long& randomSeed, size_t iLayer, size_t inputDim, size_t outputDim, ComputationNodePtr input);
     ComputationNodePtr BuildLSTMNodeComponent(ULONG& randomSeed, size_t iLayer, size_t inputDim, size_t outputDim, ComputationNodePtr input);
+    ComputationNodePtr BuildRecurrentCellComponent(unsigned long& randomSeed, size_t iLayer, size_t inputDim, size_t outputDim, ComputationNodePtr input);
     ComputationNodePtr BuildDirectConnect(unsigned long& randomSeed, size_t iLayer, size_t inputDim, size_t outputDim, ComputationNodePtr input, ComputationNodePtr toNode);
 
     // layer is 0 based
@@ -346,6 +357,7 @@ protected:
     ElemType m_forgetGateInitVal;
     ElemType m_inputGateInitVal;
     ElemType m_outputGateInitVal;
+    RecurrentCellKind m_rnnCell;
 
     intargvector m_streamSizes;           // for multiple stream data
     intargvector m_lookupTabelOrderSizes; // each stream has its own projection, so need to provide with the lookup table order size for each stream
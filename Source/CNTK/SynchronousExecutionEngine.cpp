@@ -219,6 +219,50 @@ void SynchronousNodeEvaluator<ElemType>::Evaluate(NDLNode<ElemType>* node, const
             nodePtr->SetParameterUpdateRequired(needGradient);
         }
     }
+    else if (cnNodeType == OperationNameOf(SampledSoftmaxCrossEntropyNode))
+    {
+        if (parameter.size() != 3)
+            RuntimeError("SampledSoftmaxCrossEntropy should have three parameters. Usage: SampledSoftmaxCrossEntropy(labels, input, weights, [numSamples=], [proposal=]).");
+
+        nodeParamCount = 3;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            size_t numSamples = node->GetOptionalParameter("numSamples", "1024");
+            wstring proposal = node->GetOptionalParameter("proposal", "logUniform");
+            nodePtr = builder.SampledSoftmaxCrossEntropy(NULL, NULL, NULL, numSamples, proposal, name);
+        }
+    }
+    else if (cnNodeType == OperationNameOf(DistillationCrossEntropyWithSoftmaxNode))
+    {
+        if (parameter.size() != 2)
+            RuntimeError("DistillationCrossEntropyWithSoftmax should have two parameters. Usage: DistillationCrossEntropyWithSoftmax(softTargets, prediction, [temperature=]).");
+
+        nodeParamCount = 2;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            double temperature = node->GetOptionalParameter("temperature", "1");
+            nodePtr = builder.DistillationCrossEntropyWithSoftmax(NULL, NULL, temperature, name);
+        }
+    }
+    else if (cnNodeType == OperationNameOf(NoiseContrastiveEstimationNode))
+    {
+        if (parameter.size() != 4)
+            RuntimeError("NCEBasedCrossEntropyWithSoftmax should have four parameters. Usage: NCEBasedCrossEntropyWithSoftmax(labels, input, weights, bias, [numNoiseSamples=], [noiseDistribution=]).");
+
+        nodeParamCount = 4;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            size_t numNoiseSamples = node->GetOptionalParameter("numNoiseSamples", "100");
+            wstring noiseDistribution = node->GetOptionalParameter("noiseDistribution", "logUniform");
+            nodePtr = builder.NoiseContrastiveEstimation(NULL, NULL, NULL, NULL, name, NCEEvalMode::None, numNoiseSamples, noiseDistribution);
+        }
+    }
     else if (cnNodeType == OperationNameOf(DiagonalNode))
     {
         if (parameter.size() != 1)
@@ -296,7 +340,7 @@ void SynchronousNodeEvaluator<ElemType>::Evaluate(NDLNode<ElemType>* node, const
     else if (cnNodeType == OperationNameOf(ConvolutionNode))
     {
         if (parameter.size() != 7)
-            RuntimeError("%ls should have 7 fixed parameters[weightNodeName, inputValueNodeName, kernelWidth, kernelHeight, outputChannels,horizontalSubsample, verticalSubsample] and two optional parameters [zeroPadding = [false|yourvalue], maxTempMemSizeInSamples = [0|yourvalue], imageLayout = \"HWC\"|\"cudnn\"].", cnNodeType.c_str());
+            RuntimeError("%ls should have 7 fixed parameters[weightNodeName, inputValueNodeName, kernelWidth, kernelHeight, outputChannels,horizontalSubsample, verticalSubsample] and optional parameters [zeroPadding = [false|yourvalue], maxTempMemSizeInSamples = [0|yourvalue], groups = [1|yourvalue], imageLayout = \"HWC\"|\"cudnn\"].", cnNodeType.c_str());
 
         // setup the parameter position of children so we can hook them up later
         nodeParamCount = 2;
@@ -320,9 +364,10 @@ void SynchronousNodeEvaluator<ElemType>::Evaluate(NDLNode<ElemType>* node, const
             ImageLayoutKind imageLayoutKind = ImageLayoutKindFrom(node->GetOptionalParameter("imageLayout", "HWC"));
             bool zeroPadding = node->GetOptionalParameter("zeroPadding", "false");
             size_t maxTempMemSizeInSamples = node->GetOptionalParameter("maxTempMemSizeInSamples", "0");
+            size_t groups = node->GetOptionalParameter("groups", "1");
 
             nodePtr = builder.Convolution(NULL, NULL, kernelWidth, kernelHeight, outputChannels,
-                                          horizontalSubsample, verticalSubsample, imageLayoutKind, zeroPadding, maxTempMemSizeInSamples, name);
+                                          horizontalSubsample, verticalSubsample, imageLayoutKind, zeroPadding, maxTempMemSizeInSamples, groups, name);
         }
     }
     else if (cnNodeType == OperationNameOf(MaxPoolingNode))
@@ -410,8 +455,64 @@ void SynchronousNodeEvaluator<ElemType>::Evaluate(NDLNode<ElemType>* node, const
             else
                 InvalidArgument("Unsupported batch normalization engine, choose either \"cntk\"(default) or \"cudnn\".");
             ImageLayoutKind imageLayoutKind = ImageLayoutKindFrom(node->GetOptionalParameter("imageLayout", "CHW"));
+            bool fuseReLU = node->GetOptionalParameter("fuseReLU", "false");
+
+            nodePtr = builder.BatchNormalization(nullptr, nullptr, nullptr, nullptr, nullptr, eval, spatial, expAvgFactor, epsilon, useCntkEngine, imageLayoutKind, fuseReLU, name);
+        }
+    }
+    else if (cnNodeType == OperationNameOf(LSTMCellNode))
+    {
+        // Optional parameters
+        bool peepholes = node->GetOptionalParameter("peepholes", "false");
+        bool projection = node->GetOptionalParameter("projection", "false");
+        size_t numInputs = 4 + (peepholes ? 1 : 0) + (projection ? 1 : 0);
+        if (parameter.size() != numInputs)
+            RuntimeError("%ls should have %d fixed parameters[W, R, b, inputValueNodeName%s%s].", cnNodeType.c_str(), (int) numInputs, peepholes ? ", peepholes" : "", projection ? ", projection" : "");
+
+        // setup the parameter position of children so we can hook them up later
+        nodeParamCount = numInputs;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            bool reverse = node->GetOptionalParameter("reverse", "false");
+
+            nodePtr = builder.LSTMCell(nullptr, nullptr, nullptr, nullptr, reverse, peepholes, projection, nullptr, nullptr, name);
+        }
+    }
+    else if (cnNodeType == OperationNameOf(GRUCellNode))
+    {
+        if (parameter.size() != 4)
+            RuntimeError("%ls should have 4 fixed parameters[W, R, b, inputValueNodeName].", cnNodeType.c_str());
+
+        // setup the parameter position of children so we can hook them up later
+        nodeParamCount = 4;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            // Optional parameters
+            bool reverse = node->GetOptionalParameter("reverse", "false");
+
+            nodePtr = builder.GRUCell(nullptr, nullptr, nullptr, nullptr, reverse, name);
+        }
+    }
+    else if (cnNodeType == OperationNameOf(AttentionNode))
+    {
+        if (parameter.size() != 3)
+            RuntimeError("%ls should have 3 fixed parameters[query, keys, values].", cnNodeType.c_str());
+
+        // setup the parameter position of children so we can hook them up later
+        nodeParamCount = 3;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            // Optional parameters
+            bool causal = node->GetOptionalParameter("causal", "false");
+            double scale = node->GetOptionalParameter("scale", "0");
 
-            nodePtr = builder.BatchNormalization(nullptr, nullptr, nullptr, nullptr, nullptr, eval, spatial, expAvgFactor, epsilon, useCntkEngine, imageLayoutKind, name);
+            nodePtr = builder.Attention(nullptr, nullptr, nullptr, causal, (ElemType) scale, name);
         }
     }
     else
@@ -269,7 +269,15 @@ public:
         // loop through all the optional parameters processing them as necessary
         for (NDLNode<ElemType>* param : params)
         {
-            // we only process the "tag" optional parameter for now
+            // gradient checkpointing request, e.g. h = Sigmoid(z, recompute=true)
+            if (EqualCI(param->GetName(), "recompute"))
+            {
+                bool recompute = param->GetValue();
+                compNode->SetRecompute(recompute);
+                continue;
+            }
+
+            // other than that, we only process the "tag" optional parameter for now
             if (!EqualCI(param->GetName(), "tag"))
                 continue;
 
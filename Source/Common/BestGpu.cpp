@@ -45,6 +45,7 @@ int bestGPUDummy = 42; // put something into this CPP, as to avoid a linker warn
 #include <stdio.h>
 #include <string.h>
 #include <algorithm>
+#include <climits>
 
 #include <memory>
 #include "CrossProcessMutex.h"
@@ -65,6 +66,9 @@ struct ProcessorData
     size_t cudaTotalMem;
     bool cntkFound;
     int deviceId; // the deviceId (cuda side) for this processor
+    bool nvmlFound;           // nvmlDevice and pciInfo are valid
+    nvmlDevice_t nvmlDevice;  // NVML handle, for topology and CPU affinity queries
+    nvmlPciInfo_t pciInfo;
 };
 
 enum BestGpuFlags
@@ -75,6 +79,7 @@ enum BestGpuFlags
     bestGpuFavorUtilization = 4, // favor low utilization
     bestGpuFavorSpeed = 8,       // favor fastest processor
     bestGpuExclusiveLock = 16,   // obtain mutex for selected GPU
+    bestGpuTopologyAware = 32,   // with several ranks on this machine, place them on GPUs that share a PCIe switch or NVLink
     bestGpuRequery = 256,        // rerun the last query, updating statistics
 };
 
@@ -95,6 +100,8 @@ private:
     void GetCudaProperties();
     void GetNvmlData();
     void QueryNvmlData();
+    int TopologyDistance(const ProcessorData* a, const ProcessorData* b) const;
+    int GetTopologyAwareDevice(int localRank, int localSize);
 
 public:
     BestGpu()
@@ -116,17 +123,48 @@ public:
     static const int AllDevices = -1;                                                         // can be used to specify all GPUs in GetDevices() call
     static const int RequeryDevices = -2;                                                     // Requery refreshing statistics and picking the same number as last query
     std::vector<int> GetDevices(int number = AllDevices, BestGpuFlags flags = bestGpuNormal); // get multiple devices
+    bool PinToDeviceNumaNode(int deviceId);                                                   // restrict this process to the CPUs local to a GPU
 private:
     bool LockDevice(int deviceId, bool trial = true);
 };
 
+// GetNodeLocalRank - determine our rank among the MPI processes launched on this machine
+// MPI is not necessarily initialized when the device is selected, so we read what the common launchers
+// (Open MPI, MVAPICH2, MPICH/Intel MPI/MS-MPI) export into the environment.
+// returns: false if not launched by a known MPI launcher
+static bool GetNodeLocalRank(int& localRank, int& localSize)
+{
+    static const char* envVars[][2] =
+    {
+        { "OMPI_COMM_WORLD_LOCAL_RANK", "OMPI_COMM_WORLD_LOCAL_SIZE" },
+        { "MV2_COMM_WORLD_LOCAL_RANK",  "MV2_COMM_WORLD_LOCAL_SIZE" },
+        { "MPI_LOCALRANKID",            "MPI_LOCALNRANKS" },
+        { "PMI_LOCAL_RANK",             "PMI_LOCAL_SIZE" },
+    };
+    for (const auto& vars : envVars)
+    {
+        const char* rank = getenv(vars[0]);
+        const char* size = getenv(vars[1]);
+        if (rank && size)
+        {
+            localRank = atoi(rank);
+            localSize = atoi(size);
+            return localRank >= 0 && localRank < localSize;
+        }
+    }
+    return false;
+}
+
 // DeviceFromConfig - Parse 'deviceId' config parameter to determine what type of behavior is desired
 //Symbol - Meaning
 // 'auto' - automatically pick a single GPU based on ?BestGpu? score
 // 'cpu'  - use the CPU
 // 0      - or some other single number, use a single GPU with CUDA ID same as the number
 // This can only be called with the same parameters each time, and 'auto' is determined upon first call.
-static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU)
+// With several MPI ranks on this machine, 'auto' places them on topologically close GPUs (bTopologyAware),
+// and each process is then pinned to the CPUs of the NUMA node local to its GPU (bNumaPinning), so that
+// reader threads and host buffers (first-touch allocation) do not incur cross-socket PCIe traffic.
+static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU, bool bTopologyAware = true, bool bNumaPinning = true)
 {
     // This can only be called with the same parameter.
     static DEVICEID_TYPE selectedDeviceId = DEVICEID_NOTYETDETERMINED;
@@ -135,6 +173,7 @@ static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU)
     else if (selectedDeviceId != deviceId)
         InvalidArgument("SelectDevice: Attempted to change device selection from %d to %d (%d means 'auto').", (int)selectedDeviceId, (int)deviceId, (int)DEVICEID_AUTO);
 
+    static BestGpu* g_bestGpu = nullptr;
     if (deviceId == DEVICEID_AUTO)
     {
         static DEVICEID_TYPE bestDeviceId = DEVICEID_NOTYETDETERMINED;
@@ -142,16 +181,29 @@ static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU)
         if (bestDeviceId == DEVICEID_NOTYETDETERMINED)
         {
             // GPU device to be auto-selected, so init our class
-            static BestGpu* g_bestGpu = nullptr;
             if (g_bestGpu == nullptr)
                 g_bestGpu = new BestGpu();
-            bestDeviceId = (DEVICEID_TYPE)g_bestGpu->GetDevice(BestGpuFlags(bLockGPU ? (bestGpuAvoidSharing | bestGpuExclusiveLock) : bestGpuAvoidSharing));
+            int flags = bLockGPU ? (bestGpuAvoidSharing | bestGpuExclusiveLock) : bestGpuAvoidSharing;
+            if (bTopologyAware)
+                flags |= bestGpuTopologyAware;
+            bestDeviceId = (DEVICEID_TYPE)g_bestGpu->GetDevice(BestGpuFlags(flags));
             // TODO: Do we need to hold this pointer at all? We will only query it once. Or is it used to hold lock to a GPU?
         }
         // already chosen
         deviceId = bestDeviceId;
     }
 
+    // pin once, and only if several ranks compete for this machine's sockets
+    static bool pinned = false;
+    int localRank, localSize;
+    if (!pinned && bNumaPinning && deviceId >= 0 && GetNodeLocalRank(localRank, localSize) && localSize > 1)
+    {
+        pinned = true;
+        if (g_bestGpu == nullptr)
+            g_bestGpu = new BestGpu();
+        g_bestGpu->PinToDeviceNumaNode(deviceId);
+    }
+
     return deviceId;
 }
 //#ifdef MATH_EXPORTS
@@ -160,10 +212,12 @@ static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU)
 DEVICEID_TYPE DeviceFromConfig(const ScriptableObjects::IConfigRecord& config)
 {
     bool bLockGPU = config(L"lockGPU", true);
+    bool bTopologyAware = config(L"topologyAwareGPU", true);
+    bool bNumaPinning = config(L"pinToGpuNumaNode", true);
     // we need to deal with the old CNTK config semantics where 'deviceId' can be either a string or an int
     auto valpp = config.Find(L"deviceId");
     if (!valpp)
-        return SelectDevice(DEVICEID_AUTO, bLockGPU); // not given at all: default
+        return SelectDevice(DEVICEID_AUTO, bLockGPU, bTopologyAware, bNumaPinning); // not given at all: default
     auto valp = *valpp;                               // (the type is not determined at this point)
     if (valp.Is<ScriptableObjects::String>())
     {
@@ -171,12 +225,12 @@ DEVICEID_TYPE DeviceFromConfig(const ScriptableObjects::IConfigRecord& config)
         if (val == L"cpu")
             return SelectDevice(CPUDEVICE, false);
         else if (val == L"auto")
-            return SelectDevice(DEVICEID_AUTO, bLockGPU);
+            return SelectDevice(DEVICEID_AUTO, bLockGPU, bTopologyAware, bNumaPinning);
         else
             InvalidArgument("Invalid value '%ls' for deviceId parameter. Allowed are 'auto' and 'cpu' (case-sensitive).", val.c_str());
     }
     else
-        return SelectDevice(valp, bLockGPU);
+        return SelectDevice(valp, bLockGPU, bTopologyAware, bNumaPinning);
 }
 // legacy version for old CNTK config
 //#ifdef MATH_EXPORTS
@@ -186,10 +240,12 @@ DEVICEID_TYPE DeviceFromConfig(const ConfigParameters& config)
 {
     ConfigValue val = config("deviceId", "auto");
     bool bLockGPU = config(L"lockGPU", true);
+    bool bTopologyAware = config(L"topologyAwareGPU", true);
+    bool bNumaPinning = config(L"pinToGpuNumaNode", true);
 
     if      (EqualCI(val, "cpu"))  return SelectDevice(CPUDEVICE,     false);
-    else if (EqualCI(val, "auto")) return SelectDevice(DEVICEID_AUTO, bLockGPU);
-    else                           return SelectDevice((int) val,     bLockGPU);
+    else if (EqualCI(val, "auto")) return SelectDevice(DEVICEID_AUTO, bLockGPU, bTopologyAware, bNumaPinning);
+    else                           return SelectDevice((int) val,     bLockGPU, bTopologyAware, bNumaPinning);
 }
 
 // !!!!This is from helper_cuda.h which comes with CUDA samples!!!! Consider if it is beneficial to just include all helper_cuda.h
@@ -455,6 +511,17 @@ std::vector<int> BestGpu::GetDevices(int number, BestGpuFlags p_bestFlags)
             break;
     }
 
+    // with several ranks on this machine, the topological placement takes precedence over the score;
+    // if that GPU turns out to be locked, the lock check below falls back to the next best score
+    int localRank, localSize;
+    if ((bestFlags & bestGpuTopologyAware) && number == 1 && GetNodeLocalRank(localRank, localSize) && localSize > 1)
+    {
+        int topologyDevice = GetTopologyAwareDevice(localRank, localSize);
+        auto iter = std::find(best.begin(), best.end(), topologyDevice);
+        if (iter != best.end())
+            std::rotate(best.begin(), iter, iter + 1);
+    }
+
     // global lock for this process
     CrossProcessMutex deviceAllocationLock("DBN.exe GPGPU querying lock");
 
@@ -537,6 +604,10 @@ void BestGpu::QueryNvmlData()
         if (curPd == NULL)
             continue;
 
+        curPd->nvmlDevice = device;
+        curPd->pciInfo = pci;
+        curPd->nvmlFound = true;
+
         // Get the memory usage, will only work for TCC drivers
         result = nvmlDeviceGetMemoryInfo(device, &memory);
         if (NVML_SUCCESS != result)
@@ -598,6 +669,109 @@ void BestGpu::QueryNvmlData()
     return;
 }
 
+// TopologyDistance - how far apart two GPUs are on the interconnect, smaller is closer
+// NVLink peers count as closest, followed by the PCIe hierarchy levels reported by NVML
+// (same board, single switch, multiple switches, host bridge, same CPU socket, across sockets).
+int BestGpu::TopologyDistance(const ProcessorData* a, const ProcessorData* b) const
+{
+    const int unknownDistance = 1000; // no topology information: all GPUs are equally far apart
+    if (a == b)
+        return 0;
+    if (!a->nvmlFound || !b->nvmlFound)
+        return unknownDistance;
+
+#ifdef NVML_NVLINK_MAX_LINKS
+    for (unsigned int link = 0; link < NVML_NVLINK_MAX_LINKS; link++)
+    {
+        nvmlEnableState_t isActive;
+        nvmlPciInfo_t remotePci;
+        if (nvmlDeviceGetNvLinkState(a->nvmlDevice, link, &isActive) == NVML_SUCCESS && isActive == NVML_FEATURE_ENABLED &&
+            nvmlDeviceGetNvLinkRemotePciInfo(a->nvmlDevice, link, &remotePci) == NVML_SUCCESS &&
+            remotePci.domain == b->pciInfo.domain && remotePci.bus == b->pciInfo.bus && remotePci.device == b->pciInfo.device)
+            return 0;
+    }
+#endif
+
+    nvmlGpuTopologyLevel_t level;
+    if (nvmlDeviceGetTopologyCommonAncestor(a->nvmlDevice, b->nvmlDevice, &level) != NVML_SUCCESS) // (Linux only)
+        return unknownDistance;
+    return 1 + (int) level;
+}
+
+// GetTopologyAwareDevice - pick the GPU for one of several ranks that share this machine
+// All ranks see the same topology, so each computes the same placement without communicating:
+// order the GPUs such that neighbors in the order are close, then take the tightest run of
+// 'localSize' consecutive GPUs in that order and assign them by local rank.
+// returns: the deviceId for 'localRank', or -1 if there are fewer allowed GPUs than ranks
+int BestGpu::GetTopologyAwareDevice(int localRank, int localSize)
+{
+    std::vector<const ProcessorData*> candidates;
+    for (const ProcessorData* pd : m_procData)
+    {
+        if (DeviceAllowed(pd->deviceId))
+            candidates.push_back(pd);
+    }
+    if (candidates.size() < localSize)
+        return -1;
+
+    // greedy chain: start from the lowest device id and always append the closest remaining GPU
+    std::vector<const ProcessorData*> order(1, candidates.front());
+    candidates.erase(candidates.begin());
+    while (!candidates.empty())
+    {
+        auto closest = candidates.begin();
+        for (auto iter = candidates.begin(); iter != candidates.end(); ++iter)
+        {
+            if (TopologyDistance(order.back(), *iter) < TopologyDistance(order.back(), *closest))
+                closest = iter;
+        }
+        order.push_back(*closest);
+        candidates.erase(closest);
+    }
+
+    // the window of 'localSize' GPUs whose farthest pair is closest
+    size_t bestStart = 0;
+    int bestSpread = INT_MAX;
+    for (size_t start = 0; start + localSize <= order.size(); start++)
+    {
+        int spread = 0;
+        for (size_t i = start; i < start + localSize; i++)
+            for (size_t j = i + 1; j < start + localSize; j++)
+                spread = std::max(spread, TopologyDistance(order[i], order[j]));
+        if (spread < bestSpread)
+        {
+            bestSpread = spread;
+            bestStart = start;
+        }
+    }
+
+    int deviceId = order[bestStart + localRank]->deviceId;
+    fprintf(stderr, "BestGpu: Topology-aware placement of local rank %d of %d on GPU %d.\n", localRank, localSize, deviceId);
+    return deviceId;
+}
+
+// PinToDeviceNumaNode - restrict this process to the CPUs closest to a GPU
+// Must be called before the readers spawn their threads, which inherit the affinity. Host buffers are then
+// placed on the GPU's NUMA node as well, since the OS allocates pages on the node of the first-touching CPU.
+// returns: true if the affinity was set
+bool BestGpu::PinToDeviceNumaNode(int deviceId)
+{
+    for (const ProcessorData* pd : m_procData)
+    {
+        if (pd->deviceId != deviceId || !pd->nvmlFound)
+            continue;
+        nvmlReturn_t result = nvmlDeviceSetCpuAffinity(pd->nvmlDevice); // (Linux only)
+        if (result == NVML_SUCCESS)
+        {
+            fprintf(stderr, "BestGpu: Pinned process to the CPUs local to GPU %d.\n", deviceId);
+            return true;
+        }
+        fprintf(stderr, "BestGpu: Could not pin process to the CPUs local to GPU %d: %s\n", deviceId, nvmlErrorString(result));
+        return false;
+    }
+    return false;
+}
+
 bool BestGpu::LockDevice(int deviceId, bool trial)
 {
     if (deviceId < 0) // don't lock CPU, always return true
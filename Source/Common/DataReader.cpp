@@ -198,6 +198,16 @@ bool DataReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*
     return bRet;
 }
 
+// SkipMinibatches - skip the next minibatches of the loop, to resume from a mid-epoch checkpoint
+// A single reader may skip them its own way; several ones are read together, as GetMinibatch() couples them.
+template <class ElemType>
+size_t DataReader<ElemType>::SkipMinibatches(size_t numMinibatches, std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    if (m_ioNames.size() == 1)
+        return m_dataReaders[m_ioNames[0]]->SkipMinibatches(numMinibatches, matrices);
+    return IDataReader<ElemType>::SkipMinibatches(numMinibatches, matrices);
+}
+
 // GetMinibatch4SE - Get the next minibatch for SE training, including lattice, labels and phone boundary
 // latticeinput - lattice for each utterances in this minibatch
 // uids - lables stored in size_t vector instead of ElemType matrix
@@ -289,6 +299,13 @@ void DataReader<ElemType>::CopyMBLayoutTo(MBLayoutPtr pMBLayout)
         m_dataReaders[m_ioNames[i]]->CopyMBLayoutTo(pMBLayout);
 }
 
+template <class ElemType>
+void DataReader<ElemType>::GetStatistics(std::map<std::string, double>& stats)
+{
+    for (size_t i = 0; i < m_ioNames.size(); i++)
+        m_dataReaders[m_ioNames[i]]->GetStatistics(stats);
+}
+
 template <class ElemType>
 void DataReader<ElemType>::SetRandomSeed(int seed)
 {
@@ -132,6 +132,13 @@ void DataWriter<ElemType>::SaveMapping(std::wstring saveId, const std::map<Label
     m_dataWriter->SaveMapping(saveId, labelMapping);
 }
 
+// Flush - wait until all saved data has been written
+template <class ElemType>
+void DataWriter<ElemType>::Flush()
+{
+    m_dataWriter->Flush();
+}
+
 //The explicit instantiation
 template class DataWriter<double>;
 template class DataWriter<float>;
@@ -136,6 +136,104 @@ void Eval<ElemType>::ResetState()
     m_eval->ResetState();
 }
 
+// CloneEvaluator - create an evaluator for the same model that shares its parameters and can be used concurrently
+template <class ElemType>
+IEvaluateModel<ElemType>* Eval<ElemType>::CloneEvaluator()
+{
+    return m_eval->CloneEvaluator();
+}
+
+// CreateStream - start a new stream (utterance) for streaming evaluation
+template <class ElemType>
+size_t Eval<ElemType>::CreateStream()
+{
+    return m_eval->CreateStream();
+}
+
+// EvaluateStream - evaluate the next chunk of frames of a stream
+template <class ElemType>
+void Eval<ElemType>::EvaluateStream(size_t streamId, std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+{
+    m_eval->EvaluateStream(streamId, inputs, outputs);
+}
+
+// DestroyStream - release the state of a stream
+template <class ElemType>
+void Eval<ElemType>::DestroyStream(size_t streamId)
+{
+    m_eval->DestroyStream(streamId);
+}
+
+// SaveStreamState - serialize the recurrent state of a stream
+template <class ElemType>
+void Eval<ElemType>::SaveStreamState(size_t streamId, std::vector<char>& buffer)
+{
+    m_eval->SaveStreamState(streamId, buffer);
+}
+
+// LoadStreamState - create a stream from a serialized state
+template <class ElemType>
+size_t Eval<ElemType>::LoadStreamState(const std::vector<char>& buffer)
+{
+    return m_eval->LoadStreamState(buffer);
+}
+
+// BeamSearch - decode a recurrent model step by step, feeding back its output tokens
+template <class ElemType>
+void Eval<ElemType>::BeamSearch(const std::wstring& inputNodeName, const std::wstring& outputNodeName, const std::vector<std::vector<size_t>>& prompts,
+                                std::vector<std::vector<std::pair<std::vector<size_t>, double>>>& results)
+{
+    m_eval->BeamSearch(inputNodeName, outputNodeName, prompts, results);
+}
+
+// BindInput - resolve an input node for Evaluate() with raw buffers
+template <class ElemType>
+size_t Eval<ElemType>::BindInput(const std::wstring& nodeName)
+{
+    return m_eval->BindInput(nodeName);
+}
+
+// BindOutput - resolve an output node for Evaluate() with raw buffers
+template <class ElemType>
+size_t Eval<ElemType>::BindOutput(const std::wstring& nodeName)
+{
+    return m_eval->BindOutput(nodeName);
+}
+
+// Evaluate - evaluate the bound nodes from and into caller buffers
+template <class ElemType>
+void Eval<ElemType>::Evaluate(const ElemType* const* inputs, size_t numSamples, ElemType* const* outputs)
+{
+    m_eval->Evaluate(inputs, numSamples, outputs);
+}
+
+template <class ElemType>
+void Eval<ElemType>::Evaluate(const ElemType* input, size_t numSamples, ElemType* output)
+{
+    m_eval->Evaluate(input, numSamples, output);
+}
+
+// AllocateBuffer - allocate a (page-locked if on a GPU) buffer for Evaluate() with raw buffers
+template <class ElemType>
+ElemType* Eval<ElemType>::AllocateBuffer(size_t numElements)
+{
+    return m_eval->AllocateBuffer(numElements);
+}
+
+// FreeBuffer - release a buffer from AllocateBuffer()
+template <class ElemType>
+void Eval<ElemType>::FreeBuffer(ElemType* buffer)
+{
+    m_eval->FreeBuffer(buffer);
+}
+
+// Warmup - evaluate dummy inputs of the expected sizes before the first real evaluation
+template <class ElemType>
+void Eval<ElemType>::Warmup(const std::vector<size_t>& numSamples)
+{
+    m_eval->Warmup(numSamples);
+}
+
 //The explicit instantiation
 template class Eval<double>;
 template class Eval<float>;
@@ -0,0 +1,89 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// BinaryChunkFormat.h -- on-disk layout of the binary chunked container
+//
+// The container is written by the "convertToBinaryChunks" action from any existing reader, and read by the
+// BinaryChunkReader, which maps the file into memory and hands out sequences as pointers into the mapping.
+// All values are little-endian, and all records start at 8-byte aligned offsets.
+//
+//   BinaryChunkFileHeader
+//   numberOfStreams x { BinaryChunkStreamHeader, UTF-8 stream name padded to 8 bytes }
+//   numberOfChunks x chunk payload
+//   numberOfChunks x BinaryChunkDescriptor         (the chunk table, at m_chunkTableOffset)
+//
+// A chunk payload starts with one record per sequence: a uint64 number of samples followed by one uint64 per stream,
+// the offset of the sequence's data for that stream relative to the start of the chunk. The data of a stream is
+//   - dense:      numberOfSamples x sampleDimension elements, column-major
+//   - sparse_csc: uint32 column starts [numberOfSamples + 1], uint32 row indices [nnz], padding to 8 bytes, elements [nnz]
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+const uint64_t BinaryChunkFileMagic = 0x314b4e4843544e43ull; // "CNTCHNK1"
+const uint32_t BinaryChunkFileVersion = 1;
+
+// storage type of a stream in the container
+enum class BinaryChunkStorageType : uint32_t
+{
+    dense = 0,
+    sparse_csc = 1,
+};
+
+// element type of a stream in the container
+enum class BinaryChunkElementType : uint32_t
+{
+    tfloat = 0,
+    tdouble = 1,
+};
+
+struct BinaryChunkFileHeader
+{
+    uint64_t m_magic;             // BinaryChunkFileMagic
+    uint32_t m_version;           // BinaryChunkFileVersion
+    uint32_t m_numberOfStreams;
+    uint64_t m_numberOfChunks;
+    uint64_t m_numberOfSequences; // over all chunks
+    uint64_t m_numberOfSamples;   // over all chunks
+    uint64_t m_chunkTableOffset;  // offset of the first BinaryChunkDescriptor
+};
+
+struct BinaryChunkStreamHeader
+{
+    BinaryChunkStorageType m_storageType;
+    BinaryChunkElementType m_elementType;
+    uint64_t m_sampleDimension;
+    uint32_t m_nameLength;        // in bytes, the name follows this header
+    uint32_t m_reserved;
+};
+
+struct BinaryChunkDescriptor
+{
+    uint64_t m_offset;            // offset of the chunk payload within the file
+    uint64_t m_size;              // size of the chunk payload in bytes
+    uint64_t m_numberOfSequences;
+    uint64_t m_numberOfSamples;
+};
+
+static_assert(sizeof(BinaryChunkFileHeader) == 48, "BinaryChunkFileHeader must not contain padding");
+static_assert(sizeof(BinaryChunkStreamHeader) == 24, "BinaryChunkStreamHeader must not contain padding");
+static_assert(sizeof(BinaryChunkDescriptor) == 32, "BinaryChunkDescriptor must not contain padding");
+
+// all records are aligned to 8 bytes
+inline size_t BinaryChunkAlign(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+// size of the per-sequence record at the start of a chunk payload
+inline size_t BinaryChunkSequenceRecordSize(size_t numberOfStreams)
+{
+    return sizeof(uint64_t) * (1 + numberOfStreams);
+}
+} } }
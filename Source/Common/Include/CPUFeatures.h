@@ -0,0 +1,59 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUFeatures.h -- runtime detection of the SIMD instruction sets that CPU and OS support
+//
+// This is the one place that decides which instruction sets may be used; the CPUMatrix vector kernels
+// (CPUVectorKernels.cpp) and the ssematrix inner loops (ssefloat4.h) both select their versions from it.
+//
+
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _MSC_VER
+// the OS must save the respective register state on context switches (XCR0), and the CPU must support the instructions
+inline bool OSSavesRegisters(unsigned long long mask)
+{
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    return osxsave && (_xgetbv(0) & mask) == mask;
+}
+
+inline bool CPUSupportsAVX2()
+{
+    int info[4];
+    __cpuid(info, 1);
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info, 7, 0);
+    const bool avx2 = (info[1] & (1 << 5)) != 0;
+    return fma && avx2 && OSSavesRegisters(0x6); // XMM and YMM state
+}
+
+inline bool CPUSupportsAVX512()
+{
+    int info[4];
+    __cpuidex(info, 7, 0);
+    const bool avx512f = (info[1] & (1 << 16)) != 0;
+    return avx512f && OSSavesRegisters(0xe6); // XMM, YMM, opmask, and ZMM state
+}
+#else
+// (the GCC builtins include the OS check)
+inline bool CPUSupportsAVX2()
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+inline bool CPUSupportsAVX512()
+{
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+} } }
@@ -5,57 +5,251 @@
 
 #pragma once
 
-#include <stack>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <stddef.h>
+#include <vector>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // -----------------------------------------------------------------------
-// conc_stack -- very simple version of thread-safe stack. Add other functions as needed.
+// conc_pool -- thread-safe pool of reusable objects (workspaces, file handles, random generators). Add other functions as needed.
 // Kept in a separate header because it pulls in some large headers that are not super-commonly needed otherwise.
+//
+// Objects are kept in a fixed number of slots, which are taken and filled with atomic exchanges, so pop_or_create() and push()
+// do not lock. Each thread starts its search at a slot of its own, so that a thread mostly gets back the object it pushed last
+// and threads rarely touch the same slot (the slots are on separate cache lines). Only objects pushed while all slots are full
+// go to a mutex-protected overflow list. There is no order among the pooled objects.
 // -----------------------------------------------------------------------
 
 template <typename T>
-class conc_stack
+class conc_pool
 {
 public:
-    typedef typename std::stack<T>::value_type value_type;
+    typedef T value_type;
+
+    conc_pool()
+        : m_numOverflow(0)
+    {
+        for (auto& slot : m_slots)
+            slot.m_item.store(nullptr, std::memory_order_relaxed);
+    }
 
-    conc_stack()
+    ~conc_pool()
     {
+        for (auto& slot : m_slots)
+            delete slot.m_item.load(std::memory_order_relaxed);
     }
 
     value_type pop_or_create(std::function<value_type()> factory)
     {
-        std::lock_guard<std::mutex> g(m_locker);
-        if (m_stack.size() == 0)
-            return factory();
-        auto res = std::move(m_stack.top());
-        m_stack.pop();
-        return res;
+        const size_t first = thread_slot();
+        for (size_t i = 0; i < numSlots; i++)
+        {
+            auto& slot = m_slots[(first + i) % numSlots].m_item;
+            if (slot.load(std::memory_order_relaxed) == nullptr) // (look before taking the cache line for writing)
+                continue;
+            std::unique_ptr<value_type> item(slot.exchange(nullptr, std::memory_order_acquire));
+            if (item)
+                return std::move(*item);
+        }
+        if (m_numOverflow.load(std::memory_order_acquire) > 0)
+        {
+            std::lock_guard<std::mutex> g(m_overflowLocker);
+            if (!m_overflow.empty())
+            {
+                auto res = std::move(m_overflow.back());
+                m_overflow.pop_back();
+                m_numOverflow.store(m_overflow.size(), std::memory_order_release);
+                return res;
+            }
+        }
+        return factory();
     }
 
     void push(const value_type& item)
     {
-        std::lock_guard<std::mutex> g(m_locker);
-        m_stack.push(item);
+        push_box(std::unique_ptr<value_type>(new value_type(item)));
     }
 
     void push(value_type&& item)
     {
-        std::lock_guard<std::mutex> g(m_locker);
-        m_stack.push(std::forward<value_type>(item));
+        push_box(std::unique_ptr<value_type>(new value_type(std::move(item))));
+    }
+
+public:
+    conc_pool(const conc_pool&) = delete;
+    conc_pool& operator=(const conc_pool&) = delete;
+    conc_pool(conc_pool&&) = delete;
+    conc_pool& operator=(conc_pool&&) = delete;
+
+private:
+    static const size_t numSlots = 32;
+    static const size_t cacheLineSize = 64;
+
+    void push_box(std::unique_ptr<value_type> box)
+    {
+        const size_t first = thread_slot();
+        for (size_t i = 0; i < numSlots; i++)
+        {
+            auto& slot = m_slots[(first + i) % numSlots].m_item;
+            value_type* expected = nullptr;
+            if (slot.load(std::memory_order_relaxed) == nullptr &&
+                slot.compare_exchange_strong(expected, box.get(), std::memory_order_release, std::memory_order_relaxed))
+            {
+                box.release();
+                return;
+            }
+        }
+        std::lock_guard<std::mutex> g(m_overflowLocker);
+        m_overflow.push_back(std::move(*box));
+        m_numOverflow.store(m_overflow.size(), std::memory_order_release);
+    }
+
+    // the slot a thread starts its searches at; threads get consecutive slots in the order they first use any pool
+    static size_t thread_slot()
+    {
+        static std::atomic<size_t> s_numThreads(0);
+#ifdef _WIN32
+        static __declspec(thread) size_t t_slot = 0; // (0: not assigned yet, otherwise slot + 1)
+#else
+        static __thread size_t t_slot = 0;
+#endif
+        if (t_slot == 0)
+            t_slot = s_numThreads++ % numSlots + 1;
+        return t_slot - 1;
+    }
+
+    struct Slot
+    {
+        std::atomic<value_type*> m_item;
+        char m_padding[cacheLineSize - sizeof(std::atomic<value_type*>)];
+    };
+    Slot m_slots[numSlots];
+
+    std::vector<value_type> m_overflow;
+    std::atomic<size_t> m_numOverflow; // m_overflow.size(), to skip the lock while there is no overflow
+    std::mutex m_overflowLocker;
+};
+
+// -----------------------------------------------------------------------
+// conc_bounded_queue -- lock-free first-in first-out queue of fixed capacity, for any number of producer and consumer threads
+// try_push() fails if the queue is full, try_pop() if it is empty; waiting is up to the caller. Each cell carries a sequence number
+// that says whether it is ready to be written or read in the current round, so producers and consumers only contend on their
+// position counter (after D. Vyukov's bounded MPMC queue). T must be default-constructible.
+// -----------------------------------------------------------------------
+
+template <typename T>
+class conc_bounded_queue
+{
+public:
+    typedef T value_type;
+
+    // 'capacity' is rounded up to a power of 2
+    explicit conc_bounded_queue(size_t capacity)
+        : m_enqueuePos(0), m_dequeuePos(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    bool try_push(const value_type& item)
+    {
+        value_type copy(item);
+        return try_push(std::move(copy));
+    }
+
+    bool try_push(value_type&& item)
+    {
+        size_t pos = m_enqueuePos.m_value.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            const ptrdiff_t diff = (ptrdiff_t) sequence - (ptrdiff_t) pos;
+            if (diff == 0) // the cell is free in this round: claim it
+            {
+                if (m_enqueuePos.m_value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.m_item = std::move(item);
+                    cell.m_sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) // still holds an item of the previous round
+                return false;
+            else // another producer got ahead
+                pos = m_enqueuePos.m_value.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool try_pop(value_type& item)
+    {
+        size_t pos = m_dequeuePos.m_value.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            const ptrdiff_t diff = (ptrdiff_t) sequence - (ptrdiff_t)(pos + 1);
+            if (diff == 0) // the cell holds the item of this round: claim it
+            {
+                if (m_dequeuePos.m_value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = std::move(cell.m_item);
+                    cell.m_sequence.store(pos + m_mask + 1, std::memory_order_release); // (free for the next round)
+                    return true;
+                }
+            }
+            else if (diff < 0) // not written yet
+                return false;
+            else // another consumer got ahead
+                pos = m_dequeuePos.m_value.load(std::memory_order_relaxed);
+        }
     }
 
 public:
-    conc_stack(const conc_stack&) = delete;
-    conc_stack& operator=(const conc_stack&) = delete;
-    conc_stack(conc_stack&&) = delete;
-    conc_stack& operator=(conc_stack&&) = delete;
+    conc_bounded_queue(const conc_bounded_queue&) = delete;
+    conc_bounded_queue& operator=(const conc_bounded_queue&) = delete;
+    conc_bounded_queue(conc_bounded_queue&&) = delete;
+    conc_bounded_queue& operator=(conc_bounded_queue&&) = delete;
 
 private:
-    std::stack<value_type> m_stack;
-    std::mutex m_locker;
+    static const size_t cacheLineSize = 64;
+
+    struct Cell
+    {
+        std::atomic<size_t> m_sequence;
+        value_type m_item;
+    };
+
+    // a position counter on a cache line of its own
+    struct Position
+    {
+        std::atomic<size_t> m_value;
+        char m_padding[cacheLineSize - sizeof(std::atomic<size_t>)];
+
+        Position(size_t value)
+            : m_value(value)
+        {
+        }
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    char m_padding[cacheLineSize];
+    Position m_enqueuePos;
+    Position m_dequeuePos;
 };
 } } }
@@ -82,6 +82,22 @@ public:
     }
 
     virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) = 0;
+
+    // Skips the next 'numMinibatches' minibatches of the loop just started, to resume an epoch from a mid-epoch checkpoint
+    // (see SGD's 'numMBsPerCheckpoint'). Returns the number of minibatches actually skipped, which is less at the end of the data.
+    // The default reads them into 'matrices' like the training does, which reproduces the state of any reader exactly
+    // (randomization, random transformations); readers override this to avoid the work that the training would do with the data.
+    virtual size_t SkipMinibatches(size_t numMinibatches, std::map<std::wstring, Matrix<ElemType>*>& matrices)
+    {
+        size_t numSkipped = 0;
+        while ((numSkipped < numMinibatches) && GetMinibatch(matrices))
+        {
+            DataEnd();
+            numSkipped++;
+        }
+        return numSkipped;
+    }
+
     virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& /*latticeinput*/, vector<size_t>& /*uids*/, vector<size_t>& /*boundaries*/, vector<size_t>& /*extrauttmap*/)
     {
         NOT_IMPLEMENTED;
@@ -133,6 +149,13 @@ public:
         return false;
     }
 
+    // Adds counters of the reader's own work to 'stats', e.g. the thread-seconds of each decoding or transformation stage
+    // ("stage:<name>:seconds" and "stage:<name>:calls"), or the memory held for randomization. See the "readerBenchmark" action.
+    // Readers that keep no counters add nothing.
+    virtual void GetStatistics(std::map<std::string, double>& /*stats*/)
+    {
+    }
+
     bool GetFrame(std::map<std::wstring, Matrix<ElemType>*>& /*matrices*/, const size_t /*tidx*/, vector<size_t>& /*history*/)
     {
         NOT_IMPLEMENTED;
@@ -249,6 +272,7 @@ public:
     //             [out] each matrix resized if necessary containing data.
     // returns - true if there are more minibatches, false if no more minibatchs remain
     virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices);
+    virtual size_t SkipMinibatches(size_t numMinibatches, std::map<std::wstring, Matrix<ElemType>*>& matrices) override;
     virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap);
     virtual bool GetHmmData(msra::asr::simplesenonehmm* hmm);
 
@@ -295,6 +319,8 @@ public:
 
     void CopyMBLayoutTo(MBLayoutPtr pMBLayout);
 
+    virtual void GetStatistics(std::map<std::string, double>& stats) override;
+
     void SetRandomSeed(int);
 
     bool GetProposalObs(std::map<std::wstring, Matrix<ElemType>*>*, const size_t, vector<size_t>&);
@@ -63,6 +63,10 @@ public:
     virtual bool SaveData(size_t recordStart, const std::map<std::wstring, void*, nocase_compare>& matrices, size_t numRecords, size_t datasetSize, size_t byteVariableSized) = 0;
     virtual void SaveMapping(std::wstring saveId, const std::map<LabelIdType, LabelType>& labelMapping) = 0;
     virtual bool SupportMultiUtterances() const = 0;
+    // wait until everything passed to SaveData() has been written; writers that write in the background report their errors here
+    virtual void Flush()
+    {
+    }
 };
 
 // GetWriter - get a reader type from the DLL
@@ -169,6 +173,10 @@ public:
     // saveId - name of the section to save into (section:subsection format)
     // labelMapping - map we are saving to the file
     virtual void SaveMapping(std::wstring saveId, const std::map<LabelIdType, LabelType>& labelMapping);
+
+    // Flush - wait until all saved data has been written
+    virtual void Flush() override;
+
     virtual bool SupportMultiUtterances() const 
     {
         return false;
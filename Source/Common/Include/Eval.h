@@ -48,6 +48,36 @@ public:
     virtual void StartEvaluateMinibatchLoop(const std::wstring& outputNodeName) = 0;
     virtual void Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs) = 0;
     virtual void ResetState() = 0;
+
+    // create another evaluator for the same model that can be used concurrently with this one (from a different thread)
+    // The clone shares the model parameters, but has its own node values. Release it with Destroy().
+    virtual IEvaluateModel<ElemType>* CloneEvaluator() = 0;
+
+    // streaming evaluation of recurrent models
+    // Each stream carries its own recurrent state from one EvaluateStream() call to the next, so that many utterances can be
+    // pushed through one evaluator chunk by chunk, interleaved. A stream's state can be saved and loaded (e.g. by another process).
+    virtual size_t CreateStream() = 0;
+    virtual void EvaluateStream(size_t streamId, std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs) = 0;
+    virtual void DestroyStream(size_t streamId) = 0;
+    virtual void SaveStreamState(size_t streamId, std::vector<char>& buffer) = 0;
+    virtual size_t LoadStreamState(const std::vector<char>& buffer) = 0; // creates a new stream
+
+    // beam search decoding of a recurrent model that is fed its own previous output token
+    virtual void BeamSearch(const std::wstring& inputNodeName, const std::wstring& outputNodeName, const std::vector<std::vector<size_t>>& prompts,
+                            std::vector<std::vector<std::pair<std::vector<size_t>, double>>>& results) = 0;
+
+    // evaluation from and into caller buffers, through nodes bound once to integer handles
+    // This avoids the name lookups and the copies into std::vectors of Evaluate() with maps on every call.
+    virtual size_t BindInput(const std::wstring& nodeName) = 0;
+    virtual size_t BindOutput(const std::wstring& nodeName) = 0;
+    virtual void Evaluate(const ElemType* const* inputs, size_t numSamples, ElemType* const* outputs) = 0;
+    virtual void Evaluate(const ElemType* input, size_t numSamples, ElemType* output) = 0;
+    virtual ElemType* AllocateBuffer(size_t numElements) = 0;
+    virtual void FreeBuffer(ElemType* buffer) = 0;
+
+    // run the model on dummy inputs of the expected sizes, so that the first real evaluation does not pay for the allocation
+    // of its matrices, the creation of library handles, or the search for convolution algorithms
+    virtual void Warmup(const std::vector<size_t>& numSamples) = 0;
 };
 
 // GetEval - get a evaluator type from the DLL
@@ -101,5 +131,55 @@ public:
     virtual void Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
     virtual void Init(const std::string& config);
     virtual void ResetState();
+
+    // CloneEvaluator - create an evaluator for the same model that shares its parameters and can be used concurrently
+    // The returned object is the underlying evaluator, not an Eval wrapper, and must be released with Destroy().
+    virtual IEvaluateModel<ElemType>* CloneEvaluator();
+
+    // CreateStream - start a new stream (utterance) for streaming evaluation; returns its id
+    virtual size_t CreateStream();
+
+    // EvaluateStream - evaluate the next chunk of frames of a stream, continuing from the recurrent state its previous chunk left behind
+    // inputs/outputs - as for Evaluate()
+    virtual void EvaluateStream(size_t streamId, std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
+
+    // DestroyStream - release the state of a stream
+    virtual void DestroyStream(size_t streamId);
+
+    // SaveStreamState - serialize the recurrent state of a stream into 'buffer'
+    // LoadStreamState - create a stream that continues from a state saved with SaveStreamState() (by this or another evaluator of the same model)
+    virtual void SaveStreamState(size_t streamId, std::vector<char>& buffer);
+    virtual size_t LoadStreamState(const std::vector<char>& buffer);
+
+    // BeamSearch - decode a recurrent model step by step, feeding back its output tokens
+    // inputNodeName - node that receives the previous token as a one-hot vector
+    // outputNodeName - node that scores the next token
+    // prompts - token indices each decode starts with (after the start token); may be empty
+    // results - per prompt, up to beamSize hypotheses, best first: the tokens after the prompt, and their log-probability
+    // The config gives beamSize (5), maxLength (100), startToken (0), endToken (1), and normalize (true: apply log-softmax to the output).
+    virtual void BeamSearch(const std::wstring& inputNodeName, const std::wstring& outputNodeName, const std::vector<std::vector<size_t>>& prompts,
+                            std::vector<std::vector<std::pair<std::vector<size_t>, double>>>& results);
+
+    // BindInput - resolve an input node once for Evaluate() with raw buffers; returns its handle, the index of its buffer in 'inputs'
+    // BindOutput - same for an output node; handles count from 0 in the order of binding, binding a node again returns its handle
+    virtual size_t BindInput(const std::wstring& nodeName);
+    virtual size_t BindOutput(const std::wstring& nodeName);
+
+    // Evaluate - evaluate the bound outputs for 'numSamples' samples of the bound inputs, which form one sequence (as with the maps)
+    // inputs - per input handle, the samples column by column: [dimension x numSamples]
+    // outputs - per output handle, a buffer of [dimension x numSamples] that the values are written into; nothing is allocated
+    // The second form is for a single bound input and output.
+    virtual void Evaluate(const ElemType* const* inputs, size_t numSamples, ElemType* const* outputs);
+    virtual void Evaluate(const ElemType* input, size_t numSamples, ElemType* output);
+
+    // AllocateBuffer - allocate a buffer for Evaluate() with raw buffers; on a GPU it is page-locked, so that it is copied to and from the device directly
+    // FreeBuffer - release a buffer from AllocateBuffer()
+    virtual ElemType* AllocateBuffer(size_t numElements);
+    virtual void FreeBuffer(ElemType* buffer);
+
+    // Warmup - evaluate zero inputs once for each expected number of samples per call (sequence length, or batch size with
+    // maxBatchSize), the largest first, so that the matrices are allocated for it, and the convolution algorithms are selected
+    // for every size. The bound nodes are evaluated if any output is bound, else all outputs. Then a new sequence is started.
+    virtual void Warmup(const std::vector<size_t>& numSamples);
 };
 } } }
@@ -0,0 +1,173 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// FlatVocabulary.h -- open-addressing hash table from words to ids, for the text readers
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// FlatVocabulary -- maps words to ids through a single flat table of (hash, entry) slots with linear probing.
+// A lookup costs one hash of the word and, almost always, a single string compare, and it can be done on a
+// character range without constructing a string. Unlike std::map there is no per-node allocation.
+// Lookups are const and may run concurrently on several threads once the table is built.
+// Entries are numbered in order of insertion and can be enumerated through Word() and Id().
+template <class StringType, class IdType>
+class FlatVocabulary
+{
+public:
+    typedef typename StringType::value_type CharType;
+
+    FlatVocabulary()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        m_words.clear();
+        m_ids.clear();
+        m_slots.assign(16, Slot());
+    }
+
+    size_t size() const
+    {
+        return m_words.size();
+    }
+
+    // word and id of entry 'entry' (in order of insertion)
+    const StringType& Word(size_t entry) const
+    {
+        return m_words[entry];
+    }
+    IdType Id(size_t entry) const
+    {
+        return m_ids[entry];
+    }
+
+    // make room for 'numWords' entries without rehashing
+    void Reserve(size_t numWords)
+    {
+        m_words.reserve(numWords);
+        m_ids.reserve(numWords);
+        if (2 * numWords > m_slots.size())
+            Rehash(2 * numWords);
+    }
+
+    // (re-)build from a map-like container of (word, id) pairs, e.g. a std::map<std::wstring, long>
+    template <class MapType>
+    void Build(const MapType& wordToId)
+    {
+        clear();
+        Reserve(wordToId.size());
+        for (const auto& entry : wordToId)
+            Insert(entry.first.data(), entry.first.size(), (IdType) entry.second);
+    }
+
+    // look up the word [begin, begin + length); returns 'notFound' if it is not in the table
+    IdType Find(const CharType* begin, size_t length, IdType notFound) const
+    {
+        const Slot& slot = m_slots[FindSlot(begin, length, Hash(begin, length))];
+        return slot.entry == s_empty ? notFound : m_ids[slot.entry];
+    }
+    IdType Find(const StringType& word, IdType notFound) const
+    {
+        return Find(word.data(), word.size(), notFound);
+    }
+
+    // look up the word [begin, begin + length) and add it with 'id' if it is not in the table yet
+    // Returns the id stored in the table, i.e. 'id' if the word was added.
+    IdType Insert(const CharType* begin, size_t length, IdType id)
+    {
+        const uint64_t hash = Hash(begin, length);
+        size_t index = FindSlot(begin, length, hash);
+        if (m_slots[index].entry != s_empty)
+            return m_ids[m_slots[index].entry];
+
+        // keep the load factor at or below 1/2 so that probe sequences stay short
+        if (2 * (m_words.size() + 1) > m_slots.size())
+        {
+            Rehash(2 * m_slots.size());
+            index = FindSlot(begin, length, hash);
+        }
+        m_slots[index].hash = hash;
+        m_slots[index].entry = m_words.size();
+        m_words.push_back(StringType(begin, length));
+        m_ids.push_back(id);
+        return id;
+    }
+
+private:
+    static const size_t s_empty = (size_t) -1;
+
+    struct Slot
+    {
+        uint64_t hash;
+        size_t entry; // index into m_words/m_ids, or s_empty
+        Slot()
+            : hash(0), entry(s_empty)
+        {
+        }
+    };
+
+    // 64-bit FNV-1a
+    static uint64_t Hash(const CharType* p, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= (uint64_t) p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // index of the slot that holds the word, or of the empty slot where it would be inserted
+    size_t FindSlot(const CharType* begin, size_t length, uint64_t hash) const
+    {
+        const size_t mask = m_slots.size() - 1;
+        for (size_t index = (size_t) hash & mask;; index = (index + 1) & mask)
+        {
+            const Slot& slot = m_slots[index];
+            if (slot.entry == s_empty)
+                return index;
+            if (slot.hash == hash)
+            {
+                const StringType& word = m_words[slot.entry];
+                if (word.size() == length && StringType::traits_type::compare(word.data(), begin, length) == 0)
+                    return index;
+            }
+        }
+    }
+
+    // resize the slot table to the smallest power of two >= 'minSlots' and re-insert all entries
+    void Rehash(size_t minSlots)
+    {
+        size_t numSlots = 16;
+        while (numSlots < minSlots)
+            numSlots *= 2;
+        m_slots.assign(numSlots, Slot());
+        const size_t mask = numSlots - 1;
+        for (size_t entry = 0; entry < m_words.size(); entry++)
+        {
+            const uint64_t hash = Hash(m_words[entry].data(), m_words[entry].size());
+            size_t index = (size_t) hash & mask;
+            while (m_slots[index].entry != s_empty)
+                index = (index + 1) & mask;
+            m_slots[index].hash = hash;
+            m_slots[index].entry = entry;
+        }
+    }
+
+    std::vector<Slot> m_slots; // size is a power of two
+    std::vector<StringType> m_words;
+    std::vector<IdType> m_ids;
+};
+
+} } }
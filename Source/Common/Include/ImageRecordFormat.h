@@ -0,0 +1,75 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ImageRecordFormat.h -- on-disk layout of the image record file
+//
+// The record file holds the images of an ImageReader map file decoded once and reduced to the size they are trained at,
+// so that an epoch neither decodes nor scales down full-resolution images. It is written by the "convertImageRecords"
+// action and read by the ImageReader (recordFile=...), which maps it into memory. Its chunks are the chunks the
+// randomizer shuffles. All values are little-endian, and all records start at 8-byte aligned offsets.
+//
+//   ImageRecordFileHeader
+//   numberOfChunks x chunk payload
+//   numberOfChunks x ImageRecordChunkDescriptor      (the chunk table, at m_chunkTableOffset)
+//
+// A chunk payload starts with one ImageRecord per image, followed by the data of the images (at the offsets the records
+// give, relative to the start of the chunk). The data of an image is
+//   - raw:     height x width x channels uint8 values, HWC, with the channel order of the decoder (BGR)
+//   - encoded: an image file (e.g. JPEG) as cv::imdecode() takes it
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+const uint64_t ImageRecordFileMagic = 0x3152474d49544e43ull; // "CNTIMGR1"
+const uint32_t ImageRecordFileVersion = 1;
+
+enum class ImageRecordEncoding : uint32_t
+{
+    raw = 0,
+    encoded = 1,
+};
+
+struct ImageRecordFileHeader
+{
+    uint64_t m_magic;             // ImageRecordFileMagic
+    uint32_t m_version;           // ImageRecordFileVersion
+    ImageRecordEncoding m_encoding;
+    uint32_t m_channels;
+    uint32_t m_shorterSide;       // the images were scaled down to (0: kept their size)
+    uint64_t m_numberOfChunks;
+    uint64_t m_numberOfImages;    // over all chunks
+    uint64_t m_chunkTableOffset;  // offset of the first ImageRecordChunkDescriptor
+};
+
+struct ImageRecordChunkDescriptor
+{
+    uint64_t m_offset;            // offset of the chunk payload within the file
+    uint64_t m_size;              // size of the chunk payload in bytes
+    uint64_t m_numberOfImages;
+};
+
+struct ImageRecord
+{
+    uint64_t m_offset;            // of the data, relative to the start of the chunk payload
+    uint64_t m_size;              // of the data in bytes
+    uint32_t m_width;
+    uint32_t m_height;
+    uint64_t m_classId;
+};
+
+static_assert(sizeof(ImageRecordFileHeader) == 48, "ImageRecordFileHeader must not contain padding");
+static_assert(sizeof(ImageRecordChunkDescriptor) == 24, "ImageRecordChunkDescriptor must not contain padding");
+static_assert(sizeof(ImageRecord) == 32, "ImageRecord must not contain padding");
+
+// all records are aligned to 8 bytes
+inline size_t ImageRecordAlign(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+} } }
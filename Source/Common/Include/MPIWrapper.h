@@ -6,13 +6,43 @@
 // and the MPI dev package on Linux (sudo apt-get install libopenmpi-dev openmpi-bin openmpi-doc)
 #include "mpi.h"
 #pragma comment(lib, "msmpi.lib")
+#if defined(OPEN_MPI) && OPEN_MPI
+#include "mpi-ext.h" // for MPIX_CUDA_AWARE_SUPPORT
+#endif
 
 #include <string>
 #include <array>
 #include <vector>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "Instrumentation.h"
+
+// the fault-tolerance extension of MPI (ULFM), which elastic training needs to continue after a worker failed
+#if defined(MPIX_ERR_PROC_FAILED) && defined(MPIX_ERR_REVOKED)
+#define CNTK_MPI_FAULT_TOLERANCE
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// thrown instead of aborting when an MPI operation failed because a worker died, and fault tolerance is enabled (see MPIWrapper::EnableFaultTolerance())
+class MPIProcessFailure : public std::runtime_error
+{
+public:
+    MPIProcessFailure(const std::string &what)
+        : std::runtime_error(what)
+    {
+    }
+};
+
+inline bool &MPIFaultToleranceEnabled()
+{
+    static bool enabled = false;
+    return enabled;
+}
+
 struct MpiFail : public std::string
 {
     MpiFail(const std::string &what)
@@ -31,6 +61,14 @@ static int operator||(int rc, const MpiFail &what)
     fprintf(stderr, "%s, MPI error %d\n", what.c_str(), rc);
     fflush(stderr);
 
+#ifdef CNTK_MPI_FAULT_TOLERANCE
+    // with fault tolerance, a failed (or revoked because another worker saw a failure) operation is survivable
+    int errorClass = MPI_SUCCESS;
+    MPI_Error_class(rc, &errorClass);
+    if (MPIFaultToleranceEnabled() && ((errorClass == MPIX_ERR_PROC_FAILED) || (errorClass == MPIX_ERR_REVOKED)))
+        throw MPIProcessFailure(what);
+#endif
+
     // (special case: we use that code to indicate a missing msmpi.dll...)
     if (rc != MPI_ERR_INTERN)
     {
@@ -58,8 +96,20 @@ class MPIWrapper
     // MPI communicator that reflects the current subset selection
     MPI_Comm m_currentComm;
 
+    // the workers on this host, and the workers with the same rank within their host on all hosts (see CreateNodeCommunicators())
+    MPI_Comm m_intraNodeComm;
+    MPI_Comm m_interNodeComm;
+    int m_intraNodeRank;
+    int m_numIntraNodeRanks;
+
+    // the thread that drives the progress of non-blocking operations (see StartProgressThread())
+    std::thread m_progressThread;
+    std::atomic<bool> m_stopProgressThread;
+    MPI_Comm m_progressComm;
+    int m_threadLevelProvided;
+
     // MPI_Init() with delay-loading the msmpi.dll (possibly causing a failure if missing; we want to catch that)
-    int MPI_Init_DL()
+    int MPI_Init_DL(int requiredThreadLevelSupport)
     {
 #ifdef WIN32
         __try
@@ -69,14 +119,15 @@ class MPIWrapper
             int flag = 0;
             MPI_Initialized(&flag);
             if (flag)
+            {
+                MPI_Query_thread(&m_threadLevelProvided);
                 return MPI_SUCCESS;
+            }
 
             int argc = 0;
             char **argv = NULL;
-            int requiredThreadLevelSupport = MPI_THREAD_SERIALIZED;
-            int provided;
-            int ret = MPI_Init_thread(&argc, &argv, requiredThreadLevelSupport, &provided);
-            if (provided != requiredThreadLevelSupport)
+            int ret = MPI_Init_thread(&argc, &argv, requiredThreadLevelSupport, &m_threadLevelProvided);
+            if (m_threadLevelProvided < MPI_THREAD_SERIALIZED)
                 LogicError("Failed to initialize MPI with the desired level of thread support");
 
             return ret;
@@ -104,9 +155,39 @@ class MPIWrapper
         Sleep(s_myRank * 50);
     }
 
+    // Splits 'comm' into the workers on each host (MPI_COMM_TYPE_SHARED) and, across hosts, the workers with the same local rank,
+    // for hierarchical communication: e.g. reduce within the host, exchange across hosts, broadcast within the host.
+    void CreateNodeCommunicators(MPI_Comm comm)
+    {
+        FreeNodeCommunicators();
+        int rank;
+        MPI_Comm_rank(comm, &rank) || MpiFail("CreateNodeCommunicators: MPI_Comm_rank");
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &m_intraNodeComm) || MpiFail("CreateNodeCommunicators: MPI_Comm_split_type");
+        MPI_Comm_rank(m_intraNodeComm, &m_intraNodeRank) || MpiFail("CreateNodeCommunicators: MPI_Comm_rank");
+        MPI_Comm_size(m_intraNodeComm, &m_numIntraNodeRanks) || MpiFail("CreateNodeCommunicators: MPI_Comm_size");
+        MPI_Comm_split(comm, m_intraNodeRank, rank, &m_interNodeComm) || MpiFail("CreateNodeCommunicators: MPI_Comm_split");
+    }
+
+    void FreeNodeCommunicators()
+    {
+        if (m_intraNodeComm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_intraNodeComm);
+        if (m_interNodeComm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_interNodeComm);
+    }
+
 public:
-    MPIWrapper()
-        : m_currentComm(MPI_COMM_WORLD)
+    // 'progressThread': start a thread that drives the progress of non-blocking operations, for MPI implementations that only
+    // progress them inside MPI calls (see StartProgressThread()).
+    MPIWrapper(bool progressThread = false)
+        : m_currentComm(MPI_COMM_WORLD),
+          m_intraNodeComm(MPI_COMM_NULL),
+          m_interNodeComm(MPI_COMM_NULL),
+          m_intraNodeRank(0),
+          m_numIntraNodeRanks(1),
+          m_stopProgressThread(false),
+          m_progressComm(MPI_COMM_NULL),
+          m_threadLevelProvided(MPI_THREAD_SINGLE)
     {
         static bool initialized = false;
         if (initialized)
@@ -118,10 +199,11 @@ public:
         fprintf(stderr, "MPIWrapper: initializing MPI\n");
         fflush(stderr);
 
-        MPI_Init_DL() || MpiFail("mpiaggregator: MPI_Init");
+        MPI_Init_DL(progressThread ? MPI_THREAD_MULTIPLE : MPI_THREAD_SERIALIZED) || MpiFail("mpiaggregator: MPI_Init");
         MPI_Comm_rank(MPI_COMM_WORLD, &m_myRank);
         MPI_Comm_size(MPI_COMM_WORLD, &m_numMPINodes);
         m_numNodesInUse = m_numMPINodes;
+        CreateNodeCommunicators(MPI_COMM_WORLD);
 
         // Applying MPI workaround
         s_myRank = m_myRank;
@@ -131,7 +213,7 @@ public:
         RequestNodes("MPIWrapper");
 
         if (m_numMPINodes > 1)
-            fprintf(stderr, "mpihelper: we are cog %d in a gearbox of %d\n", (int) m_myRank, (int) m_numMPINodes);
+            fprintf(stderr, "mpihelper: we are cog %d in a gearbox of %d (%d of %d on this host)\n", (int) m_myRank, (int) m_numMPINodes, m_intraNodeRank, m_numIntraNodeRanks);
         else
             fprintf(stderr, "mpihelper: only one MPI process: MPI operation will be boring\n");
 
@@ -140,6 +222,9 @@ public:
         // do an initial handshake
         Ping("mpihelper");
 
+        if (progressThread)
+            StartProgressThread();
+
         // stagger the jobs just a little to get a sort-of deterministic order e.g. in GPU allocation when running on one machine
         // continue 0.5 seconds apart
         ::Sleep((DWORD)(500 * CurrentNodeRank()));
@@ -151,6 +236,7 @@ public:
     {
         fprintf(stderr, "~MPIWrapper\n");
         fflush(stderr);
+        StopProgressThread();
         MPI_Finalize();
     }
 
@@ -246,6 +332,136 @@ public:
         return 0;
     }
 
+    // -----------------------------------------------------------------------
+    // communicators for hierarchical communication, created at startup (and again after ShrinkAfterFailure())
+    // -----------------------------------------------------------------------
+
+    // the workers on this host
+    MPI_Comm IntraNodeCommunicator() const
+    {
+        return m_intraNodeComm;
+    }
+    // the workers with the same rank within their host (IntraNodeRank()), one per host
+    MPI_Comm InterNodeCommunicator() const
+    {
+        return m_interNodeComm;
+    }
+    size_t IntraNodeRank() const
+    {
+        return m_intraNodeRank;
+    }
+    size_t NumIntraNodeRanks() const
+    {
+        return m_numIntraNodeRanks;
+    }
+
+    // -----------------------------------------------------------------------
+    // progress thread
+    // -----------------------------------------------------------------------
+
+    // Some MPI implementations progress non-blocking operations only while the process is inside an MPI call, so an operation
+    // started before a long computation would not move until the Wait() after it. This thread keeps calling into MPI (probing
+    // a communicator of its own that carries no messages) to move them along. Needs MPI_THREAD_MULTIPLE; without it, this
+    // warns and does nothing.
+    void StartProgressThread()
+    {
+        if (m_progressThread.joinable())
+            return;
+        if (m_threadLevelProvided < MPI_THREAD_MULTIPLE)
+        {
+            fprintf(stderr, "WARNING: mpihelper: no progress thread, since this MPI does not support MPI_THREAD_MULTIPLE.\n");
+            fflush(stderr);
+            return;
+        }
+
+        MPI_Comm_dup(MPI_COMM_SELF, &m_progressComm) || MpiFail("StartProgressThread: MPI_Comm_dup");
+        m_stopProgressThread = false;
+        m_progressThread = std::thread([this]()
+                                       {
+                                           while (!m_stopProgressThread)
+                                           {
+                                               int flag;
+                                               MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, m_progressComm, &flag, MPI_STATUS_IGNORE);
+                                               std::this_thread::sleep_for(std::chrono::microseconds(50));
+                                           }
+                                       });
+    }
+
+    void StopProgressThread()
+    {
+        if (!m_progressThread.joinable())
+            return;
+        m_stopProgressThread = true;
+        m_progressThread.join();
+        MPI_Comm_free(&m_progressComm);
+    }
+
+    // -----------------------------------------------------------------------
+    // fault tolerance (elastic training)
+    // -----------------------------------------------------------------------
+
+    static bool SupportsFaultTolerance()
+    {
+#ifdef CNTK_MPI_FAULT_TOLERANCE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // From now on, MPI operations that fail because a worker died throw MPIProcessFailure instead of aborting the job.
+    void EnableFaultTolerance()
+    {
+        if (!SupportsFaultTolerance())
+            RuntimeError("EnableFaultTolerance: This MPI does not support fault tolerance (ULFM), which is needed for elastic training.");
+        if (!UsingAllNodes())
+            RuntimeError("EnableFaultTolerance: Fault tolerance cannot be used with a subset of the MPI nodes.");
+
+        MPI_Comm_set_errhandler(m_currentComm, MPI_ERRORS_RETURN) || MpiFail("EnableFaultTolerance: MPI_Comm_set_errhandler");
+        MPIFaultToleranceEnabled() = true;
+    }
+
+    // After an MPIProcessFailure: revoke the communicator, so that the workers still waiting in operations on it learn about
+    // the failure as well, and continue with a communicator of the survivors. All surviving workers must call this.
+    // The ranks are renumbered; the lowest surviving rank becomes the main node.
+    void ShrinkAfterFailure()
+    {
+#ifdef CNTK_MPI_FAULT_TOLERANCE
+        size_t numNodesBefore = m_numNodesInUse;
+        MPIX_Comm_revoke(m_currentComm);
+
+        MPI_Comm survivors;
+        MPIX_Comm_shrink(m_currentComm, &survivors) || MpiFail("ShrinkAfterFailure: MPIX_Comm_shrink");
+        if (m_currentComm != MPI_COMM_WORLD)
+            MPI_Comm_free(&m_currentComm);
+        m_currentComm = survivors;
+        MPI_Comm_set_errhandler(m_currentComm, MPI_ERRORS_RETURN) || MpiFail("ShrinkAfterFailure: MPI_Comm_set_errhandler");
+
+        MPI_Comm_rank(m_currentComm, &m_myRank);
+        MPI_Comm_size(m_currentComm, &m_numMPINodes);
+        m_numNodesInUse = m_numMPINodes;
+        s_myRank = m_myRank;
+        CreateNodeCommunicators(m_currentComm);
+
+        fprintf(stderr, "mpihelper: %d of %d workers survived, we are now cog %d\n", (int) m_numNodesInUse, (int) numNodesBefore, (int) m_myRank);
+        fflush(stderr);
+#else
+        LogicError("ShrinkAfterFailure: This MPI does not support fault tolerance (ULFM).");
+#endif
+    }
+
+    // whether MPI can operate on GPU device memory directly (CUDA-aware MPI, e.g. with GPUDirect RDMA)
+    // Open MPI can tell us at runtime; for MVAPICH2 we go by its MV2_USE_CUDA switch. MS-MPI does not support it.
+    static bool IsCudaAware()
+    {
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+        return MPIX_Query_cuda_support() == 1;
+#else
+        const char *mv2UseCuda = getenv("MV2_USE_CUDA");
+        return mv2UseCuda != nullptr && atoi(mv2UseCuda) == 1;
+#endif
+    }
+
     // -----------------------------------------------------------------------
     // data-exchange functions (wrappers around MPI functions)
     // -----------------------------------------------------------------------
@@ -292,15 +508,129 @@ public:
     {
         if ((NumNodesInUse() > 1 && (Communicator() != MPI_COMM_NULL)))
         {
+            CNTK_RANGE("mpi.allreduce");
+            CNTK_COUNTER_ADD("mpi.allreduceBytes", (long long) (nData * sizeof(ElemType)));
             MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
         }
     }
 
+    // non-blocking version, to overlap the communication with computation; 'pData' must stay untouched until Wait() on the request
+    template <class ElemType>
+    MPI_Request AllReduceAsync(ElemType *pData, size_t nData)
+    {
+        MPI_Request request = MPI_REQUEST_NULL;
+        if ((NumNodesInUse() > 1 && (Communicator() != MPI_COMM_NULL)))
+        {
+            CNTK_COUNTER_ADD("mpi.allreduceBytes", (long long) (nData * sizeof(ElemType)));
+            MPI_Iallreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator(), &request) || MpiFail("AllReduceAsync: MPI_Iallreduce");
+        }
+        return request;
+    }
+
+    // The non-blocking collectives below run on Communicator() unless a communicator is given (e.g. IntraNodeCommunicator()).
+    // The buffers must stay untouched until Wait() on the request (or Test() returned true).
+
+    // non-blocking broadcast from 'srcRank'
+    template <class ElemType>
+    MPI_Request BcastAsync(ElemType *pData, size_t nData, size_t srcRank, MPI_Comm comm)
+    {
+        MPI_Request request = MPI_REQUEST_NULL;
+        if (comm != MPI_COMM_NULL && CommSize(comm) > 1)
+        {
+            CNTK_COUNTER_ADD("mpi.bcastBytes", (long long) (nData * sizeof(ElemType)));
+            MPI_Ibcast(pData, (int) nData, GetDataType(pData), (int) srcRank, comm, &request) || MpiFail("BcastAsync: MPI_Ibcast");
+        }
+        return request;
+    }
+    template <class ElemType>
+    MPI_Request BcastAsync(ElemType *pData, size_t nData, size_t srcRank)
+    {
+        return BcastAsync(pData, nData, srcRank, Communicator());
+    }
+
+    // non-blocking in-place reduce-scatter into blocks of 'nBlock' elements: 'pData' holds one block per rank, and rank i ends up
+    // with the sum of block i over all ranks, in its first block
+    template <class ElemType>
+    MPI_Request ReduceScatterAsync(ElemType *pData, size_t nBlock, MPI_Comm comm)
+    {
+        MPI_Request request = MPI_REQUEST_NULL;
+        if (comm != MPI_COMM_NULL && CommSize(comm) > 1)
+        {
+            MPI_Ireduce_scatter_block(MPI_IN_PLACE, pData, (int) nBlock, GetDataType(pData), MPI_SUM, comm, &request) || MpiFail("ReduceScatterAsync: MPI_Ireduce_scatter_block");
+        }
+        return request;
+    }
+    template <class ElemType>
+    MPI_Request ReduceScatterAsync(ElemType *pData, size_t nBlock)
+    {
+        return ReduceScatterAsync(pData, nBlock, Communicator());
+    }
+
+    // non-blocking in-place all-gather of blocks of 'nBlock' elements: rank i contributes block i of 'pData', and all ranks end up
+    // with all blocks
+    template <class ElemType>
+    MPI_Request AllGatherAsync(ElemType *pData, size_t nBlock, MPI_Comm comm)
+    {
+        MPI_Request request = MPI_REQUEST_NULL;
+        if (comm != MPI_COMM_NULL && CommSize(comm) > 1)
+        {
+            MPI_Iallgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, pData, (int) nBlock, GetDataType(pData), comm, &request) || MpiFail("AllGatherAsync: MPI_Iallgather");
+        }
+        return request;
+    }
+    template <class ElemType>
+    MPI_Request AllGatherAsync(ElemType *pData, size_t nBlock)
+    {
+        return AllGatherAsync(pData, nBlock, Communicator());
+    }
+
+    // non-blocking all-reduce on a given communicator
+    template <class ElemType>
+    MPI_Request AllReduceAsync(ElemType *pData, size_t nData, MPI_Comm comm)
+    {
+        MPI_Request request = MPI_REQUEST_NULL;
+        if (comm != MPI_COMM_NULL && CommSize(comm) > 1)
+        {
+            CNTK_COUNTER_ADD("mpi.allreduceBytes", (long long) (nData * sizeof(ElemType)));
+            MPI_Iallreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, comm, &request) || MpiFail("AllReduceAsync: MPI_Iallreduce");
+        }
+        return request;
+    }
+
+    // wait for requests of non-blocking operations to complete
+    void Wait(std::vector<MPI_Request> &requests)
+    {
+        CNTK_RANGE("mpi.wait");
+        if (!requests.empty())
+            MPI_Waitall((int) requests.size(), requests.data(), MPI_STATUSES_IGNORE) || MpiFail("Wait: MPI_Waitall");
+        requests.clear();
+    }
+
+    // whether the requests have completed, without waiting; completed requests are cleared
+    bool Test(std::vector<MPI_Request> &requests)
+    {
+        int done = 1;
+        if (!requests.empty())
+            MPI_Testall((int) requests.size(), requests.data(), &done, MPI_STATUSES_IGNORE) || MpiFail("Test: MPI_Testall");
+        if (done)
+            requests.clear();
+        return done != 0;
+    }
+
+    static int CommSize(MPI_Comm comm)
+    {
+        int size;
+        MPI_Comm_size(comm, &size) || MpiFail("CommSize: MPI_Comm_size");
+        return size;
+    }
+
     template <class ElemType>
     void Bcast(ElemType *pData, size_t nData, size_t srcRank)
     {
         if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
         {
+            CNTK_RANGE("mpi.bcast");
+            CNTK_COUNTER_ADD("mpi.bcastBytes", (long long) (nData * sizeof(ElemType)));
             MPI_Bcast(pData, (int) nData, GetDataType(pData), (int) srcRank, Communicator()) || MpiFail("Bcast: MPI_Bcast");
         }
     }
@@ -308,6 +638,7 @@ public:
     // wait for all ranks to reach here
     void WaitAll()
     {
+        CNTK_RANGE("mpi.barrier");
         MPI_Barrier(m_currentComm) || MpiFail("waitall: MPI_Barrier");
     }
 };
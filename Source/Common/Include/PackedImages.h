@@ -0,0 +1,141 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PackedImages.h -- the images of a minibatch as they come out of the decoder, with the crop that each of them gets
+//
+// Instead of cropping, scaling, subtracting the mean and transposing every image on the CPU, a reader can hand over the images
+// in their decoded form (8 bits per value, HWC, of any size) together with what to do with them; the consumer then produces
+// the network input in one pass over it (Matrix::AssignPackedImages()), which on the GPU is a single kernel. The packed form is
+// one contiguous block of
+//  - a PackedImagesHeader,
+//  - the PackedImage of each image (the columns of the output),
+//  - the mean to subtract (m_meanSize floats in the HWC layout of the output; none if 0),
+//  - the pixels of all images.
+// PackedImageValue() computes one value of the output; the CPU and GPU implementations share it.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __CUDACC__
+#define PACKED_IMAGES_FUNCTION __host__ __device__
+#else
+#define PACKED_IMAGES_FUNCTION
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct PackedImagesHeader
+{
+    uint64_t m_totalSize; // of the whole block, in bytes
+    uint32_t m_numImages;
+    uint32_t m_width; // of the output images
+    uint32_t m_height;
+    uint32_t m_channels;
+    uint32_t m_transpose; // 1: the output is CHW, 0: HWC
+    uint32_t m_meanSize;  // 0, or m_width * m_height * m_channels
+};
+
+enum PackedImageInterpolation
+{
+    packedImageNearest = 0, // as cv::INTER_NEAREST
+    packedImageLinear = 1   // as cv::INTER_LINEAR
+};
+
+struct PackedImage
+{
+    uint64_t m_offset; // of its first value, from the start of the pixels
+    uint32_t m_width;
+    uint32_t m_height; // (the number of channels is that of the output)
+    uint32_t m_cropX;  // the region that is scaled to the output size
+    uint32_t m_cropY;
+    uint32_t m_cropWidth;
+    uint32_t m_cropHeight;
+    uint32_t m_flip;          // mirror horizontally
+    uint32_t m_interpolation; // PackedImageInterpolation
+};
+
+static_assert(sizeof(PackedImagesHeader) % 8 == 0 && sizeof(PackedImage) % 8 == 0, "PackedImages: the parts of the block must stay aligned");
+
+inline PACKED_IMAGES_FUNCTION const PackedImage* PackedImagesImages(const PackedImagesHeader* header)
+{
+    return reinterpret_cast<const PackedImage*>(header + 1);
+}
+
+inline PACKED_IMAGES_FUNCTION const float* PackedImagesMean(const PackedImagesHeader* header)
+{
+    return reinterpret_cast<const float*>(PackedImagesImages(header) + header->m_numImages);
+}
+
+inline PACKED_IMAGES_FUNCTION const unsigned char* PackedImagesPixels(const PackedImagesHeader* header)
+{
+    return reinterpret_cast<const unsigned char*>(PackedImagesMean(header) + header->m_meanSize);
+}
+
+inline size_t PackedImagesSize(size_t numImages, size_t meanSize, size_t numPixelBytes)
+{
+    return sizeof(PackedImagesHeader) + numImages * sizeof(PackedImage) + meanSize * sizeof(float) + numPixelBytes;
+}
+
+// value 'row' of output column 'column': crop, mirror, scale, subtract the mean, in that order
+template <class ElemType>
+inline PACKED_IMAGES_FUNCTION ElemType PackedImageValue(const PackedImagesHeader* header, size_t row, size_t column)
+{
+    const size_t width = header->m_width;
+    const size_t height = header->m_height;
+    const size_t channels = header->m_channels;
+    size_t x, y, c;
+    if (header->m_transpose)
+    {
+        x = row % width;
+        y = row / width % height;
+        c = row / (width * height);
+    }
+    else
+    {
+        c = row % channels;
+        x = row / channels % width;
+        y = row / (channels * width);
+    }
+
+    const PackedImage& image = PackedImagesImages(header)[column];
+    const unsigned char* pixels = PackedImagesPixels(header) + image.m_offset;
+    const size_t stride = image.m_width * channels;
+    const size_t sourceX = image.m_flip ? width - 1 - x : x; // (mirroring the crop and then scaling it is the same as the reverse)
+    const size_t lastX = image.m_cropX + image.m_cropWidth - 1;
+    const size_t lastY = image.m_cropY + image.m_cropHeight - 1;
+
+    float value;
+    if (image.m_interpolation == packedImageNearest)
+    {
+        size_t ix = image.m_cropX + (size_t)(sourceX * ((float) image.m_cropWidth / width));
+        size_t iy = image.m_cropY + (size_t)(y * ((float) image.m_cropHeight / height));
+        ix = ix < lastX ? ix : lastX;
+        iy = iy < lastY ? iy : lastY;
+        value = pixels[iy * stride + ix * channels + c];
+    }
+    else
+    {
+        // the center of the output pixel in the crop, clamped to the crop (as cv::resize() does for an ROI)
+        float fx = image.m_cropX + (sourceX + 0.5f) * image.m_cropWidth / width - 0.5f;
+        float fy = image.m_cropY + (y + 0.5f) * image.m_cropHeight / height - 0.5f;
+        fx = fx > image.m_cropX ? (fx < lastX ? fx : lastX) : image.m_cropX;
+        fy = fy > image.m_cropY ? (fy < lastY ? fy : lastY) : image.m_cropY;
+        const size_t x0 = (size_t) fx;
+        const size_t y0 = (size_t) fy;
+        const size_t x1 = x0 < lastX ? x0 + 1 : lastX;
+        const size_t y1 = y0 < lastY ? y0 + 1 : lastY;
+        const float ax = fx - x0;
+        const float ay = fy - y0;
+        const float top = (1 - ax) * pixels[y0 * stride + x0 * channels + c] + ax * pixels[y0 * stride + x1 * channels + c];
+        const float bottom = (1 - ax) * pixels[y1 * stride + x0 * channels + c] + ax * pixels[y1 * stride + x1 * channels + c];
+        value = (1 - ay) * top + ay * bottom;
+    }
+    if (header->m_meanSize > 0)
+        value -= PackedImagesMean(header)[(y * width + x) * channels + c];
+    return (ElemType) value;
+}
+} } }
@@ -11,6 +11,8 @@
 #include "Matrix.h"
 #include <vector>
 #include <memory> // for shared_ptr
+#include <map>
+#include <algorithm> // for std::min
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -133,6 +135,9 @@ public:
         m_distanceToNearestEnd.assign(m_numTimeSteps, PTRDIFF_MAX);
         m_timeStepHasGap.assign(m_numTimeSteps, false);
         m_columnsValidityMask.Resize(0, 0); // invalidate
+        m_columnsValidityMaskCPU.clear();
+        m_sequenceBoundaryMasks.clear();
+        m_numActiveSequences.clear();
         // reset state
         m_numFramesDeclared = 0;
         m_numGapFrames = 0;
@@ -170,6 +175,7 @@ public:
     size_t GetActualNumSamples() const;
 
     const Matrix<char>& GetColumnsValidityMask(DEVICEID_TYPE deviceId) const;
+    const Matrix<char>& GetSequenceBoundaryMask(ptrdiff_t timeOffset, DEVICEID_TYPE deviceId) const;
 
     // compare whether two layouts are the same
     bool operator==(const MBLayout &other) const
@@ -307,6 +313,7 @@ public:
 
     bool HasGaps() const;
     bool HasGaps(const FrameRange &fr) const;
+    size_t GetNumActiveSequences(size_t t) const;
 
     // test boundary flags for a specific condition
     bool IsBeyondStartOrEnd(const FrameRange &fr) const;
@@ -398,10 +405,17 @@ private:
     // A value of 1 indicates that the column has valid content
     // and 0 indicates invalid (aka MinibatchPackingFlags::NoInput)
     mutable Matrix<char> m_columnsValidityMask;
+    mutable vector<char> m_columnsValidityMaskCPU; // (CPU-side copy, so that moving the mask to another device does not walk the layout again)
+
+    // Cached masks for crossing sequence boundaries, one per time offset, see GetSequenceBoundaryMask()
+    mutable map<ptrdiff_t, shared_ptr<Matrix<char>>> m_sequenceBoundaryMasks;
+
+    // Cached GetNumActiveSequences(t) for all t
+    mutable vector<size_t> m_numActiveSequences;
 
     // A boolean flag indicating whether the MBLayout can be further modified
     // When it's value is false, no set operations are allowed on the MBLayout.
-    // Meant to guard in lazy creation of m_columnsValidityMask.
+    // Meant to guard in lazy creation of m_columnsValidityMask and the other cached information above.
     mutable bool m_writable;
 
 public:
@@ -449,6 +463,7 @@ public:                       // TODO: make private (currently used from masking
     ptrdiff_t m_timeOffset;   // this is added to timeIdxInSeq wherever it is used
     size_t m_timeRange;       // use this to describe a custom range > 1 frame
     size_t seqIndex;          // parallel-sequence index; SIZE_MAX = all sequences in MB (most common case)  --TODO: Bad name, 'sequence' and 'parallel sequence' are two different things
+    size_t m_numActiveSequences; // if seqIndex == SIZE_MAX: only the parallel sequences [0, m_numActiveSequences) of the time step; SIZE_MAX = all
     MBLayoutPtr m_pMBLayout;  // layout associated with this
     bool m_broadcastAllowed;  // frame range may be broadcast from outer layout (e.g. a matrix with NULL layout and 1 column is acceptable to this frame range). Only applies when iterating over time; otherwise broadcasting is always OK.
     const FrameRange *parent; // or NULL: parent range, relative to which this FrameRange is interpreted  --TODO: not used yet
@@ -456,7 +471,7 @@ public:                       // TODO: make private (currently used from masking
 public:
     // can construct from a single size_t -> a single-frame range
     FrameRange(MBLayoutPtr pMBLayout, size_t timeIdxInSeq)
-        : timeIdxInSeq(timeIdxInSeq), m_timeOffset(0), m_timeRange(1), seqIndex(SIZE_MAX), m_pMBLayout(pMBLayout), m_broadcastAllowed(false), parent(nullptr)
+        : timeIdxInSeq(timeIdxInSeq), m_timeOffset(0), m_timeRange(1), seqIndex(SIZE_MAX), m_numActiveSequences(SIZE_MAX), m_pMBLayout(pMBLayout), m_broadcastAllowed(false), parent(nullptr)
     {
     }
 
@@ -490,6 +505,16 @@ public:
         return ret;
     }
 
+    // create a FrameRange that accesses the first 'numSequences' parallel sequences of a time step only (SIZE_MAX: all)
+    // The others must be gaps, e.g. sequences that have ended (see MBLayout::GetNumActiveSequences()). Since the columns
+    // of a time step are consecutive, these are a contiguous column range.
+    FrameRange ActiveSequences(size_t numSequences) const
+    {
+        FrameRange ret = *this;
+        ret.m_numActiveSequences = numSequences;
+        return ret;
+    }
+
     // create a FrameRange with its MBLayout replaced by another
     // You must check yourself whether this is correct.
     FrameRange WithLayout(MBLayoutPtr pMBLayout) const
@@ -554,7 +579,7 @@ public:
     };
     IndexIteration GetSequenceRange(const shared_ptr<MBLayout> &pMBLayout) const
     {
-        return IndexIteration(seqIndex == SIZE_MAX ? 0 : seqIndex, seqIndex == SIZE_MAX ? pMBLayout->GetNumParallelSequences() : seqIndex + 1);
+        return IndexIteration(seqIndex == SIZE_MAX ? 0 : seqIndex, seqIndex == SIZE_MAX ? std::min(pMBLayout->GetNumParallelSequences(), m_numActiveSequences) : seqIndex + 1);
     }
 
     // code that can only handle single-frame ranges will call t() to get the time index, which will throw if numFrames != 1
@@ -595,10 +620,34 @@ inline bool MBLayout::HasGaps(const FrameRange &fr) const
     CheckIsValid();
     if (fr.IsAllFrames())
         return m_numGapFrames > 0; // test entire minibatch
-    if (fr.seqIndex == SIZE_MAX)
+    if (fr.seqIndex == SIZE_MAX && fr.m_numActiveSequences >= m_numParallelSequences)
         return m_timeStepHasGap[fr.timeIdxInSeq]; // test all seq for one time step
     else
-        return IsGap(fr); // test one sequence
+        return IsGap(fr); // test one sequence, or the active ones
+}
+
+// number of parallel sequences up to the last one that is not a gap in time step 't'
+// A loop may step the time step on these only (FrameRange::ActiveSequences()); with the sequences sorted by length, the
+// sequences that have ended are exactly the ones left out.
+inline size_t MBLayout::GetNumActiveSequences(size_t t) const
+{
+    CheckIsValid();
+    if (!m_timeStepHasGap[t])
+        return m_numParallelSequences;
+    // lazily determine them for all time steps, since loops ask for every step, and every loop of the network asks again
+    if (m_numActiveSequences.empty())
+    {
+        Lock();
+        m_numActiveSequences.resize(m_numTimeSteps);
+        for (size_t t2 = 0; t2 < m_numTimeSteps; t2++)
+        {
+            size_t numActiveSequences = m_numParallelSequences;
+            while (m_timeStepHasGap[t2] && numActiveSequences > 0 && m_distanceToStart(numActiveSequences - 1, t2) < 0)
+                numActiveSequences--;
+            m_numActiveSequences[t2] = numActiveSequences;
+        }
+    }
+    return m_numActiveSequences[t];
 }
 
 // test whether a given frame is or contains a gap
@@ -611,6 +660,17 @@ inline bool MBLayout::IsGap(const FrameRange &fr) const
 
     const auto t = fr.timeIdxInSeq; // we test off the frame without offset
     const auto s = fr.seqIndex;
+    if (s == SIZE_MAX && fr.m_numActiveSequences < m_numParallelSequences) // aggregate over the active sequences requested
+    {
+        if (!m_timeStepHasGap[t])
+            return false;
+        for (size_t s2 = 0; s2 < fr.m_numActiveSequences; s2++)
+        {
+            if (m_distanceToStart(s2, t) < 0)
+                return true;
+        }
+        return false;
+    }
     if (s == SIZE_MAX) // aggregate requested
         return m_timeStepHasGap[t];
 
@@ -628,6 +688,15 @@ inline bool MBLayout::IsBeyondStartOrEnd(const FrameRange &fr) const
 
     const auto t = fr.timeIdxInSeq; // we test off the frame without offset
     const auto s = fr.seqIndex;
+    if (s == SIZE_MAX && fr.m_numActiveSequences < m_numParallelSequences) // aggregate over the active sequences requested
+    {
+        for (size_t s2 = 0; s2 < fr.m_numActiveSequences; s2++)
+        {
+            if (IsBeyondStartOrEnd(fr.Sequence(s2)))
+                return true;
+        }
+        return false;
+    }
     if (s == SIZE_MAX) // aggregate requested
     {
         // determine flags from aggregate vectors
@@ -664,49 +733,78 @@ inline bool MBLayout::IsBeyondStartOrEnd(const FrameRange &fr) const
 inline size_t MBLayout::GetActualNumSamples() const { return m_numFramesDeclared - m_numGapFrames; }
 
 // return m_columnsValidityMask(,), which is lazily created here upon first call
-// only called from MaskMissingColumnsTo()
-// TODO: Can probably be faster by using the sequence array directly.
-// TODO: Or should we just blast m_distanceToStart to GPU, and maks based on that? It is small compared to features.
+// It is formed from the gap entries of m_sequences once per minibatch, and moved to 'deviceId' if it was last asked for on another device.
 inline const Matrix<char> &MBLayout::GetColumnsValidityMask(DEVICEID_TYPE deviceId) const
 {
     CheckIsValid();
+    size_t nT = GetNumTimeSteps();
+    size_t nS = GetNumParallelSequences();
+
     // lazily compute the validity mask
-    if (m_columnsValidityMask.IsEmpty())
+    if (m_columnsValidityMaskCPU.empty())
     {
         assert(HasGaps()); // must only be called if there are gaps
         Lock();
 
-        // Determine indices of all invalid columns in the minibatch
-        // TODO: This can be done more efficiently by using m_sequences[].
-        size_t nT = GetNumTimeSteps();
-        size_t nS = GetNumParallelSequences();
-
-        std::vector<char> columnsValidityMask(nT * nS, 1); // form the mask in a CPU-side STL vector first
+        std::vector<char> &columnsValidityMask = m_columnsValidityMaskCPU; // form the mask in a CPU-side STL vector first
+        columnsValidityMask.assign(nT * nS, 1);
         size_t gapsFound = 0;
-        for (size_t t = 0; t < nT; t++)
+        for (const auto &seq : m_sequences)
         {
-            FrameRange fr(nullptr, t);
-            if (IsGap(fr))
-            {
-                for (size_t s = 0; s < nS; s++)
-                {
-                    if (IsGap(fr.Sequence(s)))
-                    {
-                        columnsValidityMask[(t * nS) + s] = 0;
-                        gapsFound++;
-                    }
-                }
-            }
+            if (seq.seqId != GAP_SEQUENCE_ID)
+                continue;
+            size_t b = (size_t) max(seq.tBegin, (ptrdiff_t) 0);
+            size_t e = min(seq.tEnd, nT);
+            for (size_t t = b; t < e; t++)
+                columnsValidityMask[(t * nS) + seq.s] = 0;
+            gapsFound += e - b;
         }
         assert(gapsFound == m_numGapFrames); // sanity check
-
+        UNUSED(gapsFound);
+    }
+    if (m_columnsValidityMask.IsEmpty() || deviceId != m_columnsValidityMask.GetDeviceId())
+    {
         if (deviceId != m_columnsValidityMask.GetDeviceId())
             m_columnsValidityMask = Matrix<char>(deviceId);
-        m_columnsValidityMask.SetValue(1, nS * nT, deviceId, columnsValidityMask.data());
+        m_columnsValidityMask.SetValue(1, nS * nT, deviceId, m_columnsValidityMaskCPU.data());
     }
     return m_columnsValidityMask;
 }
 
+// return a mask that is 0 for the columns (s,t) for which (s,t + timeOffset) lies beyond the start or end of their sequence,
+// i.e. IsBeyondStartOrEnd(FrameRange(t).Sequence(s).WithTimeOffset(timeOffset)), and 1 otherwise (including gaps)
+// This lets a recurrence reset its state at the sequence boundaries of a time step with one masking operation. It is lazily
+// created upon first call for each time offset.
+inline const Matrix<char> &MBLayout::GetSequenceBoundaryMask(ptrdiff_t timeOffset, DEVICEID_TYPE deviceId) const
+{
+    CheckIsValid();
+    auto &mask = m_sequenceBoundaryMasks[timeOffset];
+    if (!mask || mask->GetDeviceId() != deviceId)
+    {
+        Lock();
+
+        size_t nT = GetNumTimeSteps();
+        size_t nS = GetNumParallelSequences();
+        std::vector<char> boundaryMask(nT * nS, 1);
+        for (const auto &seq : m_sequences)
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            size_t b = (size_t) max(seq.tBegin, (ptrdiff_t) 0);
+            size_t e = min(seq.tEnd, nT);
+            for (size_t t = b; t < e; t++)
+            {
+                ptrdiff_t tOffset = (ptrdiff_t) t + timeOffset;
+                if (tOffset < seq.tBegin || tOffset >= (ptrdiff_t) seq.tEnd)
+                    boundaryMask[(t * nS) + seq.s] = 0;
+            }
+        }
+        mask = make_shared<Matrix<char>>(deviceId);
+        mask->SetValue(1, nS * nT, deviceId, boundaryMask.data());
+    }
+    return *mask;
+}
+
 // class for defining an iteration over a sequence, forward and backward
 // One day, we may also have nested structures. For those, FrameRangeIterations will be able to be instantiated from FrameRange objects to loop over their nested dimension.
 class FrameRangeIteration
@@ -823,7 +921,13 @@ static inline std::pair<size_t, size_t> ColumnRangeWithMBLayoutFor(size_t numCol
         size_t startColumn = (fr.timeIdxInSeq + fr.m_timeOffset) * numParallelSequences;
         if (startColumn >= numCols)
             LogicError("DataFor: FrameRange specifies a time index that is out of range.");
-        if (fr.seqIndex == SIZE_MAX)
+        if (fr.seqIndex == SIZE_MAX && fr.m_numActiveSequences < numParallelSequences)
+        {
+            if (fr.m_timeRange != 1)
+                LogicError("DataFor: FrameRange only supports active sequences of single time steps.");
+            return std::pair<size_t, size_t>(startColumn, fr.m_numActiveSequences);
+        }
+        else if (fr.seqIndex == SIZE_MAX)
             return std::pair<size_t, size_t>(startColumn, numParallelSequences * fr.m_timeRange);
         else if (fr.m_timeRange != 1)
             LogicError("DataFor: FrameRange only support per-sequence time ranges with tensor slices, not matrix slices.");
@@ -932,6 +1036,12 @@ static inline std::pair<DimensionVector, DimensionVector> TensorSliceWithMBLayou
             }
         }
     }
+    else if (fr.m_numActiveSequences != SIZE_MAX && pMBLayout && isTimeIteration && !fr.IsAllFrames()) // active sequences requested?
+    {
+        size_t sequenceDim = shape.size() - 2;
+        if (result.second[sequenceDim] > fr.m_numActiveSequences)
+            result.second[sequenceDim] = (ElemType) fr.m_numActiveSequences;
+    }
 
     return result;
 }
@@ -966,4 +1076,17 @@ static inline void MaskMissingColumnsTo(Matrix<ElemType> &matrixToMask, const MB
 #endif
     }
 }
+
+// This sets the columns of 'frameData', which holds the single time step of 'fr' without its time offset, to 'val' where the frame
+// 'fr' with its time offset lies beyond the start or end of the sequence. Recurrences call this to reset their state at boundaries.
+template <class ElemType>
+static inline void MaskSequenceBoundariesTo(Matrix<ElemType> &frameData, const MBLayoutPtr &pMBLayout, const FrameRange &fr, ElemType val)
+{
+    if (pMBLayout->IsBeyondStartOrEnd(fr))
+    {
+        const auto &maskMatrix = pMBLayout->GetSequenceBoundaryMask(fr.m_timeOffset, frameData.GetDeviceId());
+        auto maskSlice = DataWithMBLayoutFor(maskMatrix, fr.WithTimeOffset(-fr.m_timeOffset), pMBLayout);
+        frameData.MaskColumnsValue(maskSlice, val);
+    }
+}
 } } }
@@ -0,0 +1,131 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// WorkerPool.h -- bounded queues and worker pools for pipelining work across threads
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// BoundedQueue -- FIFO of limited capacity between two pipeline stages.
+// Push() blocks while the queue is full and Pop() while it is empty, so a fast producer cannot run away from
+// its consumer. Close() releases all waiting callers.
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1), m_closed(false)
+    {
+    }
+
+    // Blocks while the queue is full. Returns false (and drops 'item') if the queue has been closed.
+    bool Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+            return false;
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns false once the queue has been closed and drained.
+    bool Pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+            return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // Fails all further Push() calls; Pop() still hands out the remaining items.
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed;
+};
+
+// WorkerPool -- a fixed set of threads that run the tasks of a bounded queue in order of submission.
+// Submit() returns the future of the task's result; exceptions thrown by a task are delivered through it.
+class WorkerPool
+{
+public:
+    WorkerPool(size_t numThreads, size_t queueDepth)
+        : m_tasks(queueDepth)
+    {
+        if (numThreads == 0)
+            numThreads = 1;
+        for (size_t i = 0; i < numThreads; i++)
+        {
+            m_threads.push_back(std::thread([this]()
+                                            {
+                                                std::function<void()> task;
+                                                while (m_tasks.Pop(task))
+                                                    task();
+                                            }));
+        }
+    }
+
+    // Runs the tasks that are still queued, then joins the threads.
+    ~WorkerPool()
+    {
+        m_tasks.Close();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    size_t NumThreads() const
+    {
+        return m_threads.size();
+    }
+
+    // Queues 'function'; blocks while the task queue is full.
+    template <class Function>
+    auto Submit(Function function) -> std::future<decltype(function())>
+    {
+        typedef decltype(function()) ResultType;
+        auto task = std::make_shared<std::packaged_task<ResultType()>>(std::move(function));
+        std::future<ResultType> result = task->get_future();
+        if (!m_tasks.Push([task]() { (*task)(); }))
+            LogicError("WorkerPool: task submitted to a pool that is shutting down.");
+        return result;
+    }
+
+private:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    BoundedQueue<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+};
+
+} } }
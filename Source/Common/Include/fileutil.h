@@ -638,6 +638,37 @@ bool fuptodate(const std::wstring& target, const std::wstring& input, bool input
 };
 };
 
+// ----------------------------------------------------------------------------
+// mappedfile -- a file memory-mapped for reading
+// ----------------------------------------------------------------------------
+
+namespace msra { namespace files {
+
+class mappedfile
+{
+    const char* mapped;
+    size_t mappedsize;
+    void* maphandle; // (Windows only)
+    mappedfile(const mappedfile&);
+    void operator=(const mappedfile&);
+
+public:
+    mappedfile(const std::wstring& path); // throws if the file cannot be mapped
+    ~mappedfile();
+    const char* data() const
+    {
+        return mapped;
+    }
+    size_t size() const
+    {
+        return mappedsize;
+    }
+    // tell the OS that bytes [begin, end) will be needed soon (prefetch) or not anymore (they may be evicted from the page cache)
+    void advise(size_t begin, size_t end, bool willneed) const;
+};
+};
+};
+
 #ifdef _WIN32
 // ----------------------------------------------------------------------------
 // simple support for WAV file I/O
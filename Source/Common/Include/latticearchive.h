@@ -22,6 +22,8 @@
 #include <string>
 #include <unordered_map>
 #include <algorithm> // for find()
+#include <memory>
+#include <mutex>
 #include "simplesenonehmm.h"
 #include "Matrix.h"
 
@@ -57,6 +59,28 @@ typedef msra::math::ssematrix<matrixbase> matrix;
 typedef msra::math::ssematrixstriperef<matrixbase> matrixstripe;
 class littlematrixheap;
 
+// ===========================================================================
+// memoryreader -- sequential reads from a memory range, e.g. a lattice in a memory-mapped archive
+// ===========================================================================
+class memoryreader
+{
+    const char* p;
+    const char* end;
+
+public:
+    memoryreader(const char* begin, const char* end)
+        : p(begin), end(end)
+    {
+    }
+    void read(void* buf, size_t n)
+    {
+        if (n > (size_t)(end - p))
+            RuntimeError("memoryreader: unexpected end of data");
+        memcpy(buf, p, n);
+        p += n;
+    }
+};
+
 enum mbrclassdefinition // used to identify definition of class in minimum bayesian risk
 {
     senone = 1, // senone is default, which means no mapping; sMBR
@@ -95,6 +119,7 @@ class lattice
     std::vector<nodeinfo> nodes;
     std::vector<edgeinfowithscores> edges;
     std::vector<aligninfo> align;
+    std::vector<unsigned char> packed; // nodes, edges, and align in compact form while compact() (empty otherwise)
     // V2 lattices  --for a while, we will store both in RAM, until all code is updated
     static int fsgn(float f)
     {
@@ -695,6 +720,15 @@ private:
                               std::vector<float>& edgeacscores, const msra::math::ssematrixbase& logLLs,
                               edgealignments& thisedgealignments, backpointers& thisbackpointers, array_ref<size_t>& uids, const_array_ref<size_t> bounds) const;
 
+    // phases 1 and 2 of forwardbackwardalign(): allocate the per-edge matrices that are needed, and align on the CPU the edges that the GPU does not handle (/sil/)
+    void alignedgesoncpu(parallelstate& parallelstate, const msra::asr::simplesenonehmm& hset, const bool softalignstates,
+                         const double minlogpp, const std::vector<double>& origlogpps,
+                         std::vector<msra::math::ssematrixbase*>& abcs, littlematrixheap& matrixheap,
+                         std::vector<float>& edgeacscores, const msra::math::ssematrixbase& logLLs, edgealignments& thisedgealignments) const;
+    // same without pruning, for forwardbackwardbatch(); the per-edge matrices are released on return
+    void alignedgesoncpu(parallelstate& parallelstate, const msra::asr::simplesenonehmm& hset,
+                         std::vector<float>& edgeacscores, const msra::math::ssematrixbase& logLLs, edgealignments& thisedgealignments) const;
+
     double forwardbackwardlatticesMBR(const std::vector<float>& edgeacscores, const msra::asr::simplesenonehmm& hset,
                                       const std::vector<double>& logalphas, const std::vector<double>& logbetas,
                                       const float lmf, const float wp, const float amf, const_array_ref<size_t>& uids,
@@ -739,6 +773,9 @@ private:
     void parallelmmierrorsignal(parallelstate& parallelstate, const edgealignments& thisedgealignments,
                                 const std::vector<double>& logpps, msra::math::ssematrixbase& errorsignal) const;
 
+    // split the edges into the batches of the forward and backward kernel launches (edges within a batch do not depend on each other)
+    void getlaunchbatches(std::vector<size_t>& batchsizeforward, std::vector<size_t>& batchsizebackward) const;
+
     double parallelforwardbackwardlattice(parallelstate& parallelstate, const std::vector<float>& edgeacscores,
                                           const edgealignments& thisedgealignments, const float lmf, const float wp,
                                           const float amf, const float boostingfactor, std::vector<double>& logpps, std::vector<double>& logalphas,
@@ -902,6 +939,197 @@ public:
     {
         return info.numedges;
     }
+    // approximate memory footprint in bytes, for bounding lattice caches
+    size_t getmemorysize() const
+    {
+        return sizeof(*this) + nodes.capacity() * sizeof(nodes[0]) + edges.capacity() * sizeof(edges[0]) + align.capacity() * sizeof(align[0]) +
+               edges2.capacity() * sizeof(edges2[0]) + uniquededgedatatokens.capacity() * sizeof(uniquededgedatatokens[0]) + packed.capacity();
+    }
+
+private:
+    // variable-length integers: 7 bits per byte, low bits first; signed values are zigzag-coded (0, -1, 1, -2, ...)
+    static void putunsigned(std::vector<unsigned char>& out, size_t v)
+    {
+        for (; v >= 0x80; v >>= 7)
+            out.push_back((unsigned char) (v | 0x80));
+        out.push_back((unsigned char) v);
+    }
+    static void putsigned(std::vector<unsigned char>& out, ptrdiff_t v)
+    {
+        putunsigned(out, v < 0 ? (((size_t) -(v + 1)) << 1) | 1 : ((size_t) v) << 1);
+    }
+    static void putfloat(std::vector<unsigned char>& out, float f)
+    {
+        const unsigned char* p = (const unsigned char*) &f;
+        out.insert(out.end(), p, p + sizeof(f));
+    }
+    static size_t getunsigned(const unsigned char*& p, const unsigned char* end)
+    {
+        size_t v = 0;
+        for (size_t shift = 0;; shift += 7)
+        {
+            if (p == end)
+                LogicError("expand: compact lattice data truncated");
+            const unsigned char b = *p++;
+            v |= ((size_t) (b & 0x7f)) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+    }
+    static ptrdiff_t getsigned(const unsigned char*& p, const unsigned char* end)
+    {
+        const size_t v = getunsigned(p, end);
+        return (v & 1) ? -(ptrdiff_t) (v >> 1) - 1 : (ptrdiff_t) (v >> 1);
+    }
+    static float getfloat(const unsigned char*& p, const unsigned char* end)
+    {
+        float f;
+        if (end - p < (ptrdiff_t) sizeof(f))
+            LogicError("expand: compact lattice data truncated");
+        memcpy(&f, p, sizeof(f));
+        p += sizeof(f);
+        return f;
+    }
+    static bool samealign(const_array_ref<aligninfo> a1, const_array_ref<aligninfo> a2)
+    {
+        if (a1.size() != a2.size())
+            return false;
+        foreach_index (k, a1)
+        {
+            if (memcmp(&a1[k], &a2[k], sizeof(a1[k])) != 0)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    // Compact form, for lattices that are held but not in use (e.g. those of the chunks in RAM), expanded again right before
+    // they are used. Node times and edge node indices are delta-coded, and all integers (incl. unit ids and durations) take
+    // as few bytes as their values need. The alignment of an edge is replaced by a reference to an earlier edge if that one
+    // has the same alignment, and the AC score if it equals that of the previous edge (e.g. all LOGZERO without AC scores).
+    // Lossless: LM and AC scores are kept as they are. Meanwhile, 'nodes', 'edges', and 'align' are empty.
+    bool iscompact() const
+    {
+        return !packed.empty();
+    }
+
+    void compact()
+    {
+        if (iscompact() || edges.empty())
+            return;
+        std::vector<unsigned char> out;
+        out.reserve(nodes.size() + edges.size() * 8 + align.size() * 3);
+        putunsigned(out, nodes.size());
+        putunsigned(out, edges.size());
+        putunsigned(out, align.size());
+        size_t prevt = 0;
+        for (const auto& node : nodes)
+        {
+            putsigned(out, (ptrdiff_t) node.t - (ptrdiff_t) prevt);
+            prevt = node.t;
+        }
+        std::unordered_map<size_t, size_t> firstedgewith; // [hash of an alignment] -> first edge with that alignment
+        size_t prevS = 0;
+        size_t alignpos = 0;
+        foreach_index (j, edges)
+        {
+            const auto& e = edges[j];
+            if (e.firstalign != alignpos) // (the format relies on the alignments being stored in edge order)
+                return;
+            const auto a = getaligninfo(j);
+            alignpos += a.size();
+            size_t hash = a.size();
+            foreach_index (k, a)
+                hash = hash * 1000003 + (((size_t) a[k].unit << 11) | a[k].frames);
+            auto iter = a.size() > 0 ? firstedgewith.find(hash) : firstedgewith.end();
+            const bool isrepeat = iter != firstedgewith.end() && samealign(getaligninfo(iter->second), a);
+            const bool samea = j > 0 && memcmp(&e.a, &edges[j - 1].a, sizeof(e.a)) == 0;
+            putunsigned(out, (a.size() << 4) | ((size_t) isrepeat << 3) | ((size_t) samea << 2) | ((size_t) e.unused << 1) | (size_t) e.implysp);
+            putsigned(out, (ptrdiff_t) e.S - (ptrdiff_t) prevS);
+            putsigned(out, (ptrdiff_t) e.E - (ptrdiff_t) e.S);
+            if (!samea)
+                putfloat(out, e.a);
+            putfloat(out, e.l);
+            if (isrepeat)
+                putunsigned(out, j - iter->second);
+            else
+            {
+                foreach_index (k, a)
+                {
+                    putunsigned(out, a[k].unit);
+                    putunsigned(out, ((size_t) a[k].frames << 2) | ((size_t) a[k].unused << 1) | (size_t) a[k].last);
+                }
+                if (a.size() > 0 && iter == firstedgewith.end())
+                    firstedgewith[hash] = j;
+            }
+            prevS = e.S;
+        }
+        if (alignpos != align.size())
+            return;
+        packed.assign(out.begin(), out.end()); // (no spare capacity)
+        std::vector<nodeinfo>().swap(nodes);
+        std::vector<edgeinfowithscores>().swap(edges);
+        std::vector<aligninfo>().swap(align);
+    }
+
+    void expand()
+    {
+        if (!iscompact())
+            return;
+        const unsigned char* p = packed.data();
+        const unsigned char* end = p + packed.size();
+        nodes.resize(getunsigned(p, end));
+        edges.resize(getunsigned(p, end));
+        align.resize(getunsigned(p, end));
+        ptrdiff_t t = 0;
+        foreach_index (i, nodes)
+        {
+            t += getsigned(p, end);
+            nodes[i].t = (unsigned short) t;
+        }
+        ptrdiff_t S = 0;
+        size_t alignpos = 0;
+        foreach_index (j, edges)
+        {
+            const size_t flags = getunsigned(p, end);
+            const size_t n = flags >> 4;
+            auto& e = edges[j];
+            S += getsigned(p, end);
+            e.S = S;
+            e.E = S + getsigned(p, end);
+            e.unused = (flags >> 1) & 1;
+            e.implysp = flags & 1;
+            e.a = (flags & 4) ? edges[j - 1].a : getfloat(p, end);
+            e.l = getfloat(p, end);
+            e.firstalign = alignpos;
+            if (alignpos + n > align.size())
+                LogicError("expand: malformed compact lattice");
+            if (flags & 8)
+            {
+                const size_t back = getunsigned(p, end);
+                if (back == 0 || back > (size_t) j)
+                    LogicError("expand: malformed compact lattice");
+                const size_t src = j - back;
+                std::copy(align.begin() + edges[src].firstalign, align.begin() + edges[src].firstalign + n, align.begin() + alignpos);
+            }
+            else
+            {
+                for (size_t k = 0; k < n; k++)
+                {
+                    auto& ai = align[alignpos + k];
+                    ai.unit = (unsigned int) getunsigned(p, end);
+                    const size_t v = getunsigned(p, end);
+                    ai.frames = (unsigned int) (v >> 2);
+                    ai.unused = (v >> 1) & 1;
+                    ai.last = v & 1;
+                }
+            }
+            alignpos += n;
+        }
+        if (p != end || alignpos != align.size())
+            LogicError("expand: malformed compact lattice");
+        std::vector<unsigned char>().swap(packed);
+    }
 
     // write a tag, followed by an integer
     void fwritetag(FILE* f, const char* tag, size_t n)
@@ -943,19 +1171,42 @@ public:
     {
     }
 
-    size_t freadtag(FILE* f, const char* tag)
+    // lattices are read either from a FILE* or from a memory-mapped archive (memoryreader)
+    static void freadbytes(FILE* f, void* p, size_t n)
+    {
+        freadOrDie(p, n, 1, f);
+    }
+    static void freadbytes(memoryreader& f, void* p, size_t n)
     {
-        fcheckTag(f, tag);
-        return (unsigned int) fgetint(f);
+        f.read(p, n);
     }
 
-    template <class VECTOR>
-    void freadvector(FILE* f, const char* tag, VECTOR& v, size_t expectedsize = SIZE_MAX)
+    template <class STREAM>
+    void fchecktag(STREAM& f, const char* tag)
+    {
+        char readtag[4];
+        freadbytes(f, readtag, sizeof(readtag));
+        fcompareTag(std::string(readtag, sizeof(readtag)), tag);
+    }
+
+    template <class STREAM>
+    size_t freadtag(STREAM& f, const char* tag)
+    {
+        fchecktag(f, tag);
+        int n;
+        freadbytes(f, &n, sizeof(n));
+        return (unsigned int) n;
+    }
+
+    template <class STREAM, class VECTOR>
+    void freadvector(STREAM& f, const char* tag, VECTOR& v, size_t expectedsize = SIZE_MAX)
     {
         const size_t sz = freadtag(f, tag);
         if (expectedsize != SIZE_MAX && sz != expectedsize)
             RuntimeError("freadvector: malformed file, number of vector elements differs from head, for tag %s", tag);
-        freadOrDie(v, sz, f);
+        v.resize(sz);
+        if (sz > 0)
+            freadbytes(f, &v[0], sz * sizeof(v[0]));
     }
 
     // read from a stream
@@ -965,32 +1216,32 @@ public:
     // If this fails, the lattice is in unusable state, but it is OK to call fread() again to regain a usable object. I.e. this is safe to be used in retry loops.
     // This will also map the aligninfo entries to the new symbol table, through idmap.
     // V1 lattices will be converted. 'spsenoneid' is used in that process.
-    template <class IDMAP>
-    void fread(FILE* f, const IDMAP& idmap, size_t spunit)
+    template <class STREAM, class IDMAP>
+    void fread(STREAM& f, const IDMAP& idmap, size_t spunit)
     {
         size_t version = freadtag(f, "LAT ");
         if (version == 1)
         {
-            freadOrDie(&info, sizeof(info), 1, f);
+            freadbytes(f, &info, sizeof(info));
             freadvector(f, "NODE", nodes, info.numnodes);
             if (nodes.back().t != info.numframes)
                 RuntimeError("fread: mismatch between info.numframes and last node's time");
             freadvector(f, "EDGE", edges, info.numedges);
             freadvector(f, "ALIG", align);
-            fcheckTag(f, "END ");
+            fchecktag(f, "END ");
             // map align ids to user's symmap  --the lattice gets updated in place here
             foreach_index (k, align)
                 align[k].updateunit(idmap); // updates itself
         }
         else if (version == 2)
         {
-            freadOrDie(&info, sizeof(info), 1, f);
+            freadbytes(f, &info, sizeof(info));
             freadvector(f, "NODS", nodes, info.numnodes);
             if (nodes.back().t != info.numframes)
                 RuntimeError("fread: mismatch between info.numframes and last node's time");
             freadvector(f, "EDGS", edges2, info.numedges); // uniqued edges
             freadvector(f, "ALNS", uniquededgedatatokens); // uniqued alignments
-            fcheckTag(f, "END ");
+            fchecktag(f, "END ");
 // check if we need to map
 #if 1                                                                                     // post-bugfix for incorrect inference of spunit
             if (info.impliedspunitid != SIZE_MAX && info.impliedspunitid >= idmap.size()) // we have buggy lattices like that--what do they mean??
@@ -1069,6 +1320,7 @@ public:
     {
         struct parallelstateimpl* pimpl;
         bool cpumode;
+        float pruningbeam;
 
     public:
         parallelstate();
@@ -1099,6 +1351,18 @@ public:
         void setloglls(const Microsoft::MSR::CNTK::Matrix<double>& loglls);
         void getgamma(Microsoft::MSR::CNTK::Matrix<float>& loglls);
         void getgamma(Microsoft::MSR::CNTK::Matrix<double>& loglls);
+        // sum over t of logLLs(uids[t],t) of the LLs last passed to setloglls(), computed on the GPU
+        double getlogllsum(const std::vector<unsigned short>& uids);
+        // GPU only: before the forward-backward, drop the edges whose best path is more than 'beam' (in path-score units,
+        // i.e. after scaling by 1/amf) below the best path of the lattice; 0 disables pruning
+        void setpruningbeam(float beam)
+        {
+            pruningbeam = beam;
+        }
+        float getpruningbeam() const
+        {
+            return pruningbeam;
+        }
     };
 
     // forward-backward function
@@ -1108,6 +1372,16 @@ public:
                            const float lmf, const float wp, const float amf, const float boostingfactor, const bool sMBRmode, array_ref<size_t> uids, const_array_ref<size_t> bounds = const_array_ref<size_t>(),
                            const_array_ref<htkmlfwordsequence::word> transcript = const_array_ref<htkmlfwordsequence::word>(), const std::vector<float>& transcriptunigrams = std::vector<float>()) const;
 
+    // forward-backward for all lattices of a minibatch at once (defined in parallelforwardbackward.cpp)
+    // The lattices are concatenated into one node/edge array on the GPU, so that each kernel launch covers all of them.
+    // logLLs, result, and uids span the frames of all lattices, in order. The resulting gammas are left on the GPU; get them with parallelstate::getgamma().
+    // avlogps[i] receives what forwardbackward() would have returned for lattice i.
+    // Returns false, without doing anything, if batching is not possible (no GPU, or the minibatch exceeds the index ranges of the lattice storage types).
+    static bool forwardbackwardbatch(parallelstate& parallelstate, const std::vector<const lattice*>& lattices,
+                                     const class msra::math::ssematrixbase& logLLs, const class msra::asr::simplesenonehmm& hmms,
+                                     const class msra::math::ssematrixbase& result, const float lmf, const float wp, const float amf,
+                                     const float boostingfactor, const bool sMBRmode, const_array_ref<size_t> uids, std::vector<double>& avlogps);
+
     std::wstring key; // (keep our own name (key) so we can identify ourselves for diagnostics messages)
     const wchar_t* getkey() const
     {
@@ -1211,9 +1485,9 @@ class archive
     };
     static_assert(sizeof(latticeref) == 8, "unexpected byte size of struct latticeref");
 
-    mutable size_t currentarchiveindex;               // which archive is open
-    mutable auto_file_ptr f;                          // cached archive file handle of currentarchiveindex
-    std::unordered_map<std::wstring, latticeref> toc; // [key] -> (file, offset)  --table of content (.toc file)
+    mutable std::vector<std::unique_ptr<msra::files::mappedfile>> mappedarchives; // [archiveindex] archive files, memory-mapped on first use
+    mutable std::mutex mutex;                                                     // guards symmaps and mappedarchives, so that getlattice() can be called concurrently
+    std::unordered_map<std::wstring, latticeref> toc;                             // [key] -> (file, offset)  --table of content (.toc file)
 public:
     // construct = open the archive
     // archive() : currentarchiveindex (SIZE_MAX) {}
@@ -1229,7 +1503,7 @@ public:
 
     // construct from a list of TOC files
     archive(const std::vector<std::wstring>& tocpaths, const std::unordered_map<std::string, size_t>& modelsymmap, const std::wstring prefixPath = L"")
-        : currentarchiveindex(SIZE_MAX), modelsymmap(modelsymmap), prefixPathInToc(prefixPath), verbosity(0)
+        : modelsymmap(modelsymmap), prefixPathInToc(prefixPath), verbosity(0)
     {
         if (tocpaths.empty()) // nothing to read--keep silent
             return;
@@ -1294,6 +1568,7 @@ public:
 
         // initialize symmaps  --alloc the array, but actually read the symmap on demand
         symmaps.resize(archivepaths.size());
+        mappedarchives.resize(archivepaths.size()); // (likewise, archives are mapped on demand)
     }
 
     // check if a lattice for a given key is available  --do this during initial check ideally
@@ -1315,6 +1590,7 @@ public:
 #endif
 
     // get a lattice
+    // The lattice is deserialized directly from the memory-mapped archive file. This function is thread-safe.
     // This function is designed to be called from a retry loop due to the realistic chance of server disconnects or other server failures.
     // 'key' is supposed to be known to exist. Use haslattice() to ensure. This is because this function is called from a retry loop.
     // Lattices will have unit ids updated according to the modelsymmap.
@@ -1328,39 +1604,35 @@ public:
         // get the archive that the lattice lives in and its byte offset
         const size_t archiveindex = iter->second.archiveindex;
         const auto offset = iter->second.offset;
-        // get id map (used below); this may lazily load a .symlist file. We do it here rather than later w.r.t. an outer retry loop.
-        auto& idmap = getcachedidmap(archiveindex, modelsymmap); // at first time, this will load the .symlist file and create a mapping to the user SYMMAP
-        const size_t spunit = idmap.back();                      // ugh--getcachedidmap() just appends it to the end
+        const msra::files::mappedfile* archivefile;
+        const symbolidmapping* idmapp;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // get id map (used below); this may lazily load a .symlist file. We do it here rather than later w.r.t. an outer retry loop.
+            idmapp = &getcachedidmap(archiveindex, modelsymmap); // at first time, this will load the .symlist file and create a mapping to the user SYMMAP
+            // map the archive file in case it is not mapped yet
+            if (!mappedarchives[archiveindex])
+                mappedarchives[archiveindex].reset(new msra::files::mappedfile(archivepaths[archiveindex])); // or throw
+            archivefile = mappedarchives[archiveindex].get();
+        }
+        const auto& idmap = *idmapp;
+        const size_t spunit = idmap.back(); // ugh--getcachedidmap() just appends it to the end
 #if 1                                                            // prep for fixing the pushing of /sp/ at the end  --we actually can just look it up! Duh
         const size_t spunit2 = getid(modelsymmap, "sp");
         if (spunit2 != spunit)
             LogicError("getlattice: huh? same lookup of /sp/ gives different result?");
 #endif
-        // open archive file in case it is not the current one
-        if (archiveindex != currentarchiveindex)
-        {
-            f = fopenOrDie(archivepaths[archiveindex], L"rbS"); // or throw (will close old 'f' iff succeeded)
-            currentarchiveindex = archiveindex;
-        }
-        try // (for read operation)
-        {
-            // seek to start
-            fsetpos(f, offset);
-            // get it
-            L.fread(f, idmap, spunit);
-            L.setverbosity(verbosity);
+        if (offset >= archivefile->size())
+            RuntimeError("getlattice: lattice offset beyond end of archive file for key %ls", key.c_str());
+        // get it
+        memoryreader f(archivefile->data() + offset, archivefile->data() + archivefile->size());
+        L.fread(f, idmap, spunit);
+        L.setverbosity(verbosity);
 #ifdef HACK_IN_SILENCE // hack to simulate DEL in the lattice
-            const size_t silunit = getid(modelsymmap, "sil");
-            const bool addsp = true;
-            L.hackinsilencesubstitutionedges(silunit, spunit, addsp);
+        const size_t silunit = getid(modelsymmap, "sil");
+        const bool addsp = true;
+        L.hackinsilencesubstitutionedges(silunit, spunit, addsp);
 #endif
-        }
-        catch (...) // to retry a read error due to a disconnected file handle, we need to reopen the file
-        {
-            currentarchiveindex = SIZE_MAX;
-            f = NULL; // this closes the file handle
-            throw;
-        }
         // check if number of frames is as expected
         if (expectedframes != SIZE_MAX && L.getnumframes() != expectedframes)
             LogicError("getlattice: number of frames mismatch between numerator lattice and features");
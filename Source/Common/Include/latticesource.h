@@ -2,6 +2,13 @@
 
 #include <vector>
 #include <memory>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <iterator>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "latticearchive.h"
 
 namespace msra { namespace dbn {
@@ -30,20 +37,140 @@ public:
     {
         return second.getkey();
     }
+    size_t getmemorysize() const
+    {
+        return first.getmemorysize() + second.getmemorysize();
+    }
+    // see lattice::compact()
+    void compact()
+    {
+        first.compact();
+        second.compact();
+    }
+    bool iscompact() const
+    {
+        return first.iscompact() || second.iscompact();
+    }
+    // a copy with the full arrays, for forward-backward
+    std::shared_ptr<const latticepair> expanded() const
+    {
+        std::shared_ptr<latticepair> LP(new latticepair(*this));
+        LP->first.expand();
+        LP->second.expand();
+        return LP;
+    }
 };
 
+// Lattices of upcoming utterances can be requested ahead of time with prefetch(). They are then loaded on a background thread
+// into a cache, from which getlattices() takes them. Loading pauses while the cache holds 'maxprefetchbytes' or more,
+// and lattices that are not requested anymore by the latest prefetch() call are dropped from it.
+// With 'compactlattices', the lattices are handed out in compact form (see lattice::compact()), which takes less memory both
+// in the prefetch cache and where the caller holds them; the caller expands them (latticepair::expanded()) when it uses them.
 class latticesource
 {
+public:
+    typedef msra::dbn::latticepair latticepair;
+
+private:
     const msra::lattices::archive numlattices, denlattices;
     int verbosity;
 
+    // prefetching
+    typedef std::pair<std::wstring, size_t> prefetchrequest; // (key, expected #frames)
+    const size_t maxprefetchbytes;                           // 0 means no prefetching
+    const bool compactlattices;
+    mutable std::mutex prefetchmutex;
+    mutable std::condition_variable prefetchchanged;
+    mutable std::deque<prefetchrequest> prefetchqueue;                                                                    // lattices to load ahead, in the order they will be needed
+    mutable std::wstring prefetchinprogress;                                                                              // key the prefetch thread is loading right now
+    typedef std::unordered_map<std::wstring, std::shared_ptr<const latticepair>> prefetchcache;
+    mutable prefetchcache prefetched; // loaded ahead and not taken yet
+    mutable size_t prefetchedbytes;
+    mutable bool stopprefetching;
+    mutable std::thread prefetchthread; // started on the first prefetch() call
+
+    void loadlattices(const std::wstring& key, std::shared_ptr<const latticepair>& L, size_t expectedframes) const
+    {
+        std::shared_ptr<latticepair> LP(new latticepair);
+        denlattices.getlattice(key, LP->second, expectedframes); // this loads the lattice from disk, using the existing L.second object
+        if (compactlattices)
+            LP->compact();
+        L = LP;
+    }
+
+    void prefetchloop() const
+    {
+        std::unique_lock<std::mutex> lock(prefetchmutex);
+        for (;;)
+        {
+            prefetchchanged.wait(lock, [this]() { return stopprefetching || (!prefetchqueue.empty() && prefetchedbytes < maxprefetchbytes); });
+            if (stopprefetching)
+                return;
+            const prefetchrequest request = prefetchqueue.front();
+            prefetchqueue.pop_front();
+            if (prefetched.find(request.first) != prefetched.end())
+                continue;
+            prefetchinprogress = request.first;
+            lock.unlock();
+            std::shared_ptr<const latticepair> L;
+            try
+            {
+                loadlattices(request.first, L, request.second);
+            }
+            catch (const std::exception& e) // (getlattices() will load it again, and report the error)
+            {
+                fprintf(stderr, "latticesource: prefetching lattice for '%ls' failed: %s\n", request.first.c_str(), e.what());
+            }
+            lock.lock();
+            prefetchinprogress.clear();
+            if (L && prefetched.insert(std::make_pair(request.first, L)).second)
+                prefetchedbytes += L->getmemorysize();
+            prefetchchanged.notify_all();
+        }
+    }
+
+    // called with the lock held
+    prefetchcache::iterator dropprefetched(prefetchcache::iterator iter) const
+    {
+        prefetchedbytes -= iter->second->getmemorysize();
+        return prefetched.erase(iter);
+    }
+
+    // take a prefetched lattice if there is one, waiting for it if it is being loaded right now; returns false if it was not prefetched
+    bool takeprefetched(const std::wstring& key, std::shared_ptr<const latticepair>& L) const
+    {
+        std::unique_lock<std::mutex> lock(prefetchmutex);
+        prefetchchanged.wait(lock, [&]() { return prefetchinprogress != key; });
+        auto iter = prefetched.find(key);
+        if (iter == prefetched.end())
+            return false;
+        L = iter->second;
+        dropprefetched(iter);
+        prefetchchanged.notify_all(); // (the prefetch thread may be waiting for space)
+        return true;
+    }
+
 public:
-    typedef msra::dbn::latticepair latticepair;
-    latticesource(std::pair<std::vector<std::wstring>, std::vector<std::wstring>> latticetocs, const std::unordered_map<std::string, size_t>& modelsymmap, std::wstring RootPathInToc)
-        : numlattices(latticetocs.first, modelsymmap, RootPathInToc), denlattices(latticetocs.second, modelsymmap, RootPathInToc), verbosity(0)
+    latticesource(std::pair<std::vector<std::wstring>, std::vector<std::wstring>> latticetocs, const std::unordered_map<std::string, size_t>& modelsymmap, std::wstring RootPathInToc,
+                  size_t maxprefetchbytes = 0, bool compactlattices = false)
+        : numlattices(latticetocs.first, modelsymmap, RootPathInToc), denlattices(latticetocs.second, modelsymmap, RootPathInToc), verbosity(0),
+          maxprefetchbytes(maxprefetchbytes), compactlattices(compactlattices), prefetchedbytes(0), stopprefetching(false)
     {
     }
 
+    ~latticesource()
+    {
+        if (prefetchthread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(prefetchmutex);
+                stopprefetching = true;
+            }
+            prefetchchanged.notify_all();
+            prefetchthread.join();
+        }
+    }
+
     bool empty() const
     {
 #ifndef NONUMLATTICEMMI // TODO:set NUM lattice to null so as to save memory
@@ -64,9 +191,29 @@ public:
 
     void getlattices(const std::wstring& key, std::shared_ptr<const latticepair>& L, size_t expectedframes) const
     {
-        std::shared_ptr<latticepair> LP(new latticepair);
-        denlattices.getlattice(key, LP->second, expectedframes); // this loads the lattice from disk, using the existing L.second object
-        L = LP;
+        if (maxprefetchbytes > 0 && takeprefetched(key, L))
+            return;
+        loadlattices(key, L, expectedframes);
+    }
+
+    // start loading the lattices for the given (key, expected #frames) in the background, in the given order
+    // This replaces the requests of earlier calls that have not been served yet.
+    void prefetch(const std::vector<std::pair<std::wstring, size_t>>& requests) const
+    {
+        if (maxprefetchbytes == 0 || empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(prefetchmutex);
+            prefetchqueue.assign(requests.begin(), requests.end());
+            std::unordered_set<std::wstring> requested;
+            for (const auto& request : requests)
+                requested.insert(request.first);
+            for (auto iter = prefetched.begin(); iter != prefetched.end();)
+                iter = requested.find(iter->first) == requested.end() ? dropprefetched(iter) : std::next(iter);
+            if (!prefetchthread.joinable())
+                prefetchthread = std::thread([this]() { prefetchloop(); });
+        }
+        prefetchchanged.notify_all();
     }
 
     void setverbosity(int veb)
@@ -13,6 +13,8 @@
 #ifdef __unix__
 #include <x86intrin.h>
 #endif
+#include "CPUFeatures.h"
+#include <stddef.h>
 
 namespace msra { namespace math {
 
@@ -211,5 +213,404 @@ public:
 
     // please add anything else you might need HERE
 };
+
+// ===========================================================================
+// simd -- the inner loops of ssematrix in 4-wide (SSE, using float4), 8-wide (AVX2) and 16-wide (AVX-512) versions
+//
+// The widest version that CPU and OS support is selected at runtime, so that binaries built for SSE use AVX2 or AVX-512 where
+// available. The AVX versions are compiled for their instruction set function by function (the 'target' attribute of GCC and Clang;
+// MSVC needs nothing). Vectors are passed as 'n4' float4s, since ssematrix pads its columns to multiples of 4 floats; the AVX versions
+// load unaligned and finish the last float4s at the end with SSE or a masked load.
+// ===========================================================================
+
+#if (defined(_MSC_VER) && _MSC_VER >= 1800) || defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define SSE_AVX2_KERNELS
+#endif
+#if (defined(_MSC_VER) && _MSC_VER >= 1911) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#define SSE_AVX512_KERNELS
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define SSE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SSE_TARGET(isa)
+#endif
+
+namespace simd {
+
+enum level
+{
+    sse,
+    avx2,
+    avx512
+};
+
+// the widest instruction set supported by the CPU and enabled by the OS (which must save the wider registers)
+inline level detectlevel()
+{
+#ifdef SSE_AVX512_KERNELS
+    if (Microsoft::MSR::CNTK::CPUSupportsAVX512())
+        return avx512;
+#endif
+#ifdef SSE_AVX2_KERNELS
+    if (Microsoft::MSR::CNTK::CPUSupportsAVX2())
+        return avx2;
+#endif
+    return sse;
+}
+
+// the instruction set in use; one per process
+inline level &currentlevel()
+{
+    static level l = detectlevel();
+    return l;
+}
+inline level getlevel()
+{
+    return currentlevel();
+}
+// use at most 'maxlevel', e.g. to compare results or speed against narrower versions
+inline void setlevel(level maxlevel)
+{
+    const level detected = detectlevel();
+    currentlevel() = maxlevel < detected ? maxlevel : detected;
+}
+
+// --- SSE
+
+inline float dotprodsse(const float *a, const float *b, size_t n4)
+{
+    const float4 *pa = (const float4 *) a;
+    const float4 *pb = (const float4 *) b;
+    float4 acc = pa[0] * pb[0];
+    for (size_t m = 1; m < n4; m++)
+        acc += pa[m] * pb[m];
+    return acc.sum();
+}
+
+inline void dotprod4sse(const float *row, const float *col0, size_t colstride, size_t n4, float *result)
+{
+    const float4 *prow = (const float4 *) row;
+    const float4 *pcol0 = (const float4 *) (col0 + 0 * colstride);
+    const float4 *pcol1 = (const float4 *) (col0 + 1 * colstride);
+    const float4 *pcol2 = (const float4 *) (col0 + 2 * colstride);
+    const float4 *pcol3 = (const float4 *) (col0 + 3 * colstride);
+    float4 acc0 = prow[0] * pcol0[0];
+    float4 acc1 = prow[0] * pcol1[0];
+    float4 acc2 = prow[0] * pcol2[0];
+    float4 acc3 = prow[0] * pcol3[0];
+    for (size_t m = 1; m < n4; m++)
+    {
+        acc0 += prow[m] * pcol0[m];
+        acc1 += prow[m] * pcol1[m];
+        acc2 += prow[m] * pcol2[m];
+        acc3 += prow[m] * pcol3[m];
+    }
+    result[0] = acc0.sum();
+    result[1] = acc1.sum();
+    result[2] = acc2.sum();
+    result[3] = acc3.sum();
+}
+
+inline void axpbysse(float *y, const float *x, size_t n4, float a, float b)
+{
+    float4 *py = (float4 *) y;
+    const float4 *px = (const float4 *) x;
+    const float4 b4(b);
+    if (a == 0.0f) // (y is not read, so that NaNs in it do not survive)
+    {
+        for (size_t m = 0; m < n4; m++)
+            py[m] = px[m] * b4;
+    }
+    else
+    {
+        const float4 a4(a);
+        for (size_t m = 0; m < n4; m++)
+            py[m] = py[m] * a4 + px[m] * b4;
+    }
+}
+
+inline void scalesse(float *y, size_t n4, float a)
+{
+    float4 *py = (float4 *) y;
+    const float4 a4(a);
+    for (size_t m = 0; m < n4; m++)
+        py[m] = py[m] * a4;
+}
+
+// --- AVX2
+
+#ifdef SSE_AVX2_KERNELS
+SSE_TARGET("avx2,fma")
+inline __m128 hsum4x4avx2(__m128 s0, __m128 s1, __m128 s2, __m128 s3) // [sum(s0), sum(s1), sum(s2), sum(s3)]
+{
+    return _mm_hadd_ps(_mm_hadd_ps(s0, s1), _mm_hadd_ps(s2, s3));
+}
+SSE_TARGET("avx2,fma")
+inline __m128 halvesavx2(__m256 v) // lower + upper 4 floats
+{
+    return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+}
+
+SSE_TARGET("avx2,fma")
+inline float dotprodavx2(const float *a, const float *b, size_t n4)
+{
+    const size_t n = n4 * 4;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    __m128 s = halvesavx2(_mm256_add_ps(acc0, acc1));
+    if (i < n)
+        s = _mm_fmadd_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i), s);
+    s = _mm_hadd_ps(s, s);
+    s = _mm_hadd_ps(s, s);
+    const float result = _mm_cvtss_f32(s);
+    _mm256_zeroupper();
+    return result;
+}
+
+SSE_TARGET("avx2,fma")
+inline void dotprod4avx2(const float *row, const float *col0, size_t colstride, size_t n4, float *result)
+{
+    const size_t n = n4 * 4;
+    const float *col1 = col0 + colstride;
+    const float *col2 = col1 + colstride;
+    const float *col3 = col2 + colstride;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 r = _mm256_loadu_ps(row + i);
+        acc0 = _mm256_fmadd_ps(r, _mm256_loadu_ps(col0 + i), acc0);
+        acc1 = _mm256_fmadd_ps(r, _mm256_loadu_ps(col1 + i), acc1);
+        acc2 = _mm256_fmadd_ps(r, _mm256_loadu_ps(col2 + i), acc2);
+        acc3 = _mm256_fmadd_ps(r, _mm256_loadu_ps(col3 + i), acc3);
+    }
+    __m128 s0 = halvesavx2(acc0);
+    __m128 s1 = halvesavx2(acc1);
+    __m128 s2 = halvesavx2(acc2);
+    __m128 s3 = halvesavx2(acc3);
+    if (i < n)
+    {
+        const __m128 r = _mm_loadu_ps(row + i);
+        s0 = _mm_fmadd_ps(r, _mm_loadu_ps(col0 + i), s0);
+        s1 = _mm_fmadd_ps(r, _mm_loadu_ps(col1 + i), s1);
+        s2 = _mm_fmadd_ps(r, _mm_loadu_ps(col2 + i), s2);
+        s3 = _mm_fmadd_ps(r, _mm_loadu_ps(col3 + i), s3);
+    }
+    _mm_storeu_ps(result, hsum4x4avx2(s0, s1, s2, s3));
+    _mm256_zeroupper();
+}
+
+SSE_TARGET("avx2,fma")
+inline void axpbyavx2(float *y, const float *x, size_t n4, float a, float b)
+{
+    const size_t n = n4 * 4;
+    const __m256 vb = _mm256_set1_ps(b);
+    size_t i = 0;
+    if (a == 0.0f)
+    {
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), vb));
+    }
+    else
+    {
+        const __m256 va = _mm256_set1_ps(a);
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(_mm256_loadu_ps(y + i), va, _mm256_mul_ps(_mm256_loadu_ps(x + i), vb)));
+    }
+    _mm256_zeroupper();
+    if (i < n)
+        axpbysse(y + i, x + i, (n - i) / 4, a, b);
+}
+
+SSE_TARGET("avx2,fma")
+inline void scaleavx2(float *y, size_t n4, float a)
+{
+    const size_t n = n4 * 4;
+    const __m256 va = _mm256_set1_ps(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(y + i), va));
+    _mm256_zeroupper();
+    if (i < n)
+        scalesse(y + i, (n - i) / 4, a);
+}
+#endif
+
+// --- AVX-512
+
+#ifdef SSE_AVX512_KERNELS
+SSE_TARGET("avx512f,avx2,fma")
+inline __m128 quartersavx512(__m512 v) // sum of the four 4-float lanes
+{
+    const __m256 lo = _mm512_castps512_ps256(v);
+    const __m256 hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+    const __m256 h = _mm256_add_ps(lo, hi);
+    return _mm_add_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));
+}
+SSE_TARGET("avx512f,avx2,fma")
+inline __mmask16 tailmaskavx512(size_t rest) // the first 'rest' < 16 lanes
+{
+    return (__mmask16)((1u << rest) - 1);
+}
+
+SSE_TARGET("avx512f,avx2,fma")
+inline float dotprodavx512(const float *a, const float *b, size_t n4)
+{
+    const size_t n = n4 * 4;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16)
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    if (i < n)
+    {
+        const __mmask16 mask = tailmaskavx512(n - i);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc1);
+    }
+    __m128 s = quartersavx512(_mm512_add_ps(acc0, acc1));
+    s = _mm_hadd_ps(s, s);
+    s = _mm_hadd_ps(s, s);
+    const float result = _mm_cvtss_f32(s);
+    _mm256_zeroupper();
+    return result;
+}
+
+SSE_TARGET("avx512f,avx2,fma")
+inline void dotprod4avx512(const float *row, const float *col0, size_t colstride, size_t n4, float *result)
+{
+    const size_t n = n4 * 4;
+    const float *col1 = col0 + colstride;
+    const float *col2 = col1 + colstride;
+    const float *col3 = col2 + colstride;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m512 r = _mm512_loadu_ps(row + i);
+        acc0 = _mm512_fmadd_ps(r, _mm512_loadu_ps(col0 + i), acc0);
+        acc1 = _mm512_fmadd_ps(r, _mm512_loadu_ps(col1 + i), acc1);
+        acc2 = _mm512_fmadd_ps(r, _mm512_loadu_ps(col2 + i), acc2);
+        acc3 = _mm512_fmadd_ps(r, _mm512_loadu_ps(col3 + i), acc3);
+    }
+    if (i < n)
+    {
+        const __mmask16 mask = tailmaskavx512(n - i);
+        const __m512 r = _mm512_maskz_loadu_ps(mask, row + i);
+        acc0 = _mm512_fmadd_ps(r, _mm512_maskz_loadu_ps(mask, col0 + i), acc0);
+        acc1 = _mm512_fmadd_ps(r, _mm512_maskz_loadu_ps(mask, col1 + i), acc1);
+        acc2 = _mm512_fmadd_ps(r, _mm512_maskz_loadu_ps(mask, col2 + i), acc2);
+        acc3 = _mm512_fmadd_ps(r, _mm512_maskz_loadu_ps(mask, col3 + i), acc3);
+    }
+    _mm_storeu_ps(result, hsum4x4avx2(quartersavx512(acc0), quartersavx512(acc1), quartersavx512(acc2), quartersavx512(acc3)));
+    _mm256_zeroupper();
+}
+
+SSE_TARGET("avx512f,avx2,fma")
+inline void axpbyavx512(float *y, const float *x, size_t n4, float a, float b)
+{
+    const size_t n = n4 * 4;
+    const __m512 vb = _mm512_set1_ps(b);
+    const __m512 va = _mm512_set1_ps(a);
+    for (size_t i = 0; i < n; i += 16)
+    {
+        const __mmask16 mask = i + 16 <= n ? (__mmask16) 0xffff : tailmaskavx512(n - i);
+        const __m512 bx = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, x + i), vb);
+        const __m512 result = a == 0.0f ? bx : _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, y + i), va, bx);
+        _mm512_mask_storeu_ps(y + i, mask, result);
+    }
+    _mm256_zeroupper();
+}
+
+SSE_TARGET("avx512f,avx2,fma")
+inline void scaleavx512(float *y, size_t n4, float a)
+{
+    const size_t n = n4 * 4;
+    const __m512 va = _mm512_set1_ps(a);
+    for (size_t i = 0; i < n; i += 16)
+    {
+        const __mmask16 mask = i + 16 <= n ? (__mmask16) 0xffff : tailmaskavx512(n - i);
+        _mm512_mask_storeu_ps(y + i, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, y + i), va));
+    }
+    _mm256_zeroupper();
+}
+#endif
+
+// --- dispatch
+
+// sum_i a[i] * b[i] over n4 float4s
+inline float dotprod(const float *a, const float *b, size_t n4)
+{
+#ifdef SSE_AVX512_KERNELS
+    if (getlevel() == avx512)
+        return dotprodavx512(a, b, n4);
+#endif
+#ifdef SSE_AVX2_KERNELS
+    if (getlevel() == avx2)
+        return dotprodavx2(a, b, n4);
+#endif
+    return dotprodsse(a, b, n4);
+}
+
+// result[k] = dotprod (row, col0 + k * colstride, n4) for k = 0..3
+inline void dotprod4(const float *row, const float *col0, size_t colstride, size_t n4, float *result)
+{
+#ifdef SSE_AVX512_KERNELS
+    if (getlevel() == avx512)
+        return dotprod4avx512(row, col0, colstride, n4, result);
+#endif
+#ifdef SSE_AVX2_KERNELS
+    if (getlevel() == avx2)
+        return dotprod4avx2(row, col0, colstride, n4, result);
+#endif
+    dotprod4sse(row, col0, colstride, n4, result);
+}
+
+// y = a * y + b * x over n4 float4s; with a = 0, y is only written
+inline void axpby(float *y, const float *x, size_t n4, float a, float b)
+{
+#ifdef SSE_AVX512_KERNELS
+    if (getlevel() == avx512)
+        return axpbyavx512(y, x, n4, a, b);
+#endif
+#ifdef SSE_AVX2_KERNELS
+    if (getlevel() == avx2)
+        return axpbyavx2(y, x, n4, a, b);
+#endif
+    axpbysse(y, x, n4, a, b);
+}
+
+// y = a * y over n4 float4s
+inline void scale(float *y, size_t n4, float a)
+{
+#ifdef SSE_AVX512_KERNELS
+    if (getlevel() == avx512)
+        return scaleavx512(y, n4, a);
+#endif
+#ifdef SSE_AVX2_KERNELS
+    if (getlevel() == avx2)
+        return scaleavx2(y, n4, a);
+#endif
+    scalesse(y, n4, a);
+}
+};
 };
 };
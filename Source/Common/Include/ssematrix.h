@@ -387,17 +387,12 @@ public:
         assert((15 & reinterpret_cast<uintptr_t>(&b[0])) == 0); // enforce SSE alignment
 
         size_t nlong = (a.size() + 3) / 4; // number of SSE elements
-        const msra::math::float4 *pa = (const msra::math::float4 *) &a[0];
-        const msra::math::float4 *pb = (const msra::math::float4 *) &b[0];
-
-        msra::math::float4 acc = pa[0] * pb[0];
-        for (size_t m = 1; m < nlong; m++)
-            acc += pa[m] * pb[m];
+        const float sum = msra::math::simd::dotprod(&a[0], &b[0], nlong); // (AVX2/AVX-512 if available)
         // final sum
         if (addtoresult)
-            result = result * thisscale + weight * acc.sum();
+            result = result * thisscale + weight * sum;
         else
-            result = acc.sum();
+            result = sum;
     }
 
     // dot product of a matrix row with 4 columns at the same time
@@ -425,69 +420,25 @@ public:
         // assert (cols4stride * 4 == cols4.size());     // (passed in one vector with 4 columns stacked on top of each other)
         // assert (row.size() * 4 == cols4.size());  // this assert is no longer appropriate because of further breaking into blocks
 
-        // perform multiple columns in parallel
+        // perform multiple columns in parallel (AVX2/AVX-512 if available)
         const size_t nlong = (row.size() + 3) / 4; // number of SSE elements
-
-        // row
-        const msra::math::float4 *prow = (const msra::math::float4 *) &row[0];
-
-        // columns
-        const msra::math::float4 *pcol0 = (const msra::math::float4 *) &cols4[0 * cols4stride];
-        const msra::math::float4 *pcol1 = (const msra::math::float4 *) &cols4[1 * cols4stride];
-        const msra::math::float4 *pcol2 = (const msra::math::float4 *) &cols4[2 * cols4stride];
-        const msra::math::float4 *pcol3 = (const msra::math::float4 *) &cols4[3 * cols4stride];
-
-        // accumulation loop
-        msra::math::float4 acc0 = prow[0] * pcol0[0];
-        msra::math::float4 acc1 = prow[0] * pcol1[0];
-        msra::math::float4 acc2 = prow[0] * pcol2[0];
-        msra::math::float4 acc3 = prow[0] * pcol3[0];
-#if 1 // prefetch is not helping
-        for (size_t m = 1; m < nlong; m++)
-        {
-            acc0 += prow[m] * pcol0[m];
-            acc1 += prow[m] * pcol1[m];
-            acc2 += prow[m] * pcol2[m];
-            acc3 += prow[m] * pcol3[m];
-        }
-#else
-        const size_t prefetch = 1; // 128/sizeof(acc0);
-        size_t m;
-        for (m = 1; m < nlong - prefetch; m++)
-        {
-            acc0 += prow[m] * pcol0[m];
-            acc1 += prow[m] * pcol1[m];
-            acc2 += prow[m] * pcol2[m];
-            acc3 += prow[m] * pcol3[m];
-            msra::math::float4::prefetch(&prow[m + prefetch]);
-            msra::math::float4::prefetch(&pcol0[m + prefetch]);
-            msra::math::float4::prefetch(&pcol1[m + prefetch]);
-            msra::math::float4::prefetch(&pcol2[m + prefetch]);
-            msra::math::float4::prefetch(&pcol3[m + prefetch]);
-        }
-        for (; m < nlong; m++)
-        {
-            acc0 += prow[m] * pcol0[m];
-            acc1 += prow[m] * pcol1[m];
-            acc2 += prow[m] * pcol2[m];
-            acc3 += prow[m] * pcol3[m];
-        }
-#endif
+        float sums[4];
+        msra::math::simd::dotprod4(&row[0], &cols4[0], cols4stride, nlong, sums);
 
         // final sum
         if (addtoresult)
         {
-            usij[0 * usijstride] = usij[0 * usijstride] * thisscale + weight * acc0.sum();
-            usij[1 * usijstride] = usij[1 * usijstride] * thisscale + weight * acc1.sum();
-            usij[2 * usijstride] = usij[2 * usijstride] * thisscale + weight * acc2.sum();
-            usij[3 * usijstride] = usij[3 * usijstride] * thisscale + weight * acc3.sum();
+            usij[0 * usijstride] = usij[0 * usijstride] * thisscale + weight * sums[0];
+            usij[1 * usijstride] = usij[1 * usijstride] * thisscale + weight * sums[1];
+            usij[2 * usijstride] = usij[2 * usijstride] * thisscale + weight * sums[2];
+            usij[3 * usijstride] = usij[3 * usijstride] * thisscale + weight * sums[3];
         }
         else
         {
-            usij[0 * usijstride] = acc0.sum();
-            usij[1 * usijstride] = acc1.sum();
-            usij[2 * usijstride] = acc2.sum();
-            usij[3 * usijstride] = acc3.sum();
+            usij[0 * usijstride] = sums[0];
+            usij[1 * usijstride] = sums[1];
+            usij[2 * usijstride] = sums[2];
+            usij[3 * usijstride] = sums[3];
         }
     }
 
@@ -787,29 +738,9 @@ public:
         const_array_ref<msra::math::float4> other4(other.operator const_array_ref<msra::math::float4>());
         assert(us4.size() == other4.size());
 
-        // perform the operation on one long vector
-        msra::math::float4 weight4(weight);
-        if (thisweight == 1.0f)
-        {
-            foreach_index (i, us4)
-            {
-                us4[i] = us4[i] + other4[i] * weight4;
-            }
-        }
-        else if (thisweight == 0.0f)
-        {
-            foreach_index (i, us4)
-            {
-                us4[i] = other4[i] * weight4;
-            }
-        }
-        else
-        {
-            foreach_index (i, us4)
-            {
-                us4[i] = us4[i] * thisweight + other4[i] * weight4;
-            }
-        }
+        // perform the operation on one long vector (AVX2/AVX-512 if available; with thisweight = 0, 'this' is not read)
+        if (us4.size() > 0)
+            msra::math::simd::axpby((float *) &us4[0], (const float *) &other4[0], us4.size(), thisweight, weight);
     }
 
     // set the value to zero if less than threshold
@@ -877,12 +808,9 @@ public:
         // get data as long vectors
         array_ref<msra::math::float4> us4(us.operator array_ref<msra::math::float4>());
 
-        // perform the operation on one long vector
-        msra::math::float4 scale4(factor);
-        foreach_index (i, us4)
-        {
-            us4[i] = us4[i] * scale4;
-        }
+        // perform the operation on one long vector (AVX2/AVX-512 if available)
+        if (us4.size() > 0)
+            msra::math::simd::scale((float *) &us4[0], us4.size(), factor);
     }
 
     // this = this * thisscale + other
@@ -897,12 +825,9 @@ public:
         const_array_ref<msra::math::float4> other4(other.operator const_array_ref<msra::math::float4>());
         assert(us4.size() == other4.size());
 
-        // perform the operation on one long vector
-        msra::math::float4 thisscale4(thisscale);
-        foreach_index (i, us4)
-        {
-            us4[i] = us4[i] * thisscale4 + other4[i];
-        }
+        // perform the operation on one long vector (AVX2/AVX-512 if available)
+        if (us4.size() > 0)
+            msra::math::simd::axpby((float *) &us4[0], (const float *) &other4[0], us4.size(), thisscale, 1.0f);
     }
 
     // special function for DBN
@@ -1341,6 +1266,7 @@ template <class ssematrixbase>
 class ssematrix : public ssematrixbase
 {
     // helpers for SSE-compatible memory allocation
+    // Aligned to cache lines (64 bytes), so that the AVX-512 kernels' full-width loads of a matrix never split a cache line.
     static __declspec_noreturn void failed(size_t nbytes)
     {
         RuntimeError("allocation of SSE vector failed (%d bytes)", (int)nbytes);
@@ -1349,7 +1275,7 @@ class ssematrix : public ssematrixbase
     template <typename T>
     static T *new_sse(size_t nbytes)
     {
-        T *pv = (T *) _aligned_malloc(nbytes * sizeof(T), 16);
+        T *pv = (T *) _aligned_malloc(nbytes * sizeof(T), 64);
         if (pv)
             return pv;
         failed(nbytes * sizeof(T));
@@ -1364,7 +1290,7 @@ class ssematrix : public ssematrixbase
     template <typename T>
     static T *new_sse(size_t nbytes)
     {
-        T *pv = (T *) _mm_malloc(nbytes * sizeof(T), 16);
+        T *pv = (T *) _mm_malloc(nbytes * sizeof(T), 64);
         if (pv)
             return pv;
         failed(nbytes * sizeof(T));
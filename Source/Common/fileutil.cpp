@@ -22,6 +22,8 @@
 #ifdef __unix__
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <glob.h>
 #endif
@@ -1913,6 +1915,82 @@ bool msra::files::fuptodate(const wstring& target, const wstring& input, bool in
     return targettime >= inputtime; // note: uses an overload for WIN32 FILETIME (in Linux, FILETIME=time_t=size_t)
 }
 
+// ----------------------------------------------------------------------------
+// mappedfile -- a file memory-mapped for reading
+// ----------------------------------------------------------------------------
+
+msra::files::mappedfile::mappedfile(const wstring& path)
+    : mapped(nullptr), mappedsize(0), maphandle(nullptr)
+{
+#ifdef _WIN32
+    HANDLE filehandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (filehandle == INVALID_HANDLE_VALUE)
+        RuntimeError("mappedfile: cannot open '%ls'", path.c_str());
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(filehandle, &size))
+    {
+        CloseHandle(filehandle);
+        RuntimeError("mappedfile: cannot get the size of '%ls'", path.c_str());
+    }
+    maphandle = CreateFileMapping(filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(filehandle); // (the mapping keeps the file open)
+    if (maphandle == NULL)
+        RuntimeError("mappedfile: cannot map '%ls'", path.c_str());
+    mapped = (const char*) MapViewOfFile(maphandle, FILE_MAP_READ, 0, 0, 0);
+    mappedsize = (size_t) size.QuadPart;
+    if (mapped == nullptr)
+    {
+        CloseHandle(maphandle);
+        RuntimeError("mappedfile: cannot map '%ls'", path.c_str());
+    }
+#else
+    int fd = open(msra::strfun::utf8(path).c_str(), O_RDONLY);
+    if (fd == -1)
+        RuntimeError("mappedfile: cannot open '%ls'", path.c_str());
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+    {
+        close(fd);
+        RuntimeError("mappedfile: cannot get the size of '%ls'", path.c_str());
+    }
+    mappedsize = (size_t) sb.st_size;
+    void* data = mappedsize == 0 ? MAP_FAILED : mmap(nullptr, mappedsize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // (the mapping keeps the file open)
+    if (data == MAP_FAILED)
+        RuntimeError("mappedfile: cannot map '%ls'", path.c_str());
+    mapped = (const char*) data;
+#endif
+}
+
+msra::files::mappedfile::~mappedfile()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(maphandle);
+#else
+    munmap(const_cast<char*>(mapped), mappedsize);
+#endif
+}
+
+void msra::files::mappedfile::advise(size_t begin, size_t end, bool willneed) const
+{
+#ifdef _WIN32 // (on Windows, we rely on the read-ahead of the file cache)
+    UNUSED(begin);
+    UNUSED(end);
+    UNUSED(willneed);
+#else
+    end = min(end, mappedsize);
+    if (begin >= end)
+        return;
+    const size_t pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    // madvise() wants page-aligned ranges: round outwards to prefetch, inwards to release
+    begin = willneed ? begin / pagesize * pagesize : (begin + pagesize - 1) / pagesize * pagesize;
+    end = willneed ? min(mappedsize, (end + pagesize - 1) / pagesize * pagesize) : end / pagesize * pagesize;
+    if (begin < end)
+        madvise(const_cast<char*>(mapped) + begin, end - begin, willneed ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+}
+
 // separate string by separator
 template<class String>
 vector<String> SplitString(const String& str, const String& sep)
@@ -24,6 +24,11 @@
 #include <stack>
 #include <list>
 #include <set>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <thread>
+#include <tuple>
 
 using namespace std;
 
@@ -55,6 +60,8 @@ void ComputationNetwork::ClearNetwork()
 {
     // release all references to nodes
     InvalidateCompiledNetwork();
+    m_compiledNodeStates.clear();
+    m_compiledEvalOrders.clear();
 
     for (auto groupIter : GetAllNodeGroups())
         groupIter->clear();
@@ -83,7 +90,7 @@ void ComputationNetwork::SaveEdited(const wstring& fileName, const FileOptions f
     Save(fileName, fileFormat);
 }
 
-void ComputationNetwork::Save(const wstring& fileName, const FileOptions fileFormat) const
+void ComputationNetwork::Save(const wstring& fileName, const FileOptions fileFormat, const std::function<void(File&)>& progress) const
 {
     VerifyIsCompiled("Save");
     // In case of parallel training only the main node should we saving the model to prevent
@@ -94,13 +101,13 @@ void ComputationNetwork::Save(const wstring& fileName, const FileOptions fileFor
         // Saving into temporary file and then renaming it to the requested fileName
         // This is a standard trick to avoid havign corrupted model files if process dies during writing
         wstring tmpFileName = fileName + L".tmp";
-        SaveToFileImpl(tmpFileName, fileFormat);
+        SaveToFileImpl(tmpFileName, fileFormat, progress);
         renameOrDie(tmpFileName, fileName);
     }
 }
 
 // TODO: how does the file distinguish float vs double nodes?
-void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptions fileFormat) const
+void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptions fileFormat, const std::function<void(File&)>& progress) const
 {
     File fstream(fileName, fileFormat | FileOptions::fileOptionsWrite);
     fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCN");
@@ -118,6 +125,8 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
     {
         ComputationNodeBasePtr nodePtr = nodeIter->second;
         nodePtr->Save(fstream);
+        if (progress)
+            progress(fstream);
     }
 
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ENodeList");
@@ -371,13 +380,13 @@ bool ComputationNetwork::IsTypicalCriterionNode(ComputationNodeBasePtr nodePtr)
     if (nodePtr->OperationName() == OperationNameOf(SquareErrorNode) ||
         nodePtr->OperationName() == OperationNameOf(LogisticNode) ||
         nodePtr->OperationName() == OperationNameOf(CrossEntropyWithSoftmaxNode) ||
+        nodePtr->OperationName() == OperationNameOf(DistillationCrossEntropyWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(SequenceWithSoftmaxNode) ||
+        nodePtr->OperationName() == OperationNameOf(SampledSoftmaxCrossEntropyNode) ||
         nodePtr->OperationName() == OperationNameOf(CrossEntropyNode) ||
         nodePtr->OperationName() == OperationNameOf(ClassBasedCrossEntropyWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(ErrorPredictionNode) ||
-#ifdef COMING_SOON
         nodePtr->OperationName() == OperationNameOf(CRFNode) ||
-#endif
         nodePtr->OperationName() == OperationNameOf(DummyCriterionNode))
         return true;
 
@@ -475,6 +484,13 @@ template <class ElemType>
     }
 }
 
+template <class ElemType>
+/*static*/ void ComputationNetwork::SetDropoutMinibatchShare(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t firstSequence, size_t numSequences)
+{
+    for (auto& node : net->GetNodesWithType(OperationNameOf(DropoutNode), criterionNode))
+        dynamic_pointer_cast<DropoutNode<ElemType>>(node)->SetMinibatchShare(firstSequence, numSequences);
+}
+
 //set sequence training parameters, e.g. smoothing weight, frame drop threshhold
 template <class ElemType>
 void ComputationNetwork::SetSeqParam(ComputationNetworkPtr net,
@@ -486,12 +502,13 @@ void ComputationNetwork::SetSeqParam(ComputationNetworkPtr net,
                                      const double& lmf /*= 14.0f*/,
                                      const double& wp /*= 0.0f*/,
                                      const double& bMMIfactor /*= 0.0f*/,
-                                     const bool& sMBR /*= false*/
+                                     const bool& sMBR /*= false*/,
+                                     const double& pruningBeam /*= 0.0f*/
                                      )
 {
     fprintf(stderr, "Setting Hsmoothing weight to %.8g and frame-dropping threshhold to %.8g\n", hsmoothingWeight, frameDropThresh);
-    fprintf(stderr, "Setting SeqGammar-related parameters: amf=%.2f, lmf=%.2f, wp=%.2f, bMMIFactor=%.2f, usesMBR=%s\n",
-            amf, lmf, wp, bMMIfactor, sMBR ? "true" : "false");
+    fprintf(stderr, "Setting SeqGammar-related parameters: amf=%.2f, lmf=%.2f, wp=%.2f, bMMIFactor=%.2f, usesMBR=%s, pruningBeam=%.2f\n",
+            amf, lmf, wp, bMMIfactor, sMBR ? "true" : "false", pruningBeam);
     list<ComputationNodeBasePtr> seqNodes = net->GetNodesWithType(OperationNameOf(SequenceWithSoftmaxNode), criterionNode);
     if (seqNodes.size() == 0)
     {
@@ -505,7 +522,7 @@ void ComputationNetwork::SetSeqParam(ComputationNetworkPtr net,
             node->SetSmoothWeight(hsmoothingWeight);
             node->SetFrameDropThresh(frameDropThresh);
             node->SetReferenceAlign(doreferencealign);
-            node->SetGammarCalculationParam(amf, lmf, wp, bMMIfactor, sMBR);
+            node->SetGammarCalculationParam(amf, lmf, wp, bMMIfactor, sMBR, pruningBeam);
         }
     }
 }
@@ -851,13 +868,123 @@ void ComputationNodeBase::EnumerateArcs(std::unordered_set<ComputationNodeBasePt
 //  A \approx B*C, where rank(B)=rank(C)=r < rank(A)
 // After SVD decomposition, the node A will become an intermediate node whose children are B,C ;
 // B and C are two learnable parameters
+// Times(A, x) becomes LowRankTimes(B, C, x), which computes B (C x) without forming B C; only other uses of A get Times(B, C).
+// ========================================
+// the number of singular values to keep: the fewest whose 'energies' (in descending order) sum up to more than 'keepRatio'
+// of 'totalEnergy', rounded up to a multiple of 'alignedSize' but at most 'maxRank'; 0 if the given energies do not suffice
+static size_t KeptSingularValues(const vector<double>& energies, double totalEnergy, double keepRatio, size_t alignedSize, size_t maxRank)
+{
+    const double keepEnergy = totalEnergy * keepRatio;
+    double runEnergy = 0;
+    size_t r = 0;
+    while (r < energies.size() && runEnergy <= keepEnergy)
+        runEnergy += energies[r++];
+    if (runEnergy <= keepEnergy)
+        return 0;
+    if (r % alignedSize != 0) // aligned sizes can be helpful at runtime
+        r += alignedSize - r % alignedSize;
+    return min(r, maxRank);
+}
+
+// decomposition of one parameter A ~ left * right, with the square roots of the singular values multiplied into both
+template <class ElemType>
+struct ParameterSVDResult
+{
+    Matrix<ElemType> m_left, m_right;
+    size_t m_rank;
+    double m_seconds;
+    ParameterSVDResult()
+        : m_left(CPUDEVICE), m_right(CPUDEVICE), m_rank(0), m_seconds(0)
+    {
+    }
+};
+
+template <class ElemType>
+static void DecomposeParameter(const Matrix<ElemType>& value, float keepRatio, size_t alignedSize, const ComputationNetwork::ParameterSVDOptions& options,
+                               unsigned long seed, ParameterSVDResult<ElemType>& result)
+{
+    const size_t m = value.GetNumRows(), n = value.GetNumCols(), minDim = min(m, n);
+    chrono::time_point<chrono::system_clock> stTime = chrono::system_clock::now();
+
+    Matrix<ElemType> S(CPUDEVICE), U(CPUDEVICE), VT(CPUDEVICE);
+    size_t r;
+    if (!options.m_randomized)
+    {
+        // full SVD; the energy is the sum of the singular values
+        Matrix<ElemType> A(value, CPUDEVICE), W(CPUDEVICE);
+        Matrix<ElemType>::SVD(A, S, U, VT, W);
+        vector<double> energies(S.GetNumRows());
+        double totalEnergy = 0;
+        for (size_t i = 0; i < energies.size(); i++)
+            totalEnergy += energies[i] = S(i, 0);
+        r = KeptSingularValues(energies, totalEnergy, keepRatio, alignedSize, minDim);
+        if (r == 0) // (rounding)
+            r = minDim;
+    }
+    else
+    {
+        // truncated SVD, with a larger sketch until it captures the energy; here the energy is the sum of the squared singular
+        // values, whose total (the squared Frobenius norm) is known without decomposing
+        Matrix<ElemType> A(value, options.m_deviceId);
+        const double frobeniusNorm = A.FrobeniusNorm();
+        const double totalEnergy = frobeniusNorm * frobeniusNorm;
+        for (size_t sketchSize = min(minDim, max((size_t) 64, minDim / 8));; sketchSize = min(2 * sketchSize, minDim))
+        {
+            Matrix<ElemType>::TruncatedSVD(A, sketchSize + options.m_oversampling, options.m_numPowerIterations, seed, S, U, VT);
+            vector<double> energies(S.GetNumRows());
+            Matrix<ElemType> sigma(S, CPUDEVICE);
+            for (size_t i = 0; i < energies.size(); i++)
+                energies[i] = (double) sigma(i, 0) * sigma(i, 0);
+            r = KeptSingularValues(energies, totalEnergy, keepRatio, alignedSize, minDim);
+            if (r > 0 && r <= S.GetNumRows())
+                break;
+            if (S.GetNumRows() == minDim) // complete, up to rounding
+            {
+                r = minDim;
+                break;
+            }
+        }
+        S.TransferToDeviceIfNotThere(CPUDEVICE, true);
+        U.TransferToDeviceIfNotThere(CPUDEVICE, true);
+        VT.TransferToDeviceIfNotThere(CPUDEVICE, true);
+    }
+
+    // left in R^ {mXr}, right in R^{rXn}
+    result.m_left = U.ColumnSlice(0, r);
+    result.m_right.Resize(r, n);
+    result.m_right.AssignRowSliceValuesOf(VT, 0, r);
+
+    Matrix<ElemType> redS(r, (size_t) 1, CPUDEVICE);
+    for (size_t i = 0; i < r; i++)
+        redS(i, 0) = (ElemType) sqrt((double) S(i, 0));
+    result.m_left.RowElementMultiplyWith(redS.Transpose());
+    result.m_right.ColumnElementMultiplyWith(redS);
+
+    result.m_rank = r;
+    result.m_seconds = chrono::duration<double>(chrono::system_clock::now() - stTime).count();
+}
+
+// ========================================
+// This function performs SVD decomposition for different groups of learnable  parameters
+// we perform SVD decomposition such that
+//  A \approx B*C, where rank(B)=rank(C)=r < rank(A)
+// After SVD decomposition, the node A will become an intermediate node whose children are B,C ;
+// B and C are two learnable parameters
+// Times(A, x) becomes LowRankTimes(B, C, x), which computes B (C x) without forming B C; only other uses of A get Times(B, C).
+// The decompositions of the parameters are independent, and run concurrently on options.m_numThreads threads (the network
+// is edited afterwards, in the original order). The randomized method does its matrix products on options.m_deviceId;
+// there, the decompositions run one after the other, each using the whole device.
 // ========================================
 // BUGBUG: this only currently works for one ElemType, not both
 template <class ElemType>
-void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDConfig, size_t AlignedSize)
+void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDConfig, size_t AlignedSize, const ParameterSVDOptions& options)
 {
+    if (AlignedSize == 0)
+        InvalidArgument("PerformSVDecomposition: AlignedSize must be at least 1.");
+
     vector<pair<vector<wstring>, float>> nodeGroups;
     wregex NameFilter;
+    set<wstring> namesInGroups; // a parameter that matches several groups goes with the first
 
     for (const auto& e : SVDConfig)
     {
@@ -883,119 +1010,216 @@ void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDCo
                 continue;
 
             // still here ?
-            NamesInGroup.push_back(n->first);
+            if (namesInGroups.insert(n->first).second)
+                NamesInGroup.push_back(n->first);
         }
         nodeGroups.push_back(make_pair(NamesInGroup, keepRatio));
     }
 
-    size_t groupID = 0;
-    for (auto& group : nodeGroups)
+    // Step 1. do the SVD decompositions, concurrently
+    vector<tuple<wstring, float, size_t>> jobs; // [name, keepRatio, group]
+    for (size_t groupID = 0; groupID < nodeGroups.size(); groupID++)
+        for (const auto& name : nodeGroups[groupID].first)
+            jobs.push_back(make_tuple(name, nodeGroups[groupID].second, groupID));
+    vector<ParameterSVDResult<ElemType>> results(jobs.size());
+    vector<exception_ptr> errors(jobs.size());
+
+    size_t numThreads = options.m_numThreads > 0 ? options.m_numThreads : max((size_t) thread::hardware_concurrency(), (size_t) 1);
+    if (options.m_randomized && options.m_deviceId != CPUDEVICE)
+        numThreads = 1;
+    numThreads = min(numThreads, max(jobs.size(), (size_t) 1));
+    fprintf(stderr, "ParameterSVD: decomposing %d parameters with the %s SVD on %d threads%s.\n", (int) jobs.size(),
+            options.m_randomized ? "randomized truncated" : "full", (int) numThreads,
+            options.m_randomized && options.m_deviceId != CPUDEVICE ? msra::strfun::strprintf(" and GPU %d", (int) options.m_deviceId).c_str() : "");
+
+    atomic<size_t> nextJob(0);
+    auto worker = [&]()
     {
-        float keepratio = group.second;
-        fprintf(stderr,
-                "--------------------------------------------------------------------------------------------\n");
-        fprintf(stderr,
-                "ParameterSVD: start to process group %d with KeepRatio=%.2f\n",
-                (int) groupID++, keepratio);
-        fprintf(stderr,
-                "--------------------------------------------------------------------------------------------\n");
-
-        for (const auto& name : group.first)
+        for (size_t k = nextJob++; k < jobs.size(); k = nextJob++)
         {
-            if (m_nameToNodeMap.find(name) == m_nameToNodeMap.end())
+            try
             {
-                // could be deleted in the previous groups
-                continue;
+                auto pNode = dynamic_pointer_cast<LearnableParameter<ElemType>>(m_nameToNodeMap.at(get<0>(jobs[k])));
+                DecomposeParameter(pNode->ValueAsMatrix(), get<1>(jobs[k]), AlignedSize, options, (unsigned long) k + 1, results[k]);
             }
-
-            shared_ptr<ComputationNode<ElemType>> pNode = dynamic_pointer_cast<LearnableParameter<ElemType>>(m_nameToNodeMap[name]);
-
-            // Step 1. do SVD decomposition
-            Matrix<ElemType> A = pNode->ValueAsMatrix();
-
-            // it is a vector, no need to do it
-            if (A.GetNumCols() == 1 || A.GetNumRows() == 1)
-                continue;
-
-            size_t m = A.GetNumRows();
-            size_t n = A.GetNumCols();
-
-            Matrix<ElemType> S(-1), U(-1), VT(-1), W(-1);
-            chrono::time_point<chrono::system_clock> stTime = chrono::system_clock::now();
-            Matrix<ElemType>::SVD(A, S, U, VT, W);
-            chrono::time_point<chrono::system_clock> enTime = chrono::system_clock::now();
-
-            // A \in R^{mXn}
-            // U \in R^{mXm}
-            // VT \in R^{nXn}
-            // S \in R^{min(m,n),1}
-            // S is in descending order
-
-            ElemType totalenergy = 0.0f;
-            for (size_t i = 0; i < S.GetNumRows(); i++)
-                totalenergy += S(i, 0);
-            ElemType keepenergy = totalenergy * keepratio;
-            ElemType runenergy = 0.0f;
-
-            size_t r = 0;
-            for (size_t indx = 0; indx < S.GetNumRows(); indx++)
+            catch (...)
             {
-                runenergy += S(indx, 0);
-                if (runenergy > keepenergy)
-                {
-                    r = indx + 1;
-                    break;
-                }
+                errors[k] = current_exception();
             }
+        }
+    };
+    vector<thread> threads;
+    for (size_t t = 1; t < numThreads; t++)
+        threads.push_back(thread(worker));
+    worker();
+    for (auto& t : threads)
+        t.join();
+    for (const auto& error : errors)
+    {
+        if (error)
+            rethrow_exception(error);
+    }
 
-            r = r > S.GetNumRows() ? S.GetNumRows() : r;
+    // Steps 2 to 4. replace the parameters
+    for (size_t k = 0; k < jobs.size(); k++)
+    {
+        const wstring& name = get<0>(jobs[k]);
+        const float keepratio = get<1>(jobs[k]);
+        if (k == 0 || get<2>(jobs[k]) != get<2>(jobs[k - 1]))
+        {
+            fprintf(stderr,
+                    "--------------------------------------------------------------------------------------------\n");
+            fprintf(stderr,
+                    "ParameterSVD: start to process group %d with KeepRatio=%.2f\n",
+                    (int) get<2>(jobs[k]), keepratio);
+            fprintf(stderr,
+                    "--------------------------------------------------------------------------------------------\n");
+        }
+
+        shared_ptr<ComputationNode<ElemType>> pNode = dynamic_pointer_cast<LearnableParameter<ElemType>>(m_nameToNodeMap[name]);
+        const size_t m = pNode->ValueAsMatrix().GetNumRows();
+        const size_t n = pNode->ValueAsMatrix().GetNumCols();
+        const size_t r = results[k].m_rank;
+        Matrix<ElemType>& redU = results[k].m_left;
+        Matrix<ElemType>& redVT = results[k].m_right;
 
-            if (r % AlignedSize != 0)
+        fprintf(stderr,
+                "Performing SVD for a %5d-by-%-5d matrix (node name: %-20ls) ---  computation time %5.2f secs ;  keep %4.1f%% %s ===> keep %5d svd values (reduce to %4.1f%% parameters) \n",
+                (int) m, (int) n, name.c_str(), results[k].m_seconds,
+                keepratio * 100, options.m_randomized ? "squared energy" : "energy", (int) r,
+                ((m + n) * r + 0.0f) / m / n * 100);
+
+        // Step 2. create two new Parameter nodes
+        wstring leftChildName = name + L"-U";
+        wstring rightChildName = name + L"-V";
+        shared_ptr<ComputationNode<ElemType>> pLeft = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(m_deviceId, leftChildName, m, r));
+        shared_ptr<ComputationNode<ElemType>> pRight = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(m_deviceId, rightChildName, r, n));
+
+        pLeft->ValueAsMatrix() = redU;
+        pRight->ValueAsMatrix() = redVT;
+
+        // Step 3. let each Times(A, x) compute U (V x) instead, which never forms the product U V
+        vector<ComputationNodeBasePtr> timesNodes;
+        bool hasOtherConsumers = false;
+        for (const auto& iter : m_nameToNodeMap)
+        {
+            const auto& node = iter.second;
+            for (size_t i = 0; i < node->GetNumInputs(); i++)
             {
-                r -= r % AlignedSize;
-                r = r + AlignedSize > S.GetNumRows() ? S.GetNumRows() : r + AlignedSize;
+                if (node->Input(i) != pNode)
+                    continue;
+                if (i == 0 && node->OperationName() == OperationNameOf(TimesNode) && node->Input(1) != pNode)
+                    timesNodes.push_back(node);
+                else
+                    hasOtherConsumers = true;
             }
-            // r = (r + 7) & (~7); //  to keep the number of rows/cols of resultant matrix a multipier of 8
-            //  which can be helpful at runtime
+        }
+        for (const auto& times : timesNodes)
+        {
+            auto pLowRankTimes = New<LowRankTimesNode<ElemType>>(m_deviceId, times->NodeName());
+            pLowRankTimes->AttachInputs(vector<ComputationNodeBasePtr>{ pLeft, pRight, times->Input(1) });
+            ReplaceNode(times->NodeName(), pLowRankTimes);
+        }
 
-            chrono::duration<double> elapsedtime = enTime - stTime;
-            fprintf(stderr,
-                    "Performing SVD for a %5d-by-%-5d matrix (node name: %-20ls) ---  computation time %5.2f secs ;  keep %4.1f%% energy ===> keep %5d svd values (reduce to %4.1f%% parameters) \n",
-                    (int) m, (int) n, name.c_str(), elapsedtime.count(),
-                    keepratio * 100, (int) r,
-                    ((m + n) * r + 0.0f) / m / n * 100);
+        // Step 4. remove old node; other uses of it get the product U V
+        if (hasOtherConsumers)
+        {
+            shared_ptr<ComputationNode<ElemType>> pTimes = AddNodeToNetAndAttachInputs(New<TimesNode<ElemType>>(m_deviceId, name + L"-SVD"), pLeft, pRight);
+            ReplaceLeafNode(name, pTimes);
+        }
+        else
+            DeleteNode(name);
+    }
 
-            // redU in R^ {mXr}
-            Matrix<ElemType> redU = U.ColumnSlice(0, r);
-            Matrix<ElemType> redVT(-1);
+    // redo necessary post-processing
+    CompileNetwork();
+}
 
-            // redVT in R^{rXn}
-            redVT.Resize(r, n);
-            redVT.AssignRowSliceValuesOf(VT, 0, r);
+// ========================================
+// PruneWeights() -- zero the smallest weights, and let Times multiply them in sparse format
+// Each 2D LearnableParameter whose name matches 'nodeNameRegex' (empty: all) and that is the left operand of a Times
+// is divided into blocks of 'blockSize' consecutive rows of a column (1: plain magnitude pruning). The blocks with the
+// smallest L2 norm are set to zero until a fraction 'sparsity' of them is zero, and each Times(W, x) becomes
+// SparseWeightTimes(W, x) under the same name.
+// ========================================
+// BUGBUG: this only currently works for one ElemType, not both
+template <class ElemType>
+void ComputationNetwork::PruneWeights(const wstring& nodeNameRegex, double sparsity, size_t blockSize)
+{
+    if (sparsity < 0 || sparsity >= 1)
+        InvalidArgument("PruneWeights: The sparsity must be in [0, 1), but is %f.", sparsity);
+    if (blockSize == 0)
+        InvalidArgument("PruneWeights: The block size must be at least 1.");
+
+    // find the weights and the Times nodes that use them
+    wregex nameFilter;
+    if (!nodeNameRegex.empty())
+        nameFilter.assign(nodeNameRegex);
+    map<ComputationNodeBasePtr, vector<ComputationNodeBasePtr>> timesNodesOf; // [weights] -> Times nodes
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        if (node->OperationName() != OperationNameOf(TimesNode) || node->Input(0) == node->Input(1))
+            continue;
+        const auto weights = dynamic_pointer_cast<LearnableParameter<ElemType>>(node->Input(0));
+        if (!weights || weights->Value().GetMatrixType() != DENSE || node->Input(0)->GetSampleLayout().GetRank() != 2 ||
+            (!nodeNameRegex.empty() && !regex_match(weights->NodeName(), nameFilter)))
+            continue;
+        timesNodesOf[weights].push_back(node);
+    }
 
-            Matrix<ElemType> redS(r, (size_t)1, A.GetDeviceId());
-            for (size_t i = 0; i < r; i++)
+    for (const auto& iter : timesNodesOf)
+    {
+        auto weights = dynamic_pointer_cast<ComputationNode<ElemType>>(iter.first);
+        Matrix<ElemType>& value = weights->ValueAsMatrix();
+        const size_t rows = value.GetNumRows(), cols = value.GetNumCols();
+        if (rows == 1 || cols == 1)
+            continue;
+
+        // Step 1. zero the blocks of the smallest norm
+        unique_ptr<ElemType[]> data(value.CopyToArray());
+        const size_t blocksPerCol = (rows + blockSize - 1) / blockSize;
+        vector<double> norms(blocksPerCol * cols, 0);
+        for (size_t j = 0; j < cols; j++)
+            for (size_t i = 0; i < rows; i++)
+                norms[j * blocksPerCol + i / blockSize] += (double) data[j * rows + i] * data[j * rows + i];
+
+        const size_t numPruned = (size_t) (sparsity * norms.size());
+        size_t numZeros = 0;
+        if (numPruned > 0)
+        {
+            vector<double> sortedNorms(norms);
+            nth_element(sortedNorms.begin(), sortedNorms.begin() + (numPruned - 1), sortedNorms.end());
+            const double threshold = sortedNorms[numPruned - 1];
+            size_t numTiesToPrune = numPruned - count_if(norms.begin(), norms.end(), [threshold](double norm) { return norm < threshold; });
+            for (size_t b = 0; b < norms.size(); b++)
             {
-                ElemType sqrtsigma = (ElemType) sqrt((double) S(i, 0));
-                redS(i, 0) = sqrtsigma;
+                if (norms[b] > threshold)
+                    continue;
+                if (norms[b] == threshold)
+                {
+                    if (numTiesToPrune == 0)
+                        continue;
+                    numTiesToPrune--;
+                }
+                const size_t j = b / blocksPerCol, iBegin = (b % blocksPerCol) * blockSize, iEnd = min(rows, iBegin + blockSize);
+                for (size_t i = iBegin; i < iEnd; i++)
+                    data[j * rows + i] = 0;
             }
+        }
+        for (size_t k = 0; k < rows * cols; k++)
+            numZeros += data[k] == 0;
+        value.SetValue(rows, cols, value.GetDeviceId(), data.get());
 
-            redU.RowElementMultiplyWith(redS.Transpose());
-            redVT.ColumnElementMultiplyWith(redS);
-
-            // Step 2. create two new Parameter nodes and one Times node
-            wstring leftChildName = name + L"-U";
-            wstring rightChildName = name + L"-V";
-            shared_ptr<ComputationNode<ElemType>> pLeft = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(m_deviceId, leftChildName, m, r));
-            shared_ptr<ComputationNode<ElemType>> pRight = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(m_deviceId, rightChildName, r, n));
-
-            pLeft->ValueAsMatrix() = redU;
-            pRight->ValueAsMatrix() = redVT;
-
-            shared_ptr<ComputationNode<ElemType>> pTimes = AddNodeToNetAndAttachInputs(New<TimesNode<ElemType>>(m_deviceId, name + L"-SVD"), pLeft, pRight);
+        fprintf(stderr, "PruneWeights: %ls [%d x %d] in blocks of %d rows: %.1f%% zeros, used by %d Times node(s).\n",
+                weights->NodeName().c_str(), (int) rows, (int) cols, (int) blockSize, 100.0 * numZeros / (rows * cols), (int) iter.second.size());
 
-            // Step 3. remove old node
-            ReplaceLeafNode(name, pTimes);
+        // Step 2. let the Times nodes multiply with the sparse weights
+        for (const auto& times : iter.second)
+        {
+            auto pSparseWeightTimes = New<SparseWeightTimesNode<ElemType>>(times->GetDeviceId(), times->NodeName());
+            pSparseWeightTimes->AttachInputs(vector<ComputationNodeBasePtr>{ weights, times->Input(1) });
+            ReplaceNode(times->NodeName(), pSparseWeightTimes);
         }
     }
 
@@ -1326,19 +1550,23 @@ void ComputationNetwork::SaveToDbnFile(ComputationNetworkPtr net, const std::wst
 template void ComputationNetwork::InitLearnableParameters<float>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const float initValueScale, bool initOnCPUOnly);
 template void ComputationNetwork::Read<float>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<float>(File& fstream, bool create);
-template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize);
+template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize, const ParameterSVDOptions& options);
+template void ComputationNetwork::PruneWeights<float>(const wstring& nodeNameRegex, double sparsity, size_t blockSize);
 template /*static*/ void ComputationNetwork::SetDropoutRate<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
+template /*static*/ void ComputationNetwork::SetDropoutMinibatchShare<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t firstSequence, size_t numSequences);
 template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
-                                                     const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR);
+                                                     const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR, const double& pruningBeam);
 template void ComputationNetwork::SaveToDbnFile<float>(ComputationNetworkPtr net, const std::wstring& fileName) const;
 
 template void ComputationNetwork::InitLearnableParameters<double>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const double initValueScale, bool initOnCPUOnly);
 template void ComputationNetwork::Read<double>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<double>(File& fstream, bool create);
-template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize);
+template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize, const ParameterSVDOptions& options);
+template void ComputationNetwork::PruneWeights<double>(const wstring& nodeNameRegex, double sparsity, size_t blockSize);
 template /*static*/ void ComputationNetwork::SetDropoutRate<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
+template /*static*/ void ComputationNetwork::SetDropoutMinibatchShare<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t firstSequence, size_t numSequences);
 template void ComputationNetwork::SetSeqParam<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
-                                                      const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR);
+                                                      const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR, const double& pruningBeam);
 template void ComputationNetwork::SaveToDbnFile<double>(ComputationNetworkPtr net, const std::wstring& fileName) const;
 
 // register ComputationNetwork with the ScriptableObject system
@@ -26,10 +26,77 @@
 #include <regex>
 #include <chrono>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>
+#include <functional>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+class ComputeStreams;
+class CUDAGraph;
+
+// ===========================================================================
+// ComputationNetworkOptions -- optional optimizations that a network applies when it is compiled and evaluated
+// Each network has its own (see ComputationNetwork::SetOptions()), read from the config of the action or evaluator
+// that creates it, so that networks in the same process (e.g. several evaluators) do not interfere.
+// ===========================================================================
+
+struct ComputationNetworkOptions
+{
+    bool m_fuseElementwiseOps; // fold PlusNodes into the nonlinearity that consumes them (see ComputationNetwork::FuseElementwiseOperations())
+    bool m_batchTimesOperations; // compute independent Times products together in one batched GEMM (see ComputationNetwork::FormForwardPropBatches())
+    size_t m_concurrentStreams; // number of CUDA streams onto which independent branches of the network are spread (see ComputationNetwork::InterleaveIndependentBranches()); 0 or 1: off
+    bool m_captureLoops; // record the time steps of recurrent loops into CUDA graphs and replay them (see SEQTraversalFlowControlNode::RunCaptured())
+    bool m_hoistLoopInvariantSums; // compute the sums of loop-invariant operands inside recurrent loops once for all frames (see ComputationNetwork::HoistLoopInvariantSums())
+    bool m_skipFinishedSequences; // step recurrent loops only on the parallel sequences that have not ended (see SEQTraversalFlowControlNode::ActiveSequencesOf())
+    bool m_incrementalCompile; // after edits, revalidate and re-traverse only the nodes downstream of what was edited (see ComputationNetwork::DetermineAffectedNodes())
+    bool m_shareBuffersInPlace; // let gradients flow through identity operations and values of elementwise maps be computed in place (see ComputationNetwork::ShareBuffersWithConsumers())
+    bool m_eliminateCommonSubexpressions; // merge duplicate computations and delete unused nodes when compiling (see ComputationNetwork::EliminateCommonSubexpressions())
+    size_t m_managedMemoryPrefetchDistance; // with unified memory (managedGPUMemory), the number of nodes ahead of the current one whose matrices are prefetched to the GPU (see PARTraversalFlowControlNode::PrefetchAhead())
+    bool m_memoryAwareScheduling; // reorder the evaluation for a lower peak of live values when compiling (see ComputationNetwork::ScheduleForMemory())
+
+    ComputationNetworkOptions()
+        : m_fuseElementwiseOps(false),
+          m_batchTimesOperations(false),
+          m_concurrentStreams(0),
+          m_captureLoops(false),
+          m_hoistLoopInvariantSums(false),
+          m_skipFinishedSequences(false),
+          m_incrementalCompile(false),
+          m_shareBuffersInPlace(false),
+          m_eliminateCommonSubexpressions(false),
+          m_managedMemoryPrefetchDistance(2),
+          m_memoryAwareScheduling(false)
+    {
+    }
+    template <class ConfigRecordType>
+    explicit ComputationNetworkOptions(const ConfigRecordType& config)
+        : m_fuseElementwiseOps(config(L"fuseElementwiseOps", false)),
+          m_batchTimesOperations(config(L"batchTimesOperations", false)),
+          m_concurrentStreams(config(L"concurrentStreams", (size_t) 0)),
+          m_captureLoops(config(L"captureLoops", false)),
+          m_hoistLoopInvariantSums(config(L"hoistLoopInvariantSums", false)),
+          m_skipFinishedSequences(config(L"skipFinishedSequences", false)),
+          m_incrementalCompile(config(L"incrementalCompile", false)),
+          m_shareBuffersInPlace(config(L"shareBuffersInPlace", false)),
+          m_eliminateCommonSubexpressions(config(L"eliminateCommonSubexpressions", false)),
+          m_managedMemoryPrefetchDistance(config(L"managedMemoryPrefetchDistance", (size_t) 2)),
+          m_memoryAwareScheduling(config(L"memoryAwareScheduling", false))
+    {
+    }
+
+    // do the options differ in anything that CompileNetwork() decides?
+    bool CompilesDifferentlyFrom(const ComputationNetworkOptions& other) const
+    {
+        return m_fuseElementwiseOps != other.m_fuseElementwiseOps ||
+               m_batchTimesOperations != other.m_batchTimesOperations ||
+               m_concurrentStreams != other.m_concurrentStreams ||
+               m_hoistLoopInvariantSums != other.m_hoistLoopInvariantSums ||
+               m_eliminateCommonSubexpressions != other.m_eliminateCommonSubexpressions ||
+               m_memoryAwareScheduling != other.m_memoryAwareScheduling;
+    }
+};
+
 // ===========================================================================
 // ComputationNetwork -- computation graph and operations
 // ===========================================================================
@@ -45,8 +112,11 @@ public:
 
     ComputationNetwork()
         : m_randomSeedOffset(0),
+          m_traceLevel(0),
           m_isCompiled(false),
-          m_pMBLayout(make_shared<MBLayout>())
+          m_isIncrementalCompile(false),
+          m_pMBLayout(make_shared<MBLayout>()),
+          m_matrixPool(make_shared<MatrixPool>())
     {
     }
     ComputationNetwork(DEVICEID_TYPE deviceId)
@@ -69,6 +139,13 @@ public:
         m_deviceId = deviceId;
     }
 
+    // take the shared node matrices from 'matrixPool', which other networks may use as well, so that networks that are
+    // never evaluated at the same time share their workspace (see EvalHost). Takes effect with the next AllocateAllMatrices().
+    void SetMatrixPool(const shared_ptr<MatrixPool>& matrixPool)
+    {
+        m_matrixPool = matrixPool;
+    }
+
     DEVICEID_TYPE GetDeviceId() const { return m_deviceId; }
 
     // -----------------------------------------------------------------------
@@ -96,22 +173,28 @@ public:
 
     // static helper to instantiate a network from a file
     template <class ElemType>
-    static ComputationNetworkPtr CreateFromFile(DEVICEID_TYPE deviceId, const std::wstring& fileName)
+    static ComputationNetworkPtr CreateFromFile(DEVICEID_TYPE deviceId, const std::wstring& fileName, const ComputationNetworkOptions& options = ComputationNetworkOptions())
     {
         auto net = make_shared<ComputationNetwork>(deviceId);
+        net->SetOptions(options);
         net->Load<ElemType>(fileName);
         return net;
     }
 
-    void Save(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary) const;
+    // 'progress', if given, is called after each node is written, e.g. to throttle the writing
+    void Save(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary, const std::function<void(File&)>& progress = nullptr) const;
     void SaveEdited(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary);
 
     template <class ElemType>
     void SaveToDbnFile(ComputationNetworkPtr net, const std::wstring& fileName) const;
 
+    // writes the forward computation of 'outputNodes' (default: the output nodes) for the inference runtime (see InferenceRuntime.h)
+    template <class ElemType>
+    void ExportForInference(const std::wstring& fileName, const std::vector<ComputationNodeBasePtr>& outputNodes);
+
 private:
 
-    void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat) const;
+    void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat, const std::function<void(File&)>& progress) const;
 
 public:
 
@@ -123,18 +206,30 @@ public:
     void ForwardProp(const ComputationNodeBasePtr rootNode);
 
     // main entry point for backprop
-    void Backprop(const ComputationNodeBasePtr rootNode);
-
-    template <class NODESET> // version that takes multiple nodes
+    // If given, 'nodeDone' is called for each top-level node right after its Backprop(). Since nodes are visited
+    // in reverse evaluation order, the gradient of a node without consumers left to visit (e.g. a LearnableParameter) is final then.
+    // 'rootGradient' is the gradient the root starts with; loss scaling passes a value > 1 to keep small gradients from underflowing.
+    // With 'accumulateParameterGradients', the dense gradients of LearnableParameters are added to what the previous Backprop() left in them
+    // rather than overwritten, so that sub-minibatches sum up in place.
+    void Backprop(const ComputationNodeBasePtr rootNode, const std::function<void(const ComputationNodeBasePtr&)>& nodeDone = nullptr, double rootGradient = 1.0,
+                  bool accumulateParameterGradients = false);
+
+    // version that takes multiple nodes
+    // Only the union of the roots' cones is evaluated, as one traversal that is formed on first use and cached per set of roots.
+    void ForwardProp(const std::vector<ComputationNodeBasePtr>& rootNodes);
+    template <class NODESET>
     void ForwardProp(const NODESET& nodes)
     {
-        for (auto& node : nodes)
-            ForwardProp(node);
+        ForwardProp(std::vector<ComputationNodeBasePtr>(nodes.begin(), nodes.end()));
     }
 
     static void BumpEvalTimeStamp(const std::vector<ComputationNodeBasePtr>& nodes);
     void ResetEvalTimeStamps();
 
+    // per-node profiling of ForwardProp() and Backprop() (see NodeProfiler.h); pass nullptr to stop
+    void SetNodeProfiler(const std::shared_ptr<NodeProfiler>& profiler) { m_nodeProfiler = profiler; }
+    const std::shared_ptr<NodeProfiler>& GetNodeProfiler() const { return m_nodeProfiler; }
+
     // and for a set of nodes
     void StartEvaluateMinibatchLoop(const ComputationNodeBasePtr& rootNode) // (ugly name; meant to be unique so we can rename if needed)
     {
@@ -163,7 +258,17 @@ public:
 private:
     void ValidateNetwork();
     void ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFinalValidationPass, size_t& todo);
+    bool ValidateNode(const ComputationNodeBasePtr& node, bool isFinalValidationPass, std::vector<ComputationNodeBasePtr>& changedNodes);
+    void DetermineAffectedNodes();
+    void RememberCompiledState();
     void MarkValueNonSharableNodes();
+    bool EliminateCommonSubexpressions();
+    bool HoistLoopInvariantSums();
+    void FuseElementwiseOperations();
+    void FormForwardPropBatches();
+    void InterleaveIndependentBranches();
+    void ScheduleForMemory();
+    std::map<size_t, std::vector<ComputationNodeBasePtr>> DetermineForwardPropBatches(const std::vector<ComputationNodeBasePtr>& nestedNodes) const;
 
 private:
     void DetermineSetOfAllRoots();
@@ -174,10 +279,34 @@ private:
 public:
     void AllocateAllMatrices(const std::vector<ComputationNodeBasePtr>& evalRootNodes, const std::vector<ComputationNodeBasePtr>& outValueRootNodes, ComputationNodeBasePtr trainRootNode);
 
+    // predicted peak device memory of the node matrices (shared per the plan of AllocateAllMatrices(), and unshared)
+    // for minibatches of numParallelSequences x numTimeSteps columns. Matrices that nodes allocate internally outside
+    // the pool (e.g. convolution workspaces) are not included.
+    size_t EstimateDeviceMemory(DEVICEID_TYPE deviceId, size_t numParallelSequences, size_t numTimeSteps) const;
+    // bytes the node matrices currently hold on 'deviceId'
+    size_t GetAllocatedDeviceMemory(DEVICEID_TYPE deviceId) const;
+
+protected:
+    class SEQTraversalFlowControlNode;
+
 private:
     void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount);
     void AllocateGradientMatricesForInputs(ComputationNodeBasePtr parentNode);
 
+    // gradient checkpointing (recompute)
+    void DetermineRecomputeNodes(const std::vector<ComputationNodeBasePtr>& compositeForwardPropEvalOrder, const std::vector<ComputationNodeBasePtr>& forwardPropRoots,
+                                 std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp);
+    void RequestMatricesForRecomputeRec(const ComputationNodeBasePtr& node, std::set<ComputationNodeBasePtr>& recomputedNodes);
+    static void RecomputeValueForBackprop(const ComputationNodeBasePtr& node, const FrameRange& fr, const std::vector<std::shared_ptr<SEQTraversalFlowControlNode>>& loops);
+    static void RecomputeValuesNeededForBackprop(const ComputationNodeBasePtr& node, const FrameRange& fr, const std::vector<std::shared_ptr<SEQTraversalFlowControlNode>>& loops);
+    static void ReleaseRecomputedValue(const ComputationNodeBasePtr& node);
+    // half-precision storage of the values kept for backprop
+    void DetermineHalfPrecisionNodes(const std::vector<ComputationNodeBasePtr>& compositeForwardPropEvalOrder, const std::vector<ComputationNodeBasePtr>& forwardPropRoots,
+                                     std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp);
+    // in-place buffers: gradients shared through identity operations, values of elementwise maps computed into their input's buffer
+    void ShareBuffersWithConsumers(const std::vector<ComputationNodeBasePtr>& compositeForwardPropEvalOrder, const std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp,
+                                   bool performingBackPropagation);
+
 public:
     // -----------------------------------------------------------------------
     // evaluation: execution plan and network recurrent-loop analysis
@@ -185,6 +314,13 @@ public:
 
     void FormNestedNetwork(const ComputationNodeBasePtr& rootNode);
     ComputationNodeBasePtr GetNestedNetwork(const ComputationNodeBasePtr& rootNode);
+    ComputationNodeBasePtr GetNestedNetwork(const std::vector<ComputationNodeBasePtr>& rootNodes);
+private:
+    void AttachNodeProfiler(const ComputationNodeBasePtr& nestedNetwork);
+    void AttachComputeStreams(const ComputationNodeBasePtr& nestedNetwork);
+    void AttachOptions(const ComputationNodeBasePtr& nestedNetwork);
+    void InvalidateConcurrentStages();
+public:
 
     // The methods below determine evaluation order, which is tricky in presence of recurrent loops.
     // TODO: Can this be moved to a separate class?
@@ -192,9 +328,9 @@ private:
     // This is part of the FormRecurrentLoops() process, and only called from there.
     void FormRecurrentLoops(const ComputationNodeBasePtr& rootNode);
     void DetermineSCCs(const ComputationNodeBasePtr& rootNode);
-    void DetermineSCCsR(ComputationNodeBasePtr cur, std::list<ComputationNodeBasePtr>& sccStack, size_t& index, size_t& loopId);
+    void DetermineSCCsFrom(const ComputationNodeBasePtr& root, std::list<ComputationNodeBasePtr>& sccStack, size_t& index, size_t& loopId);
     void DetermineLoopForwardOrder(std::unordered_set<ComputationNodeBasePtr>& visited, std::unordered_set<ComputationNodeBasePtr>& recStack, std::list<ComputationNodeBasePtr>& nodesStack, ComputationNodeBasePtr cur);
-    void GatherLoopNodesR(const ComputationNodeBasePtr& rootNode, std::unordered_set<ComputationNodeBasePtr>& visited, std::map<int, std::list<ComputationNodeBasePtr>>& recurrentResult, std::list<ComputationNodeBasePtr>& noRecurrentResult);
+    void GatherLoopNodes(const ComputationNodeBasePtr& rootNode, std::unordered_set<ComputationNodeBasePtr>& visited, std::map<int, std::list<ComputationNodeBasePtr>>& recurrentResult, std::list<ComputationNodeBasePtr>& noRecurrentResult);
     void ReorderLoops(std::list<ComputationNodeBasePtr>& nodes, const std::map<int, std::list<ComputationNodeBasePtr>>& /*recurrentNodes*/, const std::list<ComputationNodeBasePtr>& /*noRecurrentNodes*/);
 
 public:
@@ -216,7 +352,18 @@ public:
         }
 
         if (rootNode)
-            m_evalOrders[rootNode] = rootNode->EnumerateNodes();
+        {
+            // a root that no edit since the last compilation has reached still has the traversal formed then
+            auto cached = m_compiledEvalOrders.find(rootNode);
+            if (m_isIncrementalCompile && cached != m_compiledEvalOrders.end() && m_affectedNodes.find(rootNode) == m_affectedNodes.end())
+                m_evalOrders[rootNode] = cached->second;
+            else
+            {
+                m_evalOrders[rootNode] = rootNode->EnumerateNodes();
+                if (m_options.m_incrementalCompile)
+                    m_compiledEvalOrders[rootNode] = m_evalOrders[rootNode]; // (copy, since FormRecurrentLoops() reorders it)
+            }
+        }
         else
             m_evalOrders[rootNode] = ComputationNodeBase::EnumerateNodes(m_allRoots);
     }
@@ -237,9 +384,6 @@ public:
         return m_evalOrders[rootNode];
     }
 
-protected:
-    class SEQTraversalFlowControlNode;
-
 private:
     static std::shared_ptr<SEQTraversalFlowControlNode> FindInRecurrentLoops(const std::vector<std::shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const ComputationNodeBasePtr& node);
 
@@ -324,11 +468,30 @@ public:
     void DeleteNode(const std::wstring& nodeName);
     void ChangeNode(wstring nodeName, ComputationNodeBasePtr newNode);
     void ReplaceLeafNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
+    void ReplaceNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
     void ReplaceFinalCriterionNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
     void AddFeatureNode(ComputationNodeBasePtr featureNode);
     void RemoveFeatureNode(ComputationNodeBasePtr featureNode);
     void SetLearnableNodesBelowNeedGradient(const bool needGradient, const ComputationNodeBasePtr& rootNode = nullptr);
     void SetBatchNormlizationNodesBelowEvalMode(const bool evalMode, const ComputationNodeBasePtr& rootNode = nullptr);
+    size_t SetStoreValuesInHalf(const std::vector<std::wstring>& operationNames, HalfFormat format);
+    void QuantizeWeightsToInt8();
+    void PackWeightsForInference();
+    ComputationNetworkPtr CloneForEvaluation() const;
+    ComputationNetworkPtr CloneForDevice(DEVICEID_TYPE deviceId) const;
+    template <class ElemType>
+    ComputationNetworkPtr CloneForSaving(const std::function<shared_ptr<Matrix<ElemType>>(const std::wstring& nodeName, const Matrix<ElemType>& value)>& snapshotValue) const;
+    template <class ElemType>
+    void PlaceOnDevices(const std::vector<DEVICEID_TYPE>& deviceIds, const std::vector<std::wstring>& stageStartNodeNames, const std::vector<ComputationNodeBasePtr>& lastStageNodes);
+    template <class ElemType>
+    void PlaceNodesOnDevices(const std::map<std::wstring, DEVICEID_TYPE>& nodeDevices, size_t cpuParameterThresholdBytes);
+    template <class ElemType>
+    void OptimizeForInference();
+
+private:
+    void RemoveDeviceTransferNodes();
+
+public:
 
     // -----------------------------------------------------------------------
     // node access
@@ -386,6 +549,10 @@ public:
     template <class ElemType>
     static void SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
 
+    // with data parallelism: which parallel sequences of the aggregate minibatch of all workers this network's minibatch is
+    template <class ElemType>
+    static void SetDropoutMinibatchShare(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t firstSequence, size_t numSequences);
+
     template <class ElemType>
     static void SetSeqParam(ComputationNetworkPtr net,
                             const ComputationNodeBasePtr criterionNode,
@@ -396,7 +563,8 @@ public:
                             const double& lmf = 14.0f,
                             const double& wp = 0.0f,
                             const double& bMMIfactor = 0.0f,
-                            const bool& sMBR = false);
+                            const bool& sMBR = false,
+                            const double& pruningBeam = 0.0f);
     static void SetMaxTempMemSizeForCNN(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const size_t maxTempMemSizeInSamples);
 
     // -----------------------------------------------------------------------
@@ -526,8 +694,24 @@ public:
     // specialized operations
     // -----------------------------------------------------------------------
 
+    // options of PerformSVDecomposition()
+    struct ParameterSVDOptions
+    {
+        bool m_randomized;            // truncated SVD by randomized subspace iteration (Matrix::TruncatedSVD()) instead of the full one
+        DEVICEID_TYPE m_deviceId;     // where the randomized SVD does its matrix products
+        size_t m_numThreads;          // decompositions running concurrently; 0: one per core
+        size_t m_numPowerIterations;  // of the randomized SVD
+        size_t m_oversampling;        // extra dimensions of the randomized SVD's sketch
+
+        ParameterSVDOptions()
+            : m_randomized(false), m_deviceId(CPUDEVICE), m_numThreads(0), m_numPowerIterations(2), m_oversampling(10)
+        {
+        }
+    };
+    template <class ElemType>
+    void PerformSVDecomposition(const map<wstring, float>& SVDConfig, size_t AlignedSize, const ParameterSVDOptions& options = ParameterSVDOptions());
     template <class ElemType>
-    void PerformSVDecomposition(const map<wstring, float>& SVDConfig, size_t AlignedSize);
+    void PruneWeights(const wstring& nodeNameRegex, double sparsity, size_t blockSize);
 
     // -----------------------------------------------------------------------
     // construction
@@ -760,16 +944,42 @@ protected:
         virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool);
         virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool);
         virtual bool IsOutOfDateWrtInputs() const override;
+        void ForwardPropStep(const FrameRange& t);
+        void BackpropStep(const FrameRange& t);
+        // all time steps at once from a recording (captureLoops option); false if the caller must step
+        bool RunCaptured(bool backprop);
+        // gradient checkpointing: run the loop again into the recompute buffers of its nodes, from the state it started from
+        void RecomputeForBackprop();
+
+    private:
+        // a recording of all time steps of the loop, for one layout
+        struct Capture
+        {
+            std::vector<const void*> m_buffers; // the buffers the recording is bound to
+            size_t m_numRuns;                   // with these buffers: 1 = warm-up, 2 = recorded
+            std::shared_ptr<CUDAGraph> m_graph;
+        };
+        bool CollectCaptureKey(bool backprop, std::vector<ptrdiff_t>& layoutKey, std::vector<const void*>& buffers) const;
+        void DetermineStepActiveSequencesOnly();
+        FrameRange ActiveSequencesOf(const FrameRange& t) const;
+        bool m_stepActiveSequencesOnly; // (skipFinishedSequences option) decided by BeginForwardProp() resp. BeginBackprop()
+        std::map<std::vector<ptrdiff_t>, Capture> m_captures; // [backprop, shape of the layouts]
+        size_t m_numCaptureFailures;
+        bool m_captureDisabled;
 
     public:
         // std::vector<ComputationNodeBasePtr> m_nestedNodes;               // all nodes involved in this loop, in evaluation order
         ComputationNodeBasePtr m_sourceNode; // one of the nodes of the loop   --TODO: What is the special meaning of this node? It seems to always be a delay node.
         int m_loopId;                        // unique loop id, index in m_allSEQNodes array
         int m_steppingDirection;             // +1 if left to right (t=0..T-1), -1 if rightt to left (t=T-1..0)
+        ComputationNetworkOptions m_networkOptions; // set by ComputationNetwork before each traversal, see AttachOptions()
 
         SEQTraversalFlowControlNode(int loopId, ComputationNodeBasePtr cur)
             : m_loopId(loopId),
-              m_sourceNode(cur)
+              m_sourceNode(cur),
+              m_numCaptureFailures(0),
+              m_captureDisabled(false),
+              m_stepActiveSequencesOnly(false)
         {
             SetNodeName(L"Loop_" + m_sourceNode->NodeName());
         }
@@ -825,6 +1035,37 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+        // called by Backprop() after each node, see ComputationNetwork::Backprop()
+        std::function<void(const ComputationNodeBasePtr&)> m_nodeBackpropDone;
+
+        // concurrent streams: if not null, the independent nodes of each stage are spread over these streams (see DetermineStages());
+        // set by ComputationNetwork before each traversal, see AttachComputeStreams()
+        ComputeStreams* m_computeStreams;
+        // set by ComputationNetwork before each traversal, see AttachOptions()
+        ComputationNetworkOptions m_networkOptions;
+        // the stages depend on the matrices the nodes hold, so they must be determined anew after the matrices are (re-)allocated
+        void InvalidateStages()
+        {
+            m_forwardStages.clear();
+            m_backpropStages.clear();
+        }
+
+    private:
+        typedef std::vector<std::vector<size_t>> Stages; // [stage] -> indices into m_nestedNodes, in traversal order
+        Stages DetermineStages(bool backprop) const;
+        std::vector<ComputationNodeBasePtr> GetUnitNodes(size_t index, bool backprop) const;
+        static void CollectMatrixUses(const std::vector<ComputationNodeBasePtr>& nodes, bool backprop, bool isLoop, std::set<const void*>& writes, std::set<const void*>& reads);
+        static bool IsRecomputeInvolved(const std::vector<ComputationNodeBasePtr>& nodes);
+        void ForwardPropUnit(size_t index, const FrameRange& fr);
+        void BackpropUnit(size_t index, const FrameRange& fr);
+        void PrefetchAhead(size_t index, bool backprop) const;
+        void DemoteParameters(size_t index) const;
+        void RunStage(const std::vector<size_t>& stage, bool backprop, const FrameRange& fr);
+
+        Stages m_forwardStages;  // formed on first use
+        Stages m_backpropStages; // in backprop order
+        std::vector<shared_ptr<SEQTraversalFlowControlNode>> m_loops; // the loops among m_nestedNodes (gradient checkpointing recomputes a loop as a whole)
     };
 
 public:
@@ -841,9 +1082,37 @@ public:
         m_randomSeedOffset = value;
     }
 
+    // > 0 for diagnostic messages, e.g. the memory sharing plan of AllocateAllMatrices()
+    void SetTraceLevel(int traceLevel)
+    {
+        m_traceLevel = traceLevel;
+    }
+    int GetTraceLevel() const
+    {
+        return m_traceLevel;
+    }
+
+    // best set before the network is compiled; a compiled network is compiled anew if the options change how
+    void SetOptions(const ComputationNetworkOptions& options)
+    {
+        const bool recompile = IsCompiled() && options.CompilesDifferentlyFrom(m_options);
+        m_options = options;
+        if (recompile)
+        {
+            InvalidateCompiledNetwork();
+            CompileNetwork();
+        }
+    }
+    const ComputationNetworkOptions& GetOptions() const
+    {
+        return m_options;
+    }
+
 protected:
     DEVICEID_TYPE m_deviceId; // TODO: is this shared by all nodes?
     unsigned long m_randomSeedOffset;
+    int m_traceLevel;
+    ComputationNetworkOptions m_options;
 
     // main node holder
     std::map<const std::wstring, ComputationNodeBasePtr, nocase_compare> m_nameToNodeMap; // [name] -> node; this is the main container that holds this networks' nodes
@@ -880,9 +1149,41 @@ private:
     // cache for evaluation ordering:
     bool m_isCompiled; // CompileNetwork has been called
 
+    // incremental compilation (incrementalCompile option): what the last CompileNetwork() saw, kept across InvalidateCompiledNetwork(),
+    // so that the next one only revalidates and re-traverses the nodes downstream of what was edited in between
+    struct CompiledNodeState
+    {
+        std::weak_ptr<ComputationNodeBase> m_node; // (weak, so that a deleted node is released; it being expired tells a new node at the same address)
+        std::vector<const ComputationNodeBase*> m_inputs;
+        TensorShape m_sampleLayout;
+        bool m_hasMBLayout;
+        bool m_parameterUpdateRequired;
+
+        CompiledNodeState(const ComputationNodeBasePtr& node)
+            : m_node(node), m_sampleLayout(node->GetSampleLayout()), m_hasMBLayout(node->HasMBLayout()), m_parameterUpdateRequired(node->IsParameterUpdateRequired())
+        {
+            for (const auto& input : node->GetInputs())
+                m_inputs.push_back(input.get());
+        }
+        bool IsStateOf(const ComputationNodeBasePtr& node) const
+        {
+            if (m_node.lock() != node || m_inputs.size() != node->GetNumInputs())
+                return false;
+            for (size_t i = 0; i < m_inputs.size(); i++)
+                if (m_inputs[i] != node->Input(i).get())
+                    return false;
+            return m_sampleLayout == node->GetSampleLayout() && m_hasMBLayout == node->HasMBLayout() && m_parameterUpdateRequired == node->IsParameterUpdateRequired();
+        }
+    };
+    std::unordered_map<const ComputationNodeBase*, CompiledNodeState> m_compiledNodeStates;              // [node] as of the last successful CompileNetwork()
+    std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_compiledEvalOrders;      // [out node] depth-first traversal, before loop reordering
+    bool m_isIncrementalCompile;                                                                         // the running CompileNetwork() compiles only m_affectedNodes anew
+    std::unordered_set<ComputationNodeBasePtr> m_affectedNodes;                                          // nodes that were edited, and everything downstream of them
+
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
     std::map<const ComputationNodeBasePtr, ComputationNodeBasePtr> m_nestedNetworks;        // [out node] network rewritten as recursive traveral, potentially optimized; execution plan
+    std::map<std::vector<ComputationNodeBasePtr>, ComputationNodeBasePtr> m_nestedNetworksForRootSets; // [sorted out nodes] execution plan for the union of their cones; formed on demand
 
     // cached quick-access list for inputs and parameters
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_inputValues;         // [out node] -> all input nodes feeding into out node
@@ -891,7 +1192,11 @@ private:
 private:
     // pool for matrices that can be shared across nodes
     // TODO: does this apply to anything else besides temporary node-internal intermediate results? What, for example?
-    MatrixPool m_matrixPool;
+    // Networks that are never evaluated at the same time may share one, see SetMatrixPool().
+    shared_ptr<MatrixPool> m_matrixPool;
+
+    std::shared_ptr<NodeProfiler> m_nodeProfiler; // see SetNodeProfiler()
+    std::shared_ptr<ComputeStreams> m_computeStreams; // created on first use if m_options.m_concurrentStreams > 1 and on a GPU, see AttachComputeStreams()
 };
 typedef ComputationNetwork::ComputationNetworkPtr ComputationNetworkPtr;
 
@@ -9,8 +9,11 @@
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
+#include "LinearAlgebraNodes.h"
 #include <string>
 #include <set>
+#include <map>
+#include <typeinfo>
 
 using namespace std;
 
@@ -119,12 +122,12 @@ void ComputationNetwork::FormRecurrentLoops(const ComputationNodeBasePtr& rootNo
         list<ComputationNodeBasePtr> noRecurrentNodes;
 #if 1 // will soon no longer be allowed
         if (rootNode)
-            GatherLoopNodesR(rootNode, visited, recurrentNodes, noRecurrentNodes);
+            GatherLoopNodes(rootNode, visited, recurrentNodes, noRecurrentNodes);
         else
 #endif
         {
             for (const auto& rootNode : m_allRoots)
-                GatherLoopNodesR(rootNode, visited, recurrentNodes, noRecurrentNodes);
+                GatherLoopNodes(rootNode, visited, recurrentNodes, noRecurrentNodes);
         }
 
         auto reorderedNodes = nodes;
@@ -190,99 +193,116 @@ void ComputationNetwork::DetermineSCCs(const ComputationNodeBasePtr& rootNode)
     if (rootNode)
     {
         if (!rootNode->m_visited)
-            DetermineSCCsR(rootNode, sccStack, index, loopId);
+            DetermineSCCsFrom(rootNode, sccStack, index, loopId);
         return;
     }
 #endif
     // traverse all root nodes (as if they were all children of a master root)
     for (auto& rootNode : m_allRoots)
         if (!rootNode->m_visited)
-            DetermineSCCsR(rootNode, sccStack, index, loopId);
+            DetermineSCCsFrom(rootNode, sccStack, index, loopId);
 }
 
-// (recursive part of DetermineSCCs())
-void ComputationNetwork::DetermineSCCsR(ComputationNodeBasePtr cur,
-                                        list<ComputationNodeBasePtr>& sccStack,
-                                        size_t& index, size_t& loopId)
+// (traversal part of DetermineSCCs())
+// This is Tarjan's algorithm, with an explicit stack of the nodes being visited and the next input of each to look at,
+// instead of recursion, since generated networks can be deeper than the call stack.
+void ComputationNetwork::DetermineSCCsFrom(const ComputationNodeBasePtr& root,
+                                           list<ComputationNodeBasePtr>& sccStack,
+                                           size_t& index, size_t& loopId)
 {
-    assert(!cur->m_visited);
+    vector<pair<ComputationNodeBasePtr, size_t>> visitStack;
+    auto enter = [&](const ComputationNodeBasePtr& node)
+    {
+        assert(!node->m_visited);
 
-    // set the index (in order of visitation)
-    cur->m_index = index;    // TODO: can this be used as m_visitedOrder?
-    cur->m_minIndex = index; // also set m_minIndex
-    index++;
+        // set the index (in order of visitation)
+        node->m_index = index;    // TODO: can this be used as m_visitedOrder?
+        node->m_minIndex = index; // also set m_minIndex
+        index++;
 
-    cur->m_visited = true;
-    sccStack.push_back(cur);
-    cur->m_inStack = true;
+        node->m_visited = true;
+        sccStack.push_back(node);
+        node->m_inStack = true;
+        visitStack.push_back(make_pair(node, (size_t) 0));
+    };
 
-    // set m_minIndex to min over m_lowLinks of children
-    for (int i = 0; i < cur->GetNumInputs(); i++)
+    enter(root);
+    while (!visitStack.empty())
     {
-        if (!cur->Input(i)->m_visited)
+        const ComputationNodeBasePtr cur = visitStack.back().first;
+
+        // set m_minIndex to min over m_lowLinks of children
+        size_t& i = visitStack.back().second;
+        if (i < cur->GetNumInputs())
         {
-            DetermineSCCsR(cur->Input(i), sccStack, index, loopId);
-            cur->m_minIndex = min(cur->m_minIndex, cur->Input(i)->m_minIndex);
+            const ComputationNodeBasePtr input = cur->Input(i++);
+            if (!input->m_visited)
+                enter(input); // its m_minIndex is passed on to 'cur' when it is done
+            else if (input->m_inStack)
+                cur->m_minIndex = min(cur->m_minIndex, input->m_minIndex);
+            continue;
         }
-        else if (cur->Input(i)->m_inStack)
+        visitStack.pop_back();
+        if (!visitStack.empty())
         {
-            cur->m_minIndex = min(cur->m_minIndex, cur->Input(i)->m_minIndex);
+            const auto& parent = visitStack.back().first;
+            parent->m_minIndex = min(parent->m_minIndex, cur->m_minIndex);
         }
-    }
 
-    // if we closed a loop then create an entry in m_allSEQNodes
-    if (cur->m_minIndex == cur->m_index) // m_minIndex is still equal to m_index, as we set it at the start of this function: we closed a loop
-    {
-        // gather the list of all nodes in this loop
-        vector<ComputationNodeBasePtr> nestedNodes;
-        // TODO: build array first in a local array. Only if succeeds, then construct the node off it.
-        SEQTraversalFlowControlNode rInfo(m_allSEQNodes.size() /*loopId*/, cur);
-        for (;;)
+        // if we closed a loop then create an entry in m_allSEQNodes
+        if (cur->m_minIndex == cur->m_index) // m_minIndex is still equal to m_index, as set when entering it: we closed a loop
         {
-            ComputationNodeBasePtr w = sccStack.back();
-            sccStack.pop_back();
-            w->m_inStack = false;
-            nestedNodes.push_back(w);
-            if (w == cur) // hit our starting point: done
-                break;
-        }
-        // insert loop into m_allSEQNodes
-        if (nestedNodes.size() > 1) // non-looped nodes are detected here as loops of size 1 --skip those
-        {
-            // only add to the array if the loop is not already there
-            // We end up producing the same loop multiple times because:
-            //  - FormRecurrentLoops() is called multiple times from different roots
-            //  - depth-first traversal might have led us to enter a loop multiple times?
-            // TODO: Check whether this edge case of idempotence is done correctly:
-            //  - a recurrent loop with two delay nodes
-            //  - two root nodes
-            //  - the first root takes the first delay node's value, the second root that of the second delay node
-            //    I.e. the depth-first tree traversals enter the loop at two different places (m_sourceNode).
-            //  -> Are these two loops detected as identical? (determined by m_minIndex, but m_index depends on traversal from each root, so maybe not)
-            bool bFound = false; // find a dup  --TODO: check whether there is an STL algorithm for this
-            for (const auto& iter2 : m_allSEQNodes)
+            // gather the list of all nodes in this loop
+            vector<ComputationNodeBasePtr> nestedNodes;
+            // TODO: build array first in a local array. Only if succeeds, then construct the node off it.
+            SEQTraversalFlowControlNode rInfo(m_allSEQNodes.size() /*loopId*/, cur);
+            for (;;)
             {
-                if (iter2->m_sourceNode == cur)
-                {
-                    bFound = true;
+                ComputationNodeBasePtr w = sccStack.back();
+                sccStack.pop_back();
+                w->m_inStack = false;
+                nestedNodes.push_back(w);
+                if (w == cur) // hit our starting point: done
                     break;
-                }
             }
-            if (!bFound)
+            // insert loop into m_allSEQNodes
+            if (nestedNodes.size() > 1) // non-looped nodes are detected here as loops of size 1 --skip those
             {
+                // only add to the array if the loop is not already there
+                // We end up producing the same loop multiple times because:
+                //  - FormRecurrentLoops() is called multiple times from different roots
+                //  - depth-first traversal might have led us to enter a loop multiple times?
+                // TODO: Check whether this edge case of idempotence is done correctly:
+                //  - a recurrent loop with two delay nodes
+                //  - two root nodes
+                //  - the first root takes the first delay node's value, the second root that of the second delay node
+                //    I.e. the depth-first tree traversals enter the loop at two different places (m_sourceNode).
+                //  -> Are these two loops detected as identical? (determined by m_minIndex, but m_index depends on traversal from each root, so maybe not)
+                bool bFound = false; // find a dup  --TODO: check whether there is an STL algorithm for this
+                for (const auto& iter2 : m_allSEQNodes)
+                {
+                    if (iter2->m_sourceNode == cur)
+                    {
+                        bFound = true;
+                        break;
+                    }
+                }
+                if (!bFound)
+                {
 #if 1
-                if (loopId != m_allSEQNodes.size())
-                    LogicError("DetermineSCCsR(): inconsistent loopId (%d) vs. m_allSEQNodes.size() (%d)", (int) loopId, (int) m_allSEQNodes.size());
-                SEQTraversalFlowControlNode rInfo(m_allSEQNodes.size(), cur);
+                    if (loopId != m_allSEQNodes.size())
+                        LogicError("DetermineSCCsFrom(): inconsistent loopId (%d) vs. m_allSEQNodes.size() (%d)", (int) loopId, (int) m_allSEQNodes.size());
+                    SEQTraversalFlowControlNode rInfo(m_allSEQNodes.size(), cur);
 #else
-                assert(loopId == m_allSEQNodes.size()); // BUGBUG: Only true if all loops are shared among roots. Fix: use m_allSEQNodes.size() instead
-                SEQTraversalFlowControlNode rInfo(loopId, cur);
+                    assert(loopId == m_allSEQNodes.size()); // BUGBUG: Only true if all loops are shared among roots. Fix: use m_allSEQNodes.size() instead
+                    SEQTraversalFlowControlNode rInfo(loopId, cur);
 #endif
-                // TODO: can we prove that 'cur' == nestedNodes.front()? If so, we won't need to store it separately.
-                rInfo.m_nestedNodes = move(nestedNodes); // TODO: make these two part of the constructor
-                rInfo.m_steppingDirection = DetermineLoopDirection(rInfo.m_nestedNodes);
-                m_allSEQNodes.push_back(make_shared<SEQTraversalFlowControlNode>(move(rInfo)));
-                loopId++; // and count it  TODO: may be removed
+                    // TODO: can we prove that 'cur' == nestedNodes.front()? If so, we won't need to store it separately.
+                    rInfo.m_nestedNodes = move(nestedNodes); // TODO: make these two part of the constructor
+                    rInfo.m_steppingDirection = DetermineLoopDirection(rInfo.m_nestedNodes);
+                    m_allSEQNodes.push_back(make_shared<SEQTraversalFlowControlNode>(move(rInfo)));
+                    loopId++; // and count it  TODO: may be removed
+                }
             }
         }
     }
@@ -316,23 +336,33 @@ void ComputationNetwork::DetermineLoopForwardOrder(unordered_set<ComputationNode
 // traverse sub-graph feeding this node (which is a top-level node at start, e.g. training criterion) and list
 //  - all nodes that participate in a loop -> recurrentResult[loopId][]
 //  - all nodes that don't                 -> noRecurrentResult[]
-// in order of traversal (depth-first).
+// in order of traversal (depth-first; with an explicit stack, since generated networks can be deeper than the call stack).
 // This is part of the FormRecurrentLoops() process, and only called from there from one place.
-void ComputationNetwork::GatherLoopNodesR(const ComputationNodeBasePtr& node, unordered_set<ComputationNodeBasePtr>& visited,
-                                          map<int, list<ComputationNodeBasePtr>>& recurrentResult,
-                                          list<ComputationNodeBasePtr>& noRecurrentResult)
+void ComputationNetwork::GatherLoopNodes(const ComputationNodeBasePtr& rootNode, unordered_set<ComputationNodeBasePtr>& visited,
+                                         map<int, list<ComputationNodeBasePtr>>& recurrentResult,
+                                         list<ComputationNodeBasePtr>& noRecurrentResult)
 {
-    if (visited.find(node) != visited.end())
+    if (!visited.insert(rootNode).second)
         return; // do each node only once
-    visited.insert(node);
-
-    for (int i = 0; i < node->GetNumInputs(); i++)
-        GatherLoopNodesR(node->Input(i), visited, recurrentResult, noRecurrentResult);
+    vector<pair<ComputationNodeBasePtr, size_t>> visitStack(1, make_pair(rootNode, (size_t) 0));
+    while (!visitStack.empty())
+    {
+        const ComputationNodeBasePtr node = visitStack.back().first;
+        size_t& i = visitStack.back().second;
+        if (i < node->GetNumInputs())
+        {
+            const ComputationNodeBasePtr input = node->Input(i++);
+            if (visited.insert(input).second)
+                visitStack.push_back(make_pair(input, (size_t) 0));
+            continue;
+        }
+        visitStack.pop_back();
 
-    if (node->m_loopId >= 0)
-        recurrentResult[node->m_loopId].push_back(node);
-    else
-        noRecurrentResult.push_back(node);
+        if (node->m_loopId >= 0)
+            recurrentResult[node->m_loopId].push_back(node);
+        else
+            noRecurrentResult.push_back(node);
+    }
 }
 
 // takes a list of nodes and modifies it such that all nodes of the same loop are consecutive
@@ -408,4 +438,647 @@ static int DetermineLoopDirection(const std::vector<ComputationNodeBasePtr>& nes
     return steppingDirection;
 }
 
+// -----------------------------------------------------------------------
+// common subexpressions and unused nodes
+// -----------------------------------------------------------------------
+
+// EliminateCommonSubexpressions() -- merge nodes that compute the same, and delete nodes whose result nobody asks for.
+// Networks from SimpleNetworkBuilder, NDL macros and especially MEL edits often instantiate a computation more than once, e.g.
+// the same Times(W,x) in two branches, or a MeanNode of the features for each of several normalizations.
+// Two nodes compute the same if they are of the same type, have the same inputs (after merging those), and the same attributes
+// (HasSameAttributesAs(), which nodes opt into). The first one in evaluation order is kept, and the consumers of the others are
+// redirected to it, unless only a later one is in a node group (criterion, output, etc.), which then is kept under its name.
+// A node is unused if it is not a leaf, nobody consumes it, and it is in no node group: a root that nothing asks for, which would
+// still be precomputed (MeanNode etc.) and allocated. Such nodes are deleted, and then those of their inputs that become unused.
+// Note: A node that is only referred to by name in the config (e.g. criterionNodes or outputNodeNames) counts as unused.
+// Returns true if the network was changed; CompileNetwork() then starts over, where this finds nothing more to do.
+bool ComputationNetwork::EliminateCommonSubexpressions()
+{
+    if (!m_options.m_eliminateCommonSubexpressions)
+        return false;
+
+    const list<ComputationNodeBasePtr> nodes = GetEvalOrder(nullptr); // (copy, since DeleteNode() invalidates it)
+    set<ComputationNodeBasePtr> groupNodes;
+    for (auto group : GetAllNodeGroups())
+        groupNodes.insert(group->begin(), group->end());
+
+    map<ComputationNodeBasePtr, ComputationNodeBasePtr> mergedInto;
+    auto survivorOf = [&](ComputationNodeBasePtr node)
+    {
+        for (auto iter = mergedInto.find(node); iter != mergedInto.end(); iter = mergedInto.find(node))
+            node = iter->second;
+        return node;
+    };
+
+    // merge, in evaluation order, so that the inputs of a node are merged before the node is looked up
+    map<pair<wstring, vector<ComputationNodeBasePtr>>, vector<ComputationNodeBasePtr>> nodesByOperationAndInputs;
+    for (auto& node : nodes)
+    {
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            auto survivor = survivorOf(node->Input(i));
+            if (survivor != node->Input(i))
+                node->SetInput(i, survivor);
+        }
+        if (node->IsLeaf())
+            continue;
+
+        auto& sameNodes = nodesByOperationAndInputs[make_pair(node->OperationName(), node->GetInputs())];
+        bool merged = false;
+        for (auto& other : sameNodes)
+        {
+            if (typeid(*other) != typeid(*node) || !other->HasSameAttributesAs(*node) ||
+                other->IsRecompute() != node->IsRecompute() || other->IsStoreValueInHalf() != node->IsStoreValueInHalf())
+                continue;
+            ComputationNodeBasePtr kept = other, dropped = node;
+            if (groupNodes.find(node) != groupNodes.end())
+            {
+                if (groupNodes.find(other) != groupNodes.end())
+                    break; // both are known by name
+                swap(kept, dropped);
+                other = node;
+            }
+            fprintf(stderr, "EliminateCommonSubexpressions: %ls %ls operation merged into %ls.\n", dropped->NodeName().c_str(), dropped->OperationName().c_str(), kept->NodeName().c_str());
+            mergedInto[dropped] = kept;
+            merged = true;
+            break;
+        }
+        if (!merged)
+            sameNodes.push_back(node);
+    }
+
+    // consumers seen before a later node was kept instead, and recurrent back edges, still refer to merged nodes
+    for (auto& node : nodes)
+    {
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            auto survivor = survivorOf(node->Input(i));
+            if (survivor != node->Input(i))
+                node->SetInput(i, survivor);
+        }
+    }
+    for (auto& merged : mergedInto)
+        DeleteNode(merged.first->NodeName());
+
+    // delete unused nodes, and then the inputs that this leaves unused
+    map<ComputationNodeBasePtr, size_t> numUses;
+    for (auto& pair : m_nameToNodeMap)
+        for (auto& input : pair.second->GetInputs())
+            numUses[input]++;
+    vector<ComputationNodeBasePtr> unusedCandidates;
+    for (auto& pair : m_nameToNodeMap)
+        unusedCandidates.push_back(pair.second);
+    size_t numDeleted = 0;
+    while (!unusedCandidates.empty())
+    {
+        const auto node = unusedCandidates.back();
+        unusedCandidates.pop_back();
+        auto iter = m_nameToNodeMap.find(node->NodeName());
+        if (iter == m_nameToNodeMap.end() || iter->second != node || node->IsLeaf() || numUses[node] != 0 || groupNodes.find(node) != groupNodes.end())
+            continue;
+        fprintf(stderr, "EliminateCommonSubexpressions: %ls %ls operation is unused and deleted.\n", node->NodeName().c_str(), node->OperationName().c_str());
+        const auto inputs = node->GetInputs(); // (copy, since DeleteNode() detaches them)
+        for (auto& input : inputs)
+            numUses[input]--;
+        DeleteNode(node->NodeName());
+        unusedCandidates.insert(unusedCandidates.end(), inputs.begin(), inputs.end());
+        numDeleted++;
+    }
+
+    if (mergedInto.empty() && numDeleted == 0)
+        return false;
+    fprintf(stderr, "EliminateCommonSubexpressions: %d nodes merged, %d unused nodes deleted.\n", (int) mergedInto.size(), (int) numDeleted);
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// loop-invariant sums
+// -----------------------------------------------------------------------
+
+// HoistLoopInvariantSums() -- reassociate sums inside recurrent loops so that the operands that do not depend on the loop are
+// added up outside of it, in PAR mode over all frames at once. A sum becomes part of a loop as soon as one of its operands is,
+// so e.g. in Plus(Plus(Times(W,x), Times(R,h_{t-1})), b) both additions are stepped frame by frame, although Times(W,x) + b
+// could be computed by one kernel for the whole minibatch; FormRecurrentLoops() itself keeps out only the nodes that do not
+// depend on the delay. Here, each maximal tree of PlusNodes in a loop is rewired into Plus(<sum of the operands in the loop>,
+// <sum of the operands outside of it>), using the same PlusNodes, so that no node is added and none is renamed.
+// The inner PlusNodes of a tree must not be observable: each is used by its tree only, is not a root, and does not recompute.
+// The result differs from the original in the order of the floating-point additions only.
+// Returns true if the network was changed; CompileNetwork() then starts over, where this finds nothing more to do.
+bool ComputationNetwork::HoistLoopInvariantSums()
+{
+    if (!m_options.m_hoistLoopInvariantSums || m_allSEQNodes.empty())
+        return false;
+
+    const auto& nodes = GetEvalOrder(nullptr);
+    map<ComputationNodeBasePtr, size_t> numUses;
+    for (auto& node : nodes)
+        for (auto& input : node->GetInputs())
+            numUses[input]++;
+    set<ComputationNodeBasePtr> roots(m_allRoots.begin(), m_allRoots.end());
+
+    auto isSum = [](const ComputationNodeBasePtr& node)
+    {
+        return node->OperationName() == OperationNameOf(PlusNode) && node->GetNumInputs() == 2 && !node->IsRecompute();
+    };
+    // an inner node of a tree: a sum in the same loop that only the tree uses
+    auto isInner = [&](const ComputationNodeBasePtr& node, const shared_ptr<SEQTraversalFlowControlNode>& loop)
+    {
+        return isSum(node) && node->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, node) == loop &&
+               numUses[node] == 1 && roots.find(node) == roots.end();
+    };
+
+    // the trees start at the sums that no other sum of the same loop absorbs
+    set<ComputationNodeBasePtr> innerNodes;
+    for (auto& node : nodes)
+    {
+        if (!isSum(node) || !node->IsPartOfLoop())
+            continue;
+        auto loop = FindInRecurrentLoops(m_allSEQNodes, node);
+        for (auto& input : node->GetInputs())
+            if (isInner(input, loop))
+                innerNodes.insert(input);
+    }
+
+    size_t numHoisted = 0;
+    for (auto& node : nodes)
+    {
+        if (!isSum(node) || !node->IsPartOfLoop() || innerNodes.find(node) != innerNodes.end())
+            continue;
+        auto loop = FindInRecurrentLoops(m_allSEQNodes, node);
+
+        // collect the inner sums and the operands of the tree
+        vector<ComputationNodeBasePtr> sums, inLoopOperands, invariantOperands;
+        vector<ComputationNodeBasePtr> stack{node->Input(1), node->Input(0)};
+        while (!stack.empty())
+        {
+            auto operand = stack.back();
+            stack.pop_back();
+            if (isInner(operand, loop))
+            {
+                sums.push_back(operand);
+                stack.push_back(operand->Input(1));
+                stack.push_back(operand->Input(0));
+            }
+            else if (operand->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, operand) == loop)
+                inLoopOperands.push_back(operand);
+            else
+                invariantOperands.push_back(operand);
+        }
+        if (invariantOperands.size() < 2 || inLoopOperands.empty()) // nothing to be gained
+            continue;
+
+        // rewire: the inner sums first add up the operands in the loop, then the invariant ones; 'node' adds the two
+        auto nextSum = sums.begin();
+        auto chain = [&](const vector<ComputationNodeBasePtr>& operands, bool isPartOfLoop)
+        {
+            ComputationNodeBasePtr sum = operands.front();
+            for (size_t i = 1; i < operands.size(); i++)
+            {
+                auto& innerSum = *nextSum++;
+                innerSum->SetInput(0, sum);
+                innerSum->SetInput(1, operands[i]);
+                innerSum->m_isPartOfLoop = isPartOfLoop; // (FormRecurrentLoops() only ever sets it)
+                sum = innerSum;
+            }
+            return sum;
+        };
+        auto inLoopSum = chain(inLoopOperands, true);
+        auto invariantSum = chain(invariantOperands, false);
+        assert(nextSum == sums.end());
+        node->SetInput(0, inLoopSum);
+        node->SetInput(1, invariantSum);
+        numHoisted += invariantOperands.size() - 1;
+    }
+
+    if (numHoisted > 0)
+        fprintf(stderr, "HoistLoopInvariantSums: %d additions moved out of recurrent loops.\n", (int) numHoisted);
+    return numHoisted > 0;
+}
+
+// -----------------------------------------------------------------------
+// elementwise fusion
+// -----------------------------------------------------------------------
+
+// FuseElementwiseOperations() -- find PlusNodes that feed a nonlinearity which can evaluate f(a + b) directly (CanAbsorbSumInput()),
+// and mark them as absorbed. The nonlinearity then does the work for both nodes in a single kernel, in forward and backward
+// direction, which saves a full round trip of the intermediate sum through device memory. This matters most for small
+// recurrent layers, where each time step is dominated by launch and bandwidth overhead, e.g. Sigmoid(Plus(Times(W,x),b)).
+// A PlusNode is only absorbed if nobody else can observe its value or gradient:
+//  - its consumer is its only parent, and it is not a root (output, criterion, etc.)
+//  - it lives in the same loop as its consumer (or both are outside of loops), so both are stepped together
+//  - its inputs have either its own MBLayout or none (broadcasting, e.g. a bias), which is what the fused kernel supports
+//  - gradient checkpointing is not requested for either node, since recomputing a no-op would not restore anything
+// Note: This may be called repeatedly (CompileNetwork() after modifications), so all flags are determined from scratch.
+void ComputationNetwork::FuseElementwiseOperations()
+{
+    const auto& nodes = GetEvalOrder(nullptr);
+    for (auto& node : nodes)
+        node->m_absorbedIntoConsumer = false;
+
+    if (!m_options.m_fuseElementwiseOps)
+        return;
+
+    // count uses of each node as an input
+    map<ComputationNodeBasePtr, size_t> numUses;
+    for (auto& node : nodes)
+        for (auto& input : node->GetInputs())
+            numUses[input]++;
+
+    set<ComputationNodeBasePtr> roots(m_allRoots.begin(), m_allRoots.end());
+
+    size_t numFused = 0;
+    for (auto& node : nodes)
+    {
+        if (node->GetNumInputs() != 1 || !node->CanAbsorbSumInput() || node->IsRecompute())
+            continue;
+
+        auto sum = node->Input(0);
+        if (sum->OperationName() != OperationNameOf(PlusNode) || sum->IsRecompute() ||
+            numUses[sum] != 1 || roots.find(sum) != roots.end())
+            continue;
+
+        if (sum->IsPartOfLoop() != node->IsPartOfLoop() ||
+            (node->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, sum) != FindInRecurrentLoops(m_allSEQNodes, node)))
+            continue;
+
+        bool layoutsMatch = true;
+        for (auto& input : sum->GetInputs())
+            if (input->HasMBLayout() && input->GetMBLayout() != sum->GetMBLayout())
+                layoutsMatch = false;
+        if (!layoutsMatch || node->GetMBLayout() != sum->GetMBLayout())
+            continue;
+
+        sum->m_absorbedIntoConsumer = true;
+        numFused++;
+    }
+
+    if (numFused > 0)
+        fprintf(stderr, "FuseElementwiseOperations: %d %ls operations fused into their consumers.\n", (int) numFused, OperationNameOf(PlusNode).c_str());
+}
+
+// -----------------------------------------------------------------------
+// batched GEMM
+// -----------------------------------------------------------------------
+
+// FormForwardPropBatches() -- group independent Times products of each loop step, and of each PAR traversal, so that they are
+// computed by a single batched GEMM call (see ComputationNodeBase::ForwardPropBatched()). Typical are the four gate projections
+// of an LSTM, Times(W_i, h_{t-1}) ... Times(W_o, h_{t-1}), which are each far too small to keep the GPU busy.
+// Note: This may be called repeatedly (CompileNetwork() after modifications), so all batches are determined from scratch.
+void ComputationNetwork::FormForwardPropBatches()
+{
+    size_t numBatches = 0, numBatchedNodes = 0;
+    auto form = [&](FlowControlNode& flowControlNode)
+    {
+        flowControlNode.SetForwardPropBatches(DetermineForwardPropBatches(flowControlNode.m_nestedNodes));
+        for (const auto& batch : flowControlNode.m_forwardPropBatches)
+        {
+            numBatches++;
+            numBatchedNodes += batch.second.size();
+        }
+    };
+    for (auto& loop : m_allSEQNodes)
+        form(*loop);
+    for (auto& network : m_nestedNetworks)
+        form(*dynamic_pointer_cast<FlowControlNode>(network.second));
+
+    if (numBatches > 0)
+        fprintf(stderr, "FormForwardPropBatches: %d %ls operations grouped into %d batched GEMMs.\n", (int) numBatchedNodes, OperationNameOf(TimesNode).c_str(), (int) numBatches);
+}
+
+// DetermineForwardPropBatches() -- greedily group Times nodes in 'nestedNodes' (in evaluation order) that may be computed together
+// at the position of the first one, i.e. all of whose inputs are computed before it. Nested loops count as a whole.
+// Whether the products really have matching dimensions can only be known at runtime, where non-matching ones are computed on their own.
+// Returns [index of the first node of a batch] -> all nodes of the batch, for batches of at least two nodes.
+map<size_t, vector<ComputationNodeBasePtr>> ComputationNetwork::DetermineForwardPropBatches(const vector<ComputationNodeBasePtr>& nestedNodes) const
+{
+    map<size_t, vector<ComputationNodeBasePtr>> batches;
+    if (!m_options.m_batchTimesOperations)
+        return batches;
+
+    // position of each node in the traversal; nodes inside a nested loop get the position of the loop
+    map<ComputationNodeBasePtr, size_t> positions;
+    for (size_t i = 0; i < nestedNodes.size(); i++)
+    {
+        positions[nestedNodes[i]] = i;
+        auto loop = dynamic_pointer_cast<SEQTraversalFlowControlNode>(nestedNodes[i]);
+        if (loop)
+            for (auto& node : loop->m_nestedNodes)
+                positions[node] = i;
+    }
+
+    auto isTimes = [](const ComputationNodeBasePtr& node) -> bool
+    {
+        return !node->IsRecompute() && (node->OperationName() == OperationNameOf(TimesNode) || node->OperationName() == OperationNameOf(TransposeTimesNode));
+    };
+
+    vector<bool> isBatched(nestedNodes.size(), false);
+    for (size_t i = 0; i < nestedNodes.size(); i++)
+    {
+        const auto& leader = nestedNodes[i];
+        if (isBatched[i] || !isTimes(leader))
+            continue;
+
+        vector<ComputationNodeBasePtr> batch(1, leader);
+        vector<size_t> members;
+        for (size_t j = i + 1; j < nestedNodes.size(); j++)
+        {
+            const auto& node = nestedNodes[j];
+            if (isBatched[j] || node->OperationName() != leader->OperationName())
+                continue;
+            bool inputsReady = true;
+            for (auto& input : node->GetInputs())
+            {
+                auto iter = positions.find(input);
+                if (iter != positions.end() && iter->second >= i)
+                    inputsReady = false;
+            }
+            if (inputsReady)
+            {
+                batch.push_back(node);
+                members.push_back(j);
+            }
+        }
+
+        if (batch.size() > 1)
+        {
+            isBatched[i] = true;
+            for (auto j : members)
+                isBatched[j] = true;
+            batches[i] = batch;
+        }
+    }
+    return batches;
+}
+
+// -----------------------------------------------------------------------
+// concurrent streams
+// -----------------------------------------------------------------------
+
+// InterleaveIndependentBranches() -- reorder all evaluation orders by depth, so that the nodes of independent branches (e.g. the
+// towers of an inception block, or the two directions of a bidirectional recurrence) come next to each other instead of one branch
+// after the other, where PARTraversalFlowControlNode can run them concurrently (see DetermineStages()). The depth of a node is
+// one more than that of its deepest input; a loop counts as one unit, which keeps its members consecutive.
+// Since the matrix pool plans the sharing in this same order, more matrices are alive at the same time, which costs memory.
+// Called by CompileNetwork() after FormRecurrentLoops(), which has put the loops into their final order.
+void ComputationNetwork::InterleaveIndependentBranches()
+{
+    if (m_options.m_concurrentStreams <= 1)
+        return;
+
+    // depth and position in the global order of each node
+    map<ComputationNodeBasePtr, pair<size_t, size_t>> keys;
+    const auto& globalOrder = GetEvalOrder(nullptr);
+    size_t position = 0;
+    for (auto iter = globalOrder.begin(); iter != globalOrder.end();)
+    {
+        vector<ComputationNodeBasePtr> unit;
+        auto loop = (*iter)->IsPartOfLoop() ? FindInRecurrentLoops(m_allSEQNodes, *iter) : nullptr;
+        if (loop)
+        {
+            while (iter != globalOrder.end() && (*iter)->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, *iter) == loop)
+                unit.push_back(*iter++);
+        }
+        else
+            unit.push_back(*iter++);
+
+        size_t depth = 0;
+        for (const auto& node : unit)
+        {
+            for (const auto& input : node->GetInputs())
+            {
+                auto key = keys.find(input); // (inputs inside the loop have no key yet)
+                if (key != keys.end())
+                    depth = max(depth, key->second.first + 1);
+            }
+        }
+        for (const auto& node : unit)
+            keys[node] = make_pair(depth, position++);
+    }
+
+    for (auto& evalOrder : m_evalOrders)
+    {
+        evalOrder.second.sort([&keys](const ComputationNodeBasePtr& a, const ComputationNodeBasePtr& b)
+                              {
+                                  return keys[a] < keys[b];
+                              });
+    }
+}
+
+// -----------------------------------------------------------------------
+// memory-aware scheduling
+// -----------------------------------------------------------------------
+
+// the estimated peak of live node values in forward order, and of live gradients in backward order, of a sequence of units
+// A value lives from its unit until the last unit that consumes it (that of an output, to the end); a gradient lives from the first
+// unit in backward order that propagates into it until its own unit. Leaves are not counted, since the pool does not share them.
+static pair<size_t, size_t> EstimatePeakLiveElements(const vector<vector<ComputationNodeBasePtr>>& units, const vector<size_t>& order,
+                                                     const map<ComputationNodeBasePtr, size_t>& unitOf, const map<ComputationNodeBasePtr, size_t>& sizes)
+{
+    vector<size_t> step(units.size()); // [unit] when it runs in 'order'
+    for (size_t i = 0; i < order.size(); i++)
+        step[order[i]] = i;
+    // the last step that consumes the value of each non-leaf node
+    map<ComputationNodeBasePtr, size_t> lastUses;
+    for (const auto& unit : units)
+    {
+        for (const auto& node : unit)
+        {
+            for (const auto& input : node->GetInputs())
+            {
+                if (input->IsLeaf())
+                    continue;
+                auto& lastUse = lastUses.insert(make_pair(input, (size_t) 0)).first->second;
+                lastUse = max(lastUse, step[unitOf.at(node)]);
+            }
+        }
+    }
+
+    vector<long long> valueDeltas(order.size() + 1, 0), gradientDeltas(order.size() + 1, 0);
+    for (const auto& unit : units)
+    {
+        for (const auto& node : unit)
+        {
+            if (node->IsLeaf())
+                continue;
+            const size_t size = sizes.at(node);
+            const size_t first = step[unitOf.at(node)];
+            auto lastUse = lastUses.find(node);
+            const size_t last = (lastUse != lastUses.end()) ? max(first, lastUse->second) : order.size() - 1; // (outputs live to the end)
+            valueDeltas[first] += size;
+            valueDeltas[last + 1] -= size;
+            // backward runs the steps in reverse, so the gradient lives over the same steps, counted from the other end
+            if (node->NeedGradient())
+            {
+                gradientDeltas[order.size() - 1 - last] += size;
+                gradientDeltas[order.size() - first] -= size;
+            }
+        }
+    }
+    size_t valuePeak = 0, gradientPeak = 0;
+    long long value = 0, gradient = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        value += valueDeltas[i];
+        gradient += gradientDeltas[i];
+        valuePeak = max(valuePeak, (size_t) value);
+        gradientPeak = max(gradientPeak, (size_t) gradient);
+    }
+    return make_pair(valuePeak, gradientPeak);
+}
+
+// ScheduleForMemory() -- reorder all evaluation orders so that fewer node values (and gradients) are alive at the same time,
+// which lowers the peak of the memory that the matrix pool plans (see AllocateAllMatrices()), within the order of the inputs.
+// The depth-first order keeps a branch's values alive while another branch is computed; this list scheduling instead picks, of
+// the units whose inputs are computed, the one that allocates the least net of the values it releases (by the size of their
+// samples, for those with an MBLayout), so that a branch is finished before one that produces more is begun. A loop counts as
+// one unit, which keeps its members consecutive and in order. The new order is kept only if its estimated peak is lower.
+// Called by CompileNetwork() after ValidateNetwork(), since the sizes are known only then; the nested networks are formed anew.
+void ComputationNetwork::ScheduleForMemory()
+{
+    if (!m_options.m_memoryAwareScheduling)
+        return;
+    if (m_options.m_concurrentStreams > 1) // (which orders for concurrency instead)
+    {
+        fprintf(stderr, "ScheduleForMemory: Skipped, since concurrentStreams is set.\n");
+        return;
+    }
+
+    // units in the global order, and the unit of each node
+    vector<vector<ComputationNodeBasePtr>> units;
+    map<ComputationNodeBasePtr, size_t> unitOf;
+    map<ComputationNodeBasePtr, size_t> sizes;
+    const auto& globalOrder = GetEvalOrder(nullptr);
+    for (auto iter = globalOrder.begin(); iter != globalOrder.end();)
+    {
+        units.push_back(vector<ComputationNodeBasePtr>());
+        auto loop = (*iter)->IsPartOfLoop() ? FindInRecurrentLoops(m_allSEQNodes, *iter) : nullptr;
+        if (loop)
+        {
+            while (iter != globalOrder.end() && (*iter)->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, *iter) == loop)
+                units.back().push_back(*iter++);
+        }
+        else
+            units.back().push_back(*iter++);
+        for (const auto& node : units.back())
+        {
+            unitOf[node] = units.size() - 1;
+            sizes[node] = node->GetSampleLayout().GetNumElements();
+        }
+    }
+    if (units.size() < 3)
+        return;
+
+    // the units each unit consumes, and the number of units that consume each non-leaf node
+    vector<set<size_t>> inputUnits(units.size());
+    vector<vector<size_t>> consumerUnits(units.size());
+    map<ComputationNodeBasePtr, size_t> remainingConsumers;
+    for (size_t u = 0; u < units.size(); u++)
+    {
+        set<ComputationNodeBasePtr> consumed;
+        for (const auto& node : units[u])
+        {
+            for (const auto& input : node->GetInputs())
+            {
+                const size_t v = unitOf.at(input);
+                if (v == u)
+                    continue;
+                if (inputUnits[u].insert(v).second)
+                    consumerUnits[v].push_back(u);
+                if (!input->IsLeaf() && consumed.insert(input).second)
+                    remainingConsumers[input]++;
+            }
+        }
+    }
+
+    // the net number of elements a unit allocates if it runs now: its own values minus those of inputs it consumes last
+    auto netAllocation = [&](size_t u)
+    {
+        long long net = 0;
+        set<ComputationNodeBasePtr> consumed;
+        for (const auto& node : units[u])
+        {
+            if (!node->IsLeaf())
+                net += sizes[node];
+            for (const auto& input : node->GetInputs())
+            {
+                if (unitOf.at(input) != u && !input->IsLeaf() && consumed.insert(input).second && remainingConsumers[input] == 1)
+                    net -= sizes[input];
+            }
+        }
+        return net;
+    };
+
+    vector<size_t> numPendingInputs(units.size());
+    set<size_t> ready; // (ordered by the original position, which breaks ties)
+    for (size_t u = 0; u < units.size(); u++)
+    {
+        numPendingInputs[u] = inputUnits[u].size();
+        if (numPendingInputs[u] == 0)
+            ready.insert(u);
+    }
+    vector<size_t> newOrder;
+    while (!ready.empty())
+    {
+        size_t best = *ready.begin();
+        long long bestNet = netAllocation(best);
+        for (auto u : ready)
+        {
+            const long long net = netAllocation(u);
+            if (net < bestNet)
+            {
+                best = u;
+                bestNet = net;
+            }
+        }
+        ready.erase(best);
+        newOrder.push_back(best);
+        set<ComputationNodeBasePtr> consumed;
+        for (const auto& node : units[best])
+        {
+            for (const auto& input : node->GetInputs())
+            {
+                if (unitOf.at(input) != best && !input->IsLeaf() && consumed.insert(input).second)
+                    remainingConsumers[input]--;
+            }
+        }
+        for (auto consumer : consumerUnits[best])
+        {
+            if (--numPendingInputs[consumer] == 0)
+                ready.insert(consumer);
+        }
+    }
+    if (newOrder.size() != units.size())
+        LogicError("ScheduleForMemory: The inputs of %d units form a cycle outside of the recurrent loops.", (int) (units.size() - newOrder.size()));
+
+    vector<size_t> oldOrder(units.size());
+    for (size_t u = 0; u < units.size(); u++)
+        oldOrder[u] = u;
+    const auto oldPeaks = EstimatePeakLiveElements(units, oldOrder, unitOf, sizes);
+    const auto newPeaks = EstimatePeakLiveElements(units, newOrder, unitOf, sizes);
+    fprintf(stderr, "ScheduleForMemory: Estimated peak of live elements (per sample) %d values, %d gradients; reordered %d values, %d gradients%s.\n",
+            (int) oldPeaks.first, (int) oldPeaks.second, (int) newPeaks.first, (int) newPeaks.second,
+            newPeaks.first + newPeaks.second < oldPeaks.first + oldPeaks.second ? "" : " (not used)");
+    if (newPeaks.first + newPeaks.second >= oldPeaks.first + oldPeaks.second)
+        return;
+
+    map<ComputationNodeBasePtr, size_t> positions;
+    size_t position = 0;
+    for (auto u : newOrder)
+    {
+        for (const auto& node : units[u])
+            positions[node] = position++;
+    }
+    for (auto& evalOrder : m_evalOrders)
+    {
+        evalOrder.second.sort([&positions](const ComputationNodeBasePtr& a, const ComputationNodeBasePtr& b)
+                              {
+                                  return positions[a] < positions[b];
+                              });
+    }
+    m_nestedNetworks.clear();
+    m_nestedNetworksForRootSets.clear();
+    for (auto& node : m_allRoots)
+        FormNestedNetwork(node);
+}
+
 } } }
@@ -9,10 +9,17 @@
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
 #include "InputAndParamNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "ConvolutionalNodes.h"
+#include "ReshapingNodes.h"
+#include "PreComputeNodes.h"
 #include "TrainingNodes.h"
+#include "SpecialPurposeNodes.h"
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
 
 using namespace std;
 
@@ -225,6 +232,33 @@ void ComputationNetwork::ReplaceLeafNode(wstring oldNodeName, ComputationNodeBas
     // RemoveOrphanNode(oldNode);
 }
 
+// replace the old node by a new node of possibly different type, which takes over its name, its consumers, and its node groups
+// The inputs of newNode must have been attached already; the old node is deleted.
+void ComputationNetwork::ReplaceNode(wstring oldNodeName, ComputationNodeBasePtr newNode)
+{
+    InvalidateCompiledNetwork();
+
+    ComputationNodeBasePtr oldNode = GetNodeFromName(oldNodeName);
+    if (newNode->NodeName() != oldNodeName)
+        InvalidArgument("ReplaceNode: newNode must have the name of the node it replaces ('%ls').", oldNodeName.c_str());
+
+    // change the input of those nodes whose child is oldNode
+    for (auto nodeIter = m_nameToNodeMap.begin(); nodeIter != m_nameToNodeMap.end(); nodeIter++)
+    {
+        ComputationNodeBasePtr node = nodeIter->second;
+        for (int i = 0; i < node->GetNumInputs(); i++)
+            if (node->GetInputs()[i] == oldNode)
+                node->SetInput(i, newNode);
+    }
+
+    // change other maps
+    for (auto groupIter : GetAllNodeGroups())
+        std::replace(groupIter->begin(), groupIter->end(), oldNode, newNode);
+
+    DeleteNode(oldNodeName);
+    AddNodeToNet(newNode);
+}
+
 void ComputationNetwork::ReplaceFinalCriterionNode(wstring oldNodeName, ComputationNodeBasePtr newNode)
 {
     InvalidateCompiledNetwork();
@@ -360,4 +394,706 @@ void ComputationNetwork::SetBatchNormlizationNodesBelowEvalMode(const bool evalM
         }
     }
 }
+
+// request half-precision storage of the values kept for backprop (see ComputationNodeBase::SetStoreValueInHalf()) for all nodes
+// of the given operation types; returns the number of nodes. Takes effect with the next AllocateAllMatrices().
+size_t ComputationNetwork::SetStoreValuesInHalf(const std::vector<std::wstring>& operationNames, HalfFormat format)
+{
+    size_t numNodes = 0;
+    for (auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        if (std::find(operationNames.begin(), operationNames.end(), node->OperationName()) == operationNames.end())
+            continue;
+        node->SetStoreValueInHalf(true, format);
+        numNodes++;
+    }
+    return numNodes;
+}
+
+// let all nodes that multiply with constant weights switch to int8 weights (for CPU inference only)
+void ComputationNetwork::QuantizeWeightsToInt8()
+{
+    size_t numQuantized = 0;
+    for (auto& pair : m_nameToNodeMap)
+    {
+        if (pair.second->QuantizeWeightsToInt8())
+            numQuantized++;
+    }
+    fprintf(stderr, "QuantizeWeightsToInt8: %d nodes use int8 weights.\n", (int) numQuantized);
+}
+
+// let all nodes that multiply with constant weights keep them packed for small-minibatch products (for CPU inference only)
+void ComputationNetwork::PackWeightsForInference()
+{
+    size_t numPacked = 0;
+    for (auto& pair : m_nameToNodeMap)
+    {
+        if (pair.second->PackWeightsForInference())
+            numPacked++;
+    }
+    fprintf(stderr, "PackWeightsForInference: %d nodes use packed weights.\n", (int) numPacked);
+}
+
+// create a copy of this network that can be evaluated concurrently with it
+// All nodes are duplicated, so that the copy has its own node values and MBLayout, except that LearnableParameters share
+// their value matrices with this network. The copy must hence never be trained; its parameters are marked as not requiring an update.
+ComputationNetworkPtr ComputationNetwork::CloneForEvaluation() const
+{
+    auto net = make_shared<ComputationNetwork>(m_deviceId);
+    net->SetRandomSeedOffset(m_randomSeedOffset);
+    net->SetOptions(m_options);
+
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        int flags = CopyNodeFlags::copyNodeValue;
+        if (node->OperationName() == OperationNameOf(LearnableParameter))
+            flags |= CopyNodeFlags::copyNodeShareValue;
+        net->AddNodeToNet(node->Duplicate(node->NodeName(), (CopyNodeFlags) flags));
+    }
+
+    // link the copies up the same way as the originals
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : node->GetInputs())
+            inputs.push_back(net->GetNodeFromName(input->NodeName()));
+        if (!inputs.empty())
+            net->GetNodeFromName(node->NodeName())->AttachInputs(inputs);
+    }
+
+    // node groups
+    const vector<const vector<ComputationNodeBasePtr>*> fromGroups = { &m_features, &m_labels, &m_finalCriteria, &m_evalNodes, &m_outputNodes };
+    const auto toGroups = net->GetAllNodeGroups();
+    for (size_t i = 0; i < fromGroups.size(); i++)
+    {
+        for (const auto& node : *fromGroups[i])
+            toGroups[i]->push_back(net->GetNodeFromName(node->NodeName()));
+    }
+
+    net->SetLearnableNodesBelowNeedGradient(false);
+    net->CompileNetwork();
+    return net;
+}
+
+// data parallelism within one process: an independent copy of the network on another device, which trains on its share
+// of each minibatch (see LocalDataParallelReplicas). Everything is copied, including the parameters, which are kept in sync
+// by the caller. This must be called before AllocateAllMatrices(), while the nodes hold no gradients yet.
+ComputationNetworkPtr ComputationNetwork::CloneForDevice(DEVICEID_TYPE deviceId) const
+{
+    VerifyIsCompiled("CloneForDevice");
+    auto net = make_shared<ComputationNetwork>(deviceId);
+    net->SetRandomSeedOffset(m_randomSeedOffset);
+    net->SetOptions(m_options);
+
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        if (node->OperationName() == OperationNameOf(DeviceTransferNode))
+            InvalidArgument("CloneForDevice: The network is placed on several devices (node %ls); it cannot be replicated.", node->NodeName().c_str());
+        auto copy = node->Duplicate(node->NodeName(), CopyNodeFlags::copyNodeValue);
+        copy->MoveToDevice(deviceId);
+        net->AddNodeToNet(copy);
+    }
+
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : node->GetInputs())
+            inputs.push_back(net->GetNodeFromName(input->NodeName()));
+        if (!inputs.empty())
+            net->GetNodeFromName(node->NodeName())->AttachInputs(inputs);
+    }
+
+    const vector<const vector<ComputationNodeBasePtr>*> fromGroups = { &m_features, &m_labels, &m_finalCriteria, &m_evalNodes, &m_outputNodes };
+    const auto toGroups = net->GetAllNodeGroups();
+    for (size_t i = 0; i < fromGroups.size(); i++)
+    {
+        for (const auto& node : *fromGroups[i])
+            toGroups[i]->push_back(net->GetNodeFromName(node->NodeName()));
+    }
+
+    net->CompileNetwork();
+    return net;
+}
+
+// checkpointing: a copy of the network that Save() can write on another thread while the training goes on
+// Only what Save() writes is copied: the nodes with their attributes, the links, the node groups, and the values of the
+// parameters and precomputed nodes, for which 'snapshotValue' makes a copy in host memory. The copy is not meant to be
+// evaluated, and is not compiled beyond what Save() requires.
+template <class ElemType>
+ComputationNetworkPtr ComputationNetwork::CloneForSaving(const std::function<shared_ptr<Matrix<ElemType>>(const std::wstring& nodeName, const Matrix<ElemType>& value)>& snapshotValue) const
+{
+    VerifyIsCompiled("CloneForSaving");
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    net->SetRandomSeedOffset(m_randomSeedOffset);
+    net->SetOptions(m_options);
+
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(pair.second);
+        if (!node)
+            LogicError("CloneForSaving: Node '%ls' is not of the network's element type.", pair.first.c_str());
+        shared_ptr<Matrix<ElemType>> value;
+        if ((node->OperationName() == OperationNameOf(LearnableParameter) || node->RequiresPreCompute()))
+            value = snapshotValue(node->NodeName(), node->Value());
+        net->AddNodeToNet(node->DuplicateForSaving(value));
+    }
+
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : node->GetInputs())
+            inputs.push_back(net->GetNodeFromName(input->NodeName()));
+        if (!inputs.empty())
+            net->GetNodeFromName(node->NodeName())->AttachInputs(inputs);
+    }
+
+    const vector<const vector<ComputationNodeBasePtr>*> fromGroups = { &m_features, &m_labels, &m_finalCriteria, &m_evalNodes, &m_outputNodes };
+    const auto toGroups = net->GetAllNodeGroups();
+    for (size_t i = 0; i < fromGroups.size(); i++)
+    {
+        for (const auto& node : *fromGroups[i])
+            toGroups[i]->push_back(net->GetNodeFromName(node->NodeName()));
+    }
+
+    net->m_isCompiled = true; // a copy of a compiled network, for Save() only
+    return net;
+}
+
+template ComputationNetworkPtr ComputationNetwork::CloneForSaving<float>(const std::function<shared_ptr<Matrix<float>>(const std::wstring& nodeName, const Matrix<float>& value)>& snapshotValue) const;
+template ComputationNetworkPtr ComputationNetwork::CloneForSaving<double>(const std::function<shared_ptr<Matrix<double>>(const std::wstring& nodeName, const Matrix<double>& value)>& snapshotValue) const;
+
+// removes the DeviceTransferNodes of an earlier placement (PlaceOnDevices(), PlaceNodesOnDevices()), reconnecting their consumers to the originals
+void ComputationNetwork::RemoveDeviceTransferNodes()
+{
+    set<ComputationNodeBasePtr> oldTransferNodes;
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        if (pair.second->OperationName() == OperationNameOf(DeviceTransferNode))
+            oldTransferNodes.insert(pair.second);
+    }
+    if (oldTransferNodes.empty())
+        return;
+
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            auto input = node->Input(i);
+            while (oldTransferNodes.find(input) != oldTransferNodes.end())
+                input = input->Input(0);
+            if (input != node->Input(i))
+                node->SetInput(i, input);
+        }
+    }
+    for (const auto& transferNode : oldTransferNodes)
+    {
+        transferNode->DetachInputs();
+        m_nameToNodeMap.erase(transferNode->NodeName());
+    }
+    InvalidateCompiledNetwork();
+    CompileNetwork();
+}
+
+// model parallelism: spread the network over several devices
+// The global evaluation order is cut into deviceIds.size() contiguous stages, stage s living on deviceIds[s]. Unless the first nodes
+// of stages 1.. are given by name, the cuts balance an estimate of the cost of each stage: a node costs the number of elements
+// of the parameters it consumes (both the flops per sample and the memory of a layer are dominated by its weights) plus the size of its output.
+// Recurrent loops are never cut. Leaves (inputs, parameters) go to the stage of their first consumer, and 'lastStageNodes'
+// (the criteria) to the last stage. Wherever a node consumes an input from another stage, a DeviceTransferNode is inserted.
+// The network's own device becomes the last one, where the criteria live.
+// This must be called before AllocateAllMatrices(). Transfer nodes of an earlier placement (e.g. in a checkpoint) are replaced.
+template <class ElemType>
+void ComputationNetwork::PlaceOnDevices(const std::vector<DEVICEID_TYPE>& deviceIds, const std::vector<std::wstring>& stageStartNodeNames, const std::vector<ComputationNodeBasePtr>& lastStageNodes)
+{
+    const size_t numStages = deviceIds.size();
+    if (numStages < 2)
+        InvalidArgument("PlaceOnDevices: At least two devices are needed.");
+    if (!stageStartNodeNames.empty() && stageStartNodeNames.size() != numStages - 1)
+        InvalidArgument("PlaceOnDevices: %d stage boundaries given for %d devices; expected one for each device but the first.", (int) stageStartNodeNames.size(), (int) numStages);
+    VerifyIsCompiled("PlaceOnDevices");
+
+    RemoveDeviceTransferNodes();
+
+    const list<ComputationNodeBasePtr> evalOrder = GetEvalOrder(nullptr); // (copy, since we modify the network below)
+
+    // estimated cost of each node
+    map<ComputationNodeBasePtr, double> cost;
+    double totalCost = 0;
+    for (const auto& node : evalOrder)
+    {
+        if (node->IsLeaf())
+            continue;
+        double nodeCost = (double) node->GetSampleLayout().GetNumElements();
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->OperationName() == OperationNameOf(LearnableParameter))
+                nodeCost += (double) input->GetSampleLayout().GetNumElements();
+        }
+        cost[node] = nodeCost;
+        totalCost += nodeCost;
+    }
+
+    // cut the evaluation order into stages
+    map<ComputationNodeBasePtr, size_t> stageOf;
+    vector<double> stageCost(numStages, 0);
+    double remainingCost = totalCost; // of this and all later stages
+    size_t stage = 0;
+    for (const auto& node : evalOrder)
+    {
+        if (node->IsLeaf())
+            continue;
+        if (stage + 1 < numStages)
+        {
+            bool startsNextStage;
+            if (!stageStartNodeNames.empty())
+            {
+                startsNextStage = node->NodeName() == stageStartNodeNames[stage];
+                if (startsNextStage && node->IsPartOfLoop())
+                    InvalidArgument("PlaceOnDevices: Stage boundary %ls is part of a recurrent loop; loops cannot be split across devices.", node->NodeName().c_str());
+            }
+            else // cut once this stage would get more than its share of what is left
+                startsNextStage = !node->IsPartOfLoop() && stageCost[stage] > 0 &&
+                                  stageCost[stage] + cost[node] / 2 > remainingCost / (numStages - stage);
+            if (startsNextStage)
+            {
+                remainingCost -= stageCost[stage];
+                stage++;
+            }
+        }
+        stageOf[node] = stage;
+        stageCost[stage] += cost[node];
+    }
+    if (!stageStartNodeNames.empty() && stage + 1 < numStages)
+        InvalidArgument("PlaceOnDevices: Stage boundary %ls was not found in the network.", stageStartNodeNames[stage].c_str());
+
+    for (const auto& node : lastStageNodes)
+        stageOf[node] = numStages - 1;
+
+    // leaves go where they are first needed
+    for (const auto& node : evalOrder)
+    {
+        if (node->IsLeaf())
+            continue;
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->IsLeaf() && (stageOf.find(input) == stageOf.end() || stageOf[input] > stageOf[node]))
+                stageOf[input] = stageOf[node];
+        }
+    }
+
+    for (const auto& node : evalOrder)
+    {
+        if (stageOf.find(node) == stageOf.end()) // (a leaf that nothing consumes)
+            stageOf[node] = 0;
+        node->MoveToDevice(deviceIds[stageOf[node]]);
+    }
+
+    // connect the stages
+    map<pair<ComputationNodeBasePtr, size_t>, ComputationNodeBasePtr> transferNodes; // [(input, stage)] -> its copy on that stage's device
+    for (const auto& node : evalOrder)
+    {
+        const size_t nodeStage = stageOf[node];
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            const auto input = node->Input(i);
+            if (stageOf[input] == nodeStage)
+                continue;
+            auto& transferNode = transferNodes[make_pair(input, nodeStage)];
+            if (!transferNode)
+            {
+                transferNode = New<DeviceTransferNode<ElemType>>(deviceIds[nodeStage], input->NodeName() + L".stage" + std::to_wstring(nodeStage));
+                transferNode->AttachInputs(vector<ComputationNodeBasePtr>{ input });
+                AddNodeToNet(transferNode);
+            }
+            node->SetInput(i, transferNode);
+        }
+    }
+
+    fprintf(stderr, "PlaceOnDevices: %d nodes on %d devices, %d device transfers.\n", (int) evalOrder.size(), (int) numStages, (int) transferNodes.size());
+    for (size_t s = 0; s < numStages; s++)
+    {
+        size_t numNodes = 0;
+        for (const auto& node : evalOrder)
+            numNodes += stageOf[node] == s;
+        fprintf(stderr, "\tstage %d on %s %d: %d nodes, estimated cost %.0f\n",
+                (int) s, deviceIds[s] < 0 ? "CPU" : "GPU", (int) deviceIds[s], (int) numNodes, stageCost[s]);
+    }
+
+    SetDeviceId(deviceIds.back());
+    InvalidateCompiledNetwork();
+    CompileNetwork();
+}
+
+template void ComputationNetwork::PlaceOnDevices<float>(const std::vector<DEVICEID_TYPE>& deviceIds, const std::vector<std::wstring>& stageStartNodeNames, const std::vector<ComputationNodeBasePtr>& lastStageNodes);
+template void ComputationNetwork::PlaceOnDevices<double>(const std::vector<DEVICEID_TYPE>& deviceIds, const std::vector<std::wstring>& stageStartNodeNames, const std::vector<ComputationNodeBasePtr>& lastStageNodes);
+
+// heterogeneous placement: run selected nodes on the CPU (or another device) next to the network's device
+// 'nodeDevices' places nodes by name. With 'cpuParameterThresholdBytes' > 0, every LearnableParameter of at least that size that
+// is only consumed by LookupTableNodes goes to the CPU together with these lookups: huge embedding tables then stay in host memory,
+// are looked up and updated there (sparse updates, with the CPU matrix kernels), and only the looked-up rows travel to the device.
+// Leaves whose consumers all live on one other device follow them, e.g. the sparse word input of such a lookup is read into host memory.
+// Wherever a node consumes an input from another device, a DeviceTransferNode is inserted; its gradient travels back the same way.
+// This must be called before AllocateAllMatrices(). Transfer nodes of an earlier placement are replaced.
+template <class ElemType>
+void ComputationNetwork::PlaceNodesOnDevices(const std::map<std::wstring, DEVICEID_TYPE>& nodeDevices, size_t cpuParameterThresholdBytes)
+{
+    VerifyIsCompiled("PlaceNodesOnDevices");
+
+    RemoveDeviceTransferNodes();
+
+    const list<ComputationNodeBasePtr> evalOrder = GetEvalOrder(nullptr); // (copy, since we modify the network below)
+    map<ComputationNodeBasePtr, vector<ComputationNodeBasePtr>> consumers;
+    for (const auto& node : evalOrder)
+    {
+        for (const auto& input : node->GetInputs())
+            consumers[input].push_back(node);
+    }
+
+    // explicit placement
+    map<ComputationNodeBasePtr, DEVICEID_TYPE> deviceOf;
+    for (const auto& pair : nodeDevices)
+    {
+        if (!NodeNameExists(pair.first))
+            InvalidArgument("PlaceNodesOnDevices: Node %ls was not found in the network.", pair.first.c_str());
+        deviceOf[GetNodeFromName(pair.first)] = pair.second;
+    }
+
+    // large embedding tables to the CPU, with their lookups
+    size_t numTablesOnCPU = 0;
+    if (cpuParameterThresholdBytes > 0)
+    {
+        for (const auto& node : evalOrder)
+        {
+            if (node->OperationName() != OperationNameOf(LearnableParameter) || deviceOf.find(node) != deviceOf.end())
+                continue;
+            if (node->GetSampleLayout().GetNumElements() * sizeof(ElemType) < cpuParameterThresholdBytes)
+                continue;
+            const auto& lookups = consumers[node];
+            bool onlyLookups = !lookups.empty();
+            for (const auto& lookup : lookups)
+                onlyLookups &= lookup->OperationName() == OperationNameOf(LookupTableNode) && lookup->Input(0) == node;
+            if (!onlyLookups)
+            {
+                fprintf(stderr, "PlaceNodesOnDevices: Parameter %ls has %d MB but is not only used as a lookup table; it stays on the device.\n",
+                        node->NodeName().c_str(), (int) (node->GetSampleLayout().GetNumElements() * sizeof(ElemType) / (1024 * 1024)));
+                continue;
+            }
+            deviceOf[node] = CPUDEVICE;
+            for (const auto& lookup : lookups)
+            {
+                if (deviceOf.find(lookup) == deviceOf.end())
+                    deviceOf[lookup] = CPUDEVICE;
+            }
+            numTablesOnCPU++;
+        }
+    }
+
+    // leaves whose consumers all live on one other device follow them
+    for (const auto& node : evalOrder)
+    {
+        if (!node->IsLeaf() || deviceOf.find(node) != deviceOf.end() || consumers[node].empty())
+            continue;
+        set<DEVICEID_TYPE> consumerDevices;
+        for (const auto& consumer : consumers[node])
+            consumerDevices.insert(deviceOf.find(consumer) != deviceOf.end() ? deviceOf[consumer] : consumer->GetDeviceId());
+        if (consumerDevices.size() == 1 && *consumerDevices.begin() != node->GetDeviceId())
+            deviceOf[node] = *consumerDevices.begin();
+    }
+
+    for (const auto& pair : deviceOf)
+        pair.first->MoveToDevice(pair.second);
+
+    // connect the devices
+    map<pair<ComputationNodeBasePtr, DEVICEID_TYPE>, ComputationNodeBasePtr> transferNodes; // [(input, device)] -> its copy on that device
+    for (const auto& node : evalOrder)
+    {
+        const DEVICEID_TYPE nodeDevice = node->GetDeviceId();
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            const auto input = node->Input(i);
+            if (input->GetDeviceId() == nodeDevice)
+                continue;
+            if (input->OperationName() == L"SparseInputValue")
+                InvalidArgument("PlaceNodesOnDevices: Sparse input %ls is consumed on several devices; sparse values cannot be transferred. Place its consumers on one device.",
+                                input->NodeName().c_str());
+            auto& transferNode = transferNodes[make_pair(input, nodeDevice)];
+            if (!transferNode)
+            {
+                transferNode = New<DeviceTransferNode<ElemType>>(nodeDevice, input->NodeName() + (nodeDevice < 0 ? L".CPU" : L".GPU" + std::to_wstring(nodeDevice)));
+                transferNode->AttachInputs(vector<ComputationNodeBasePtr>{ input });
+                AddNodeToNet(transferNode);
+            }
+            node->SetInput(i, transferNode);
+        }
+    }
+
+    size_t numNodesOnOtherDevices = 0;
+    for (const auto& node : evalOrder)
+        numNodesOnOtherDevices += node->GetDeviceId() != GetDeviceId();
+    fprintf(stderr, "PlaceNodesOnDevices: %d of %d nodes placed off device %d (%d embedding tables on the CPU), %d device transfers.\n",
+            (int) numNodesOnOtherDevices, (int) evalOrder.size(), (int) GetDeviceId(), (int) numTablesOnCPU, (int) transferNodes.size());
+
+    InvalidateCompiledNetwork();
+    CompileNetwork();
+}
+
+template void ComputationNetwork::PlaceNodesOnDevices<float>(const std::map<std::wstring, DEVICEID_TYPE>& nodeDevices, size_t cpuParameterThresholdBytes);
+template void ComputationNetwork::PlaceNodesOnDevices<double>(const std::map<std::wstring, DEVICEID_TYPE>& nodeDevices, size_t cpuParameterThresholdBytes);
+
+// rewrite the network into one that computes the same outputs with fewer operations, for inference only
+//  - Dropout nodes are bypassed, since they are the identity at inference time. So are Reshapes that do not change the layout, and
+//    Reshapes feeding a Reshape that replaces the whole layout.
+//  - A PerDimMeanVarNormalization with constant mean m and inverse std dev s that feeds a Times is folded into its weights:
+//    W ((x - m) .* s) = W' x + b with W' = W diag(s) and b = -W' m.
+//  - A BatchNormalization (without a fused ReLU) with constant parameters that follows a Times (per-activation) or Convolution (spatial), optionally with a
+//    bias in between, is folded into the weights and bias, using the running statistics (i.e. with eval-mode semantics):
+//    scale .* ((W x + b0) - mean) .* invStdDev + bias = W' x + b with a = scale .* invStdDev, W' = diag(a) W and b = a .* (b0 - mean) + bias.
+// Weights and biases are modified in place, so folds are only done where nothing else uses them.
+// Nodes that replace a node take over its name, so that outputs can still be found by name; nodes that become unused are deleted.
+// Call SaveEdited() afterwards to keep the optimized model.
+template <class ElemType>
+void ComputationNetwork::OptimizeForInference()
+{
+    auto isInNodeGroup = [this](const ComputationNodeBasePtr& node) -> bool
+    {
+        for (auto group : GetAllNodeGroups())
+        {
+            if (std::find(group->begin(), group->end(), node) != group->end())
+                return true;
+        }
+        return false;
+    };
+    auto isConstant = [](const ComputationNodeBasePtr& node) -> bool
+    {
+        if (node->OperationName() == OperationNameOf(LearnableParameter))
+            return true;
+        auto preComputeNode = dynamic_pointer_cast<IPreComputeNode>(node);
+        return preComputeNode && preComputeNode->HasComputed();
+    };
+    auto getNumConsumers = [this]() -> map<ComputationNodeBasePtr, size_t>
+    {
+        map<ComputationNodeBasePtr, size_t> numConsumers;
+        for (const auto& pair : m_nameToNodeMap)
+        {
+            for (const auto& input : pair.second->GetInputs())
+                numConsumers[input]++;
+        }
+        return numConsumers;
+    };
+    auto valueOf = [](const ComputationNodeBasePtr& node) -> Matrix<ElemType>&
+    {
+        return dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+    };
+    // copy of the value of a node, as a column vector
+    auto columnOf = [&valueOf](const ComputationNodeBasePtr& node) -> Matrix<ElemType>
+    {
+        const auto& value = valueOf(node);
+        Matrix<ElemType> column(value.GetDeviceId());
+        column.SetValue(value);
+        column.Reshape(column.GetNumElements(), 1);
+        return column;
+    };
+    // set the value of a node to the column vector 'b', keeping its dimensions
+    auto setValueOf = [&valueOf](const ComputationNodeBasePtr& node, const Matrix<ElemType>& b)
+    {
+        auto& value = valueOf(node);
+        const size_t rows = value.GetNumRows(), cols = value.GetNumCols();
+        value.SetValue(b);
+        value.Reshape(rows, cols);
+    };
+    // let all consumers and node groups of 'oldNode' use 'newNode' instead, except 'newNode' itself, which may consume 'oldNode'
+    auto redirectConsumers = [this](const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& newNode)
+    {
+        for (const auto& pair : m_nameToNodeMap)
+        {
+            const auto& node = pair.second;
+            if (node == newNode)
+                continue;
+            for (size_t i = 0; i < node->GetNumInputs(); i++)
+            {
+                if (node->Input(i) == oldNode)
+                    node->SetInput(i, newNode);
+            }
+        }
+        for (auto group : GetAllNodeGroups())
+            std::replace(group->begin(), group->end(), oldNode, newNode);
+    };
+    auto uniqueName = [this](const wstring& name) -> wstring
+    {
+        wstring result = name;
+        for (size_t k = 1; NodeNameExists(result); k++)
+            result = name + std::to_wstring(k);
+        return result;
+    };
+    // replace 'oldNode' by Plus('linear', b), where b is a new parameter of shape 'biasShape' with value 'b'
+    // 'oldNode' is either 'linear' itself, which then gets a new name, or a node that is going away.
+    auto replaceByBiased = [&](const ComputationNodeBasePtr& oldNode, const ComputationNodeBasePtr& linear, const Matrix<ElemType>& b, const TensorShape& biasShape)
+    {
+        const wstring name = oldNode->NodeName();
+        auto bias = New<LearnableParameter<ElemType>>(linear->GetDeviceId(), uniqueName(name + L".foldedBias"), biasShape);
+        setValueOf(bias, b);
+        auto plus = New<PlusNode<ElemType>>(linear->GetDeviceId(), name);
+        plus->AttachInputs(vector<ComputationNodeBasePtr>{ linear, bias });
+        redirectConsumers(oldNode, plus);
+        if (oldNode == linear)
+            RenameNode(linear, uniqueName(name + L".folded"));
+        else
+            DeleteNode(name);
+        AddNodeToNet(plus);
+        AddNodeToNet(bias);
+    };
+
+    vector<ComputationNodeBasePtr> unusedCandidates; // nodes that may no longer be used after the rewrites
+
+    // bypass Dropouts and redundant Reshapes
+    set<ComputationNodeBasePtr> bypassedNodes;
+    for (const auto& pair : m_nameToNodeMap)
+    {
+        const auto& node = pair.second;
+        auto reshape = dynamic_pointer_cast<ReshapeNode<ElemType>>(node);
+        const bool replacesWholeLayout = reshape && reshape->ReplacesWholeSampleLayout();
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            auto input = node->Input(i);
+            for (;;)
+            {
+                if (input->OperationName() == OperationNameOf(DropoutNode) ||
+                    (input->OperationName() == OperationNameOf(ReshapeNode) && (replacesWholeLayout || input->GetSampleLayout() == input->Input(0)->GetSampleLayout())))
+                {
+                    bypassedNodes.insert(input);
+                    unusedCandidates.push_back(input);
+                    input = input->Input(0);
+                }
+                else
+                    break;
+            }
+            if (input != node->Input(i))
+                node->SetInput(i, input);
+        }
+    }
+
+    vector<ComputationNodeBasePtr> nodes; // (copy, since we modify the network below)
+    for (const auto& pair : m_nameToNodeMap)
+        nodes.push_back(pair.second);
+
+    // fold mean/variance normalizations into Times weights
+    size_t numNormalizationsFolded = 0;
+    for (const auto& times : nodes)
+    {
+        if (times->OperationName() != OperationNameOf(TimesNode))
+            continue;
+        const auto weights = times->Input(0);
+        const auto normalization = times->Input(1);
+        if (normalization->OperationName() != OperationNameOf(PerDimMeanVarNormalizationNode) || !isConstant(normalization->Input(1)) || !isConstant(normalization->Input(2)) ||
+            weights->OperationName() != OperationNameOf(LearnableParameter) || weights->GetSampleLayout().GetRank() != 2 || getNumConsumers()[weights] != 1)
+            continue;
+        auto& w = valueOf(weights);
+        if (w.GetNumCols() != normalization->GetSampleLayout().GetNumElements())
+            continue;
+
+        Matrix<ElemType> invStdDev = columnOf(normalization->Input(2));
+        invStdDev.Reshape(1, invStdDev.GetNumElements());
+        w.RowElementMultiplyWith(invStdDev);
+        Matrix<ElemType> b(w.GetDeviceId());
+        Matrix<ElemType>::MultiplyAndWeightedAdd(-1, w, false, columnOf(normalization->Input(1)), false, 0, b);
+
+        times->SetInput(1, normalization->Input(0));
+        unusedCandidates.push_back(normalization);
+        replaceByBiased(times, times, b, TensorShape(w.GetNumRows()));
+        numNormalizationsFolded++;
+    }
+
+    // fold batch normalizations into Times or Convolution weights
+    size_t numBatchNormalizationsFolded = 0;
+    for (const auto& node : nodes)
+    {
+        auto batchNormalization = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node);
+        if (!batchNormalization || batchNormalization->HasFusedReLU())
+            continue;
+        bool hasConstantParameters = true;
+        for (size_t i = 1; i < node->GetNumInputs(); i++)
+            hasConstantParameters &= isConstant(node->Input(i));
+        if (!hasConstantParameters)
+            continue;
+
+        // find W x or W x + b0
+        auto numConsumers = getNumConsumers();
+        auto linear = node->Input(0);
+        ComputationNodeBasePtr plus, priorBias;
+        if (linear->OperationName() == OperationNameOf(PlusNode) && numConsumers[linear] == 1 && !isInNodeGroup(linear) &&
+            linear->Input(1)->OperationName() == OperationNameOf(LearnableParameter) && numConsumers[linear->Input(1)] == 1)
+        {
+            plus = linear;
+            priorBias = linear->Input(1);
+            linear = linear->Input(0);
+        }
+        const bool isSpatial = batchNormalization->IsSpatial();
+        if (numConsumers[linear] != 1 || isInNodeGroup(linear) || linear->OperationName() != (isSpatial ? OperationNameOf(ConvolutionNode) : OperationNameOf(TimesNode)))
+            continue;
+        if (isSpatial && dynamic_pointer_cast<ConvolutionNode<ElemType>>(linear)->GetImageLayoutKind() != ImageLayoutKind::CHW)
+            continue;
+        const auto weights = linear->Input(0);
+        if (weights->OperationName() != OperationNameOf(LearnableParameter) || weights->GetSampleLayout().GetRank() != 2 || numConsumers[weights] != 1)
+            continue;
+        auto& w = valueOf(weights); // [output dim or output channels x ...]
+        Matrix<ElemType> a = columnOf(node->Input(1));
+        if (a.GetNumRows() != w.GetNumRows() || (priorBias && priorBias->GetSampleLayout().GetNumElements() != w.GetNumRows()))
+            continue;
+
+        a.ElementMultiplyWith(columnOf(node->Input(4)));
+        w.ColumnElementMultiplyWith(a);
+        Matrix<ElemType> b(w.GetDeviceId());
+        if (priorBias)
+            b.AssignDifferenceOf(columnOf(priorBias), columnOf(node->Input(3)));
+        else
+            b.AssignDifferenceOf(0, columnOf(node->Input(3)));
+        b.ElementMultiplyWith(a);
+        b += columnOf(node->Input(2));
+
+        for (size_t i = 1; i < node->GetNumInputs(); i++)
+            unusedCandidates.push_back(node->Input(i));
+        if (priorBias)
+        {
+            setValueOf(priorBias, b);
+            const wstring name = node->NodeName();
+            redirectConsumers(node, plus);
+            DeleteNode(name);
+            RenameNode(plus, name);
+        }
+        else
+            replaceByBiased(node, linear, b, isSpatial ? ImageDimensions::AsTensorShape(1, 1, w.GetNumRows(), ImageLayoutKind::CHW) : linear->GetSampleLayout());
+        numBatchNormalizationsFolded++;
+    }
+
+    // delete what is no longer used
+    size_t numDeleted = 0;
+    while (!unusedCandidates.empty())
+    {
+        const auto node = unusedCandidates.back();
+        unusedCandidates.pop_back();
+        auto iter = m_nameToNodeMap.find(node->NodeName());
+        if (iter == m_nameToNodeMap.end() || iter->second != node || isInNodeGroup(node) || getNumConsumers()[node] != 0)
+            continue;
+        const auto inputs = node->GetInputs(); // (copy, since DeleteNode() detaches them)
+        DeleteNode(node->NodeName());
+        unusedCandidates.insert(unusedCandidates.end(), inputs.begin(), inputs.end());
+        numDeleted++;
+    }
+
+    fprintf(stderr, "OptimizeForInference: %d Dropout/Reshape nodes bypassed, %d mean/variance normalizations and %d batch normalizations folded into weights, %d nodes deleted.\n",
+            (int) bypassedNodes.size(), (int) numNormalizationsFolded, (int) numBatchNormalizationsFolded, (int) numDeleted);
+
+    InvalidateCompiledNetwork();
+    CompileNetwork();
+}
+
+template void ComputationNetwork::OptimizeForInference<float>();
+template void ComputationNetwork::OptimizeForInference<double>();
 } } }
@@ -10,6 +10,14 @@
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
+#include "TrainingNodes.h"
+#include "NodeProfiler.h"
+#include "ComputeStreams.h"
+#include "DeviceTransferMonitor.h"
+#include "MemoryAccounting.h"
+#include "Instrumentation.h"
+#include "CUDAGraph.h"
+#include "TimerUtility.h"
 #include <string>
 #include <vector>
 #include <list>
@@ -40,13 +48,36 @@ void ComputationNetwork::ForwardProp(const ComputationNodeBasePtr rootNode)
     VerifyIsCompiled("ForwardProp");
 
     // traverse all nodes in the pre-determined evaluation order
-    GetNestedNetwork(rootNode)->ForwardProp(FrameRange(nullptr));
+    auto network = GetNestedNetwork(rootNode);
+    AttachNodeProfiler(network);
+    AttachComputeStreams(network);
+    AttachOptions(network);
+    network->ForwardProp(FrameRange(nullptr));
 }
 
-// set the gradient matrix of a node to an 1x1 matrix containing 1.0
+// forward prop for several roots, e.g. all heads requested from a multi-head model
+// Evaluating the roots one by one would visit the shared part of their cones once per root (and skip it by time stamp);
+// instead, a single traversal over the union of the cones is run. Nodes outside of all cones are never visited.
+void ComputationNetwork::ForwardProp(const std::vector<ComputationNodeBasePtr>& rootNodes)
+{
+    VerifyIsCompiled("ForwardProp");
+
+    if (rootNodes.size() == 1)
+        ForwardProp(rootNodes.front());
+    else if (!rootNodes.empty())
+    {
+        auto network = GetNestedNetwork(rootNodes);
+        AttachNodeProfiler(network);
+        AttachComputeStreams(network);
+        AttachOptions(network);
+        network->ForwardProp(FrameRange(nullptr));
+    }
+}
+
+// set the gradient matrix of a node to an 1x1 matrix containing 'value' (usually 1.0)
 // Returns false if the node is not a ComputationNode<ElemType>.
 template <class ElemType>
-static bool SetGradientToScalarOne(ComputationNodeBasePtr nodep)
+static bool SetGradientToScalar(ComputationNodeBasePtr nodep, double value)
 {
     auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodep);
     bool hasMatchingType = (node != nullptr);
@@ -54,7 +85,7 @@ static bool SetGradientToScalarOne(ComputationNodeBasePtr nodep)
     {
         node->Value().VerifySize(1, 1);
         node->Gradient().Resize(1, 1);
-        node->Gradient().SetValue((ElemType) 1.0);
+        node->Gradient().SetValue((ElemType) value);
     }
     return hasMatchingType;
 }
@@ -64,17 +95,42 @@ static bool SetGradientToScalarOne(ComputationNodeBasePtr nodep)
 //  - ForwardProp() for eval nodes
 //  - ForwardProp() for the training criterion (which will reuse computation results from the previous step)
 //  - Backprop() for the training criterion
-void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode) // training criterion to compute the gradients for
+void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode, // training criterion to compute the gradients for
+                                  const std::function<void(const ComputationNodeBasePtr&)>& nodeDone,
+                                  double rootGradient,
+                                  bool accumulateParameterGradients)
 {
     // reset all gradients to zero (actually, internally, this is lazy, but we don't care here)
     ZeroGradients(rootNode);
 
-    // initialize root gradient with a scalar value of 1.0
-    if (!SetGradientToScalarOne<float>(rootNode) && !SetGradientToScalarOne<double>(rootNode))
+    // ...except for the parameters that keep accumulating (sparse ones are not eligible and still get reset)
+    if (accumulateParameterGradients)
+    {
+        for (auto& node : GetEvalOrder(rootNode))
+            if (node->IsParameterUpdateRequired())
+                node->ResumeGradientAccumulation();
+    }
+
+    // initialize root gradient with a scalar value of 1.0 (or the loss scale)
+    if (!SetGradientToScalar<float>(rootNode, rootGradient) && !SetGradientToScalar<double>(rootNode, rootGradient))
         LogicError("Backprop: Training criterion is neither ComputationNode<float> nor ComputationNode<double>.");
 
     // backpropagate through the network
-    GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
+    auto network = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode));
+    network->m_nodeBackpropDone = nodeDone;
+    AttachNodeProfiler(network);
+    AttachComputeStreams(network);
+    AttachOptions(network);
+    try
+    {
+        network->Backprop(FrameRange(nullptr), true, true);
+    }
+    catch (...)
+    {
+        network->m_nodeBackpropDone = nullptr;
+        throw;
+    }
+    network->m_nodeBackpropDone = nullptr;
 }
 
 void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNode)
@@ -85,6 +141,42 @@ void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNod
     m_nestedNetworks[rootNode] = make_shared<PARTraversalFlowControlNode>(m_allSEQNodes, GetEvalOrder(rootNode));
 }
 
+// hand the node profiler (or nullptr) to the traversal that is about to run, and to the loops it may run
+void ComputationNetwork::AttachNodeProfiler(const ComputationNodeBasePtr& nestedNetwork)
+{
+    static_cast<FlowControlNode&>(*nestedNetwork).m_profiler = m_nodeProfiler.get();
+    for (auto& loop : m_allSEQNodes)
+        loop->m_profiler = m_nodeProfiler.get();
+}
+
+// hand the concurrent streams (or nullptr) to the traversal that is about to run
+// Only the outermost traversal spreads nodes over them; a loop runs entirely on the stream of its stage.
+void ComputationNetwork::AttachComputeStreams(const ComputationNodeBasePtr& nestedNetwork)
+{
+    if (m_options.m_concurrentStreams > 1 && m_deviceId >= 0 && (!m_computeStreams || m_computeStreams->GetDeviceId() != m_deviceId))
+        m_computeStreams = make_shared<ComputeStreams>(m_deviceId, m_options.m_concurrentStreams);
+    else if (m_options.m_concurrentStreams <= 1 || m_deviceId < 0)
+        m_computeStreams.reset();
+    dynamic_pointer_cast<PARTraversalFlowControlNode>(nestedNetwork)->m_computeStreams = m_computeStreams.get();
+}
+
+// hand the options that decide how to run (as opposed to how to compile) to the traversal that is about to run, and to the loops it may run
+void ComputationNetwork::AttachOptions(const ComputationNodeBasePtr& nestedNetwork)
+{
+    dynamic_pointer_cast<PARTraversalFlowControlNode>(nestedNetwork)->m_networkOptions = m_options;
+    for (auto& loop : m_allSEQNodes)
+        loop->m_networkOptions = m_options;
+}
+
+// the stages of all traversals refer to the matrices the nodes currently hold
+void ComputationNetwork::InvalidateConcurrentStages()
+{
+    for (auto& network : m_nestedNetworks)
+        dynamic_pointer_cast<PARTraversalFlowControlNode>(network.second)->InvalidateStages();
+    for (auto& network : m_nestedNetworksForRootSets)
+        dynamic_pointer_cast<PARTraversalFlowControlNode>(network.second)->InvalidateStages();
+}
+
 ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNodeBasePtr& rootNode)
 {
     if (m_nestedNetworks.find(rootNode) == m_nestedNetworks.end())
@@ -92,6 +184,39 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
     return m_nestedNetworks[rootNode];
 }
 
+// get the execution plan for a set of roots, forming it on first use
+// This is the global eval order (in which loop members are consecutive) restricted to the nodes needed by any of the roots.
+ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const std::vector<ComputationNodeBasePtr>& rootNodes)
+{
+    std::vector<ComputationNodeBasePtr> key = rootNodes;
+    sort(key.begin(), key.end());
+    key.erase(unique(key.begin(), key.end()), key.end());
+
+    auto iter = m_nestedNetworksForRootSets.find(key);
+    if (iter != m_nestedNetworksForRootSets.end())
+        return iter->second;
+
+    set<ComputationNodeBasePtr> neededNodes;
+    for (const auto& rootNode : key)
+    {
+        const auto& nodes = GetEvalOrder(rootNode);
+        neededNodes.insert(nodes.begin(), nodes.end());
+    }
+
+    list<ComputationNodeBasePtr> evalOrder;
+    for (const auto& node : GetEvalOrder(nullptr))
+    {
+        if (neededNodes.find(node) != neededNodes.end())
+            evalOrder.push_back(node);
+    }
+
+    auto network = make_shared<PARTraversalFlowControlNode>(m_allSEQNodes, evalOrder);
+    auto& flowControlNode = static_cast<FlowControlNode&>(*network);
+    flowControlNode.SetForwardPropBatches(DetermineForwardPropBatches(flowControlNode.m_nestedNodes));
+    m_nestedNetworksForRootSets[key] = network;
+    return network;
+}
+
 // -----------------------------------------------------------------------
 // PARTraversalFlowControlNode methods -- implements PAR traversal
 //
@@ -101,6 +226,7 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
 // -----------------------------------------------------------------------
 
 ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes /*must be in eval order*/)
+    : m_computeStreams(nullptr)
 {
     // traverse the network in evaluation order and create a new list that replaces all recurrence by a SEQTraversalFlowControlNode
     set<shared_ptr<IComputationNode>> loopsSeen; // for consistency check only
@@ -111,6 +237,7 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         {
             // instead of the node itself, include the sentinel SEQTraversalFlowControlNode in our list
             m_nestedNodes.push_back(recInfo);
+            m_loops.push_back(recInfo);
             // and verify that we only encountered the loop once (all nodes should have been consecutive)
             if (!loopsSeen.insert(recInfo).second)
                 LogicError("PARTraversalFlowControlNode: members of loop %ls are not consecutive in node list.", recInfo->NodeName().c_str());
@@ -127,32 +254,413 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
 {
-    for (auto& node : m_nestedNodes)
+    if (!m_computeStreams || m_profiler) // (the profiler times each node on its own)
     {
-        if (node->IsOutOfDateWrtInputs())
-        {
-            node->BeginForwardProp();
-            node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
-            node->EndForwardProp();
+        for (size_t i = 0; i < m_nestedNodes.size(); i++)
+            ForwardPropUnit(i, fr);
+        return;
+    }
 
-            node->BumpEvalTimeStamp();
+    if (m_forwardStages.empty())
+        m_forwardStages = DetermineStages(/*backprop=*/false);
+    for (const auto& stage : m_forwardStages)
+    {
+        if (stage.size() == 1)
+            ForwardPropUnit(stage[0], fr);
+        else
+            RunStage(stage, /*backprop=*/false, fr);
+    }
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::ForwardPropUnit(size_t index, const FrameRange& fr)
+{
+    const bool prefetch = m_networkOptions.m_managedMemoryPrefetchDistance > 0 && TracingGPUMemoryAllocator::IsManagedMemoryEnabled();
+    if (prefetch)
+        PrefetchAhead(index, /*backprop=*/false);
+
+    auto& node = m_nestedNodes[index];
+    auto batch = m_forwardPropBatches.find(index);
+    if (batch != m_forwardPropBatches.end())
+    {
+        // first node of a batch: compute all that are out of date in one go; the others are then skipped as up to date
+        vector<ComputationNodeBasePtr> nodes;
+        for (auto& member : batch->second)
+            if (member->IsOutOfDateWrtInputs())
+                nodes.push_back(member);
+        if (nodes.empty())
+            return;
+        NodeProfiler::Scope profile(m_profiler, nodes, fr);
+        CNTK_RANGE(nodes[0]->NodeName().c_str());
+        CNTK_COUNTER_ADD("network.forwardProp", nodes.size());
+        DeviceTransferMonitor::Context transfers(*nodes[0]);
+        MemoryAccounting::Context memory(*nodes[0], MemoryAccounting::workspace); // (the node's own value and gradient override this)
+        for (auto& member : nodes)
+            member->BeginForwardProp();
+        nodes[0]->ForwardPropBatched(nodes, fr);
+        for (auto& member : nodes)
+        {
+            member->EndForwardProp();
+            if (member->m_valueStoredInHalf)
+                member->PackValueToHalf();
+            member->BumpEvalTimeStamp();
         }
     }
+    else if (node->IsOutOfDateWrtInputs())
+    {
+        NodeProfiler::Scope profile(m_profiler, node, NodeProfiler::forwardPass, fr.WithLayout(node->GetMBLayout()));
+        CNTK_RANGE(node->NodeName().c_str());
+        CNTK_COUNTER_ADD("network.forwardProp", 1);
+        DeviceTransferMonitor::Context transfers(*node);
+        MemoryAccounting::Context memory(*node, MemoryAccounting::workspace);
+        node->BeginForwardProp();
+        node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+        node->EndForwardProp();
+        if (node->m_valueStoredInHalf)
+            node->PackValueToHalf();
+
+        node->BumpEvalTimeStamp();
+    }
+
+    if (prefetch)
+        DemoteParameters(index);
 }
 
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
-    // process nodes in pre-determined order
-    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
+    if (!m_computeStreams || m_profiler)
+    {
+        // process nodes in pre-determined order
+        for (size_t k = m_nestedNodes.size(); k-- > 0;) // iterate backwards over evaluation order
+        {
+            BackpropUnit(k, fr);
+            if (m_nodeBackpropDone)
+                m_nodeBackpropDone(m_nestedNodes[k]);
+        }
+        return;
+    }
+
+    if (m_backpropStages.empty())
+        m_backpropStages = DetermineStages(/*backprop=*/true);
+    for (const auto& stage : m_backpropStages)
     {
-        auto& node = *pnode;
+        if (stage.size() == 1)
+            BackpropUnit(stage[0], fr);
+        else
+            RunStage(stage, /*backprop=*/true, fr);
+        // the gradients are complete only now, on the main stream
+        if (m_nodeBackpropDone)
+        {
+            for (auto index : stage)
+                m_nodeBackpropDone(m_nestedNodes[index]);
+        }
+    }
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::BackpropUnit(size_t index, const FrameRange& fr)
+{
+    if (m_networkOptions.m_managedMemoryPrefetchDistance > 0 && TracingGPUMemoryAllocator::IsManagedMemoryEnabled())
+        PrefetchAhead(index, /*backprop=*/true);
+
+    auto& node = m_nestedNodes[index];
 
+    // below frozen parameters and inputs, nothing needs a gradient, and Backprop() would only visit the inputs (for a loop, in every time step)
+    if (!node->NeedGradient())
+    {
+        ReleaseRecomputedValue(node); // (it may have been recomputed for a consumer)
+        return;
+    }
+
+    RecomputeValuesNeededForBackprop(node, fr, m_loops);
+
+    {
+        NodeProfiler::Scope profile(m_profiler, node, NodeProfiler::backpropPass, fr.WithLayout(node->GetMBLayout()));
+        CNTK_RANGE(node->NodeName().c_str());
+        CNTK_COUNTER_ADD("network.backprop", 1);
+        DeviceTransferMonitor::Context transfers(*node);
+        MemoryAccounting::Context memory(*node, MemoryAccounting::workspace);
         node->BeginBackprop();
         node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
         node->EndBackprop();
     }
+
+    ReleaseRecomputedValue(node); // this node was the last to use its own value
 }
+
+// run the units of a stage on the concurrent streams (round robin)
+// The loops of the stage (e.g. the two directions of a bidirectional recurrence) step through time together, one step of
+// each in turn, so that the GPU steps them concurrently: a loop is bound by the launches of its many small kernels, and
+// running one loop after the other would only overlap the end of one with the start of the next.
+// In backprop, the gradients that the loops pass to nodes outside of them are computed after the join, one loop after the
+// other (EndBackprop()), since the loops may share such inputs; DetermineStages() leaves them out of the check for that reason.
+// A loop that has been recorded (see RunCaptured()) is replayed on its stream instead of stepped.
+void ComputationNetwork::PARTraversalFlowControlNode::RunStage(const std::vector<size_t>& stage, bool backprop, const FrameRange& fr)
+{
+    const size_t numStreams = m_computeStreams->GetNumStreams();
+    std::vector<shared_ptr<SEQTraversalFlowControlNode>> loops;
+    std::vector<size_t> loopStreams;
+    std::vector<FrameRangeIteration::FrameRangeIterator> steps, ends;
+    m_computeStreams->Fork();
+    try
+    {
+        for (size_t k = 0; k < stage.size(); k++)
+        {
+            m_computeStreams->Select(k % numStreams);
+            auto loop = dynamic_pointer_cast<SEQTraversalFlowControlNode>(m_nestedNodes[stage[k]]);
+            if (!loop && backprop)
+                BackpropUnit(stage[k], fr);
+            else if (!loop)
+                ForwardPropUnit(stage[k], fr);
+            else if (backprop ? loop->NeedGradient() : loop->IsOutOfDateWrtInputs())
+            {
+                if (backprop)
+                    loop->BeginBackprop();
+                else
+                    loop->BeginForwardProp();
+                const bool replayed = loop->RunCaptured(backprop); // (then there is nothing to step)
+                FrameRangeIteration range(loop->GetMBLayout(), loop->m_steppingDirection);
+                steps.push_back(backprop ? (replayed ? range.rend() : range.rbegin()) : (replayed ? range.end() : range.begin()));
+                ends.push_back(backprop ? range.rend() : range.end());
+                loops.push_back(loop);
+                loopStreams.push_back(k % numStreams);
+            }
+        }
+
+        for (bool stepped = true; stepped;)
+        {
+            stepped = false;
+            for (size_t l = 0; l < loops.size(); l++)
+            {
+                if (!(steps[l] != ends[l]))
+                    continue;
+                m_computeStreams->Select(loopStreams[l]);
+                if (backprop)
+                    loops[l]->BackpropStep(steps[l]);
+                else
+                    loops[l]->ForwardPropStep(steps[l]);
+                steps[l]++;
+                stepped = true;
+            }
+        }
+
+        if (!backprop)
+        {
+            for (size_t l = 0; l < loops.size(); l++)
+            {
+                m_computeStreams->Select(loopStreams[l]);
+                loops[l]->EndForwardProp();
+                loops[l]->BumpEvalTimeStamp();
+            }
+        }
+    }
+    catch (...)
+    {
+        m_computeStreams->Join();
+        throw;
+    }
+    m_computeStreams->Join();
+
+    if (backprop)
+    {
+        for (auto& loop : loops)
+            loop->EndBackprop();
+    }
+}
+
+// -----------------------------------------------------------------------
+// concurrent streams
+//
+// The traversal is cut into stages of consecutive units (nodes or loops; in backprop order for backprop) that do not
+// depend on each other, and each stage is forked onto the concurrent streams and joined back before the next one.
+// InterleaveIndependentBranches() has sorted the evaluation order by depth, so that the units of independent branches
+// come next to each other. Units of a stage must not share any matrix that one of them writes: besides the direct data
+// flow, this catches buffers that the matrix pool hands to several nodes, since its plan assumes sequential execution.
+// Units with gradient checkpointing involved run on their own, since recomputation writes values outside of the unit.
+// -----------------------------------------------------------------------
+
+// the nodes computed by the unit m_nestedNodes[index]: the members of a loop, or of a batch in forward prop
+// unified memory (see TracingGPUMemoryAllocator::SetManagedMemoryEnabled()): before unit 'index' runs, the matrices of the unit
+// managedMemoryPrefetchDistance units further in traversal order are migrated to the device (at the start of a pass, those of all
+// units up to there), so that they are resident by the time that unit runs instead of being paged in one fault at a time
+void ComputationNetwork::PARTraversalFlowControlNode::PrefetchAhead(size_t index, bool backprop) const
+{
+    const size_t numUnits = m_nestedNodes.size();
+    const size_t position = backprop ? numUnits - 1 - index : index; // (backprop runs backwards)
+    const size_t last = position + m_networkOptions.m_managedMemoryPrefetchDistance;
+    for (size_t p = position == 0 ? 0 : last; p <= last && p < numUnits; p++)
+    {
+        for (const auto& node : GetUnitNodes(backprop ? numUnits - 1 - p : p, backprop))
+        {
+            node->PrefetchMatrices(/*toDevice=*/true, /*withGradient=*/backprop);
+            for (const auto& input : node->GetInputs())
+                input->PrefetchMatrices(/*toDevice=*/true, /*withGradient=*/backprop && input->NeedGradient());
+        }
+    }
+}
+
+// unified memory: after the forward pass of unit 'index', the parameters it read that no unit within the prefetch distance reads
+// go to the host, making room for the activations still to come; backprop prefetches them again
+void ComputationNetwork::PARTraversalFlowControlNode::DemoteParameters(size_t index) const
+{
+    const size_t numUnits = m_nestedNodes.size();
+    for (const auto& node : GetUnitNodes(index, /*backprop=*/false))
+    {
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->OperationName() != OperationNameOf(LearnableParameter))
+                continue;
+            bool usedSoon = false;
+            for (size_t p = index + 1; p <= index + m_networkOptions.m_managedMemoryPrefetchDistance && p < numUnits && !usedSoon; p++)
+            {
+                for (const auto& later : GetUnitNodes(p, /*backprop=*/false))
+                    usedSoon |= std::find(later->GetInputs().begin(), later->GetInputs().end(), input) != later->GetInputs().end();
+            }
+            if (!usedSoon)
+                input->PrefetchMatrices(/*toDevice=*/false, /*withGradient=*/false);
+        }
+    }
+}
+
+std::vector<ComputationNodeBasePtr> ComputationNetwork::PARTraversalFlowControlNode::GetUnitNodes(size_t index, bool backprop) const
+{
+    const auto& node = m_nestedNodes[index];
+    auto batch = m_forwardPropBatches.find(index);
+    if (!backprop && batch != m_forwardPropBatches.end())
+        return batch->second;
+    auto loop = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
+    if (loop)
+        return loop->m_nestedNodes;
+    return std::vector<ComputationNodeBasePtr>{node};
+}
+
+// the matrices that ForwardProp() resp. Backprop() of 'nodes' write and read
+// For a loop in backprop, the gradients of the nodes outside of it are left out, since RunStage() computes them after the join.
+/*static*/ void ComputationNetwork::PARTraversalFlowControlNode::CollectMatrixUses(const std::vector<ComputationNodeBasePtr>& nodes, bool backprop, bool isLoop,
+                                                                                   std::set<const void*>& writes, std::set<const void*>& reads)
+{
+    auto add = [](std::set<const void*>& matrices, const void* matrix)
+    {
+        if (matrix)
+            matrices.insert(matrix);
+    };
+    for (const auto& node : nodes)
+    {
+        // a sum absorbed into this node is computed from its inputs right here
+        std::vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->IsAbsorbedIntoConsumer())
+                inputs.insert(inputs.end(), input->GetInputs().begin(), input->GetInputs().end());
+            else
+                inputs.push_back(input);
+        }
+        std::vector<const void*> fromPool;
+        node->CollectMatricesFromPool(fromPool);
+
+        if (!backprop)
+        {
+            add(writes, node->ValueMatrixId());
+            for (auto matrix : fromPool)
+                add(writes, matrix);
+            for (const auto& input : inputs)
+                add(reads, input->ValueMatrixId());
+        }
+        else
+        {
+            add(reads, node->ValueMatrixId());
+            add(reads, node->GradientMatrixId());
+            for (auto matrix : fromPool)
+            {
+                if (matrix != node->ValueMatrixId() && matrix != node->GradientMatrixId())
+                    add(writes, matrix);
+            }
+            for (const auto& input : inputs)
+            {
+                add(reads, input->ValueMatrixId());
+                if (!isLoop || std::find(nodes.begin(), nodes.end(), input) != nodes.end())
+                    add(writes, input->GradientMatrixId());
+            }
+        }
+    }
+}
+
+// does the backprop of 'nodes' recompute values or expand them from half precision (see RecomputeValuesNeededForBackprop())?
+/*static*/ bool ComputationNetwork::PARTraversalFlowControlNode::IsRecomputeInvolved(const std::vector<ComputationNodeBasePtr>& nodes)
+{
+    for (const auto& node : nodes)
+    {
+        if (node->m_recomputeDuringBackprop || node->m_valueStoredInHalf)
+            return true;
+        for (const auto& input : node->GetInputs())
+        {
+            if (input->m_recomputeDuringBackprop || input->m_valueStoredInHalf)
+                return true;
+        }
+    }
+    return false;
+}
+
+// greedily cut the traversal into stages: a unit joins the current stage unless it depends on, or shares a written matrix with, one of its units
+ComputationNetwork::PARTraversalFlowControlNode::Stages ComputationNetwork::PARTraversalFlowControlNode::DetermineStages(bool backprop) const
+{
+    Stages stages;
+    std::set<const void*> stageWrites, stageReads;
+    std::set<ComputationNodeBasePtr> stageNodes; // forward: nodes computed in the stage; backprop: their inputs, whose gradients the stage computes
+    bool stageIsExclusive = false;
+    const size_t numUnits = m_nestedNodes.size();
+    for (size_t k = 0; k < numUnits; k++)
+    {
+        const size_t index = backprop ? numUnits - 1 - k : k;
+        if (!backprop && index < m_isComputedByBatch.size() && m_isComputedByBatch[index] && !stages.empty())
+        {
+            stages.back().push_back(index); // nothing to do, its batch has computed it
+            continue;
+        }
+
+        const auto nodes = GetUnitNodes(index, backprop);
+        const bool isLoop = dynamic_pointer_cast<SEQTraversalFlowControlNode>(m_nestedNodes[index]) != nullptr;
+        std::set<const void*> writes, reads;
+        CollectMatrixUses(nodes, backprop, isLoop, writes, reads);
+        const bool isExclusive = backprop && IsRecomputeInvolved(nodes);
+
+        bool canJoin = !stages.empty() && !isExclusive && !stageIsExclusive;
+        for (const auto& node : nodes)
+        {
+            if (!backprop)
+            {
+                for (const auto& input : node->GetInputs())
+                    canJoin = canJoin && stageNodes.find(input) == stageNodes.end();
+            }
+            else
+                canJoin = canJoin && stageNodes.find(node) == stageNodes.end();
+        }
+        for (auto matrix : writes)
+            canJoin = canJoin && stageWrites.find(matrix) == stageWrites.end() && stageReads.find(matrix) == stageReads.end();
+        for (auto matrix : reads)
+            canJoin = canJoin && stageWrites.find(matrix) == stageWrites.end();
+
+        if (!canJoin)
+        {
+            stages.push_back(std::vector<size_t>());
+            stageWrites.clear();
+            stageReads.clear();
+            stageNodes.clear();
+        }
+        stages.back().push_back(index);
+        stageWrites.insert(writes.begin(), writes.end());
+        stageReads.insert(reads.begin(), reads.end());
+        stageIsExclusive = isExclusive;
+        for (const auto& node : nodes)
+        {
+            if (!backprop)
+                stageNodes.insert(node);
+            else
+                stageNodes.insert(node->GetInputs().begin(), node->GetInputs().end());
+        }
+    }
+    return stages;
+}
+
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
 }
@@ -188,9 +696,36 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
                        node->NodeName().c_str(), m_nestedNodes[0]->NodeName().c_str());
     }
 
+    // gradient checkpointing: the loop will be run again for backprop, from the state it starts from now (see RecomputeForBackprop())
+    for (auto& node : m_nestedNodes)
+    {
+        auto statefulNode = dynamic_pointer_cast<IStatefulNode>(node);
+        if (statefulNode && node->m_recomputeDuringBackprop && !node->m_valueIsRecomputed)
+            statefulNode->SaveStateForRecompute();
+    }
+
     // tell all that loop is about to commence
     for (auto& node : m_nestedNodes)
         node->BeginForwardProp();
+    DetermineStepActiveSequencesOnly();
+}
+
+// With the skipFinishedSequences option, each time step is computed only on the parallel sequences up to the last one that has not ended
+// (or not started) yet, instead of computing all and masking the gaps later. The earlier the sequences are sorted by length
+// (longest first), the less is computed on gaps. This needs all nodes of the loop to support it (CanStepActiveSequencesOnly()).
+void ComputationNetwork::SEQTraversalFlowControlNode::DetermineStepActiveSequencesOnly()
+{
+    m_stepActiveSequencesOnly = m_networkOptions.m_skipFinishedSequences && GetMBLayout()->HasGaps();
+    for (auto& node : m_nestedNodes)
+        m_stepActiveSequencesOnly = m_stepActiveSequencesOnly && node->CanStepActiveSequencesOnly();
+}
+
+// the time step 't', restricted to the active sequences if so decided
+FrameRange ComputationNetwork::SEQTraversalFlowControlNode::ActiveSequencesOf(const FrameRange& t) const
+{
+    if (!m_stepActiveSequencesOnly)
+        return t;
+    return t.ActiveSequences(GetMBLayout()->GetNumActiveSequences(t.t()));
 }
 
 // evaluation of a SEQTraversalFlowControlNode FlowControlNode
@@ -206,11 +741,38 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     // for every time step run through all nodes in this particular loop (treat the loop like a little ComputationNetwork)
     // Note: Currently, this is limited to linear-time loops. But nothing stops the iteration below to, e.g., be a 2D iteration over an image
     // if we implement an according FrameRangeIteration.
+    if (RunCaptured(false /*backprop*/))
+        return;
     FrameRangeIteration range(GetMBLayout(), m_steppingDirection);
     for (auto t = range.begin(); t != range.end(); t++)
+        ForwardPropStep(t);
+}
+
+// one time step of ForwardProp(); also used to step several loops together (see PARTraversalFlowControlNode::RunStage())
+void ComputationNetwork::SEQTraversalFlowControlNode::ForwardPropStep(const FrameRange& step)
+{
+    const FrameRange t = ActiveSequencesOf(step);
+    for (size_t i = 0; i < m_nestedNodes.size(); i++)
     {
-        for (auto& node : m_nestedNodes)
+        auto& node = m_nestedNodes[i];
+        auto batch = m_forwardPropBatches.find(i);
+        if (batch != m_forwardPropBatches.end())
         {
+            // independent products of this step, computed together (see ComputationNetwork::DetermineForwardPropBatches())
+            NodeProfiler::Scope profile(m_profiler, batch->second, t, this);
+            DeviceTransferMonitor::Context transfers(*node);
+            MemoryAccounting::Context memory(*node, MemoryAccounting::workspace);
+            node->ForwardPropBatched(batch->second, t);
+            for (auto& member : batch->second)
+                member->BumpEvalTimeStamp();
+        }
+        else if (!m_isComputedByBatch.empty() && m_isComputedByBatch[i])
+            continue;
+        else
+        {
+            NodeProfiler::Scope profile(m_profiler, node, NodeProfiler::forwardPass, t, this);
+            DeviceTransferMonitor::Context transfers(*node);
+            MemoryAccounting::Context memory(*node, MemoryAccounting::workspace);
             node->ForwardProp(t);
             node->BumpEvalTimeStamp();
         }
@@ -219,33 +781,75 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 
 /*virtual*/ void ComputationNetwork::SEQTraversalFlowControlNode::EndForwardProp() /*override*/
 {
+    // the gaps that were skipped still hold stale values; consumers outside of the loop must not pick up NaNs from there
+    if (m_stepActiveSequencesOnly)
+    {
+        for (auto& node : m_nestedNodes)
+            node->MaskMissingValueColumnsToZero(FrameRange(GetMBLayout()));
+    }
+
     // tell all that loop is done  --e.g. PastValueNode will capture its state for BPTT processing
     for (auto& node : m_nestedNodes)
         node->EndForwardProp();
 }
 
+// gradient checkpointing of the loop (see ComputationNetwork::RecomputeValueForBackprop())
+// The inputs from outside of the loop must have been recomputed. The delay nodes end up with the same state as after the
+// forward prop, which the next minibatch continues from.
+void ComputationNetwork::SEQTraversalFlowControlNode::RecomputeForBackprop()
+{
+    for (auto& node : m_nestedNodes)
+    {
+        if (!node->m_recomputeDuringBackprop)
+            continue;
+        node->SwapValueWithRecomputeBuffer();
+        node->m_valueIsRecomputed = true;
+        auto statefulNode = dynamic_pointer_cast<IStatefulNode>(node);
+        if (statefulNode)
+            statefulNode->RestoreStateForRecompute();
+    }
+
+    // stepped, since a recording (RunCaptured()) is bound to the forward-prop buffers
+    BeginForwardProp();
+    FrameRangeIteration range(GetMBLayout(), m_steppingDirection);
+    for (auto t = range.begin(); t != range.end(); t++)
+        ForwardPropStep(t);
+    EndForwardProp();
+}
+
 // called before first iteration step of ComputeGradient()
 /*virtual*/ void ComputationNetwork::SEQTraversalFlowControlNode::BeginBackprop() /*override*/
 {
     for (auto& node2 : m_nestedNodes)
         node2->BeginBackprop();
+    DetermineStepActiveSequencesOnly();
 }
 
 /*virtual*/ void ComputationNetwork::SEQTraversalFlowControlNode::Backprop(const FrameRange&, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop;    // TODO: think through what these mean when coming from PAR mode
-    const auto& recurrentNodes = m_nestedNodes; // BUGBUG: -ForForward?? Does this mean we can remove non-ForForward?
-    auto pMBLayout = recurrentNodes[0]->GetMBLayout();
+    if (RunCaptured(true /*backprop*/))
+        return;
+    auto pMBLayout = m_nestedNodes[0]->GetMBLayout();
     FrameRangeIteration range(pMBLayout, m_steppingDirection);
     for (auto t = range.rbegin(); t != range.rend(); t++) // note: reverse iteration
+        BackpropStep(t);
+}
+
+// one time step of Backprop(), see ForwardPropStep()
+void ComputationNetwork::SEQTraversalFlowControlNode::BackpropStep(const FrameRange& step)
+{
+    const FrameRange t = ActiveSequencesOf(step);
+    const auto& recurrentNodes = m_nestedNodes; // BUGBUG: -ForForward?? Does this mean we can remove non-ForForward?
+    for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
     {
-        for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
-        {
-            auto& node2 = *nodeIter2;
-            node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
-            // The above flags tell Backprop() to skip back-propagation from inside a node into
-            // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
-        }
+        auto& node2 = *nodeIter2;
+        NodeProfiler::Scope profile(m_profiler, node2, NodeProfiler::backpropPass, t, this, true, false);
+        DeviceTransferMonitor::Context transfers(*node2);
+        MemoryAccounting::Context memory(*node2, MemoryAccounting::workspace);
+        node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
+        // The above flags tell Backprop() to skip back-propagation from inside a node into
+        // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
     }
 }
 
@@ -257,7 +861,11 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     for (auto nodeIter2 = m_nestedNodes.rbegin(); nodeIter2 != m_nestedNodes.rend(); ++nodeIter2)
     {
         auto& node2 = *nodeIter2;
-        node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+        const FrameRange fr(m_nestedNodes[0]->GetMBLayout());
+        NodeProfiler::Scope profile(m_profiler, node2, NodeProfiler::backpropPass, fr, this, false, true);
+        DeviceTransferMonitor::Context transfers(*node2);
+        MemoryAccounting::Context memory(*node2, MemoryAccounting::workspace);
+        node2->Backprop(fr, false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
     }
 
     // tell all nodes we are done for this iteraTion
@@ -265,6 +873,154 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         node2->EndBackprop();
 }
 
+// -----------------------------------------------------------------------
+// loop capture
+//
+// A loop is bound by the launches of the many small kernels of its time steps. With the captureLoops option on a GPU, the kernels of
+// all time steps are recorded into a CUDA graph (see CUDAGraph.h), and replayed with a single launch whenever the loop runs
+// again with the same shape of its layouts (the sequence boundaries and gaps decide which kernels the nodes launch on which
+// columns) and on the same buffers (the recording is bound to device pointers); only the data differs from one minibatch
+// to the next. The first run with a shape and buffers is stepped as usual, which creates lazy state such as the cuBLAS
+// workspace, the second one is recorded, and the following ones are replays.
+// A loop with a node that cannot be replayed (see CollectCaptureState()), or whose recording keeps failing, is stepped.
+// -----------------------------------------------------------------------
+
+static const size_t maxCapturesPerLoop = 16; // distinct shapes, e.g. truncated BPTT with a few sequence boundary patterns
+static const size_t maxCaptureFailures = 3;
+
+// the shape of the layouts that the time steps depend on, and the buffers they use
+bool ComputationNetwork::SEQTraversalFlowControlNode::CollectCaptureKey(bool backprop, std::vector<ptrdiff_t>& layoutKey, std::vector<const void*>& buffers) const
+{
+    std::vector<MBLayoutPtr> layouts{GetMBLayout()};
+    for (const auto& node : m_nestedNodes)
+    {
+        if (!node->CollectCaptureState(buffers, layouts))
+            return false;
+    }
+
+    // sequence ids are left out, they are new in every minibatch
+    layoutKey.push_back(backprop ? 1 : 0);
+    for (const auto& layout : layouts)
+    {
+        if (!layout)
+        {
+            layoutKey.push_back(-1);
+            continue;
+        }
+        const auto& sequences = layout->GetAllSequences();
+        layoutKey.push_back((ptrdiff_t) layout->GetNumParallelSequences());
+        layoutKey.push_back((ptrdiff_t) layout->GetNumTimeSteps());
+        layoutKey.push_back((ptrdiff_t) sequences.size());
+        for (const auto& sequence : sequences)
+        {
+            layoutKey.push_back((ptrdiff_t) sequence.s);
+            layoutKey.push_back(sequence.tBegin);
+            layoutKey.push_back((ptrdiff_t) sequence.tEnd);
+            layoutKey.push_back(sequence.seqId == GAP_SEQUENCE_ID ? 1 : 0);
+        }
+    }
+
+    // the masking of gaps reads the validity mask, which is created lazily; create it here, outside of the recording
+    if (GetMBLayout()->HasGaps())
+        buffers.push_back(GetMBLayout()->GetColumnsValidityMask(m_nestedNodes[0]->GetDeviceId()).BufferPointer());
+    return true;
+}
+
+// Called after BeginForwardProp() resp. BeginBackprop(), in place of stepping; the caller still calls EndForwardProp() resp. EndBackprop().
+bool ComputationNetwork::SEQTraversalFlowControlNode::RunCaptured(bool backprop)
+{
+    const DEVICEID_TYPE deviceId = m_nestedNodes[0]->GetDeviceId();
+    if (!m_networkOptions.m_captureLoops || m_captureDisabled || m_profiler || deviceId < 0 || !CUDAGraph::IsSupported())
+        return false;
+
+    std::vector<ptrdiff_t> layoutKey;
+    std::vector<const void*> buffers;
+    if (!CollectCaptureKey(backprop, layoutKey, buffers))
+    {
+        fprintf(stderr, "%ls: Not captured, since a node of the loop cannot be replayed.\n", NodeName().c_str());
+        m_captureDisabled = true;
+        return false;
+    }
+    auto iter = m_captures.find(layoutKey);
+    if (iter == m_captures.end())
+    {
+        if (m_captures.size() >= maxCapturesPerLoop)
+            return false;
+        iter = m_captures.insert(make_pair(layoutKey, Capture{std::vector<const void*>(), 0, nullptr})).first;
+    }
+    auto& capture = iter->second;
+    if (capture.m_buffers != buffers) // reallocated; the recording would access the old buffers
+    {
+        capture.m_buffers = buffers;
+        capture.m_numRuns = 0;
+        capture.m_graph.reset();
+    }
+    if (++capture.m_numRuns == 1)
+        return false; // warm-up
+
+    // Backprop() zeroes each gradient lazily at its first use. The recording must not zero it, since it is replayed after
+    // others have started to accumulate into it from outside of the loop; zero all of them up front instead.
+    if (backprop)
+    {
+        for (auto& node : m_nestedNodes)
+        {
+            if (node->NeedGradient() && !node->IsAbsorbedIntoConsumer())
+                node->LazyZeroGradient();
+        }
+    }
+
+    if (!capture.m_graph)
+    {
+        // record; nothing is executed yet
+        capture.m_graph = make_shared<CUDAGraph>(deviceId);
+        capture.m_graph->BeginCapture();
+        try
+        {
+            FrameRangeIteration range(GetMBLayout(), m_steppingDirection);
+            if (backprop)
+            {
+                for (auto t = range.rbegin(); t != range.rend(); t++)
+                    BackpropStep(t);
+            }
+            else
+            {
+                for (auto t = range.begin(); t != range.end(); t++)
+                    ForwardPropStep(t);
+            }
+        }
+        catch (...)
+        {
+            capture.m_graph->AbortCapture();
+            m_captures.erase(iter);
+            throw;
+        }
+        bool captured = capture.m_graph->EndCapture();
+
+        // a buffer reallocated during the recording (e.g. a gradient sized at its first use) would be stale in every replay
+        std::vector<ptrdiff_t> layoutKeyAfter;
+        std::vector<const void*> buffersAfter;
+        captured = captured && CollectCaptureKey(backprop, layoutKeyAfter, buffersAfter) && buffersAfter == buffers;
+        if (!captured)
+        {
+            m_captures.erase(iter);
+            if (++m_numCaptureFailures >= maxCaptureFailures)
+            {
+                fprintf(stderr, "%ls: Not captured, since the time steps could not be recorded.\n", NodeName().c_str());
+                m_captureDisabled = true;
+            }
+            return false; // the caller steps
+        }
+    }
+
+    capture.m_graph->Launch();
+    if (!backprop)
+    {
+        for (auto& node : m_nestedNodes)
+            node->BumpEvalTimeStamp();
+    }
+    return true;
+}
+
 /*virtual*/ void ComputationNetwork::SEQTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
     for (auto& nodeLoopIter : m_nestedNodes)
@@ -293,6 +1049,89 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     }
 }
 
+// -----------------------------------------------------------------------
+// gradient checkpointing (recompute)
+//
+// Nodes with m_recomputeDuringBackprop set release their value after the last forward-prop consumer,
+// like nodes whose value is not needed for backprop. When the gradient computation reaches the first node that
+// may read that value, the value is recomputed into a separate buffer (inputs that are themselves dropped are
+// recomputed first), and the buffer is kept until the node's own Backprop() is done.
+// Gradient checkpointing of a recurrent loop applies to all of its nodes. The loop is run again as a whole, from the state
+// that its delay nodes started the minibatch with (SEQTraversalFlowControlNode::RecomputeForBackprop()).
+// Nodes with m_valueStoredInHalf set go the same way, except that their value is packed into half precision right after
+// their forward prop, and expanded from there instead of being recomputed.
+// AllocateAllMatrices() simulates exactly this order to plan the recompute buffers.
+// -----------------------------------------------------------------------
+
+/*static*/ void ComputationNetwork::RecomputeValueForBackprop(const ComputationNodeBasePtr& node, const FrameRange& fr, const std::vector<std::shared_ptr<SEQTraversalFlowControlNode>>& loops)
+{
+    if (node->m_valueIsRecomputed)
+        return;
+    if (node->m_valueStoredInHalf)
+    {
+        node->ExpandValueFromHalf();
+        node->m_valueIsRecomputed = true;
+        return;
+    }
+    if (!node->m_recomputeDuringBackprop)
+        return;
+
+    // a loop is recomputed as a whole, after the inputs from outside of it
+    if (node->IsPartOfLoop())
+    {
+        const auto loop = FindInRecurrentLoops(loops, node);
+        for (const auto& nestedNode : loop->m_nestedNodes)
+        {
+            for (const auto& input : nestedNode->GetInputs())
+            {
+                if (std::find(loop->m_nestedNodes.begin(), loop->m_nestedNodes.end(), input) == loop->m_nestedNodes.end())
+                    RecomputeValueForBackprop(input, fr, loops);
+            }
+        }
+        loop->RecomputeForBackprop();
+        return;
+    }
+
+    for (const auto& input : node->GetInputs())
+        RecomputeValueForBackprop(input, fr, loops);
+
+    node->SwapValueWithRecomputeBuffer();
+    node->m_valueIsRecomputed = true;
+
+    node->BeginForwardProp();
+    node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+    node->EndForwardProp();
+}
+
+// recompute whatever the Backprop() of 'node' may read: its own value and those of its inputs (for loops: of all nodes in the loop)
+/*static*/ void ComputationNetwork::RecomputeValuesNeededForBackprop(const ComputationNodeBasePtr& node, const FrameRange& fr, const std::vector<std::shared_ptr<SEQTraversalFlowControlNode>>& loops)
+{
+    const auto flowControlNode = dynamic_pointer_cast<FlowControlNode>(node);
+    const auto& nodes = flowControlNode ? flowControlNode->m_nestedNodes : std::vector<ComputationNodeBasePtr>{node};
+    for (const auto& nestedNode : nodes)
+    {
+        if (!nestedNode->NeedGradient()) // Backprop() will not do anything
+            continue;
+        RecomputeValueForBackprop(nestedNode, fr, loops);
+        for (const auto& input : nestedNode->GetInputs())
+            RecomputeValueForBackprop(input, fr, loops);
+    }
+}
+
+/*static*/ void ComputationNetwork::ReleaseRecomputedValue(const ComputationNodeBasePtr& node)
+{
+    if (const auto loop = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node))
+    {
+        for (const auto& nestedNode : loop->m_nestedNodes)
+            ReleaseRecomputedValue(nestedNode);
+        return;
+    }
+    if (!node->m_valueIsRecomputed)
+        return;
+    node->SwapValueWithRecomputeBuffer(); // the forward-prop buffer is back; its content is stale, but nobody reads it before the next forward prop
+    node->m_valueIsRecomputed = false;
+}
+
 // find if node is part of a recurrent loop; and return the loop id
 // If found then return a pointer to the list of nodes of this loop.
 /*static*/ shared_ptr<ComputationNetwork::SEQTraversalFlowControlNode> ComputationNetwork::FindInRecurrentLoops(const std::vector<std::shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const ComputationNodeBasePtr& node)
@@ -370,6 +1209,7 @@ void ComputationNetwork::InvalidateCompiledNetwork()
     m_allSEQNodes.clear();
     m_evalOrders.clear();
     m_nestedNetworks.clear();
+    m_nestedNetworksForRootSets.clear();
     m_inputValues.clear();
     m_learnableParameters.clear();
 }
@@ -390,6 +1230,8 @@ void ComputationNetwork::VerifyIsCompiled(const char* where) const
 void ComputationNetwork::CompileNetwork()
 {
     fprintf(stderr, "\nPost-processing network...\n");
+    Timer compileTimer, stepTimer;
+    compileTimer.Start();
 
     // all steps below have to be repeated for all root nodes (=nodes without parents and PreComputeNodes)
     DetermineSetOfAllRoots();
@@ -404,6 +1246,16 @@ void ComputationNetwork::CompileNetwork()
     // STEP: Create a depth-first tree-traversal order through original graph for every root.
     // This is used wherever a nested structure is not relevant.
     FormEvalOrder(nullptr); // form the global one
+
+    // STEP: Merge duplicate computations and delete unused nodes. This edits the network, which is then compiled anew.
+    if (EliminateCommonSubexpressions())
+    {
+        InvalidateCompiledNetwork();
+        CompileNetwork();
+        return;
+    }
+
+    DetermineAffectedNodes(); // with incremental compilation, only the affected roots are traversed anew, and only the affected nodes validated
     for (auto& node : m_allRoots)
         FormEvalOrder(node);
 
@@ -413,25 +1265,116 @@ void ComputationNetwork::CompileNetwork()
         CollectInputAndLearnableParameters(root);
 
     // STEP: Discover nested loops.
+    stepTimer.Start();
     FormRecurrentLoops(nullptr); // form the global one  --TODO: just use this; should be no need to do this for each root
     for (auto& node : m_allRoots)
         FormRecurrentLoops(node);
+    stepTimer.Stop();
+    const double loopAnalysisSeconds = stepTimer.ElapsedSeconds();
+
+    // STEP: Move the loop-invariant operands of sums out of the loops. This edits the network, which is then compiled anew.
+    if (HoistLoopInvariantSums())
+    {
+        InvalidateCompiledNetwork();
+        CompileNetwork();
+        return;
+    }
+
+    // STEP: Order independent branches next to each other, if they are to run concurrently.
+    InterleaveIndependentBranches();
 
     // STEP: Form nested structure of PAR and SEQ traversal nodes.
     for (auto& node : m_allRoots)
         FormNestedNetwork(node);
 
     // STEP: Infer node dimensions.
+    stepTimer.Restart();
     ValidateNetwork();
+    stepTimer.Stop();
+    const double validationSeconds = stepTimer.ElapsedSeconds();
+
+    // STEP: Reorder independent nodes so that fewer values are alive at the same time. This needs the dimensions.
+    ScheduleForMemory();
 
     // STEP: Optimize the network.
-    // :)
+    // Fuse elementwise chains so that they are computed in fewer passes over memory.
+    FuseElementwiseOperations();
+    // Group independent small products into batched GEMMs.
+    FormForwardPropBatches();
 
     // STEP: Some final details.
     ResetEvalTimeStamps(); // invalidate all m_value fields. Really belongs into StartEvaluateMinibatchLoop()
 
-    fprintf(stderr, "\nPost-processing network complete.\n");
+    compileTimer.Stop();
+    fprintf(stderr, "\nPost-processing network complete in %.3f seconds (loop analysis %.3f, validation %.3f).\n",
+            compileTimer.ElapsedSeconds(), loopAnalysisSeconds, validationSeconds);
     m_isCompiled = true;
+    RememberCompiledState();
+}
+
+// with incremental compilation, determine the nodes that were edited since the last CompileNetwork() -> m_affectedNodes
+// A node counts as edited if it is new, or if its inputs, dimensions or need for parameter updates differ from then; this catches
+// every kind of edit (MEL, NDL, the optimizations of this class) without each of them having to report what it touched.
+// Everything downstream of an edited node is affected as well; everything else keeps its validated dimensions and traversals.
+void ComputationNetwork::DetermineAffectedNodes()
+{
+    m_affectedNodes.clear();
+    m_isIncrementalCompile = m_options.m_incrementalCompile && !m_compiledNodeStates.empty();
+    if (!m_isIncrementalCompile)
+        return;
+
+    const auto& nodes = GetEvalOrder(nullptr);
+    for (const auto& node : nodes)
+    {
+        auto iter = m_compiledNodeStates.find(node.get());
+        if (iter == m_compiledNodeStates.end() || !iter->second.IsStateOf(node))
+            m_affectedNodes.insert(node);
+    }
+    // propagate downstream; this takes another pass for each recurrent back edge, since there an input comes later in the order
+    bool changed = !m_affectedNodes.empty();
+    while (changed)
+    {
+        changed = false;
+        for (const auto& node : nodes)
+        {
+            if (m_affectedNodes.find(node) != m_affectedNodes.end())
+                continue;
+            for (const auto& input : node->GetInputs())
+            {
+                if (m_affectedNodes.find(input) != m_affectedNodes.end())
+                {
+                    m_affectedNodes.insert(node);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    fprintf(stderr, "\nIncremental compilation: %d out of %d nodes are affected by edits.\n", (int) m_affectedNodes.size(), (int) nodes.size());
+}
+
+// remember the state of the nodes for the next incremental compilation
+void ComputationNetwork::RememberCompiledState()
+{
+    m_isIncrementalCompile = false;
+    m_affectedNodes.clear();
+    m_compiledNodeStates.clear();
+    if (!m_options.m_incrementalCompile)
+    {
+        m_compiledEvalOrders.clear();
+        return;
+    }
+    for (const auto& node : GetEvalOrder(nullptr))
+        m_compiledNodeStates.emplace(node.get(), CompiledNodeState(node));
+    // traversals of nodes that are no longer roots are not needed anymore
+    const set<ComputationNodeBasePtr> allRoots(m_allRoots.begin(), m_allRoots.end());
+    for (auto iter = m_compiledEvalOrders.begin(); iter != m_compiledEvalOrders.end();)
+    {
+        if (allRoots.find(iter->first) == allRoots.end())
+            iter = m_compiledEvalOrders.erase(iter);
+        else
+            ++iter;
+    }
 }
 
 // determine the set of all root nodes
@@ -515,28 +1458,92 @@ void ComputationNetwork::ValidateNetwork()
     // Nodes validated on partial input (i.e. some children not yet validated) will be revisited.
     const auto& nodes = GetEvalOrder(nullptr);
 
+    // with incremental compilation, only the nodes affected by edits are validated; the others still have what they were validated to before
+    list<ComputationNodeBasePtr> affectedNodes;
     for (auto& node : nodes)
     {
+        if (m_isIncrementalCompile && m_affectedNodes.find(node) == m_affectedNodes.end())
+        {
+            node->m_visited = true;
+            continue;
+        }
         node->m_visited = false;
         node->m_needsGradient = node->IsParameterUpdateRequired(); // these get propagated upwards in the following
+        affectedNodes.push_back(node);
     }
+    const auto& nodesToValidate = m_isIncrementalCompile ? affectedNodes : nodes;
 
     // loop and validate until we are done
     // steps:
     //  - validate (not final)          // not final means no dimension checks
     //    Keep going through the list until all nodes have been validated and all inputs have been validated as well.
+    //    The eval order is topological except for the delayed inputs inside loops, so a single pass settles most nodes; a node is
+    //    validated again only if some of its inputs were not visited yet, or one of its inputs changed after it was validated
+    //    (a later node changed it, or inferred its dimensions). Passes after the first thus typically only revisit the loops.
     //  - validate (final)              // final means consistency checks
     //    Fail if any change during this stage.
+    const vector<ComputationNodeBasePtr> order(nodesToValidate.begin(), nodesToValidate.end());
+    unordered_map<const ComputationNodeBase*, size_t> positionOf;           // [node] index into 'order'
+    unordered_map<const ComputationNodeBase*, vector<size_t>> consumersOf; // [node] indices into 'order' of the nodes that take it as an input
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        positionOf[order[k].get()] = k;
+        for (const auto& input : order[k]->GetInputs())
+            consumersOf[input.get()].push_back(k);
+    }
+    vector<bool> pending(order.size(), true); // a node whose pending flag is raised during a pass is still done in that pass if it comes later
+    size_t numPending = order.size();
+    auto setPending = [&](size_t k)
+    {
+        if (!pending[k])
+        {
+            pending[k] = true;
+            numPending++;
+        }
+    };
+    vector<ComputationNodeBasePtr> changedNodes;
     size_t pass = 0;
-    size_t toValidate = nodes.size();
-    while (toValidate > 0)
+    while (numPending > 0)
     {
         pass++;
-        fprintf(stderr, "\n\nValidating network. %d nodes to process in pass %d.\n", (int) toValidate, (int) pass);
-        ValidateNodes(nodes, false /*isFinalValidationPass*/, toValidate);
+        fprintf(stderr, "\n\nValidating network. %d nodes to process in pass %d.\n", (int) numPending, (int) pass);
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            if (!pending[k])
+                continue;
+            pending[k] = false;
+            numPending--;
+            const auto& node = order[k];
+            changedNodes.clear();
+            ValidateNode(node, false /*isFinalValidationPass*/, changedNodes);
+            for (const auto& input : node->GetInputs())
+            {
+                if (!input->m_visited)
+                {
+                    setPending(k); // to be revisited once all inputs are
+                    break;
+                }
+            }
+            for (const auto& changedNode : changedNodes)
+            {
+                if (changedNode != node)
+                {
+                    auto position = positionOf.find(changedNode.get());
+                    if (position != positionOf.end())
+                        setPending(position->second);
+                }
+                auto consumers = consumersOf.find(changedNode.get());
+                if (consumers != consumersOf.end())
+                {
+                    for (size_t c : consumers->second)
+                        setPending(c);
+                }
+            }
+        }
     }
     fprintf(stderr, "\n\nValidating network, final pass.\n");
-    ValidateNodes(nodes, true /*isFinalValidationPass*/, toValidate);
+    size_t toValidate;
+    ValidateNodes(nodesToValidate, true /*isFinalValidationPass*/, toValidate);
     if (toValidate != 0)
         LogicError("ValidateSubNetwork: ValidateNodes(true) unexpectedly returned with work left to do.");
 
@@ -582,62 +1589,75 @@ static pair<TensorShape, bool> GetDims(const ComputationNodeBasePtr& node)
 void ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFinalValidationPass, size_t& todo)
 {
     todo = 0; // returns how many nodes are to be redone
+    vector<ComputationNodeBasePtr> changedNodes;
     for (auto& node : nodes)
     {
-        const auto& children = node->GetInputs();
-        const bool isLeaf = node->IsLeaf();
-        // only validate a node if it has at least one child
-        bool hasVisitedChild = false;
-        bool allChildrenVisited = true;
-        for (auto& child : children)
-        {
-            hasVisitedChild |= child->m_visited; // if not a single visited child then no point in validating
-            allChildrenVisited &= child->m_visited;
-        }
-        // if there is not at least one visited child
-        bool valid = false;
-        if (hasVisitedChild || isLeaf)
-        {
-            // got at least one child: it makes sense to call Validate()
-            // keep state
-            MBLayoutPtr oldMBLayoutPtr = node->GetMBLayout();
-            auto dim = GetDims(node);
-            vector<pair<TensorShape, bool>> childDims;
-            for (auto& child : children)
-                childDims.push_back(GetDims(child));
-            auto sampleLayout = node->GetSampleLayout();
-            // We do call validate(final) as many times as needed, since stuff may have changed underneath.
-            node->PrintSelfBeforeValidation();
-            node->Validate(isFinalValidationPass /*final*/); // all nodes have been visited: do verification instead of just inference
-            fprintf(stderr, " -> [%s%s]", string(node->GetSampleLayout()).c_str(), node->HasMBLayout() ? " x *" : "");
-            node->m_visited = true;
-            // also take the opportunity to propagate m_needsGradient
-            auto needsGradient = node->m_needsGradient;
-            for (auto& child : children) // TODO: do we need a check that this is stable if isFinalValidationPass?
-                node->m_needsGradient |= child->m_needsGradient;
-            // check state --node will be valid if all nodes have been visited and node has not been updated
-            bool unchanged = true;
-            unchanged &= (oldMBLayoutPtr == node->GetMBLayout());
-            unchanged &= (dim == GetDims(node));
-            vector<pair<TensorShape, bool>> newChildDims;
-            for (auto& child : children)
-                newChildDims.push_back(GetDims(child));
-            unchanged &= (childDims == newChildDims);
-            unchanged &= (sampleLayout == node->GetSampleLayout());
-            unchanged &= (needsGradient == node->m_needsGradient);
-            if (isFinalValidationPass && !unchanged)
-                LogicError("ValidateSubNetwork: %ls %ls operation changed during final validation.", node->NodeName().c_str(), node->OperationName().c_str());
-            if (isFinalValidationPass && !allChildrenVisited)
-                LogicError("ValidateSubNetwork: %ls %ls operation in final validation although not all children were visited?", node->NodeName().c_str(), node->OperationName().c_str());
-            // if all children valid then
-            valid = (allChildrenVisited && unchanged) || isLeaf;
-        }
         // count those that we need to redo
-        if (!valid)
+        if (!ValidateNode(node, isFinalValidationPass, changedNodes))
             todo++;
     }
 }
 
+// validate a single node; returns whether it is valid, i.e. all its inputs had been visited and Validate() changed nothing
+// Appended to 'changedNodes' are the node if it was visited for the first time or changed, and the inputs whose dimensions it changed (inferred).
+bool ComputationNetwork::ValidateNode(const ComputationNodeBasePtr& node, bool isFinalValidationPass, vector<ComputationNodeBasePtr>& changedNodes)
+{
+    const auto& children = node->GetInputs();
+    const bool isLeaf = node->IsLeaf();
+    // only validate a node if it has at least one child
+    bool hasVisitedChild = false;
+    bool allChildrenVisited = true;
+    for (auto& child : children)
+    {
+        hasVisitedChild |= child->m_visited; // if not a single visited child then no point in validating
+        allChildrenVisited &= child->m_visited;
+    }
+    // if there is not at least one visited child
+    if (!hasVisitedChild && !isLeaf)
+        return false;
+
+    // got at least one child: it makes sense to call Validate()
+    // keep state
+    MBLayoutPtr oldMBLayoutPtr = node->GetMBLayout();
+    auto dim = GetDims(node);
+    vector<pair<TensorShape, bool>> childDims;
+    for (auto& child : children)
+        childDims.push_back(GetDims(child));
+    auto sampleLayout = node->GetSampleLayout();
+    const bool wasVisited = node->m_visited;
+    // We do call validate(final) as many times as needed, since stuff may have changed underneath.
+    node->PrintSelfBeforeValidation();
+    node->Validate(isFinalValidationPass /*final*/); // all nodes have been visited: do verification instead of just inference
+    fprintf(stderr, " -> [%s%s]", string(node->GetSampleLayout()).c_str(), node->HasMBLayout() ? " x *" : "");
+    node->m_visited = true;
+    // also take the opportunity to propagate m_needsGradient
+    auto needsGradient = node->m_needsGradient;
+    for (auto& child : children) // TODO: do we need a check that this is stable if isFinalValidationPass?
+        node->m_needsGradient |= child->m_needsGradient;
+    // check state --node will be valid if all nodes have been visited and node has not been updated
+    bool unchanged = true;
+    unchanged &= (oldMBLayoutPtr == node->GetMBLayout());
+    unchanged &= (dim == GetDims(node));
+    unchanged &= (sampleLayout == node->GetSampleLayout());
+    unchanged &= (needsGradient == node->m_needsGradient);
+    if (!unchanged || !wasVisited)
+        changedNodes.push_back(node);
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        if (childDims[i] != GetDims(children[i]))
+        {
+            unchanged = false;
+            changedNodes.push_back(children[i]);
+        }
+    }
+    if (isFinalValidationPass && !unchanged)
+        LogicError("ValidateSubNetwork: %ls %ls operation changed during final validation.", node->NodeName().c_str(), node->OperationName().c_str());
+    if (isFinalValidationPass && !allChildrenVisited)
+        LogicError("ValidateSubNetwork: %ls %ls operation in final validation although not all children were visited?", node->NodeName().c_str(), node->OperationName().c_str());
+    // if all children valid then
+    return (allChildrenVisited && unchanged) || isLeaf;
+}
+
 // -----------------------------------------------------------------------
 // memory allocation
 // -----------------------------------------------------------------------
@@ -685,7 +1705,8 @@ void ComputationNetwork::MarkValueNonSharableNodes()
                 }
             }
             allLeafDescendentsAreParameters[myname] = allParameters;
-            if (allParameters)
+            // a precomputed value is computed once and must survive all minibatches, even if no backprop reads it
+            if (allParameters || node->RequiresPreCompute())
             {
                 node->MarkValueNonSharable();
             }
@@ -709,6 +1730,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
     fprintf(stderr, "\n\nAllocating matrices for forward and/or backward propagation.\n");
 
     VerifyIsCompiled("AllocateAllMatrices");
+    InvalidateConcurrentStages();
 
     // Due to special topology, if a node is solely induced by parameters, its function value should not be shared
     MarkValueNonSharableNodes();
@@ -736,12 +1758,21 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                 ComputationNodeBasePtr pNode = currentNode->GetInputs()[i];
                 parentsMap[pNode].insert(currentNode);
 
+                // an absorbed input is computed by its consumer, which therefore reads the absorbed node's inputs as well
+                if (pNode->IsAbsorbedIntoConsumer())
+                {
+                    for (auto& absorbedInput : pNode->GetInputs())
+                        parentsMap[absorbedInput].insert(currentNode);
+                }
+
+                // Values are only read by a Backprop() that computes something, i.e. of a node that needs a gradient; below frozen
+                // parameters, no value needs to be kept.
                 if (performingBackPropagation)
                 {
                     if (outputValueNeededDuringBackProp.find(pNode) == outputValueNeededDuringBackProp.end())
-                        outputValueNeededDuringBackProp[pNode] = pNode->OutputUsedInComputingInputNodesGradients();
+                        outputValueNeededDuringBackProp[pNode] = pNode->NeedGradient() && pNode->OutputUsedInComputingInputNodesGradients();
 
-                    outputValueNeededDuringBackProp[pNode] |= currentNode->InputUsedInComputingInputNodesGradients(i);
+                    outputValueNeededDuringBackProp[pNode] |= currentNode->NeedGradient() && currentNode->InputUsedInComputingInputNodesGradients(i);
                 }
                 else
                 {
@@ -771,6 +1802,15 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
+    // gradient checkpointing: decide which of the requested recomputations we can honor; this changes what needs to be kept for backprop
+    if (performingBackPropagation)
+        DetermineRecomputeNodes(compositeForwardPropEvalOrder, forwardPropRoots, outputValueNeededDuringBackProp);
+    // half-precision storage likewise; a node whose value must survive for a recomputation may be stored in half as well
+    if (performingBackPropagation)
+        DetermineHalfPrecisionNodes(compositeForwardPropEvalOrder, forwardPropRoots, outputValueNeededDuringBackProp);
+    // in-place buffers, which depend on all of the above
+    ShareBuffersWithConsumers(compositeForwardPropEvalOrder, outputValueNeededDuringBackProp, performingBackPropagation);
+
     set<ComputationNodeBasePtr> completedEvaluate;
     for (auto& nodeIter : compositeForwardPropEvalOrder)
     {
@@ -783,7 +1823,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
             assert(recInfo != nullptr);
             if (completedEvaluate.insert(recInfo).second)
             {
-                recInfo->RequestMatricesBeforeForwardProp(m_matrixPool);
+                recInfo->RequestMatricesBeforeForwardProp(*m_matrixPool);
 
                 for (auto& nodeLoopIter : recInfo->m_nestedNodes)
                 {
@@ -793,7 +1833,9 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
         else
         {
-            nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
+            nodeIter->RequestMatricesBeforeForwardProp(*m_matrixPool);
+            if (nodeIter->m_valueStoredInHalf) // the packed value lives from here until backprop expands it
+                nodeIter->RequestMatricesForHalfStorage(*m_matrixPool);
             // we only release matrices for the children since the root node's informatioin will be used and should not be shared
             // with others
             ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
@@ -803,12 +1845,19 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
     if (trainRootNode != nullptr)
     {
         std::list<ComputationNodeBasePtr>& backPropNodes = GetEvalOrder(trainRootNode);
+        if (m_traceLevel > 0)
+        {
+            const size_t numNodesNeedingGradient = count_if(backPropNodes.begin(), backPropNodes.end(), [](const ComputationNodeBasePtr& node) { return node->NeedGradient(); });
+            fprintf(stderr, "Backprop: %d of the %d nodes of %ls need a gradient; the others only depend on inputs and frozen parameters, and are skipped.\n",
+                    (int) numNodesNeedingGradient, (int) backPropNodes.size(), trainRootNode->NodeName().c_str());
+        }
 
         // now, simulate the gradient computation order to determine how to allocate matrices
         set<ComputationNodeBasePtr> completedGradient;
+        set<ComputationNodeBasePtr> recomputedNodes; // nodes whose recompute buffer is currently live
 
         // we need to call it here since we always compute gradients for children and root node is not children of other node
-        trainRootNode->RequestMatricesBeforeBackprop(m_matrixPool);
+        trainRootNode->RequestMatricesBeforeBackprop(*m_matrixPool);
 
         for (auto iter = backPropNodes.rbegin(); iter != backPropNodes.rend(); iter++) // for gradient computation, traverse in reverse order
         {
@@ -819,24 +1868,393 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                 shared_ptr<SEQTraversalFlowControlNode> recInfo = FindInRecurrentLoops(m_allSEQNodes, n);
                 if (completedGradient.insert(recInfo).second)
                 {
+                    // this mirrors PARTraversalFlowControlNode::Backprop()
+                    for (auto& nodeLoopIter : recInfo->m_nestedNodes)
+                    {
+                        if (!nodeLoopIter->NeedGradient())
+                            continue;
+                        RequestMatricesForRecomputeRec(nodeLoopIter, recomputedNodes);
+                        for (auto& input : nodeLoopIter->GetInputs())
+                            RequestMatricesForRecomputeRec(input, recomputedNodes);
+                    }
+
                     // SEQ mode: allocate all in loop first, then deallocate again
                     // TODO: next step: use PARTraversalFlowControlNode::AllocateGradientMatricesForInputs() and ReleaseMatricesAfterBackprop()...
                     // BUGBUG: naw, ^^ would not work! Wrong order! Need to rethink this. Need to make AllocateEvalMatrices() and AllocateGradientMatrices() the virtual functions.
-                    recInfo->AllocateGradientMatricesForInputs(m_matrixPool);
+                    recInfo->AllocateGradientMatricesForInputs(*m_matrixPool);
                     // Loops are computed sample by sample so we have to allocate them all
-                    recInfo->ReleaseMatricesAfterBackprop(m_matrixPool);
+                    recInfo->ReleaseMatricesAfterBackprop(*m_matrixPool);
+
+                    for (auto& nodeLoopIter : recInfo->m_nestedNodes)
+                    {
+                        if (recomputedNodes.erase(nodeLoopIter) > 0)
+                            nodeLoopIter->ReleaseMatricesAfterRecompute(*m_matrixPool);
+                    }
                 }
             }
             else
             {
+                // this mirrors PARTraversalFlowControlNode::Backprop()
+                if (n->NeedGradient())
+                {
+                    RequestMatricesForRecomputeRec(n, recomputedNodes);
+                    for (auto& input : n->GetInputs())
+                        RequestMatricesForRecomputeRec(input, recomputedNodes);
+                }
+
                 // PAR mode: we can allocate and immediately deallocate one by one
-                n->AllocateGradientMatricesForInputs(m_matrixPool);
+                n->AllocateGradientMatricesForInputs(*m_matrixPool);
+                // a fused node propagates into the inputs of its absorbed input right away, so those gradients must exist before ours is released
+                for (auto& input : n->GetInputs())
+                {
+                    if (input->IsAbsorbedIntoConsumer())
+                        input->AllocateGradientMatricesForInputs(*m_matrixPool);
+                }
                 // Root node's information will be used and should not be shared with others, also it's small (1x1)
                 if ((n != trainRootNode) && n->NeedGradient())
-                    n->ReleaseMatricesAfterBackprop(m_matrixPool);
+                    n->ReleaseMatricesAfterBackprop(*m_matrixPool);
+
+                if (recomputedNodes.erase(n) > 0)
+                    n->ReleaseMatricesAfterRecompute(*m_matrixPool);
             }
         }
     }
+
+    // report the plan. Sizes are in elements per sample for nodes with an MBLayout (multiply by the number of parallel
+    // sequences x time steps to get the actual footprint), and in total elements for the fixed-size ones.
+    if (m_traceLevel > 0)
+    {
+        for (bool perColumn : {true, false})
+        {
+            if (m_matrixPool->GetNumRequests(perColumn) == 0)
+                continue;
+            fprintf(stderr, "Memory sharing plan (%ls): %d matrix requests served by %d shared matrices; planned %.2f M elements (peak live %.2f M, %.2f M without sharing).\n",
+                    perColumn ? L"per sample" : L"fixed size", (int) m_matrixPool->GetNumRequests(perColumn), (int) m_matrixPool->GetNumMatrices(perColumn),
+                    m_matrixPool->GetPlannedElements(perColumn) / 1e6, m_matrixPool->GetPeakLiveElements(perColumn) / 1e6, m_matrixPool->GetUnsharedElements(perColumn) / 1e6);
+        }
+    }
+}
+
+size_t ComputationNetwork::EstimateDeviceMemory(DEVICEID_TYPE deviceId, size_t numParallelSequences, size_t numTimeSteps) const
+{
+    const size_t numColumns = numParallelSequences * numTimeSteps;
+    size_t perColumnBytes = 0, fixedBytes = 0;
+    for (const auto& iter : m_nameToNodeMap)
+        iter.second->EstimateUnsharedMatrixBytes(*m_matrixPool, perColumnBytes, fixedBytes);
+    return m_matrixPool->EstimateBytes(deviceId, numColumns) + perColumnBytes * numColumns + fixedBytes;
+}
+
+size_t ComputationNetwork::GetAllocatedDeviceMemory(DEVICEID_TYPE deviceId) const
+{
+    std::map<const void*, size_t> matrixBytes;
+    for (const auto& iter : m_nameToNodeMap)
+        iter.second->CollectAllocatedMatrixBytes(deviceId, matrixBytes);
+    size_t bytes = 0;
+    for (const auto& matrix : matrixBytes)
+        bytes += matrix.second;
+    return bytes;
+}
+
+// decide for which nodes gradient checkpointing is in effect, and update which values must be kept for backprop accordingly
+// A request is only honored for nodes whose value would otherwise be kept for backprop, and which can be recomputed without side
+// effects (recomputing a dropout mask or updating batch-norm statistics a second time would change results). A request for
+// a node of a recurrent loop applies to the whole loop, which must meet the same conditions in all of its nodes.
+void ComputationNetwork::DetermineRecomputeNodes(const std::vector<ComputationNodeBasePtr>& compositeForwardPropEvalOrder, const std::vector<ComputationNodeBasePtr>& forwardPropRoots,
+                                                 std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp)
+{
+    auto whyNotRecompute = [&](const ComputationNodeBasePtr& node) -> const char*
+    {
+        if (!g_shareNodeValueMatrices)
+            return "shareNodeValueMatrices is not enabled";
+        else if (node->IsLeaf() || node->RequiresPreCompute() || !node->IsValueSharable())
+            return "its value is not shared";
+        else if (std::find(forwardPropRoots.begin(), forwardPropRoots.end(), node) != forwardPropRoots.end())
+            return "it is a criterion, evaluation or output node";
+        else if (node->OperationName() == OperationNameOf(DropoutNode) || node->OperationName() == OperationNameOf(BatchNormalizationNode))
+            return "recomputing it would not reproduce the same value";
+        return nullptr;
+    };
+
+    size_t numRecomputeNodes = 0;
+    set<shared_ptr<SEQTraversalFlowControlNode>> loopsDone;
+    for (auto& node : compositeForwardPropEvalOrder)
+        node->m_recomputeDuringBackprop = false;
+    for (auto& node : compositeForwardPropEvalOrder)
+    {
+        if (!node->IsRecompute())
+            continue;
+
+        if (node->IsPartOfLoop())
+        {
+            const auto loop = FindInRecurrentLoops(m_allSEQNodes, node);
+            if (!loopsDone.insert(loop).second)
+                continue;
+            bool anyValueNeeded = false;
+            for (auto& nestedNode : loop->m_nestedNodes)
+            {
+                const char* reason = whyNotRecompute(nestedNode);
+                if (reason)
+                {
+                    fprintf(stderr, "WARNING: Ignoring recompute request for %ls %ls operation because of the %ls %ls operation in its recurrent loop: %s.\n",
+                            node->NodeName().c_str(), node->OperationName().c_str(), nestedNode->NodeName().c_str(), nestedNode->OperationName().c_str(), reason);
+                    anyValueNeeded = false;
+                    break;
+                }
+                anyValueNeeded = anyValueNeeded || outputValueNeededDuringBackProp[nestedNode];
+            }
+            if (!anyValueNeeded)
+                continue; // (or released after forward prop anyway)
+
+            // the loop is run again into the recompute buffers of all of its nodes, including those that are not needed for backprop
+            // (but not of fused ones, which have no value of their own)
+            for (auto& nestedNode : loop->m_nestedNodes)
+            {
+                if (nestedNode->IsAbsorbedIntoConsumer())
+                    continue;
+                nestedNode->m_recomputeDuringBackprop = true;
+                outputValueNeededDuringBackProp[nestedNode] = false;
+                numRecomputeNodes++;
+            }
+            continue;
+        }
+
+        const char* reason = whyNotRecompute(node);
+        if (reason)
+        {
+            fprintf(stderr, "WARNING: Ignoring recompute request for %ls %ls operation because %s.\n", node->NodeName().c_str(), node->OperationName().c_str(), reason);
+            continue;
+        }
+        if (!outputValueNeededDuringBackProp[node])
+            continue; // released after forward prop anyway
+
+        node->m_recomputeDuringBackprop = true;
+        outputValueNeededDuringBackProp[node] = false;
+        numRecomputeNodes++;
+    }
+
+    // the inputs of recomputed nodes must survive until the recomputation, unless they are recomputed themselves
+    for (auto& node : compositeForwardPropEvalOrder)
+    {
+        if (!node->m_recomputeDuringBackprop)
+            continue;
+        for (auto& input : node->GetInputs())
+        {
+            if (!input->m_recomputeDuringBackprop)
+                outputValueNeededDuringBackProp[input] = true;
+        }
+    }
+
+    if (numRecomputeNodes > 0 && m_traceLevel > 0)
+        fprintf(stderr, "Gradient checkpointing: %d node values will be recomputed during backprop instead of being kept.\n", (int) numRecomputeNodes);
+}
+
+// decide for which nodes half-precision storage is in effect, and update which values must be kept for backprop accordingly
+// The same restrictions as for recomputation apply, except that any node can be stored (the conversion has no side effects).
+// The value of an input of an absorbed node is read by the absorbing consumer, which RecomputeValuesNeededForBackprop()
+// does not know about, so it is kept as is.
+void ComputationNetwork::DetermineHalfPrecisionNodes(const std::vector<ComputationNodeBasePtr>& compositeForwardPropEvalOrder, const std::vector<ComputationNodeBasePtr>& forwardPropRoots,
+                                                     std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp)
+{
+    std::set<ComputationNodeBasePtr> readByAbsorbingConsumer;
+    for (auto& node : compositeForwardPropEvalOrder)
+    {
+        if (node->IsAbsorbedIntoConsumer())
+            readByAbsorbingConsumer.insert(node->GetInputs().begin(), node->GetInputs().end());
+    }
+
+    size_t numHalfNodes = 0;
+    for (auto& node : compositeForwardPropEvalOrder)
+    {
+        node->m_valueStoredInHalf = false;
+        if (!node->IsStoreValueInHalf())
+            continue;
+
+        const char* reason = nullptr;
+        if (!g_shareNodeValueMatrices)
+            reason = "shareNodeValueMatrices is not enabled";
+        else if (node->IsPartOfLoop())
+            reason = "it is part of a recurrent loop";
+        else if (node->IsLeaf() || node->RequiresPreCompute() || !node->IsValueSharable())
+            reason = "its value is not shared";
+        else if (std::find(forwardPropRoots.begin(), forwardPropRoots.end(), node) != forwardPropRoots.end())
+            reason = "it is a criterion, evaluation or output node";
+        else if (node->IsAbsorbedIntoConsumer() || readByAbsorbingConsumer.find(node) != readByAbsorbingConsumer.end())
+            reason = "it is part of a fused operation";
+        if (reason)
+        {
+            fprintf(stderr, "WARNING: Ignoring half-precision storage request for %ls %ls operation because %s.\n", node->NodeName().c_str(), node->OperationName().c_str(), reason);
+            continue;
+        }
+        if (node->m_recomputeDuringBackprop || !outputValueNeededDuringBackProp[node])
+            continue; // not kept for backprop anyway
+
+        node->m_valueStoredInHalf = true;
+        outputValueNeededDuringBackProp[node] = false;
+        numHalfNodes++;
+    }
+
+    if (numHalfNodes > 0)
+        fprintf(stderr, "Half-precision storage: %d node values will be kept for backprop in 16 bits.\n", (int) numHalfNodes);
+}
+
+// decide which nodes use the buffer of a neighbor instead of one from the matrix pool
+//  - gradients: the gradient of a consumer w.r.t. an input of Plus (either), Minus (the minuend), or Reshape is the consumer's
+//    gradient itself. If the input has no other consumer, it can use that gradient as its own; nothing is propagated into it,
+//    and the lazy zeroing and copy are saved. At most one input per consumer, since the others still accumulate into their own.
+//  - values computed in place: an elementwise map whose backprop needs only its output (Sigmoid, Tanh, RectifiedLinear, etc.)
+//    can compute its value into its input's buffer if nothing else reads that input, neither in forward prop nor for backprop.
+//  - values as views: Reshape's value is its input's with other dimensions, so it can use the input's buffer and skip the copy.
+//    The buffer must live as long as either needs it: if the input keeps its value for backprop anyway, or never releases it
+//    (parameters, features), it stays the input's; if the Reshape is the input's only consumer, the Reshape takes it over;
+//    otherwise there is no view.
+// Either pair must be outside of loops (a time step reads other steps' values and gradients), and have the same number of
+// elements per sample (no broadcasting). Row slices and row stacks cannot share: in column-major storage, a block of rows
+// is not a matrix view.
+// This may be called again for another set of roots (e.g. cross validation on the training network). The buffers of the
+// earlier plan persist, so a pair is only newly shared when the consumer has no buffer yet; a pair that shares already stays so.
+void ComputationNetwork::ShareBuffersWithConsumers(const std::vector<ComputationNodeBasePtr>& compositeForwardPropEvalOrder, const std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp,
+                                                   bool performingBackPropagation)
+{
+    for (auto& node : compositeForwardPropEvalOrder)
+    {
+        node->m_valueSharedWithInput = false;
+        node->m_valueTakenOverByConsumer = false;
+        if (performingBackPropagation) // (otherwise the gradients of the training plan stay as they are)
+        {
+            node->m_gradientSharedWithConsumer = false;
+            node->m_gradientSharedWithInput = false;
+        }
+    }
+
+    if (!m_options.m_shareBuffersInPlace)
+        return;
+
+    // count uses of each node as an input, over the entire network
+    map<ComputationNodeBasePtr, size_t> numUses;
+    for (auto& node : GetEvalOrder(nullptr))
+        for (auto& input : node->GetInputs())
+            numUses[input]++;
+
+    set<ComputationNodeBasePtr> roots(m_allRoots.begin(), m_allRoots.end());
+
+    // can 'node' and its 'input' share a buffer at all?
+    auto isCompatiblePair = [&](const ComputationNodeBasePtr& node, const ComputationNodeBasePtr& input)
+    {
+        return !node->IsAbsorbedIntoConsumer() && !input->IsAbsorbedIntoConsumer() && !node->IsPartOfLoop() && !input->IsPartOfLoop() &&
+               input->HasMBLayout() && input->GetMBLayout() == node->GetMBLayout() &&
+               input->GetSampleLayout().GetNumElements() == node->GetSampleLayout().GetNumElements();
+    };
+    // is 'input' read by nobody but 'node'?
+    auto isOnlyUse = [&](const ComputationNodeBasePtr& input)
+    {
+        return numUses[input] == 1 && roots.find(input) == roots.end() && !input->IsLeaf() && !input->RequiresPreCompute();
+    };
+    // the node that releases the value buffer of 'node' (earlier nodes are decided already)
+    auto valueBufferOwner = [](ComputationNodeBasePtr node)
+    {
+        while (node->m_valueSharedWithInput && !node->Input(0)->m_valueTakenOverByConsumer)
+            node = node->Input(0);
+        return node;
+    };
+    auto isValueKept = [&](const ComputationNodeBasePtr& node)
+    {
+        return !g_shareNodeValueMatrices || outputValueNeededDuringBackProp.at(node);
+    };
+
+    size_t numSharedGradients = 0;
+    size_t numSharedValues = 0;
+    for (auto& node : compositeForwardPropEvalOrder)
+    {
+        if (performingBackPropagation && node->NeedGradient())
+        {
+            for (size_t i = 0; i < node->GetNumInputs(); i++)
+            {
+                auto input = node->Input(i);
+                if (!input->NeedGradient() || !node->CanShareGradientWithInput(i) || !isCompatiblePair(node, input) || !isOnlyUse(input))
+                    continue;
+                if (input->GradientMatrixId() != node->GradientMatrixId()) // (both nullptr if new)
+                    continue;
+                input->m_gradientSharedWithConsumer = true;
+                node->m_gradientSharedWithInput = true;
+                numSharedGradients++;
+                break;
+            }
+        }
+
+        if (node->GetNumInputs() != 1 || !node->IsValueSharable() || node->m_recomputeDuringBackprop || node->m_valueStoredInHalf)
+            continue;
+        auto input = node->Input(0);
+        if (!isCompatiblePair(node, input) || input->m_recomputeDuringBackprop || input->m_valueStoredInHalf ||
+            (node->ValueMatrixId() != nullptr && node->ValueMatrixId() != input->ValueMatrixId()))
+            continue;
+        if (node->CanComputeValueInPlace())
+        {
+            if (g_shareNodeValueMatrices && isOnlyUse(input) && input->IsValueSharable() && !isValueKept(input) && valueBufferOwner(input) == input)
+            {
+                node->m_valueSharedWithInput = true;
+                input->m_valueTakenOverByConsumer = true;
+                numSharedValues++;
+            }
+        }
+        else if (node->IsValueViewOfInput())
+        {
+            auto owner = valueBufferOwner(input);
+            if (!owner->IsValueSharable() || isValueKept(owner)) // (the owner is upstream, so it keeps it until after our backprop)
+                node->m_valueSharedWithInput = true;
+            else if (owner == input && isOnlyUse(input))
+            {
+                node->m_valueSharedWithInput = true;
+                input->m_valueTakenOverByConsumer = true;
+            }
+            numSharedValues += node->m_valueSharedWithInput;
+        }
+    }
+
+    if (numSharedGradients + numSharedValues > 0)
+        fprintf(stderr, "ShareBuffersWithConsumers: %d gradients shared with consumers, %d values computed in place or as views.\n", (int) numSharedGradients, (int) numSharedValues);
+}
+
+// simulation of RecomputeValueForBackprop()
+void ComputationNetwork::RequestMatricesForRecomputeRec(const ComputationNodeBasePtr& node, std::set<ComputationNodeBasePtr>& recomputedNodes)
+{
+    if (recomputedNodes.find(node) != recomputedNodes.end())
+        return;
+    if (node->m_valueStoredInHalf)
+    {
+        node->RequestMatricesForRecompute(*m_matrixPool);
+        node->ReleaseMatricesForHalfStorage(*m_matrixPool);
+        recomputedNodes.insert(node);
+        return;
+    }
+    if (!node->m_recomputeDuringBackprop)
+        return;
+
+    if (node->IsPartOfLoop())
+    {
+        const auto loop = FindInRecurrentLoops(m_allSEQNodes, node);
+        for (const auto& nestedNode : loop->m_nestedNodes)
+        {
+            for (const auto& input : nestedNode->GetInputs())
+            {
+                if (std::find(loop->m_nestedNodes.begin(), loop->m_nestedNodes.end(), input) == loop->m_nestedNodes.end())
+                    RequestMatricesForRecomputeRec(input, recomputedNodes);
+            }
+        }
+        for (const auto& nestedNode : loop->m_nestedNodes)
+        {
+            if (!nestedNode->m_recomputeDuringBackprop)
+                continue;
+            nestedNode->RequestMatricesForRecompute(*m_matrixPool);
+            recomputedNodes.insert(nestedNode);
+        }
+        return;
+    }
+
+    for (const auto& input : node->GetInputs())
+        RequestMatricesForRecomputeRec(input, recomputedNodes);
+
+    node->RequestMatricesForRecompute(*m_matrixPool);
+    recomputedNodes.insert(node);
 }
 
 void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount)
@@ -846,7 +2264,18 @@ void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBase
         ComputationNodeBasePtr pNode = n->GetInputs()[i];
         parentCount[pNode]--;
         if (parentCount[pNode] == 0)
-            pNode->ReleaseMatricesAfterForwardProp(m_matrixPool);
+            pNode->ReleaseMatricesAfterForwardProp(*m_matrixPool);
+
+        // we also consumed the inputs of an absorbed input (see AllocateAllMatrices())
+        if (pNode->IsAbsorbedIntoConsumer())
+        {
+            for (auto& absorbedInput : pNode->GetInputs())
+            {
+                parentCount[absorbedInput]--;
+                if (parentCount[absorbedInput] == 0)
+                    absorbedInput->ReleaseMatricesAfterForwardProp(*m_matrixPool);
+            }
+        }
     }
 }
 } } }
@@ -0,0 +1,397 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "ComputationNetwork.h"
+#include "InputAndParamNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "NonlinearityNodes.h"
+#include "ReshapingNodes.h"
+#include "PreComputeNodes.h"
+#include "TrainingNodes.h"
+#include "InferenceModelFormat.h"
+#include "fileutil.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// This source file contains the export of networks for the inference runtime (see InferenceRuntime.h).
+
+namespace IMF = InferenceModelFormat;
+
+// write the forward computation of 'outputNodes' (default: the output nodes) in the format of InferenceModelFormat.h
+//  - Only the nodes that the outputs depend on are exported; there are no gradients, and criterion nodes are not exported
+//    unless requested. Dropout and Reshapes that keep the sample dimension are the identity and are dropped.
+//  - Subgraphs that depend on parameters only are evaluated here and exported as constants (constant folding).
+//  - Each remaining node becomes one operation, which must be one of those the runtime implements; recurrent networks and
+//    sparse inputs are not supported. Call OptimizeForInference() before, to fold normalizations into weights.
+//  - Activation memory is planned here: the operations run in evaluation order, and an activation's rows in the arena are
+//    reused once its last reader has run. The outputs are kept to the end.
+// Values are exported as float also from a double network. The file is written tensor by tensor, without a copy of the
+// model in memory.
+template <class ElemType>
+void ComputationNetwork::ExportForInference(const std::wstring& fileName, const std::vector<ComputationNodeBasePtr>& outputNodes)
+{
+    VerifyIsCompiled("ExportForInference");
+    const vector<ComputationNodeBasePtr> outputs = outputNodes.empty() ? OutputNodes() : outputNodes;
+    if (outputs.empty())
+        InvalidArgument("ExportForInference: The network has no output nodes, and none were given.");
+
+    // the nodes the outputs depend on, in evaluation order
+    set<ComputationNodeBasePtr> needed;
+    vector<ComputationNodeBasePtr> stack(outputs.begin(), outputs.end());
+    while (!stack.empty())
+    {
+        auto node = stack.back();
+        stack.pop_back();
+        if (!needed.insert(node).second)
+            continue;
+        for (const auto& input : node->GetInputs())
+            stack.push_back(input);
+    }
+    vector<ComputationNodeBasePtr> nodes;
+    for (const auto& node : GetEvalOrder(nullptr))
+    {
+        if (needed.find(node) != needed.end())
+            nodes.push_back(node);
+    }
+
+    // determine the constants, and evaluate those that are computed from other constants
+    set<ComputationNodeBasePtr> constants;
+    vector<ComputationNodeBasePtr> foldedNodes;
+    for (const auto& node : nodes)
+    {
+        if (node->OperationName() == OperationNameOf(LearnableParameter))
+            constants.insert(node);
+        else if (dynamic_pointer_cast<IPreComputeNode>(node))
+        {
+            if (!dynamic_pointer_cast<IPreComputeNode>(node)->HasComputed())
+                InvalidArgument("ExportForInference: %ls %ls operation has not been precomputed.", node->NodeName().c_str(), node->OperationName().c_str());
+            constants.insert(node);
+        }
+        else if (node->GetNumInputs() > 0 && !node->HasMBLayout())
+        {
+            bool allInputsConstant = true;
+            for (const auto& input : node->GetInputs())
+                allInputsConstant &= constants.find(input) != constants.end();
+            if (allInputsConstant)
+            {
+                constants.insert(node);
+                foldedNodes.push_back(node);
+            }
+        }
+    }
+    if (!foldedNodes.empty())
+    {
+        AllocateAllMatrices({}, outputs, nullptr);
+        for (const auto& node : foldedNodes) // (in evaluation order)
+        {
+            node->BeginForwardProp();
+            node->ForwardProp(FrameRange(nullptr));
+            node->EndForwardProp();
+            node->BumpEvalTimeStamp();
+        }
+    }
+
+    // translate the nodes into tensors and operations
+    vector<IMF::Tensor> tensors;
+    vector<IMF::Operation> operations;
+    vector<ComputationNodeBasePtr> constantNodes; // [tensor id] for constants
+    string names;
+    map<ComputationNodeBasePtr, uint32_t> tensorOf;
+    auto addName = [&names](const wstring& name) -> uint32_t
+    {
+        const uint32_t offset = (uint32_t) names.size();
+        names += msra::strfun::utf8(name);
+        names.push_back('\0');
+        return offset;
+    };
+    auto addTensor = [&](const ComputationNodeBasePtr& node, IMF::TensorKind kind, size_t rows, size_t cols) -> uint32_t
+    {
+        IMF::Tensor tensor;
+        tensor.kind = kind;
+        tensor.nameOffset = addName(node->NodeName());
+        tensor.rows = rows;
+        tensor.cols = cols;
+        tensor.offset = 0; // (set below)
+        tensors.push_back(tensor);
+        constantNodes.push_back(kind == IMF::constantTensor ? node : nullptr);
+        return (uint32_t) (tensors.size() - 1);
+    };
+    auto fail = [](const ComputationNodeBasePtr& node, const char* why)
+    {
+        InvalidArgument("ExportForInference: %ls %ls operation cannot be exported: %s", node->NodeName().c_str(), node->OperationName().c_str(), why);
+    };
+    // the tensor of an input of an operation; constants become tensors when they are first used
+    auto tensorOfInput = [&](const ComputationNodeBasePtr& node, size_t i) -> uint32_t
+    {
+        const auto& input = node->Input(i);
+        auto iter = tensorOf.find(input);
+        if (iter != tensorOf.end())
+            return iter->second;
+        const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(input)->Value();
+        if (value.GetMatrixType() != MatrixType::DENSE)
+            fail(input, "Sparse constants are not supported.");
+        return tensorOf[input] = addTensor(input, IMF::constantTensor, value.GetNumRows(), value.GetNumCols());
+    };
+    auto isConstant = [&](const ComputationNodeBasePtr& node, size_t i)
+    {
+        return constants.find(node->Input(i)) != constants.end();
+    };
+    auto numElementsOfInput = [&](const ComputationNodeBasePtr& node, size_t i) -> size_t
+    {
+        return isConstant(node, i) ? dynamic_pointer_cast<ComputationNode<ElemType>>(node->Input(i))->Value().GetNumElements() : node->Input(i)->GetSampleMatrixNumRows();
+    };
+
+    static const map<wstring, IMF::OpCode> unaryOpCodes = {
+        {OperationNameOf(SigmoidNode), IMF::opSigmoid},
+        {OperationNameOf(TanhNode), IMF::opTanh},
+        {OperationNameOf(RectifiedLinearNode), IMF::opRectifiedLinear},
+        {OperationNameOf(ExpNode), IMF::opExp},
+        {OperationNameOf(LogNode), IMF::opLog},
+        {OperationNameOf(SoftmaxNode), IMF::opSoftmax},
+        {OperationNameOf(LogSoftmaxNode), IMF::opLogSoftmax}};
+    static const map<wstring, IMF::OpCode> binaryOpCodes = {
+        {OperationNameOf(PlusNode), IMF::opPlus},
+        {OperationNameOf(MinusNode), IMF::opMinus},
+        {OperationNameOf(ElementTimesNode), IMF::opElementTimes}};
+
+    for (const auto& node : nodes)
+    {
+        if (constants.find(node) != constants.end())
+            continue;
+        const wstring& opName = node->OperationName();
+        const size_t rows = node->GetSampleMatrixNumRows();
+
+        if (opName == OperationNameOf(InputValue))
+        {
+            tensorOf[node] = addTensor(node, IMF::inputTensor, rows, 0);
+            continue;
+        }
+        if (opName == OperationNameOf(SparseInputValue))
+            fail(node, "Sparse inputs are not supported.");
+        if (opName == OperationNameOf(DropoutNode) || opName == OperationNameOf(ReshapeNode))
+        {
+            if (node->Input(0)->GetSampleMatrixNumRows() != rows)
+                fail(node, "Reshaping across samples is not supported.");
+            tensorOf[node] = tensorOfInput(node, 0);
+            continue;
+        }
+        if (!node->HasMBLayout())
+            fail(node, "Nodes without a minibatch layout must depend on constants only.");
+
+        IMF::Operation op;
+        op.numInputs = (uint32_t) node->GetNumInputs();
+        for (uint32_t i = 0; i < IMF::maxOperationInputs; i++)
+            op.inputs[i] = 0;
+        if (op.numInputs > IMF::maxOperationInputs)
+            fail(node, "The operation is not supported by the inference runtime.");
+
+        auto unary = unaryOpCodes.find(opName);
+        auto binary = binaryOpCodes.find(opName);
+        if (unary != unaryOpCodes.end())
+        {
+            op.opCode = unary->second;
+            if (isConstant(node, 0))
+                fail(node, "The input must not be a constant.");
+        }
+        else if (binary != binaryOpCodes.end())
+        {
+            op.opCode = binary->second;
+            for (size_t i = 0; i < 2; i++)
+            {
+                const size_t n = numElementsOfInput(node, i);
+                if (n != rows && !(isConstant(node, i) && n == 1))
+                    fail(node, "Only broadcasting of a constant column or a single element over samples is supported.");
+            }
+        }
+        else if (opName == OperationNameOf(TimesNode))
+        {
+            op.opCode = IMF::opTimes;
+            if (!isConstant(node, 0) || isConstant(node, 1))
+                fail(node, "Only a product of a constant matrix and an activation is supported.");
+            const size_t inner = node->Input(1)->GetSampleMatrixNumRows();
+            if (numElementsOfInput(node, 0) != rows * inner)
+                fail(node, "The weight matrix does not match the input and output dimensions.");
+        }
+        else if (opName == OperationNameOf(PerDimMeanVarNormalizationNode))
+        {
+            op.opCode = IMF::opNormalize;
+            if (isConstant(node, 0) || !isConstant(node, 1) || !isConstant(node, 2) || numElementsOfInput(node, 1) != rows || numElementsOfInput(node, 2) != rows)
+                fail(node, "The mean and standard deviation must be constant columns.");
+        }
+        else
+            fail(node, "The operation is not supported by the inference runtime.");
+
+        for (uint32_t i = 0; i < op.numInputs; i++)
+            op.inputs[i] = tensorOfInput(node, i);
+        // the runtime reads the weights of a product as a [rows x inner] matrix
+        if (op.opCode == IMF::opTimes)
+        {
+            tensors[op.inputs[0]].rows = rows;
+            tensors[op.inputs[0]].cols = node->Input(1)->GetSampleMatrixNumRows();
+        }
+        op.output = addTensor(node, IMF::activationTensor, rows, 0);
+        tensorOf[node] = op.output;
+        operations.push_back(op);
+    }
+
+    vector<IMF::Output> outputTable;
+    for (const auto& node : outputs)
+    {
+        IMF::Output output;
+        output.tensor = tensorOf.at(node);
+        if (tensors[output.tensor].kind != IMF::activationTensor)
+            InvalidArgument("ExportForInference: Output %ls is not computed from the inputs.", node->NodeName().c_str());
+        output.nameOffset = addName(node->NodeName());
+        outputTable.push_back(output);
+    }
+
+    // plan the arena: first fit into the gaps left by activations that are no longer needed, else at the end
+    const size_t never = operations.size();
+    vector<size_t> lastUse(tensors.size(), 0);
+    for (size_t i = 0; i < operations.size(); i++)
+    {
+        for (uint32_t k = 0; k < operations[i].numInputs; k++)
+            lastUse[operations[i].inputs[k]] = i;
+    }
+    for (const auto& output : outputTable)
+        lastUse[output.tensor] = never;
+    map<uint64_t, uint64_t> freeRows; // [first row] -> number of rows
+    uint64_t arenaRows = 0;
+    for (size_t i = 0; i < operations.size(); i++)
+    {
+        IMF::Tensor& out = tensors[operations[i].output];
+        auto fit = freeRows.end();
+        for (auto iter = freeRows.begin(); iter != freeRows.end(); ++iter)
+        {
+            if (iter->second >= out.rows && (fit == freeRows.end() || iter->second < fit->second))
+                fit = iter;
+        }
+        if (fit != freeRows.end())
+        {
+            out.offset = fit->first;
+            const uint64_t remainingRows = fit->second - out.rows;
+            freeRows.erase(fit);
+            if (remainingRows > 0)
+                freeRows[out.offset + out.rows] = remainingRows;
+        }
+        else
+        {
+            out.offset = arenaRows;
+            arenaRows += out.rows;
+        }
+        // (freed after the output is placed, since an operation must not overwrite its own inputs)
+        for (uint32_t k = 0; k < operations[i].numInputs; k++)
+        {
+            const uint32_t id = operations[i].inputs[k];
+            const IMF::Tensor& in = tensors[id];
+            if (in.kind != IMF::activationTensor || lastUse[id] != i)
+                continue;
+            lastUse[id] = never + 1; // (an input may be read twice by the same operation)
+            auto next = freeRows.insert(make_pair(in.offset, in.rows)).first;
+            auto following = std::next(next);
+            if (following != freeRows.end() && next->first + next->second == following->first)
+            {
+                next->second += following->second;
+                freeRows.erase(following);
+            }
+            if (next != freeRows.begin())
+            {
+                auto previous = std::prev(next);
+                if (previous->first + previous->second == next->first)
+                {
+                    previous->second += next->second;
+                    freeRows.erase(next);
+                }
+            }
+        }
+    }
+
+    // lay out the file
+    IMF::Header header;
+    memcpy(header.magic, IMF::magic, sizeof(header.magic));
+    header.version = IMF::currentVersion;
+    header.numTensors = (uint32_t) tensors.size();
+    header.numOperations = (uint32_t) operations.size();
+    header.numOutputs = (uint32_t) outputTable.size();
+    header.tensorsOffset = IMF::AlignedOffset(sizeof(header));
+    header.operationsOffset = IMF::AlignedOffset(header.tensorsOffset + tensors.size() * sizeof(IMF::Tensor));
+    header.outputsOffset = IMF::AlignedOffset(header.operationsOffset + operations.size() * sizeof(IMF::Operation));
+    header.namesOffset = IMF::AlignedOffset(header.outputsOffset + outputTable.size() * sizeof(IMF::Output));
+    header.dataOffset = IMF::AlignedOffset(header.namesOffset + names.size());
+    uint64_t fileSize = header.dataOffset;
+    for (auto& tensor : tensors)
+    {
+        if (tensor.kind != IMF::constantTensor)
+            continue;
+        tensor.offset = IMF::AlignedOffset(fileSize);
+        fileSize = tensor.offset + tensor.rows * tensor.cols * sizeof(float);
+    }
+    header.fileSize = fileSize;
+    header.arenaRows = arenaRows;
+
+    // write it, tensor by tensor
+    const wstring tempFileName = fileName + L".tmp";
+    File::MakeIntermediateDirs(fileName);
+    FILE* f = fopenOrDie(tempFileName, L"wb");
+    uint64_t position = 0;
+    auto writeAt = [&](uint64_t offset, const void* data, size_t bytes)
+    {
+        static const char zeros[IMF::alignment] = {0};
+        while (position < offset)
+        {
+            const size_t n = (size_t) min<uint64_t>(offset - position, sizeof(zeros));
+            fwriteOrDie(zeros, 1, n, f);
+            position += n;
+        }
+        if (bytes > 0)
+            fwriteOrDie(data, 1, bytes, f);
+        position += bytes;
+    };
+    writeAt(0, &header, sizeof(header));
+    writeAt(header.tensorsOffset, tensors.data(), tensors.size() * sizeof(IMF::Tensor));
+    writeAt(header.operationsOffset, operations.data(), operations.size() * sizeof(IMF::Operation));
+    writeAt(header.outputsOffset, outputTable.data(), outputTable.size() * sizeof(IMF::Output));
+    writeAt(header.namesOffset, names.data(), names.size());
+    writeAt(header.dataOffset, nullptr, 0);
+    vector<float> data;
+    for (size_t id = 0; id < tensors.size(); id++)
+    {
+        if (tensors[id].kind != IMF::constantTensor)
+            continue;
+        const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(constantNodes[id])->Value();
+        unique_ptr<ElemType[]> values(value.CopyToArray());
+        data.assign(values.get(), values.get() + value.GetNumElements());
+        writeAt(tensors[id].offset, data.data(), data.size() * sizeof(float));
+    }
+    fcloseOrDie(f);
+    renameOrDie(tempFileName, fileName);
+
+    size_t numConstantElements = 0;
+    for (const auto& tensor : tensors)
+        numConstantElements += tensor.kind == IMF::constantTensor ? (size_t) (tensor.rows * tensor.cols) : 0;
+    fprintf(stderr, "ExportForInference: Wrote %ls: %d operations, %d constants with %d elements (%d folded nodes), %d inputs, %d outputs, %d arena rows per sample.\n",
+            fileName.c_str(), (int) operations.size(), (int) count_if(tensors.begin(), tensors.end(), [](const IMF::Tensor& t) { return t.kind == IMF::constantTensor; }),
+            (int) numConstantElements, (int) foldedNodes.size(),
+            (int) count_if(tensors.begin(), tensors.end(), [](const IMF::Tensor& t) { return t.kind == IMF::inputTensor; }),
+            (int) outputTable.size(), (int) arenaRows);
+}
+
+template void ComputationNetwork::ExportForInference<float>(const std::wstring& fileName, const std::vector<ComputationNodeBasePtr>& outputNodes);
+template void ComputationNetwork::ExportForInference<double>(const std::wstring& fileName, const std::vector<ComputationNodeBasePtr>& outputNodes);
+
+} } }
@@ -11,6 +11,7 @@
 #include "Sequences.h"
 #include "TensorShape.h"
 #include "MatrixPool.h"
+#include "MemoryAccounting.h"
 
 #include <unordered_set>
 #include <map>
@@ -30,7 +31,10 @@
 // version number to control how to read and write
 #define CNTK_MODEL_VERSION_1 1
 #define CNTK_MODEL_VERSION_2 2
-#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_2
+#define CNTK_MODEL_VERSION_3 3 // NoiseContrastiveEstimationNode saves its sampling parameters
+#define CNTK_MODEL_VERSION_4 4 // LSTMCellNode saves its peephole and projection flags
+#define CNTK_MODEL_VERSION_5 5 // ConvolutionNode saves its number of groups
+#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_5
 
 extern bool g_shareNodeValueMatrices;
 
@@ -51,6 +55,7 @@ enum CopyNodeFlags // flags to be passed to the CopyTo() function
     copyNodeChildren = 2,             // only copy over children links
     copyNodeAll = 3,                  // copy everything
     copyNodeChildrenCrossNetwork = 4, // allow a cross network child copy
+    copyNodeShareValue = 8,           // with copyNodeValue: let the copy share the value matrix instead of copying it (for read-only parameters)
 };
 
 #pragma region base computation class
@@ -128,6 +133,9 @@ struct /*interface*/ IStatefulNode
     typedef std::shared_ptr<INodeState> NodeStatePtr;
     virtual NodeStatePtr ExportState() = 0;
     virtual void ImportState(const NodeStatePtr& state) = 0;
+    // gradient checkpointing of a loop: keep the state that the minibatch starts from, and go back to it to run the loop again
+    virtual void SaveStateForRecompute() = 0;
+    virtual void RestoreStateForRecompute() = 0;
 };
 typedef IStatefulNode::NodeStatePtr NodeStatePtr;
 
@@ -142,7 +150,8 @@ struct ComputationNetworkOwnedNodeState
     friend class ComputationNetwork;
 
     ComputationNetworkOwnedNodeState()
-        : m_needsGradient(false), m_valueSharable(true)
+        : m_needsGradient(false), m_valueSharable(true), m_recomputeDuringBackprop(false), m_valueStoredInHalf(false), m_valueIsRecomputed(false), m_absorbedIntoConsumer(false),
+          m_gradientSharedWithConsumer(false), m_gradientSharedWithInput(false), m_valueSharedWithInput(false), m_valueTakenOverByConsumer(false)
     {
         PurgeStateForFormingRecurrentLoops();
         m_isPartOfLoop = false;
@@ -161,6 +170,13 @@ struct ComputationNetworkOwnedNodeState
     virtual void MarkValueSharable() { m_valueSharable = true; }
     bool IsValueSharable() const { return m_valueSharable; }
 
+    // elementwise fusion: this node's ForwardProp() and BackpropTo() are performed by its only consumer (decided by ComputationNetwork::FuseElementwiseOperations())
+    bool IsAbsorbedIntoConsumer() const { return m_absorbedIntoConsumer; }
+
+    // in-place buffers (decided by ComputationNetwork::ShareBuffersWithConsumers())
+    bool IsGradientSharedWithConsumer() const { return m_gradientSharedWithConsumer; }
+    bool IsValueSharedWithInput() const { return m_valueSharedWithInput; }
+
 protected:                // TODO: should be fully encapsulated here
 
     bool m_needsGradient; // true if this node or any children need a gradient to be computed (for own consumption or propagation to somewhere in the child tree)
@@ -168,6 +184,17 @@ protected:                // TODO: should be fully encapsulated here
     bool m_valueSharable; // a flag is needed for memory share.
                           // If it is false (e.g., learnableParameters/InputValue and those nodes are solely induced by learnableParameters),
                           // it will never be released to memory pool
+
+    bool m_recomputeDuringBackprop; // gradient checkpointing is in effect for this node: value is released after forward prop and recomputed for backprop (decided by AllocateAllMatrices())
+    bool m_valueStoredInHalf;       // half-precision storage is in effect for this node: value is packed after forward prop and expanded for backprop (decided by AllocateAllMatrices())
+    bool m_valueIsRecomputed;       // during backprop: value currently lives in the recompute buffer (recomputed, or expanded from half precision)
+
+    bool m_absorbedIntoConsumer; // value and gradient of this node are never materialized; its consumer evaluates it as part of a fused operation
+
+    bool m_gradientSharedWithConsumer; // the gradient is the one of the only consumer, whose gradient w.r.t. this node is the identity; nothing is propagated into it
+    bool m_gradientSharedWithInput;    // the other side of the above: an input owns our gradient from our Backprop() on, and releases it
+    bool m_valueSharedWithInput;       // the value lives in the buffer of the (only) input: computed into it in place, or a view of it
+    bool m_valueTakenOverByConsumer;   // the other side of the above: the consumer owns our value buffer from its ForwardProp() on, and releases it (otherwise it stays ours)
 private:
 
     bool m_isPartOfLoop; // true if this loop is part of a recurrent loop
@@ -264,7 +291,7 @@ public:
     // -----------------------------------------------------------------------
 
     ComputationNodeBase(DEVICEID_TYPE deviceId, const wstring& name)
-        : m_deviceId(deviceId), m_outputNeededDuringBackprop(true), m_parameterUpdateRequired(false), m_gradientInitialized(false), m_nodeName(name == L"" ? CreateUniqNodeName() : name)
+        : m_deviceId(deviceId), m_outputNeededDuringBackprop(true), m_parameterUpdateRequired(false), m_gradientInitialized(false), m_recompute(false), m_storeValueInHalf(false), m_halfFormat(HalfFormat::fp16), m_nodeName(name == L"" ? CreateUniqNodeName() : name)
     {
     }
     virtual ~ComputationNodeBase()
@@ -283,6 +310,9 @@ public:
         {
             node->m_deviceId = m_deviceId;
             node->m_parameterUpdateRequired = m_parameterUpdateRequired;
+            node->m_recompute = m_recompute;
+            node->m_storeValueInHalf = m_storeValueInHalf;
+            node->m_halfFormat = m_halfFormat;
             node->m_nodeName = newName;
 
             node->m_sampleLayout = m_sampleLayout;
@@ -571,6 +601,10 @@ public:
 
     DEVICEID_TYPE GetDeviceId() const { return m_deviceId; }
 
+    // model parallelism: place this node on another device (see ComputationNetwork::PlaceOnDevices())
+    // Matrices the node creates later go to the new device. This must happen before AllocateAllMatrices().
+    virtual void MoveToDevice(DEVICEID_TYPE deviceId) { m_deviceId = deviceId; }
+
     // helper to access to element(0,0) without having to type-cast
     virtual double Get00Element() const = 0;
 
@@ -679,6 +713,8 @@ public:
     virtual void InvalidateMissingGradientColumns(const FrameRange&) = 0;
 
     virtual void ZeroGradientsOfInputs() = 0;
+    virtual void LazyZeroGradient() = 0;
+    virtual bool ResumeGradientAccumulation() = 0;
 
     // -----------------------------------------------------------------------
     // memory sharing
@@ -697,6 +733,100 @@ public:
     void SetOutputNeededDuringBackprop(bool f) { m_outputNeededDuringBackprop = f; }
     bool IsOutputNeededDuringBackprop() const { return !g_shareNodeValueMatrices || m_outputNeededDuringBackprop; }
 
+    // gradient checkpointing: if set, the output value is not kept alive for backprop but recomputed from the inputs when the gradient computation needs it
+    // This is a request; ComputationNetwork::AllocateAllMatrices() decides whether it can be honored.
+    void SetRecompute(bool f) { m_recompute = f; }
+    bool IsRecompute() const { return m_recompute; }
+
+    // request/release the buffer that the value is recomputed into during backprop, and swap it with the forward-prop value
+    virtual void RequestMatricesForRecompute(MatrixPool& matrixPool) = 0;
+    virtual void ReleaseMatricesAfterRecompute(MatrixPool& matrixPool) = 0;
+    virtual void SwapValueWithRecomputeBuffer() = 0;
+
+    // half-precision storage: if set, the output value is kept for backprop as 16-bit floats of the given format, and expanded
+    // into the recompute buffer when the gradient computation needs it. Also a request that AllocateAllMatrices() decides on.
+    void SetStoreValueInHalf(bool f, HalfFormat format = HalfFormat::fp16)
+    {
+        m_storeValueInHalf = f;
+        m_halfFormat = format;
+    }
+    bool IsStoreValueInHalf() const { return m_storeValueInHalf; }
+    HalfFormat GetHalfFormat() const { return m_halfFormat; }
+
+    // request/release the buffer that holds the packed value, and convert into and out of it
+    virtual void RequestMatricesForHalfStorage(MatrixPool& matrixPool) = 0;
+    virtual void ReleaseMatricesForHalfStorage(MatrixPool& matrixPool) = 0;
+    virtual void PackValueToHalf() = 0;
+    virtual void ExpandValueFromHalf() = 0; // into the recompute buffer, which then becomes the value
+
+    // elementwise fusion: can this node evaluate itself directly from the inputs of a PlusNode input, in forward and backward direction?
+    // If so, ComputationNetwork::FuseElementwiseOperations() may mark that input as absorbed, and it is up to this node to do its work.
+    virtual bool CanAbsorbSumInput() const { return false; }
+
+    // common subexpressions (see ComputationNetwork::EliminateCommonSubexpressions()): given a node of the same type, is it configured the same,
+    // so that with the same inputs it computes the same value? Nodes opt in; those that draw random numbers or keep state must not.
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const { return false; }
+
+    // in-place buffers (see ComputationNetwork::ShareBuffersWithConsumers()):
+    // Is the gradient w.r.t. an input the identity of ours, so that the input may use our gradient as its own?
+    virtual bool CanShareGradientWithInput(size_t /*inputIndex*/) const { return false; }
+    // Can this node compute its value elementwise into the buffer of its only input, with a backprop that needs only the output?
+    virtual bool CanComputeValueInPlace() const { return false; }
+    // Is the value that of the only input with other dimensions, so that this node can use the input's buffer as it is and skip its ForwardProp()?
+    virtual bool IsValueViewOfInput() const { return false; }
+
+    // variable-length loops (see SEQTraversalFlowControlNode::ActiveSequencesOf()): can ForwardProp() and BackpropTo() of a time
+    // step be restricted to the active parallel sequences (FrameRange::ActiveSequences())? True for all nodes that access frames
+    // through ValueFor(), GradientFor() and the like only, and do not count parallel sequences themselves.
+    virtual bool CanStepActiveSequencesOnly() const { return true; }
+
+    // int8 inference: replace the product with a constant weight matrix by an int8 one (see Int8QuantizedMatrix.h)
+    // Returns false if this node has no weights that qualify. Only meant for evaluation; the int8 copy does not follow later updates of the weights.
+    virtual bool QuantizeWeightsToInt8() { return false; }
+
+    // CPU inference: pack the constant weight matrix of a product once, for small minibatches (see PackedGemmMatrix.h)
+    // Returns false if this node has no weights that qualify. Like QuantizeWeightsToInt8(), only meant for evaluation.
+    virtual bool PackWeightsForInference() { return false; }
+
+    // profiling (see NodeProfiler.h): estimated number of floating-point operations of ForwardProp(fr), or 0 if not estimated
+    // Nodes that override this are assumed to spend the same per input gradient in BackpropTo(), which holds for products.
+    virtual double EstimateFlops(const FrameRange&) const { return 0; }
+    // profiling: bytes of the value and gradient matrices this node currently holds
+    virtual size_t GetMatrixBytes() const { return 0; }
+    // memory estimation (ComputationNetwork::EstimateDeviceMemory()): adds the bytes of the value and gradient matrices that
+    // are not shared through the pool, split into a part that grows with the number of minibatch columns and a fixed part
+    virtual void EstimateUnsharedMatrixBytes(const MatrixPool&, size_t& /*perColumnBytes*/, size_t& /*fixedBytes*/) const { }
+    // adds the value and gradient matrices on 'deviceId' with their current allocation, keyed by matrix to count shared ones once
+    virtual void CollectAllocatedMatrixBytes(DEVICEID_TYPE /*deviceId*/, std::map<const void*, size_t>& /*bytes*/) const { }
+    // unified memory (see PARTraversalFlowControlNode::PrefetchAhead()): migrate the value, and the gradient if asked for, to the device or to the host
+    virtual void PrefetchMatrices(bool /*toDevice*/, bool /*withGradient*/) const { }
+    // concurrent streams (see PARTraversalFlowControlNode::DetermineStages()): identity of the value and gradient matrices, and of all
+    // matrices this node got from the matrix pool, which the pool may hand to other nodes as well (at other points of the traversal)
+    virtual const void* ValueMatrixId() const { return nullptr; }
+    virtual const void* GradientMatrixId() const { return nullptr; }
+    virtual void CollectMatricesFromPool(std::vector<const void*>& /*matrices*/) const { }
+    // loop capture (see SEQTraversalFlowControlNode::RunCaptured()): adds the device buffers that a time step of this node reads
+    // or writes, and the layouts other than its own that its host-side decisions depend on; false if a recorded time step
+    // cannot be replayed even where those are the same (random numbers, host-side state, sparse matrices)
+    virtual bool CollectCaptureState(std::vector<const void*>& /*buffers*/, std::vector<MBLayoutPtr>& /*layouts*/) const { return false; }
+
+    // number of columns that ForwardProp(fr) computes
+    size_t GetNumColsFor(const FrameRange& fr) const
+    {
+        if (!HasMBLayout() || fr.IsAllFrames())
+            return GetSampleMatrixNumCols();
+        else
+            return fr.seqIndex == SIZE_MAX ? std::min(GetMBLayout()->GetNumParallelSequences(), fr.m_numActiveSequences) * fr.m_timeRange : 1;
+    }
+
+    // batched GEMM: compute the values of all nodes in 'batch' (this one first, all of its type) together, as far as their operands allow
+    // (see ComputationNetwork::DetermineForwardPropBatches()). The default just computes them one by one.
+    virtual void ForwardPropBatched(const std::vector<ComputationNodeBasePtr>& batch, const FrameRange& fr)
+    {
+        for (const auto& node : batch)
+            node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+    }
+
     // -----------------------------------------------------------------------
     // helpers for network traversal
     // -----------------------------------------------------------------------
@@ -711,7 +841,7 @@ public:
         std::unordered_set<ComputationNodeBasePtr> visited;
 
         for (const auto& root : allRoots)
-            root->EnumerateNodesRec(visited, nodes); // call into the recursive portion of this function below
+            root->EnumerateNodesFrom(visited, nodes); // call into the traversal portion of this function below
 
         return nodes;
     }
@@ -724,20 +854,31 @@ public:
 
 private:
 
-    // Recursive part of EnumerateNodes().
-    void EnumerateNodesRec(std::unordered_set<ComputationNodeBasePtr>& visited, std::list<ComputationNodeBasePtr>& result) /*const*/ // const not working due to shared_from_this()
+    // Traversal part of EnumerateNodes().
+    // This is a depth-first traversal with an explicit stack of the nodes being visited and the next input of each, instead of
+    // recursion, since generated networks can be deeper than the call stack.
+    void EnumerateNodesFrom(std::unordered_set<ComputationNodeBasePtr>& visited, std::list<ComputationNodeBasePtr>& result) /*const*/ // const not working due to shared_from_this()
     {
-        if (visited.find(shared_from_this()) == visited.end()) // do not include a node twice
+        if (!visited.insert(shared_from_this()).second) // do not include a node twice
+            return;
+        std::vector<std::pair<ComputationNodeBasePtr, size_t>> visitStack(1, std::make_pair(shared_from_this(), (size_t) 0));
+        while (!visitStack.empty())
         {
-            visited.insert(shared_from_this()); // have visited tagged here to avoid infinite loop over children, children's children, etc
+            const ComputationNodeBasePtr node = visitStack.back().first;
+            size_t& i = visitStack.back().second;
 
             // children first for function evaluation
-            for (int i = 0; i < m_inputs.size(); i++)
-                if (m_inputs[i])
-                    m_inputs[i]->EnumerateNodesRec(visited, result);
+            if (i < node->m_inputs.size())
+            {
+                const ComputationNodeBasePtr& input = node->m_inputs[i++];
+                if (input && visited.insert(input).second) // have visited tagged here to avoid infinite loop over children, children's children, etc
+                    visitStack.push_back(std::make_pair(input, (size_t) 0));
+                continue;
+            }
 
             // now that all children are in list before us, put ourselves
-            result.push_back(shared_from_this());
+            result.push_back(node);
+            visitStack.pop_back();
         }
     }
 
@@ -831,6 +972,9 @@ protected:
     bool m_parameterUpdateRequired;    // update parameters? Only used for LearnableParameters.    --TODO: Should we make this a member of LearnableParameters actually? And require a type cast? Currently it is read out for all leaves.
     bool m_gradientInitialized;        // indicates whether the gradient matrix has been resized and initialized to 0
     bool m_outputNeededDuringBackprop; // indicates whether the output value of the node is needed during backprop
+    bool m_recompute;                  // user asked for the value to be recomputed during backprop instead of kept (gradient checkpointing)
+    bool m_storeValueInHalf;           // user asked for the value to be kept for backprop in half precision
+    HalfFormat m_halfFormat;           // ...in this format
 };
 typedef ComputationNodeBase::ComputationNodeBasePtr ComputationNodeBasePtr;
 
@@ -899,7 +1043,13 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = DownCast(nodeP);
-            *node->m_value = *m_value;
+            if (flags & CopyNodeFlags::copyNodeShareValue)
+                node->m_value = m_value;
+            else if (m_value) // (values of sharable nodes only exist once they are taken from the matrix pool)
+            {
+                node->CreateMatrixIfNull(node->m_value);
+                *node->m_value = *m_value;
+            }
             if (m_gradient)
                 *node->m_gradient = *m_gradient;
             else
@@ -912,7 +1062,32 @@ public:
     {
         const std::wstring& name = (newName == L"") ? NodeName() : newName;
         ComputationNodeBasePtr node(NewThis(m_deviceId, name)); // NewThis() is a virtual function that creates a new node of the actual type of 'this'
-        node->CopyTo(shared_from_this(), newName, flags);       // note: shared_from_this() is the base class, but CopyTo() up-casts it as needed
+        CopyTo(node, name, flags);                              // note: node is of the base class, but CopyTo() up-casts it as needed
+        return node;
+    }
+
+    // checkpointing: a copy of this node on the CPU, without inputs, whose value is 'value' (a snapshot, or null for nodes
+    // whose value Save() does not write); see ComputationNetwork::CloneForSaving().
+    // Our value and gradient are kept out of CopyTo(), which would copy them on the device.
+    ComputationNodePtr DuplicateForSaving(const shared_ptr<Matrix<ElemType>>& value)
+    {
+        ComputationNodePtr node = DownCast(ComputationNodeBasePtr(NewThis(CPUDEVICE, NodeName())));
+        shared_ptr<Matrix<ElemType>> ourValue, ourGradient;
+        ourValue.swap(m_value);
+        ourGradient.swap(m_gradient);
+        try
+        {
+            CopyTo(node, NodeName(), CopyNodeFlags::copyNodeValue);
+        }
+        catch (...)
+        {
+            m_value.swap(ourValue);
+            m_gradient.swap(ourGradient);
+            throw;
+        }
+        m_value.swap(ourValue);
+        m_gradient.swap(ourGradient);
+        node->m_value = value;
         return node;
     }
 
@@ -1087,9 +1262,106 @@ public:
     const Matrix<ElemType>& Value() const { return *m_value; }
     Matrix<ElemType>&       Value()       { return *m_value; }
 
+    // the value matrix object itself, so that read-only parameters of several networks can share one (see EvalHost)
+    const shared_ptr<Matrix<ElemType>>& ValuePtr() const { return m_value; }
+    void ShareValue(const shared_ptr<Matrix<ElemType>>& value) { m_value = value; }
+
     const Matrix<ElemType>& Gradient() const { return *m_gradient; }
     Matrix<ElemType>&       Gradient()       { return *m_gradient; }
 
+    // move the node to a different device, including the matrices it already holds
+    virtual void MoveToDevice(DEVICEID_TYPE deviceId) override
+    {
+        Base::MoveToDevice(deviceId);
+        if (m_value)
+            m_value->TransferToDeviceIfNotThere(deviceId, true);
+        if (m_gradient)
+            m_gradient->TransferToDeviceIfNotThere(deviceId, true);
+    }
+
+    virtual size_t GetMatrixBytes() const override
+    {
+        return (m_value ? m_value->BufferSize() : 0) + (m_gradient ? m_gradient->BufferSize() : 0);
+    }
+
+    virtual void EstimateUnsharedMatrixBytes(const MatrixPool& matrixPool, size_t& perColumnBytes, size_t& fixedBytes) const override
+    {
+        for (const auto& matrix : {m_value, m_gradient})
+        {
+            if (!matrix || matrixPool.IsShared(matrix.get()) || matrix->GetDeviceId() != m_deviceId)
+                continue;
+            if (matrix->GetMatrixType() == SPARSE) // no size to go by but the current one
+            {
+                if (HasMBLayout() && matrix->GetNumCols() > 0)
+                    perColumnBytes += matrix->BufferSize() / matrix->GetNumCols();
+                else
+                    fixedBytes += matrix->BufferSize();
+            }
+            else if (HasMBLayout())
+                perColumnBytes += GetSampleLayout().GetNumElements() * sizeof(ElemType);
+            else
+                fixedBytes += GetSampleLayout().GetNumElements() * sizeof(ElemType);
+        }
+    }
+
+    virtual void CollectAllocatedMatrixBytes(DEVICEID_TYPE deviceId, std::map<const void*, size_t>& bytes) const override
+    {
+        for (const auto& matrix : {m_value, m_gradient})
+        {
+            if (matrix && matrix->GetDeviceId() == deviceId)
+                bytes[matrix.get()] = matrix->BufferSize();
+        }
+    }
+
+    virtual void PrefetchMatrices(bool toDevice, bool withGradient) const override
+    {
+        for (const auto& matrix : {m_value, withGradient ? m_gradient : nullptr})
+        {
+            if (matrix && toDevice)
+                matrix->PrefetchToDevice();
+            else if (matrix)
+                matrix->PrefetchToHost();
+        }
+    }
+
+    virtual const void* ValueMatrixId() const override { return m_value.get(); }
+    virtual const void* GradientMatrixId() const override { return m_gradient.get(); }
+    virtual void CollectMatricesFromPool(std::vector<const void*>& matrices) const override
+    {
+        for (const auto matrixPtr : m_matricesFromPool)
+        {
+            if (*matrixPtr)
+                matrices.push_back(matrixPtr->get());
+        }
+    }
+    // own value, gradient and pool matrices, and the values of the inputs (of an absorbed input: of its inputs)
+    virtual bool CollectCaptureState(std::vector<const void*>& buffers, std::vector<MBLayoutPtr>& /*layouts*/) const override
+    {
+        std::vector<const Matrix<ElemType>*> matrices{m_value.get(), m_gradient.get()};
+        for (const auto matrixPtr : m_matricesFromPool)
+            matrices.push_back(matrixPtr->get());
+        for (size_t i = 0; i < m_inputs.size(); i++)
+        {
+            const auto& input = Input(i);
+            if (!input->IsAbsorbedIntoConsumer())
+                matrices.push_back(input->m_value.get());
+            else
+            {
+                for (size_t j = 0; j < input->GetNumInputs(); j++)
+                    matrices.push_back(input->Input(j)->m_value.get());
+            }
+        }
+        for (const auto matrix : matrices)
+        {
+            if (!matrix)
+                continue;
+            if (matrix->GetMatrixType() == MatrixType::SPARSE) // its kernels depend on the number of non-zeros
+                return false;
+            buffers.push_back(matrix->BufferPointer());
+        }
+        return true;
+    }
+
 private:
 
     // map a tensor to a matrix
@@ -1216,6 +1488,7 @@ public:
     // update the actual matrix allocation for m_value based on the node dimension
     void UpdateFunctionValuesSize()
     {
+        MemoryAccounting::Context memory(*this, MemoryAccounting::value);
         UpdateDataSize(Value());
     }
 
@@ -1231,15 +1504,16 @@ public:
     {
         Base::BeginForwardProp();
 
-        // update the actual m_value allocation
-        if (!IsLeaf() && !RequiresPreCompute()) // TODO: guard this through overrides instead
+        // update the actual m_value allocation (an absorbed node never writes its value, so it stays empty)
+        if (!IsLeaf() && !RequiresPreCompute() && !IsAbsorbedIntoConsumer()) // TODO: guard this through overrides instead
             UpdateFunctionValuesSize();
 
         // give nodes a chance to update their internal state that may also have to match MB size
         UpdateFunctionMBSize();
 
         // and make sure dimensions are what we expect
-        VerifyDataSize(Value());
+        if (!IsAbsorbedIntoConsumer())
+            VerifyDataSize(Value());
     }
 
 #ifdef _DEBUG
@@ -1296,7 +1570,7 @@ public:
         for (size_t i = 0; i < m_inputs.size(); i++)
         {
             ComputationNodePtr child = Input(i);
-            if (child->m_needsGradient &&
+            if (child->m_needsGradient && !child->m_gradientSharedWithConsumer && // (a child that shares our gradient has it already)
                 (childrenInThisLoop && child->IsPartOfLoop() == IsPartOfLoop() ||
                  childrenInOuterLoop && child->IsPartOfLoop() != IsPartOfLoop()))
             {
@@ -1309,7 +1583,8 @@ public:
 #if DUMPOUTPUT
                 fprintf(stderr, "Backprop%d_%ls\n", i, NodeName().c_str());
 #endif
-                child->LazyZeroGradient(); // set gradient to 0 if this is the first time
+                if (!child->IsAbsorbedIntoConsumer()) // (an absorbed child's gradient is never materialized; we propagate into its inputs directly)
+                    child->LazyZeroGradient(); // set gradient to 0 if this is the first time
 
                 // If we propagate from a loop to a node that is outside the loop, we are not efficient.
                 // This case is handled by SEQTraversalFlowControlNode::Backprop().
@@ -1338,7 +1613,7 @@ public:
     }
 
     // lazy resetting of gradient
-    void LazyZeroGradient()
+    void /*ComputationNodeBase::*/ LazyZeroGradient() override
     {
         if (!m_needsGradient)
             LogicError("%ls %ls operation: LazyZeroGradient() called although this node needs no gradient.", NodeName().c_str(), OperationName().c_str());
@@ -1346,12 +1621,25 @@ public:
         if (m_gradientInitialized)
             return;
 
+        MemoryAccounting::Context memory(*this, MemoryAccounting::gradient);
         UpdateDataSize(Gradient());
         Gradient().SetValue(0);
 
         m_gradientInitialized = true;
     }
 
+    // undo the lazy reset for this Backprop(), so that the gradient gets added to what the previous Backprop() left in it
+    // Only dense gradients of the current size qualify; returns false (and leaves the node alone) otherwise.
+    bool /*ComputationNodeBase::*/ ResumeGradientAccumulation() override
+    {
+        if (!m_needsGradient || !m_gradient || m_gradient->GetMatrixType() != DENSE ||
+            m_gradient->GetNumRows() != GetSampleMatrixNumRows() || m_gradient->GetNumCols() != GetSampleMatrixNumCols())
+            return false;
+
+        m_gradientInitialized = true;
+        return true;
+    }
+
     // -----------------------------------------------------------------------
     // memory sharing
     // -----------------------------------------------------------------------
@@ -1359,6 +1647,15 @@ public:
     // request matrices needed to do node function value evaluation
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
+        if (IsAbsorbedIntoConsumer()) // our consumer computes us as part of its own operation; an empty matrix suffices
+        {
+            CreateMatrixIfNull(m_value);
+            return;
+        }
+        if (m_valueSharedWithInput) // use the buffer of the input
+            m_value = Input(0)->m_value;
+        else if ((CanComputeValueInPlace() || IsValueViewOfInput()) && m_value && m_value == Input(0)->m_value) // shared in an earlier plan
+            m_value = nullptr;
         if (IsValueSharable())
             RequestMatrixFromPool(m_value, matrixPool);
         else
@@ -1369,7 +1666,7 @@ public:
     // don't release matrices that need to be used in the gradient computation
     virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool) override
     {
-        if (!IsOutputNeededDuringBackprop() && (m_value->GetMatrixType() != SPARSE) && IsValueSharable())
+        if (!IsOutputNeededDuringBackprop() && (m_value->GetMatrixType() != SPARSE) && IsValueSharable() && OwnsValueBuffer() && !IsAbsorbedIntoConsumer())
             ReleaseMatrixToPool(m_value, matrixPool);
     }
 
@@ -1377,32 +1674,88 @@ public:
     {
         for (int i = 0; i < m_inputs.size(); i++)
         {
-            if (m_inputs[i]->NeedGradient())
-                m_inputs[i]->RequestMatricesBeforeBackprop(matrixPool);
+            if (!m_inputs[i]->NeedGradient())
+                continue;
+            const auto input = Input(i);
+            if (input->m_gradientSharedWithConsumer) // our gradient becomes the input's
+                input->m_gradient = m_gradient;
+            else if (input->m_gradient && input->m_gradient == m_gradient) // shared in an earlier plan
+                input->m_gradient = nullptr;
+            input->RequestMatricesBeforeBackprop(matrixPool);
         }
     }
 
     // request matrices that are needed for gradient computation
     virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
     {
-        RequestMatrixFromPool(m_gradient, matrixPool);
+        if (IsAbsorbedIntoConsumer()) // our consumer propagates straight into our inputs
+            CreateMatrixIfNull(m_gradient);
+        else
+            RequestMatrixFromPool(m_gradient, matrixPool);
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
     virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
     {
-        if (!IsLeaf() && !RequiresPreCompute())
+        if (!IsLeaf() && !RequiresPreCompute() && !IsAbsorbedIntoConsumer())
         {
-            if (m_gradient != nullptr && m_gradient->GetMatrixType() != SPARSE) // since we don't have a sparse pool yet
+            if (m_gradient != nullptr && m_gradient->GetMatrixType() != SPARSE && !m_gradientSharedWithInput) // since we don't have a sparse pool yet; a shared one is the input's to release
                 ReleaseMatrixToPool(m_gradient, matrixPool);
 
             // Release the Value matrix only if the output value is needed during backprop
             // since in the case it isn't used, we release it during forward prop itself
-            if (IsOutputNeededDuringBackprop() && m_value->GetMatrixType() != SPARSE && IsValueSharable())
+            if (IsOutputNeededDuringBackprop() && m_value->GetMatrixType() != SPARSE && IsValueSharable() && OwnsValueBuffer())
                 ReleaseMatrixToPool(m_value, matrixPool);
         }
     }
 
+    // gradient checkpointing: the value is recomputed into a separate buffer so that the forward-prop buffer can be shared freely
+    virtual void RequestMatricesForRecompute(MatrixPool& matrixPool) override
+    {
+        RequestMatrixFromPool(m_recomputedValue, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterRecompute(MatrixPool& matrixPool) override
+    {
+        ReleaseMatrixToPool(m_recomputedValue, matrixPool);
+    }
+
+    virtual void SwapValueWithRecomputeBuffer() override
+    {
+        if (!m_recomputedValue)
+            LogicError("%ls %ls operation: SwapValueWithRecomputeBuffer() called without a recompute buffer.", NodeName().c_str(), OperationName().c_str());
+        m_value.swap(m_recomputedValue);
+    }
+
+    // half-precision storage: the packed value takes PackedHalfRows() rows of ElemType per column
+    virtual void RequestMatricesForHalfStorage(MatrixPool& matrixPool) override
+    {
+        RequestMatrixFromPool(m_packedValue, matrixPool, Matrix<ElemType>::PackedHalfRows(GetSampleLayout().GetNumElements()));
+    }
+
+    virtual void ReleaseMatricesForHalfStorage(MatrixPool& matrixPool) override
+    {
+        ReleaseMatrixToPool(m_packedValue, matrixPool);
+    }
+
+    virtual void PackValueToHalf() override
+    {
+        if (!m_packedValue)
+            LogicError("%ls %ls operation: PackValueToHalf() called without a packed-value buffer.", NodeName().c_str(), OperationName().c_str());
+        if (m_value->GetMatrixType() != DENSE)
+            RuntimeError("%ls %ls operation: Half-precision storage requires a dense value.", NodeName().c_str(), OperationName().c_str());
+        m_packedValueNumRows = m_value->GetNumRows();
+        m_packedValue->AssignPackedHalfOf(*m_value, m_halfFormat);
+    }
+
+    virtual void ExpandValueFromHalf() override
+    {
+        if (!m_packedValue || !m_recomputedValue)
+            LogicError("%ls %ls operation: ExpandValueFromHalf() called without its buffers.", NodeName().c_str(), OperationName().c_str());
+        m_recomputedValue->AssignUnpackedHalfOf(*m_packedValue, m_packedValueNumRows, m_halfFormat);
+        m_value.swap(m_recomputedValue);
+    }
+
     void CreateGradientMatrixIfNull()
     {
         CreateMatrixIfNull(m_gradient);
@@ -1426,11 +1779,18 @@ protected:
     }
 
     void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
+    {
+        // the sample layout is known after validation, which lets the pool pick a buffer of matching size
+        RequestMatrixFromPool(matrixPtr, matrixPool, GetSampleLayout().GetNumElements());
+    }
+
+    // for a matrix whose columns are not samples of the node's layout: 'numElementsPerSample' is its size per column
+    void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool, size_t numElementsPerSample)
     {
         if (matrixPtr == nullptr)
-        {
-            matrixPtr = matrixPool.Request<ElemType>(m_deviceId);
-        }
+            matrixPtr = matrixPool.Request<ElemType>(m_deviceId, numElementsPerSample, HasMBLayout());
+        if (std::find(m_matricesFromPool.begin(), m_matricesFromPool.end(), &matrixPtr) == m_matricesFromPool.end())
+            m_matricesFromPool.push_back(&matrixPtr);
     }
 
     void ReleaseMatrixToPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
@@ -1439,6 +1799,12 @@ protected:
         matrixPool.Release<ElemType>(matrixPtr);
     }
 
+    // false if the value buffer is released by someone else: a consumer took it over, or it belongs to the input we share it with
+    bool OwnsValueBuffer() const
+    {
+        return !m_valueTakenOverByConsumer && (!m_valueSharedWithInput || Input(0)->m_valueTakenOverByConsumer);
+    }
+
 public:
 
     // -----------------------------------------------------------------------
@@ -1556,6 +1922,10 @@ public:
 protected:
 
     shared_ptr<Matrix<ElemType>> m_value, m_gradient;
+    shared_ptr<Matrix<ElemType>> m_recomputedValue; // only for nodes with gradient checkpointing or half-precision storage in effect
+    shared_ptr<Matrix<ElemType>> m_packedValue;     // only for nodes with half-precision storage in effect
+    size_t m_packedValueNumRows = 0;
+    std::vector<shared_ptr<Matrix<ElemType>>*> m_matricesFromPool; // the members that RequestMatrixFromPool() was called for, see CollectMatricesFromPool()
 
     static std::map<size_t, std::map<size_t, Matrix<ElemType>*>> s_constOnes;
 };
@@ -1610,13 +1980,16 @@ public:
 // FlowControlNode -- special wrapper node for use by ComputationNetwork only
 // =======================================================================
 
+class NodeProfiler;
+
 class FlowControlNode : public ComputationNodeBase
 {
     typedef ComputationNodeBase Base;
 
 public:
     FlowControlNode()
-        : ComputationNodeBase(DEVICEID_NOTYETDETERMINED /*we don't own matrices*/, L"" /*name: we don't care*/)
+        : ComputationNodeBase(DEVICEID_NOTYETDETERMINED /*we don't own matrices*/, L"" /*name: we don't care*/),
+          m_profiler(nullptr)
     {
     }
 
@@ -1636,6 +2009,8 @@ public:
     virtual void ValidateInferInputDimsFrom(const TensorShape&) override { NOT_IMPLEMENTED; }
     virtual void SetInput(const size_t, const Microsoft::MSR::CNTK::ComputationNodeBase::ComputationNodeBasePtr&) override { NOT_IMPLEMENTED; }
     virtual void ZeroGradientsOfInputs(void) override { NOT_IMPLEMENTED; }
+    virtual void LazyZeroGradient() override { NOT_IMPLEMENTED; }
+    virtual bool ResumeGradientAccumulation() override { NOT_IMPLEMENTED; }
     virtual void MaskMissingValueColumnsToZero(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void MaskMissingGradientColumnsToZero(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void InvalidateMissingValueColumns(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
@@ -1646,9 +2021,33 @@ public:
     virtual bool RequiresPreCompute() const override { return false; } // return true if the node's value should be computed before the normal training. e.g., mean and invStd of input features.
     virtual void PrintSelfBeforeValidation() const override { }
     virtual void DumpNodeInfo(const bool /*printValues*/, const bool /*printMetadata*/, File& fstream) const override {}
+    virtual void RequestMatricesForRecompute(MatrixPool& matrixPool) override { NOT_IMPLEMENTED; }
+    virtual void ReleaseMatricesAfterRecompute(MatrixPool& matrixPool) override { NOT_IMPLEMENTED; }
+    virtual void SwapValueWithRecomputeBuffer() override { NOT_IMPLEMENTED; }
+    virtual void RequestMatricesForHalfStorage(MatrixPool& matrixPool) override { NOT_IMPLEMENTED; }
+    virtual void ReleaseMatricesForHalfStorage(MatrixPool& matrixPool) override { NOT_IMPLEMENTED; }
+    virtual void PackValueToHalf() override { NOT_IMPLEMENTED; }
+    virtual void ExpandValueFromHalf() override { NOT_IMPLEMENTED; }
 
 protected: public:                                     // needed in ComputationNetwork::FindInRecurrentLoops(), which really should be part of SEQTraversalFlowControlNode
     std::vector<ComputationNodeBasePtr> m_nestedNodes; // nodes tucked away in this node, in evaluation order
+
+    // batched GEMM (see ComputationNetwork::DetermineForwardPropBatches()): [index into m_nestedNodes of the first node of a batch] -> all nodes of the batch
+    std::map<size_t, std::vector<ComputationNodeBasePtr>> m_forwardPropBatches;
+    std::vector<bool> m_isComputedByBatch; // [index into m_nestedNodes] true for the nodes of a batch except the first, which computes them
+
+    NodeProfiler* m_profiler; // if not null, the traversal reports every node to it (set by ComputationNetwork, see SetNodeProfiler())
+
+    void SetForwardPropBatches(const std::map<size_t, std::vector<ComputationNodeBasePtr>>& batches)
+    {
+        m_forwardPropBatches = batches;
+        m_isComputedByBatch.assign(m_nestedNodes.size(), false);
+        for (const auto& batch : batches)
+        {
+            for (size_t i = 1; i < batch.second.size(); i++)
+                m_isComputedByBatch[std::find(m_nestedNodes.begin(), m_nestedNodes.end(), batch.second[i]) - m_nestedNodes.begin()] = true;
+        }
+    }
 };
 
 // =======================================================================
@@ -1759,6 +2158,8 @@ protected:
     using Base::InvalidateMissingValueColumns;                                                                                                           \
     using Base::IsLeaf;                                                                                                                                  \
     using Base::IsOutOfDateWrtInputs;                                                                                                                 \
+    using Base::IsAbsorbedIntoConsumer;                                                                                                                  \
+    using Base::IsValueSharedWithInput;                                                                                                                  \
     using Base::IsPartOfLoop;                                                                                                                 \
     using Base::LinkToMBLayout;                                                                                                                          \
     using Base::Load;                                                                                                                                    \
@@ -1890,6 +2291,8 @@ public:
 #endif
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
 
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; } // (no attributes)
+
     virtual void /*IComputationNode::*/ BeginForwardProp() override // called before first iteration step of ForwardProp()
     {
         Base::BeginForwardProp();
@@ -75,12 +75,13 @@ public:
           m_verticalSubsample(SIZE_MAX),
           m_zeroPadding(false),
           m_maxTempMemSizeInSamples(SIZE_MAX),
-          m_imageLayoutKind(ImageLayoutKind::HWC)
+          m_imageLayoutKind(ImageLayoutKind::HWC),
+          m_groups(1)
     {
         SetDims(ImageDimensions::AsTensorShape(1, 1, 0, m_imageLayoutKind), 0);
     }
     ConvolutionNode(DEVICEID_TYPE deviceId, const wstring& name, const size_t kernelWidth, const size_t kernelHeight, const size_t outputChannels, const size_t horizontalSubsample, const size_t verticalSubsample, ImageLayoutKind imageLayoutKind,
-                    const bool zeroPadding = false, const size_t maxTempMemSizeInSamples = 0)
+                    const bool zeroPadding = false, const size_t maxTempMemSizeInSamples = 0, const size_t groups = 1)
         : Base(deviceId, name),
           m_outputChannels(outputChannels),
           m_kernelWidth(kernelWidth),
@@ -89,17 +90,20 @@ public:
           m_verticalSubsample(verticalSubsample),
           m_zeroPadding(zeroPadding),
           m_maxTempMemSizeInSamples(maxTempMemSizeInSamples),
-          m_imageLayoutKind(imageLayoutKind)
+          m_imageLayoutKind(imageLayoutKind),
+          m_groups(groups)
     {
+        if (m_groups == 0)
+            InvalidArgument("%ls %ls operation: groups must be at least 1.", NodeName().c_str(), OperationName().c_str());
         SetDims(ImageDimensions::AsTensorShape(1, 1, m_outputChannels, m_imageLayoutKind), 0); // TODO: necessary?
-        m_factory = ConvolutionEngineFactory<ElemType>::Create(deviceId, ConvolutionEngineFactory<ElemType>::EngineType::Auto, m_imageLayoutKind);
+        CreateFactory();
     }
     ConvolutionNode(const ScriptableObjects::IConfigRecordPtr configp)
         : ConvolutionNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"kernelWidth"), configp->Get(L"kernelHeight"), configp->Get(L"outputChannels"),
                           configp->Get(L"horizontalSubsample"), configp->Get(L"verticalSubsample"), ImageLayoutKindFrom(configp->Get(L"imageLayout")),
-                          configp->Get(L"zeroPadding"), configp->Get(L"maxTempMemSizeInSamples"))
+                          configp->Get(L"zeroPadding"), configp->Get(L"maxTempMemSizeInSamples"), configp->Get(L"groups"))
     {
-        // weightNodeName, inputValueNodeName, kernelWidth, kernelHeight, outputChannels, horizontalSubsample, verticalSubsample, zeroPadding = false, maxTempMemSizeInSamples = 0
+        // weightNodeName, inputValueNodeName, kernelWidth, kernelHeight, outputChannels, horizontalSubsample, verticalSubsample, zeroPadding = false, maxTempMemSizeInSamples = 0, groups = 1
         AttachInputs(configp, this->GetExpectedNumInputs());
     }
 
@@ -111,6 +115,7 @@ public:
         uint32_t outputChannels = (uint32_t) m_outputChannels;
         fstream << outputChannels << imageLayoutKind;
         fstream << m_zeroPadding << m_maxTempMemSizeInSamples;
+        fstream << m_groups;
     }
 
     void Load(File& fstream, size_t modelVersion) override
@@ -123,7 +128,10 @@ public:
         m_outputChannels = outputChannels;
         SetDims(ImageDimensions::AsTensorShape(1, 1, m_outputChannels, m_imageLayoutKind), HasMBLayout()); // TODO: needed?
         fstream >> m_zeroPadding >> m_maxTempMemSizeInSamples;
-        m_factory = ConvolutionEngineFactory<ElemType>::Create(GetDeviceId(), ConvolutionEngineFactory<ElemType>::EngineType::Auto, m_imageLayoutKind);
+        m_groups = 1;
+        if (modelVersion >= CNTK_MODEL_VERSION_5)
+            fstream >> m_groups;
+        CreateFactory();
     }
 
     void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
@@ -144,6 +152,8 @@ public:
 
             node->m_imageLayoutKind = m_imageLayoutKind;
 
+            node->m_groups = m_groups;
+
             *node->m_tempMatrix = *m_tempMatrix;
         }
     }
@@ -198,6 +208,12 @@ public:
 #endif
     }
 
+    // each output element is an inner product over the kernel across the input channels of its group
+    virtual double /*ComputationNodeBase::*/ EstimateFlops(const FrameRange& fr) const override
+    {
+        return 2.0 * GetSampleMatrixNumRows() * Input(0)->GetAsMatrixNumCols() * this->GetNumColsFor(fr);
+    }
+
     void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -217,14 +233,20 @@ public:
             (inDims.m_height - kernelHeightCenter) / m_verticalSubsample   + 1,
             m_outputChannels);
 
-        size_t weightCols = m_kernelWidth * m_kernelHeight * inDims.m_numChannels;
+        if (isFinalValidationPass && (inDims.m_numChannels % m_groups != 0 || m_outputChannels % m_groups != 0))
+            InvalidArgument("%ls %ls operation requires that the number of input channels (%d) and outputChannels (%d) be multiples of groups (%d).",
+                            NodeName().c_str(), OperationName().c_str(), (int) inDims.m_numChannels, (int) m_outputChannels, (int) m_groups);
+
+        // each filter spans the input channels of its group
+        size_t groupChannels = inDims.m_numChannels / m_groups;
+        size_t weightCols = m_kernelWidth * m_kernelHeight * groupChannels;
 
         // check/infer input [0] (weights)
         // BUGBUG: For now, we treat the weights as a 2D matrix. They should be a tensor proper.
         Input(0)->ValidateInferInputDimsFrom(TensorShape(m_outputChannels, weightCols));
 
         if (isFinalValidationPass && (Input(0)->GetAsMatrixNumCols() != weightCols || Input(0)->GetAsMatrixNumRows() != m_outputChannels))
-            LogicError("convolutionWeight matrix %ls should have dimension [%d, %d] which is [outputChannels, kernelWidth * kernelHeight * inputChannels]", Input(0)->NodeName().c_str(), (int) m_outputChannels, (int) weightCols);
+            LogicError("convolutionWeight matrix %ls should have dimension [%d, %d] which is [outputChannels, kernelWidth * kernelHeight * inputChannels / groups]", Input(0)->NodeName().c_str(), (int) m_outputChannels, (int) weightCols);
 
         // that's our dimension
         SetDims(outDims.AsTensorShape(m_imageLayoutKind), true);
@@ -243,11 +265,11 @@ public:
             if (m_inT == nullptr)
                 m_inT = m_factory->CreateTensor(inDims.m_width, inDims.m_height, inDims.m_numChannels, 1);
             if (m_filterT == nullptr)
-                m_filterT = m_factory->CreateFilter(m_kernelWidth, m_kernelHeight, inDims.m_numChannels, m_outputChannels);
+                m_filterT = m_factory->CreateFilter(m_kernelWidth, m_kernelHeight, groupChannels, m_outputChannels);
             if (m_outT == nullptr)
                 m_outT = m_factory->CreateTensor(outDims.m_width, outDims.m_height, outDims.m_numChannels, 1);
             if (m_convDesc == nullptr)
-                m_convDesc = m_factory->CreateConvDescriptor(*m_inT, *m_filterT, m_horizontalSubsample, m_verticalSubsample, m_zeroPadding);
+                m_convDesc = m_factory->CreateConvDescriptor(*m_inT, *m_filterT, m_horizontalSubsample, m_verticalSubsample, m_zeroPadding, m_groups);
             // REVIEW alexeyk: create per-channel bias (shared across all pixels). Consider adding other types of biases.
             if (m_biasT == nullptr)
                 m_biasT = m_factory->CreateTensor(1, 1, outDims.m_numChannels, 1);
@@ -268,7 +290,7 @@ public:
         fstream << string(str);
         sprintf(str, "Output[Width:%lu, Height:%lu, Channels:%lu]  \n", outDims.m_width, outDims.m_height, outDims.m_numChannels);
         fstream << string(str);
-        sprintf(str, "zeroPadding=%ls  maxTempMemSizeInSamples=%lu\n", m_zeroPadding ? L"true" : L"false", m_maxTempMemSizeInSamples);
+        sprintf(str, "zeroPadding=%ls  maxTempMemSizeInSamples=%lu  groups=%lu\n", m_zeroPadding ? L"true" : L"false", m_maxTempMemSizeInSamples, m_groups);
         fstream << string(str);
     }
 
@@ -277,6 +299,11 @@ public:
         m_maxTempMemSizeInSamples = maxTempMemSizeInSamples;
     }
 
+    ImageLayoutKind GetImageLayoutKind() const
+    {
+        return m_imageLayoutKind;
+    }
+
     // request matrices needed to do node function value evaluation
     void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
@@ -292,6 +319,13 @@ public:
     }
 
 private:
+    // grouped convolution on the GPU is only implemented by cuDNN, which takes HWC data as well
+    void CreateFactory()
+    {
+        auto engineType = m_groups > 1 && GetDeviceId() >= 0 ? ConvolutionEngineFactory<ElemType>::EngineType::CuDnn : ConvolutionEngineFactory<ElemType>::EngineType::Auto;
+        m_factory = ConvolutionEngineFactory<ElemType>::Create(GetDeviceId(), engineType, m_imageLayoutKind);
+    }
+
     size_t m_outputChannels;
     size_t m_kernelWidth, m_kernelHeight;
     size_t m_horizontalSubsample, m_verticalSubsample;
@@ -302,6 +336,7 @@ private:
     size_t m_maxTempMemSizeInSamples; // can change during runtime
 
     ImageLayoutKind m_imageLayoutKind; // how to interpret the tensor (which dimensions are X/Y and C)
+    size_t m_groups;                   // channel groups (see ConvolutionDescriptor::groups()); 1 for a dense convolution
 
     std::unique_ptr<ConvolutionEngineFactory<ElemType>> m_factory;
     std::unique_ptr<ConvolutionEngine<ElemType>> m_convEng;
@@ -115,16 +115,20 @@ public:
             if (cols > 1) // in some legacy format, last tensor dimension was split off as an explicit column dimension
                 sampleLayout.AppendInPlace(sampleLayout.GetRank(), cols);
         }
+        MemoryAccounting::Context memory(*this, MemoryAccounting::value);
         LoadValue(fstream);
         SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
         VerifyDataSize(Value());      // sanity check
     }
 
     // initialize with random numbers
+    // By default, they come from the counter-based generator of Philox.h on the device of the parameter, which gives the same
+    // values on the CPU and the GPU. 'initOnCPUOnly' selects the sequential generator of the CPU instead, which reproduces the
+    // initialization of models (and test baselines) created before.
     void InitRandom(const bool uniformInit,
                     const unsigned long randomSeed,
                     const ElemType initValueScale,
-                    bool initOnCPUOnly) // if true then always init on CPU, making initialization consistent across both (for testing)
+                    bool initOnCPUOnly) // if true then always init on CPU with the legacy generator
     {
         // fprintf(stderr, "%d x %d: %d  %ls\n", (int)GetNumRows(), (int)GetNumCols(), (int)randomSeed, NodeName().c_str());
 
@@ -140,13 +144,19 @@ public:
         {
             // TODO: move these hidden extra factors out from here and into NDL, and make them visible in BS
             ElemType randRange = 0.05f * initValueScale;
-            value.SetUniformRandomValue(-randRange, randRange, randomSeed);
+            if (initOnCPUOnly)
+                value.SetUniformRandomValue(-randRange, randRange, randomSeed);
+            else
+                value.SetPhiloxUniformRandomValue(-randRange, randRange, randomSeed);
         }
         else
         {
             size_t inputSize = GetAsMatrixNumCols();
             ElemType randInitstd = 0.2f * initValueScale / sqrt(ElemType(inputSize));
-            value.SetGaussianRandomValue(0, randInitstd, randomSeed);
+            if (initOnCPUOnly)
+                value.SetGaussianRandomValue(0, randInitstd, randomSeed);
+            else
+                value.SetPhiloxGaussianRandomValue(0, randInitstd, randomSeed);
         }
         if (initOnCPUOnly)
             Value().TransferToDeviceIfNotThereAndNotAutoPlace(m_deviceId, true);
@@ -493,6 +503,19 @@ public:
         }
     }
 
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // With a sparse input only the columns of the words present in the minibatch receive a gradient,
+        // so the gradient of the embedding matrix is allocated in block-sparse format instead of from the pool, as in TimesNode.
+        if (Input(0)->NeedGradient() && Input(1)->Value().GetMatrixType() == SPARSE)
+        {
+            Input(0)->CreateGradientMatrixIfNull();
+            Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
     /*TODO: merge with call site*/ void BackpropToLeft(Matrix<ElemType>& inputFunctionValues, Matrix<ElemType>& inputGradientValues, Matrix<ElemType>& gradientValues)
     {
         size_t rows1 = inputFunctionValues.GetNumRows(), cols1 = inputFunctionValues.GetNumCols();
@@ -590,7 +613,7 @@ public:
             if (!ISCLOSE(Value()(0, 0), 1.0, EPSILON) ||
                 !ISCLOSE(Value()(0, 1), 2.0, EPSILON) ||
                 !ISCLOSE(Value()(1, 1), 2.0, EPSILON))
-                throw("LSTMNode forward computation error");
+                throw("LookupTableNode forward computation error");
 
             Value().TransferToDeviceIfNotThere(m_deviceId, true);
 
@@ -605,12 +628,11 @@ public:
                 BackpropTo(i, FrameRange(m_pMBLayout));
 
             // check with expected values
-            if (!ISCLOSE(Input(1)->Gradient()(0, 0), 2, EPSILON)    // bi
-                || !ISCLOSE(Input(1)->Gradient()(0, 1), 2, EPSILON) // Wxi
-                || !ISCLOSE(Input(1)->Gradient()(1, 0), 2, EPSILON) // Whi
-                || !ISCLOSE(Input(1)->Gradient()(2, 1), 2, EPSILON) // Wci
-                )
-                throw("LSTMNode gradient error on input gates");
+            if (!ISCLOSE(Input(1)->Gradient()(0, 0), 2, EPSILON) ||
+                !ISCLOSE(Input(1)->Gradient()(0, 1), 2, EPSILON) ||
+                !ISCLOSE(Input(1)->Gradient()(1, 0), 2, EPSILON) ||
+                !ISCLOSE(Input(1)->Gradient()(2, 1), 2, EPSILON))
+                throw("LookupTableNode gradient error on the input");
 
             for (size_t i = 0; i < 2; i++)
                 Input(i)->Gradient().TransferToDeviceIfNotThere(m_deviceId, true);
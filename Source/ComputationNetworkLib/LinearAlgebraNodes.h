@@ -8,6 +8,8 @@
 #include "ComputationNode.h"
 #include "ConvolutionalNodes.h"
 #include "Matrix.h"
+#include "Int8QuantizedMatrix.h"
+#include "PackedGemmMatrix.h"
 #include "TensorView.h"
 
 #include <unordered_set>
@@ -46,6 +48,9 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (IsAbsorbedIntoConsumer()) // our consumer has already propagated into our inputs
+            return;
+
         size_t rank = DetermineElementwiseTensorRank();
         auto gradient = GradientTensorFor(rank, fr);
         auto inputGradient = Input(inputIndex)->GradientTensorFor(rank, fr.AllowBroadcast());
@@ -57,8 +62,14 @@ public:
         inputGradient.AddCopyOf(gradient);
     }
 
+    // the gradient w.r.t. either summand is ours (an input that shares it has it already, see ComputationNetwork::ShareBuffersWithConsumers())
+    virtual bool CanShareGradientWithInput(size_t /*inputIndex*/) const override { return true; }
+
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
+        if (IsAbsorbedIntoConsumer()) // our consumer computes f(input0 + input1) in one go
+            return;
+
         size_t rank = DetermineElementwiseTensorRank();
         auto result = ValueTensorFor(rank, fr);
         auto input0 = Input(0)->ValueTensorFor(rank, fr.AllowBroadcast());
@@ -105,6 +116,9 @@ public:
         inputGradient.AddCopyOf(gradient, sign);
     }
 
+    // the gradient w.r.t. the minuend is ours
+    virtual bool CanShareGradientWithInput(size_t inputIndex) const override { return inputIndex == 0; }
+
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
         size_t rank = DetermineElementwiseTensorRank();
@@ -192,6 +206,8 @@ public:
     {
     }
 
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; } // (the int8 and packed weights are derived)
+
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
         if (inputIndex == 0) // left derivative
@@ -235,8 +251,25 @@ public:
 #if DUMPOUTPUT
         Input(0)->ValueAsMatrix().Print("TimesNode - Input0");
 #endif
-        // BUGBUG: This uses correct Matrix dimensions when multiplying with a non-minibatch only by luck. To be fixed when we allow to apply TimesNode to a subset of tensor dimensions.
-        sliceOutputValue.AssignProductOf(Input(0)->ValueAsMatrix(), m_transpose, sliceInput1Value, false);
+        if (m_int8Weights && sliceInput1Value.GetMatrixType() == DENSE && sliceInput1Value.GetDeviceId() == CPUDEVICE)
+        {
+            if (sliceInput1Value.GetNumRows() != m_int8Weights->GetNumCols())
+                LogicError("%ls %ls operation: The int8 weights do not match the inner dimension of the input (%d vs. %d).", this->NodeName().c_str(), this->OperationName().c_str(), (int) m_int8Weights->GetNumCols(), (int) sliceInput1Value.GetNumRows());
+            sliceOutputValue.VerifySize(m_int8Weights->GetNumRows(), sliceInput1Value.GetNumCols());
+            m_int8Weights->Multiply(sliceInput1Value.BufferPointer(), sliceInput1Value.GetNumCols(), sliceOutputValue.BufferPointer());
+        }
+        else if (UsePackedWeights(sliceInput1Value))
+        {
+            if (sliceInput1Value.GetNumRows() != m_packedWeights->GetNumCols())
+                LogicError("%ls %ls operation: The packed weights do not match the inner dimension of the input (%d vs. %d).", this->NodeName().c_str(), this->OperationName().c_str(), (int) m_packedWeights->GetNumCols(), (int) sliceInput1Value.GetNumRows());
+            sliceOutputValue.VerifySize(m_packedWeights->GetNumRows(), sliceInput1Value.GetNumCols());
+            m_packedWeights->Multiply(sliceInput1Value.BufferPointer(), sliceInput1Value.GetNumCols(), sliceOutputValue.BufferPointer());
+        }
+        else
+        {
+            // BUGBUG: This uses correct Matrix dimensions when multiplying with a non-minibatch only by luck. To be fixed when we allow to apply TimesNode to a subset of tensor dimensions.
+            sliceOutputValue.AssignProductOf(Input(0)->ValueAsMatrix(), m_transpose, sliceInput1Value, false);
+        }
 #if NANCHECK
         sliceOutputValue.HasNan("Times");
 #endif
@@ -245,6 +278,56 @@ public:
 #endif
     }
 
+    virtual double /*ComputationNodeBase::*/ EstimateFlops(const FrameRange& fr) const override
+    {
+        bool transpose = m_transpose; // (assigning to a non-const variable avoids a compiler warning C4127: conditional expression is constant)
+        size_t innerDim = transpose ? Input(0)->GetAsMatrixNumRows() : Input(0)->GetAsMatrixNumCols();
+        return 2.0 * GetSampleMatrixNumRows() * innerDim * this->GetNumColsFor(fr);
+    }
+
+    // products with dense weights of the same dimensions and inputs of the same dimensions become a single batched GEMM;
+    // the others (e.g. int8, packed, or sparse) are computed by their own ForwardProp()
+    virtual void /*ComputationNodeBase::*/ ForwardPropBatched(const std::vector<ComputationNodeBasePtr>& batch, const FrameRange& fr) override
+    {
+        std::vector<Matrix<ElemType>> slices; // input and output slices of the batched nodes; reserved so that the pointers below stay valid
+        slices.reserve(2 * batch.size());
+        std::vector<const Matrix<ElemType>*> weights, inputs;
+        std::vector<Matrix<ElemType>*> outputs;
+        for (const auto& nodeBase : batch)
+        {
+            auto node = dynamic_pointer_cast<TimesNodeBase<ElemType, m_transpose>>(nodeBase);
+            if (node)
+            {
+                const FrameRange nodeFr = fr.WithLayout(node->GetMBLayout());
+                const auto& weight = node->Input(0)->ValueAsMatrix();
+                auto input = node->Input(1)->ValueFor(nodeFr);
+                bool qualifies = !node->m_int8Weights && !node->UsePackedWeights(input) && weight.GetMatrixType() == DENSE && input.GetMatrixType() == DENSE &&
+                                 (weights.empty() || (weight.GetDeviceId() == weights[0]->GetDeviceId() &&
+                                                      weight.GetNumRows() == weights[0]->GetNumRows() && weight.GetNumCols() == weights[0]->GetNumCols() &&
+                                                      input.GetNumRows() == inputs[0]->GetNumRows() && input.GetNumCols() == inputs[0]->GetNumCols()));
+                if (qualifies)
+                {
+                    weights.push_back(&weight);
+                    slices.push_back(std::move(input));
+                    inputs.push_back(&slices.back());
+                    slices.push_back(node->ValueFor(nodeFr));
+                    outputs.push_back(&slices.back());
+                    continue;
+                }
+            }
+            nodeBase->ForwardProp(fr.WithLayout(nodeBase->GetMBLayout()));
+        }
+
+        if (outputs.size() == 1)
+            outputs[0]->AssignProductOf(*weights[0], m_transpose, *inputs[0], false);
+        else if (outputs.size() > 1)
+            Matrix<ElemType>::MultiplyAndWeightedAddBatched(1, weights, m_transpose, inputs, false, 0, outputs);
+#if NANCHECK
+        for (auto* output : outputs)
+            output->HasNan("Times");
+#endif
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -299,6 +382,48 @@ public:
         // so that the default allocator will not allocate it again.
         Base::AllocateGradientMatricesForInputs(matrixPool);
     }
+
+    // only dense learnable weights on the CPU qualify; the input stays in float and is quantized per minibatch
+    virtual bool /*ComputationNodeBase::*/ QuantizeWeightsToInt8() override
+    {
+        if (Input(0)->OperationName() != L"LearnableParameter" || Input(0)->GetDeviceId() != CPUDEVICE || Input(0)->Value().GetMatrixType() != DENSE)
+            return false;
+        const auto& weights = Input(0)->ValueAsMatrix();
+        m_int8Weights = make_shared<Int8QuantizedMatrix<ElemType>>(weights.BufferPointer(), weights.GetNumRows(), weights.GetNumCols(), m_transpose);
+        return true;
+    }
+
+    // the same weights qualify, unless they are already int8
+    virtual bool /*ComputationNodeBase::*/ PackWeightsForInference() override
+    {
+        if (m_int8Weights || Input(0)->OperationName() != L"LearnableParameter" || Input(0)->GetDeviceId() != CPUDEVICE || Input(0)->Value().GetMatrixType() != DENSE)
+            return false;
+        const auto& weights = Input(0)->ValueAsMatrix();
+        m_packedWeights = make_shared<PackedGemmMatrix<ElemType>>(weights.BufferPointer(), weights.GetNumRows(), weights.GetNumCols(), m_transpose);
+        return true;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<TimesNodeBase<ElemType, m_transpose>>(nodeP);
+            node->m_int8Weights = m_int8Weights; // read-only, so copies may share them
+            node->m_packedWeights = m_packedWeights;
+        }
+    }
+
+private:
+    // the packed weights pay off for the few columns of a latency-critical request; larger products go to the BLAS
+    bool UsePackedWeights(const Matrix<ElemType>& input) const
+    {
+        return m_packedWeights && input.GetMatrixType() == DENSE && input.GetDeviceId() == CPUDEVICE &&
+               input.GetNumCols() <= PackedGemmMatrix<ElemType>::maxPackedColumns;
+    }
+
+    shared_ptr<Int8QuantizedMatrix<ElemType>> m_int8Weights; // set by QuantizeWeightsToInt8()
+    shared_ptr<PackedGemmMatrix<ElemType>> m_packedWeights;  // set by PackWeightsForInference()
 };
 
 // -----------------------------------------------------------------------
@@ -353,6 +478,305 @@ public:
 template class TransposeTimesNode<float>;
 template class TransposeTimesNode<double>;
 
+// -----------------------------------------------------------------------
+// LowRankTimesNode (U, V, B) -- U (V B), i.e. Times with a weight matrix given by two low-rank factors
+// U: [m x r], V: [r x n]. This is what ParameterSVD turns Times(W, B) into. Unlike Times(Times(U, V), B), the product
+// U V is never formed; the two GEMMs with r rows in between take (m + n) r instead of m n multiply-adds per column.
+// The intermediate V B is kept in a workspace for backprop, which is only resized when the minibatch size changes.
+// Right operand and output can have MB layout, while the factors cannot.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class LowRankTimesNode : public ComputationNode<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"LowRankTimes";
+    }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(LowRankTimesNode);
+    LowRankTimesNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        auto sliceInput2Value = Input(2)->ValueFor(fr);
+        auto sliceOutputValue = ValueFor(fr);
+
+        // the workspace covers all columns of the output, so that it holds V B of all frames in backprop
+        const size_t rank = Input(1)->GetAsMatrixNumRows();
+        if (m_lowRankValue->GetNumRows() != rank || m_lowRankValue->GetNumCols() != Value().GetNumCols())
+            m_lowRankValue->Resize(rank, Value().GetNumCols());
+        auto sliceLowRankValue = DataFor(*m_lowRankValue, fr);
+
+        sliceLowRankValue.AssignProductOf(Input(1)->ValueAsMatrix(), false, sliceInput2Value, false);
+        sliceOutputValue.AssignProductOf(Input(0)->ValueAsMatrix(), false, sliceLowRankValue, false);
+#if NANCHECK
+        sliceOutputValue.HasNan("LowRankTimes");
+#endif
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        if (inputIndex == 0) // U += dY (V B)^T
+        {
+            // this potentially computes inner products over time, so we use the Masked- variants
+            auto sliceOutputGrad = MaskedGradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(sliceOutputGrad, false, DataFor(*m_lowRankValue, fr), true, Input(0)->GradientAsMatrix());
+            return;
+        }
+
+        // the gradient w.r.t. V B is shared by V and B; it is computed for whichever of them comes first
+        if (inputIndex == 1 || !Input(1)->NeedGradient())
+        {
+            if (m_lowRankGradient->GetNumRows() != m_lowRankValue->GetNumRows() || m_lowRankGradient->GetNumCols() != m_lowRankValue->GetNumCols())
+                m_lowRankGradient->Resize(m_lowRankValue->GetNumRows(), m_lowRankValue->GetNumCols());
+            DataFor(*m_lowRankGradient, fr).AssignProductOf(Input(0)->ValueAsMatrix(), true, MaskedGradientFor(fr), false);
+        }
+        auto sliceLowRankGrad = DataFor(*m_lowRankGradient, fr);
+
+        if (inputIndex == 1) // V += dZ B^T  with Z = V B
+        {
+            auto sliceInput2Value = Input(2)->MaskedValueFor(fr);
+            // currently we only support one combination when the input is sparse.
+            if (sliceInput2Value.GetMatrixType() == SPARSE && Input(1)->Gradient().GetMatrixType() == DENSE)
+                Input(1)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+            Matrix<ElemType>::MultiplyAndAdd(sliceLowRankGrad, false, sliceInput2Value, true, Input(1)->GradientAsMatrix());
+        }
+        else // B += V^T dZ
+        {
+            auto sliceInput2Grad = Input(2)->GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(Input(1)->ValueAsMatrix(), true, sliceLowRankGrad, false, sliceInput2Grad);
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        // the intermediate V B is kept in m_lowRankValue
+        return false;
+    }
+
+    virtual double /*ComputationNodeBase::*/ EstimateFlops(const FrameRange& fr) const override
+    {
+        return 2.0 * (GetSampleMatrixNumRows() + Input(1)->GetAsMatrixNumCols()) * Input(1)->GetAsMatrixNumRows() * this->GetNumColsFor(fr);
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        if (isFinalValidationPass && (Input(0)->HasMBLayout() || Input(1)->HasMBLayout()))
+            InvalidArgument("%ls LowRankTimes operation requires the factors to not be minibatch data (must not have an MBLayout).", NodeName().c_str());
+        InferMBLayoutFromInputsForStandardCase();
+
+        // support automatic dimension inference for learnable parameters: the inner dimensions of V from B, of U from V
+        size_t rows0 = Input(0)->GetAsMatrixNumRows(), rank = Input(1)->GetAsMatrixNumRows();
+        size_t rows2 = Input(2)->HasMBLayout() ? Input(2)->GetSampleMatrixNumRows() : Input(2)->GetAsMatrixNumRows();
+        Input(1)->ValidateInferInputDimsFrom(TensorShape(rank, rows2));
+        Input(0)->ValidateInferInputDimsFrom(TensorShape(rows0, rank));
+
+        size_t cols1 = Input(1)->GetAsMatrixNumCols();
+        if (Input(2)->HasMBLayout())
+        {
+            Input(2)->ValidateInferInputDimsFrom(TensorShape(cols1));
+            SetDims(TensorShape(rows0), true);
+        }
+        else // multiplying straight matrices
+        {
+            size_t cols2 = Input(2)->GetAsMatrixNumCols();
+            Input(2)->ValidateInferInputDimsFrom(TensorShape(cols1, cols2));
+            SetDims(TensorShape(rows0, cols2), false);
+        }
+
+        // update after inference
+        rows2 = Input(2)->HasMBLayout() ? Input(2)->GetSampleMatrixNumRows() : Input(2)->GetAsMatrixNumRows();
+        if (isFinalValidationPass && Input(0)->GetAsMatrixNumCols() != Input(1)->GetAsMatrixNumRows())
+            InvalidArgument("The rank of the factors in the %ls LowRankTimes operation does not match (%d vs. %d).", NodeName().c_str(),
+                            (int) Input(0)->GetAsMatrixNumCols(), (int) Input(1)->GetAsMatrixNumRows());
+        if (isFinalValidationPass && cols1 != rows2)
+            InvalidArgument("The inner matrix dimension in the %ls LowRankTimes operation does not match (%d vs. %d).", NodeName().c_str(), (int) rows2, (int) cols1);
+    }
+
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // as for TimesNode, the gradient of the factor multiplied with a sparse input is sparse and not from the pool
+        if (Input(1)->NeedGradient() && Input(2)->Value().GetMatrixType() == SPARSE)
+        {
+            Input(1)->CreateGradientMatrixIfNull();
+            Input(1)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
+    // the intermediate V B is needed from forward prop until backprop
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_lowRankValue, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_lowRankGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_lowRankValue, matrixPool);
+        ReleaseMatrixToPool(m_lowRankGradient, matrixPool);
+    }
+
+private:
+    Matrix<ElemType> DataFor(Matrix<ElemType>& data, const FrameRange& fr)
+    {
+        return DataWithMBLayoutFor(data, fr, m_pMBLayout);
+    }
+
+    shared_ptr<Matrix<ElemType>> m_lowRankValue;    // [r x cols] V B
+    shared_ptr<Matrix<ElemType>> m_lowRankGradient; // [r x cols] U^T dY
+};
+
+template class LowRankTimesNode<float>;
+template class LowRankTimesNode<double>;
+
+// -----------------------------------------------------------------------
+// SparseWeightTimesNode (A, B) -- Times with pruned weights A, which are multiplied in sparse (CSC) format
+// The model keeps A dense, so it saves and loads like Times; the sparse copy is made on first use on A's device.
+// Weights pruned in blocks of consecutive rows (ComputationNetwork::PruneWeights()) give the CPU kernel contiguous runs.
+// A sparse right operand is multiplied with the dense weights. The weights are not trained.
+// Right operand and output can have MB layout, while the weights cannot.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class SparseWeightTimesNode : public ComputationNode<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"SparseWeightTimes";
+    }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(SparseWeightTimesNode);
+    SparseWeightTimesNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        auto sliceInput1Value = Input(1)->ValueFor(fr);
+        auto sliceOutputValue = ValueFor(fr);
+        sliceOutputValue.AssignProductOf(WeightsFor(sliceInput1Value), false, sliceInput1Value, false);
+#if NANCHECK
+        sliceOutputValue.HasNan("SparseWeightTimes");
+#endif
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        if (inputIndex == 0)
+            LogicError("%ls %ls operation: The pruned weights '%ls' cannot be trained.", NodeName().c_str(), OperationName().c_str(), Input(0)->NodeName().c_str());
+
+        auto sliceInput1Grad = Input(1)->GradientFor(fr);
+        Matrix<ElemType>::MultiplyAndAdd(WeightsFor(sliceInput1Grad), true, GradientFor(fr), false, sliceInput1Grad);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        return false;
+    }
+
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override
+    {
+        // only the weights, of which the sparse copy may still have to be made
+        return childIndex == 0;
+    }
+
+    virtual double /*ComputationNodeBase::*/ EstimateFlops(const FrameRange& fr) const override
+    {
+        double nonZeros = m_sparseWeights ? (double) m_sparseWeights->NzCount() : (double) Input(0)->GetAsMatrixNumRows() * Input(0)->GetAsMatrixNumCols();
+        return 2.0 * nonZeros * this->GetNumColsFor(fr);
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        if (isFinalValidationPass && Input(0)->HasMBLayout())
+            InvalidArgument("%ls SparseWeightTimes operation requires the weights to not be minibatch data (must not have an MBLayout).", NodeName().c_str());
+        InferMBLayoutFromInputsForStandardCase();
+
+        size_t rows0 = Input(0)->GetAsMatrixNumRows(), cols0 = Input(0)->GetAsMatrixNumCols();
+        size_t rows1 = Input(1)->HasMBLayout() ? Input(1)->GetSampleMatrixNumRows() : Input(1)->GetAsMatrixNumRows();
+        if (Input(1)->HasMBLayout())
+            SetDims(TensorShape(rows0), true);
+        else
+            SetDims(TensorShape(rows0, Input(1)->GetAsMatrixNumCols()), false);
+        if (isFinalValidationPass && cols0 != rows1)
+            InvalidArgument("The inner matrix dimension in the %ls SparseWeightTimes operation does not match (%d vs. %d).", NodeName().c_str(), (int) rows1, (int) cols0);
+
+        Input(0)->SetParameterUpdateRequired(false); // pruned weights are not trained, which would fill in the zeros
+        m_sparseWeights.reset();                     // the weights may have been edited
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<SparseWeightTimesNode<ElemType>>(nodeP);
+            node->m_sparseWeights = m_sparseWeights; // read-only, so copies may share it
+        }
+    }
+
+private:
+    // the sparse copy of the weights, or the weights themselves for a sparse 'other' operand (Matrix has no sparse-times-sparse into dense)
+    const Matrix<ElemType>& WeightsFor(const Matrix<ElemType>& other)
+    {
+        const auto& weights = Input(0)->ValueAsMatrix();
+        if (other.GetMatrixType() == SPARSE || weights.GetMatrixType() == SPARSE)
+            return weights;
+        if (!m_sparseWeights || m_sparseWeights->GetDeviceId() != weights.GetDeviceId())
+            m_sparseWeights = SparseCopyOf(weights);
+        return *m_sparseWeights;
+    }
+
+    static shared_ptr<Matrix<ElemType>> SparseCopyOf(const Matrix<ElemType>& weights)
+    {
+        const size_t rows = weights.GetNumRows(), cols = weights.GetNumCols();
+        unique_ptr<ElemType[]> dense(weights.CopyToArray());
+        vector<CPUSPARSE_INDEX_TYPE> colStarts(1, 0), rowIds;
+        vector<ElemType> values;
+        for (size_t j = 0; j < cols; j++)
+        {
+            for (size_t i = 0; i < rows; i++)
+            {
+                if (dense[j * rows + i] != 0)
+                {
+                    rowIds.push_back((CPUSPARSE_INDEX_TYPE) i);
+                    values.push_back(dense[j * rows + i]);
+                }
+            }
+            colStarts.push_back((CPUSPARSE_INDEX_TYPE) values.size());
+        }
+        auto sparse = make_shared<Matrix<ElemType>>(rows, cols, weights.GetDeviceId(), SPARSE, matrixFormatSparseCSC);
+        sparse->SetMatrixFromCSCFormat(colStarts.data(), rowIds.data(), values.data(), values.size(), rows, cols);
+        return sparse;
+    }
+
+    shared_ptr<Matrix<ElemType>> m_sparseWeights; // CSC copy of Input(0), made by WeightsFor()
+};
+
+template class SparseWeightTimesNode<float>;
+template class SparseWeightTimesNode<double>;
+
 // -----------------------------------------------------------------------
 // ElementTimesNode (factor1, factor2)
 // This allows broadcasting, and can thus also scale with a row, a column, or a scalar.
@@ -430,22 +854,24 @@ public:
     {
     }
 
+    // The slices are viewed as rows x cols tensors and the diagonal as a rows x 1 tensor broadcast along the columns, so that
+    // each direction is one fused elementwise operation without temporary copies; the gradient of the diagonal is reduced
+    // over the columns on the fly.
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
         if (inputIndex == 0) // left derivative
         {
             Matrix<ElemType> sliceOutputGrad = MaskedGradientFor(fr); // use Masked- version since this is reducing over frames
             Matrix<ElemType> sliceInput1Value = Input(1)->MaskedValueFor(fr);
-            m_innerproduct->AssignInnerProductOf(sliceOutputGrad, sliceInput1Value, false);
-            Input(0)->GradientAsMatrix() += *m_innerproduct;
+            TensorShape shape(sliceOutputGrad.GetNumRows(), sliceOutputGrad.GetNumCols());
+            TensorView<ElemType>(Input(0)->GradientAsMatrix(), TensorShape(shape[0], 1)).AddElementwiseProductOf(TensorView<ElemType>(sliceOutputGrad, shape), TensorView<ElemType>(sliceInput1Value, shape));
         }
         else // right derivative
         {
             Matrix<ElemType> sliceOutputGrad = GradientFor(fr);
             Matrix<ElemType> sliceInput1Grad = Input(1)->GradientFor(fr);
-            m_rightGradient->SetValue(sliceOutputGrad);
-            m_rightGradient->ColumnElementMultiplyWith(Input(0)->ValueAsMatrix());
-            sliceInput1Grad += *m_rightGradient;
+            TensorShape shape(sliceOutputGrad.GetNumRows(), sliceOutputGrad.GetNumCols());
+            TensorView<ElemType>(sliceInput1Grad, shape).AddElementwiseProductOf(TensorView<ElemType>(sliceOutputGrad, shape), TensorView<ElemType>(Input(0)->ValueAsMatrix(), TensorShape(shape[0], 1)));
         }
     }
 
@@ -460,9 +886,8 @@ public:
     {
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
-
-        sliceOutputValue.SetValue(sliceInput1Value);
-        sliceOutputValue.ColumnElementMultiplyWith(Input(0)->ValueAsMatrix());
+        TensorShape shape(sliceOutputValue.GetNumRows(), sliceOutputValue.GetNumCols());
+        TensorView<ElemType>(sliceOutputValue, shape).AssignElementwiseProductOf(TensorView<ElemType>(Input(0)->ValueAsMatrix(), TensorShape(shape[0], 1)), TensorView<ElemType>(sliceInput1Value, shape));
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -501,36 +926,6 @@ public:
 
         SetDims(Input(1));
     }
-
-    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
-    {
-        Base::CopyTo(nodeP, newName, flags);
-        if (flags & CopyNodeFlags::copyNodeValue)
-        {
-            auto node = dynamic_pointer_cast<DiagTimesNode<ElemType>>(nodeP);
-            *node->m_innerproduct = *m_innerproduct;
-            *node->m_rightGradient = *m_rightGradient;
-        }
-    }
-    // request matrices that are needed for gradient computation
-    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool)
-    {
-        Base::RequestMatricesBeforeBackprop(matrixPool);
-        RequestMatrixFromPool(m_innerproduct, matrixPool);
-        RequestMatrixFromPool(m_rightGradient, matrixPool);
-    }
-
-    // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
-    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool)
-    {
-        Base::ReleaseMatricesAfterBackprop(matrixPool);
-        ReleaseMatrixToPool(m_innerproduct, matrixPool);
-        ReleaseMatrixToPool(m_rightGradient, matrixPool);
-    }
-
-private:
-    shared_ptr<Matrix<ElemType>> m_innerproduct;
-    shared_ptr<Matrix<ElemType>> m_rightGradient;
 };
 
 template class DiagTimesNode<float>;
@@ -971,114 +1366,18 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (inputIndex > 1) // shift and neg are constants
+            return;
+
         Matrix<ElemType> sliceInput0Value = Input(0)->ValueFor(fr);
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
         Matrix<ElemType> sliceInputGrad = Input(inputIndex)->GradientFor(fr);
         Matrix<ElemType> sliceThisGrad = GradientFor(fr);
 
-        BackpropToS(inputIndex, *m_invNorm0, *m_invNorm1, sliceOutputValue, *m_temp, *m_rightTerm, *m_leftTerm, *m_invNormSquare, sliceInput0Value, sliceInput1Value, Input(2)->Value(), Input(3)->Value(), sliceInputGrad, sliceThisGrad);
-    }
-
-    // functionValues, invNorm0, invNorm1 - output from the EvaluateNode() method
-    // temp, rightTerm, leftTerm - temporary matrices
-    // in0, in1, in2, in3 - input functionValues from other nodes
-    // inputGradientValues(x) - gradients to update, where x matches inputIndex
-    /*TODO: merge with call site*/ void BackpropToS(const size_t inputIndex, const Matrix<ElemType>& invNorm0, const Matrix<ElemType>& invNorm1, const Matrix<ElemType>& functionValues,
-                                                    Matrix<ElemType>& temp, Matrix<ElemType>& rightTerm, Matrix<ElemType>& leftTerm, Matrix<ElemType>& invNormSquare, // the temporary variables
-                                                    const Matrix<ElemType>& in0, const Matrix<ElemType>& in1, const Matrix<ElemType>& in2, const Matrix<ElemType>& in3,
-                                                    Matrix<ElemType>& inputGradientValues, Matrix<ElemType>& thisGradientValues)
-    {
-        size_t shift = (size_t) in2.Get00Element();
-        size_t negNumber = (size_t) in3.Get00Element();
-        size_t numCols = in0.GetNumCols(); // used in computing right child's graident
-
-        if (inputIndex == 0) // left derivative
-        {
-            invNormSquare.AssignElementProductOf(invNorm0, invNorm0);
-
-            for (long m = 0; m < negNumber + 1; m++)
-            {
-                temp.GetARowByIndex(functionValues, m); // set this matrx to be the m-th row in functionValues
-                temp.ElementMultiplyWith(invNormSquare);
-
-                Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in0, rightTerm, 0, true);
-
-                if (m == 0)
-                {
-                    temp.AssignElementProductOf(invNorm0, invNorm1);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in1, leftTerm, 0, true);
-                }
-                else
-                {
-                    size_t currshift = m + shift - 1; // for current line, how much should we shift
-
-                    temp.AssignElementProductOfWithShift(invNorm0, invNorm1, currshift); // this is a row vector
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in1, leftTerm, currshift, true);
-                }
-
-                leftTerm = leftTerm - rightTerm;
-
-                temp.GetARowByIndex(thisGradientValues, m);
-
-                Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, leftTerm, rightTerm, 0, true);
-
-                inputGradientValues += rightTerm;
-            }
-        }
-        else // right part
-        {
-            invNormSquare.AssignElementProductOf(invNorm1, invNorm1); // this matrix should be save and unchanged. It should not be changed
-
-            for (long m = 0; m < negNumber + 1; m++)
-            {
-                temp.GetARowByIndex(functionValues, m); // set this matrx to be the m-th row in functionValues
-
-                if (m == 0) // this is the first line. computation should be symmetric
-                {
-                    // the following is for the right part
-                    temp.ElementMultiplyWith(invNormSquare);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in1, rightTerm, 0, true);
-
-                    // the following is for the left part
-                    temp.AssignElementProductOf(invNorm0, invNorm1);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in0, leftTerm, 0, true);
-
-                    leftTerm = leftTerm - rightTerm;
-
-                    temp.GetARowByIndex(thisGradientValues, m);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, leftTerm, rightTerm, 0, true);
-
-                    inputGradientValues += rightTerm;
-                }
-                else // this requires shift
-                {
-                    size_t currshift = (m + shift - 1) % numCols;
-                    size_t reverseshift = numCols - currshift;
-
-                    leftTerm.AssignElementProductOfWithShift(invNormSquare, temp, reverseshift); // use leftTerm as a temp variable here
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(leftTerm, in1, rightTerm, 0, true);
-
-                    temp.AssignElementProductOfWithShift(invNorm1, invNorm0, reverseshift);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in0, leftTerm, reverseshift, true);
-
-                    leftTerm = leftTerm - rightTerm;
-
-                    temp.GetARowByIndex(thisGradientValues, m);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, leftTerm, rightTerm, reverseshift, false);
-
-                    inputGradientValues += rightTerm;
-                }
-            }
-        }
+        // a single pass per input that gathers, for each column, the terms of all the similarities it took part in
+        size_t shift = (size_t) Input(2)->Get00Element();
+        Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient(sliceInput0Value, sliceInput1Value, *m_invNorm0, *m_invNorm1, sliceOutputValue, sliceThisGrad, shift, /*wrtRight=*/inputIndex == 1, sliceInputGrad);
     }
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
@@ -1087,31 +1386,10 @@ public:
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
 
-        ForwardPropS(*m_invNorm0, *m_invNorm1, sliceOutputValue, sliceInput0Value, sliceInput1Value, Input(2)->Value(), Input(3)->Value(), *m_leftTerm, *m_rightTerm);
-    }
-
-    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType>& invNorm0, Matrix<ElemType>& invNorm1, Matrix<ElemType>& functionValues, Matrix<ElemType>& in0, Matrix<ElemType>& in1, Matrix<ElemType>& in2, Matrix<ElemType>& in3, Matrix<ElemType>& leftTermTemp, Matrix<ElemType>& rightTermTemp)
-    {
-        invNorm0.AssignVectorNorm2Of(in0, true); // seems to modify input (in0)
-        invNorm0.AssignElementInverseOf(invNorm0);
-
-        invNorm1.AssignVectorNorm2Of(in1, true); // seems to modify the input (in1)
-        invNorm1.AssignElementInverseOf(invNorm1);
-
-        size_t shift = (size_t) in2.Get00Element();
-        size_t negNumber = (size_t) in3.Get00Element();
-
-        // mutiply invNorm0 and invNorm1 with shift and neg.
-        // The result is a matrix of (numberneg+1, invNorm0.Cols)
-        leftTermTemp.AssignElementProductOfWithShiftNeg(invNorm0, invNorm1, shift, negNumber);
-
-        // compute the right values
-        // Again, the ouput is a matrix of (negNumber+1, invNorm0.cols)
-        rightTermTemp.AssignInnerProductOfWithShiftNeg(in0, in1, true, shift, negNumber);
-
-        // compute the evaluation result matrix by multiply these two matrices, element by element
-        // we get a (negNumber+1, n) matrix
-        functionValues.AssignElementProductOf(leftTermTemp, rightTermTemp);
+        // norms, shifted inner products and scaling in one pass; the negative samples are read in place rather than built as shifted copies
+        size_t shift = (size_t) Input(2)->Get00Element();
+        size_t negNumber = (size_t) Input(3)->Get00Element();
+        Matrix<ElemType>::CosDistanceWithNegativeSamples(sliceInput0Value, sliceInput1Value, shift, negNumber, *m_invNorm0, *m_invNorm1, sliceOutputValue);
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -1142,10 +1420,6 @@ public:
             auto node = dynamic_pointer_cast<CosDistanceWithNegativeSamplesNode<ElemType>>(nodeP);
             *node->m_invNorm0 = *m_invNorm0;
             *node->m_invNorm1 = *m_invNorm1;
-            *node->m_invNormSquare = *m_invNormSquare;
-            *node->m_leftTerm = *m_leftTerm;
-            *node->m_rightTerm = *m_rightTerm;
-            *node->m_temp = *m_temp;
         }
     }
     // request matrices needed to do node function value evaluation
@@ -1154,16 +1428,6 @@ public:
         Base::RequestMatricesBeforeForwardProp(matrixPool);
         RequestMatrixFromPool(m_invNorm0, matrixPool);
         RequestMatrixFromPool(m_invNorm1, matrixPool);
-        RequestMatrixFromPool(m_leftTerm, matrixPool);
-        RequestMatrixFromPool(m_rightTerm, matrixPool);
-    }
-
-    // request matrices that are needed for gradient computation
-    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool)
-    {
-        Base::RequestMatricesBeforeBackprop(matrixPool);
-        RequestMatrixFromPool(m_invNormSquare, matrixPool);
-        RequestMatrixFromPool(m_temp, matrixPool);
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
@@ -1172,23 +1436,175 @@ public:
         Base::ReleaseMatricesAfterBackprop(matrixPool);
         ReleaseMatrixToPool(m_invNorm0, matrixPool);
         ReleaseMatrixToPool(m_invNorm1, matrixPool);
-        ReleaseMatrixToPool(m_leftTerm, matrixPool);
-        ReleaseMatrixToPool(m_rightTerm, matrixPool);
-        ReleaseMatrixToPool(m_invNormSquare, matrixPool);
-        ReleaseMatrixToPool(m_temp, matrixPool);
     }
 
 private:
     // invNorm nodes tranfer data between ForwardProp and BackpropTo
     shared_ptr<Matrix<ElemType>> m_invNorm0;
     shared_ptr<Matrix<ElemType>> m_invNorm1;
-    shared_ptr<Matrix<ElemType>> m_leftTerm;
-    shared_ptr<Matrix<ElemType>> m_rightTerm;
-    // the rest are temporaries, values don't need to be maintained
-    shared_ptr<Matrix<ElemType>> m_invNormSquare;
-    shared_ptr<Matrix<ElemType>> m_temp;
 };
 
 template class CosDistanceWithNegativeSamplesNode<float>;
 template class CosDistanceWithNegativeSamplesNode<double>;
+
+// -----------------------------------------------------------------------
+// AttentionNode (query, keys, values, causal=false, scale=0) -- scaled dot-product attention within each sequence
+//
+// For each frame t of each sequence:
+//   out_t = sum_u softmax_u(scale * query_t^T keys_u) values_u
+// where u runs over the frames of the same sequence (with causal=true, only those up to t), and scale=0 means 1/sqrt(D).
+// query and keys are [D], values [Dv], and all three must have the same MBLayout; the output is [Dv] with that layout.
+// The attention is restricted to the frames of a sequence that are in the current minibatch.
+//
+// Compared to building the same from Times, Softmax and masking nodes, this never materializes the [T x T] score matrix:
+// one fused kernel per direction computes the scores, the softmax (masked to the sequence boundaries) and the context.
+// Only the log-sum-exp of the scores is kept for the backprop, which recomputes the softmax weights from it.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class AttentionNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"Attention";
+    }
+
+public:
+    AttentionNode(DEVICEID_TYPE deviceId, const wstring& name, bool causal = false, ElemType scale = 0)
+        : Base(deviceId, name), m_causal(causal), m_scale(scale), m_gradientsValid(false), m_keyRanges(deviceId)
+    {
+    }
+    AttentionNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : AttentionNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"causal"), (ElemType)(double) configp->Get(L"scale"))
+    {
+        AttachInputs(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_causal << m_scale;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_causal >> m_scale;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<AttentionNode<ElemType>>(nodeP);
+            node->m_causal = m_causal;
+            node->m_scale = m_scale;
+        }
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        UpdateKeyRanges();
+        m_logSumExp->Resize(1, Input(0)->Value().GetNumCols());
+        Matrix<ElemType>::AttentionForward(Input(0)->Value(), Input(1)->Value(), Input(2)->Value(), m_keyRanges, GetNumParallelSequences(), GetScale(), Value(), *m_logSumExp);
+    }
+
+    virtual void /*IComputationNode::*/ BeginBackprop() override
+    {
+        Base::BeginBackprop();
+        m_gradientsValid = false;
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t /*inputIndex*/) override
+    {
+        // the gradients w.r.t. all inputs are computed at once by a single kernel, when the first one is asked for
+        if (m_gradientsValid)
+            return;
+        Matrix<ElemType> none(m_deviceId);
+        for (size_t i = 0; i < GetNumInputs(); i++)
+        {
+            if (Input(i)->NeedGradient())
+                Input(i)->LazyZeroGradient(); // (the network would do this only right before asking for input i)
+        }
+        Matrix<ElemType>::AttentionBackward(Input(0)->Value(), Input(1)->Value(), Input(2)->Value(), m_keyRanges, GetNumParallelSequences(), GetScale(),
+                                            Value(), *m_logSumExp, Gradient(),
+                                            Input(0)->NeedGradient() ? Input(0)->Gradient() : none,
+                                            Input(1)->NeedGradient() ? Input(1)->Gradient() : none,
+                                            Input(2)->NeedGradient() ? Input(2)->Gradient() : none);
+        m_gradientsValid = true;
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase();
+
+        if (isFinalValidationPass)
+        {
+            if (!Input(0)->HasMBLayout() || Input(1)->GetMBLayout() != Input(0)->GetMBLayout() || Input(2)->GetMBLayout() != Input(0)->GetMBLayout())
+                InvalidArgument("%ls %ls operation requires query, keys and values to be minibatch data with the same MBLayout.", NodeName().c_str(), OperationName().c_str());
+            if (Input(1)->GetSampleMatrixNumRows() != Input(0)->GetSampleMatrixNumRows())
+                InvalidArgument("%ls %ls operation: query and keys must have the same dimension, but have %d and %d.", NodeName().c_str(), OperationName().c_str(),
+                                (int) Input(0)->GetSampleMatrixNumRows(), (int) Input(1)->GetSampleMatrixNumRows());
+        }
+
+        SetDims(Input(2)->GetSampleLayout(), true);
+    }
+
+    // the log-sum-exp of the scores is needed from forward prop until backprop
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_logSumExp, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_logSumExp, matrixPool);
+    }
+
+private:
+    ElemType GetScale() const
+    {
+        return m_scale != 0 ? m_scale : (ElemType)(1 / sqrt((double) Input(0)->GetSampleMatrixNumRows()));
+    }
+
+    // for each column, the first column and number of the key frames it attends to: the frames of its own sequence that
+    // are in this minibatch, which are S columns apart; none for gaps
+    void UpdateKeyRanges()
+    {
+        const size_t S = GetNumParallelSequences();
+        const size_t T = GetNumTimeSteps();
+        vector<ElemType> ranges(2 * S * T, 0);
+        for (const auto& seq : m_pMBLayout->GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            const size_t tBegin = (size_t) max(seq.tBegin, (ptrdiff_t) 0);
+            const size_t tEnd = min(seq.tEnd, T);
+            const size_t first = tBegin * S + seq.s;
+            for (size_t t = tBegin; t < tEnd; t++)
+            {
+                const size_t j = t * S + seq.s;
+                ranges[2 * j] = (ElemType) first;
+                ranges[2 * j + 1] = (ElemType)(m_causal ? t - tBegin + 1 : tEnd - tBegin);
+            }
+        }
+        m_keyRanges.SetValue(2, S * T, m_deviceId, ranges.data(), matrixFlagNormal);
+    }
+
+    bool m_causal;         // attend only to the current and earlier frames
+    ElemType m_scale;      // of the scores; 0 means 1/sqrt(D)
+    bool m_gradientsValid; // the gradients of all inputs have been computed in this backprop pass
+
+    Matrix<ElemType> m_keyRanges;              // [2 x S*T] per column: first key column, number of keys (see UpdateKeyRanges())
+    shared_ptr<Matrix<ElemType>> m_logSumExp; // [1 x S*T] log sum_u exp(score), to recompute the softmax in backprop
+};
+
+template class AttentionNode<float>;
+template class AttentionNode<double>;
 } } }
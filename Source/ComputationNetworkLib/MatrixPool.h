@@ -10,6 +10,8 @@
 #include <vector>
 #include <algorithm>
 #include <stdlib.h>
+#include <map>
+#include <stdint.h>
 
 #include "Basics.h"
 #include "Matrix.h"
@@ -17,6 +19,18 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// -----------------------------------------------------------------------
+// MatrixPool -- plans the sharing of value/gradient/temp matrices
+//
+// AllocateAllMatrices() simulates the forward/backward order and requests a matrix when a node's output
+// becomes live and releases it after its last consumer. This yields the lifetimes; the pool then decides
+// which released buffer to hand to the next request. Matrices are not sized at this point, so every request
+// carries a size hint (elements per column for nodes with an MBLayout, total elements otherwise), and the
+// pool hands out the released matrix that fits the hint best, so that small and large buffers do not get
+// mixed up and keep growing each other. The two kinds of hints are not comparable (a per-column matrix grows
+// with the minibatch), so a matrix is only ever shared among requests of one kind.
+// -----------------------------------------------------------------------
+
 class MatrixPool
 {
     vector<shared_ptr<Matrix<float>>> m_releasedFloatMatrices;
@@ -25,6 +39,23 @@ class MatrixPool
     template <class ElemType>
     vector<shared_ptr<Matrix<ElemType>>>& GetReleasedMatrices();
 
+    // planning state, keyed by matrix object
+    struct PlannedMatrix
+    {
+        DEVICEID_TYPE m_deviceId;
+        size_t m_elementSize;
+        bool m_perColumn; // its users have an MBLayout, so it grows with the minibatch
+        size_t m_elements; // largest size hint any user of this matrix has requested
+    };
+    std::map<const void*, PlannedMatrix> m_plannedMatrices;
+    std::map<const void*, size_t> m_liveSize; // size hint of the current user, for matrices currently handed out
+
+    // statistics, [perColumn]
+    size_t m_numRequests[2] = {};
+    size_t m_plannedLiveElements[2] = {};     // sum of m_liveSize
+    size_t m_peakPlannedLiveElements[2] = {}; // high-water mark of the above
+    size_t m_unsharedElements[2] = {};        // what we would need without any sharing
+
 public:
     // release here means the matrix can be put back and shared by others
     template <class ElemType>
@@ -41,11 +72,19 @@ public:
         }
 
 #endif
+        auto live = m_liveSize.find(freeMatrix.get());
+        if (live != m_liveSize.end())
+        {
+            m_plannedLiveElements[m_plannedMatrices.at(freeMatrix.get()).m_perColumn] -= live->second;
+            m_liveSize.erase(live);
+        }
         releasedMatrices.push_back(freeMatrix);
     }
 
+    // 'sizeHint' is the number of elements the requester expects to store, per column if 'perColumn' (it has an MBLayout);
+    // pass 0 if unknown, which falls back to LIFO reuse
     template <class ElemType>
-    shared_ptr<Matrix<ElemType>> Request(DEVICEID_TYPE deviceId)
+    shared_ptr<Matrix<ElemType>> Request(DEVICEID_TYPE deviceId, size_t sizeHint = 0, bool perColumn = false)
     {
         vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
         shared_ptr<Matrix<ElemType>> matrixPtr;
@@ -55,14 +94,98 @@ public:
         }
         else
         {
-            matrixPtr = releasedMatrices.back();
-            releasedMatrices.pop_back();
+            size_t index = FindBestFit(releasedMatrices, deviceId, sizeHint, perColumn);
+            if (index == SIZE_MAX)
+            {
+                matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
+            }
+            else
+            {
+                matrixPtr = releasedMatrices[index];
+                releasedMatrices.erase(releasedMatrices.begin() + index);
+            }
         }
 
         if (!matrixPtr) // this can't really happen
             LogicError("MatrixPool::Request: failed to get a valid matrix.");
 
+        auto planned = m_plannedMatrices.insert(make_pair((const void*) matrixPtr.get(), PlannedMatrix{deviceId, sizeof(ElemType), perColumn, 0})).first;
+        planned->second.m_elements = max(planned->second.m_elements, sizeHint);
+        m_liveSize[matrixPtr.get()] = sizeHint;
+        m_numRequests[perColumn]++;
+        m_unsharedElements[perColumn] += sizeHint;
+        m_plannedLiveElements[perColumn] += sizeHint;
+        m_peakPlannedLiveElements[perColumn] = max(m_peakPlannedLiveElements[perColumn], m_plannedLiveElements[perColumn]);
+
         return matrixPtr;
     }
+
+    // summary of the plan, in units of the size hints, separately for per-column and fixed-size matrices
+    size_t GetNumRequests(bool perColumn) const { return m_numRequests[perColumn]; }
+    size_t GetNumMatrices(bool perColumn) const
+    {
+        return count_if(m_plannedMatrices.begin(), m_plannedMatrices.end(), [perColumn](const pair<const void* const, PlannedMatrix>& planned) { return planned.second.m_perColumn == perColumn; });
+    }
+    size_t GetPlannedElements(bool perColumn) const
+    {
+        size_t total = 0;
+        for (const auto& planned : m_plannedMatrices)
+        {
+            if (planned.second.m_perColumn == perColumn)
+                total += planned.second.m_elements;
+        }
+        return total;
+    }
+    size_t GetPeakLiveElements(bool perColumn) const { return m_peakPlannedLiveElements[perColumn]; }
+    size_t GetUnsharedElements(bool perColumn) const { return m_unsharedElements[perColumn]; }
+
+    bool IsShared(const void* matrix) const { return m_plannedMatrices.find(matrix) != m_plannedMatrices.end(); }
+
+    // predicted bytes of the shared matrices on 'deviceId' once they have served minibatches of 'numColumns' columns;
+    // each grows to its largest user, and none is ever freed
+    size_t EstimateBytes(DEVICEID_TYPE deviceId, size_t numColumns) const
+    {
+        size_t bytes = 0;
+        for (const auto& planned : m_plannedMatrices)
+        {
+            const PlannedMatrix& matrix = planned.second;
+            if (matrix.m_deviceId == deviceId)
+                bytes += matrix.m_elementSize * (matrix.m_perColumn ? matrix.m_elements * numColumns : matrix.m_elements);
+        }
+        return bytes;
+    }
+
+private:
+    // best fit: the smallest released matrix (on the right device, of the same kind) whose planned size covers the hint;
+    // if none is large enough, grow the largest one, which adds the least to the total.
+    // Returns SIZE_MAX if no released matrix of that kind lives on the requested device.
+    template <class ElemType>
+    size_t FindBestFit(const vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices, DEVICEID_TYPE deviceId, size_t sizeHint, bool perColumn) const
+    {
+        size_t bestFit = SIZE_MAX;
+        size_t largest = SIZE_MAX;
+        size_t bestFitSize = SIZE_MAX;
+        size_t largestSize = 0;
+        for (size_t i = releasedMatrices.size(); i-- > 0;) // backwards so that ties are resolved LIFO, as before
+        {
+            if (releasedMatrices[i]->GetDeviceId() != deviceId)
+                continue;
+            auto iter = m_plannedMatrices.find(releasedMatrices[i].get());
+            if (iter != m_plannedMatrices.end() && iter->second.m_perColumn != perColumn)
+                continue;
+            size_t plannedSize = (iter == m_plannedMatrices.end()) ? 0 : iter->second.m_elements;
+            if (plannedSize >= sizeHint && plannedSize < bestFitSize)
+            {
+                bestFit = i;
+                bestFitSize = plannedSize;
+            }
+            if (largest == SIZE_MAX || plannedSize > largestSize)
+            {
+                largest = i;
+                largestSize = plannedSize;
+            }
+        }
+        return bestFit != SIZE_MAX ? bestFit : largest;
+    }
 };
 } } }
@@ -0,0 +1,315 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "NodeProfiler.h"
+#include "ComputationNode.h"
+#include "CuDnnConvolutionEngine.h" // for CudaTimer
+#include "fileutil.h"
+#include <algorithm>
+#include <exception>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+NodeProfiler::NodeProfiler(bool useCudaEvents)
+    : m_useCudaEvents(useCudaEvents),
+      m_traceTruncated(false)
+{
+    m_clock.Start();
+}
+
+// -----------------------------------------------------------------------
+// measuring
+// -----------------------------------------------------------------------
+
+NodeProfiler::Scope::Scope(NodeProfiler* profiler, const ComputationNodeBasePtr& node, Pass pass, const FrameRange& fr,
+                           const ComputationNodeBase* loop, bool childrenInThisLoop, bool childrenInOuterLoop)
+    : m_profiler(profiler)
+{
+    if (!m_profiler)
+        return;
+
+    const bool isLoop = dynamic_cast<const FlowControlNode*>(node.get()) != nullptr;
+    double flops = 0;
+    if (!isLoop)
+    {
+        flops = node->EstimateFlops(fr);
+        if (pass == backpropPass && flops > 0)
+        {
+            // one product per input whose gradient Backprop() computes (same condition as in ComputationNode::Backprop())
+            size_t numGradients = 0;
+            for (const auto& input : node->GetInputs())
+            {
+                if (input->NeedGradient() &&
+                    (childrenInThisLoop && input->IsPartOfLoop() == node->IsPartOfLoop() ||
+                     childrenInOuterLoop && input->IsPartOfLoop() != node->IsPartOfLoop()))
+                    numGradients++;
+            }
+            flops *= numGradients;
+        }
+    }
+    m_nodes.push_back(node.get());
+    m_flops.push_back(flops);
+    // a loop is not synchronized by itself; the nodes inside are
+    Begin(pass, loop, /*synchronize=*/!isLoop);
+}
+
+NodeProfiler::Scope::Scope(NodeProfiler* profiler, const std::vector<ComputationNodeBasePtr>& batch, const FrameRange& fr, const ComputationNodeBase* loop)
+    : m_profiler(profiler)
+{
+    if (!m_profiler)
+        return;
+
+    for (const auto& node : batch)
+    {
+        m_nodes.push_back(node.get());
+        m_flops.push_back(node->EstimateFlops(fr.WithLayout(node->GetMBLayout())));
+    }
+    Begin(forwardPass, loop, /*synchronize=*/true);
+}
+
+void NodeProfiler::Scope::Begin(Pass pass, const ComputationNodeBase* loop, bool synchronize)
+{
+    m_pass = pass;
+    m_loop = loop;
+    if (synchronize && m_profiler->m_useCudaEvents)
+    {
+        m_cudaTimer.reset(new CudaTimer());
+        m_cudaTimer->Start();
+    }
+    m_beginSeconds = m_profiler->Now();
+}
+
+NodeProfiler::Scope::~Scope()
+{
+    if (!m_profiler || std::uncaught_exception()) // (CudaTimer::Stop() may throw)
+        return;
+
+    double gpuSeconds = 0;
+    if (m_cudaTimer)
+    {
+        m_cudaTimer->Stop(); // waits for the GPU
+        gpuSeconds = m_cudaTimer->Elapsed() / 1000.0;
+    }
+    const double seconds = m_profiler->Now() - m_beginSeconds;
+
+    const double share = 1.0 / m_nodes.size();
+    for (size_t i = 0; i < m_nodes.size(); i++)
+        m_profiler->Record(m_nodes[i], m_loop, m_pass, m_beginSeconds + i * share * seconds, share * seconds, share * gpuSeconds, m_flops[i]);
+}
+
+NodeProfiler::Statistics& NodeProfiler::GetStatistics(const ComputationNodeBase* node, const ComputationNodeBase* loop)
+{
+    const auto key = make_pair(node, loop);
+    auto iter = m_statistics.find(key);
+    if (iter != m_statistics.end())
+        return iter->second;
+
+    // the names are copied so that the summary does not depend on the nodes still being alive
+    Statistics& statistics = m_statistics[key];
+    statistics.m_isLoop = dynamic_cast<const FlowControlNode*>(node) != nullptr;
+    statistics.m_nodeName = node->NodeName();
+    statistics.m_operationName = statistics.m_isLoop ? L"Loop" : node->OperationName();
+    statistics.m_loopName = loop ? loop->NodeName() : L"";
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        statistics.m_numCalls[pass] = 0;
+        statistics.m_seconds[pass] = 0;
+        statistics.m_gpuSeconds[pass] = 0;
+        statistics.m_flops[pass] = 0;
+    }
+    statistics.m_matrixBytes = 0;
+    return statistics;
+}
+
+void NodeProfiler::Record(const ComputationNodeBase* node, const ComputationNodeBase* loop, Pass pass, double beginSeconds, double seconds, double gpuSeconds, double flops)
+{
+    Statistics& statistics = GetStatistics(node, loop);
+    statistics.m_numCalls[pass]++;
+    statistics.m_seconds[pass] += seconds;
+    statistics.m_gpuSeconds[pass] += gpuSeconds;
+    statistics.m_flops[pass] += flops;
+    statistics.m_matrixBytes = max(statistics.m_matrixBytes, node->GetMatrixBytes());
+
+    // the time steps of a loop are covered by the event of the loop itself
+    if (loop)
+        return;
+    if (m_trace.size() >= maxTraceEvents)
+    {
+        m_traceTruncated = true;
+        return;
+    }
+    TraceEvent event;
+    event.m_node = &statistics;
+    event.m_pass = pass;
+    event.m_beginSeconds = beginSeconds;
+    event.m_seconds = seconds;
+    m_trace.push_back(event);
+}
+
+void NodeProfiler::Reset()
+{
+    m_statistics.clear();
+    m_trace.clear();
+    m_traceTruncated = false;
+    m_clock.Restart();
+}
+
+// -----------------------------------------------------------------------
+// reporting
+// -----------------------------------------------------------------------
+
+void NodeProfiler::PrintSummary(FILE* f, const std::string& title, size_t maxNodes) const
+{
+    // totals are taken over the top-level calls only (nodes outside of loops, and the loops), so that nothing is counted twice
+    double seconds[2] = {0, 0};
+    double gpuSeconds = 0;
+    double flops = 0;
+    vector<const Statistics*> nodes, loops;
+    map<wstring, Statistics> operations; // [operation name] sum over its nodes
+    for (const auto& entry : m_statistics)
+    {
+        const Statistics& statistics = entry.second;
+        if (statistics.m_loopName.empty())
+        {
+            seconds[forwardPass] += statistics.m_seconds[forwardPass];
+            seconds[backpropPass] += statistics.m_seconds[backpropPass];
+        }
+        if (statistics.m_isLoop)
+        {
+            loops.push_back(&statistics);
+            continue;
+        }
+        nodes.push_back(&statistics);
+        gpuSeconds += statistics.m_gpuSeconds[forwardPass] + statistics.m_gpuSeconds[backpropPass];
+        flops += statistics.m_flops[forwardPass] + statistics.m_flops[backpropPass];
+
+        auto iter = operations.find(statistics.m_operationName);
+        if (iter == operations.end())
+        {
+            operations.insert(make_pair(statistics.m_operationName, statistics));
+            continue;
+        }
+        Statistics& operation = iter->second;
+        for (size_t pass = 0; pass < 2; pass++)
+        {
+            operation.m_numCalls[pass] += statistics.m_numCalls[pass];
+            operation.m_seconds[pass] += statistics.m_seconds[pass];
+            operation.m_gpuSeconds[pass] += statistics.m_gpuSeconds[pass];
+            operation.m_flops[pass] += statistics.m_flops[pass];
+        }
+        operation.m_matrixBytes += statistics.m_matrixBytes;
+    }
+    if (m_statistics.empty())
+    {
+        fprintf(f, "%s: Node profile: no nodes were run.\n", title.c_str());
+        return;
+    }
+
+    fprintf(f, "%s: Node profile: %.3f seconds forward, %.3f seconds backprop", title.c_str(), seconds[forwardPass], seconds[backpropPass]);
+    if (m_useCudaEvents)
+        fprintf(f, ", %.3f seconds on the GPU", gpuSeconds);
+    fprintf(f, ", %.3f GFLOP estimated\n", flops * 1e-9);
+
+    const auto printHeader = [f](const char* what)
+    {
+        fprintf(f, "  %10s %10s %10s %10s %9s %9s %8s %9s  %s\n", "total ms", "fwd ms", "bwd ms", "GPU ms", "calls", "GFLOP", "GFLOP/s", "MB", what);
+    };
+    const auto printRow = [f](const Statistics& statistics, const wstring& label)
+    {
+        const double totalSeconds = statistics.TotalSeconds();
+        const double gpuSeconds = statistics.m_gpuSeconds[forwardPass] + statistics.m_gpuSeconds[backpropPass];
+        const double flops = statistics.m_flops[forwardPass] + statistics.m_flops[backpropPass];
+        const double rateSeconds = gpuSeconds > 0 ? gpuSeconds : totalSeconds; // with CUDA events, the rate refers to the GPU time
+        fprintf(f, "  %10.2f %10.2f %10.2f %10.2f %9d %9.3f %8.1f %9.1f  %ls\n",
+                totalSeconds * 1e3, statistics.m_seconds[forwardPass] * 1e3, statistics.m_seconds[backpropPass] * 1e3, gpuSeconds * 1e3,
+                (int) (statistics.m_numCalls[forwardPass] + statistics.m_numCalls[backpropPass]),
+                flops * 1e-9, rateSeconds > 0 ? flops * 1e-9 / rateSeconds : 0.0, statistics.m_matrixBytes / (1024.0 * 1024.0), label.c_str());
+    };
+    const auto byTime = [](const Statistics* a, const Statistics* b)
+    {
+        return a->TotalSeconds() > b->TotalSeconds();
+    };
+
+    sort(nodes.begin(), nodes.end(), byTime);
+    printHeader("node (operation) [loop]");
+    double otherSeconds = 0;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const Statistics& statistics = *nodes[i];
+        if (i >= maxNodes)
+        {
+            otherSeconds += statistics.TotalSeconds();
+            continue;
+        }
+        wstring label = statistics.m_nodeName + L" (" + statistics.m_operationName + L")";
+        if (!statistics.m_loopName.empty())
+            label += L" [" + statistics.m_loopName + L"]";
+        printRow(statistics, label);
+    }
+    if (nodes.size() > maxNodes)
+        fprintf(f, "  %10.2f ... %d more nodes\n", otherSeconds * 1e3, (int) (nodes.size() - maxNodes));
+
+    vector<const Statistics*> operationList;
+    for (const auto& operation : operations)
+        operationList.push_back(&operation.second);
+    sort(operationList.begin(), operationList.end(), byTime);
+    printHeader("operation");
+    for (const auto* operation : operationList)
+        printRow(*operation, operation->m_operationName);
+
+    if (!loops.empty())
+    {
+        sort(loops.begin(), loops.end(), byTime);
+        printHeader("loop");
+        for (const auto* loop : loops)
+            printRow(*loop, loop->m_nodeName);
+    }
+
+    if (m_traceTruncated)
+        fprintf(f, "  (the trace was truncated after %d events)\n", (int) maxTraceEvents);
+}
+
+// string literal for JSON
+static string JsonString(const wstring& s)
+{
+    string result = "\"";
+    for (char c : msra::strfun::utf8(s))
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char) c < 0x20)
+            result += msra::strfun::strprintf("\\u%04x", (int) c);
+        else
+            result += c;
+    }
+    return result + "\"";
+}
+
+// The Chrome trace-event format: complete events ("ph": "X") with timestamps and durations in microseconds.
+// Forward and backprop go into separate rows ("threads") of the same process.
+void NodeProfiler::WriteChromeTrace(const std::wstring& path) const
+{
+    FILE* f = fopenOrDie(path, L"wb");
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"ForwardProp\"}},\n", (int) forwardPass);
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"Backprop\"}}", (int) backpropPass);
+    for (const auto& event : m_trace)
+    {
+        fprintf(f, ",\n{\"name\":%s,\"cat\":%s,\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f}",
+                JsonString(event.m_node->m_nodeName).c_str(), JsonString(event.m_node->m_operationName).c_str(),
+                (int) event.m_pass, event.m_beginSeconds * 1e6, event.m_seconds * 1e6);
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fcloseOrDie(f);
+}
+} } }
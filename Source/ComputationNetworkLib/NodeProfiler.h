@@ -0,0 +1,113 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NodeProfiler.h -- per-node timing of ComputationNetwork::ForwardProp() and Backprop()
+//
+// A NodeProfiler that is set on a ComputationNetwork (SetNodeProfiler()) is called by the PAR and SEQ traversal around every
+// node, and records per node (and separately for the nodes inside each recurrent loop):
+//  - number of calls and wall-clock time of ForwardProp() and Backprop()
+//  - with useCudaEvents, the GPU time between CUDA events recorded around each call. This synchronizes after every node,
+//    so the wall time then includes the GPU execution as well. Without it, the wall time of GPU nodes is mostly launch overhead.
+//  - the estimated number of floating-point operations (ComputationNodeBase::EstimateFlops(); only products and convolutions)
+//  - the size of the node's value and gradient matrices. Those are taken from the MatrixPool and may be shared,
+//    so the sum over all nodes is larger than what is allocated.
+// PrintSummary() prints nodes, operations, and loops sorted by time. WriteChromeTrace() writes the calls in the Chrome
+// trace-event format (open in chrome://tracing); a recurrent loop appears there as one event per pass, not one per time step.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "TimerUtility.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class ComputationNodeBase;
+class FrameRange;
+class CudaTimer;
+
+class NodeProfiler
+{
+public:
+    enum Pass
+    {
+        forwardPass,
+        backpropPass
+    };
+
+    NodeProfiler(bool useCudaEvents);
+
+    // measures one call in its scope; does nothing if 'profiler' is nullptr
+    class Scope
+    {
+    public:
+        // node->ForwardProp(fr) resp. node->Backprop(fr, childrenInThisLoop, childrenInOuterLoop)
+        // 'loop' is the SEQTraversalFlowControlNode if the call is a time step of a recurrent loop. If 'node' itself is a
+        // SEQTraversalFlowControlNode, the whole pass over the loop is measured (its nodes are measured by the loop itself).
+        Scope(NodeProfiler* profiler, const std::shared_ptr<ComputationNodeBase>& node, Pass pass, const FrameRange& fr,
+              const ComputationNodeBase* loop = nullptr, bool childrenInThisLoop = true, bool childrenInOuterLoop = true);
+        // node->ForwardPropBatched() for the nodes of 'batch'; the time is split evenly across them
+        Scope(NodeProfiler* profiler, const std::vector<std::shared_ptr<ComputationNodeBase>>& batch, const FrameRange& fr, const ComputationNodeBase* loop = nullptr);
+        ~Scope();
+
+    private:
+        void Begin(Pass pass, const ComputationNodeBase* loop, bool synchronize);
+
+        NodeProfiler* m_profiler;
+        Pass m_pass;
+        const ComputationNodeBase* m_loop;
+        std::vector<const ComputationNodeBase*> m_nodes;
+        std::vector<double> m_flops; // [index into m_nodes]
+        double m_beginSeconds;
+        std::unique_ptr<CudaTimer> m_cudaTimer;
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // 'title' goes into the header line, e.g. "Epoch[3]"; at most 'maxNodes' nodes are listed individually
+    void PrintSummary(FILE* f, const std::string& title, size_t maxNodes = 30) const;
+    void WriteChromeTrace(const std::wstring& path) const;
+    void Reset();
+
+private:
+    struct Statistics
+    {
+        std::wstring m_nodeName;
+        std::wstring m_operationName;
+        std::wstring m_loopName; // empty if not inside a recurrent loop
+        bool m_isLoop;           // this is the SEQTraversalFlowControlNode of a loop
+        size_t m_numCalls[2];    // [Pass]
+        double m_seconds[2];
+        double m_gpuSeconds[2];
+        double m_flops[2];
+        size_t m_matrixBytes; // largest seen
+
+        double TotalSeconds() const { return m_seconds[forwardPass] + m_seconds[backpropPass]; }
+    };
+    struct TraceEvent
+    {
+        const Statistics* m_node;
+        Pass m_pass;
+        double m_beginSeconds; // since construction of the profiler
+        double m_seconds;
+    };
+
+    Statistics& GetStatistics(const ComputationNodeBase* node, const ComputationNodeBase* loop);
+    void Record(const ComputationNodeBase* node, const ComputationNodeBase* loop, Pass pass, double beginSeconds, double seconds, double gpuSeconds, double flops);
+    double Now() { return m_clock.ElapsedSeconds(); }
+
+    bool m_useCudaEvents;
+    Timer m_clock; // started at construction, never stopped
+    std::map<std::pair<const ComputationNodeBase*, const ComputationNodeBase*>, Statistics> m_statistics; // [(node, loop)]
+    std::vector<TraceEvent> m_trace;
+    bool m_traceTruncated;
+
+    static const size_t maxTraceEvents = 1000000;
+};
+} } }
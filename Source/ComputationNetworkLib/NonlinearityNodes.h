@@ -41,6 +41,9 @@ public:
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
+        if (Input(0)->IsAbsorbedIntoConsumer())
+            return ForwardPropOfSum(fr);
+
         size_t rank = DetermineElementwiseTensorRank();
         auto result = ValueTensorFor(rank, fr);
         auto input = Input(0)->ValueTensorFor(rank, fr);
@@ -52,6 +55,9 @@ public:
         assert(inputIndex == 0);
         inputIndex;
 
+        if (Input(0)->IsAbsorbedIntoConsumer())
+            return BackpropToInputsOfSum(fr);
+
         // get the args
         size_t rank = DetermineElementwiseTensorRank();
         auto sliceOutputGrad = GradientTensorFor(rank, fr);               // propagate from this one...
@@ -76,6 +82,98 @@ public:
     {
         return !gradientFromOutput;
     }
+
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; } // (no attributes)
+
+    // an elementwise map whose backprop needs only the output can overwrite its input (see ComputationNetwork::ShareBuffersWithConsumers())
+    virtual bool CanComputeValueInPlace() const override
+    {
+        return gradientFromOutput;
+    }
+
+    // -----------------------------------------------------------------------
+    // elementwise fusion with a PlusNode input
+    // If our input is a PlusNode that nobody else consumes, ComputationNetwork::FuseElementwiseOperations() marks it as absorbed.
+    // We then compute f(a + b) from its inputs in a single kernel, and backprop straight into a and b, skipping
+    // one write and two reads of the intermediate sum in each direction. This requires the gradient to be computable from the output.
+    // -----------------------------------------------------------------------
+
+    virtual bool CanAbsorbSumInput() const override
+    {
+        ElementWiseOperator fusedOp;
+        return gradientFromOutput && GetFusedOpOfSum(fusedOp);
+    }
+
+private:
+    // opcode that computes opForward(a + b) in one pass
+    static bool GetFusedOpOfSum(ElementWiseOperator& fusedOp)
+    {
+        switch (opForward)
+        {
+        case opSigmoid:         fusedOp = opSigmoidOfSum;         return true;
+        case opTanh:            fusedOp = opTanhOfSum;            return true;
+        case opLinearRectifier: fusedOp = opLinearRectifierOfSum; return true;
+        default:                return false;
+        }
+    }
+
+    // input of the absorbed sum
+    ComputationNodePtr SumInput(size_t inputIndex) const
+    {
+        return Base::DownCast(Input(0)->GetInputs()[inputIndex]);
+    }
+
+    // tensor rank that covers us, the absorbed sum, and its inputs
+    size_t DetermineFusedTensorRank() const
+    {
+        size_t maxRank = GetSampleLayout().GetRank();
+        for (const auto& node : Input(0)->GetInputs())
+            maxRank = max(maxRank, node->GetSampleLayout().GetRank());
+        return maxRank;
+    }
+
+    void ForwardPropOfSum(const FrameRange& fr)
+    {
+        ElementWiseOperator fusedOp;
+        if (!GetFusedOpOfSum(fusedOp))
+            LogicError("%ls %ls operation: Input was absorbed although this operation cannot be fused.", this->NodeName().c_str(), this->OperationName().c_str());
+
+        size_t rank = DetermineFusedTensorRank();
+        auto result = ValueTensorFor(rank, fr);
+        auto input0 = SumInput(0)->ValueTensorFor(rank, fr.AllowBroadcast());
+        auto input1 = SumInput(1)->ValueTensorFor(rank, fr.AllowBroadcast());
+        result.DoBinaryOpOf(0, input0, input1, 1, fusedOp);
+    }
+
+    // the gradient of a sum w.r.t. each of its inputs is the identity, so opBackward can write directly into the inputs' gradients
+    // (reducing over broadcast dimensions, e.g. for a bias)
+    void BackpropToInputsOfSum(const FrameRange& fr)
+    {
+        size_t numInputs = Input(0)->GetNumInputs();
+        size_t rank = DetermineFusedTensorRank();
+        auto sliceOutputGrad = GradientTensorFor(rank, fr);
+        auto sliceValue = ValueTensorFor(rank, fr);
+
+        // if reduction then mask the gaps, as PlusNode::BackpropTo() would have done on the sum's gradient
+        for (size_t i = 0; i < numInputs; i++)
+        {
+            if (SumInput(i)->NeedGradient() && SumInput(i)->ReducesInTimeWrt(shared_from_this()))
+            {
+                MaskMissingGradientColumnsToZero(fr);
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < numInputs; i++)
+        {
+            auto input = SumInput(i);
+            if (!input->NeedGradient())
+                continue;
+            input->LazyZeroGradient();
+            auto sliceInputGrad = input->GradientTensorFor(rank, fr.AllowBroadcast());
+            sliceInputGrad.DoBinaryOpOf(1, sliceOutputGrad, sliceValue, 1, opBackward);
+        }
+    }
 };
 
 #define UnaryElementWiseWithOpCodeNodeBaseMembers UsingComputationNodeMembersBoilerplate;
@@ -141,6 +239,8 @@ public:
     {
     }
 
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; } // (no attributes)
+
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
         assert(inputIndex == 0);
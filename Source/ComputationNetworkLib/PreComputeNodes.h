@@ -112,6 +112,13 @@ public:
         }
     }
 
+    // the same if both are still to be computed, or both have been computed to the same value
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& other) const override
+    {
+        auto node = dynamic_cast<const PreComputedNodeBase<ElemType>*>(&other);
+        return node && node->m_hasComputed == m_hasComputed && (!m_hasComputed || node->Value().IsEqualTo(Value(), 0));
+    }
+
     // this is for the special case: convertDBN needs this; because we initialize values directly from another well-trained model
     virtual void SideLoadFromMatrix(const Matrix<ElemType>& value)
     {
@@ -199,6 +206,18 @@ public:
         }
     }
 
+    // access to the accumulators between MarkComputed(false) and MarkComputed(true)
+    // SGD uses these to combine the statistics of the data-parallel workers, and to restore them from its PreCompute cache.
+    // 'var' is the population variance; it is left empty by nodes that do not accumulate it (MeanNode).
+    size_t GetNumAccumulatedSamples() const
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: GetNumAccumulatedSamples() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        return m_numSamples;
+    }
+    virtual void GetAccumulators(Matrix<ElemType>& mean, Matrix<ElemType>& var) const = 0;
+    virtual void SetAccumulators(size_t numSamples, const Matrix<ElemType>& mean, const Matrix<ElemType>& var) = 0;
+
 protected:
     size_t m_numSamples; // (SIZE_MAX while outside accumulation state)
     bool IsAccumulating() const
@@ -280,6 +299,25 @@ public:
 
         m_numSamples += numNewSamples;
     }
+
+    virtual void GetAccumulators(Matrix<ElemType>& mean, Matrix<ElemType>& var) const override
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: GetAccumulators() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        mean.SetValue(Value());
+        var.Resize(0, 0);
+    }
+
+    virtual void SetAccumulators(size_t numSamples, const Matrix<ElemType>& mean, const Matrix<ElemType>& /*var*/) override
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: SetAccumulators() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        if (mean.GetNumRows() != Value().GetNumRows() || mean.GetNumCols() != Value().GetNumCols())
+            InvalidArgument("%ls %ls operation: SetAccumulators() got a [%d x %d] mean for a [%d x %d] value.", NodeName().c_str(), OperationName().c_str(),
+                            (int) mean.GetNumRows(), (int) mean.GetNumCols(), (int) Value().GetNumRows(), (int) Value().GetNumCols());
+        Value().SetValue(mean);
+        m_numSamples = numSamples;
+    }
 };
 
 template class MeanNode<float>;
@@ -393,6 +431,26 @@ public:
 #endif
     }
 
+    virtual void GetAccumulators(Matrix<ElemType>& mean, Matrix<ElemType>& var) const override
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: GetAccumulators() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        mean.SetValue(m_mean);
+        var.SetValue(m_var);
+    }
+
+    virtual void SetAccumulators(size_t numSamples, const Matrix<ElemType>& mean, const Matrix<ElemType>& var) override
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: SetAccumulators() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        if (mean.GetNumRows() != m_mean.GetNumRows() || var.GetNumRows() != m_var.GetNumRows() || mean.GetNumCols() != 1 || var.GetNumCols() != 1)
+            InvalidArgument("%ls %ls operation: SetAccumulators() got a [%d x %d] mean and a [%d x %d] variance for dimension %d.", NodeName().c_str(), OperationName().c_str(),
+                            (int) mean.GetNumRows(), (int) mean.GetNumCols(), (int) var.GetNumRows(), (int) var.GetNumCols(), (int) m_mean.GetNumRows());
+        m_mean.SetValue(mean);
+        m_var.SetValue(var);
+        m_numSamples = numSamples;
+    }
+
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
     {
         Base::CopyTo(nodeP, newName, flags);
@@ -435,6 +493,8 @@ public:
     {
     }
 
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; } // (no attributes)
+
     virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange&) override
     {
         InvalidArgument("PerDimMeanVarNormalizationNode should only be called in the evaluation stage.");
@@ -112,13 +112,15 @@ private:
 protected:
     DelayedValueNodeBase(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          m_delayedValue(deviceId)
+          m_delayedValue(deviceId),
+          m_delayedValueForRecompute(deviceId)
     {
         Init(TensorShape(), (ElemType) DEFAULT_HIDDEN_ACTIVATION);
     }
     DelayedValueNodeBase(DEVICEID_TYPE deviceId, const wstring& name, ElemType initialActivationValue, const TensorShape& sampleLayout, size_t timeStep)
         : Base(deviceId, name),
-          m_delayedValue(deviceId)
+          m_delayedValue(deviceId),
+          m_delayedValueForRecompute(deviceId)
     {
         Init(sampleLayout, initialActivationValue);
         m_timeStep = (int) timeStep; // TODO: pass this to Init() instead as well
@@ -244,20 +246,45 @@ public:
         return false;
     }
 
+    // the first steps read the state carried over from the previous minibatch
+    virtual bool CollectCaptureState(std::vector<const void*>& buffers, std::vector<MBLayoutPtr>& layouts) const override
+    {
+        if (!Base::CollectCaptureState(buffers, layouts))
+            return false;
+        buffers.push_back(m_delayedValue.IsEmpty() ? nullptr : m_delayedValue.BufferPointer());
+        layouts.push_back(m_delayedActivationMBLayout);
+        return true;
+    }
+
     virtual void EndForwardProp() override // called after last iteration step of ForwardProp()
     {
         // In truncated BPTT, we carry over left-to-right state across minibatches.
-        // It is kept in m_delayedValue, m_delayedActivationMBLayout.
-        // This could be optimized as follows:
-        //  - only keep the required number of frames (m_timeStep)
+        // It is kept in m_delayedValue, m_delayedActivationMBLayout: only the m_timeStep frames the next minibatch can reach
+        // (the last ones when looking into the past, the first ones into the future), copied into the same device buffer every time.
+        // This could be optimized further:
         //  - we don't need to keep anything in full-sequence mode
         //  - we don't need to keep anything if all sequences are closed (sentence end)
         //    This condition includes full-sequence mode.
         // TODO: Can we optimize this and only copy if there is a sequence spanning across the end of the MB? And add a check to BeginForwardProp() to make sure we got one if there is a boundary at the start?
-        m_delayedValue = Input(0)->Value();
+        size_t T = GetNumTimeSteps();
+        size_t S = GetNumParallelSequences();
+        size_t numFrames = min((size_t) m_timeStep, T);
+        size_t firstFrame = direction < 0 ? T - numFrames : 0;
+        Matrix<ElemType> keptFrames = Input(0)->Value().ColumnSlice(firstFrame * S, numFrames * S);
+        m_delayedValue.SetValue(keptFrames, keptFrames.GetFormat());
+
+        // their layout: the sequences that overlap them, shifted in time
         if (!m_delayedActivationMBLayout)
             m_delayedActivationMBLayout = make_shared<MBLayout>();
-        m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+        m_delayedActivationMBLayout->Init(S, numFrames);
+        for (auto seq : m_pMBLayout->GetAllSequences())
+        {
+            if (seq.tBegin >= (ptrdiff_t) (firstFrame + numFrames) || seq.tEnd <= firstFrame)
+                continue;
+            seq.tBegin -= (ptrdiff_t) firstFrame;
+            seq.tEnd -= firstFrame;
+            m_delayedActivationMBLayout->AddSequence(seq);
+        }
 
         Base::EndForwardProp();
     }
@@ -294,10 +321,27 @@ public:
 
         Matrix<ElemType> inp((DEVICEID_TYPE)m_value->GetDeviceId());
 
-        // if any sequence at this time step has a boundary flag, then process one by one
-        // TODO: Would there be an efficiency gain from grouping consecutive sequences with identical flags?
+        // the delayed frame exists for all sequences if it is inside this minibatch, or carried over in the same parallel-sequence layout
+        bool isDelayedFrameInWindow = t_delayed >= 0 && t_delayed < (int) T;
+        bool isDelayedFrameCarriedOver = !m_delayedValue.IsEmpty() && m_delayedActivationMBLayout->GetNumParallelSequences() == GetNumParallelSequences() &&
+                                         (t_delayed < 0 ? t_delayed + (int) T_delayedActivation >= 0 : t_delayed - (int) T < (int) T_delayedActivation);
+
+        // if any sequence at this time step has a boundary flag, then copy the whole time step and set the boundary columns in one go,
+        // or process one by one if some sequence has nothing to copy
         // assert(m_pShiftedMBLayout->Is(t, SequenceStart_or_End) == m_pMBLayout->IsBeyondStartOrEnd(frDelayed));
-        if (m_pMBLayout->IsBeyondStartOrEnd(frDelayed))
+        if (m_pMBLayout->IsBeyondStartOrEnd(frDelayed) && (isDelayedFrameInWindow || isDelayedFrameCarriedOver))
+        {
+            Matrix<ElemType> out = ValueFor(fr);
+            if (t_delayed < 0)
+                inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation).ActiveSequences(fr.m_numActiveSequences), m_delayedActivationMBLayout);
+            else if (t_delayed >= T)
+                inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T).ActiveSequences(fr.m_numActiveSequences), m_delayedActivationMBLayout);
+            else
+                inp = Input(0)->ValueFor(frDelayed);
+            out.SetValue(inp);
+            MaskSequenceBoundariesTo(out, m_pMBLayout, frDelayed, m_initialActivationValue); // resets only the sequences that start (or end) here
+        }
+        else if (m_pMBLayout->IsBeyondStartOrEnd(frDelayed))
         {
             for (size_t id = 0; id < GetNumParallelSequences(); id++)
             {
@@ -338,7 +382,7 @@ public:
                         inp = Input(0)->ValueFor(FrameRange(m_pMBLayout, 0));
                 }
                 else
-                    inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation), m_delayedActivationMBLayout);
+                    inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation).ActiveSequences(fr.m_numActiveSequences), m_delayedActivationMBLayout);
             }
 
             else if (t_delayed >= T)
@@ -351,7 +395,7 @@ public:
                         inp = Input(0)->ValueFor(FrameRange(m_pMBLayout, T - 1));
                 }
                 else
-                    inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T), m_delayedActivationMBLayout);
+                    inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T).ActiveSequences(fr.m_numActiveSequences), m_delayedActivationMBLayout);
             }
             else
                 inp = Input(0)->ValueFor(frDelayed);
@@ -390,7 +434,7 @@ public:
     virtual NodeStatePtr /*IStatefulNode::*/ ExportState() override
     {
         NodeStatePtr pExportedState;
-        size_t nT = m_pMBLayout->GetNumTimeSteps();
+        size_t nT = m_delayedActivationMBLayout ? m_delayedActivationMBLayout->GetNumTimeSteps() : 0; // (the frames kept by EndForwardProp())
         size_t nU = m_pMBLayout->GetNumParallelSequences();
         int dir = direction;
         if (m_timeStep != 1)
@@ -404,7 +448,7 @@ public:
             {
                 auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
                 pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
-                // return an empty one
+                pExportedState = pState; // return an empty one
             }
             else
             {
@@ -425,7 +469,7 @@ public:
             else
             {
                 auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-                pState->CacheState(m_delayedValue.ColumnSlice((nT - 1) * nU, nU));
+                pState->CacheState(m_delayedValue.ColumnSlice(0, nU));
                 pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
                 pExportedState = pState;
             }
@@ -444,6 +488,8 @@ public:
         if (!pState)
             LogicError("Expecting DelayValueNodeState after downcasting");
 
+        if (!m_delayedActivationMBLayout) // (this node has not been evaluated yet, e.g. when continuing a stream in a different evaluator)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
         pState->ExportDelayedMBLayout(m_delayedActivationMBLayout); // pstate copy to m_delayedActivationMBLayout
         if (pState->IsEmpty())
         {
@@ -454,6 +500,10 @@ public:
         size_t nT = m_delayedActivationMBLayout->GetNumTimeSteps();
         size_t nU = m_delayedActivationMBLayout->GetNumParallelSequences();
 
+        // the state may stem from a minibatch of a different length than the one this node saw last
+        if (m_delayedValue.GetNumRows() != delayedActivation.GetNumRows() || m_delayedValue.GetNumCols() != nT * nU)
+            m_delayedValue.Resize(delayedActivation.GetNumRows(), nT * nU);
+
         int dir = direction;
         if (dir == -1) // looking backward
             m_delayedValue.SetColumnSlice(delayedActivation, (nT - 1) * nU, nU);
@@ -463,10 +513,31 @@ public:
             LogicError("Unrecognized direction in DelayedValueNodeBase");
     }
 
+    // unlike ExportState(), this keeps all frames, for any m_timeStep
+    virtual void /*IStatefulNode::*/ SaveStateForRecompute() override
+    {
+        m_delayedValueForRecompute.SetValue(m_delayedValue);
+        if (m_delayedActivationMBLayout)
+            (m_delayedActivationMBLayoutForRecompute = make_shared<MBLayout>())->CopyFrom(m_delayedActivationMBLayout);
+        else
+            m_delayedActivationMBLayoutForRecompute = nullptr;
+    }
+
+    virtual void /*IStatefulNode::*/ RestoreStateForRecompute() override
+    {
+        m_delayedValue.SetValue(m_delayedValueForRecompute);
+        if (m_delayedActivationMBLayoutForRecompute)
+            (m_delayedActivationMBLayout = make_shared<MBLayout>())->CopyFrom(m_delayedActivationMBLayoutForRecompute);
+        else
+            m_delayedActivationMBLayout = nullptr;
+    }
+
 protected:
     ElemType m_initialActivationValue;       // starting value for hidden activation vector at boundary
     Matrix<ElemType> m_delayedValue;         // saves the activation of the previous step that this node points to
     MBLayoutPtr m_delayedActivationMBLayout; // layout for m_delayedValue
+    Matrix<ElemType> m_delayedValueForRecompute;         // m_delayedValue as of the start of the minibatch (gradient checkpointing)
+    MBLayoutPtr m_delayedActivationMBLayoutForRecompute; // and its layout
     int m_timeStep;                          // delay in frames (typ. 1)
     function<void()> m_attachInputsFn;       // for late expansion of inputs (scripting)
 };
@@ -551,6 +622,700 @@ public:
 template class FutureValueNode<float>;
 template class FutureValueNode<double>;
 
+// -----------------------------------------------------------------------
+// LSTMCellNode (W, R, b, input [, P] [, Wp], reverse=false, peepholes=false, projection=false) -- complete LSTM layer over all frames of a minibatch
+//
+// Computes, for each frame t of each sequence of 'input' x:
+//   z_t = W x_t + R h_{t-1} + b     with z = [i; f; o; g], W: [4H x D], R: [4H x H], b: [4H x 1]
+//   c_t = sigmoid(f) .* c_{t-1} + sigmoid(i) .* tanh(g)
+//   h_t = sigmoid(o) .* tanh(c_t)   (this node's output; h and c are 0 at the start of each sequence)
+// With reverse=true, the recurrence runs right-to-left, i.e. h_{t+1}/c_{t+1} take the role of h_{t-1}/c_{t-1}.
+// With peepholes=true, the input P: [3H x 1] holds diagonal peephole weights [p_i; p_f; p_o], and the input and forget
+// gates see p_i .* c_{t-1} resp. p_f .* c_{t-1}, and the output gate p_o .* c_t (Gers et al.).
+// With projection=true, the input Wp: [P x H] projects the output to h_t = Wp (sigmoid(o) .* tanh(c_t)), which is also
+// what is fed back, so R is [4H x P] (LSTMP, Sak et al.).
+//
+// Compared to building the same cell from Times, Plus, Sigmoid, ElementTimes and PastValue nodes, this
+//  - computes the input projections of all four gates and all frames as a single GEMM,
+//  - runs only one small GEMM (R h_{t-1}, plus Wp m_t with projection) and one fused pointwise kernel per time step,
+//  - computes the weight gradients as one GEMM each over the entire minibatch,
+// and it keeps its recurrence internal, so it does not form a loop in the network.
+// In left-to-right mode, the state of sequences that extend beyond the end of the minibatch is carried over
+// into the next one (truncated BPTT). In reverse mode, sequences that extend beyond the minibatch end start from 0.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class LSTMCellNode : public ComputationNode<ElemType>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"LSTMCell";
+    }
+
+public:
+    LSTMCellNode(DEVICEID_TYPE deviceId, const wstring& name, bool reverse = false, bool peepholes = false, bool projection = false)
+        : Base(deviceId, name), m_reverse(reverse), m_peepholes(peepholes), m_projection(projection), m_gatesGradientValid(false), m_carriedOutput(deviceId), m_carriedCell(deviceId), m_noPeepholes(deviceId)
+    {
+    }
+    LSTMCellNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : LSTMCellNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"reverse"), configp->Get(L"peepholes"), configp->Get(L"projection"))
+    {
+        AttachInputs(configp, GetExpectedNumInputs());
+    }
+
+    virtual bool CanStepActiveSequencesOnly() const override
+    {
+        return false; // steps through all parallel sequences itself
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_reverse;
+        fstream << m_peepholes << m_projection;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_reverse;
+        if (modelVersion >= CNTK_MODEL_VERSION_4)
+            fstream >> m_peepholes >> m_projection;
+        else
+            m_peepholes = m_projection = false;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<LSTMCellNode<ElemType>>(nodeP);
+            node->m_reverse = m_reverse;
+            node->m_peepholes = m_peepholes;
+            node->m_projection = m_projection;
+            node->m_carriedOutput = m_carriedOutput;
+            node->m_carriedCell = m_carriedCell;
+        }
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation cannot be part of a recurrent loop; it implements the recurrence internally.", NodeName().c_str(), OperationName().c_str());
+
+        const Matrix<ElemType>& W = Input(0)->Value();
+        const Matrix<ElemType>& R = Input(1)->Value();
+        const Matrix<ElemType>& b = Input(2)->Value();
+        const Matrix<ElemType>& peepholes = m_peepholes ? Input(PeepholesIndex())->Value() : m_noPeepholes;
+        const size_t P = GetSampleMatrixNumRows();
+        const size_t H = GetCellDim();
+        const size_t S = GetNumParallelSequences();
+        const size_t T = GetNumTimeSteps();
+
+        // input projections of all frames in one go
+        Input(3)->MaskMissingValueColumnsToZero(fr); // gaps may hold garbage, which would leak into neighboring columns through the GEMM
+        m_gates->Resize(4 * H, S * T);
+        Matrix<ElemType>::Multiply(W, false, Input(3)->Value(), false, *m_gates);
+        Matrix<ElemType>::ScaleAndAdd(1, b, *m_gates); // (broadcasting the bias column)
+
+        m_cell->Resize(H, S * T);
+        m_prevOutput->Resize(P, S * T);
+        m_prevCell->Resize(H, S * T);
+        if (m_projection)
+            m_cellOutput->Resize(H, S * T);
+
+        // the recurrence
+        const int dir = m_reverse ? -1 : +1; // stepping direction
+        for (size_t k = 0; k < T; k++)
+        {
+            size_t t = m_reverse ? T - 1 - k : k;
+            FrameRange frt(m_pMBLayout, t);
+
+            // gather the previous state of each sequence
+            Matrix<ElemType> prevOutput = DataFor(*m_prevOutput, frt);
+            Matrix<ElemType> prevCell = DataFor(*m_prevCell, frt);
+            if (k > 0)
+            {
+                FrameRange frPrev(m_pMBLayout, t - dir);
+                prevOutput.SetValue(ValueFor(frPrev));
+                prevCell.SetValue(DataFor(*m_cell, frPrev));
+            }
+            else if (!m_reverse && m_carriedOutput.GetNumCols() == S && m_carriedOutput.GetNumRows() == P && m_carriedCell.GetNumRows() == H)
+            {
+                prevOutput.SetValue(m_carriedOutput);
+                prevCell.SetValue(m_carriedCell);
+            }
+            else
+            {
+                prevOutput.SetValue(0);
+                prevCell.SetValue(0);
+            }
+            ResetStateAtSequenceBoundaries(frt.WithTimeOffset(-dir), prevOutput, prevCell);
+
+            Matrix<ElemType> gates = DataFor(*m_gates, frt);
+            Matrix<ElemType>::MultiplyAndAdd(R, false, prevOutput, false, gates);
+            Matrix<ElemType> cell = DataFor(*m_cell, frt);
+            Matrix<ElemType> output = ValueFor(frt);
+            if (m_projection)
+            {
+                Matrix<ElemType> cellOutput = DataFor(*m_cellOutput, frt);
+                Matrix<ElemType>::LSTMPointwiseForward(gates, prevCell, peepholes, cell, cellOutput);
+                Matrix<ElemType>::Multiply(Input(ProjectionIndex())->Value(), false, cellOutput, false, output);
+            }
+            else
+                Matrix<ElemType>::LSTMPointwiseForward(gates, prevCell, peepholes, cell, output);
+        }
+
+        // carry over the state into the next minibatch for sequences that continue there
+        if (!m_reverse && m_pMBLayout->HasSequenceBeyondEnd())
+        {
+            FrameRange frLast(m_pMBLayout, T - 1);
+            m_carriedOutput.SetValue(ValueFor(frLast));
+            m_carriedCell.SetValue(DataFor(*m_cell, frLast));
+        }
+        else
+            m_carriedOutput.Resize(P, 0);
+    }
+
+    virtual void /*IComputationNode::*/ BeginBackprop() override
+    {
+        Base::BeginBackprop();
+        m_gatesGradientValid = false;
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation cannot be part of a recurrent loop; it implements the recurrence internally.", NodeName().c_str(), OperationName().c_str());
+
+        // the gradient w.r.t. all gate pre-activations is computed once and shared by all inputs
+        if (!m_gatesGradientValid)
+        {
+            BackpropThroughTime();
+            m_gatesGradientValid = true;
+        }
+
+        switch (inputIndex)
+        {
+        case 0: // W += dZ x^T
+            Matrix<ElemType>::MultiplyAndAdd(*m_gatesGradient, false, Input(3)->Value(), true, Input(0)->Gradient());
+            break;
+        case 1: // R += dZ h_{t-1}^T
+            Matrix<ElemType>::MultiplyAndAdd(*m_gatesGradient, false, *m_prevOutput, true, Input(1)->Gradient());
+            break;
+        case 2: // b += sum_t dZ_t
+            Matrix<ElemType>::MultiplyAndAdd(*m_gatesGradient, false, ConstOnes(m_gatesGradient->GetNumCols(), 1, m_gatesGradient->GetDeviceId()), false, Input(2)->Gradient());
+            break;
+        case 3: // x += W^T dZ
+            Matrix<ElemType>::MultiplyAndAdd(Input(0)->Value(), true, *m_gatesGradient, false, Input(3)->Gradient());
+            break;
+        default:
+            if (m_projection && inputIndex == ProjectionIndex()) // Wp += dh m^T
+                Matrix<ElemType>::MultiplyAndAdd(*m_outputGradients, false, *m_cellOutput, true, Input(inputIndex)->Gradient());
+            else // [p_i; p_f; p_o] += sum_t [dZ_i .* c_{t-1}; dZ_f .* c_{t-1}; dZ_o .* c_t]
+                BackpropToPeepholes(Input(inputIndex)->Gradient());
+            break;
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        // the previous outputs needed for the gradient are kept in m_prevOutput
+        return false;
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        if (m_inputs.size() != GetExpectedNumInputs())
+            InvalidArgument("%ls %ls operation requires %d inputs (W, R, b, input%ls%ls).", NodeName().c_str(), OperationName().c_str(),
+                            (int) GetExpectedNumInputs(), m_peepholes ? L", peepholes" : L"", m_projection ? L", projection" : L"");
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase();
+
+        for (size_t i = 0; i < m_inputs.size(); i++)
+        {
+            if (isFinalValidationPass && i != 3 && Input(i)->HasMBLayout())
+                InvalidArgument("%ls %ls operation requires its parameters to not be minibatch data (must not have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+        }
+        if (isFinalValidationPass && !Input(3)->HasMBLayout())
+            InvalidArgument("%ls %ls operation requires the input to be minibatch data (must have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+
+        // the cell dimension is determined by R, which is [4H x H], or, with projection, by Wp, which is [P x H]
+        size_t P = Input(1)->GetAsMatrixNumCols();
+        size_t H = P;
+        if (m_projection)
+        {
+            P = Input(ProjectionIndex())->GetAsMatrixNumRows();
+            H = Input(ProjectionIndex())->GetAsMatrixNumCols();
+        }
+        size_t D = Input(3)->GetSampleMatrixNumRows();
+        Input(1)->ValidateInferInputDimsFrom(TensorShape(4 * H, P));
+        Input(0)->ValidateInferInputDimsFrom(TensorShape(4 * H, D));
+        Input(2)->ValidateInferInputDimsFrom(TensorShape(4 * H, 1));
+        if (m_peepholes)
+            Input(PeepholesIndex())->ValidateInferInputDimsFrom(TensorShape(3 * H, 1));
+
+        if (isFinalValidationPass)
+        {
+            if (Input(1)->GetAsMatrixNumRows() != 4 * H || Input(1)->GetAsMatrixNumCols() != P)
+                InvalidArgument("%ls %ls operation: R must have dimensions [%d x %d], but has [%d x %d].", NodeName().c_str(), OperationName().c_str(),
+                                (int) (4 * H), (int) P, (int) Input(1)->GetAsMatrixNumRows(), (int) Input(1)->GetAsMatrixNumCols());
+            if (Input(0)->GetAsMatrixNumRows() != 4 * H || Input(0)->GetAsMatrixNumCols() != D)
+                InvalidArgument("%ls %ls operation: W must have dimensions [%d x %d], but has [%d x %d].", NodeName().c_str(), OperationName().c_str(),
+                                (int) (4 * H), (int) D, (int) Input(0)->GetAsMatrixNumRows(), (int) Input(0)->GetAsMatrixNumCols());
+            if (Input(2)->GetAsMatrixNumRows() != 4 * H || Input(2)->GetAsMatrixNumCols() != 1)
+                InvalidArgument("%ls %ls operation: b must have dimensions [%d x 1], but has [%d x %d].", NodeName().c_str(), OperationName().c_str(),
+                                (int) (4 * H), (int) Input(2)->GetAsMatrixNumRows(), (int) Input(2)->GetAsMatrixNumCols());
+            if (m_peepholes && (Input(PeepholesIndex())->GetAsMatrixNumRows() != 3 * H || Input(PeepholesIndex())->GetAsMatrixNumCols() != 1))
+                InvalidArgument("%ls %ls operation: the peepholes must have dimensions [%d x 1], but have [%d x %d].", NodeName().c_str(), OperationName().c_str(),
+                                (int) (3 * H), (int) Input(PeepholesIndex())->GetAsMatrixNumRows(), (int) Input(PeepholesIndex())->GetAsMatrixNumCols());
+        }
+
+        SetDims(TensorShape(P), true);
+    }
+
+    // the gate activations, cell states and previous states are needed from forward prop until backprop
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_gates, matrixPool);
+        RequestMatrixFromPool(m_cell, matrixPool);
+        RequestMatrixFromPool(m_prevOutput, matrixPool);
+        RequestMatrixFromPool(m_prevCell, matrixPool);
+        RequestMatrixFromPool(m_cellOutput, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_gatesGradient, matrixPool);
+        RequestMatrixFromPool(m_outputGradientCarry, matrixPool);
+        RequestMatrixFromPool(m_cellGradientCarry, matrixPool);
+        RequestMatrixFromPool(m_outputGradients, matrixPool);
+        RequestMatrixFromPool(m_cellOutputGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_gates, matrixPool);
+        ReleaseMatrixToPool(m_cell, matrixPool);
+        ReleaseMatrixToPool(m_prevOutput, matrixPool);
+        ReleaseMatrixToPool(m_prevCell, matrixPool);
+        ReleaseMatrixToPool(m_cellOutput, matrixPool);
+        ReleaseMatrixToPool(m_gatesGradient, matrixPool);
+        ReleaseMatrixToPool(m_outputGradientCarry, matrixPool);
+        ReleaseMatrixToPool(m_cellGradientCarry, matrixPool);
+        ReleaseMatrixToPool(m_outputGradients, matrixPool);
+        ReleaseMatrixToPool(m_cellOutputGradient, matrixPool);
+    }
+
+    bool HasPeepholes() const { return m_peepholes; }
+    bool HasProjection() const { return m_projection; }
+
+private:
+    size_t GetExpectedNumInputs() const { return 4 + (m_peepholes ? 1 : 0) + (m_projection ? 1 : 0); }
+    size_t PeepholesIndex() const { return 4; }
+    size_t ProjectionIndex() const { return m_peepholes ? 5 : 4; }
+    size_t GetCellDim() const { return Input(2)->GetAsMatrixNumRows() / 4; } // from b, which is [4H x 1]
+
+    Matrix<ElemType> DataFor(Matrix<ElemType>& data, const FrameRange& fr)
+    {
+        return DataWithMBLayoutFor(data, fr, m_pMBLayout);
+    }
+
+    // zero the previous state of all sequences for which 'frPrev' lies outside the sequence
+    void ResetStateAtSequenceBoundaries(const FrameRange& frPrev, Matrix<ElemType>& prevOutput, Matrix<ElemType>& prevCell)
+    {
+        MaskSequenceBoundariesTo(prevOutput, m_pMBLayout, frPrev, (ElemType) 0);
+        MaskSequenceBoundariesTo(prevCell, m_pMBLayout, frPrev, (ElemType) 0);
+    }
+
+    // zero columns of 'data' (one per parallel sequence) at frame 'fr' that are gaps
+    void MaskGapsAtFrame(const FrameRange& fr, Matrix<ElemType>& data)
+    {
+        if (m_pMBLayout->IsGap(fr))
+            data.MaskColumnsValue(DataWithMBLayoutFor(m_pMBLayout->GetColumnsValidityMask(data.GetDeviceId()), fr, m_pMBLayout), 0);
+    }
+
+    // compute m_gatesGradient, the gradient w.r.t. z_t for all frames, by running the recurrence backwards
+    void BackpropThroughTime()
+    {
+        const Matrix<ElemType>& R = Input(1)->Value();
+        const Matrix<ElemType>& peepholes = m_peepholes ? Input(PeepholesIndex())->Value() : m_noPeepholes;
+        const size_t P = GetSampleMatrixNumRows();
+        const size_t H = GetCellDim();
+        const size_t S = GetNumParallelSequences();
+        const size_t T = GetNumTimeSteps();
+
+        MaskMissingGradientColumnsToZero(FrameRange(m_pMBLayout));
+        m_gatesGradient->Resize(4 * H, S * T);
+        m_outputGradientCarry->Resize(P, S);
+        m_outputGradientCarry->SetValue(0);
+        m_cellGradientCarry->Resize(H, S);
+        m_cellGradientCarry->SetValue(0);
+        if (m_projection)
+        {
+            m_outputGradients->Resize(P, S * T);
+            m_cellOutputGradient->Resize(H, S);
+        }
+
+        const int dir = m_reverse ? -1 : +1; // stepping direction of the forward computation
+        for (size_t k = T; k-- > 0;)
+        {
+            size_t t = m_reverse ? T - 1 - k : k;
+            FrameRange frt(m_pMBLayout, t);
+
+            // dh_t = (gradient from consumers) + (gradient through the recurrence from the following step)
+            *m_outputGradientCarry += GradientFor(frt);
+
+            // with projection, the pointwise part sees dm_t = Wp^T dh_t, and dh_t is kept for the gradient of Wp
+            const Matrix<ElemType>* cellOutputGradient = m_outputGradientCarry.get();
+            if (m_projection)
+            {
+                DataFor(*m_outputGradients, frt).SetValue(*m_outputGradientCarry);
+                Matrix<ElemType>::Multiply(Input(ProjectionIndex())->Value(), true, *m_outputGradientCarry, false, *m_cellOutputGradient);
+                cellOutputGradient = m_cellOutputGradient.get();
+            }
+
+            Matrix<ElemType> gatesGradient = DataFor(*m_gatesGradient, frt);
+            Matrix<ElemType>::LSTMPointwiseBackward(DataFor(*m_gates, frt), DataFor(*m_cell, frt), DataFor(*m_prevCell, frt), peepholes, *cellOutputGradient, *m_cellGradientCarry, gatesGradient);
+            MaskGapsAtFrame(frt, gatesGradient);
+            MaskGapsAtFrame(frt, *m_cellGradientCarry);
+
+            // gradient w.r.t. h_{t-1}; c_{t-1} has already been updated in place
+            Matrix<ElemType>::Multiply(R, true, gatesGradient, false, *m_outputGradientCarry);
+            ResetStateAtSequenceBoundaries(frt.WithTimeOffset(-dir), *m_outputGradientCarry, *m_cellGradientCarry);
+        }
+    }
+
+    // add the gradient w.r.t. the peepholes, the products of the gate gradients with the cell states they have seen, summed over all frames
+    void BackpropToPeepholes(Matrix<ElemType>& peepholesGradient)
+    {
+        const size_t H = GetCellDim();
+        Matrix<ElemType> product(m_gatesGradient->GetDeviceId());
+        Matrix<ElemType> sum(H, 1, m_gatesGradient->GetDeviceId());
+        for (size_t k = 0; k < 3; k++) // (gaps do not contribute since m_gatesGradient is 0 there)
+        {
+            product.AssignRowSliceValuesOf(*m_gatesGradient, k * H, H);
+            product.ElementMultiplyWith(k == 2 ? *m_cell : *m_prevCell);
+            Matrix<ElemType>::Multiply(product, false, ConstOnes(product.GetNumCols(), 1, product.GetDeviceId()), false, sum);
+            peepholesGradient.AddToRowSliceValuesOf(sum, k * H, H);
+        }
+    }
+
+    bool m_reverse;            // run the recurrence right-to-left
+    bool m_peepholes;          // has the input P with the peephole weights
+    bool m_projection;         // has the input Wp that projects the output
+    bool m_gatesGradientValid; // m_gatesGradient has been computed in this backprop pass
+
+    shared_ptr<Matrix<ElemType>> m_gates;      // [4H x S*T] gate activations [i; f; o; g]
+    shared_ptr<Matrix<ElemType>> m_cell;       // [H x S*T] cell states c_t
+    shared_ptr<Matrix<ElemType>> m_prevOutput; // [P x S*T] h_{t-1} as used for each frame (0 at sequence boundaries)
+    shared_ptr<Matrix<ElemType>> m_prevCell;   // [H x S*T] c_{t-1} as used for each frame
+    shared_ptr<Matrix<ElemType>> m_cellOutput; // [H x S*T] m_t = sigmoid(o) .* tanh(c_t) before the projection (projection only)
+    shared_ptr<Matrix<ElemType>> m_gatesGradient;       // [4H x S*T] gradient w.r.t. z_t
+    shared_ptr<Matrix<ElemType>> m_outputGradientCarry; // [P x S] gradient w.r.t. h flowing back through the recurrence
+    shared_ptr<Matrix<ElemType>> m_cellGradientCarry;   // [H x S] gradient w.r.t. c flowing back through the recurrence
+    shared_ptr<Matrix<ElemType>> m_outputGradients;     // [P x S*T] dh_t of all frames (projection only)
+    shared_ptr<Matrix<ElemType>> m_cellOutputGradient;  // [H x S] dm_t = Wp^T dh_t (projection only)
+
+    Matrix<ElemType> m_carriedOutput; // [P x S] h of the last frame of the previous minibatch (truncated BPTT)
+    Matrix<ElemType> m_carriedCell;   // [H x S] c of the last frame of the previous minibatch
+    Matrix<ElemType> m_noPeepholes;   // empty; passed to the pointwise kernels if there are no peepholes
+};
+
+template class LSTMCellNode<float>;
+template class LSTMCellNode<double>;
+
+// -----------------------------------------------------------------------
+// GRUCellNode (W, R, b, input, reverse=false) -- complete GRU layer over all frames of a minibatch
+//
+// Computes, for each frame t of each sequence of 'input' x:
+//   z_t = W x_t + b,  q_t = R h_{t-1}   with z, q = [r; u; n], W: [3H x D], R: [3H x H], b: [3H x 1]
+//   r_t = sigmoid(z_r + q_r),  u_t = sigmoid(z_u + q_u),  n_t = tanh(z_n + r_t .* q_n)
+//   h_t = (1 - u_t) .* n_t + u_t .* h_{t-1}   (this node's output; h is 0 at the start of each sequence)
+// The reset gate is applied after the recurrent projection (as in cuDNN), so that a time step takes a single GEMM.
+// Everything else--reverse mode, carrying the state into the next minibatch, the single GEMMs over all frames for the
+// input projections and weight gradients--is as for LSTMCellNode.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class GRUCellNode : public ComputationNode<ElemType>, public NumInputs<4>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"GRUCell";
+    }
+
+public:
+    GRUCellNode(DEVICEID_TYPE deviceId, const wstring& name, bool reverse = false)
+        : Base(deviceId, name), m_reverse(reverse), m_gatesGradientValid(false), m_carriedOutput(deviceId)
+    {
+    }
+    GRUCellNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : GRUCellNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"reverse"))
+    {
+        AttachInputs(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual bool CanStepActiveSequencesOnly() const override
+    {
+        return false; // steps through all parallel sequences itself
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_reverse;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_reverse;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<GRUCellNode<ElemType>>(nodeP);
+            node->m_reverse = m_reverse;
+            node->m_carriedOutput = m_carriedOutput;
+        }
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation cannot be part of a recurrent loop; it implements the recurrence internally.", NodeName().c_str(), OperationName().c_str());
+
+        const Matrix<ElemType>& W = Input(0)->Value();
+        const Matrix<ElemType>& R = Input(1)->Value();
+        const Matrix<ElemType>& b = Input(2)->Value();
+        const size_t H = GetSampleMatrixNumRows();
+        const size_t S = GetNumParallelSequences();
+        const size_t T = GetNumTimeSteps();
+
+        // input projections of all frames in one go
+        Input(3)->MaskMissingValueColumnsToZero(fr); // gaps may hold garbage, which would leak into neighboring columns through the GEMM
+        m_gates->Resize(3 * H, S * T);
+        Matrix<ElemType>::Multiply(W, false, Input(3)->Value(), false, *m_gates);
+        Matrix<ElemType>::ScaleAndAdd(1, b, *m_gates); // (broadcasting the bias column)
+
+        m_recurrent->Resize(3 * H, S * T);
+        m_prevOutput->Resize(H, S * T);
+
+        // the recurrence
+        const int dir = m_reverse ? -1 : +1; // stepping direction
+        for (size_t k = 0; k < T; k++)
+        {
+            size_t t = m_reverse ? T - 1 - k : k;
+            FrameRange frt(m_pMBLayout, t);
+
+            // gather the previous state of each sequence
+            Matrix<ElemType> prevOutput = DataFor(*m_prevOutput, frt);
+            if (k > 0)
+                prevOutput.SetValue(ValueFor(FrameRange(m_pMBLayout, t - dir)));
+            else if (!m_reverse && m_carriedOutput.GetNumCols() == S && m_carriedOutput.GetNumRows() == H)
+                prevOutput.SetValue(m_carriedOutput);
+            else
+                prevOutput.SetValue(0);
+            ResetStateAtSequenceBoundaries(frt.WithTimeOffset(-dir), prevOutput);
+
+            Matrix<ElemType> recurrent = DataFor(*m_recurrent, frt);
+            Matrix<ElemType>::Multiply(R, false, prevOutput, false, recurrent);
+            Matrix<ElemType> gates = DataFor(*m_gates, frt);
+            Matrix<ElemType> output = ValueFor(frt);
+            Matrix<ElemType>::GRUPointwiseForward(gates, recurrent, prevOutput, output);
+        }
+
+        // carry over the state into the next minibatch for sequences that continue there
+        if (!m_reverse && m_pMBLayout->HasSequenceBeyondEnd())
+            m_carriedOutput.SetValue(ValueFor(FrameRange(m_pMBLayout, T - 1)));
+        else
+            m_carriedOutput.Resize(H, 0);
+    }
+
+    virtual void /*IComputationNode::*/ BeginBackprop() override
+    {
+        Base::BeginBackprop();
+        m_gatesGradientValid = false;
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation cannot be part of a recurrent loop; it implements the recurrence internally.", NodeName().c_str(), OperationName().c_str());
+
+        // the gradients w.r.t. the input and recurrent projections are computed once and shared by all inputs
+        if (!m_gatesGradientValid)
+        {
+            BackpropThroughTime();
+            m_gatesGradientValid = true;
+        }
+
+        switch (inputIndex)
+        {
+        case 0: // W += dZ x^T
+            Matrix<ElemType>::MultiplyAndAdd(*m_gatesGradient, false, Input(3)->Value(), true, Input(0)->Gradient());
+            break;
+        case 1: // R += dQ h_{t-1}^T
+            Matrix<ElemType>::MultiplyAndAdd(*m_recurrentGradient, false, *m_prevOutput, true, Input(1)->Gradient());
+            break;
+        case 2: // b += sum_t dZ_t
+            Matrix<ElemType>::MultiplyAndAdd(*m_gatesGradient, false, ConstOnes(m_gatesGradient->GetNumCols(), 1, m_gatesGradient->GetDeviceId()), false, Input(2)->Gradient());
+            break;
+        case 3: // x += W^T dZ
+            Matrix<ElemType>::MultiplyAndAdd(Input(0)->Value(), true, *m_gatesGradient, false, Input(3)->Gradient());
+            break;
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        // the previous outputs needed for the gradient are kept in m_prevOutput
+        return false;
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase();
+
+        if (isFinalValidationPass && (Input(0)->HasMBLayout() || Input(1)->HasMBLayout() || Input(2)->HasMBLayout()))
+            InvalidArgument("%ls %ls operation requires W, R and b to not be minibatch data (must not have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+        if (isFinalValidationPass && !Input(3)->HasMBLayout())
+            InvalidArgument("%ls %ls operation requires the input to be minibatch data (must have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+
+        // the hidden dimension is determined by R, which is [3H x H]
+        size_t H = Input(1)->GetAsMatrixNumCols();
+        size_t D = Input(3)->GetSampleMatrixNumRows();
+        Input(1)->ValidateInferInputDimsFrom(TensorShape(3 * H, H));
+        Input(0)->ValidateInferInputDimsFrom(TensorShape(3 * H, D));
+        Input(2)->ValidateInferInputDimsFrom(TensorShape(3 * H, 1));
+
+        if (isFinalValidationPass)
+        {
+            if (Input(1)->GetAsMatrixNumRows() != 3 * H)
+                InvalidArgument("%ls %ls operation: R must have dimensions [3H x H], but has [%d x %d].", NodeName().c_str(), OperationName().c_str(), (int) Input(1)->GetAsMatrixNumRows(), (int) H);
+            if (Input(0)->GetAsMatrixNumRows() != 3 * H || Input(0)->GetAsMatrixNumCols() != D)
+                InvalidArgument("%ls %ls operation: W must have dimensions [%d x %d], but has [%d x %d].", NodeName().c_str(), OperationName().c_str(),
+                                (int) (3 * H), (int) D, (int) Input(0)->GetAsMatrixNumRows(), (int) Input(0)->GetAsMatrixNumCols());
+            if (Input(2)->GetAsMatrixNumRows() != 3 * H || Input(2)->GetAsMatrixNumCols() != 1)
+                InvalidArgument("%ls %ls operation: b must have dimensions [%d x 1], but has [%d x %d].", NodeName().c_str(), OperationName().c_str(),
+                                (int) (3 * H), (int) Input(2)->GetAsMatrixNumRows(), (int) Input(2)->GetAsMatrixNumCols());
+        }
+
+        SetDims(TensorShape(H), true);
+    }
+
+    // the gate activations, recurrent projections and previous outputs are needed from forward prop until backprop
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_gates, matrixPool);
+        RequestMatrixFromPool(m_recurrent, matrixPool);
+        RequestMatrixFromPool(m_prevOutput, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_gatesGradient, matrixPool);
+        RequestMatrixFromPool(m_recurrentGradient, matrixPool);
+        RequestMatrixFromPool(m_outputGradientCarry, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_gates, matrixPool);
+        ReleaseMatrixToPool(m_recurrent, matrixPool);
+        ReleaseMatrixToPool(m_prevOutput, matrixPool);
+        ReleaseMatrixToPool(m_gatesGradient, matrixPool);
+        ReleaseMatrixToPool(m_recurrentGradient, matrixPool);
+        ReleaseMatrixToPool(m_outputGradientCarry, matrixPool);
+    }
+
+private:
+    Matrix<ElemType> DataFor(Matrix<ElemType>& data, const FrameRange& fr)
+    {
+        return DataWithMBLayoutFor(data, fr, m_pMBLayout);
+    }
+
+    // zero the previous state of all sequences for which 'frPrev' lies outside the sequence
+    void ResetStateAtSequenceBoundaries(const FrameRange& frPrev, Matrix<ElemType>& prevOutput)
+    {
+        MaskSequenceBoundariesTo(prevOutput, m_pMBLayout, frPrev, (ElemType) 0);
+    }
+
+    // zero columns of 'data' (one per parallel sequence) at frame 'fr' that are gaps
+    void MaskGapsAtFrame(const FrameRange& fr, Matrix<ElemType>& data)
+    {
+        if (m_pMBLayout->IsGap(fr))
+            data.MaskColumnsValue(DataWithMBLayoutFor(m_pMBLayout->GetColumnsValidityMask(data.GetDeviceId()), fr, m_pMBLayout), 0);
+    }
+
+    // compute m_gatesGradient and m_recurrentGradient for all frames by running the recurrence backwards
+    void BackpropThroughTime()
+    {
+        const Matrix<ElemType>& R = Input(1)->Value();
+        const size_t H = GetSampleMatrixNumRows();
+        const size_t S = GetNumParallelSequences();
+        const size_t T = GetNumTimeSteps();
+
+        MaskMissingGradientColumnsToZero(FrameRange(m_pMBLayout));
+        m_gatesGradient->Resize(3 * H, S * T);
+        m_recurrentGradient->Resize(3 * H, S * T);
+        m_outputGradientCarry->Resize(H, S);
+        m_outputGradientCarry->SetValue(0);
+
+        const int dir = m_reverse ? -1 : +1; // stepping direction of the forward computation
+        for (size_t k = T; k-- > 0;)
+        {
+            size_t t = m_reverse ? T - 1 - k : k;
+            FrameRange frt(m_pMBLayout, t);
+
+            // dh_t = (gradient from consumers) + (gradient through the recurrence from the following step)
+            *m_outputGradientCarry += GradientFor(frt);
+
+            Matrix<ElemType> gatesGradient = DataFor(*m_gatesGradient, frt);
+            Matrix<ElemType> recurrentGradient = DataFor(*m_recurrentGradient, frt);
+            Matrix<ElemType>::GRUPointwiseBackward(DataFor(*m_gates, frt), DataFor(*m_recurrent, frt), DataFor(*m_prevOutput, frt), *m_outputGradientCarry, gatesGradient, recurrentGradient);
+            MaskGapsAtFrame(frt, gatesGradient);
+            MaskGapsAtFrame(frt, recurrentGradient);
+            MaskGapsAtFrame(frt, *m_outputGradientCarry);
+
+            // gradient w.r.t. h_{t-1}: the direct part dh_t .* u_t is already in the carry
+            Matrix<ElemType>::MultiplyAndAdd(R, true, recurrentGradient, false, *m_outputGradientCarry);
+            ResetStateAtSequenceBoundaries(frt.WithTimeOffset(-dir), *m_outputGradientCarry);
+        }
+    }
+
+    bool m_reverse;            // run the recurrence right-to-left
+    bool m_gatesGradientValid; // m_gatesGradient has been computed in this backprop pass
+
+    shared_ptr<Matrix<ElemType>> m_gates;      // [3H x S*T] gate activations [r; u; n]
+    shared_ptr<Matrix<ElemType>> m_recurrent;  // [3H x S*T] recurrent projections R h_{t-1}
+    shared_ptr<Matrix<ElemType>> m_prevOutput; // [H x S*T] h_{t-1} as used for each frame (0 at sequence boundaries)
+    shared_ptr<Matrix<ElemType>> m_gatesGradient;       // [3H x S*T] gradient w.r.t. z_t
+    shared_ptr<Matrix<ElemType>> m_recurrentGradient;   // [3H x S*T] gradient w.r.t. q_t
+    shared_ptr<Matrix<ElemType>> m_outputGradientCarry; // [H x S] gradient w.r.t. h flowing back through the recurrence
+
+    Matrix<ElemType> m_carriedOutput; // [H x S] h of the last frame of the previous minibatch (truncated BPTT)
+};
+
+template class GRUCellNode<float>;
+template class GRUCellNode<double>;
+
 #ifdef COMING_SOON
 
 // -----------------------------------------------------------------------
@@ -598,7 +1363,7 @@ public:
         duplicate = 0     // duplicate frame at boundary, e.g. duplicate first frame. Non-recurrent mode only.
     };
     ShiftNode(DEVICEID_TYPE deviceId, const wstring& name, int fromOffset, BoundaryMode boundaryMode, int shiftDimParam)
-        : Base(deviceId, name), m_fromOffset(fromOffset), m_boundaryMode(boundaryMode), m_shiftDimParam(shiftDimParam), m_shiftDim(SIZE_MAX), m_state(deviceId)
+        : Base(deviceId, name), m_fromOffset(fromOffset), m_boundaryMode(boundaryMode), m_shiftDimParam(shiftDimParam), m_shiftDim(SIZE_MAX), m_state(deviceId), m_stateForRecompute(deviceId)
     {
         CreateMatrixIfNull(m_value);
     }
@@ -1065,6 +1830,17 @@ public:
         return false;
     }
 
+    // the boundary handling depends on state that is not exposed for loop capture
+    virtual bool CollectCaptureState(std::vector<const void*>&, std::vector<MBLayoutPtr>&) const override
+    {
+        return false;
+    }
+    // ...and determines its own frame ranges
+    virtual bool CanStepActiveSequencesOnly() const override
+    {
+        return false;
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         assert(m_inputs.size() == 2);
@@ -1163,6 +1939,14 @@ public:
         m_state.m_shape = std::move(state->m_shape);
         m_state.m_delayedSequences = std::move(state->m_delayedSequences);
     }
+    virtual void SaveStateForRecompute() override
+    {
+        m_stateForRecompute = m_state;
+    }
+    virtual void RestoreStateForRecompute() override
+    {
+        m_state = m_stateForRecompute;
+    }
 
 protected:
     // parameters remembered from construction
@@ -1173,6 +1957,7 @@ protected:
     size_t m_shiftDim; // m_shiftDimParam matched to the real tensor index
 
     ShiftNodeState m_state; // state that is carried over across evaluations
+    ShiftNodeState m_stateForRecompute; // m_state as of the start of the minibatch (gradient checkpointing)
     // Note: The version held by this node lives in the GPU, whereas the versions being exported carry CPU-side copies
 
     function<void()> m_attachInputsFn; // for late expansion of inputs (scripting)
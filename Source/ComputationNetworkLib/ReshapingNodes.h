@@ -158,6 +158,8 @@ public:
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
+        if (IsValueSharedWithInput()) // our value is our input's (see ComputationNetwork::ShareBuffersWithConsumers())
+            return;
         ValueFor(fr).SetValue(Input(0)->ValueFor(fr));
     }
 
@@ -166,6 +168,13 @@ public:
         Input(inputIndex)->GradientFor(fr).SetValue(GradientFor(fr));
     }
 
+    // the elements are the same and in the same order, so the input's buffers can serve as ours (not for sparse inputs, whose format is the reader's)
+    virtual bool IsValueViewOfInput() const override
+    {
+        return !Input(0)->IsLeaf() || Input(0)->Value().GetMatrixType() == DENSE;
+    }
+    virtual bool CanShareGradientWithInput(size_t /*inputIndex*/) const override { return true; }
+
     virtual bool OutputUsedInComputingInputNodesGradients() const override
     {
         return false;
@@ -175,6 +184,19 @@ public:
         return false;
     }
 
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& other) const override
+    {
+        auto node = dynamic_cast<const ReshapeNode<ElemType>*>(&other);
+        return node && node->m_replacementSampleLayout == m_replacementSampleLayout &&
+               node->m_beginDimParameter == m_beginDimParameter && node->m_endDimParameter == m_endDimParameter;
+    }
+
+    // true if all dimensions of the input are replaced, i.e. the result does not depend on the input's shape, only on its #elements
+    bool ReplacesWholeSampleLayout() const
+    {
+        return m_beginDimParameter <= 1 && m_endDimParameter == 0;
+    }
+
 private:
     TensorShape m_replacementSampleLayout; // user-specified dimensions to replace dimensions [beginDim, endDim]
     int m_beginDimParameter;               // 1-based index range as specified
@@ -668,6 +690,11 @@ public:
     {
     }
 
+    virtual bool CanStepActiveSequencesOnly() const override
+    {
+        return false; // Stack() and Unstack() shuffle all parallel sequences
+    }
+
     // stack K consecutive frames into a single frame that is K times taller
     // FrameRange and MBLayout refer to the 'to' (reduced) timeline.
     // BUGBUG: THIS IS UNTESTED!!
@@ -19,8 +19,6 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This header collects special-purpose nodes.
 
-#ifdef COMING_SOON
-
 // -----------------------------------------------------------------------
 // GMMLogLikelihoodNode (unnormedPrior, means, logStdDevs, features) -- GMM log LL over input vector(s)
 // calculates the log likelihood of a feature given parameters of a Gaussian mixture model (GMM) with shared diagonal variance
@@ -29,6 +27,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 //  - logStdDevs: std deviations, pooled across mix (i.e. same dim as features)
 // UnnormedPrior, means, and logStdDevs can be either a single column or one per sample, e.g.
 // when parameters are computed by other nodes.
+// With a single column (model parameters), all components and frames are computed at once with matrix products, using
+// ||x-u_c||^2 = ||x||^2 - 2 u_c'x + ||u_c||^2, so that no (feature dim x #components) difference vector is formed per frame.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -74,7 +74,7 @@ public:
         {
             Matrix<ElemType> sliceNormedDeviationVectors = DataFor(*m_normedDeviationVectors, fr);
             if (colsPrior == 1)
-                BackpropToMean(Input(1)->Gradient(), sliceGradientValue, sliceNormedDeviationVectors, slicePosterior, *m_temp);
+                BackpropToSharedMean(Input(1)->Gradient(), sliceGradientValue, Input(1)->Value(), Input(3)->ValueFor(fr), slicePosterior, *m_temp);
             else
             {
                 Matrix<ElemType> sliceMeanGradient = Input(1)->GradientFor(fr);
@@ -86,19 +86,24 @@ public:
         {
             Matrix<ElemType> sliceNormedDeviation = DataFor(*m_normedDeviation, fr);
             if (colsPrior == 1)
-                BackpropToLogStddev(Input(2)->Gradient(), sliceGradientValue, sliceNormedDeviation, slicePosterior, *m_temp);
+                BackpropToLogStddev(Input(2)->Gradient(), sliceGradientValue, sliceNormedDeviation, slicePosterior, *m_temp, Input(3)->GetSampleMatrixNumRows());
             else
             {
                 Matrix<ElemType> sliceLotStddevGradient = Input(2)->GradientFor(fr);
-                BackpropToLogStddev(sliceLotStddevGradient, sliceGradientValue, sliceNormedDeviation, slicePosterior, *m_temp);
+                BackpropToLogStddev(sliceLotStddevGradient, sliceGradientValue, sliceNormedDeviation, slicePosterior, *m_temp, Input(3)->GetSampleMatrixNumRows());
             }
         }
         break;
         case 3:
         {
-            Matrix<ElemType> sliceNormedDeviationVectors = DataFor(*m_normedDeviationVectors, fr);
             Matrix<ElemType> sliceFeatureGradient = Input(3)->GradientFor(fr);
-            BackpropToFeature(sliceFeatureGradient, sliceGradientValue, sliceNormedDeviationVectors, slicePosterior, *m_temp);
+            if (colsPrior == 1)
+                BackpropToFeatureWithSharedParameters(sliceFeatureGradient, sliceGradientValue, Input(3)->ValueFor(fr), slicePosterior, *m_temp);
+            else
+            {
+                Matrix<ElemType> sliceNormedDeviationVectors = DataFor(*m_normedDeviationVectors, fr);
+                BackpropToFeature(sliceFeatureGradient, sliceGradientValue, sliceNormedDeviationVectors, slicePosterior, *m_temp);
+            }
         }
         break;
         default:
@@ -115,10 +120,9 @@ public:
 
     virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override
     {
-        // The GMMLogLikelihoodNode does not require any of it's input's values for computing
-        // the gradients of its input nodes
-        UNREFERENCED_PARAMETER(childIndex);
-        return false;
+        // with shared parameters, the gradients w.r.t. means and features are formed from the means and features
+        // instead of kept difference vectors
+        return childIndex == 1 || childIndex == 3;
     }
 
     void BackpropToUnnormedPrior(Matrix<ElemType>& unnormedPriorGradientValues, const Matrix<ElemType>& gradientValues,
@@ -160,13 +164,33 @@ public:
             RuntimeError("GMMLogLikelihoodNode: stddev should either have same number of columns as the features or have only one column.");
     }
 
-    void BackpropToLogStddev(Matrix<ElemType>& logStddevGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& normedDeviation,
-                             const Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
+    // shared means (one column): meanGradient_c += sum_t posterior_c,t gradient_t (x_t - u_c)/stddev_c^2
+    void BackpropToSharedMean(Matrix<ElemType>& meanGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& mean, const Matrix<ElemType>& feature,
+                              const Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
     {
         size_t numComponent = posterior.GetNumRows();
+        size_t featureDim = feature.GetNumRows();
+        const TensorShape meansShape(featureDim, numComponent);
+
+        // temp <-- posterior * gradient / stddev^2
+        temp.Resize(posterior);
+        TensorView<ElemType> tempTensor(temp);
+        tempTensor.AssignElementwiseProductOf(TensorView<ElemType>(posterior), TensorView<ElemType>(gradientValues));
+        tempTensor.AssignElementwiseProductOf(tempTensor, TensorView<ElemType>(*m_invVariance));
+
+        Matrix<ElemType> meanGradientMatrix = meanGradientValues.Reshaped(featureDim, numComponent);
+        Matrix<ElemType>::MultiplyAndAdd(feature, false, temp, true, meanGradientMatrix);
+        m_componentTemp->Resize(numComponent, 1);
+        TensorView<ElemType>(*m_componentTemp).AssignCopyOf(tempTensor);
+        TensorView<ElemType>(meanGradientValues, meansShape).AddElementwiseProductOf(TensorView<ElemType>(mean, meansShape), TensorView<ElemType>(*m_componentTemp, TensorShape(1, numComponent)), -1);
+    }
+
+    void BackpropToLogStddev(Matrix<ElemType>& logStddevGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& normedDeviation,
+                             const Matrix<ElemType>& posterior, Matrix<ElemType>& temp, size_t featureDim)
+    {
         size_t numSamples = posterior.GetNumCols();
 
-        temp.AssignDifferenceOf(normedDeviation, (ElemType) numComponent);
+        temp.AssignDifferenceOf(normedDeviation, (ElemType) featureDim);
         temp.ElementMultiplyWith(posterior);
         temp.RowElementMultiplyWith(gradientValues);
         if (logStddevGradientValues.GetNumCols() == numSamples)
@@ -198,6 +222,18 @@ public:
             featureGradientValues.AddWithRowSliceValuesOf(temp, i * featureSize, featureSize);
     }
 
+    // shared parameters: featureGradient_t += sum_c posterior_c,t gradient_t (u_c - x_t)/stddev_c^2
+    void BackpropToFeatureWithSharedParameters(Matrix<ElemType>& featureGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& feature,
+                                               const Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
+    {
+        temp.Resize(posterior);
+        TensorView<ElemType>(temp).AssignElementwiseProductOf(TensorView<ElemType>(posterior), TensorView<ElemType>(gradientValues));
+
+        Matrix<ElemType>::MultiplyAndAdd(*m_scaledMeans, false, temp, false, featureGradientValues);
+        Matrix<ElemType>::Multiply(*m_invVariance, true, temp, false, *m_sampleTemp);
+        TensorView<ElemType>(featureGradientValues).AddElementwiseProductOf(TensorView<ElemType>(feature), TensorView<ElemType>(*m_sampleTemp), -1);
+    }
+
     virtual void UpdateFunctionMBSize() override
     {
         Base::UpdateFunctionMBSize();
@@ -210,8 +246,10 @@ public:
         m_prior->Resize(numComponents, colsPrior);
         m_stddev->Resize(numComponents, colsPrior);
         m_normedDeviation->Resize(numComponents, numCols);
-        m_normedDeviationVectors->Resize(numComponents * featureSize, numCols);
+        m_normedDeviationVectors->Resize(colsPrior == 1 ? 0 : numComponents * featureSize, colsPrior == 1 ? 0 : numCols); // (only for per-sample parameters)
         m_posterior->Resize(numComponents, numCols);
+        m_invVariance->Resize(numComponents, 1);
+        m_scaledMeans->Resize(featureSize, numComponents);
     }
 
     // input0=unnormedPrior, input1=mean, input2=logstddev, input3=feature
@@ -229,8 +267,11 @@ public:
 
         if (colsPrior == 1)
         {
-            ForwardPropS(sliceOutputValue, Input(0)->Value(), Input(1)->Value(), Input(2)->Value(), sliceFeature,
-                         *m_prior, *m_stddev, sliceNormedDeviationVectors, sliceNormedDeviation, slicePosterior, *m_temp);
+            ForwardPropWithSharedParameters(sliceOutputValue, Input(0)->Value(), Input(1)->Value(), Input(2)->Value(), sliceFeature, sliceNormedDeviation, slicePosterior);
+
+            // gaps must not contribute to the sums over frames in the gradients
+            MaskMissingColumnsTo(*m_normedDeviation, m_pMBLayout, fr, (ElemType) 0);
+            MaskMissingColumnsTo(*m_posterior, m_pMBLayout, fr, (ElemType) 0);
         }
         else if (colsPrior == numSamples)
         {
@@ -248,8 +289,54 @@ public:
             RuntimeError("GMMLogLikelihoodNode: UnnormedPrior should either have same number of columns as the features or have only one column.");
     }
 
+    // input0=unnormedPrior, input1=mean, input2=logstddev, input3=feature, each of the first three a single column
+    // Computes normedDeviation <-- ||x-u_c||^2/stddev_c^2 with one matrix product over all components and frames, and keeps
+    // m_prior, m_invVariance <-- 1/stddev^2, and m_scaledMeans <-- u_c/stddev_c^2 for the gradients. The sum over components
+    // is taken in the log domain: log sum_c p_c = sum_c posterior_c (log p_c - log posterior_c), where every term in
+    // parentheses is the same, so that neither the per-component likelihoods nor the weighted sum underflow.
+    void ForwardPropWithSharedParameters(Matrix<ElemType>& functionValues, const Matrix<ElemType>& unnormedPrior, const Matrix<ElemType>& mean, const Matrix<ElemType>& logstddev,
+                                         const Matrix<ElemType>& feature, Matrix<ElemType>& normedDeviation, Matrix<ElemType>& posterior)
+    {
+        size_t numComponent = unnormedPrior.GetNumRows();
+        size_t numSamples = feature.GetNumCols();
+        size_t featureDim = feature.GetNumRows();
+        const TensorShape meansShape(featureDim, numComponent);
+
+        m_prior->AssignLogSoftmaxOf(unnormedPrior, true); // log prior
+        m_invVariance->AssignProductOf(-2, logstddev);
+        m_invVariance->InplaceExp();
+
+        // normedDeviation <-- (||x||^2 - 2 u_c'x + ||u_c||^2) / stddev_c^2
+        TensorView<ElemType>(*m_scaledMeans, meansShape).AssignElementwiseProductOf(TensorView<ElemType>(mean, meansShape), TensorView<ElemType>(*m_invVariance, TensorShape(1, numComponent)));
+        m_sampleTemp->Resize(1, numSamples);
+        TensorView<ElemType>(*m_sampleTemp).AssignElementwiseProductOf(TensorView<ElemType>(feature), TensorView<ElemType>(feature)); // ||x||^2
+        m_componentTemp->Resize(numComponent, 1);
+        TensorView<ElemType>(*m_componentTemp, TensorShape(1, numComponent)).AssignElementwiseProductOf(TensorView<ElemType>(*m_scaledMeans, meansShape), TensorView<ElemType>(mean, meansShape)); // ||u_c||^2/stddev_c^2
+        Matrix<ElemType>::MultiplyAndWeightedAdd(-2, *m_scaledMeans, true, feature, false, 0, normedDeviation);
+        TensorView<ElemType> normedDeviationTensor(normedDeviation);
+        normedDeviationTensor.AddElementwiseProductOf(TensorView<ElemType>(*m_invVariance), TensorView<ElemType>(*m_sampleTemp));
+        normedDeviationTensor.AddCopyOf(TensorView<ElemType>(*m_componentTemp));
+
+        // m_temp <-- log p_c = log prior_c - normedDeviation/2 - featureDim (log stddev_c + log(2 pi)/2)
+        TensorView<ElemType> componentTempTensor(*m_componentTemp);
+        componentTempTensor.AssignCopyOf(TensorView<ElemType>(*m_prior));
+        componentTempTensor.AddCopyOf(TensorView<ElemType>(logstddev), -(ElemType) featureDim);
+        *m_componentTemp -= (ElemType)(featureDim / 2.0f * log(TWO_PI));
+        m_temp->Resize(numComponent, numSamples);
+        TensorView<ElemType> tempTensor(*m_temp);
+        tempTensor.AssignCopyOf(normedDeviationTensor, -0.5f);
+        tempTensor.AddCopyOf(componentTempTensor);
+
+        // posterior and log likelihood
+        posterior.AssignLogSoftmaxOf(*m_temp, true);
+        tempTensor.AddCopyOf(TensorView<ElemType>(posterior), -1); // m_temp <-- log likelihood of the frame, in every row
+        posterior.InplaceExp();
+        TensorView<ElemType>(functionValues).AssignElementwiseProductOf(TensorView<ElemType>(posterior), tempTensor);
+
+        m_prior->InplaceExp(); // the gradient w.r.t. unnormedPrior needs the prior
+    }
+
     // input0=unnormedPrior, input1=mean, input2=logstddev, input3=feature
-    // If we want to speed up we need to replace following code with a several specialized GPU functions
     /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType>& functionValues, const Matrix<ElemType>& unnormedPrior, const Matrix<ElemType>& mean, Matrix<ElemType>& logstddev,
                                                      const Matrix<ElemType>& feature, Matrix<ElemType>& prior, Matrix<ElemType>& stddev, Matrix<ElemType>& normedDeviationVectors,
                                                      Matrix<ElemType>& normedDeviation, Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
@@ -294,9 +381,9 @@ public:
         // compute per-component likelihood
         posterior.AssignProductOf(-0.5f, normedDeviation); // posterior  <-- -||x-u_c||^2/(stddev^2)/2 and in (1, numSamples* numComponent) dim
         temp.InplaceLog();
-        temp *= ((ElemType) numComponent / 2.0f);                   // temp <-- stddev^c and in (1, numSamples* numComponent) dim
-        posterior -= temp;                                          // posterior  <-- exp[-||x-u_c||^2/(stddev^2)/2]/(stddev^c)
-        posterior -= (ElemType)(numComponent / 2.0f * log(TWO_PI)); // likelihood for each component and sample is now computed and stored in posterior
+        temp *= ((ElemType) featureDim / 2.0f);                   // temp <-- stddev^d and in (1, numSamples* numComponent) dim
+        posterior -= temp;                                        // posterior  <-- exp[-||x-u_c||^2/(stddev^2)/2]/(stddev^d)
+        posterior -= (ElemType)(featureDim / 2.0f * log(TWO_PI)); // likelihood for each component and sample is now computed and stored in posterior
         posterior.InplaceExp();                                     // posterior  <-- exp(-||x-u_c||^2/(stddev^2)/2)
 
         normedDeviation.Reshape(numComponent, numSamples); // reshape back
@@ -374,6 +461,10 @@ public:
         RequestMatrixFromPool(m_stddev, matrixPool);
         RequestMatrixFromPool(m_posterior, matrixPool);
         RequestMatrixFromPool(m_temp, matrixPool);
+        RequestMatrixFromPool(m_invVariance, matrixPool);
+        RequestMatrixFromPool(m_scaledMeans, matrixPool);
+        RequestMatrixFromPool(m_componentTemp, matrixPool);
+        RequestMatrixFromPool(m_sampleTemp, matrixPool);
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
@@ -386,6 +477,10 @@ public:
         ReleaseMatrixToPool(m_stddev, matrixPool);
         ReleaseMatrixToPool(m_posterior, matrixPool);
         ReleaseMatrixToPool(m_temp, matrixPool);
+        ReleaseMatrixToPool(m_invVariance, matrixPool);
+        ReleaseMatrixToPool(m_scaledMeans, matrixPool);
+        ReleaseMatrixToPool(m_componentTemp, matrixPool);
+        ReleaseMatrixToPool(m_sampleTemp, matrixPool);
     }
 
 protected:
@@ -395,13 +490,15 @@ protected:
     shared_ptr<Matrix<ElemType>> m_stddev;
     shared_ptr<Matrix<ElemType>> m_posterior;
     shared_ptr<Matrix<ElemType>> m_temp;
+    shared_ptr<Matrix<ElemType>> m_invVariance;   // (shared parameters) 1/stddev^2
+    shared_ptr<Matrix<ElemType>> m_scaledMeans;   // (shared parameters) u_c/stddev_c^2, as a (feature dim x #components) matrix
+    shared_ptr<Matrix<ElemType>> m_componentTemp; // (shared parameters) one value per component
+    shared_ptr<Matrix<ElemType>> m_sampleTemp;    // (shared parameters) one value per frame
 };
 
 template class GMMLogLikelihoodNode<float>;
 template class GMMLogLikelihoodNode<double>;
 
-#endif
-
 // -----------------------------------------------------------------------
 // SequenceWithSoftmaxNode (label, prediction, loglikelihood)
 // word-lattice based sequence training criterion, using a Microsoft-proprietary lattice format
@@ -602,7 +699,7 @@ public:
     void SetFrameDropThresh(double frameDropThresh) { m_frameDropThreshold = frameDropThresh; }
     void SetReferenceAlign(const bool doreferencealign) { m_doReferenceAlignment = doreferencealign; }
 
-    void SetGammarCalculationParam(const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR)
+    void SetGammarCalculationParam(const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR, const double& pruningBeam = 0.0)
     {
         msra::lattices::SeqGammarCalParam param;
         param.amf = amf;
@@ -610,6 +707,7 @@ public:
         param.wp = wp;
         param.bMMIfactor = bMMIfactor;
         param.sMBRmode = sMBR;
+        param.pruningbeam = pruningBeam;
         m_gammaCalculator.SetGammarCalculationParams(param);
     }
 
@@ -734,4 +832,58 @@ public:
 template class DummyCriterionNode<float>;
 template class DummyCriterionNode<double>;
 
+// -----------------------------------------------------------------------
+// DeviceTransferNode (input) -- the input, copied to this node's device
+// Inserted by ComputationNetwork::PlaceOnDevices() wherever a node consumes the output of a node that lives on another device,
+// so that all other nodes only ever see inputs on their own device. The gradient is copied back to the input's device.
+// On the same device, this is a plain copy.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class DeviceTransferNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<1>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"DeviceTransfer";
+    }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(DeviceTransferNode);
+    DeviceTransferNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        Value().SetValueAcrossDevices(Input(0)->Value());
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t /*inputIndex*/) override
+    {
+        // bring the gradient over to the input's device, and accumulate it there
+        const DEVICEID_TYPE inputDeviceId = Input(0)->GetDeviceId();
+        if (!m_gradientOnInputDevice || m_gradientOnInputDevice->GetDeviceId() != inputDeviceId)
+            m_gradientOnInputDevice = make_shared<Matrix<ElemType>>(inputDeviceId);
+        m_gradientOnInputDevice->SetValueAcrossDevices(Gradient());
+        Input(0)->Gradient() += *m_gradientOnInputDevice;
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        ValidateUnaryMap(isFinalValidationPass);
+    }
+
+private:
+    shared_ptr<Matrix<ElemType>> m_gradientOnInputDevice; // staging buffer for the gradient, on Input(0)'s device
+};
+
+template class DeviceTransferNode<float>;
+template class DeviceTransferNode<double>;
+
 } } }
@@ -14,6 +14,7 @@
 #include <stdexcept>
 #include <list>
 #include <memory>
+#include <random>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -113,6 +114,9 @@ template class SquareErrorNode<double>;
 // -----------------------------------------------------------------------
 // CrossEntropyWithSoftmaxNode (labels, prediction)
 // calculates: -sum(left_i * log(softmax_i(right)))
+// With dense labels, forward and backward each read the prediction once (Matrix::CrossEntropyWithSoftmaxForward/Backward())
+// and keep only the log-sum-exp of each column; the softmax and log softmax are never stored for the whole minibatch,
+// except the log softmax for the gradient w.r.t. the labels, which is rarely needed.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -138,6 +142,11 @@ public:
         // left input is scalar
         if (inputIndex == 0) // left derivative
         {
+            if (IsFused())
+            {
+                m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
+                MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
+            }
 #if DUMPOUTPUT
             *m_logSoftmaxOfRight.Print("CrossEntropyWithSoftmax Partial-logSoftmaxOfRight");
             Gradient().Print("CrossEntropyWithSoftmax Partial-gradientValues");
@@ -154,14 +163,19 @@ public:
         else if (inputIndex == 1) // right derivative
         {
 #if DUMPOUTPUT
-            *m_softmaxOfRight.Print("CrossEntropyWithSoftmax Partial-softmaxOfRight");
             Input(0)->ValueFor(fr).Print("CrossEntropyWithSoftmax Partial-inputFunctionValues");
             Gradient().Print("CrossEntropyWithSoftmax Partial-gradientValues");
             Input(1)->GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Right-in");
 #endif
 
             auto gradient = Input(1)->GradientFor(fr);
-            Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, Input(0)->ValueFor(fr), gradient);
+            if (IsFused())
+                Matrix<ElemType>::CrossEntropyWithSoftmaxBackward(Gradient(), Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExp, gradient);
+            else
+            {
+                m_softmaxOfRight->AssignExpOf(*m_logSoftmaxOfRight);
+                Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, Input(0)->ValueFor(fr), gradient);
+            }
 #if DUMPOUTPUT
             Input(1)->GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Right");
 #endif
@@ -178,23 +192,30 @@ public:
 
     virtual void UpdateFunctionMBSize() override
     {
-        m_logSoftmaxOfRight->Resize(Input(1)->Value());
-        m_softmaxOfRight->Resize(*m_logSoftmaxOfRight);
+        m_logSumExp->Resize(1, Input(1)->Value().GetNumCols());
+        m_columnLoss->Resize(*m_logSumExp);
     }
 
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override // -sum(left_i * log(softmax_i(right)))
     {
         FrameRange fr(Input(0)->GetMBLayout());
-        // first compute the softmax (column-wise)
-        // Note that we need both log and non-log for gradient computation.
-        m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
-        m_softmaxOfRight->SetValue(*m_logSoftmaxOfRight);
-        m_softmaxOfRight->InplaceExp();
-        // flatten all gaps to zero, such that gaps will contribute zero to the sum
-        MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
-        // reduce over all frames
-        Value().AssignInnerProductOfMatrices(Input(0)->MaskedValueFor(fr), *m_logSoftmaxOfRight);
-        Value() *= -1;
+        if (IsFused())
+        {
+            // loss and log-sum-exp of each column in one pass; gaps contribute zero to the sum
+            Matrix<ElemType>::CrossEntropyWithSoftmaxForward(Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExp, *m_columnLoss);
+            MaskMissingColumnsToZero(*m_columnLoss, Input(1)->GetMBLayout(), fr);
+            Value().AssignSumOfElements(*m_columnLoss);
+        }
+        else
+        {
+            // other sparse labels: compute the log softmax (column-wise), which the gradient also uses
+            m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
+            // flatten all gaps to zero, such that gaps will contribute zero to the sum
+            MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
+            // reduce over all frames
+            Value().AssignInnerProductOfMatrices(Input(0)->MaskedValueFor(fr), *m_logSoftmaxOfRight);
+            Value() *= -1;
+        }
 #if NANCHECK
         Value().HasNan("CrossEntropyWithSoftmax");
 #endif
@@ -214,8 +235,9 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
+            *node->m_logSumExp = *m_logSumExp;
+            *node->m_columnLoss = *m_columnLoss;
             *node->m_logSoftmaxOfRight = *m_logSoftmaxOfRight;
-            *node->m_softmaxOfRight = *m_softmaxOfRight;
         }
     }
 
@@ -223,11 +245,35 @@ public:
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
     {
         Base::RequestMatricesBeforeForwardProp(matrixPool);
-        RequestMatrixFromPool(m_logSoftmaxOfRight, matrixPool);
-        RequestMatrixFromPool(m_softmaxOfRight, matrixPool);
+        RequestMatrixFromPool(m_logSumExp, matrixPool);
+        RequestMatrixFromPool(m_columnLoss, matrixPool);
+        RequestMatrixFromPool(m_logSoftmaxOfRight, matrixPool); // only filled for sparse labels or the gradient w.r.t. the labels
+    }
+
+    // request matrices that are needed for gradient computation
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool)
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_softmaxOfRight, matrixPool); // only filled for sparse labels
+    }
+
+    // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool)
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_softmaxOfRight, matrixPool);
     }
 
 protected:
+    // the fused kernels take dense labels, or sparse CSC labels (one-hot input from a reader), at whose non-zeros they gather the logits
+    bool IsFused() const
+    {
+        const auto& labels = Input(0)->Value();
+        return labels.GetMatrixType() == DENSE || labels.GetFormat() == matrixFormatSparseCSC;
+    }
+
+    shared_ptr<Matrix<ElemType>> m_logSumExp;  // [1 x T] log sum_i exp(right_i) of each column
+    shared_ptr<Matrix<ElemType>> m_columnLoss; // [1 x T]
     shared_ptr<Matrix<ElemType>> m_logSoftmaxOfRight;
     shared_ptr<Matrix<ElemType>> m_softmaxOfRight;
 };
@@ -235,6 +281,184 @@ protected:
 template class CrossEntropyWithSoftmaxNode<float>;
 template class CrossEntropyWithSoftmaxNode<double>;
 
+// -----------------------------------------------------------------------
+// DistillationCrossEntropyWithSoftmaxNode (softTargets, prediction)
+// calculates: -T^2 sum(left_i * log(softmax_i(right / T))) for a temperature T
+// The soft targets are the teacher's posteriors at the same temperature, typically the top-k sparse targets that
+// convertToBinaryChunks stores along with the data (see DoConvertToBinaryChunks()), so that the teacher does not run
+// during training. Each column of the targets must sum to 1. The factor T^2 keeps the magnitude of the gradient
+// independent of T, so that the loss can be mixed with a CrossEntropyWithSoftmax on the hard labels by fixed weights.
+// Sparse targets are expanded into a dense matrix, after which the fused kernels of CrossEntropyWithSoftmax are used.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class DistillationCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping /*ComputationNode*/<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"DistillationCrossEntropyWithSoftmax";
+    }
+
+public:
+    DistillationCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name, double temperature = 1.0)
+        : Base(deviceId, name),
+          m_temperature(temperature)
+    {
+        CheckTemperature();
+    }
+    DistillationCrossEntropyWithSoftmaxNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : DistillationCrossEntropyWithSoftmaxNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"temperature"))
+    {
+        AttachInputs(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<DistillationCrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
+            node->m_temperature = m_temperature;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_temperature;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_temperature;
+        CheckTemperature();
+    }
+
+    virtual void PrintSelfBeforeValidation() const override
+    {
+        Base::PrintSelfBeforeValidation();
+        fprintf(stderr, ", temperature=%g", m_temperature);
+    }
+
+    virtual void UpdateFunctionMBSize() override
+    {
+        m_logSumExp->Resize(1, Input(1)->Value().GetNumCols());
+        m_columnLoss->Resize(*m_logSumExp);
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        FrameRange fr(Input(0)->GetMBLayout());
+        Matrix<ElemType>::CrossEntropyWithSoftmaxForward(Targets(fr), ScaledPrediction(fr), *m_logSumExp, *m_columnLoss);
+        // gaps contribute zero to the sum
+        MaskMissingColumnsToZero(*m_columnLoss, Input(1)->GetMBLayout(), fr);
+        Value().AssignSumOfElements(*m_columnLoss);
+        Value() *= (ElemType) (m_temperature * m_temperature);
+#if NANCHECK
+        Value().HasNan("DistillationCrossEntropyWithSoftmax");
+#endif
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        if (inputIndex == 0)
+            InvalidArgument("%ls %ls operation cannot compute the gradient of its soft targets.", NodeName().c_str(), OperationName().c_str());
+
+        // d/dright = T^2 / T * (softmax(right / T) - left); the scaled prediction and dense targets are still those of the forward pass
+        FrameRange fr(Input(0)->GetMBLayout());
+        m_scaledGradient->AssignProductOf((ElemType) m_temperature, Gradient());
+        auto targets = IsDenseTargets() ? Input(0)->ValueFor(fr) : m_denseTargets->ColumnSlice(0, m_denseTargets->GetNumCols());
+        auto prediction = m_temperature == 1 ? Input(1)->ValueFor(fr) : m_scaledPrediction->ColumnSlice(0, m_scaledPrediction->GetNumCols());
+        auto gradient = Input(1)->GradientFor(fr);
+        Matrix<ElemType>::CrossEntropyWithSoftmaxBackward(*m_scaledGradient, targets, prediction, *m_logSumExp, gradient);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        return false;
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        ValidateBinaryReduce(isFinalValidationPass);
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_logSumExp, matrixPool);
+        RequestMatrixFromPool(m_columnLoss, matrixPool);
+        RequestMatrixFromPool(m_scaledPrediction, matrixPool); // only filled for T != 1
+        RequestMatrixFromPool(m_denseTargets, matrixPool);     // only filled for sparse targets
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_scaledGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_scaledPrediction, matrixPool);
+        ReleaseMatrixToPool(m_denseTargets, matrixPool);
+        ReleaseMatrixToPool(m_scaledGradient, matrixPool);
+    }
+
+    double GetTemperature() const
+    {
+        return m_temperature;
+    }
+
+private:
+    void CheckTemperature() const
+    {
+        if (m_temperature <= 0)
+            InvalidArgument("%ls %ls operation: The temperature must be positive.", NodeName().c_str(), OperationName().c_str());
+    }
+
+    bool IsDenseTargets() const
+    {
+        return Input(0)->Value().GetMatrixType() == DENSE;
+    }
+
+    // the targets as a dense matrix, which the fused kernels take
+    Matrix<ElemType> Targets(const FrameRange& fr)
+    {
+        auto targets = Input(0)->ValueFor(fr);
+        if (IsDenseTargets())
+            return targets;
+        m_denseTargets->Resize(targets.GetNumRows(), targets.GetNumCols());
+        m_denseTargets->SetValue(0);
+        Matrix<ElemType>::ScaleAndAdd(1, targets, *m_denseTargets);
+        return m_denseTargets->ColumnSlice(0, m_denseTargets->GetNumCols());
+    }
+
+    // right / T
+    Matrix<ElemType> ScaledPrediction(const FrameRange& fr)
+    {
+        auto prediction = Input(1)->ValueFor(fr);
+        if (m_temperature == 1)
+            return prediction;
+        m_scaledPrediction->AssignProductOf((ElemType) (1 / m_temperature), prediction);
+        return m_scaledPrediction->ColumnSlice(0, m_scaledPrediction->GetNumCols());
+    }
+
+    double m_temperature;
+    shared_ptr<Matrix<ElemType>> m_logSumExp;  // [1 x T] log sum_i exp(right_i / T) of each column
+    shared_ptr<Matrix<ElemType>> m_columnLoss; // [1 x T]
+    shared_ptr<Matrix<ElemType>> m_scaledPrediction;
+    shared_ptr<Matrix<ElemType>> m_denseTargets;
+    shared_ptr<Matrix<ElemType>> m_scaledGradient; // [1 x 1] T * Gradient()
+};
+
+template class DistillationCrossEntropyWithSoftmaxNode<float>;
+template class DistillationCrossEntropyWithSoftmaxNode<double>;
+
 // -----------------------------------------------------------------------
 /// CrossEntropyNode (labels, prediction)
 // -----------------------------------------------------------------------
@@ -519,6 +743,15 @@ template class MatrixL2RegNode<double>;
 //  - inputWeights: weight matrix in [hdsize x vocab_size], for speed-up, as per word matrix can be simply obtained as column slice
 //  - biasWeights: clsprob in dense matrix in [nbr_cls x T]. this is the output from logsoftmax node for the log-posterior probabilty of class given observations
 // */
+// With numNoiseSamples > 0, the node draws the noise itself, and the labels are one-hot in [vocab_size x T], typically sparse,
+// and the bias is [1 x vocab_size]:
+//  - Each minibatch draws numNoiseSamples words on the device from an alias table of the noise distribution, shared by all frames.
+//    noiseDistribution = "logUniform" (the default) assumes the word ids are sorted by decreasing frequency (Zipf's law),
+//    "uniform" draws uniformly, and anything else is a text file of the unigram count of each word, in the order of the ids.
+//  - The columns of the weights and the bias of the labels and samples are gathered, the samples are scored for all frames
+//    with one GEMM, and the loss and its gradient are computed in one pass (Matrix::NoiseContrastiveLoss()).
+//  - Only the columns of the labels and samples are touched, so the gradient of the weights is a sparse block-column matrix.
+//  - In evaluation, Softmax uses the full softmax and Unnormalized the score of the label.
 // BUGBUG: This node has not been converted to memshare conventions.
 // -----------------------------------------------------------------------
 
@@ -539,37 +772,85 @@ class NoiseContrastiveEstimationNode : public ComputationNodeNonLooping /*Comput
     }
 
 public:
-    DeclareConstructorFromConfigWithNumInputs(NoiseContrastiveEstimationNode);
-    NoiseContrastiveEstimationNode(DEVICEID_TYPE deviceId, const wstring& name)
+    NoiseContrastiveEstimationNode(DEVICEID_TYPE deviceId, const wstring& name, NCEEvalMode xm_evalMode = NCEEvalMode::None,
+                                   size_t numNoiseSamples = 0, const wstring& noiseDistribution = L"logUniform")
         : Base(deviceId, name),
           m_logSoftmax(deviceId),
           m_softMax(deviceId),
           m_grdToSoftMaxInput(deviceId),
           m_ncePrediction(deviceId),
-          m_evalMode(NCEEvalMode::None)
+          m_numNoiseSamples(numNoiseSamples),
+          m_noiseDistribution(noiseDistribution),
+          m_aliasTable(deviceId),
+          m_logExpectedCounts(deviceId),
+          m_uniforms(deviceId),
+          m_indexRow(deviceId),
+          m_labelIds(deviceId),
+          m_noiseIds(deviceId),
+          m_candidateIds(deviceId),
+          m_candidates(deviceId),
+          m_candidateWeights(deviceId),
+          m_candidateOffsets(deviceId),
+          m_candidateLogCounts(deviceId),
+          m_trueLogits(deviceId),
+          m_sampledLogits(deviceId),
+          m_sampledOffsets(deviceId),
+          m_logits(deviceId),
+          m_loss(deviceId),
+          m_logitGradient(deviceId),
+          m_gradTrue(deviceId),
+          m_gradSampled(deviceId),
+          m_candidateGradient(deviceId),
+          m_inputGradient(deviceId),
+          m_candidateBiasGradient(deviceId),
+          m_sampledBiasGradient(deviceId),
+          m_sampledBiasGradientRow(deviceId),
+          m_biasColumn(deviceId),
+          m_denseLabels(deviceId),
+          m_logSumExp(deviceId),
+          m_columnLoss(deviceId),
+          m_randomSeed(0),
+          m_randomSeeded(false),
+          m_needRecomputeCandidates(false),
+          m_evalMode(xm_evalMode)
     {
     }
-    NoiseContrastiveEstimationNode(DEVICEID_TYPE deviceId, const wstring& name, NCEEvalMode xm_evalMode)
-        : Base(deviceId, name),
-          m_logSoftmax(deviceId),
-          m_softMax(deviceId),
-          m_grdToSoftMaxInput(deviceId),
-          m_ncePrediction(deviceId),
-          m_evalMode(xm_evalMode)
+    NoiseContrastiveEstimationNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : NoiseContrastiveEstimationNode(configp->Get(L"deviceId"), L"<placeholder>", NCEEvalMode::None, configp->Get(L"numNoiseSamples"), (const wstring&) configp->Get(L"noiseDistribution"))
+    {
+        AttachInputs(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
     {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<NoiseContrastiveEstimationNode<ElemType>>(nodeP);
+            node->m_evalMode = m_evalMode;
+            node->m_numNoiseSamples = m_numNoiseSamples;
+            node->m_noiseDistribution = m_noiseDistribution;
+            node->m_noiseProbabilities = m_noiseProbabilities;
+        }
     }
-    // ^^ TODO: we can merge these two
 
+    // The noise probabilities are saved so that a model trained with a unigram file does not need it any more.
     virtual void Save(File& fstream) const override
     {
         Base::Save(fstream);
         fstream << m_evalMode;
+        fstream << m_numNoiseSamples << m_noiseDistribution << m_noiseProbabilities;
     }
 
     virtual void Load(File& fstream, size_t modelVersion) override
     {
         Base::Load(fstream, modelVersion);
         fstream >> m_evalMode;
+        if (modelVersion >= CNTK_MODEL_VERSION_3)
+        {
+            fstream >> m_numNoiseSamples >> m_noiseDistribution >> m_noiseProbabilities;
+            return;
+        }
         if (m_evalMode > NCEEvalMode::None)
         {
             m_evalMode = NCEEvalMode::None;
@@ -577,6 +858,13 @@ public:
         }
     }
 
+    virtual void PrintSelfBeforeValidation() const override
+    {
+        Base::PrintSelfBeforeValidation();
+        if (m_numNoiseSamples > 0)
+            fprintf(stderr, ", numNoiseSamples=%lu, noiseDistribution=%ls", m_numNoiseSamples, m_noiseDistribution.c_str());
+    }
+
     void SetEvalMode(NCEEvalMode& xevMode)
     {
         m_evalMode = xevMode;
@@ -591,6 +879,12 @@ public:
         */
     virtual void BackpropToNonLooping(size_t inputIndex) override
     {
+        if (m_numNoiseSamples > 0)
+        {
+            BackpropToSampled(inputIndex);
+            return;
+        }
+
         FrameRange fr(Input(0)->GetMBLayout());
         m_needRecomputeGradientToSoftmaxInput = false;
         // gradient computation@yinggongzhao
@@ -619,6 +913,12 @@ public:
 
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override // -sum(left_i * log(softmax_i(right)))
     {
+        if (m_numNoiseSamples > 0)
+        {
+            ForwardPropSampled();
+            return;
+        }
+
         FrameRange fr(Input(0)->GetMBLayout());
         if (Input(0)->HasMBLayout() && Input(0)->GetMBLayout()->HasGaps())
             LogicError("%ls %ls operation does not handle multiple parallel sequences with gaps correctly. Contact fseide@microsoft.com if you have a need and a test case.", NodeName().c_str(), OperationName().c_str());
@@ -659,6 +959,17 @@ public:
         m_needRecomputeGradientToSoftmaxInput = true;
     }
 
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // with sampling, only the columns of the labels and samples receive a gradient, as in SampledSoftmaxCrossEntropyNode
+        if (m_numNoiseSamples > 0 && Input(2)->NeedGradient())
+        {
+            Input(2)->CreateGradientMatrixIfNull();
+            Input(2)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -668,32 +979,675 @@ public:
         {
             if (Input(1)->GetSampleMatrixNumRows() != Input(2)->GetAsMatrixNumRows())
                 LogicError("The Matrix dimension for observation and weight in the NoiseContrastiveEstimationNode operation does not match.");
-            if (!Input(0)->HasMBLayout() || !Input(1)->HasMBLayout() || Input(2)->HasMBLayout() || !Input(3)->HasMBLayout())
+            if (m_numNoiseSamples > 0)
+            {
+                if (!Input(0)->HasMBLayout() || !Input(1)->HasMBLayout() || Input(2)->HasMBLayout() || Input(3)->HasMBLayout())
+                    LogicError("%ls %ls operation requires inputs 0 and 1 to be a minibatch, and inputs 2 and 3 to be a matrix.", NodeName().c_str(), OperationName().c_str());
+                if (Input(0)->GetMBLayout() != Input(1)->GetMBLayout())
+                    LogicError("%ls %ls operation requires the labels and the input to have the same MB layout.", NodeName().c_str(), OperationName().c_str());
+                const size_t vocabSize = Input(0)->GetSampleMatrixNumRows();
+                if (Input(2)->GetAsMatrixNumCols() != vocabSize || Input(3)->GetAsMatrixNumRows() != 1 || Input(3)->GetAsMatrixNumCols() != vocabSize)
+                    LogicError("%ls %ls operation: The weights must be [%d x %d] and the bias [1 x %d] for the label dimension %d.", NodeName().c_str(), OperationName().c_str(),
+                               (int) Input(2)->GetAsMatrixNumRows(), (int) vocabSize, (int) vocabSize, (int) vocabSize);
+            }
+            else if (!Input(0)->HasMBLayout() || !Input(1)->HasMBLayout() || Input(2)->HasMBLayout() || !Input(3)->HasMBLayout())
                 LogicError("%ls %ls operation requires inputs 0, 1, and 3 to be a minibatch, and input 2 to be a matrix.", NodeName().c_str(), OperationName().c_str());
         }
 
-        SetDims(TensorShape(1), false);
+        SetDims(TensorShape(1), false);
+    }
+
+    size_t GetNumNoiseSamples() const
+    {
+        return m_numNoiseSamples;
+    }
+
+private:
+    void ForwardPropSampled()
+    {
+        FrameRange fr(Input(0)->GetMBLayout());
+        const size_t vocabSize = Input(0)->GetSampleMatrixNumRows();
+        const size_t numFrames = Input(0)->Value().GetNumCols();
+        const size_t numSamples = m_numNoiseSamples;
+        const auto& input = Input(1)->ValueFor(fr);
+        PrepareNoiseDistribution(vocabSize);
+
+        // word id of each frame: [0 1 ... vocabSize-1] * labels; gaps come out as 0 and are masked below
+        if (m_indexRow.GetNumCols() != vocabSize)
+        {
+            std::vector<ElemType> indices(vocabSize);
+            for (size_t k = 0; k < vocabSize; k++)
+                indices[k] = (ElemType) k;
+            m_indexRow.SetValue(1, vocabSize, m_deviceId, indices.data());
+        }
+        Matrix<ElemType>::Multiply(m_indexRow, false, Input(0)->ValueFor(fr), false, m_labelIds);
+
+        if (m_evalMode == NCEEvalMode::Softmax)
+        {
+            // full softmax over the vocabulary, [vocabSize x T]
+            m_logSoftmax.AssignProductOf(Input(2)->ValueAsMatrix(), true, input, false);
+            m_biasColumn.AssignTransposeOf(Input(3)->Value());
+            Matrix<ElemType>::ScaleAndAdd(1, m_biasColumn, m_logSoftmax); // broadcasts the column vector
+            Matrix<ElemType> labelsSlice = Input(0)->ValueFor(fr);
+            const Matrix<ElemType>* labels = &labelsSlice;
+            if (labelsSlice.GetMatrixType() == MatrixType::SPARSE)
+            {
+                m_denseLabels.SetValue(labelsSlice);
+                m_denseLabels.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, true);
+                labels = &m_denseLabels;
+            }
+            m_logSumExp.Resize(1, numFrames);
+            m_columnLoss.Resize(1, numFrames);
+            Matrix<ElemType>::CrossEntropyWithSoftmaxForward(*labels, m_logSoftmax, m_logSumExp, m_columnLoss);
+            MaskMissingColumnsToZero(m_columnLoss, Input(1)->GetMBLayout(), fr);
+            Value().AssignSumOfElements(m_columnLoss);
+            return;
+        }
+        if (m_evalMode == NCEEvalMode::Unnormalized)
+        {
+            // score of the label, which NCE trains to be its log probability
+            m_candidateWeights.AssignGatheredColumnsOf(Input(2)->ValueAsMatrix(), m_labelIds);
+            m_candidateOffsets.AssignGatheredColumnsOf(Input(3)->Value(), m_labelIds);
+            m_trueLogits.AssignInnerProductOf(m_candidateWeights, input, true);
+            m_trueLogits += m_candidateOffsets;
+            MaskMissingColumnsToZero(m_trueLogits, Input(1)->GetMBLayout(), fr);
+            Value().AssignSumOfElements(m_trueLogits);
+            Value() *= -1;
+            return;
+        }
+
+        // draw the shared noise samples on the device
+        if (!m_randomSeeded)
+        {
+            m_randomSeed = (unsigned long) std::hash<std::wstring>()(NodeName());
+            m_randomSeeded = true;
+        }
+        m_uniforms.Resize(2, numSamples);
+        m_uniforms.SetUniformRandomValue(0, 1, m_randomSeed++);
+        m_noiseIds.AssignAliasSamplesOf(m_aliasTable, m_uniforms);
+
+        // the ids of the labels followed by those of the samples, [1 x (T + numSamples)], and their columns of the weights and the bias, minus log(k * q)
+        m_candidateIds.Resize(1, numFrames + numSamples);
+        m_candidateIds.SetColumnSlice(m_labelIds, 0, numFrames);
+        m_candidateIds.SetColumnSlice(m_noiseIds, numFrames, numSamples);
+        m_candidateWeights.AssignGatheredColumnsOf(Input(2)->ValueAsMatrix(), m_candidateIds);
+        m_candidateOffsets.AssignGatheredColumnsOf(Input(3)->Value(), m_candidateIds);
+        m_candidateLogCounts.AssignGatheredColumnsOf(m_logExpectedCounts, m_candidateIds);
+        m_candidateOffsets -= m_candidateLogCounts;
+
+        // logit of the label of each frame, [1 x T]
+        m_trueLogits.AssignInnerProductOf(m_candidateWeights.ColumnSlice(0, numFrames), input, true);
+        m_trueLogits += m_candidateOffsets.ColumnSlice(0, numFrames);
+
+        // logits of the samples for all frames in one GEMM, [numSamples x T]
+        m_sampledLogits.AssignProductOf(m_candidateWeights.ColumnSlice(numFrames, numSamples), true, input, false);
+        m_sampledOffsets.AssignTransposeOf(m_candidateOffsets.ColumnSlice(numFrames, numSamples));
+        Matrix<ElemType>::ScaleAndAdd(1, m_sampledOffsets, m_sampledLogits); // broadcasts the column vector
+
+        m_logits.Resize(1 + numSamples, numFrames);
+        m_logits.AssignToRowSliceValuesOf(m_trueLogits, 0, 1);
+        m_logits.AssignToRowSliceValuesOf(m_sampledLogits, 1, numSamples);
+        Matrix<ElemType>::NoiseContrastiveLoss(m_logits, m_loss, m_logitGradient);
+        MaskMissingColumnsToZero(m_loss, Input(1)->GetMBLayout(), fr);
+        Value().AssignSumOfElements(m_loss);
+#if NANCHECK
+        Value().HasNan("NoiseContrastiveEstimation");
+#endif
+        m_needRecomputeGradientToSoftmaxInput = true;
+        m_needRecomputeCandidates = true;
+    }
+
+    void BackpropToSampled(size_t inputIndex)
+    {
+        if (m_evalMode != NCEEvalMode::None)
+            LogicError("BackpropTo should only be called in training mode");
+        if (inputIndex == 0)
+            InvalidArgument("%ls %ls operation cannot compute the gradient of its labels.", NodeName().c_str(), OperationName().c_str());
+
+        FrameRange fr(Input(0)->GetMBLayout());
+        const size_t numFrames = m_logits.GetNumCols();
+        const size_t numSamples = m_numNoiseSamples;
+        if (m_needRecomputeGradientToSoftmaxInput)
+        {
+            const ElemType gradient = Gradient().Get00Element();
+            m_gradTrue.AssignRowSliceValuesOf(m_logitGradient, 0, 1);
+            m_gradTrue *= gradient;
+            m_gradSampled.AssignRowSliceValuesOf(m_logitGradient, 1, numSamples);
+            m_gradSampled *= gradient;
+            MaskMissingColumnsToZero(m_gradTrue, Input(1)->GetMBLayout(), fr);
+            MaskMissingColumnsToZero(m_gradSampled, Input(1)->GetMBLayout(), fr);
+            m_needRecomputeGradientToSoftmaxInput = false;
+        }
+
+        const auto& input = Input(1)->ValueFor(fr);
+        if (inputIndex == 1)
+        {
+            auto inputGradient = Input(1)->GradientFor(fr);
+            m_inputGradient.SetValue(m_candidateWeights.ColumnSlice(0, numFrames));
+            m_inputGradient.RowElementMultiplyWith(m_gradTrue);
+            inputGradient += m_inputGradient;
+            Matrix<ElemType>::MultiplyAndAdd(m_candidateWeights.ColumnSlice(numFrames, numSamples), false, m_gradSampled, false, inputGradient);
+            return;
+        }
+
+        UpdateCandidates();
+        if (inputIndex == 2)
+        {
+            // gradient of the candidate columns of the weights, [hdsize x (T + numSamples)], scattered into the sparse gradient by the candidate matrix
+            m_candidateGradient.Resize(input.GetNumRows(), numFrames + numSamples);
+            auto trueGradient = m_candidateGradient.ColumnSlice(0, numFrames);
+            trueGradient.SetValue(input);
+            trueGradient.RowElementMultiplyWith(m_gradTrue);
+            auto sampledGradient = m_candidateGradient.ColumnSlice(numFrames, numSamples);
+            Matrix<ElemType>::Multiply(input, false, m_gradSampled, true, sampledGradient);
+            Matrix<ElemType>::MultiplyAndAdd(m_candidateGradient, false, m_candidates, true, Input(2)->GradientAsMatrix());
+        }
+        else
+        {
+            // the same for the bias, [1 x (T + numSamples)]
+            assert(inputIndex == 3);
+            Matrix<ElemType>::VectorSum(m_gradSampled, m_sampledBiasGradient, false);
+            m_sampledBiasGradientRow.AssignTransposeOf(m_sampledBiasGradient);
+            m_candidateBiasGradient.Resize(1, numFrames + numSamples);
+            m_candidateBiasGradient.SetColumnSlice(m_gradTrue, 0, numFrames);
+            m_candidateBiasGradient.SetColumnSlice(m_sampledBiasGradientRow, numFrames, numSamples);
+            Matrix<ElemType>::MultiplyAndAdd(m_candidateBiasGradient, false, m_candidates, true, Input(3)->Gradient());
+        }
+    }
+
+    // sparse one-hot columns of the candidates, [vocabSize x (T + numSamples)], for scattering the gradients;
+    // this is the only place where the ids go to the host, once per minibatch, and only in training
+    void UpdateCandidates()
+    {
+        if (!m_needRecomputeCandidates)
+            return;
+        const size_t vocabSize = Input(0)->GetSampleMatrixNumRows();
+        const size_t numCandidates = m_candidateIds.GetNumCols();
+        std::vector<ElemType> ids(numCandidates);
+        m_candidateIds.CopySection(1, numCandidates, ids.data(), 1);
+        std::vector<CPUSPARSE_INDEX_TYPE> colStarts(numCandidates + 1);
+        std::vector<CPUSPARSE_INDEX_TYPE> rows(numCandidates);
+        std::vector<ElemType> ones(numCandidates, 1);
+        for (size_t j = 0; j < numCandidates; j++)
+        {
+            colStarts[j] = (CPUSPARSE_INDEX_TYPE) j;
+            rows[j] = (CPUSPARSE_INDEX_TYPE) std::min((size_t) ids[j], vocabSize - 1);
+        }
+        colStarts[numCandidates] = (CPUSPARSE_INDEX_TYPE) numCandidates;
+        m_candidates.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, false);
+        m_candidates.SetMatrixFromCSCFormat(colStarts.data(), rows.data(), ones.data(), numCandidates, vocabSize, numCandidates);
+        m_needRecomputeCandidates = false;
+    }
+
+    // sets up the alias table and log(k * q) of the noise distribution q; the probabilities are read or computed once
+    void PrepareNoiseDistribution(size_t vocabSize)
+    {
+        if (m_aliasTable.GetNumCols() == vocabSize)
+            return;
+
+        if (m_noiseProbabilities.size() != vocabSize)
+        {
+            m_noiseProbabilities.assign(vocabSize, 0);
+            if (m_noiseDistribution == L"uniform")
+                m_noiseProbabilities.assign(vocabSize, 1.0 / vocabSize);
+            else if (m_noiseDistribution == L"logUniform")
+            {
+                for (size_t k = 0; k < vocabSize; k++)
+                    m_noiseProbabilities[k] = log((k + 2.0) / (k + 1.0)) / log(vocabSize + 1.0);
+            }
+            else
+            {
+                size_t numRows, numCols;
+                auto counts = File::LoadMatrixFromTextFile<ElemType>(m_noiseDistribution, numRows, numCols);
+                if (counts.size() != vocabSize)
+                    InvalidArgument("%ls %ls operation: The noise distribution '%ls' has %d entries, but the label dimension is %d.", NodeName().c_str(), OperationName().c_str(),
+                                    m_noiseDistribution.c_str(), (int) counts.size(), (int) vocabSize);
+                // words that never occur are raised to the smallest count, so that their log(k * q) stays finite
+                double minCount = 0, sum = 0;
+                for (auto count : counts)
+                {
+                    if (count < 0)
+                        InvalidArgument("%ls %ls operation: The noise distribution '%ls' has a negative count.", NodeName().c_str(), OperationName().c_str(), m_noiseDistribution.c_str());
+                    if (count > 0 && (minCount == 0 || count < minCount))
+                        minCount = count;
+                }
+                if (minCount == 0)
+                    InvalidArgument("%ls %ls operation: The noise distribution '%ls' is all zero.", NodeName().c_str(), OperationName().c_str(), m_noiseDistribution.c_str());
+                for (size_t k = 0; k < vocabSize; k++)
+                {
+                    m_noiseProbabilities[k] = std::max((double) counts[k], minCount);
+                    sum += m_noiseProbabilities[k];
+                }
+                for (auto& p : m_noiseProbabilities)
+                    p /= sum;
+            }
+        }
+
+        // alias method (Vose): each bucket keeps its own index with probability table(0, k), and draws table(1, k) otherwise
+        std::vector<ElemType> table(2 * vocabSize);
+        std::vector<ElemType> logExpectedCounts(vocabSize);
+        std::vector<double> scaled(vocabSize);
+        std::vector<size_t> small, large;
+        for (size_t k = 0; k < vocabSize; k++)
+        {
+            scaled[k] = m_noiseProbabilities[k] * vocabSize;
+            (scaled[k] < 1 ? small : large).push_back(k);
+            logExpectedCounts[k] = (ElemType) log(m_numNoiseSamples * m_noiseProbabilities[k]);
+        }
+        while (!small.empty() && !large.empty())
+        {
+            size_t s = small.back();
+            small.pop_back();
+            size_t l = large.back();
+            table[2 * s] = (ElemType) scaled[s];
+            table[2 * s + 1] = (ElemType) l;
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        for (auto bins : { &small, &large }) // what is left is full up to rounding
+        {
+            for (size_t k : *bins)
+            {
+                table[2 * k] = 1;
+                table[2 * k + 1] = (ElemType) k;
+            }
+        }
+        m_aliasTable.SetValue(2, vocabSize, m_deviceId, table.data());
+        m_logExpectedCounts.SetValue(1, vocabSize, m_deviceId, logExpectedCounts.data());
+    }
+
+protected:
+    Matrix<ElemType> m_logSoftmax;
+    Matrix<ElemType> m_softMax;
+    Matrix<ElemType> m_ncePrediction;
+
+    // gradient of cross entropy with respect to the input of softmax
+    // a 1 row by \sum_t m_nbrWordsInEachTime[t] vector
+    // one slice of size m_nbrWordsInEachTime[t] saves the input to softmax for word y_t
+    Matrix<ElemType> m_grdToSoftMaxInput;
+    bool m_needRecomputeGradientToSoftmaxInput;
+
+    size_t m_nbrNoise;
+    size_t m_totalNbrWords;
+
+private:
+    size_t m_numNoiseSamples; // 0: the reader supplies the samples in the labels
+    wstring m_noiseDistribution;
+    std::vector<double> m_noiseProbabilities; // [vocab_size] q
+
+    Matrix<ElemType> m_aliasTable;             // [2 x vocab_size] see PrepareNoiseDistribution()
+    Matrix<ElemType> m_logExpectedCounts;      // [1 x vocab_size] log(k * q)
+    Matrix<ElemType> m_uniforms;               // [2 x k]
+    Matrix<ElemType> m_indexRow;               // [1 x vocab_size] holding 0 ... vocab_size-1
+    Matrix<ElemType> m_labelIds;               // [1 x T]
+    Matrix<ElemType> m_noiseIds;               // [1 x k]
+    Matrix<ElemType> m_candidateIds;           // [1 x (T + k)] the labels followed by the samples
+    Matrix<ElemType> m_candidates;             // [vocab_size x (T + k)] sparse one-hot columns of the candidates
+    Matrix<ElemType> m_candidateWeights;       // [hdsize x (T + k)] the corresponding columns of the weights
+    Matrix<ElemType> m_candidateOffsets;       // [1 x (T + k)] bias - log(k * q)
+    Matrix<ElemType> m_candidateLogCounts;     // [1 x (T + k)] log(k * q)
+    Matrix<ElemType> m_trueLogits;             // [1 x T]
+    Matrix<ElemType> m_sampledLogits;          // [k x T]
+    Matrix<ElemType> m_sampledOffsets;         // [k x 1]
+    Matrix<ElemType> m_logits;                 // [(1 + k) x T]
+    Matrix<ElemType> m_loss;                   // [1 x T]
+    Matrix<ElemType> m_logitGradient;          // [(1 + k) x T]
+    Matrix<ElemType> m_gradTrue;               // [1 x T] gradient w.r.t. the label logits
+    Matrix<ElemType> m_gradSampled;            // [k x T] gradient w.r.t. the sampled logits
+    Matrix<ElemType> m_candidateGradient;      // [hdsize x (T + k)]
+    Matrix<ElemType> m_inputGradient;          // [hdsize x T]
+    Matrix<ElemType> m_candidateBiasGradient;  // [1 x (T + k)]
+    Matrix<ElemType> m_sampledBiasGradient;    // [k x 1]
+    Matrix<ElemType> m_sampledBiasGradientRow; // [1 x k]
+    Matrix<ElemType> m_biasColumn;             // [vocab_size x 1] for the evaluation with softmax
+    Matrix<ElemType> m_denseLabels;            // [vocab_size x T]
+    Matrix<ElemType> m_logSumExp;              // [1 x T]
+    Matrix<ElemType> m_columnLoss;             // [1 x T]
+
+    unsigned long m_randomSeed;
+    bool m_randomSeeded;
+    bool m_needRecomputeCandidates;
+
+    NCEEvalMode m_evalMode;
+};
+template class NoiseContrastiveEstimationNode<float>;
+template class NoiseContrastiveEstimationNode<double>;
+
+// -----------------------------------------------------------------------
+// SampledSoftmaxCrossEntropyNode (labels, input, weights)
+// Training criterion that approximates CrossEntropyWithSoftmax(labels, weights' * input) for very large vocabularies.
+//  - labels: one-hot labels in [vocab_size x T], typically sparse
+//  - input: hidden layer activity in [hdsize x T]
+//  - weights: output embedding in [hdsize x vocab_size]; an output bias can be folded in as an extra row with a constant input
+// Each minibatch draws numSamples negative classes from a proposal distribution and shares them across all frames.
+// The softmax of each frame is taken over its label and the samples, with logits corrected by the log expected sample count
+// (sampled softmax, Jean et al. 2015), and samples that hit the label of a frame are removed from that frame's softmax.
+// proposal = "logUniform" (the default) assumes the class ids are sorted by decreasing frequency (Zipf's law); "uniform" samples uniformly.
+// Only the columns of the labels and samples are touched, so the gradient of the weights is a sparse block-column matrix.
+// Since the value is the sampled loss, evaluation and perplexity should use a full softmax, e.g. CrossEntropyWithSoftmax(labels, Times(weights, input, transpose)).
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class SampledSoftmaxCrossEntropyNode : public ComputationNodeNonLooping /*ComputationNode*/<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName()
+    {
+        return L"SampledSoftmaxCrossEntropy";
+    }
+
+public:
+    SampledSoftmaxCrossEntropyNode(DEVICEID_TYPE deviceId, const wstring& name, size_t numSamples = 1024, const wstring& proposal = L"logUniform")
+        : Base(deviceId, name),
+          m_numSamples(numSamples),
+          m_proposal(proposal),
+          m_indexRow(deviceId),
+          m_labelIndices(deviceId),
+          m_candidates(deviceId),
+          m_candidateWeights(deviceId),
+          m_trueLogits(deviceId),
+          m_sampledLogits(deviceId),
+          m_logQ(deviceId),
+          m_sampledLogQ(deviceId),
+          m_accidentalHits(deviceId),
+          m_logProbs(deviceId),
+          m_trueLogProbs(deviceId),
+          m_gradTrue(deviceId),
+          m_gradSampled(deviceId),
+          m_candidateGradient(deviceId),
+          m_inputGradient(deviceId),
+          m_randomSeeded(false),
+          m_needRecomputeGradient(false)
+    {
+        CheckProposal();
+    }
+    SampledSoftmaxCrossEntropyNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : SampledSoftmaxCrossEntropyNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"numSamples"), (const wstring&) configp->Get(L"proposal"))
+    {
+        AttachInputs(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<SampledSoftmaxCrossEntropyNode<ElemType>>(nodeP);
+            node->m_numSamples = m_numSamples;
+            node->m_proposal = m_proposal;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_numSamples << m_proposal;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_numSamples >> m_proposal;
+        CheckProposal();
+    }
+
+    virtual void PrintSelfBeforeValidation() const override
+    {
+        Base::PrintSelfBeforeValidation();
+        fprintf(stderr, ", numSamples=%lu, proposal=%ls", m_numSamples, m_proposal.c_str());
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        FrameRange fr(Input(0)->GetMBLayout());
+        const size_t vocabSize = Input(0)->GetSampleMatrixNumRows();
+        const size_t numFrames = Input(0)->Value().GetNumCols();
+        const size_t numSamples = m_numSamples;
+
+        // class id of each frame: [0 1 ... vocabSize-1] * labels; gaps come out as 0 and are masked below
+        if (m_indexRow.GetNumCols() != vocabSize)
+        {
+            std::vector<ElemType> indices(vocabSize);
+            for (size_t k = 0; k < vocabSize; k++)
+                indices[k] = (ElemType) k;
+            m_indexRow.SetValue(1, vocabSize, m_deviceId, indices.data());
+        }
+        Matrix<ElemType>::Multiply(m_indexRow, false, Input(0)->ValueFor(fr), false, m_labelIndices);
+        std::vector<ElemType> labelIds(numFrames);
+        m_labelIndices.CopySection(1, numFrames, labelIds.data(), 1);
+
+        // draw the shared negatives on the host; this is O(numSamples) and only the small index matrices below are uploaded
+        if (!m_randomSeeded)
+        {
+            m_randomGenerator.seed((unsigned long) std::hash<std::wstring>()(NodeName()));
+            m_randomSeeded = true;
+        }
+        std::vector<CPUSPARSE_INDEX_TYPE> colStarts(numFrames + numSamples + 1);
+        std::vector<CPUSPARSE_INDEX_TYPE> rows(numFrames + numSamples);
+        std::vector<ElemType> ones(numFrames + numSamples, 1);
+        std::vector<ElemType> logQ(numFrames + numSamples);
+        std::map<size_t, std::vector<CPUSPARSE_INDEX_TYPE>> samplePositions;
+        for (size_t j = 0; j < numFrames + numSamples; j++)
+        {
+            size_t classId;
+            if (j < numFrames)
+                classId = std::min((size_t) labelIds[j], vocabSize - 1);
+            else
+            {
+                classId = DrawSample(vocabSize);
+                samplePositions[classId].push_back((CPUSPARSE_INDEX_TYPE) (j - numFrames));
+            }
+            colStarts[j] = (CPUSPARSE_INDEX_TYPE) j;
+            rows[j] = (CPUSPARSE_INDEX_TYPE) classId;
+            logQ[j] = (ElemType) log(numSamples * ProposalProbability(classId, vocabSize)); // log of the expected number of draws
+        }
+        colStarts[numFrames + numSamples] = (CPUSPARSE_INDEX_TYPE) (numFrames + numSamples);
+
+        // one-hot columns of the labels followed by those of the samples, [vocabSize x (T + numSamples)]
+        m_candidates.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, false);
+        m_candidates.SetMatrixFromCSCFormat(colStarts.data(), rows.data(), ones.data(), numFrames + numSamples, vocabSize, numFrames + numSamples);
+
+        // gather the weights of the candidates, [hdsize x (T + numSamples)]
+        const auto& input = Input(1)->ValueFor(fr);
+        Matrix<ElemType>::Multiply(Input(2)->ValueAsMatrix(), false, m_candidates, false, m_candidateWeights);
+        m_logQ.SetValue(1, numFrames + numSamples, m_deviceId, logQ.data());
+
+        // logit of the label of each frame, [1 x T]
+        m_trueLogits.AssignInnerProductOf(m_candidateWeights.ColumnSlice(0, numFrames), input, true);
+        Matrix<ElemType>::ScaleAndAdd(-1, m_logQ.ColumnSlice(0, numFrames), m_trueLogits);
+
+        // logits of the samples, [numSamples x T]
+        m_sampledLogits.AssignProductOf(m_candidateWeights.ColumnSlice(numFrames, numSamples), true, input, false);
+        m_sampledLogQ.AssignTransposeOf(m_logQ.ColumnSlice(numFrames, numSamples));
+        Matrix<ElemType>::ScaleAndAdd(-1, m_sampledLogQ, m_sampledLogits); // broadcasts the column vector
+
+        // remove samples that are the label of the frame
+        std::vector<CPUSPARSE_INDEX_TYPE> hitColStarts(numFrames + 1);
+        std::vector<CPUSPARSE_INDEX_TYPE> hitRows;
+        for (size_t t = 0; t < numFrames; t++)
+        {
+            hitColStarts[t] = (CPUSPARSE_INDEX_TYPE) hitRows.size();
+            auto iter = samplePositions.find(rows[t]);
+            if (iter != samplePositions.end())
+                hitRows.insert(hitRows.end(), iter->second.begin(), iter->second.end());
+        }
+        hitColStarts[numFrames] = (CPUSPARSE_INDEX_TYPE) hitRows.size();
+        if (!hitRows.empty())
+        {
+            const ElemType accidentalHitPenalty = (ElemType) 1e10; // lowers the logit far enough to remove the sample from the softmax
+            std::vector<ElemType> hitValues(hitRows.size(), 1);
+            m_accidentalHits.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, false);
+            m_accidentalHits.SetMatrixFromCSCFormat(hitColStarts.data(), hitRows.data(), hitValues.data(), hitRows.size(), numSamples, numFrames);
+            Matrix<ElemType>::ScaleAndAdd(-accidentalHitPenalty, m_accidentalHits, m_sampledLogits);
+        }
+
+        // log softmax over [label; samples] for each frame, [(1 + numSamples) x T]
+        m_logProbs.Resize(1 + numSamples, numFrames);
+        m_logProbs.AssignToRowSliceValuesOf(m_trueLogits, 0, 1);
+        m_logProbs.AssignToRowSliceValuesOf(m_sampledLogits, 1, numSamples);
+        m_logProbs.InplaceLogSoftmax(true);
+
+        m_trueLogProbs.AssignRowSliceValuesOf(m_logProbs, 0, 1);
+        MaskMissingColumnsToZero(m_trueLogProbs, Input(1)->GetMBLayout(), fr);
+        Value().AssignSumOfElements(m_trueLogProbs);
+        Value() *= -1;
+#if NANCHECK
+        Value().HasNan("SampledSoftmaxCrossEntropy");
+#endif
+        m_needRecomputeGradient = true;
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        if (inputIndex == 0)
+            InvalidArgument("%ls %ls operation cannot compute the gradient of its labels.", NodeName().c_str(), OperationName().c_str());
+
+        FrameRange fr(Input(0)->GetMBLayout());
+        const size_t numFrames = m_logProbs.GetNumCols();
+        const size_t numSamples = m_numSamples;
+        if (m_needRecomputeGradient)
+        {
+            // gradient w.r.t. the corrected logits: gradient * (softmax - [1; 0 ... 0]), the same for both inputs
+            const ElemType gradient = Gradient().Get00Element();
+            m_logProbs.InplaceExp();
+            m_gradTrue.AssignRowSliceValuesOf(m_logProbs, 0, 1);
+            m_gradTrue -= 1;
+            m_gradTrue *= gradient;
+            m_gradSampled.AssignRowSliceValuesOf(m_logProbs, 1, numSamples);
+            m_gradSampled *= gradient;
+            MaskMissingColumnsToZero(m_gradTrue, Input(1)->GetMBLayout(), fr);
+            MaskMissingColumnsToZero(m_gradSampled, Input(1)->GetMBLayout(), fr);
+            m_needRecomputeGradient = false;
+        }
+
+        const auto& input = Input(1)->ValueFor(fr);
+        if (inputIndex == 1)
+        {
+            auto inputGradient = Input(1)->GradientFor(fr);
+            m_inputGradient.SetValue(m_candidateWeights.ColumnSlice(0, numFrames));
+            m_inputGradient.RowElementMultiplyWith(m_gradTrue);
+            inputGradient += m_inputGradient;
+            Matrix<ElemType>::MultiplyAndAdd(m_candidateWeights.ColumnSlice(numFrames, numSamples), false, m_gradSampled, false, inputGradient);
+        }
+        else
+        {
+            // gradient of the candidate columns of the weights, [hdsize x (T + numSamples)], scattered into the sparse gradient by the candidate matrix
+            m_candidateGradient.Resize(input.GetNumRows(), numFrames + numSamples);
+            auto trueGradient = m_candidateGradient.ColumnSlice(0, numFrames);
+            trueGradient.SetValue(input);
+            trueGradient.RowElementMultiplyWith(m_gradTrue);
+            auto sampledGradient = m_candidateGradient.ColumnSlice(numFrames, numSamples);
+            Matrix<ElemType>::Multiply(input, false, m_gradSampled, true, sampledGradient);
+            Matrix<ElemType>::MultiplyAndAdd(m_candidateGradient, false, m_candidates, true, Input(2)->GradientAsMatrix());
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        return false;
+    }
+
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override
+    {
+        return childIndex == 1;
+    }
+
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // only the columns of the candidates of a minibatch receive a gradient, so the weight gradient is allocated sparse, as in TimesNode
+        if (Input(2)->NeedGradient())
+        {
+            Input(2)->CreateGradientMatrixIfNull();
+            Input(2)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        m_pMBLayout = nullptr; // this node does not hold mini-batch data
+
+        if (isFinalValidationPass)
+        {
+            if (!Input(0)->HasMBLayout() || !Input(1)->HasMBLayout() || Input(2)->HasMBLayout())
+                LogicError("%ls %ls operation requires inputs 0 and 1 to be a minibatch, and input 2 to be a matrix.", NodeName().c_str(), OperationName().c_str());
+            if (Input(0)->GetMBLayout() != Input(1)->GetMBLayout())
+                LogicError("%ls %ls operation requires the labels and the input to have the same MB layout.", NodeName().c_str(), OperationName().c_str());
+            if (Input(1)->GetSampleMatrixNumRows() != Input(2)->GetAsMatrixNumRows())
+                LogicError("%ls %ls operation: The input dimension %d does not match the number of rows %d of the weights.",
+                           NodeName().c_str(), OperationName().c_str(), (int) Input(1)->GetSampleMatrixNumRows(), (int) Input(2)->GetAsMatrixNumRows());
+            if (Input(0)->GetSampleMatrixNumRows() != Input(2)->GetAsMatrixNumCols())
+                LogicError("%ls %ls operation: The label dimension %d does not match the number of columns %d of the weights.",
+                           NodeName().c_str(), OperationName().c_str(), (int) Input(0)->GetSampleMatrixNumRows(), (int) Input(2)->GetAsMatrixNumCols());
+            if (m_numSamples == 0 || m_numSamples >= Input(0)->GetSampleMatrixNumRows())
+                InvalidArgument("%ls %ls operation: numSamples must be between 1 and the label dimension.", NodeName().c_str(), OperationName().c_str());
+        }
+
+        SetDims(TensorShape(1), false);
+    }
+
+    size_t GetNumSamples() const
+    {
+        return m_numSamples;
+    }
+
+private:
+    void CheckProposal() const
+    {
+        if (m_proposal != L"logUniform" && m_proposal != L"uniform")
+            InvalidArgument("SampledSoftmaxCrossEntropy: Unknown proposal '%ls'; must be 'logUniform' or 'uniform'.", m_proposal.c_str());
+    }
+
+    // probability of drawing 'classId' in one draw
+    double ProposalProbability(size_t classId, size_t vocabSize) const
+    {
+        if (m_proposal == L"uniform")
+            return 1.0 / vocabSize;
+        return log((classId + 2.0) / (classId + 1.0)) / log(vocabSize + 1.0);
     }
 
-protected:
-    Matrix<ElemType> m_logSoftmax;
-    Matrix<ElemType> m_softMax;
-    Matrix<ElemType> m_ncePrediction;
+    size_t DrawSample(size_t vocabSize)
+    {
+        if (m_proposal == L"uniform")
+            return std::uniform_int_distribution<size_t>(0, vocabSize - 1)(m_randomGenerator);
+        // inverse of the cumulative distribution log(k + 1) / log(vocabSize + 1) of the log-uniform distribution
+        double u = std::uniform_real_distribution<double>(0, 1)(m_randomGenerator);
+        size_t classId = (size_t) exp(u * log(vocabSize + 1.0)) - 1;
+        return std::min(classId, vocabSize - 1);
+    }
 
-    // gradient of cross entropy with respect to the input of softmax
-    // a 1 row by \sum_t m_nbrWordsInEachTime[t] vector
-    // one slice of size m_nbrWordsInEachTime[t] saves the input to softmax for word y_t
-    Matrix<ElemType> m_grdToSoftMaxInput;
-    bool m_needRecomputeGradientToSoftmaxInput;
+    size_t m_numSamples;
+    wstring m_proposal;
 
-    size_t m_nbrNoise;
-    size_t m_totalNbrWords;
+    Matrix<ElemType> m_indexRow;          // [1 x vocab_size] holding 0 ... vocab_size-1
+    Matrix<ElemType> m_labelIndices;      // [1 x T] class id of each frame
+    Matrix<ElemType> m_candidates;        // [vocab_size x (T + numSamples)] sparse one-hot columns of the labels and the samples
+    Matrix<ElemType> m_candidateWeights;  // [hdsize x (T + numSamples)] the corresponding columns of the weights
+    Matrix<ElemType> m_trueLogits;        // [1 x T]
+    Matrix<ElemType> m_sampledLogits;     // [numSamples x T]
+    Matrix<ElemType> m_logQ;              // [1 x (T + numSamples)] log expected number of draws of each candidate
+    Matrix<ElemType> m_sampledLogQ;       // [numSamples x 1]
+    Matrix<ElemType> m_accidentalHits;    // [numSamples x T] sparse, 1 where a sample is the label of the frame
+    Matrix<ElemType> m_logProbs;          // [(1 + numSamples) x T] log softmax over label and samples; softmax after the first backprop call
+    Matrix<ElemType> m_trueLogProbs;      // [1 x T]
+    Matrix<ElemType> m_gradTrue;          // [1 x T] gradient w.r.t. the label logits
+    Matrix<ElemType> m_gradSampled;       // [numSamples x T] gradient w.r.t. the sampled logits
+    Matrix<ElemType> m_candidateGradient; // [hdsize x (T + numSamples)]
+    Matrix<ElemType> m_inputGradient;     // [hdsize x T]
 
-private:
-    NCEEvalMode m_evalMode;
+    std::mt19937 m_randomGenerator;
+    bool m_randomSeeded;
+    bool m_needRecomputeGradient;
 };
-template class NoiseContrastiveEstimationNode<float>;
-template class NoiseContrastiveEstimationNode<double>;
+
+template class SampledSoftmaxCrossEntropyNode<float>;
+template class SampledSoftmaxCrossEntropyNode<double>;
 
 // -----------------------------------------------------------------------
 // ClassBasedCrossEntropyWithSoftmaxNode (labeldata(.,t), inputdata(.,t), embeddingMatrix, clsProbBeforeSoftmaxData(.,t))
@@ -709,6 +1663,10 @@ template class NoiseContrastiveEstimationNode<double>;
 
 // calculates: -sum(left_i * log(softmax_i(right))) for class given history and for word given history
 // need to provide class probabilty from external node
+// The samples of the minibatch are grouped by class (on the CPU, where the labels are), so that the word logits of all
+// samples of a class are one matrix product with that class's columns of the weight matrix. The class-conditional
+// distributions are packed into one row vector, and their log softmax and gradient, as well as those of the class
+// posteriors, are each computed by a single segmented kernel. The grouping is uploaded once per minibatch.
 template <class ElemType>
 class ClassBasedCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping /*ComputationNode*/<ElemType>, public NumInputs<4>
 {
@@ -730,10 +1688,14 @@ public:
     ClassBasedCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
           m_logSoftmax(deviceId),
-          m_softMax(deviceId),
           m_grdToSoftMaxInput(deviceId),
           m_clsLogSoftmax(deviceId),
-          m_clsSoftmax(deviceId)
+          m_columnIndices(deviceId),
+          m_wordSegments(deviceId),
+          m_classSegments(deviceId),
+          m_sampleLoss(deviceId),
+          m_sortedInput(deviceId),
+          m_sortedInputGradient(deviceId)
     {
     }
 
@@ -746,56 +1708,38 @@ public:
 
         ComputeSoftMaxPartial();
 
-        const size_t nT = Input(LABELDATA)->GetNumTimeSteps();
-        const size_t nS = Input(LABELDATA)->GetNumParallelSequences();
-        size_t sz = 0; // iterate over the packed concatenated class-conditioned prob vectors
-        for (size_t s = 0; s < nS; s++)
-            for (size_t t = 0; t < nT; t++)
+        switch (inputIndex)
+        {
+        case 1:
+        {
+            // gradient to input, per class in sorted order, then added to the samples' columns
+            m_sortedInputGradient.Resize(m_sortedInput.GetNumRows(), m_sortedInput.GetNumCols());
+            for (const auto& group : m_classGroups)
             {
-                FrameRange fr = FrameRange(Input(LABELDATA)->GetMBLayout(), t).Sequence(s);
-
-                if (Input(LABELDATA)->GetMBLayout()->IsGap(fr)) // skip gaps
-                    continue;
-
-                Matrix<ElemType> lbl_t = Input(LABELDATA)->ValueFor(fr);
-                size_t c_t = (size_t) lbl_t(1, 0);
-                size_t lft_bnd = (size_t) lbl_t(2, 0); // index of first word belonging to current word token's class
-                size_t rgt_bnd = (size_t) lbl_t(3, 0); // and end of that range
-                size_t nbr_wrd = (rgt_bnd - lft_bnd);  // number of words in the class
-
-                // compute prb - 1 and prb
-                Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(lft_bnd, nbr_wrd);
-                Matrix<ElemType> obs = Input(INPUTDATA)->ValueFor(fr); // hidden activation vector for current word token
-                Matrix<ElemType> grd_to_soft_max_input = m_grdToSoftMaxInput.ColumnSlice(sz, nbr_wrd);
-                Matrix<ElemType> grd_to_cls_prob = DataWithMBLayoutFor(m_clsLogSoftmax, fr, Input(CLASSPROBINDATA)->GetMBLayout());
-
-                switch (inputIndex)
-                {
-                case 1:
-                {
-                    // gradient to input
-                    Matrix<ElemType> grd_t = Input(INPUTDATA)->GradientFor(fr);
-                    Matrix<ElemType>::MultiplyAndAdd(weightForClass, false, grd_to_soft_max_input, true, grd_t);
-                    break;
-                }
-                case 2:
-                {
-                    // gradient to input weight
-                    Matrix<ElemType> grd_to_wgt_t = Input(EMBEDDINGMATRIX)->GradientAsMatrix().ColumnSlice(lft_bnd, nbr_wrd);
-                    Matrix<ElemType>::MultiplyAndAdd(obs, false, grd_to_soft_max_input, false, grd_to_wgt_t);
-                    break;
-                }
-                case 3:
-                {
-                    Matrix<ElemType> grd_t = Input(CLASSPROBINDATA)->GradientFor(fr);
-                    grd_t.SetValue(DataWithMBLayoutFor(m_clsSoftmax, fr, Input(CLASSPROBINDATA)->GetMBLayout()));
-                    ComputeCEPartialToSoftmaxInputs(grd_t, Gradient(), c_t);
-                    break;
-                }
-                }
-
-                sz += nbr_wrd;
+                Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(group.m_firstWord, group.m_numWords);
+                Matrix<ElemType> grd_t = m_sortedInputGradient.ColumnSlice(group.m_firstSample, group.m_numSamples);
+                Matrix<ElemType>::Multiply(weightForClass, false, GroupSlice(m_grdToSoftMaxInput, group), false, grd_t);
+            }
+            Input(INPUTDATA)->Gradient().AddScatteredColumnsOf(m_sortedInputGradient, m_columnIndices);
+            break;
+        }
+        case 2:
+        {
+            // gradient to input weight
+            for (const auto& group : m_classGroups)
+            {
+                Matrix<ElemType> obs = m_sortedInput.ColumnSlice(group.m_firstSample, group.m_numSamples);
+                Matrix<ElemType> grd_to_wgt_t = Input(EMBEDDINGMATRIX)->GradientAsMatrix().ColumnSlice(group.m_firstWord, group.m_numWords);
+                Matrix<ElemType>::MultiplyAndAdd(obs, false, GroupSlice(m_grdToSoftMaxInput, group), true, grd_to_wgt_t);
             }
+            break;
+        }
+        case 3:
+        {
+            Matrix<ElemType>::SegmentedSoftmaxGradient(Gradient(), m_clsLogSoftmax, m_classSegments, 1, Input(CLASSPROBINDATA)->Gradient());
+            break;
+        }
+        }
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -804,10 +1748,20 @@ public:
     }
 
 private:
-    void ComputeCEPartialToSoftmaxInputs(Matrix<ElemType>& inputGradientValues, Matrix<ElemType>& gradientValues, size_t y_t)
+    // the samples of one class, consecutive in the sorted order
+    struct ClassGroup
+    {
+        size_t m_firstWord; // the class's words are [m_firstWord, m_firstWord + m_numWords)
+        size_t m_numWords;
+        size_t m_firstSample; // in the sorted order
+        size_t m_numSamples;
+        size_t m_offset; // of the group's [m_numWords x m_numSamples] logits in the packed vector
+    };
+
+    // the [numWords x numSamples] view of a group's part of a packed vector
+    static Matrix<ElemType> GroupSlice(const Matrix<ElemType>& packed, const ClassGroup& group)
     {
-        Matrix<ElemType>::MinusOneAt(inputGradientValues, y_t);
-        Matrix<ElemType>::Scale(gradientValues, inputGradientValues);
+        return packed.ColumnSlice(group.m_offset, group.m_numWords * group.m_numSamples).Reshaped(group.m_numWords, group.m_numSamples);
     }
 
     // gradient of cross entropy w.r.t. to input to softmax
@@ -816,37 +1770,80 @@ private:
         if (m_needRecomputeGradientToSoftmaxInput)
         {
             m_grdToSoftMaxInput.Resize(1, m_totalNbrWords); // buffer that contains a concatenation of class-conditional values
+            Matrix<ElemType>::SegmentedSoftmaxGradient(Gradient(), m_logSoftmax, m_wordSegments, 0, m_grdToSoftMaxInput);
+            m_needRecomputeGradientToSoftmaxInput = false;
+        }
+    }
 
-            const size_t nT = Input(LABELDATA)->GetNumTimeSteps();
-            const size_t nS = Input(LABELDATA)->GetNumParallelSequences();
-            size_t sz = 0; // iterate over the packed concatenated class-conditioned prob vectors
-            for (size_t s = 0; s < nS; s++)
-                for (size_t t = 0; t < nT; t++)
-                {
-                    FrameRange fr = FrameRange(Input(LABELDATA)->GetMBLayout(), t).Sequence(s);
-
-                    // if (Input(LABELDATA)->GetMBLayout()->IsGap(s, t))  // skip gaps
-                    if (Input(LABELDATA)->GetMBLayout()->IsGap(fr)) // skip gaps
-                        continue;
-
-                    Matrix<ElemType> lbl_t = Input(LABELDATA)->ValueFor(fr);
-                    size_t y_t = (size_t) lbl_t(0, 0);     // word index
-                    size_t lft_bnd = (size_t) lbl_t(2, 0); // index of first word belonging to current word token's class
-                    size_t rgt_bnd = (size_t) lbl_t(3, 0); // and end of that range
-                    size_t nbr_wrd = (rgt_bnd - lft_bnd);  // number of words in the class
-
-                    Matrix<ElemType> softMax = m_softMax.ColumnSlice(sz, nbr_wrd);
-
-                    size_t idx_in_class = y_t - lft_bnd;
-                    ComputeCEPartialToSoftmaxInputs(softMax, Gradient(), idx_in_class);
+    // groups the samples by class, and uploads the sorted column indices and the segments of the softmaxes
+    void GroupSamplesByClass()
+    {
+        const Matrix<ElemType>& labels = Input(LABELDATA)->Value();
+        auto pMBLayout = Input(LABELDATA)->GetMBLayout();
+        const size_t nT = Input(LABELDATA)->GetNumTimeSteps();
+        const size_t nS = Input(LABELDATA)->GetNumParallelSequences();
 
-                    m_grdToSoftMaxInput.ColumnSlice(sz, nbr_wrd).SetValue(softMax);
+        // the non-gap samples, ordered by class
+        std::vector<size_t> columns;
+        for (size_t s = 0; s < nS; s++)
+            for (size_t t = 0; t < nT; t++)
+            {
+                FrameRange fr = FrameRange(pMBLayout, t).Sequence(s);
+                if (pMBLayout->IsGap(fr)) // skip gaps
+                    continue;
 
-                    sz += nbr_wrd;
-                }
+                const size_t j = t * nS + s;
+                size_t y_t = (size_t) labels(0, j);     // current word token index
+                size_t lft_bnd = (size_t) labels(2, j); // index of first word belonging to current word token's class
+                size_t rgt_bnd = (size_t) labels(3, j); // and end of that range
+                if (rgt_bnd <= lft_bnd)
+                    LogicError("ClassBasedCrossEntropyWithSoftmax (ForwardPropNonLooping()): Encountered a class of size 0. This sample seems to lack an NoInput flag.");
+                if (y_t < lft_bnd || y_t >= rgt_bnd)
+                    LogicError("ClassBasedCrossEntropyWithSoftmax (ForwardPropNonLooping()): Word index out of bounds of class-member index range (word not a class member).");
+                if ((size_t) labels(1, j) >= m_nbrCls)
+                    LogicError("ClassBasedCrossEntropyWithSoftmax (ForwardPropNonLooping()): Class index out of range.");
+                columns.push_back(j);
+            }
+        std::stable_sort(columns.begin(), columns.end(), [&labels](size_t a, size_t b)
+                         {
+                             return labels(2, a) < labels(2, b);
+                         });
+
+        const size_t numSamples = columns.size();
+        std::vector<ElemType> columnIndices(numSamples), wordSegments(3 * numSamples), classSegments(3 * numSamples);
+        m_classGroups.clear();
+        size_t sz = 0; // offset into the packed vector of class-conditioned logits
+        for (size_t k = 0; k < numSamples; k++)
+        {
+            const size_t j = columns[k];
+            const size_t lft_bnd = (size_t) labels(2, j);
+            const size_t nbr_wrd = (size_t) labels(3, j) - lft_bnd; // number of words in the class
+            if (m_classGroups.empty() || m_classGroups.back().m_firstWord != lft_bnd)
+                m_classGroups.push_back(ClassGroup{lft_bnd, nbr_wrd, k, 0, sz});
+            m_classGroups.back().m_numSamples++;
+
+            columnIndices[k] = (ElemType) j;
+            wordSegments[3 * k] = (ElemType) sz;
+            wordSegments[3 * k + 1] = (ElemType) nbr_wrd;
+            wordSegments[3 * k + 2] = (ElemType) ((size_t) labels(0, j) - lft_bnd);
+            classSegments[3 * k] = (ElemType) (j * m_nbrCls);
+            classSegments[3 * k + 1] = (ElemType) m_nbrCls;
+            classSegments[3 * k + 2] = labels(1, j);
+            sz += nbr_wrd;
+        }
+        m_totalNbrWords = sz; // total size of concatenated vector
 
-            m_needRecomputeGradientToSoftmaxInput = false;
+        if (numSamples == 0)
+        {
+            m_columnIndices.Resize(1, 0);
+            m_wordSegments.Resize(3, 0);
+            m_classSegments.Resize(3, 0);
+            return;
         }
+        const DEVICEID_TYPE deviceId = Input(INPUTDATA)->Value().GetDeviceId();
+        m_columnIndices.SetValue(1, numSamples, deviceId, columnIndices.data());
+        m_wordSegments.SetValue(3, numSamples, deviceId, wordSegments.data());
+        m_classSegments.SetValue(3, numSamples, deviceId, classSegments.data());
     }
 
 public:
@@ -862,101 +1859,37 @@ public:
             LogicError("ClassBasedCrossEntropyWithSoftmax (ForwardPropNonLooping()): The label matrix is not using CPU device. This will make computation slow, even though the label data is probably saved on GPU. Because of the external loop over time with explicit class id retrieved from the label matrix, the computation will be very slow if the label matrix is saved on GPU. However, this is only a constraint for label matrix and other matrices such as data are suggested to reside on GPU. ");
         // TODO: Get the label matrix into location=Both state.
 
-        auto& functionValues = Value();
-
-        const size_t hdSize = Input(INPUTDATA)->GetSampleMatrixNumRows(); // hdSize
         assert(m_nbrCls == Input(CLASSPROBINDATA)->GetSampleMatrixNumRows());
+        GroupSamplesByClass();
+        const size_t numSamples = m_columnIndices.GetNumCols();
 
-        // compute the class posteriors
-        m_clsLogSoftmax = Input(CLASSPROBINDATA)->Value();
-        m_clsLogSoftmax.InplaceLogSoftmax(true);   // log
-        m_clsSoftmax.AssignExpOf(m_clsLogSoftmax); // non-log
-
-        // create a large workspace to contain all class-conditioned probs concatenated
-        // 'sz' is the offset into that vector. We will iterate over these vectors at a few places. Always use this same boilerplate code.
-        // TODO: should we pull this iteration into an iterator, to reduce the code dup?
-        const size_t nT = Input(LABELDATA)->GetNumTimeSteps();
-        const size_t nS = Input(LABELDATA)->GetNumParallelSequences();
-        size_t sz = 0;
-        for (size_t s = 0; s < nS; s++)
-            for (size_t t = 0; t < nT; t++)
-            {
-                FrameRange fr = FrameRange(Input(LABELDATA)->GetMBLayout(), t).Sequence(s);
-                if (Input(LABELDATA)->GetMBLayout()->IsGap(fr)) // skip gaps
-                    continue;
-
-                const Matrix<ElemType>& lbl_t = Input(LABELDATA)->ValueFor(fr);
-                size_t lft_bnd = (size_t) lbl_t(2, 0);
-                size_t rgt_bnd = (size_t) lbl_t(3, 0);
-                size_t nbr_wrd = (rgt_bnd - lft_bnd); // number of words in the class
-                if (nbr_wrd == 0)
-                    LogicError("ClassBasedCrossEntropyWithSoftmax (ForwardPropNonLooping()): Encountered a class of size 0. This sample seems to lack an NoInput flag.");
-
-                sz += nbr_wrd;
-            }
-        m_totalNbrWords = sz; // total size of concatenated vector
+        // multiply the hidden activations of the samples of each class with the weight matrix slice for the class members
+        m_sortedInput.AssignGatheredColumnsOf(Input(INPUTDATA)->Value(), m_columnIndices); // [hdSize x numSamples]
+        m_logSoftmax.Resize(1, m_totalNbrWords);
+        for (const auto& group : m_classGroups)
+        {
+            Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(group.m_firstWord, group.m_numWords); // [hdSize x nbr_wrd]
+            Matrix<ElemType> obs = m_sortedInput.ColumnSlice(group.m_firstSample, group.m_numSamples);                                // [hdSize x numSamples]
+            Matrix<ElemType> logSoftMax_t = GroupSlice(m_logSoftmax, group);
+            Matrix<ElemType>::Multiply(weightForClass, true, obs, false, logSoftMax_t); // -> nbr_wrd x numSamples
+        }
 
-        // buffer to hold the concatenated class-conditioned prob vectors
-        m_softMax.Resize(1, sz);
-        m_logSoftmax.Resize(1, sz);
+        // log softmax(W x_t) of each sample, in place, and of the class posteriors; losses of the words, then of the classes
+        m_sampleLoss.Resize(1, 2 * numSamples);
+        Matrix<ElemType> wordLoss = m_sampleLoss.ColumnSlice(0, numSamples);
+        Matrix<ElemType> classLoss = m_sampleLoss.ColumnSlice(numSamples, numSamples);
+        Matrix<ElemType>::SegmentedLogSoftmax(m_logSoftmax, m_wordSegments, m_logSoftmax, wordLoss);
+        m_clsLogSoftmax.Resize(Input(CLASSPROBINDATA)->Value()); // gap columns are not computed
+        Matrix<ElemType>::SegmentedLogSoftmax(Input(CLASSPROBINDATA)->Value(), m_classSegments, m_clsLogSoftmax, classLoss);
 
         // accumulate objective
-        functionValues.SetValue(0);
-        sz = 0; // iterate over the packed concatenated class-conditioned prob vectors
-        for (size_t s = 0; s < nS; s++)
-            for (size_t t = 0; t < nT; t++)
-            {
-                FrameRange fr = FrameRange(Input(LABELDATA)->GetMBLayout(), t).Sequence(s);
-                if (Input(LABELDATA)->GetMBLayout()->IsGap(fr)) // skip gaps
-                    continue;
-
-                const Matrix<ElemType>& lbl_t = Input(LABELDATA)->ValueFor(fr);
-                size_t y_t = (size_t) lbl_t(0, 0);     // current word token index
-                size_t c_t = (size_t) lbl_t(1, 0);     // current word token's class index
-                size_t lft_bnd = (size_t) lbl_t(2, 0); // index of first word belonging to current word token's class
-                size_t rgt_bnd = (size_t) lbl_t(3, 0); // and end of that range
-                size_t nbr_wrd = (rgt_bnd - lft_bnd);  // number of words in the class
-
-                // now get views of various arrays that correspond to the index range of words belonging to this class
-
-                // get hidden vectors for the words in this class
-                Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(lft_bnd, nbr_wrd); // [hdSize x nbr_wrd]
-
-                // buffer to hold the class-conditional distribution
-                Matrix<ElemType> softMax_t = m_softMax.ColumnSlice(sz, nbr_wrd); // TODO: declare these outside of the loop to avoid the malloc
-                Matrix<ElemType> logSoftMax_t = m_logSoftmax.ColumnSlice(sz, nbr_wrd);
-
-                Matrix<ElemType> obs = Input(INPUTDATA)->ValueFor(fr); // hidden activation vector for current word token
-
-                // multiply hidden activation with weight matrix (the slice of the weight matrix for the range of class members)
-                // TODO: can we use 'true' here instead? Above transposition hack won't work with row slices. 'obs' not used elsewhere
-                obs.Reshape(1, hdSize);                                                                                // transpose it (make it a column vector)
-                logSoftMax_t.AssignProductOf(obs /*(1 x hdSize)*/, false, weightForClass /*hdSize x nbr_wrd*/, false); // -> 1 x nbr_word
-
-                // log softmax(W x_t)
-                logSoftMax_t.InplaceLogSoftmax(false);
-
-                // and non-log version
-                softMax_t.SetValue(logSoftMax_t);
-                softMax_t.InplaceExp();
-                // we now have a column vector of class-conditional probabilities over the class members
-
-                // add  the word's class-conditional log posterior
-                if (y_t < lft_bnd || y_t >= rgt_bnd)
-                    LogicError("ClassBasedCrossEntropyWithSoftmax (ForwardPropNonLooping()): Word index out of bounds of class-member index range (word not a class member).");
-                size_t idx_in_class = y_t - lft_bnd;
-                Matrix<ElemType>::AddElementToElement(logSoftMax_t, 0, idx_in_class, functionValues, 0, 0); // (1x1)
-
-                // add the class log posterior probability
-                Matrix<ElemType>::AddElementToElement(m_clsLogSoftmax, c_t, t, functionValues, 0, 0); // (1x1)
-
-                sz += nbr_wrd;
-            }
-
-        functionValues *= (-1);
+        if (numSamples > 0)
+            Value().AssignSumOfElements(m_sampleLoss);
+        else
+            Value().SetValue(0);
 
 #if NANCHECK
-        functionValues.HasNan("ClassBasedCrossEntropyWithSoftmax");
+        Value().HasNan("ClassBasedCrossEntropyWithSoftmax");
 #endif
         m_needRecomputeGradientToSoftmaxInput = true;
     }
@@ -982,11 +1915,10 @@ public:
     }
 
 protected:
+    // the class-conditional log softmax of all samples, packed: [1 x m_totalNbrWords]
     Matrix<ElemType> m_logSoftmax;
-    Matrix<ElemType> m_softMax;
 
     Matrix<ElemType> m_clsLogSoftmax;
-    Matrix<ElemType> m_clsSoftmax;
 
     // gradient of cross entropy with respect to the input of softmax
     // a 1 row by \sum_t m_nbrWordsInEachTime[t] vector
@@ -994,6 +1926,15 @@ protected:
     Matrix<ElemType> m_grdToSoftMaxInput;
     bool m_needRecomputeGradientToSoftmaxInput;
 
+    // the samples grouped by class (see GroupSamplesByClass()); the matrices are on the device
+    std::vector<ClassGroup> m_classGroups;
+    Matrix<ElemType> m_columnIndices;       // [1 x numSamples] column of each sample in the minibatch, in the sorted order
+    Matrix<ElemType> m_wordSegments;        // [3 x numSamples] segments of m_logSoftmax, see SegmentedLogSoftmax()
+    Matrix<ElemType> m_classSegments;       // [3 x numSamples] segments of m_clsLogSoftmax
+    Matrix<ElemType> m_sampleLoss;          // [1 x 2 numSamples] word, then class losses
+    Matrix<ElemType> m_sortedInput;         // [hdSize x numSamples] Input(INPUTDATA) in the sorted order
+    Matrix<ElemType> m_sortedInputGradient; // [hdSize x numSamples]
+
     size_t m_nbrCls;
     size_t m_totalNbrWords;
 };
@@ -1001,16 +1942,17 @@ protected:
 template class ClassBasedCrossEntropyWithSoftmaxNode<float>;
 template class ClassBasedCrossEntropyWithSoftmaxNode<double>;
 
-#ifdef COMING_SOON
-
 // -----------------------------------------------------------------------
-// CRFNode (labels, position_dependent_scores, transition_scores)
-//  - labels: output label vector of [0:T-1]
-//  - position_dependent_scores [0:T-1]: score from position dependent node,
+// CRFNode (labels, position_dependent_scores, transition_scores) -- linear-chain conditional random field criterion
+//  - labels: [L] one-hot label of each frame
+//  - position_dependent_scores: [L] score of each label at each frame, with the MBLayout of the labels;
 //    in the R-CRF case, it is the RNN output score before softmax
-//  - transition scores: square transition matrix,  --TODO: log?
+//  - transition_scores: [L x L] (k, j) is the score of label k following label j;
 //    in the R-CRF case, it is the transition probability between labels
-// BUGBUG: This node cannot operate with truncated BPTT, but does not detect it. It also does not handle gaps or test boundary flags.
+// The criterion is the sum over all sequences of -log P(labels) = log Z - score(labels), where a path y scores
+// sum_t scores(y_t, t) + sum_{t>0} transition_scores(y_t, y_{t-1}), and Z sums exp(score) over all paths.
+// All sequences of the minibatch, including the parallel ones, go through the log-space forward-backward at once,
+// one GPU block or OpenMP thread each. Gaps are skipped; sequences must be complete, so truncated BPTT is not supported.
 // -----------------------------------------------------------------------
 
 /**
@@ -1042,77 +1984,53 @@ public:
     DeclareConstructorFromConfigWithNumInputs(CRFNode);
     CRFNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          mAlpha(deviceId),
-          mBeta(deviceId),
-          mPostProb(deviceId)
+          m_gradientsValid(false),
+          m_sequences(deviceId),
+          m_indexRow(deviceId),
+          m_labelIds(deviceId),
+          m_logPartition(deviceId),
+          m_sequenceLoss(deviceId)
     {
     }
 
-    // compute posterior probability of label y at position t
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
-        FrameRange fr(Input(0)->GetMBLayout());
-        size_t nrow = Input(0)->Value().GetNumRows();
-        size_t ncol = Input(0)->Value().GetNumCols();
-
-        mAlpha.Resize(nrow, ncol);
-        mBeta.Resize(nrow, ncol);
-        mPostProb.Resize(nrow, ncol);
-
-        Value().SetValue(0.0);
-        Matrix<ElemType> funcVal = Value(); // TODO: This just creates a 1x1 matrix set to 0.
-
-        size_t nS = Input(0)->GetNumParallelSequences();
-        if (nS != 1)
-            LogicError("CRFNode: >1 parallel sequences are curently not implemented correctly.");
-        for (size_t i = 0; i < nS; i++) // process parallel sequences one by one  --BUGBUG: We should loop over individual sequences.
-        {
-            FrameRange sequenceRange = fr.Sequence(i); // FrameRange to select one sequence
-            // BUGBUG: This ^^ is neither supported nor correct, since this code does not handle gaps or start/end flags.
-            ForwardPropS(
-                DataWithMBLayoutFor(mPostProb, sequenceRange, Input(0)->GetMBLayout()),
-                DataWithMBLayoutFor(mAlpha, sequenceRange, Input(0)->GetMBLayout()),
-                DataWithMBLayoutFor(mBeta, sequenceRange, Input(0)->GetMBLayout()),
-                funcVal,
-                Input(0)->ValueFor(sequenceRange),
-                Input(1)->ValueFor(sequenceRange),
-                Input(2)->ValueAsMatrix(), mStartLbl,
-                mEndLbl);
+        UpdateSequences(*Input(0)->GetMBLayout(), m_sequences);
+        UpdateLabelIds();
+        Matrix<ElemType>::CRFForward(m_labelIds, Input(1)->Value(), Input(2)->ValueAsMatrix(), m_sequences, Input(0)->GetNumParallelSequences(),
+                                     *m_logAlpha, m_logPartition, m_sequenceLoss);
+        if (m_sequenceLoss.IsEmpty())
+            Value().SetValue(0);
+        else
+            Value().AssignSumOfElements(m_sequenceLoss);
+    }
 
-            Value() += funcVal; // aggregate over sequences
-        }
+    virtual void /*IComputationNode::*/ BeginBackprop() override
+    {
+        Base::BeginBackprop();
+        m_gradientsValid = false;
     }
 
-    virtual void BackpropToNonLooping(size_t inputIndex) override // scaled by 2*number of colmns (samples) in the Matrix<ElemType>
+    virtual void BackpropToNonLooping(size_t inputIndex) override
     {
-        FrameRange fr(Input(0)->GetMBLayout());
         // inputIndex 0 should not get us here, it should be prevented by the needGradient flag of input[0]
         if (inputIndex != 1 && inputIndex != 2)
             InvalidArgument("CRFNode only takes with respect to input and weight.");
 
-        if (inputIndex == 1)
-        {
-            auto gradient = Input(1)->GradientFor(fr);
-            Matrix<ElemType>::AddScaledDifference(Gradient(), mPostProb, Input(0)->ValueFor(fr), gradient);
-        }
-        else if (inputIndex == 2)
+        // the backward recursion serves both gradients, so they are computed at once when the first one is asked for
+        if (m_gradientsValid)
+            return;
+        Matrix<ElemType> none(m_deviceId);
+        for (size_t i = 1; i < GetNumInputs(); i++)
         {
-            assert(Input(inputIndex)->GradientFor(fr).GetNumElements() > 0);
-            size_t nS = Input(0)->GetNumParallelSequences();
-            for (size_t i = 0; i < nS; i++) // process all sequences one by one
-            {
-                FrameRange sequenceRange = fr.Sequence(i); // FrameRange to select one sequence
-                auto& gradient = Input(2)->GradientAsMatrix();
-                TransGrdCompute(Input(0)->ValueFor(sequenceRange),
-                                DataWithMBLayoutFor(mAlpha, sequenceRange, Input(0)->GetMBLayout()),
-                                DataWithMBLayoutFor(mBeta, sequenceRange, Input(0)->GetMBLayout()),
-                                Input(2)->ValueAsMatrix(),
-                                gradient,
-                                mStartLbl, 1);
-            }
+            if (Input(i)->NeedGradient())
+                Input(i)->LazyZeroGradient(); // (the network would do this only right before asking for input i)
         }
-        else
-            return;
+        Matrix<ElemType>::CRFBackward(Gradient(), m_labelIds, Input(1)->Value(), Input(2)->ValueAsMatrix(), m_sequences, Input(0)->GetNumParallelSequences(),
+                                      *m_logAlpha, m_logPartition, *m_logBeta,
+                                      Input(1)->NeedGradient() ? Input(1)->Gradient() : none,
+                                      Input(2)->NeedGradient() ? Input(2)->GradientAsMatrix() : none);
+        m_gradientsValid = true;
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -1120,145 +2038,27 @@ public:
         return false;
     }
 
-    // compute forward backward algorithm
-    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType> postprob, Matrix<ElemType> alpha, Matrix<ElemType> beta, Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls, const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, int& firstLbl, int& lastLbl, const int iStep = 1)
-    {
-        // to-do, each slice is for one sentence
-        // to-do, number of slices correspond to number of frames
-        // this implementation only supports one sentence per minibatch
-
-        int nObs = lbls.GetNumCols();
-
-        // change to other values so can support multiple sentences in each minibatch
-        assert(iStep == 1);
-        ForwardCompute(alpha, lbls, pos_scores, pair_scores);
-        BackwardCompute(alpha, beta, functionValues, lbls, pos_scores, pair_scores, iStep);
-        PostProbCompute(postprob, alpha, beta);
-
-        firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        lastLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, nObs - 1) != 0)
-            {
-                lastLbl = ik;
-                break;
-            }
-
-        functionValues.AssignInnerProductOfMatrices(lbls, pos_scores);
-
-        Matrix<ElemType> a = alpha.ColumnSlice(nObs - 1, 1);
-        ElemType fAlpha;
-        fAlpha = a.LogAddSumOfElements();
-
-        // transition score
-        ElemType tscore = 0;
-        for (int t = 0; t < nObs - 1; t++)
-        {
-            int i = -1;
-            for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-                if (lbls(ik, t) != 0)
-                {
-                    i = ik;
-                    break;
-                }
-            int j = -1;
-            for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-                if (lbls(ik, t + 1) != 0)
-                {
-                    j = ik;
-                    break;
-                }
-            tscore += pair_scores(j, i);
-        }
-        tscore += functionValues.Get00Element(); // correct path score
-        tscore -= fAlpha;                        // reduced by the scores from all paths
-        functionValues.SetValue(tscore);
-
-        functionValues *= (-1);
-    }
-
-    // compute forward backward algorithm
-    static void ForwardCompute(Matrix<ElemType>& alpha,
-                               const Matrix<ElemType>& lbls,
-                               const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores)
+    // the sequences of a minibatch as [2 x S] first column and number of frames, for the CRF kernels; shared with SequenceDecoderNode
+    static void UpdateSequences(const MBLayout& layout, Matrix<ElemType>& sequences)
     {
-        // to-do, shift more than 1 to support muliple sentences per minibatch
-        int iNumPos = lbls.GetNumCols();
-        int iNumLab = lbls.GetNumRows();
-
-        int firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        // need to have
-        alpha.Resize(iNumLab, iNumPos);
-
-        for (int t = 0; t < iNumPos; t++)
+        const size_t S = layout.GetNumParallelSequences();
+        const size_t T = layout.GetNumTimeSteps();
+        vector<ElemType> ranges;
+        for (const auto& seq : layout.GetAllSequences())
         {
-            for (int k = 0; k < iNumLab; k++)
-            {
-                ElemType fTmp = (ElemType) LZERO;
-                for (int j = 0; j < iNumLab; j++)
-                {
-                    ElemType fAlpha = (j == firstLbl) ? (ElemType) 0.0 : (ElemType) LZERO;
-                    if (t > 0)
-                        fAlpha = alpha(j, t - 1);
-                    fTmp = alpha.LogAdd(fTmp, fAlpha + pair_scores(k, j));
-                }
-                fTmp += pos_scores(k, t); // include position dependent score
-                alpha(k, t) = fTmp;
-            }
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            if (seq.tBegin < 0 || seq.tEnd > T)
+                LogicError("CRF: Sequences must be complete within a minibatch; truncated BPTT is not supported.");
+            if (seq.tEnd == (size_t) seq.tBegin)
+                continue;
+            ranges.push_back((ElemType)(seq.tBegin * S + seq.s));
+            ranges.push_back((ElemType)(seq.tEnd - seq.tBegin));
         }
-    }
-
-    // compute backward algorithm
-    static void BackwardCompute(const Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
-                                Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls,
-                                const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, const int shift = 1)
-    {
-        assert(shift == 1);
-
-        alpha.RCRFBackwardCompute(alpha, beta, functionValues, lbls, pos_scores, pair_scores, shift);
-    }
-
-    static void TransGrdCompute(const Matrix<ElemType>& lbls,
-                                const Matrix<ElemType>& alpha,
-                                const Matrix<ElemType>& beta,
-                                const Matrix<ElemType>& pair_scores,
-                                Matrix<ElemType>& grd,
-                                const int startLbl,
-                                const int shift = 1)
-    {
-        assert(shift == 1);
-
-        alpha.RCRFTransGrdCompute(lbls,
-                                  alpha,
-                                  beta,
-                                  pair_scores,
-                                  grd,
-                                  startLbl, shift);
-    }
-
-    // compute forward backward algorithm
-    static void PostProbCompute(Matrix<ElemType>& postprob, const Matrix<ElemType>& alpha, const Matrix<ElemType>& beta)
-    {
-        int iNumPos = alpha.GetNumCols();
-        int iNumLab = alpha.GetNumRows();
-
-        postprob.Resize(iNumLab, iNumPos);
-        postprob.SetValue(beta);
-        postprob.InplaceExp();
+        if (ranges.empty())
+            sequences.Resize(2, 0);
+        else
+            sequences.SetValue(2, ranges.size() / 2, sequences.GetDeviceId(), ranges.data(), matrixFlagNormal);
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -1270,7 +2070,6 @@ public:
             if (!(Input(1)->GetSampleMatrixNumRows() == Input(2)->GetAsMatrixNumRows() && // position dependent and pair scores have same number of labels
                   Input(0)->GetSampleMatrixNumRows() == Input(1)->GetSampleMatrixNumRows() &&
                   Input(0)->HasMBLayout() && Input(0)->GetMBLayout() == Input(1)->GetMBLayout() &&
-                  // Input(0)->GetNumCols() == Input(1)->GetNumCols() && // position dependent and pair scores have the same observation numbers
                   Input(2)->GetAsMatrixNumCols() == Input(2)->GetAsMatrixNumRows()))
             {
                 LogicError("The Matrix dimension in the CRFNode operation does not match.");
@@ -1279,30 +2078,54 @@ public:
         SetDims(TensorShape(1), false);
     }
 
-    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    // logAlpha is needed from forward prop until backprop, logBeta only during backprop
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
-        Base::CopyTo(nodeP, newName, flags);
-        if (flags & CopyNodeFlags::copyNodeValue)
-        {
-            auto node = dynamic_pointer_cast<CRFNode<ElemType>>(nodeP);
-            node->mAlpha = mAlpha;
-            node->mBeta = mBeta;
-            node->mPostProb = mPostProb;
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_logAlpha, matrixPool);
+    }
 
-            node->mStartLbl = mStartLbl;
-            node->mEndLbl = mEndLbl;
-        }
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_logBeta, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_logAlpha, matrixPool);
+        ReleaseMatrixToPool(m_logBeta, matrixPool);
     }
 
 private:
-    Matrix<ElemType> mAlpha; // TODO: m_Alpha etc.
-    Matrix<ElemType> mBeta;
-    Matrix<ElemType> mPostProb;
-    int mStartLbl;
-    int mEndLbl;
+    // label of each frame: [0 1 ... L-1] * labels; gaps come out as 0 and are not part of any sequence
+    void UpdateLabelIds()
+    {
+        const size_t numLabels = Input(0)->GetSampleMatrixNumRows();
+        if (m_indexRow.GetNumCols() != numLabels)
+        {
+            std::vector<ElemType> indices(numLabels);
+            for (size_t k = 0; k < numLabels; k++)
+                indices[k] = (ElemType) k;
+            m_indexRow.SetValue(1, numLabels, m_deviceId, indices.data());
+        }
+        Matrix<ElemType>::Multiply(m_indexRow, false, Input(0)->Value(), false, m_labelIds);
+    }
+
+    bool m_gradientsValid; // the gradients of both inputs have been computed in this backprop pass
+
+    Matrix<ElemType> m_sequences;             // [2 x S] first column and number of frames of each sequence (see UpdateSequences())
+    Matrix<ElemType> m_indexRow;              // [1 x L] holding 0 ... L-1
+    Matrix<ElemType> m_labelIds;              // [1 x S*T] label of each frame
+    Matrix<ElemType> m_logPartition;          // [1 x S] log Z of each sequence
+    Matrix<ElemType> m_sequenceLoss;          // [1 x S] -log P(labels) of each sequence
+    shared_ptr<Matrix<ElemType>> m_logAlpha; // [L x S*T] forward recursion
+    shared_ptr<Matrix<ElemType>> m_logBeta;  // [L x S*T] backward recursion
 };
 
-#endif
+template class CRFNode<float>;
+template class CRFNode<double>;
 
 // -----------------------------------------------------------------------
 // LogisticNode (labels, prediction, weight)
@@ -1465,6 +2288,10 @@ template class LogisticNode<double>;
 // -----------------------------------------------------------------------
 // DropoutNode (input) -- perform drop-out
 // Output is scaled such that no post-scaling is necessary.
+// The mask is not stored: it comes from a counter-based generator (Philox.h) keyed by the node's seed, the minibatch
+// and the position of each element, and backprop regenerates it, fused with the multiply in both directions.
+// With data parallelism, the position is that within the aggregate minibatch of all workers (SetMinibatchShare()),
+// so that the masks do not depend on the number of workers.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -1481,20 +2308,29 @@ public:
     DeclareConstructorFromConfigWithNumInputs(DropoutNode);
     DropoutNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          m_dropoutRate(0)
+          m_dropoutRate(0),
+          m_minibatchCount(0),
+          m_firstAggregateSequence(0),
+          m_aggregateNumSequences(0)
     {
         m_randomSeed = (unsigned long) CreateUniqId();
     }
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
-        Matrix<ElemType> sliceInput0Grad = Input(0)->GradientFor(fr);
-        Matrix<ElemType> sliceOutputGrad = GradientFor(fr);
-
         if (m_dropoutRate > 0)
-            sliceInput0Grad.AddElementProductOf(sliceOutputGrad, DataFor(*m_maskOfDropout, fr));
+        {
+            ForEachMaskSlice(fr, [&](const FrameRange& frSlice, size_t maskOffset)
+                             {
+                                 Matrix<ElemType> sliceInput0Grad = Input(0)->GradientFor(frSlice);
+                                 sliceInput0Grad.AddDropoutOf(GradientFor(frSlice), (ElemType) m_dropoutRate, m_randomSeed, m_minibatchCount, maskOffset);
+                             });
+        }
         else
-            sliceInput0Grad += sliceOutputGrad;
+        {
+            Matrix<ElemType> sliceInput0Grad = Input(0)->GradientFor(fr);
+            sliceInput0Grad += GradientFor(fr);
+        }
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -1512,31 +2348,33 @@ public:
         return false;
     }
 
-    virtual void UpdateFunctionMBSize() override
+    // a replayed time step would repeat the random mask of the recording
+    virtual bool CollectCaptureState(std::vector<const void*>&, std::vector<MBLayoutPtr>&) const override
     {
-        Base::UpdateFunctionMBSize();
-        // resize temporaries to their proper size
-        if (m_dropoutRate > 0)
-            m_maskOfDropout->Resize(Input(0)->Value());
+        return false;
     }
 
-    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    // each minibatch gets a new mask; all time steps of a loop share the random stream at different offsets
+    virtual void /*IComputationNode::*/ BeginForwardProp() override
     {
-        Matrix<ElemType> sliceInput0Value = Input(0)->ValueFor(fr);
-        Matrix<ElemType> sliceOutputValue = ValueFor(fr);
+        Base::BeginForwardProp();
+        m_minibatchCount++;
+    }
 
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
         if (m_dropoutRate > 0)
         {
-            // determine drop-out mask for this minibatch
-            auto sliceMask = DataFor(*m_maskOfDropout, fr);
-            sliceMask.SetUniformRandomMask((ElemType) m_dropoutRate, (ElemType)(1.0 / (1.0 - m_dropoutRate)) /*pre-scaled*/, m_randomSeed);
-            m_randomSeed += 1073807359; // 1073807359 is a very large prime number to avoid collision with other dropout nodes
-            // apply dropout mask
-            sliceOutputValue.AssignElementProductOf(sliceMask, sliceInput0Value);
+            ForEachMaskSlice(fr, [&](const FrameRange& frSlice, size_t maskOffset)
+                             {
+                                 Matrix<ElemType> sliceOutputValue = ValueFor(frSlice);
+                                 sliceOutputValue.AssignDropoutOf(Input(0)->ValueFor(frSlice), (ElemType) m_dropoutRate, m_randomSeed, m_minibatchCount, maskOffset);
+                             });
         }
         else
         {
-            sliceOutputValue.SetValue(sliceInput0Value);
+            Matrix<ElemType> sliceOutputValue = ValueFor(fr);
+            sliceOutputValue.SetValue(Input(0)->ValueFor(fr));
         }
     }
 
@@ -1556,6 +2394,16 @@ public:
     void SetRandomSeed(const unsigned long val)
     {
         m_randomSeed = (unsigned long) val;
+        m_minibatchCount = 0;
+    }
+
+    // with data parallelism: this worker's parallel sequences are [firstSequence, firstSequence + its own number) of the
+    // aggregate minibatch, i.e. of the minibatches of all workers side by side, which has 'numSequences' in total
+    // (0: the minibatch is not split)
+    void SetMinibatchShare(size_t firstSequence, size_t numSequences)
+    {
+        m_firstAggregateSequence = firstSequence;
+        m_aggregateNumSequences = numSequences;
     }
 
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
@@ -1566,28 +2414,42 @@ public:
             auto node = dynamic_pointer_cast<DropoutNode<ElemType>>(nodeP);
             node->m_dropoutRate = m_dropoutRate;
             node->m_randomSeed = m_randomSeed;
-            node->m_maskOfDropout = m_maskOfDropout;
+            node->m_minibatchCount = m_minibatchCount;
+            node->m_firstAggregateSequence = m_firstAggregateSequence;
+            node->m_aggregateNumSequences = m_aggregateNumSequences;
         }
     }
-    // request matrices needed to do node function value evaluation
-    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
+
+private:
+    // Time step t of parallel sequence s is column t * S + s of our minibatch, but t * S' + s' + s of the aggregate one
+    // (S' sequences, ours starting at s'). A slice within one time step is contiguous in both, but a whole minibatch is
+    // not unless S == S', so it is then processed one time step at a time.
+    template <class ApplyFunction>
+    void ForEachMaskSlice(const FrameRange& fr, const ApplyFunction& apply) const
     {
-        Base::RequestMatricesBeforeForwardProp(matrixPool);
-        RequestMatrixFromPool(m_maskOfDropout, matrixPool);
+        if (!fr.IsAllFrames() || !HasMBLayout() || m_aggregateNumSequences == 0 || m_aggregateNumSequences == GetMBLayout()->GetNumParallelSequences())
+            return apply(fr, MaskOffsetFor(fr));
+        for (size_t t = 0; t < GetMBLayout()->GetNumTimeSteps(); t++)
+            apply(fr.WithTimeStep(t), MaskOffsetFor(fr.WithTimeStep(t)));
     }
 
-    // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
-    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool)
+    // index of the first element of the slice 'fr' within the mask of the aggregate minibatch
+    size_t MaskOffsetFor(const FrameRange& fr) const
     {
-        Base::ReleaseMatricesAfterBackprop(matrixPool);
-        ReleaseMatrixToPool(m_maskOfDropout, matrixPool);
+        size_t column = ColumnRangeWithMBLayoutFor(Value().GetNumCols(), fr, GetMBLayout()).first;
+        if (HasMBLayout() && m_aggregateNumSequences > 0)
+        {
+            const size_t numSequences = GetMBLayout()->GetNumParallelSequences();
+            column = (column / numSequences) * m_aggregateNumSequences + m_firstAggregateSequence + column % numSequences;
+        }
+        return column * GetSampleMatrixNumRows();
     }
 
-private:
     double m_dropoutRate;
     unsigned long m_randomSeed;
-
-    shared_ptr<Matrix<ElemType>> m_maskOfDropout;
+    size_t m_minibatchCount;         // the random stream of the mask
+    size_t m_firstAggregateSequence; // our share of the aggregate minibatch, see SetMinibatchShare()
+    size_t m_aggregateNumSequences;
 };
 
 template class DropoutNode<float>;
@@ -1613,17 +2475,18 @@ class BatchNormalizationNode : public ComputationNode<ElemType>, public NumInput
 
 public:
     BatchNormalizationNode(DEVICEID_TYPE deviceId, const wstring& name)
-        : Base(deviceId, name), m_eval(false), m_spatial(false), m_expAvgFactor(0), m_epsilon(0), m_useCntkEngine(true), m_mbCount(0), m_imageLayoutKind(ImageLayoutKind::CHW)
+        : Base(deviceId, name), m_eval(false), m_spatial(false), m_expAvgFactor(0), m_epsilon(0), m_useCntkEngine(true), m_mbCount(0), m_imageLayoutKind(ImageLayoutKind::CHW), m_fuseReLU(false)
     {
     }
-    BatchNormalizationNode(DEVICEID_TYPE deviceId, const wstring& name, bool eval, bool spatial, double expAvgFactor, double epsilon, bool useCntkEngine, ImageLayoutKind imageLayoutKind)
+    BatchNormalizationNode(DEVICEID_TYPE deviceId, const wstring& name, bool eval, bool spatial, double expAvgFactor, double epsilon, bool useCntkEngine, ImageLayoutKind imageLayoutKind,
+                           bool fuseReLU = false)
         : Base(deviceId, name), m_eval(eval), m_spatial(spatial), m_expAvgFactor(expAvgFactor), m_epsilon(epsilon), m_useCntkEngine(useCntkEngine),
-          m_imageLayoutKind(imageLayoutKind), m_mbCount(0)
+          m_imageLayoutKind(imageLayoutKind), m_mbCount(0), m_fuseReLU(fuseReLU)
     {
     }
     BatchNormalizationNode(const ScriptableObjects::IConfigRecordPtr configp)
         : BatchNormalizationNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"eval"), configp->Get(L"spatial"), configp->Get(L"expAvgFactor"),
-                                 configp->Get(L"epsilon"), configp->Get(L"useCntkEngine"), ImageLayoutKindFrom(configp->Get(L"imageLayout")))
+                                 configp->Get(L"epsilon"), configp->Get(L"useCntkEngine"), ImageLayoutKindFrom(configp->Get(L"imageLayout")), configp->Get(L"fuseReLU"))
     {
         AttachInputs(configp, this->GetExpectedNumInputs());
     }
@@ -1640,6 +2503,7 @@ public:
         fstream << m_mbCount;
         fstream << m_epsilon;
         fstream << m_useCntkEngine;
+        fstream << m_fuseReLU;
     }
 
     void Load(File& fstream, size_t modelVersion) override
@@ -1673,6 +2537,8 @@ public:
             fstream >> m_epsilon;
             fstream >> m_useCntkEngine;
         }
+        if (verWritten >= 0x00010004)
+            fstream >> m_fuseReLU;
     }
 
     void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
@@ -1686,6 +2552,7 @@ public:
             node->m_eval = m_eval;
             node->m_spatial = m_spatial;
             node->m_expAvgFactor = m_expAvgFactor;
+            node->m_fuseReLU = m_fuseReLU;
         }
     }
 
@@ -1696,8 +2563,14 @@ public:
 
         if (inputIndex == 0) // derivative with respect to the input.
         {
-            auto sliceOutputGrad = GradientFor(fr);
-            auto sliceInputValue = Input(0)->ValueFor(fr);
+            if (m_fuseReLU) // the gradient of the normalization is zero where the ReLU cut off the output
+            {
+                size_t rank = DetermineElementwiseTensorRank();
+                auto sliceOutputGradTensor = GradientTensorFor(rank, fr);
+                sliceOutputGradTensor.DoBinaryOpOf(0, sliceOutputGradTensor, ValueTensorFor(rank, fr), 1, opElementwiseProductWithLinearRectifierDerivativeFromOutput);
+            }
+            auto sliceOutputGrad = NormalizedView(GradientFor(fr));
+            auto sliceInputValue = NormalizedView(Input(0)->ValueFor(fr));
             const Matrix<ElemType>& scale = Input(1)->Value();
             const Matrix<ElemType>& bias = Input(2)->Value();
 
@@ -1705,11 +2578,11 @@ public:
             m_inT->setN(batchSize);
             assert(m_convEng != nullptr);
 
-            auto sliceInputGrad = Input(0)->GradientFor(fr);
+            auto sliceInputGrad = NormalizedView(Input(0)->GradientFor(fr));
             m_dScale->Resize(scale);
             m_dBias->Resize(bias);
             // Compute all derivatives in one step. Save derivatives with respect to scale and bias in temp matrices.
-            m_convEng->BackwardNormalizeBatch(*m_inT, sliceInputValue, sliceOutputGrad, sliceInputGrad, *m_scaleBiasT, scale, m_spatial,
+            m_convEng->BackwardNormalizeBatch(*m_inT, sliceInputValue, sliceOutputGrad, sliceInputGrad, *m_scaleBiasT, scale, IsEngineSpatial(),
                                               *m_saveMean, *m_saveInvStdDev, *m_dScale, *m_dBias);
         }
         else if (inputIndex == 1) // derivative with respect to the scale
@@ -1730,13 +2603,19 @@ public:
     virtual bool OutputUsedInComputingInputNodesGradients() const override
     {
         // The BatchNormalizationNode does not require its output value for computing
-        // the gradients of its input nodes
+        // the gradients of its input nodes, except for the mask of a fused ReLU
+        return m_fuseReLU;
+    }
+
+    // the running statistics are blended with a factor computed on the host from the number of samples seen
+    virtual bool CollectCaptureState(std::vector<const void*>&, std::vector<MBLayoutPtr>&) const override
+    {
         return false;
     }
 
     void ForwardProp(const FrameRange& fr) override
     {
-        Matrix<ElemType> sliceInputValue = Input(0)->ValueFor(fr);
+        Matrix<ElemType> sliceInputValue = NormalizedView(Input(0)->ValueFor(fr));
 
         const Matrix<ElemType>& scale = Input(1)->Value();
         const Matrix<ElemType>& bias = Input(2)->Value();
@@ -1749,7 +2628,7 @@ public:
         assert(runMean.GetNumRows() == runInvStdDev.GetNumRows());
         assert(runMean.GetNumCols() == runInvStdDev.GetNumCols());
 
-        Matrix<ElemType> sliceOutputValue = ValueFor(fr);
+        Matrix<ElemType> sliceOutputValue = NormalizedView(ValueFor(fr));
 
         size_t batchSize = sliceInputValue.GetNumCols();
         m_inT->setN(batchSize);
@@ -1758,7 +2637,7 @@ public:
         sliceInputValue.HasNan("BatchNormalization-input");
 #endif
         if (m_eval)
-            m_convEng->NormalizeBatchInference(*m_inT, sliceInputValue, *m_scaleBiasT, scale, bias, m_spatial, runMean, runInvStdDev, sliceOutputValue);
+            m_convEng->NormalizeBatchInference(*m_inT, sliceInputValue, *m_scaleBiasT, scale, bias, IsEngineSpatial(), runMean, runInvStdDev, sliceOutputValue, m_fuseReLU);
         else
         {
             // REVIEW alexeyk: hack, use m_expAvgFactor <= 0 to compute CMA.
@@ -1769,8 +2648,8 @@ public:
             if (m_saveInvStdDev->GetNumElements() != runMean.GetNumElements())
                 m_saveInvStdDev->Resize(runMean.GetNumRows(), runMean.GetNumCols());
 
-            m_convEng->NormalizeBatch(*m_inT, sliceInputValue, *m_scaleBiasT, scale, bias, m_spatial, expAvgFactor, runMean, runInvStdDev,
-                                      sliceOutputValue, m_epsilon, *m_saveMean, *m_saveInvStdDev);
+            m_convEng->NormalizeBatch(*m_inT, sliceInputValue, *m_scaleBiasT, scale, bias, IsEngineSpatial(), expAvgFactor, runMean, runInvStdDev,
+                                      sliceOutputValue, m_epsilon, *m_saveMean, *m_saveInvStdDev, m_fuseReLU);
 
             m_mbCount++;
         }
@@ -1792,24 +2671,28 @@ public:
 
         if (isFinalValidationPass)
         {
-            if (m_spatial && m_imageLayoutKind != CHW)
-            {
-                InvalidArgument(
-                    "Batch normalization currently supports only cuDNN (CHW) data layout. " 
-                    "Please specify imageLayout=\"cudnn\" in BatchNormalization node in your NDL/BrainScript "
-                    "and make sure your input data layout is CHW");
-            }
             double cudnnMinEps = 1e-5; // CUDNN_BN_MIN_EPSILON
             if (!m_useCntkEngine && m_epsilon < cudnnMinEps) 
                 fprintf(stderr, "\nWARNING: cuDNN batch normalization requires epsilon >= %e. Epsilon will be reset to that value.\n", cudnnMinEps);
 
             auto shape = GetSampleLayout();
 
+            // The tensors of the channels-fastest case are plain vectors, which are the same in all layouts.
             if (m_factory == nullptr)
-                m_factory = ConvolutionEngineFactory<ElemType>::Create(m_deviceId, ConvolutionEngineFactory<ElemType>::EngineType::Auto, m_imageLayoutKind);
+                m_factory = ConvolutionEngineFactory<ElemType>::Create(m_deviceId, ConvolutionEngineFactory<ElemType>::EngineType::Auto, IsChannelsFastest() ? CHW : m_imageLayoutKind);
             if (m_convEng == nullptr)
                 m_convEng = m_factory->CreateConvEngine(m_deviceId, 0, m_useCntkEngine ? BatchNormImpl::Cntk : BatchNormImpl::CuDnn);
-            if (m_spatial)
+            if (IsChannelsFastest())
+            {
+                // Spatial normalization of HWC data is per-activation normalization of the channel vectors of all pixels,
+                // see NormalizedView(). This needs no transposition of the data to CHW.
+                auto dims = ImageDimensions(shape, m_imageLayoutKind);
+                if (m_inT == nullptr)
+                    m_inT = m_factory->CreateTensor(dims.m_numChannels, 1, 1, 1);
+                if (m_scaleBiasT == nullptr)
+                    m_scaleBiasT = m_factory->CreateTensor(dims.m_numChannels, 1, 1, 1);
+            }
+            else if (m_spatial)
             {
                 auto dims = ImageDimensions(shape, m_imageLayoutKind);
                 if (m_inT == nullptr)
@@ -1864,13 +2747,48 @@ public:
         m_eval = bnEvalMode;
     }
 
+    // per-channel (after convolutions) rather than per-activation normalization
+    bool IsSpatial() const
+    {
+        return m_spatial;
+    }
+
+    // the output is max(0, normalized), i.e. a following RectifiedLinear is computed by this node
+    bool HasFusedReLU() const
+    {
+        return m_fuseReLU;
+    }
+
+private:
+    // In the HWC layout, the channels of a pixel are contiguous, so the values of one channel are spread over the whole sample.
+    bool IsChannelsFastest() const
+    {
+        return m_spatial && m_imageLayoutKind == ImageLayoutKind::HWC;
+    }
+
+    // whether the engine is asked for spatial normalization; the channels-fastest case is per-activation on NormalizedView()
+    bool IsEngineSpatial() const
+    {
+        return m_spatial && !IsChannelsFastest();
+    }
+
+    // reference to a minibatch matrix as the engine sees it: unchanged, or [channel x (pixel, sample)] in the channels-fastest case
+    Matrix<ElemType> NormalizedView(const Matrix<ElemType>& m) const
+    {
+        if (!IsChannelsFastest())
+            return m.AsReference();
+        const size_t numChannels = ImageDimensions(GetSampleLayout(), m_imageLayoutKind).m_numChannels;
+        return m.Reshaped(numChannels, m.GetNumElements() / numChannels);
+    }
+
 private:
     struct VersionInfo
     {
         //int32_t VerWrittenCur() const      { return 0x00010001; } // Initial
         //int32_t VerWrittenCur() const      { return 0x00010002; } // Added m_imageLayoutKind and m_mbCount
-        int32_t VerWrittenCur() const        { return 0x00010003; } // Added m_epsilon and m_useCntkEngine
-        int32_t VerReadableCur() const       { return 0x00010003; }
+        //int32_t VerWrittenCur() const      { return 0x00010003; } // Added m_epsilon and m_useCntkEngine
+        int32_t VerWrittenCur() const        { return 0x00010004; } // Added m_fuseReLU
+        int32_t VerReadableCur() const       { return 0x00010004; }
         int32_t VerWeCanReadBack() const     { return 0x00010001; }
     };
     VersionInfo m_version;
@@ -1891,6 +2809,8 @@ private:
     ImageLayoutKind m_imageLayoutKind;
     // Minibatch count, used to compute cumulative moving average.
     size_t m_mbCount;
+    // Whether the output is followed by a ReLU computed in the same pass.
+    bool m_fuseReLU;
 
     // Stores pre-computed on forward pass mean values that are used in gradient computation.
     shared_ptr<Matrix<ElemType>> m_saveMean;
@@ -11,11 +11,17 @@
 #include "CNTKEval.h"
 #include "CPUMatrix.h" // for SetNumThreads()
 #include "SimpleOutputWriter.h"
+#include "RecurrentNodes.h" // for DelayedValueNodeState
 #ifdef LEAKDETECT
 #include <vld.h> // leak detection
 #endif
 #include "BestGpu.h"
 #include "MPIWrapper.h"
+#include "CuDnnConvolutionEngine.h" // for CuDnnAlgorithmCache and ConvolutionEngineSelection
+#include "CUDAPageLockedMemAllocator.h"
+#include "TimerUtility.h"
+#include <algorithm>
+#include <functional>
 
 // TODO: Get rid of this global
 Microsoft::MSR::CNTK::MPIWrapper* g_mpi = nullptr;
@@ -47,6 +53,15 @@ void CNTKEval<ElemType>::Init(const std::string& config)
 {
     m_start = 0;
     m_config.Parse(config);
+    // process-wide settings, which must be made before the model is loaded
+    wstring algorithmCacheFile = m_config(L"cudnnAlgorithmCacheFile", L"");
+    if (!algorithmCacheFile.empty()) // (the cache is process-wide, so other evaluators keep theirs if this one does not set any)
+        CuDnnAlgorithmCache::SetFile(algorithmCacheFile);
+    if (m_config.Exists("cudnnForHWC")) // (process-wide as well)
+        ConvolutionEngineSelection::SetCuDnnForHWC(m_config(L"cudnnForHWC", false));
+    if (m_config.Exists("cpuMemoryPlacement")) // (process-wide as well; applies to the buffers allocated from now on)
+        CPUMemoryPlacement::Set(m_config(L"cpuMemoryPlacement", "none"));
+
     if (m_config.Exists("modelPath"))
     {
         std::wstring path = m_config("modelPath");
@@ -55,7 +70,23 @@ void CNTKEval<ElemType>::Init(const std::string& config)
     size_t nThreads = m_config("numCPUThreads", "1");
     CPUMatrix<ElemType>::SetNumThreads(nThreads);
 
+    // per evaluator: threads of each operation, and CPUs to run on (see CPUThreading.h)
+    m_cpuThreading.m_intraOpThreads = m_config(L"intraOpThreads", 0);
+    m_cpuThreading.m_cpus = CPUThreading::ParseCpuList(m_config(L"cpuAffinity", ""));
+    if (m_config.Exists("maxConcurrentEvaluations")) // (process-wide, so other evaluators keep the limit if this one does not set any)
+        CPUThreading::SetMaxConcurrentEvaluations(m_config(L"maxConcurrentEvaluations", (size_t) 0));
+
     g_shareNodeValueMatrices = m_config(L"shareNodeValueMatrices", false);
+
+    // optionally warm up a model loaded from the config right away (see Warmup()); this is after the settings it depends on
+    if (m_net && m_config.Exists("warmupNumSamples"))
+    {
+        ConfigArray warmupNumSamples = m_config("warmupNumSamples");
+        std::vector<size_t> numSamples;
+        for (size_t i = 0; i < warmupNumSamples.size(); i++)
+            numSamples.push_back(warmupNumSamples[i]);
+        Warmup(numSamples);
+    }
 }
 
 // Destroy - cleanup and remove this class
@@ -64,7 +95,18 @@ template <class ElemType>
 void CNTKEval<ElemType>::Destroy()
 {
     // cleanup everything
+    if (m_batcher)
+        m_batcher->PrintStatistics();
+    m_batcher.reset();
+    if (m_cascade)
+        m_cascade->PrintStatistics();
+    m_cascade.reset();
+    DestroyCascadeStages();
+    m_decoder.reset();
+    for (ElemType* buffer : m_pageLockedBuffers)
+        CUDAPageLockedMemAllocator::FreeToPool(buffer);
     m_net.reset();
+    m_host.reset();
     delete m_reader;
     delete m_writer;
     delete this;
@@ -77,7 +119,162 @@ void CNTKEval<ElemType>::LoadModel(const std::wstring& modelFileName)
 {
     DEVICEID_TYPE deviceId = DeviceFromConfig(m_config);
     fprintf(stderr, "DeviceID=%d\n", (int) deviceId);
-    m_net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+    m_decoder.reset(); // (refers to the previous network)
+    m_boundInputs.clear();
+    m_boundOutputs.clear();
+    m_boundInputNodes.clear();
+    m_boundOutputNodes.clear();
+    m_boundPrepared = false;
+    m_net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName, ComputationNetworkOptions(m_config));
+
+    // optionally fold normalizations into weights and drop training-only nodes (see ComputationNetwork::OptimizeForInference())
+    if (m_config(L"optimizeForInference", false))
+        m_net->OptimizeForInference<ElemType>();
+
+    // optionally share identical parameters and the activation workspace with the other models of a host (see EvalHost.h)
+    std::wstring hostName = m_config(L"evalHost", L"");
+    m_host.reset();
+    if (!hostName.empty())
+    {
+        m_host = EvalHost::Get(hostName, deviceId);
+        m_host->AddModel<ElemType>(m_net);
+    }
+
+    // optionally evaluate products with weight matrices in int8 (CPU only)
+    if (m_config(L"quantizeWeightsToInt8", false))
+    {
+        if (deviceId == CPUDEVICE)
+            m_net->QuantizeWeightsToInt8();
+        else
+            fprintf(stderr, "WARNING: quantizeWeightsToInt8 is only supported on the CPU, ignored for DeviceID=%d.\n", (int) deviceId);
+    }
+
+    // on the CPU, the remaining weight matrices are packed once for the small minibatches of serving (see PackedGemmMatrix.h);
+    // this keeps a second copy of them
+    if (deviceId == CPUDEVICE && m_config(L"packWeightsForInference", true))
+        m_net->PackWeightsForInference();
+
+    CreateCascadeIfRequested();
+    CreateBatcherIfRequested();
+}
+
+// CreateBatcherIfRequested - set up request batching if the config asks for it (maxBatchSize > 0)
+// maxBatchSize - max number of samples evaluated together
+// maxBatchLatencyMs - max time a request waits for others to join its batch
+template <class ElemType>
+void CNTKEval<ElemType>::CreateBatcherIfRequested()
+{
+    size_t maxBatchSize = m_isCascadeStage ? 0 : m_config(L"maxBatchSize", (size_t) 0); // (a stage is batched by its cascade)
+    if (maxBatchSize == 0)
+    {
+        m_batcher.reset();
+        return;
+    }
+
+    // samples of different requests end up in the same sequence, which is only correct if nothing looks across samples
+    for (const auto& pair : m_net->GetNameToNodeMap())
+    {
+        if (pair.second->IsPartOfLoop())
+            InvalidArgument("maxBatchSize: Batching of Evaluate() calls requires a network without recurrent loops, but %ls is part of one.", pair.first.c_str());
+    }
+
+    std::map<std::wstring, size_t> inputDimensions;
+    GetNodeDimensions(inputDimensions, nodeInput);
+    double maxLatencyMs = m_config(L"maxBatchLatencyMs", 5.0);
+    m_batcher.reset(new EvalBatcher<ElemType>([this](std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+                                              {
+                                                  EvaluateUnbatched(inputs, outputs);
+                                              },
+                                              inputDimensions, maxBatchSize, maxLatencyMs));
+    fprintf(stderr, "Batching Evaluate() calls into up to %d samples, waiting at most %.1f ms.\n", (int) maxBatchSize, maxLatencyMs);
+}
+
+// CreateCascadeIfRequested - set up early-exit evaluation if the config asks for it (see EvalCascade.h)
+// cascadeModelPaths - the models to go on to, cheapest first, after the one loaded here; e.g. {|C:\models\mid.dnn|C:\models\large.dnn}
+// cascadeGate - maxPosterior (default) or entropy
+// cascadeThresholds - one threshold for all gates, or one per gate (i.e. per model but the last); by default 0.9 for maxPosterior, 0.3 for entropy
+// cascadeGateNode - the output node that the gates judge, by default the first output node
+// cascadeNormalize - apply a softmax to the gate node's values first, for a model whose output is logits (default true)
+// If 'cloneOf' is given, the stages are clones of its stages rather than loaded from the files.
+template <class ElemType>
+void CNTKEval<ElemType>::CreateCascadeIfRequested(const CNTKEval<ElemType>* cloneOf)
+{
+    m_cascade.reset();
+    DestroyCascadeStages();
+    if (m_isCascadeStage || !m_config.Exists("cascadeModelPaths"))
+        return;
+
+    ConfigArray modelPaths = m_config("cascadeModelPaths");
+    if (modelPaths.empty())
+        return;
+    std::wstring gateKind = m_config(L"cascadeGate", L"maxPosterior");
+    typename EvalCascade<ElemType>::Gate gate;
+    if (gateKind == L"maxPosterior")
+        gate.m_kind = EvalCascade<ElemType>::maxPosterior;
+    else if (gateKind == L"entropy")
+        gate.m_kind = EvalCascade<ElemType>::entropy;
+    else
+        InvalidArgument("cascadeGate: '%ls' is not a gate; use maxPosterior or entropy.", gateKind.c_str());
+    gate.m_normalize = m_config(L"cascadeNormalize", true);
+    gate.m_nodeName = m_config(L"cascadeGateNode", m_net->OutputNodes().empty() ? L"" : m_net->OutputNodes()[0]->NodeName());
+    ConfigArray thresholds = m_config("cascadeThresholds", gate.m_kind == EvalCascade<ElemType>::maxPosterior ? "0.9" : "0.3");
+    if (thresholds.size() != 1 && thresholds.size() != modelPaths.size())
+        InvalidArgument("cascadeThresholds: %d gates need one threshold or %d, not %d.", (int) modelPaths.size(), (int) modelPaths.size(), (int) thresholds.size());
+
+    // like batching, this evaluates samples on their own, regardless of the sequences they came in
+    std::map<std::wstring, size_t> inputDimensions, outputDimensions;
+    GetNodeDimensions(inputDimensions, nodeInput);
+    GetNodeDimensions(outputDimensions, nodeOutput);
+    std::vector<typename EvalCascade<ElemType>::EvaluateFunction> stages;
+    std::vector<typename EvalCascade<ElemType>::Gate> gates;
+    for (size_t k = 0; k <= modelPaths.size(); k++)
+    {
+        CNTKEval<ElemType>* stage = this;
+        if (k > 0 && cloneOf)
+        {
+            stage = static_cast<CNTKEval<ElemType>*>(cloneOf->m_cascadeStages[k - 1]->CloneEvaluator());
+            m_cascadeStages.push_back(stage);
+        }
+        else if (k > 0)
+        {
+            stage = new CNTKEval<ElemType>();
+            m_cascadeStages.push_back(stage); // (owned from here, also if loading fails)
+            stage->m_config = m_config;
+            stage->m_cpuThreading = m_cpuThreading;
+            stage->m_isCascadeStage = true;
+            stage->LoadModel(msra::strfun::utf16(modelPaths[k - 1]));
+            std::map<std::wstring, size_t> stageInputDimensions, stageOutputDimensions;
+            stage->GetNodeDimensions(stageInputDimensions, nodeInput);
+            stage->GetNodeDimensions(stageOutputDimensions, nodeOutput);
+            if (stageInputDimensions != inputDimensions || stageOutputDimensions != outputDimensions)
+                InvalidArgument("cascadeModelPaths: The model %s does not have the same input and output nodes as the first one.", modelPaths[k - 1].c_str());
+        }
+        for (const auto& pair : stage->m_net->GetNameToNodeMap())
+        {
+            if (pair.second->IsPartOfLoop())
+                InvalidArgument("cascadeModelPaths: A cascade requires networks without recurrent loops, but %ls is part of one.", pair.first.c_str());
+        }
+        stages.push_back([stage](std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+                         {
+                             stage->EvaluateImmediately(inputs, outputs);
+                         });
+        if (k < modelPaths.size())
+        {
+            gate.m_threshold = thresholds[thresholds.size() == 1 ? 0 : k];
+            gates.push_back(gate);
+        }
+    }
+    m_cascade.reset(new EvalCascade<ElemType>(stages, gates, inputDimensions, outputDimensions));
+    fprintf(stderr, "Evaluating a cascade of %d models, gated by %ls of %ls.\n", (int) stages.size(), gateKind.c_str(), gate.m_nodeName.c_str());
+}
+
+// DestroyCascadeStages - release the evaluators of the models after this one
+template <class ElemType>
+void CNTKEval<ElemType>::DestroyCascadeStages()
+{
+    for (auto stage : m_cascadeStages)
+        stage->Destroy();
+    m_cascadeStages.clear();
 }
 
 // GetNodeDimensions - Get the node dimensions of the specified nodes
@@ -140,9 +337,35 @@ void CNTKEval<ElemType>::StartEvaluateMinibatchLoop(const std::wstring& outputNo
 // Evaluate - Evalute using the model with the given inputs and outputs
 // inputs - map from node name to input vector
 // outputs - map from node name to output vector, outputs vectors need to be preallocated by caller, sizing will happen during evaluation
+// With batching enabled, this may be called from multiple threads at once, and the call returns once the batch it was merged into has been evaluated.
 template <class ElemType>
 void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
 {
+    if (m_batcher)
+        m_batcher->Evaluate(inputs, outputs);
+    else
+        EvaluateUnbatched(inputs, outputs);
+}
+
+// EvaluateUnbatched - evaluate the given inputs through the cascade if there is one, otherwise right away
+template <class ElemType>
+void CNTKEval<ElemType>::EvaluateUnbatched(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+{
+    if (m_cascade)
+        m_cascade->Evaluate(inputs, outputs);
+    else
+        EvaluateImmediately(inputs, outputs);
+}
+
+// EvaluateImmediately - evaluate the given inputs right away as one sequence
+// This waits for a slot if maxConcurrentEvaluations are running, and runs with this evaluator's CPU threading options.
+template <class ElemType>
+void CNTKEval<ElemType>::EvaluateImmediately(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+{
+    CPUThreading::ConcurrencySlot slot;
+    CPUThreading::Scope threading(m_cpuThreading);
+    auto hostLock = LockHost();
+
     size_t minibatchSize = m_config(L"minibatchSize", (size_t) 10240);
     // get the evaluation names from the output string
     vector<wstring> outNodeNames;
@@ -171,6 +394,7 @@ void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>
     m_writer->SetData(&outputs, &m_dimensions);
 
     // call the evaluator
+    m_boundPrepared = false; // (this allocates the matrices for its own outputs)
     SimpleOutputWriter<ElemType> eval(m_net);
     eval.WriteOutput(*m_reader, minibatchSize, *m_writer, outNodeNames);
 }
@@ -182,6 +406,508 @@ void CNTKEval<ElemType>::ResetState()
     m_start = 1 - m_start;
 }
 
+// CloneEvaluator - create an evaluator for the same model that can be used concurrently with this one
+// The clone gets its own copy of the network, whose LearnableParameters share their values with ours (see ComputationNetwork::CloneForEvaluation()),
+// and its own reader, writer and recurrent state. Like this evaluator, it has to be prepared with StartEvaluateMinibatchLoop().
+// Note: clone before calling StartEvaluateMinibatchLoop() here, otherwise the clone inherits private copies of our node values.
+// The clone does not join our EvalHost: it is meant to be evaluated concurrently, so it has a workspace of its own.
+template <class ElemType>
+IEvaluateModel<ElemType>* CNTKEval<ElemType>::CloneEvaluator()
+{
+    if (m_net == nullptr)
+        RuntimeError("CloneEvaluator: A model must be loaded before the evaluator can be cloned.");
+
+    auto clone = new CNTKEval<ElemType>();
+    clone->m_config = m_config;
+    clone->m_cpuThreading = m_cpuThreading;
+    clone->m_isCascadeStage = m_isCascadeStage;
+    clone->m_net = m_net->CloneForEvaluation();
+    clone->CreateCascadeIfRequested(this);
+    clone->CreateBatcherIfRequested();
+    for (const auto& node : m_boundInputs)
+        clone->BindInput(node->NodeName());
+    for (const auto& node : m_boundOutputs)
+        clone->BindOutput(node->NodeName());
+    return clone;
+}
+
+// -----------------------------------------------------------------------
+// streaming evaluation
+// -----------------------------------------------------------------------
+
+// CreateStream - start a new stream (utterance); its first chunk starts a new sequence
+template <class ElemType>
+size_t CNTKEval<ElemType>::CreateStream()
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    size_t streamId = m_nextStreamId++;
+    m_streams[streamId].m_started = false;
+    return streamId;
+}
+
+template <class ElemType>
+typename CNTKEval<ElemType>::EvalStream& CNTKEval<ElemType>::GetStream(size_t streamId)
+{
+    auto iter = m_streams.find(streamId);
+    if (iter == m_streams.end())
+        InvalidArgument("Unknown stream id %d.", (int) streamId);
+    return iter->second;
+}
+
+// the nodes that carry state across minibatches (PastValue etc.)
+template <class ElemType>
+std::map<std::wstring, shared_ptr<IStatefulNode>> CNTKEval<ElemType>::GetStatefulNodes() const
+{
+    std::map<std::wstring, shared_ptr<IStatefulNode>> statefulNodes;
+    for (const auto& node : m_net->GetAllNodes())
+    {
+        auto statefulNode = dynamic_pointer_cast<IStatefulNode>(node);
+        if (statefulNode)
+            statefulNodes[node->NodeName()] = statefulNode;
+    }
+    return statefulNodes;
+}
+
+// EvaluateStream - evaluate the next chunk of a stream
+// The network only holds the state of the stream evaluated last, so we swap the stream's state in before and out after the chunk.
+// Note: Chunks of different streams are evaluated one after the other, not packed into one minibatch.
+template <class ElemType>
+void CNTKEval<ElemType>::EvaluateStream(size_t streamId, std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (m_net == nullptr)
+        RuntimeError("EvaluateStream: No model loaded.");
+    if (m_batcher)
+        RuntimeError("EvaluateStream: Streaming evaluation cannot be combined with batching (maxBatchSize).");
+    auto& stream = GetStream(streamId);
+    auto statefulNodes = GetStatefulNodes();
+
+    if (!stream.m_started)
+        ResetState(); // the reader flags a sequence start at the first frame
+    else
+    {
+        for (const auto& nodeState : stream.m_nodeStates)
+        {
+            auto iter = statefulNodes.find(nodeState.first);
+            if (iter == statefulNodes.end())
+                RuntimeError("EvaluateStream: The stream state refers to node %ls, which is not a stateful node of this model.", nodeState.first.c_str());
+            if (nodeState.second)
+                iter->second->ImportState(nodeState.second);
+        }
+    }
+
+    EvaluateImmediately(inputs, outputs);
+
+    stream.m_nodeStates.clear();
+    for (const auto& node : statefulNodes)
+        stream.m_nodeStates[node.first] = node.second->ExportState();
+    stream.m_started = true;
+}
+
+// DestroyStream - release the state of a stream
+template <class ElemType>
+void CNTKEval<ElemType>::DestroyStream(size_t streamId)
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    GetStream(streamId);
+    m_streams.erase(streamId);
+}
+
+// helpers to (de-)serialize stream states
+static const uint32_t s_streamStateVersion = 1;
+
+template <class T>
+static void AppendToBuffer(std::vector<char>& buffer, const T& value)
+{
+    const char* p = (const char*) &value;
+    buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+static void AppendToBuffer(std::vector<char>& buffer, const void* data, size_t size)
+{
+    const char* p = (const char*) data;
+    buffer.insert(buffer.end(), p, p + size);
+}
+
+static void ReadFromBuffer(const std::vector<char>& buffer, size_t& offset, void* data, size_t size)
+{
+    if (offset + size > buffer.size())
+        RuntimeError("LoadStreamState: The stream state is truncated.");
+    memcpy(data, buffer.data() + offset, size);
+    offset += size;
+}
+
+template <class T>
+static T ReadFromBuffer(const std::vector<char>& buffer, size_t& offset)
+{
+    T value;
+    ReadFromBuffer(buffer, offset, &value, sizeof(T));
+    return value;
+}
+
+// SaveStreamState - serialize the recurrent state of a stream
+// Format: version, started flag, number of nodes, and per node its name, the delayed MBLayout, and the cached activations.
+// Only the state of PastValue/FutureValue nodes can be serialized.
+template <class ElemType>
+void CNTKEval<ElemType>::SaveStreamState(size_t streamId, std::vector<char>& buffer)
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    const auto& stream = GetStream(streamId);
+
+    buffer.clear();
+    AppendToBuffer(buffer, s_streamStateVersion);
+    AppendToBuffer(buffer, (uint8_t) stream.m_started);
+    AppendToBuffer(buffer, (uint64_t) stream.m_nodeStates.size());
+    for (const auto& nodeState : stream.m_nodeStates)
+    {
+        std::string name = msra::strfun::utf8(nodeState.first);
+        AppendToBuffer(buffer, (uint64_t) name.size());
+        AppendToBuffer(buffer, name.data(), name.size());
+
+        auto state = dynamic_pointer_cast<DelayedValueNodeState<ElemType>>(nodeState.second);
+        if (nodeState.second && !state)
+            RuntimeError("SaveStreamState: The state of node %ls cannot be serialized.", nodeState.first.c_str());
+        AppendToBuffer(buffer, (uint8_t) (state != nullptr));
+        if (!state)
+            continue;
+
+        auto layout = make_shared<MBLayout>();
+        state->ExportDelayedMBLayout(layout);
+        AppendToBuffer(buffer, (uint64_t) layout->GetNumParallelSequences());
+        AppendToBuffer(buffer, (uint64_t) layout->GetNumTimeSteps());
+        const auto& sequences = layout->GetAllSequences();
+        AppendToBuffer(buffer, (uint64_t) sequences.size());
+        for (const auto& sequence : sequences)
+            AppendToBuffer(buffer, sequence);
+
+        AppendToBuffer(buffer, (uint8_t) state->IsEmpty());
+        if (state->IsEmpty())
+            continue;
+        const auto& activity = state->ExportCachedActivity();
+        std::vector<ElemType> values(activity.GetNumElements());
+        ElemType* p = values.data();
+        size_t size = values.size();
+        activity.CopyToArray(p, size);
+        AppendToBuffer(buffer, (uint64_t) activity.GetNumRows());
+        AppendToBuffer(buffer, (uint64_t) activity.GetNumCols());
+        AppendToBuffer(buffer, values.data(), values.size() * sizeof(ElemType));
+    }
+}
+
+// LoadStreamState - create a stream that continues from a serialized state
+template <class ElemType>
+size_t CNTKEval<ElemType>::LoadStreamState(const std::vector<char>& buffer)
+{
+    if (m_net == nullptr)
+        RuntimeError("LoadStreamState: No model loaded.");
+
+    size_t offset = 0;
+    if (ReadFromBuffer<uint32_t>(buffer, offset) != s_streamStateVersion)
+        RuntimeError("LoadStreamState: Unsupported stream state version.");
+
+    EvalStream stream;
+    stream.m_started = ReadFromBuffer<uint8_t>(buffer, offset) != 0;
+    size_t numNodes = (size_t) ReadFromBuffer<uint64_t>(buffer, offset);
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        std::string name((size_t) ReadFromBuffer<uint64_t>(buffer, offset), '\0');
+        ReadFromBuffer(buffer, offset, &name[0], name.size());
+        auto& nodeState = stream.m_nodeStates[msra::strfun::utf16(name)];
+        if (!ReadFromBuffer<uint8_t>(buffer, offset))
+            continue;
+
+        auto state = make_shared<DelayedValueNodeState<ElemType>>(m_net->GetDeviceId());
+        auto layout = make_shared<MBLayout>();
+        size_t numParallelSequences = (size_t) ReadFromBuffer<uint64_t>(buffer, offset);
+        size_t numTimeSteps = (size_t) ReadFromBuffer<uint64_t>(buffer, offset);
+        layout->Init(numParallelSequences, numTimeSteps);
+        size_t numSequences = (size_t) ReadFromBuffer<uint64_t>(buffer, offset);
+        for (size_t k = 0; k < numSequences; k++)
+            layout->AddSequence(ReadFromBuffer<MBLayout::SequenceInfo>(buffer, offset));
+        state->CacheDelayedMBLayout(layout);
+
+        if (!ReadFromBuffer<uint8_t>(buffer, offset)) // not empty
+        {
+            size_t rows = (size_t) ReadFromBuffer<uint64_t>(buffer, offset);
+            size_t cols = (size_t) ReadFromBuffer<uint64_t>(buffer, offset);
+            std::vector<ElemType> values(rows * cols);
+            ReadFromBuffer(buffer, offset, values.data(), values.size() * sizeof(ElemType));
+            state->CacheState(Matrix<ElemType>(rows, cols, values.data(), m_net->GetDeviceId()));
+        }
+        nodeState = state;
+    }
+    if (offset != buffer.size())
+        RuntimeError("LoadStreamState: Unexpected data after the stream state.");
+
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    size_t streamId = m_nextStreamId++;
+    m_streams[streamId] = std::move(stream);
+    return streamId;
+}
+
+// -----------------------------------------------------------------------
+// beam search
+// -----------------------------------------------------------------------
+
+// BeamSearch - decode a recurrent model step by step, feeding back its output tokens (see BeamSearchDecoder.h)
+// The decoder changes the recurrent state of the network, so a stream continued after it starts from its saved state anyway.
+template <class ElemType>
+void CNTKEval<ElemType>::BeamSearch(const std::wstring& inputNodeName, const std::wstring& outputNodeName, const std::vector<std::vector<size_t>>& prompts,
+                                    std::vector<std::vector<std::pair<std::vector<size_t>, double>>>& results)
+{
+    std::lock_guard<std::mutex> lock(m_streamMutex); // (uses the network like a stream)
+    if (m_net == nullptr)
+        RuntimeError("BeamSearch: No model loaded.");
+    if (m_batcher)
+        RuntimeError("BeamSearch: Beam search cannot be combined with batching (maxBatchSize).");
+
+    CPUThreading::ConcurrencySlot slot;
+    CPUThreading::Scope threading(m_cpuThreading);
+    auto hostLock = LockHost(); // (also while the decoder allocates its matrices)
+
+    if (!m_decoder || m_decoderInputNodeName != inputNodeName || m_decoderOutputNodeName != outputNodeName)
+    {
+        m_decoder.reset(new BeamSearchDecoder<ElemType>(m_net, inputNodeName, outputNodeName,
+                                                        m_config(L"beamSize", (size_t) 5), m_config(L"maxLength", (size_t) 100),
+                                                        m_config(L"startToken", (size_t) 0), m_config(L"endToken", (size_t) 1), m_config(L"normalize", true)));
+        m_decoderInputNodeName = inputNodeName;
+        m_decoderOutputNodeName = outputNodeName;
+    }
+
+    m_boundPrepared = false; // (the decoder allocates the matrices for its own output)
+    results.clear();
+    for (const auto& hypotheses : m_decoder->Decode(prompts))
+    {
+        results.push_back(std::vector<std::pair<std::vector<size_t>, double>>());
+        for (const auto& hypothesis : hypotheses)
+            results.back().push_back(make_pair(hypothesis.m_tokens, hypothesis.m_score));
+    }
+}
+
+// -----------------------------------------------------------------------
+// evaluation from and into raw buffers
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+typename CNTKEval<ElemType>::ComputationNodePtr CNTKEval<ElemType>::GetNodeToBind(const std::wstring& nodeName, const char* function) const
+{
+    if (m_net == nullptr)
+        RuntimeError("%s: No model loaded.", function);
+    auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(m_net->GetNodeFromName(nodeName));
+    if (!node)
+        InvalidArgument("%s: Node '%ls' has the wrong element type.", function, nodeName.c_str());
+    return node;
+}
+
+// BindInput - resolve an input node for Evaluate() with raw buffers; returns its handle
+template <class ElemType>
+size_t CNTKEval<ElemType>::BindInput(const std::wstring& nodeName)
+{
+    auto node = GetNodeToBind(nodeName, "BindInput");
+    if (!node->IsLeaf() || !node->HasMBLayout())
+        InvalidArgument("BindInput: Node '%ls' is not an input node.", nodeName.c_str());
+    auto iter = find(m_boundInputs.begin(), m_boundInputs.end(), node);
+    if (iter != m_boundInputs.end())
+        return iter - m_boundInputs.begin();
+    m_boundInputs.push_back(node);
+    m_boundInputNodes.push_back(node);
+    m_boundPrepared = false;
+    return m_boundInputs.size() - 1;
+}
+
+// BindOutput - resolve an output node for Evaluate() with raw buffers; returns its handle
+template <class ElemType>
+size_t CNTKEval<ElemType>::BindOutput(const std::wstring& nodeName)
+{
+    auto node = GetNodeToBind(nodeName, "BindOutput");
+    auto iter = find(m_boundOutputs.begin(), m_boundOutputs.end(), node);
+    if (iter != m_boundOutputs.end())
+        return iter - m_boundOutputs.begin();
+    m_boundOutputs.push_back(node);
+    m_boundOutputNodes.push_back(node);
+    m_boundPrepared = false;
+    return m_boundOutputs.size() - 1;
+}
+
+// allocate the matrices for the bound outputs and start their minibatch loop, unless done since the last binding or Evaluate() with maps
+template <class ElemType>
+void CNTKEval<ElemType>::PrepareBoundEvaluation()
+{
+    if (m_boundPrepared)
+        return;
+    if (m_boundOutputs.empty())
+        RuntimeError("Evaluate: No output node is bound, call BindOutput() first.");
+
+    // every minibatch input the outputs depend on must be fed
+    for (const auto& output : m_boundOutputNodes)
+    {
+        for (const auto& node : m_net->InputNodes(output))
+        {
+            if (node->HasMBLayout() && find(m_boundInputNodes.begin(), m_boundInputNodes.end(), node) == m_boundInputNodes.end())
+                RuntimeError("Evaluate: Output node '%ls' depends on input node '%ls', which is not bound.", output->NodeName().c_str(), node->NodeName().c_str());
+        }
+    }
+
+    m_net->AllocateAllMatrices({}, m_boundOutputNodes, nullptr);
+    m_net->StartEvaluateMinibatchLoop(m_boundOutputNodes);
+    m_boundMinibatchSize = max(m_config(L"minibatchSize", (size_t) 10240), (size_t) 1);
+    m_boundPrepared = true;
+}
+
+// Evaluate - evaluate the bound outputs for 'numSamples' samples of the bound inputs, from and into caller buffers
+// The samples form one sequence, which continues the one of the previous call unless ResetState() was called in between (like
+// the sequence EvalReader makes of the maps). The inputs go into the input matrices with one copy (on a GPU, from page-locked buffers
+// directly), and the outputs are copied from the output matrices straight into the caller's buffers.
+template <class ElemType>
+void CNTKEval<ElemType>::Evaluate(const ElemType* const* inputs, size_t numSamples, ElemType* const* outputs)
+{
+    if (m_net == nullptr)
+        RuntimeError("Evaluate: No model loaded.");
+    if (m_batcher)
+        RuntimeError("Evaluate: Evaluation of bound nodes cannot be combined with batching (maxBatchSize).");
+
+    CPUThreading::ConcurrencySlot slot;
+    CPUThreading::Scope threading(m_cpuThreading);
+    auto hostLock = LockHost();
+    PrepareBoundEvaluation();
+
+    bool newSequence = !m_boundStarted || m_boundStart != m_start;
+    auto pMBLayout = m_net->GetMBLayoutPtr();
+    for (size_t begin = 0; begin < numSamples; begin += m_boundMinibatchSize)
+    {
+        const size_t numCols = min(m_boundMinibatchSize, numSamples - begin);
+        pMBLayout->Init(1, numCols);
+        pMBLayout->AddSequence(0, 0, newSequence ? 0 : -1, numCols + 1); // (the sequence may go on, see EvalReader::CopyMBLayoutTo())
+        newSequence = false;
+
+        for (size_t i = 0; i < m_boundInputs.size(); i++)
+        {
+            auto& node = m_boundInputs[i];
+            const size_t rows = node->GetSampleMatrixNumRows();
+            node->Value().SetValue(rows, numCols, node->Value().GetDeviceId(), const_cast<ElemType*>(inputs[i]) + begin * rows, matrixFlagNormal);
+            node->NotifyFunctionValuesMBSizeModified();
+        }
+        ComputationNetwork::BumpEvalTimeStamp(m_boundInputNodes);
+
+        m_net->ForwardProp(m_boundOutputNodes);
+
+        for (size_t i = 0; i < m_boundOutputs.size(); i++)
+        {
+            const auto& value = m_boundOutputs[i]->Value();
+            if (value.GetNumCols() != numCols)
+                RuntimeError("Evaluate: Output node '%ls' has %d columns for %d samples; only outputs with one column per sample can be written into a buffer.",
+                             m_boundOutputs[i]->NodeName().c_str(), (int) value.GetNumCols(), (int) numCols);
+            const size_t rows = value.GetNumRows();
+            value.CopySection(rows, numCols, outputs[i] + begin * rows, rows);
+        }
+    }
+    m_boundStarted = true;
+    m_boundStart = m_start;
+}
+
+template <class ElemType>
+void CNTKEval<ElemType>::Evaluate(const ElemType* input, size_t numSamples, ElemType* output)
+{
+    if (m_boundInputs.size() != 1 || m_boundOutputs.size() != 1)
+        RuntimeError("Evaluate: This form of Evaluate() requires exactly one bound input and one bound output, but %d and %d are bound.",
+                     (int) m_boundInputs.size(), (int) m_boundOutputs.size());
+    Evaluate(&input, numSamples, &output);
+}
+
+// AllocateBuffer - allocate a buffer for Evaluate() with raw buffers
+// On a GPU it comes page-locked from the pool of CUDAPageLockedMemAllocator, so that the copies to and from the device need no staging.
+// Page-locked buffers still held are released with the evaluator.
+template <class ElemType>
+ElemType* CNTKEval<ElemType>::AllocateBuffer(size_t numElements)
+{
+    if (m_net != nullptr && m_net->GetDeviceId() != CPUDEVICE)
+    {
+        ElemType* buffer = (ElemType*) CUDAPageLockedMemAllocator::MallocFromPool(numElements * sizeof(ElemType), m_net->GetDeviceId());
+        if (buffer != nullptr) // (nullptr in a CPUONLY build)
+        {
+            m_pageLockedBuffers.insert(buffer);
+            return buffer;
+        }
+    }
+    return new ElemType[numElements];
+}
+
+// FreeBuffer - release a buffer from AllocateBuffer()
+template <class ElemType>
+void CNTKEval<ElemType>::FreeBuffer(ElemType* buffer)
+{
+    if (m_pageLockedBuffers.erase(buffer) > 0)
+        CUDAPageLockedMemAllocator::FreeToPool(buffer);
+    else
+        delete[] buffer;
+}
+
+// -----------------------------------------------------------------------
+// warmup
+// -----------------------------------------------------------------------
+
+// Warmup - evaluate zero inputs once for each expected number of samples per call, before the first real request
+// The first evaluations after loading pay for the creation of the cuBLAS/cuDNN handles, for the growth of the matrices to the
+// minibatch size (the largest size goes first, so that the smaller ones fit into what it allocated), and for the autotuning of
+// the convolution algorithms, which is done per input size. The outputs that are bound are evaluated, if any, as their
+// evaluation allocates matrices of its own; else all outputs, bypassing the batcher. Afterwards a new sequence is started.
+// The models of a cascade are warmed up with all sizes, as any part of a request may go on to them.
+template <class ElemType>
+void CNTKEval<ElemType>::Warmup(const std::vector<size_t>& numSamples)
+{
+    if (m_net == nullptr)
+        RuntimeError("Warmup: No model loaded.");
+    vector<size_t> sizes(numSamples);
+    sort(sizes.begin(), sizes.end(), greater<size_t>());
+    sizes.erase(unique(sizes.begin(), sizes.end()), sizes.end());
+    if (!sizes.empty() && sizes.back() == 0)
+        InvalidArgument("Warmup: The numbers of samples must be positive.");
+
+    Timer timer;
+    timer.Start();
+    for (size_t n : sizes)
+    {
+        ResetState();
+        if (!m_boundOutputs.empty())
+        {
+            vector<vector<ElemType>> inputs, outputs;
+            vector<const ElemType*> inputPointers;
+            vector<ElemType*> outputPointers;
+            for (const auto& node : m_boundInputs)
+                inputs.push_back(vector<ElemType>(node->GetSampleMatrixNumRows() * n, 0));
+            for (const auto& node : m_boundOutputs)
+                outputs.push_back(vector<ElemType>(node->GetSampleMatrixNumRows() * n));
+            for (auto& input : inputs)
+                inputPointers.push_back(input.data());
+            for (auto& output : outputs)
+                outputPointers.push_back(output.data());
+            Evaluate(inputPointers.data(), n, outputPointers.data());
+        }
+        else
+        {
+            std::map<std::wstring, size_t> inputDimensions, outputDimensions;
+            GetNodeDimensions(inputDimensions, nodeInput);
+            GetNodeDimensions(outputDimensions, nodeOutput);
+            std::map<std::wstring, std::vector<ElemType>> inputValues, outputValues;
+            std::map<std::wstring, std::vector<ElemType>*> inputs, outputs;
+            for (const auto& input : inputDimensions)
+            {
+                inputValues[input.first].assign(input.second * n, 0);
+                inputs[input.first] = &inputValues[input.first];
+            }
+            for (const auto& output : outputDimensions)
+                outputs[output.first] = &outputValues[output.first];
+            EvaluateImmediately(inputs, outputs);
+        }
+    }
+    for (auto stage : m_cascadeStages)
+        stage->Warmup(sizes);
+    ResetState();
+    timer.Stop();
+    fprintf(stderr, "Warmup: Evaluated %d sizes (up to %d samples) in %.1f ms.\n",
+            (int) sizes.size(), sizes.empty() ? 0 : (int) sizes.front(), timer.ElapsedSeconds() * 1000);
+}
+
 // instantiate all the combinations we expect to be used
 template class CNTKEval<double>;
 template class CNTKEval<float>;
@@ -9,12 +9,20 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <set>
 
 #include "Eval.h"
 #include "EvalReader.h"
 #include "EvalWriter.h"
+#include "EvalBatcher.h"
+#include "EvalCascade.h"
+#include "EvalHost.h"
+#include "BeamSearchDecoder.h"
 
 #include "ComputationNetwork.h"
+#include "CPUThreading.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -28,11 +36,65 @@ class CNTKEval : public IEvaluateModel<ElemType>
     ComputationNetworkPtr m_net;
     std::map<std::wstring, size_t> m_dimensions;
     size_t m_start;
+    std::unique_ptr<EvalBatcher<ElemType>> m_batcher; // if set, concurrent Evaluate() calls are merged into larger minibatches
+    CPUThreading::Options m_cpuThreading;             // intra-op threads and CPU affinity of this evaluator's evaluations
+    std::shared_ptr<EvalHost> m_host;                 // if set, the model shares parameters and workspace with the other models of the host
+
+    // early-exit evaluation: samples that this model is not confident about go on to the models of the stages (see EvalCascade.h)
+    std::unique_ptr<EvalCascade<ElemType>> m_cascade;
+    std::vector<CNTKEval<ElemType>*> m_cascadeStages; // owned; the models after this one, cheapest first
+    bool m_isCascadeStage;                            // this evaluator is a stage of another one's cascade
+
+    // held while the network is evaluated, if the model shares its workspace with other models
+    std::unique_lock<std::mutex> LockHost()
+    {
+        return m_host ? m_host->LockForEvaluation() : std::unique_lock<std::mutex>();
+    }
+
+    void CreateBatcherIfRequested();
+    void CreateCascadeIfRequested(const CNTKEval<ElemType>* cloneOf = nullptr);
+    void DestroyCascadeStages();
+    void EvaluateUnbatched(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
+    void EvaluateImmediately(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
+
+    // streaming evaluation: the recurrent state each stream left behind, to be imported into the network before its next chunk
+    struct EvalStream
+    {
+        bool m_started; // false until the first chunk has been evaluated, which then starts a new sequence
+        std::map<std::wstring, NodeStatePtr> m_nodeStates; // [stateful node name] -> exported state
+    };
+    std::map<size_t, EvalStream> m_streams;
+    size_t m_nextStreamId;
+    std::mutex m_streamMutex; // streams share the network, so their chunks are evaluated one at a time
+
+    // beam search, kept for the node names it was created for
+    std::unique_ptr<BeamSearchDecoder<ElemType>> m_decoder;
+    std::wstring m_decoderInputNodeName;
+    std::wstring m_decoderOutputNodeName;
+
+    // evaluation from and into raw buffers, through the nodes bound to the handles (indices into these)
+    std::vector<ComputationNodePtr> m_boundInputs;
+    std::vector<ComputationNodePtr> m_boundOutputs;
+    std::vector<ComputationNodeBasePtr> m_boundInputNodes; // (the same, as needed by ComputationNetwork)
+    std::vector<ComputationNodeBasePtr> m_boundOutputNodes;
+    bool m_boundPrepared;   // matrices allocated and minibatch loop started for the bound outputs
+    bool m_boundStarted;    // a bound evaluation has run, so the next one continues its sequence unless ResetState() was called
+    size_t m_boundStart;    // m_start as of the last bound evaluation
+    size_t m_boundMinibatchSize;
+    std::set<ElemType*> m_pageLockedBuffers; // from AllocateBuffer(); others were allocated with new[]
+
+    ComputationNodePtr GetNodeToBind(const std::wstring& nodeName, const char* function) const;
+    void PrepareBoundEvaluation();
+
+    EvalStream& GetStream(size_t streamId);
+    std::map<std::wstring, shared_ptr<IStatefulNode>> GetStatefulNodes() const;
 
 public:
     // constructor
     CNTKEval()
-        : m_reader(nullptr), m_net(nullptr)
+        : m_reader(nullptr), m_writer(nullptr), m_net(nullptr), m_start(0), m_nextStreamId(0),
+          m_boundPrepared(false), m_boundStarted(false), m_boundStart(0), m_boundMinibatchSize(0),
+          m_isCascadeStage(false)
     {
     }
 
@@ -57,5 +119,30 @@ public:
     virtual void Init(const std::string& config);
     virtual void Destroy();
     virtual void ResetState();
+
+    // CloneEvaluator - create an evaluator for the same model that shares its parameters and can be used concurrently
+    virtual IEvaluateModel<ElemType>* CloneEvaluator();
+
+    // streaming evaluation with per-stream recurrent state
+    virtual size_t CreateStream();
+    virtual void EvaluateStream(size_t streamId, std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
+    virtual void DestroyStream(size_t streamId);
+    virtual void SaveStreamState(size_t streamId, std::vector<char>& buffer);
+    virtual size_t LoadStreamState(const std::vector<char>& buffer);
+
+    // beam search decoding
+    virtual void BeamSearch(const std::wstring& inputNodeName, const std::wstring& outputNodeName, const std::vector<std::vector<size_t>>& prompts,
+                            std::vector<std::vector<std::pair<std::vector<size_t>, double>>>& results);
+
+    // evaluation from and into raw buffers through bound nodes
+    virtual size_t BindInput(const std::wstring& nodeName);
+    virtual size_t BindOutput(const std::wstring& nodeName);
+    virtual void Evaluate(const ElemType* const* inputs, size_t numSamples, ElemType* const* outputs);
+    virtual void Evaluate(const ElemType* input, size_t numSamples, ElemType* output);
+    virtual ElemType* AllocateBuffer(size_t numElements);
+    virtual void FreeBuffer(ElemType* buffer);
+
+    // warmup on dummy inputs of the expected sizes
+    virtual void Warmup(const std::vector<size_t>& numSamples);
 };
 } } }
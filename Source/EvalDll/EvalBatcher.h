@@ -0,0 +1,277 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBatcher.h -- collects concurrent Evaluate() calls into one minibatch
+//
+// Online traffic calls Evaluate() with one or a few samples at a time, which leaves the GEMMs tiny and the GPU launch-bound.
+// The batcher queues concurrent requests. The first caller that finds no batch in progress becomes the leader: it waits until
+// either maxBatchSize samples are queued or the oldest queued request has waited for maxLatencyMs, concatenates the inputs of
+// the queued requests column-wise, runs a single evaluation, and copies each request's columns of the outputs back.
+// Requests arriving meanwhile queue up for the next batch.
+// Since the samples of all requests end up in one sequence, this is only valid for networks without recurrence (checked by CNTKEval).
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <map>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class EvalBatcher
+{
+public:
+    typedef std::map<std::wstring, std::vector<ElemType>*> Buffers;
+    typedef std::function<void(Buffers& inputs, Buffers& outputs)> EvaluateFunction;
+
+    // evaluate - runs one (merged) evaluation; it is never called concurrently
+    // inputDimensions - [input node name] -> number of rows, to determine the number of samples of a request
+    EvalBatcher(const EvaluateFunction& evaluate, const std::map<std::wstring, size_t>& inputDimensions, size_t maxBatchSize, double maxLatencyMs)
+        : m_evaluate(evaluate),
+          m_inputDimensions(inputDimensions),
+          m_maxBatchSize(maxBatchSize),
+          m_maxLatency(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(maxLatencyMs))),
+          m_queuedSamples(0),
+          m_batchInProgress(false),
+          m_numRequests(0),
+          m_numBatches(0),
+          m_nextLatency(0)
+    {
+        if (m_maxBatchSize == 0)
+            InvalidArgument("EvalBatcher: maxBatchSize must be positive.");
+        m_latencies.reserve(s_numLatencies);
+    }
+
+    // evaluate one request; blocks until the batch it ended up in has been evaluated
+    void Evaluate(Buffers& inputs, Buffers& outputs)
+    {
+        Request request(inputs, outputs, NumSamples(inputs));
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue.push_back(&request);
+        m_queuedSamples += request.m_numSamples;
+        m_queueChanged.notify_all();
+
+        while (!request.m_done)
+        {
+            if (m_batchInProgress)
+            {
+                m_batchDone.wait(lock);
+                continue;
+            }
+
+            // no batch in progress: lead the next one
+            m_batchInProgress = true;
+            const auto deadline = m_queue.front()->m_arrival + m_maxLatency;
+            m_queueChanged.wait_until(lock, deadline, [this]() { return m_queuedSamples >= m_maxBatchSize; });
+            std::vector<Request*> batch = TakeBatch();
+
+            lock.unlock();
+            EvaluateBatch(batch);
+            lock.lock();
+
+            for (auto* r : batch)
+                r->m_done = true;
+            m_numBatches++;
+            m_batchInProgress = false;
+            m_batchDone.notify_all();
+        }
+
+        RecordLatency(request);
+        lock.unlock();
+
+        if (request.m_error)
+            std::rethrow_exception(request.m_error);
+    }
+
+    // latency in milliseconds (from the call to Evaluate() to its return) at percentile 'p' (0..100) over the most recent requests
+    double GetLatencyPercentile(double p) const
+    {
+        std::vector<double> latencies;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            latencies = m_latencies;
+        }
+        if (latencies.empty())
+            return 0;
+        size_t index = std::min(latencies.size() - 1, (size_t) (p / 100 * latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+        return latencies[index];
+    }
+
+    void PrintStatistics() const
+    {
+        size_t numRequests, numBatches;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            numRequests = m_numRequests;
+            numBatches = m_numBatches;
+        }
+        fprintf(stderr, "EvalBatcher: %d requests in %d batches (%.1f requests per batch); latency p50 = %.2f ms, p99 = %.2f ms\n",
+                (int) numRequests, (int) numBatches, numBatches == 0 ? 0.0 : (double) numRequests / numBatches,
+                GetLatencyPercentile(50), GetLatencyPercentile(99));
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    static const size_t s_numLatencies = 10000; // size of the window the percentiles are computed over
+
+    struct Request
+    {
+        Buffers* m_inputs;
+        Buffers* m_outputs;
+        size_t m_numSamples;
+        Clock::time_point m_arrival;
+        bool m_done;
+        std::exception_ptr m_error;
+
+        Request(Buffers& inputs, Buffers& outputs, size_t numSamples)
+            : m_inputs(&inputs), m_outputs(&outputs), m_numSamples(numSamples), m_arrival(Clock::now()), m_done(false)
+        {
+        }
+    };
+
+    size_t NumSamples(const Buffers& inputs) const
+    {
+        if (inputs.empty())
+            return 0;
+        const auto& name = inputs.begin()->first;
+        auto iter = m_inputDimensions.find(name);
+        if (iter == m_inputDimensions.end() || iter->second == 0)
+            RuntimeError("Input %ls not found in CNTK model.", name.c_str());
+        return inputs.begin()->second->size() / iter->second;
+    }
+
+    // requests can only share a batch if they feed and read the same nodes
+    static bool SameNodes(const Buffers& a, const Buffers& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (auto iterA = a.begin(), iterB = b.begin(); iterA != a.end(); iterA++, iterB++)
+        {
+            if (iterA->first != iterB->first)
+                return false;
+        }
+        return true;
+    }
+
+    // remove the requests of the next batch from the queue (called with the lock held)
+    // The oldest request is always taken; others are added in order as long as they fit and are compatible with it.
+    std::vector<Request*> TakeBatch()
+    {
+        std::vector<Request*> batch;
+        size_t numSamples = 0;
+        for (auto iter = m_queue.begin(); iter != m_queue.end();)
+        {
+            Request* r = *iter;
+            bool fits = batch.empty() ||
+                        (numSamples + r->m_numSamples <= m_maxBatchSize && SameNodes(*r->m_inputs, *batch[0]->m_inputs) && SameNodes(*r->m_outputs, *batch[0]->m_outputs));
+            if (fits)
+            {
+                batch.push_back(r);
+                numSamples += r->m_numSamples;
+                m_queuedSamples -= r->m_numSamples;
+                iter = m_queue.erase(iter);
+            }
+            else
+                iter++;
+        }
+        return batch;
+    }
+
+    // evaluate the merged requests and scatter the outputs back (called without the lock)
+    void EvaluateBatch(const std::vector<Request*>& batch)
+    {
+        try
+        {
+            if (batch.size() == 1)
+            {
+                m_evaluate(*batch[0]->m_inputs, *batch[0]->m_outputs);
+                return;
+            }
+
+            // concatenate the inputs
+            std::map<std::wstring, std::vector<ElemType>> inputData, outputData;
+            Buffers inputs, outputs;
+            size_t numSamples = 0;
+            for (const auto* r : batch)
+            {
+                for (const auto& input : *r->m_inputs)
+                    inputData[input.first].insert(inputData[input.first].end(), input.second->begin(), input.second->end());
+                numSamples += r->m_numSamples;
+            }
+            for (auto& input : inputData)
+                inputs[input.first] = &input.second;
+            for (const auto& output : *batch[0]->m_outputs)
+            {
+                outputData[output.first].resize(output.second->size() / std::max(batch[0]->m_numSamples, (size_t) 1) * numSamples);
+                outputs[output.first] = &outputData[output.first];
+            }
+
+            m_evaluate(inputs, outputs);
+
+            // hand each request its columns of the outputs
+            for (const auto& output : outputData)
+            {
+                const auto& values = output.second;
+                if (numSamples == 0 || values.size() % numSamples != 0)
+                    LogicError("EvalBatcher: Output %ls has %d values, which is not a multiple of the %d samples of the batch.", output.first.c_str(), (int) values.size(), (int) numSamples);
+                const size_t rows = values.size() / numSamples;
+                size_t firstSample = 0;
+                for (auto* r : batch)
+                {
+                    auto begin = values.begin() + firstSample * rows;
+                    r->m_outputs->at(output.first)->assign(begin, begin + r->m_numSamples * rows);
+                    firstSample += r->m_numSamples;
+                }
+            }
+        }
+        catch (...)
+        {
+            for (auto* r : batch)
+                r->m_error = std::current_exception();
+        }
+    }
+
+    // called with the lock held
+    void RecordLatency(const Request& request)
+    {
+        double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - request.m_arrival).count();
+        if (m_latencies.size() < s_numLatencies)
+            m_latencies.push_back(latencyMs);
+        else
+            m_latencies[m_nextLatency] = latencyMs;
+        m_nextLatency = (m_nextLatency + 1) % s_numLatencies;
+        m_numRequests++;
+    }
+
+    EvaluateFunction m_evaluate;
+    std::map<std::wstring, size_t> m_inputDimensions;
+    size_t m_maxBatchSize;  // in samples
+    Clock::duration m_maxLatency; // how long the oldest request may wait for others to join
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueChanged; // a request was added
+    std::condition_variable m_batchDone;    // the batch in progress has been evaluated
+    std::deque<Request*> m_queue;           // requests waiting for a batch, oldest first
+    size_t m_queuedSamples;
+    bool m_batchInProgress;
+
+    // statistics
+    size_t m_numRequests;
+    size_t m_numBatches;
+    std::vector<double> m_latencies; // ring buffer of the latest s_numLatencies latencies in ms
+    size_t m_nextLatency;
+};
+} } }
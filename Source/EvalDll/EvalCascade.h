@@ -0,0 +1,202 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalCascade.h -- early-exit evaluation through a chain of models of increasing cost
+//
+// Most production inputs are easy: a small model is already confident about them. A cascade evaluates all samples with the
+// first model, and passes on to the next model only the samples whose output fails a confidence gate. Those are compacted
+// column-wise into a smaller minibatch, and the next model's outputs are scattered back into their columns, overwriting the
+// earlier ones. The outputs of a sample are those of the first model whose gate it passes, or of the last model.
+// A gate looks at one output node (posteriors, or their logits if 'normalize' is set): with maxPosterior, a sample passes if
+// its largest posterior is at least the threshold; with entropy, if the entropy of its posteriors (in nats) is at most the
+// threshold.
+// All models must have the same input and output nodes. Each sample is treated on its own, so, as with EvalBatcher, this is
+// only valid for networks without recurrence (checked by CNTKEval).
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <map>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class EvalCascade
+{
+public:
+    typedef std::map<std::wstring, std::vector<ElemType>*> Buffers;
+    typedef std::function<void(Buffers& inputs, Buffers& outputs)> EvaluateFunction;
+
+    enum GateKind
+    {
+        maxPosterior,
+        entropy
+    };
+
+    struct Gate
+    {
+        std::wstring m_nodeName; // output node whose values are judged
+        GateKind m_kind;
+        double m_threshold;
+        bool m_normalize; // apply a softmax to the values first
+    };
+
+    // stages - the evaluations of the models, cheapest first
+    // gates - [k] decides which samples go on from stage k to stage k + 1 (one fewer than stages)
+    // inputDimensions, outputDimensions - [node name] -> number of rows, the same for all stages
+    EvalCascade(const std::vector<EvaluateFunction>& stages, const std::vector<Gate>& gates,
+                const std::map<std::wstring, size_t>& inputDimensions, const std::map<std::wstring, size_t>& outputDimensions)
+        : m_stages(stages), m_gates(gates), m_inputDimensions(inputDimensions), m_outputDimensions(outputDimensions),
+          m_samplesPerStage(stages.size(), 0)
+    {
+        if (m_stages.size() < 2)
+            InvalidArgument("EvalCascade: A cascade needs at least two models.");
+        if (m_gates.size() != m_stages.size() - 1)
+            InvalidArgument("EvalCascade: %d models need %d gates, not %d.", (int) m_stages.size(), (int) m_stages.size() - 1, (int) m_gates.size());
+        for (const auto& gate : m_gates)
+        {
+            if (m_outputDimensions.find(gate.m_nodeName) == m_outputDimensions.end())
+                InvalidArgument("EvalCascade: The gate node '%ls' is not an output node.", gate.m_nodeName.c_str());
+        }
+    }
+
+    // evaluate the samples of 'inputs' (column by column) into 'outputs', each with the first model that is confident about it
+    void Evaluate(Buffers& inputs, Buffers& outputs)
+    {
+        const size_t numSamples = NumSamples(inputs);
+        std::vector<size_t> columns(numSamples); // [sample of the current stage] -> its column in the caller's buffers
+        for (size_t i = 0; i < numSamples; i++)
+            columns[i] = i;
+
+        Buffers stageInputs = inputs;
+        std::map<std::wstring, std::vector<ElemType>> compactedInputs, stageOutputValues;
+        for (size_t k = 0; k < m_stages.size(); k++)
+        {
+            // the first stage writes into the caller's outputs; the later ones into buffers of their own, scattered back below
+            Buffers stageOutputs;
+            for (const auto& output : outputs)
+                stageOutputs[output.first] = (k == 0) ? output.second : &stageOutputValues[output.first];
+            if (k < m_gates.size() && stageOutputs.find(m_gates[k].m_nodeName) == stageOutputs.end())
+                stageOutputs[m_gates[k].m_nodeName] = &stageOutputValues[m_gates[k].m_nodeName];
+
+            m_stages[k](stageInputs, stageOutputs);
+            m_samplesPerStage[k] += columns.size();
+
+            if (k > 0)
+            {
+                for (const auto& output : outputs)
+                {
+                    const size_t rows = m_outputDimensions.at(output.first);
+                    const auto& values = *stageOutputs[output.first];
+                    if (values.size() != rows * columns.size() || output.second->size() != rows * numSamples)
+                        RuntimeError("EvalCascade: Output node '%ls' does not have one column per sample.", output.first.c_str());
+                    for (size_t i = 0; i < columns.size(); i++)
+                        std::copy(values.begin() + i * rows, values.begin() + (i + 1) * rows, output.second->begin() + columns[i] * rows);
+                }
+            }
+            if (k == m_gates.size())
+                break;
+
+            // the samples that fail the gate go on to the next stage
+            const auto& gate = m_gates[k];
+            const size_t gateRows = m_outputDimensions.at(gate.m_nodeName);
+            const auto& gateValues = *stageOutputs[gate.m_nodeName];
+            if (gateValues.size() != gateRows * columns.size())
+                RuntimeError("EvalCascade: The gate node '%ls' does not have one column per sample.", gate.m_nodeName.c_str());
+            std::vector<size_t> failed;
+            for (size_t i = 0; i < columns.size(); i++)
+            {
+                if (!Passes(gate, gateValues.data() + i * gateRows, gateRows))
+                    failed.push_back(i);
+            }
+            if (failed.empty())
+                break;
+
+            std::map<std::wstring, std::vector<ElemType>> nextInputs;
+            for (const auto& input : stageInputs)
+            {
+                const size_t rows = m_inputDimensions.at(input.first);
+                auto& compacted = nextInputs[input.first];
+                compacted.resize(rows * failed.size());
+                for (size_t j = 0; j < failed.size(); j++)
+                    std::copy(input.second->begin() + failed[j] * rows, input.second->begin() + (failed[j] + 1) * rows, compacted.begin() + j * rows);
+            }
+            compactedInputs.swap(nextInputs); // (the previous compacted inputs are no longer needed)
+            stageInputs.clear();
+            for (auto& input : compactedInputs)
+                stageInputs[input.first] = &input.second;
+            std::vector<size_t> nextColumns(failed.size());
+            for (size_t j = 0; j < failed.size(); j++)
+                nextColumns[j] = columns[failed[j]];
+            columns.swap(nextColumns);
+        }
+    }
+
+    void PrintStatistics() const
+    {
+        if (m_samplesPerStage[0] == 0)
+            return;
+        fprintf(stderr, "EvalCascade: %d samples;", (int) m_samplesPerStage[0]);
+        for (size_t k = 1; k < m_samplesPerStage.size(); k++)
+            fprintf(stderr, " %.1f%% went on to model %d;", 100.0 * m_samplesPerStage[k] / m_samplesPerStage[0], (int) k + 1);
+        fprintf(stderr, "\n");
+    }
+
+private:
+    size_t NumSamples(const Buffers& inputs) const
+    {
+        size_t numSamples = 0;
+        for (const auto& input : inputs)
+        {
+            auto dimension = m_inputDimensions.find(input.first);
+            if (dimension == m_inputDimensions.end())
+                InvalidArgument("EvalCascade: '%ls' is not an input node.", input.first.c_str());
+            if (dimension->second == 0 || input.second->size() % dimension->second != 0)
+                InvalidArgument("EvalCascade: The input of '%ls' is not a whole number of samples.", input.first.c_str());
+            const size_t n = input.second->size() / dimension->second;
+            if (input.first != inputs.begin()->first && n != numSamples)
+                InvalidArgument("EvalCascade: The inputs do not have the same number of samples.");
+            numSamples = n;
+        }
+        return numSamples;
+    }
+
+    static bool Passes(const Gate& gate, const ElemType* values, size_t rows)
+    {
+        if (rows == 0)
+            return true;
+        std::vector<double> posteriors(values, values + rows);
+        if (gate.m_normalize)
+        {
+            const double maxValue = *std::max_element(posteriors.begin(), posteriors.end());
+            double sum = 0;
+            for (auto& p : posteriors)
+                sum += (p = exp(p - maxValue));
+            for (auto& p : posteriors)
+                p /= sum;
+        }
+        if (gate.m_kind == maxPosterior)
+            return *std::max_element(posteriors.begin(), posteriors.end()) >= gate.m_threshold;
+        double entropy = 0;
+        for (auto p : posteriors)
+        {
+            if (p > 0)
+                entropy -= p * log(p);
+        }
+        return entropy <= gate.m_threshold;
+    }
+
+    std::vector<EvaluateFunction> m_stages;
+    std::vector<Gate> m_gates;
+    std::map<std::wstring, size_t> m_inputDimensions;
+    std::map<std::wstring, size_t> m_outputDimensions;
+    std::vector<size_t> m_samplesPerStage; // [stage] samples evaluated there, for the statistics
+};
+} } }
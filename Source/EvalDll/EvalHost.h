@@ -0,0 +1,177 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalHost.h -- lets the models of several evaluators in one process share device memory
+//
+// Each evaluator owns its network, with its own parameters and its own pool of node matrices. Model variants that share a
+// common trunk (e.g. per-locale acoustic models) hold the same parameters many times over, and each keeps a workspace for
+// activations that is idle whenever another model is evaluated. Evaluators that name the same host (config evalHost=<name>):
+//  - share the parameter matrices with identical contents: when a model is added, each LearnableParameter is hashed by
+//    dimensions and contents, and if a model added earlier holds an identical one (compared in full), the node takes that
+//    matrix instead of its own, which is then freed;
+//  - take their node matrices from one MatrixPool, so that the activations of all models live in one workspace that only
+//    grows to what the largest model needs. This is only valid as long as the models are never evaluated concurrently, so
+//    the host serializes their evaluations (LockForEvaluation()).
+// All models of a host must live on the same device. Device memory itself comes from the process-wide caching allocator of
+// the device (CUDACachingMemAllocator). A host lives as long as an evaluator uses it; shared parameters as long as a model does.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "ComputationNode.h"
+#include "InputAndParamNodes.h"
+#include "MatrixPool.h"
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class EvalHost
+{
+public:
+    // the host of the given name, created by the first evaluator that asks for it
+    static std::shared_ptr<EvalHost> Get(const std::wstring& name, DEVICEID_TYPE deviceId)
+    {
+        static std::mutex s_hostsMutex;
+        static std::map<std::wstring, std::weak_ptr<EvalHost>> s_hosts;
+
+        std::lock_guard<std::mutex> lock(s_hostsMutex);
+        auto host = s_hosts[name].lock();
+        if (!host)
+        {
+            host.reset(new EvalHost(name, deviceId));
+            s_hosts[name] = host;
+        }
+        else if (host->m_deviceId != deviceId)
+            InvalidArgument("EvalHost: The models of host '%ls' live on device %d, a model cannot be added on device %d.", name.c_str(), (int) host->m_deviceId, (int) deviceId);
+        return host;
+    }
+
+    // let a freshly loaded network share parameters and workspace with the other models of this host
+    template <class ElemType>
+    void AddModel(const ComputationNetworkPtr& net)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex); // (no model of the host is evaluated meanwhile)
+
+        size_t numParameters = 0, numShared = 0, sharedBytes = 0;
+        std::vector<ElemType> values, candidateValues;
+        auto& parameters = Parameters<ElemType>();
+        for (const auto& nodeBase : net->GetAllNodes())
+        {
+            auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodeBase);
+            if (!node || node->OperationName() != OperationNameOf(LearnableParameter))
+                continue;
+            numParameters++;
+
+            const Matrix<ElemType>& value = node->Value();
+            CopyToHost(value, values);
+            auto& candidates = parameters[Hash(value.GetNumRows(), value.GetNumCols(), values)];
+            bool shared = false;
+            for (size_t i = 0; i < candidates.size() && !shared;)
+            {
+                auto candidate = candidates[i].lock();
+                if (!candidate) // (its models are gone)
+                {
+                    candidates.erase(candidates.begin() + i);
+                    continue;
+                }
+                if (candidate.get() != &value && candidate->GetNumRows() == value.GetNumRows() && candidate->GetNumCols() == value.GetNumCols() &&
+                    candidate->GetMatrixType() == value.GetMatrixType())
+                {
+                    CopyToHost(*candidate, candidateValues);
+                    if (memcmp(candidateValues.data(), values.data(), values.size() * sizeof(ElemType)) == 0)
+                    {
+                        sharedBytes += values.size() * sizeof(ElemType);
+                        node->ShareValue(candidate);
+                        shared = true;
+                    }
+                }
+                i++;
+            }
+            if (!shared)
+                candidates.push_back(node->ValuePtr());
+            else
+                numShared++;
+        }
+
+        net->SetMatrixPool(m_workspace);
+        m_numModels++;
+        m_sharedBytes += sharedBytes;
+        fprintf(stderr, "EvalHost '%ls': Model %d shares %d of its %d parameters (%.1f MB) with the models added before; %.1f MB shared in total.\n",
+                m_name.c_str(), (int) m_numModels, (int) numShared, (int) numParameters, sharedBytes / 1e6, m_sharedBytes / 1e6);
+    }
+
+    // held by an evaluator of this host while it evaluates, since the models share the workspace
+    std::unique_lock<std::mutex> LockForEvaluation()
+    {
+        return std::unique_lock<std::mutex>(m_mutex);
+    }
+
+private:
+    EvalHost(const std::wstring& name, DEVICEID_TYPE deviceId)
+        : m_name(name), m_deviceId(deviceId), m_workspace(make_shared<MatrixPool>()), m_numModels(0), m_sharedBytes(0)
+    {
+    }
+
+    template <class ElemType>
+    static void CopyToHost(const Matrix<ElemType>& value, std::vector<ElemType>& values)
+    {
+        values.resize(value.GetNumElements());
+        ElemType* p = values.data();
+        size_t size = values.size();
+        if (size > 0)
+            value.CopyToArray(p, size);
+    }
+
+    // FNV-1a over the dimensions and the bytes of the values
+    template <class ElemType>
+    static size_t Hash(size_t rows, size_t cols, const std::vector<ElemType>& values)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const void* data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= ((const unsigned char*) data)[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        add(&rows, sizeof(rows));
+        add(&cols, sizeof(cols));
+        add(values.data(), values.size() * sizeof(ElemType));
+        return (size_t) hash;
+    }
+
+    // [hash] -> parameter matrices of the models of this host with that hash
+    template <class ElemType>
+    std::map<size_t, std::vector<std::weak_ptr<Matrix<ElemType>>>>& Parameters();
+
+    std::wstring m_name;
+    DEVICEID_TYPE m_deviceId;
+    std::shared_ptr<MatrixPool> m_workspace;
+    std::map<size_t, std::vector<std::weak_ptr<Matrix<float>>>> m_floatParameters;
+    std::map<size_t, std::vector<std::weak_ptr<Matrix<double>>>> m_doubleParameters;
+    std::mutex m_mutex;
+    size_t m_numModels;   // added so far
+    size_t m_sharedBytes; // parameter bytes that were not allocated again, over all models added so far
+};
+
+template <>
+inline std::map<size_t, std::vector<std::weak_ptr<Matrix<float>>>>& EvalHost::Parameters<float>()
+{
+    return m_floatParameters;
+}
+template <>
+inline std::map<size_t, std::vector<std::weak_ptr<Matrix<double>>>>& EvalHost::Parameters<double>()
+{
+    return m_doubleParameters;
+}
+} } }
@@ -23,6 +23,7 @@ using namespace std;
 using namespace System;
 using namespace System::Collections::Generic;
 using namespace System::Collections;
+using namespace System::Runtime::InteropServices;
 using namespace Microsoft::MSR::CNTK;
 
 namespace Microsoft { namespace MSR { namespace CNTK { namespace Extensibility { namespace Managed {
@@ -64,6 +65,12 @@ public:
         {
             throw gcnew CNTKException(gcnew System::String(ex.what()));
         }
+
+        m_inputDimensions = gcnew List<int>();
+        m_outputDimensions = gcnew List<int>();
+        m_pinHandles = gcnew array<GCHandle>(0);
+        m_inputPointers = new std::vector<const ElemType*>();
+        m_outputPointers = new std::vector<ElemType*>();
     }
 
     /// <summary>Initializes the model evaluation library with a CNTK configuration</summary>
@@ -196,6 +203,149 @@ public:
         return outputMap[outputKey];
     }
 
+    /// <summary>Binds an input node for evaluation from arrays</summary>
+    /// <param name="nodeName">The name of the input node</param>
+    /// <returns>The handle of the node: the index of its array in the inputs of Evaluate()</returns>
+    int BindInput(String^ nodeName)
+    {
+        int handle = Bind(nodeName, true);
+        if (handle == m_inputDimensions->Count)
+        {
+            m_inputDimensions->Add(GetDimension(nodeName));
+        }
+        return handle;
+    }
+
+    /// <summary>Binds an output node for evaluation into arrays</summary>
+    /// <param name="nodeName">The name of the output node</param>
+    /// <returns>The handle of the node: the index of its array in the outputs of Evaluate()</returns>
+    int BindOutput(String^ nodeName)
+    {
+        int handle = Bind(nodeName, false);
+        if (handle == m_outputDimensions->Count)
+        {
+            m_outputDimensions->Add(GetDimension(nodeName));
+        }
+        return handle;
+    }
+
+    /// <summary>Evaluates the bound output nodes from and into arrays</summary>
+    /// <remarks>The arrays are pinned during the call and read and written in place, nothing is copied into intermediate lists.</remarks>
+    /// <param name="inputs">Per input handle, the values of the samples one after the other</param>
+    /// <param name="numSamples">The number of samples</param>
+    /// <param name="outputs">Per output handle, an array that receives the values of the samples one after the other</param>
+    void Evaluate(array<array<ElemType>^>^ inputs, int numSamples, array<array<ElemType>^>^ outputs)
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+
+        CheckBuffers(inputs, m_inputDimensions, numSamples, "inputs");
+        CheckBuffers(outputs, m_outputDimensions, numSamples, "outputs");
+
+        int numBuffers = inputs->Length + outputs->Length;
+        if (m_pinHandles->Length < numBuffers)
+        {
+            m_pinHandles = gcnew array<GCHandle>(numBuffers);
+        }
+        m_inputPointers->resize(inputs->Length);
+        m_outputPointers->resize(outputs->Length);
+
+        int numPinned = 0;
+        try
+        {
+            for (int i = 0; i < inputs->Length; i++)
+            {
+                m_pinHandles[numPinned] = GCHandle::Alloc(inputs[i], GCHandleType::Pinned);
+                (*m_inputPointers)[i] = (const ElemType*)m_pinHandles[numPinned++].AddrOfPinnedObject().ToPointer();
+            }
+            for (int i = 0; i < outputs->Length; i++)
+            {
+                m_pinHandles[numPinned] = GCHandle::Alloc(outputs[i], GCHandleType::Pinned);
+                (*m_outputPointers)[i] = (ElemType*)m_pinHandles[numPinned++].AddrOfPinnedObject().ToPointer();
+            }
+
+            try
+            {
+                m_eval->Evaluate(m_inputPointers->data(), numSamples, m_outputPointers->data());
+            }
+            catch (const exception& ex)
+            {
+                throw GetCustomException(ex);
+            }
+        }
+        finally
+        {
+            for (int i = 0; i < numPinned; i++)
+            {
+                m_pinHandles[i].Free();
+            }
+        }
+    }
+
+    /// <summary>Evaluates the single bound output node from and into arrays</summary>
+    /// <param name="input">The values of the samples of the single bound input, one after the other</param>
+    /// <param name="numSamples">The number of samples</param>
+    /// <param name="output">Receives the values of the single bound output for the samples, one after the other</param>
+    void Evaluate(array<ElemType>^ input, int numSamples, array<ElemType>^ output)
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+
+        if (m_inputDimensions->Count != 1 || m_outputDimensions->Count != 1)
+        {
+            throw gcnew InvalidOperationException("Exactly one input and one output node must be bound.");
+        }
+        CheckBuffer(input, m_inputDimensions[0], numSamples, "input");
+        CheckBuffer(output, m_outputDimensions[0], numSamples, "output");
+        if (numSamples == 0)
+        {
+            return;
+        }
+
+        pin_ptr<ElemType> pInput = &input[0];
+        pin_ptr<ElemType> pOutput = &output[0];
+        try
+        {
+            m_eval->Evaluate((const ElemType*)pInput, numSamples, (ElemType*)pOutput);
+        }
+        catch (const exception& ex)
+        {
+            throw GetCustomException(ex);
+        }
+    }
+
+    /// <summary>Evaluates dummy inputs of the expected sizes, so that the first real evaluation runs at full speed</summary>
+    /// <param name="numSamples">The expected numbers of samples per call</param>
+    void Warmup(array<int>^ numSamples)
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+
+        std::vector<size_t> sizes;
+        for each (int n in numSamples)
+        {
+            if (n <= 0)
+            {
+                throw gcnew ArgumentException("The numbers of samples must be positive.", "numSamples");
+            }
+            sizes.push_back(n);
+        }
+        try
+        {
+            m_eval->Warmup(sizes);
+        }
+        catch (const exception& ex)
+        {
+            throw GetCustomException(ex);
+        }
+    }
+
     ~IEvaluateModelManaged()
     {
         if (m_eval == nullptr)
@@ -214,12 +364,92 @@ protected:
             m_eval->Destroy();
             m_eval = nullptr;
         }
+
+        delete m_inputPointers;
+        m_inputPointers = nullptr;
+        delete m_outputPointers;
+        m_outputPointers = nullptr;
     }
 
 private:
     // Native model evaluation instance
     IEvaluateModel<ElemType> *m_eval;
 
+    // Dimensions of the bound nodes, by handle
+    List<int>^ m_inputDimensions;
+    List<int>^ m_outputDimensions;
+
+    // Reused from call to call of Evaluate() with arrays: the pinning handles and the native pointers to the pinned arrays
+    array<GCHandle>^ m_pinHandles;
+    std::vector<const ElemType*>* m_inputPointers;
+    std::vector<ElemType*>* m_outputPointers;
+
+    /// <summary>Binds an input or output node in the native model</summary>
+    int Bind(String^ nodeName, bool isInput)
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+
+        pin_ptr<const WCHAR> name = PtrToStringChars(nodeName);
+        try
+        {
+            return (int)(isInput ? m_eval->BindInput(name) : m_eval->BindOutput(name));
+        }
+        catch (const exception& ex)
+        {
+            throw GetCustomException(ex);
+        }
+    }
+
+    /// <summary>Gets the dimension of a node from the native model</summary>
+    int GetDimension(String^ nodeName)
+    {
+        pin_ptr<const WCHAR> name = PtrToStringChars(nodeName);
+        std::map<std::wstring, size_t> dimensions;
+        dimensions[name] = 0;
+        try
+        {
+            m_eval->GetNodeDimensions(dimensions, NodeGroup::nodeSpecified);
+        }
+        catch (const exception& ex)
+        {
+            throw GetCustomException(ex);
+        }
+        return (int)dimensions.begin()->second;
+    }
+
+    /// <summary>Verifies that an array holds the values of 'numSamples' samples of a node</summary>
+    void CheckBuffer(array<ElemType>^ buffer, int dimension, int numSamples, String^ paramName)
+    {
+        if (buffer == nullptr)
+        {
+            throw gcnew ArgumentNullException(paramName);
+        }
+        if (numSamples < 0 || buffer->Length < (long long)dimension * numSamples)
+        {
+            throw gcnew ArgumentException(String::Format("The array holds {0} values, but {1} samples of dimension {2} were requested.", buffer->Length, numSamples, dimension), paramName);
+        }
+    }
+
+    /// <summary>Verifies that there is one array per bound node, each large enough</summary>
+    void CheckBuffers(array<array<ElemType>^>^ buffers, List<int>^ dimensions, int numSamples, String^ paramName)
+    {
+        if (buffers == nullptr)
+        {
+            throw gcnew ArgumentNullException(paramName);
+        }
+        if (buffers->Length != dimensions->Count)
+        {
+            throw gcnew ArgumentException(String::Format("{0} arrays were passed for {1} bound nodes.", buffers->Length, dimensions->Count), paramName);
+        }
+        for (int i = 0; i < buffers->Length; i++)
+        {
+            CheckBuffer(buffers[i], dimensions[i], numSamples, paramName);
+        }
+    }
+
     /// <summary>Copies a list of element types from a CLI structure to a native structure</summary>
     /// <param name="list">The CLI list of items</param>
     /// <returns>A native vector of items</returns>
@@ -355,12 +585,22 @@ void emit()
     f.Evaluate(nullptr, nullptr);
     f.Evaluate(nullptr, "", 0);
     f.LoadModel("");
+    f.BindInput("");
+    f.BindOutput("");
+    f.Evaluate((array<array<float>^>^)nullptr, 0, (array<array<float>^>^)nullptr);
+    f.Evaluate((array<float>^)nullptr, 0, (array<float>^)nullptr);
+    f.Warmup(nullptr);
 
     IEvaluateModelManagedD d;
     d.Init("");
     d.Evaluate(nullptr, nullptr);
     d.Evaluate(nullptr, "", 0);
     d.LoadModel("");
+    d.BindInput("");
+    d.BindOutput("");
+    d.Evaluate((array<array<double>^>^)nullptr, 0, (array<array<double>^>^)nullptr);
+    d.Evaluate((array<double>^)nullptr, 0, (array<double>^)nullptr);
+    d.Warmup(nullptr);
 }
 
 }}}}}
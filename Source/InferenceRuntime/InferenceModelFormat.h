@@ -0,0 +1,108 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// InferenceModelFormat.h -- the file format of models exported for the inference runtime
+//
+// Written by ComputationNetwork::ExportForInference(), read by InferenceModel (InferenceRuntime.h). This header is shared by
+// both and depends on nothing else, so that the runtime can be built without the rest of CNTK.
+//
+// A file consists of the sections below, each starting at a multiple of 'alignment' bytes, so that a file that is mapped
+// into memory can be used in place:
+//   Header | Tensor[numTensors] | Operation[numOperations] | Output[numOutputs] | names | constant data
+// Names are zero-terminated UTF-8 strings. Constant data are floats, column-major, each tensor's starting at a multiple
+// of 'alignment' bytes. All integers are little-endian.
+// A tensor is a constant (with its data in the file), an input (provided by the caller, one column per sample), or an
+// activation (one column per sample). The activations live in one arena whose layout was planned at export time: an
+// activation of R rows occupies R x numSamples floats starting at arenaRow x numSamples, and activations whose lifetimes
+// do not overlap share arena rows. The operations run in file order; each computes one activation.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace InferenceModelFormat {
+
+static const char magic[8] = {'C', 'N', 'T', 'K', 'I', 'N', 'F', '\0'};
+static const uint32_t currentVersion = 1;
+static const uint64_t alignment = 64;
+
+enum TensorKind : uint32_t
+{
+    constantTensor,
+    inputTensor,
+    activationTensor
+};
+
+// operations; 'inputs' as listed, 'x' and 'y' are activations or inputs, 'c' constants
+enum OpCode : uint32_t
+{
+    opTimes,           // (c, x): c x, with c a matrix whose number of columns is x's number of rows
+    opPlus,            // (x, y): x + y; either may also be a constant column (added to each sample) or a single element
+    opMinus,           // (x, y): x - y; broadcasting as for opPlus
+    opElementTimes,    // (x, y): x .* y; broadcasting as for opPlus (a scaling is a product with a single element)
+    opSigmoid,         // (x)
+    opTanh,            // (x)
+    opRectifiedLinear, // (x)
+    opExp,             // (x)
+    opLog,             // (x)
+    opSoftmax,         // (x): per sample
+    opLogSoftmax,      // (x): per sample
+    opNormalize,       // (x, mean, invStdDev): (x - mean) .* invStdDev, with constant columns mean and invStdDev
+    numOpCodes
+};
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numTensors;
+    uint32_t numOperations;
+    uint32_t numOutputs;
+    uint64_t tensorsOffset; // byte offsets of the sections from the start of the file
+    uint64_t operationsOffset;
+    uint64_t outputsOffset;
+    uint64_t namesOffset;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+    uint64_t arenaRows; // activation rows of the arena, which holds arenaRows x numSamples floats
+};
+
+struct Tensor
+{
+    uint32_t kind;       // TensorKind
+    uint32_t nameOffset; // from the start of the names section
+    uint64_t rows;
+    uint64_t cols;   // constants only; 0 for inputs and activations
+    uint64_t offset; // constants: byte offset of the data from the start of the file; activations: first arena row
+};
+
+static const uint32_t maxOperationInputs = 3;
+
+struct Operation
+{
+    uint32_t opCode; // OpCode
+    uint32_t output; // tensor id
+    uint32_t numInputs;
+    uint32_t inputs[maxOperationInputs]; // tensor ids
+};
+
+// an output of the model, with its own name, since several outputs may be the same tensor
+struct Output
+{
+    uint32_t tensor;
+    uint32_t nameOffset;
+};
+
+static_assert(sizeof(Header) == 80, "InferenceModelFormat::Header has an unexpected layout.");
+static_assert(sizeof(Tensor) == 32, "InferenceModelFormat::Tensor has an unexpected layout.");
+static_assert(sizeof(Operation) == 24, "InferenceModelFormat::Operation has an unexpected layout.");
+static_assert(sizeof(Output) == 8, "InferenceModelFormat::Output has an unexpected layout.");
+
+static inline uint64_t AlignedOffset(uint64_t offset)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} } } }
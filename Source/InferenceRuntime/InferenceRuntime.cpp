@@ -0,0 +1,425 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// InferenceRuntime.cpp -- loads and evaluates models in the format of InferenceModelFormat.h
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "InferenceRuntime.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace InferenceModelFormat;
+
+static void Fail(const std::string& message)
+{
+    throw std::runtime_error("InferenceModel: " + message);
+}
+
+InferenceModel::InferenceModel(const std::string& path)
+    : m_data(nullptr), m_size(0),
+#ifdef _WIN32
+      m_fileHandle(INVALID_HANDLE_VALUE), m_mappingHandle(nullptr),
+#endif
+      m_header(nullptr), m_tensors(nullptr), m_operations(nullptr)
+{
+    Map(path);
+    try
+    {
+        CheckTables();
+    }
+    catch (...)
+    {
+        Unmap();
+        throw;
+    }
+}
+
+InferenceModel::~InferenceModel()
+{
+    Unmap();
+}
+
+void InferenceModel::Map(const std::string& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        Fail("Cannot open " + path + ".");
+    m_fileHandle = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        Unmap();
+        Fail("Cannot determine the size of " + path + ", or it is empty.");
+    }
+    m_size = (size_t) size.QuadPart;
+    m_mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mappingHandle)
+        m_data = (const char*) MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data)
+    {
+        Unmap();
+        Fail("Cannot map " + path + " into memory.");
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        Fail("Cannot open " + path + ".");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        Fail("Cannot determine the size of " + path + ", or it is empty.");
+    }
+    m_size = (size_t) st.st_size;
+    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // (the mapping keeps the file)
+    if (p == MAP_FAILED)
+        Fail("Cannot map " + path + " into memory.");
+    m_data = (const char*) p;
+#endif
+}
+
+void InferenceModel::Unmap()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mappingHandle)
+        CloseHandle(m_mappingHandle);
+    if (m_fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(m_fileHandle);
+    m_mappingHandle = nullptr;
+    m_fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (m_data)
+        munmap((void*) m_data, m_size);
+#endif
+    m_data = nullptr;
+}
+
+// Verifies everything that evaluation relies on, so that a damaged or foreign file is rejected here instead of causing
+// reads outside of the mapping later.
+void InferenceModel::CheckTables()
+{
+    if (m_size < sizeof(Header))
+        Fail("The file is too short to be a model.");
+    m_header = (const Header*) m_data;
+    if (memcmp(m_header->magic, magic, sizeof(magic)) != 0)
+        Fail("The file is not an exported model.");
+    if (m_header->version != currentVersion)
+        Fail("The model has version " + std::to_string(m_header->version) + ", but this runtime reads version " + std::to_string(currentVersion) + ".");
+    if (m_header->fileSize != m_size)
+        Fail("The file is truncated or has trailing data.");
+
+    auto checkSection = [this](uint64_t offset, uint64_t bytes, const char* what)
+    {
+        if (offset % alignment != 0 || offset > m_size || bytes > m_size - offset)
+            Fail(std::string("The ") + what + " section is outside of the file.");
+    };
+    checkSection(m_header->tensorsOffset, (uint64_t) m_header->numTensors * sizeof(Tensor), "tensor");
+    checkSection(m_header->operationsOffset, (uint64_t) m_header->numOperations * sizeof(Operation), "operation");
+    checkSection(m_header->outputsOffset, (uint64_t) m_header->numOutputs * sizeof(Output), "output");
+    checkSection(m_header->namesOffset, m_header->dataOffset - std::min(m_header->dataOffset, m_header->namesOffset), "name");
+    checkSection(m_header->dataOffset, 0, "data");
+    if (m_header->dataOffset < m_header->namesOffset)
+        Fail("The name section is outside of the file.");
+    m_tensors = (const Tensor*) (m_data + m_header->tensorsOffset);
+    m_operations = (const Operation*) (m_data + m_header->operationsOffset);
+
+    const char* names = m_data + m_header->namesOffset;
+    const size_t namesSize = (size_t) (m_header->dataOffset - m_header->namesOffset);
+    auto nameAt = [&](uint32_t offset, const std::string& what) -> std::string
+    {
+        if (offset >= namesSize || !memchr(names + offset, 0, namesSize - offset))
+            Fail("The name of " + what + " is outside of the name section.");
+        return std::string(names + offset);
+    };
+    auto nameOf = [&](uint32_t tensorId) -> std::string
+    {
+        return nameAt(m_tensors[tensorId].nameOffset, "tensor " + std::to_string(tensorId));
+    };
+
+    const uint64_t maxRows = std::numeric_limits<uint32_t>::max();
+    m_tensorData.assign(m_header->numTensors, nullptr);
+    for (uint32_t id = 0; id < m_header->numTensors; id++)
+    {
+        const Tensor& tensor = m_tensors[id];
+        if (tensor.rows == 0 || tensor.rows > maxRows)
+            Fail("Tensor " + nameOf(id) + " has an invalid number of rows.");
+        if (tensor.kind == constantTensor)
+        {
+            if (tensor.cols == 0 || tensor.cols > maxRows || tensor.offset % alignment != 0 || tensor.offset < m_header->dataOffset ||
+                tensor.offset > m_size || tensor.rows * tensor.cols * sizeof(float) > m_size - tensor.offset)
+                Fail("The data of tensor " + nameOf(id) + " are outside of the file.");
+            m_tensorData[id] = (const float*) (m_data + tensor.offset);
+        }
+        else if (tensor.kind == inputTensor)
+        {
+            m_inputs.push_back(id);
+            m_inputNames.push_back(nameOf(id));
+        }
+        else if (tensor.kind == activationTensor)
+        {
+            if (tensor.offset > m_header->arenaRows || tensor.rows > m_header->arenaRows - tensor.offset)
+                Fail("Tensor " + nameOf(id) + " is outside of the arena.");
+        }
+        else
+            Fail("Tensor " + nameOf(id) + " has an invalid kind.");
+    }
+
+    // each operation must compute an activation from tensors that exist by then, with matching dimensions
+    std::vector<bool> isDefined(m_header->numTensors, false);
+    for (uint32_t id = 0; id < m_header->numTensors; id++)
+        isDefined[id] = m_tensors[id].kind != activationTensor;
+    static const uint32_t numInputsOf[numOpCodes] = {2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 3};
+    for (uint32_t i = 0; i < m_header->numOperations; i++)
+    {
+        const Operation& op = m_operations[i];
+        const std::string where = "Operation " + std::to_string(i);
+        if (op.opCode >= numOpCodes || op.numInputs != numInputsOf[op.opCode])
+            Fail(where + " is invalid.");
+        if (op.output >= m_header->numTensors || m_tensors[op.output].kind != activationTensor)
+            Fail(where + " does not compute an activation.");
+        for (uint32_t k = 0; k < op.numInputs; k++)
+        {
+            if (op.inputs[k] >= m_header->numTensors || !isDefined[op.inputs[k]])
+                Fail(where + " reads a tensor that is not computed before.");
+        }
+        const Tensor& out = m_tensors[op.output];
+        auto isPerSample = [&](uint32_t k)
+        {
+            return m_tensors[op.inputs[k]].kind != constantTensor;
+        };
+        auto numElements = [&](uint32_t k)
+        {
+            const Tensor& t = m_tensors[op.inputs[k]];
+            return t.kind == constantTensor ? t.rows * t.cols : t.rows;
+        };
+        bool valid;
+        switch (op.opCode)
+        {
+        case opTimes:
+            valid = !isPerSample(0) && isPerSample(1) && m_tensors[op.inputs[0]].rows == out.rows && m_tensors[op.inputs[0]].cols == m_tensors[op.inputs[1]].rows;
+            break;
+        case opPlus:
+        case opMinus:
+        case opElementTimes:
+            valid = (isPerSample(0) || isPerSample(1));
+            for (uint32_t k = 0; k < 2; k++)
+                valid = valid && (numElements(k) == out.rows || (!isPerSample(k) && numElements(k) == 1));
+            break;
+        case opNormalize:
+            valid = isPerSample(0) && !isPerSample(1) && !isPerSample(2) && numElements(0) == out.rows && numElements(1) == out.rows && numElements(2) == out.rows;
+            break;
+        default: // unary
+            valid = isPerSample(0) && numElements(0) == out.rows;
+        }
+        if (!valid)
+            Fail(where + " has inputs of mismatching dimensions.");
+        isDefined[op.output] = true;
+    }
+
+    const Output* outputs = (const Output*) (m_data + m_header->outputsOffset);
+    for (uint32_t i = 0; i < m_header->numOutputs; i++)
+    {
+        const std::string where = "output " + std::to_string(i);
+        if (outputs[i].tensor >= m_header->numTensors || m_tensors[outputs[i].tensor].kind != activationTensor || !isDefined[outputs[i].tensor])
+            Fail("The " + where + " is not a computed activation.");
+        m_outputs.push_back(outputs[i].tensor);
+        m_outputNames.push_back(nameAt(outputs[i].nameOffset, where));
+    }
+}
+
+void InferenceModel::Evaluate(const std::vector<const float*>& inputs, const std::vector<float*>& outputs, size_t numSamples)
+{
+    if (inputs.size() != m_inputs.size() || outputs.size() != m_outputs.size())
+        Fail("Evaluate() needs " + std::to_string(m_inputs.size()) + " inputs and " + std::to_string(m_outputs.size()) + " outputs.");
+    if (numSamples == 0)
+        return;
+
+    const size_t arenaSize = (size_t) m_header->arenaRows * numSamples;
+    if (m_arena.size() < arenaSize)
+        m_arena.resize(arenaSize);
+    for (size_t i = 0; i < m_inputs.size(); i++)
+        m_tensorData[m_inputs[i]] = inputs[i];
+    for (uint32_t id = 0; id < m_header->numTensors; id++)
+    {
+        if (m_tensors[id].kind == activationTensor)
+            m_tensorData[id] = m_arena.data() + m_tensors[id].offset * numSamples;
+    }
+
+    for (uint32_t i = 0; i < m_header->numOperations; i++)
+        RunOperation(m_operations[i], numSamples);
+
+    for (size_t i = 0; i < m_outputs.size(); i++)
+        memcpy(outputs[i], m_tensorData[m_outputs[i]], sizeof(float) * OutputDim(i) * numSamples);
+}
+
+// an operand of an elementwise operation: element (r, j) is at data[j * sampleStride + r * rowStride]
+struct Operand
+{
+    const float* data;
+    size_t sampleStride;
+    size_t rowStride;
+};
+
+void InferenceModel::RunOperation(const Operation& op, size_t numSamples)
+{
+    const Tensor& out = m_tensors[op.output];
+    float* y = const_cast<float*>(m_tensorData[op.output]); // (activations live in the arena)
+    const size_t rows = (size_t) out.rows;
+    const long n = (long) numSamples;
+
+    auto operand = [&](uint32_t k) -> Operand
+    {
+        const Tensor& t = m_tensors[op.inputs[k]];
+        Operand a;
+        a.data = m_tensorData[op.inputs[k]];
+        a.sampleStride = t.kind == constantTensor ? 0 : (size_t) t.rows;
+        a.rowStride = (t.kind == constantTensor && t.rows * t.cols == 1) ? 0 : 1;
+        return a;
+    };
+
+    switch (op.opCode)
+    {
+    case opTimes:
+    {
+        // y_j = W x_j as a sum of W's columns scaled by x_j's elements, in blocks of rows, so that the innermost loop runs
+        // over contiguous memory and parallelizes also for a single sample
+        const float* w = m_tensorData[op.inputs[0]];
+        const float* x = m_tensorData[op.inputs[1]];
+        const size_t inner = (size_t) m_tensors[op.inputs[0]].cols;
+        const size_t blockRows = 64;
+        const long numBlocks = (long) ((rows + blockRows - 1) / blockRows);
+#pragma omp parallel for if (n * numBlocks > 1)
+        for (long b = 0; b < n * numBlocks; b++)
+        {
+            const size_t j = (size_t) (b / numBlocks);
+            const size_t r0 = (size_t) (b % numBlocks) * blockRows;
+            const size_t r1 = std::min(rows, r0 + blockRows);
+            float* yj = y + j * rows;
+            const float* xj = x + j * inner;
+            for (size_t r = r0; r < r1; r++)
+                yj[r] = 0;
+            for (size_t k = 0; k < inner; k++)
+            {
+                const float a = xj[k];
+                if (a == 0)
+                    continue;
+                const float* wk = w + k * rows;
+                for (size_t r = r0; r < r1; r++)
+                    yj[r] += a * wk[r];
+            }
+        }
+        break;
+    }
+    case opPlus:
+    case opMinus:
+    case opElementTimes:
+    {
+        const Operand a = operand(0), b = operand(1);
+        const uint32_t opCode = op.opCode;
+#pragma omp parallel for if (n > 1)
+        for (long jj = 0; jj < n; jj++)
+        {
+            const size_t j = (size_t) jj;
+            const float* aj = a.data + j * a.sampleStride;
+            const float* bj = b.data + j * b.sampleStride;
+            float* yj = y + j * rows;
+            if (opCode == opPlus)
+                for (size_t r = 0; r < rows; r++)
+                    yj[r] = aj[r * a.rowStride] + bj[r * b.rowStride];
+            else if (opCode == opMinus)
+                for (size_t r = 0; r < rows; r++)
+                    yj[r] = aj[r * a.rowStride] - bj[r * b.rowStride];
+            else
+                for (size_t r = 0; r < rows; r++)
+                    yj[r] = aj[r * a.rowStride] * bj[r * b.rowStride];
+        }
+        break;
+    }
+    case opNormalize:
+    {
+        const float* x = m_tensorData[op.inputs[0]];
+        const float* mean = m_tensorData[op.inputs[1]];
+        const float* invStdDev = m_tensorData[op.inputs[2]];
+#pragma omp parallel for if (n > 1)
+        for (long jj = 0; jj < n; jj++)
+        {
+            const size_t j = (size_t) jj;
+            for (size_t r = 0; r < rows; r++)
+                y[j * rows + r] = (x[j * rows + r] - mean[r]) * invStdDev[r];
+        }
+        break;
+    }
+    case opSoftmax:
+    case opLogSoftmax:
+    {
+        const float* x = m_tensorData[op.inputs[0]];
+        const bool isLog = op.opCode == opLogSoftmax;
+#pragma omp parallel for if (n > 1)
+        for (long jj = 0; jj < n; jj++)
+        {
+            const size_t j = (size_t) jj;
+            const float* xj = x + j * rows;
+            float* yj = y + j * rows;
+            const float maxValue = *std::max_element(xj, xj + rows);
+            double sum = 0;
+            for (size_t r = 0; r < rows; r++)
+                sum += exp((double) (xj[r] - maxValue));
+            const float logSum = (float) log(sum) + maxValue;
+            for (size_t r = 0; r < rows; r++)
+                yj[r] = isLog ? xj[r] - logSum : (float) exp((double) (xj[r] - logSum));
+        }
+        break;
+    }
+    default: // unary elementwise
+    {
+        const float* x = m_tensorData[op.inputs[0]];
+        const long numElements = (long) (rows * numSamples);
+        const uint32_t opCode = op.opCode;
+#pragma omp parallel for if (numElements > 4096)
+        for (long i = 0; i < numElements; i++)
+        {
+            const float v = x[i];
+            switch (opCode)
+            {
+            case opSigmoid: // (as CNTK's Sigmoid, without overflow for large negative v)
+                y[i] = v >= 0 ? 1 / (1 + expf(-v)) : expf(v) / (1 + expf(v));
+                break;
+            case opTanh:
+                y[i] = tanhf(v);
+                break;
+            case opRectifiedLinear:
+                y[i] = v > 0 ? v : 0;
+                break;
+            case opExp:
+                y[i] = expf(v);
+                break;
+            default: // opLog
+                y[i] = logf(v);
+            }
+        }
+    }
+    }
+}
+
+} } }
@@ -0,0 +1,93 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// InferenceRuntime.h -- a small CPU runtime for models exported with the "exportInference" action
+//
+// The runtime depends only on the C++ standard library (and OpenMP, if compiled with it). It maps the model file into
+// memory, so that loading does no more than check the tables, and the constants are used in place. An evaluation runs
+// the operations in the order and with the activation memory that were planned at export time (see
+// InferenceModelFormat.h); the arena grows to the largest number of samples evaluated and is then reused.
+// Errors (a file that is not a valid model, mismatching arguments) are reported as std::runtime_error.
+//
+// An InferenceModel must not be evaluated from several threads at the same time, since the arena is shared; use one per
+// thread. They can map the same file, whose pages the operating system then shares.
+//
+
+#pragma once
+
+#include "InferenceModelFormat.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class InferenceModel
+{
+public:
+    explicit InferenceModel(const std::string& path);
+    ~InferenceModel();
+
+    size_t NumInputs() const
+    {
+        return m_inputs.size();
+    }
+    const std::string& InputName(size_t i) const
+    {
+        return m_inputNames.at(i);
+    }
+    size_t InputDim(size_t i) const
+    {
+        return (size_t) m_tensors[m_inputs.at(i)].rows;
+    }
+    size_t NumOutputs() const
+    {
+        return m_outputs.size();
+    }
+    const std::string& OutputName(size_t i) const
+    {
+        return m_outputNames.at(i);
+    }
+    size_t OutputDim(size_t i) const
+    {
+        return (size_t) m_tensors[m_outputs.at(i)].rows;
+    }
+
+    // evaluates the model on 'numSamples' samples
+    // inputs[i] holds InputDim(i) x numSamples floats and outputs[i] receives OutputDim(i) x numSamples floats, one sample
+    // after another, in the order of InputName() and OutputName().
+    void Evaluate(const std::vector<const float*>& inputs, const std::vector<float*>& outputs, size_t numSamples);
+
+private:
+    void Map(const std::string& path);
+    void Unmap();
+    void CheckTables();
+    void RunOperation(const InferenceModelFormat::Operation& op, size_t numSamples);
+
+    // the mapped file
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_fileHandle;
+    void* m_mappingHandle;
+#endif
+
+    // views into it
+    const InferenceModelFormat::Header* m_header;
+    const InferenceModelFormat::Tensor* m_tensors;
+    const InferenceModelFormat::Operation* m_operations;
+    std::vector<uint32_t> m_inputs; // tensor ids, in the order of the tensor table
+    std::vector<uint32_t> m_outputs;
+    std::vector<std::string> m_inputNames;
+    std::vector<std::string> m_outputNames;
+
+    // evaluation state
+    std::vector<float> m_arena;
+    std::vector<const float*> m_tensorData; // where each tensor's values are in the current evaluation
+
+    InferenceModel(const InferenceModel&) = delete;
+    InferenceModel& operator=(const InferenceModel&) = delete;
+};
+
+} } }
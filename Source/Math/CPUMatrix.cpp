@@ -10,7 +10,11 @@
 #include "File.h"
 
 #include "CPUMatrix.h"
+#include "CPUVectorKernels.h"
+#include "MemoryAccounting.h"
 #include "TensorOps.h"
+#include "Philox.h"
+#include "PackedImages.h"
 #include <assert.h>
 #include <stdexcept>
 #include <omp.h>
@@ -18,6 +22,7 @@
 #include <random>
 #include <chrono>
 #include <exception>
+#include <new>
 #include <thread>
 #include <iostream>
 #include <algorithm>
@@ -26,6 +31,8 @@
 #include "Windows.h"
 #else
 #include <cfloat>
+#include <unistd.h>
+#include <sys/syscall.h>
 #endif
 
 #ifdef LEAKDETECT
@@ -71,6 +78,8 @@
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 int MATH_API TracingGPUMemoryAllocator::m_traceLevel = 0;
+bool MATH_API TracingGPUMemoryAllocator::m_cachingEnabled = false;
+bool MATH_API TracingGPUMemoryAllocator::m_managedMemoryEnabled = false;
 
 void TracingGPUMemoryAllocator::SetTraceLevel(int traceLevel)
 {
@@ -82,6 +91,126 @@ bool TracingGPUMemoryAllocator::IsTraceEnabled()
     return (m_traceLevel > 0);
 }
 
+void TracingGPUMemoryAllocator::SetCachingEnabled(bool enabled)
+{
+    m_cachingEnabled = enabled;
+}
+
+bool TracingGPUMemoryAllocator::IsCachingEnabled()
+{
+    return m_cachingEnabled && !m_managedMemoryEnabled; // (the cache holds on to device memory, which is what unified memory is to relieve)
+}
+
+void TracingGPUMemoryAllocator::SetManagedMemoryEnabled(bool enabled)
+{
+    m_managedMemoryEnabled = enabled;
+}
+
+bool TracingGPUMemoryAllocator::IsManagedMemoryEnabled()
+{
+    return m_managedMemoryEnabled;
+}
+
+CPUMemoryPlacement::Policy CPUMemoryPlacement::s_policy = CPUMemoryPlacement::none;
+
+#ifdef __linux__
+// the number of NUMA nodes, from sysfs (1 if that is not available)
+static size_t GetNumNumaNodes()
+{
+    size_t numNodes = 0;
+    while (numNodes < 1024 && access(("/sys/devices/system/node/node" + std::to_string(numNodes)).c_str(), F_OK) == 0)
+        numNodes++;
+    return std::max(numNodes, (size_t) 1);
+}
+#endif
+
+void CPUMemoryPlacement::Set(const std::string& policy)
+{
+    if (policy == "none")
+        s_policy = none;
+    else if (policy == "firstTouch")
+        s_policy = firstTouch;
+    else if (policy == "interleave")
+    {
+#ifdef __linux__
+        s_policy = interleave;
+#else
+        fprintf(stderr, "CPUMemoryPlacement: WARNING: interleave is only supported on Linux, using firstTouch.\n");
+        s_policy = firstTouch;
+#endif
+    }
+    else
+        InvalidArgument("CPUMemoryPlacement: '%s' is not one of none, firstTouch, interleave.", policy.c_str());
+#ifdef __linux__
+    if (s_policy != none)
+        fprintf(stderr, "CPUMemoryPlacement: %s over %d NUMA nodes.\n", policy.c_str(), (int) GetNumNumaNodes());
+#endif
+}
+
+CPUMemoryPlacement::Policy CPUMemoryPlacement::Get()
+{
+    return s_policy;
+}
+
+bool CPUMemoryPlacement::AppliesTo(size_t bytes)
+{
+    return s_policy != none && bytes >= 1024 * 1024;
+}
+
+void CPUMemoryPlacement::Place(void* p, size_t bytes)
+{
+#ifdef __linux__
+    // interleave the whole pages of the buffer; this only takes effect for pages not written yet
+    static const size_t numNodes = GetNumNumaNodes();
+    if (s_policy == interleave && numNodes > 1)
+    {
+        const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+        const size_t begin = ((size_t) p + pageSize - 1) / pageSize * pageSize;
+        const size_t end = ((size_t) p + bytes) / pageSize * pageSize;
+        unsigned long nodeMask[1024 / (8 * sizeof(unsigned long))] = {};
+        for (size_t node = 0; node < numNodes; node++)
+            nodeMask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+        const int mpolInterleave = 3; // MPOL_INTERLEAVE of <numaif.h>, which needs libnuma
+        if (end > begin && syscall(SYS_mbind, begin, end - begin, mpolInterleave, nodeMask, (unsigned long) 1024, 0) != 0)
+        {
+            static bool warned = false;
+            if (!warned)
+                fprintf(stderr, "CPUMemoryPlacement: WARNING: mbind() failed (errno %d), pages are placed by first touch.\n", errno);
+            warned = true;
+        }
+    }
+#endif
+    // each thread zeroes the part of the buffer that a static schedule over the elements gives it
+#pragma omp parallel
+    {
+        const size_t thread = omp_get_thread_num();
+        const size_t numThreads = omp_get_num_threads();
+        const size_t begin = bytes * thread / numThreads;
+        const size_t end = bytes * (thread + 1) / numThreads;
+        memset((char*) p + begin, 0, end - begin);
+    }
+}
+
+// Elementwise ops on float matrices go through the SIMD kernels of CPUVectorKernels. The elements of a CPUMatrix are
+// contiguous, so the matrix is processed as one array, which is split into chunks across the OpenMP threads.
+// Returns false (and does nothing) for other element types, which keep using the scalar loops.
+template <class ElemType, class KERNEL>
+static bool ApplyFloatVectorKernel(const ElemType* a, ElemType* us, size_t n, const KERNEL& kernel)
+{
+    if (sizeof(ElemType) != sizeof(float))
+        return false;
+
+    const long chunksize = 16384; // elements per work item
+    const long numchunks = (long) ((n + chunksize - 1) / chunksize);
+#pragma omp parallel for
+    for (long k = 0; k < numchunks; k++)
+    {
+        const size_t begin = (size_t) k * chunksize;
+        kernel((const float*) a + begin, (float*) us + begin, std::min((size_t) chunksize, n - begin));
+    }
+    return true;
+}
+
 #pragma region Helpful Enum Definitions
 enum class MatrixOrder
 {
@@ -155,6 +284,35 @@ static ElemType* NewArray(size_t n)
     return p;
 }
 
+// allocate and free the buffer of a matrix
+// Unlike NewArray(), which also makes the copies handed out to callers, these tell MemoryAccounting.
+template <class ElemType>
+static ElemType* NewBuffer(size_t n)
+{
+    ElemType* p;
+    const bool place = CPUMemoryPlacement::AppliesTo(n * sizeof(ElemType));
+    try
+    {
+        p = place ? new ElemType[n] : NewArray<ElemType>(n); // (without zeroing, the pages stay untouched for Place())
+    }
+    catch (const std::bad_alloc&)
+    {
+        MemoryAccounting::ReportOutOfMemory(CPUDEVICE, n * sizeof(ElemType));
+        throw;
+    }
+    if (place)
+        CPUMemoryPlacement::Place(p, n * sizeof(ElemType));
+    MemoryAccounting::RecordAllocation(CPUDEVICE, p, n * sizeof(ElemType));
+    return p;
+}
+
+template <class ElemType>
+static void DeleteBuffer(ElemType* p)
+{
+    MemoryAccounting::RecordFree(p);
+    delete[] p;
+}
+
 template <class ElemType>
 CPUMatrix<ElemType>::CPUMatrix(const size_t numRows, const size_t numCols)
 {
@@ -165,7 +323,7 @@ CPUMatrix<ElemType>::CPUMatrix(const size_t numRows, const size_t numCols)
     m_elemSizeAllocated = GetNumElements();
 
     if (m_elemSizeAllocated != 0)
-        m_pArray = NewArray<ElemType>(m_elemSizeAllocated);
+        m_pArray = NewBuffer<ElemType>(m_elemSizeAllocated);
 }
 
 template <class ElemType>
@@ -219,7 +377,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::operator=(CPUMatrix<ElemType>&& moveFr
     if (this != &moveFrom)
     {
         if (OwnBuffer() && m_pArray != nullptr)
-            delete[] m_pArray; // always delete the data pointer since we will use the pointer from moveFrom
+            DeleteBuffer(m_pArray); // always delete the data pointer since we will use the pointer from moveFrom
 
         m_computeDevice = moveFrom.m_computeDevice;
         m_numRows = moveFrom.m_numRows;
@@ -246,7 +404,7 @@ void CPUMatrix<ElemType>::Clear()
 {
     if (m_pArray != nullptr && OwnBuffer())
     {
-        delete[] m_pArray;
+        DeleteBuffer(m_pArray);
         m_pArray = nullptr;
         m_elemSizeAllocated = 0;
     }
@@ -321,6 +479,104 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::SetColumnSlice(const CPUMatrix<ElemTyp
     return *this;
 }
 
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignGatheredColumnsOf(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& columnIndices)
+{
+    const size_t m = a.GetNumRows();
+    const long n = (long) columnIndices.GetNumCols();
+    for (long j = 0; j < n; j++)
+    {
+        if ((size_t) columnIndices.m_pArray[j] >= a.GetNumCols())
+            InvalidArgument("AssignGatheredColumnsOf: Column index %d out of range.", (int) columnIndices.m_pArray[j]);
+    }
+    Resize(m, n);
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const size_t col = (size_t) columnIndices.m_pArray[j];
+        memcpy(m_pArray + j * m, a.m_pArray + col * m, m * sizeof(ElemType));
+    }
+    return *this;
+}
+
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddScatteredColumnsOf(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& columnIndices)
+{
+    const size_t m = a.GetNumRows();
+    const long n = (long) a.GetNumCols();
+    for (long j = 0; j < n; j++)
+    {
+        if ((size_t) columnIndices.m_pArray[j] >= GetNumCols())
+            InvalidArgument("AddScatteredColumnsOf: Column index %d out of range.", (int) columnIndices.m_pArray[j]);
+    }
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const size_t col = (size_t) columnIndices.m_pArray[j];
+        ElemType* pc = m_pArray + col * m;
+        const ElemType* pa = a.m_pArray + j * m;
+        for (size_t i = 0; i < m; i++)
+            pc[i] += pa[i];
+    }
+    return *this;
+}
+
+// see Matrix<ElemType>::AssignPackedHalfOf() for comments
+// Each column of this holds the 16-bit values of a column of a, followed by zeros to fill the last element.
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignPackedHalfOf(const CPUMatrix<ElemType>& a, HalfFormat format)
+{
+    const size_t m = a.GetNumRows();
+    const long n = (long) a.GetNumCols();
+    const size_t packedRows = (m * 2 + sizeof(ElemType) - 1) / sizeof(ElemType);
+    const size_t halvesPerColumn = packedRows * sizeof(ElemType) / 2;
+    Resize(packedRows, n);
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const ElemType* pa = a.m_pArray + j * m;
+        unsigned short* pu = (unsigned short*) (m_pArray + j * packedRows);
+        for (size_t i = 0; i < m; i++)
+            pu[i] = FloatToHalfBits((float) pa[i], format);
+        for (size_t i = m; i < halvesPerColumn; i++)
+            pu[i] = 0;
+    }
+    return *this;
+}
+
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignUnpackedHalfOf(const CPUMatrix<ElemType>& packed, size_t numRows, HalfFormat format)
+{
+    const size_t packedRows = packed.GetNumRows();
+    const long n = (long) packed.GetNumCols();
+    Resize(numRows, n);
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const unsigned short* pu = (const unsigned short*) (packed.m_pArray + j * packedRows);
+        ElemType* pc = m_pArray + j * numRows;
+        for (size_t i = 0; i < numRows; i++)
+            pc[i] = (ElemType) HalfBitsToFloat(pu[i], format);
+    }
+    return *this;
+}
+
+// see Matrix<ElemType>::AssignAliasSamplesOf() for comments
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignAliasSamplesOf(const CPUMatrix<ElemType>& aliasTable, const CPUMatrix<ElemType>& uniforms)
+{
+    const size_t V = aliasTable.GetNumCols();
+    const long k = (long) uniforms.GetNumCols();
+    Resize(1, k);
+#pragma omp parallel for
+    for (long j = 0; j < k; j++)
+    {
+        const size_t bucket = min((size_t) (uniforms.m_pArray[2 * j] * V), V - 1);
+        m_pArray[j] = uniforms.m_pArray[2 * j + 1] < aliasTable.m_pArray[2 * bucket] ? (ElemType) bucket : aliasTable.m_pArray[2 * bucket + 1];
+    }
+    return *this;
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::CopyColumnsStrided(const CPUMatrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride)
 {
@@ -623,6 +879,25 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddToRowRepeatValuesOf(const CPUMatrix
     return *this;
 }
 
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignPackedImages(const void* packedImages)
+{
+    const auto* header = reinterpret_cast<const PackedImagesHeader*>(packedImages);
+    const long m = (long) header->m_width * header->m_height * header->m_channels;
+    const long n = (long) header->m_numImages;
+    Resize(m, n);
+    auto& us = *this;
+
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        for (long i = 0; i < m; i++)
+            us(i, j) = PackedImageValue<ElemType>(header, i, j);
+    }
+
+    return *this;
+}
+
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignPositiveAndShiftedNegSample(const CPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber)
 {
@@ -852,7 +1127,7 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     {
         // free previous array allocation if any before overwriting
         if (m_pArray != nullptr)
-            delete[] m_pArray;
+            DeleteBuffer(m_pArray);
 
         m_pArray = pArray;
         m_numRows = numRows;
@@ -1127,6 +1402,49 @@ void CPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     }
 }
 
+// see Matrix<ElemType>::SetPhiloxUniformRandomValue() for comments
+// a, b: low and high, or mean and sigma
+template <class ElemType>
+void CPUMatrix<ElemType>::SetPhiloxRandomValue(const bool gaussian, const ElemType a, const ElemType b, unsigned long seed)
+{
+    const long long N = (long long) GetNumElements();
+    ElemType* p = m_pArray;
+#pragma omp parallel for
+    for (long long i = 0; i < N; i += 4) // each call of the generator gives four numbers
+    {
+        const Philox4x32 r = PhiloxRandomAt(seed, 0, i);
+        for (int slot = 0; slot < 4 && i + slot < N; slot++)
+            p[i + slot] = gaussian ? (ElemType)(a + b * PhiloxNormal(r, slot)) : (ElemType)(a + (b - a) * PhiloxUniform(r.v[slot]));
+    }
+}
+
+// see Matrix<ElemType>::AssignDropoutOf() for comments
+// this = beta * this + a .* mask
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::ScaleAndAddDropoutOf(const ElemType beta, const CPUMatrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset)
+{
+    const long long N = (long long) GetNumElements();
+    const ElemType scale = (ElemType)(1 / (1 - (double) dropoutRate));
+    const long long firstBlock = (long long) (offset / 4);
+    const long long endBlock = (long long) ((offset + N + 3) / 4);
+    const ElemType* pa = a.m_pArray;
+    ElemType* pc = m_pArray;
+#pragma omp parallel for
+    for (long long block = firstBlock; block < endBlock; block++)
+    {
+        const Philox4x32 r = PhiloxRandomAt(seed, stream, 4 * block);
+        for (int slot = 0; slot < 4; slot++)
+        {
+            const long long i = 4 * block + slot - (long long) offset;
+            if (i < 0 || i >= N)
+                continue;
+            const ElemType v = PhiloxUniform(r.v[slot]) < dropoutRate ? 0 : scale * pa[i];
+            pc[i] = beta == 0 ? v : beta * pc[i] + v;
+        }
+    }
+    return *this;
+}
+
 template <class ElemType>
 ElemType CPUMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1242,6 +1560,39 @@ void CPUMatrix<ElemType>::FSAdagrad(CPUMatrix<ElemType>& gradients,
     }
 }
 
+// Adam, see Matrix::Adam() and Matrix::Lamb(); this = [first moments, second moments]
+template <class ElemType>
+void CPUMatrix<ElemType>::Adam(CPUMatrix<ElemType>& gradients, CPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+                              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+    size_t numColsNeeded = 2 * gradients.GetNumCols();
+    if (IsEmpty() || (GetNumCols() < numColsNeeded))
+    {
+        Resize(gradients.GetNumRows(), numColsNeeded);
+        SetValue(0.0);
+    }
+
+    assert((GetNumRows() == gradients.GetNumRows()) && (GetNumCols() == numColsNeeded));
+
+    size_t n = gradients.GetNumElements();
+    ElemType* grad = gradients.m_pArray;
+    ElemType* smoothMom = m_pArray;
+    ElemType* smoothSqr = m_pArray + n;
+    ElemType* val = functionValues.m_pArray;
+#pragma omp parallel for
+    for (long i = 0; i < n; i++)
+    {
+        ElemType g = grad[i];
+        smoothMom[i] = beta1 * smoothMom[i] + (1 - beta1) * g;
+        smoothSqr[i] = beta2 * smoothSqr[i] + (1 - beta2) * g * g;
+        ElemType d = smoothMom[i] * biasCorrection1 / (sqrt(smoothSqr[i] * biasCorrection2) + epsilon);
+        if (directionOnly)
+            grad[i] = d + weightDecay * val[i];
+        else
+            val[i] -= learnRatePerSample * d;
+    }
+}
+
 template <class ElemType>
 ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
                                       ElemType RMS_GAMMA,
@@ -1371,11 +1722,11 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
         {
             if (!OwnBuffer())
                 LogicError("Resize: Resizing an matrix you don't own is not supported.");
-            pArray = NewArray<ElemType>(numElements);
+            pArray = NewBuffer<ElemType>(numElements);
         }
         // success: update the object
         if (OwnBuffer())
-            delete[] m_pArray;
+            DeleteBuffer(m_pArray);
         else
             assert(pArray == nullptr); // (if !OwnBuffer we can still resize to 0)
         m_pArray = pArray;
@@ -2078,6 +2429,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidOf(const CPUMatrix<ElemTy
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (ApplyFloatVectorKernel(a.m_pArray, m_pArray, GetNumElements(), CPUVectorKernels::Get().Sigmoid))
+        return *this;
+
 #pragma omp parallel for
     foreach_coord (i, j, us)
     {
@@ -2194,6 +2548,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTanhOf(const CPUMatrix<ElemType>
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (ApplyFloatVectorKernel(a.m_pArray, m_pArray, GetNumElements(), CPUVectorKernels::Get().Tanh))
+        return *this;
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2233,7 +2590,21 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
-    if (isColWise)
+    if (isColWise && sizeof(ElemType) == sizeof(float)) // columns are contiguous: vectorized kernels
+    {
+        const size_t m = a.GetNumRows();
+        const CPUVectorKernels& kernels = CPUVectorKernels::Get();
+#pragma omp parallel for
+        foreach_column (j, a)
+        {
+            const float* pa = (const float*) a.m_pArray + a.LocateColumn(j);
+            float* pus = (float*) m_pArray + LocateColumn(j);
+            const float maxV = kernels.Max(pa, m);
+            const float sum = kernels.SubtractAndSumExp(pa, maxV, pus, m);
+            kernels.AddScalar(pus, -log(sum), pus, m);
+        }
+    }
+    else if (isColWise)
     {
 #pragma omp parallel for
         foreach_column (j, a)
@@ -2395,6 +2766,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignExpOf(const CPUMatrix<ElemType>&
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (ApplyFloatVectorKernel(a.m_pArray, m_pArray, GetNumElements(), CPUVectorKernels::Get().Exp))
+        return *this;
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2480,6 +2854,12 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogOf(const CPUMatrix<ElemType>&
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (ApplyFloatVectorKernel(a.m_pArray, m_pArray, GetNumElements(), [](const float* pa, float* pus, size_t n)
+                               {
+                                   CPUVectorKernels::Get().Log(pa, EPS_IN_LOG, LOG_OF_EPS_IN_LOG, pus, n);
+                               }))
+        return *this;
+
 #pragma omp parallel for
     foreach_coord (i, j, a)
     {
@@ -2625,6 +3005,12 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceTruncate(const ElemType thresho
     ElemType locThresholdPos = abs(threshold);
     ElemType locTHresholdNeg = -locThresholdPos;
 
+    if (ApplyFloatVectorKernel(m_pArray, m_pArray, GetNumElements(), [locThresholdPos, locTHresholdNeg](const float* pa, float* pus, size_t n)
+                               {
+                                   CPUVectorKernels::Get().Clip(pa, (float) locTHresholdNeg, (float) locThresholdPos, pus, n);
+                               }))
+        return *this;
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2839,6 +3225,16 @@ ElemType CPUMatrix<ElemType>::SumOfElements() const
     ElemType sum = 0;
     long m = (long) GetNumElements(); // note: OpenMP requires loop indices to be long, not size_t
 
+    if (sizeof(ElemType) == sizeof(float)) // vectorized partial sums of chunks
+    {
+        const long chunksize = 16384;
+        const long numchunks = (m + chunksize - 1) / chunksize;
+#pragma omp parallel for reduction(+ : sum)
+        for (long k = 0; k < numchunks; k++)
+            sum += CPUVectorKernels::Get().Sum((const float*) m_pArray + k * chunksize, std::min(chunksize, m - k * chunksize));
+        return sum;
+    }
+
 //four-way unrolling
 #pragma omp parallel for reduction(+ : sum)
     for (long i = 0; i < (m & ~3); i += 4)
@@ -2884,6 +3280,31 @@ void CPUMatrix<ElemType>::VectorSum(const CPUMatrix<ElemType>& a, CPUMatrix<Elem
 
     assert(m > 0 && n > 0); // converting from size_t to int may cause overflow
 
+    if (sizeof(ElemType) == sizeof(float)) // vectorized; columns are contiguous
+    {
+        const CPUVectorKernels& kernels = CPUVectorKernels::Get();
+        if (isColWise)
+        {
+            c.Resize(1, n);
+#pragma omp parallel for
+            foreach_column (j, a)
+                c(0, j) = (ElemType) kernels.Sum((const float*) a.m_pArray + a.LocateColumn(j), m);
+        }
+        else // sum of the columns, in chunks of rows
+        {
+            c.Resize(m, 1);
+            c.SetValue(0);
+            const int chunksize = 1024;
+#pragma omp parallel for
+            for (int i = 0; i < m; i += chunksize)
+            {
+                foreach_column (j, a)
+                    kernels.AddTo((const float*) a.m_pArray + a.LocateElement(i, j), (float*) c.m_pArray + i, std::min(chunksize, m - i));
+            }
+        }
+        return;
+    }
+
     if (isColWise) // col-wise
     {
         c.Resize(1, n);
@@ -3125,23 +3546,26 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignKhatriRaoProductOf(const CPUMatr
     if (cols != b.GetNumCols())
         InvalidArgument("a.GetNumCols() != b.GetNumCols()");
 
-    long rowsA = (long) a.GetNumRows();
-    long rowsB = (long) b.GetNumRows();
+    const size_t rowsA = a.GetNumRows();
+    const size_t rowsB = b.GetNumRows();
     Resize(rowsA * rowsB, cols);
 
-#ifdef __INTEL_COMPILER // TODO: check this
-#pragma simd statement
-#endif
-#pragma omp parallel for
+    // column k is b(:,k) a(:,k)^T, flattened: one scaled copy of a(:,k) per element of b(:,k), which the compiler vectorizes
+    const ElemType* pa = a.m_pArray;
+    const ElemType* pb = b.m_pArray;
+    ElemType* pus = m_pArray;
+#pragma omp parallel for if (rowsA * rowsB * cols >= 65536)
     for (long k = 0; k < cols; k++)
     {
-        long jj = 0;
-        for (long j = 0; j < rowsB; j++)
+        const ElemType* ak = pa + k * rowsA;
+        const ElemType* bk = pb + k * rowsB;
+        ElemType* usk = pus + k * rowsA * rowsB;
+        for (size_t j = 0; j < rowsB; j++)
         {
-            for (long i = 0; i < rowsA; i++)
-            {
-                (*this)(jj++, k) = a(i, k) * b(j, k);
-            }
+            const ElemType bjk = bk[j];
+            ElemType* out = usk + j * rowsA;
+            for (size_t i = 0; i < rowsA; i++)
+                out[i] = ak[i] * bjk;
         }
     }
 
@@ -3174,52 +3598,37 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddColumnReshapeProductOf(const CPUMat
     if (rowsC != GetNumRows() || cols != GetNumCols())
         InvalidArgument("AddColumnReshapeProductOf: This matrix does not have the right size.");
 
-    auto& us = *this;
-
-    if (transposeAColumn)
+    // both products read column t of a, A_t, contiguously
+    const ElemType* pa = a.m_pArray;
+    const ElemType* pb = b.m_pArray;
+    ElemType* pus = m_pArray;
+#pragma omp parallel for if (rowsA * cols >= 65536)
+    for (long t = 0; t < cols; t++)
     {
-        // find nrows and ncols of tbe reshaped a
-        long nrows = rowsB;
-        long ncols = rowsC;
-
-#ifdef __INTEL_COMPILER // TODO: check this
-#pragma simd statement
-#endif
-#pragma omp parallel for
-        foreach_column (t, a)
+        const ElemType* at = pa + t * rowsA;
+        const ElemType* bt = pb + t * rowsB;
+        ElemType* ust = pus + t * rowsC;
+        if (transposeAColumn)
         {
-            size_t k = 0;
-            for (size_t j = 0; j < ncols; j++) // row and col is transposed
+            // A_t is rowsB x rowsC, and us(:,t) += A_t^T b(:,t): one dot product per column of A_t
+            for (long j = 0; j < rowsC; j++)
             {
+                const ElemType* atj = at + j * rowsB;
                 ElemType v = 0;
-                for (size_t i = 0; i < nrows; i++)
-                {
-                    v += a(k, t) * b(i, t);
-                    k++;
-                }
-                us(j, t) += v;
+                for (long i = 0; i < rowsB; i++)
+                    v += atj[i] * bt[i];
+                ust[j] += v;
             }
         }
-    }
-    else
-    {
-        size_t ncols = rowsB;
-        size_t nrows = rowsC;
-
-#ifdef __INTEL_COMPILER // TODO: check this
-#pragma simd statement
-#endif
-#pragma omp parallel for
-        foreach_column (t, a)
+        else
         {
-            size_t k = 0;
-            for (size_t j = 0; j < ncols; j++)
+            // A_t is rowsC x rowsB, and us(:,t) += A_t b(:,t): one scaled column of A_t added at a time, which the compiler vectorizes
+            for (long j = 0; j < rowsB; j++)
             {
-                for (size_t i = 0; i < nrows; i++)
-                {
-                    us(i, t) += a(k, t) * b(j, t);
-                    k++;
-                }
+                const ElemType* atj = at + j * rowsC;
+                const ElemType bjt = bt[j];
+                for (long i = 0; i < rowsC; i++)
+                    ust[i] += atj[i] * bjt;
             }
         }
     }
@@ -3435,12 +3844,12 @@ void CPUMatrix<ElemType>::VectorMax(CPUMatrix<ElemType>& maxIndexes, CPUMatrix<E
             ElemType* curMax = maxValues.m_pArray;
             for (int icol = 0; icol < n; icol++, curVal += m, curIdx += topK, curMax += topK)
             {
-                // Partial sort, descending order.
-                std::nth_element(indices.begin(), indices.begin() + topK, indices.end(),
-                                 [curVal](const int& a, const int& b)
-                                 {
-                                     return curVal[a] > curVal[b];
-                                 });
+                // Partial sort, descending order, ties to the lower index (as on the GPU).
+                std::partial_sort(indices.begin(), indices.begin() + topK, indices.end(),
+                                  [curVal](const int& a, const int& b)
+                                  {
+                                      return curVal[a] > curVal[b] || (curVal[a] == curVal[b] && a < b);
+                                  });
                 // REVIEW alexeyk: the following produces warning (see SCL_SECURE_NO_WARNINGS) so use loop instead.
                 // std::transform(indices.begin(), indices.begin() + topK, curIdx, [](const int& a) { return static_cast<ElemType>(a); });
                 for (int i = 0; i < topK; i++)
@@ -4027,6 +4436,83 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddAveragePoolingGradient(const CPUMat
 
 #pragma region Static BLAS Functions
 
+static const size_t s_multiTensorChunkSize = 65536; // elements per chunk
+
+// the (tensor, first element) of the chunks of the multi-tensor functions, in which the threads share the work
+static std::vector<std::pair<size_t, size_t>> MultiTensorChunks(const std::vector<size_t>& numElements)
+{
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t i = 0; i < numElements.size(); i++)
+        for (size_t begin = 0; begin < numElements[i]; begin += s_multiTensorChunkSize)
+            chunks.push_back(std::make_pair(i, begin));
+    return chunks;
+}
+
+// sumsOfSquares[i] = the squared Frobenius norm of matrices[i]
+template <class ElemType>
+void CPUMatrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const CPUMatrix<ElemType>*>& matrices, std::vector<double>& sumsOfSquares)
+{
+    std::vector<size_t> numElements;
+    for (const auto* matrix : matrices)
+        numElements.push_back(matrix->GetNumElements());
+    const auto chunks = MultiTensorChunks(numElements);
+    std::vector<double> partialSums(chunks.size());
+#pragma omp parallel for
+    for (long k = 0; k < (long) chunks.size(); k++)
+    {
+        const ElemType* g = matrices[chunks[k].first]->m_pArray;
+        const size_t end = min(chunks[k].second + s_multiTensorChunkSize, numElements[chunks[k].first]);
+        double sum = 0;
+        for (size_t j = chunks[k].second; j < end; j++)
+            sum += (double) g[j] * g[j];
+        partialSums[k] = sum;
+    }
+
+    sumsOfSquares.assign(matrices.size(), 0);
+    for (size_t k = 0; k < chunks.size(); k++)
+        sumsOfSquares[chunks[k].first] += partialSums[k];
+}
+
+// the SGD update of all weights[i], see Matrix::MultiTensorSGDUpdate()
+template <class ElemType>
+void CPUMatrix<ElemType>::MultiTensorSGDUpdate(const std::vector<CPUMatrix<ElemType>*>& weights, const std::vector<const CPUMatrix<ElemType>*>& gradients, const std::vector<CPUMatrix<ElemType>*>& smoothedGradients,
+                                               const std::vector<ElemType>& gradientScales, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                               const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad)
+{
+    std::vector<size_t> numElements;
+    for (const auto* matrix : weights)
+        numElements.push_back(matrix->GetNumElements());
+    const auto chunks = MultiTensorChunks(numElements);
+#pragma omp parallel for
+    for (long k = 0; k < (long) chunks.size(); k++)
+    {
+        const size_t i = chunks[k].first;
+        ElemType* w = weights[i]->m_pArray;
+        const ElemType* g = gradients[i]->m_pArray;
+        ElemType* s = smoothedGradients[i]->m_pArray;
+        const ElemType scale = gradientScales[i];
+        const size_t end = min(chunks[k].second + s_multiTensorChunkSize, numElements[i]);
+        for (size_t j = chunks[k].second; j < end; j++)
+        {
+            ElemType gj = scale * g[j];
+            if (truncation > 0)
+                gj = max(-truncation, min(gj, truncation));
+            gj += l2RegWeight * w[j];
+            if (useAdaGrad)
+            {
+                const ElemType floor = 1e-16f;
+                s[j] += gj * gj;
+                w[j] -= learnRatePerSample * gj / sqrt(s[j] + floor);
+            }
+            else
+            {
+                s[j] = (1 - momentum) * learnRatePerSample * gj + momentum * s[j];
+                w[j] -= useNesterovMomentum ? momentum * s[j] + (1 - momentum) * learnRatePerSample * gj : s[j];
+            }
+        }
+    }
+}
+
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c = alpha * op(a) * op(b) + beta*c</summary>
 /// <param name="alpha">Scalar</param>
 /// <param name="a">Input matrix</param>
@@ -4924,18 +5410,635 @@ void CPUMatrix<ElemType>::TensorShuffleScaleAndAdd(ElemType keepWeight, const CP
     }
 }
 
+// see Matrix<ElemType>::LSTMPointwiseForward() for comments
 template <class ElemType>
-CPUMatrix<ElemType> CPUMatrix<ElemType>::Ones(const size_t rows, const size_t cols)
+void CPUMatrix<ElemType>::LSTMPointwiseForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>* peepholes, CPUMatrix<ElemType>& cell, CPUMatrix<ElemType>& output)
 {
-    CPUMatrix<ElemType> c(rows, cols); // will initialize to 0
-    c.SetValue(1);
-    return c;
+    const long H = (long) cell.GetNumRows(), S = (long) cell.GetNumCols();
+    const ElemType* pp = peepholes ? peepholes->m_pArray : nullptr;
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        ElemType* pz = gates.m_pArray + s * 4 * H;
+        const ElemType* pcp = prevCell.m_pArray + s * H;
+        ElemType* pc = cell.m_pArray + s * H;
+        ElemType* ph = output.m_pArray + s * H;
+        for (long j = 0; j < H; j++)
+        {
+            ElemType cp = pcp[j];
+            ElemType i = Microsoft::MSR::CNTK::Sigmoid(pp ? pz[j] + pp[j] * cp : pz[j]);
+            ElemType f = Microsoft::MSR::CNTK::Sigmoid(pp ? pz[H + j] + pp[H + j] * cp : pz[H + j]);
+            ElemType g = tanh_(pz[3 * H + j]);
+            ElemType c = f * cp + i * g;
+            ElemType o = Microsoft::MSR::CNTK::Sigmoid(pp ? pz[2 * H + j] + pp[2 * H + j] * c : pz[2 * H + j]);
+            pz[j] = i;
+            pz[H + j] = f;
+            pz[2 * H + j] = o;
+            pz[3 * H + j] = g;
+            pc[j] = c;
+            ph[j] = o * tanh_(c);
+        }
+    }
 }
 
+// see Matrix<ElemType>::LSTMPointwiseBackward() for comments
 template <class ElemType>
-CPUMatrix<ElemType> CPUMatrix<ElemType>::Zeros(const size_t rows, const size_t cols)
+void CPUMatrix<ElemType>::LSTMPointwiseBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& cell, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>* peepholes, const CPUMatrix<ElemType>& outputGradient,
+                                                CPUMatrix<ElemType>& cellGradient, CPUMatrix<ElemType>& gatesGradient)
 {
-    CPUMatrix<ElemType> c(rows, cols); // will initialize to 0
+    const long H = (long) cell.GetNumRows(), S = (long) cell.GetNumCols();
+    const ElemType* pp = peepholes ? peepholes->m_pArray : nullptr;
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const ElemType* pz = gates.m_pArray + s * 4 * H;
+        const ElemType* pc = cell.m_pArray + s * H;
+        const ElemType* pcp = prevCell.m_pArray + s * H;
+        const ElemType* pdh = outputGradient.m_pArray + s * H;
+        ElemType* pdc = cellGradient.m_pArray + s * H;
+        ElemType* pdz = gatesGradient.m_pArray + s * 4 * H;
+        for (long j = 0; j < H; j++)
+        {
+            ElemType i = pz[j], f = pz[H + j], o = pz[2 * H + j], g = pz[3 * H + j];
+            ElemType tc = tanh_(pc[j]);
+            ElemType dh = pdh[j];
+            ElemType dzo = dh * tc * o * (1 - o);
+            ElemType dc = pdc[j] + dh * o * (1 - tc * tc);
+            if (pp)
+                dc += dzo * pp[2 * H + j];
+            ElemType dzi = dc * g * i * (1 - i);
+            ElemType dzf = dc * pcp[j] * f * (1 - f);
+            pdz[j] = dzi;
+            pdz[H + j] = dzf;
+            pdz[2 * H + j] = dzo;
+            pdz[3 * H + j] = dc * i * (1 - g * g);
+            pdc[j] = pp ? dc * f + dzi * pp[j] + dzf * pp[H + j] : dc * f;
+        }
+    }
+}
+
+// see Matrix<ElemType>::GRUPointwiseForward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::GRUPointwiseForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, CPUMatrix<ElemType>& output)
+{
+    const long H = (long) output.GetNumRows(), S = (long) output.GetNumCols();
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        ElemType* pz = gates.m_pArray + s * 3 * H;
+        const ElemType* pq = recurrent.m_pArray + s * 3 * H;
+        const ElemType* php = prevOutput.m_pArray + s * H;
+        ElemType* ph = output.m_pArray + s * H;
+        for (long j = 0; j < H; j++)
+        {
+            ElemType r = Microsoft::MSR::CNTK::Sigmoid(pz[j] + pq[j]);
+            ElemType u = Microsoft::MSR::CNTK::Sigmoid(pz[H + j] + pq[H + j]);
+            ElemType n = tanh_(pz[2 * H + j] + r * pq[2 * H + j]);
+            pz[j] = r;
+            pz[H + j] = u;
+            pz[2 * H + j] = n;
+            ph[j] = (1 - u) * n + u * php[j];
+        }
+    }
+}
+
+// see Matrix<ElemType>::GRUPointwiseBackward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::GRUPointwiseBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, CPUMatrix<ElemType>& outputGradient,
+                                               CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& recurrentGradient)
+{
+    const long H = (long) prevOutput.GetNumRows(), S = (long) prevOutput.GetNumCols();
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const ElemType* pz = gates.m_pArray + s * 3 * H;
+        const ElemType* pq = recurrent.m_pArray + s * 3 * H;
+        const ElemType* php = prevOutput.m_pArray + s * H;
+        ElemType* pdh = outputGradient.m_pArray + s * H;
+        ElemType* pdz = gatesGradient.m_pArray + s * 3 * H;
+        ElemType* pdq = recurrentGradient.m_pArray + s * 3 * H;
+        for (long j = 0; j < H; j++)
+        {
+            ElemType r = pz[j], u = pz[H + j], n = pz[2 * H + j];
+            ElemType dh = pdh[j];
+            ElemType dn = dh * (1 - u) * (1 - n * n);
+            ElemType du = dh * (php[j] - n) * u * (1 - u);
+            ElemType dr = dn * pq[2 * H + j] * r * (1 - r);
+            pdz[j] = pdq[j] = dr;
+            pdz[H + j] = pdq[H + j] = du;
+            pdz[2 * H + j] = dn;
+            pdq[2 * H + j] = dn * r;
+            pdh[j] = dh * u;
+        }
+    }
+}
+
+// see Matrix<ElemType>::CosDistanceWithNegativeSamples() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::CosDistanceWithNegativeSamples(const CPUMatrix<ElemType>& left, const CPUMatrix<ElemType>& right, size_t shift,
+                                                         CPUMatrix<ElemType>& invNormLeft, CPUMatrix<ElemType>& invNormRight, CPUMatrix<ElemType>& cosDistance)
+{
+    const long D = (long) left.GetNumRows(), n = (long) left.GetNumCols(), M = (long) cosDistance.GetNumRows();
+    ElemType* pia = invNormLeft.m_pArray;
+    ElemType* pib = invNormRight.m_pArray;
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const ElemType* pa = left.m_pArray + j * D;
+        const ElemType* pb = right.m_pArray + j * D;
+        ElemType sa = 0, sb = 0;
+        for (long d = 0; d < D; d++)
+        {
+            sa += pa[d] * pa[d];
+            sb += pb[d] * pb[d];
+        }
+        pia[j] = 1 / sqrt(sa);
+        pib[j] = 1 / sqrt(sb);
+    }
+#pragma omp parallel for
+    for (long j = 0; j < n; j++)
+    {
+        const ElemType* pa = left.m_pArray + j * D;
+        ElemType* pc = cosDistance.m_pArray + j * M;
+        for (long m = 0; m < M; m++)
+        {
+            const long k = m == 0 ? j : (long) ((j + shift + m - 1) % n);
+            const ElemType* pb = right.m_pArray + k * D;
+            ElemType dot = 0;
+            for (long d = 0; d < D; d++)
+                dot += pa[d] * pb[d];
+            pc[m] = dot * pia[j] * pib[k];
+        }
+    }
+}
+
+// see Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient() for comments
+// With c = ia ib a^T b, where ia = 1 / ||a|| and ib = 1 / ||b||: dc/da = ia ib b - c ia^2 a, and symmetrically for b.
+template <class ElemType>
+void CPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(const CPUMatrix<ElemType>& left, const CPUMatrix<ElemType>& right, const CPUMatrix<ElemType>& invNormLeft, const CPUMatrix<ElemType>& invNormRight,
+                                                                 const CPUMatrix<ElemType>& cosDistance, const CPUMatrix<ElemType>& gradient, size_t shift, bool wrtRight, CPUMatrix<ElemType>& inputGradient)
+{
+    const long D = (long) left.GetNumRows(), n = (long) left.GetNumCols(), M = (long) cosDistance.GetNumRows();
+    // the gradient w.r.t. one side is that of the other side's formula with the roles swapped; only the column pairing differs
+    const CPUMatrix<ElemType>& self = wrtRight ? right : left;
+    const CPUMatrix<ElemType>& other = wrtRight ? left : right;
+    const ElemType* pis = (wrtRight ? invNormRight : invNormLeft).m_pArray;
+    const ElemType* pio = (wrtRight ? invNormLeft : invNormRight).m_pArray;
+#pragma omp parallel for
+    for (long i = 0; i < n; i++) // (column of the input gradient)
+    {
+        const ElemType* ps = self.m_pArray + i * D;
+        ElemType* pdi = inputGradient.m_pArray + i * D;
+        ElemType selfCoef = 0;
+        for (long m = 0; m < M; m++)
+        {
+            // the similarity in row m that column i takes part in is that of left column j, and o is its column on the other side
+            const long s = m == 0 ? 0 : (long) ((shift + m - 1) % n);
+            const long j = wrtRight ? (i - s + n) % n : i;
+            const long o = wrtRight ? j : (i + s) % n;
+            const ElemType g = gradient.m_pArray[j * M + m];
+            const ElemType otherCoef = g * pis[i] * pio[o];
+            selfCoef += g * cosDistance.m_pArray[j * M + m] * pis[i] * pis[i];
+            const ElemType* po = other.m_pArray + o * D;
+            for (long d = 0; d < D; d++)
+                pdi[d] += otherCoef * po[d];
+        }
+        for (long d = 0; d < D; d++)
+            pdi[d] -= selfCoef * ps[d];
+    }
+}
+
+// see Matrix<ElemType>::AttentionForward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::AttentionForward(const CPUMatrix<ElemType>& query, const CPUMatrix<ElemType>& keys, const CPUMatrix<ElemType>& values, const CPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                           CPUMatrix<ElemType>& context, CPUMatrix<ElemType>& logSumExp)
+{
+    const long D = (long) query.GetNumRows(), Dv = (long) values.GetNumRows(), Nq = (long) query.GetNumCols();
+#pragma omp parallel for
+    for (long j = 0; j < Nq; j++)
+    {
+        const size_t first = (size_t) keyRanges.m_pArray[2 * j];
+        const long n = (long) keyRanges.m_pArray[2 * j + 1];
+        const ElemType* pq = query.m_pArray + j * D;
+        ElemType* pc = context.m_pArray + j * Dv;
+        for (long d = 0; d < Dv; d++)
+            pc[d] = 0;
+        logSumExp.m_pArray[j] = 0;
+        if (n == 0)
+            continue;
+
+        // the scores of one query take only n elements, so unlike on the GPU they are kept rather than recomputed
+        vector<ElemType> p(n);
+        ElemType maxScore = 0;
+        for (long i = 0; i < n; i++)
+        {
+            const ElemType* pk = keys.m_pArray + (first + i * keyStride) * D;
+            ElemType score = 0;
+            for (long d = 0; d < D; d++)
+                score += pq[d] * pk[d];
+            p[i] = scale * score;
+            if (i == 0 || p[i] > maxScore)
+                maxScore = p[i];
+        }
+        ElemType sum = 0;
+        for (long i = 0; i < n; i++)
+        {
+            p[i] = exp(p[i] - maxScore);
+            sum += p[i];
+        }
+        for (long i = 0; i < n; i++)
+        {
+            const ElemType w = p[i] / sum;
+            const ElemType* pv = values.m_pArray + (first + i * keyStride) * Dv;
+            for (long d = 0; d < Dv; d++)
+                pc[d] += w * pv[d];
+        }
+        logSumExp.m_pArray[j] = maxScore + log(sum);
+    }
+}
+
+// see Matrix<ElemType>::AttentionBackward() for comments
+// Queries of different sequences would touch disjoint keys, but this function does not know about sequences, so it runs sequentially.
+template <class ElemType>
+void CPUMatrix<ElemType>::AttentionBackward(const CPUMatrix<ElemType>& query, const CPUMatrix<ElemType>& keys, const CPUMatrix<ElemType>& values, const CPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                            const CPUMatrix<ElemType>& context, const CPUMatrix<ElemType>& logSumExp, const CPUMatrix<ElemType>& contextGradient,
+                                            CPUMatrix<ElemType>* queryGradient, CPUMatrix<ElemType>* keysGradient, CPUMatrix<ElemType>* valuesGradient)
+{
+    const long D = (long) query.GetNumRows(), Dv = (long) values.GetNumRows(), Nq = (long) query.GetNumCols();
+    for (long j = 0; j < Nq; j++)
+    {
+        const size_t first = (size_t) keyRanges.m_pArray[2 * j];
+        const long n = (long) keyRanges.m_pArray[2 * j + 1];
+        const ElemType* pq = query.m_pArray + j * D;
+        const ElemType* pdc = contextGradient.m_pArray + j * Dv;
+        const ElemType* pc = context.m_pArray + j * Dv;
+        const ElemType lse = logSumExp.m_pArray[j];
+
+        // with p_i = softmax_i(s), ds_i = p_i (dc^T v_i - dc^T c), where dc^T c = sum_i p_i dc^T v_i
+        ElemType delta = 0;
+        for (long d = 0; d < Dv; d++)
+            delta += pdc[d] * pc[d];
+        for (long i = 0; i < n; i++)
+        {
+            const size_t col = first + i * keyStride;
+            const ElemType* pk = keys.m_pArray + col * D;
+            const ElemType* pv = values.m_pArray + col * Dv;
+            ElemType score = 0;
+            for (long d = 0; d < D; d++)
+                score += pq[d] * pk[d];
+            const ElemType p = exp(scale * score - lse);
+            ElemType dp = 0;
+            for (long d = 0; d < Dv; d++)
+                dp += pdc[d] * pv[d];
+            const ElemType ds = p * (dp - delta);
+            if (queryGradient)
+            {
+                ElemType* pdq = queryGradient->m_pArray + j * D;
+                for (long d = 0; d < D; d++)
+                    pdq[d] += scale * ds * pk[d];
+            }
+            if (keysGradient)
+            {
+                ElemType* pdk = keysGradient->m_pArray + col * D;
+                for (long d = 0; d < D; d++)
+                    pdk[d] += scale * ds * pq[d];
+            }
+            if (valuesGradient)
+            {
+                ElemType* pdv = valuesGradient->m_pArray + col * Dv;
+                for (long d = 0; d < Dv; d++)
+                    pdv[d] += p * pdc[d];
+            }
+        }
+    }
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxForward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::CrossEntropyWithSoftmaxForward(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& columnLoss)
+{
+    const long M = (long) logits.GetNumRows(), N = (long) logits.GetNumCols();
+#pragma omp parallel for
+    for (long j = 0; j < N; j++)
+    {
+        const ElemType* pz = logits.m_pArray + j * M;
+        const ElemType* pl = labels.m_pArray + j * M;
+        ElemType maxv = pz[0];
+        for (long i = 1; i < M; i++)
+        {
+            if (pz[i] > maxv)
+                maxv = pz[i];
+        }
+        ElemType sum = 0, labelSum = 0, dot = 0; // dot = sum_i l_i * (z_i - maxv)
+        for (long i = 0; i < M; i++)
+        {
+            sum += exp(pz[i] - maxv);
+            labelSum += pl[i];
+            dot += pl[i] * (pz[i] - maxv);
+        }
+        const ElemType logSum = log(sum);
+        logSumExp.m_pArray[j] = maxv + logSum;
+        columnLoss.m_pArray[j] = labelSum * logSum - dot;
+    }
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxBackward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp,
+                                                          CPUMatrix<ElemType>& gradient)
+{
+    const long M = (long) logits.GetNumRows(), N = (long) logits.GetNumCols();
+    const ElemType a = alpha.m_pArray[0];
+#pragma omp parallel for
+    for (long j = 0; j < N; j++)
+    {
+        const ElemType* pz = logits.m_pArray + j * M;
+        const ElemType* pl = labels.m_pArray + j * M;
+        ElemType* pg = gradient.m_pArray + j * M;
+        const ElemType lse = logSumExp.m_pArray[j];
+        for (long i = 0; i < M; i++)
+            pg[i] += a * (exp(pz[i] - lse) - pl[i]);
+    }
+}
+
+// see Matrix<ElemType>::SegmentedLogSoftmax() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::SegmentedLogSoftmax(const CPUMatrix<ElemType>& values, const CPUMatrix<ElemType>& segments, CPUMatrix<ElemType>& logProbs, CPUMatrix<ElemType>& loss)
+{
+    const long S = (long) segments.GetNumCols();
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const size_t offset = (size_t) segments.m_pArray[3 * s];
+        const size_t length = (size_t) segments.m_pArray[3 * s + 1];
+        const size_t target = (size_t) segments.m_pArray[3 * s + 2];
+        const ElemType* pz = values.m_pArray + offset;
+        ElemType* pl = logProbs.m_pArray + offset;
+        ElemType maxv = pz[0];
+        for (size_t i = 1; i < length; i++)
+        {
+            if (pz[i] > maxv)
+                maxv = pz[i];
+        }
+        ElemType sum = 0;
+        for (size_t i = 0; i < length; i++)
+            sum += exp(pz[i] - maxv);
+        const ElemType logSumExp = maxv + log(sum);
+        for (size_t i = 0; i < length; i++)
+            pl[i] = pz[i] - logSumExp;
+        loss.m_pArray[s] = -pl[target];
+    }
+}
+
+// see Matrix<ElemType>::SegmentedSoftmaxGradient() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::SegmentedSoftmaxGradient(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& logProbs, const CPUMatrix<ElemType>& segments, ElemType beta, CPUMatrix<ElemType>& gradient)
+{
+    const long S = (long) segments.GetNumCols();
+    const ElemType a = alpha.m_pArray[0];
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const size_t offset = (size_t) segments.m_pArray[3 * s];
+        const size_t length = (size_t) segments.m_pArray[3 * s + 1];
+        const size_t target = (size_t) segments.m_pArray[3 * s + 2];
+        const ElemType* pl = logProbs.m_pArray + offset;
+        ElemType* pg = gradient.m_pArray + offset;
+        for (size_t i = 0; i < length; i++)
+        {
+            const ElemType g = a * (exp(pl[i]) - (i == target ? 1 : 0));
+            pg[i] = beta == 0 ? g : beta * pg[i] + g;
+        }
+    }
+}
+
+// see Matrix<ElemType>::NoiseContrastiveLoss() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::NoiseContrastiveLoss(const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& loss, CPUMatrix<ElemType>& gradient)
+{
+    const size_t M = logits.GetNumRows();
+    const long T = (long) logits.GetNumCols();
+#pragma omp parallel for
+    for (long t = 0; t < T; t++)
+    {
+        const ElemType* pz = logits.m_pArray + t * M;
+        ElemType* pg = gradient.m_pArray + t * M;
+        ElemType sum = 0;
+        for (size_t i = 0; i < M; i++)
+        {
+            const ElemType z = i == 0 ? -pz[i] : pz[i]; // the target is to be classified as data, the samples as noise
+            const ElemType e = exp(-fabs(z));
+            sum += max(z, (ElemType) 0) + log1p(e); // softplus(z)
+            const ElemType sigmoid = z >= 0 ? 1 / (1 + e) : e / (1 + e);
+            pg[i] = i == 0 ? -sigmoid : sigmoid;
+        }
+        loss.m_pArray[t] = sum;
+    }
+}
+
+// see Matrix<ElemType>::CRFForward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::CRFForward(const CPUMatrix<ElemType>& labelIds, const CPUMatrix<ElemType>& scores, const CPUMatrix<ElemType>& transitions, const CPUMatrix<ElemType>& sequences, size_t stride,
+                                     CPUMatrix<ElemType>& logAlpha, CPUMatrix<ElemType>& logPartition, CPUMatrix<ElemType>& loss)
+{
+    const size_t L = scores.GetNumRows();
+    const long S = (long) sequences.GetNumCols();
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const size_t first = (size_t) sequences(0, s);
+        const size_t T = (size_t) sequences(1, s);
+        ElemType gold = 0;
+        for (size_t t = 0; t < T; t++)
+        {
+            const size_t j = first + t * stride;
+            for (size_t k = 0; k < L; k++)
+            {
+                // logAlpha(k, t) = scores(k, t) + log sum_i exp(logAlpha(i, t-1) + transitions(k, i))
+                ElemType a = 0;
+                if (t > 0)
+                {
+                    ElemType maxv = logAlpha(0, j - stride) + transitions(k, 0);
+                    ElemType sum = 1;
+                    for (size_t i = 1; i < L; i++)
+                    {
+                        const ElemType v = logAlpha(i, j - stride) + transitions(k, i);
+                        if (v > maxv)
+                        {
+                            sum = sum * exp(maxv - v) + 1;
+                            maxv = v;
+                        }
+                        else
+                            sum += exp(v - maxv);
+                    }
+                    a = maxv + log(sum);
+                }
+                logAlpha(k, j) = scores(k, j) + a;
+            }
+            const size_t y = (size_t) labelIds(0, j);
+            gold += scores(y, j) + (t > 0 ? transitions(y, (size_t) labelIds(0, j - stride)) : 0);
+        }
+
+        const size_t last = first + (T - 1) * stride;
+        ElemType maxv = logAlpha(0, last);
+        for (size_t k = 1; k < L; k++)
+            maxv = max(maxv, logAlpha(k, last));
+        ElemType sum = 0;
+        for (size_t k = 0; k < L; k++)
+            sum += exp(logAlpha(k, last) - maxv);
+        logPartition(0, s) = maxv + log(sum);
+        loss(0, s) = logPartition(0, s) - gold;
+    }
+}
+
+// see Matrix<ElemType>::CRFBackward() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::CRFBackward(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labelIds, const CPUMatrix<ElemType>& scores, const CPUMatrix<ElemType>& transitions, const CPUMatrix<ElemType>& sequences, size_t stride,
+                                      const CPUMatrix<ElemType>& logAlpha, const CPUMatrix<ElemType>& logPartition, CPUMatrix<ElemType>& logBeta, CPUMatrix<ElemType>* scoresGradient, CPUMatrix<ElemType>* transitionsGradient)
+{
+    const size_t L = scores.GetNumRows();
+    const long S = (long) sequences.GetNumCols();
+    const ElemType a = alpha.m_pArray[0];
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const size_t first = (size_t) sequences(0, s);
+        const size_t T = (size_t) sequences(1, s);
+        for (size_t t = T; t-- > 0;)
+        {
+            const size_t j = first + t * stride;
+            for (size_t k = 0; k < L; k++)
+            {
+                // logBeta(k, t) = log sum_m exp(transitions(m, k) + scores(m, t+1) + logBeta(m, t+1))
+                ElemType b = 0;
+                if (t + 1 < T)
+                {
+                    const size_t next = j + stride;
+                    ElemType maxv = transitions(0, k) + scores(0, next) + logBeta(0, next);
+                    ElemType sum = 1;
+                    for (size_t m = 1; m < L; m++)
+                    {
+                        const ElemType v = transitions(m, k) + scores(m, next) + logBeta(m, next);
+                        if (v > maxv)
+                        {
+                            sum = sum * exp(maxv - v) + 1;
+                            maxv = v;
+                        }
+                        else
+                            sum += exp(v - maxv);
+                    }
+                    b = maxv + log(sum);
+                }
+                logBeta(k, j) = b;
+            }
+        }
+
+        if (scoresGradient)
+        {
+            const ElemType logZ = logPartition(0, s);
+            for (size_t t = 0; t < T; t++)
+            {
+                const size_t j = first + t * stride;
+                const size_t y = (size_t) labelIds(0, j);
+                for (size_t k = 0; k < L; k++)
+                    (*scoresGradient)(k, j) += a * (exp(logAlpha(k, j) + logBeta(k, j) - logZ) - (k == y ? 1 : 0));
+            }
+        }
+    }
+
+    // each pair of labels sums over all sequences, so that no two threads write the same element
+    if (transitionsGradient)
+    {
+        const long LL = (long) (L * L);
+#pragma omp parallel for
+        for (long id = 0; id < LL; id++)
+        {
+            const size_t k = id % L;
+            const size_t i = id / L;
+            ElemType sum = 0;
+            for (long s = 0; s < S; s++)
+            {
+                const size_t first = (size_t) sequences(0, s);
+                const size_t T = (size_t) sequences(1, s);
+                const ElemType logZ = logPartition(0, s);
+                for (size_t t = 1; t < T; t++)
+                {
+                    const size_t j = first + t * stride;
+                    sum += exp(logAlpha(i, j - stride) + transitions(k, i) + scores(k, j) + logBeta(k, j) - logZ);
+                    if ((size_t) labelIds(0, j) == k && (size_t) labelIds(0, j - stride) == i)
+                        sum -= 1;
+                }
+            }
+            (*transitionsGradient)(k, i) += a * sum;
+        }
+    }
+}
+
+// see Matrix<ElemType>::CRFViterbi() for comments
+template <class ElemType>
+void CPUMatrix<ElemType>::CRFViterbi(const CPUMatrix<ElemType>& scores, const CPUMatrix<ElemType>& transitions, const CPUMatrix<ElemType>& sequences, size_t stride,
+                                     CPUMatrix<ElemType>& bestScores, CPUMatrix<ElemType>& backpointers, CPUMatrix<ElemType>& path)
+{
+    const size_t L = scores.GetNumRows();
+    const long S = (long) sequences.GetNumCols();
+#pragma omp parallel for
+    for (long s = 0; s < S; s++)
+    {
+        const size_t first = (size_t) sequences(0, s);
+        const size_t T = (size_t) sequences(1, s);
+        for (size_t t = 0; t < T; t++)
+        {
+            const size_t j = first + t * stride;
+            for (size_t k = 0; k < L; k++)
+            {
+                ElemType best = 0;
+                size_t from = 0;
+                if (t > 0)
+                {
+                    best = bestScores(0, j - stride) + transitions(k, 0);
+                    for (size_t i = 1; i < L; i++)
+                    {
+                        const ElemType v = bestScores(i, j - stride) + transitions(k, i);
+                        if (v > best)
+                        {
+                            best = v;
+                            from = i;
+                        }
+                    }
+                }
+                bestScores(k, j) = scores(k, j) + best;
+                backpointers(k, j) = (ElemType) from;
+            }
+        }
+
+        const size_t last = first + (T - 1) * stride;
+        size_t y = 0;
+        for (size_t k = 1; k < L; k++)
+        {
+            if (bestScores(k, last) > bestScores(y, last))
+                y = k;
+        }
+        for (size_t t = T; t-- > 0;)
+        {
+            const size_t j = first + t * stride;
+            path(y, j) = 1;
+            y = (size_t) backpointers(y, j);
+        }
+    }
+}
+
+template <class ElemType>
+CPUMatrix<ElemType> CPUMatrix<ElemType>::Ones(const size_t rows, const size_t cols)
+{
+    CPUMatrix<ElemType> c(rows, cols); // will initialize to 0
+    c.SetValue(1);
+    return c;
+}
+
+template <class ElemType>
+CPUMatrix<ElemType> CPUMatrix<ElemType>::Zeros(const size_t rows, const size_t cols)
+{
+    CPUMatrix<ElemType> c(rows, cols); // will initialize to 0
     c.SetValue(0);
     return c;
 }
@@ -5574,12 +6677,19 @@ template <class ElemType, typename OPFN, size_t N, int m>
 struct TensorOpReduction
 {
     // reduction case (non-reduction case is specialized)
-    static inline ElemType Loop(array<ElemType*, N> pointers, const OPFN& opfn,
-                                const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+    // The result is aggregated in double precision throughout; the caller rounds it once.
+    static inline double Loop(array<ElemType*, N> pointers, const OPFN& opfn,
+                              const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
     {
         array<ptrdiff_t, N - 1> strides;   // N-1 because last one is the result pointer, which is unused in reduction
+        bool contiguous = m == 0;
         for (size_t i = 0; i < N - 1; i++) // N = a small constant, this will be unrolled
+        {
             strides[i] = reducingStrides[i][(size_t) m];
+            contiguous &= strides[i] == 1;
+        }
+        if (contiguous) // innermost reduction over consecutive elements, e.g. a column sum: use the tree version
+            return ContiguousLoop(pointers, opfn, reducingOpDims[0]);
         double /*ElemType*/ aggregate = 0;
         for (size_t dim = reducingOpDims[(size_t) m]; dim-- > 0;)
         {
@@ -5589,7 +6699,39 @@ struct TensorOpReduction
             for (size_t i = 0; i < N - 1; i++)
                 pointers[i] += strides[i]; // note: last pointer (result) is unused and untouched here
         }
-        return (ElemType) aggregate;
+        return aggregate;
+    }
+
+    // innermost reduction with all strides being 1
+    // This sums into four independent partial sums that get combined pairwise at the end, which breaks the
+    // dependency chain of a single accumulator and lets the adds of consecutive elements overlap.
+    static inline double ContiguousLoop(const array<ElemType*, N>& pointers, const OPFN& opfn, size_t D)
+    {
+        array<ElemType*, N> pp = pointers;
+        double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        size_t j = 0;
+        for (; j + 4 <= D; j += 4)
+        {
+            for (size_t i = 0; i < N - 1; i++)
+                pp[i] = pointers[i] + j;
+            sum0 += opfn(pp);
+            for (size_t i = 0; i < N - 1; i++)
+                pp[i]++;
+            sum1 += opfn(pp);
+            for (size_t i = 0; i < N - 1; i++)
+                pp[i]++;
+            sum2 += opfn(pp);
+            for (size_t i = 0; i < N - 1; i++)
+                pp[i]++;
+            sum3 += opfn(pp);
+        }
+        for (; j < D; j++)
+        {
+            for (size_t i = 0; i < N - 1; i++)
+                pp[i] = pointers[i] + j;
+            sum0 += opfn(pp);
+        }
+        return (sum0 + sum1) + (sum2 + sum3);
     }
 };
 
@@ -5632,61 +6774,81 @@ struct TensorOpIteration
     }
 };
 
-// Special version for innermost loop with strides all being 1 and no further reduction. Compiler can use SSE.
-// This is a very common case, e.g. adding vectors or computing the Sigmoid.
-template <class ElemType, typename OPFN>
-struct TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
+// determine whether the innermost loop can use one of the hard-coded increments of TensorOpContiguousLoop
+// Returns the bit mask of the inputs that broadcast along the innermost dimension (stride 0), or -1 if there is no specialized loop.
+// This requires the output to have stride 1, and each input to have stride 1 or 0. Only the patterns that matter in practice have
+// specialized loops: all contiguous, and one of the first two inputs broadcasting (e.g. adding a bias vector to a minibatch).
+template <size_t N>
+static int TensorOpInnerBroadcastMask(const array<SmallVector<ptrdiff_t>, N>& regularStrides)
 {
-    static inline void Loop(ElemType beta, array<ElemType*, 3> pointers, ElemType alpha, const OPFN& opfn,
-                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, 3>& regularStrides,
-                            const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, 3>& reducingStrides)
+    if (regularStrides[N - 1][0] != 1)
+        return -1;
+    int mask = 0;
+    for (size_t i = 0; i < N - 1; i++)
+    {
+        if (regularStrides[i][0] == 0)
+            mask |= 1 << i;
+        else if (regularStrides[i][0] != 1)
+            return -1;
+    }
+    return (mask == 0 || mask == 1 || mask == 2) ? mask : -1;
+}
+
+// innermost loop where the output and all inputs except those in broadcastMask have stride 1, and those in broadcastMask have stride 0
+// The increments are hard-coded to allow the compiler to use SSE/AVX.
+template <class ElemType, typename OPFN, size_t N, int broadcastMask>
+struct TensorOpContiguousLoop
+{
+    static inline void Loop(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn, size_t K)
     {
-        ElemType* pa = pointers[0];
-        ElemType* pb = pointers[1];
-        ElemType* pc = pointers[2];
-        size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
-                TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            for (size_t k = 0; k < K; k++)
+                Element(beta, pointers, alpha, opfn, k);
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
-                TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            for (size_t k = 0; k < K; k++)
+                Element(0, pointers, alpha, opfn, k);
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
-                TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, 1, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-        // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Solution: change the lambda to take an N, or to implement the loop inside (with 1 element by default).
-        // TODO: The signedness of k (required for omp) causes an extra sign-extend.
-        // TODO: OMP adds LOTS of overhead. Do we need a guard, a min size when to use it?
+            for (size_t k = 0; k < K; k++)
+                Element(0, pointers, 1, opfn, k);
+    }
+
+    static inline void Element(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn, size_t k)
+    {
+        array<ElemType*, N> pp;
+        for (size_t i = 0; i < N - 1; i++) // N = a small constant, this will be unrolled, and the condition is a constant
+            pp[i] = (broadcastMask & (1 << i)) ? pointers[i] : pointers[i] + k;
+        pp[N - 1] = pointers[N - 1] + k;
+        ElemType val = opfn(pp) * alpha;
+        if (beta != 0)
+            val += beta * *pp[N - 1];
+        *pp[N - 1] = val;
     }
 };
-// and unary
-template <class ElemType, typename OPFN>
-struct TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
+
+// Special version for innermost loop with strides all being 1 (or 0 for a broadcasting input) and no further reduction.
+// This is a very common case, e.g. adding vectors, adding a bias, or computing the Sigmoid.
+// Parallelization happens outside (TensorOpParallelLoop), so this is a plain serial loop.
+template <class ElemType, typename OPFN, size_t N>
+struct TensorOpIteration<ElemType, OPFN, N, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
 {
-    static inline void Loop(ElemType beta, array<ElemType*, 2> pointers, ElemType alpha, const OPFN& opfn,
-                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, 2>& regularStrides,
-                            const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, 2>& reducingStrides)
+    static inline void Loop(ElemType beta, array<ElemType*, N> pointers, ElemType alpha, const OPFN& opfn,
+                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+                            const SmallVector<size_t>&, const array<SmallVector<ptrdiff_t>, N>&)
     {
-        ElemType* pa = pointers[0];
-        ElemType* pb = pointers[1];
-        size_t K = regularOpDims[0];
-        // special-case beta and alpha to allow the compiler to short-circuit it
-        if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
-                TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-        else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
-                TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-        else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
-                TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, 1, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+        const size_t K = regularOpDims[0];
+        switch (TensorOpInnerBroadcastMask<N>(regularStrides))
+        {
+        case 0:
+            return TensorOpContiguousLoop<ElemType, OPFN, N, 0>::Loop(beta, pointers, alpha, opfn, K);
+        case 1:
+            return TensorOpContiguousLoop<ElemType, OPFN, N, 1>::Loop(beta, pointers, alpha, opfn, K);
+        case 2:
+            return TensorOpContiguousLoop<ElemType, OPFN, N, 2>::Loop(beta, pointers, alpha, opfn, K);
+        default:
+            LogicError("TensorOp: Innermost loop is not vectorizable."); // TensorOpWithRegularLoop() checked this
+        }
+        // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Solution: change the lambda to take an N, or to implement the loop inside (with 1 element by default).
     }
 };
 
@@ -5698,7 +6860,7 @@ struct TensorOpIteration<ElemType, OPFN, N, vectorizable, m, -1>
                             const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
     {
         // we are at element level for the result: perform the op (there may still be reduction)
-        ElemType val = TensorOpReduction<ElemType, OPFN, N, m>::Loop(pointers, opfn, reducingOpDims, reducingStrides);
+        ElemType val = (ElemType) TensorOpReduction<ElemType, OPFN, N, m>::Loop(pointers, opfn, reducingOpDims, reducingStrides);
         // scale
         val *= alpha;
         // combine with previous value in target matrix, then write it out
@@ -5711,6 +6873,128 @@ struct TensorOpIteration<ElemType, OPFN, N, vectorizable, m, -1>
     }
 };
 
+// -----------------------------------------------------------------------
+// parallelization
+// -----------------------------------------------------------------------
+
+// Below this many elementary operations per thread, the OpenMP overhead outweighs the gain.
+static const size_t tensorOpMinOpsPerThread = 16384;
+
+// A full reduction is split into this many chunks. This is independent of the number of threads, for reproducible results.
+static const size_t tensorOpReductionChunks = 64;
+
+// number of elementary operations (op invocations) of a tensor operation
+static size_t TensorOpNumOps(const SmallVector<size_t>& regularOpDims, const SmallVector<size_t>& reducingOpDims)
+{
+    size_t numOps = 1;
+    for (size_t dim : regularOpDims)
+        numOps *= dim;
+    for (size_t dim : reducingOpDims)
+        numOps *= dim;
+    return numOps;
+}
+
+// perform the loop over regular indices k..0 on multiple threads
+// The output is split into tasks of rows (innermost dimension), or pieces of rows if there are fewer rows than threads
+// (e.g. a single long vector). Each task runs the same serial innermost loop as the single-threaded case, so results
+// do not depend on the number of threads.
+template <class ElemType, typename OPFN, size_t N, bool vectorizable, int m, int k>
+static void TensorOpParallelLoop(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn,
+                                 const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+                                 const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides,
+                                 int numThreads)
+{
+    size_t numRows = 1;
+    for (int j = 1; j <= k; j++)
+        numRows *= regularOpDims[(size_t) j];
+    const size_t K = regularOpDims[0];
+    size_t piecesPerRow = 1;
+    if (numRows < (size_t) numThreads)
+        piecesPerRow = min(K, ((size_t) numThreads + numRows - 1) / numRows);
+    const size_t pieceSize = (K + piecesPerRow - 1) / piecesPerRow;
+    piecesPerRow = (K + pieceSize - 1) / pieceSize;
+    const int numTasks = (int) (numRows * piecesPerRow);
+
+#pragma omp parallel for num_threads(numThreads)
+    for (int t = 0; t < numTasks; t++)
+    {
+        // locate the piece
+        size_t row = (size_t) t / piecesPerRow;
+        const size_t begin = ((size_t) t % piecesPerRow) * pieceSize;
+        array<ElemType*, N> pp = pointers;
+        for (size_t i = 0; i < N; i++)
+            pp[i] += (ptrdiff_t) begin * regularStrides[i][0];
+        for (int j = 1; j <= k; j++)
+        {
+            const size_t index = row % regularOpDims[(size_t) j];
+            row /= regularOpDims[(size_t) j];
+            for (size_t i = 0; i < N; i++)
+                pp[i] += (ptrdiff_t) index * regularStrides[i][(size_t) j];
+        }
+        SmallVector<size_t> pieceOpDims = regularOpDims;
+        pieceOpDims[0] = min(pieceSize, K - begin);
+        // and process it
+        TensorOpIteration<ElemType, OPFN, N, vectorizable, m, 0>::Loop(beta, pp, alpha, opfn, pieceOpDims, regularStrides, reducingOpDims, reducingStrides);
+    }
+}
+
+// perform a reduction into a single output element (regular rank 0) on multiple threads
+// The outermost reducing dimension m is split into chunks that are summed independently, and the chunk sums are then combined pairwise.
+// This is also used single-threaded for large reductions, so that the order of summation does not depend on the number of threads.
+template <class ElemType, typename OPFN, size_t N, int m>
+static void TensorOpParallelReduction(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn,
+                                      const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides,
+                                      int numThreads)
+{
+    const size_t D = reducingOpDims[(size_t) m];
+    size_t numChunks = min(D, tensorOpReductionChunks);
+    const size_t chunkSize = (D + numChunks - 1) / numChunks;
+    numChunks = (D + chunkSize - 1) / chunkSize;
+    vector<double> partials(numChunks);
+
+#pragma omp parallel for num_threads(numThreads)
+    for (int c = 0; c < (int) numChunks; c++)
+    {
+        const size_t begin = (size_t) c * chunkSize;
+        array<ElemType*, N> pp = pointers;
+        for (size_t i = 0; i < N - 1; i++) // (last pointer is the result)
+            pp[i] += (ptrdiff_t) begin * reducingStrides[i][(size_t) m];
+        SmallVector<size_t> chunkOpDims = reducingOpDims;
+        chunkOpDims[(size_t) m] = min(chunkSize, D - begin);
+        partials[c] = TensorOpReduction<ElemType, OPFN, N, m>::Loop(pp, opfn, chunkOpDims, reducingStrides);
+    }
+
+    // combine the chunk sums as a tree
+    for (size_t step = 1; step < numChunks; step *= 2)
+        for (size_t c = 0; c + step < numChunks; c += 2 * step)
+            partials[c] += partials[c + step];
+
+    // same as TensorOpIteration<..., -1>
+    ElemType val = (ElemType) partials[0];
+    val *= alpha;
+    auto* pout = pointers.back();
+    if (beta != 0)
+        val += beta * *pout;
+    *pout = val;
+}
+
+// perform loop over regular index k and reducing index m, on as many threads as the size of the operation warrants
+template <class ElemType, typename OPFN, size_t N, bool vectorizable, int m, int k>
+static void TensorOpLoop(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn,
+                         const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+                         const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    const size_t numOps = TensorOpNumOps(regularOpDims, reducingOpDims);
+    const bool isLarge = numOps >= 2 * tensorOpMinOpsPerThread;
+    const int numThreads = isLarge ? (int) min((size_t) omp_get_max_threads(), numOps / tensorOpMinOpsPerThread) : 1;
+    if (k >= 0 && numThreads > 1)
+        TensorOpParallelLoop<ElemType, OPFN, N, vectorizable, m, k>(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides, numThreads);
+    else if (k < 0 && m >= 0 && isLarge) // full reduction
+        TensorOpParallelReduction<ElemType, OPFN, N, m>(beta, pointers, alpha, opfn, reducingOpDims, reducingStrides, numThreads);
+    else
+        TensorOpIteration<ElemType, OPFN, N, vectorizable, m, k>::Loop(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+}
+
 // -----------------------------------------------------------------------
 // map runtime parameters N to template parameters
 // -----------------------------------------------------------------------
@@ -5725,19 +7009,16 @@ static void TensorOpWithRegularLoop(ElemType beta, const array<ElemType*, N>& po
     switch (dims)
     {
     case 2:
-        return TensorOpIteration<ElemType, OPFN, N, false /*vectorizable*/, 1, k>::Loop(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+        return TensorOpLoop<ElemType, OPFN, N, false /*vectorizable*/, 1, k>(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
     case 1:
-        return TensorOpIteration<ElemType, OPFN, N, false /*vectorizable*/, 0, k>::Loop(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+        return TensorOpLoop<ElemType, OPFN, N, false /*vectorizable*/, 0, k>(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
     case 0:
     {
-        // if all leading dimensions are 1, we can let the compiler do some unrolling
-        bool leadingAllOne = true;
-        for (size_t i = 0; i < N; i++)
-            leadingAllOne &= k >= 0 && regularStrides[i][0] == 1;
-        if (leadingAllOne) // special version that uses a hard-coded increment of 1 for all leading dimensions
-            return TensorOpIteration<ElemType, OPFN, N, true /*vectorizable*/, -1, k>::Loop(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+        // if the leading dimensions are contiguous or broadcasting, we can let the compiler do some unrolling
+        if (k >= 0 && TensorOpInnerBroadcastMask<N>(regularStrides) >= 0) // special version that uses hard-coded increments for all leading dimensions
+            return TensorOpLoop<ElemType, OPFN, N, true /*vectorizable*/, -1, k>(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else
-            return TensorOpIteration<ElemType, OPFN, N, false /*vectorizable*/, -1, k>::Loop(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            return TensorOpLoop<ElemType, OPFN, N, false /*vectorizable*/, -1, k>(beta, pointers, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
     }
     default:
         LogicError("TensorOp: %d non-flattened reduction dimensions are not supported.", (int) dims);
@@ -71,11 +71,18 @@ public:
     CPUMatrix<ElemType>& SetColumnSlice(const CPUMatrix<ElemType>& fromMatrix, size_t startColumn, size_t numCols);
 
     void CopyColumnsStrided(const CPUMatrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride);
+    CPUMatrix<ElemType>& AssignGatheredColumnsOf(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& columnIndices);
+    CPUMatrix<ElemType>& AssignAliasSamplesOf(const CPUMatrix<ElemType>& aliasTable, const CPUMatrix<ElemType>& uniforms);
+    CPUMatrix<ElemType>& AddScatteredColumnsOf(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& columnIndices);
+    CPUMatrix<ElemType>& AssignPackedHalfOf(const CPUMatrix<ElemType>& a, HalfFormat format);
+    CPUMatrix<ElemType>& AssignUnpackedHalfOf(const CPUMatrix<ElemType>& packed, size_t numRows, HalfFormat format);
 
     CPUMatrix<ElemType> Diagonal() const;
 
     ElemType Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(CPUMatrix<ElemType>& gradients, CPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul);
+    void Adam(CPUMatrix<ElemType>& gradients, CPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly);
     ElemType RmsProp(CPUMatrix<ElemType>& gradients,
                      ElemType RMS_GAMMA,
                      ElemType RMS_WGT_INC,
@@ -118,6 +125,8 @@ public:
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, unsigned long seed = USE_TIME_BASED_SEED);
+    void SetPhiloxRandomValue(const bool gaussian, const ElemType a, const ElemType b, unsigned long seed);
+    CPUMatrix<ElemType>& ScaleAndAddDropoutOf(const ElemType beta, const CPUMatrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
 
     CPUMatrix<ElemType> Transpose();
@@ -273,6 +282,8 @@ public:
     CPUMatrix<ElemType>& AssignRepeatOf(const CPUMatrix<ElemType>& a, const size_t numRowRepeats, const size_t numColRepeats);
     CPUMatrix<ElemType>& AddToRowRepeatValuesOf(const CPUMatrix<ElemType>& a, const size_t numRowRepeats);
 
+    CPUMatrix<ElemType>& AssignPackedImages(const void* packedImages);
+
     CPUMatrix<ElemType>& AssignPositiveAndShiftedNegSample(const CPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber);
     CPUMatrix<ElemType>& AddFoldedPositiveAndShiftedNegSample(const CPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber);
 
@@ -323,6 +334,10 @@ public:
     static void SVD(const CPUMatrix<ElemType>& A, CPUMatrix<ElemType>& SIGMA, CPUMatrix<ElemType>& U, CPUMatrix<ElemType>& VT, CPUMatrix<ElemType>& W);
 
     static void MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
+    static void MultiTensorSumOfSquares(const std::vector<const CPUMatrix<ElemType>*>& matrices, std::vector<double>& sumsOfSquares);
+    static void MultiTensorSGDUpdate(const std::vector<CPUMatrix<ElemType>*>& weights, const std::vector<const CPUMatrix<ElemType>*>& gradients, const std::vector<CPUMatrix<ElemType>*>& smoothedGradients,
+                                     const std::vector<ElemType>& gradientScales, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                     const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad);
     static void MultiplyAndAdd(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
@@ -351,6 +366,37 @@ public:
 
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const CPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
 
+    static void LSTMPointwiseForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>* peepholes, CPUMatrix<ElemType>& cell, CPUMatrix<ElemType>& output);
+    static void LSTMPointwiseBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& cell, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>* peepholes, const CPUMatrix<ElemType>& outputGradient,
+                                      CPUMatrix<ElemType>& cellGradient, CPUMatrix<ElemType>& gatesGradient);
+    static void GRUPointwiseForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, CPUMatrix<ElemType>& output);
+    static void GRUPointwiseBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, CPUMatrix<ElemType>& outputGradient,
+                                     CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& recurrentGradient);
+    static void CosDistanceWithNegativeSamples(const CPUMatrix<ElemType>& left, const CPUMatrix<ElemType>& right, size_t shift,
+                                               CPUMatrix<ElemType>& invNormLeft, CPUMatrix<ElemType>& invNormRight, CPUMatrix<ElemType>& cosDistance);
+    static void CosDistanceWithNegativeSamplesGradient(const CPUMatrix<ElemType>& left, const CPUMatrix<ElemType>& right, const CPUMatrix<ElemType>& invNormLeft, const CPUMatrix<ElemType>& invNormRight,
+                                                       const CPUMatrix<ElemType>& cosDistance, const CPUMatrix<ElemType>& gradient, size_t shift, bool wrtRight, CPUMatrix<ElemType>& inputGradient);
+
+    // (the gradients are nullptr if not needed)
+    static void AttentionForward(const CPUMatrix<ElemType>& query, const CPUMatrix<ElemType>& keys, const CPUMatrix<ElemType>& values, const CPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                 CPUMatrix<ElemType>& context, CPUMatrix<ElemType>& logSumExp);
+    static void AttentionBackward(const CPUMatrix<ElemType>& query, const CPUMatrix<ElemType>& keys, const CPUMatrix<ElemType>& values, const CPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                  const CPUMatrix<ElemType>& context, const CPUMatrix<ElemType>& logSumExp, const CPUMatrix<ElemType>& contextGradient,
+                                  CPUMatrix<ElemType>* queryGradient, CPUMatrix<ElemType>* keysGradient, CPUMatrix<ElemType>* valuesGradient);
+
+    static void CrossEntropyWithSoftmaxForward(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& columnLoss);
+    static void CrossEntropyWithSoftmaxBackward(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp,
+                                                CPUMatrix<ElemType>& gradient);
+    static void SegmentedLogSoftmax(const CPUMatrix<ElemType>& values, const CPUMatrix<ElemType>& segments, CPUMatrix<ElemType>& logProbs, CPUMatrix<ElemType>& loss);
+    static void SegmentedSoftmaxGradient(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& logProbs, const CPUMatrix<ElemType>& segments, ElemType beta, CPUMatrix<ElemType>& gradient);
+    static void NoiseContrastiveLoss(const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& loss, CPUMatrix<ElemType>& gradient);
+    static void CRFForward(const CPUMatrix<ElemType>& labelIds, const CPUMatrix<ElemType>& scores, const CPUMatrix<ElemType>& transitions, const CPUMatrix<ElemType>& sequences, size_t stride,
+                           CPUMatrix<ElemType>& logAlpha, CPUMatrix<ElemType>& logPartition, CPUMatrix<ElemType>& loss);
+    static void CRFBackward(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labelIds, const CPUMatrix<ElemType>& scores, const CPUMatrix<ElemType>& transitions, const CPUMatrix<ElemType>& sequences, size_t stride,
+                            const CPUMatrix<ElemType>& logAlpha, const CPUMatrix<ElemType>& logPartition, CPUMatrix<ElemType>& logBeta, CPUMatrix<ElemType>* scoresGradient, CPUMatrix<ElemType>* transitionsGradient);
+    static void CRFViterbi(const CPUMatrix<ElemType>& scores, const CPUMatrix<ElemType>& transitions, const CPUMatrix<ElemType>& sequences, size_t stride,
+                           CPUMatrix<ElemType>& bestScores, CPUMatrix<ElemType>& backpointers, CPUMatrix<ElemType>& path);
+
     void TensorOp(ElemType beta, const CPUMatrix<ElemType>& a, ElemType alpha, ElementWiseOperator op,
                   const std::array<size_t, 2>& offsets,
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 2>& regularStrides,
@@ -393,17 +439,14 @@ public:
         size_t numRows, numCols;
         int format;
         stream >> matrixName >> format >> numRows >> numCols;
-        ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        us.Resize(numRows, numCols);
+        stream.ReadArray(us.m_pArray, numRows * numCols); // directly into the matrix
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
-        us.SetValue(numRows, numCols, d_array, matrixFlagNormal);
         if (us.m_matrixName)
             delete[] us.m_matrixName;
         us.m_matrixName = new wchar_t[matrixName.length() + 1];
         wmemcpy(us.m_matrixName, matrixName.c_str(), matrixName.length() + 1);
 
-        delete[] d_array;
         return stream;
     }
     friend File& operator<<(File& stream, const CPUMatrix<ElemType>& us)
@@ -416,8 +459,7 @@ public:
         stream << s << format;
 
         stream << us.m_numRows << us.m_numCols;
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << us.m_pArray[i];
+        stream.WriteArray(us.m_pArray, us.GetNumElements());
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         return stream;
     }
@@ -66,8 +66,53 @@
         (a) ^= (b); \
     }
 #define IDX2C(i, j, ld) (((j) * (ld)) + (i)) // 0 based indexing
+
+// the inspector-executor sparse BLAS (mkl_sparse_?_mm) requires MKL 11.3 and above
+#if defined(USE_MKL) && defined(INTEL_MKL_VERSION) && INTEL_MKL_VERSION >= 110300
+#define USE_MKL_SPARSE_MM
+#endif
+
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+#ifdef USE_MKL_SPARSE_MM
+static_assert(sizeof(MKL_INT) == sizeof(CPUSPARSE_INDEX_TYPE), "MKL sparse BLAS requires MKL_INT indexes");
+
+static sparse_status_t MKLSparseCreateCSR(sparse_matrix_t* a, MKL_INT rows, MKL_INT cols, MKL_INT* rowStart, MKL_INT* colIndex, float* values)
+{
+    return mkl_sparse_s_create_csr(a, SPARSE_INDEX_BASE_ZERO, rows, cols, rowStart, rowStart + 1, colIndex, values);
+}
+static sparse_status_t MKLSparseCreateCSR(sparse_matrix_t* a, MKL_INT rows, MKL_INT cols, MKL_INT* rowStart, MKL_INT* colIndex, double* values)
+{
+    return mkl_sparse_d_create_csr(a, SPARSE_INDEX_BASE_ZERO, rows, cols, rowStart, rowStart + 1, colIndex, values);
+}
+static sparse_status_t MKLSparseMM(sparse_operation_t op, float alpha, sparse_matrix_t a, matrix_descr descr, const float* b, MKL_INT columns, float beta, float* c)
+{
+    return mkl_sparse_s_mm(op, alpha, a, descr, SPARSE_LAYOUT_ROW_MAJOR, b, columns, columns, beta, c, columns);
+}
+static sparse_status_t MKLSparseMM(sparse_operation_t op, double alpha, sparse_matrix_t a, matrix_descr descr, const double* b, MKL_INT columns, double beta, double* c)
+{
+    return mkl_sparse_d_mm(op, alpha, a, descr, SPARSE_LAYOUT_ROW_MAJOR, b, columns, columns, beta, c, columns);
+}
+
+// c = alpha * op(a) * b + beta * c for a 'rows' x 'cols' CSR matrix a and row-major dense b and c with 'columns' columns
+template <class ElemType>
+static void MKLSparseMultiply(ElemType alpha, const CPUSPARSE_INDEX_TYPE* rowStart, const CPUSPARSE_INDEX_TYPE* colIndex, const ElemType* values,
+                              size_t rows, size_t cols, bool transpose, const ElemType* b, size_t columns, ElemType beta, ElemType* c)
+{
+    sparse_matrix_t a = nullptr;
+    sparse_status_t status = MKLSparseCreateCSR(&a, (MKL_INT) rows, (MKL_INT) cols, (MKL_INT*) rowStart, (MKL_INT*) colIndex, const_cast<ElemType*>(values));
+    if (status == SPARSE_STATUS_SUCCESS)
+    {
+        matrix_descr descr;
+        descr.type = SPARSE_MATRIX_TYPE_GENERAL;
+        status = MKLSparseMM(transpose ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE, alpha, a, descr, b, (MKL_INT) columns, beta, c);
+        mkl_sparse_destroy(a);
+    }
+    if (status != SPARSE_STATUS_SUCCESS)
+        RuntimeError("MKLSparseMultiply: MKL sparse BLAS failed with status %d.", (int) status);
+}
+#endif
+
 #pragma region Helpful Enum Definitions
 enum class MatrixOrder
 {
@@ -536,6 +581,144 @@ void CPUSparseMatrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYP
     memcpy(NzValues(), h_Val, NzSize());
 }
 
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::SetMatrixFromCSRFormat(const CPUSPARSE_INDEX_TYPE* h_CSRRow, const CPUSPARSE_INDEX_TYPE* h_Col, const ElemType* h_Val,
+                                                       const size_t nz, const size_t numRows, const size_t numCols)
+{
+    if (!OwnBuffer())
+        LogicError("Cannot modify since the buffer is managed externally.");
+
+    m_format = matrixFormatSparseCSR;
+    Resize(numRows, numCols, nz, true, false);
+    this->SetNzCount(nz);
+
+    memcpy(RowLocation(), h_CSRRow, RowSize());
+    memcpy(ColLocation(), h_Col, ColSize());
+    memcpy(NzValues(), h_Val, NzSize());
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat)
+{
+    if (m_format == newFormat)
+        return;
+
+    CPUSparseMatrix<ElemType> converted(newFormat);
+    ConvertToSparseFormat(newFormat, converted);
+    *this = std::move(converted);
+}
+
+// CSC <-> CSR. The CSR arrays of a matrix are the CSC arrays of its transpose, so this is a sparse transpose:
+// each thread counts the major ids of a contiguous range of the compressed dimension, the counts are turned into
+// per-thread write offsets, and each thread then scatters its range. Elements stay sorted by their new major id.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat, CPUSparseMatrix<ElemType>& outMatrix) const
+{
+    if ((m_format != matrixFormatSparseCSC && m_format != matrixFormatSparseCSR) ||
+        (newFormat != matrixFormatSparseCSC && newFormat != matrixFormatSparseCSR))
+        NOT_IMPLEMENTED;
+
+    if (&outMatrix == this)
+        LogicError("ConvertToSparseFormat: The output matrix must be different from the input matrix.");
+
+    if (m_format == newFormat)
+    {
+        outMatrix.SetValue(*this);
+        return;
+    }
+
+    const size_t nz = this->NzCount();
+    const size_t numIn = (m_format == matrixFormatSparseCSC) ? m_numCols : m_numRows;  // length of the compressed dimension of this
+    const size_t numOut = (m_format == matrixFormatSparseCSC) ? m_numRows : m_numCols; // and of outMatrix
+
+    outMatrix.SetFormat(newFormat);
+    outMatrix.Resize(m_numRows, m_numCols, nz, true, false);
+    outMatrix.SetNzCount(nz);
+
+    const CPUSPARSE_INDEX_TYPE* inCompIndex = m_compIndex;
+    const CPUSPARSE_INDEX_TYPE* inIndex = m_unCompIndex;
+    const ElemType* inValues = m_pArray; // m_compIndex is always against m_pArray, also for column slices
+    CPUSPARSE_INDEX_TYPE* outCompIndex = outMatrix.m_compIndex;
+    CPUSPARSE_INDEX_TYPE* outIndex = outMatrix.m_unCompIndex;
+    ElemType* outValues = outMatrix.m_pArray;
+
+    const size_t minElementsPerThread = 16384;
+    const int numThreads = (int) max((size_t) 1, min((size_t) omp_get_max_threads(), nz / minElementsPerThread));
+    const size_t inPerThread = (numIn + numThreads - 1) / numThreads;
+    std::vector<CPUSPARSE_INDEX_TYPE> offsets(numThreads * numOut, 0); // [t * numOut + i]: counts, then write positions of thread t for major id i
+
+#pragma omp parallel for num_threads(numThreads)
+    for (int t = 0; t < numThreads; t++)
+    {
+        CPUSPARSE_INDEX_TYPE* count = offsets.data() + t * numOut;
+        const size_t end = min(numIn, (t + 1) * inPerThread);
+        for (size_t j = t * inPerThread; j < end; j++)
+            for (CPUSPARSE_INDEX_TYPE p = inCompIndex[j]; p < inCompIndex[j + 1]; p++)
+                count[inIndex[p]]++;
+    }
+
+    CPUSPARSE_INDEX_TYPE pos = 0;
+    for (size_t i = 0; i < numOut; i++)
+    {
+        outCompIndex[i] = pos;
+        for (int t = 0; t < numThreads; t++)
+        {
+            const CPUSPARSE_INDEX_TYPE count = offsets[t * numOut + i];
+            offsets[t * numOut + i] = pos;
+            pos += count;
+        }
+    }
+    outCompIndex[numOut] = pos;
+    assert(pos == (CPUSPARSE_INDEX_TYPE) nz);
+
+#pragma omp parallel for num_threads(numThreads)
+    for (int t = 0; t < numThreads; t++)
+    {
+        CPUSPARSE_INDEX_TYPE* writePos = offsets.data() + t * numOut;
+        const size_t end = min(numIn, (t + 1) * inPerThread);
+        for (size_t j = t * inPerThread; j < end; j++)
+        {
+            for (CPUSPARSE_INDEX_TYPE p = inCompIndex[j]; p < inCompIndex[j + 1]; p++)
+            {
+                const CPUSPARSE_INDEX_TYPE q = writePos[inIndex[p]]++;
+                outIndex[q] = (CPUSPARSE_INDEX_TYPE) j;
+                outValues[q] = inValues[p];
+            }
+        }
+    }
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& columnValues) const
+{
+    if (m_format != matrixFormatSparseBlockCol)
+        LogicError("GetSparseBlockColumns: Matrix must be in sparse block-column format.");
+
+    columnIds.resize(m_blockSize);
+    for (size_t j = 0; j < m_blockSize; j++)
+        columnIds[j] = m_blockIds[j] - m_blockIdShift;
+    columnValues.assign(m_nzValues, m_nzValues + m_blockSize * m_numRows);
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& columnValues)
+{
+    if (!OwnBuffer())
+        LogicError("Cannot modify since the buffer is managed externally.");
+    if (columnValues.size() != columnIds.size() * numRows)
+        InvalidArgument("SetSparseBlockColumns: Expected %d values for %d columns of %d rows.", (int) (columnIds.size() * numRows), (int) columnIds.size(), (int) numRows);
+
+    Reset();
+    m_format = matrixFormatSparseBlockCol;
+    Resize(numRows, numCols, columnValues.size(), true, false);
+
+    m_blockSize = columnIds.size();
+    m_nz = columnValues.size();
+    for (size_t j = 0; j < m_blockSize; j++)
+        m_blockIds[j] = columnIds[j];
+    memcpy(m_nzValues, columnValues.data(), NzSize());
+}
+
 template <class ElemType>
 ElemType* CPUSparseMatrix<ElemType>::BufferPointer() const
 {
@@ -649,6 +832,17 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
     else
         c.VerifySize(m, n); // Can't resize if beta != 0
 
+#ifdef USE_MKL_SPARSE_MM
+    // In row-major terms this is c^T = alpha * op(rhs)^T * lhs^T + beta * c^T, where the CSC arrays of rhs are the CSR
+    // arrays of rhs^T and the column-major lhs is lhs^T in row-major, so MKL can work on the buffers as they are.
+    if (!transposeA && rhs.GetFormat() == matrixFormatSparseCSC)
+    {
+        MKLSparseMultiply(alpha, rhs.m_compIndex, rhs.m_unCompIndex, rhs.m_pArray, rhs.GetNumCols(), rhs.GetNumRows(), transposeB,
+                          lhs.BufferPointer(), (size_t) m, beta, c.BufferPointer());
+        return;
+    }
+#endif
+
     if (beta == 0)
     {
         memset(c.GetArray(), 0, sizeof(ElemType) * c.GetNumElements());
@@ -665,38 +859,55 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
     if (rhs.GetFormat() != matrixFormatSparseCSC)
         NOT_IMPLEMENTED;
 
+    // Sparse inputs are typically one-hot (one non-zero per column), for which the product is a gather of columns of lhs (forward)
+    // resp. a scatter-add into columns of c (gradient). Both loops therefore work on whole contiguous columns.
+    const size_t numRows = lhs.GetNumRows();
+    const ElemType* lhsData = lhs.BufferPointer();
+    ElemType* cData = c.BufferPointer();
     if (!transposeA && !transposeB)
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
+        // c(:,j) += alpha * sum_p val_p * lhs(:,i_p); columns of c are independent
+        const long numCols = (long) rhs.GetNumCols();
+#pragma omp parallel for
+        for (long j = 0; j < numCols; j++)
         {
             size_t start = rhs.m_compIndex[j]; // ColLocation
             size_t end = rhs.m_compIndex[j + 1];
+            ElemType* cCol = cData + j * numRows;
             for (size_t p = start; p < end; p++)
             {
                 size_t i = rhs.m_unCompIndex[p]; // RowLocation
-                ElemType val = rhs.m_pArray[p];
-
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                {
-                    c(h, j) += alpha * lhs(h, i) * val;
-                }
+                const ElemType weight = alpha * rhs.m_pArray[p];
+                const ElemType* lhsCol = lhsData + i * numRows;
+                for (size_t h = 0; h < numRows; h++)
+                    cCol[h] += weight * lhsCol[h];
             }
         }
     }
     else if (!transposeA && transposeB)
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
+        // c(:,i_p) += alpha * val_p * lhs(:,j)
+        // Multiple columns of rhs may hit the same column of c (the same word occurring multiple times in a minibatch),
+        // so we parallelize over blocks of rows instead of over columns.
+        const size_t rowsPerBlock = 64;
+        const long numRowBlocks = (long) ((numRows + rowsPerBlock - 1) / rowsPerBlock);
+#pragma omp parallel for
+        for (long b = 0; b < numRowBlocks; b++)
         {
-            size_t start = rhs.m_compIndex[j];
-            size_t end = rhs.m_compIndex[j + 1];
-
-            for (size_t p = start; p < end; p++)
+            const size_t hBegin = b * rowsPerBlock;
+            const size_t hEnd = min(numRows, hBegin + rowsPerBlock);
+            for (size_t j = 0; j < rhs.GetNumCols(); j++)
             {
-                size_t i = rhs.m_unCompIndex[p];
-                ElemType val = rhs.m_pArray[p];
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
+                size_t start = rhs.m_compIndex[j];
+                size_t end = rhs.m_compIndex[j + 1];
+                const ElemType* lhsCol = lhsData + j * numRows;
+                for (size_t p = start; p < end; p++)
                 {
-                    c(h, i) += alpha * lhs(h, j) * val;
+                    size_t i = rhs.m_unCompIndex[p];
+                    const ElemType weight = alpha * rhs.m_pArray[p];
+                    ElemType* cCol = cData + i * numRows;
+                    for (size_t h = hBegin; h < hEnd; h++)
+                        cCol[h] += weight * lhsCol[h];
                 }
             }
         }
@@ -711,6 +922,90 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
     }
 }
 
+// c = alpha * op(lhs) * rhs + beta * c with a sparse lhs in CSC or CSR format, e.g. pruned weights times dense activations
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, const bool transposeA,
+                                                       const CPUMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (lhs.IsEmpty() || rhs.IsEmpty())
+        LogicError("MultiplyAndWeightedAdd:  one of the input matrix is empty.");
+    if (transposeB || (lhs.GetFormat() != matrixFormatSparseCSC && lhs.GetFormat() != matrixFormatSparseCSR))
+        NOT_IMPLEMENTED;
+
+    const size_t m = transposeA ? lhs.GetNumCols() : lhs.GetNumRows();
+    const size_t k = transposeA ? lhs.GetNumRows() : lhs.GetNumCols();
+    const size_t n = rhs.GetNumCols();
+    if (k != rhs.GetNumRows())
+        InvalidArgument("CPUSparseMatrix::MultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
+
+    if (beta == 0)
+        c.Resize(m, n);
+    else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+
+    // The CSR of lhs is the CSC of lhs^T. Either each stored column of op(lhs) is scaled into the column of c (scatter),
+    // or each element of c is the inner product of a stored column of op(lhs)^T with the column of rhs (gather).
+    const bool scatter = (lhs.GetFormat() == matrixFormatSparseCSC) != transposeA;
+    const CPUSPARSE_INDEX_TYPE* compIndex = lhs.m_compIndex; // begin of each stored column (CSC) resp. row (CSR)
+    const CPUSPARSE_INDEX_TYPE* index = lhs.m_unCompIndex;   // and the row resp. column ids of its elements
+    const ElemType* values = lhs.m_pArray;
+    // Weights pruned in blocks leave runs of consecutive ids, over which the innermost loops are plain (vectorizable) axpys and dot products.
+    auto runLength = [index](size_t p, size_t end) -> size_t
+    {
+        size_t run = 1;
+        while (p + run < end && index[p + run] == index[p] + (CPUSPARSE_INDEX_TYPE) run)
+            run++;
+        return run;
+    };
+
+    const ElemType* rhsData = rhs.BufferPointer();
+    ElemType* cData = c.BufferPointer();
+    const long numCols = (long) n;
+#pragma omp parallel for
+    for (long j = 0; j < numCols; j++)
+    {
+        const ElemType* rhsCol = rhsData + j * k;
+        ElemType* cCol = cData + j * m;
+        for (size_t i = 0; i < m; i++)
+            cCol[i] = beta == 0 ? 0 : beta * cCol[i];
+        if (scatter)
+        {
+            for (size_t q = 0; q < k; q++)
+            {
+                const ElemType x = alpha * rhsCol[q];
+                if (x == 0)
+                    continue;
+                const size_t end = compIndex[q + 1];
+                for (size_t p = compIndex[q], run; p < end; p += run)
+                {
+                    run = runLength(p, end);
+                    ElemType* cRun = cCol + index[p];
+                    const ElemType* valueRun = values + p;
+                    for (size_t h = 0; h < run; h++)
+                        cRun[h] += x * valueRun[h];
+                }
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < m; i++)
+            {
+                ElemType sum = 0;
+                const size_t end = compIndex[i + 1];
+                for (size_t p = compIndex[i], run; p < end; p += run)
+                {
+                    run = runLength(p, end);
+                    const ElemType* rhsRun = rhsCol + index[p];
+                    const ElemType* valueRun = values + p;
+                    for (size_t h = 0; h < run; h++)
+                        sum += valueRun[h] * rhsRun[h];
+                }
+                cCol[i] += alpha * sum;
+            }
+        }
+    }
+}
+
 //c = alpha * op(lhs) * op(rhs)
 template <class ElemType>
 void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
@@ -860,6 +1155,61 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     }
 }
 
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxForward() for comments
+// The loss only gathers the logits at the non-zeros of the labels: loss_j = sum_p l_p * (logSumExp_j - z(row_p, j)).
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxForward(const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& columnLoss)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    const long M = (long) logits.GetNumRows(), N = (long) logits.GetNumCols();
+    const ElemType* z = logits.BufferPointer();
+#pragma omp parallel for
+    for (long j = 0; j < N; j++)
+    {
+        const ElemType* pz = z + j * M;
+        ElemType maxv = pz[0];
+        for (long i = 1; i < M; i++)
+        {
+            if (pz[i] > maxv)
+                maxv = pz[i];
+        }
+        ElemType sum = 0;
+        for (long i = 0; i < M; i++)
+            sum += exp(pz[i] - maxv);
+        const ElemType lse = maxv + log(sum);
+        ElemType loss = 0;
+        for (CPUSPARSE_INDEX_TYPE p = labels.m_compIndex[j]; p < labels.m_compIndex[j + 1]; p++)
+            loss += labels.m_pArray[p] * (lse - pz[labels.m_unCompIndex[p]]);
+        logSumExp.BufferPointer()[j] = lse;
+        columnLoss.BufferPointer()[j] = loss;
+    }
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxBackward() for comments
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(const CPUMatrix<ElemType>& alpha, const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp,
+                                                                CPUMatrix<ElemType>& gradient)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    const long M = (long) logits.GetNumRows(), N = (long) logits.GetNumCols();
+    const ElemType a = alpha.BufferPointer()[0];
+#pragma omp parallel for
+    for (long j = 0; j < N; j++)
+    {
+        const ElemType* pz = logits.BufferPointer() + j * M;
+        ElemType* pg = gradient.BufferPointer() + j * M;
+        const ElemType lse = logSumExp.BufferPointer()[j];
+        for (long i = 0; i < M; i++)
+            pg[i] += a * exp(pz[i] - lse);
+        for (CPUSPARSE_INDEX_TYPE p = labels.m_compIndex[j]; p < labels.m_compIndex[j + 1]; p++)
+            pg[labels.m_unCompIndex[p]] -= a * labels.m_pArray[p];
+    }
+}
+
 template <class ElemType>
 bool CPUSparseMatrix<ElemType>::AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold)
 {
@@ -985,6 +1335,180 @@ ElemType CPUSparseMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& c, const bool n
         return 1;
 }
 
+// FSAdagrad update of the values (functionValues) touched by the block-sparse gradients (this)
+// c holds the smoothed squared gradients and the momentum in the same layout as for dense gradients, so that both can share it.
+// Elements outside the blocks are left alone, i.e. their statistics are not decayed and no momentum is applied to them.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::FSAdagrad(CPUMatrix<ElemType>& c, CPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul)
+{
+    if (m_format != MatrixFormat::matrixFormatSparseBlockCol && m_format != MatrixFormat::matrixFormatSparseBlockRow)
+        RuntimeError("CPUSparseMatrix:: FSAdagrad() only support block sparse format");
+
+    size_t numColsNeeded = 2 * GetNumCols();
+    if (c.IsEmpty() || c.GetNumCols() < numColsNeeded)
+    {
+        c.Resize(GetNumRows(), numColsNeeded);
+        c.SetValue(0.0);
+    }
+
+    assert(c.GetNumRows() == GetNumRows() && c.GetNumCols() == numColsNeeded);
+
+    const bool isBlockCol = (m_format == MatrixFormat::matrixFormatSparseBlockCol);
+    const size_t len = isBlockCol ? GetNumRows() : GetNumCols();
+    const size_t n = this->GetNumElements();
+    ElemType* smoothAda = c.BufferPointer();
+    ElemType* smoothMom = c.BufferPointer() + n;
+    ElemType* val = functionValues.BufferPointer();
+#pragma omp parallel for
+    for (long j = 0; j < (long) m_blockSize; j++)
+    {
+        size_t colOrRow = m_blockIds[j] - m_blockIdShift;
+        for (size_t i = 0; i < len; i++)
+        {
+            size_t row = isBlockCol ? i : colOrRow;
+            size_t col = isBlockCol ? colOrRow : i;
+            size_t index = row + col * GetNumRows();
+
+            ElemType g = m_pArray[j * len + i];
+            ElemType adaSqr = adaWeight * smoothAda[index] + (1.0f - adaWeight) * g * g;
+            smoothAda[index] = adaSqr;
+            if (adaSqr != 0.0f)
+            {
+                ElemType w = adaMul * ((ElemType) 1.0 / sqrt(adaSqr));
+                if (w > 10.0f)
+                    w = 10.0f;
+                g *= w;
+            }
+
+            if (momentum > 0.0f)
+            {
+                g = momentum * smoothMom[index] + (1.0f - momentum) * g;
+                smoothMom[index] = g;
+            }
+
+            val[index] -= g * learnRatePerSample;
+        }
+    }
+}
+
+// Adam update of the values touched by the block-sparse gradients (this), see Matrix::Adam(); c has the layout of the
+// dense Adam. With 'directionOnly' (LAMB) the direction overwrites the nonzeros of this instead.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::Adam(CPUMatrix<ElemType>& c, CPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+                              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+    if (m_format != MatrixFormat::matrixFormatSparseBlockCol && m_format != MatrixFormat::matrixFormatSparseBlockRow)
+        RuntimeError("CPUSparseMatrix:: Adam() only support block sparse format");
+
+    size_t numColsNeeded = 2 * GetNumCols();
+    if (c.IsEmpty() || c.GetNumCols() < numColsNeeded)
+    {
+        c.Resize(GetNumRows(), numColsNeeded);
+        c.SetValue(0.0);
+    }
+
+    assert(c.GetNumRows() == GetNumRows() && c.GetNumCols() == numColsNeeded);
+
+    const bool isBlockCol = (m_format == MatrixFormat::matrixFormatSparseBlockCol);
+    const size_t len = isBlockCol ? GetNumRows() : GetNumCols();
+    const size_t n = this->GetNumElements();
+    ElemType* smoothMom = c.BufferPointer();
+    ElemType* smoothSqr = c.BufferPointer() + n;
+    ElemType* val = functionValues.BufferPointer();
+#pragma omp parallel for
+    for (long j = 0; j < (long) m_blockSize; j++)
+    {
+        size_t colOrRow = m_blockIds[j] - m_blockIdShift;
+        for (size_t i = 0; i < len; i++)
+        {
+            size_t row = isBlockCol ? i : colOrRow;
+            size_t col = isBlockCol ? colOrRow : i;
+            size_t index = row + col * GetNumRows();
+
+            ElemType& g = m_pArray[j * len + i];
+            smoothMom[index] = beta1 * smoothMom[index] + (1 - beta1) * g;
+            smoothSqr[index] = beta2 * smoothSqr[index] + (1 - beta2) * g * g;
+            ElemType d = smoothMom[index] * biasCorrection1 / (sqrt(smoothSqr[index] * biasCorrection2) + epsilon);
+            if (directionOnly)
+                g = d + weightDecay * val[index];
+            else
+                val[index] -= learnRatePerSample * d;
+        }
+    }
+}
+
+// RmsProp scaling of the block-sparse gradients (this), updating the statistics in c for the touched elements only
+// c has the layout of the dense RmsProp (accumulated variances, signs, step sizes). An element whose step size is still 0
+// has never been touched and gets initialized from its first gradient, as the dense version does for all elements.
+template <class ElemType>
+ElemType CPUSparseMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& c,
+                                            ElemType RMS_GAMMA,
+                                            ElemType RMS_WGT_INC,
+                                            ElemType RMS_WGT_MAX,
+                                            ElemType RMS_WGT_DEC,
+                                            ElemType RMS_WGT_MIN,
+                                            const bool needAveMultiplier)
+{
+    if (m_format != MatrixFormat::matrixFormatSparseBlockCol && m_format != MatrixFormat::matrixFormatSparseBlockRow)
+        RuntimeError("CPUSparseMatrix:: RmsProp() only support block sparse format");
+
+    const ElemType floor = 1e-6f;
+
+    size_t numColsNeeded = 3 * GetNumCols();
+    if (c.IsEmpty() || c.GetNumCols() < numColsNeeded)
+    {
+        c.Resize(GetNumRows(), numColsNeeded);
+        c.SetValue(0.0);
+    }
+
+    const bool isBlockCol = (m_format == MatrixFormat::matrixFormatSparseBlockCol);
+    const size_t len = isBlockCol ? GetNumRows() : GetNumCols();
+    const size_t n = this->GetNumElements();
+    ElemType* avars = c.BufferPointer();         // accumulated variances for RMS scaling
+    ElemType* signs = c.BufferPointer() + n;     // sign of previous gradient
+    ElemType* steps = c.BufferPointer() + 2 * n; // current step size
+
+    const ElemType ONE_MINUS_GAMMA = ElemType(1.0) - RMS_GAMMA;
+    ElemType aveMultiplier = 0;
+    for (size_t j = 0; j < m_blockSize; j++)
+    {
+        size_t colOrRow = m_blockIds[j] - m_blockIdShift;
+        for (size_t i = 0; i < len; i++)
+        {
+            size_t row = isBlockCol ? i : colOrRow;
+            size_t col = isBlockCol ? colOrRow : i;
+            size_t index = row + col * GetNumRows();
+
+            ElemType& g = m_pArray[j * len + i];
+            if (steps[index] == 0)
+            {
+                avars[index] = g * g;
+                steps[index] = ElemType(0.02);
+            }
+
+            avars[index] = RMS_GAMMA * avars[index] + ONE_MINUS_GAMMA * (g * g);
+            const int grad_sign = (ElemType(0) < g) - (g < ElemType(0));
+
+            if (signs[index] * grad_sign > 0)
+                steps[index] = std::min(steps[index] * RMS_WGT_INC, RMS_WGT_MAX);
+            else
+                steps[index] = std::max(steps[index] * RMS_WGT_DEC, RMS_WGT_MIN);
+
+            ElemType a = steps[index] / sqrt(avars[index] + floor);
+            g *= a;
+            signs[index] = (ElemType) grad_sign;
+
+            if (needAveMultiplier)
+                aveMultiplier += a;
+        }
+    }
+
+    if (needAveMultiplier && m_nz > 0)
+        return aveMultiplier / m_nz;
+    else
+        return 1;
+}
+
 template <class ElemType>
 CPUSparseMatrix<ElemType>& CPUSparseMatrix<ElemType>::InplaceTruncateTop(const ElemType threshold)
 {
@@ -0,0 +1,196 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CPUThreading.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <omp.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include "Windows.h"
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef USE_MKL
+#include <mkl.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+static const int maxCpu = 64; // (SetThreadAffinityMask() takes one processor group)
+#else
+static const int maxCpu = CPU_SETSIZE;
+#endif
+
+std::vector<int> CPUThreading::ParseCpuList(const std::string& cpuList)
+{
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < cpuList.size())
+    {
+        size_t end = cpuList.find_first_of(",:", pos);
+        if (end == std::string::npos)
+            end = cpuList.size();
+        const std::string item = cpuList.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+
+        // "n" or "first-last"
+        const size_t dash = item.find('-', 1);
+        const std::string firstStr = item.substr(0, dash);
+        const std::string lastStr = dash == std::string::npos ? firstStr : item.substr(dash + 1);
+        char* firstEnd;
+        char* lastEnd;
+        const long first = strtol(firstStr.c_str(), &firstEnd, 10);
+        const long last = strtol(lastStr.c_str(), &lastEnd, 10);
+        if (firstStr.empty() || lastStr.empty() || *firstEnd || *lastEnd || first < 0 || last < first || last >= maxCpu)
+            InvalidArgument("ParseCpuList: '%s' in the CPU list '%s' is not a CPU number or range (first-last) below %d.", item.c_str(), cpuList.c_str(), maxCpu);
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back((int) cpu);
+    }
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+// -----------------------------------------------------------------------
+// Scope
+// -----------------------------------------------------------------------
+
+static bool BindCurrentThread(const std::vector<int>& cpus)
+{
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus)
+        mask |= (DWORD_PTR) 1 << cpu;
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// what the calling thread and its OpenMP team were last bound to (a hash of the CPU list, 0 if never), and the team size
+#ifdef _WIN32
+static __declspec(thread) size_t t_boundCpusHash = 0;
+static __declspec(thread) int t_boundTeamSize = 0;
+#else
+static __thread size_t t_boundCpusHash = 0;
+static __thread int t_boundTeamSize = 0;
+#endif
+
+static size_t HashCpus(const std::vector<int>& cpus)
+{
+    size_t hash = 14695981039346656037ull; // FNV-1a
+    for (int cpu : cpus)
+    {
+        hash ^= (size_t) cpu;
+        hash *= 1099511628211ull;
+    }
+    return hash ? hash : 1;
+}
+
+// binds the calling thread and the threads of its OpenMP team of 'teamSize', unless that was done already
+static void BindTeam(const std::vector<int>& cpus, int teamSize)
+{
+    const size_t hash = HashCpus(cpus);
+    if (hash == t_boundCpusHash && teamSize <= t_boundTeamSize)
+        return;
+
+    bool failed = !BindCurrentThread(cpus); // (threads the team creates from now on inherit this)
+#pragma omp parallel num_threads(teamSize)
+    {
+        if (!BindCurrentThread(cpus))
+        {
+#pragma omp critical
+            failed = true;
+        }
+    }
+    if (failed)
+    {
+        t_boundCpusHash = 0;
+        RuntimeError("CPUThreading: Failed to bind threads to the CPUs %d..%d; they may not exist or not be available to this process.", cpus.front(), cpus.back());
+    }
+    t_boundCpusHash = hash;
+    t_boundTeamSize = teamSize;
+}
+
+CPUThreading::Scope::Scope(const Options& options)
+    : m_active(!options.IsDefault()), m_prevOmpThreads(0), m_prevMklThreads(0)
+{
+    if (!m_active)
+        return;
+
+    m_prevOmpThreads = omp_get_max_threads();
+    if (options.m_intraOpThreads > 0)
+    {
+        omp_set_num_threads(options.m_intraOpThreads);
+#ifdef USE_MKL
+        m_prevMklThreads = mkl_set_num_threads_local(options.m_intraOpThreads); // (0: the process-wide setting)
+#endif
+    }
+    if (!options.m_cpus.empty())
+        BindTeam(options.m_cpus, omp_get_max_threads());
+}
+
+CPUThreading::Scope::~Scope()
+{
+    if (!m_active)
+        return;
+    omp_set_num_threads(m_prevOmpThreads);
+#ifdef USE_MKL
+    mkl_set_num_threads_local(m_prevMklThreads);
+#endif
+}
+
+// -----------------------------------------------------------------------
+// ConcurrencySlot
+// -----------------------------------------------------------------------
+
+static std::mutex s_slotMutex;
+static std::condition_variable s_slotFreed;
+static size_t s_maxConcurrentEvaluations = 0;
+static size_t s_numSlotsHeld = 0;
+
+void CPUThreading::SetMaxConcurrentEvaluations(size_t maxConcurrentEvaluations)
+{
+    std::lock_guard<std::mutex> lock(s_slotMutex);
+    s_maxConcurrentEvaluations = maxConcurrentEvaluations;
+    s_slotFreed.notify_all(); // (a higher limit may let waiting evaluations in)
+}
+
+size_t CPUThreading::GetMaxConcurrentEvaluations()
+{
+    std::lock_guard<std::mutex> lock(s_slotMutex);
+    return s_maxConcurrentEvaluations;
+}
+
+CPUThreading::ConcurrencySlot::ConcurrencySlot()
+{
+    std::unique_lock<std::mutex> lock(s_slotMutex);
+    s_slotFreed.wait(lock, []
+                     {
+                         return s_maxConcurrentEvaluations == 0 || s_numSlotsHeld < s_maxConcurrentEvaluations;
+                     });
+    s_numSlotsHeld++;
+}
+
+CPUThreading::ConcurrencySlot::~ConcurrencySlot()
+{
+    std::lock_guard<std::mutex> lock(s_slotMutex);
+    s_numSlotsHeld--;
+    s_slotFreed.notify_one();
+}
+
+} } }
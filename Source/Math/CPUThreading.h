@@ -0,0 +1,93 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUThreading.h -- per-thread control of the CPU threads of matrix operations, for several evaluators in one process
+//
+// The CPU kernels parallelize with OpenMP, and MKL with its own threads. CPUMatrix::SetNumThreads() sets their number for
+// the whole process, so that several evaluators in one process each use all cores and oversubscribe them.
+// A Scope instead applies Options to the calling thread only, for as long as it exists:
+//  - intra-op threads: how many threads each operation started on this thread may use. OpenMP's thread count is a setting
+//    of the calling thread, and so is MKL's with mkl_set_num_threads_local(); OpenBLAS and ACML only have a process-wide
+//    one, which is left alone.
+//  - CPU affinity: the calling thread and its OpenMP team, i.e. the pool of threads that runs the parallel loops started
+//    on this thread, are bound to the given CPUs. Binding sticks with the threads after the Scope ends; it is redone only
+//    when a Scope asks for other CPUs or a larger team.
+// A ConcurrencySlot limits how many evaluations run at the same time in the process (inter-op concurrency). While the
+// limit is reached, further evaluations wait for a slot, so that their latency is spent queuing instead of competing.
+// E.g. 16 evaluators on 32 cores: 2 intra-op threads each, evaluator k bound to CPUs 2k and 2k+1.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class MATH_API CPUThreading
+{
+public:
+    struct Options
+    {
+        int m_intraOpThreads;    // threads per operation; 0: leave the current setting
+        std::vector<int> m_cpus; // CPUs to run on; empty: leave the current binding
+
+        Options()
+            : m_intraOpThreads(0)
+        {
+        }
+        bool IsDefault() const
+        {
+            return m_intraOpThreads <= 0 && m_cpus.empty();
+        }
+    };
+
+    // parses a list of CPU numbers and ranges, e.g. "0-7,16-23" (also ':' as separator, for config lists); "" gives none
+    static std::vector<int> ParseCpuList(const std::string& cpuList);
+
+    class MATH_API Scope
+    {
+    public:
+        explicit Scope(const Options& options);
+        ~Scope();
+
+    private:
+        bool m_active;
+        int m_prevOmpThreads;
+        int m_prevMklThreads;
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // the number of evaluations that may run at the same time in the process; 0: no limit (the default)
+    static void SetMaxConcurrentEvaluations(size_t maxConcurrentEvaluations);
+    static size_t GetMaxConcurrentEvaluations();
+
+    // waits until fewer than GetMaxConcurrentEvaluations() evaluations hold a slot, and holds one while it exists
+    class MATH_API ConcurrencySlot
+    {
+    public:
+        ConcurrencySlot();
+        ~ConcurrencySlot();
+
+    private:
+        ConcurrencySlot(const ConcurrencySlot&) = delete;
+        ConcurrencySlot& operator=(const ConcurrencySlot&) = delete;
+    };
+};
+
+} } }
@@ -0,0 +1,237 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernels.cpp -- generic implementation of CPUVectorKernels, and runtime selection of the best one
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+#include "CPUFeatures.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// defined in CPUVectorKernelsAVX2.cpp and CPUVectorKernelsAVX512.cpp; return false if the compiler could not target the instruction set
+bool CreateAVX2VectorKernels(CPUVectorKernels& kernels);
+bool CreateAVX512VectorKernels(CPUVectorKernels& kernels);
+
+// ---------------------------------------------------------------------------
+// generic kernels, same arithmetic as the scalar CPUMatrix loops
+// ---------------------------------------------------------------------------
+
+static void GenericExp(const float* a, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+        us[k] = exp(a[k]);
+}
+
+static void GenericLog(const float* a, float floor, float valuebelowfloor, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+        us[k] = a[k] < floor ? valuebelowfloor : log(a[k]);
+}
+
+static void GenericSigmoid(const float* a, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        if (a[k] >= 0)
+            us[k] = 1 / (1 + exp(-a[k]));
+        else
+        {
+            float v = exp(a[k]);
+            us[k] = v / (1 + v);
+        }
+    }
+}
+
+static void GenericTanh(const float* a, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+        us[k] = tanh(a[k]);
+}
+
+static void GenericClip(const float* a, float lo, float hi, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        float v = a[k];
+        if (v > hi)
+            v = hi;
+        else if (v < lo)
+            v = lo;
+        us[k] = v;
+    }
+}
+
+static void GenericAddScalar(const float* a, float c, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+        us[k] = a[k] + c;
+}
+
+static float GenericSum(const float* a, size_t n)
+{
+    float sum = 0;
+    for (size_t k = 0; k < n; k++)
+        sum += a[k];
+    return sum;
+}
+
+static float GenericMax(const float* a, size_t n)
+{
+    float maxval = a[0];
+    for (size_t k = 1; k < n; k++)
+        maxval = std::max(maxval, a[k]);
+    return maxval;
+}
+
+static void GenericAddTo(const float* a, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+        us[k] += a[k];
+}
+
+static float GenericSubtractAndSumExp(const float* a, float shift, float* us, size_t n)
+{
+    float sum = 0;
+    for (size_t k = 0; k < n; k++)
+        sum += exp(us[k] = a[k] - shift);
+    return sum;
+}
+
+static float GenericAddAndSum(const float* a, const float* b, float* us, size_t n)
+{
+    float sum = 0;
+    for (size_t k = 0; k < n; k++)
+        sum += us[k] = a[k] + b[k];
+    return sum;
+}
+
+static void GenericSumBelowAndAbove(const float* a, float threshold, float sums[2], size_t counts[2], size_t n)
+{
+    float sum0 = 0, sum1 = 0;
+    size_t num0 = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        if (a[k] < threshold)
+        {
+            sum0 += a[k];
+            num0++;
+        }
+        else
+            sum1 += a[k];
+    }
+    sums[0] = sum0;
+    sums[1] = sum1;
+    counts[0] = num0;
+    counts[1] = n - num0;
+}
+
+static float GenericSumOfSquaredDeviations(const float* a, float mean, size_t n)
+{
+    float sum = 0;
+    for (size_t k = 0; k < n; k++)
+        sum += (a[k] - mean) * (a[k] - mean);
+    return sum;
+}
+
+static void GenericQuantize1Bit(float* us, float threshold, float val0, float val1, unsigned int bitmask, unsigned int* bits, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        if (us[k] >= threshold)
+        {
+            bits[k] |= bitmask;
+            us[k] -= val1;
+        }
+        else
+            us[k] -= val0;
+    }
+}
+
+static void GenericUnquantize1Bit(const unsigned int* bits, unsigned int bitmask, float val0, float val1, bool add, float* us, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        const float val = (bits[k] & bitmask) ? val1 : val0;
+        us[k] = add ? us[k] + val : val;
+    }
+}
+
+static bool CreateGenericVectorKernels(CPUVectorKernels& kernels)
+{
+    kernels.m_name = "generic";
+    kernels.Exp = &GenericExp;
+    kernels.Log = &GenericLog;
+    kernels.Sigmoid = &GenericSigmoid;
+    kernels.Tanh = &GenericTanh;
+    kernels.Clip = &GenericClip;
+    kernels.AddScalar = &GenericAddScalar;
+    kernels.Sum = &GenericSum;
+    kernels.Max = &GenericMax;
+    kernels.AddTo = &GenericAddTo;
+    kernels.SubtractAndSumExp = &GenericSubtractAndSumExp;
+    kernels.AddAndSum = &GenericAddAndSum;
+    kernels.SumBelowAndAbove = &GenericSumBelowAndAbove;
+    kernels.SumOfSquaredDeviations = &GenericSumOfSquaredDeviations;
+    kernels.Quantize1Bit = &GenericQuantize1Bit;
+    kernels.Unquantize1Bit = &GenericUnquantize1Bit;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// selection
+// ---------------------------------------------------------------------------
+
+// All of these are initialized during static initialization, i.e. before any CPUMatrix operation can run, and are read-only afterwards.
+static CPUVectorKernels s_genericKernels;
+static CPUVectorKernels s_avx2Kernels;
+static CPUVectorKernels s_avx512Kernels;
+static const bool s_hasGeneric = CreateGenericVectorKernels(s_genericKernels);
+static const bool s_hasAVX2 = CPUSupportsAVX2() && CreateAVX2VectorKernels(s_avx2Kernels);
+static const bool s_hasAVX512 = CPUSupportsAVX512() && CreateAVX512VectorKernels(s_avx512Kernels);
+
+static const CPUVectorKernels* SelectVectorKernels()
+{
+    const CPUVectorKernels* best = s_hasAVX512 ? &s_avx512Kernels : s_hasAVX2 ? &s_avx2Kernels : &s_genericKernels;
+    const char* requested = getenv("CNTK_CPU_VECTOR_KERNELS");
+    if (requested && *requested)
+    {
+        const CPUVectorKernels* candidates[] = {CPUVectorKernels::GetGeneric(), CPUVectorKernels::GetAVX2(), CPUVectorKernels::GetAVX512()};
+        for (const CPUVectorKernels* candidate : candidates)
+        {
+            if (candidate && strcmp(candidate->m_name, requested) == 0)
+                return candidate;
+        }
+        fprintf(stderr, "CNTK_CPU_VECTOR_KERNELS: '%s' is unknown or not supported on this CPU, using '%s'\n", requested, best->m_name);
+    }
+    return best;
+}
+
+static const CPUVectorKernels* s_kernels = SelectVectorKernels();
+
+/*static*/ const CPUVectorKernels& CPUVectorKernels::Get()
+{
+    return *s_kernels;
+}
+
+/*static*/ const CPUVectorKernels* CPUVectorKernels::GetGeneric()
+{
+    return s_hasGeneric ? &s_genericKernels : nullptr;
+}
+
+/*static*/ const CPUVectorKernels* CPUVectorKernels::GetAVX2()
+{
+    return s_hasAVX2 ? &s_avx2Kernels : nullptr;
+}
+
+/*static*/ const CPUVectorKernels* CPUVectorKernels::GetAVX512()
+{
+    return s_hasAVX512 ? &s_avx512Kernels : nullptr;
+}
+} } }
@@ -0,0 +1,64 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernels.h -- SIMD kernels over contiguous float arrays for the hot elementwise and reduction ops of CPUMatrix and MatrixQuantizerCPU
+//
+// There is one implementation per instruction set: a generic one (scalar code that the compiler may auto-vectorize, using
+// the CRT math functions), AVX2+FMA, and AVX-512. The ISA-specific ones live in their own translation units, which are the
+// only ones compiled with the respective instruction set enabled, and Get() selects the best one the CPU supports at runtime.
+// The environment variable CNTK_CPU_VECTOR_KERNELS=generic|avx2|avx512 overrides the choice (e.g. for comparisons).
+//
+// The SIMD versions use polynomial approximations of exp() and log() (Cephes), which are accurate to a few ulps:
+//  - Exp, Log: relative error < 1e-6; exp() flushes to 0 below -87.3 (no denormals) and saturates above 88.3
+//  - Sigmoid, Tanh: absolute error < 1e-6
+// NaNs are propagated.
+// Reductions sum in a different order than the scalar loops, so results differ from them by rounding.
+// None of the kernels is parallelized; callers split large arrays across OpenMP threads.
+//
+
+#pragma once
+
+#include "CommonMatrix.h" // for MATH_API
+#include <cstddef>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct MATH_API CPUVectorKernels
+{
+    const char* m_name;
+
+    // us[k] = f(a[k]) for k < n; 'us' may be 'a'
+    void (*Exp)(const float* a, float* us, size_t n);
+    void (*Log)(const float* a, float floor, float valuebelowfloor, float* us, size_t n); // a[k] < floor ? valuebelowfloor : log(a[k]); floor must be normal and > 0
+    void (*Sigmoid)(const float* a, float* us, size_t n);
+    void (*Tanh)(const float* a, float* us, size_t n);
+    void (*Clip)(const float* a, float lo, float hi, float* us, size_t n); // min(max(a[k], lo), hi)
+    void (*AddScalar)(const float* a, float c, float* us, size_t n);       // a[k] + c
+
+    // reductions
+    float (*Sum)(const float* a, size_t n);
+    float (*Max)(const float* a, size_t n); // n > 0
+    void (*AddTo)(const float* a, float* us, size_t n); // us[k] += a[k]
+
+    // us[k] = a[k] - shift; returns sum_k exp(us[k]) (the core of softmax and logsoftmax)
+    float (*SubtractAndSumExp)(const float* a, float shift, float* us, size_t n);
+
+    // range statistics and 1-bit quantization of a column (MatrixQuantizerCPU)
+    float (*AddAndSum)(const float* a, const float* b, float* us, size_t n);   // us[k] = a[k] + b[k]; returns sum_k us[k]; 'us' may be 'a' or 'b'
+    void (*SumBelowAndAbove)(const float* a, float threshold, float sums[2], size_t counts[2], size_t n); // [0]: a[k] < threshold, [1]: the others
+    float (*SumOfSquaredDeviations)(const float* a, float mean, size_t n); // sum_k (a[k] - mean)^2
+    // us[k] >= threshold ? (bits[k] |= bitmask, us[k] -= val1) : (us[k] -= val0), i.e. us[k] goes from value to residual
+    void (*Quantize1Bit)(float* us, float threshold, float val0, float val1, unsigned int bitmask, unsigned int* bits, size_t n);
+    // us[k] (+)= (bits[k] & bitmask) ? val1 : val0
+    void (*Unquantize1Bit)(const unsigned int* bits, unsigned int bitmask, float val0, float val1, bool add, float* us, size_t n);
+
+    // the best implementation for this CPU
+    static const CPUVectorKernels& Get();
+
+    // the individual implementations; nullptr if not compiled in or not supported by the CPU
+    static const CPUVectorKernels* GetGeneric();
+    static const CPUVectorKernels* GetAVX2();
+    static const CPUVectorKernels* GetAVX512();
+};
+} } }
@@ -0,0 +1,105 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsAVX2.cpp -- AVX2+FMA implementation of CPUVectorKernels
+//
+// This is the only file compiled with AVX2 and FMA enabled (-mavx2 -mfma, /arch:AVX2). Nothing in here may be called
+// unless CPUVectorKernels::GetAVX2() has confirmed that the CPU supports both.
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+#include "CPUVectorKernelsImpl.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct AVX2Traits
+{
+    typedef __m256 Vec;
+    typedef __m256 Mask;
+    enum { width = 8 };
+
+    static Vec Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+    static Vec Set(float x) { return _mm256_set1_ps(x); }
+    static Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+    static Vec Fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+    static Vec Min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+    static Vec Max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+    static Vec Floor(Vec a) { return _mm256_floor_ps(a); }
+    static Vec Abs(Vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static Vec CopySign(Vec a, Vec b) { return _mm256_or_ps(Abs(a), _mm256_and_ps(_mm256_set1_ps(-0.0f), b)); }
+
+    static Mask Lt(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask Gt(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask Ge(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static Mask IsNaN(Vec a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+    static Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    static Vec Select(Mask m, Vec a, Vec b) { return _mm256_blendv_ps(b, a, m); }
+
+    static Mask TestBits(const unsigned int* p, unsigned int bitmask)
+    {
+        const __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) p), _mm256_set1_epi32((int) bitmask));
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(b, _mm256_set1_epi32((int) bitmask)));
+    }
+    static void OrBits(unsigned int* p, Mask m, unsigned int bitmask)
+    {
+        const __m256i b = _mm256_and_si256(_mm256_castps_si256(m), _mm256_set1_epi32((int) bitmask));
+        _mm256_storeu_si256((__m256i*) p, _mm256_or_si256(_mm256_loadu_si256((const __m256i*) p), b));
+    }
+
+    static Vec Pow2(Vec n)
+    {
+        const __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    static Vec Frexp(Vec x, Vec& e)
+    {
+        const __m256i bits = _mm256_castps_si256(x);
+        e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+        const __m256i mantissa = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)); // exponent of 0.5
+        return _mm256_castsi256_ps(mantissa);
+    }
+
+    static float HorizontalSum(Vec v)
+    {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+    static float HorizontalMax(Vec v)
+    {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+};
+
+bool CreateAVX2VectorKernels(CPUVectorKernels& kernels)
+{
+    kernels = CPUVectorKernelsImpl<AVX2Traits>::Create("avx2");
+    return true;
+}
+} } }
+
+#else // compiler does not target AVX2 for this file
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+bool CreateAVX2VectorKernels(CPUVectorKernels&)
+{
+    return false;
+}
+} } }
+
+#endif
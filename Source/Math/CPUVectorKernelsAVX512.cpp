@@ -0,0 +1,94 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsAVX512.cpp -- AVX-512 implementation of CPUVectorKernels
+//
+// This is the only file compiled with AVX-512F enabled (-mavx512f). Nothing in here may be called unless
+// CPUVectorKernels::GetAVX512() has confirmed that the CPU supports it. Compilers that cannot target AVX-512
+// (e.g. Visual Studio 2013) compile this file to a stub, and the AVX2 kernels are used instead.
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+
+#ifdef __AVX512F__
+
+#include <immintrin.h>
+#include "CPUVectorKernelsImpl.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct AVX512Traits
+{
+    typedef __m512 Vec;
+    typedef __mmask16 Mask;
+    enum { width = 16 };
+
+    // (AVX-512F has no bitwise float operations, only integer ones)
+    static __m512i Bits(Vec a) { return _mm512_castps_si512(a); }
+    static Vec Float(__m512i a) { return _mm512_castsi512_ps(a); }
+
+    static Vec Load(const float* p) { return _mm512_loadu_ps(p); }
+    static void Store(float* p, Vec v) { _mm512_storeu_ps(p, v); }
+    static Vec Set(float x) { return _mm512_set1_ps(x); }
+    static Vec Add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm512_sub_ps(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm512_div_ps(a, b); }
+    static Vec Fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+    static Vec Min(Vec a, Vec b) { return _mm512_min_ps(a, b); }
+    static Vec Max(Vec a, Vec b) { return _mm512_max_ps(a, b); }
+    static Vec Floor(Vec a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static Vec Abs(Vec a) { return Float(_mm512_and_si512(Bits(a), _mm512_set1_epi32(0x7fffffff))); }
+    static Vec CopySign(Vec a, Vec b) { return Float(_mm512_or_si512(Bits(Abs(a)), _mm512_and_si512(Bits(b), _mm512_set1_epi32(0x80000000)))); }
+
+    static Mask Lt(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Mask Gt(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static Mask Ge(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static Mask IsNaN(Vec a) { return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q); }
+    static Mask Or(Mask a, Mask b) { return (Mask) (a | b); }
+    static Vec Select(Mask m, Vec a, Vec b) { return _mm512_mask_blend_ps(m, b, a); }
+
+    static Mask TestBits(const unsigned int* p, unsigned int bitmask) { return _mm512_test_epi32_mask(_mm512_loadu_si512(p), _mm512_set1_epi32((int) bitmask)); }
+    static void OrBits(unsigned int* p, Mask m, unsigned int bitmask)
+    {
+        const __m512i b = _mm512_loadu_si512(p);
+        _mm512_storeu_si512(p, _mm512_mask_or_epi32(b, m, b, _mm512_set1_epi32((int) bitmask)));
+    }
+
+    static Vec Pow2(Vec n)
+    {
+        const __m512i e = _mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127));
+        return Float(_mm512_slli_epi32(e, 23));
+    }
+    static Vec Frexp(Vec x, Vec& e)
+    {
+        const __m512i bits = Bits(x);
+        e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+        const __m512i mantissa = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000)); // exponent of 0.5
+        return Float(mantissa);
+    }
+
+    static float HorizontalSum(Vec v) { return _mm512_reduce_add_ps(v); }
+    static float HorizontalMax(Vec v) { return _mm512_reduce_max_ps(v); }
+};
+
+bool CreateAVX512VectorKernels(CPUVectorKernels& kernels)
+{
+    kernels = CPUVectorKernelsImpl<AVX512Traits>::Create("avx512");
+    return true;
+}
+} } }
+
+#else // compiler does not target AVX-512 for this file
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+bool CreateAVX512VectorKernels(CPUVectorKernels&)
+{
+    return false;
+}
+} } }
+
+#endif
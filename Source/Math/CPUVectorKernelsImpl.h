@@ -0,0 +1,369 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsImpl.h -- the SIMD kernels of CPUVectorKernels, written once against an instruction-set traits class
+//
+// Include this only from a translation unit compiled for the instruction set of the traits class (CPUVectorKernelsAVX2.cpp,
+// CPUVectorKernelsAVX512.cpp). The traits class V provides
+//  - types: V::Vec (float vector), V::Mask (result of comparisons); V::width (number of floats in a Vec)
+//  - Load, Store, Set, Add, Sub, Mul, Div, Fma (a * b + c), Min, Max (second operand if one is NaN), Floor, Abs, CopySign (magnitude of a, sign of b)
+//  - Lt, Gt, Ge, IsNaN -> Mask; Or (Mask, Mask); Select (Mask m, a, b) = m ? a : b
+//  - TestBits (p, bitmask) -> Mask of (p[k] & bitmask) != 0; OrBits (p, Mask m, bitmask): p[k] |= bitmask where m (V::width unsigned ints at p)
+//  - Pow2 (n) = 2^n for integral n in [-126, 127]; Frexp (x, e) = mantissa in [0.5, 1), sets e to the exponent (x normal and > 0)
+//  - HorizontalSum, HorizontalMax
+// The exp() and log() approximations are those of the Cephes library (expf.c, logf.c).
+//
+
+#pragma once
+
+#include "CPUVectorKernels.h"
+#include <algorithm>
+#include <limits>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class V>
+struct CPUVectorKernelsImpl
+{
+    typedef typename V::Vec Vec;
+
+    // exp(x), relative error < 1e-6 in [-87.3, 88.3]; flushes to 0 below (no denormals) and saturates above that range
+    static Vec Exp(Vec x)
+    {
+        const Vec nan = x;
+        const typename V::Mask isnan = V::IsNaN(x);
+        const typename V::Mask underflow = V::Lt(x, V::Set(-87.33654f));
+        x = V::Min(V::Max(x, V::Set(-87.33654f)), V::Set(88.3762626647949f));
+
+        // exp(x) = 2^n * exp(r) with n = round(x / log(2)), r = x - n log(2) in [-log(2)/2, log(2)/2]
+        const Vec n = V::Min(V::Floor(V::Fma(x, V::Set(1.44269504088896341f), V::Set(0.5f))), V::Set(127.0f));
+        Vec r = V::Fma(n, V::Set(-0.693359375f), x); // log(2) in two parts, for an exact product with the high part
+        r = V::Fma(n, V::Set(2.12194440e-4f), r);
+
+        const Vec r2 = V::Mul(r, r);
+        Vec p = V::Set(1.9875691500E-4f);
+        p = V::Fma(p, r, V::Set(1.3981999507E-3f));
+        p = V::Fma(p, r, V::Set(8.3334519073E-3f));
+        p = V::Fma(p, r, V::Set(4.1665795894E-2f));
+        p = V::Fma(p, r, V::Set(1.6666665459E-1f));
+        p = V::Fma(p, r, V::Set(5.0000001201E-1f));
+        p = V::Add(V::Fma(p, r2, r), V::Set(1.0f));
+
+        Vec y = V::Mul(p, V::Pow2(n));
+        y = V::Select(underflow, V::Set(0.0f), y);
+        return V::Select(isnan, nan, y);
+    }
+
+    // log(x) for normal x > 0, relative error < 1e-6; +inf and NaN are passed through
+    static Vec Log(Vec x)
+    {
+        const Vec orig = x;
+        const typename V::Mask passthrough = V::Or(V::IsNaN(x), V::Gt(x, V::Set(std::numeric_limits<float>::max())));
+
+        Vec e;
+        x = V::Frexp(x, e); // x in [0.5, 1)
+
+        // shift x into [sqrt(1/2), sqrt(2)) and subtract 1
+        const typename V::Mask small = V::Lt(x, V::Set(0.707106781186547524f));
+        e = V::Select(small, V::Sub(e, V::Set(1.0f)), e);
+        x = V::Sub(V::Select(small, V::Add(x, x), x), V::Set(1.0f));
+
+        const Vec z = V::Mul(x, x);
+        Vec p = V::Set(7.0376836292E-2f);
+        p = V::Fma(p, x, V::Set(-1.1514610310E-1f));
+        p = V::Fma(p, x, V::Set(1.1676998740E-1f));
+        p = V::Fma(p, x, V::Set(-1.2420140846E-1f));
+        p = V::Fma(p, x, V::Set(1.4249322787E-1f));
+        p = V::Fma(p, x, V::Set(-1.6668057665E-1f));
+        p = V::Fma(p, x, V::Set(2.0000714765E-1f));
+        p = V::Fma(p, x, V::Set(-2.4999993993E-1f));
+        p = V::Fma(p, x, V::Set(3.3333331174E-1f));
+        Vec y = V::Mul(V::Mul(p, x), z);
+        y = V::Fma(e, V::Set(-2.12194440e-4f), y);
+        y = V::Fma(z, V::Set(-0.5f), y);
+        y = V::Add(x, y);
+        y = V::Fma(e, V::Set(0.693359375f), y);
+        return V::Select(passthrough, orig, y);
+    }
+
+    // 1 / (1 + exp(-x)), absolute error < 1e-6
+    static Vec Sigmoid(Vec x)
+    {
+        return V::Div(V::Set(1.0f), V::Add(V::Set(1.0f), Exp(V::Sub(V::Set(0.0f), x))));
+    }
+
+    // tanh(x), absolute error < 1e-6: polynomial for small |x| (Cephes tanhf.c), else 1 - 2 / (exp(2|x|) + 1)
+    static Vec Tanh(Vec x)
+    {
+        const Vec ax = V::Abs(x);
+        const Vec z = V::Mul(x, x);
+        Vec p = V::Set(-5.70498872745E-3f);
+        p = V::Fma(p, z, V::Set(2.06390887954E-2f));
+        p = V::Fma(p, z, V::Set(-5.37397155531E-2f));
+        p = V::Fma(p, z, V::Set(1.33314422036E-1f));
+        p = V::Fma(p, z, V::Set(-3.33332819422E-1f));
+        const Vec small = V::Fma(V::Mul(p, z), x, x);
+
+        const Vec e = Exp(V::Add(ax, ax));
+        const Vec large = V::CopySign(V::Sub(V::Set(1.0f), V::Div(V::Set(2.0f), V::Add(e, V::Set(1.0f)))), x);
+        return V::Select(V::Gt(ax, V::Set(0.625f)), large, small);
+    }
+
+    // apply a Vec -> Vec function to n elements; the tail is processed through a padded buffer
+    template <class F>
+    static void Apply(const float* a, float* us, size_t n, F f)
+    {
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+            V::Store(us + k, f(V::Load(a + k)));
+        if (k < n)
+        {
+            float buf[V::width] = {0};
+            std::copy(a + k, a + n, buf);
+            V::Store(buf, f(V::Load(buf)));
+            std::copy(buf, buf + (n - k), us + k);
+        }
+    }
+
+    static void ExpKernel(const float* a, float* us, size_t n)
+    {
+        Apply(a, us, n, [](Vec x) -> Vec { return Exp(x); });
+    }
+
+    static void LogKernel(const float* a, float floor, float valuebelowfloor, float* us, size_t n)
+    {
+        const Vec vfloor = V::Set(floor);
+        const Vec vbelow = V::Set(valuebelowfloor);
+        Apply(a, us, n, [vfloor, vbelow](Vec x) -> Vec
+              {
+                  const typename V::Mask below = V::Lt(x, vfloor);
+                  return V::Select(below, vbelow, Log(V::Select(below, vfloor, x)));
+              });
+    }
+
+    static void SigmoidKernel(const float* a, float* us, size_t n)
+    {
+        Apply(a, us, n, [](Vec x) -> Vec { return Sigmoid(x); });
+    }
+
+    static void TanhKernel(const float* a, float* us, size_t n)
+    {
+        Apply(a, us, n, [](Vec x) -> Vec { return Tanh(x); });
+    }
+
+    static void ClipKernel(const float* a, float lo, float hi, float* us, size_t n)
+    {
+        const Vec vlo = V::Set(lo);
+        const Vec vhi = V::Set(hi);
+        Apply(a, us, n, [vlo, vhi](Vec x) -> Vec { return V::Min(vhi, V::Max(vlo, x)); }); // (NaN in x is kept: min/max return their second operand if one is NaN)
+    }
+
+    static void AddScalarKernel(const float* a, float c, float* us, size_t n)
+    {
+        const Vec vc = V::Set(c);
+        Apply(a, us, n, [vc](Vec x) -> Vec { return V::Add(x, vc); });
+    }
+
+    static float SumKernel(const float* a, size_t n)
+    {
+        Vec sum0 = V::Set(0.0f), sum1 = V::Set(0.0f); // two accumulators to hide the latency of the additions
+        size_t k = 0;
+        for (; k + 2 * V::width <= n; k += 2 * V::width)
+        {
+            sum0 = V::Add(sum0, V::Load(a + k));
+            sum1 = V::Add(sum1, V::Load(a + k + V::width));
+        }
+        float sum = V::HorizontalSum(V::Add(sum0, sum1));
+        for (; k < n; k++)
+            sum += a[k];
+        return sum;
+    }
+
+    static float MaxKernel(const float* a, size_t n)
+    {
+        float maxval = a[0];
+        size_t k = 0;
+        if (n >= V::width)
+        {
+            Vec vmax = V::Load(a);
+            for (k = V::width; k + V::width <= n; k += V::width)
+                vmax = V::Max(vmax, V::Load(a + k));
+            maxval = V::HorizontalMax(vmax);
+        }
+        for (; k < n; k++)
+            maxval = std::max(maxval, a[k]);
+        return maxval;
+    }
+
+    static void AddToKernel(const float* a, float* us, size_t n)
+    {
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+            V::Store(us + k, V::Add(V::Load(us + k), V::Load(a + k)));
+        for (; k < n; k++)
+            us[k] += a[k];
+    }
+
+    static float SubtractAndSumExpKernel(const float* a, float shift, float* us, size_t n)
+    {
+        const Vec vshift = V::Set(shift);
+        Vec sum = V::Set(0.0f);
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+        {
+            const Vec x = V::Sub(V::Load(a + k), vshift);
+            V::Store(us + k, x);
+            sum = V::Add(sum, Exp(x));
+        }
+        if (k < n)
+        {
+            float buf[V::width];
+            std::fill(buf, buf + V::width, -std::numeric_limits<float>::infinity()); // contributes exp(-inf) = 0
+            for (size_t i = k; i < n; i++)
+                buf[i - k] = us[i] = a[i] - shift;
+            sum = V::Add(sum, Exp(V::Load(buf)));
+        }
+        return V::HorizontalSum(sum);
+    }
+
+    static float AddAndSumKernel(const float* a, const float* b, float* us, size_t n)
+    {
+        Vec vsum = V::Set(0.0f);
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+        {
+            const Vec x = V::Add(V::Load(a + k), V::Load(b + k));
+            V::Store(us + k, x);
+            vsum = V::Add(vsum, x);
+        }
+        float sum = V::HorizontalSum(vsum);
+        for (; k < n; k++)
+            sum += us[k] = a[k] + b[k];
+        return sum;
+    }
+
+    static void SumBelowAndAboveKernel(const float* a, float threshold, float sums[2], size_t counts[2], size_t n)
+    {
+        const Vec vthreshold = V::Set(threshold);
+        const Vec zero = V::Set(0.0f);
+        const Vec one = V::Set(1.0f);
+        float sum0 = 0, sum1 = 0;
+        size_t num0 = 0;
+        size_t k = 0;
+        while (k + V::width <= n)
+        {
+            // the counts are accumulated as floats, which are exact up to 2^24; hence blocks of that many elements
+            const size_t blockEnd = std::min(n, k + ((size_t) 1 << 24));
+            Vec vsum0 = zero, vsum1 = zero, vnum0 = zero;
+            for (; k + V::width <= blockEnd; k += V::width)
+            {
+                const Vec x = V::Load(a + k);
+                const typename V::Mask below = V::Lt(x, vthreshold);
+                vsum0 = V::Add(vsum0, V::Select(below, x, zero));
+                vsum1 = V::Add(vsum1, V::Select(below, zero, x));
+                vnum0 = V::Add(vnum0, V::Select(below, one, zero));
+            }
+            sum0 += V::HorizontalSum(vsum0);
+            sum1 += V::HorizontalSum(vsum1);
+            num0 += (size_t) V::HorizontalSum(vnum0);
+        }
+        for (; k < n; k++)
+        {
+            if (a[k] < threshold)
+            {
+                sum0 += a[k];
+                num0++;
+            }
+            else
+                sum1 += a[k];
+        }
+        sums[0] = sum0;
+        sums[1] = sum1;
+        counts[0] = num0;
+        counts[1] = n - num0;
+    }
+
+    static float SumOfSquaredDeviationsKernel(const float* a, float mean, size_t n)
+    {
+        const Vec vmean = V::Set(mean);
+        Vec vsum = V::Set(0.0f);
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+        {
+            const Vec d = V::Sub(V::Load(a + k), vmean);
+            vsum = V::Fma(d, d, vsum);
+        }
+        float sum = V::HorizontalSum(vsum);
+        for (; k < n; k++)
+            sum += (a[k] - mean) * (a[k] - mean);
+        return sum;
+    }
+
+    // The bits of V::width consecutive values go to the same bit position of V::width consecutive QWords (the interleaved
+    // layout of QuantizedColumn), so they are OR-ed in by a masked vector operation rather than packed into one word.
+    static void Quantize1BitKernel(float* us, float threshold, float val0, float val1, unsigned int bitmask, unsigned int* bits, size_t n)
+    {
+        const Vec vthreshold = V::Set(threshold);
+        const Vec vval0 = V::Set(val0);
+        const Vec vval1 = V::Set(val1);
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+        {
+            const Vec x = V::Load(us + k);
+            const typename V::Mask isone = V::Ge(x, vthreshold);
+            V::Store(us + k, V::Sub(x, V::Select(isone, vval1, vval0)));
+            V::OrBits(bits + k, isone, bitmask);
+        }
+        for (; k < n; k++)
+        {
+            if (us[k] >= threshold)
+            {
+                bits[k] |= bitmask;
+                us[k] -= val1;
+            }
+            else
+                us[k] -= val0;
+        }
+    }
+
+    static void Unquantize1BitKernel(const unsigned int* bits, unsigned int bitmask, float val0, float val1, bool add, float* us, size_t n)
+    {
+        const Vec vval0 = V::Set(val0);
+        const Vec vval1 = V::Set(val1);
+        size_t k = 0;
+        for (; k + V::width <= n; k += V::width)
+        {
+            const Vec val = V::Select(V::TestBits(bits + k, bitmask), vval1, vval0);
+            V::Store(us + k, add ? V::Add(V::Load(us + k), val) : val);
+        }
+        for (; k < n; k++)
+        {
+            const float val = (bits[k] & bitmask) ? val1 : val0;
+            us[k] = add ? us[k] + val : val;
+        }
+    }
+
+    static CPUVectorKernels Create(const char* name)
+    {
+        CPUVectorKernels kernels;
+        kernels.m_name = name;
+        kernels.Exp = &ExpKernel;
+        kernels.Log = &LogKernel;
+        kernels.Sigmoid = &SigmoidKernel;
+        kernels.Tanh = &TanhKernel;
+        kernels.Clip = &ClipKernel;
+        kernels.AddScalar = &AddScalarKernel;
+        kernels.Sum = &SumKernel;
+        kernels.Max = &MaxKernel;
+        kernels.AddTo = &AddToKernel;
+        kernels.SubtractAndSumExp = &SubtractAndSumExpKernel;
+        kernels.AddAndSum = &AddAndSumKernel;
+        kernels.SumBelowAndAbove = &SumBelowAndAboveKernel;
+        kernels.SumOfSquaredDeviations = &SumOfSquaredDeviationsKernel;
+        kernels.Quantize1Bit = &Quantize1BitKernel;
+        kernels.Unquantize1Bit = &Unquantize1BitKernel;
+        return kernels;
+    }
+};
+} } }
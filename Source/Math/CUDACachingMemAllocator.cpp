@@ -0,0 +1,317 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CUDACachingMemAllocator.h"
+#include "BestGpu.h" // for CPUONLY
+#include "Basics.h"
+#ifndef CPUONLY
+#include "GPUMatrix.h" // for PrepareDevice(), GetStream() and CUDA_CALL
+#include "MemoryAccounting.h"
+#include <cuda_runtime_api.h>
+#endif
+#include <memory>
+#include <algorithm>
+
+#pragma comment(lib, "cudart.lib")
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Size classes: powers of two up to 1 MB (at least 512 bytes, the alignment cudaMalloc() gives us anyway).
+// Above that, each power-of-two range is split into four classes, so that rounding wastes at most 25%
+// while minibatches of slightly different lengths still map onto the same class.
+/*static*/ size_t CUDACachingMemAllocator::RoundUpToSizeClass(size_t size)
+{
+    const size_t minClass = 512;
+    const size_t maxPowerOfTwoClass = 1 << 20;
+    if (size <= minClass)
+        return minClass;
+
+    size_t powerOfTwo = minClass;
+    while (powerOfTwo < size)
+        powerOfTwo <<= 1;
+    if (powerOfTwo <= maxPowerOfTwoClass)
+        return powerOfTwo;
+
+    // size lies in (powerOfTwo/2, powerOfTwo]; pick the smallest quarter step that fits
+    size_t step = powerOfTwo / 8;
+    size_t sizeClass = powerOfTwo / 2;
+    while (sizeClass < size)
+        sizeClass += step;
+    return sizeClass;
+}
+
+#ifndef CPUONLY
+
+CUDACachingMemAllocator::CUDACachingMemAllocator(int deviceID)
+    : m_deviceID(deviceID)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+CUDACachingMemAllocator::~CUDACachingMemAllocator()
+{
+    // Note: the process-wide instances are never destroyed, since by the time static destructors run the CUDA runtime may be gone.
+    ReleaseCachedBuffers();
+}
+
+int CUDACachingMemAllocator::GetDeviceId() const
+{
+    return m_deviceID;
+}
+
+/*static*/ CUDACachingMemAllocator& CUDACachingMemAllocator::ForDevice(int deviceId)
+{
+    static std::mutex s_mutex;
+    static std::map<int, CUDACachingMemAllocator*> s_allocators; // intentionally leaked, see destructor
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& allocator = s_allocators[deviceId];
+    if (!allocator)
+        allocator = new CUDACachingMemAllocator(deviceId);
+    return *allocator;
+}
+
+// pick a cached block of the given size class that can be used on 'stream'
+// Blocks last used on the same stream can be reused right away, since the stream executes in order.
+// Otherwise we make the stream wait for the event recorded when the block was freed, which keeps reuse stream-ordered without a host sync.
+bool CUDACachingMemAllocator::TryTakeFromCache(size_t sizeClass, cudaStream_t stream, Block& block)
+{
+    auto iter = m_freeBlocks.find(sizeClass);
+    if (iter == m_freeBlocks.end() || iter->second.empty())
+        return false;
+
+    auto& blocks = iter->second;
+    size_t index = blocks.size() - 1; // LIFO: the most recently freed block is most likely still in the L2 cache
+    for (size_t i = blocks.size(); i-- > 0;)
+    {
+        if (blocks[i].m_stream == stream)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    block = blocks[index];
+    blocks[index] = blocks.back();
+    blocks.pop_back();
+
+    if (block.m_stream != stream && block.m_event != nullptr)
+        CUDA_CALL(cudaStreamWaitEvent(stream, block.m_event, 0));
+    return true;
+}
+
+void* CUDACachingMemAllocator::Malloc(size_t size)
+{
+    if (size == 0)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PrepareDevice(m_deviceID);
+
+    const size_t sizeClass = RoundUpToSizeClass(size);
+    const cudaStream_t stream = GetStream();
+
+    m_stats.numMallocs++;
+    Block block;
+    if (TryTakeFromCache(sizeClass, stream, block))
+    {
+        m_stats.numHits++;
+        m_stats.bytesCached -= sizeClass;
+    }
+    else
+    {
+        m_stats.numMisses++;
+        block.m_size = sizeClass;
+        block.m_event = nullptr;
+        cudaError_t rc = cudaMalloc(&block.m_ptr, sizeClass);
+        if (rc == cudaErrorMemoryAllocation && m_stats.bytesCached > 0)
+        {
+            // out of memory: give everything we hold back to the runtime and try once more
+            cudaGetLastError(); // clear the sticky error state
+            ReleaseCachedBuffersNoLock();
+            m_stats.numCacheFlushes++;
+            rc = cudaMalloc(&block.m_ptr, sizeClass);
+        }
+        if (rc == cudaErrorMemoryAllocation)
+            MemoryAccounting::ReportOutOfMemory(m_deviceID, sizeClass);
+        CUDA_CALL(rc);
+    }
+
+    block.m_requestedSize = size;
+    block.m_stream = stream;
+    m_allocatedBlocks[block.m_ptr] = block;
+
+    m_stats.bytesInUse += sizeClass;
+    m_stats.bytesRequested += size;
+    m_stats.peakBytesReserved = std::max(m_stats.peakBytesReserved, m_stats.bytesInUse + m_stats.bytesCached);
+    return block.m_ptr;
+}
+
+void CUDACachingMemAllocator::Free(void* p)
+{
+    if (p == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PrepareDevice(m_deviceID);
+
+    auto iter = m_allocatedBlocks.find(p);
+    if (iter == m_allocatedBlocks.end())
+    {
+        // not ours (e.g. allocated before caching got enabled)
+        CUDA_CALL(cudaFree(p));
+        return;
+    }
+
+    Block block = iter->second;
+    m_allocatedBlocks.erase(iter);
+
+    // remember where the last use of this buffer was enqueued, so that a consumer on a different stream can wait for it
+    block.m_stream = GetStream();
+    if (block.m_event == nullptr)
+        CUDA_CALL(cudaEventCreateWithFlags(&block.m_event, cudaEventDisableTiming));
+    // uses on other streams: the freeing stream waits for them, so that m_event covers them as well
+    for (auto stream : block.m_otherStreams)
+    {
+        if (stream == block.m_stream)
+            continue;
+        CUDA_CALL(cudaEventRecord(block.m_event, stream));
+        CUDA_CALL(cudaStreamWaitEvent(block.m_stream, block.m_event, 0));
+    }
+    block.m_otherStreams.clear();
+    CUDA_CALL(cudaEventRecord(block.m_event, block.m_stream));
+
+    m_stats.numFrees++;
+    m_stats.bytesInUse -= block.m_size;
+    m_stats.bytesRequested -= block.m_requestedSize;
+    m_stats.bytesCached += block.m_size;
+    m_freeBlocks[block.m_size].push_back(block);
+}
+
+bool CUDACachingMemAllocator::RecordStream(void* p, cudaStream_t stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_allocatedBlocks.find(p);
+    if (iter == m_allocatedBlocks.end())
+        return false;
+    auto& streams = iter->second.m_otherStreams;
+    if (stream != iter->second.m_stream && std::find(streams.begin(), streams.end(), stream) == streams.end())
+        streams.push_back(stream);
+    return true;
+}
+
+void CUDACachingMemAllocator::DestroyBlock(Block& block)
+{
+    // Note: we do not check the return codes here, since this may get called during process exit when the CUDA runtime is already shutting down.
+    if (block.m_event != nullptr)
+        cudaEventDestroy(block.m_event);
+    cudaFree(block.m_ptr);
+    block.m_event = nullptr;
+    block.m_ptr = nullptr;
+}
+
+void CUDACachingMemAllocator::ReleaseCachedBuffersNoLock()
+{
+    for (auto& sizeClassBlocks : m_freeBlocks)
+    {
+        for (auto& block : sizeClassBlocks.second)
+            DestroyBlock(block);
+    }
+    m_freeBlocks.clear();
+    m_stats.bytesCached = 0;
+}
+
+void CUDACachingMemAllocator::ReleaseCachedBuffers()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PrepareDevice(m_deviceID);
+    ReleaseCachedBuffersNoLock();
+}
+
+CUDACachingMemAllocator::Statistics CUDACachingMemAllocator::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void CUDACachingMemAllocator::PrintStatistics() const
+{
+    Statistics stats = GetStatistics();
+    const double numBytesPerMB = 1 << 20;
+    fprintf(stderr, "GPU memory cache [DeviceId = %d]: %d requests, %d hits, %d misses (hit rate %.1f%%), %d cache flushes; in use %.1f MB, cached %.1f MB, peak reserved %.1f MB, fragmentation %.1f%%\n",
+            m_deviceID, (int) stats.numMallocs, (int) stats.numHits, (int) stats.numMisses,
+            stats.numMallocs == 0 ? 0.0 : 100.0 * stats.numHits / stats.numMallocs, (int) stats.numCacheFlushes,
+            stats.bytesInUse / numBytesPerMB, stats.bytesCached / numBytesPerMB, stats.peakBytesReserved / numBytesPerMB,
+            100.0 * stats.Fragmentation());
+}
+
+/*static*/ void CUDACachingMemAllocator::PrintStatisticsForAllDevices()
+{
+    int numDevices = 0;
+    if (cudaGetDeviceCount(&numDevices) != cudaSuccess)
+        return;
+    for (int deviceId = 0; deviceId < numDevices; deviceId++)
+    {
+        const auto& allocator = ForDevice(deviceId);
+        if (allocator.GetStatistics().numMallocs > 0)
+            allocator.PrintStatistics();
+    }
+}
+
+#else
+// Dummy definitions when compiling for CPUONLY
+CUDACachingMemAllocator::CUDACachingMemAllocator(int)
+{
+}
+
+CUDACachingMemAllocator::~CUDACachingMemAllocator()
+{
+}
+
+int CUDACachingMemAllocator::GetDeviceId() const
+{
+    return -1;
+}
+
+/*static*/ CUDACachingMemAllocator& CUDACachingMemAllocator::ForDevice(int)
+{
+    static CUDACachingMemAllocator s_dummy(-1);
+    return s_dummy;
+}
+
+void* CUDACachingMemAllocator::Malloc(size_t)
+{
+    return nullptr;
+}
+
+void CUDACachingMemAllocator::Free(void*)
+{
+}
+
+bool CUDACachingMemAllocator::RecordStream(void*, cudaStream_t)
+{
+    return false;
+}
+
+void CUDACachingMemAllocator::ReleaseCachedBuffers()
+{
+}
+
+CUDACachingMemAllocator::Statistics CUDACachingMemAllocator::GetStatistics() const
+{
+    Statistics stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+}
+
+void CUDACachingMemAllocator::PrintStatistics() const
+{
+}
+
+/*static*/ void CUDACachingMemAllocator::PrintStatisticsForAllDevices()
+{
+}
+#endif
+} } }
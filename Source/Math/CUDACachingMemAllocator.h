@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CUDACachingMemAllocator.h -- device-wide caching allocator for GPU buffers
+//
+// cudaFree() implicitly synchronizes the device. When minibatch sizes vary, Resize() keeps releasing and
+// re-acquiring buffers, and every such cycle stalls the GPU. This allocator keeps released buffers in
+// per-device free lists, bucketed into size classes, and hands them out again for requests of the same class.
+//
+
+#pragma once
+
+#include "MemAllocator.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <mutex>
+
+// predeclare CUDA stream and event types so that this header does not need to pull in the CUDA headers
+struct CUstream_st;
+typedef struct CUstream_st* cudaStream_t;
+struct CUevent_st;
+typedef struct CUevent_st* cudaEvent_t;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+class MATH_API CUDACachingMemAllocator : public MemAllocator
+{
+public:
+    // counters exposed for diagnostics
+    struct Statistics
+    {
+        size_t numMallocs;       // number of Malloc() requests
+        size_t numHits;          // requests served from the free lists
+        size_t numMisses;        // requests that needed a fresh cudaMalloc()
+        size_t numFrees;         // number of Free() calls that returned a buffer into the cache
+        size_t numCacheFlushes;  // number of times the cache had to be emptied because cudaMalloc() ran out of memory
+        size_t bytesInUse;       // size-class bytes currently handed out
+        size_t bytesRequested;   // bytes actually requested for the buffers currently handed out
+        size_t bytesCached;      // bytes sitting idle in the free lists
+        size_t peakBytesReserved; // high-water mark of bytesInUse + bytesCached
+
+        // fraction of the reserved device memory that is not backing a requested byte (rounding waste + idle cache)
+        double Fragmentation() const
+        {
+            size_t reserved = bytesInUse + bytesCached;
+            return reserved == 0 ? 0.0 : 1.0 - (double) bytesRequested / (double) reserved;
+        }
+    };
+
+    CUDACachingMemAllocator(int deviceID);
+    ~CUDACachingMemAllocator();
+
+    int GetDeviceId() const;
+    void* Malloc(size_t size) override;
+    void Free(void* p) override;
+
+    // declare that the buffer 'p' is also used on 'stream', besides the current stream at Malloc() or Free()
+    // Free() then makes the buffer's reuse wait for the work on 'stream' as well. Returns false if 'p' is not a buffer of ours.
+    bool RecordStream(void* p, cudaStream_t stream);
+
+    // give all cached (currently unused) buffers back to the CUDA runtime
+    void ReleaseCachedBuffers();
+
+    Statistics GetStatistics() const;
+    void PrintStatistics() const;
+
+    // the process-wide instance for a device
+    static CUDACachingMemAllocator& ForDevice(int deviceId);
+    static void PrintStatisticsForAllDevices();
+
+    // size class that a request of 'size' bytes is rounded up to
+    static size_t RoundUpToSizeClass(size_t size);
+
+private:
+    struct Block
+    {
+        void* m_ptr;
+        size_t m_size;           // size class of this block
+        size_t m_requestedSize;  // bytes asked for by the current owner
+        cudaStream_t m_stream;   // stream that last used the block
+        cudaEvent_t m_event;     // recorded on m_stream upon Free() when the block may be picked up by another stream
+        std::vector<cudaStream_t> m_otherStreams; // further streams that used the block, see RecordStream()
+    };
+
+    bool TryTakeFromCache(size_t sizeClass, cudaStream_t stream, Block& block);
+    void DestroyBlock(Block& block);
+    void ReleaseCachedBuffersNoLock();
+
+    int m_deviceID;
+    mutable std::mutex m_mutex;
+    std::map<size_t, std::vector<Block>> m_freeBlocks; // [size class] -> released blocks of that class
+    std::map<void*, Block> m_allocatedBlocks;          // blocks currently handed out, keyed by pointer
+    Statistics m_stats;
+};
+} } }
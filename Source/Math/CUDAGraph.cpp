@@ -0,0 +1,144 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CUDAGraph.h"
+#include "BestGpu.h" // for CPUONLY
+#include "Basics.h"
+#ifndef CPUONLY
+#include "GPUMatrix.h" // for PrepareDevice(), SetStream(), GetStream() and CUDA_CALL
+#include "CUDACachingMemAllocator.h"
+#include <cuda_runtime_api.h>
+#endif
+
+#pragma comment(lib, "cudart.lib")
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#if !defined(CPUONLY) && CUDART_VERSION >= 10000
+
+/*static*/ bool CUDAGraph::IsSupported()
+{
+    return true;
+}
+
+CUDAGraph::CUDAGraph(int deviceId)
+    : m_deviceId(deviceId), m_mainStream(nullptr), m_captureStream(nullptr), m_captureEvent(nullptr), m_graph(nullptr), m_graphExec(nullptr), m_numMallocs(0)
+{
+    PrepareDevice(m_deviceId);
+    // blocking, so that a kernel on the legacy default stream fails the capture instead of escaping it
+    CUDA_CALL(cudaStreamCreateWithFlags(&m_captureStream, cudaStreamDefault));
+    CUDA_CALL(cudaEventCreateWithFlags(&m_captureEvent, cudaEventDisableTiming));
+}
+
+CUDAGraph::~CUDAGraph()
+{
+    // no CUDA_CALL here: destructors must not throw
+    PrepareDevice(m_deviceId);
+    DestroyGraph();
+    cudaEventDestroy(m_captureEvent);
+    cudaStreamDestroy(m_captureStream);
+}
+
+void CUDAGraph::DestroyGraph()
+{
+    if (m_graphExec)
+        cudaGraphExecDestroy((cudaGraphExec_t) m_graphExec);
+    if (m_graph)
+        cudaGraphDestroy((cudaGraph_t) m_graph);
+    m_graphExec = nullptr;
+    m_graph = nullptr;
+}
+
+void CUDAGraph::BeginCapture()
+{
+    PrepareDevice(m_deviceId);
+    DestroyGraph();
+    m_mainStream = GetStream();
+    m_numMallocs = CUDACachingMemAllocator::ForDevice(m_deviceId).GetStatistics().numMallocs;
+    CUDA_CALL(cudaEventRecord(m_captureEvent, m_mainStream));
+    CUDA_CALL(cudaStreamWaitEvent(m_captureStream, m_captureEvent, 0 /*flags 'must be 0'*/));
+    // thread-local mode: calls of this thread that cannot be recorded (synchronization, allocation) fail instead of breaking the recording silently
+    CUDA_CALL(cudaStreamBeginCapture(m_captureStream, cudaStreamCaptureModeThreadLocal));
+    SetStream(m_captureStream);
+}
+
+bool CUDAGraph::EndCapture()
+{
+    SetStream(m_mainStream);
+    cudaGraph_t graph = nullptr;
+    cudaError_t status = cudaStreamEndCapture(m_captureStream, &graph);
+    m_graph = graph;
+    cudaGraphExec_t graphExec = nullptr;
+    if (status == cudaSuccess && graph)
+#if CUDART_VERSION >= 12000
+        status = cudaGraphInstantiate(&graphExec, graph, 0);
+#else
+        status = cudaGraphInstantiate(&graphExec, graph, nullptr, nullptr, 0);
+#endif
+    m_graphExec = status == cudaSuccess ? graphExec : nullptr;
+    // (another thread may have allocated meanwhile, e.g. a prefetcher; a false alarm only costs another attempt)
+    bool allocated = CUDACachingMemAllocator::ForDevice(m_deviceId).GetStatistics().numMallocs != m_numMallocs;
+    if (!m_graphExec || allocated)
+    {
+        cudaGetLastError(); // capture errors are not sticky; clear them for the work to be rerun
+        DestroyGraph();
+        return false;
+    }
+    return true;
+}
+
+void CUDAGraph::AbortCapture()
+{
+    EndCapture();
+    DestroyGraph();
+}
+
+void CUDAGraph::Launch()
+{
+    if (!m_graphExec)
+        LogicError("CUDAGraph::Launch: Nothing has been captured.");
+    CUDA_CALL(cudaGraphLaunch((cudaGraphExec_t) m_graphExec, GetStream()));
+}
+
+#else
+// Dummy definitions when compiling for CPUONLY, or with a CUDA version without graphs
+/*static*/ bool CUDAGraph::IsSupported()
+{
+    return false;
+}
+
+CUDAGraph::CUDAGraph(int deviceId)
+    : m_deviceId(deviceId), m_mainStream(nullptr), m_captureStream(nullptr), m_captureEvent(nullptr), m_graph(nullptr), m_graphExec(nullptr), m_numMallocs(0)
+{
+}
+
+CUDAGraph::~CUDAGraph()
+{
+}
+
+void CUDAGraph::DestroyGraph()
+{
+}
+
+void CUDAGraph::BeginCapture()
+{
+}
+
+bool CUDAGraph::EndCapture()
+{
+    return false;
+}
+
+void CUDAGraph::AbortCapture()
+{
+}
+
+void CUDAGraph::Launch()
+{
+    LogicError("CUDAGraph::Launch: Nothing has been captured.");
+}
+#endif
+} } }
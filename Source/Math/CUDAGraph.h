@@ -0,0 +1,77 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CUDAGraph.h -- records the kernels that a piece of code issues once, and replays them with a single launch
+//
+// A sequence of many small kernels, such as the time steps of a recurrent loop, is bound by the host-side cost of
+// launching them. CUDA graphs (CUDA 10 or newer) record such a sequence and launch it as a whole:
+//     CUDAGraph graph(deviceId);
+//     graph.BeginCapture();          // the work is recorded from here on, not executed
+//     Work();
+//     if (graph.EndCapture())
+//         graph.Launch();            // executes the work, and again for every further Launch()
+//     else
+//         Work();                    // the work did something that cannot be recorded
+// Recording happens on a stream of its own (the legacy default stream cannot be recorded), ordered after the current stream.
+// It fails if the work synchronizes with the host (e.g. a blocking copy), allocates device memory (even from the cache of
+// CUDACachingMemAllocator, whose buffer would be handed to others while the recording still uses it), or launches a kernel
+// on the legacy default stream; an exception from the work must be followed by AbortCapture(). The recorded kernels keep the device
+// pointers and the host-side decisions of the recording, so it is up to the caller to replay them only where those still hold.
+// Without CUDA graphs, IsSupported() is false and any capture fails.
+//
+
+#pragma once
+
+#include <cstddef>
+
+// predeclare CUDA stream and event types so that this header does not need to pull in the CUDA headers
+struct CUstream_st;
+typedef struct CUstream_st* cudaStream_t;
+struct CUevent_st;
+typedef struct CUevent_st* cudaEvent_t;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+class MATH_API CUDAGraph
+{
+public:
+    static bool IsSupported();
+
+    CUDAGraph(int deviceId);
+    ~CUDAGraph();
+
+    void BeginCapture(); // makes the capture stream the current stream
+    bool EndCapture();   // restores the current stream; false if nothing usable was recorded
+    void AbortCapture(); // in place of EndCapture() after the work threw
+    bool IsCaptured() const
+    {
+        return m_graphExec != nullptr;
+    }
+    void Launch(); // on the current stream
+
+private:
+    void DestroyGraph();
+
+    int m_deviceId;
+    cudaStream_t m_mainStream;    // current stream at BeginCapture()
+    cudaStream_t m_captureStream;
+    cudaEvent_t m_captureEvent;   // orders the capture after the work on m_mainStream
+    void* m_graph;                // cudaGraph_t
+    void* m_graphExec;            // cudaGraphExec_t, the instantiated graph
+    size_t m_numMallocs;          // of the device's CUDACachingMemAllocator at BeginCapture()
+
+    CUDAGraph(const CUDAGraph&) = delete;
+    CUDAGraph& operator=(const CUDAGraph&) = delete;
+};
+} } }
@@ -1,9 +1,14 @@
 #include "stdafx.h"
 #include "CUDAPageLockedMemAllocator.h"
+#include "CUDACachingMemAllocator.h" // for RoundUpToSizeClass()
+#include "Basics.h"
 #include "BestGpu.h" // for CPUONLY
 #ifndef CPUONLY
 #include <cuda_runtime_api.h>
 #endif
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -44,6 +49,45 @@ int CUDAPageLockedMemAllocator::GetDeviceId() const
 {
     return m_deviceID;
 }
+
+// the pool behind MallocFromPool(); intentionally leaked, since by the time static destructors run the CUDA runtime may be gone
+static std::mutex s_poolMutex;
+static std::map<size_t, std::vector<void*>>* s_poolFreeBuffers = new std::map<size_t, std::vector<void*>>(); // [size class]
+static std::map<void*, size_t>* s_poolAllocatedBuffers = new std::map<void*, size_t>();                     // -> size class
+
+void* CUDAPageLockedMemAllocator::MallocFromPool(size_t size, int deviceId)
+{
+    const size_t sizeClass = CUDACachingMemAllocator::RoundUpToSizeClass(size);
+    std::lock_guard<std::mutex> lock(s_poolMutex);
+
+    void* p;
+    auto& freeBuffers = (*s_poolFreeBuffers)[sizeClass];
+    if (!freeBuffers.empty())
+    {
+        p = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    else
+    {
+        cudaSetDevice(deviceId);
+        cudaHostAlloc(&p, sizeClass, cudaHostAllocPortable) || "MallocFromPool in CUDAPageLockedMemAllocator failed";
+    }
+    (*s_poolAllocatedBuffers)[p] = sizeClass;
+    return p;
+}
+
+void CUDAPageLockedMemAllocator::FreeToPool(void* p)
+{
+    if (!p)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_poolMutex);
+    auto iter = s_poolAllocatedBuffers->find(p);
+    if (iter == s_poolAllocatedBuffers->end())
+        LogicError("FreeToPool in CUDAPageLockedMemAllocator: The buffer was not allocated by MallocFromPool().");
+    (*s_poolFreeBuffers)[iter->second].push_back(p);
+    s_poolAllocatedBuffers->erase(iter);
+}
 #else
 // Dummy definitions when compiling for CPUONLY
 CUDAPageLockedMemAllocator::CUDAPageLockedMemAllocator(int)
@@ -72,5 +116,14 @@ void CUDAPageLockedMemAllocator::Free(void*)
 void CUDAPageLockedMemAllocator::Free(void*, int)
 {
 }
+
+void* CUDAPageLockedMemAllocator::MallocFromPool(size_t, int)
+{
+    return nullptr;
+}
+
+void CUDAPageLockedMemAllocator::FreeToPool(void*)
+{
+}
 #endif
 } } }
@@ -25,6 +25,13 @@ public:
     static void* Malloc(size_t size, int deviceId);
     static void Free(void* p, int deviceId);
 
+    // Process-wide pool for staging buffers that are released and requested again (per epoch, or whenever the
+    // minibatch size changes). cudaHostAlloc() is slow and cudaFreeHost() synchronizes the device, so released
+    // buffers are kept and handed out again for requests of the same size class (CUDACachingMemAllocator::RoundUpToSizeClass()).
+    // The buffers are page-locked for all devices. Returns nullptr in a CPUONLY build.
+    static void* MallocFromPool(size_t size, int deviceId);
+    static void FreeToPool(void* p);
+
 private:
     int m_deviceID;
 };
@@ -137,7 +137,8 @@ public:
                 // quantize
                 size_t ij = ColMIDX(i, colIdx, M);
                 ElemType val = inMat[ij] + inResidual[ij];
-                QWordVal qval = valQ.Quantize<ZeroThresholdFor1Bit>(val);
+                // Explicit use of 'template' keyword is needed to compile with GCC
+                QWordVal qval = valQ.template Quantize<ZeroThresholdFor1Bit>(val);
 
                 // compute residual
                 ElemType uval = valQ.Unquantize(qval);
@@ -279,44 +280,8 @@ public:
             allReduceUint(num0);
             allReduceUint(num1);
 
-            ElemType radius;
-            ElemType newmean;
-            if (!ZeroThresholdFor1Bit)
-            {
-                // we minimize the error jointly across positive and negative numbers to make things
-                // symmetrical around the mean (which may be non-zero) tying the two sides
-                ElemType devacc0 = (num0 * mean) - meanacc0;
-                ElemType devacc1 = meanacc1 - (num1 * mean);
-
-                // both deviations tied, to ensure consistent mean
-                ElemType dev = (devacc0 + devacc1) / rows;
-                radius = 2.0f * dev;
-                newmean = mean;
-            }
-            else
-            {
-                // we keep two separate reconstruction values to allow for asymmetries--but we
-                // instead hard-code that the threshold is 0
-
-                // happens for all-zero columns which do exist (mean0 is 0 in that case)
-                if (num0 == 0)
-                    num0 = 1;
-                if (num1 == 0)
-                    num1 = 1;
-                ElemType mean0 = meanacc0 / num0;
-                ElemType mean1 = meanacc1 / num1;
-
-                // approximate by using their average as the threshold between 0 and 1
-                // with these values, bits (0,1) which mean values (0.5,1.5) will reconstruct to mean0/1
-                newmean = 0.5f * (mean0 + mean1);
-                radius = 2.0f * (mean1 - newmean);
-            }
-
             if (subset == 0)
-            {
-                lower = newmean - radius;
-                upper = newmean + radius;
-            }
+                RangeFor1Bit<ZeroThresholdFor1Bit>(mean, meanacc0, meanacc1, num0, num1, rows, lower, upper);
         }
         else
         {
@@ -343,6 +308,48 @@ public:
         }
     }
 
+    // 1-bit quantization range of a column of 'rows' values with the given 'mean' (0 if ZeroThresholdFor1Bit), from the sums
+    // and numbers of the values below the mean (meanacc0, num0) and of the others (meanacc1, num1)
+    template <bool ZeroThresholdFor1Bit>
+    static cudasharedcode void RangeFor1Bit(ElemType mean, ElemType meanacc0, ElemType meanacc1, unsigned int num0, unsigned int num1, size_t rows, ElemType& lower, ElemType& upper)
+    {
+        ElemType radius;
+        ElemType newmean;
+        if (!ZeroThresholdFor1Bit)
+        {
+            // we minimize the error jointly across positive and negative numbers to make things
+            // symmetrical around the mean (which may be non-zero) tying the two sides
+            ElemType devacc0 = (num0 * mean) - meanacc0;
+            ElemType devacc1 = meanacc1 - (num1 * mean);
+
+            // both deviations tied, to ensure consistent mean
+            ElemType dev = (devacc0 + devacc1) / rows;
+            radius = 2.0f * dev;
+            newmean = mean;
+        }
+        else
+        {
+            // we keep two separate reconstruction values to allow for asymmetries--but we
+            // instead hard-code that the threshold is 0
+
+            // happens for all-zero columns which do exist (mean0 is 0 in that case)
+            if (num0 == 0)
+                num0 = 1;
+            if (num1 == 0)
+                num1 = 1;
+            ElemType mean0 = meanacc0 / num0;
+            ElemType mean1 = meanacc1 / num1;
+
+            // approximate by using their average as the threshold between 0 and 1
+            // with these values, bits (0,1) which mean values (0.5,1.5) will reconstruct to mean0/1
+            newmean = 0.5f * (mean0 + mean1);
+            radius = 2.0f * (mean1 - newmean);
+        }
+
+        lower = newmean - radius;
+        upper = newmean + radius;
+    }
+
 private:
     ValueQuantizer<ElemType> valQ;
 
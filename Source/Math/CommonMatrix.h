@@ -15,6 +15,7 @@
 #endif
 
 #include "Basics.h"
+#include "HalfPrecision.h"
 #include <string>
 #include <stdint.h>
 
@@ -41,11 +42,24 @@ class MATH_API TracingGPUMemoryAllocator
 {
 private:
     static int m_traceLevel;
+    static bool m_cachingEnabled;
+    static bool m_managedMemoryEnabled;
 
 public:
     static void SetTraceLevel(int traceLevel);
     static bool IsTraceEnabled();
 
+    // route device allocations through the per-device CUDACachingMemAllocator instead of raw cudaMalloc()/cudaFree()
+    // Must be set before the first GPU buffer is allocated.
+    static void SetCachingEnabled(bool enabled);
+    static bool IsCachingEnabled();
+
+    // unified memory: allocate device buffers with cudaMallocManaged(), so that the values and gradients of a network may exceed
+    // the device memory; the driver pages them between host and device, guided by prefetch hints (see Matrix::PrefetchToDevice()).
+    // Takes precedence over caching. Must be set before the first GPU buffer is allocated.
+    static void SetManagedMemoryEnabled(bool enabled);
+    static bool IsManagedMemoryEnabled();
+
     template <typename AllocatedElemType>
     static AllocatedElemType* Allocate(int deviceId, size_t numRows, size_t numCols);
 
@@ -62,6 +76,54 @@ private:
     static std::pair<size_t, size_t> GetFreeAndTotalMemoryInMBs(int deviceId);
 };
 
+// -----------------------------------------------------------------------
+// MatrixObjectCache -- recycles the memory of CPUMatrix, GPUMatrix, and the sparse matrix objects
+// Matrix creates one of these small objects on the heap for every column slice, e.g. for every ValueFor(fr) and
+// GradientFor(fr) of every node in every time step of a recurrent loop. BaseMatrix allocates them through this cache,
+// which keeps a short per-thread free list for each object size, so that in steady state creating and destroying
+// a slice does not touch the heap. An object may be freed on a different thread than the one that allocated it.
+// -----------------------------------------------------------------------
+
+class MATH_API MatrixObjectCache
+{
+public:
+    static void* Allocate(size_t size);
+    static void Free(void* p);
+};
+
+// -----------------------------------------------------------------------
+// CPUMemoryPlacement -- on which NUMA nodes the pages of large CPU matrix buffers end up
+// A page is placed on the node of the thread that first writes it. new[] zeroes a buffer on one thread, which puts all of it on
+// one node, and on a multi-socket machine the OpenMP kernels then mostly read remote memory.
+//  - firstTouch: a new buffer is zeroed by the OpenMP threads in the static schedule of the elementwise kernels, so that each
+//    page lands on the node of the thread that later works on it.
+//  - interleave: the pages are spread round-robin over all nodes, which suits accesses that do not follow that schedule
+//    (e.g. of the BLAS). Linux only; elsewhere it falls back to firstTouch.
+// Small buffers share their pages with other allocations and are left alone. Process-wide; set it before allocating.
+// -----------------------------------------------------------------------
+
+class MATH_API CPUMemoryPlacement
+{
+public:
+    enum Policy
+    {
+        none, // zeroed by the allocating thread (the default)
+        firstTouch,
+        interleave
+    };
+
+    // "none", "firstTouch" or "interleave"
+    static void Set(const std::string& policy);
+    static Policy Get();
+
+    // used by CPUMatrix: whether a buffer of that size is placed, and placing a new, untouched buffer (which is zeroed)
+    static bool AppliesTo(size_t bytes);
+    static void Place(void* p, size_t bytes);
+
+private:
+    static Policy s_policy;
+};
+
 // -----------------------------------------------------------------------
 // ElementWiseOperator -- This enum represents which function to apply.
 // This is shared between all matrix types and tensors.
@@ -110,6 +172,10 @@ enum ElementWiseOperator
     opElementwiseProductWithLinearRectifierDerivativeFromOutput,
     opElementwiseProductWithLogDerivativeFromOutput,
     opElementwiseProductWithCosDerivative,
+    // binary ops that fuse a sum with a nonlinearity, f(a + b), to save a pass over memory
+    opSigmoidOfSum,
+    opTanhOfSum,
+    opLinearRectifierOfSum,
     // binary ops for indexing
     // opIndex,
     // ternary
@@ -157,7 +223,10 @@ enum ElementWiseOperator
     Macro(ElementwiseProductWithTanhDerivativeFromOutput);            \
     Macro(ElementwiseProductWithLinearRectifierDerivativeFromOutput); \
     Macro(ElementwiseProductWithLogDerivativeFromOutput);             \
-    Macro(ElementwiseProductWithCosDerivative); \
+    Macro(ElementwiseProductWithCosDerivative);                       \
+    Macro(SigmoidOfSum);                                              \
+    Macro(TanhOfSum);                                                 \
+    Macro(LinearRectifierOfSum);                                      \
 //Macro(Index);
 
 #define ForAllTernaryOps(Macro) \
@@ -188,7 +257,7 @@ enum MatrixFormat
     matrixFormatDenseRowMajor = matrixFormatDense + matrixFormatRowMajor,
     matrixFormatSparseCSC = matrixFormatSparse + matrixFormatColMajor + matrixFormatCompressed,
     matrixFormatSparseCSR = matrixFormatSparse + matrixFormatRowMajor + matrixFormatCompressed,
-    matrixFormatSparseOther = matrixFormatSparse + matrixFormatRowMajor,                   // currently used for CPU sparse format, will change to CSC/CSR eventually
+    matrixFormatSparseOther = matrixFormatSparse + matrixFormatRowMajor,                   // unused; CPUSparseMatrix stores CSC/CSR natively like GPUSparseMatrix
     matrixFormatMask = matrixFormatRowMajor + matrixFormatSparse + matrixFormatCompressed, // mask that covers all the
     matrixFormatSparseBlockCol,                                                            // col block based sparse matrix
     matrixFormatSparseBlockRow,                                                            // row block based sparse matrix
@@ -243,6 +312,16 @@ public:
     {
         m_pArray = parray;
     }
+    // the objects are allocated through the MatrixObjectCache (see there)
+    static void* operator new(size_t size)
+    {
+        return MatrixObjectCache::Allocate(size);
+    }
+    static void operator delete(void* p)
+    {
+        MatrixObjectCache::Free(p);
+    }
+
     virtual DEVICEID_TYPE GetComputeDeviceId() const
     {
         return m_computeDevice;
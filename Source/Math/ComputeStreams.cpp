@@ -0,0 +1,254 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "ComputeStreams.h"
+#include "BestGpu.h" // for CPUONLY
+#include "Basics.h"
+#ifndef CPUONLY
+#include "GPUMatrix.h" // for PrepareDevice(), SetStream(), GetStream() and CUDA_CALL
+#include <cuda_runtime_api.h>
+#endif
+
+#pragma comment(lib, "cudart.lib")
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifndef CPUONLY
+
+ComputeStreams::ComputeStreams(int deviceId, size_t numStreams)
+    : m_deviceId(deviceId), m_mainStream(nullptr), m_forkEvent(nullptr)
+{
+    if (numStreams == 0)
+        InvalidArgument("ComputeStreams: At least one stream is needed.");
+
+    PrepareDevice(m_deviceId);
+    // Note: Do NOT use cudaEventBlockingSync here either, see GPUDataTransferer.
+    CUDA_CALL(cudaEventCreateWithFlags(&m_forkEvent, cudaEventDisableTiming));
+    m_streams.resize(numStreams, nullptr);
+    m_joinEvents.resize(numStreams, nullptr);
+    for (size_t i = 0; i < numStreams; i++)
+    {
+        CUDA_CALL(cudaStreamCreateWithFlags(&m_streams[i], cudaStreamDefault)); // blocking, see header
+        CUDA_CALL(cudaEventCreateWithFlags(&m_joinEvents[i], cudaEventDisableTiming));
+    }
+}
+
+ComputeStreams::~ComputeStreams()
+{
+    // no CUDA_CALL here: destructors must not throw
+    PrepareDevice(m_deviceId);
+    for (size_t i = 0; i < m_streams.size(); i++)
+    {
+        cudaStreamSynchronize(m_streams[i]);
+        cudaEventDestroy(m_joinEvents[i]);
+        cudaStreamDestroy(m_streams[i]);
+    }
+    cudaEventDestroy(m_forkEvent);
+}
+
+void ComputeStreams::Fork()
+{
+    PrepareDevice(m_deviceId);
+    m_mainStream = GetStream();
+    CUDA_CALL(cudaEventRecord(m_forkEvent, m_mainStream));
+    for (auto stream : m_streams)
+        CUDA_CALL(cudaStreamWaitEvent(stream, m_forkEvent, 0 /*flags 'must be 0'*/));
+}
+
+void ComputeStreams::Select(size_t index)
+{
+    SetStream(m_streams[index]);
+}
+
+void ComputeStreams::Join()
+{
+    SetStream(m_mainStream);
+    for (size_t i = 0; i < m_streams.size(); i++)
+    {
+        CUDA_CALL(cudaEventRecord(m_joinEvents[i], m_streams[i]));
+        CUDA_CALL(cudaStreamWaitEvent(m_mainStream, m_joinEvents[i], 0 /*flags 'must be 0'*/));
+    }
+}
+
+ComputeStream::ComputeStream(int deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr)
+{
+    PrepareDevice(m_deviceId);
+    CUDA_CALL(cudaStreamCreateWithFlags(&m_stream, cudaStreamDefault)); // blocking, see header
+}
+
+ComputeStream::~ComputeStream()
+{
+    // no CUDA_CALL here: destructors must not throw
+    PrepareDevice(m_deviceId);
+    cudaStreamSynchronize(m_stream);
+    cudaStreamDestroy(m_stream);
+}
+
+void ComputeStream::Synchronize() const
+{
+    CUDA_CALL(cudaStreamSynchronize(m_stream));
+}
+
+StreamScope::StreamScope(const ComputeStream& stream)
+    : StreamScope(stream.GetDeviceId(), stream.GetHandle())
+{
+}
+
+StreamScope::StreamScope(int deviceId, cudaStream_t stream)
+    : m_previousStream(GetStream())
+{
+    PrepareDevice(deviceId);
+    SetStream(stream);
+}
+
+StreamScope::~StreamScope()
+{
+    SetStream(m_previousStream);
+}
+
+DeviceEvent::DeviceEvent(int deviceId)
+    : m_deviceId(deviceId), m_event(nullptr)
+{
+    if (m_deviceId < 0)
+        return;
+    PrepareDevice(m_deviceId);
+    // Note: Do NOT use cudaEventBlockingSync here either, see GPUDataTransferer.
+    CUDA_CALL(cudaEventCreateWithFlags(&m_event, cudaEventDisableTiming));
+}
+
+DeviceEvent::~DeviceEvent()
+{
+    if (m_event != nullptr)
+        cudaEventDestroy(m_event); // (released by CUDA once the recorded work has completed)
+}
+
+void DeviceEvent::Record()
+{
+    if (m_event != nullptr)
+        CUDA_CALL(cudaEventRecord(m_event, GetStream()));
+}
+
+void DeviceEvent::Record(const ComputeStream& stream)
+{
+    if (m_event != nullptr)
+        CUDA_CALL(cudaEventRecord(m_event, stream.GetHandle()));
+}
+
+void DeviceEvent::Wait() const
+{
+    if (m_event != nullptr)
+        CUDA_CALL(cudaStreamWaitEvent(GetStream(), m_event, 0 /*flags 'must be 0'*/));
+}
+
+void DeviceEvent::Wait(const ComputeStream& stream) const
+{
+    if (m_event != nullptr)
+        CUDA_CALL(cudaStreamWaitEvent(stream.GetHandle(), m_event, 0 /*flags 'must be 0'*/));
+}
+
+void DeviceEvent::Synchronize() const
+{
+    if (m_event != nullptr)
+        CUDA_CALL(cudaEventSynchronize(m_event));
+}
+
+bool DeviceEvent::IsComplete() const
+{
+    if (m_event == nullptr)
+        return true;
+    cudaError_t rc = cudaEventQuery(m_event);
+    if (rc == cudaErrorNotReady)
+        return false;
+    CUDA_CALL(rc);
+    return true;
+}
+
+#else
+// Dummy definitions when compiling for CPUONLY
+ComputeStreams::ComputeStreams(int deviceId, size_t numStreams)
+    : m_deviceId(deviceId), m_mainStream(nullptr), m_forkEvent(nullptr), m_streams(numStreams, nullptr)
+{
+}
+
+ComputeStreams::~ComputeStreams()
+{
+}
+
+void ComputeStreams::Fork()
+{
+}
+
+void ComputeStreams::Select(size_t)
+{
+}
+
+void ComputeStreams::Join()
+{
+}
+
+ComputeStream::ComputeStream(int deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr)
+{
+}
+
+ComputeStream::~ComputeStream()
+{
+}
+
+void ComputeStream::Synchronize() const
+{
+}
+
+StreamScope::StreamScope(const ComputeStream&)
+    : m_previousStream(nullptr)
+{
+}
+
+StreamScope::StreamScope(int, cudaStream_t)
+    : m_previousStream(nullptr)
+{
+}
+
+StreamScope::~StreamScope()
+{
+}
+
+DeviceEvent::DeviceEvent(int deviceId)
+    : m_deviceId(deviceId), m_event(nullptr)
+{
+}
+
+DeviceEvent::~DeviceEvent()
+{
+}
+
+void DeviceEvent::Record()
+{
+}
+
+void DeviceEvent::Record(const ComputeStream&)
+{
+}
+
+void DeviceEvent::Wait() const
+{
+}
+
+void DeviceEvent::Wait(const ComputeStream&) const
+{
+}
+
+void DeviceEvent::Synchronize() const
+{
+}
+
+bool DeviceEvent::IsComplete() const
+{
+    return true;
+}
+#endif
+} } }
@@ -0,0 +1,160 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ComputeStreams.h -- extra CUDA streams for running independent parts of a computation concurrently
+//
+// All GPU operations go to the current stream (SetStream()/GetStream(), the legacy default stream unless changed).
+// This class owns a few more streams on one device, onto which the caller forks work and joins it back:
+//     streams.Fork();      // all streams wait for the work issued so far on the current (main) stream
+//     streams.Select(k);   // issue the following operations on stream k
+//     streams.Join();      // the main stream waits for the work on all streams, and is the current stream again
+// The streams are created blocking, i.e. synchronized with the legacy default stream, so that an operation that
+// still goes to the default stream (e.g. a synchronous copy, or a library handle bound to it) acts as a barrier
+// instead of racing with the forked work.
+//
+// For finer control there are the building blocks:
+//     ComputeStream stream(deviceId);  // one stream of its own
+//     {
+//         StreamScope scope(stream);   // operations issued by this thread within the scope go to 'stream'
+//         ...
+//         done.Record();               // DeviceEvent: marks the work issued on 'stream' so far
+//     }
+//     done.Wait();                     // work issued later on this thread's current stream waits for it
+// The current stream is per thread. Matrix exposes the same as RecordEvent()/WaitForEvent(), and RecordStreamUse() for
+// buffers that are used on another stream than the one they were allocated on (see CUDACachingMemAllocator).
+//
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// predeclare CUDA stream and event types so that this header does not need to pull in the CUDA headers
+struct CUstream_st;
+typedef struct CUstream_st* cudaStream_t;
+struct CUevent_st;
+typedef struct CUevent_st* cudaEvent_t;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+class MATH_API ComputeStreams
+{
+public:
+    ComputeStreams(int deviceId, size_t numStreams);
+    ~ComputeStreams();
+
+    int GetDeviceId() const
+    {
+        return m_deviceId;
+    }
+    size_t GetNumStreams() const
+    {
+        return m_streams.size();
+    }
+
+    void Fork();
+    void Select(size_t index);
+    void Join();
+
+    // stream 'index', e.g. for a StreamScope
+    cudaStream_t GetStream(size_t index) const
+    {
+        return m_streams[index];
+    }
+
+private:
+    int m_deviceId;
+    cudaStream_t m_mainStream;         // current stream at Fork()
+    cudaEvent_t m_forkEvent;           // recorded on m_mainStream by Fork()
+    std::vector<cudaStream_t> m_streams;
+    std::vector<cudaEvent_t> m_joinEvents; // [stream] recorded by Join()
+
+    ComputeStreams(const ComputeStreams&) = delete;
+    ComputeStreams& operator=(const ComputeStreams&) = delete;
+};
+
+// ComputeStream -- one CUDA stream on a device, owned by this object (blocking, like the ComputeStreams)
+class MATH_API ComputeStream
+{
+public:
+    explicit ComputeStream(int deviceId);
+    ~ComputeStream();
+
+    int GetDeviceId() const
+    {
+        return m_deviceId;
+    }
+    cudaStream_t GetHandle() const
+    {
+        return m_stream;
+    }
+
+    // block the calling thread until all work issued on this stream has completed
+    void Synchronize() const;
+
+private:
+    int m_deviceId;
+    cudaStream_t m_stream;
+
+    ComputeStream(const ComputeStream&) = delete;
+    ComputeStream& operator=(const ComputeStream&) = delete;
+};
+
+// StreamScope -- makes a stream the current stream of the calling thread, and the previous one current again upon destruction
+class MATH_API StreamScope
+{
+public:
+    explicit StreamScope(const ComputeStream& stream);
+    StreamScope(int deviceId, cudaStream_t stream);
+    ~StreamScope();
+
+private:
+    cudaStream_t m_previousStream;
+
+    StreamScope(const StreamScope&) = delete;
+    StreamScope& operator=(const StreamScope&) = delete;
+};
+
+// DeviceEvent -- orders work across streams without blocking the host
+// Record() marks the work issued so far on a stream; Wait() makes a stream wait for the marked work.
+// Without a stream argument, both use the current stream of the calling thread. For deviceId < 0 (CPU) all operations are no-ops.
+class MATH_API DeviceEvent
+{
+public:
+    explicit DeviceEvent(int deviceId);
+    ~DeviceEvent();
+
+    int GetDeviceId() const
+    {
+        return m_deviceId;
+    }
+
+    void Record();
+    void Record(const ComputeStream& stream);
+    void Wait() const;
+    void Wait(const ComputeStream& stream) const;
+
+    // block the calling thread until the recorded work has completed
+    void Synchronize() const;
+    // true if the recorded work has completed (or nothing was recorded)
+    bool IsComplete() const;
+
+private:
+    int m_deviceId;
+    cudaEvent_t m_event;
+
+    DeviceEvent(const DeviceEvent&) = delete;
+    DeviceEvent& operator=(const DeviceEvent&) = delete;
+};
+} } }
@@ -21,7 +21,8 @@ public:
 
 public:
     DefaultConvolutionEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples)
-        : m_ones(deviceId), m_maxTempMemSizeInSamples(maxTempMemSizeInSamples)
+        : m_ones(deviceId), m_maxTempMemSizeInSamples(maxTempMemSizeInSamples), m_forwardAlgorithm(Algorithm::Unrolled),
+          m_winogradFilter(CPUDEVICE), m_winogradInput(CPUDEVICE), m_winogradProducts(CPUDEVICE)
     {
     }
 
@@ -33,9 +34,17 @@ public:
         assert(inT.n() == in.GetNumCols());
         assert(filterT.k() == filter.GetNumRows());
         assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
-        assert(inT.c() == filterT.c());
+        assert(inT.c() == filterT.c() * convDesc.groups());
         assert(outT.c() == filterT.k());
 
+        if (convDesc.groups() > 1)
+        {
+            VerifyGroupedConvolutionOnCpu(in);
+            out.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, false);
+            GroupedForward(in.BufferPointer(), filter.BufferPointer(), UnrollGeometry(inT, outT, filterT, convDesc), convDesc.groups(), outT.c(), inT.n(), out.BufferPointer());
+            return;
+        }
+
         size_t packedInputRows = filterT.w() * filterT.h() * filterT.c();
         size_t packedInputColsPerSample = outT.w() * outT.h();
         size_t outputSizePerChannel = packedInputColsPerSample;
@@ -58,6 +67,43 @@ public:
 
         out.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, false);
 
+        m_forwardAlgorithm = ChooseAlgorithm(in, out, filterT, convDesc, outT);
+        if (m_forwardAlgorithm == Algorithm::Direct1x1)
+        {
+            // the input already is the unrolled matrix: [channel x (pixel, sample)]
+            Mat inputTmp = in.ColumnSlice(0, batchSize);
+            inputTmp.Reshape(inT.c(), inT.w() * inT.h() * batchSize);
+            out.Reshape(outT.c(), outputSizePerChannel * batchSize);
+            Mat::Multiply(filter, false, inputTmp, false, out);
+            out.Reshape(outT.c() * outputSizePerChannel, batchSize);
+            return;
+        }
+        else if (m_forwardAlgorithm != Algorithm::Unrolled)
+        {
+            const WinogradTransforms transforms(m_forwardAlgorithm);
+            TransformWinogradFilter(filter, outT.c(), inT.c(), false, transforms);
+            ForEachSubBatch(batchSize, maxTempMemSizeInSamples, [&](size_t startSampleId, size_t smallBatchSize)
+                            {
+                                WinogradConvolve(in.ColumnSlice(startSampleId, smallBatchSize).BufferPointer(), smallBatchSize, inT.c(), inT.h(), inT.w(),
+                                                 convDesc.padding() ? 1 : 0, transforms,
+                                                 out.ColumnSlice(startSampleId, smallBatchSize).BufferPointer(), outT.c(), outT.h(), outT.w(), false);
+                            });
+            return;
+        }
+        else if (m_forwardAlgorithm == Algorithm::Tiled)
+        {
+            const UnrollGeometry geometry(inT, outT, filterT, convDesc);
+            out.Reshape(outT.c(), outputSizePerChannel * batchSize);
+            ForEachUnrolledTile(packedInputRows, outputSizePerChannel * batchSize, workspace, [&](size_t firstCol, size_t numCols, Mat& tile)
+                                {
+                                    PackTile(in.BufferPointer(), geometry, firstCol, numCols, tile.BufferPointer());
+                                    Mat outputTile = out.ColumnSlice(firstCol, numCols);
+                                    Mat::Multiply(filter, false, tile, false, outputTile);
+                                });
+            out.Reshape(outT.c() * outputSizePerChannel, batchSize);
+            return;
+        }
+
         // Reshaping is only necessary if we are going to use the unpacking trick
         if (m_gpuSparseOpt)
             out.Reshape(outT.c() * outT.w(), outT.h() * batchSize);
@@ -124,10 +170,17 @@ public:
         assert(filterT.k() == filter.GetNumRows());
         assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
         assert(srcGradT.c() == filterT.k());
-        assert(gradT.c() == filterT.c());
+        assert(gradT.c() == filterT.c() * convDesc.groups());
         assert(gradT.w() * gradT.h() * gradT.c() == grad.GetNumRows());
         assert(gradT.n() == grad.GetNumCols());
 
+        if (convDesc.groups() > 1)
+        {
+            VerifyGroupedConvolutionOnCpu(grad);
+            GroupedBackwardData(srcGrad.BufferPointer(), filter.BufferPointer(), UnrollGeometry(gradT, srcGradT, filterT, convDesc), convDesc.groups(), srcGradT.c(), srcGradT.n(), grad.BufferPointer());
+            return;
+        }
+
         size_t packedInputRows = filterT.w() * filterT.h() * filterT.c();
         size_t packedInputColsPerSample = srcGradT.w() * srcGradT.h();
         size_t outputSizePerChannel = packedInputColsPerSample;
@@ -142,6 +195,39 @@ public:
         Matrix<ElemType> srcGradTmp = srcGrad.ColumnSlice(0, srcGrad.GetNumCols());
         srcGradTmp.Reshape(srcGradT.c(), outputSizePerChannel * batchSize); // reshape to match the longernal operation
 
+        const Algorithm algorithm = ChooseAlgorithm(srcGrad, grad, filterT, convDesc, gradT);
+        if (algorithm == Algorithm::Direct1x1)
+        {
+            Mat gradTmp = grad.ColumnSlice(0, batchSize);
+            gradTmp.Reshape(gradT.c(), gradT.w() * gradT.h() * batchSize);
+            Matrix<ElemType>::MultiplyAndAdd(filter, true, srcGradTmp, false, gradTmp);
+            return;
+        }
+        else if (algorithm != Algorithm::Unrolled)
+        {
+            // the input gradient is the convolution of the output gradient with the flipped, transposed filters,
+            // padded such that every input pixel sees all output pixels it contributed to
+            const WinogradTransforms transforms(algorithm);
+            TransformWinogradFilter(filter, gradT.c(), srcGradT.c(), true, transforms);
+            ForEachSubBatch(batchSize, maxTempMemSizeInSamples, [&](size_t startSampleId, size_t smallBatchSize)
+                            {
+                                WinogradConvolve(srcGrad.ColumnSlice(startSampleId, smallBatchSize).BufferPointer(), smallBatchSize, srcGradT.c(), srcGradT.h(), srcGradT.w(),
+                                                 convDesc.padding() ? 1 : 2, transforms,
+                                                 grad.ColumnSlice(startSampleId, smallBatchSize).BufferPointer(), gradT.c(), gradT.h(), gradT.w(), true);
+                            });
+            return;
+        }
+        else if (algorithm == Algorithm::Tiled)
+        {
+            const UnrollGeometry geometry(gradT, srcGradT, filterT, convDesc);
+            ForEachUnrolledTile(packedInputRows, outputSizePerChannel * batchSize, workspace, [&](size_t firstCol, size_t numCols, Mat& tile)
+                                {
+                                    Mat::Multiply(filter, true, srcGradTmp.ColumnSlice(firstCol, numCols), false, tile);
+                                    UnpackTileAndAdd(tile.BufferPointer(), geometry, firstCol, numCols, grad.BufferPointer());
+                                });
+            return;
+        }
+
         size_t subBatchSize = min(batchSize, maxTempMemSizeInSamples);
         size_t numSubBatches = (batchSize + subBatchSize - 1) / subBatchSize;
 
@@ -175,10 +261,17 @@ public:
         assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
         assert(inT.n() == in.GetNumCols());
         assert(srcGradT.c() == filterT.k());
-        assert(inT.c() == filterT.c());
+        assert(inT.c() == filterT.c() * convDesc.groups());
         assert(filterT.k() == filter.GetNumRows());
         assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
 
+        if (convDesc.groups() > 1)
+        {
+            VerifyGroupedConvolutionOnCpu(in);
+            GroupedBackwardFilter(srcGrad.BufferPointer(), in.BufferPointer(), UnrollGeometry(inT, srcGradT, filterT, convDesc), convDesc.groups(), srcGradT.c(), inT.n(), filter.BufferPointer());
+            return;
+        }
+
         size_t packedInputRows = filterT.w() * filterT.h() * filterT.c();
         size_t packedInputColsPerSample = srcGradT.w() * srcGradT.h();
         size_t outputSizePerChannel = packedInputColsPerSample;
@@ -196,10 +289,30 @@ public:
         Matrix<ElemType> srcGradTmp = srcGrad.ColumnSlice(0, srcGrad.GetNumCols());
         srcGradTmp.Reshape(srcGradT.c(), outputSizePerChannel * batchSize); // reshape to match the longernal operation
 
+        const Algorithm algorithm = ChooseAlgorithm(in, srcGrad, filterT, convDesc, srcGradT);
+        if (algorithm == Algorithm::Direct1x1)
+        {
+            Mat inputTmp = in.ColumnSlice(0, batchSize);
+            inputTmp.Reshape(inT.c(), inT.w() * inT.h() * batchSize);
+            Matrix<ElemType>::MultiplyAndAdd(srcGradTmp, false, inputTmp, true, filter);
+            return;
+        }
+        else if (algorithm == Algorithm::Tiled)
+        {
+            const UnrollGeometry geometry(inT, srcGradT, filterT, convDesc);
+            ForEachUnrolledTile(packedInputRows, outputSizePerChannel * batchSize, workspace, [&](size_t firstCol, size_t numCols, Mat& tile)
+                                {
+                                    PackTile(in.BufferPointer(), geometry, firstCol, numCols, tile.BufferPointer());
+                                    Matrix<ElemType>::MultiplyAndAdd(srcGradTmp.ColumnSlice(firstCol, numCols), false, tile, true, filter);
+                                });
+            return;
+        }
+
         size_t subBatchSize = min(batchSize, maxTempMemSizeInSamples);
         size_t numSubBatches = (batchSize + subBatchSize - 1) / subBatchSize;
 
-        if (numSubBatches == 1 && allowReuse && !m_gpuSparseOpt) // reuse packed input from evaluation step if it's not changed by either subbatch or recurrent steps.
+        // (the workspace only holds the packed input if Forward() unrolled it)
+        if (numSubBatches == 1 && allowReuse && !m_gpuSparseOpt && m_forwardAlgorithm == Algorithm::Unrolled) // reuse packed input from evaluation step if it's not changed by either subbatch or recurrent steps.
             // REVIEW alexeyk: the following makes an assumption that data in workspace was filled by Forward call and remained unchanged. Find way to enforce/verify that.
             Matrix<ElemType>::MultiplyAndAdd(srcGradTmp, false, workspace, true, filter);
         else
@@ -284,55 +397,629 @@ public:
     }
 
     void NormalizeBatch(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
-                        bool spatial, double expAvgFactor, Mat& runMean, Mat& runInvStdDev, Mat& out, double epsilon, Mat& saveMean, Mat& saveInvStdDev) override
+                        bool spatial, double expAvgFactor, Mat& runMean, Mat& runInvStdDev, Mat& out, double epsilon, Mat& saveMean, Mat& saveInvStdDev,
+                        bool relu) override
     {
-        UNUSED(inT);
-        UNUSED(in);
         UNUSED(scaleBiasT);
-        UNUSED(scale);
-        UNUSED(bias);
-        UNUSED(out);
-        UNUSED(spatial);
-        UNUSED(expAvgFactor);
-        UNUSED(runMean);
-        UNUSED(runInvStdDev);
-        UNUSED(epsilon);
-        UNUSED(saveMean);
-        UNUSED(saveInvStdDev);
-        RuntimeError("Not yet implemented.");
+        VerifyBatchNormalizationOnCpu(in);
+        const size_t vectorSize = inT.w() * inT.h() * inT.c();
+        const size_t spatialSize = spatial ? inT.w() * inT.h() : 1;
+        assert(vectorSize == in.GetNumRows() && inT.n() == in.GetNumCols());
+        assert(runMean.GetNumElements() == vectorSize / spatialSize && saveMean.GetNumElements() >= runMean.GetNumElements());
+
+        ElemType* mean = saveMean.BufferPointer();
+        ElemType* invStdDev = saveInvStdDev.BufferPointer();
+        ComputeBatchMeanAndInvStdDev(in.BufferPointer(), vectorSize, spatialSize, inT.n(), std::max(epsilon, 1e-9), mean, invStdDev);
+        ElemType* rm = runMean.BufferPointer();
+        ElemType* rs = runInvStdDev.BufferPointer();
+        for (size_t s = 0; s < runMean.GetNumElements(); s++)
+        {
+            // expAvgFactor = 1 overwrites, so that an uninitialized running statistic does not leak in
+            rm[s] = expAvgFactor == 1 ? mean[s] : (ElemType) ((1 - expAvgFactor) * rm[s] + expAvgFactor * mean[s]);
+            rs[s] = expAvgFactor == 1 ? invStdDev[s] : (ElemType) ((1 - expAvgFactor) * rs[s] + expAvgFactor * invStdDev[s]);
+        }
+        ApplyBatchNormalization(in.BufferPointer(), out.BufferPointer(), vectorSize, spatialSize, inT.n(),
+                                scale.BufferPointer(), bias.BufferPointer(), mean, invStdDev, relu);
     }
 
     void NormalizeBatchInference(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
-                                 bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out) override
+                                 bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out, bool relu) override
     {
-        UNUSED(inT);
-        UNUSED(in);
         UNUSED(scaleBiasT);
-        UNUSED(scale);
-        UNUSED(bias);
-        UNUSED(out);
-        UNUSED(spatial);
-        UNUSED(runMean);
-        UNUSED(runInvStdDev);
-        RuntimeError("Not yet implemented.");
+        VerifyBatchNormalizationOnCpu(in);
+        const size_t vectorSize = inT.w() * inT.h() * inT.c();
+        const size_t spatialSize = spatial ? inT.w() * inT.h() : 1;
+        assert(vectorSize == in.GetNumRows() && inT.n() == in.GetNumCols());
+        assert(runMean.GetNumElements() == vectorSize / spatialSize);
+
+        ApplyBatchNormalization(in.BufferPointer(), out.BufferPointer(), vectorSize, spatialSize, inT.n(),
+                                scale.BufferPointer(), bias.BufferPointer(), runMean.BufferPointer(), runInvStdDev.BufferPointer(), relu);
     }
 
     void BackwardNormalizeBatch(const Tensor4D& inT, const Mat& in, const Mat& srcGrad, Mat& grad,
                                 const Tensor4D& scaleBiasT, const Mat& scale, bool spatial, const Mat& saveMean, const Mat& saveInvStdDev,
                                 Mat& scaleGrad, Mat& biasGrad) override
     {
-        UNUSED(inT);
-        UNUSED(in);
-        UNUSED(srcGrad);
-        UNUSED(grad);
         UNUSED(scaleBiasT);
-        UNUSED(scale);
-        UNUSED(scaleGrad);
-        UNUSED(biasGrad);
-        UNUSED(spatial);
-        UNUSED(saveMean);
-        UNUSED(saveInvStdDev);
-        RuntimeError("Not yet implemented.");
+        VerifyBatchNormalizationOnCpu(in);
+        const size_t vectorSize = inT.w() * inT.h() * inT.c();
+        const size_t spatialSize = spatial ? inT.w() * inT.h() : 1;
+        assert(vectorSize == in.GetNumRows() && inT.n() == in.GetNumCols());
+        assert(scaleGrad.GetNumElements() == vectorSize / spatialSize && biasGrad.GetNumElements() == scaleGrad.GetNumElements());
+
+        ComputeScaleAndBiasGradients(in.BufferPointer(), srcGrad.BufferPointer(), vectorSize, spatialSize, inT.n(),
+                                     saveMean.BufferPointer(), saveInvStdDev.BufferPointer(), scaleGrad.BufferPointer(), biasGrad.BufferPointer());
+        BackpropagateBatchNormalization(in.BufferPointer(), srcGrad.BufferPointer(), grad.BufferPointer(), vectorSize, spatialSize, inT.n(),
+                                        scale.BufferPointer(), scaleGrad.BufferPointer(), biasGrad.BufferPointer(),
+                                        saveMean.BufferPointer(), saveInvStdDev.BufferPointer());
+    }
+
+private:
+    // Dense input on the CPU is never unrolled as a whole by AssignPackedConvolutionInput(): the most common kernels need no
+    // unrolling, and all others are unrolled a tile at a time. The GPU and sparse input unroll whole sub-batches and multiply.
+    enum class Algorithm
+    {
+        Unrolled,
+        Direct1x1,   // 1x1 kernel, stride 1: the input already is the unrolled matrix
+        Winograd2x2, // 3x3 kernel, stride 1: Winograd F(2x2,3x3), 16 instead of 36 multiplications per 2x2 output tile
+        Winograd4x4, // ditto, F(4x4,3x3) for larger images, 36 instead of 144 multiplications per 4x4 output tile
+        Tiled        // other kernels and strides: unrolled and multiplied a cache-sized tile of columns at a time
+    };
+
+    // 'a' and 'b' are the matrices the operation reads and writes, 'outT' determines the Winograd tile size
+    static Algorithm ChooseAlgorithm(const Mat& a, const Mat& b, const Filter& filterT, const ConvDesc& convDesc, const Tensor4D& outT)
+    {
+        if (a.GetDeviceId() != CPUDEVICE || a.GetMatrixType() != MatrixType::DENSE || b.GetMatrixType() != MatrixType::DENSE)
+            return Algorithm::Unrolled;
+        if (convDesc.wStride() == 1 && convDesc.hStride() == 1)
+        {
+            if (filterT.w() == 1 && filterT.h() == 1)
+                return Algorithm::Direct1x1;
+            if (filterT.w() == 3 && filterT.h() == 3)
+                return outT.w() >= 8 && outT.h() >= 8 ? Algorithm::Winograd4x4 : Algorithm::Winograd2x2;
+        }
+        return Algorithm::Tiled;
+    }
+
+    // calls f(startSampleId, smallBatchSize) for consecutive sub-batches of at most maxTempMemSizeInSamples samples
+    template <class F>
+    static void ForEachSubBatch(size_t batchSize, size_t maxTempMemSizeInSamples, const F& f)
+    {
+        size_t subBatchSize = min(batchSize, maxTempMemSizeInSamples);
+        for (size_t startSampleId = 0; startSampleId < batchSize; startSampleId += subBatchSize)
+            f(startSampleId, min(subBatchSize, batchSize - startSampleId));
+    }
+
+    // Tiled unrolling on the CPU. The unrolled input of AssignPackedConvolutionInput() is
+    // [(channel, kernel column, kernel row) x (sample, output column, output row)]; instead of all of it, only a tile of its
+    // columns exists at a time, small enough to stay in cache from being written until the GEMM has read it. The tiles run
+    // over the whole minibatch, so maxTempMemSizeInSamples does not matter, and the workspace only ever holds one tile.
+    struct UnrollGeometry
+    {
+        size_t inW, inH, inC;
+        size_t outW, outH;
+        size_t kW, kH;
+        size_t sW, sH;
+        long padW, padH; // output pixel (r, c) sees input rows r * sH - padH + [0, kH) and columns c * sW - padW + [0, kW)
+
+        UnrollGeometry(const Tensor4D& inT, const Tensor4D& outT, const Filter& filterT, const ConvDesc& convDesc)
+            : inW(inT.w()), inH(inT.h()), inC(inT.c()), outW(outT.w()), outH(outT.h()), kW(filterT.w()), kH(filterT.h()),
+              sW(convDesc.wStride()), sH(convDesc.hStride()),
+              padW(convDesc.padding() ? (long) filterT.w() / 2 : 0), padH(convDesc.padding() ? (long) filterT.h() / 2 : 0)
+        {
+        }
+    };
+    static const size_t UnrolledTileBytes = 256 * 1024; // about half of a typical L2 cache
+    static const size_t MinUnrolledTileColumns = 32;     // below, the GEMMs get inefficient
+
+    // calls f(firstCol, numCols, tile) for consecutive tiles of the 'numCols' columns of the unrolled input;
+    // 'tile' is a packedRows x numCols matrix in 'workspace'
+    template <class F>
+    static void ForEachUnrolledTile(size_t packedRows, size_t numCols, Mat& workspace, const F& f)
+    {
+        const size_t tileCols = min(numCols, max(MinUnrolledTileColumns, UnrolledTileBytes / (packedRows * sizeof(ElemType))));
+        workspace.Resize(packedRows, tileCols);
+        for (size_t firstCol = 0; firstCol < numCols; firstCol += tileCols)
+        {
+            Mat tile = workspace.ColumnSlice(0, min(tileCols, numCols - firstCol));
+            f(firstCol, tile.GetNumCols(), tile);
+        }
+    }
+
+    // tile = columns [firstCol, firstCol + numCols) of the unrolled input, gathered from 'in' (one sample per column)
+    static void PackTile(const ElemType* in, const UnrollGeometry& g, size_t firstCol, size_t numCols, ElemType* tile)
+    {
+        const size_t packedRows = g.inC * g.kW * g.kH;
+        const size_t outPixels = g.outW * g.outH;
+        const size_t inDim = g.inC * g.inH * g.inW;
+#pragma omp parallel for
+        for (long j = 0; j < (long) numCols; j++)
+        {
+            const size_t col = firstCol + j;
+            const size_t pixel = col % outPixels;
+            const long row0 = (long) ((pixel % g.outH) * g.sH) - g.padH;
+            const long col0 = (long) ((pixel / g.outH) * g.sW) - g.padW;
+            const ElemType* x = in + (col / outPixels) * inDim;
+            ElemType* t = tile + j * packedRows;
+            for (size_t i = 0; i < g.inC; i++)
+                for (size_t kc = 0; kc < g.kW; kc++)
+                {
+                    const long c = col0 + (long) kc;
+                    const bool colInside = c >= 0 && c < (long) g.inW;
+                    for (size_t kr = 0; kr < g.kH; kr++)
+                    {
+                        const long r = row0 + (long) kr;
+                        *t++ = (colInside && r >= 0 && r < (long) g.inH) ? x[i + g.inC * (r + g.inH * c)] : 0;
+                    }
+                }
+        }
+    }
+
+    // the reverse: adds each element of the tile to the input element it was gathered from
+    // Parallel over the input channels, which no two threads then write to at the same time.
+    static void UnpackTileAndAdd(const ElemType* tile, const UnrollGeometry& g, size_t firstCol, size_t numCols, ElemType* grad)
+    {
+        const size_t packedRows = g.inC * g.kW * g.kH;
+        const size_t outPixels = g.outW * g.outH;
+        const size_t inDim = g.inC * g.inH * g.inW;
+#pragma omp parallel for
+        for (long i = 0; i < (long) g.inC; i++)
+        {
+            for (size_t j = 0; j < numCols; j++)
+            {
+                const size_t col = firstCol + j;
+                const size_t pixel = col % outPixels;
+                const long row0 = (long) ((pixel % g.outH) * g.sH) - g.padH;
+                const long col0 = (long) ((pixel / g.outH) * g.sW) - g.padW;
+                ElemType* x = grad + (col / outPixels) * inDim;
+                const ElemType* t = tile + j * packedRows + i * g.kW * g.kH;
+                for (size_t kc = 0; kc < g.kW; kc++)
+                {
+                    const long c = col0 + (long) kc;
+                    for (size_t kr = 0; kr < g.kH; kr++, t++)
+                    {
+                        const long r = row0 + (long) kr;
+                        if (c >= 0 && c < (long) g.inW && r >= 0 && r < (long) g.inH)
+                            x[i + g.inC * (r + g.inH * c)] += *t;
+                    }
+                }
+            }
+        }
+    }
+
+    // Grouped and depthwise convolution on the CPU, computed directly on the HWC data without unrolling: an output pixel
+    // of all K output channels accumulates, per kernel tap and input channel of a group, one filter column times the input
+    // pixel's channels. The channels are the fastest dimension of both the data and the filter columns, so the loops over
+    // the output channels are contiguous, and in the depthwise case (one input and one output channel per group) they are
+    // plain multiply-adds that the compiler vectorizes.
+    // Filter column of input channel i of a group and tap (kr, kc): (i * kW + kc) * kH + kr; output channel k reads input
+    // channel (k / (K / groups)) * (C / groups) + i.
+
+    static void VerifyGroupedConvolutionOnCpu(const Mat& in)
+    {
+        if (in.GetDeviceId() != CPUDEVICE || in.GetMatrixType() != MatrixType::DENSE)
+            InvalidArgument("Grouped convolution requires dense input, and on the GPU the cuDNN convolution engine.");
+    }
+
+    // calls f(output row, input row, input column, tap) for the taps of all output pixels in the given output column that fall
+    // inside the input, tap = kc * kH + kr
+    template <class F>
+    static void ForEachTapInside(const UnrollGeometry& g, size_t outCol, const F& f)
+    {
+        for (size_t outRow = 0; outRow < g.outH; outRow++)
+        {
+            for (size_t kc = 0; kc < g.kW; kc++)
+            {
+                const long c = (long) (outCol * g.sW + kc) - g.padW;
+                if (c < 0 || c >= (long) g.inW)
+                    continue;
+                for (size_t kr = 0; kr < g.kH; kr++)
+                {
+                    const long r = (long) (outRow * g.sH + kr) - g.padH;
+                    if (r >= 0 && r < (long) g.inH)
+                        f(outRow, (size_t) r, (size_t) c, kc * g.kH + kr);
+                }
+            }
+        }
+    }
+
+    static void GroupedForward(const ElemType* in, const ElemType* filter, const UnrollGeometry& g, size_t groups, size_t K, size_t batchSize, ElemType* out)
+    {
+        const size_t C = g.inC, Cg = C / groups, Kg = K / groups, taps = g.kW * g.kH;
+        const size_t inDim = C * g.inH * g.inW, outDim = K * g.outH * g.outW;
+#pragma omp parallel for
+        for (long j = 0; j < (long) (batchSize * g.outW); j++) // (sample, output column)
+        {
+            const size_t sample = j / g.outW, outCol = j % g.outW;
+            const ElemType* x = in + sample * inDim;
+            ElemType* y = out + sample * outDim + K * g.outH * outCol;
+            for (size_t k = 0; k < K * g.outH; k++)
+                y[k] = 0;
+            ForEachTapInside(g, outCol, [&](size_t outRow, size_t r, size_t c, size_t tap)
+            {
+                const ElemType* xp = x + C * (r + g.inH * c);
+                ElemType* yp = y + K * outRow;
+                for (size_t i = 0; i < Cg; i++)
+                {
+                    const ElemType* w = filter + K * (i * taps + tap);
+                    if (Cg == 1 && Kg == 1)
+                        for (size_t k = 0; k < K; k++)
+                            yp[k] += w[k] * xp[k];
+                    else
+                        for (size_t k = 0; k < K; k++)
+                            yp[k] += w[k] * xp[(k / Kg) * Cg + i];
+                }
+            });
+        }
+    }
+
+    // adds to 'grad'; parallel over the samples, which no two threads then write to at the same time
+    static void GroupedBackwardData(const ElemType* srcGrad, const ElemType* filter, const UnrollGeometry& g, size_t groups, size_t K, size_t batchSize, ElemType* grad)
+    {
+        const size_t C = g.inC, Cg = C / groups, Kg = K / groups, taps = g.kW * g.kH;
+        const size_t inDim = C * g.inH * g.inW, outDim = K * g.outH * g.outW;
+#pragma omp parallel for
+        for (long sample = 0; sample < (long) batchSize; sample++)
+        {
+            ElemType* dx = grad + sample * inDim;
+            for (size_t outCol = 0; outCol < g.outW; outCol++)
+            {
+                const ElemType* dy = srcGrad + sample * outDim + K * g.outH * outCol;
+                ForEachTapInside(g, outCol, [&](size_t outRow, size_t r, size_t c, size_t tap)
+                {
+                    ElemType* dxp = dx + C * (r + g.inH * c);
+                    const ElemType* dyp = dy + K * outRow;
+                    for (size_t i = 0; i < Cg; i++)
+                    {
+                        const ElemType* w = filter + K * (i * taps + tap);
+                        if (Cg == 1 && Kg == 1)
+                            for (size_t k = 0; k < K; k++)
+                                dxp[k] += w[k] * dyp[k];
+                        else
+                            for (size_t k = 0; k < K; k++)
+                                dxp[(k / Kg) * Cg + i] += w[k] * dyp[k];
+                    }
+                });
+            }
+        }
+    }
+
+    // adds to 'filter'; the filter is small, so each thread accumulates its share of the output columns into a copy of its own
+    static void GroupedBackwardFilter(const ElemType* srcGrad, const ElemType* in, const UnrollGeometry& g, size_t groups, size_t K, size_t batchSize, ElemType* filter)
+    {
+        const size_t C = g.inC, Cg = C / groups, Kg = K / groups, taps = g.kW * g.kH;
+        const size_t inDim = C * g.inH * g.inW, outDim = K * g.outH * g.outW;
+        const size_t filterSize = K * Cg * taps;
+#pragma omp parallel
+        {
+            std::vector<ElemType> dw(filterSize, 0);
+#pragma omp for
+            for (long j = 0; j < (long) (batchSize * g.outW); j++) // (sample, output column)
+            {
+                const size_t sample = j / g.outW, outCol = j % g.outW;
+                const ElemType* x = in + sample * inDim;
+                const ElemType* dy = srcGrad + sample * outDim + K * g.outH * outCol;
+                ForEachTapInside(g, outCol, [&](size_t outRow, size_t r, size_t c, size_t tap)
+                {
+                    const ElemType* xp = x + C * (r + g.inH * c);
+                    const ElemType* dyp = dy + K * outRow;
+                    for (size_t i = 0; i < Cg; i++)
+                    {
+                        ElemType* dwp = dw.data() + K * (i * taps + tap);
+                        if (Cg == 1 && Kg == 1)
+                            for (size_t k = 0; k < K; k++)
+                                dwp[k] += dyp[k] * xp[k];
+                        else
+                            for (size_t k = 0; k < K; k++)
+                                dwp[k] += dyp[k] * xp[(k / Kg) * Cg + i];
+                    }
+                });
+            }
+#pragma omp critical
+            for (size_t i = 0; i < filterSize; i++)
+                filter[i] += dw[i];
+        }
+    }
+
+    // Batch normalization on the CPU. A statistic belongs to one row (per-activation) or to a run of 'spatialSize' rows, the pixels
+    // of one channel in CHW (spatial), in each of the 'batchSize' columns of 'vectorSize' rows.
+
+    static void VerifyBatchNormalizationOnCpu(const Mat& in)
+    {
+        if (in.GetDeviceId() != CPUDEVICE || in.GetMatrixType() != MatrixType::DENSE)
+            RuntimeError("Batch normalization on the GPU requires the cuDNN convolution engine (with engine = \"cntk\" or \"cudnn\").");
+    }
+
+    // calls f(begin, end) in parallel for blocks of the statistics; per-activation, a block covers a contiguous range of each column
+    template <class F>
+    static void ForEachStatisticsBlock(size_t numStats, size_t spatialSize, const F& f)
+    {
+        size_t blockSize = 1;
+        if (spatialSize == 1)
+            blockSize = MaxStatisticsBlock;
+        const long numBlocks = (long) ((numStats + blockSize - 1) / blockSize);
+#pragma omp parallel for
+        for (long block = 0; block < numBlocks; block++)
+            f(block * blockSize, min((block + 1) * blockSize, numStats));
+    }
+    static const size_t MaxStatisticsBlock = 64;
+
+    // Mean and inverse standard deviation in one pass: per column, the run of a statistic is summarized by its mean and sum of
+    // squared deviations while in cache, and merged into the running Welford state (Chan, Golub, LeVeque).
+    static void ComputeBatchMeanAndInvStdDev(const ElemType* x, size_t vectorSize, size_t spatialSize, size_t batchSize, double epsilon,
+                                             ElemType* mean, ElemType* invStdDev)
+    {
+        ForEachStatisticsBlock(vectorSize / spatialSize, spatialSize, [=](size_t begin, size_t end)
+        {
+            double m[MaxStatisticsBlock] = {0};
+            double m2[MaxStatisticsBlock] = {0};
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                const ElemType* col = x + j * vectorSize;
+                const double seen = (double) j * spatialSize;
+                const double total = seen + spatialSize;
+                for (size_t s = begin; s < end; s++)
+                {
+                    const ElemType* run = col + s * spatialSize;
+                    double sum = 0;
+                    for (size_t i = 0; i < spatialSize; i++)
+                        sum += run[i];
+                    const double runMean = sum / spatialSize;
+                    double runM2 = 0;
+                    for (size_t i = 0; i < spatialSize; i++)
+                        runM2 += (run[i] - runMean) * (run[i] - runMean);
+                    const double delta = runMean - m[s - begin];
+                    m[s - begin] += delta * spatialSize / total;
+                    m2[s - begin] += runM2 + delta * delta * seen * spatialSize / total;
+                }
+            }
+            for (size_t s = begin; s < end; s++)
+            {
+                mean[s] = (ElemType) m[s - begin];
+                invStdDev[s] = (ElemType) (1 / sqrt(m2[s - begin] / ((double) batchSize * spatialSize) + epsilon));
+            }
+        });
+    }
+
+    // y = scale (x - mean) invStdDev + bias, as y = a x + b per statistic, and with 'relu' max(0, y), in one pass
+    static void ApplyBatchNormalization(const ElemType* x, ElemType* y, size_t vectorSize, size_t spatialSize, size_t batchSize,
+                                        const ElemType* scale, const ElemType* bias, const ElemType* mean, const ElemType* invStdDev, bool relu)
+    {
+        const size_t numStats = vectorSize / spatialSize;
+        std::vector<ElemType> a(numStats), b(numStats);
+        for (size_t s = 0; s < numStats; s++)
+        {
+            a[s] = scale[s] * invStdDev[s];
+            b[s] = bias[s] - mean[s] * a[s];
+        }
+        const ElemType lowest = relu ? 0 : -std::numeric_limits<ElemType>::infinity();
+#pragma omp parallel for
+        for (long j = 0; j < (long) batchSize; j++)
+        {
+            const ElemType* xj = x + j * vectorSize;
+            ElemType* yj = y + j * vectorSize;
+            for (size_t s = 0; s < numStats; s++)
+            {
+                const ElemType as = a[s];
+                const ElemType bs = b[s];
+                for (size_t i = s * spatialSize; i < (s + 1) * spatialSize; i++)
+                    yj[i] = std::max(as * xj[i] + bs, lowest);
+            }
+        }
+    }
+
+    // dBias = sum dy, dScale = sum dy xHat, with xHat = (x - mean) invStdDev
+    static void ComputeScaleAndBiasGradients(const ElemType* x, const ElemType* dy, size_t vectorSize, size_t spatialSize, size_t batchSize,
+                                             const ElemType* mean, const ElemType* invStdDev, ElemType* dScale, ElemType* dBias)
+    {
+        ForEachStatisticsBlock(vectorSize / spatialSize, spatialSize, [=](size_t begin, size_t end)
+        {
+            double ds[MaxStatisticsBlock] = {0};
+            double db[MaxStatisticsBlock] = {0};
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                for (size_t s = begin; s < end; s++)
+                {
+                    const size_t offset = j * vectorSize + s * spatialSize;
+                    double sumDy = 0;
+                    double sumDyX = 0;
+                    for (size_t i = 0; i < spatialSize; i++)
+                    {
+                        sumDy += dy[offset + i];
+                        sumDyX += dy[offset + i] * (x[offset + i] - mean[s]);
+                    }
+                    db[s - begin] += sumDy;
+                    ds[s - begin] += sumDyX * invStdDev[s];
+                }
+            }
+            for (size_t s = begin; s < end; s++)
+            {
+                dScale[s] = (ElemType) ds[s - begin];
+                dBias[s] = (ElemType) db[s - begin];
+            }
+        });
+    }
+
+    // dx += scale invStdDev (dy - (xHat dScale + dBias) / m), with m values per statistic (see the BN paper)
+    static void BackpropagateBatchNormalization(const ElemType* x, const ElemType* dy, ElemType* dx, size_t vectorSize, size_t spatialSize, size_t batchSize,
+                                                const ElemType* scale, const ElemType* dScale, const ElemType* dBias, const ElemType* mean, const ElemType* invStdDev)
+    {
+        const ElemType m = (ElemType) (batchSize * spatialSize);
+        const size_t numStats = vectorSize / spatialSize;
+#pragma omp parallel for
+        for (long j = 0; j < (long) batchSize; j++)
+        {
+            for (size_t s = 0; s < numStats; s++)
+            {
+                const ElemType a = scale[s] * invStdDev[s];
+                const ElemType ds = dScale[s] * invStdDev[s] / m;
+                const ElemType db = dBias[s] / m;
+                for (size_t i = j * vectorSize + s * spatialSize; i < j * vectorSize + (s + 1) * spatialSize; i++)
+                    dx[i] += a * (dy[i] - (x[i] - mean[s]) * ds - db);
+            }
+        }
+    }
+
+    // transformation matrices (row-major) of Winograd F(m x m, 3x3), see Lavin and Gray, "Fast Algorithms for Convolutional Neural Networks"
+    struct WinogradTransforms
+    {
+        size_t m;        // output tile size
+        size_t alpha;    // input tile size, m + 2
+        ElemType Bt[36]; // alpha x alpha, input transform
+        ElemType G[18];  // alpha x 3, filter transform
+        ElemType At[24]; // m x alpha, output transform
+
+        WinogradTransforms(Algorithm algorithm)
+        {
+            static const double Bt2[] = {1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 1, 0, 0, 1, 0, -1};
+            static const double G2[] = {1, 0, 0, 0.5, 0.5, 0.5, 0.5, -0.5, 0.5, 0, 0, 1};
+            static const double At2[] = {1, 1, 1, 0, 0, 1, -1, -1};
+            static const double Bt4[] = {4, 0, -5, 0, 1, 0,
+                                         0, -4, -4, 1, 1, 0,
+                                         0, 4, -4, -1, 1, 0,
+                                         0, -2, -1, 2, 1, 0,
+                                         0, 2, -1, -2, 1, 0,
+                                         0, 4, 0, -5, 0, 1};
+            static const double G4[] = {1.0 / 4, 0, 0,
+                                        -1.0 / 6, -1.0 / 6, -1.0 / 6,
+                                        -1.0 / 6, 1.0 / 6, -1.0 / 6,
+                                        1.0 / 24, 1.0 / 12, 1.0 / 6,
+                                        1.0 / 24, -1.0 / 12, 1.0 / 6,
+                                        0, 0, 1};
+            static const double At4[] = {1, 1, 1, 1, 1, 0,
+                                         0, 1, -1, 2, -2, 0,
+                                         0, 1, 1, 4, 4, 0,
+                                         0, 1, -1, 8, -8, 1};
+            const bool large = algorithm == Algorithm::Winograd4x4;
+            m = large ? 4 : 2;
+            alpha = m + 2;
+            for (size_t i = 0; i < alpha * alpha; i++)
+                Bt[i] = (ElemType) (large ? Bt4[i] : Bt2[i]);
+            for (size_t i = 0; i < alpha * 3; i++)
+                G[i] = (ElemType) (large ? G4[i] : G2[i]);
+            for (size_t i = 0; i < m * alpha; i++)
+                At[i] = (ElemType) (large ? At4[i] : At2[i]);
+        }
+    };
+
+    // result = L * x * L^T, where L is rows x cols and x is cols x cols (all row-major); 'tmp' holds rows x cols values
+    static void Sandwich(const ElemType* L, size_t rows, size_t cols, const ElemType* x, ElemType* tmp, ElemType* result)
+    {
+        for (size_t i = 0; i < rows; i++)
+            for (size_t j = 0; j < cols; j++)
+            {
+                ElemType sum = 0;
+                for (size_t k = 0; k < cols; k++)
+                    sum += L[i * cols + k] * x[k * cols + j];
+                tmp[i * cols + j] = sum;
+            }
+        for (size_t i = 0; i < rows; i++)
+            for (size_t j = 0; j < rows; j++)
+            {
+                ElemType sum = 0;
+                for (size_t k = 0; k < cols; k++)
+                    sum += tmp[i * cols + k] * L[j * cols + k];
+                result[i * rows + j] = sum;
+            }
+    }
+
+    // m_winogradFilter = [G g G^T] for all 3x3 kernels g, as numOut x (alpha^2 * numIn): column xi * numIn + i holds element xi of the kernel for input channel i.
+    // 'filter' is in the layout of the unrolled convolution, [output channel x (input channel, kernel column, kernel row)].
+    // If 'flipTransposed', the kernels are rotated by 180 degrees and their input and output channels are swapped (for the backward pass).
+    void TransformWinogradFilter(const Mat& filter, size_t numOut, size_t numIn, bool flipTransposed, const WinogradTransforms& transforms)
+    {
+        const size_t alpha2 = transforms.alpha * transforms.alpha;
+        const ElemType* f = filter.BufferPointer();
+        const size_t filterRows = filter.GetNumRows();
+        m_winogradFilter.Resize(numOut, alpha2 * numIn);
+        ElemType* u = m_winogradFilter.BufferPointer();
+#pragma omp parallel for
+        for (long o = 0; o < (long) numOut; o++)
+        {
+            ElemType g[9], tmp[18], t[36];
+            for (size_t i = 0; i < numIn; i++)
+            {
+                for (size_t r = 0; r < 3; r++)
+                    for (size_t c = 0; c < 3; c++)
+                        g[r * 3 + c] = flipTransposed ? f[i + filterRows * (o * 9 + (2 - r) + 3 * (2 - c))] : f[o + filterRows * (i * 9 + r + 3 * c)];
+                Sandwich(transforms.G, transforms.alpha, 3, g, tmp, t);
+                for (size_t xi = 0; xi < alpha2; xi++)
+                    u[o + numOut * (xi * numIn + i)] = t[xi];
+            }
+        }
+    }
+
+    // Stride-1 3x3 convolution of dense samples in the layout [channel, row, column] (channel fastest) with m_winogradFilter:
+    // output pixel (r, c) sees the input pixels (r + i - pad, c + j - pad) for kernel position (i, j), with zeros outside the image.
+    // The input is cut into overlapping alpha x alpha tiles, each transformed once per channel; the products of all tiles with all
+    // filters are then alpha^2 GEMMs of [numOut x numIn] * [numIn x tiles], and the inverse transform yields m x m output pixels per tile.
+    void WinogradConvolve(const ElemType* in, size_t numSamples, size_t numIn, size_t inH, size_t inW, size_t pad, const WinogradTransforms& transforms,
+                          ElemType* out, size_t numOut, size_t outH, size_t outW, bool accumulate)
+    {
+        const size_t m = transforms.m;
+        const size_t alpha = transforms.alpha;
+        const size_t alpha2 = alpha * alpha;
+        const size_t tilesH = (outH + m - 1) / m;
+        const size_t tilesPerSample = tilesH * ((outW + m - 1) / m);
+        const size_t numTiles = numSamples * tilesPerSample;
+
+        // input transform: element xi of B^T d B for tile p and channel i goes to row i, column xi * numTiles + p
+        m_winogradInput.Resize(numIn, alpha2 * numTiles);
+        ElemType* v = m_winogradInput.BufferPointer();
+#pragma omp parallel for
+        for (long p = 0; p < (long) numTiles; p++)
+        {
+            const size_t tile = p % tilesPerSample;
+            const long row0 = (long) ((tile % tilesH) * m) - (long) pad;
+            const long col0 = (long) ((tile / tilesH) * m) - (long) pad;
+            const ElemType* x = in + (p / tilesPerSample) * numIn * inH * inW;
+            ElemType d[36], tmp[36], t[36];
+            for (size_t i = 0; i < numIn; i++)
+            {
+                for (size_t r = 0; r < alpha; r++)
+                    for (size_t c = 0; c < alpha; c++)
+                    {
+                        const long row = row0 + (long) r;
+                        const long col = col0 + (long) c;
+                        d[r * alpha + c] = (row >= 0 && row < (long) inH && col >= 0 && col < (long) inW) ? x[i + numIn * (row + inH * col)] : 0;
+                    }
+                Sandwich(transforms.Bt, alpha, alpha, d, tmp, t);
+                for (size_t xi = 0; xi < alpha2; xi++)
+                    v[i + numIn * (xi * numTiles + p)] = t[xi];
+            }
+        }
+
+        // elementwise products in the transformed domain, summed over the input channels
+        m_winogradProducts.Resize(numOut, alpha2 * numTiles);
+        for (size_t xi = 0; xi < alpha2; xi++)
+        {
+            Mat products = m_winogradProducts.ColumnSlice(xi * numTiles, numTiles);
+            Mat::Multiply(m_winogradFilter.ColumnSlice(xi * numIn, numIn), false, m_winogradInput.ColumnSlice(xi * numTiles, numTiles), false, products);
+        }
+
+        // output transform A^T M A, clipped at the image border
+        const ElemType* products = m_winogradProducts.BufferPointer();
+#pragma omp parallel for
+        for (long p = 0; p < (long) numTiles; p++)
+        {
+            const size_t tile = p % tilesPerSample;
+            const size_t row0 = (tile % tilesH) * m;
+            const size_t col0 = (tile / tilesH) * m;
+            ElemType* y = out + (p / tilesPerSample) * numOut * outH * outW;
+            ElemType mm[36], tmp[24], t[16];
+            for (size_t o = 0; o < numOut; o++)
+            {
+                for (size_t xi = 0; xi < alpha2; xi++)
+                    mm[xi] = products[o + numOut * (xi * numTiles + p)];
+                Sandwich(transforms.At, m, alpha, mm, tmp, t);
+                for (size_t r = 0; r < m && row0 + r < outH; r++)
+                    for (size_t c = 0; c < m && col0 + c < outW; c++)
+                    {
+                        ElemType& result = y[o + numOut * (row0 + r + outH * (col0 + c))];
+                        result = accumulate ? result + t[r * m + c] : t[r * m + c];
+                    }
+            }
+        }
     }
 
 private:
@@ -340,6 +1027,11 @@ private:
     Mat m_ones;
     bool m_gpuSparseOpt;
     bool m_gpuSparse1D;
+
+    Algorithm m_forwardAlgorithm; // of the last Forward() call; BackwardFilter() may only reuse the workspace if it was Unrolled
+    Mat m_winogradFilter;         // transformed filters
+    Mat m_winogradInput;          // transformed input tiles
+    Mat m_winogradProducts;       // their products, before the output transform
 };
 
 template class ConvolutionEngine<float>;
@@ -355,6 +1047,11 @@ public:
     using typename Base::Mat;
 
 public:
+    DefaultPoolingEngine()
+        : m_argmaxOut(nullptr), m_argmaxNumCols(0)
+    {
+    }
+
     void Forward(const Tensor4D& inT, const Mat& in, const PoolDesc& poolDesc, const Tensor4D& outT, Mat& out) override
     {
         assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
@@ -362,7 +1059,19 @@ public:
         assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
         assert(outT.n() == out.GetNumCols());
 
-        if (poolDesc.kind() == PoolDesc::PoolKind::Max)
+        m_argmaxOut = nullptr;
+        if (poolDesc.kind() == PoolDesc::PoolKind::Max && UseCpuMaxPooling(in, poolDesc))
+        {
+            const PoolGeometry geometry(inT, outT, poolDesc);
+            m_argmax.resize(out.GetNumElements() * ArgmaxBytes(poolDesc));
+            if (ArgmaxBytes(poolDesc) == 1)
+                MaxPoolForward(in.BufferPointer(), inT.n(), geometry, out.BufferPointer(), (unsigned char*) m_argmax.data());
+            else
+                MaxPoolForward(in.BufferPointer(), inT.n(), geometry, out.BufferPointer(), (unsigned short*) m_argmax.data());
+            m_argmaxOut = out.BufferPointer();
+            m_argmaxNumCols = out.GetNumCols();
+        }
+        else if (poolDesc.kind() == PoolDesc::PoolKind::Max)
         {
             out.AssignMaxPoolingResult(in, inT.c(), inT.w(), inT.h(), inT.w() * inT.h() * inT.c(),
                                        outT.w(), outT.h(), outT.w() * outT.h() * outT.c(),
@@ -389,7 +1098,17 @@ public:
         assert(in.GetNumRows() == grad.GetNumRows());
         assert(in.GetNumCols() == grad.GetNumCols());
 
-        if (poolDesc.kind() == PoolDesc::PoolKind::Max)
+        // the positions of the maxima are known if Forward() recorded them for this output
+        if (poolDesc.kind() == PoolDesc::PoolKind::Max && m_argmaxOut != nullptr && m_argmaxOut == out.BufferPointer() && m_argmaxNumCols == out.GetNumCols() &&
+            UseCpuMaxPooling(grad, poolDesc) && srcGrad.GetMatrixType() == MatrixType::DENSE)
+        {
+            const PoolGeometry geometry(inT, outT, poolDesc);
+            if (ArgmaxBytes(poolDesc) == 1)
+                MaxPoolBackward(srcGrad.BufferPointer(), (const unsigned char*) m_argmax.data(), inT.n(), geometry, grad.BufferPointer());
+            else
+                MaxPoolBackward(srcGrad.BufferPointer(), (const unsigned short*) m_argmax.data(), inT.n(), geometry, grad.BufferPointer());
+        }
+        else if (poolDesc.kind() == PoolDesc::PoolKind::Max)
         {
             grad.AddMaxPoolingGradient(srcGrad, in, out,
                                        inT.c(), inT.w(), inT.h(), inT.w() * inT.h() * inT.c(),
@@ -405,6 +1124,132 @@ public:
         else
             assert(false);
     }
+
+private:
+    // Max pooling of dense input on the CPU is done in one pass over each window, vectorized over the channels (which are
+    // adjacent in the legacy layout [channel, row, column]), and records for each output element the position of its maximum
+    // within the window, in one byte or, for windows of more than 256 elements, two. Backward() then adds each output gradient to
+    // that position instead of searching the window for input values equal to the output. Windows may overlap, and with
+    // padding are clipped at the image border. Of several equal maxima, the first one gets the gradient.
+    struct PoolGeometry
+    {
+        size_t inH, inW, numChannels;
+        size_t outH, outW;
+        size_t windowH, windowW;
+        size_t hStride, wStride;
+        long hPad, wPad; // output pixel (r, c) pools input rows r * hStride - hPad + [0, windowH) and columns c * wStride - wPad + [0, windowW)
+
+        PoolGeometry(const Tensor4D& inT, const Tensor4D& outT, const PoolDesc& poolDesc)
+            : inH(inT.h()), inW(inT.w()), numChannels(inT.c()), outH(outT.h()), outW(outT.w()), windowH(poolDesc.h()), windowW(poolDesc.w()),
+              hStride(poolDesc.hStride()), wStride(poolDesc.wStride()), hPad((long) poolDesc.hPad()), wPad((long) poolDesc.wPad())
+        {
+        }
+    };
+
+    static bool UseCpuMaxPooling(const Mat& in, const PoolDesc& poolDesc)
+    {
+        return in.GetDeviceId() == CPUDEVICE && in.GetMatrixType() == MatrixType::DENSE && poolDesc.w() * poolDesc.h() <= 65536 &&
+               poolDesc.wPad() < poolDesc.w() && poolDesc.hPad() < poolDesc.h(); // (every window has a pixel inside the image)
+    }
+    static size_t ArgmaxBytes(const PoolDesc& poolDesc)
+    {
+        return poolDesc.w() * poolDesc.h() <= 256 ? 1 : 2;
+    }
+
+    template <class Index>
+    static void MaxPoolForward(const ElemType* in, size_t numSamples, const PoolGeometry& g, ElemType* out, Index* argmax)
+    {
+        const size_t C = g.numChannels;
+        const size_t inDim = C * g.inH * g.inW;
+        const size_t outDim = C * g.outH * g.outW;
+#pragma omp parallel for
+        for (long p = 0; p < (long) (numSamples * g.outW); p++) // (sample, output column)
+        {
+            const size_t sample = p / g.outW;
+            const size_t outCol = p % g.outW;
+            const ElemType* x = in + sample * inDim;
+            const long col0 = (long) (outCol * g.wStride) - g.wPad;
+            for (size_t outRow = 0; outRow < g.outH; outRow++)
+            {
+                const size_t offset = sample * outDim + (outRow + outCol * g.outH) * C;
+                ElemType* y = out + offset;
+                Index* a = argmax + offset;
+                const long row0 = (long) (outRow * g.hStride) - g.hPad;
+                bool first = true;
+                for (size_t wc = 0; wc < g.windowW; wc++)
+                {
+                    const long col = col0 + (long) wc;
+                    if (col < 0 || col >= (long) g.inW)
+                        continue;
+                    for (size_t wr = 0; wr < g.windowH; wr++)
+                    {
+                        const long row = row0 + (long) wr;
+                        if (row < 0 || row >= (long) g.inH)
+                            continue;
+                        const ElemType* v = x + (row + col * g.inH) * C;
+                        const Index k = (Index) (wr + wc * g.windowH);
+                        if (first)
+                        {
+                            for (size_t c = 0; c < C; c++)
+                            {
+                                y[c] = v[c];
+                                a[c] = k;
+                            }
+                            first = false;
+                        }
+                        else
+                        {
+                            for (size_t c = 0; c < C; c++)
+                            {
+                                const bool larger = v[c] > y[c];
+                                y[c] = larger ? v[c] : y[c];
+                                a[c] = larger ? k : a[c];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // grad += srcGrad at the recorded positions; parallel over samples and blocks of channels, whose gradients are disjoint
+    template <class Index>
+    static void MaxPoolBackward(const ElemType* srcGrad, const Index* argmax, size_t numSamples, const PoolGeometry& g, ElemType* grad)
+    {
+        const size_t C = g.numChannels;
+        const size_t inDim = C * g.inH * g.inW;
+        const size_t outDim = C * g.outH * g.outW;
+        const size_t channelBlock = 16;
+        const size_t numBlocks = (C + channelBlock - 1) / channelBlock;
+#pragma omp parallel for
+        for (long p = 0; p < (long) (numSamples * numBlocks); p++)
+        {
+            const size_t sample = p / numBlocks;
+            const size_t cBegin = (p % numBlocks) * channelBlock;
+            const size_t cEnd = min(C, cBegin + channelBlock);
+            ElemType* x = grad + sample * inDim;
+            for (size_t outCol = 0; outCol < g.outW; outCol++)
+            {
+                const long col0 = (long) (outCol * g.wStride) - g.wPad;
+                for (size_t outRow = 0; outRow < g.outH; outRow++)
+                {
+                    const size_t offset = sample * outDim + (outRow + outCol * g.outH) * C;
+                    const long row0 = (long) (outRow * g.hStride) - g.hPad;
+                    for (size_t c = cBegin; c < cEnd; c++)
+                    {
+                        const size_t k = argmax[offset + c];
+                        const size_t row = (size_t) (row0 + (long) (k % g.windowH));
+                        const size_t col = (size_t) (col0 + (long) (k / g.windowH));
+                        x[(row + col * g.inH) * C + c] += srcGrad[offset + c];
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned char> m_argmax; // of the last Forward(), as unsigned char or unsigned short (see ArgmaxBytes())
+    const ElemType* m_argmaxOut;         // the output they belong to, or null if Forward() did not record them
+    size_t m_argmaxNumCols;
 };
 
 template class PoolingEngine<float>;
@@ -439,9 +1284,9 @@ public:
     }
 
     ConvDescPtr CreateConvDescriptor(const Tensor4D& /*inT*/, const Filter& /*filterT*/,
-                                     size_t wStride, size_t hStride, bool padding) override
+                                     size_t wStride, size_t hStride, bool padding, size_t groups) override
     {
-        return std::make_unique<ConvDesc>(wStride, hStride, padding);
+        return std::make_unique<ConvDesc>(wStride, hStride, padding, groups);
     }
 
     PoolDescPtr CreatePoolDescriptor(typename PoolDesc::PoolKind kind, size_t w, size_t h, size_t wStride, size_t hStride, size_t wPad, size_t hPad) override
@@ -460,23 +1305,34 @@ public:
     }
 };
 
+static bool s_cuDnnForHWC = false;
+
+/*static*/ void ConvolutionEngineSelection::SetCuDnnForHWC(bool enable)
+{
+    s_cuDnnForHWC = enable;
+}
+
+/*static*/ bool ConvolutionEngineSelection::GetCuDnnForHWC()
+{
+    return s_cuDnnForHWC;
+}
+
 template <class ElemType>
 std::unique_ptr<ConvolutionEngineFactory<ElemType>> ConvolutionEngineFactory<ElemType>::Create(DEVICEID_TYPE deviceId, EngineType engType, ImageLayoutKind imageLayoutKind)
 {
     if (engType == EngineType::Auto)
     {
         // REVIEW alexeyk: make cuDNN default when running on GPU and compiled with cuDNN, add config parameter to enable runtime switch between implementations.
-        if (deviceId >= 0 && CuDnnConvolutionEngineFactory<ElemType>::IsSupported(deviceId) && imageLayoutKind == ImageLayoutKind::CHW)
+        bool layoutOnCuDnn = imageLayoutKind == ImageLayoutKind::CHW || ConvolutionEngineSelection::GetCuDnnForHWC();
+        if (deviceId >= 0 && CuDnnConvolutionEngineFactory<ElemType>::IsSupported(deviceId) && layoutOnCuDnn)
             return Create(deviceId, EngineType::CuDnn, imageLayoutKind);
         else
             return Create(deviceId, EngineType::Legacy, imageLayoutKind);
     }
     else if (engType == EngineType::CuDnn)
     {
-        if (imageLayoutKind != ImageLayoutKind::CHW)
-            InvalidArgument("ConvolutionEngineFactory: ImageLayout '%s' is not compatible with the cuDNN engine.", ToString(imageLayoutKind).c_str());
         if (deviceId >= 0 && CuDnnConvolutionEngineFactory<ElemType>::IsSupported(deviceId))
-            return std::make_unique<CuDnnConvolutionEngineFactory<ElemType>>();
+            return std::make_unique<CuDnnConvolutionEngineFactory<ElemType>>(imageLayoutKind);
         RuntimeError("cuDNN convolution engine is not supported, check the device id and whether the code was compiled with cuDNN.");
     }
     else if (engType == EngineType::Legacy)
@@ -132,13 +132,20 @@ public:
     {
         return m_padding;
     }
+    // Number of groups the channels are split into: output channel k only sees the input channels of group k / (outputs / groups),
+    // and the filter spans inputs / groups channels. 1 is a dense convolution; groups == inputs is a depthwise convolution.
+    size_t groups() const
+    {
+        return m_groups;
+    }
 
 public:
-    ConvolutionDescriptor(size_t wStride = 1, size_t hStride = 1, bool padding = false)
+    ConvolutionDescriptor(size_t wStride = 1, size_t hStride = 1, bool padding = false, size_t groups = 1)
     {
         m_wStride = wStride;
         m_hStride = hStride;
         m_padding = padding;
+        m_groups = groups;
     }
 
 public:
@@ -151,6 +158,7 @@ private:
     size_t m_wStride;
     size_t m_hStride;
     bool m_padding;
+    size_t m_groups;
 };
 
 // PoolingDescriptor describes properties specific to convolution application.
@@ -250,12 +258,14 @@ public:
     virtual void AddBias(const Tensor4D& outT, const Mat& out, const Tensor4D& biasT, const Mat& bias, Mat& dst) = 0;
     virtual void BackwardBias(const Tensor4D& srcGradT, const Mat& srcGrad, const Tensor4D& biasT, Mat& biasGrad) = 0;
 
+    // With 'relu', the output is max(0, normalized), computed in the same pass. The derivative of the ReLU is not part of
+    // BackwardNormalizeBatch(), the caller masks 'srcGrad' with the output.
     virtual void NormalizeBatch(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
                                 bool spatial, double expAvgFactor, Mat& runMean, Mat& runInvStdDev, Mat& out,
-                                double epsilon, Mat& saveMean, Mat& saveInvStdDev) = 0;
+                                double epsilon, Mat& saveMean, Mat& saveInvStdDev, bool relu = false) = 0;
 
     virtual void NormalizeBatchInference(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
-                                         bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out) = 0;
+                                         bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out, bool relu = false) = 0;
 
     virtual void BackwardNormalizeBatch(const Tensor4D& inT, const Mat& in, const Mat& srcGrad, Mat& grad,
                                         const Tensor4D& scaleBiasT, const Mat& scale, bool spatial, const Mat& saveMean, const Mat& saveInvStdDev,
@@ -297,6 +307,17 @@ enum class BatchNormImpl
     Cntk
 };
 
+// Process-wide choices of ConvolutionEngineFactory::Create() for EngineType::Auto.
+class MATH_API ConvolutionEngineSelection
+{
+public:
+    // By default, HWC data runs on the legacy engine, which also handles sparse input (e.g. 1D convolution over text).
+    // If enabled, HWC data on a GPU runs on cuDNN with NHWC tensors instead, so that dense image models can skip
+    // the HWC to CHW transposition in the reader without falling back to the legacy engine.
+    static void SetCuDnnForHWC(bool enable);
+    static bool GetCuDnnForHWC();
+};
+
 template <class ElemType>
 class MATH_API ConvolutionEngineFactory
 {
@@ -319,8 +340,9 @@ public:
 
     virtual Tensor4DPtr CreateTensor(size_t w, size_t h, size_t c, size_t n) = 0;
     virtual FilterPtr CreateFilter(size_t w, size_t h, size_t c, size_t k) = 0;
+    // 'filterT' spans the input channels of one group (see ConvolutionDescriptor::groups())
     virtual ConvDescPtr CreateConvDescriptor(const Tensor4D& inT, const Filter& filterT,
-                                             size_t wStride, size_t hStride, bool padding) = 0;
+                                             size_t wStride, size_t hStride, bool padding, size_t groups = 1) = 0;
     virtual PoolDescPtr CreatePoolDescriptor(PoolDesc::PoolKind kind, size_t w, size_t h, size_t wStride, size_t hStride, size_t wPad, size_t hPad) = 0;
     // virtual Tensor4DPtr CreateLrnDescriptor() = 0;
 
@@ -6,6 +6,8 @@
 #include "stdafx.h"
 #include "CuDnnConvolutionEngine.h"
 #include "GPUMatrix.h"
+#include "fileutil.h"
+#include <mutex>
 #ifdef USE_CUDNN
 #include <cudnn.h>
 #include "CuDnnConvolutionEngine.cuh"
@@ -19,6 +21,8 @@ const char* CudaErrString<cudnnStatus_t>(cudnnStatus_t x)
 // A note on the formats: CNTK originally used NHWC for input/output tensors and CHWN for filters.
 // Such formats have very limited support in cuDNN and not used in other frameworks.
 // CNTK with cuDNN by default uses NCHW formats for both inputs/outputs and filters.
+// For ImageLayoutKind::HWC, inputs/outputs are described as NHWC instead, and filters are transposed from CHWN to NCHW
+// (see CuDnnConvolutionEngineFactory).
 #define TENSOR_FORMAT CUDNN_TENSOR_NCHW
 #define FILTER_FORMAT CUDNN_TENSOR_NCHW
 #endif
@@ -71,17 +75,70 @@ float CudaTimer::Elapsed()
     return ms;
 }
 
+// file format: one line per tuned shape, "<key>\t<algorithm>\t<workspace size in bytes>"
+static std::mutex s_algoCacheMutex;
+static std::wstring s_algoCacheFile;
+static std::map<std::string, std::pair<int, size_t>> s_algoCache; // [key] -> (algorithm, workspace size)
+
+void CuDnnAlgorithmCache::SetFile(const std::wstring& path)
+{
+    std::lock_guard<std::mutex> lock(s_algoCacheMutex);
+    s_algoCacheFile = path;
+    if (path.empty() || !fexists(path.c_str()))
+        return;
+
+    FILE* f = fopenOrDie(path, L"r");
+    char line[1024];
+    size_t numEntries = 0;
+    while (fgets(line, sizeof(line), f) != nullptr)
+    {
+        char* algo = strchr(line, '\t');
+        char* memory = algo != nullptr ? strchr(algo + 1, '\t') : nullptr;
+        if (memory == nullptr)
+            continue; // not an entry (e.g. an empty line)
+        *algo = 0;
+        s_algoCache[line] = std::make_pair(atoi(algo + 1), (size_t) strtoull(memory + 1, nullptr, 10));
+        numEntries++;
+    }
+    fclose(f);
+    fprintf(stderr, "CuDnnAlgorithmCache: %d tuned convolution shapes loaded from %ls.\n", (int) numEntries, path.c_str());
+}
+
+bool CuDnnAlgorithmCache::Find(const std::string& key, int& algo, size_t& memory)
+{
+    std::lock_guard<std::mutex> lock(s_algoCacheMutex);
+    auto iter = s_algoCache.find(key);
+    if (iter == s_algoCache.end())
+        return false;
+    algo = iter->second.first;
+    memory = iter->second.second;
+    return true;
+}
+
+void CuDnnAlgorithmCache::Add(const std::string& key, int algo, size_t memory)
+{
+    std::lock_guard<std::mutex> lock(s_algoCacheMutex);
+    s_algoCache[key] = std::make_pair(algo, memory);
+    if (s_algoCacheFile.empty())
+        return;
+    // appending a line at a time lets concurrent jobs share the file
+    FILE* f = fopenOrDie(s_algoCacheFile, L"a");
+    fprintf(f, "%s\t%d\t%llu\n", key.c_str(), algo, (unsigned long long) memory);
+    fclose(f);
+}
+
 #ifdef USE_CUDNN
 
 class CuDnnTensor4D : public ConvolutionTensor4D
 {
 public:
-    CuDnnTensor4D(size_t w, size_t h, size_t c, size_t n, cudnnDataType_t dataType)
-        : ConvolutionTensor4D(w, h, c, n), m_dataType(dataType), m_tensor(nullptr)
+    // The HWC layout stores the channels fastest, followed by what the legacy engine treats as the image rows (h), then the columns (w).
+    // A single-channel tensor has the same memory layout in both formats, so it is always described as NCHW, which all cuDNN functions accept.
+    CuDnnTensor4D(size_t w, size_t h, size_t c, size_t n, cudnnDataType_t dataType, ImageLayoutKind imageLayoutKind)
+        : ConvolutionTensor4D(w, h, c, n), m_dataType(dataType), m_channelsFastest(imageLayoutKind == ImageLayoutKind::HWC && c > 1), m_tensor(nullptr)
     {
         CUDNN_CALL(cudnnCreateTensorDescriptor(&m_tensor));
-        CUDNN_CALL(cudnnSetTensor4dDescriptor(m_tensor, TENSOR_FORMAT, dataType,
-                                              static_cast<int>(n), static_cast<int>(c), static_cast<int>(h), static_cast<int>(w)));
+        SetDescriptor();
     }
 
 public:
@@ -102,24 +159,36 @@ public:
     void setN(size_t newN) override
     {
         ConvolutionTensor4D::setN(newN);
-        CUDNN_CALL(cudnnSetTensor4dDescriptor(m_tensor, TENSOR_FORMAT, m_dataType,
-                                              static_cast<int>(n()), static_cast<int>(c()), static_cast<int>(h()), static_cast<int>(w())));
+        SetDescriptor();
     }
 
 private:
+    void SetDescriptor()
+    {
+        if (m_channelsFastest)
+            CUDNN_CALL(cudnnSetTensor4dDescriptor(m_tensor, CUDNN_TENSOR_NHWC, m_dataType,
+                                                  static_cast<int>(n()), static_cast<int>(c()), static_cast<int>(w()), static_cast<int>(h())));
+        else
+            CUDNN_CALL(cudnnSetTensor4dDescriptor(m_tensor, TENSOR_FORMAT, m_dataType,
+                                                  static_cast<int>(n()), static_cast<int>(c()), static_cast<int>(h()), static_cast<int>(w())));
+    }
+
     cudnnDataType_t m_dataType;
+    bool m_channelsFastest;
     cudnnTensorDescriptor_t m_tensor;
 };
 
 class CuDnnFilter : public ConvolutionFilter
 {
 public:
-    CuDnnFilter(size_t w, size_t h, size_t c, size_t k, cudnnDataType_t dataType)
+    // For HWC, the descriptor is that of the transposed (NCHW) filter, whose fastest dimension is the kernel height as in the legacy engine.
+    CuDnnFilter(size_t w, size_t h, size_t c, size_t k, cudnnDataType_t dataType, ImageLayoutKind imageLayoutKind)
         : ConvolutionFilter(w, h, c, k), m_filter(nullptr)
     {
+        const bool hwc = imageLayoutKind == ImageLayoutKind::HWC;
         CUDNN_CALL(cudnnCreateFilterDescriptor(&m_filter));
         CUDNN_CALL(cudnnSetFilter4dDescriptor_v4(m_filter, dataType, FILTER_FORMAT,
-                                                 static_cast<int>(k), static_cast<int>(c), static_cast<int>(h), static_cast<int>(w)));
+                                                 static_cast<int>(k), static_cast<int>(c), static_cast<int>(hwc ? w : h), static_cast<int>(hwc ? h : w)));
     }
 
 public:
@@ -144,14 +213,28 @@ private:
 class CuDnnConvolutionDescriptor : public ConvolutionDescriptor
 {
 public:
-    CuDnnConvolutionDescriptor(size_t wStride, size_t hStride, size_t wPad, size_t hPad)
-        : ConvolutionDescriptor(wStride, hStride, wPad > 0 || hPad > 0), m_conv(nullptr)
+    // HWC tensors are described with w and h swapped (see CuDnnTensor4D), and so are the strides and paddings.
+    CuDnnConvolutionDescriptor(size_t wStride, size_t hStride, size_t wPad, size_t hPad, size_t groups, ImageLayoutKind imageLayoutKind)
+        : ConvolutionDescriptor(wStride, hStride, wPad > 0 || hPad > 0, groups), m_conv(nullptr)
     {
+        if (imageLayoutKind == ImageLayoutKind::HWC)
+        {
+            std::swap(wStride, hStride);
+            std::swap(wPad, hPad);
+        }
         CUDNN_CALL(cudnnCreateConvolutionDescriptor(&m_conv));
         CUDNN_CALL(cudnnSetConvolution2dDescriptor(m_conv,
                                                    static_cast<int>(hPad), static_cast<int>(wPad),
                                                    static_cast<int>(hStride), static_cast<int>(wStride),
                                                    1, 1, CUDNN_CROSS_CORRELATION));
+        if (groups > 1)
+        {
+#if CUDNN_MAJOR >= 7
+            CUDNN_CALL(cudnnSetConvolutionGroupCount(m_conv, static_cast<int>(groups)));
+#else
+            RuntimeError("Grouped convolution requires cuDNN 7 or later.");
+#endif
+        }
     }
 
 public:
@@ -176,11 +259,18 @@ private:
 class CuDnnPoolingDescriptor : public PoolingDescriptor
 {
 public:
-    CuDnnPoolingDescriptor(PoolKind kind, size_t w, size_t h, size_t wStride, size_t hStride, size_t wPad, size_t hPad)
+    CuDnnPoolingDescriptor(PoolKind kind, size_t w, size_t h, size_t wStride, size_t hStride, size_t wPad, size_t hPad, ImageLayoutKind imageLayoutKind)
         : PoolingDescriptor(kind, w, h, wStride, hStride, wPad, hPad), m_pool(nullptr)
     {
         assert(kind == PoolKind::Max || kind == PoolKind::Average);
 
+        if (imageLayoutKind == ImageLayoutKind::HWC)
+        {
+            std::swap(w, h);
+            std::swap(wStride, hStride);
+            std::swap(wPad, hPad);
+        }
+
         CUDNN_CALL(cudnnCreatePoolingDescriptor(&m_pool));
         CUDNN_CALL(cudnnSetPooling2dDescriptor(m_pool,
                                                kind == PoolKind::Max ? CUDNN_POOLING_MAX : CUDNN_POOLING_AVERAGE_COUNT_EXCLUDE_PADDING,
@@ -267,11 +357,20 @@ public:
     using typename Base::Filter;
     using typename Base::ConvDesc;
 
-    CuDnnConvolutionEngine(size_t maxTempMemSizeInSamples, BatchNormImpl bnImpl)
-        : m_maxTempMemSizeInSamples(maxTempMemSizeInSamples), m_bnImpl(bnImpl), m_stream(GetStream()), m_cudnn(nullptr)
+    CuDnnConvolutionEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples, BatchNormImpl bnImpl, ImageLayoutKind imageLayoutKind)
+        : m_maxTempMemSizeInSamples(maxTempMemSizeInSamples), m_bnImpl(bnImpl), m_cudnn(nullptr),
+          m_transposeFilter(imageLayoutKind == ImageLayoutKind::HWC), m_transposedFilter(deviceId)
     {
         CUDNN_CALL(cudnnCreate(&m_cudnn));
-        CUDNN_CALL(cudnnSetStream(m_cudnn, m_stream));
+
+        // the tuned algorithms depend on the GPU model, the cuDNN version and the element type besides the shapes
+        int currentDevice;
+        cudaDeviceProp props = {0};
+        CUDA_CALL(cudaGetDevice(&currentDevice));
+        CUDA_CALL(cudaGetDeviceProperties(&props, currentDevice));
+        char prefix[512];
+        sprintf(prefix, "%s|cuDNN %d|%s", props.name, (int) cudnnGetVersion(), sizeof(ElemType) == sizeof(float) ? "float" : "double");
+        m_algoCacheKeyPrefix = prefix;
     }
 
     ~CuDnnConvolutionEngine()
@@ -291,15 +390,17 @@ public:
         assert(inT.n() == in.GetNumCols());
         assert(filterT.k() == filter.GetNumRows());
         assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
-        assert(inT.c() == filterT.c());
+        assert(inT.c() == filterT.c() * convDesc.groups());
         assert(outT.c() == filterT.k());
+        if (in.GetMatrixType() != MatrixType::DENSE)
+            InvalidArgument("The cuDNN convolution engine does not support sparse input. Use the legacy engine for sparse HWC data.");
 
         // Find best algo and allocate temp buffer, if needed.
         FindBestForwardAlgo(t(inT), f(filterT), cd(convDesc), t(outT));
         if (m_fwdAlgo.Algo.memory > 0)
             workspace.Resize((m_fwdAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Perform forward convolution operation.
-        CUDNN_CALL(cudnnConvolutionForward(m_cudnn, &C::One, t(inT), ptr(in), f(filterT), ptr(filter), cd(convDesc), m_fwdAlgo.Algo.algo,
+        CUDNN_CALL(cudnnConvolutionForward(Handle(), &C::One, t(inT), ptr(in), f(filterT), ptr(NchwFilter(filter)), cd(convDesc), m_fwdAlgo.Algo.algo,
                                            ptr(workspace), m_fwdAlgo.Algo.memory, &C::Zero, t(outT), ptr(out)));
     }
 
@@ -311,7 +412,7 @@ public:
         assert(filterT.k() == filter.GetNumRows());
         assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
         assert(srcGradT.c() == filterT.k());
-        assert(gradT.c() == filterT.c());
+        assert(gradT.c() == filterT.c() * convDesc.groups());
         assert(gradT.w() * gradT.h() * gradT.c() == grad.GetNumRows());
         assert(gradT.n() == grad.GetNumCols());
 
@@ -320,7 +421,7 @@ public:
         if (m_backDataAlgo.Algo.memory > 0)
             workspace.Resize((m_backDataAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Compute gradients with respect to the output tensor (data).
-        CUDNN_CALL(cudnnConvolutionBackwardData(m_cudnn, &C::One, f(filterT), ptr(filter), t(srcGradT), ptr(srcGrad), cd(convDesc), m_backDataAlgo.Algo.algo,
+        CUDNN_CALL(cudnnConvolutionBackwardData(Handle(), &C::One, f(filterT), ptr(NchwFilter(filter)), t(srcGradT), ptr(srcGrad), cd(convDesc), m_backDataAlgo.Algo.algo,
                                                 ptr(workspace), m_backDataAlgo.Algo.memory, &C::One, t(gradT), ptr(grad)));
     }
 
@@ -332,7 +433,7 @@ public:
         assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
         assert(inT.n() == in.GetNumCols());
         assert(srcGradT.c() == filterT.k());
-        assert(inT.c() == filterT.c());
+        assert(inT.c() == filterT.c() * convDesc.groups());
         assert(filterT.k() == filter.GetNumRows());
         assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
 
@@ -341,8 +442,12 @@ public:
         if (m_backFiltAlgo.Algo.memory > 0)
             workspace.Resize((m_backFiltAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Compute gradients with respect to the output tensor (data).
-        CUDNN_CALL(cudnnConvolutionBackwardFilter(m_cudnn, &C::One, t(inT), ptr(in), t(srcGradT), ptr(srcGrad), cd(convDesc), m_backFiltAlgo.Algo.algo,
-                                                  ptr(workspace), m_backFiltAlgo.Algo.memory, &C::One, f(filterT), ptr(filter)));
+        // The gradient is accumulated, so for HWC the current one is transposed to NCHW, accumulated into, and transposed back.
+        Mat& nchwFilter = m_transposeFilter ? m_transposedFilter.AssignTransposeOf(filter) : filter;
+        CUDNN_CALL(cudnnConvolutionBackwardFilter(Handle(), &C::One, t(inT), ptr(in), t(srcGradT), ptr(srcGrad), cd(convDesc), m_backFiltAlgo.Algo.algo,
+                                                  ptr(workspace), m_backFiltAlgo.Algo.memory, &C::One, f(filterT), ptr(nchwFilter)));
+        if (m_transposeFilter)
+            filter.AssignTransposeOf(m_transposedFilter);
     }
 
     void AddBias(const Tensor4D& outT, const Mat& out, const Tensor4D& biasT, const Mat& bias, Mat& dst) override
@@ -354,8 +459,8 @@ public:
         assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
         assert(outT.n() == out.GetNumCols());
 
-        CUDNN_CALL(cudnnAddTensor(m_cudnn, &C::One, t(outT), ptr(out), &C::Zero, t(outT), ptr(dst)));
-        CUDNN_CALL(cudnnAddTensor(m_cudnn, &C::One, t(biasT), ptr(bias), &C::One, t(outT), ptr(dst)));
+        CUDNN_CALL(cudnnAddTensor(Handle(), &C::One, t(outT), ptr(out), &C::Zero, t(outT), ptr(dst)));
+        CUDNN_CALL(cudnnAddTensor(Handle(), &C::One, t(biasT), ptr(bias), &C::One, t(outT), ptr(dst)));
     }
 
     void BackwardBias(const Tensor4D& srcGradT, const Mat& srcGrad, const Tensor4D& biasT, Mat& biasGrad) override
@@ -365,12 +470,12 @@ public:
         assert(biasT.h() == 1);
         assert(biasT.n() == 1);
 
-        CUDNN_CALL(cudnnConvolutionBackwardBias(m_cudnn, &C::One, t(srcGradT), ptr(srcGrad), &C::One, t(biasT), ptr(biasGrad)));
+        CUDNN_CALL(cudnnConvolutionBackwardBias(Handle(), &C::One, t(srcGradT), ptr(srcGrad), &C::One, t(biasT), ptr(biasGrad)));
     }
 
     void NormalizeBatch(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
                         bool spatial, double expAvgFactor, Mat& runMean, Mat& runInvStdDev, Mat& out,
-                        double epsilon, Mat& saveMean, Mat& saveInvStdDev) override
+                        double epsilon, Mat& saveMean, Mat& saveInvStdDev, bool relu) override
     {
         const size_t crowIn = inT.w() * inT.h() * inT.c();
         if (spatial)
@@ -407,9 +512,11 @@ public:
             cudnnBatchNormMode_t mode = spatial ? CUDNN_BATCHNORM_SPATIAL : CUDNN_BATCHNORM_PER_ACTIVATION;
             // cuDNN will fail with BAD_PARAM if epsilon < CUDNN_BN_MIN_EPSILON.
             epsilon = std::max(epsilon, CUDNN_BN_MIN_EPSILON);
-            CUDNN_CALL(cudnnBatchNormalizationForwardTraining(m_cudnn, mode, &C::One, &C::Zero, t(inT), ptr(in), t(inT), ptr(out),
+            CUDNN_CALL(cudnnBatchNormalizationForwardTraining(Handle(), mode, &C::One, &C::Zero, t(inT), ptr(in), t(inT), ptr(out),
                 t(scaleBiasT), ptr(scale), ptr(bias), expAvgFactor, ptr(runMean), ptr(runInvStdDev), 
                 epsilon, ptr(saveMean), ptr(saveInvStdDev)));
+            if (relu) // cuDNN has no fused activation for batch normalization
+                out.InplaceTruncateBottom(0);
         }
         else if (m_bnImpl == BatchNormImpl::Cntk)
         {
@@ -420,14 +527,14 @@ public:
             epsilon = std::max(epsilon, 1e-9);
             CUDA_CALL(BatchNormalizationForwardTraining(inT, spatial, ptr(in), ptr(out), ptr(scale), ptr(bias),
                                                         ptr(runMean), ptr(runInvStdDev), epsilon, 
-                                                        ptr(saveMean), ptr(saveInvStdDev), m_stream));
+                                                        ptr(saveMean), ptr(saveInvStdDev), relu, GetStream()));
         }
         else
             RuntimeError("Provided batch norm implementation (%d) is not supported.", m_bnImpl);
     }
 
     void NormalizeBatchInference(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
-                                 bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out) override
+                                 bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out, bool relu) override
     {
         const size_t crowIn = inT.w() * inT.h() * inT.c();
 
@@ -459,13 +566,15 @@ public:
         if (m_bnImpl == BatchNormImpl::CuDnn)
         {
             cudnnBatchNormMode_t mode = spatial ? CUDNN_BATCHNORM_SPATIAL : CUDNN_BATCHNORM_PER_ACTIVATION;
-            CUDNN_CALL(cudnnBatchNormalizationForwardInference(m_cudnn, mode, &C::One, &C::Zero, t(inT), ptr(in), t(inT), ptr(out),
+            CUDNN_CALL(cudnnBatchNormalizationForwardInference(Handle(), mode, &C::One, &C::Zero, t(inT), ptr(in), t(inT), ptr(out),
                                                                t(scaleBiasT), ptr(scale), ptr(bias), ptr(runMean), ptr(runInvStdDev), CUDNN_BN_MIN_EPSILON));
+            if (relu)
+                out.InplaceTruncateBottom(0);
         }
         else if (m_bnImpl == BatchNormImpl::Cntk)
         {
             CUDA_CALL(BatchNormalizationForwardInference(inT, spatial, ptr(in), ptr(out), ptr(scale), ptr(bias),
-                                                         ptr(runMean), ptr(runInvStdDev), m_stream));
+                                                         ptr(runMean), ptr(runInvStdDev), relu, GetStream()));
         }
         else
             RuntimeError("Provided batch norm implementation (%d) is not supported.", m_bnImpl);
@@ -504,29 +613,45 @@ public:
         if (m_bnImpl == BatchNormImpl::CuDnn)
         {
             cudnnBatchNormMode_t mode = spatial ? CUDNN_BATCHNORM_SPATIAL : CUDNN_BATCHNORM_PER_ACTIVATION;
-            CUDNN_CALL(cudnnBatchNormalizationBackward(m_cudnn, mode, &C::One, &C::One, t(inT), ptr(in), t(inT), ptr(srcGrad), t(inT), ptr(grad),
+            CUDNN_CALL(cudnnBatchNormalizationBackward(Handle(), mode, &C::One, &C::One, t(inT), ptr(in), t(inT), ptr(srcGrad), t(inT), ptr(grad),
                                                        t(scaleBiasT), ptr(scale), ptr(scaleGrad), ptr(biasGrad), CUDNN_BN_MIN_EPSILON, ptr(saveMean), ptr(saveInvStdDev)));
         }
         else if (m_bnImpl == BatchNormImpl::Cntk)
         {
             CUDA_CALL(BatchNormalizationBackward(inT, spatial, ptr(in), ptr(srcGrad), ptr(grad), ptr(scale), ptr(scaleGrad), ptr(biasGrad),
-                                                 ptr(saveMean), ptr(saveInvStdDev), m_stream));
+                                                 ptr(saveMean), ptr(saveInvStdDev), GetStream()));
         }
         else
             RuntimeError("Provided batch norm implementation (%d) is not supported.", m_bnImpl);
     }
 
 private:
+    // The legacy filter matrix is [output channel x (input channel, kernel column, kernel row)], i.e. CHWN in memory.
+    // For HWC, cuDNN gets its transpose, which is NCHW with the kernel rows fastest, matching the NHWC tensor descriptors.
+    const Mat& NchwFilter(const Mat& filter)
+    {
+        if (!m_transposeFilter)
+            return filter;
+        return m_transposedFilter.AssignTransposeOf(filter);
+    }
+
     void FindBestForwardAlgo(const CuDnnTensor4D& inT, const CuDnnFilter& filtT, const CuDnnConvolutionDescriptor& convDesc, const CuDnnTensor4D& outT)
     {
         if (!m_fwdAlgo.NeedAutotuning(inT, outT))
             return;
+        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inT.w() * inT.h() * inT.c() * m_maxTempMemSizeInSamples * sizeof(ElemType);
+        const std::string key = AlgoCacheKey("fwd", inT, filtT, convDesc, maxMem);
+        if (FindInAlgoCache(key, m_fwdAlgo.Algo))
+        {
+            m_fwdAlgo.CurMBSize = inT.n();
+            return;
+        }
+
         const int MaxAlgoCount = 10;
         int calgo = 0;
         cudnnConvolutionFwdAlgoPerf_t algoPerf[MaxAlgoCount];
-        CUDNN_CALL(cudnnFindConvolutionForwardAlgorithm(m_cudnn, inT, filtT, convDesc, outT, MaxAlgoCount, &calgo, algoPerf));
+        CUDNN_CALL(cudnnFindConvolutionForwardAlgorithm(Handle(), inT, filtT, convDesc, outT, MaxAlgoCount, &calgo, algoPerf));
         assert(calgo > 0);
-        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inT.w() * inT.h() * inT.c() * m_maxTempMemSizeInSamples * sizeof(ElemType);
         auto res = std::find_if(algoPerf, algoPerf + calgo,
                                 [=](const cudnnConvolutionFwdAlgoPerf_t& cur)
                                 {
@@ -536,18 +661,26 @@ private:
             RuntimeError("cuDNN could not find suitable algorithm for cudnnConvolutionForward.");
         m_fwdAlgo.CurMBSize = inT.n();
         m_fwdAlgo.Algo = *res;
+        AddToAlgoCache(key, *res);
     }
 
     void FindBestBackwardDataAlgo(const CuDnnFilter& filtT, const CuDnnTensor4D& srcGradT, const CuDnnConvolutionDescriptor& convDesc, const CuDnnTensor4D& gradT)
     {
         if (!m_backDataAlgo.NeedAutotuning(srcGradT, gradT))
             return;
+        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : gradT.w() * gradT.h() * gradT.c() * m_maxTempMemSizeInSamples * sizeof(ElemType);
+        const std::string key = AlgoCacheKey("bwdData", gradT, filtT, convDesc, maxMem);
+        if (FindInAlgoCache(key, m_backDataAlgo.Algo))
+        {
+            m_backDataAlgo.CurMBSize = srcGradT.n();
+            return;
+        }
+
         const int MaxAlgoCount = 10;
         int calgo = 0;
         cudnnConvolutionBwdDataAlgoPerf_t algoPerf[MaxAlgoCount];
-        CUDNN_CALL(cudnnFindConvolutionBackwardDataAlgorithm(m_cudnn, filtT, srcGradT, convDesc, gradT, MaxAlgoCount, &calgo, algoPerf));
+        CUDNN_CALL(cudnnFindConvolutionBackwardDataAlgorithm(Handle(), filtT, srcGradT, convDesc, gradT, MaxAlgoCount, &calgo, algoPerf));
         assert(calgo > 0);
-        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : gradT.w() * gradT.h() * gradT.c() * m_maxTempMemSizeInSamples * sizeof(ElemType);
         auto res = std::find_if(algoPerf, algoPerf + calgo,
                                 [=](const cudnnConvolutionBwdDataAlgoPerf_t& cur)
                                 {
@@ -557,18 +690,26 @@ private:
             RuntimeError("cuDNN could not find suitable algorithm for cudnnConvolutionBackwardData.");
         m_backDataAlgo.CurMBSize = srcGradT.n();
         m_backDataAlgo.Algo = *res;
+        AddToAlgoCache(key, *res);
     }
 
     void FindBestBackwardFilterAlgo(const CuDnnTensor4D& inT, const CuDnnTensor4D& srcGradT, const CuDnnConvolutionDescriptor& convDesc, const CuDnnFilter& filtT)
     {
         if (!m_backFiltAlgo.NeedAutotuning(inT, srcGradT))
             return;
+        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inT.w() * inT.h() * inT.c() * m_maxTempMemSizeInSamples * sizeof(ElemType);
+        const std::string key = AlgoCacheKey("bwdFilter", inT, filtT, convDesc, maxMem);
+        if (FindInAlgoCache(key, m_backFiltAlgo.Algo))
+        {
+            m_backFiltAlgo.CurMBSize = inT.n();
+            return;
+        }
+
         const int MaxAlgoCount = 10;
         int calgo = 0;
         cudnnConvolutionBwdFilterAlgoPerf_t algoPerf[MaxAlgoCount];
-        CUDNN_CALL(cudnnFindConvolutionBackwardFilterAlgorithm(m_cudnn, inT, srcGradT, convDesc, filtT, MaxAlgoCount, &calgo, algoPerf));
+        CUDNN_CALL(cudnnFindConvolutionBackwardFilterAlgorithm(Handle(), inT, srcGradT, convDesc, filtT, MaxAlgoCount, &calgo, algoPerf));
         assert(calgo > 0);
-        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inT.w() * inT.h() * inT.c() * m_maxTempMemSizeInSamples * sizeof(ElemType);
         auto res = std::find_if(algoPerf, algoPerf + calgo,
                                 [=](const cudnnConvolutionBwdFilterAlgoPerf_t& cur)
                                 {
@@ -578,6 +719,41 @@ private:
             RuntimeError("cuDNN could not find suitable algorithm for cudnnConvolutionBackwardFilter.");
         m_backFiltAlgo.CurMBSize = inT.n();
         m_backFiltAlgo.Algo = *res;
+        AddToAlgoCache(key, *res);
+    }
+
+    // key of a tuned shape in the CuDnnAlgorithmCache; 'inT' is the tensor of the convolution input (or its gradient)
+    std::string AlgoCacheKey(const char* operation, const ConvolutionTensor4D& inT, const ConvolutionFilter& filtT, const ConvolutionDescriptor& convDesc, size_t maxMem) const
+    {
+        char key[256];
+        sprintf(key, "|%s|in %dx%dx%dx%d|filter %dx%dx%dx%d|stride %dx%d|pad %d|mem %llu", operation,
+                (int) inT.w(), (int) inT.h(), (int) inT.c(), (int) inT.n(), (int) filtT.w(), (int) filtT.h(), (int) filtT.c(), (int) filtT.k(),
+                (int) convDesc.wStride(), (int) convDesc.hStride(), (int) convDesc.padding(), (unsigned long long) maxMem);
+        // HWC and grouped convolutions are different problems for cuDNN; the suffixes keep the keys of dense CHW shapes as they were
+        std::string suffix = m_transposeFilter ? "|HWC" : "";
+        if (convDesc.groups() > 1)
+            suffix += "|groups " + std::to_string(convDesc.groups());
+        return m_algoCacheKeyPrefix + key + suffix;
+    }
+
+    template <typename T>
+    static bool FindInAlgoCache(const std::string& key, T& algoPerf)
+    {
+        int algo;
+        size_t memory;
+        if (!CuDnnAlgorithmCache::Find(key, algo, memory))
+            return false;
+        algoPerf.algo = static_cast<decltype(algoPerf.algo)>(algo);
+        algoPerf.memory = memory;
+        algoPerf.status = CUDNN_STATUS_SUCCESS;
+        algoPerf.time = 0;
+        return true;
+    }
+
+    template <typename T>
+    static void AddToAlgoCache(const std::string& key, const T& algoPerf)
+    {
+        CuDnnAlgorithmCache::Add(key, (int) algoPerf.algo, algoPerf.memory);
     }
 
 private:
@@ -608,14 +784,24 @@ private:
 
     using C = Consts<ElemType>;
 
+    // The handle is bound to the current stream at each call, as GPUMatrix does for cuBLAS, so that the engine
+    // runs on whatever stream the node is run on (see ComputeStreams).
+    cudnnHandle_t Handle()
+    {
+        CUDNN_CALL(cudnnSetStream(m_cudnn, GetStream()));
+        return m_cudnn;
+    }
+
     // REVIEW alexeyk: currently limit is set once in ctor though in CNTK it can be, theoretically, changed in runtime.
     size_t m_maxTempMemSizeInSamples;
     BatchNormImpl m_bnImpl;
     cudnnHandle_t m_cudnn;
-    cudaStream_t m_stream;
     ConvAlgoInfo<cudnnConvolutionFwdAlgoPerf_t> m_fwdAlgo;
     ConvAlgoInfo<cudnnConvolutionBwdDataAlgoPerf_t> m_backDataAlgo;
     ConvAlgoInfo<cudnnConvolutionBwdFilterAlgoPerf_t> m_backFiltAlgo;
+    std::string m_algoCacheKeyPrefix; // GPU model, cuDNN version and element type
+    bool m_transposeFilter;           // set for HWC, see NchwFilter()
+    Mat m_transposedFilter;
 };
 
 template <class ElemType>
@@ -632,7 +818,6 @@ public:
         : m_cudnn(nullptr)
     {
         CUDNN_CALL(cudnnCreate(&m_cudnn));
-        CUDNN_CALL(cudnnSetStream(m_cudnn, GetStream()));
     }
 
     ~CuDnnPoolingEngine()
@@ -652,7 +837,7 @@ public:
         assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
         assert(outT.n() == out.GetNumCols());
 
-        CUDNN_CALL(cudnnPoolingForward(m_cudnn, p(poolDesc), &C::One, t(inT), ptr(in), &C::Zero, t(outT), ptr(out)));
+        CUDNN_CALL(cudnnPoolingForward(Handle(), p(poolDesc), &C::One, t(inT), ptr(in), &C::Zero, t(outT), ptr(out)));
     }
 
     void Backward(const Tensor4D& outT, const Mat& out, const Mat& srcGrad, const PoolDesc& poolDesc, const Tensor4D& inT, const Mat& in, Mat& grad) override
@@ -666,13 +851,20 @@ public:
         assert(in.GetNumRows() == grad.GetNumRows());
         assert(in.GetNumCols() == grad.GetNumCols());
 
-        CUDNN_CALL(cudnnPoolingBackward(m_cudnn, p(poolDesc), &C::One, t(outT), ptr(out), t(outT), ptr(srcGrad),
+        CUDNN_CALL(cudnnPoolingBackward(Handle(), p(poolDesc), &C::One, t(outT), ptr(out), t(outT), ptr(srcGrad),
                                         t(inT), ptr(in), &C::One, t(inT), ptr(grad)));
     }
 
 private:
     using C = Consts<ElemType>;
 
+    // bound to the current stream at each call, see CuDnnConvolutionEngine::Handle()
+    cudnnHandle_t Handle()
+    {
+        CUDNN_CALL(cudnnSetStream(m_cudnn, GetStream()));
+        return m_cudnn;
+    }
+
     cudnnHandle_t m_cudnn;
 };
 
@@ -686,12 +878,12 @@ typename CuDnnConvolutionEngineFactory<ElemType>::Tensor4DPtr CuDnnConvolutionEn
 template <>
 typename CuDnnConvolutionEngineFactory<float>::Tensor4DPtr CuDnnConvolutionEngineFactory<float>::CreateTensor(size_t w, size_t h, size_t c, size_t n)
 {
-    return std::make_unique<CuDnnTensor4D>(w, h, c, n, CUDNN_DATA_FLOAT);
+    return std::make_unique<CuDnnTensor4D>(w, h, c, n, CUDNN_DATA_FLOAT, m_imageLayoutKind);
 }
 template <>
 typename CuDnnConvolutionEngineFactory<double>::Tensor4DPtr CuDnnConvolutionEngineFactory<double>::CreateTensor(size_t w, size_t h, size_t c, size_t n)
 {
-    return std::make_unique<CuDnnTensor4D>(w, h, c, n, CUDNN_DATA_DOUBLE);
+    return std::make_unique<CuDnnTensor4D>(w, h, c, n, CUDNN_DATA_DOUBLE, m_imageLayoutKind);
 }
 
 template <class ElemType>
@@ -704,35 +896,35 @@ typename CuDnnConvolutionEngineFactory<ElemType>::FilterPtr CuDnnConvolutionEngi
 template <>
 typename CuDnnConvolutionEngineFactory<float>::FilterPtr CuDnnConvolutionEngineFactory<float>::CreateFilter(size_t w, size_t h, size_t c, size_t k)
 {
-    return std::make_unique<CuDnnFilter>(w, h, c, k, CUDNN_DATA_FLOAT);
+    return std::make_unique<CuDnnFilter>(w, h, c, k, CUDNN_DATA_FLOAT, m_imageLayoutKind);
 }
 template <>
 typename CuDnnConvolutionEngineFactory<double>::FilterPtr CuDnnConvolutionEngineFactory<double>::CreateFilter(size_t w, size_t h, size_t c, size_t k)
 {
-    return std::make_unique<CuDnnFilter>(w, h, c, k, CUDNN_DATA_DOUBLE);
+    return std::make_unique<CuDnnFilter>(w, h, c, k, CUDNN_DATA_DOUBLE, m_imageLayoutKind);
 }
 
 template <class ElemType>
 typename CuDnnConvolutionEngineFactory<ElemType>::ConvDescPtr CuDnnConvolutionEngineFactory<ElemType>::CreateConvDescriptor(
-    const Tensor4D& /*inT*/, const Filter& filterT, size_t wStride, size_t hStride, bool padding)
+    const Tensor4D& /*inT*/, const Filter& filterT, size_t wStride, size_t hStride, bool padding, size_t groups)
 {
     size_t wPad = padding ? filterT.w() / 2 : 0;
     size_t hPad = padding ? filterT.h() / 2 : 0;
-    return std::make_unique<CuDnnConvolutionDescriptor>(wStride, hStride, wPad, hPad);
+    return std::make_unique<CuDnnConvolutionDescriptor>(wStride, hStride, wPad, hPad, groups, m_imageLayoutKind);
 }
 
 template <class ElemType>
 typename CuDnnConvolutionEngineFactory<ElemType>::PoolDescPtr CuDnnConvolutionEngineFactory<ElemType>::CreatePoolDescriptor(
     typename PoolDesc::PoolKind kind, size_t w, size_t h, size_t wStride, size_t hStride, size_t wPad, size_t hPad)
 {
-    return std::make_unique<CuDnnPoolingDescriptor>(kind, w, h, wStride, hStride, wPad, hPad);
+    return std::make_unique<CuDnnPoolingDescriptor>(kind, w, h, wStride, hStride, wPad, hPad, m_imageLayoutKind);
 }
 
 template <class ElemType>
 typename CuDnnConvolutionEngineFactory<ElemType>::ConvEnginePtr CuDnnConvolutionEngineFactory<ElemType>::CreateConvEngine(
-    DEVICEID_TYPE /*deviceId*/, size_t maxTempMemSizeInSamples, BatchNormImpl bnImpl)
+    DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples, BatchNormImpl bnImpl)
 {
-    return std::make_unique<CuDnnConvolutionEngine<ElemType>>(maxTempMemSizeInSamples, bnImpl);
+    return std::make_unique<CuDnnConvolutionEngine<ElemType>>(deviceId, maxTempMemSizeInSamples, bnImpl, m_imageLayoutKind);
 }
 
 template <class ElemType>
@@ -758,7 +950,7 @@ typename CuDnnConvolutionEngineFactory<ElemType>::FilterPtr CuDnnConvolutionEngi
 
 template <class ElemType>
 typename CuDnnConvolutionEngineFactory<ElemType>::ConvDescPtr CuDnnConvolutionEngineFactory<ElemType>::CreateConvDescriptor(
-    const Tensor4D&, const Filter&, size_t, size_t, bool)
+    const Tensor4D&, const Filter&, size_t, size_t, bool, size_t)
 {
     RuntimeError("The code is compiled without USE_CUDNN macro.");
 }
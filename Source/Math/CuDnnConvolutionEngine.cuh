@@ -496,9 +496,10 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     // It also updates runMean and runInvStdDev with running mean/var computed over all minibatches. 
     // These values are used in inference/evaluation phase.
     // The *Inference function computes outputs based on pre-computed mean and inv stddev.
+    // Both optionally apply a ReLU to the outputs in the same kernel (relu = true).
     //--------------------------------------------------------------------
 
-    template <int BlockDimX, int BlockDimY, bool Spatial, int U, typename ElemType>
+    template <int BlockDimX, int BlockDimY, bool Spatial, bool ReLU, int U, typename ElemType>
     __global__ void kNormalizeBatchTraining(int vectorSize, int spatialSize, int batchSize, const ElemType* x, ElemType* y,
         const ElemType* bnScale, const ElemType* bnBias, const ElemType* batchMean, const ElemType* batchInvStdDev)
     {
@@ -569,6 +570,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             for (int k = 0; k < U; k++)
             {
                 val[k] = scale[k] * (val[k] - mean[k]) * invStdDev[k] + bias[k];
+                if (ReLU && val[k] < 0)
+                    val[k] = 0;
             }
             StoreValues<U>(val, pdst);
         }
@@ -579,6 +582,16 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     {
         template <typename ElemType>
         static void Call(size_t vectorSize, size_t spatialSize, size_t batchSize, bool spatial, const ElemType* x, ElemType* y,
+            const ElemType* bnScale, const ElemType* bnBias, const ElemType* batchMean, const ElemType* batchInvStdDev, bool relu, cudaStream_t stream)
+        {
+            if (relu)
+                Launch<true>(vectorSize, spatialSize, batchSize, spatial, x, y, bnScale, bnBias, batchMean, batchInvStdDev, stream);
+            else
+                Launch<false>(vectorSize, spatialSize, batchSize, spatial, x, y, bnScale, bnBias, batchMean, batchInvStdDev, stream);
+        }
+
+        template <bool ReLU, typename ElemType>
+        static void Launch(size_t vectorSize, size_t spatialSize, size_t batchSize, bool spatial, const ElemType* x, ElemType* y,
             const ElemType* bnScale, const ElemType* bnBias, const ElemType* batchMean, const ElemType* batchInvStdDev, cudaStream_t stream)
         {
             assert((vectorSize % U) == 0);
@@ -590,13 +603,13 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             auto gdim = dim3(static_cast<unsigned int>(RoundUpToMultiple(vectorSize, BlockDimX * U)));
             if (spatial)
             {
-                kNormalizeBatchTraining<BlockDimX, BlockDimY, true, U><<<gdim, bdim, 0, stream>>>(
+                kNormalizeBatchTraining<BlockDimX, BlockDimY, true, ReLU, U><<<gdim, bdim, 0, stream>>>(
                     static_cast<int>(vectorSize), static_cast<int>(spatialSize), static_cast<int>(batchSize), x, y, bnScale, bnBias,
                     batchMean, batchInvStdDev);
             }
             else
             {
-                kNormalizeBatchTraining<BlockDimX, BlockDimY, false, U><<<gdim, bdim, 0, stream>>>(
+                kNormalizeBatchTraining<BlockDimX, BlockDimY, false, ReLU, U><<<gdim, bdim, 0, stream>>>(
                     static_cast<int>(vectorSize), static_cast<int>(spatialSize), static_cast<int>(batchSize), x, y, bnScale, bnBias,
                     batchMean, batchInvStdDev);
             }
@@ -607,7 +620,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     template <typename ElemType>
     cudaError_t BatchNormalizationForwardTraining(const Tensor4D& t, bool spatial, const ElemType* x, ElemType* y,
                                                   const ElemType* bnScale, const ElemType* bnBias, ElemType* runMean, ElemType* runInvStdDev,
-                                                  double epsilon, ElemType* saveMean, ElemType* saveInvStdDev, cudaStream_t stream)
+                                                  double epsilon, ElemType* saveMean, ElemType* saveInvStdDev, bool relu, cudaStream_t stream)
     {
         assert(nullptr != x);
         assert(nullptr != y);
@@ -643,13 +656,13 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                 return err;
         }
         Call<NormalizeBatchTraining, ElemType>(spatial ? spatialSize : vectorSize, vectorSize, spatialSize, batchSize,
-                                        spatial, x, y, bnScale, bnBias, saveMean, saveInvStdDev, stream);
+                                        spatial, x, y, bnScale, bnBias, saveMean, saveInvStdDev, relu, stream);
         return GetLastCudaError();
     }
 
     template <typename ElemType>
     cudaError_t BatchNormalizationForwardInference(const Tensor4D& t, bool spatial, const ElemType* x, ElemType* y, const ElemType* bnScale,
-                                                   const ElemType* bnBias, const ElemType* runMean, const ElemType* runInvStdDev, cudaStream_t stream)
+                                                   const ElemType* bnBias, const ElemType* runMean, const ElemType* runInvStdDev, bool relu, cudaStream_t stream)
     {
         assert(nullptr != x);
         assert(nullptr != y);
@@ -665,7 +678,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         assert(0 < batchSize  && batchSize  <= std::numeric_limits<int>::max());
 
         Call<NormalizeBatchTraining, ElemType>(spatial ? spatialSize : vectorSize, vectorSize, spatialSize, batchSize,
-                                        spatial, x, y, bnScale, bnBias, runMean, runInvStdDev, stream);
+                                        spatial, x, y, bnScale, bnBias, runMean, runInvStdDev, relu, stream);
         return GetLastCudaError();
     }
 
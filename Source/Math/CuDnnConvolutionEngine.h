@@ -27,16 +27,41 @@ public:
     using typename Base::PoolEnginePtr;
 
 public:
+    // With ImageLayoutKind::HWC, the tensors are described to cuDNN as NHWC, with the dimensions arranged as the legacy engine
+    // interprets them, and the filters (stored in the legacy CHWN format) are transposed to NCHW on the fly.
+    // This lets HWC models move between the legacy engine and cuDNN without any conversion of data or parameters.
+    explicit CuDnnConvolutionEngineFactory(ImageLayoutKind imageLayoutKind = ImageLayoutKind::CHW)
+        : m_imageLayoutKind(imageLayoutKind)
+    {
+    }
+
     Tensor4DPtr CreateTensor(size_t w, size_t h, size_t c, size_t n) override;
     FilterPtr CreateFilter(size_t w, size_t h, size_t c, size_t k) override;
     ConvDescPtr CreateConvDescriptor(const Tensor4D& inT, const Filter& filterT,
-                                     size_t wStride, size_t hStride, bool padding) override;
+                                     size_t wStride, size_t hStride, bool padding, size_t groups) override;
     PoolDescPtr CreatePoolDescriptor(typename PoolDesc::PoolKind kind, size_t w, size_t h, size_t wStride, size_t hStride, size_t wPad, size_t hPad) override;
 
     ConvEnginePtr CreateConvEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples, BatchNormImpl bnImpl) override;
     PoolEnginePtr CreatePoolEngine(DEVICEID_TYPE deviceId) override;
 
     static bool IsSupported(DEVICEID_TYPE deviceId);
+
+private:
+    ImageLayoutKind m_imageLayoutKind;
+};
+
+// Process-wide cache of the convolution algorithms picked by the cuDNN autotuner (cudnnFind*Algorithm()), per convolution shape.
+// If a file is set, the cache is loaded from it, and every newly tuned shape is appended to it, so that later jobs skip the search.
+// The keys contain the GPU model and the cuDNN version, so one file may be shared by different machines.
+class MATH_API CuDnnAlgorithmCache
+{
+public:
+    // set (and load) the file to persist the cache in; an empty path keeps the cache in memory only
+    static void SetFile(const std::wstring& path);
+
+    // used by the cuDNN convolution engine
+    static bool Find(const std::string& key, int& algo, size_t& memory);
+    static void Add(const std::string& key, int algo, size_t memory);
 };
 
 // REVIEW alexeyk: wrong place. It is currently used only in unit tests but I can't add it there because of the build issues.
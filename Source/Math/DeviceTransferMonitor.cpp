@@ -0,0 +1,164 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "DeviceTransferMonitor.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+static std::atomic<int> s_mode(DeviceTransferMonitor::off);
+
+// innermost Context of the calling thread
+#ifdef _WIN32
+static __declspec(thread) DeviceTransferMonitor::Context* t_context = nullptr;
+#else
+static __thread DeviceTransferMonitor::Context* t_context = nullptr;
+#endif
+
+namespace {
+struct TransferKey
+{
+    std::wstring m_nodeName; // empty outside of a Context
+    std::wstring m_operationName;
+    std::string m_direction;
+    bool m_isExplicit;
+
+    bool operator<(const TransferKey& other) const
+    {
+        return std::tie(m_nodeName, m_operationName, m_direction, m_isExplicit) <
+               std::tie(other.m_nodeName, other.m_operationName, other.m_direction, other.m_isExplicit);
+    }
+};
+struct TransferStatistics
+{
+    size_t m_numTransfers;
+    size_t m_bytes;
+    TransferStatistics()
+        : m_numTransfers(0), m_bytes(0)
+    {
+    }
+};
+}
+
+static std::mutex s_mutex; // protects s_statistics
+static std::map<TransferKey, TransferStatistics> s_statistics;
+
+static std::string DeviceName(int deviceId)
+{
+    return deviceId < 0 ? std::string("CPU") : "GPU" + std::to_string(deviceId);
+}
+
+/*static*/ void DeviceTransferMonitor::SetMode(Mode mode)
+{
+    s_mode = mode;
+}
+
+/*static*/ DeviceTransferMonitor::Mode DeviceTransferMonitor::GetMode()
+{
+    return (Mode) s_mode.load();
+}
+
+/*static*/ DeviceTransferMonitor::Mode DeviceTransferMonitor::ParseMode(const std::wstring& mode)
+{
+    if (mode == L"off")
+        return off;
+    else if (mode == L"count")
+        return count;
+    else if (mode == L"strict")
+        return strict;
+    InvalidArgument("DeviceTransferMonitor: Invalid mode '%ls'; must be 'off', 'count', or 'strict'.", mode.c_str());
+}
+
+void DeviceTransferMonitor::Context::Begin(const std::wstring& nodeName, const std::wstring& operationName)
+{
+    m_nodeName = nodeName;
+    m_operationName = operationName;
+    m_outer = t_context;
+    m_active = true;
+    t_context = this;
+}
+
+DeviceTransferMonitor::Context::~Context()
+{
+    if (m_active)
+        t_context = m_outer;
+}
+
+/*static*/ void DeviceTransferMonitor::RecordTransfer(int fromDeviceId, int toDeviceId, size_t bytes, bool isExplicit)
+{
+    const Mode mode = GetMode();
+    if (mode == off)
+        return;
+
+    const Context* context = t_context;
+    if (mode == strict && !isExplicit && context)
+        LogicError("DeviceTransferMonitor: Implicit transfer of %d bytes from %s to %s in %ls %ls operation (strict mode).",
+                   (int) bytes, DeviceName(fromDeviceId).c_str(), DeviceName(toDeviceId).c_str(), context->m_nodeName.c_str(), context->m_operationName.c_str());
+
+    TransferKey key;
+    if (context)
+    {
+        key.m_nodeName = context->m_nodeName;
+        key.m_operationName = context->m_operationName;
+    }
+    key.m_direction = DeviceName(fromDeviceId) + "->" + DeviceName(toDeviceId);
+    key.m_isExplicit = isExplicit;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& statistics = s_statistics[key];
+    statistics.m_numTransfers++;
+    statistics.m_bytes += bytes;
+}
+
+/*static*/ void DeviceTransferMonitor::PrintSummary(FILE* f, const std::string& title, size_t maxEntries)
+{
+    std::vector<std::pair<TransferKey, TransferStatistics>> entries;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        entries.assign(s_statistics.begin(), s_statistics.end());
+    }
+    std::sort(entries.begin(), entries.end(), [](const std::pair<TransferKey, TransferStatistics>& a, const std::pair<TransferKey, TransferStatistics>& b)
+              {
+                  return a.second.m_bytes > b.second.m_bytes;
+              });
+
+    size_t numTransfers[2] = {0, 0}; // [isExplicit]
+    double megaBytes[2] = {0, 0};
+    for (const auto& entry : entries)
+    {
+        numTransfers[entry.first.m_isExplicit] += entry.second.m_numTransfers;
+        megaBytes[entry.first.m_isExplicit] += entry.second.m_bytes / 1e6;
+    }
+    fprintf(f, "%s: Device transfers: %d implicit (%.1f MB), %d explicit (%.1f MB)\n",
+            title.c_str(), (int) numTransfers[false], megaBytes[false], (int) numTransfers[true], megaBytes[true]);
+    if (entries.empty())
+        return;
+
+    fprintf(f, "    %-8s %-11s %10s %12s  %s\n", "kind", "direction", "transfers", "MB", "node (operation)");
+    for (size_t i = 0; i < entries.size() && i < maxEntries; i++)
+    {
+        const TransferKey& key = entries[i].first;
+        const TransferStatistics& statistics = entries[i].second;
+        fprintf(f, "    %-8s %-11s %10d %12.3f  %ls\n", key.m_isExplicit ? "explicit" : "implicit", key.m_direction.c_str(),
+                (int) statistics.m_numTransfers, statistics.m_bytes / 1e6,
+                key.m_nodeName.empty() ? L"(outside of node evaluation)" : (key.m_nodeName + L" (" + key.m_operationName + L")").c_str());
+    }
+    if (entries.size() > maxEntries)
+        fprintf(f, "    ... %d more\n", (int) (entries.size() - maxEntries));
+}
+
+/*static*/ void DeviceTransferMonitor::Reset()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_statistics.clear();
+}
+
+} } }
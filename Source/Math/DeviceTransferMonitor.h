@@ -0,0 +1,95 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// DeviceTransferMonitor.h -- counts and attributes the data transfers between devices done by Matrix
+//
+// Matrix silently moves its data between CPU and GPU (or between GPUs) whenever the operands of an operation live on
+// different devices (DecideAndMoveToRightDevice()), when a GPU matrix is accessed element by element, or when it is printed.
+// These implicit transfers are easy to miss, and since a matrix in the BOTH state keeps its source, the same data may be
+// copied over and over. With monitoring enabled, Matrix reports every transfer that copies data, with its size and
+// direction, and whether it was implicit or requested explicitly (TransferFromDeviceToDevice(), TransferToDeviceIfNotThere()).
+// Transfers are attributed to the innermost Context on the calling thread; ComputationNetwork sets one around the
+// ForwardProp() and Backprop() of every node, with the node's name and operation.
+// In strict mode, an implicit transfer inside a Context raises a LogicError that names the node, so the offending operation
+// shows up in the call stack. Explicit transfers, and transfers outside of a Context (e.g. reader input), are still allowed.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class MATH_API DeviceTransferMonitor
+{
+public:
+    enum Mode
+    {
+        off,    // nothing is recorded (default)
+        count,  // every transfer is recorded
+        strict  // as 'count', and implicit transfers inside a Context fail
+    };
+
+    static void SetMode(Mode mode);
+    static Mode GetMode();
+    // parses "off", "count", or "strict"
+    static Mode ParseMode(const std::wstring& mode);
+
+    // the node (or other unit of work) that the transfers on this thread are attributed to while the Context exists
+    // Does nothing if monitoring is off.
+    class MATH_API Context
+    {
+    public:
+        Context(const std::wstring& nodeName, const std::wstring& operationName)
+            : m_outer(nullptr), m_active(false)
+        {
+            if (GetMode() != off)
+                Begin(nodeName, operationName);
+        }
+        // for a ComputationNode; NodeName() and OperationName() are only called if monitoring is on
+        template <class Node>
+        explicit Context(const Node& node)
+            : m_outer(nullptr), m_active(false)
+        {
+            if (GetMode() != off)
+                Begin(node.NodeName(), node.OperationName());
+        }
+        ~Context();
+
+    private:
+        void Begin(const std::wstring& nodeName, const std::wstring& operationName);
+
+        std::wstring m_nodeName;
+        std::wstring m_operationName;
+        Context* m_outer;
+        bool m_active;
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        friend class DeviceTransferMonitor;
+    };
+
+    // called by Matrix for every transfer that copies 'bytes' bytes of data; device ids < 0 denote the CPU
+    static void RecordTransfer(int fromDeviceId, int toDeviceId, size_t bytes, bool isExplicit);
+
+    // prints the transfers sorted by bytes, at most 'maxEntries' of them individually
+    // 'title' goes into the header line, e.g. "Epoch[3]".
+    static void PrintSummary(FILE* f, const std::string& title, size_t maxEntries = 30);
+    static void Reset();
+};
+
+} } }
@@ -75,6 +75,12 @@ cudaStream_t GPUDataTransferer<ElemType>::GetFetchStream()
     return m_fetchStream;
 }
 
+template <class ElemType>
+cudaStream_t GPUDataTransferer<ElemType>::GetAssignStream()
+{
+    return m_assignStream;
+}
+
 template <class ElemType>
 GPUDataTransferer<ElemType>::GPUDataTransferer(int deviceId, bool useConcurrentStreams)
     : m_deviceId(deviceId)
@@ -136,6 +142,14 @@ void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsync()
     SyncEvent(m_assignCompleteEvent);
 }
 
+template <class ElemType>
+void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsyncOnComputeStream()
+{
+    PrepareDevice(m_deviceId);
+
+    cudaStreamWaitEvent(GetStream(), m_assignCompleteEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+}
+
 //explicit
 template class GPUDataTransferer<float>;
 template class GPUDataTransferer<double>;
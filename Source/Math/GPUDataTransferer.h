@@ -36,9 +36,12 @@ public:
 
     void CopyCPUToGPUAsync(ElemType* cpuBuffer, size_t numElements, ElemType* gpuBuffer);
     void WaitForCopyCPUToGPUAsync();
+    // makes the main compute stream wait for the last CopyCPUToGPUAsync(), without blocking the host
+    void WaitForCopyCPUToGPUAsyncOnComputeStream();
 
 #ifndef CPUONLY
     static cudaStream_t GetFetchStream();
+    static cudaStream_t GetAssignStream();
 #endif // !CPUONLY
 
 private:
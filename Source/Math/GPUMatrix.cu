@@ -14,6 +14,8 @@
 #include "GPUSparseMatrix.h"
 #include "GPUTensor.h"
 #include "CommonMatrix.h"
+#include "CUDACachingMemAllocator.h"
+#include "MemoryAccounting.h"
 #define TENSOR_OPS_DECL __device__ __host__
 #include "TensorOps.h"
 #include "device_launch_parameters.h"
@@ -24,6 +26,9 @@
 #include "cublas_v2.h"
 #include <assert.h>
 #include <memory>
+#include <map>
+#include <set>
+#include <mutex>
 
 #pragma comment(lib, "cudart.lib") // instruct linker to reference these libs
 #pragma comment(lib, "cublas.lib")
@@ -44,9 +49,11 @@ bool do_sync = true;
 
 #define UNCONST(t, c, uc) GPUMatrix<t>& uc = const_cast<GPUMatrix<t>&>(c);
 
-#ifdef _WIN32
 // thread local storage to access the current stream, initalize to default stream
+#ifdef _WIN32
 __declspec(thread)
+#else
+__thread
 #endif
     cudaStream_t t_stream = cudaStreamDefault;
 
@@ -163,8 +170,11 @@ AllocatedElemType* TracingGPUMemoryAllocator::Allocate(int deviceId, size_t numE
 template <typename AllocatedElemType>
 void TracingGPUMemoryAllocator::Free(int deviceId, AllocatedElemType* bufferPtr, bool ignoreCUDARetCode /*= false*/)
 {
+    MemoryAccounting::RecordFree(bufferPtr);
     PrepareDevice(deviceId);
-    if (ignoreCUDARetCode)
+    if (IsCachingEnabled())
+        CUDACachingMemAllocator::ForDevice(deviceId).Free((void*) bufferPtr); // no cudaFree() here; the buffer stays with the cache
+    else if (ignoreCUDARetCode)
         cudaFree((void*) bufferPtr);
     else
         CUDA_CALL(cudaFree((void*) bufferPtr));
@@ -183,8 +193,31 @@ AllocatedElemType* TracingGPUMemoryAllocator::AllocateNoTrace(int deviceId, size
     AllocatedElemType* deviceBufferPtr;
 
     PrepareDevice(deviceId);
-    CUDA_CALL(cudaMalloc((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements));
+    if (IsCachingEnabled())
+        deviceBufferPtr = (AllocatedElemType*) CUDACachingMemAllocator::ForDevice(deviceId).Malloc(sizeof(AllocatedElemType) * numElements); // (reports running out of memory itself)
+    else if (IsManagedMemoryEnabled())
+    {
+        // The pages that the driver moves to the host stay mapped into the device, so that a buffer demoted to the host
+        // (see GPUMatrix::PrefetchManaged()) is read from there where it was not prefetched, rather than faulted back page by page.
+        deviceBufferPtr = nullptr;
+        if (numElements > 0) // (cudaMallocManaged() rejects empty buffers)
+        {
+            cudaError_t rc = cudaMallocManaged((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements, cudaMemAttachGlobal);
+            if (rc == cudaErrorMemoryAllocation)
+                MemoryAccounting::ReportOutOfMemory(deviceId, sizeof(AllocatedElemType) * numElements);
+            CUDA_CALL(rc);
+            CUDA_CALL(cudaMemAdvise(deviceBufferPtr, sizeof(AllocatedElemType) * numElements, cudaMemAdviseSetAccessedBy, deviceId));
+        }
+    }
+    else
+    {
+        cudaError_t rc = cudaMalloc((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements);
+        if (rc == cudaErrorMemoryAllocation)
+            MemoryAccounting::ReportOutOfMemory(deviceId, sizeof(AllocatedElemType) * numElements);
+        CUDA_CALL(rc);
+    }
 
+    MemoryAccounting::RecordAllocation(deviceId, deviceBufferPtr, sizeof(AllocatedElemType) * numElements);
     return deviceBufferPtr;
 }
 
@@ -328,6 +361,26 @@ void GPUMatrix<ElemType>::CopySection(size_t numRows, size_t numCols, ElemType*
     CUBLAS_CALL(cublasGetMatrix((int) numRows, (int) numCols, sizeof(ElemType),
                                 m_pArray, (int) GetNumRows(), dst, (int) colStride));
 }
+
+template <typename ElemType>
+void GPUMatrix<ElemType>::RecordStreamUse(cudaStream_t stream) const
+{
+    // views (e.g. column slices) point into their parent's buffer; the allocator only knows buffers by their start
+    if (OwnBuffer() && m_pArray != nullptr)
+        CUDACachingMemAllocator::ForDevice(m_computeDevice).RecordStream(m_pArray, stream);
+}
+// unified memory (see TracingGPUMemoryAllocator::SetManagedMemoryEnabled()): queues the migration of the elements to this matrix's
+// device, or to the host, on the current stream. The host does not wait for it.
+template <class ElemType>
+void GPUMatrix<ElemType>::PrefetchManaged(bool toDevice) const
+{
+    if (!TracingGPUMemoryAllocator::IsManagedMemoryEnabled() || m_pArray == nullptr || BufferSize() == 0)
+        return;
+    PrepareDevice();
+    if (cudaMemPrefetchAsync(m_pArray, BufferSize(), toDevice ? m_computeDevice : cudaCpuDeviceId, t_stream) != cudaSuccess)
+        cudaGetLastError(); // (not managed memory, e.g. an external buffer; a hint only)
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::ChangeDeviceTo(DEVICEID_TYPE to_id)
 {
@@ -581,7 +634,7 @@ std::unique_ptr<GPUMatrix<ElemType>> GPUMatrix<ElemType>::GetOrCreateWorkspace()
 {
     // REVIEW alexeyk: not thread-safe, fine for now.
     if (m_workspace == nullptr)
-        m_workspace = std::make_unique<conc_stack<std::unique_ptr<GPUMatrix<ElemType>>>>();
+        m_workspace = std::make_unique<conc_pool<std::unique_ptr<GPUMatrix<ElemType>>>>();
     assert(m_workspace != nullptr);
     auto deviceId = m_computeDevice;
     return m_workspace->pop_or_create([deviceId]()
@@ -682,6 +735,118 @@ void GPUMatrix<ElemType>::CopyColumnsStrided(const GPUMatrix<ElemType>& fromMatr
     }
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignGatheredColumnsOf(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& columnIndices)
+{
+    Resize(a.GetNumRows(), columnIndices.GetNumCols());
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    if (N == 0)
+        return *this;
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _assignGatheredColumnsOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, a.m_pArray, columnIndices.m_pArray, N, (CUDA_LONG) m_numRows);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddScatteredColumnsOf(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& columnIndices)
+{
+    CUDA_LONG N = (CUDA_LONG) a.GetNumElements();
+    if (N == 0)
+        return *this;
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _addScatteredColumnsOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, a.m_pArray, columnIndices.m_pArray, N, (CUDA_LONG) m_numRows);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedHalfOf(const GPUMatrix<ElemType>& a, HalfFormat format)
+{
+    const size_t packedRows = (a.GetNumRows() * 2 + sizeof(ElemType) - 1) / sizeof(ElemType);
+    const CUDA_LONG halvesPerColumn = (CUDA_LONG) (packedRows * sizeof(ElemType) / 2);
+    Resize(packedRows, a.GetNumCols());
+    CUDA_LONG N = halvesPerColumn * (CUDA_LONG) a.GetNumCols();
+    if (N == 0)
+        return *this;
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _assignPackedHalfOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>((unsigned short*) m_pArray, a.m_pArray, N, (CUDA_LONG) a.GetNumRows(), halvesPerColumn, format);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignUnpackedHalfOf(const GPUMatrix<ElemType>& packed, size_t numRows, HalfFormat format)
+{
+    const CUDA_LONG halvesPerColumn = (CUDA_LONG) (packed.GetNumRows() * sizeof(ElemType) / 2);
+    Resize(numRows, packed.GetNumCols());
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    if (N == 0)
+        return *this;
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _assignUnpackedHalfOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, (const unsigned short*) packed.m_pArray, N, (CUDA_LONG) numRows, halvesPerColumn, format);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignAliasSamplesOf(const GPUMatrix<ElemType>& aliasTable, const GPUMatrix<ElemType>& uniforms)
+{
+    CUDA_LONG k = (CUDA_LONG) uniforms.GetNumCols();
+    Resize(1, k);
+    if (k == 0)
+        return *this;
+    int blocksPerGrid = (int) ceil(1.0 * k / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _assignAliasSamplesOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, aliasTable.m_pArray, uniforms.m_pArray, (CUDA_LONG) aliasTable.GetNumCols(), k);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return *this;
+}
+
 //for each column of a, we assign all rows of a to this starting from startIndex
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignToRowSliceValuesOf(const GPUMatrix<ElemType>& a, const size_t startIndex, const size_t numRows)
@@ -916,6 +1081,38 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddToRowRepeatValuesOf(const GPUMatrix
     return *this;
 }
 
+// The block of packed images is copied to the device as a whole (it is in page-locked memory if the reader allocates
+// its buffers through CudaMemoryProvider), and each thread then computes one value of the output.
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedImages(const void* packedImages)
+{
+    const auto* header = reinterpret_cast<const PackedImagesHeader*>(packedImages);
+    const size_t m = (size_t) header->m_width * header->m_height * header->m_channels;
+    Resize(m, header->m_numImages);
+    if (IsEmpty())
+        return *this;
+
+    PrepareDevice();
+    char* d_packedImages = TracingGPUMemoryAllocator::Allocate<char>(m_computeDevice, header->m_totalSize);
+    CUDA_CALL(cudaMemcpy(d_packedImages, packedImages, header->m_totalSize, cudaMemcpyHostToDevice));
+
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _assignPackedImages<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, reinterpret_cast<const PackedImagesHeader*>(d_packedImages), N, (CUDA_LONG) m);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    TracingGPUMemoryAllocator::Free<char>(m_computeDevice, d_packedImages); // (the kernel is ordered before any later use of the memory)
+
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPositiveAndShiftedNegSample(const GPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber)
 {
@@ -1170,6 +1367,70 @@ void GPUMatrix<ElemType>::SetValue(const GPUMatrix<ElemType>& deepCopyFrom)
         CUDA_CALL(cudaMemcpy(m_pArray, deepCopyFrom.m_pArray, cpSize * sizeof(ElemType), cudaMemcpyDeviceToDevice));
 }
 
+// enable direct access of 'toId' to the memory of 'fromId' once per pair of devices, where the hardware supports it
+// Without it, copies between the two devices are staged through host memory by the driver.
+static void EnablePeerAccess(DEVICEID_TYPE fromId, DEVICEID_TYPE toId)
+{
+    static std::mutex s_mutex;
+    static std::set<std::pair<DEVICEID_TYPE, DEVICEID_TYPE>> s_checked;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_checked.insert(std::make_pair(fromId, toId)).second)
+        return;
+
+    int canAccessPeer = 0;
+    CUDA_CALL(cudaDeviceCanAccessPeer(&canAccessPeer, toId, fromId));
+    if (!canAccessPeer)
+    {
+        fprintf(stderr, "EnablePeerAccess: GPU %d cannot access the memory of GPU %d directly; copies between them go through host memory.\n", (int) toId, (int) fromId);
+        return;
+    }
+    Microsoft::MSR::CNTK::PrepareDevice(toId);
+    cudaError_t err = cudaDeviceEnablePeerAccess(fromId, 0);
+    if (err == cudaErrorPeerAccessAlreadyEnabled)
+        cudaGetLastError(); // clear the error state
+    else
+        CUDA_CALL(err);
+}
+
+// copy deepCopyFrom, which lives on a different GPU, into this matrix without moving this matrix
+// The copy is queued on the current stream of this matrix's device and is ordered after all work queued on deepCopyFrom's device
+// so far; work queued on deepCopyFrom's device afterwards waits for the copy, so deepCopyFrom may be overwritten right away.
+// The host does not wait for the copy.
+template <class ElemType>
+void GPUMatrix<ElemType>::SetValueFromPeer(const GPUMatrix<ElemType>& deepCopyFrom)
+{
+    const DEVICEID_TYPE fromId = deepCopyFrom.GetComputeDeviceId();
+    const DEVICEID_TYPE toId = GetComputeDeviceId();
+    if (fromId == toId)
+        return SetValue(deepCopyFrom);
+
+    EnablePeerAccess(fromId, toId);
+    Resize(deepCopyFrom.GetNumRows(), deepCopyFrom.GetNumCols());
+    m_format = deepCopyFrom.m_format;
+    size_t cpSize = deepCopyFrom.GetNumRows() * deepCopyFrom.GetNumCols();
+    if (cpSize == 0)
+        return;
+
+    cudaEvent_t sourceReady, copyDone;
+    Microsoft::MSR::CNTK::PrepareDevice(fromId);
+    CUDA_CALL(cudaEventCreateWithFlags(&sourceReady, cudaEventDisableTiming));
+    CUDA_CALL(cudaEventRecord(sourceReady, t_stream));
+
+    Microsoft::MSR::CNTK::PrepareDevice(toId);
+    CUDA_CALL(cudaEventCreateWithFlags(&copyDone, cudaEventDisableTiming));
+    CUDA_CALL(cudaStreamWaitEvent(t_stream, sourceReady, 0));
+    CUDA_CALL(cudaMemcpyPeerAsync(m_pArray, toId, deepCopyFrom.m_pArray, fromId, cpSize * sizeof(ElemType), t_stream));
+    CUDA_CALL(cudaEventRecord(copyDone, t_stream));
+
+    Microsoft::MSR::CNTK::PrepareDevice(fromId);
+    CUDA_CALL(cudaStreamWaitEvent(t_stream, copyDone, 0));
+
+    // events may be destroyed while still pending; their resources are released once they complete
+    CUDA_CALL(cudaEventDestroy(sourceReady));
+    CUDA_CALL(cudaEventDestroy(copyDone));
+    Microsoft::MSR::CNTK::PrepareDevice(toId);
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, size_t matrixFlags)
 {
@@ -1371,6 +1632,47 @@ void GPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
         CUDA_CALL(cudaEventDestroy(done));
 }
 
+// see Matrix<ElemType>::SetPhiloxUniformRandomValue() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::SetPhiloxRandomValue(const bool gaussian, const ElemType a, const ElemType b, unsigned long seed)
+{
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil((N + 3) / 4 / (double) GridDim::maxThreadsPerBlock);
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _setPhiloxRandomValue<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, N, gaussian, a, b, seed);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::AssignDropoutOf() for comments
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::ScaleAndAddDropoutOf(const ElemType beta, const GPUMatrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset)
+{
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    const size_t numBlocksOf4 = (offset + N + 3) / 4 - offset / 4;
+    int blocksPerGrid = (int) ceil(numBlocksOf4 / (double) GridDim::maxThreadsPerBlock);
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _scaleAndAddDropoutOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(beta, a.m_pArray, m_pArray, N, dropoutRate, (ElemType)(1 / (1 - (double) dropoutRate)),
+                                                                                                 seed, stream, offset);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return *this;
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1437,6 +1739,26 @@ void GPUMatrix<ElemType>::FSAdagrad(GPUMatrix<ElemType>& gradients,
                                                                          learnRatePerSample, momentum, adaWeight, adaMul);
 }
 
+// Adam, see Matrix::Adam() and Matrix::Lamb(); this = [first moments, second moments]
+template <class ElemType>
+void GPUMatrix<ElemType>::Adam(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+                              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+    size_t numColsNeeded = 2 * gradients.GetNumCols();
+    if (IsEmpty() || (GetNumCols() < numColsNeeded))
+    {
+        Resize(gradients.GetNumRows(), numColsNeeded);
+        SetValue(0.0);
+    }
+
+    assert((GetNumRows() == gradients.GetNumRows()) && (GetNumCols() == numColsNeeded));
+
+    size_t n = gradients.GetNumElements();
+    int blocksPerGrid = (n + GridDim::maxThreadsPerBlock - 1) / GridDim::maxThreadsPerBlock;
+    _adam<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(n, gradients.m_pArray, m_pArray, m_pArray + n, functionValues.m_pArray,
+                                                                                 learnRatePerSample, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& gradients,
                                       ElemType RMS_GAMMA,
@@ -3105,6 +3427,19 @@ void GPUMatrix<ElemType>::VectorMax(GPUMatrix<ElemType>& maxIndexes, GPUMatrix<E
     maxValues.Resize(topK, n);
     maxIndexes.Resize(topK, n);
 
+    // A small k (an n-best list, a beam) is selected by one pass over each column.
+    if (topK <= maxSmallTopK)
+    {
+        _vectorTopK<ElemType><<<n, topKThreadsPerBlock, 0, t_stream>>>(us.m_pArray, maxIndexes.m_pArray, maxValues.m_pArray, m, topK);
+        if (do_sync)
+            CUDA_CALL(cudaEventRecord(done));
+        if (do_sync)
+            CUDA_CALL(cudaEventSynchronize(done));
+        if (do_sync)
+            CUDA_CALL(cudaEventDestroy(done));
+        return;
+    }
+
     // To sort matrix columns we use 2-pass _stable_ sort algorithm:
     // 1. Sort by values (descending) with corresponding row/col indexes.
     // 2. Sort by col indices (ascending) with corresponding values/row indices.
@@ -3496,6 +3831,15 @@ static cublasStatus_t cublas_gemm(cublasHandle_t handle, cublasOperation_t trans
 {
     return cublasDgemm(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
 }
+// float/double overloads of cublasSgemmBatched()/cublasDgemmBatched()
+static cublasStatus_t cublas_gemmBatched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const float* alpha, const float* A[], int lda, const float* B[], int ldb, const float* beta, float* C[], int ldc, int batchCount)
+{
+    return cublasSgemmBatched(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, batchCount);
+}
+static cublasStatus_t cublas_gemmBatched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const double* alpha, const double* A[], int lda, const double* B[], int ldb, const double* beta, double* C[], int ldc, int batchCount)
+{
+    return cublasDgemmBatched(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, batchCount);
+}
 static cublasStatus_t cublas_axpy(cublasHandle_t handle, int n, const float* alpha, const float* x, int incx, float* y, int incy)
 {
     return cublasSaxpy(handle, n, alpha, x, incx, y, incy);
@@ -3505,6 +3849,82 @@ static cublasStatus_t cublas_axpy(cublasHandle_t handle, int n, const double* al
     return cublasDaxpy(handle, n, alpha, x, incx, y, incy);
 }
 
+static bool s_fp16GEMMEnabled = false;
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetFP16GEMMEnabled(bool enabled)
+{
+    if (enabled && sizeof(ElemType) != sizeof(float))
+        InvalidArgument("FP16 GEMM is only supported with precision 'float'.");
+    s_fp16GEMMEnabled = enabled;
+}
+
+template <class ElemType>
+bool GPUMatrix<ElemType>::IsFP16GEMMEnabled()
+{
+    return s_fp16GEMMEnabled;
+}
+
+// FP16 GEMM: the operands are rounded to half precision into per-device scratch buffers (grown as needed), and cublasSgemmEx()
+// multiplies them, accumulating and storing the result in single precision.
+// Returns false if the device has no fast FP16 math, in which case the caller falls back to cublas_gemm().
+static bool cublas_gemm_fp16(int deviceId, cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const float* alpha,
+                             const float* A, size_t numElementsA, int lda, const float* B, size_t numElementsB, int ldb, const float* beta, float* C, int ldc)
+{
+    struct HalfScratchBuffers
+    {
+        bool supported;
+        __half* buffers[2];
+        size_t sizes[2];
+    };
+    static std::map<int, HalfScratchBuffers> s_scratch;
+
+    auto iter = s_scratch.find(deviceId);
+    if (iter == s_scratch.end())
+    {
+        cudaDeviceProp props;
+        CUDA_CALL(cudaGetDeviceProperties(&props, deviceId));
+        HalfScratchBuffers scratch = {};
+        scratch.supported = (props.major > 5) || (props.major == 5 && props.minor >= 3);
+        if (!scratch.supported)
+            fprintf(stderr, "FP16 GEMM: GPU %d (compute capability %d.%d) has no fast FP16 math, using single precision.\n", deviceId, props.major, props.minor);
+        iter = s_scratch.insert(std::make_pair(deviceId, scratch)).first;
+    }
+
+    HalfScratchBuffers& scratch = iter->second;
+    if (!scratch.supported)
+        return false;
+
+    const float* operands[2] = {A, B};
+    const size_t numElements[2] = {numElementsA, numElementsB};
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (scratch.sizes[i] < numElements[i])
+        {
+            if (scratch.buffers[i] != nullptr)
+                CUDA_CALL(cudaFree(scratch.buffers[i]));
+            CUDA_CALL(cudaMalloc((void**) &scratch.buffers[i], sizeof(__half) * numElements[i]));
+            scratch.sizes[i] = numElements[i];
+        }
+
+        CUDA_LONG N = (CUDA_LONG) numElements[i];
+        int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+        _convertFloatToHalf<<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(operands[i], scratch.buffers[i], N);
+    }
+
+#if CUDA_VERSION >= 8000
+    CUBLAS_CALL(cublasSgemmEx(handle, transa, transb, m, n, k, alpha, scratch.buffers[0], CUDA_R_16F, lda, scratch.buffers[1], CUDA_R_16F, ldb, beta, C, CUDA_R_32F, ldc));
+#else
+    CUBLAS_CALL(cublasSgemmEx(handle, transa, transb, m, n, k, alpha, scratch.buffers[0], CUBLAS_DATA_HALF, lda, scratch.buffers[1], CUBLAS_DATA_HALF, ldb, beta, C, CUBLAS_DATA_FLOAT, ldc));
+#endif
+    return true;
+}
+static bool cublas_gemm_fp16(int, cublasHandle_t, cublasOperation_t, cublasOperation_t, int, int, int, const double*,
+                             const double*, size_t, int, const double*, size_t, int, const double*, double*, int)
+{
+    return false; // (SetFP16GEMMEnabled() rejects double)
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB,
                                                  ElemType beta, GPUMatrix<ElemType>& c)
@@ -3530,11 +3950,177 @@ void GPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix
         RuntimeError("!(m>0 && k>0 && l>0 && n>0)"); // converting from size_t to int may cause overflow
     if (k != l)
         RuntimeError("matrix dim mismatch in MultiplyAndWeightedAdd");
-    CUBLAS_CALL(cublas_gemm(cuHandle, transA, transB, m, n, k, &alpha, a.m_pArray, (int) a.m_numRows, b.m_pArray, (int) b.m_numRows, &beta, c.m_pArray, (int) c.m_numRows));
+    if (!s_fp16GEMMEnabled ||
+        !cublas_gemm_fp16(b.GetComputeDeviceId(), cuHandle, transA, transB, m, n, k, &alpha, a.m_pArray, a.GetNumElements(), (int) a.m_numRows, b.m_pArray, b.GetNumElements(), (int) b.m_numRows, &beta, c.m_pArray, (int) c.m_numRows))
+    {
+        CUBLAS_CALL(cublas_gemm(cuHandle, transA, transB, m, n, k, &alpha, a.m_pArray, (int) a.m_numRows, b.m_pArray, (int) b.m_numRows, &beta, c.m_pArray, (int) c.m_numRows));
+    }
     c.m_numRows = m;
     c.m_numCols = n;
 }
 
+// device buffers for the pointer arrays of batched GEMMs, one per GPU and stream (products on concurrent streams, see
+// ComputeStreams, must not share one); grown as needed and never freed
+static std::map<std::pair<int, cudaStream_t>, std::pair<void*, size_t>> s_gemmBatchedPointers; // [(deviceId, stream)] -> (buffer, bytes)
+
+// c[i] = alpha * op(a[i]) * op(b[i]) + beta * c[i] for all i in a single cublas call; all products must have the same dimensions
+template <class ElemType>
+void GPUMatrix<ElemType>::MultiplyAndWeightedAddBatched(ElemType alpha, const std::vector<const GPUMatrix<ElemType>*>& a, const bool transposeA, const std::vector<const GPUMatrix<ElemType>*>& b, const bool transposeB,
+                                                        ElemType beta, const std::vector<GPUMatrix<ElemType>*>& c)
+{
+    const size_t batchSize = c.size();
+    if (a.size() != batchSize || b.size() != batchSize)
+        InvalidArgument("MultiplyAndWeightedAddBatched: There must be as many left and right factors as results.");
+    if (batchSize == 0)
+        return;
+
+    a[0]->PrepareDevice();
+    const int deviceId = a[0]->GetComputeDeviceId();
+    const size_t rowsA = a[0]->m_numRows, colsA = a[0]->m_numCols, rowsB = b[0]->m_numRows, colsB = b[0]->m_numCols;
+    int m = int(transposeA ? colsA : rowsA);
+    int n = int(transposeB ? rowsB : colsB);
+    int k = int(transposeA ? rowsA : colsA);
+    int l = int(transposeB ? colsB : rowsB);
+    if (!(m > 0 && k > 0 && l > 0 && n > 0))
+        RuntimeError("!(m>0 && k>0 && l>0 && n>0)"); // converting from size_t to int may cause overflow
+    if (k != l)
+        RuntimeError("matrix dim mismatch in MultiplyAndWeightedAddBatched");
+
+    // pointer arrays [a[0..], b[0..], c[0..]]
+    std::vector<ElemType*> pointers(3 * batchSize);
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        if (a[i]->GetComputeDeviceId() != deviceId || b[i]->GetComputeDeviceId() != deviceId || c[i]->GetComputeDeviceId() != deviceId)
+            InvalidArgument("All matrices must be on the same GPU");
+        if (a[i]->m_numRows != rowsA || a[i]->m_numCols != colsA || b[i]->m_numRows != rowsB || b[i]->m_numCols != colsB)
+            InvalidArgument("MultiplyAndWeightedAddBatched: All products must have the same dimensions.");
+        if (beta == 0)
+            c[i]->Resize(m, n);
+        else
+            c[i]->VerifySize(m, n); // Can't resize if beta != 0
+        pointers[i] = a[i]->m_pArray;
+        pointers[batchSize + i] = b[i]->m_pArray;
+        pointers[2 * batchSize + i] = c[i]->m_pArray;
+    }
+
+    // Reusing the device buffer is safe since the copy and the GEMM are queued on the same stream.
+    const size_t numBytes = pointers.size() * sizeof(ElemType*);
+    auto& buffer = s_gemmBatchedPointers[std::make_pair(deviceId, t_stream)];
+    if (buffer.second < numBytes)
+    {
+        if (buffer.first)
+            CUDA_CALL(cudaFree(buffer.first)); // (synchronizes the device, so no GEMM still uses it)
+        CUDA_CALL(cudaMalloc(&buffer.first, numBytes));
+        buffer.second = numBytes;
+    }
+    ElemType** devicePointers = (ElemType**) buffer.first;
+    CUDA_CALL(cudaMemcpyAsync(devicePointers, pointers.data(), numBytes, cudaMemcpyHostToDevice, t_stream));
+
+    cublasHandle_t cuHandle = GetCublasHandle(deviceId);
+    cublasOperation_t transA = transposeA ? CUBLAS_OP_T : CUBLAS_OP_N;
+    cublasOperation_t transB = transposeB ? CUBLAS_OP_T : CUBLAS_OP_N;
+    CUBLAS_CALL(cublas_gemmBatched(cuHandle, transA, transB, m, n, k, &alpha, (const ElemType**) devicePointers, (int) rowsA, (const ElemType**) (devicePointers + batchSize), (int) rowsB,
+                                   &beta, devicePointers + 2 * batchSize, (int) c[0]->m_numRows, (int) batchSize));
+}
+
+// device buffers for the tables of the multi-tensor kernels, like s_gemmBatchedPointers
+static std::map<std::pair<int, cudaStream_t>, std::pair<void*, size_t>> s_multiTensorTables; // [(deviceId, stream)] -> (buffer, bytes)
+static const CUDA_LONG s_multiTensorChunkSize = 65536;                                        // elements per block
+
+// splits the tensors into chunks and copies the descriptors and the chunk table to the device, followed by
+// 'bytesPerChunk' of room for the results of each chunk; returns the device buffer: [descriptors][chunks][results]
+template <class ElemType>
+static char* UploadMultiTensorTable(int deviceId, const std::vector<MultiTensorDescriptor<ElemType>>& tensors, std::vector<MultiTensorChunk>& chunks, size_t bytesPerChunk)
+{
+    chunks.clear();
+    for (size_t i = 0; i < tensors.size(); i++)
+        for (CUDA_LONG begin = 0; begin < tensors[i].numElements; begin += s_multiTensorChunkSize)
+            chunks.push_back(MultiTensorChunk{(int) i, begin});
+
+    const size_t tensorBytes = tensors.size() * sizeof(MultiTensorDescriptor<ElemType>);
+    const size_t chunkBytes = chunks.size() * sizeof(MultiTensorChunk);
+    const size_t numBytes = tensorBytes + chunkBytes + chunks.size() * bytesPerChunk;
+    auto& buffer = s_multiTensorTables[std::make_pair(deviceId, t_stream)];
+    if (buffer.second < numBytes)
+    {
+        if (buffer.first)
+            CUDA_CALL(cudaFree(buffer.first)); // (synchronizes the device, so no kernel still uses it)
+        CUDA_CALL(cudaMalloc(&buffer.first, numBytes));
+        buffer.second = numBytes;
+    }
+    char* table = (char*) buffer.first;
+    CUDA_CALL(cudaMemcpyAsync(table, tensors.data(), tensorBytes, cudaMemcpyHostToDevice, t_stream));
+    CUDA_CALL(cudaMemcpyAsync(table + tensorBytes, chunks.data(), chunkBytes, cudaMemcpyHostToDevice, t_stream));
+    return table;
+}
+
+// sumsOfSquares[i] = the squared Frobenius norm of matrices[i], for all i in a single reduction
+template <class ElemType>
+void GPUMatrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const GPUMatrix<ElemType>*>& matrices, std::vector<double>& sumsOfSquares)
+{
+    sumsOfSquares.assign(matrices.size(), 0);
+    if (matrices.empty())
+        return;
+
+    const int deviceId = matrices[0]->GetComputeDeviceId();
+    matrices[0]->PrepareDevice();
+    std::vector<MultiTensorDescriptor<ElemType>> tensors(matrices.size());
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+        if (matrices[i]->GetComputeDeviceId() != deviceId)
+            InvalidArgument("All matrices must be on the same GPU");
+        if (matrices[i]->GetNumElements() > (size_t) std::numeric_limits<CUDA_LONG>::max())
+            InvalidArgument("MultiTensorSumOfSquares: Matrix too large.");
+        tensors[i] = MultiTensorDescriptor<ElemType>{nullptr, matrices[i]->m_pArray, nullptr, (CUDA_LONG) matrices[i]->GetNumElements(), 1};
+    }
+
+    std::vector<MultiTensorChunk> chunks;
+    char* table = UploadMultiTensorTable(deviceId, tensors, chunks, sizeof(double));
+    if (chunks.empty())
+        return;
+    auto* deviceTensors = (const MultiTensorDescriptor<ElemType>*) table;
+    auto* deviceChunks = (const MultiTensorChunk*) (table + tensors.size() * sizeof(MultiTensorDescriptor<ElemType>));
+    double* devicePartialSums = (double*) (deviceChunks + chunks.size());
+    _multiTensorSumOfSquares<GridDim::maxThreadsPerBlock, ElemType><<<(unsigned int) chunks.size(), GridDim::maxThreadsPerBlock, 0, t_stream>>>(deviceTensors, deviceChunks, s_multiTensorChunkSize, devicePartialSums);
+
+    std::vector<double> partialSums(chunks.size());
+    CUDA_CALL(cudaMemcpyAsync(partialSums.data(), devicePartialSums, partialSums.size() * sizeof(double), cudaMemcpyDeviceToHost, t_stream));
+    CUDA_CALL(cudaStreamSynchronize(t_stream));
+    for (size_t k = 0; k < chunks.size(); k++)
+        sumsOfSquares[chunks[k].tensor] += partialSums[k];
+}
+
+// the SGD update of all weights[i] in a single launch, see Matrix::MultiTensorSGDUpdate()
+template <class ElemType>
+void GPUMatrix<ElemType>::MultiTensorSGDUpdate(const std::vector<GPUMatrix<ElemType>*>& weights, const std::vector<const GPUMatrix<ElemType>*>& gradients, const std::vector<GPUMatrix<ElemType>*>& smoothedGradients,
+                                               const std::vector<ElemType>& gradientScales, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                               const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad)
+{
+    if (weights.empty())
+        return;
+
+    const int deviceId = weights[0]->GetComputeDeviceId();
+    weights[0]->PrepareDevice();
+    std::vector<MultiTensorDescriptor<ElemType>> tensors(weights.size());
+    for (size_t i = 0; i < weights.size(); i++)
+    {
+        if (weights[i]->GetComputeDeviceId() != deviceId || gradients[i]->GetComputeDeviceId() != deviceId || smoothedGradients[i]->GetComputeDeviceId() != deviceId)
+            InvalidArgument("All matrices must be on the same GPU");
+        if (weights[i]->GetNumElements() > (size_t) std::numeric_limits<CUDA_LONG>::max())
+            InvalidArgument("MultiTensorSGDUpdate: Matrix too large.");
+        tensors[i] = MultiTensorDescriptor<ElemType>{weights[i]->m_pArray, gradients[i]->m_pArray, smoothedGradients[i]->m_pArray, (CUDA_LONG) weights[i]->GetNumElements(), gradientScales[i]};
+    }
+
+    std::vector<MultiTensorChunk> chunks;
+    char* table = UploadMultiTensorTable(deviceId, tensors, chunks, 0);
+    if (chunks.empty())
+        return;
+    auto* deviceTensors = (const MultiTensorDescriptor<ElemType>*) table;
+    auto* deviceChunks = (const MultiTensorChunk*) (table + tensors.size() * sizeof(MultiTensorDescriptor<ElemType>));
+    _multiTensorSGDUpdate<ElemType><<<(unsigned int) chunks.size(), GridDim::maxThreadsPerBlock, 0, t_stream>>>(deviceTensors, deviceChunks, s_multiTensorChunkSize,
+                                                                                                               truncation, l2RegWeight, learnRatePerSample, momentum, useNesterovMomentum, useAdaGrad);
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, ElemType beta, GPUMatrix<ElemType>& c)
 {
@@ -4265,6 +4851,351 @@ void GPUMatrix<ElemType>::TensorShuffleScaleAndAdd(ElemType keepWeight, const GP
         CUDA_CALL(cudaEventDestroy(done));
 }
 
+// see Matrix<ElemType>::LSTMPointwiseForward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMPointwiseForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& prevCell, const GPUMatrix<ElemType>* peepholes, GPUMatrix<ElemType>& cell, GPUMatrix<ElemType>& output)
+{
+    CUDA_LONG H = (CUDA_LONG) cell.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) cell.GetNumElements();
+    gates.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _lstmPointwiseForward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(gates.m_pArray, prevCell.m_pArray, peepholes ? peepholes->m_pArray : nullptr, cell.m_pArray, output.m_pArray, H, N);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::LSTMPointwiseBackward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMPointwiseBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& cell, const GPUMatrix<ElemType>& prevCell, const GPUMatrix<ElemType>* peepholes, const GPUMatrix<ElemType>& outputGradient,
+                                                GPUMatrix<ElemType>& cellGradient, GPUMatrix<ElemType>& gatesGradient)
+{
+    CUDA_LONG H = (CUDA_LONG) cell.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) cell.GetNumElements();
+    gates.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _lstmPointwiseBackward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(gates.m_pArray, cell.m_pArray, prevCell.m_pArray, peepholes ? peepholes->m_pArray : nullptr, outputGradient.m_pArray, cellGradient.m_pArray, gatesGradient.m_pArray, H, N);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::GRUPointwiseForward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::GRUPointwiseForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& recurrent, const GPUMatrix<ElemType>& prevOutput, GPUMatrix<ElemType>& output)
+{
+    CUDA_LONG H = (CUDA_LONG) output.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) output.GetNumElements();
+    gates.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _gruPointwiseForward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(gates.m_pArray, recurrent.m_pArray, prevOutput.m_pArray, output.m_pArray, H, N);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::GRUPointwiseBackward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::GRUPointwiseBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& recurrent, const GPUMatrix<ElemType>& prevOutput, GPUMatrix<ElemType>& outputGradient,
+                                               GPUMatrix<ElemType>& gatesGradient, GPUMatrix<ElemType>& recurrentGradient)
+{
+    CUDA_LONG H = (CUDA_LONG) prevOutput.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) prevOutput.GetNumElements();
+    gates.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _gruPointwiseBackward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(gates.m_pArray, recurrent.m_pArray, prevOutput.m_pArray, outputGradient.m_pArray, gatesGradient.m_pArray, recurrentGradient.m_pArray, H, N);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CosDistanceWithNegativeSamples() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamples(const GPUMatrix<ElemType>& left, const GPUMatrix<ElemType>& right, size_t shift,
+                                                         GPUMatrix<ElemType>& invNormLeft, GPUMatrix<ElemType>& invNormRight, GPUMatrix<ElemType>& cosDistance)
+{
+    CUDA_LONG D = (CUDA_LONG) left.GetNumRows();
+    CUDA_LONG n = (CUDA_LONG) left.GetNumCols();
+    CUDA_LONG M = (CUDA_LONG) cosDistance.GetNumRows();
+    left.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * n / GridDim::maxThreadsPerBlock);
+    _cosDistanceInvNorms<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(left.m_pArray, right.m_pArray, invNormLeft.m_pArray, invNormRight.m_pArray, D, n);
+    blocksPerGrid = (int) ceil(1.0 * n * M / GridDim::maxThreadsPerBlock);
+    _cosDistanceWithNegativeSamples<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(left.m_pArray, right.m_pArray, invNormLeft.m_pArray, invNormRight.m_pArray, cosDistance.m_pArray,
+                                                                                                          (CUDA_LONG)(shift % n), D, n, M);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(const GPUMatrix<ElemType>& left, const GPUMatrix<ElemType>& right, const GPUMatrix<ElemType>& invNormLeft, const GPUMatrix<ElemType>& invNormRight,
+                                                                 const GPUMatrix<ElemType>& cosDistance, const GPUMatrix<ElemType>& gradient, size_t shift, bool wrtRight, GPUMatrix<ElemType>& inputGradient)
+{
+    CUDA_LONG D = (CUDA_LONG) left.GetNumRows();
+    CUDA_LONG n = (CUDA_LONG) left.GetNumCols();
+    CUDA_LONG M = (CUDA_LONG) cosDistance.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) inputGradient.GetNumElements();
+    left.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _cosDistanceWithNegativeSamplesGradient<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>((wrtRight ? right : left).m_pArray, (wrtRight ? left : right).m_pArray,
+                                                                                                                  (wrtRight ? invNormRight : invNormLeft).m_pArray, (wrtRight ? invNormLeft : invNormRight).m_pArray,
+                                                                                                                  cosDistance.m_pArray, gradient.m_pArray, inputGradient.m_pArray, (CUDA_LONG)(shift % n), wrtRight, D, n, M);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::AttentionForward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::AttentionForward(const GPUMatrix<ElemType>& query, const GPUMatrix<ElemType>& keys, const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                           GPUMatrix<ElemType>& context, GPUMatrix<ElemType>& logSumExp)
+{
+    CUDA_LONG D = (CUDA_LONG) query.GetNumRows();
+    CUDA_LONG Dv = (CUDA_LONG) values.GetNumRows();
+    int blocksPerGrid = (int) query.GetNumCols();
+    query.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _attentionForward<ElemType><<<blocksPerGrid, attentionThreadsPerBlock, 0, t_stream>>>(query.m_pArray, keys.m_pArray, values.m_pArray, keyRanges.m_pArray, (CUDA_LONG) keyStride, scale,
+                                                                                         context.m_pArray, logSumExp.m_pArray, D, Dv);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::AttentionBackward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::AttentionBackward(const GPUMatrix<ElemType>& query, const GPUMatrix<ElemType>& keys, const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                            const GPUMatrix<ElemType>& context, const GPUMatrix<ElemType>& logSumExp, const GPUMatrix<ElemType>& contextGradient,
+                                            GPUMatrix<ElemType>* queryGradient, GPUMatrix<ElemType>* keysGradient, GPUMatrix<ElemType>* valuesGradient)
+{
+    CUDA_LONG D = (CUDA_LONG) query.GetNumRows();
+    CUDA_LONG Dv = (CUDA_LONG) values.GetNumRows();
+    int blocksPerGrid = (int) query.GetNumCols();
+    query.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _attentionBackward<ElemType><<<blocksPerGrid, attentionThreadsPerBlock, 0, t_stream>>>(query.m_pArray, keys.m_pArray, values.m_pArray, keyRanges.m_pArray, (CUDA_LONG) keyStride, scale,
+                                                                                          context.m_pArray, logSumExp.m_pArray, contextGradient.m_pArray,
+                                                                                          queryGradient ? queryGradient->m_pArray : nullptr,
+                                                                                          keysGradient ? keysGradient->m_pArray : nullptr,
+                                                                                          valuesGradient ? valuesGradient->m_pArray : nullptr, D, Dv);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxForward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CrossEntropyWithSoftmaxForward(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& columnLoss)
+{
+    CUDA_LONG M = (CUDA_LONG) logits.GetNumRows();
+    int blocksPerGrid = (int) logits.GetNumCols();
+    logits.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _crossEntropyWithSoftmaxForward<ElemType><<<blocksPerGrid, crossEntropyThreadsPerBlock, 0, t_stream>>>(labels.m_pArray, logits.m_pArray, logSumExp.m_pArray, columnLoss.m_pArray, M);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxBackward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp,
+                                                          GPUMatrix<ElemType>& gradient)
+{
+    CUDA_LONG M = (CUDA_LONG) logits.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) logits.GetNumElements();
+    logits.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _crossEntropyWithSoftmaxBackward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(alpha.m_pArray, labels.m_pArray, logits.m_pArray, logSumExp.m_pArray, gradient.m_pArray, M, N);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::SegmentedLogSoftmax() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::SegmentedLogSoftmax(const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& segments, GPUMatrix<ElemType>& logProbs, GPUMatrix<ElemType>& loss)
+{
+    int blocksPerGrid = (int) segments.GetNumCols();
+    values.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _segmentedLogSoftmax<ElemType><<<blocksPerGrid, crossEntropyThreadsPerBlock, 0, t_stream>>>(values.m_pArray, segments.m_pArray, logProbs.m_pArray, loss.m_pArray);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::SegmentedSoftmaxGradient() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::SegmentedSoftmaxGradient(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& logProbs, const GPUMatrix<ElemType>& segments, ElemType beta, GPUMatrix<ElemType>& gradient)
+{
+    int blocksPerGrid = (int) segments.GetNumCols();
+    logProbs.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _segmentedSoftmaxGradient<ElemType><<<blocksPerGrid, crossEntropyThreadsPerBlock, 0, t_stream>>>(alpha.m_pArray, logProbs.m_pArray, segments.m_pArray, beta, gradient.m_pArray);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::NoiseContrastiveLoss() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::NoiseContrastiveLoss(const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& loss, GPUMatrix<ElemType>& gradient)
+{
+    CUDA_LONG M = (CUDA_LONG) logits.GetNumRows();
+    int blocksPerGrid = (int) logits.GetNumCols();
+    logits.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _noiseContrastiveLoss<ElemType><<<blocksPerGrid, crossEntropyThreadsPerBlock, 0, t_stream>>>(logits.m_pArray, loss.m_pArray, gradient.m_pArray, M);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CRFForward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFForward(const GPUMatrix<ElemType>& labelIds, const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                                     GPUMatrix<ElemType>& logAlpha, GPUMatrix<ElemType>& logPartition, GPUMatrix<ElemType>& loss)
+{
+    CUDA_LONG L = (CUDA_LONG) scores.GetNumRows();
+    int blocksPerGrid = (int) sequences.GetNumCols();
+    scores.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _crfForward<ElemType><<<blocksPerGrid, crfThreadsPerBlock, 0, t_stream>>>(labelIds.m_pArray, scores.m_pArray, transitions.m_pArray, sequences.m_pArray, (CUDA_LONG) stride, L,
+                                                                              logAlpha.m_pArray, logPartition.m_pArray, loss.m_pArray);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CRFBackward() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFBackward(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labelIds, const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                                      const GPUMatrix<ElemType>& logAlpha, const GPUMatrix<ElemType>& logPartition, GPUMatrix<ElemType>& logBeta, GPUMatrix<ElemType>* scoresGradient, GPUMatrix<ElemType>* transitionsGradient)
+{
+    CUDA_LONG L = (CUDA_LONG) scores.GetNumRows();
+    CUDA_LONG S = (CUDA_LONG) sequences.GetNumCols();
+    scores.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _crfBackward<ElemType><<<S, crfThreadsPerBlock, 0, t_stream>>>(alpha.m_pArray, labelIds.m_pArray, scores.m_pArray, transitions.m_pArray, sequences.m_pArray, (CUDA_LONG) stride, L,
+                                                                   logAlpha.m_pArray, logPartition.m_pArray, logBeta.m_pArray, scoresGradient ? scoresGradient->m_pArray : nullptr);
+    if (transitionsGradient)
+    {
+        int blocksPerGrid = (int) ceil(1.0 * L * L / GridDim::maxThreadsPerBlock);
+        _crfTransitionsGradient<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(alpha.m_pArray, labelIds.m_pArray, scores.m_pArray, transitions.m_pArray, sequences.m_pArray, S,
+                                                                                                       (CUDA_LONG) stride, L, logAlpha.m_pArray, logPartition.m_pArray, logBeta.m_pArray,
+                                                                                                       transitionsGradient->m_pArray);
+    }
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CRFViterbi() for comments
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFViterbi(const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                                     GPUMatrix<ElemType>& bestScores, GPUMatrix<ElemType>& backpointers, GPUMatrix<ElemType>& path)
+{
+    CUDA_LONG L = (CUDA_LONG) scores.GetNumRows();
+    int blocksPerGrid = (int) sequences.GetNumCols();
+    scores.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _crfViterbi<ElemType><<<blocksPerGrid, crfThreadsPerBlock, 0, t_stream>>>(scores.m_pArray, transitions.m_pArray, sequences.m_pArray, (CUDA_LONG) stride, L,
+                                                                              bestScores.m_pArray, backpointers.m_pArray, path.m_pArray);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
 template <class ElemType>
 bool GPUMatrix<ElemType>::HasElement(const GPUMatrix<ElemType>& a, const ElemType v)
 {
@@ -4760,6 +5691,7 @@ static shared_ptr<GPUMatrix<ElemType>> GetOnesVector(size_t N, DEVICEID_TYPE dev
     if (!p || p->GetNumRows() < N) // must (re-)allocate
     {
         p = make_shared<GPUMatrix<ElemType>>(GPUMatrix<ElemType>::Ones(N, 1, deviceId));
+        CUDA_CALL(cudaStreamSynchronize(t_stream)); // filled before other streams may use it (see ComputeStreams); rare
         onesCache[deviceId] = p; // this will replace the pointer thread-safely (although weird race conditions may happen where a larger entry is overwritten by a smaller one; will still run correctly)
     }
     return p;
@@ -124,7 +124,7 @@ private:
 // The only workaround is to use naked pointer.
 #pragma warning(push)
 #pragma warning(disable : 4251)
-    mutable std::unique_ptr<conc_stack<std::unique_ptr<GPUMatrix<ElemType>>>> m_workspace;
+    mutable std::unique_ptr<conc_pool<std::unique_ptr<GPUMatrix<ElemType>>>> m_workspace;
 #pragma warning(pop)
 
 private:
@@ -153,10 +153,21 @@ public:
     DEVICEID_TYPE PrepareDevice(DEVICEID_TYPE deviceId = -1) const;
 
     static cublasHandle_t GetCublasHandle(int computeDevice = -1);
+
+    // FP16 GEMM: MultiplyAndWeightedAdd() rounds its operands to half precision and accumulates in single precision.
+    // Process-wide, for precision float only; devices without fast FP16 math (below compute capability 5.3) keep using single precision.
+    static void SetFP16GEMMEnabled(bool enabled);
+    static bool IsFP16GEMMEnabled();
     ElemType* CopyToArray() const;                                              // allocated by the callee but need to be deleted by the caller
     size_t CopyToArray(ElemType*& arrayCopyTo, size_t& currentArraySize) const; // allocated by the callee but need to be deleted by the caller
     void CopySection(size_t numRows, size_t numCols, ElemType* dst, size_t colStride) const;
 
+    // tell the caching allocator that the buffer is used on 'stream' as well (see CUDACachingMemAllocator::RecordStream())
+    void RecordStreamUse(cudaStream_t stream) const;
+
+    // unified memory: migrate the elements to the device or to the host ahead of time; a no-op without unified memory
+    void PrefetchManaged(bool toDevice) const;
+
     void ChangeDeviceTo(DEVICEID_TYPE to_id);
 
 public:
@@ -165,6 +176,11 @@ public:
     GPUMatrix<ElemType>& SetColumnSlice(const GPUMatrix<ElemType>& fromMatrix, size_t startColumn, size_t numCols);
 
     void CopyColumnsStrided(const GPUMatrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride);
+    GPUMatrix<ElemType>& AssignGatheredColumnsOf(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& columnIndices);
+    GPUMatrix<ElemType>& AssignAliasSamplesOf(const GPUMatrix<ElemType>& aliasTable, const GPUMatrix<ElemType>& uniforms);
+    GPUMatrix<ElemType>& AddScatteredColumnsOf(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& columnIndices);
+    GPUMatrix<ElemType>& AssignPackedHalfOf(const GPUMatrix<ElemType>& a, HalfFormat format);
+    GPUMatrix<ElemType>& AssignUnpackedHalfOf(const GPUMatrix<ElemType>& packed, size_t numRows, HalfFormat format);
 
     GPUMatrix<ElemType> Diagonal() const;
 
@@ -179,6 +195,8 @@ public:
 
     ElemType Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul);
+    void Adam(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly);
     ElemType RmsProp(GPUMatrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
     void Reshape(const size_t numRows, const size_t numCols);
@@ -203,12 +221,15 @@ public:
 
     void SetValue(const GPUMatrix<ElemType>& deepCopyFrom);
     void SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, size_t matrixFlags = matrixFlagNormal);
+    void SetValueFromPeer(const GPUMatrix<ElemType>& deepCopyFrom); // deepCopyFrom lives on another GPU; this stays on its own
 
     void SetDiagonalValue(const ElemType v);
     void SetDiagonalValue(const GPUMatrix<ElemType>& vector);
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, unsigned long seed = USE_TIME_BASED_SEED);
+    void SetPhiloxRandomValue(const bool gaussian, const ElemType a, const ElemType b, unsigned long seed);
+    GPUMatrix<ElemType>& ScaleAndAddDropoutOf(const ElemType beta, const GPUMatrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset);
 
     GPUMatrix<ElemType> Transpose() const;
     GPUMatrix<ElemType>& AssignTransposeOf(const GPUMatrix<ElemType>& a);
@@ -352,6 +373,8 @@ public:
     GPUMatrix<ElemType>& AssignRepeatOf(const GPUMatrix<ElemType>& a, const size_t numRowRepeats, const size_t numColRepeats);
     GPUMatrix<ElemType>& AddToRowRepeatValuesOf(const GPUMatrix<ElemType>& a, const size_t numRowRepeats);
 
+    GPUMatrix<ElemType>& AssignPackedImages(const void* packedImages);
+
     GPUMatrix<ElemType>& AssignPositiveAndShiftedNegSample(const GPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber);
     GPUMatrix<ElemType>& AddFoldedPositiveAndShiftedNegSample(const GPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber);
 
@@ -407,6 +430,12 @@ public:
 public:
     // static BLAS functions
     static void MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c);
+    static void MultiplyAndWeightedAddBatched(ElemType alpha, const std::vector<const GPUMatrix<ElemType>*>& a, const bool transposeA, const std::vector<const GPUMatrix<ElemType>*>& b, const bool transposeB,
+                                              ElemType beta, const std::vector<GPUMatrix<ElemType>*>& c);
+    static void MultiTensorSumOfSquares(const std::vector<const GPUMatrix<ElemType>*>& matrices, std::vector<double>& sumsOfSquares);
+    static void MultiTensorSGDUpdate(const std::vector<GPUMatrix<ElemType>*>& weights, const std::vector<const GPUMatrix<ElemType>*>& gradients, const std::vector<GPUMatrix<ElemType>*>& smoothedGradients,
+                                     const std::vector<ElemType>& gradientScales, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                     const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad);
     static void MultiplyAndAdd(const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, GPUMatrix<ElemType>& c);
     static void Multiply(const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, GPUMatrix<ElemType>& c);
     static void Multiply(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
@@ -435,6 +464,37 @@ public:
 
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
 
+    static void LSTMPointwiseForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& prevCell, const GPUMatrix<ElemType>* peepholes, GPUMatrix<ElemType>& cell, GPUMatrix<ElemType>& output);
+    static void LSTMPointwiseBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& cell, const GPUMatrix<ElemType>& prevCell, const GPUMatrix<ElemType>* peepholes, const GPUMatrix<ElemType>& outputGradient,
+                                      GPUMatrix<ElemType>& cellGradient, GPUMatrix<ElemType>& gatesGradient);
+    static void GRUPointwiseForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& recurrent, const GPUMatrix<ElemType>& prevOutput, GPUMatrix<ElemType>& output);
+    static void GRUPointwiseBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& recurrent, const GPUMatrix<ElemType>& prevOutput, GPUMatrix<ElemType>& outputGradient,
+                                     GPUMatrix<ElemType>& gatesGradient, GPUMatrix<ElemType>& recurrentGradient);
+    static void CosDistanceWithNegativeSamples(const GPUMatrix<ElemType>& left, const GPUMatrix<ElemType>& right, size_t shift,
+                                               GPUMatrix<ElemType>& invNormLeft, GPUMatrix<ElemType>& invNormRight, GPUMatrix<ElemType>& cosDistance);
+    static void CosDistanceWithNegativeSamplesGradient(const GPUMatrix<ElemType>& left, const GPUMatrix<ElemType>& right, const GPUMatrix<ElemType>& invNormLeft, const GPUMatrix<ElemType>& invNormRight,
+                                                       const GPUMatrix<ElemType>& cosDistance, const GPUMatrix<ElemType>& gradient, size_t shift, bool wrtRight, GPUMatrix<ElemType>& inputGradient);
+
+    // (the gradients are nullptr if not needed)
+    static void AttentionForward(const GPUMatrix<ElemType>& query, const GPUMatrix<ElemType>& keys, const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                 GPUMatrix<ElemType>& context, GPUMatrix<ElemType>& logSumExp);
+    static void AttentionBackward(const GPUMatrix<ElemType>& query, const GPUMatrix<ElemType>& keys, const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                  const GPUMatrix<ElemType>& context, const GPUMatrix<ElemType>& logSumExp, const GPUMatrix<ElemType>& contextGradient,
+                                  GPUMatrix<ElemType>* queryGradient, GPUMatrix<ElemType>* keysGradient, GPUMatrix<ElemType>* valuesGradient);
+
+    static void CrossEntropyWithSoftmaxForward(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& columnLoss);
+    static void CrossEntropyWithSoftmaxBackward(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp,
+                                                GPUMatrix<ElemType>& gradient);
+    static void SegmentedLogSoftmax(const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& segments, GPUMatrix<ElemType>& logProbs, GPUMatrix<ElemType>& loss);
+    static void SegmentedSoftmaxGradient(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& logProbs, const GPUMatrix<ElemType>& segments, ElemType beta, GPUMatrix<ElemType>& gradient);
+    static void NoiseContrastiveLoss(const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& loss, GPUMatrix<ElemType>& gradient);
+    static void CRFForward(const GPUMatrix<ElemType>& labelIds, const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                           GPUMatrix<ElemType>& logAlpha, GPUMatrix<ElemType>& logPartition, GPUMatrix<ElemType>& loss);
+    static void CRFBackward(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labelIds, const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                            const GPUMatrix<ElemType>& logAlpha, const GPUMatrix<ElemType>& logPartition, GPUMatrix<ElemType>& logBeta, GPUMatrix<ElemType>* scoresGradient, GPUMatrix<ElemType>* transitionsGradient);
+    static void CRFViterbi(const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                           GPUMatrix<ElemType>& bestScores, GPUMatrix<ElemType>& backpointers, GPUMatrix<ElemType>& path);
+
     void TensorOp(ElemType beta, const GPUMatrix<ElemType>& a, ElemType alpha, ElementWiseOperator op,
                   const std::array<size_t, 2>& offsets,
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 2>& regularStrides,
@@ -496,8 +556,7 @@ public:
         int format;
         stream >> matrixName >> format >> numRows >> numCols;
         ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        stream.ReadArray(d_array, numRows * numCols);
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         us.SetValue(numRows, numCols, us.GetComputeDeviceId(), d_array, matrixFlagNormal | format);
         delete[] d_array;
@@ -517,9 +576,8 @@ public:
 
         stream << us.m_numRows << us.m_numCols;
         ElemType* pArray = us.CopyToArray();
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << pArray[i];
-        
+        stream.WriteArray(pArray, us.GetNumElements());
+
         delete[] pArray;
 
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
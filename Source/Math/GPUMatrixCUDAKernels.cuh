@@ -14,8 +14,13 @@
 #include "CommonMatrix.h"
 #include "GPUMatrix.h"
 #include "TensorOps.h" // for exp_() etc.
+#define PHILOX_DECL __device__ __host__
+#include "Philox.h"
+#include "PackedImages.h"
+#undef PHILOX_DECL
 #include "device_functions.h"
 #include <cuda_runtime.h>
+#include <cuda_fp16.h>
 #include <assert.h>
 #include <float.h>
 #pragma pop_macro("TENSOR_OPS_DECL")
@@ -397,6 +402,62 @@ __global__ void _copyColumnsStrided(ElemType* dest, ElemType* src, CUDA_LONG N,
     dest[(denseColIdx * destNumColsStride * numRows) + rowIdx] = src[(denseColIdx * srcNumColsStride * numRows) + rowIdx];
 }
 
+template <class ElemType>
+__global__ void _assignGatheredColumnsOf(ElemType* us, const ElemType* a, const ElemType* columnIndices, const CUDA_LONG N, const CUDA_LONG numRows)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    CUDA_LONG col = id / numRows;
+    CUDA_LONG row = id - col * numRows;
+    us[id] = a[(CUDA_LONG) columnIndices[col] * numRows + row];
+}
+
+template <class ElemType>
+__global__ void _addScatteredColumnsOf(ElemType* us, const ElemType* a, const ElemType* columnIndices, const CUDA_LONG N, const CUDA_LONG numRows)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    CUDA_LONG col = id / numRows;
+    CUDA_LONG row = id - col * numRows;
+    us[(CUDA_LONG) columnIndices[col] * numRows + row] += a[id];
+}
+
+// see Matrix<ElemType>::AssignPackedHalfOf() for comments; one thread per 16-bit value, including the padding
+template <class ElemType>
+__global__ void _assignPackedHalfOf(unsigned short* us, const ElemType* a, const CUDA_LONG N, const CUDA_LONG numRows, const CUDA_LONG halvesPerColumn, const HalfFormat format)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    CUDA_LONG col = id / halvesPerColumn;
+    CUDA_LONG row = id - col * halvesPerColumn;
+    us[id] = row < numRows ? FloatToHalfBits((float) a[col * numRows + row], format) : 0;
+}
+
+template <class ElemType>
+__global__ void _assignUnpackedHalfOf(ElemType* us, const unsigned short* packed, const CUDA_LONG N, const CUDA_LONG numRows, const CUDA_LONG halvesPerColumn, const HalfFormat format)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    CUDA_LONG col = id / numRows;
+    CUDA_LONG row = id - col * numRows;
+    us[id] = (ElemType) HalfBitsToFloat(packed[col * halvesPerColumn + row], format);
+}
+
+// see Matrix<ElemType>::AssignAliasSamplesOf() for comments
+template <class ElemType>
+__global__ void _assignAliasSamplesOf(ElemType* us, const ElemType* aliasTable, const ElemType* uniforms, const CUDA_LONG V, const CUDA_LONG k)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= k)
+        return;
+    CUDA_LONG bucket = min((CUDA_LONG) (uniforms[2 * id] * V), V - 1);
+    us[id] = uniforms[2 * id + 1] < aliasTable[2 * bucket] ? (ElemType) bucket : aliasTable[2 * bucket + 1];
+}
+
 template <class ElemType>
 __global__ void _assignToRowSliceValuesOf(ElemType* dest, ElemType* src, const CUDA_LONG N, const CUDA_LONG startIndex, const CUDA_LONG destRows, const CUDA_LONG srcRows)
 {
@@ -502,6 +563,18 @@ __global__ void _assignRepeatOf(ElemType* dest, ElemType* src, const CUDA_LONG N
     dest[id] = src[IDX2C(srcRow, srcCol, srcRows)];
 }
 
+template <class ElemType>
+__global__ void _assignPackedImages(ElemType* dest, const PackedImagesHeader* packedImages, const CUDA_LONG N, const CUDA_LONG destRows)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+
+    CUDA_LONG destCol = id / destRows;
+    CUDA_LONG destRow = id - (destCol * destRows);
+    dest[id] = PackedImageValue<ElemType>(packedImages, destRow, destCol);
+}
+
 template <class ElemType>
 __global__ void _addToRowRepeatValuesOf(ElemType* dest, ElemType* src, const CUDA_LONG N, const CUDA_LONG srcRows, const CUDA_LONG srcCols, const CUDA_LONG destRows)
 {
@@ -591,6 +664,15 @@ __global__ void _scaleAndAddScalar(
     c[id] = alpha * a[0] + b[id];
 };
 
+// rounds the operands of the FP16 GEMM to half precision
+__global__ void _convertFloatToHalf(const float* a, __half* b, CUDA_LONG N)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    b[id] = __float2half(a[id]);
+}
+
 template <class ElemType>
 __global__ void _multiply1x1AndWeightedAdd(
     ElemType alpha, const ElemType* a, const ElemType* b, ElemType beta, ElemType* c, CUDA_LONG N)
@@ -1245,6 +1327,844 @@ __global__ void _tensorShuffleScaleAndAdd(
     pc[nb] = cval;
 }
 
+// see Matrix<ElemType>::LSTMPointwiseForward() for comments
+// one thread per (cell, sequence) pair; all four gates of a cell are read and written by the same thread
+template <class ElemType>
+__global__ void _lstmPointwiseForward(ElemType* pz, const ElemType* pcp, const ElemType* pp, ElemType* pc, ElemType* ph, const CUDA_LONG H, const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG j = id % H;
+    CUDA_LONG s = id / H;
+    ElemType* z = pz + s * 4 * H;
+    ElemType cp = pcp[id];
+    ElemType i = Microsoft::MSR::CNTK::Sigmoid(pp ? z[j] + pp[j] * cp : z[j]);
+    ElemType f = Microsoft::MSR::CNTK::Sigmoid(pp ? z[H + j] + pp[H + j] * cp : z[H + j]);
+    ElemType g = tanh_(z[3 * H + j]);
+    ElemType c = f * cp + i * g;
+    ElemType o = Microsoft::MSR::CNTK::Sigmoid(pp ? z[2 * H + j] + pp[2 * H + j] * c : z[2 * H + j]);
+    z[j] = i;
+    z[H + j] = f;
+    z[2 * H + j] = o;
+    z[3 * H + j] = g;
+    pc[id] = c;
+    ph[id] = o * tanh_(c);
+}
+
+// see Matrix<ElemType>::LSTMPointwiseBackward() for comments
+template <class ElemType>
+__global__ void _lstmPointwiseBackward(const ElemType* pz, const ElemType* pc, const ElemType* pcp, const ElemType* pp, const ElemType* pdh, ElemType* pdc, ElemType* pdz, const CUDA_LONG H, const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG j = id % H;
+    CUDA_LONG s = id / H;
+    const ElemType* z = pz + s * 4 * H;
+    ElemType* dz = pdz + s * 4 * H;
+    ElemType i = z[j], f = z[H + j], o = z[2 * H + j], g = z[3 * H + j];
+    ElemType tc = tanh_(pc[id]);
+    ElemType dh = pdh[id];
+    ElemType dzo = dh * tc * o * (1 - o);
+    ElemType dc = pdc[id] + dh * o * (1 - tc * tc);
+    if (pp)
+        dc += dzo * pp[2 * H + j];
+    ElemType dzi = dc * g * i * (1 - i);
+    ElemType dzf = dc * pcp[id] * f * (1 - f);
+    dz[j] = dzi;
+    dz[H + j] = dzf;
+    dz[2 * H + j] = dzo;
+    dz[3 * H + j] = dc * i * (1 - g * g);
+    pdc[id] = pp ? dc * f + dzi * pp[j] + dzf * pp[H + j] : dc * f;
+}
+
+// see Matrix<ElemType>::GRUPointwiseForward() for comments
+// one thread per (unit, sequence) pair, like _lstmPointwiseForward()
+template <class ElemType>
+__global__ void _gruPointwiseForward(ElemType* pz, const ElemType* pq, const ElemType* php, ElemType* ph, const CUDA_LONG H, const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG j = id % H;
+    CUDA_LONG s = id / H;
+    ElemType* z = pz + s * 3 * H;
+    const ElemType* q = pq + s * 3 * H;
+    ElemType r = Microsoft::MSR::CNTK::Sigmoid(z[j] + q[j]);
+    ElemType u = Microsoft::MSR::CNTK::Sigmoid(z[H + j] + q[H + j]);
+    ElemType n = tanh_(z[2 * H + j] + r * q[2 * H + j]);
+    z[j] = r;
+    z[H + j] = u;
+    z[2 * H + j] = n;
+    ph[id] = (1 - u) * n + u * php[id];
+}
+
+// see Matrix<ElemType>::GRUPointwiseBackward() for comments
+template <class ElemType>
+__global__ void _gruPointwiseBackward(const ElemType* pz, const ElemType* pq, const ElemType* php, ElemType* pdh, ElemType* pdz, ElemType* pdq, const CUDA_LONG H, const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG j = id % H;
+    CUDA_LONG s = id / H;
+    const ElemType* z = pz + s * 3 * H;
+    const ElemType* q = pq + s * 3 * H;
+    ElemType* dz = pdz + s * 3 * H;
+    ElemType* dq = pdq + s * 3 * H;
+    ElemType r = z[j], u = z[H + j], n = z[2 * H + j];
+    ElemType dh = pdh[id];
+    ElemType dn = dh * (1 - u) * (1 - n * n);
+    ElemType du = dh * (php[id] - n) * u * (1 - u);
+    ElemType dr = dn * q[2 * H + j] * r * (1 - r);
+    dz[j] = dq[j] = dr;
+    dz[H + j] = dq[H + j] = du;
+    dz[2 * H + j] = dn;
+    dq[2 * H + j] = dn * r;
+    pdh[id] = dh * u;
+}
+
+// see Matrix<ElemType>::CosDistanceWithNegativeSamples() for comments
+// first kernel: one thread per column, computing the inverse norms of both sides
+template <class ElemType>
+__global__ void _cosDistanceInvNorms(const ElemType* pa, const ElemType* pb, ElemType* pia, ElemType* pib, const CUDA_LONG D, const CUDA_LONG n)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(j, n);
+    const ElemType* a = pa + j * D;
+    const ElemType* b = pb + j * D;
+    ElemType sa = 0, sb = 0;
+    for (CUDA_LONG d = 0; d < D; d++)
+    {
+        sa += a[d] * a[d];
+        sb += b[d] * b[d];
+    }
+    pia[j] = 1 / sqrt_(sa);
+    pib[j] = 1 / sqrt_(sb);
+}
+
+// second kernel: one thread per element of the output
+template <class ElemType>
+__global__ void _cosDistanceWithNegativeSamples(const ElemType* pa, const ElemType* pb, const ElemType* pia, const ElemType* pib, ElemType* pc, const CUDA_LONG shift, const CUDA_LONG D, const CUDA_LONG n, const CUDA_LONG M)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, n * M);
+    CUDA_LONG m = id % M;
+    CUDA_LONG j = id / M;
+    CUDA_LONG k = m == 0 ? j : (j + shift + m - 1) % n;
+    const ElemType* a = pa + j * D;
+    const ElemType* b = pb + k * D;
+    ElemType dot = 0;
+    for (CUDA_LONG d = 0; d < D; d++)
+        dot += a[d] * b[d];
+    pc[id] = dot * pia[j] * pib[k];
+}
+
+// see Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient() for comments
+// One thread per element of the input gradient; 'self' is the side the gradient is for and 'other' the opposite side.
+template <class ElemType>
+__global__ void _cosDistanceWithNegativeSamplesGradient(const ElemType* pself, const ElemType* pother, const ElemType* pis, const ElemType* pio, const ElemType* pc, const ElemType* pg,
+                                                        ElemType* pdi, const CUDA_LONG shift, const bool wrtRight, const CUDA_LONG D, const CUDA_LONG n, const CUDA_LONG M)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, D * n);
+    CUDA_LONG d = id % D;
+    CUDA_LONG i = id / D;
+    ElemType sum = 0, selfCoef = 0;
+    for (CUDA_LONG m = 0; m < M; m++)
+    {
+        CUDA_LONG s = m == 0 ? 0 : (shift + m - 1) % n;
+        CUDA_LONG j = wrtRight ? (i - s + n) % n : i;
+        CUDA_LONG o = wrtRight ? j : (i + s) % n;
+        ElemType g = pg[j * M + m];
+        sum += g * pio[o] * pother[o * D + d];
+        selfCoef += g * pc[j * M + m];
+    }
+    pdi[id] += pis[i] * (sum - selfCoef * pis[i] * pself[id]);
+}
+
+// threads per block of the attention kernels, which run one block per query
+static const CUDA_LONG attentionThreadsPerBlock = 128;
+
+// see Matrix<ElemType>::AttentionForward() for comments
+// First pass: each thread keeps a running max and sum of exp() over a strided subset of the keys, and the block reduces them
+// into the log-sum-exp. Second pass: the keys are processed in chunks of one per thread, whose softmax weights are shared,
+// and each thread accumulates a subset of the context dimensions. The scores are computed twice but never stored.
+template <class ElemType>
+__global__ void _attentionForward(const ElemType* pq, const ElemType* pk, const ElemType* pv, const ElemType* pr, const CUDA_LONG keyStride, const ElemType scale,
+                                  ElemType* pc, ElemType* plse, const CUDA_LONG D, const CUDA_LONG Dv)
+{
+    __shared__ ElemType partialMax[attentionThreadsPerBlock];
+    __shared__ ElemType partialSum[attentionThreadsPerBlock];
+    __shared__ ElemType weights[attentionThreadsPerBlock];
+    const CUDA_LONG j = blockIdx.x;
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG first = (CUDA_LONG) pr[2 * j];
+    const CUDA_LONG n = (CUDA_LONG) pr[2 * j + 1];
+    const ElemType* q = pq + j * D;
+    ElemType* c = pc + j * Dv;
+
+    ElemType m = -1e30f, sum = 0;
+    for (CUDA_LONG i = tid; i < n; i += attentionThreadsPerBlock)
+    {
+        const ElemType* k = pk + (first + i * keyStride) * D;
+        ElemType score = 0;
+        for (CUDA_LONG d = 0; d < D; d++)
+            score += q[d] * k[d];
+        score *= scale;
+        if (score > m)
+        {
+            sum = sum * exp_(m - score) + 1;
+            m = score;
+        }
+        else
+            sum += exp_(score - m);
+    }
+    partialMax[tid] = m;
+    partialSum[tid] = sum;
+    __syncthreads();
+    for (CUDA_LONG stride = attentionThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+        {
+            const ElemType m1 = partialMax[tid], m2 = partialMax[tid + stride];
+            const ElemType mm = m1 > m2 ? m1 : m2;
+            partialSum[tid] = partialSum[tid] * exp_(m1 - mm) + partialSum[tid + stride] * exp_(m2 - mm);
+            partialMax[tid] = mm;
+        }
+        __syncthreads();
+    }
+    const ElemType lse = n > 0 ? partialMax[0] + log_(partialSum[0]) : 0;
+    if (tid == 0)
+        plse[j] = lse;
+
+    for (CUDA_LONG d = tid; d < Dv; d += attentionThreadsPerBlock)
+        c[d] = 0;
+    for (CUDA_LONG chunk = 0; chunk < n; chunk += attentionThreadsPerBlock)
+    {
+        const CUDA_LONG i = chunk + tid;
+        if (i < n)
+        {
+            const ElemType* k = pk + (first + i * keyStride) * D;
+            ElemType score = 0;
+            for (CUDA_LONG d = 0; d < D; d++)
+                score += q[d] * k[d];
+            weights[tid] = exp_(scale * score - lse);
+        }
+        __syncthreads();
+        const CUDA_LONG chunkSize = min(attentionThreadsPerBlock, n - chunk);
+        for (CUDA_LONG d = tid; d < Dv; d += attentionThreadsPerBlock)
+        {
+            ElemType acc = 0;
+            for (CUDA_LONG ii = 0; ii < chunkSize; ii++)
+                acc += weights[ii] * pv[(first + (chunk + ii) * keyStride) * Dv + d];
+            c[d] += acc;
+        }
+        __syncthreads();
+    }
+}
+
+// see Matrix<ElemType>::AttentionBackward() for comments
+// Same blocking as _attentionForward(). The softmax weights p and score gradients ds of a chunk of keys are shared; the query
+// gradient belongs to this block, while the key and value gradients are shared with the other queries and added atomically.
+template <class ElemType>
+__global__ void _attentionBackward(const ElemType* pq, const ElemType* pk, const ElemType* pv, const ElemType* pr, const CUDA_LONG keyStride, const ElemType scale,
+                                   const ElemType* pc, const ElemType* plse, const ElemType* pdc,
+                                   ElemType* pdq, ElemType* pdk, ElemType* pdv, const CUDA_LONG D, const CUDA_LONG Dv)
+{
+    __shared__ ElemType partialDelta[attentionThreadsPerBlock];
+    __shared__ ElemType weights[attentionThreadsPerBlock];
+    __shared__ ElemType scoreGradients[attentionThreadsPerBlock];
+    const CUDA_LONG j = blockIdx.x;
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG first = (CUDA_LONG) pr[2 * j];
+    const CUDA_LONG n = (CUDA_LONG) pr[2 * j + 1];
+    const ElemType* q = pq + j * D;
+    const ElemType* dc = pdc + j * Dv;
+    const ElemType lse = plse[j];
+
+    // delta = dc^T c = sum_i p_i dc^T v_i
+    ElemType delta = 0;
+    for (CUDA_LONG d = tid; d < Dv; d += attentionThreadsPerBlock)
+        delta += dc[d] * pc[j * Dv + d];
+    partialDelta[tid] = delta;
+    __syncthreads();
+    for (CUDA_LONG stride = attentionThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+            partialDelta[tid] += partialDelta[tid + stride];
+        __syncthreads();
+    }
+    delta = partialDelta[0];
+
+    for (CUDA_LONG chunk = 0; chunk < n; chunk += attentionThreadsPerBlock)
+    {
+        const CUDA_LONG i = chunk + tid;
+        if (i < n)
+        {
+            const CUDA_LONG col = first + i * keyStride;
+            const ElemType* k = pk + col * D;
+            const ElemType* v = pv + col * Dv;
+            ElemType score = 0;
+            for (CUDA_LONG d = 0; d < D; d++)
+                score += q[d] * k[d];
+            ElemType dp = 0;
+            for (CUDA_LONG d = 0; d < Dv; d++)
+                dp += dc[d] * v[d];
+            const ElemType p = exp_(scale * score - lse);
+            weights[tid] = p;
+            scoreGradients[tid] = p * (dp - delta);
+        }
+        __syncthreads();
+        const CUDA_LONG chunkSize = min(attentionThreadsPerBlock, n - chunk);
+        if (pdq)
+        {
+            for (CUDA_LONG d = tid; d < D; d += attentionThreadsPerBlock)
+            {
+                ElemType acc = 0;
+                for (CUDA_LONG ii = 0; ii < chunkSize; ii++)
+                    acc += scoreGradients[ii] * pk[(first + (chunk + ii) * keyStride) * D + d];
+                pdq[j * D + d] += scale * acc;
+            }
+        }
+        for (CUDA_LONG ii = 0; ii < chunkSize; ii++)
+        {
+            const CUDA_LONG col = first + (chunk + ii) * keyStride;
+            if (pdk)
+            {
+                for (CUDA_LONG d = tid; d < D; d += attentionThreadsPerBlock)
+                    atomicAdd(&pdk[col * D + d], scale * scoreGradients[ii] * q[d]);
+            }
+            if (pdv)
+            {
+                for (CUDA_LONG d = tid; d < Dv; d += attentionThreadsPerBlock)
+                    atomicAdd(&pdv[col * Dv + d], weights[ii] * dc[d]);
+            }
+        }
+        __syncthreads();
+    }
+}
+
+// threads per block of _crossEntropyWithSoftmaxForward(), the segmented softmax kernels and _noiseContrastiveLoss(), which run one block per column or segment
+static const CUDA_LONG crossEntropyThreadsPerBlock = 128;
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxForward() for comments
+// Each thread keeps, over a strided subset of the rows, a running max m, sum of exp(z - m), sum of the labels, and
+// sum of label * (z - m), which are rebased whenever m grows; the block then merges them pairwise the same way.
+template <class ElemType>
+__global__ void _crossEntropyWithSoftmaxForward(const ElemType* labels, const ElemType* logits, ElemType* logSumExp, ElemType* columnLoss, const CUDA_LONG M)
+{
+    __shared__ ElemType partialMax[crossEntropyThreadsPerBlock];
+    __shared__ ElemType partialSum[crossEntropyThreadsPerBlock];
+    __shared__ ElemType partialLabelSum[crossEntropyThreadsPerBlock];
+    __shared__ ElemType partialDot[crossEntropyThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG j = blockIdx.x;
+    const ElemType* pz = logits + IDX2C(0, j, M);
+    const ElemType* pl = labels + IDX2C(0, j, M);
+
+    ElemType maxv = 0, sum = 0, labelSum = 0, dot = 0; // sum = 0: no rows yet
+    for (CUDA_LONG i = tid; i < M; i += crossEntropyThreadsPerBlock)
+    {
+        const ElemType z = pz[i];
+        const ElemType l = pl[i];
+        if (sum == 0)
+            maxv = z;
+        else if (z > maxv)
+        {
+            sum *= exp_(maxv - z);
+            dot -= labelSum * (z - maxv);
+            maxv = z;
+        }
+        sum += exp_(z - maxv);
+        labelSum += l;
+        dot += l * (z - maxv);
+    }
+    partialMax[tid] = maxv;
+    partialSum[tid] = sum;
+    partialLabelSum[tid] = labelSum;
+    partialDot[tid] = dot;
+    __syncthreads();
+
+    for (CUDA_LONG stride = crossEntropyThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride && partialSum[tid + stride] != 0)
+        {
+            const CUDA_LONG other = tid + stride;
+            if (partialSum[tid] == 0)
+            {
+                partialMax[tid] = partialMax[other];
+                partialSum[tid] = partialSum[other];
+                partialLabelSum[tid] = partialLabelSum[other];
+                partialDot[tid] = partialDot[other];
+            }
+            else
+            {
+                const ElemType m = max(partialMax[tid], partialMax[other]);
+                partialSum[tid] = partialSum[tid] * exp_(partialMax[tid] - m) + partialSum[other] * exp_(partialMax[other] - m);
+                partialDot[tid] += partialLabelSum[tid] * (partialMax[tid] - m) + partialDot[other] + partialLabelSum[other] * (partialMax[other] - m);
+                partialLabelSum[tid] += partialLabelSum[other];
+                partialMax[tid] = m;
+            }
+        }
+        __syncthreads();
+    }
+
+    if (tid == 0)
+    {
+        const ElemType logSum = log_(partialSum[0]);
+        logSumExp[j] = partialMax[0] + logSum;
+        columnLoss[j] = partialLabelSum[0] * logSum - partialDot[0];
+    }
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxBackward() for comments
+template <class ElemType>
+__global__ void _crossEntropyWithSoftmaxBackward(const ElemType* alpha, const ElemType* labels, const ElemType* logits, const ElemType* logSumExp, ElemType* gradient,
+                                                 const CUDA_LONG M, const CUDA_LONG N)
+{
+    const CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    gradient[id] += alpha[0] * (exp_(logits[id] - logSumExp[id / M]) - labels[id]);
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxForward() for comments, for labels in CSC format
+// The block computes the log-sum-exp of its column as above, and the loss gathers the logits at the non-zeros of the labels.
+template <class ElemType>
+__global__ void _crossEntropyWithSoftmaxSparseLabelsForward(const ElemType* labelValues, const GPUSPARSE_INDEX_TYPE* labelRows, const GPUSPARSE_INDEX_TYPE* labelColStarts,
+                                                            const ElemType* logits, ElemType* logSumExp, ElemType* columnLoss, const CUDA_LONG M)
+{
+    __shared__ ElemType partialMax[crossEntropyThreadsPerBlock];
+    __shared__ ElemType partialSum[crossEntropyThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG j = blockIdx.x;
+    const ElemType* pz = logits + IDX2C(0, j, M);
+
+    ElemType maxv = 0, sum = 0; // sum = 0: no rows yet
+    for (CUDA_LONG i = tid; i < M; i += crossEntropyThreadsPerBlock)
+    {
+        const ElemType z = pz[i];
+        if (sum == 0)
+            maxv = z;
+        else if (z > maxv)
+        {
+            sum *= exp_(maxv - z);
+            maxv = z;
+        }
+        sum += exp_(z - maxv);
+    }
+    partialMax[tid] = maxv;
+    partialSum[tid] = sum;
+    __syncthreads();
+
+    for (CUDA_LONG stride = crossEntropyThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride && partialSum[tid + stride] != 0)
+        {
+            const CUDA_LONG other = tid + stride;
+            if (partialSum[tid] == 0)
+            {
+                partialMax[tid] = partialMax[other];
+                partialSum[tid] = partialSum[other];
+            }
+            else
+            {
+                const ElemType m = max(partialMax[tid], partialMax[other]);
+                partialSum[tid] = partialSum[tid] * exp_(partialMax[tid] - m) + partialSum[other] * exp_(partialMax[other] - m);
+                partialMax[tid] = m;
+            }
+        }
+        __syncthreads();
+    }
+
+    if (tid == 0)
+    {
+        const ElemType lse = partialMax[0] + log_(partialSum[0]);
+        ElemType loss = 0;
+        for (GPUSPARSE_INDEX_TYPE p = labelColStarts[j]; p < labelColStarts[j + 1]; p++)
+            loss += labelValues[p] * (lse - pz[labelRows[p]]);
+        logSumExp[j] = lse;
+        columnLoss[j] = loss;
+    }
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxBackward() for comments, for labels in CSC format (few non-zeros per column)
+template <class ElemType>
+__global__ void _crossEntropyWithSoftmaxSparseLabelsBackward(const ElemType* alpha, const ElemType* labelValues, const GPUSPARSE_INDEX_TYPE* labelRows, const GPUSPARSE_INDEX_TYPE* labelColStarts,
+                                                             const ElemType* logits, const ElemType* logSumExp, ElemType* gradient, const CUDA_LONG M, const CUDA_LONG N)
+{
+    const CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    const CUDA_LONG i = id % M;
+    const CUDA_LONG j = id / M;
+    ElemType l = 0;
+    for (GPUSPARSE_INDEX_TYPE p = labelColStarts[j]; p < labelColStarts[j + 1]; p++)
+    {
+        if (labelRows[p] == i)
+            l += labelValues[p];
+    }
+    gradient[id] += alpha[0] * (exp_(logits[id] - logSumExp[j]) - l);
+}
+
+// see Matrix<ElemType>::SegmentedLogSoftmax() for comments
+template <class ElemType>
+__global__ void _segmentedLogSoftmax(const ElemType* values, const ElemType* segments, ElemType* logProbs, ElemType* loss)
+{
+    __shared__ ElemType partials[crossEntropyThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG s = blockIdx.x;
+    const CUDA_LONG offset = (CUDA_LONG) segments[3 * s];
+    const CUDA_LONG length = (CUDA_LONG) segments[3 * s + 1];
+    const CUDA_LONG target = (CUDA_LONG) segments[3 * s + 2];
+    const ElemType* pz = values + offset;
+    ElemType* pl = logProbs + offset;
+
+    // max
+    ElemType maxv = pz[0];
+    for (CUDA_LONG i = tid; i < length; i += crossEntropyThreadsPerBlock)
+        maxv = max(maxv, pz[i]);
+    partials[tid] = maxv;
+    __syncthreads();
+    for (CUDA_LONG stride = crossEntropyThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+            partials[tid] = max(partials[tid], partials[tid + stride]);
+        __syncthreads();
+    }
+    maxv = partials[0];
+    __syncthreads();
+
+    // sum of exp
+    ElemType sum = 0;
+    for (CUDA_LONG i = tid; i < length; i += crossEntropyThreadsPerBlock)
+        sum += exp_(pz[i] - maxv);
+    partials[tid] = sum;
+    __syncthreads();
+    for (CUDA_LONG stride = crossEntropyThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+            partials[tid] += partials[tid + stride];
+        __syncthreads();
+    }
+    const ElemType logSumExp = maxv + log_(partials[0]);
+
+    // values and logProbs may be the same, so the target is read before it is overwritten
+    if (tid == 0)
+        loss[s] = logSumExp - pz[target];
+    __syncthreads();
+    for (CUDA_LONG i = tid; i < length; i += crossEntropyThreadsPerBlock)
+        pl[i] = pz[i] - logSumExp;
+}
+
+// see Matrix<ElemType>::SegmentedSoftmaxGradient() for comments
+template <class ElemType>
+__global__ void _segmentedSoftmaxGradient(const ElemType* alpha, const ElemType* logProbs, const ElemType* segments, const ElemType beta, ElemType* gradient)
+{
+    const CUDA_LONG s = blockIdx.x;
+    const CUDA_LONG offset = (CUDA_LONG) segments[3 * s];
+    const CUDA_LONG length = (CUDA_LONG) segments[3 * s + 1];
+    const CUDA_LONG target = (CUDA_LONG) segments[3 * s + 2];
+    const ElemType a = alpha[0];
+    for (CUDA_LONG i = threadIdx.x; i < length; i += crossEntropyThreadsPerBlock)
+    {
+        const ElemType g = a * (exp_(logProbs[offset + i]) - (i == target ? 1 : 0));
+        gradient[offset + i] = beta == 0 ? g : beta * gradient[offset + i] + g;
+    }
+}
+
+// see Matrix<ElemType>::NoiseContrastiveLoss() for comments
+template <class ElemType>
+__global__ void _noiseContrastiveLoss(const ElemType* logits, ElemType* loss, ElemType* gradient, const CUDA_LONG M)
+{
+    __shared__ ElemType partials[crossEntropyThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG t = blockIdx.x;
+    const ElemType* pz = logits + IDX2C(0, t, M);
+    ElemType* pg = gradient + IDX2C(0, t, M);
+
+    ElemType sum = 0;
+    for (CUDA_LONG i = tid; i < M; i += crossEntropyThreadsPerBlock)
+    {
+        const ElemType z = i == 0 ? -pz[i] : pz[i]; // the target is to be classified as data, the samples as noise
+        const ElemType e = exp_(-fabs_(z));
+        sum += max(z, (ElemType) 0) + log1p(e); // softplus(z)
+        const ElemType sigmoid = z >= 0 ? 1 / (1 + e) : e / (1 + e);
+        pg[i] = i == 0 ? -sigmoid : sigmoid;
+    }
+    partials[tid] = sum;
+    __syncthreads();
+    for (CUDA_LONG stride = crossEntropyThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+            partials[tid] += partials[tid + stride];
+        __syncthreads();
+    }
+    if (tid == 0)
+        loss[t] = partials[0];
+}
+
+// threads per block of the CRF kernels, which run one block per sequence with the threads over the labels
+static const CUDA_LONG crfThreadsPerBlock = 128;
+
+// sum of one value of each thread of the block; partials is shared memory of crfThreadsPerBlock
+template <class ElemType>
+__device__ ElemType _crfBlockSum(ElemType value, ElemType* partials)
+{
+    const CUDA_LONG tid = threadIdx.x;
+    partials[tid] = value;
+    __syncthreads();
+    for (CUDA_LONG stride = crfThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+            partials[tid] += partials[tid + stride];
+        __syncthreads();
+    }
+    const ElemType sum = partials[0];
+    __syncthreads();
+    return sum;
+}
+
+// log sum_k exp(v[k]) over k < L, by all threads of the block
+template <class ElemType>
+__device__ ElemType _crfBlockLogSumExp(const ElemType* v, const CUDA_LONG L, ElemType* partials)
+{
+    const CUDA_LONG tid = threadIdx.x;
+    ElemType maxv = v[0];
+    for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+        maxv = max(maxv, v[k]);
+    partials[tid] = maxv;
+    __syncthreads();
+    for (CUDA_LONG stride = crfThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+            partials[tid] = max(partials[tid], partials[tid + stride]);
+        __syncthreads();
+    }
+    maxv = partials[0];
+    __syncthreads();
+
+    ElemType sum = 0;
+    for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+        sum += exp_(v[k] - maxv);
+    return maxv + log_(_crfBlockSum(sum, partials));
+}
+
+// see Matrix<ElemType>::CRFForward() for comments
+// The frames of a sequence are processed in order, each thread computing the log-sum-exp over the previous labels for
+// a strided subset of the current ones in a single pass (rebasing the sum whenever the running max grows).
+template <class ElemType>
+__global__ void _crfForward(const ElemType* labelIds, const ElemType* scores, const ElemType* transitions, const ElemType* sequences, const CUDA_LONG stride, const CUDA_LONG L,
+                            ElemType* logAlpha, ElemType* logPartition, ElemType* loss)
+{
+    __shared__ ElemType partials[crfThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG s = blockIdx.x;
+    const CUDA_LONG first = (CUDA_LONG) sequences[2 * s];
+    const CUDA_LONG T = (CUDA_LONG) sequences[2 * s + 1];
+
+    for (CUDA_LONG t = 0; t < T; t++)
+    {
+        const CUDA_LONG j = first + t * stride;
+        for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+        {
+            ElemType a = 0;
+            if (t > 0)
+            {
+                const ElemType* prev = logAlpha + IDX2C(0, j - stride, L);
+                ElemType maxv = prev[0] + transitions[IDX2C(k, 0, L)];
+                ElemType sum = 1;
+                for (CUDA_LONG i = 1; i < L; i++)
+                {
+                    const ElemType v = prev[i] + transitions[IDX2C(k, i, L)];
+                    if (v > maxv)
+                    {
+                        sum = sum * exp_(maxv - v) + 1;
+                        maxv = v;
+                    }
+                    else
+                        sum += exp_(v - maxv);
+                }
+                a = maxv + log_(sum);
+            }
+            logAlpha[IDX2C(k, j, L)] = scores[IDX2C(k, j, L)] + a;
+        }
+        __syncthreads();
+    }
+
+    // score of the labeled path
+    ElemType gold = 0;
+    for (CUDA_LONG t = tid; t < T; t += crfThreadsPerBlock)
+    {
+        const CUDA_LONG j = first + t * stride;
+        const CUDA_LONG y = (CUDA_LONG) labelIds[j];
+        gold += scores[IDX2C(y, j, L)];
+        if (t > 0)
+            gold += transitions[IDX2C(y, (CUDA_LONG) labelIds[j - stride], L)];
+    }
+    gold = _crfBlockSum(gold, partials);
+    const ElemType logZ = _crfBlockLogSumExp(logAlpha + IDX2C(0, first + (T - 1) * stride, L), L, partials);
+    if (tid == 0)
+    {
+        logPartition[s] = logZ;
+        loss[s] = logZ - gold;
+    }
+}
+
+// see Matrix<ElemType>::CRFBackward() for comments
+// logBeta and, if given, the gradient of the scores; one block per sequence like _crfForward()
+template <class ElemType>
+__global__ void _crfBackward(const ElemType* alpha, const ElemType* labelIds, const ElemType* scores, const ElemType* transitions, const ElemType* sequences, const CUDA_LONG stride, const CUDA_LONG L,
+                             const ElemType* logAlpha, const ElemType* logPartition, ElemType* logBeta, ElemType* scoresGradient)
+{
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG s = blockIdx.x;
+    const CUDA_LONG first = (CUDA_LONG) sequences[2 * s];
+    const CUDA_LONG T = (CUDA_LONG) sequences[2 * s + 1];
+
+    for (CUDA_LONG t = T - 1; t >= 0; t--)
+    {
+        const CUDA_LONG j = first + t * stride;
+        for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+        {
+            ElemType b = 0;
+            if (t + 1 < T)
+            {
+                const CUDA_LONG next = j + stride;
+                ElemType maxv = transitions[IDX2C(0, k, L)] + scores[IDX2C(0, next, L)] + logBeta[IDX2C(0, next, L)];
+                ElemType sum = 1;
+                for (CUDA_LONG m = 1; m < L; m++)
+                {
+                    const ElemType v = transitions[IDX2C(m, k, L)] + scores[IDX2C(m, next, L)] + logBeta[IDX2C(m, next, L)];
+                    if (v > maxv)
+                    {
+                        sum = sum * exp_(maxv - v) + 1;
+                        maxv = v;
+                    }
+                    else
+                        sum += exp_(v - maxv);
+                }
+                b = maxv + log_(sum);
+            }
+            logBeta[IDX2C(k, j, L)] = b;
+        }
+        __syncthreads();
+    }
+
+    if (!scoresGradient)
+        return;
+    const ElemType a = alpha[0];
+    const ElemType logZ = logPartition[s];
+    for (CUDA_LONG t = 0; t < T; t++)
+    {
+        const CUDA_LONG j = first + t * stride;
+        const CUDA_LONG y = (CUDA_LONG) labelIds[j];
+        for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+            scoresGradient[IDX2C(k, j, L)] += a * (exp_(logAlpha[IDX2C(k, j, L)] + logBeta[IDX2C(k, j, L)] - logZ) - (k == y ? 1 : 0));
+    }
+}
+
+// see Matrix<ElemType>::CRFBackward() for comments
+// One thread per pair of labels, summing over all frames of all sequences, so that no atomics are needed.
+template <class ElemType>
+__global__ void _crfTransitionsGradient(const ElemType* alpha, const ElemType* labelIds, const ElemType* scores, const ElemType* transitions, const ElemType* sequences, const CUDA_LONG S,
+                                        const CUDA_LONG stride, const CUDA_LONG L, const ElemType* logAlpha, const ElemType* logPartition, const ElemType* logBeta, ElemType* transitionsGradient)
+{
+    const CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= L * L)
+        return;
+    const CUDA_LONG k = id % L;
+    const CUDA_LONG i = id / L;
+    const ElemType transition = transitions[id];
+    ElemType sum = 0;
+    for (CUDA_LONG s = 0; s < S; s++)
+    {
+        const CUDA_LONG first = (CUDA_LONG) sequences[2 * s];
+        const CUDA_LONG T = (CUDA_LONG) sequences[2 * s + 1];
+        const ElemType logZ = logPartition[s];
+        for (CUDA_LONG t = 1; t < T; t++)
+        {
+            const CUDA_LONG j = first + t * stride;
+            sum += exp_(logAlpha[IDX2C(i, j - stride, L)] + transition + scores[IDX2C(k, j, L)] + logBeta[IDX2C(k, j, L)] - logZ);
+            if ((CUDA_LONG) labelIds[j] == k && (CUDA_LONG) labelIds[j - stride] == i)
+                sum -= 1;
+        }
+    }
+    transitionsGradient[id] += alpha[0] * sum;
+}
+
+// see Matrix<ElemType>::CRFViterbi() for comments
+// the max-product counterpart of _crfForward(), followed by the backtrace by one thread
+template <class ElemType>
+__global__ void _crfViterbi(const ElemType* scores, const ElemType* transitions, const ElemType* sequences, const CUDA_LONG stride, const CUDA_LONG L,
+                            ElemType* bestScores, ElemType* backpointers, ElemType* path)
+{
+    __shared__ ElemType partialMax[crfThreadsPerBlock];
+    __shared__ CUDA_LONG partialArg[crfThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const CUDA_LONG s = blockIdx.x;
+    const CUDA_LONG first = (CUDA_LONG) sequences[2 * s];
+    const CUDA_LONG T = (CUDA_LONG) sequences[2 * s + 1];
+
+    for (CUDA_LONG t = 0; t < T; t++)
+    {
+        const CUDA_LONG j = first + t * stride;
+        for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+        {
+            ElemType best = 0;
+            CUDA_LONG from = 0;
+            if (t > 0)
+            {
+                const ElemType* prev = bestScores + IDX2C(0, j - stride, L);
+                best = prev[0] + transitions[IDX2C(k, 0, L)];
+                for (CUDA_LONG i = 1; i < L; i++)
+                {
+                    const ElemType v = prev[i] + transitions[IDX2C(k, i, L)];
+                    if (v > best)
+                    {
+                        best = v;
+                        from = i;
+                    }
+                }
+            }
+            bestScores[IDX2C(k, j, L)] = scores[IDX2C(k, j, L)] + best;
+            backpointers[IDX2C(k, j, L)] = (ElemType) from;
+        }
+        __syncthreads();
+    }
+
+    // best label at the last frame; ties go to the lower label
+    const CUDA_LONG last = first + (T - 1) * stride;
+    CUDA_LONG arg = 0;
+    ElemType maxv = bestScores[IDX2C(0, last, L)];
+    for (CUDA_LONG k = tid; k < L; k += crfThreadsPerBlock)
+    {
+        if (bestScores[IDX2C(k, last, L)] > maxv)
+        {
+            maxv = bestScores[IDX2C(k, last, L)];
+            arg = k;
+        }
+    }
+    partialMax[tid] = maxv;
+    partialArg[tid] = arg;
+    __syncthreads();
+    for (CUDA_LONG step = crfThreadsPerBlock / 2; step > 0; step /= 2)
+    {
+        if (tid < step)
+        {
+            const CUDA_LONG other = tid + step;
+            if (partialMax[other] > partialMax[tid] || (partialMax[other] == partialMax[tid] && partialArg[other] < partialArg[tid]))
+            {
+                partialMax[tid] = partialMax[other];
+                partialArg[tid] = partialArg[other];
+            }
+        }
+        __syncthreads();
+    }
+
+    if (tid == 0)
+    {
+        CUDA_LONG y = partialArg[0];
+        for (CUDA_LONG t = T - 1; t >= 0; t--)
+        {
+            const CUDA_LONG j = first + t * stride;
+            path[IDX2C(y, j, L)] = 1;
+            y = (CUDA_LONG) backpointers[IDX2C(y, j, L)];
+        }
+    }
+}
+
 // see Matrix<ElemType>::TensorShuffleScaleAndAdd() for comments
 template <class ElemType>
 __global__ void _tensorShuffleScaleAndAddRowSparse(
@@ -1403,6 +2323,56 @@ __global__ void _adagrad4BlockSparse(
         multipliers[id] = 1 / temp;
 }
 
+// FSAdagrad for the elements of a block-sparse gradient; smoothAda, smoothMom and val are dense with numRows rows
+template <class ElemType>
+__global__ void _fsadagrad4BlockSparse(
+    const size_t numRows,
+    const ElemType* d_v, // block sparse
+    const GPUSPARSE_INDEX_TYPE* blockId2ColOrRow,
+    ElemType* smoothAda, ElemType* smoothMom, ElemType* val,
+    ElemType lr, ElemType mom, ElemType adaWeight, ElemType adaMul,
+    const bool colMajor,
+    const size_t len,  // major dim, numRows in colMajor and numcols in rowMajor
+    const CUDA_LONG N) // total number of non-zero values
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+
+    CUDA_LONG blockid = id / len;
+    CUDA_LONG row = colMajor ? id - blockid * len : blockId2ColOrRow[blockid];
+    CUDA_LONG col = colMajor ? blockId2ColOrRow[blockid] : id - blockid * len;
+    size_t index = row + col * numRows;
+
+    ElemType g = d_v[id];
+    ElemType adaSqr = adaWeight * smoothAda[index] + (1.0f - adaWeight) * g * g;
+    smoothAda[index] = adaSqr;
+    if (adaSqr != 0.0f)
+    {
+        ElemType w;
+        if (sizeof(ElemType) == sizeof(double))
+        {
+            w = adaMul * rsqrt(adaSqr);
+        }
+        else
+        {
+            w = adaMul * rsqrtf(adaSqr);
+        }
+
+        if (w > 10.0f)
+            w = 10.0f;
+        g *= w;
+    }
+
+    if (mom > 0.0f)
+    {
+        g = mom * smoothMom[index] + (1.0f - mom) * g;
+        smoothMom[index] = g;
+    }
+
+    val[index] -= g * lr;
+}
+
 template <class ElemType>
 __global__ void _fsadagrad(CUDA_LONG size, ElemType* grad, ElemType* smoothAda, ElemType* smoothMom, ElemType* val,
                            ElemType lr, ElemType mom, ElemType adaWeight, ElemType adaMul)
@@ -1442,6 +2412,57 @@ __global__ void _fsadagrad(CUDA_LONG size, ElemType* grad, ElemType* smoothAda,
     }
 }
 
+// Adam update of one element; with 'directionOnly' (LAMB) the direction plus the weight decay is returned in g,
+// and the weight is left for the caller to update by the trust ratio
+template <class ElemType>
+__device__ __forceinline__ void _adamElement(ElemType& g, ElemType& m, ElemType& v, ElemType& w,
+                                             ElemType lr, ElemType beta1, ElemType beta2, ElemType epsilon,
+                                             ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+    m = beta1 * m + (1 - beta1) * g;
+    v = beta2 * v + (1 - beta2) * g * g;
+    ElemType d = m * biasCorrection1 / (sqrt(v * biasCorrection2) + epsilon);
+    if (directionOnly)
+        g = d + weightDecay * w;
+    else
+        w -= lr * d;
+}
+
+template <class ElemType>
+__global__ void _adam(CUDA_LONG size, ElemType* grad, ElemType* smoothMom, ElemType* smoothSqr, ElemType* val,
+                      ElemType lr, ElemType beta1, ElemType beta2, ElemType epsilon,
+                      ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+    CUDA_LONG idx = blockIdx.x * blockDim.x + threadIdx.x;
+    CUDA_LONG stride = blockDim.x * gridDim.x;
+    for (; idx < size; idx += stride)
+        _adamElement(grad[idx], smoothMom[idx], smoothSqr[idx], val[idx], lr, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+}
+
+// Adam for the elements of a block-sparse gradient; smoothMom, smoothSqr and val are dense with numRows rows
+template <class ElemType>
+__global__ void _adam4BlockSparse(
+    const size_t numRows,
+    ElemType* d_v, // block sparse
+    const GPUSPARSE_INDEX_TYPE* blockId2ColOrRow,
+    ElemType* smoothMom, ElemType* smoothSqr, ElemType* val,
+    ElemType lr, ElemType beta1, ElemType beta2, ElemType epsilon,
+    ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly,
+    const bool colMajor,
+    const size_t len,  // major dim, numRows in colMajor and numcols in rowMajor
+    const CUDA_LONG N) // total number of non-zero values
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+
+    CUDA_LONG blockid = id / len;
+    CUDA_LONG row = colMajor ? id - blockid * len : blockId2ColOrRow[blockid];
+    CUDA_LONG col = colMajor ? blockId2ColOrRow[blockid] : id - blockid * len;
+    size_t index = row + col * numRows;
+    _adamElement(d_v[id], smoothMom[index], smoothSqr[index], val[index], lr, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+}
+
 template <class ElemType>
 __global__ void _rmsprop_init(
     ElemType* avars, ElemType* signs, ElemType* steps,
@@ -1511,6 +2532,54 @@ __global__ void _rmsprop(
         multipliers[i] = temp;
 }
 
+// RmsProp for the elements of a block-sparse gradient; avars, signs and steps are dense with numRows rows
+// Elements whose step size is still 0 have not been touched before and are initialized as in _rmsprop_init.
+template <class ElemType>
+__global__ void _rmsprop4BlockSparse(
+    ElemType* avars, ElemType* signs, ElemType* steps,
+    const size_t numRows,
+    ElemType* d_v, // block sparse
+    const GPUSPARSE_INDEX_TYPE* blockId2ColOrRow,
+    const bool colMajor,
+    const size_t len,  // major dim, numRows in colMajor and numcols in rowMajor
+    const CUDA_LONG N, // total number of non-zero values
+    ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN,
+    ElemType floor,
+    ElemType* multipliers)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+
+    CUDA_LONG blockid = id / len;
+    CUDA_LONG row = colMajor ? id - blockid * len : blockId2ColOrRow[blockid];
+    CUDA_LONG col = colMajor ? blockId2ColOrRow[blockid] : id - blockid * len;
+    size_t i = row + col * numRows;
+
+    ElemType g = d_v[id];
+    if (steps[i] == 0)
+    {
+        avars[i] = g * g;
+        steps[i] = ElemType(0.02);
+    }
+
+    avars[i] = RMS_GAMMA * avars[i] + (ElemType(1.0) - RMS_GAMMA) * (g * g);
+
+    const int grad_sign = (ElemType(0) < g) - (g < ElemType(0));
+
+    if (signs[i] * grad_sign > 0)
+        steps[i] = min(steps[i] * RMS_WGT_INC, RMS_WGT_MAX);
+    else
+        steps[i] = max(steps[i] * RMS_WGT_DEC, RMS_WGT_MIN);
+
+    ElemType temp = steps[i] / sqrt(avars[i] + floor);
+    d_v[id] = g * temp;
+    signs[i] = grad_sign;
+
+    if (multipliers != nullptr)
+        multipliers[id] = temp;
+}
+
 template <class ElemType>
 __global__ void _rescaleToRange(
     ElemType* a,
@@ -1537,6 +2606,39 @@ __global__ void _setMaskAndScale(
     a[id] = a[id] <= maskRate ? 0 : scaleValue;
 }
 
+// see Matrix<ElemType>::SetPhiloxUniformRandomValue() for comments
+// one thread per four elements, which is one call of the generator
+template <class ElemType>
+__global__ void _setPhiloxRandomValue(ElemType* c, const CUDA_LONG N, const bool gaussian, const ElemType a, const ElemType b, const unsigned long long seed)
+{
+    const CUDA_LONG i = 4 * (blockDim.x * blockIdx.x + threadIdx.x);
+    if (i >= N)
+        return;
+    const Philox4x32 r = PhiloxRandomAt(seed, 0, i);
+    for (int slot = 0; slot < 4 && i + slot < N; slot++)
+        c[i + slot] = gaussian ? (ElemType)(a + b * PhiloxNormal(r, slot)) : (ElemType)(a + (b - a) * PhiloxUniform(r.v[slot]));
+}
+
+// see Matrix<ElemType>::AssignDropoutOf() for comments
+// c = beta * c + a .* mask, one thread per four elements of the random stream
+template <class ElemType>
+__global__ void _scaleAndAddDropoutOf(const ElemType beta, const ElemType* a, ElemType* c, const CUDA_LONG N, const ElemType dropoutRate, const ElemType scale,
+                                      const unsigned long long seed, const unsigned long long stream, const unsigned long long offset)
+{
+    const unsigned long long block = offset / 4 + blockDim.x * blockIdx.x + threadIdx.x;
+    if (4 * block >= offset + N)
+        return;
+    const Philox4x32 r = PhiloxRandomAt(seed, stream, 4 * block);
+    for (int slot = 0; slot < 4; slot++)
+    {
+        const long long i = (long long) (4 * block + slot) - (long long) offset;
+        if (i < 0 || i >= N)
+            continue;
+        const ElemType v = PhiloxUniform(r.v[slot]) < dropoutRate ? 0 : scale * a[i];
+        c[i] = beta == 0 ? v : beta * c[i] + v;
+    }
+}
+
 template <class ElemType>
 __global__ void _vectorSum(
     ElemType* c,       // output
@@ -2815,6 +3917,73 @@ __global__ void _shiftColCSCIndexFromSliceViewToAbsolute(
         colCSCIndex[cols] = nz;
 }
 
+// c = alpha * op(a) * b + beta * c, with b sparse CSC and few non-zeros per column (e.g. one-hot word inputs)
+// One thread per element of c, which is a gather of the rows of op(a) selected by the non-zeros of its column in b.
+// For one-hot b this is a (scaled) column copy; consecutive threads handle consecutive rows of c, so all accesses coalesce.
+template <class ElemType>
+__global__ void _denseMultSparseCSCAndWeightedAddToDense(
+    const int m, // rows of op(a) and c
+    const int k, // columns of op(a), rows of b
+    const int n, // columns of b and c
+    const ElemType alpha,
+    const ElemType* a, // dense
+    const bool transposeA,
+    const ElemType* bnzValues, // sparse nz values
+    const GPUSPARSE_INDEX_TYPE* rowIndex,
+    const GPUSPARSE_INDEX_TYPE* colCSCIndex,
+    const ElemType beta,
+    ElemType* c // dense target
+    )
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= m * n)
+        return;
+
+    int rowInC = id % m;
+    int colInC = id / m;
+
+    ElemType s = 0;
+    for (int p = colCSCIndex[colInC]; p < colCSCIndex[colInC + 1]; p++)
+    {
+        int i = rowIndex[p];
+        s += (transposeA ? a[IDX2C(i, rowInC, k)] : a[IDX2C(rowInC, i, m)]) * bnzValues[p];
+    }
+    c[id] = alpha * s + (beta == 0 ? 0 : beta * c[id]); // If beta is zero then don't lookup c
+}
+
+// c += alpha * op(a) * b^T, with b sparse CSC and few non-zeros per column (gradient of the above w.r.t. a dense weight)
+// One thread per element of op(a), which is scattered into the columns of c selected by the non-zeros of its column in b.
+// Different columns of b may select the same column of c (a word occurring multiple times in a minibatch), hence atomicAdd().
+template <class ElemType>
+__global__ void _denseMultSparseCSCTransposeAndAddToDense(
+    const int m, // rows of op(a) and c
+    const int n, // columns of op(a) and b
+    const ElemType alpha,
+    const ElemType* a, // dense
+    const bool transposeA,
+    const ElemType* bnzValues, // sparse nz values
+    const GPUSPARSE_INDEX_TYPE* rowIndex,
+    const GPUSPARSE_INDEX_TYPE* colCSCIndex,
+    ElemType* c // dense target
+    )
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= m * n)
+        return;
+
+    int rowInA = id % m;
+    int colInA = id / m;
+
+    int start = colCSCIndex[colInA];
+    int end = colCSCIndex[colInA + 1];
+    if (start == end)
+        return;
+
+    ElemType s = alpha * (transposeA ? a[IDX2C(colInA, rowInA, n)] : a[IDX2C(rowInA, colInA, m)]);
+    for (int p = start; p < end; p++)
+        atomicAdd(&c[IDX2C(rowInA, rowIndex[p], m)], s * bnzValues[p]);
+}
+
 //c = alpha * op(a) * op(b) + beta*c
 // TODO: This function can be further improved by loading the kernel in shared memory
 template <class ElemType>
@@ -4950,6 +6119,70 @@ __global__ void _copyTopKResults(const uint64_t* indexes, const ElemType* values
     maxValues[id] = values[icol * crow + irow];
 }
 
+// Top k of each column for a small k, without sorting the whole matrix (which a 32k-class output makes expensive).
+// Each block processes one column: every thread keeps the k largest values of its rows in descending order, and k
+// rounds of a block-wide max over the best remaining value of each thread then yield the column's top k in order.
+// Ties go to the lower row index, like the stable sort. There must be topKThreadsPerBlock threads in a block.
+static const int topKThreadsPerBlock = 128;
+static const int maxSmallTopK = 32;
+template <class ElemType>
+__global__ void _vectorTopK(const ElemType* us, ElemType* maxIndexes, ElemType* maxValues, const CUDA_LONG m, const int topK)
+{
+    __shared__ ElemType partialValues[topKThreadsPerBlock];
+    __shared__ CUDA_LONG partialRows[topKThreadsPerBlock];
+    const CUDA_LONG tid = threadIdx.x;
+    const ElemType* col = us + IDX2C(0, blockIdx.x, m);
+
+    ElemType localValues[maxSmallTopK];
+    CUDA_LONG localRows[maxSmallTopK];
+    int count = 0;
+    for (CUDA_LONG i = tid; i < m; i += topKThreadsPerBlock)
+    {
+        const ElemType v = col[i];
+        if (count == topK && !(localValues[topK - 1] < v))
+            continue;
+        int pos = count < topK ? count++ : topK - 1;
+        for (; pos > 0 && localValues[pos - 1] < v; pos--)
+        {
+            localValues[pos] = localValues[pos - 1];
+            localRows[pos] = localRows[pos - 1];
+        }
+        localValues[pos] = v;
+        localRows[pos] = i;
+    }
+
+    int head = 0; // the best value of this thread not taken yet; row m denotes none left
+    for (int k = 0; k < topK; k++)
+    {
+        partialValues[tid] = head < count ? localValues[head] : 0;
+        partialRows[tid] = head < count ? localRows[head] : m;
+        __syncthreads();
+        for (CUDA_LONG stride = topKThreadsPerBlock / 2; stride > 0; stride /= 2)
+        {
+            if (tid < stride)
+            {
+                const CUDA_LONG other = tid + stride;
+                if (partialRows[other] != m &&
+                    (partialRows[tid] == m || partialValues[tid] < partialValues[other] ||
+                     (partialValues[tid] == partialValues[other] && partialRows[other] < partialRows[tid])))
+                {
+                    partialValues[tid] = partialValues[other];
+                    partialRows[tid] = partialRows[other];
+                }
+            }
+            __syncthreads();
+        }
+        if (tid == 0)
+        {
+            maxValues[IDX2C(k, blockIdx.x, topK)] = partialValues[0];
+            maxIndexes[IDX2C(k, blockIdx.x, topK)] = (ElemType) partialRows[0];
+        }
+        if (head < count && localRows[head] == partialRows[0])
+            head++;
+        __syncthreads();
+    }
+}
+
 template <int BlockSize, class ElemType>
 __global__ void _assignNumOfDiffCol(const ElemType* a, const ElemType* b, ElemType* c, CUDA_LONG crowB, CUDA_LONG ccol)
 {
@@ -4995,6 +6228,79 @@ __global__ void _maskColumnsValue(ElemType* a, const char* columnsMask, CUDA_LON
         a[IDX2C(rowIdx, colIdx, numRows)] = val;
     }
 }
+
+// multi-tensor kernels (GPUMatrix::MultiTensorSumOfSquares() and MultiTensorSGDUpdate()): each block processes one
+// chunk of one tensor, so that a single launch covers all tensors regardless of their sizes
+template <class ElemType>
+struct MultiTensorDescriptor
+{
+    ElemType* weights;
+    ElemType* gradients;
+    ElemType* smoothedGradients;
+    CUDA_LONG numElements;
+    ElemType gradientScale;
+};
+
+struct MultiTensorChunk
+{
+    int tensor;
+    CUDA_LONG begin;
+};
+
+// partialSums[chunk] = sum of the squares of the chunk of the gradients
+template <int BlockSize, class ElemType>
+__global__ void _multiTensorSumOfSquares(const MultiTensorDescriptor<ElemType>* tensors, const MultiTensorChunk* chunks, const CUDA_LONG chunkSize, double* partialSums)
+{
+    const MultiTensorChunk chunk = chunks[blockIdx.x];
+    const MultiTensorDescriptor<ElemType> tensor = tensors[chunk.tensor];
+    const CUDA_LONG end = min(chunk.begin + chunkSize, tensor.numElements);
+    double sum = 0;
+    for (CUDA_LONG i = chunk.begin + threadIdx.x; i < end; i += BlockSize)
+    {
+        double g = tensor.gradients[i];
+        sum += g * g;
+    }
+
+    using BlockReduceT = cub::BlockReduce<double, BlockSize>;
+    __shared__ typename BlockReduceT::TempStorage tmp;
+    double res = BlockReduceT(tmp).Sum(sum);
+    if (threadIdx.x == 0)
+        partialSums[blockIdx.x] = res;
+}
+
+// the updates of Matrix::NormalGrad() (plain or Nesterov momentum) and of Matrix::Adagrad() followed by the step,
+// on the gradients after scaling, truncation (if truncation > 0) and the L2 term; the gradients themselves are left untouched
+template <class ElemType>
+__global__ void _multiTensorSGDUpdate(const MultiTensorDescriptor<ElemType>* tensors, const MultiTensorChunk* chunks, const CUDA_LONG chunkSize,
+                                      const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                      const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad)
+{
+    const MultiTensorChunk chunk = chunks[blockIdx.x];
+    const MultiTensorDescriptor<ElemType> tensor = tensors[chunk.tensor];
+    const CUDA_LONG end = min(chunk.begin + chunkSize, tensor.numElements);
+    for (CUDA_LONG i = chunk.begin + threadIdx.x; i < end; i += blockDim.x)
+    {
+        ElemType w = tensor.weights[i];
+        ElemType g = tensor.gradientScale * tensor.gradients[i];
+        if (truncation > 0)
+            g = max(-truncation, min(g, truncation));
+        g += l2RegWeight * w;
+        if (useAdaGrad)
+        {
+            const ElemType floor = 1e-16f;
+            ElemType s = tensor.smoothedGradients[i] + g * g;
+            tensor.smoothedGradients[i] = s;
+            w -= learnRatePerSample * g / sqrt(s + floor);
+        }
+        else
+        {
+            ElemType v = (1 - momentum) * learnRatePerSample * g + momentum * tensor.smoothedGradients[i];
+            tensor.smoothedGradients[i] = v;
+            w -= useNesterovMomentum ? momentum * v + (1 - momentum) * learnRatePerSample * g : v;
+        }
+        tensor.weights[i] = w;
+    }
+}
 }
 }
 }
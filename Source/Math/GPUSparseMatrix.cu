@@ -15,6 +15,8 @@
 #include "cublas_v2.h"
 #include "GPUMatrixCUDAKernels.cuh"
 #include <functional>
+#include <algorithm>
+#include <cmath>
 #include "CommonMatrix.h"
 #include <iostream> // for cout/cerr
 #include <assert.h>
@@ -86,6 +88,11 @@ void GPUSparseMatrix<ElemType>::ZeroInit(const MatrixFormat matrixFormat, const
 
     m_tempHostBuffer = nullptr;
     m_tempHostBufferSize = 0;
+
+    m_tempDeviceBuffer = nullptr;
+    m_tempDeviceBufferSize = 0;
+
+    m_nzMean = m_nzMeanSquare = 0;
 }
 
 template <class ElemType>
@@ -192,13 +199,14 @@ void GPUSparseMatrix<ElemType>::SetValue(const CPUSparseMatrix<ElemType>& deepCo
         return;
     }
 
+    // both sides use the same index type and layout, so this is a straight copy of the arrays in use (no format conversion)
     if (deepCopy.GetFormat() == matrixFormatSparseCSR)
     {
-        SetMatrixFromCSRFormat(deepCopy.RowLocation(), deepCopy.ColLocation(), deepCopy.BufferPointer(), deepCopy.GetNumElemAllocated(), deepCopy.GetNumRows(), deepCopy.GetNumCols());
+        SetMatrixFromCSRFormat(deepCopy.RowLocation(), deepCopy.ColLocation(), deepCopy.BufferPointer(), deepCopy.NzCount(), deepCopy.GetNumRows(), deepCopy.GetNumCols());
     }
     else if (deepCopy.GetFormat() == matrixFormatSparseCSC)
     {
-        SetMatrixFromCSCFormat(deepCopy.ColLocation(), deepCopy.RowLocation(), deepCopy.BufferPointer(), deepCopy.GetNumElemAllocated(), deepCopy.GetNumRows(), deepCopy.GetNumCols());
+        SetMatrixFromCSCFormat(deepCopy.ColLocation(), deepCopy.RowLocation(), deepCopy.BufferPointer(), deepCopy.NzCount(), deepCopy.GetNumRows(), deepCopy.GetNumCols());
     }
     else
         NOT_IMPLEMENTED;
@@ -497,7 +505,7 @@ void GPUSparseMatrix<ElemType>::SetValue(const GPUMatrix<ElemType>& denseMatrix,
     int numRows = (int) denseMatrix.GetNumRows(); // m
     int numCols = (int) denseMatrix.GetNumCols(); // n
 
-    int* nnzPerRowOrCol = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(m_computeDevice, ((matrixFormat & matrixFormatRowMajor) ? numRows : numCols));
+    int* nnzPerRowOrCol = (GPUSPARSE_INDEX_TYPE*) ReserveTempDeviceBuffer(sizeof(GPUSPARSE_INDEX_TYPE) * ((matrixFormat & matrixFormatRowMajor) ? numRows : numCols));
     int nnzTotalDevHostPtr = -1;
 
     cudaEvent_t done = nullptr;
@@ -595,6 +603,12 @@ GPUSparseMatrix<ElemType>::GPUSparseMatrix(GPUSparseMatrix<ElemType>&& moveFrom)
     m_tempHostBuffer = moveFrom.m_tempHostBuffer;
     m_tempHostBufferSize = moveFrom.m_tempHostBufferSize;
 
+    m_tempDeviceBuffer = moveFrom.m_tempDeviceBuffer;
+    m_tempDeviceBufferSize = moveFrom.m_tempDeviceBufferSize;
+
+    m_nzMean = moveFrom.m_nzMean;
+    m_nzMeanSquare = moveFrom.m_nzMeanSquare;
+
     moveFrom.ZeroInit(moveFrom.m_format, moveFrom.m_computeDevice); // so that memory in moveFrom is not freeed
 }
 
@@ -625,6 +639,12 @@ GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::operator=(GPUSparseMatrix<
         m_tempHostBuffer = moveFrom.m_tempHostBuffer;
         m_tempHostBufferSize = moveFrom.m_tempHostBufferSize;
 
+        m_tempDeviceBuffer = moveFrom.m_tempDeviceBuffer;
+        m_tempDeviceBufferSize = moveFrom.m_tempDeviceBufferSize;
+
+        m_nzMean = moveFrom.m_nzMean;
+        m_nzMeanSquare = moveFrom.m_nzMeanSquare;
+
         moveFrom.ZeroInit(moveFrom.m_format, moveFrom.m_computeDevice);
     }
 
@@ -657,6 +677,8 @@ void GPUSparseMatrix<ElemType>::ReleaseMemory()
         TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(m_computeDevice, m_rowToId);
         m_rowToId = nullptr;
     }
+    if (m_tempDeviceBuffer != nullptr)
+        TracingGPUMemoryAllocator::Free<char>(m_computeDevice, (char*) m_tempDeviceBuffer);
 
     ZeroInit(m_format, m_computeDevice);
 }
@@ -757,11 +779,33 @@ void GPUSparseMatrix<ElemType>::Resize(const size_t numRows, const size_t numCol
     if (matrixFormat != m_format || m_numRows != numRows || m_numCols != numCols)
         keepExistingValues = false;
 
+    // track the requested nonzero counts, which vary from minibatch to minibatch
+    const double nzSmoothing = 0.1;
+    if (m_nzMean == 0)
+    {
+        m_nzMean = (double) numNZElemToReserve;
+        m_nzMeanSquare = m_nzMean * m_nzMean;
+    }
+    else
+    {
+        m_nzMean += nzSmoothing * (numNZElemToReserve - m_nzMean);
+        m_nzMeanSquare += nzSmoothing * ((double) numNZElemToReserve * numNZElemToReserve - m_nzMeanSquare);
+    }
+
+    size_t numNZToAllocate = numNZElemToReserve;
     size_t bufferSizeNeeded = BufferSizeNeeded(numRows, numCols, numNZElemToReserve, matrixFormat);
     bool reallocate = (m_totalBufferSizeAllocated < bufferSizeNeeded || (!growOnly && m_totalBufferSizeAllocated > bufferSizeNeeded));
 
     if (reallocate)
     {
+        // A matrix that outgrows its buffer is typically reused from minibatch to minibatch; reserving room for the counts to come
+        // keeps it from being reallocated at every new peak. (A new matrix gets what is asked for, since some callers rely on that.)
+        if (growOnly && m_totalBufferSizeAllocated > 0)
+        {
+            numNZToAllocate = NzCountToReserve(numRows, numCols, numNZElemToReserve);
+            bufferSizeNeeded = BufferSizeNeeded(numRows, numCols, numNZToAllocate, matrixFormat);
+        }
+
         ElemType* pArray = TracingGPUMemoryAllocator::Allocate<ElemType>(m_computeDevice, bufferSizeNeeded / sizeof(ElemType));
 
         if (m_pArray != nullptr)
@@ -773,11 +817,11 @@ void GPUSparseMatrix<ElemType>::Resize(const size_t numRows, const size_t numCol
 
                 CUDA_CALL(cudaMemcpy(pArray, BufferPointer(), GetSizeElemAllocated(), cudaMemcpyDeviceToDevice));
 
-                GPUSPARSE_INDEX_TYPE* majorIndexInNewBuffer = (GPUSPARSE_INDEX_TYPE*) (pArray + numNZElemToReserve);
+                GPUSPARSE_INDEX_TYPE* majorIndexInNewBuffer = (GPUSPARSE_INDEX_TYPE*) (pArray + numNZToAllocate);
 
                 CUDA_CALL(cudaMemcpy(majorIndexInNewBuffer, MajorIndexLocation(), MajorIndexSize(), cudaMemcpyDeviceToDevice));
 
-                GPUSPARSE_INDEX_TYPE* secondaryIndexInNewBuffer = majorIndexInNewBuffer + MajorIndexCount(numRows, numCols, numNZElemToReserve, matrixFormat);
+                GPUSPARSE_INDEX_TYPE* secondaryIndexInNewBuffer = majorIndexInNewBuffer + MajorIndexCount(numRows, numCols, numNZToAllocate, matrixFormat);
                 CUDA_CALL(cudaMemcpy(secondaryIndexInNewBuffer, SecondaryIndexLocation(), SecondaryIndexSize(), cudaMemcpyDeviceToDevice));
             }
             else
@@ -792,10 +836,10 @@ void GPUSparseMatrix<ElemType>::Resize(const size_t numRows, const size_t numCol
         if (m_rowToId != nullptr)
             TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(m_computeDevice, m_rowToId);
 
-        m_rowToId = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(m_computeDevice, numNZElemToReserve);
+        m_rowToId = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(m_computeDevice, numNZToAllocate);
 
         m_totalBufferSizeAllocated = bufferSizeNeeded;
-        m_elemSizeAllocated = numNZElemToReserve;
+        m_elemSizeAllocated = numNZToAllocate;
     }
     else // if requested size is smaller, keeping original values does not make sense
     {
@@ -807,6 +851,46 @@ void GPUSparseMatrix<ElemType>::Resize(const size_t numRows, const size_t numCol
     m_format = matrixFormat;
 }
 
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& columnValues) const
+{
+    if (m_format != matrixFormatSparseBlockCol)
+        LogicError("GetSparseBlockColumns: Matrix must be in sparse block-column format.");
+
+    columnIds.resize(m_blockSize);
+    columnValues.resize(m_blockSize * m_numRows);
+    if (m_blockSize == 0)
+        return;
+
+    PrepareDevice();
+    std::vector<GPUSPARSE_INDEX_TYPE> blockIds(m_blockSize);
+    CUDA_CALL(cudaMemcpy(blockIds.data(), BlockId2ColOrRow(), sizeof(GPUSPARSE_INDEX_TYPE) * m_blockSize, cudaMemcpyDeviceToHost));
+    CUDA_CALL(cudaMemcpy(columnValues.data(), BufferPointer(), sizeof(ElemType) * columnValues.size(), cudaMemcpyDeviceToHost));
+    for (size_t j = 0; j < m_blockSize; j++)
+        columnIds[j] = (size_t) blockIds[j];
+}
+
+// Note: only the block-to-column map is set up, which is all that the consumers of block-column matrices (ScaleAndAdd(), the gradient updates) use.
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& columnValues)
+{
+    if (!OwnBuffer())
+        LogicError("Cannot modify since the buffer is managed externally.");
+    if (columnValues.size() != columnIds.size() * numRows)
+        InvalidArgument("SetSparseBlockColumns: Expected %d values for %d columns of %d rows.", (int) (columnIds.size() * numRows), (int) columnIds.size(), (int) numRows);
+
+    Resize(numRows, numCols, columnValues.size(), matrixFormatSparseBlockCol, true, false);
+    m_blockSize = columnIds.size();
+    SetNzCount(columnValues.size());
+    if (m_blockSize == 0)
+        return;
+
+    PrepareDevice();
+    std::vector<GPUSPARSE_INDEX_TYPE> blockIds(columnIds.begin(), columnIds.end());
+    CUDA_CALL(cudaMemcpy(BlockId2ColOrRow(), blockIds.data(), sizeof(GPUSPARSE_INDEX_TYPE) * m_blockSize, cudaMemcpyHostToDevice));
+    CUDA_CALL(cudaMemcpy(BufferPointer(), columnValues.data(), sizeof(ElemType) * columnValues.size(), cudaMemcpyHostToDevice));
+}
+
 //Reset matrix so it can be reused
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::Reset()
@@ -1010,7 +1094,42 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
     c.PrepareDevice();
     if (rhs.m_format == MatrixFormat::matrixFormatSparseCSC)
     {
-        ConvolveAndWeightedAdd(alpha, lhs, transposeA, rhs, transposeB, beta, c, 1, 1, false, false);
+        // Sparse inputs are typically one-hot (one non-zero per column), for which the product is a column gather (forward)
+        // resp. scatter-add (gradient). We process each column of rhs with one thread per dense row, which is exact for any
+        // CSC matrix, but is designed for very few non-zeros per column.
+        cudaEvent_t done = nullptr;
+        if (do_sync)
+            CUDA_CALL(cudaEventCreate(&done));
+        if (!transposeB)
+        {
+            int blocksPerGrid = (int) ceil(1.0 * m * n / GridDim::maxThreadsPerBlock);
+            _denseMultSparseCSCAndWeightedAddToDense<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+                m, k, n, alpha,
+                reinterpret_cast<const ElemType*>(lhs.BufferPointer()), transposeA,
+                reinterpret_cast<const ElemType*>(rhs.BufferPointer()), rhs.RowLocation(), rhs.ColLocation(),
+                beta, reinterpret_cast<ElemType*>(c.BufferPointer()));
+        }
+        else
+        {
+            // c = beta * c first, then scatter-add
+            if (beta == 0)
+                CUDA_CALL(cudaMemset(c.BufferPointer(), 0, sizeof(ElemType) * c.GetNumElements()));
+            else if (beta != 1)
+                GPUMatrix<ElemType>::Scale(beta, c);
+            int numCols = (int) rhs.GetNumCols(); // (= columns of op(lhs))
+            int blocksPerGrid = (int) ceil(1.0 * m * numCols / GridDim::maxThreadsPerBlock);
+            _denseMultSparseCSCTransposeAndAddToDense<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+                m, numCols, alpha,
+                reinterpret_cast<const ElemType*>(lhs.BufferPointer()), transposeA,
+                reinterpret_cast<const ElemType*>(rhs.BufferPointer()), rhs.RowLocation(), rhs.ColLocation(),
+                reinterpret_cast<ElemType*>(c.BufferPointer()));
+        }
+        if (do_sync)
+            CUDA_CALL(cudaEventRecord(done));
+        if (do_sync)
+            CUDA_CALL(cudaEventSynchronize(done));
+        if (do_sync)
+            CUDA_CALL(cudaEventDestroy(done));
     }
     else if (rhs.m_format == matrixFormatSparseCSR)
     {
@@ -1238,7 +1357,7 @@ void GPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const GPUMatrix<E
         {
             c.Resize(m, n, 1, true, false); // reserve memory for BlockId2ColOrRow() and ColOrRow2BlockId()
 
-            size_t* blockSize = TracingGPUMemoryAllocator::Allocate<size_t>(lhs.GetComputeDeviceId(), 1);
+            size_t* blockSize = (size_t*) c.ReserveTempDeviceBuffer(sizeof(size_t));
             CUDA_CALL(cudaMemset(blockSize, 0, sizeof(size_t)));
 
             CUDA_CALL(cudaMemset(c.BlockId2ColOrRow(), 0, sizeof(GPUSPARSE_INDEX_TYPE) * (n)));
@@ -1261,7 +1380,6 @@ void GPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const GPUMatrix<E
                 CUDA_CALL(cudaEventSynchronize(done));
 
             CUDA_CALL(cudaMemcpy(&c.m_blockSize, blockSize, sizeof(size_t), cudaMemcpyDeviceToHost));
-            TracingGPUMemoryAllocator::Free<size_t>(lhs.GetComputeDeviceId(), blockSize);
 
             size_t nnz = m * c.m_blockSize;
             c.Resize(m, n, nnz, true, true); // we need to keep the col2blockid and blockid2col info when resizing.
@@ -1390,6 +1508,56 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSpars
     }
 }
 
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxForward() for comments
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxForward(const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& columnLoss)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    CUDA_LONG M = (CUDA_LONG) logits.GetNumRows();
+    int blocksPerGrid = (int) logits.GetNumCols();
+    logits.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    _crossEntropyWithSoftmaxSparseLabelsForward<ElemType><<<blocksPerGrid, crossEntropyThreadsPerBlock, 0, t_stream>>>(
+        labels.BufferPointer(), labels.RowLocation(), labels.ColLocation(),
+        logits.BufferPointer(), logSumExp.BufferPointer(), columnLoss.BufferPointer(), M);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
+// see Matrix<ElemType>::CrossEntropyWithSoftmaxBackward() for comments
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(const GPUMatrix<ElemType>& alpha, const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp,
+                                                                GPUMatrix<ElemType>& gradient)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    CUDA_LONG M = (CUDA_LONG) logits.GetNumRows();
+    CUDA_LONG N = (CUDA_LONG) logits.GetNumElements();
+    logits.PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    _crossEntropyWithSoftmaxSparseLabelsBackward<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+        alpha.BufferPointer(), labels.BufferPointer(), labels.RowLocation(), labels.ColLocation(),
+        logits.BufferPointer(), logSumExp.BufferPointer(), gradient.BufferPointer(), M, N);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
 template <class ElemType>
 GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::InplaceTruncate(const ElemType threshold)
 {
@@ -1539,6 +1707,117 @@ ElemType GPUSparseMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& c, const bool n
     }
 }
 
+// FSAdagrad update of the values touched by the block-sparse gradients (this); c has the layout of the dense FSAdagrad
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::FSAdagrad(GPUMatrix<ElemType>& c, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul)
+{
+    if (m_format != MatrixFormat::matrixFormatSparseBlockCol && m_format != MatrixFormat::matrixFormatSparseBlockRow)
+        NOT_IMPLEMENTED;
+
+    size_t numColsNeeded = 2 * GetNumCols();
+    if (c.IsEmpty() || c.GetNumCols() < numColsNeeded)
+    {
+        c.Resize(GetNumRows(), numColsNeeded);
+        c.SetValue(0.0);
+    }
+
+    assert(c.GetNumRows() == GetNumRows() && c.GetNumCols() == numColsNeeded);
+
+    size_t n = GetNumElements();
+    int blocksPerGrid = (m_nz + GridDim::maxThreadsPerBlock - 1) / GridDim::maxThreadsPerBlock;
+    bool colMajor = (m_format == MatrixFormat::matrixFormatSparseBlockCol ? true : false);
+    size_t len = colMajor ? GetNumRows() : GetNumCols();
+    _fsadagrad4BlockSparse<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock>>>(GetNumRows(), BufferPointer(), BlockId2ColOrRow(), c.GetArray(), c.GetArray() + n, functionValues.GetArray(),
+                                                                                     learnRatePerSample, momentum, adaWeight, adaMul, colMajor, len, m_nz);
+}
+
+// Adam update of the values touched by the block-sparse gradients (this); c has the layout of the dense Adam.
+// With 'directionOnly' (LAMB) the direction overwrites the nonzeros of this instead.
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::Adam(GPUMatrix<ElemType>& c, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+                              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+    if (m_format != MatrixFormat::matrixFormatSparseBlockCol && m_format != MatrixFormat::matrixFormatSparseBlockRow)
+        NOT_IMPLEMENTED;
+
+    size_t numColsNeeded = 2 * GetNumCols();
+    if (c.IsEmpty() || c.GetNumCols() < numColsNeeded)
+    {
+        c.Resize(GetNumRows(), numColsNeeded);
+        c.SetValue(0.0);
+    }
+
+    assert(c.GetNumRows() == GetNumRows() && c.GetNumCols() == numColsNeeded);
+
+    size_t n = GetNumElements();
+    int blocksPerGrid = (m_nz + GridDim::maxThreadsPerBlock - 1) / GridDim::maxThreadsPerBlock;
+    bool colMajor = (m_format == MatrixFormat::matrixFormatSparseBlockCol ? true : false);
+    size_t len = colMajor ? GetNumRows() : GetNumCols();
+    _adam4BlockSparse<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock>>>(GetNumRows(), BufferPointer(), BlockId2ColOrRow(), c.GetArray(), c.GetArray() + n, functionValues.GetArray(),
+                                                                                learnRatePerSample, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly,
+                                                                                colMajor, len, m_nz);
+}
+
+// RmsProp scaling of the block-sparse gradients (this); c has the layout of the dense RmsProp
+template <class ElemType>
+ElemType GPUSparseMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& c,
+                                            ElemType RMS_GAMMA,
+                                            ElemType RMS_WGT_INC,
+                                            ElemType RMS_WGT_MAX,
+                                            ElemType RMS_WGT_DEC,
+                                            ElemType RMS_WGT_MIN,
+                                            const bool needAveMultiplier)
+{
+    if (!OwnBuffer())
+        LogicError("Cannot modify since the buffer is managed externally.");
+    if (m_format != MatrixFormat::matrixFormatSparseBlockCol && m_format != MatrixFormat::matrixFormatSparseBlockRow)
+        NOT_IMPLEMENTED;
+
+    const ElemType floor = 1e-6f;
+
+    size_t numColsNeeded = GetNumCols() * 3;
+    if (needAveMultiplier)
+        numColsNeeded += GetNumCols();
+
+    if (c.IsEmpty() || c.GetNumCols() < numColsNeeded)
+    {
+        c.Resize(GetNumRows(), numColsNeeded);
+        c.SetValue(0.0);
+    }
+
+    size_t n = GetNumElements();
+    ElemType* avars = c.GetArray();         // accumulated variances for RMS scaling
+    ElemType* signs = c.GetArray() + n;     // sign of previous gradient
+    ElemType* steps = c.GetArray() + 2 * n; // current step size
+
+    ElemType* multipliers = nullptr;
+    if (needAveMultiplier)
+        multipliers = c.GetArray() + 3 * n; // temp memory used to store multipliers
+
+    int blocksPerGrid = (m_nz + GridDim::maxThreadsPerBlock - 1) / GridDim::maxThreadsPerBlock;
+    bool colMajor = (m_format == MatrixFormat::matrixFormatSparseBlockCol ? true : false);
+    size_t len = colMajor ? GetNumRows() : GetNumCols();
+    _rmsprop4BlockSparse<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock>>>(avars, signs, steps, GetNumRows(), BufferPointer(), BlockId2ColOrRow(), colMajor, len, m_nz,
+                                                                                   RMS_GAMMA, RMS_WGT_INC, RMS_WGT_MAX, RMS_WGT_DEC, RMS_WGT_MIN, floor, multipliers);
+
+    if (!needAveMultiplier || m_nz == 0)
+        return 1;
+
+    cublasHandle_t cuHandle = GPUMatrix<ElemType>::GetCublasHandle(GetComputeDeviceId());
+    if (sizeof(ElemType) == sizeof(float))
+    {
+        float aveMultiplier = 0;
+        CUBLAS_CALL(cublasSasum(cuHandle, (LONG64) m_nz, reinterpret_cast<float*>(multipliers), 1, &aveMultiplier));
+        return (ElemType) aveMultiplier / m_nz;
+    }
+    else
+    {
+        double aveMultiplier = 0;
+        CUBLAS_CALL(cublasDasum(cuHandle, (LONG64) m_nz, reinterpret_cast<double*>(multipliers), 1, &aveMultiplier));
+        return (ElemType) aveMultiplier / m_nz;
+    }
+}
+
 //-------------------------------------------------------------------------
 // End of new GPU Sparse Matrix code
 //-------------------------------------------------------------------------
@@ -2850,6 +3129,36 @@ void* GPUSparseMatrix<ElemType>::ReserveTempHostBuffer(const size_t sizeInByte)
     return (void*) m_tempHostBuffer;
 }
 
+// ReserveTempDeviceBuffer - scratch on the device for temporaries of format conversions, kept for the next conversion
+// It grows geometrically, since its size follows the minibatch.
+template <class ElemType>
+void* GPUSparseMatrix<ElemType>::ReserveTempDeviceBuffer(const size_t sizeInByte) const
+{
+    if (m_tempDeviceBufferSize < sizeInByte)
+    {
+        const size_t newSize = std::max(sizeInByte, m_tempDeviceBufferSize + m_tempDeviceBufferSize / 2);
+        if (m_tempDeviceBuffer != nullptr)
+            TracingGPUMemoryAllocator::Free<char>(m_computeDevice, (char*) m_tempDeviceBuffer);
+        m_tempDeviceBuffer = TracingGPUMemoryAllocator::Allocate<char>(m_computeDevice, newSize);
+        m_tempDeviceBufferSize = newSize;
+    }
+    return m_tempDeviceBuffer;
+}
+
+// NzCountToReserve - the nonzero capacity to reallocate a growing matrix with, for a request of 'numNZ'
+// The larger of a geometric growth of the current capacity and a prediction of the coming counts (mean + 3 standard
+// deviations of the recent ones), but no more than a dense matrix would hold.
+template <class ElemType>
+size_t GPUSparseMatrix<ElemType>::NzCountToReserve(const size_t numRows, const size_t numCols, const size_t numNZ) const
+{
+    const double growthFactor = 1.5;
+    const double variance = std::max(0.0, m_nzMeanSquare - m_nzMean * m_nzMean);
+    const double predicted = m_nzMean + 3 * std::sqrt(variance);
+    size_t reserve = (size_t) std::max(growthFactor * m_elemSizeAllocated, predicted);
+    reserve = std::min(reserve, numRows * numCols);
+    return std::max(reserve, numNZ);
+}
+
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::performElementWiseFunction(ElementWiseOperator kind, const GPUSparseMatrix<ElemType>& src)
 {
@@ -2950,23 +3259,15 @@ MATH_API File& operator>>(File& stream, GPUSparseMatrix<ElemType>& us)
         CPUSPARSE_INDEX_TYPE* unCompressedIndex = new CPUSPARSE_INDEX_TYPE[nz];
         CPUSPARSE_INDEX_TYPE* compressedIndex = new CPUSPARSE_INDEX_TYPE[compressedSize];
 
-        // read in the sparse matrix info
+        // read in the sparse matrix info; the indices are stored as size_t
+        stream.ReadArray(dataBuffer, nz);
+        std::vector<size_t> indexBuffer(std::max(nz, compressedSize));
+        stream.ReadArray(indexBuffer.data(), nz);
         for (size_t i = 0; i < nz; ++i)
-        {
-            stream >> dataBuffer[i];
-        }
-        for (size_t i = 0; i < nz; ++i)
-        {
-            size_t val;
-            stream >> val;
-            unCompressedIndex[i] = val;
-        }
+            unCompressedIndex[i] = (CPUSPARSE_INDEX_TYPE) indexBuffer[i];
+        stream.ReadArray(indexBuffer.data(), compressedSize);
         for (size_t i = 0; i < compressedSize; ++i)
-        {
-            size_t val;
-            stream >> val;
-            compressedIndex[i] = val;
-        }
+            compressedIndex[i] = (CPUSPARSE_INDEX_TYPE) indexBuffer[i];
 
         if (us.m_format == matrixFormatSparseCSC)
             us.SetMatrixFromCSCFormat(compressedIndex, unCompressedIndex, dataBuffer, nz, rownum, colnum);
@@ -3024,20 +3325,11 @@ MATH_API File& operator<<(File& stream, const GPUSparseMatrix<ElemType>& us)
         else
             NOT_IMPLEMENTED;
 
-        for (size_t i = 0; i < nz; ++i)
-        {
-            stream << dataBuffer[i];
-        }
-        for (size_t i = 0; i < nz; ++i)
-        {
-            size_t val = unCompressedIndex[i];
-            stream << val;
-        }
-        for (size_t i = 0; i < compressedSize; ++i)
-        {
-            size_t val = compressedIndex[i];
-            stream << val;
-        }
+        stream.WriteArray(dataBuffer, nz);
+        std::vector<size_t> indexBuffer(unCompressedIndex, unCompressedIndex + nz);
+        stream.WriteArray(indexBuffer.data(), nz);
+        indexBuffer.assign(compressedIndex, compressedIndex + compressedSize);
+        stream.WriteArray(indexBuffer.data(), compressedSize);
 
         delete[] dataBuffer;
         delete[] unCompressedIndex;
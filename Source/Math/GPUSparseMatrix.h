@@ -238,6 +238,10 @@ public:
     GPUMatrix<ElemType> CopyToDenseMatrix() const;
     void CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatrix) const;
     void CopyToCPUSparseMatrix(CPUSparseMatrix<ElemType>& cpuSparseMatrix) const;
+
+    // access to the columns present in sparse block-column format, as host copies: the column ids and their values (column-major, GetNumRows() per column)
+    void GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& columnValues) const;
+    void SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& columnValues);
     void ChangeDeviceTo(DEVICEID_TYPE toId);
 
     GPUSparseMatrix<ElemType>& operator=(const GPUSparseMatrix<ElemType>& deepCopy);
@@ -328,12 +332,20 @@ public:
     static void MultiplyAndAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs,
                                const bool transposeB, GPUSparseMatrix<ElemType>& c);
     static void ScaleAndAdd(const ElemType alpha, const GPUSparseMatrix<ElemType>& lhs, GPUMatrix<ElemType>& c);
+    // see Matrix<ElemType>::CrossEntropyWithSoftmaxForward/Backward(), for labels in CSC format
+    static void CrossEntropyWithSoftmaxForward(const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& columnLoss);
+    static void CrossEntropyWithSoftmaxBackward(const GPUMatrix<ElemType>& alpha, const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp,
+                                                GPUMatrix<ElemType>& gradient);
     static void ConvolveAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs,
                                        const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise);
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUSparseMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUSparseMatrix<ElemType>& b, GPUSparseMatrix<ElemType>& c);
 
     void NormalGrad(GPUMatrix<ElemType>& c, const ElemType momentum);
     ElemType Adagrad(GPUMatrix<ElemType>& c, const bool needAveMultiplier);
+    void FSAdagrad(GPUMatrix<ElemType>& c, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul);
+    void Adam(GPUMatrix<ElemType>& c, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly);
+    ElemType RmsProp(GPUMatrix<ElemType>& c, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
     static void Multiply(const GPUSparseMatrix<ElemType>& S, const GPUMatrix<ElemType>& D, GPUMatrix<ElemType>& C);
     static void Multiply(const GPUMatrix<ElemType>& D, const GPUSparseMatrix<ElemType>& S, GPUMatrix<ElemType>& C);
@@ -364,6 +376,8 @@ public:
 
 private:
     void* ReserveTempHostBuffer(const size_t sizeInByte) const;
+    void* ReserveTempDeviceBuffer(const size_t sizeInByte) const;
+    size_t NzCountToReserve(const size_t numRows, const size_t numCols, const size_t numNZ) const;
     template <class OutType, class InType>
     static void CopyBuffer(OutType* outBuffer, const InType* inBuffer, const size_t size);
 
@@ -391,6 +405,13 @@ private:
     mutable void* m_tempHostBuffer; // used to copy values.
     mutable size_t m_tempHostBufferSize;
 
+    mutable void* m_tempDeviceBuffer; // scratch of format conversions, kept for the next one (not shared with slices)
+    mutable size_t m_tempDeviceBufferSize;
+
+    // exponential moving mean and mean square of the nonzero counts that Resize() was asked for, to predict the next ones
+    double m_nzMean;
+    double m_nzMeanSquare;
+
     static bool do_sync;
 };
 } } }
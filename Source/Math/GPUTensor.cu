@@ -428,24 +428,28 @@ struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/true, /*k=*/-1>
             sum += val;
         }
 
-        // reduce    --cf https://docs.nvidia.com/cuda/samples/6_Advanced/reduction/doc/reduction.pdf
-        __shared__ ReduceElemType accumulators[GridDim::maxThreadsPerBlock /*tids*/];
-        accumulators[tid] = sum;
+        // reduce hierarchically: within each warp (register shuffles on sm_30+), then the per-warp sums within the block (shared memory),
+        // and finally across blocks (atomicAdd() below)
+        // The launch code makes tids a multiple of the warp size, so that all warps are complete.
+        typedef cub::WarpReduce<ReduceElemType> WarpReduce;
+        static_assert(GridDim::maxWarpsPerBlock <= 32, "GridDim::maxWarpsPerBlock too large, the per-warp sums must fit into a single warp");
+        __shared__ typename WarpReduce::TempStorage warpReduceStorage[GridDim::maxWarpsPerBlock];
+        __shared__ ReduceElemType warpSums[GridDim::maxWarpsPerBlock];
+        CUDA_LONG warp = tid / warpSize;
+        CUDA_LONG lane = tid % warpSize;
+        ReduceElemType warpSum = WarpReduce(warpReduceStorage[warp]).Sum(sum);
+        if (lane == 0)
+            warpSums[warp] = warpSum;
         __syncthreads();
-        static_assert(GridDim::maxThreadsPerBlock <= 512, "GridDim::maxThreadsPerBlock too large, need to add manually unrolled steps");
-        for (CUDA_LONG i = 256; i; i >>= 1)
-        {
-            if (tid < i && tid + i < tids)
-                accumulators[tid] += accumulators[tid + i];
-            if (0 + i < tids)
-                __syncthreads(); // sync if condition true for at least one thread
-            // TODO: use volatile* and then we can skip the __syncthreads() for the last 32 values. See Amit's allreduce() function implementation in MatrixQuantizer_kernel.cu.
-        }
+        if (warp != 0)
+            return;
+        CUDA_LONG warps = tids / warpSize;
+        ReduceElemType blockSum = WarpReduce(warpReduceStorage[0]).Sum(lane < warps ? warpSums[lane] : (ReduceElemType) 0);
 
         // now set final value to output coordinate
         if (tid == 0)
         {
-            ElemType val = (ElemType) accumulators[0];
+            ElemType val = (ElemType) blockSum;
             // scale
             val *= alpha;
             // combine with previous value in target matrix, then write it out
@@ -481,10 +485,123 @@ __global__ void _launchTensorOp(ElemType beta, FixedArray<ElemType*, N> pointers
         TensorOpElement<ElemType, N, M, K, false, K - 1>::Compute(id, beta, pointers, alpha, op, regularOpStrides, regularStrides, reducingOpDims, reducingStrides, 0, 0);
 }
 
+// -----------------------------------------------------------------------
+// kernel and launch  --linear, i.e. all operands are gap-free vectors (after flattening), no reduction
+// -----------------------------------------------------------------------
+
+// load/store 4 consecutive elements with 16-byte accesses (one float4 resp. two double2); p must be 16-byte aligned
+static __device__ __forceinline__ void Load4(const float* p, float v[4])
+{
+    float4 x = *reinterpret_cast<const float4*>(p);
+    v[0] = x.x;
+    v[1] = x.y;
+    v[2] = x.z;
+    v[3] = x.w;
+}
+static __device__ __forceinline__ void Load4(const double* p, double v[4])
+{
+    double2 x = *reinterpret_cast<const double2*>(p);
+    double2 y = *reinterpret_cast<const double2*>(p + 2);
+    v[0] = x.x;
+    v[1] = x.y;
+    v[2] = y.x;
+    v[3] = y.y;
+}
+static __device__ __forceinline__ void Store4(float* p, const float v[4])
+{
+    *reinterpret_cast<float4*>(p) = make_float4(v[0], v[1], v[2], v[3]);
+}
+static __device__ __forceinline__ void Store4(double* p, const double v[4])
+{
+    *reinterpret_cast<double2*>(p) = make_double2(v[0], v[1]);
+    *reinterpret_cast<double2*>(p + 2) = make_double2(v[2], v[3]);
+}
+
+// Each thread processes 4 consecutive elements with vector loads and stores. This is what makes binary ops
+// (which, unlike unary ones, are not special-cased by GPUMatrix::TensorOp()) reach memory bandwidth.
+// The caller guarantees that all pointers are 16-byte aligned; only the last thread may see a partial group of 4.
+template <class ElemType, C_size_t N>
+__global__ void _launchLinearTensorOp(ElemType beta, FixedArray<ElemType*, N> pointers, ElemType alpha, ElementWiseOperator op, CUDA_LONG numElements)
+{
+    CUDA_LONG id = GridDim::GetLinearThreadId() * 4;
+    if (id >= numElements)
+        return;
+    FixedArray<ElemType*, N> pp(pointers);
+    if (id + 4 <= numElements)
+    {
+        ElemType values[N][4]; // [operand][element]; the output is only loaded if beta != 0
+#pragma unroll
+        for (C_size_t i = 0; i < N - 1; i++)
+            Load4(pointers[i] + id, values[i]);
+        if (beta != 0)
+            Load4(pointers[N - 1] + id, values[N - 1]);
+        ElemType results[4];
+#pragma unroll
+        for (int j = 0; j < 4; j++)
+        {
+#pragma unroll
+            for (C_size_t i = 0; i < N - 1; i++)
+                pp[i] = &values[i][j];
+            ElemType val = TensorOps<ElemType>::Compute(pp, op);
+            val *= alpha;
+            if (beta != 0)
+                val += beta * values[N - 1][j];
+            results[j] = val;
+        }
+        Store4(pointers[N - 1] + id, results);
+    }
+    else // tail
+    {
+        for (; id < numElements; id++)
+        {
+            for (C_size_t i = 0; i < N; i++)
+                pp[i] = pointers[i] + id;
+            ElemType val = TensorOps<ElemType>::Compute(pp, op);
+            val *= alpha;
+            if (beta != 0)
+                val += beta * *pp[N - 1];
+            *pp[N - 1] = val;
+        }
+    }
+}
+
+// returns true if the operation was linear and has been launched
+template <class ElemType, C_size_t N>
+static bool TryLaunchLinearTensorOp(ElemType beta, const array<ElemType*, N>& pointerVector, ElemType alpha, ElementWiseOperator op,
+                                    const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrideVectors)
+{
+    if (regularOpDims.size() != 1)
+        return false;
+    for (C_size_t i = 0; i < N; i++)
+    {
+        if (regularStrideVectors[i][0] != 1 || reinterpret_cast<uintptr_t>(pointerVector[i]) % 16 != 0)
+            return false;
+    }
+
+    FixedArray<ElemType*, N> pointers(pointerVector);
+    CUDA_LONG NN = (CUDA_LONG) regularOpDims[0];
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    GridDim grid(CeilDiv(NN, 4));
+    _launchLinearTensorOp<ElemType, N><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(beta, pointers, alpha, op, NN);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+    return true;
+}
+
 template <class ElemType, C_size_t N, C_int K>
 static void LaunchTensorOp(ElemType beta, array<ElemType*, N> pointerVector, ElemType alpha, ElementWiseOperator op,
                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrideVectors)
 {
+    // special case: all operands are gap-free vectors
+    if (K == 1 && TryLaunchLinearTensorOp<ElemType, N>(beta, pointerVector, alpha, op, regularOpDims, regularStrideVectors))
+        return;
+
     // copy all parameters to CUDA-compatible data structures
     FixedArray<ElemType*, N> pointers(pointerVector);
     SmallVector<C_size_t> regularOpStrideVector; // kernel needs the strides for converting thread index back to multi-dimensional tensor index
@@ -528,6 +645,9 @@ __global__ void _launchTensorOpWithReduction(ElemType beta, FixedArray<ElemType*
         TensorOpElement<ElemType, N, M, K, true, K - 1>::Compute(id, beta, pointers, alpha, op, regularOpStrides, regularStrides, reducingOpDims, reducingStrides, reductionBegin, reductionChunkSize);
 }
 
+// when splitting a reduction over multiple blocks, aim at this many blocks per multiprocessor, for latency hiding
+static const CUDA_LONG reductionBlocksPerMultiProcessor = 4;
+
 // All dimensions (N-ariness, number of input dimensions K and number of reduction dimensions M) are bound to template parameters now.
 template <class ElemType, C_size_t N, C_int M, C_int K>
 static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> pointerVector, ElemType alpha, ElementWiseOperator op,
@@ -572,16 +692,24 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
     C_size_t reductionDim = 1; // number of elements to reduce over
     for (C_size_t k = 0; k < reducingOpDimVector.size(); k++)
         reductionDim *= (C_size_t) reducingOpDimVector[k];
+    //  - If the reduction runs along consecutive memory (e.g. the bias gradient of a convolution, which reduces [W x H x C x N] to [1 x 1 x C x 1]),
+    //    one thread per output element would read with a large stride and not coalesce at all, while a block per output element
+    //    reads consecutive addresses with consecutive threads. So we use the parallel reduction for those as well, regardless of NN.
     let& props = GridDim::GetDeviceProps();
     GridDim grid(NN);
-    if (reductionDim > 1 && grid.m_blocksPerGrid < props.multiProcessorCount /*    && NN == 10 && reductionDim <= GridDim::maxThreadsPerBlock*/)
+    bool isContiguousReduction = true; // are all inputs consecutive (or broadcasting) along the innermost reduction dimension?
+    for (C_size_t i = 0; i < N - 1; i++)
+        isContiguousReduction &= reducingStrideVectors[i][0] == 1 || reducingStrideVectors[i][0] == 0;
+    if ((reductionDim > 1 && grid.m_blocksPerGrid < props.multiProcessorCount) ||
+        (reductionDim >= GridDim::maxThreadsPerBlock && isContiguousReduction))
     {
-        // we are reducing and are underutilizing the multiprocs we have: get more parallelism by doing reduction in parallel
+        // we are reducing and are underutilizing the multiprocs we have, or would read uncoalesced: do reduction in parallel
         // Change of strategy: All NN elements get their own block. Reduction gets split over blocks as well.
 
         // By how much do we underutilize?
-        // We increase #blocks by that factor by breaking reduction into that many chunks.
-        let numReductionChunks = CeilDiv(props.multiProcessorCount, NN);
+        // We increase #blocks by that factor by breaking reduction into that many chunks (aiming at a few blocks per multiproc,
+        // but not so many that blocks have less than a full complement of threads).
+        let numReductionChunks = min(CeilDiv(props.multiProcessorCount * reductionBlocksPerMultiProcessor, NN), CeilDiv(reductionDim, GridDim::maxThreadsPerBlock));
 
         // NN may be too large for a single dimension
         let blockXOverBy = CeilDiv(NN, props.maxGridSize[0]);
@@ -594,18 +722,18 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
 
         // reduction goes into thread dim X
         let reductionChunkSize = CeilDiv(reductionDim, numReductionChunks);
-        let numThreadsX = min(reductionChunkSize, GridDim::maxThreadsPerBlock); // any that's over will be done by looping inside the kernel
+        let numThreadsX = min(CeilDiv(reductionChunkSize, props.warpSize) * props.warpSize, GridDim::maxThreadsPerBlock); // any that's over will be done by looping inside the kernel; whole warps for the warp reduction
 
         if (beta == 1 || numBlocksZ == 1)
         {
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(/*beta=*/1, pointers, alpha, op, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, 0, t_stream>>>(/*beta=*/1, pointers, alpha, op, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
         }
         else
         {
             // We need more than one chunk, we will use atomicAdd().
             // First reset/pre-multiply input; then do the remaining chunks using atomicAdd().
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, 1), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(beta, pointers, alpha, op, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ - 1), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(/*beta=*/1, pointers, alpha, op, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, reductionChunkSize, reductionChunkSize);
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, 1), numThreadsX, 0, t_stream>>>(beta, pointers, alpha, op, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ - 1), numThreadsX, 0, t_stream>>>(/*beta=*/1, pointers, alpha, op, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, reductionChunkSize, reductionChunkSize);
         }
     }
     else
@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// HalfPrecision.h -- conversion between float and 16-bit floating-point formats, shared by the CPU and CUDA code
+//
+// Used to store values compactly (see Matrix::AssignPackedHalfOf()); the arithmetic stays in float. The conversions are
+// done bit by bit, so that both sides give identical results independent of the hardware's half-precision support:
+// round to nearest even, with overflow to infinity and gradual underflow, and NaNs kept NaNs.
+//
+
+#pragma once
+
+#ifndef cudasharedcode // (as in cudabasetypes.h)
+#ifdef __device__
+#define cudasharedcode __device__ __host__
+#else
+#define cudasharedcode
+#endif
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+enum class HalfFormat
+{
+    fp16,    // IEEE 754 binary16: 11 significant bits, up to 65504
+    bfloat16 // the upper half of a float: 8 significant bits, the full float range
+};
+
+union FloatBits
+{
+    float f;
+    unsigned int u;
+};
+
+static inline cudasharedcode unsigned short FloatToHalfBits(float value, HalfFormat format)
+{
+    FloatBits bits;
+    bits.f = value;
+    const unsigned int x = bits.u;
+    if (format == HalfFormat::bfloat16)
+    {
+        if ((x & 0x7fffffff) > 0x7f800000) // NaN: keep a mantissa bit, which rounding might clear
+            return (unsigned short) ((x >> 16) | 0x40);
+        return (unsigned short) ((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+    }
+
+    const unsigned int sign = (x >> 16) & 0x8000;
+    const unsigned int absx = x & 0x7fffffff;
+    if (absx >= 0x7f800000) // infinity or NaN
+        return (unsigned short) (sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0));
+    if (absx >= 0x477ff000) // rounds to 65536 or more
+        return (unsigned short) (sign | 0x7c00);
+    if (absx < 0x38800000) // below 2^-14: subnormal (in units of 2^-24) or zero
+    {
+        if (absx <= 0x33000000) // at most 2^-25, which is halfway to 2^-24 and rounds to even
+            return (unsigned short) sign;
+        const unsigned int exponent = absx >> 23;
+        const unsigned int mantissa = (absx & 0x7fffff) | 0x800000;
+        const unsigned int shift = 126 - exponent;
+        unsigned int h = mantissa >> shift;
+        const unsigned int remainder = mantissa & ((1u << shift) - 1);
+        const unsigned int halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (h & 1)))
+            h++;
+        return (unsigned short) (sign | h);
+    }
+    // normal: rebias the exponent from 127 to 15 and round the mantissa to 10 bits (a carry correctly bumps the exponent)
+    unsigned int h = (absx - 0x38000000) >> 13;
+    const unsigned int remainder = absx & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (h & 1)))
+        h++;
+    return (unsigned short) (sign | h);
+}
+
+static inline cudasharedcode float HalfBitsToFloat(unsigned short h, HalfFormat format)
+{
+    FloatBits bits;
+    if (format == HalfFormat::bfloat16)
+    {
+        bits.u = (unsigned int) h << 16;
+        return bits.f;
+    }
+
+    const unsigned int sign = (unsigned int) (h & 0x8000) << 16;
+    unsigned int exponent = (h >> 10) & 0x1f;
+    unsigned int mantissa = h & 0x3ff;
+    if (exponent == 0x1f) // infinity or NaN
+        bits.u = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0)
+        bits.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        bits.u = sign;
+    else // subnormal: normalize
+    {
+        exponent = 113;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits.u = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    return bits.f;
+}
+
+} } }
@@ -0,0 +1,275 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "Instrumentation.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef USE_NVTX
+#include <nvToolsExt.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+namespace {
+// The values of one thread. Only the owning thread writes them, so relaxed loads and stores suffice; they are atomic only so
+// that the readers summing them up do not race with it.
+struct ThreadBuffer
+{
+    std::atomic<long long> m_counters[Instrumentation::maxCounters];
+    std::atomic<long long> m_histograms[Instrumentation::maxHistograms][Instrumentation::numBuckets];
+    std::atomic<long long> m_histogramSums[Instrumentation::maxHistograms];
+
+    ThreadBuffer()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        for (auto& value : m_counters)
+            value.store(0, std::memory_order_relaxed);
+        for (auto& histogram : m_histograms)
+            for (auto& value : histogram)
+                value.store(0, std::memory_order_relaxed);
+        for (auto& value : m_histogramSums)
+            value.store(0, std::memory_order_relaxed);
+    }
+};
+
+inline void AddRelaxed(std::atomic<long long>& value, long long delta)
+{
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+}
+
+// all protected by s_mutex; the buffers of threads that have ended are kept, so their values still count
+static std::mutex s_mutex;
+static std::vector<std::string> s_counterNames;
+static std::vector<std::string> s_histogramNames;
+static std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+
+static std::atomic<bool> s_rangesEnabled(true);
+
+#ifdef _WIN32
+static __declspec(thread) ThreadBuffer* t_buffer = nullptr;
+#else
+static __thread ThreadBuffer* t_buffer = nullptr;
+#endif
+
+static ThreadBuffer& GetThreadBuffer()
+{
+    if (!t_buffer)
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_buffers.emplace_back(new ThreadBuffer());
+        t_buffer = s_buffers.back().get();
+    }
+    return *t_buffer;
+}
+
+static size_t Register(std::vector<std::string>& names, const char* name, size_t maxNames, const char* what)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (size_t id = 0; id < names.size(); id++)
+    {
+        if (names[id] == name) // (the same name at several sites is one value)
+            return id;
+    }
+    if (names.size() >= maxNames)
+        LogicError("Instrumentation: More than %d %s.", (int) maxNames, what);
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+Instrumentation::Counter::Counter(const char* name)
+    : m_id(Register(s_counterNames, name, maxCounters, "counters"))
+{
+}
+
+void Instrumentation::Counter::Add(long long value)
+{
+    AddRelaxed(GetThreadBuffer().m_counters[m_id], value);
+}
+
+Instrumentation::Histogram::Histogram(const char* name)
+    : m_id(Register(s_histogramNames, name, maxHistograms, "histograms"))
+{
+}
+
+void Instrumentation::Histogram::Record(long long value)
+{
+    size_t bucket = 0;
+    for (unsigned long long v = value > 0 ? (unsigned long long) value : 0; v != 0; v >>= 1)
+        bucket++;
+    auto& buffer = GetThreadBuffer();
+    AddRelaxed(buffer.m_histograms[m_id][bucket], 1);
+    AddRelaxed(buffer.m_histogramSums[m_id], value);
+}
+
+Instrumentation::Range::Range(const char* name)
+    : m_pushed(false)
+{
+#ifdef USE_NVTX
+    if (s_rangesEnabled.load(std::memory_order_relaxed))
+    {
+        nvtxRangePushA(name);
+        m_pushed = true;
+    }
+#else
+    UNUSED(name);
+#endif
+}
+
+Instrumentation::Range::Range(const wchar_t* name)
+    : m_pushed(false)
+{
+#ifdef USE_NVTX
+    if (s_rangesEnabled.load(std::memory_order_relaxed))
+    {
+        nvtxRangePushW(name);
+        m_pushed = true;
+    }
+#else
+    UNUSED(name);
+#endif
+}
+
+Instrumentation::Range::~Range()
+{
+#ifdef USE_NVTX
+    if (m_pushed)
+        nvtxRangePop();
+#endif
+}
+
+/*static*/ void Instrumentation::SetRangesEnabled(bool enabled)
+{
+    s_rangesEnabled = enabled;
+}
+
+/*static*/ long long Instrumentation::GetCounter(const char* name)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    long long sum = 0;
+    for (size_t id = 0; id < s_counterNames.size(); id++)
+    {
+        if (s_counterNames[id] != name)
+            continue;
+        for (const auto& buffer : s_buffers)
+            sum += buffer->m_counters[id].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+// the upper end of the bucket that holds the given fraction of the values
+static long long Percentile(const std::vector<long long>& buckets, long long count, double fraction)
+{
+    long long seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); bucket++)
+    {
+        seen += buckets[bucket];
+        if (seen >= fraction * count)
+            return bucket == 0 ? 0 : (bucket >= 63 ? LLONG_MAX : (1ll << bucket) - 1);
+    }
+    return LLONG_MAX;
+}
+
+/*static*/ void Instrumentation::Print(FILE* f, const std::string& title)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    fprintf(f, "Instrumentation %s:\n", title.c_str());
+    for (size_t id = 0; id < s_counterNames.size(); id++)
+    {
+        long long sum = 0;
+        for (const auto& buffer : s_buffers)
+            sum += buffer->m_counters[id].load(std::memory_order_relaxed);
+        fprintf(f, "    counter %s = %lld\n", s_counterNames[id].c_str(), sum);
+    }
+    for (size_t id = 0; id < s_histogramNames.size(); id++)
+    {
+        std::vector<long long> buckets(numBuckets, 0);
+        long long count = 0, sum = 0;
+        for (const auto& buffer : s_buffers)
+        {
+            for (size_t bucket = 0; bucket < numBuckets; bucket++)
+                buckets[bucket] += buffer->m_histograms[id][bucket].load(std::memory_order_relaxed);
+            sum += buffer->m_histogramSums[id].load(std::memory_order_relaxed);
+        }
+        for (auto value : buckets)
+            count += value;
+        if (count == 0)
+            continue;
+        fprintf(f, "    histogram %s: count = %lld, mean = %.1f, p50 <= %lld, p90 <= %lld, p99 <= %lld\n",
+                s_histogramNames[id].c_str(), count, (double) sum / count,
+                Percentile(buckets, count, 0.5), Percentile(buckets, count, 0.9), Percentile(buckets, count, 0.99));
+    }
+    fflush(f);
+}
+
+/*static*/ void Instrumentation::Reset()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto& buffer : s_buffers)
+        buffer->Clear(); // (an Add() running concurrently may be lost)
+}
+
+// the periodic dump
+static std::mutex s_dumpMutex;
+static std::condition_variable s_dumpWakeUp;
+static std::thread* s_dumpThread = nullptr; // (never destroyed, so that exiting with the dump running does not terminate)
+static bool s_stopDump = false;
+
+/*static*/ void Instrumentation::StartPeriodicDump(double seconds, const std::wstring& path)
+{
+    StopPeriodicDump();
+    if (seconds <= 0)
+        InvalidArgument("Instrumentation: The dump period must be positive.");
+    s_stopDump = false;
+    s_dumpThread = new std::thread([seconds, path]()
+                               {
+                                   const auto period = std::chrono::duration<double>(seconds);
+                                   const auto start = std::chrono::steady_clock::now();
+                                   std::unique_lock<std::mutex> lock(s_dumpMutex);
+                                   while (!s_dumpWakeUp.wait_for(lock, period, []() { return s_stopDump; }))
+                                   {
+                                       const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                                       const std::string title = "after " + std::to_string((long long) elapsed) + " s";
+                                       if (path.empty())
+                                       {
+                                           Print(stderr, title);
+                                           continue;
+                                       }
+                                       FILE* f = _wfopen(path.c_str(), L"a");
+                                       if (!f)
+                                           continue; // (try again next time)
+                                       Print(f, title);
+                                       fclose(f);
+                                   }
+                               });
+}
+
+/*static*/ void Instrumentation::StopPeriodicDump()
+{
+    if (!s_dumpThread)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(s_dumpMutex);
+        s_stopDump = true;
+    }
+    s_dumpWakeUp.notify_one();
+    s_dumpThread->join();
+    delete s_dumpThread;
+    s_dumpThread = nullptr;
+}
+
+} } }
@@ -0,0 +1,119 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Instrumentation.h -- named counters and histograms for hot paths, and profiler ranges that external tools can see
+//
+// Counters and histograms are cheap enough for the hot paths of every build: each thread adds into a buffer of its own, with
+// plain (relaxed) loads and stores rather than atomic read-modify-writes, and the buffers are summed up only when the values are
+// read (Print(), or the periodic dump of StartPeriodicDump()). A histogram has one bucket per power of 2.
+// Ranges are NVTX push/pop pairs: with a CUDA build (USE_NVTX), Nsight Systems and nvprof show them on the timeline of each
+// thread; without a tool attached they cost next to nothing. They mark node ForwardProp()/Backprop(), reader stages,
+// gradient quantization and MPI operations, so that a profile of a production run can be read in terms of the network.
+// Use the macros below; building with CNTK_NO_INSTRUMENTATION removes all of it.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class MATH_API Instrumentation
+{
+public:
+    static const size_t maxCounters = 256;
+    static const size_t maxHistograms = 64;
+    static const size_t numBuckets = 64; // bucket b > 0 holds the values in [2^(b-1), 2^b), bucket 0 those <= 0
+
+    // a named sum, e.g. of calls or bytes; create it once (as a static) and Add() from any thread
+    class MATH_API Counter
+    {
+    public:
+        explicit Counter(const char* name);
+        void Add(long long value = 1);
+
+    private:
+        size_t m_id;
+    };
+
+    // a named distribution of values, e.g. sizes or latencies
+    class MATH_API Histogram
+    {
+    public:
+        explicit Histogram(const char* name);
+        void Record(long long value);
+
+    private:
+        size_t m_id;
+    };
+
+    // an NVTX range for the lifetime of the object
+    class MATH_API Range
+    {
+    public:
+        explicit Range(const char* name);
+        explicit Range(const wchar_t* name);
+        ~Range();
+
+    private:
+        bool m_pushed;
+
+        Range(const Range&) = delete;
+        Range& operator=(const Range&) = delete;
+    };
+
+    // ranges are on by default
+    static void SetRangesEnabled(bool enabled);
+
+    // the sums over all threads
+    static long long GetCounter(const char* name); // 0 if there is no such counter
+    // prints all counters, and count, mean and approximate percentiles of all histograms that have values
+    static void Print(FILE* f, const std::string& title);
+    // sets all values to 0
+    static void Reset();
+
+    // prints every 'seconds' on a background thread, to stderr if 'path' is empty, otherwise appended to the file at 'path'
+    // (which a metrics agent can tail)
+    static void StartPeriodicDump(double seconds, const std::wstring& path);
+    static void StopPeriodicDump();
+};
+
+} } }
+
+#define CNTK_INSTRUMENTATION_CONCAT2(a, b) a##b
+#define CNTK_INSTRUMENTATION_CONCAT(a, b) CNTK_INSTRUMENTATION_CONCAT2(a, b)
+
+#ifndef CNTK_NO_INSTRUMENTATION
+// 'name' must be a string literal; each use site registers its counter once
+#define CNTK_COUNTER_ADD(name, value)                                                  \
+    do                                                                                 \
+    {                                                                                  \
+        static ::Microsoft::MSR::CNTK::Instrumentation::Counter s_cntkCounter(name);   \
+        s_cntkCounter.Add(value);                                                      \
+    } while (0)
+#define CNTK_HISTOGRAM_RECORD(name, value)                                             \
+    do                                                                                 \
+    {                                                                                  \
+        static ::Microsoft::MSR::CNTK::Instrumentation::Histogram s_cntkHistogram(name); \
+        s_cntkHistogram.Record(value);                                                 \
+    } while (0)
+// a range until the end of the enclosing scope; 'name' may be a narrow or wide string
+#define CNTK_RANGE(name) ::Microsoft::MSR::CNTK::Instrumentation::Range CNTK_INSTRUMENTATION_CONCAT(cntkRange, __LINE__)(name)
+#else
+#define CNTK_COUNTER_ADD(name, value) do { } while (0)
+#define CNTK_HISTOGRAM_RECORD(name, value) do { } while (0)
+#define CNTK_RANGE(name) do { } while (0)
+#endif
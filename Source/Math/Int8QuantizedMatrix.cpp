@@ -0,0 +1,90 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "Int8QuantizedMatrix.h"
+#include "Basics.h"
+#include <cmath>
+#include <climits>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+Int8QuantizedMatrix<ElemType>::Int8QuantizedMatrix(const ElemType* data, size_t numRows, size_t numCols, bool transpose)
+{
+    m_numRows = transpose ? numCols : numRows;
+    m_numCols = transpose ? numRows : numCols;
+
+    // each dot product accumulates up to m_numCols products of magnitude 127 * 127 in an int32
+    if (m_numCols > INT_MAX / (127 * 127))
+        InvalidArgument("Int8QuantizedMatrix: inner dimension %d is too large for int32 accumulation.", (int) m_numCols);
+
+    m_values.resize(m_numRows * m_numCols);
+    m_scales.resize(m_numRows);
+
+    // row i of the represented matrix is row i of 'data' (stride numRows), or column i of 'data' (stride 1) if transposed
+    const size_t rowStride = transpose ? 1 : numRows;
+#pragma omp parallel for
+    for (long i = 0; i < (long) m_numRows; i++)
+    {
+        const ElemType* row = transpose ? data + i * numRows : data + i;
+        m_scales[i] = QuantizeToInt8(row, m_numCols, rowStride, m_values.data() + i * m_numCols);
+    }
+}
+
+template <class ElemType>
+/*static*/ ElemType Int8QuantizedMatrix<ElemType>::QuantizeToInt8(const ElemType* values, size_t n, size_t stride, int8_t* result)
+{
+    ElemType maxAbs = 0;
+    for (size_t k = 0; k < n; k++)
+        maxAbs = std::max(maxAbs, (ElemType) fabs(values[k * stride]));
+
+    if (maxAbs == 0)
+    {
+        memset(result, 0, n * sizeof(int8_t));
+        return 0;
+    }
+
+    const ElemType invScale = 127 / maxAbs;
+    for (size_t k = 0; k < n; k++)
+        result[k] = (int8_t) lrint(values[k * stride] * invScale);
+    return maxAbs / 127;
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Multiply(const ElemType* b, size_t numColsB, ElemType* c) const
+{
+    const size_t K = m_numCols;
+    const size_t M = m_numRows;
+
+    // quantized copy of b, column-major, with one scale per column
+    std::vector<int8_t> quantizedB(K * numColsB);
+    std::vector<ElemType> scalesB(numColsB);
+#pragma omp parallel for
+    for (long j = 0; j < (long) numColsB; j++)
+        scalesB[j] = QuantizeToInt8(b + j * K, K, 1, quantizedB.data() + j * K);
+
+    const int8_t* a = m_values.data();
+    const int8_t* qb = quantizedB.data();
+#pragma omp parallel for
+    for (long j = 0; j < (long) numColsB; j++)
+    {
+        const int8_t* bj = qb + j * K;
+        for (size_t i = 0; i < M; i++)
+        {
+            // plain loop over contiguous int8 data with an int32 accumulator, which the compiler vectorizes
+            const int8_t* ai = a + i * K;
+            int32_t sum = 0;
+            for (size_t k = 0; k < K; k++)
+                sum += (int32_t) ai[k] * (int32_t) bj[k];
+            c[i + j * M] = sum * m_scales[i] * scalesB[j];
+        }
+    }
+}
+
+// Explicit instantiation
+template class Int8QuantizedMatrix<float>;
+template class Int8QuantizedMatrix<double>;
+} } }
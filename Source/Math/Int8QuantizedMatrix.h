@@ -0,0 +1,60 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Int8QuantizedMatrix.h -- int8 copy of a weight matrix for CPU inference
+//
+// Unlike QuantizedMatrix (1-bit SGD gradient quantization with residuals), this is a symmetric, per-row 8-bit
+// quantization of a constant weight matrix W. Multiply() computes W * B for a float/double B by quantizing each
+// column of B on the fly, accumulating the products in int32 and rescaling the result. The row scales of W and the
+// column scales of B are independent, so a single rescale per output element suffices.
+//
+
+#pragma once
+
+#include "CommonMatrix.h" // for MATH_API
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class MATH_API Int8QuantizedMatrix
+{
+public:
+    // Quantize the column-major numRows x numCols matrix 'data'. If 'transpose' is set, the matrix represented is its transpose,
+    // i.e. the rows of the quantized matrix are the columns of 'data'.
+    Int8QuantizedMatrix(const ElemType* data, size_t numRows, size_t numCols, bool transpose);
+
+    // dimensions of the represented (possibly transposed) matrix
+    size_t GetNumRows() const
+    {
+        return m_numRows;
+    }
+
+    size_t GetNumCols() const
+    {
+        return m_numCols;
+    }
+
+    // memory held by the quantized values and scales
+    size_t GetSizeInBytes() const
+    {
+        return m_values.size() * sizeof(int8_t) + m_scales.size() * sizeof(ElemType);
+    }
+
+    // c = this * b, where b is column-major GetNumCols() x numColsB and c is column-major GetNumRows() x numColsB
+    // This does not modify the object, so concurrent calls are safe.
+    void Multiply(const ElemType* b, size_t numColsB, ElemType* c) const;
+
+    // Quantize n values spaced 'stride' apart to [-127, 127], and return the scale to multiply the result with.
+    static ElemType QuantizeToInt8(const ElemType* values, size_t n, size_t stride, int8_t* result);
+
+private:
+    size_t m_numRows;
+    size_t m_numCols;
+    std::vector<int8_t> m_values;   // row-major, so that each output element is a dot product over contiguous memory
+    std::vector<ElemType> m_scales; // [row]
+};
+} } }
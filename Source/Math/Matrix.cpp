@@ -11,9 +11,15 @@
 #include "CPUSparseMatrix.h"
 #include "GPUMatrix.h"
 #include "GPUSparseMatrix.h"
+#include "ComputeStreams.h"
+#include "DeviceTransferMonitor.h"
+#include "Instrumentation.h"
 #include "File.h"
 #include <assert.h>
 #include <math.h>
+#include <functional>
+#include <limits>
+#include <new>
 #include "GPUWatcher.h" // bring in this class as well so that it gets exported from this DLL
 #ifndef CPUONLY
 #pragma comment(lib, "MathCUDA.lib") // built by CNTKMathCUDA project
@@ -166,6 +172,65 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+#pragma region MatrixObjectCache
+
+// Each block is preceded by a header that holds its size class. Objects up to maxCachedObjectSize bytes are rounded up
+// to a multiple of objectSizeGranularity; larger ones (size class 0) go straight to the heap. A free block is linked
+// into the list of its size class through its first bytes. The blocks of a thread's free lists are not returned to
+// the heap when the thread ends; that is bounded by maxCachedObjectsPerSize.
+static const size_t objectSizeGranularity = 64;
+static const size_t maxCachedObjectSize = 8 * objectSizeGranularity;
+static const size_t numObjectSizeClasses = maxCachedObjectSize / objectSizeGranularity + 1;
+static const size_t maxCachedObjectsPerSize = 64;
+static const size_t objectHeaderSize = 16; // keeps the alignment of malloc()
+
+#ifdef _WIN32
+static __declspec(thread) void* t_freeObjects[numObjectSizeClasses];
+static __declspec(thread) size_t t_numFreeObjects[numObjectSizeClasses];
+#else
+static __thread void* t_freeObjects[numObjectSizeClasses];
+static __thread size_t t_numFreeObjects[numObjectSizeClasses];
+#endif
+
+/*static*/ void* MatrixObjectCache::Allocate(size_t size)
+{
+    const size_t sizeClass = size <= maxCachedObjectSize ? (size + objectSizeGranularity - 1) / objectSizeGranularity : 0; // (0 for size 0)
+    char* block;
+    if (sizeClass != 0 && t_freeObjects[sizeClass] != nullptr)
+    {
+        block = (char*) t_freeObjects[sizeClass];
+        t_freeObjects[sizeClass] = *(void**) (block + objectHeaderSize);
+        t_numFreeObjects[sizeClass]--;
+    }
+    else
+    {
+        block = (char*) malloc(objectHeaderSize + (sizeClass != 0 ? sizeClass * objectSizeGranularity : size));
+        if (block == nullptr)
+            throw std::bad_alloc();
+        *(size_t*) block = sizeClass;
+    }
+    return block + objectHeaderSize;
+}
+
+/*static*/ void MatrixObjectCache::Free(void* p)
+{
+    if (p == nullptr)
+        return;
+    char* block = (char*) p - objectHeaderSize;
+    const size_t sizeClass = *(size_t*) block;
+    if (sizeClass == 0 || t_numFreeObjects[sizeClass] >= maxCachedObjectsPerSize)
+    {
+        free(block);
+        return;
+    }
+    // the size class stays in the header; the link goes into the (now unused) object memory
+    *(void**) p = t_freeObjects[sizeClass];
+    t_freeObjects[sizeClass] = block;
+    t_numFreeObjects[sizeClass]++;
+}
+
+#pragma endregion MatrixObjectCache
+
 #pragma region Constructors, destructors and other static matrix builders
 
 //This function will only initialize default bland matrix. The actual matrices need to allocated
@@ -551,6 +616,12 @@ void Matrix<ElemType>::SetDevice(DEVICEID_TYPE deviceId)
         GPUMatrix<ElemType>::SetDevice(deviceId);
 }
 
+template <class ElemType>
+void Matrix<ElemType>::SetFP16GEMMEnabled(bool enabled)
+{
+    GPUMatrix<ElemType>::SetFP16GEMMEnabled(enabled);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::Read(File& stream)
 {
@@ -808,6 +879,110 @@ Matrix<ElemType>& Matrix<ElemType>::SetColumnSlice(const Matrix<ElemType>& fromM
     return *this;
 }
 
+// this(:, j) = a(:, columnIndices(0, j)), for a [1 x N] columnIndices; this becomes [a.rows x N]
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignGatheredColumnsOf(const Matrix<ElemType>& a, const Matrix<ElemType>& columnIndices)
+{
+    if (columnIndices.GetNumRows() != 1)
+        InvalidArgument("AssignGatheredColumnsOf: columnIndices must be a row vector.");
+
+    DecideAndMoveToRightDevice(a, columnIndices, *this);
+    SwitchToMatrixType(a.GetMatrixType(), a.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&a,
+                            this,
+                            m_CPUMatrix->AssignGatheredColumnsOf(*a.m_CPUMatrix, *columnIndices.m_CPUMatrix),
+                            m_GPUMatrix->AssignGatheredColumnsOf(*a.m_GPUMatrix, *columnIndices.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+// this(:, columnIndices(0, j)) += a(:, j), for a [1 x a.cols] columnIndices without duplicates
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AddScatteredColumnsOf(const Matrix<ElemType>& a, const Matrix<ElemType>& columnIndices)
+{
+    if (columnIndices.GetNumRows() != 1 || columnIndices.GetNumCols() != a.GetNumCols() || a.GetNumRows() != GetNumRows())
+        InvalidArgument("AddScatteredColumnsOf: columnIndices must be a row vector with an index for each column of a, which must have the rows of this.");
+
+    DecideAndMoveToRightDevice(*this, a, columnIndices);
+
+    DISPATCH_MATRIX_ON_FLAG(&a,
+                            this,
+                            m_CPUMatrix->AddScatteredColumnsOf(*a.m_CPUMatrix, *columnIndices.m_CPUMatrix),
+                            m_GPUMatrix->AddScatteredColumnsOf(*a.m_GPUMatrix, *columnIndices.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+// see comment in header
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignPackedHalfOf(const Matrix<ElemType>& a, HalfFormat format)
+{
+    if (this == &a)
+        InvalidArgument("AssignPackedHalfOf: The target must be a different matrix.");
+
+    DecideAndMoveToRightDevice(a, *this);
+    SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&a,
+                            this,
+                            m_CPUMatrix->AssignPackedHalfOf(*a.m_CPUMatrix, format),
+                            m_GPUMatrix->AssignPackedHalfOf(*a.m_GPUMatrix, format),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignUnpackedHalfOf(const Matrix<ElemType>& packed, size_t numRows, HalfFormat format)
+{
+    if (this == &packed)
+        InvalidArgument("AssignUnpackedHalfOf: The target must be a different matrix.");
+    if (packed.GetNumRows() != PackedHalfRows(numRows))
+        InvalidArgument("AssignUnpackedHalfOf: %d packed rows cannot hold %d rows.", (int) packed.GetNumRows(), (int) numRows);
+
+    DecideAndMoveToRightDevice(packed, *this);
+    SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&packed,
+                            this,
+                            m_CPUMatrix->AssignUnpackedHalfOf(*packed.m_CPUMatrix, numRows, format),
+                            m_GPUMatrix->AssignUnpackedHalfOf(*packed.m_GPUMatrix, numRows, format),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+// AssignAliasSamplesOf() -- draws from a discrete distribution over 0..V-1 by the alias method (Walker; Vose), on the device of the table
+//  - aliasTable: [2 x V] the probability of keeping each bucket, and the index drawn instead of it otherwise
+//  - uniforms:   [2 x k] random numbers in [0, 1], e.g. from SetUniformRandomValue(); the first picks the bucket, the second decides on bucket or alias
+//  - this:       [1 x k] out: the drawn indices
+// Each draw costs O(1) independent of V, and all k run in parallel.
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignAliasSamplesOf(const Matrix<ElemType>& aliasTable, const Matrix<ElemType>& uniforms)
+{
+    if (aliasTable.GetNumRows() != 2 || aliasTable.GetNumCols() == 0 || uniforms.GetNumRows() != 2)
+        InvalidArgument("AssignAliasSamplesOf: aliasTable must be [2 x V] with V > 0, and uniforms [2 x k].");
+
+    DecideAndMoveToRightDevice(aliasTable, uniforms, *this);
+    SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&aliasTable,
+                            this,
+                            m_CPUMatrix->AssignAliasSamplesOf(*aliasTable.m_CPUMatrix, *uniforms.m_CPUMatrix),
+                            m_GPUMatrix->AssignAliasSamplesOf(*aliasTable.m_GPUMatrix, *uniforms.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 template <class ElemType>
 void Matrix<ElemType>::CopyColumnsStrided(const Matrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride)
 {
@@ -1188,6 +1363,40 @@ void Matrix<ElemType>::SetValue(const Matrix<ElemType>& deepCopyFrom, const Matr
                             m_GPUSparseMatrix->SetValue(*deepCopyFrom.m_GPUSparseMatrix));
 }
 
+// deep copy that leaves this matrix on its own device, unlike SetValue(const Matrix&), which moves this matrix to deepCopyFrom's device
+// Used to hand values between parts of a network that are placed on different devices. Dense only.
+template <class ElemType>
+void Matrix<ElemType>::SetValueAcrossDevices(const Matrix<ElemType>& deepCopyFrom)
+{
+    if (this == &deepCopyFrom)
+        return;
+    if (deepCopyFrom.GetDeviceId() == GetDeviceId())
+        return SetValue(deepCopyFrom);
+    if (deepCopyFrom.GetMatrixType() != MatrixType::DENSE)
+        NOT_IMPLEMENTED;
+
+    SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+    const size_t numRows = deepCopyFrom.GetNumRows();
+    const size_t numCols = deepCopyFrom.GetNumCols();
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            // GPU to CPU
+                            {
+                                m_CPUMatrix->Resize(numRows, numCols);
+                                deepCopyFrom.CopySection(numRows, numCols, m_CPUMatrix->GetArray(), numRows);
+                            },
+                            // CPU or another GPU to GPU
+                            {
+                                if (deepCopyFrom.GetDeviceId() == CPUDEVICE)
+                                    m_GPUMatrix->SetValue(numRows, numCols, m_GPUMatrix->GetComputeDeviceId(), deepCopyFrom.BufferPointer(), matrixFlagNormal);
+                                else
+                                    m_GPUMatrix->SetValueFromPeer(*deepCopyFrom.m_GPUMatrix);
+                            },
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, const size_t matrixFlags)
 {
@@ -1226,6 +1435,28 @@ void Matrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCC
                             m_GPUSparseMatrix->SetMatrixFromCSCFormat(h_CSCCol, h_Row, h_Val, nz, numRows, numCols));
 }
 
+template <class ElemType>
+void Matrix<ElemType>::GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& columnValues) const
+{
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            nullptr,
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED,
+                            m_CPUSparseMatrix->GetSparseBlockColumns(columnIds, columnValues),
+                            m_GPUSparseMatrix->GetSparseBlockColumns(columnIds, columnValues));
+}
+
+template <class ElemType>
+void Matrix<ElemType>::SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& columnValues)
+{
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED,
+                            m_CPUSparseMatrix->SetSparseBlockColumns(numRows, numCols, columnIds, columnValues),
+                            m_GPUSparseMatrix->SetSparseBlockColumns(numRows, numCols, columnIds, columnValues));
+}
+
 template <class ElemType>
 void Matrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1347,6 +1578,92 @@ void Matrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const ElemT
                             NOT_IMPLEMENTED);
 }
 
+// SetPhiloxUniformRandomValue() -- uniform random values in [low, high) from the counter-based generator of Philox.h
+// Element i (in column-major order) is a function of seed and i only, so the result is the same on the CPU and the GPU.
+template <class ElemType>
+void Matrix<ElemType>::SetPhiloxUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
+{
+    if (IsEmpty())
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->SetPhiloxRandomValue(false, low, high, seed),
+                            m_GPUMatrix->SetPhiloxRandomValue(false, low, high, seed),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// SetPhiloxGaussianRandomValue() -- normal random values from the counter-based generator, see SetPhiloxUniformRandomValue()
+template <class ElemType>
+void Matrix<ElemType>::SetPhiloxGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
+{
+    if (sigma <= 0)
+        InvalidArgument("SetPhiloxGaussianRandomValue: sigma must be a positive value.");
+    if (IsEmpty())
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->SetPhiloxRandomValue(true, mean, sigma, seed),
+                            m_GPUMatrix->SetPhiloxRandomValue(true, mean, sigma, seed),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// AssignDropoutOf() -- this = a .* mask, with a dropout mask that is generated on the fly instead of stored
+//  - dropoutRate: the probability of an element being dropped; the others are scaled by 1 / (1 - dropoutRate)
+//  - seed, stream: the random stream of the mask, e.g. of a node and a minibatch
+//  - offset: the index of the first element of a within the stream, so that a slice of a minibatch (e.g. a time
+//    step) gets the mask elements of its position; the same arguments give the same mask, which is how the backprop
+//    of a dropout (AddDropoutOf()) regenerates the mask of its forward prop
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignDropoutOf(const Matrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset)
+{
+    if (dropoutRate < 0 || dropoutRate >= 1)
+        InvalidArgument("AssignDropoutOf: dropoutRate must be >= 0 and < 1.");
+    if (a.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(a, *this);
+    SwitchToMatrixType(a.GetMatrixType(), a.GetFormat(), false);
+    Resize(a.GetNumRows(), a.GetNumCols());
+    if (IsEmpty())
+        return *this;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->ScaleAndAddDropoutOf(0, *a.m_CPUMatrix, dropoutRate, seed, stream, offset),
+                            m_GPUMatrix->ScaleAndAddDropoutOf(0, *a.m_GPUMatrix, dropoutRate, seed, stream, offset),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+    return *this;
+}
+
+// AddDropoutOf() -- this += a .* mask, with the mask of AssignDropoutOf() for the same arguments
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AddDropoutOf(const Matrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset)
+{
+    if (dropoutRate < 0 || dropoutRate >= 1)
+        InvalidArgument("AddDropoutOf: dropoutRate must be >= 0 and < 1.");
+    if (a.GetNumRows() != GetNumRows() || a.GetNumCols() != GetNumCols())
+        InvalidArgument("AddDropoutOf: The input matrix dimensions do not match.");
+    if (a.GetMatrixType() != DENSE || GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(a, *this);
+    if (IsEmpty())
+        return *this;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->ScaleAndAddDropoutOf(1, *a.m_CPUMatrix, dropoutRate, seed, stream, offset),
+                            m_GPUMatrix->ScaleAndAddDropoutOf(1, *a.m_GPUMatrix, dropoutRate, seed, stream, offset),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+    return *this;
+}
+
 template <class ElemType>
 void Matrix<ElemType>::NormalGrad(Matrix<ElemType>& gradients,
                                   Matrix<ElemType>& functionValues,
@@ -1444,8 +1761,61 @@ void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Mat
                             SetDataLocation(CPU),
                             m_GPUMatrix->FSAdagrad(*gradients.m_GPUMatrix, *functionValues.m_GPUMatrix, learnRatePerSample, momentum, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
                             SetDataLocation(GPU),
-                            NOT_IMPLEMENTED,
-                            NOT_IMPLEMENTED);
+                            gradients.m_CPUSparseMatrix->FSAdagrad(*m_CPUMatrix, *functionValues.m_CPUMatrix, learnRatePerSample, momentum, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
+                            SetDataLocation(CPU),
+                            gradients.m_GPUSparseMatrix->FSAdagrad(*m_GPUMatrix, *functionValues.m_GPUMatrix, learnRatePerSample, momentum, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
+                            SetDataLocation(GPU));
+}
+
+// Adam (Kingma and Ba, 2015). This holds the first and the second moments of the gradients side by side, like FSAdagrad,
+// and is allocated on first use; 'step' counts the updates from 1, for the bias correction of the moments.
+// For block-sparse gradients only the columns (rows) present are updated, as by FSAdagrad, but with the bias correction of all steps.
+template <class ElemType>
+void Matrix<ElemType>::Adam(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType beta1, const ElemType beta2, const ElemType epsilon, const size_t step)
+{
+    AdamUpdate(gradients, functionValues, learnRatePerSample, beta1, beta2, epsilon, 0, step, /*directionOnly=*/false);
+}
+
+// LAMB (You et al., 2019, "Large Batch Optimization for Deep Learning"): the Adam direction plus the decoupled weight decay,
+// u = m / (sqrt(v) + epsilon) + weightDecay * w (bias-corrected moments), scaled per matrix by the trust ratio ||w|| / ||u||,
+// so that each layer moves by about learnRatePerSample relative to its weights regardless of the batch size.
+// The direction overwrites the gradients; for block-sparse gradients u and its norm are those of the columns (rows) present.
+template <class ElemType>
+void Matrix<ElemType>::Lamb(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType beta1, const ElemType beta2, const ElemType epsilon,
+                            const ElemType weightDecay, const size_t step)
+{
+    AdamUpdate(gradients, functionValues, learnRatePerSample, beta1, beta2, epsilon, weightDecay, step, /*directionOnly=*/true);
+
+    const double weightNorm = functionValues.FrobeniusNorm();
+    const double updateNorm = gradients.FrobeniusNorm();
+    const double trustRatio = weightNorm > 0 && updateNorm > 0 ? weightNorm / updateNorm : 1;
+    ScaleAndAdd((ElemType) (-learnRatePerSample * trustRatio), gradients, functionValues);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::AdamUpdate(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType beta1, const ElemType beta2, const ElemType epsilon,
+                                  const ElemType weightDecay, const size_t step, const bool directionOnly)
+{
+    if (step == 0)
+        InvalidArgument("Adam: The steps are counted from 1.");
+    if (!(beta1 >= 0 && beta1 < 1 && beta2 >= 0 && beta2 < 1))
+        InvalidArgument("Adam: beta1 and beta2 must be in [0, 1).");
+
+    const ElemType biasCorrection1 = (ElemType) (1 / (1 - pow((double) beta1, (double) step)));
+    const ElemType biasCorrection2 = (ElemType) (1 / (1 - pow((double) beta2, (double) step)));
+
+    DecideAndMoveToRightDevice(*this, gradients, functionValues);
+
+    DISPATCH_MATRIX_ON_FLAG(&gradients,
+                            &gradients,
+                            m_CPUMatrix->Adam(*gradients.m_CPUMatrix, *functionValues.m_CPUMatrix, learnRatePerSample, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+                            SetDataLocation(CPU),
+                            m_GPUMatrix->Adam(*gradients.m_GPUMatrix, *functionValues.m_GPUMatrix, learnRatePerSample, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+                            SetDataLocation(GPU),
+                            gradients.m_CPUSparseMatrix->Adam(*m_CPUMatrix, *functionValues.m_CPUMatrix, learnRatePerSample, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+                            SetDataLocation(CPU),
+                            gradients.m_GPUSparseMatrix->Adam(*m_GPUMatrix, *functionValues.m_GPUMatrix, learnRatePerSample, beta1, beta2, epsilon, biasCorrection1, biasCorrection2, weightDecay, directionOnly);
+                            SetDataLocation(GPU));
 }
 
 template <class ElemType>
@@ -1459,14 +1829,16 @@ ElemType Matrix<ElemType>::RmsProp(Matrix<ElemType>& gradients,
 {
     DecideAndMoveToRightDevice(*this, gradients);
 
-    DISPATCH_MATRIX_ON_FLAG(this,
+    DISPATCH_MATRIX_ON_FLAG(&gradients,
                             &gradients,
                             return m_CPUMatrix->RmsProp(*gradients.m_CPUMatrix, RMS_GAMMA, RMS_WGT_INC, RMS_WGT_MAX, RMS_WGT_DEC, RMS_WGT_MIN, needAveMultiplier);
                             SetDataLocation(CPU),
                             return m_GPUMatrix->RmsProp(*gradients.m_GPUMatrix, RMS_GAMMA, RMS_WGT_INC, RMS_WGT_MAX, RMS_WGT_DEC, RMS_WGT_MIN, needAveMultiplier);
                             SetDataLocation(GPU),
-                            NOT_IMPLEMENTED,
-                            NOT_IMPLEMENTED);
+                            return gradients.m_CPUSparseMatrix->RmsProp(*m_CPUMatrix, RMS_GAMMA, RMS_WGT_INC, RMS_WGT_MAX, RMS_WGT_DEC, RMS_WGT_MIN, needAveMultiplier);
+                            SetDataLocation(CPU),
+                            return gradients.m_GPUSparseMatrix->RmsProp(*m_GPUMatrix, RMS_GAMMA, RMS_WGT_INC, RMS_WGT_MAX, RMS_WGT_DEC, RMS_WGT_MIN, needAveMultiplier);
+                            SetDataLocation(GPU));
 }
 
 template <class ElemType>
@@ -1802,6 +2174,19 @@ Matrix<ElemType>& Matrix<ElemType>::AddToRowRepeatValuesOf(const Matrix<ElemType
     return *this;
 }
 
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignPackedImages(const void* packedImages)
+{
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->AssignPackedImages(packedImages),
+                            m_GPUMatrix->AssignPackedImages(packedImages),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 //used in the DSSM model. The resulted *this is a [a.GetRows()*(negNumber+1), a.GetCols()] matrix
 //each column contains posNumber of  positive samples (original) and negNumber negative samples generated by copying
 //sample shifted by shiftNumber columns
@@ -3533,7 +3918,7 @@ void Matrix<ElemType>::_transferToDevice(int to_id, bool ismoved, bool emptyTran
 }
 
 template <class ElemType>
-void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool ismoved, bool emptyTransfer) const
+void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool ismoved, bool emptyTransfer, bool isExplicit) const
 {
     if (from_id < 0)
         from_id = CPUDEVICE;
@@ -3548,6 +3933,12 @@ void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool
         return;
     }
 
+    if (!emptyTransfer && DeviceTransferMonitor::GetMode() != DeviceTransferMonitor::off)
+    {
+        const size_t bytes = m_matrixType == MatrixType::SPARSE ? NzCount() * (sizeof(ElemType) + sizeof(CPUSPARSE_INDEX_TYPE)) : GetNumElements() * sizeof(ElemType);
+        DeviceTransferMonitor::RecordTransfer(from_id, to_id, bytes, isExplicit);
+    }
+
 #define NUM_DEVICE_CHANGED_WARN 20
     if (m_numTimesDeviceChanged <= NUM_DEVICE_CHANGED_WARN &&
         (!emptyTransfer || (from_id >= 0 && to_id >= 0)))
@@ -3698,7 +4089,7 @@ void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool
 template <class ElemType>
 void Matrix<ElemType>::TransferFromDeviceToDevice(int from_id, int to_id, bool ismoved, bool emptyTransfer, bool updatePreferredDevice) const
 {
-    _transferFromDeviceToDevice(from_id, to_id, ismoved, emptyTransfer);
+    _transferFromDeviceToDevice(from_id, to_id, ismoved, emptyTransfer, /*isExplicit=*/true);
     if (updatePreferredDevice)
         m_preferredDeviceId = GetDeviceId();
 }
@@ -3708,13 +4099,62 @@ void Matrix<ElemType>::TransferToDeviceIfNotThere(int id_to, bool ismoved, bool
     if (GetDeviceId() != id_to)
         TransferFromDeviceToDevice(GetDeviceId(), id_to, ismoved, emptyTransfer, updatePreferredDevice);
 }
-// TODO: This function vv is now (after memshare update) only used by LearnableParameter::InitRandom(). Maybe it is time to get rid of it.
+// TODO: This function vv is no longer used (LearnableParameter::InitRandom() now initializes on the device). Maybe it is time to get rid of it.
 template <class ElemType>
 void Matrix<ElemType>::TransferToDeviceIfNotThereAndNotAutoPlace(int id_to, bool ismoved, bool emptyTransfer, bool updatePreferredDevice) const
 {
     TransferToDeviceIfNotThere(id_to, ismoved, emptyTransfer, updatePreferredDevice);
 }
 
+template <class ElemType>
+void Matrix<ElemType>::RecordEvent(DeviceEvent& event) const
+{
+    if (GetDeviceId() < 0)
+        return;
+    if (event.GetDeviceId() != GetDeviceId())
+        InvalidArgument("RecordEvent: The event belongs to device %d, but the matrix is on device %d.", event.GetDeviceId(), GetDeviceId());
+    PrepareDevice(GetDeviceId());
+    event.Record();
+}
+
+template <class ElemType>
+void Matrix<ElemType>::WaitForEvent(const DeviceEvent& event) const
+{
+    if (GetDeviceId() < 0)
+        return;
+    if (event.GetDeviceId() != GetDeviceId())
+        InvalidArgument("WaitForEvent: The event belongs to device %d, but the matrix is on device %d.", event.GetDeviceId(), GetDeviceId());
+    PrepareDevice(GetDeviceId());
+    event.Wait();
+}
+
+template <class ElemType>
+void Matrix<ElemType>::RecordStreamUse(const ComputeStream& stream) const
+{
+    if (GetDeviceId() < 0)
+        return;
+    if (stream.GetDeviceId() != GetDeviceId())
+        InvalidArgument("RecordStreamUse: The stream belongs to device %d, but the matrix is on device %d.", stream.GetDeviceId(), GetDeviceId());
+    // (sparse matrices hold several buffers; only dense ones are tracked)
+    if (GetMatrixType() == MatrixType::DENSE)
+        m_GPUMatrix->RecordStreamUse(stream.GetHandle());
+}
+
+// (sparse matrices hold several buffers; only dense ones are migrated)
+template <class ElemType>
+void Matrix<ElemType>::PrefetchToDevice() const
+{
+    if (GetDeviceId() >= 0 && GetMatrixType() == MatrixType::DENSE)
+        m_GPUMatrix->PrefetchManaged(/*toDevice=*/true);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::PrefetchToHost() const
+{
+    if (GetDeviceId() >= 0 && GetMatrixType() == MatrixType::DENSE)
+        m_GPUMatrix->PrefetchManaged(/*toDevice=*/false);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::Print(const char* matrixName, ptrdiff_t rowStart, ptrdiff_t rowEnd, ptrdiff_t colStart, ptrdiff_t colEnd) const
 {
@@ -4018,6 +4458,128 @@ void Matrix<ElemType>::SVD(const Matrix<ElemType>& A, Matrix<ElemType>& SIGMA, M
                             NOT_IMPLEMENTED);
 }
 
+// eigendecomposition of a small symmetric positive semi-definite matrix G = V diag(lambda) V', on the CPU in double precision
+// 'eigenvectors' are the columns of V, column-major; the eigenvalues are in descending order.
+template <class ElemType>
+static void SymmetricEigenOnCPU(const Matrix<ElemType>& G, std::vector<double>& eigenvalues, std::vector<double>& eigenvectors)
+{
+    const size_t l = G.GetNumRows();
+    ElemType* g = nullptr;
+    size_t size = 0;
+    G.CopyToArray(g, size);
+    std::vector<double> gDouble(g, g + l * l);
+    delete[] g;
+
+    // for a symmetric positive semi-definite matrix, the SVD is the eigendecomposition
+    Matrix<double> A(l, l, gDouble.data(), CPUDEVICE), S(CPUDEVICE), U(CPUDEVICE), VT(CPUDEVICE), W(CPUDEVICE);
+    Matrix<double>::SVD(A, S, U, VT, W);
+    eigenvalues.resize(l);
+    eigenvectors.resize(l * l);
+    for (size_t j = 0; j < l; j++)
+    {
+        eigenvalues[j] = S(j, 0);
+        for (size_t i = 0; i < l; i++)
+            eigenvectors[j * l + i] = U(i, j);
+    }
+}
+
+// the l x l matrix V diag(scale(lambda)) on 'deviceId'
+template <class ElemType>
+static Matrix<ElemType> ScaledEigenvectors(const std::vector<double>& eigenvalues, const std::vector<double>& eigenvectors, const std::function<double(double)>& scale, DEVICEID_TYPE deviceId)
+{
+    const size_t l = eigenvalues.size();
+    std::vector<ElemType> m(l * l);
+    for (size_t j = 0; j < l; j++)
+    {
+        const double f = scale(eigenvalues[j]);
+        for (size_t i = 0; i < l; i++)
+            m[j * l + i] = (ElemType) (eigenvectors[j * l + i] * f);
+    }
+    return Matrix<ElemType>(l, l, m.data(), deviceId);
+}
+
+// make the columns of Y orthonormal (they keep spanning the same space), via the eigendecomposition of the Gram matrix Y'Y
+// Squaring loses the directions whose singular values are below sqrt(epsilon) of the largest; they become 0 columns.
+// A second pass restores the orthonormality that the first one achieves only approximately (as in CholeskyQR2).
+template <class ElemType>
+static void OrthonormalizeColumns(Matrix<ElemType>& Y)
+{
+    const double tolerance = std::numeric_limits<ElemType>::epsilon() * Y.GetNumCols();
+    std::vector<double> eigenvalues, eigenvectors;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        Matrix<ElemType> G(Y.GetDeviceId()), orthonormalY(Y.GetDeviceId());
+        Matrix<ElemType>::Multiply(Y, true, Y, false, G);
+        SymmetricEigenOnCPU(G, eigenvalues, eigenvectors);
+        const double threshold = eigenvalues[0] * tolerance;
+        Matrix<ElemType> M = ScaledEigenvectors<ElemType>(eigenvalues, eigenvectors, [threshold](double lambda)
+                                                          {
+                                                              return lambda > threshold ? 1 / sqrt(lambda) : 0;
+                                                          }, Y.GetDeviceId());
+        Matrix<ElemType>::Multiply(Y, false, M, false, orthonormalY);
+        Y = std::move(orthonormalY);
+    }
+}
+
+// truncated SVD A ~ U*SIGMA*VT of rank 'rank' by randomized subspace iteration (Halko, Martinsson and Tropp, 2011)
+// The products with A, which are the bulk of the work, run on A's device; only rank x rank eigendecompositions run on the
+// CPU. With 'rank' = min(m, n) the result is the full decomposition (up to rounding). SIGMA is rank x 1, in descending order,
+// U is m x rank, VT is rank x n. A few power iterations sharpen the subspace when the singular values decay slowly.
+template <class ElemType>
+void Matrix<ElemType>::TruncatedSVD(const Matrix<ElemType>& A, size_t rank, size_t numPowerIterations, unsigned long seed,
+                                    Matrix<ElemType>& SIGMA, Matrix<ElemType>& U, Matrix<ElemType>& VT)
+{
+    if (A.IsEmpty())
+        LogicError("TruncatedSVD:  the input matrix is empty.");
+    if (A.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    const size_t m = A.GetNumRows(), n = A.GetNumCols();
+    const size_t l = min(max(rank, (size_t) 1), min(m, n));
+    const DEVICEID_TYPE deviceId = A.GetDeviceId();
+
+    // range finder: an orthonormal basis Y of the space spanned by A Omega, refined by multiplying with A A'
+    Matrix<ElemType> omega(n, l, deviceId), Y(deviceId), Z(deviceId);
+    omega.SetGaussianRandomValue(0, 1, seed);
+    Multiply(A, false, omega, false, Y);
+    OrthonormalizeColumns(Y);
+    for (size_t q = 0; q < numPowerIterations; q++)
+    {
+        Multiply(A, true, Y, false, Z);
+        OrthonormalizeColumns(Z);
+        Multiply(A, false, Z, false, Y);
+        OrthonormalizeColumns(Y);
+    }
+
+    // A ~ Y B with B = Y'A, and B = W SIGMA V' from the eigendecomposition of B B' = W SIGMA^2 W'
+    Matrix<ElemType> B(deviceId), G(deviceId);
+    Multiply(Y, true, A, false, B);
+    Multiply(B, false, B, true, G);
+    std::vector<double> eigenvalues, eigenvectors;
+    SymmetricEigenOnCPU(G, eigenvalues, eigenvectors);
+
+    const double threshold = eigenvalues[0] * std::numeric_limits<ElemType>::epsilon() * l;
+    Matrix<ElemType> W = ScaledEigenvectors<ElemType>(eigenvalues, eigenvectors, [](double)
+                                                      {
+                                                          return 1.0;
+                                                      }, deviceId);
+    Matrix<ElemType> WOverSigma = ScaledEigenvectors<ElemType>(eigenvalues, eigenvectors, [threshold](double lambda)
+                                                               {
+                                                                   return lambda > threshold ? 1 / sqrt(lambda) : 0;
+                                                               }, deviceId);
+    U.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    VT.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    U._transferToDevice(deviceId);
+    VT._transferToDevice(deviceId);
+    Multiply(Y, false, W, false, U);
+    Multiply(WOverSigma, true, B, false, VT);
+
+    std::vector<ElemType> sigma(l);
+    for (size_t j = 0; j < l; j++)
+        sigma[j] = (ElemType) (eigenvalues[j] > threshold ? sqrt(eigenvalues[j]) : 0);
+    SIGMA.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    SIGMA.SetValue(l, 1, deviceId, sigma.data(), matrixFlagNormal);
+}
+
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c = alpha * op(a) * op(b) + beta*c</summary>
 /// <param name="alpha">Scalar</param>
 /// <param name="a">Input matrix</param>
@@ -4026,17 +4588,163 @@ void Matrix<ElemType>::SVD(const Matrix<ElemType>& A, Matrix<ElemType>& SIGMA, M
 /// <param name="transposeB">Whether matrix b is transposed</param>
 /// <param name="beta">Scalar</param>
 /// <param name="c">Resulting matrix, user is responsible for allocating this</param>
+// batched MultiplyAndWeightedAdd(): c[i] = alpha * op(a[i]) * op(b[i]) + beta * c[i] for all i
+// All matrices must be dense and on the same device, and all products must have the same dimensions.
+// On the GPU this is a single batched GEMM, which saves the launch overhead of many small products (e.g. the gate projections of an LSTM in a time step).
+template <class ElemType>
+void Matrix<ElemType>::MultiplyAndWeightedAddBatched(ElemType alpha, const std::vector<const Matrix<ElemType>*>& a, const bool transposeA, const std::vector<const Matrix<ElemType>*>& b, const bool transposeB,
+                                                     ElemType beta, const std::vector<Matrix<ElemType>*>& c)
+{
+    const size_t batchSize = c.size();
+    if (a.size() != batchSize || b.size() != batchSize)
+        InvalidArgument("MultiplyAndWeightedAddBatched: There must be as many left and right factors as results.");
+    if (batchSize == 0)
+        return;
+
+    const DEVICEID_TYPE deviceId = c[0]->GetDeviceId();
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        if (a[i]->GetMatrixType() != MatrixType::DENSE || b[i]->GetMatrixType() != MatrixType::DENSE || c[i]->GetMatrixType() != MatrixType::DENSE)
+            InvalidArgument("MultiplyAndWeightedAddBatched: All matrices must be dense.");
+        if (a[i]->GetDeviceId() != deviceId || b[i]->GetDeviceId() != deviceId || c[i]->GetDeviceId() != deviceId)
+            InvalidArgument("MultiplyAndWeightedAddBatched: All matrices must be on the same device.");
+    }
+
+    if (deviceId < 0) // CPU: no batched GEMM, so just loop
+    {
+        for (size_t i = 0; i < batchSize; i++)
+        {
+            CPUMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, *a[i]->m_CPUMatrix, transposeA, *b[i]->m_CPUMatrix, transposeB, beta, *c[i]->m_CPUMatrix);
+            c[i]->SetDataLocation(CPU, DENSE);
+        }
+    }
+    else
+    {
+        std::vector<const GPUMatrix<ElemType>*> gpuA(batchSize), gpuB(batchSize);
+        std::vector<GPUMatrix<ElemType>*> gpuC(batchSize);
+        for (size_t i = 0; i < batchSize; i++)
+        {
+            gpuA[i] = a[i]->m_GPUMatrix;
+            gpuB[i] = b[i]->m_GPUMatrix;
+            gpuC[i] = c[i]->m_GPUMatrix;
+        }
+        GPUMatrix<ElemType>::MultiplyAndWeightedAddBatched(alpha, gpuA, transposeA, gpuB, transposeB, beta, gpuC);
+        for (size_t i = 0; i < batchSize; i++)
+            c[i]->SetDataLocation(GPU, DENSE);
+    }
+}
+
+// sumsOfSquares[i] = the squared Frobenius norm of matrices[i], for all i in a single reduction (e.g. for gradient clipping)
+// All matrices must be dense and on the same device.
+template <class ElemType>
+void Matrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const Matrix<ElemType>*>& matrices, std::vector<double>& sumsOfSquares)
+{
+    sumsOfSquares.assign(matrices.size(), 0);
+    if (matrices.empty())
+        return;
+
+    const DEVICEID_TYPE deviceId = matrices[0]->GetDeviceId();
+    for (const auto* matrix : matrices)
+    {
+        if (matrix->GetMatrixType() != MatrixType::DENSE)
+            InvalidArgument("MultiTensorSumOfSquares: All matrices must be dense.");
+        if (matrix->GetDeviceId() != deviceId)
+            InvalidArgument("MultiTensorSumOfSquares: All matrices must be on the same device.");
+    }
+
+    if (deviceId < 0)
+    {
+        std::vector<const CPUMatrix<ElemType>*> cpuMatrices;
+        for (const auto* matrix : matrices)
+            cpuMatrices.push_back(matrix->m_CPUMatrix);
+        CPUMatrix<ElemType>::MultiTensorSumOfSquares(cpuMatrices, sumsOfSquares);
+    }
+    else
+    {
+        std::vector<const GPUMatrix<ElemType>*> gpuMatrices;
+        for (const auto* matrix : matrices)
+            gpuMatrices.push_back(matrix->m_GPUMatrix);
+        GPUMatrix<ElemType>::MultiTensorSumOfSquares(gpuMatrices, sumsOfSquares);
+    }
+}
+
+// the SGD update of many parameters at once, in a single launch on the GPU and without temporaries: for each i, with
+//     g = gradientScales[i] * gradients[i], truncated to [-truncation, truncation] if truncation > 0, plus l2RegWeight * weights[i],
+// the update of NormalGrad() with (Nesterov) momentum, or for useAdaGrad that of Adagrad() (without the average multiplier)
+// followed by weights[i] -= learnRatePerSample * g; 'smoothedGradients' are updated, 'gradients' are not modified.
+// All matrices must be dense and on the same device, and the three matrices of a parameter of the same size.
+template <class ElemType>
+void Matrix<ElemType>::MultiTensorSGDUpdate(const std::vector<Matrix<ElemType>*>& weights, const std::vector<const Matrix<ElemType>*>& gradients, const std::vector<Matrix<ElemType>*>& smoothedGradients,
+                                            const std::vector<ElemType>& gradientScales, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                            const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad)
+{
+    const size_t numTensors = weights.size();
+    if (gradients.size() != numTensors || smoothedGradients.size() != numTensors || gradientScales.size() != numTensors)
+        InvalidArgument("MultiTensorSGDUpdate: There must be as many gradients, smoothed gradients and gradient scales as weights.");
+    if (numTensors == 0)
+        return;
+
+    const DEVICEID_TYPE deviceId = weights[0]->GetDeviceId();
+    for (size_t i = 0; i < numTensors; i++)
+    {
+        if (weights[i]->GetMatrixType() != MatrixType::DENSE || gradients[i]->GetMatrixType() != MatrixType::DENSE || smoothedGradients[i]->GetMatrixType() != MatrixType::DENSE)
+            InvalidArgument("MultiTensorSGDUpdate: All matrices must be dense.");
+        if (weights[i]->GetDeviceId() != deviceId || gradients[i]->GetDeviceId() != deviceId || smoothedGradients[i]->GetDeviceId() != deviceId)
+            InvalidArgument("MultiTensorSGDUpdate: All matrices must be on the same device.");
+        if (gradients[i]->GetNumElements() != weights[i]->GetNumElements() || smoothedGradients[i]->GetNumElements() != weights[i]->GetNumElements())
+            InvalidArgument("MultiTensorSGDUpdate: The gradients and smoothed gradients must have the size of the weights.");
+    }
+
+    if (deviceId < 0)
+    {
+        std::vector<CPUMatrix<ElemType>*> cpuWeights, cpuSmoothedGradients;
+        std::vector<const CPUMatrix<ElemType>*> cpuGradients;
+        for (size_t i = 0; i < numTensors; i++)
+        {
+            cpuWeights.push_back(weights[i]->m_CPUMatrix);
+            cpuGradients.push_back(gradients[i]->m_CPUMatrix);
+            cpuSmoothedGradients.push_back(smoothedGradients[i]->m_CPUMatrix);
+        }
+        CPUMatrix<ElemType>::MultiTensorSGDUpdate(cpuWeights, cpuGradients, cpuSmoothedGradients, gradientScales, truncation, l2RegWeight, learnRatePerSample, momentum, useNesterovMomentum, useAdaGrad);
+    }
+    else
+    {
+        std::vector<GPUMatrix<ElemType>*> gpuWeights, gpuSmoothedGradients;
+        std::vector<const GPUMatrix<ElemType>*> gpuGradients;
+        for (size_t i = 0; i < numTensors; i++)
+        {
+            gpuWeights.push_back(weights[i]->m_GPUMatrix);
+            gpuGradients.push_back(gradients[i]->m_GPUMatrix);
+            gpuSmoothedGradients.push_back(smoothedGradients[i]->m_GPUMatrix);
+        }
+        GPUMatrix<ElemType>::MultiTensorSGDUpdate(gpuWeights, gpuGradients, gpuSmoothedGradients, gradientScales, truncation, l2RegWeight, learnRatePerSample, momentum, useNesterovMomentum, useAdaGrad);
+    }
+    for (size_t i = 0; i < numTensors; i++)
+    {
+        weights[i]->SetDataLocation(deviceId < 0 ? CPU : GPU, DENSE);
+        smoothedGradients[i]->SetDataLocation(deviceId < 0 ? CPU : GPU, DENSE);
+    }
+}
+
 template <class ElemType>
 void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB,
                                               ElemType beta, Matrix<ElemType>& c)
 {
     DecideAndMoveToRightDevice(a, b, c);
+    CNTK_COUNTER_ADD("matrix.gemm", 1);
+    CNTK_HISTOGRAM_RECORD("matrix.gemmInnerDim", (long long) (transposeA ? a.GetNumRows() : a.GetNumCols()));
 
     if (c.GetDeviceId() < 0) // CPU
     {
         if (a.GetMatrixType() == MatrixType::SPARSE)
-            NOT_IMPLEMENTED;
-        if (b.GetMatrixType() == MatrixType::SPARSE)
+        {
+            if (b.GetMatrixType() != MatrixType::DENSE)
+                NOT_IMPLEMENTED;
+            c.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+            CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, *a.m_CPUSparseMatrix, transposeA, *b.m_CPUMatrix, transposeB, beta, *c.m_CPUMatrix);
+            c.SetDataLocation(CPU, DENSE);
+        }
+        else if (b.GetMatrixType() == MatrixType::SPARSE)
         {
             if (c.GetMatrixType() == MatrixType::DENSE)
             {
@@ -4320,6 +5028,546 @@ template <class ElemType>
                             GPUSparseMatrix<ElemType>::TensorShuffleScaleAndAdd(keepWeight, *a.m_GPUSparseMatrix, D, S, M, K, T, scaleFactor, *b.m_GPUSparseMatrix, *c.m_GPUSparseMatrix));
 }
 
+// LSTMPointwiseForward() -- the elementwise part of one LSTM time step, for S parallel sequences, in a single pass
+//  - gates:     [4H x S] in: pre-activations (W x + R h_prev + b), out: activations, stacked as [input; forget; output; cell candidate]
+//  - prevCell:  [H x S] cell state of the previous step
+//  - peepholes: [3H x 1] diagonal peephole weights p_i, p_f, p_o, or empty for none. With peepholes, the input and forget
+//               gates also see p .* c_prev and the output gate p_o .* c.
+//  - cell:      [H x S] out: c = sigmoid(f) .* c_prev + sigmoid(i) .* tanh(c~)
+//  - output:    [H x S] out: h = sigmoid(o) .* tanh(c)
+// All may be column slices of larger matrices. Dimensions must already be correct.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::LSTMPointwiseForward(Matrix<ElemType>& gates, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& peepholes, Matrix<ElemType>& cell, Matrix<ElemType>& output)
+{
+    size_t H = cell.GetNumRows(), S = cell.GetNumCols();
+    if (gates.GetNumRows() != 4 * H || gates.GetNumCols() != S || prevCell.GetNumRows() != H || prevCell.GetNumCols() != S || output.GetNumRows() != H || output.GetNumCols() != S)
+        InvalidArgument("LSTMPointwiseForward: gates must be [4H x S] and prevCell, cell and output [H x S].");
+    if (!peepholes.IsEmpty() && peepholes.GetNumElements() != 3 * H)
+        InvalidArgument("LSTMPointwiseForward: peepholes must be [3H x 1] or empty.");
+    if (cell.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(gates, prevCell, cell);
+    output._transferToDevice(gates.GetDeviceId());
+    if (!peepholes.IsEmpty())
+        peepholes._transferToDevice(gates.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&gates,
+                            nullptr,
+                            CPUMatrix<ElemType>::LSTMPointwiseForward(*gates.m_CPUMatrix, *prevCell.m_CPUMatrix, peepholes.IsEmpty() ? nullptr : peepholes.m_CPUMatrix, *cell.m_CPUMatrix, *output.m_CPUMatrix),
+                            GPUMatrix<ElemType>::LSTMPointwiseForward(*gates.m_GPUMatrix, *prevCell.m_GPUMatrix, peepholes.IsEmpty() ? nullptr : peepholes.m_GPUMatrix, *cell.m_GPUMatrix, *output.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// LSTMPointwiseBackward() -- gradient of LSTMPointwiseForward() for one time step
+//  - gates, cell, prevCell, peepholes: as passed to and computed by LSTMPointwiseForward() (gates are the activations)
+//  - outputGradient: [H x S] dh, already including the gradient that flows back through the recurrence
+//  - cellGradient:   [H x S] in: gradient w.r.t. c from the next step; out: gradient w.r.t. c_prev
+//  - gatesGradient:  [4H x S] out: gradient w.r.t. the pre-activations
+// The gradient w.r.t. the peepholes is left to the caller: it is the row sum of the gate gradients times c_prev resp. c.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::LSTMPointwiseBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& cell, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& peepholes, const Matrix<ElemType>& outputGradient,
+                                                       Matrix<ElemType>& cellGradient, Matrix<ElemType>& gatesGradient)
+{
+    size_t H = cell.GetNumRows(), S = cell.GetNumCols();
+    if (gates.GetNumRows() != 4 * H || gates.GetNumCols() != S || gatesGradient.GetNumRows() != 4 * H || gatesGradient.GetNumCols() != S ||
+        prevCell.GetNumRows() != H || prevCell.GetNumCols() != S || outputGradient.GetNumRows() != H || outputGradient.GetNumCols() != S ||
+        cellGradient.GetNumRows() != H || cellGradient.GetNumCols() != S)
+        InvalidArgument("LSTMPointwiseBackward: gates and gatesGradient must be [4H x S] and cell, prevCell, outputGradient and cellGradient [H x S].");
+    if (!peepholes.IsEmpty() && peepholes.GetNumElements() != 3 * H)
+        InvalidArgument("LSTMPointwiseBackward: peepholes must be [3H x 1] or empty.");
+    if (cell.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(gates, cell, prevCell);
+    outputGradient._transferToDevice(gates.GetDeviceId());
+    cellGradient._transferToDevice(gates.GetDeviceId());
+    gatesGradient._transferToDevice(gates.GetDeviceId());
+    if (!peepholes.IsEmpty())
+        peepholes._transferToDevice(gates.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&gates,
+                            nullptr,
+                            CPUMatrix<ElemType>::LSTMPointwiseBackward(*gates.m_CPUMatrix, *cell.m_CPUMatrix, *prevCell.m_CPUMatrix, peepholes.IsEmpty() ? nullptr : peepholes.m_CPUMatrix, *outputGradient.m_CPUMatrix, *cellGradient.m_CPUMatrix, *gatesGradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::LSTMPointwiseBackward(*gates.m_GPUMatrix, *cell.m_GPUMatrix, *prevCell.m_GPUMatrix, peepholes.IsEmpty() ? nullptr : peepholes.m_GPUMatrix, *outputGradient.m_GPUMatrix, *cellGradient.m_GPUMatrix, *gatesGradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// GRUPointwiseForward() -- the elementwise part of one GRU time step, for S parallel sequences, in a single pass
+//  - gates:      [3H x S] in: input projections (W x + b), out: activations, stacked as [reset; update; candidate]
+//  - recurrent:  [3H x S] recurrent projections R h_prev, in the same order; kept for the backward pass
+//  - prevOutput: [H x S] output of the previous step
+//  - output:     [H x S] out: h = (1 - u) .* n + u .* h_prev, where r = sigmoid(.), u = sigmoid(.) and n = tanh(W_n x + b_n + r .* R_n h_prev)
+// The reset gate is applied after the recurrent projection (as in cuDNN), so that all of R h_prev is a single GEMM.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::GRUPointwiseForward(Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, Matrix<ElemType>& output)
+{
+    size_t H = output.GetNumRows(), S = output.GetNumCols();
+    if (gates.GetNumRows() != 3 * H || gates.GetNumCols() != S || recurrent.GetNumRows() != 3 * H || recurrent.GetNumCols() != S || prevOutput.GetNumRows() != H || prevOutput.GetNumCols() != S)
+        InvalidArgument("GRUPointwiseForward: gates and recurrent must be [3H x S] and prevOutput and output [H x S].");
+    if (output.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(gates, recurrent, prevOutput);
+    output._transferToDevice(gates.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&gates,
+                            nullptr,
+                            CPUMatrix<ElemType>::GRUPointwiseForward(*gates.m_CPUMatrix, *recurrent.m_CPUMatrix, *prevOutput.m_CPUMatrix, *output.m_CPUMatrix),
+                            GPUMatrix<ElemType>::GRUPointwiseForward(*gates.m_GPUMatrix, *recurrent.m_GPUMatrix, *prevOutput.m_GPUMatrix, *output.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// GRUPointwiseBackward() -- gradient of GRUPointwiseForward() for one time step
+//  - gates, recurrent, prevOutput: as passed to and computed by GRUPointwiseForward() (gates are the activations)
+//  - outputGradient:    [H x S] in: dh, already including the gradient that flows back through the recurrence;
+//                       out: the direct part of the gradient w.r.t. h_prev, dh .* u
+//  - gatesGradient:     [3H x S] out: gradient w.r.t. the input projections
+//  - recurrentGradient: [3H x S] out: gradient w.r.t. the recurrent projections
+// The caller adds R^T recurrentGradient to the gradient w.r.t. h_prev.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::GRUPointwiseBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, Matrix<ElemType>& outputGradient,
+                                                      Matrix<ElemType>& gatesGradient, Matrix<ElemType>& recurrentGradient)
+{
+    size_t H = prevOutput.GetNumRows(), S = prevOutput.GetNumCols();
+    if (gates.GetNumRows() != 3 * H || gates.GetNumCols() != S || recurrent.GetNumRows() != 3 * H || recurrent.GetNumCols() != S ||
+        gatesGradient.GetNumRows() != 3 * H || gatesGradient.GetNumCols() != S || recurrentGradient.GetNumRows() != 3 * H || recurrentGradient.GetNumCols() != S ||
+        outputGradient.GetNumRows() != H || outputGradient.GetNumCols() != S)
+        InvalidArgument("GRUPointwiseBackward: gates, recurrent, gatesGradient and recurrentGradient must be [3H x S] and prevOutput and outputGradient [H x S].");
+    if (prevOutput.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(gates, recurrent, prevOutput);
+    outputGradient._transferToDevice(gates.GetDeviceId());
+    gatesGradient._transferToDevice(gates.GetDeviceId());
+    recurrentGradient._transferToDevice(gates.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&gates,
+                            nullptr,
+                            CPUMatrix<ElemType>::GRUPointwiseBackward(*gates.m_CPUMatrix, *recurrent.m_CPUMatrix, *prevOutput.m_CPUMatrix, *outputGradient.m_CPUMatrix, *gatesGradient.m_CPUMatrix, *recurrentGradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::GRUPointwiseBackward(*gates.m_GPUMatrix, *recurrent.m_GPUMatrix, *prevOutput.m_GPUMatrix, *outputGradient.m_GPUMatrix, *gatesGradient.m_GPUMatrix, *recurrentGradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// CosDistanceWithNegativeSamples() -- the cosine similarities of DSSM training in a single pass, without shifted copies of the inputs
+//  - left, right:  [D x n] n pairs of positive samples (a_j, b_j)
+//  - invNormLeft:  [1 x n] out: 1 / ||a_j||, kept for the gradient; likewise invNormRight
+//  - cosDistance:  [(negNumber + 1) x n] out: row 0 is cos(a_j, b_j), row m > 0 is cos(a_j, b_k) with k = (j + shift + m - 1) mod n,
+//                  i.e. the right column m - 1 + shift positions further serves as the m-th negative sample of a_j
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CosDistanceWithNegativeSamples(const Matrix<ElemType>& left, const Matrix<ElemType>& right, size_t shift, size_t negNumber,
+                                                                Matrix<ElemType>& invNormLeft, Matrix<ElemType>& invNormRight, Matrix<ElemType>& cosDistance)
+{
+    size_t n = left.GetNumCols();
+    if (right.GetNumRows() != left.GetNumRows() || right.GetNumCols() != n || cosDistance.GetNumRows() != negNumber + 1 || cosDistance.GetNumCols() != n)
+        InvalidArgument("CosDistanceWithNegativeSamples: left and right must be [D x n] and cosDistance [(negNumber + 1) x n].");
+    if (cosDistance.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(left, right, cosDistance);
+    invNormLeft._transferToDevice(left.GetDeviceId());
+    invNormRight._transferToDevice(left.GetDeviceId());
+    invNormLeft.Resize(1, n);
+    invNormRight.Resize(1, n);
+
+    DISPATCH_MATRIX_ON_FLAG(&left,
+                            nullptr,
+                            CPUMatrix<ElemType>::CosDistanceWithNegativeSamples(*left.m_CPUMatrix, *right.m_CPUMatrix, shift, *invNormLeft.m_CPUMatrix, *invNormRight.m_CPUMatrix, *cosDistance.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CosDistanceWithNegativeSamples(*left.m_GPUMatrix, *right.m_GPUMatrix, shift, *invNormLeft.m_GPUMatrix, *invNormRight.m_GPUMatrix, *cosDistance.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// CosDistanceWithNegativeSamplesGradient() -- adds the gradient of CosDistanceWithNegativeSamples() w.r.t. one of its inputs
+//  - left, right, invNormLeft, invNormRight, cosDistance: as passed to and computed by CosDistanceWithNegativeSamples()
+//  - gradient:      [(negNumber + 1) x n] gradient w.r.t. cosDistance
+//  - wrtRight:      false for the gradient w.r.t. left, true for right
+//  - inputGradient: [D x n] the gradient to add to
+// Each column of the input gradient gathers the terms of all the similarities it took part in, so nothing is shifted or copied.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient(const Matrix<ElemType>& left, const Matrix<ElemType>& right, const Matrix<ElemType>& invNormLeft, const Matrix<ElemType>& invNormRight,
+                                                                        const Matrix<ElemType>& cosDistance, const Matrix<ElemType>& gradient, size_t shift, bool wrtRight, Matrix<ElemType>& inputGradient)
+{
+    size_t D = left.GetNumRows(), n = left.GetNumCols();
+    if (right.GetNumRows() != D || right.GetNumCols() != n || invNormLeft.GetNumElements() != n || invNormRight.GetNumElements() != n ||
+        cosDistance.GetNumCols() != n || gradient.GetNumRows() != cosDistance.GetNumRows() || gradient.GetNumCols() != n ||
+        inputGradient.GetNumRows() != D || inputGradient.GetNumCols() != n)
+        InvalidArgument("CosDistanceWithNegativeSamplesGradient: left, right and inputGradient must be [D x n], invNormLeft and invNormRight [1 x n], and cosDistance and gradient [(negNumber + 1) x n].");
+    if (inputGradient.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(left, right, inputGradient);
+    invNormLeft._transferToDevice(left.GetDeviceId());
+    invNormRight._transferToDevice(left.GetDeviceId());
+    cosDistance._transferToDevice(left.GetDeviceId());
+    gradient._transferToDevice(left.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&left,
+                            nullptr,
+                            CPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(*left.m_CPUMatrix, *right.m_CPUMatrix, *invNormLeft.m_CPUMatrix, *invNormRight.m_CPUMatrix, *cosDistance.m_CPUMatrix, *gradient.m_CPUMatrix, shift, wrtRight, *inputGradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(*left.m_GPUMatrix, *right.m_GPUMatrix, *invNormLeft.m_GPUMatrix, *invNormRight.m_GPUMatrix, *cosDistance.m_GPUMatrix, *gradient.m_GPUMatrix, shift, wrtRight, *inputGradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// AttentionForward() -- scaled dot-product attention in a single pass, without materializing the score matrix
+//  - query:     [D x Nq]
+//  - keys:      [D x Nk], values: [Dv x Nk]
+//  - keyRanges: [2 x Nq] for each query j, the first key column f_j and the number n_j of keys it attends to, which are the
+//               columns f_j + i * keyStride, i < n_j (e.g. the frames of one sequence in an MBLayout); n_j = 0 gives a 0 context
+//  - context:   [Dv x Nq] out: c_j = sum_i softmax_i(scale * q_j^T k_i) v_i
+//  - logSumExp: [1 x Nq] out: log sum_i exp(scale * q_j^T k_i), from which AttentionBackward() recomputes the softmax
+// All may be column slices of larger matrices. Dimensions must already be correct.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::AttentionForward(const Matrix<ElemType>& query, const Matrix<ElemType>& keys, const Matrix<ElemType>& values, const Matrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                                  Matrix<ElemType>& context, Matrix<ElemType>& logSumExp)
+{
+    size_t Nq = query.GetNumCols();
+    if (keys.GetNumRows() != query.GetNumRows() || values.GetNumCols() != keys.GetNumCols() || keyRanges.GetNumRows() != 2 || keyRanges.GetNumCols() != Nq ||
+        context.GetNumRows() != values.GetNumRows() || context.GetNumCols() != Nq || logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != Nq)
+        InvalidArgument("AttentionForward: query must be [D x Nq], keys [D x Nk], values [Dv x Nk], keyRanges [2 x Nq], context [Dv x Nq] and logSumExp [1 x Nq].");
+    if (context.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(query, keys, values);
+    keyRanges._transferToDevice(query.GetDeviceId());
+    context._transferToDevice(query.GetDeviceId());
+    logSumExp._transferToDevice(query.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&query,
+                            nullptr,
+                            CPUMatrix<ElemType>::AttentionForward(*query.m_CPUMatrix, *keys.m_CPUMatrix, *values.m_CPUMatrix, *keyRanges.m_CPUMatrix, keyStride, scale, *context.m_CPUMatrix, *logSumExp.m_CPUMatrix),
+                            GPUMatrix<ElemType>::AttentionForward(*query.m_GPUMatrix, *keys.m_GPUMatrix, *values.m_GPUMatrix, *keyRanges.m_GPUMatrix, keyStride, scale, *context.m_GPUMatrix, *logSumExp.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// AttentionBackward() -- gradient of AttentionForward(), recomputing the softmax from logSumExp instead of having stored it
+//  - query, keys, values, keyRanges, keyStride, scale: as passed to AttentionForward()
+//  - context, logSumExp: as computed by AttentionForward()
+//  - contextGradient: [Dv x Nq]
+//  - queryGradient: [D x Nq], keysGradient: [D x Nk], valuesGradient: [Dv x Nk] in/out: the gradients are added; an empty one is not computed
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::AttentionBackward(const Matrix<ElemType>& query, const Matrix<ElemType>& keys, const Matrix<ElemType>& values, const Matrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                                   const Matrix<ElemType>& context, const Matrix<ElemType>& logSumExp, const Matrix<ElemType>& contextGradient,
+                                                   Matrix<ElemType>& queryGradient, Matrix<ElemType>& keysGradient, Matrix<ElemType>& valuesGradient)
+{
+    size_t Nq = query.GetNumCols();
+    if (keys.GetNumRows() != query.GetNumRows() || values.GetNumCols() != keys.GetNumCols() || keyRanges.GetNumRows() != 2 || keyRanges.GetNumCols() != Nq ||
+        context.GetNumRows() != values.GetNumRows() || context.GetNumCols() != Nq || logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != Nq ||
+        contextGradient.GetNumRows() != context.GetNumRows() || contextGradient.GetNumCols() != Nq ||
+        (!queryGradient.IsEmpty() && (queryGradient.GetNumRows() != query.GetNumRows() || queryGradient.GetNumCols() != Nq)) ||
+        (!keysGradient.IsEmpty() && (keysGradient.GetNumRows() != keys.GetNumRows() || keysGradient.GetNumCols() != keys.GetNumCols())) ||
+        (!valuesGradient.IsEmpty() && (valuesGradient.GetNumRows() != values.GetNumRows() || valuesGradient.GetNumCols() != values.GetNumCols())))
+        InvalidArgument("AttentionBackward: The gradients must have the dimensions of query, keys and values, and contextGradient those of context.");
+    if (context.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(query, keys, values);
+    const DEVICEID_TYPE deviceId = query.GetDeviceId();
+    keyRanges._transferToDevice(deviceId);
+    context._transferToDevice(deviceId);
+    logSumExp._transferToDevice(deviceId);
+    contextGradient._transferToDevice(deviceId);
+    for (auto gradient : { &queryGradient, &keysGradient, &valuesGradient })
+    {
+        if (!gradient->IsEmpty())
+            gradient->_transferToDevice(deviceId);
+    }
+
+    DISPATCH_MATRIX_ON_FLAG(&query,
+                            nullptr,
+                            CPUMatrix<ElemType>::AttentionBackward(*query.m_CPUMatrix, *keys.m_CPUMatrix, *values.m_CPUMatrix, *keyRanges.m_CPUMatrix, keyStride, scale,
+                                                                   *context.m_CPUMatrix, *logSumExp.m_CPUMatrix, *contextGradient.m_CPUMatrix,
+                                                                   queryGradient.IsEmpty() ? nullptr : queryGradient.m_CPUMatrix,
+                                                                   keysGradient.IsEmpty() ? nullptr : keysGradient.m_CPUMatrix,
+                                                                   valuesGradient.IsEmpty() ? nullptr : valuesGradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::AttentionBackward(*query.m_GPUMatrix, *keys.m_GPUMatrix, *values.m_GPUMatrix, *keyRanges.m_GPUMatrix, keyStride, scale,
+                                                                   *context.m_GPUMatrix, *logSumExp.m_GPUMatrix, *contextGradient.m_GPUMatrix,
+                                                                   queryGradient.IsEmpty() ? nullptr : queryGradient.m_GPUMatrix,
+                                                                   keysGradient.IsEmpty() ? nullptr : keysGradient.m_GPUMatrix,
+                                                                   valuesGradient.IsEmpty() ? nullptr : valuesGradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// CrossEntropyWithSoftmaxForward() -- cross entropy of softmax(logits) against the labels in a single pass over the columns
+//  - labels:     [M x N] dense, or sparse CSC (e.g. one-hot), in which case the loss gathers the logits at its non-zeros
+//  - logits:     [M x N]
+//  - logSumExp:  [1 x N] out: log sum_i exp(logits(i,j)), from which CrossEntropyWithSoftmaxBackward() recomputes the softmax
+//  - columnLoss: [1 x N] out: -sum_i labels(i,j) * log softmax_i(logits(:,j))
+// All may be column slices of larger matrices. Dimensions must already be correct.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CrossEntropyWithSoftmaxForward(const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, Matrix<ElemType>& logSumExp, Matrix<ElemType>& columnLoss)
+{
+    size_t N = logits.GetNumCols();
+    if (labels.GetNumRows() != logits.GetNumRows() || labels.GetNumCols() != N ||
+        logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != N || columnLoss.GetNumRows() != 1 || columnLoss.GetNumCols() != N)
+        InvalidArgument("CrossEntropyWithSoftmaxForward: labels and logits must be [M x N], and logSumExp and columnLoss [1 x N].");
+    if (logits.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(labels, logits, logSumExp);
+    columnLoss._transferToDevice(logits.GetDeviceId());
+
+    if (logits.GetMatrixType() != DENSE || (labels.GetMatrixType() == SPARSE && labels.GetFormat() != matrixFormatSparseCSC))
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(&labels,
+                            nullptr,
+                            CPUMatrix<ElemType>::CrossEntropyWithSoftmaxForward(*labels.m_CPUMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *columnLoss.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CrossEntropyWithSoftmaxForward(*labels.m_GPUMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *columnLoss.m_GPUMatrix),
+                            CPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxForward(*labels.m_CPUSparseMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *columnLoss.m_CPUMatrix),
+                            GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxForward(*labels.m_GPUSparseMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *columnLoss.m_GPUMatrix));
+}
+
+// CrossEntropyWithSoftmaxBackward() -- gradient of CrossEntropyWithSoftmaxForward() w.r.t. the logits, recomputing the softmax from logSumExp
+//  - alpha: [1 x 1] the gradient of the summed loss
+//  - labels, logits: as passed to CrossEntropyWithSoftmaxForward()
+//  - logSumExp: as computed by CrossEntropyWithSoftmaxForward()
+//  - gradient: [M x N] in/out: alpha * (softmax(logits) - labels) is added
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CrossEntropyWithSoftmaxBackward(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, const Matrix<ElemType>& logSumExp,
+                                                                 Matrix<ElemType>& gradient)
+{
+    size_t N = logits.GetNumCols();
+    if (alpha.GetNumElements() != 1 || labels.GetNumRows() != logits.GetNumRows() || labels.GetNumCols() != N ||
+        logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != N || gradient.GetNumRows() != logits.GetNumRows() || gradient.GetNumCols() != N)
+        InvalidArgument("CrossEntropyWithSoftmaxBackward: alpha must be [1 x 1], labels, logits and gradient [M x N], and logSumExp [1 x N].");
+    if (logits.IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(gradient, labels, logits);
+    alpha._transferToDevice(gradient.GetDeviceId());
+    logSumExp._transferToDevice(gradient.GetDeviceId());
+
+    if (!(alpha.GetMatrixType() == DENSE && logits.GetMatrixType() == DENSE && gradient.GetMatrixType() == DENSE) ||
+        (labels.GetMatrixType() == SPARSE && labels.GetFormat() != matrixFormatSparseCSC))
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(&labels,
+                            nullptr,
+                            CPUMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(*alpha.m_CPUMatrix, *labels.m_CPUMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *gradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(*alpha.m_GPUMatrix, *labels.m_GPUMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *gradient.m_GPUMatrix),
+                            CPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(*alpha.m_CPUMatrix, *labels.m_CPUSparseMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *gradient.m_CPUMatrix),
+                            GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(*alpha.m_GPUMatrix, *labels.m_GPUSparseMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *gradient.m_GPUMatrix));
+    gradient.SetDataLocation(gradient.GetDeviceId() < 0 ? CurrentDataLocation::CPU : CurrentDataLocation::GPU, DENSE); // (dispatched on the type of the labels)
+}
+
+// SegmentedLogSoftmax() -- log softmax and cross entropy over segments of the elements of a matrix, in one kernel for all
+//  - values:   any shape, dense
+//  - segments: [3 x S] for each segment s, the offset of its first element (in column-major order), its length, and the
+//              position of its target within it; segments must not overlap, and elements outside of all are not touched
+//  - logProbs: in/out, shape of values: the log softmax of each segment; may be the same matrix as values
+//  - loss:     [1 x S] out: -logProbs at the target of each segment
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::SegmentedLogSoftmax(const Matrix<ElemType>& values, const Matrix<ElemType>& segments, Matrix<ElemType>& logProbs, Matrix<ElemType>& loss)
+{
+    size_t S = segments.GetNumCols();
+    if (segments.GetNumRows() != 3 || logProbs.GetNumRows() != values.GetNumRows() || logProbs.GetNumCols() != values.GetNumCols() ||
+        loss.GetNumRows() != 1 || loss.GetNumCols() != S)
+        InvalidArgument("SegmentedLogSoftmax: segments must be [3 x S], logProbs have the dimensions of values, and loss be [1 x S].");
+    if (S == 0)
+        return;
+
+    DecideAndMoveToRightDevice(values, segments, logProbs);
+    loss._transferToDevice(values.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&values,
+                            nullptr,
+                            CPUMatrix<ElemType>::SegmentedLogSoftmax(*values.m_CPUMatrix, *segments.m_CPUMatrix, *logProbs.m_CPUMatrix, *loss.m_CPUMatrix),
+                            GPUMatrix<ElemType>::SegmentedLogSoftmax(*values.m_GPUMatrix, *segments.m_GPUMatrix, *logProbs.m_GPUMatrix, *loss.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// SegmentedSoftmaxGradient() -- gradient of the summed loss of SegmentedLogSoftmax() w.r.t. its values
+//  - alpha: [1 x 1] the gradient of the summed loss
+//  - logProbs, segments: as passed to SegmentedLogSoftmax()
+//  - gradient: shape of values, in/out: within the segments, gradient = beta * gradient + alpha * (softmax - onehot(target))
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::SegmentedSoftmaxGradient(const Matrix<ElemType>& alpha, const Matrix<ElemType>& logProbs, const Matrix<ElemType>& segments, ElemType beta, Matrix<ElemType>& gradient)
+{
+    if (alpha.GetNumElements() != 1 || segments.GetNumRows() != 3 || gradient.GetNumRows() != logProbs.GetNumRows() || gradient.GetNumCols() != logProbs.GetNumCols())
+        InvalidArgument("SegmentedSoftmaxGradient: alpha must be [1 x 1], segments [3 x S], and gradient have the dimensions of logProbs.");
+    if (segments.GetNumCols() == 0)
+        return;
+
+    DecideAndMoveToRightDevice(gradient, logProbs, segments);
+    alpha._transferToDevice(gradient.GetDeviceId());
+
+    DISPATCH_MATRIX_ON_FLAG(&gradient,
+                            &gradient,
+                            CPUMatrix<ElemType>::SegmentedSoftmaxGradient(*alpha.m_CPUMatrix, *logProbs.m_CPUMatrix, *segments.m_CPUMatrix, beta, *gradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::SegmentedSoftmaxGradient(*alpha.m_GPUMatrix, *logProbs.m_GPUMatrix, *segments.m_GPUMatrix, beta, *gradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// NoiseContrastiveLoss() -- loss and gradient of the binary classification of noise contrastive estimation, in one pass
+//  - logits:   [(1 + k) x T] for each column, the score of the target in row 0 and of k noise samples below, each minus log(k * q) of its noise probability q
+//  - loss:     [1 x T] out: softplus(-logits(0, t)) + sum_i softplus(logits(i, t)), i.e. -log sigmoid for the target and -log(1 - sigmoid) for the noise
+//  - gradient: [(1 + k) x T] out: d loss / d logits, i.e. sigmoid(logits) - 1 in row 0 and sigmoid(logits) below
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::NoiseContrastiveLoss(const Matrix<ElemType>& logits, Matrix<ElemType>& loss, Matrix<ElemType>& gradient)
+{
+    if (logits.GetNumRows() == 0)
+        InvalidArgument("NoiseContrastiveLoss: logits must have a row for the target.");
+    if (logits.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(logits, loss, gradient);
+    loss.Resize(1, logits.GetNumCols());
+    gradient.Resize(logits.GetNumRows(), logits.GetNumCols());
+    if (logits.GetNumCols() == 0)
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(&logits,
+                            nullptr,
+                            CPUMatrix<ElemType>::NoiseContrastiveLoss(*logits.m_CPUMatrix, *loss.m_CPUMatrix, *gradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::NoiseContrastiveLoss(*logits.m_GPUMatrix, *loss.m_GPUMatrix, *gradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// CRFForward() -- forward recursion of a linear-chain CRF in log space, and the loss, for all sequences at once
+// A path y through a sequence of T frames scores sum_t scores(y_t, t) + sum_{t>0} transitions(y_t, y_{t-1}).
+//  - labelIds:    [1 x N] the label of each column, as a number
+//  - scores:      [L x N] the score of each label at each column
+//  - transitions: [L x L] (k, j) is the score of label k following label j
+//  - sequences:   [2 x S] for each sequence, its first column and its number of frames (> 0), which are 'stride' columns
+//                 apart; sequences must not overlap, and columns outside of all are not touched
+//  - logAlpha:    [L x N] out: log sum of exp(score) over the paths ending in label k at the column (including its score)
+//  - logPartition: [1 x S] out: log Z, the log sum of exp(score) over all paths through the sequence
+//  - loss:        [1 x S] out: log Z - the score of the labeled path, i.e. -log P(labels)
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CRFForward(const Matrix<ElemType>& labelIds, const Matrix<ElemType>& scores, const Matrix<ElemType>& transitions, const Matrix<ElemType>& sequences, size_t stride,
+                                            Matrix<ElemType>& logAlpha, Matrix<ElemType>& logPartition, Matrix<ElemType>& loss)
+{
+    const size_t L = scores.GetNumRows();
+    const size_t N = scores.GetNumCols();
+    if (labelIds.GetNumRows() != 1 || labelIds.GetNumCols() != N || transitions.GetNumRows() != L || transitions.GetNumCols() != L || sequences.GetNumRows() != 2 || stride == 0)
+        InvalidArgument("CRFForward: labelIds must be [1 x N] for [L x N] scores, transitions [L x L], sequences [2 x S], and the stride positive.");
+    if (scores.GetMatrixType() != DENSE || transitions.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(scores, transitions, labelIds);
+    const DEVICEID_TYPE deviceId = scores.GetDeviceId();
+    sequences._transferToDevice(deviceId);
+    logAlpha._transferToDevice(deviceId);
+    logPartition._transferToDevice(deviceId);
+    loss._transferToDevice(deviceId);
+    logAlpha.Resize(L, N);
+    logPartition.Resize(1, sequences.GetNumCols());
+    loss.Resize(1, sequences.GetNumCols());
+    if (sequences.GetNumCols() == 0)
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(&scores,
+                            nullptr,
+                            CPUMatrix<ElemType>::CRFForward(*labelIds.m_CPUMatrix, *scores.m_CPUMatrix, *transitions.m_CPUMatrix, *sequences.m_CPUMatrix, stride,
+                                                            *logAlpha.m_CPUMatrix, *logPartition.m_CPUMatrix, *loss.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CRFForward(*labelIds.m_GPUMatrix, *scores.m_GPUMatrix, *transitions.m_GPUMatrix, *sequences.m_GPUMatrix, stride,
+                                                            *logAlpha.m_GPUMatrix, *logPartition.m_GPUMatrix, *loss.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// CRFBackward() -- backward recursion of a linear-chain CRF in log space, and the gradients of the summed loss of CRFForward()
+//  - alpha: [1 x 1] the gradient of the summed loss
+//  - labelIds, scores, transitions, sequences, stride: as passed to CRFForward()
+//  - logAlpha, logPartition: as computed by CRFForward()
+//  - logBeta: [L x N] out: log sum of exp(score) over the continuations of label k at the column (excluding its score)
+//  - scoresGradient: [L x N] in/out: alpha * (P(y_t = k) - [labels_t = k]) is added within the sequences
+//  - transitionsGradient: [L x L] in/out: alpha * sum_t (P(y_t = k, y_{t-1} = j) - [labels_t = k, labels_{t-1} = j]) is added
+//  An empty gradient is not computed.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CRFBackward(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labelIds, const Matrix<ElemType>& scores, const Matrix<ElemType>& transitions, const Matrix<ElemType>& sequences, size_t stride,
+                                             const Matrix<ElemType>& logAlpha, const Matrix<ElemType>& logPartition, Matrix<ElemType>& logBeta, Matrix<ElemType>& scoresGradient, Matrix<ElemType>& transitionsGradient)
+{
+    const size_t L = scores.GetNumRows();
+    const size_t N = scores.GetNumCols();
+    if (alpha.GetNumElements() != 1 || labelIds.GetNumRows() != 1 || labelIds.GetNumCols() != N || transitions.GetNumRows() != L || transitions.GetNumCols() != L ||
+        sequences.GetNumRows() != 2 || stride == 0 || logAlpha.GetNumRows() != L || logAlpha.GetNumCols() != N ||
+        logPartition.GetNumRows() != 1 || logPartition.GetNumCols() != sequences.GetNumCols() ||
+        (!scoresGradient.IsEmpty() && (scoresGradient.GetNumRows() != L || scoresGradient.GetNumCols() != N)) ||
+        (!transitionsGradient.IsEmpty() && (transitionsGradient.GetNumRows() != L || transitionsGradient.GetNumCols() != L)))
+        InvalidArgument("CRFBackward: The arguments must be as passed to and computed by CRFForward(), and the gradients have the dimensions of scores and transitions.");
+    if (scores.GetMatrixType() != DENSE || transitions.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(scores, transitions, labelIds);
+    const DEVICEID_TYPE deviceId = scores.GetDeviceId();
+    alpha._transferToDevice(deviceId);
+    sequences._transferToDevice(deviceId);
+    logAlpha._transferToDevice(deviceId);
+    logPartition._transferToDevice(deviceId);
+    logBeta._transferToDevice(deviceId);
+    for (auto gradient : { &scoresGradient, &transitionsGradient })
+    {
+        if (!gradient->IsEmpty())
+            gradient->_transferToDevice(deviceId);
+    }
+    logBeta.Resize(L, N);
+    if (sequences.GetNumCols() == 0)
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(&scores,
+                            nullptr,
+                            CPUMatrix<ElemType>::CRFBackward(*alpha.m_CPUMatrix, *labelIds.m_CPUMatrix, *scores.m_CPUMatrix, *transitions.m_CPUMatrix, *sequences.m_CPUMatrix, stride,
+                                                             *logAlpha.m_CPUMatrix, *logPartition.m_CPUMatrix, *logBeta.m_CPUMatrix,
+                                                             scoresGradient.IsEmpty() ? nullptr : scoresGradient.m_CPUMatrix,
+                                                             transitionsGradient.IsEmpty() ? nullptr : transitionsGradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CRFBackward(*alpha.m_GPUMatrix, *labelIds.m_GPUMatrix, *scores.m_GPUMatrix, *transitions.m_GPUMatrix, *sequences.m_GPUMatrix, stride,
+                                                             *logAlpha.m_GPUMatrix, *logPartition.m_GPUMatrix, *logBeta.m_GPUMatrix,
+                                                             scoresGradient.IsEmpty() ? nullptr : scoresGradient.m_GPUMatrix,
+                                                             transitionsGradient.IsEmpty() ? nullptr : transitionsGradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+// CRFViterbi() -- the best path of a linear-chain CRF through each sequence
+//  - scores, transitions, sequences, stride: as for CRFForward()
+//  - bestScores: [L x N] out: the score of the best path ending in label k at the column
+//  - backpointers: [L x N] out: the label before k on that path
+//  - path: [L x N] out: one-hot labels of the best path of each sequence, 0 outside of the sequences; ties go to the lower label
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CRFViterbi(const Matrix<ElemType>& scores, const Matrix<ElemType>& transitions, const Matrix<ElemType>& sequences, size_t stride,
+                                            Matrix<ElemType>& bestScores, Matrix<ElemType>& backpointers, Matrix<ElemType>& path)
+{
+    const size_t L = scores.GetNumRows();
+    const size_t N = scores.GetNumCols();
+    if (transitions.GetNumRows() != L || transitions.GetNumCols() != L || sequences.GetNumRows() != 2 || stride == 0)
+        InvalidArgument("CRFViterbi: transitions must be [L x L] for [L x N] scores, sequences [2 x S], and the stride positive.");
+    if (scores.GetMatrixType() != DENSE || transitions.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(scores, transitions, sequences);
+    const DEVICEID_TYPE deviceId = scores.GetDeviceId();
+    bestScores._transferToDevice(deviceId);
+    backpointers._transferToDevice(deviceId);
+    path._transferToDevice(deviceId);
+    bestScores.Resize(L, N);
+    backpointers.Resize(L, N);
+    path.Resize(L, N);
+    path.SetValue(0);
+    if (sequences.GetNumCols() == 0)
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(&scores,
+                            nullptr,
+                            CPUMatrix<ElemType>::CRFViterbi(*scores.m_CPUMatrix, *transitions.m_CPUMatrix, *sequences.m_CPUMatrix, stride,
+                                                            *bestScores.m_CPUMatrix, *backpointers.m_CPUMatrix, *path.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CRFViterbi(*scores.m_GPUMatrix, *transitions.m_GPUMatrix, *sequences.m_GPUMatrix, stride,
+                                                            *bestScores.m_GPUMatrix, *backpointers.m_GPUMatrix, *path.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 /// <summary>c += alpha * (a-b)</summary>
 /// if a, b, c  must have same dim
 /// <param name="alpha">Scalar</param>
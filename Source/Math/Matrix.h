@@ -55,6 +55,8 @@ template <class ElemType>
 class CPUSparseMatrix;
 template <class ElemType>
 class DeviceBoundNumber;
+class ComputeStream;
+class DeviceEvent;
 
 //To compy with BLAS libraries matrices are stored in ColMajor. However, by default C/C++/C# use RowMajor
 //convertion is need when passing data between Matrix and C++ matrices
@@ -78,7 +80,8 @@ private:
     mutable int m_devicesTransferedTo[2]; // TODO: what is this for? Seems only diagnostics
 
     // Moves matrix from device id_from to device with id_to. This method doesn't change preferred device Id
-    void _transferFromDeviceToDevice(int id_from, int id_to, bool ismoved = true, bool emptyTransfer = false) const;
+    // 'isExplicit' is only for DeviceTransferMonitor: the transfer was requested by the caller rather than done implicitly by an operation
+    void _transferFromDeviceToDevice(int id_from, int id_to, bool ismoved = true, bool emptyTransfer = false, bool isExplicit = false) const;
     // Moves matrix from current device to device with id_to. This method doesn't change preferred device Id
     void _transferToDevice(int id_to, bool ismoved = true, bool emptyTransfer = false) const;
     static void DecideAndMoveToRightDevice(const Matrix<ElemType>& a, const Matrix<ElemType>& b);
@@ -112,6 +115,9 @@ public:
 
     static void SetDevice(DEVICEID_TYPE deviceId);
 
+    // multiply GPU matrices in half precision with single-precision accumulation (see GPUMatrix::SetFP16GEMMEnabled())
+    static void SetFP16GEMMEnabled(bool enabled);
+
     void Clear();
     ~Matrix();
 
@@ -121,6 +127,8 @@ private:
     Matrix(const MatrixFlags matrixFlags, DEVICEID_TYPE deviceID);                                                               // only used internally to initialize a blank matrix
     void Init(DEVICEID_TYPE deviceID);                                                                                           // only used internally to initialize a blank matrix
     void SetDataLocation(CurrentDataLocation location, MatrixType type = UNDETERMINED) const;
+    void AdamUpdate(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType beta1, const ElemType beta2, const ElemType epsilon,
+                    const ElemType weightDecay, const size_t step, const bool directionOnly);
 
 public:
     MatrixType GetMatrixType() const
@@ -150,6 +158,15 @@ public:
     // Same as TransferFromDeviceToDevice() but moves only if it is currently not on the target device
     void TransferToDeviceIfNotThere(int id_to, bool ismoved = false, bool emptyTransfer = false, bool updatePreferredDevice = true) const;
     void TransferToDeviceIfNotThereAndNotAutoPlace(int id_to, bool ismoved = false, bool emptyTransfer = false, bool updatePreferredDevice = true) const;
+
+    // ordering of work across GPU streams (see ComputeStreams.h); no-ops on the CPU
+    void RecordEvent(DeviceEvent& event) const;              // 'event' marks the work issued so far on this thread's current stream
+    void WaitForEvent(const DeviceEvent& event) const;       // work issued later on this thread's current stream waits for 'event'
+    void RecordStreamUse(const ComputeStream& stream) const; // the buffer is also used on 'stream'; its release waits for that work
+
+    // unified memory hints (see TracingGPUMemoryAllocator::SetManagedMemoryEnabled()); no-ops on the CPU and for device memory
+    void PrefetchToDevice() const; // the buffer will be used soon: migrate it to the GPU ahead of time
+    void PrefetchToHost() const;   // the buffer will not be used for a while: make room for others
     CurrentDataLocation GetCurrentMatrixLocation() const
     {
         return m_currentDataLocation;
@@ -188,6 +205,20 @@ public:
 
     void CopyColumnsStrided(const Matrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride);
 
+    // this(:, j) = a(:, columnIndices(0, j)), and this(:, columnIndices(0, j)) += a(:, j) for distinct indices; the indices stay on the device
+    Matrix<ElemType>& AssignGatheredColumnsOf(const Matrix<ElemType>& a, const Matrix<ElemType>& columnIndices);
+    Matrix<ElemType>& AddScatteredColumnsOf(const Matrix<ElemType>& a, const Matrix<ElemType>& columnIndices);
+    // stores the columns of a as 16-bit floats, packed into the elements of this matrix, which becomes [PackedHalfRows(a.rows) x a.cols];
+    // AssignUnpackedHalfOf() restores the [numRows x packed.cols] matrix, rounded to the 16-bit format (see HalfPrecision.h)
+    Matrix<ElemType>& AssignPackedHalfOf(const Matrix<ElemType>& a, HalfFormat format);
+    Matrix<ElemType>& AssignUnpackedHalfOf(const Matrix<ElemType>& packed, size_t numRows, HalfFormat format);
+    static size_t PackedHalfRows(size_t numRows)
+    {
+        return (numRows * 2 + sizeof(ElemType) - 1) / sizeof(ElemType);
+    }
+    // draws a [1 x k] row of indices from a [2 x V] alias table with [2 x k] uniform random numbers
+    Matrix<ElemType>& AssignAliasSamplesOf(const Matrix<ElemType>& aliasTable, const Matrix<ElemType>& uniforms);
+
     Matrix<ElemType> Diagonal() const;
     Matrix<ElemType> AssignDiagonalValuesTo(Matrix<ElemType>& diag) const;
     void ShiftBy(int numShift);
@@ -196,6 +227,9 @@ public:
     void NormalGrad(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum, const bool useNAG);
     ElemType Adagrad(Matrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum);
+    void Adam(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType beta1, const ElemType beta2, const ElemType epsilon, const size_t step);
+    void Lamb(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType beta1, const ElemType beta2, const ElemType epsilon,
+              const ElemType weightDecay, const size_t step);
     ElemType RmsProp(Matrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
     void Resize(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve = 10000, bool growOnly = true); // by default we only reallocate if need to grow
@@ -240,6 +274,7 @@ public:
     void SetValue(const DeviceBoundNumber<ElemType>& db_number);
     void SetValue(const Matrix<ElemType>& deepCopyFrom, const MatrixFormat format = matrixFormatSparseCSR);
     void SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, const size_t matrixFlags = matrixFlagNormal);
+    void SetValueAcrossDevices(const Matrix<ElemType>& deepCopyFrom); // like SetValue(deepCopyFrom), but this matrix stays on its device
     void SetValue(const size_t rIdx, const size_t cIdx, ElemType val); // set matrix sparsely
     void SetValue(const size_t numRows, const size_t numCols, std::initializer_list<ElemType> l)
     {
@@ -255,6 +290,11 @@ public:
     void SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCCol, const CPUSPARSE_INDEX_TYPE* h_Row, const ElemType* h_Val,
                                 const size_t nz, const size_t numRows, const size_t numCols);
 
+    // Columns present in a matrix in sparse block-column format (e.g. the gradient of an embedding applied to a sparse input),
+    // as host copies of the column ids and of their values (column-major, GetNumRows() per column).
+    void GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& columnValues) const;
+    void SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& columnValues);
+
     void MaskColumnsValue(const Matrix<char>& columnsMask, ElemType val);
 
     void SetColumn(const ElemType* colPointer, size_t colInd);
@@ -267,6 +307,12 @@ public:
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, unsigned long seed = USE_TIME_BASED_SEED);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
+    // counter-based (Philox) random values: the same on the CPU and the GPU, for any number of threads
+    void SetPhiloxUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed);
+    void SetPhiloxGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed);
+    // a times a dropout mask that is regenerated from the seed instead of stored (see DropoutNode)
+    Matrix<ElemType>& AssignDropoutOf(const Matrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset);
+    Matrix<ElemType>& AddDropoutOf(const Matrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset);
     Matrix<ElemType>& AssignNoiseContrastiveEstimation(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, const Matrix<ElemType>& bias, Matrix<ElemType>& tmp);
 
     Matrix<ElemType>& AssignNCEDerivative(const Matrix<ElemType>& tmp, const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, size_t inputIndex);
@@ -392,6 +438,9 @@ public:
     Matrix<ElemType>& AssignRepeatOf(const Matrix<ElemType>& a, const size_t numRowRepeats, const size_t numColRepeats);
     Matrix<ElemType>& AddToRowRepeatValuesOf(const Matrix<ElemType>& a, const size_t numRepeats);
 
+    // one column per image of a block of packed images (see PackedImages.h); the block lives in CPU memory
+    Matrix<ElemType>& AssignPackedImages(const void* packedImages);
+
     Matrix<ElemType>& AssignPositiveAndShiftedNegSample(const Matrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber);
     Matrix<ElemType>& AddFoldedPositiveAndShiftedNegSample(const Matrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber);
 
@@ -477,8 +526,18 @@ public:
 
     // singular value decomposition of A as A = U*SIGMA*VT
     static void SVD(const Matrix<ElemType>& A, Matrix<ElemType>& SIGMA, Matrix<ElemType>& U, Matrix<ElemType>& VT, Matrix<ElemType>& W);
+    // truncated SVD of rank 'rank' by randomized subspace iteration; the bulk of the work runs on A's device (see Matrix.cpp)
+    static void TruncatedSVD(const Matrix<ElemType>& A, size_t rank, size_t numPowerIterations, unsigned long seed,
+                             Matrix<ElemType>& SIGMA, Matrix<ElemType>& U, Matrix<ElemType>& VT);
 
     static void MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c); // SGEMM
+    static void MultiplyAndWeightedAddBatched(ElemType alpha, const std::vector<const Matrix<ElemType>*>& a, const bool transposeA, const std::vector<const Matrix<ElemType>*>& b, const bool transposeB,
+                                              ElemType beta, const std::vector<Matrix<ElemType>*>& c); // batched SGEMM, for many small products of the same dimensions
+    // multi-tensor functions for the SGD update of many dense parameters on one device in single launches
+    static void MultiTensorSumOfSquares(const std::vector<const Matrix<ElemType>*>& matrices, std::vector<double>& sumsOfSquares);
+    static void MultiTensorSGDUpdate(const std::vector<Matrix<ElemType>*>& weights, const std::vector<const Matrix<ElemType>*>& gradients, const std::vector<Matrix<ElemType>*>& smoothedGradients,
+                                     const std::vector<ElemType>& gradientScales, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                     const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad);
     static void MultiplyAndAdd(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
@@ -509,6 +568,46 @@ public:
 
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const Matrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const Matrix<ElemType>& b, Matrix<ElemType>& c);
 
+    // pointwise part of one LSTM time step (see LSTMCellNode); gates are stacked as [input; forget; output; cell candidate], peepholes (may be empty) as [input; forget; output]
+    static void LSTMPointwiseForward(Matrix<ElemType>& gates, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& peepholes, Matrix<ElemType>& cell, Matrix<ElemType>& output);
+    static void LSTMPointwiseBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& cell, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& peepholes, const Matrix<ElemType>& outputGradient,
+                                      Matrix<ElemType>& cellGradient, Matrix<ElemType>& gatesGradient);
+
+    // pointwise part of one GRU time step (see GRUCellNode); gates are stacked as [reset; update; candidate]
+    static void GRUPointwiseForward(Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, Matrix<ElemType>& output);
+    static void GRUPointwiseBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, Matrix<ElemType>& outputGradient,
+                                     Matrix<ElemType>& gatesGradient, Matrix<ElemType>& recurrentGradient);
+
+    // cosine similarity of each left column with its right column and with negNumber shifted right columns (see CosDistanceWithNegativeSamplesNode)
+    static void CosDistanceWithNegativeSamples(const Matrix<ElemType>& left, const Matrix<ElemType>& right, size_t shift, size_t negNumber,
+                                               Matrix<ElemType>& invNormLeft, Matrix<ElemType>& invNormRight, Matrix<ElemType>& cosDistance);
+    static void CosDistanceWithNegativeSamplesGradient(const Matrix<ElemType>& left, const Matrix<ElemType>& right, const Matrix<ElemType>& invNormLeft, const Matrix<ElemType>& invNormRight,
+                                                       const Matrix<ElemType>& cosDistance, const Matrix<ElemType>& gradient, size_t shift, bool wrtRight, Matrix<ElemType>& inputGradient);
+
+    // scaled dot-product attention, each query over its own strided range of key columns (see AttentionNode)
+    static void AttentionForward(const Matrix<ElemType>& query, const Matrix<ElemType>& keys, const Matrix<ElemType>& values, const Matrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                 Matrix<ElemType>& context, Matrix<ElemType>& logSumExp);
+    static void AttentionBackward(const Matrix<ElemType>& query, const Matrix<ElemType>& keys, const Matrix<ElemType>& values, const Matrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                  const Matrix<ElemType>& context, const Matrix<ElemType>& logSumExp, const Matrix<ElemType>& contextGradient,
+                                  Matrix<ElemType>& queryGradient, Matrix<ElemType>& keysGradient, Matrix<ElemType>& valuesGradient);
+
+    // cross entropy with softmax, reading the logits once per pass and never storing the softmax (see CrossEntropyWithSoftmaxNode)
+    static void CrossEntropyWithSoftmaxForward(const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, Matrix<ElemType>& logSumExp, Matrix<ElemType>& columnLoss);
+    static void CrossEntropyWithSoftmaxBackward(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, const Matrix<ElemType>& logSumExp,
+                                                Matrix<ElemType>& gradient);
+    // the same over segments of varying length anywhere in a matrix, with one target each (see ClassBasedCrossEntropyWithSoftmaxNode)
+    static void SegmentedLogSoftmax(const Matrix<ElemType>& values, const Matrix<ElemType>& segments, Matrix<ElemType>& logProbs, Matrix<ElemType>& loss);
+    static void SegmentedSoftmaxGradient(const Matrix<ElemType>& alpha, const Matrix<ElemType>& logProbs, const Matrix<ElemType>& segments, ElemType beta, Matrix<ElemType>& gradient);
+    // logistic loss of noise contrastive estimation with the target in row 0 and the noise samples below (see NoiseContrastiveEstimationNode)
+    static void NoiseContrastiveLoss(const Matrix<ElemType>& logits, Matrix<ElemType>& loss, Matrix<ElemType>& gradient);
+    // linear-chain CRF over sequences of columns, all sequences at once: forward-backward in log space and Viterbi decoding (see CRFNode, SequenceDecoderNode)
+    static void CRFForward(const Matrix<ElemType>& labelIds, const Matrix<ElemType>& scores, const Matrix<ElemType>& transitions, const Matrix<ElemType>& sequences, size_t stride,
+                           Matrix<ElemType>& logAlpha, Matrix<ElemType>& logPartition, Matrix<ElemType>& loss);
+    static void CRFBackward(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labelIds, const Matrix<ElemType>& scores, const Matrix<ElemType>& transitions, const Matrix<ElemType>& sequences, size_t stride,
+                            const Matrix<ElemType>& logAlpha, const Matrix<ElemType>& logPartition, Matrix<ElemType>& logBeta, Matrix<ElemType>& scoresGradient, Matrix<ElemType>& transitionsGradient);
+    static void CRFViterbi(const Matrix<ElemType>& scores, const Matrix<ElemType>& transitions, const Matrix<ElemType>& sequences, size_t stride,
+                           Matrix<ElemType>& bestScores, Matrix<ElemType>& backpointers, Matrix<ElemType>& path);
+
     void TensorOp(ElemType beta, const Matrix<ElemType>& a, ElemType alpha, ElementWiseOperator op,
                   const std::array<size_t, 2>& offsets,
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 2>& regularStrides,
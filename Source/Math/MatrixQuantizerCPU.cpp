@@ -1,5 +1,9 @@
 #include "stdafx.h"
 #include "MatrixQuantizerCPU.h"
+#include "Instrumentation.h"
+#include "CPUVectorKernels.h"
+#include <algorithm>
+#include <string.h>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -9,9 +13,128 @@ MatrixQuantizerCPU<ElemType>::MatrixQuantizerCPU()
 {
 }
 
+// Columns are quantized in parallel if the matrix has at least this many elements.
+static const size_t c_minElementsForParallelQuantization = 16384;
+
+// 1-bit quantization and unquantization of a float column through the CPUVectorKernels; false where this does not apply
+// (double, or more than 1 bit), in which case the caller uses ColumnQuantizer.
+// A QWord q of the column holds the bits of rows q, q + numQWords, q + 2 numQWords, ... (the interleaved layout that suits
+// the GPU), so the rows [k numQWords, (k+1) numQWords) go to bit k of consecutive QWords. These stripes are processed one
+// after another, each by contiguous vector operations.
+template <class ElemType>
+static bool Quantize1BitColumnVectorized(const ElemType*, const ElemType*, size_t, size_t, size_t, QuantizedColumn<ElemType>&, ElemType*, bool)
+{
+    return false;
+}
+
+static bool Quantize1BitColumnVectorized(const float* inMatrix, const float* inResidual, size_t nRow, size_t j, size_t nBits, QuantizedColumn<float>& qcol, float* outResidual, bool zeroThresholdFor1Bit)
+{
+    if (nBits != 1)
+        return false;
+    const CPUVectorKernels& kernels = CPUVectorKernels::Get();
+    const size_t offset = j * nRow;
+
+    // the values to quantize go into 'outResidual', where the quantization turns them into the residual
+    float* values = outResidual + offset;
+    const float sum = kernels.AddAndSum(inMatrix + offset, inResidual + offset, values, nRow);
+
+    // range statistics, as ColumnQuantizer::ComputeRangeStatColj()
+    const float mean = zeroThresholdFor1Bit ? 0.0f : sum / nRow;
+    float sums[2];
+    size_t counts[2];
+    kernels.SumBelowAndAbove(values, mean, sums, counts, nRow);
+    if (zeroThresholdFor1Bit)
+        ColumnQuantizer<float>::RangeFor1Bit<true>(mean, sums[0], sums[1], (unsigned int) counts[0], (unsigned int) counts[1], nRow, qcol.lower, qcol.upper);
+    else
+        ColumnQuantizer<float>::RangeFor1Bit<false>(mean, sums[0], sums[1], (unsigned int) counts[0], (unsigned int) counts[1], nRow, qcol.lower, qcol.upper);
+
+    // quantize, as ColumnQuantizer::QuantizeOneQWord()
+    const ValueQuantizer<float> valQ(0, qcol.lower, qcol.upper);
+    const float threshold = zeroThresholdFor1Bit ? 0.0f : 0.5f * (qcol.upper + qcol.lower);
+    const size_t numQWords = ColumnQuantizer<float>::QWordsPerCol(nRow, 1);
+    memset(qcol.bits, 0, numQWords * sizeof(*qcol.bits));
+    for (size_t k = 0, rowStart = 0; rowStart < nRow; k++, rowStart += numQWords)
+        kernels.Quantize1Bit(values + rowStart, threshold, valQ.Unquantize(0), valQ.Unquantize(1), 1u << k, qcol.bits, std::min(numQWords, nRow - rowStart));
+    return true;
+}
+
+template <class ElemType>
+static bool Unquantize1BitColumnVectorized(const QuantizedColumn<ElemType>&, size_t, size_t, size_t, ElemType*, bool)
+{
+    return false;
+}
+
+static bool Unquantize1BitColumnVectorized(const QuantizedColumn<float>& qcol, size_t nRow, size_t j, size_t nBits, float* outMatrix, bool add)
+{
+    if (nBits != 1)
+        return false;
+    const CPUVectorKernels& kernels = CPUVectorKernels::Get();
+    const ValueQuantizer<float> valQ(0, qcol.lower, qcol.upper);
+    const size_t numQWords = ColumnQuantizer<float>::QWordsPerCol(nRow, 1);
+    float* us = outMatrix + j * nRow;
+    for (size_t k = 0, rowStart = 0; rowStart < nRow; k++, rowStart += numQWords)
+        kernels.Unquantize1Bit(qcol.bits, 1u << k, valQ.Unquantize(0), valQ.Unquantize(1), add, us + rowStart, std::min(numQWords, nRow - rowStart));
+    return true;
+}
+
+// quantize the columns of a matrix into consecutive QuantizedColumns of 'qColSize' bytes starting at 'qData'
+template <class ElemType>
+static void QuantizeColumns(const ElemType* inMatrix, const ElemType* inResidual, size_t nRow, size_t nCol, size_t nBits, char* qData, size_t qColSize, ElemType* outResidual, bool zeroThresholdFor1Bit)
+{
+    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
+#pragma omp parallel for if (nRow * nCol >= c_minElementsForParallelQuantization)
+    for (long j = 0; j < (long) nCol; j++)
+    {
+        auto& qcol = *(QuantizedColumn<ElemType>*) &qData[qColSize * j];
+        if (Quantize1BitColumnVectorized(inMatrix, inResidual, nRow, j, nBits, qcol, outResidual, zeroThresholdFor1Bit))
+            continue;
+
+        if (zeroThresholdFor1Bit)
+        {
+            // Explicit use of 'template' keyword is needed to compile with GCC
+            ColumnQuantizer<ElemType>::template ComputeRangeStatColj<true>(inMatrix, inResidual, (long) nRow, j, nBits, qcol.lower, qcol.upper);
+        }
+        else
+        {
+            // Explicit use of 'template' keyword is needed to compile with GCC
+            ColumnQuantizer<ElemType>::template ComputeRangeStatColj<false>(inMatrix, inResidual, (long) nRow, j, nBits, qcol.lower, qcol.upper);
+        }
+
+        ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
+        if (zeroThresholdFor1Bit)
+        {
+            // Explicit use of 'template' keyword is needed to compile with GCC
+            q.template Quantize<true>(inMatrix, inResidual, (long) nRow, j, qcol.bits, outResidual);
+        }
+        else
+        {
+            // Explicit use of 'template' keyword is needed to compile with GCC
+            q.template Quantize<false>(inMatrix, inResidual, (long) nRow, j, qcol.bits, outResidual);
+        }
+    }
+}
+
+// unquantize an entire matrix, calling unquantize() for each column
+template <class ElemType>
+static void UnquantizeColumns(const char* qData, size_t qColSize, size_t nRow, size_t nCol, size_t nBits, ElemType* outMatrix, bool add)
+{
+    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
+#pragma omp parallel for if (nRow * nCol >= c_minElementsForParallelQuantization)
+    for (long j = 0; j < (long) nCol; j++)
+    {
+        const auto& qcol = *(const QuantizedColumn<ElemType>*) &qData[qColSize * j];
+        if (Unquantize1BitColumnVectorized(qcol, nRow, j, nBits, outMatrix, add))
+            continue;
+
+        ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
+        q.Unquantize(outMatrix, (long) nRow, j, qcol.bits, add);
+    }
+}
+
 template <class ElemType>
 void MatrixQuantizerCPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatrix, const Matrix<ElemType>& inResidual, QuantizedMatrix<ElemType>& outQMatrix, Matrix<ElemType>& outResidual, bool zeroThresholdFor1Bit)
 {
+    CNTK_RANGE("quantize");
     // The outQMatrix should be on the CPU
     // TODO: Support transferring the quantization output to a quantized matrix on the GPU
     assert(outQMatrix.GetDeviceId() == CPUDEVICE);
@@ -26,40 +149,8 @@ void MatrixQuantizerCPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatri
     assert((inResidual.GetNumRows() == nRow) && (inResidual.GetNumCols() == nCol));
     assert((outResidual.GetNumRows() == nRow) && (outResidual.GetNumCols() == nCol));
 
-    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
-#ifdef QUANTUSEPPL
-    Concurrency::parallel_for((size_t) 0, us.cols(), [&](size_t j)
-#else
-    for (size_t j = 0; j < nCol; j++)
-#endif
-                              {
-                                  auto& qcol = *(outQMatrix.GetQuantizedColumn(j));
-                                  if (zeroThresholdFor1Bit)
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      ColumnQuantizer<ElemType>::template ComputeRangeStatColj<true>(inMatrix.BufferPointer(), inResidual.BufferPointer(), (long) nRow, j, nBits, qcol.lower, qcol.upper);
-                                  }
-                                  else
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      ColumnQuantizer<ElemType>::template ComputeRangeStatColj<false>(inMatrix.BufferPointer(), inResidual.BufferPointer(), (long) nRow, j, nBits, qcol.lower, qcol.upper);
-                                  }
-
-                                  ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
-                                  if (zeroThresholdFor1Bit)
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      q.template Quantize<true>(inMatrix.BufferPointer(), inResidual.BufferPointer(), (long) nRow, j, qcol.bits, outResidual.BufferPointer());
-                                  }
-                                  else
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      q.template Quantize<false>(inMatrix.BufferPointer(), inResidual.BufferPointer(), (long) nRow, j, qcol.bits, outResidual.BufferPointer());
-                                  }
-                              }
-#ifdef QUANTUSEPPL
-                              );
-#endif
+    const size_t qColSize = QuantizedColumn<ElemType>::QuantizedColumnSize(nBits, nRow);
+    QuantizeColumns(inMatrix.BufferPointer(), inResidual.BufferPointer(), nRow, nCol, nBits, outQMatrix.GetArray(), qColSize, outResidual.BufferPointer(), zeroThresholdFor1Bit);
 }
 
 template <class ElemType>
@@ -68,10 +159,10 @@ void MatrixQuantizerCPU<ElemType>::WaitQuantizeAsyncDone()
     // TODO: Currently this is a no-op since the actual quantization is synchronous
 }
 
-// unquantize an entire matrix, calling unquantize() for each column
 template <class ElemType>
 void MatrixQuantizerCPU<ElemType>::UnquantizeAsync(QuantizedMatrix<ElemType>& inQMatrix, Matrix<ElemType>& outMatrix, bool add /*= false*/)
 {
+    CNTK_RANGE("unquantize");
     // The inQMatrix and hould be on the CPU
     assert(inQMatrix.GetDeviceId() == CPUDEVICE);
     assert(outMatrix.GetDeviceId() == CPUDEVICE);
@@ -83,20 +174,8 @@ void MatrixQuantizerCPU<ElemType>::UnquantizeAsync(QuantizedMatrix<ElemType>& in
     // Verify that the different matrix parameters have matching dimensions
     assert((outMatrix.GetNumRows() == nRow) && (outMatrix.GetNumCols() == nCol));
 
-    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
-#ifdef QUANTUSEPPL
-    Concurrency::parallel_for((size_t) 0, us.cols(), [&](size_t j)
-#else
-    for (size_t j = 0; j < nCol; j++)
-#endif
-                              {
-                                  const auto& qcol = *(inQMatrix.GetQuantizedColumn(j));
-                                  ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
-                                  q.Unquantize(outMatrix.BufferPointer(), (long) nRow, j, qcol.bits, add);
-                              }
-#ifdef QUANTUSEPPL
-                              );
-#endif
+    const size_t qColSize = QuantizedColumn<ElemType>::QuantizedColumnSize(nBits, nRow);
+    UnquantizeColumns(inQMatrix.GetArray(), qColSize, nRow, nCol, nBits, outMatrix.BufferPointer(), add);
 }
 
 template <class ElemType>
@@ -105,6 +184,38 @@ void MatrixQuantizerCPU<ElemType>::WaitUnquantizeAsyncDone()
     // TODO: Currently this is a no-op since the actual quantization is synchronous
 }
 
+// on the CPU, the batched versions simply process one matrix after another
+template <class ElemType>
+void MatrixQuantizerCPU<ElemType>::QuantizeBatchAsync(const std::vector<const Matrix<ElemType>*>& inMatrices, const std::vector<const Matrix<ElemType>*>& inResiduals, QuantizedMatrixBatch<ElemType>& outQBatch, const std::vector<Matrix<ElemType>*>& outResiduals, bool zeroThresholdFor1Bit)
+{
+    CNTK_RANGE("quantize");
+    assert(outQBatch.GetDeviceId() == CPUDEVICE);
+    this->VerifyBatchDimensions(outQBatch, inMatrices, "input matrices");
+    this->VerifyBatchDimensions(outQBatch, inResiduals, "input residuals");
+    this->VerifyBatchDimensions(outQBatch, outResiduals, "output residuals");
+
+    for (size_t i = 0; i < outQBatch.GetNumMatrices(); i++)
+    {
+        QuantizeColumns(inMatrices[i]->BufferPointer(), inResiduals[i]->BufferPointer(), outQBatch.GetNumRows(i), outQBatch.GetNumCols(i), outQBatch.GetNumBits(),
+                        outQBatch.GetArray() + outQBatch.GetOffset(i), outQBatch.GetQuantizedColumnSize(i), outResiduals[i]->BufferPointer(), zeroThresholdFor1Bit);
+    }
+}
+
+template <class ElemType>
+void MatrixQuantizerCPU<ElemType>::UnquantizeBatchAsync(QuantizedMatrixBatch<ElemType>& inQBatch, const std::vector<Matrix<ElemType>*>& outMatrices, bool add /*= false*/)
+{
+    CNTK_RANGE("unquantize");
+    assert(inQBatch.GetDeviceId() == CPUDEVICE);
+    this->VerifyBatchDimensions(inQBatch, outMatrices, "output matrices");
+
+    for (size_t i = 0; i < inQBatch.GetNumMatrices(); i++)
+    {
+        assert(outMatrices[i]->GetDeviceId() == CPUDEVICE);
+        UnquantizeColumns(inQBatch.GetArray() + inQBatch.GetOffset(i), inQBatch.GetQuantizedColumnSize(i), inQBatch.GetNumRows(i), inQBatch.GetNumCols(i), inQBatch.GetNumBits(),
+                          outMatrices[i]->BufferPointer(), add);
+    }
+}
+
 //The explicit instantiation part will make the linker happy
 template class MatrixQuantizerCPU<float>;
 template class MatrixQuantizerCPU<double>;
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "MatrixQuantizerGPU.h"
+#include "Instrumentation.h"
 #include "MatrixQuantizer_kernel.cu"
 #include "GPUMatrix.h"
 #include "GPUDataTransferer.h"
@@ -178,11 +179,86 @@ QuantizedMatrix<ElemType>& MatrixQuantizerGPU<ElemType>::GetTempGPUQuantizedMatr
     return *m_tempGPUQuantizedMatrix;
 }
 
+template <class ElemType>
+QuantizedMatrixBatch<ElemType>& MatrixQuantizerGPU<ElemType>::GetTempGPUQuantizedBatch(const QuantizedMatrixBatch<ElemType>& qBatch, bool& newlyAllocated)
+{
+    newlyAllocated = false;
+
+    // Check if the existing one is good for our needs
+    if ((m_tempGPUQuantizedBatch != nullptr) && m_tempGPUQuantizedBatch->HasSameLayout(qBatch))
+    {
+        return *m_tempGPUQuantizedBatch;
+    }
+
+    if (m_tempGPUQuantizedBatch != nullptr)
+    {
+        delete m_tempGPUQuantizedBatch;
+        m_tempGPUQuantizedBatch = nullptr;
+    }
+
+    std::vector<std::pair<size_t, size_t>> dims;
+    for (size_t i = 0; i < qBatch.GetNumMatrices(); i++)
+        dims.push_back(std::make_pair(qBatch.GetNumRows(i), qBatch.GetNumCols(i)));
+    m_tempGPUQuantizedBatch = new QuantizedMatrixBatch<ElemType>(dims, qBatch.GetNumBits(), (short) this->GetDeviceId());
+    newlyAllocated = true;
+
+    return *m_tempGPUQuantizedBatch;
+}
+
+template <class ElemType>
+/*static*/ std::vector<QuantizedBatchSegment<ElemType>> MatrixQuantizerGPU<ElemType>::GetBatchSegments(const QuantizedMatrixBatch<ElemType>& qBatch, std::vector<size_t>& matrixIndices, size_t& totalQWords)
+{
+    std::vector<QuantizedBatchSegment<ElemType>> segments;
+    matrixIndices.clear();
+    totalQWords = 0;
+    for (size_t i = 0; i < qBatch.GetNumMatrices(); i++)
+    {
+        // the kernels require non-empty segments
+        if ((qBatch.GetNumRows(i) == 0) || (qBatch.GetNumCols(i) == 0))
+            continue;
+
+        QuantizedBatchSegment<ElemType> segment;
+        memset(&segment, 0, sizeof(segment)); // the table is compared bytewise in UploadBatchSegments()
+        segment.numRows = (long) qBatch.GetNumRows(i);
+        segment.numQWordsPerCol = ColumnQuantizer<ElemType>::QWordsPerCol(qBatch.GetNumRows(i), qBatch.GetNumBits());
+        segment.qColSize = qBatch.GetQuantizedColumnSize(i);
+        segment.offset = qBatch.GetOffset(i);
+        segment.firstColumn = qBatch.GetFirstColumn(i);
+        segment.firstQWord = totalQWords;
+        totalQWords += segment.numQWordsPerCol * qBatch.GetNumCols(i);
+
+        segments.push_back(segment);
+        matrixIndices.push_back(i);
+    }
+    return segments;
+}
+
+template <class ElemType>
+void MatrixQuantizerGPU<ElemType>::UploadBatchSegments(const std::vector<QuantizedBatchSegment<ElemType>>& segments)
+{
+    // the layout and the matrix buffers of the gradients rarely change between minibatches
+    if ((segments.size() == m_batchSegments.size()) && (segments.empty() || (memcmp(segments.data(), m_batchSegments.data(), segments.size() * sizeof(segments[0])) == 0)))
+        return;
+
+    m_batchSegments = segments;
+    if (m_batchSegments.size() > m_batchSegmentsGPUCapacity)
+    {
+        if (m_batchSegmentsGPU != nullptr)
+            cudaFree(m_batchSegmentsGPU) || "cudaFree failed"; // (implicitly waits for kernels still using it)
+        cudaMalloc((void**) &m_batchSegmentsGPU, m_batchSegments.size() * sizeof(m_batchSegments[0])) || "cudaMalloc failed";
+        m_batchSegmentsGPUCapacity = m_batchSegments.size();
+    }
+
+    // ordered before the kernel on the same stream; pageable source memory is staged before the call returns
+    if (!m_batchSegments.empty())
+        cudaMemcpyAsync(m_batchSegmentsGPU, m_batchSegments.data(), m_batchSegments.size() * sizeof(m_batchSegments[0]), cudaMemcpyHostToDevice, GetComputeStream()) || "cudaMemcpyAsync failed";
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///cpubuffer should be page-locked memory allocated, otherwise CUDA will not be efficient (hence we don't use STL)
 template <class ElemType>
 MatrixQuantizerGPU<ElemType>::MatrixQuantizerGPU(int deviceId, bool useDedicatedComputeStream, bool forceSync /*= false*/)
-    : MatrixQuantizerImpl<ElemType>(deviceId), m_quantizeCompleteEvent(NULL), m_fetchCompleteEvent(NULL), m_tempMatrixZeroingCompleteEvent(NULL), m_assignCompleteEvent(NULL), m_forceSync(forceSync), m_tempGPUQuantizedMatrix(nullptr), m_quantizeOpIncludedFetch(false)
+    : MatrixQuantizerImpl<ElemType>(deviceId), m_quantizeCompleteEvent(NULL), m_fetchCompleteEvent(NULL), m_tempMatrixZeroingCompleteEvent(NULL), m_assignCompleteEvent(NULL), m_forceSync(forceSync), m_tempGPUQuantizedMatrix(nullptr), m_quantizeOpIncludedFetch(false), m_tempGPUQuantizedBatch(nullptr), m_batchSegmentsGPU(nullptr), m_batchSegmentsGPUCapacity(0)
 {
     PrepareDevice(this->GetDeviceId());
 
@@ -215,6 +291,18 @@ MatrixQuantizerGPU<ElemType>::~MatrixQuantizerGPU()
         m_tempGPUQuantizedMatrix = nullptr;
     }
 
+    if (nullptr != m_tempGPUQuantizedBatch)
+    {
+        delete m_tempGPUQuantizedBatch;
+        m_tempGPUQuantizedBatch = nullptr;
+    }
+
+    if (nullptr != m_batchSegmentsGPU)
+    {
+        cudaFree(m_batchSegmentsGPU);
+        m_batchSegmentsGPU = nullptr;
+    }
+
     // BUGBUG: we don't destroy our streams (they are static variables); we need a static destructor, I am too lazy now
     cudaEventDestroy(m_assignCompleteEvent);
     cudaEventDestroy(m_fetchCompleteEvent);
@@ -225,6 +313,7 @@ MatrixQuantizerGPU<ElemType>::~MatrixQuantizerGPU()
 template <class ElemType>
 void MatrixQuantizerGPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatrix, const Matrix<ElemType>& inResidual, QuantizedMatrix<ElemType>& outQMatrix, Matrix<ElemType>& outResidual, bool zeroThresholdFor1Bit)
 {
+    CNTK_RANGE("quantize");
     // Verify various input matrix parameter's dimensions
     assert((inMatrix.GetNumRows() == outQMatrix.GetNumRows()) && (inMatrix.GetNumCols() == outQMatrix.GetNumCols()));
     assert((inMatrix.GetNumRows() == inResidual.GetNumRows()) && (inMatrix.GetNumCols() == inResidual.GetNumCols()));
@@ -285,6 +374,7 @@ void MatrixQuantizerGPU<ElemType>::WaitQuantizeAsyncDone()
 template <class ElemType>
 void MatrixQuantizerGPU<ElemType>::UnquantizeAsync(QuantizedMatrix<ElemType>& inQMatrix, Matrix<ElemType>& outMatrix, bool add /*= false*/)
 {
+    CNTK_RANGE("unquantize");
     // The outMatrix should be on the same GPU as m_inMatrix
     assert(outMatrix.GetDeviceId() == this->GetDeviceId());
 
@@ -339,6 +429,115 @@ void MatrixQuantizerGPU<ElemType>::WaitUnquantizeAsyncDone()
     SyncEvent(m_quantizeCompleteEvent);
 }
 
+template <class ElemType>
+void MatrixQuantizerGPU<ElemType>::QuantizeBatchAsync(const std::vector<const Matrix<ElemType>*>& inMatrices, const std::vector<const Matrix<ElemType>*>& inResiduals, QuantizedMatrixBatch<ElemType>& outQBatch, const std::vector<Matrix<ElemType>*>& outResiduals, bool zeroThresholdFor1Bit)
+{
+    CNTK_RANGE("quantize");
+    this->VerifyBatchDimensions(outQBatch, inMatrices, "input matrices");
+    this->VerifyBatchDimensions(outQBatch, inResiduals, "input residuals");
+    this->VerifyBatchDimensions(outQBatch, outResiduals, "output residuals");
+
+    size_t nBits = outQBatch.GetNumBits();
+
+    PrepareDevice(this->GetDeviceId());
+    if (m_forceSync)
+    {
+        Sync();
+    }
+
+    bool GPUMatrixNewlyAllocated = false;
+    QuantizedMatrixBatch<ElemType>& outQBatchGPU = (outQBatch.GetDeviceId() == CPUDEVICE) ? GetTempGPUQuantizedBatch(outQBatch, GPUMatrixNewlyAllocated) : outQBatch;
+
+    // see QuantizeAsync()
+    if (GPUMatrixNewlyAllocated && (GetComputeStream() != GetStream()))
+    {
+        cudaEventRecord(m_tempMatrixZeroingCompleteEvent, GetStream()) || "cudaEventRecord failed";
+        cudaStreamWaitEvent(GetComputeStream(), m_tempMatrixZeroingCompleteEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+    }
+
+    std::vector<size_t> matrixIndices;
+    size_t totalQWords;
+    auto segments = GetBatchSegments(outQBatch, matrixIndices, totalQWords);
+    for (size_t k = 0; k < segments.size(); k++)
+    {
+        const size_t i = matrixIndices[k];
+        assert((inMatrices[i]->GetDeviceId() == this->GetDeviceId()) && (outResiduals[i]->GetDeviceId() == this->GetDeviceId()));
+        segments[k].us = const_cast<ElemType*>(inMatrices[i]->BufferPointer()); // (only read by the quantization kernel)
+        segments[k].inResidual = inResiduals[i]->BufferPointer();
+        segments[k].outResidual = outResiduals[i]->BufferPointer();
+    }
+    UploadBatchSegments(segments);
+
+    // Quantize all matrices with a single kernel on the compute stream and insert event into stream
+    _QuantizeMatrixBatch<ElemType>(m_batchSegmentsGPU, segments.size(), outQBatch.GetTotalNumCols(),
+                                   outQBatchGPU.GetArray(), nBits, GetComputeStream(), zeroThresholdFor1Bit);
+
+    RecordQuantizeCompleteEvent(GetComputeStream());
+
+    // copy the whole batch from gpu to cpu if needed, as a single transfer on the fetch stream
+    m_quantizeOpIncludedFetch = false;
+    if (outQBatch.GetDeviceId() == CPUDEVICE)
+    {
+        SyncQuantizeCompleEventAndFetchAndRecordFetchCompleteEvent(outQBatch.GetArray(), outQBatchGPU.GetArray(), outQBatchGPU.GetSize());
+        m_quantizeOpIncludedFetch = true;
+    }
+}
+
+template <class ElemType>
+void MatrixQuantizerGPU<ElemType>::UnquantizeBatchAsync(QuantizedMatrixBatch<ElemType>& inQBatch, const std::vector<Matrix<ElemType>*>& outMatrices, bool add /*= false*/)
+{
+    CNTK_RANGE("unquantize");
+    this->VerifyBatchDimensions(inQBatch, outMatrices, "output matrices");
+
+    PrepareDevice(this->GetDeviceId());
+
+    size_t nBits = inQBatch.GetNumBits();
+
+    bool GPUMatrixNewlyAllocated = false;
+    QuantizedMatrixBatch<ElemType>& inQBatchGPU = (inQBatch.GetDeviceId() == CPUDEVICE) ? GetTempGPUQuantizedBatch(inQBatch, GPUMatrixNewlyAllocated) : inQBatch;
+
+    if (inQBatch.GetDeviceId() == CPUDEVICE)
+    {
+        // see UnquantizeAsync()
+        if (GPUMatrixNewlyAllocated)
+        {
+            cudaEventRecord(m_tempMatrixZeroingCompleteEvent, GetStream()) || "cudaEventRecord failed";
+            cudaStreamWaitEvent(GetAssignStream(), m_tempMatrixZeroingCompleteEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+        }
+
+        // schedule assign of the whole batch to GPU (on transfer stream)
+        cudaMemcpyAsync(inQBatchGPU.GetArray(), inQBatch.GetArray(), inQBatch.GetSize(), cudaMemcpyHostToDevice, GetAssignStream()) || "cudaMemcpyAsync failed";
+
+        // schedule to flag the assign-complete event
+        cudaEventRecord(m_assignCompleteEvent, GetAssignStream()) || "cudaEventRecord failed"; // for subsequent GPU operation to consume this buffer
+
+        if (m_forceSync)
+        {
+            SyncStream(GetAssignStream());
+        }
+
+        // let the computing stream wait for the assign complete
+        SyncAssignCompleteEvent(GetComputeStream());
+    }
+
+    std::vector<size_t> matrixIndices;
+    size_t totalQWords;
+    auto segments = GetBatchSegments(inQBatch, matrixIndices, totalQWords);
+    for (size_t k = 0; k < segments.size(); k++)
+    {
+        // The outMatrices should be on the same GPU as the quantizer
+        assert(outMatrices[matrixIndices[k]]->GetDeviceId() == this->GetDeviceId());
+        segments[k].us = outMatrices[matrixIndices[k]]->BufferPointer();
+    }
+    UploadBatchSegments(segments);
+
+    // do the actual unquantization of all matrices with a single kernel
+    _UnquantizeMatrixBatch<ElemType>(m_batchSegmentsGPU, segments.size(), totalQWords, inQBatchGPU.GetArray(), nBits, add, GetComputeStream());
+
+    // Record the event of unquantization
+    RecordQuantizeCompleteEvent(GetComputeStream());
+}
+
 //explicit
 template class MatrixQuantizerGPU<float>;
 template class MatrixQuantizerGPU<double>;
@@ -376,9 +575,17 @@ void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent()
     cudaStreamWaitEvent(GPUDataTransferer<ElemType>::GetFetchStream(), m_mainGPUComputeStreamCUDAEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
 }
 
+template <typename ElemType>
+void GPUMatrixComputeStreamEvent::SynchronizeDataTransferAssignStreamWithEvent()
+{
+    cudaStreamWaitEvent(GPUDataTransferer<ElemType>::GetAssignStream(), m_mainGPUComputeStreamCUDAEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+}
+
 // Explicit template instantiations
 template void GPUMatrixComputeStreamEvent::SynchronizeQuantizationComputeStreamWithEvent<float>();
 template void GPUMatrixComputeStreamEvent::SynchronizeQuantizationComputeStreamWithEvent<double>();
 template void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent<float>();
 template void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent<double>();
+template void GPUMatrixComputeStreamEvent::SynchronizeDataTransferAssignStreamWithEvent<float>();
+template void GPUMatrixComputeStreamEvent::SynchronizeDataTransferAssignStreamWithEvent<double>();
 } } }
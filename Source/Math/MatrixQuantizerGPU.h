@@ -13,6 +13,23 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// one matrix of a QuantizedMatrixBatch as seen by the batched quantization kernels
+// The kernels get the table of all (non-empty) matrices of the batch and locate the matrix of a column or QWord by
+// binary search on 'firstColumn' or 'firstQWord', so that the whole batch is processed by a single launch.
+template <class ElemType>
+struct QuantizedBatchSegment
+{
+    ElemType* us; // matrix to quantize, or to unquantize into
+    const ElemType* inResidual;
+    ElemType* outResidual;
+    long numRows;
+    size_t numQWordsPerCol;
+    size_t qColSize;    // bytes per quantized column
+    size_t offset;      // byte offset of the matrix in the batch buffer
+    size_t firstColumn; // index of the first column of the matrix among all columns of the batch
+    size_t firstQWord;  // index of the first QWord of the matrix among all QWords of the batch
+};
+
 template <class ElemType>
 class MatrixQuantizerGPU : public MatrixQuantizerImpl<ElemType>
 {
@@ -29,10 +46,19 @@ public:
     void UnquantizeAsync(QuantizedMatrix<ElemType>& inQMatrix, Matrix<ElemType>& outMatrix, bool add = false) override;
     void WaitUnquantizeAsyncDone() override;
 
+    void QuantizeBatchAsync(const std::vector<const Matrix<ElemType>*>& inMatrices, const std::vector<const Matrix<ElemType>*>& inResiduals, QuantizedMatrixBatch<ElemType>& outQBatch, const std::vector<Matrix<ElemType>*>& outResiduals, bool zeroThresholdFor1Bit) override;
+    void UnquantizeBatchAsync(QuantizedMatrixBatch<ElemType>& inQBatch, const std::vector<Matrix<ElemType>*>& outMatrices, bool add = false) override;
+
 private:
     // Helper function to get a temporary intermediate matrix on the GPU to store quantization results
     QuantizedMatrix<ElemType>& GetTempGPUQuantizedMatrix(size_t numRows, size_t numCols, size_t nBits, bool& newlyAllocated);
 
+    // Same for a batch with the layout of 'qBatch'
+    QuantizedMatrixBatch<ElemType>& GetTempGPUQuantizedBatch(const QuantizedMatrixBatch<ElemType>& qBatch, bool& newlyAllocated);
+
+    // Build the table of the non-empty matrices of 'qBatch'; the matrix pointers are set by the caller
+    static std::vector<QuantizedBatchSegment<ElemType>> GetBatchSegments(const QuantizedMatrixBatch<ElemType>& qBatch, std::vector<size_t>& matrixIndices, size_t& totalQWords);
+
 #ifndef CPUONLY
     // Record a event to flag the completion of quantization/unquantization kernel on the compute stream
     void RecordQuantizeCompleteEvent(cudaStream_t computestream) const;
@@ -45,6 +71,9 @@ private:
     // wait for the assign stream operations, scheduled so far, to finish
     void SyncAssignCompleteEvent(cudaStream_t computestream) const;
 
+    // Upload the segment table for the next batched kernel on the compute stream, unless it is unchanged since the last batch
+    void UploadBatchSegments(const std::vector<QuantizedBatchSegment<ElemType>>& segments);
+
     // for concurrent computation and memcpy
     //  - assign to GPU : CPU-to-GPU,started by CPU when data read; flags assigncomplete
     //  - GPU-side operation        --waits for assigncomplete; flags quantizecomplete
@@ -71,6 +100,11 @@ private:
     mutable cudaEvent_t m_quantizeCompleteEvent;
     mutable cudaEvent_t m_fetchCompleteEvent;
     mutable cudaEvent_t m_assignCompleteEvent;
+
+    // segment table of the last batch, and its copy on the GPU
+    std::vector<QuantizedBatchSegment<ElemType>> m_batchSegments;
+    QuantizedBatchSegment<ElemType>* m_batchSegmentsGPU;
+    size_t m_batchSegmentsGPUCapacity;
 #endif // !CPUONLY
 
 private:
@@ -79,6 +113,9 @@ private:
 
     // A temporary intermediate QuantizedMatrix buffer on the GPU
     QuantizedMatrix<ElemType>* m_tempGPUQuantizedMatrix;
+
+    // A temporary intermediate QuantizedMatrixBatch buffer on the GPU
+    QuantizedMatrixBatch<ElemType>* m_tempGPUQuantizedBatch;
 };
 
 // This type records and synchronizes events on the main
@@ -97,6 +134,9 @@ public:
     template <typename ElemType>
     void SynchronizeDataTransferFetchStreamWithEvent();
 
+    template <typename ElemType>
+    void SynchronizeDataTransferAssignStreamWithEvent();
+
 private:
 #ifndef CPUONLY
     cudaEvent_t m_mainGPUComputeStreamCUDAEvent;
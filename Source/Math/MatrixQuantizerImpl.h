@@ -33,12 +33,34 @@ public:
     virtual void UnquantizeAsync(QuantizedMatrix<ElemType>& inQMatrix, Matrix<ElemType>& outMatrix, bool add = false) = 0;
     virtual void WaitUnquantizeAsyncDone() = 0;
 
+    // Batched versions of the above for a set of matrices, e.g. all gradients of a model, which are quantized into (or
+    // unquantized from) the single buffer of a QuantizedMatrixBatch. Matrix i of the batch corresponds to inMatrices[i] etc.
+    // On the GPU, this is one kernel launch and one transfer for the whole batch instead of several per matrix, which
+    // dominate the quantization time for models with many small matrices.
+    // Completion is waited for through WaitQuantizeAsyncDone() and WaitUnquantizeAsyncDone(), respectively.
+    virtual void QuantizeBatchAsync(const std::vector<const Matrix<ElemType>*>& inMatrices, const std::vector<const Matrix<ElemType>*>& inResiduals, QuantizedMatrixBatch<ElemType>& outQBatch, const std::vector<Matrix<ElemType>*>& outResiduals, bool zeroThresholdFor1Bit) = 0;
+    virtual void UnquantizeBatchAsync(QuantizedMatrixBatch<ElemType>& inQBatch, const std::vector<Matrix<ElemType>*>& outMatrices, bool add = false) = 0;
+
 protected:
     MatrixQuantizerImpl(int deviceId)
         : m_deviceId(deviceId)
     {
     }
 
+    // verify that the matrices passed to QuantizeBatchAsync()/UnquantizeBatchAsync() match the layout of the batch
+    template <class MatrixPtr>
+    static void VerifyBatchDimensions(const QuantizedMatrixBatch<ElemType>& qBatch, const std::vector<MatrixPtr>& matrices, const char* what)
+    {
+        if (matrices.size() != qBatch.GetNumMatrices())
+            InvalidArgument("MatrixQuantizer: The number of %s (%d) does not match the number of matrices in the quantized batch (%d).", what, (int) matrices.size(), (int) qBatch.GetNumMatrices());
+        for (size_t i = 0; i < matrices.size(); i++)
+        {
+            if ((matrices[i]->GetNumRows() != qBatch.GetNumRows(i)) || (matrices[i]->GetNumCols() != qBatch.GetNumCols(i)))
+                InvalidArgument("MatrixQuantizer: Dimensions [%d x %d] of %s %d do not match the quantized batch [%d x %d].",
+                                (int) matrices[i]->GetNumRows(), (int) matrices[i]->GetNumCols(), what, (int) i, (int) qBatch.GetNumRows(i), (int) qBatch.GetNumCols(i));
+        }
+    }
+
     int GetDeviceId() const
     {
         return m_deviceId;
@@ -64,6 +86,10 @@ public:
     template <typename ElemType>
     void SynchronizeDataTransferFetchStreamWithEvent();
 
+    // makes the CPU-to-GPU stream of GPUDataTransferer wait for the event, e.g. before copying into a buffer the computation may still read
+    template <typename ElemType>
+    void SynchronizeDataTransferAssignStreamWithEvent();
+
 protected:
     MatrixComputeStreamEvent(int deviceId);
 
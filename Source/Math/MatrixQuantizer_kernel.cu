@@ -9,6 +9,7 @@
 #include "ValueQuantizer.h"
 #include "ColumnQuantizer.h"
 #include "QuantizedMatrix.h"
+#include "MatrixQuantizerGPU.h" // for QuantizedBatchSegment
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -201,6 +202,67 @@ __global__ void UnquantizeStripejOneQWord(ElemType* us, const long M, const long
     q.UnquantizeOneQWord(us, M, iQWord, M, numQWordsPerCol, j, qcol.bits[iQWord], add);
 }
 
+// =======================================================================
+// batched quantization of several matrices into one QuantizedMatrixBatch
+// =======================================================================
+
+// index of the segment that contains the item 'index' (a column or QWord of the batch, as given by 'first')
+// Segments are sorted by 'first' and not empty.
+template <class ElemType>
+__device__ __inline__ static size_t _FindBatchSegment(const QuantizedBatchSegment<ElemType>* segments, size_t numSegments, size_t index, size_t QuantizedBatchSegment<ElemType>::*first)
+{
+    size_t begin = 0;
+    size_t end = numSegments;
+    while (end - begin > 1)
+    {
+        const size_t mid = (begin + end) / 2;
+        if (segments[mid].*first <= index)
+            begin = mid;
+        else
+            end = mid;
+    }
+    return begin;
+}
+
+// one block per column of the batch, like _ComputeQuantiStatParj(); the block then quantizes the column right away,
+// so that range statistics, quantization, and residual update of all matrices of the batch are a single launch
+template <class ElemType, bool ZeroThresholdFor1Bit>
+__global__ void _QuantizeBatchColumnj(const QuantizedBatchSegment<ElemType>* segments, size_t numSegments, size_t ldNbits, char* qBatch)
+{
+    const size_t batchColumn = blockIdx.x;
+    const auto& segment = segments[_FindBatchSegment(segments, numSegments, batchColumn, &QuantizedBatchSegment<ElemType>::firstColumn)];
+    const size_t j = batchColumn - segment.firstColumn;
+    auto& qCol = *(Microsoft::MSR::CNTK::QuantizedColumn<ElemType>*) &qBatch[segment.offset + segment.qColSize * j];
+
+    const size_t bits = 1 << ldNbits;
+    Microsoft::MSR::CNTK::ColumnQuantizer<ElemType>::ComputeRangeStatColjSubset<ZeroThresholdFor1Bit>(segment.us, segment.inResidual, segment.numRows, j, bits, qCol.lower, qCol.upper,
+                                                                                                      threadIdx.x, REDUCTION_BLOCK_SIZE, allreduce<ElemType, REDUCTION_BLOCK_SIZE>, allreduce<unsigned int, REDUCTION_BLOCK_SIZE>);
+    __syncthreads(); // lower and upper were written by thread 0
+
+    const Microsoft::MSR::CNTK::ColumnQuantizer<ElemType> q(ldNbits, qCol.lower, qCol.upper);
+    for (size_t iQWord = threadIdx.x; iQWord < segment.numQWordsPerCol; iQWord += REDUCTION_BLOCK_SIZE)
+    {
+        qCol.bits[iQWord] = q.QuantizeOneQWord<ZeroThresholdFor1Bit>(segment.us, segment.inResidual, segment.numRows, iQWord, segment.numRows, segment.numQWordsPerCol, j, segment.outResidual);
+    }
+}
+
+// same thread layout as UnquantizeStripejOneQWord(), over the QWords of all matrices of the batch
+template <class ElemType>
+__global__ void _UnquantizeBatchOneQWord(const QuantizedBatchSegment<ElemType>* segments, size_t numSegments, size_t totalQWords, size_t ldNbits, const char* qBatch, bool add)
+{
+    const size_t linindex = ParallelizeOverRangeIndex();
+    if (linindex >= totalQWords)
+        return;
+
+    const auto& segment = segments[_FindBatchSegment(segments, numSegments, linindex, &QuantizedBatchSegment<ElemType>::firstQWord)];
+    const size_t j = (linindex - segment.firstQWord) / segment.numQWordsPerCol;
+    const size_t iQWord = (linindex - segment.firstQWord) % segment.numQWordsPerCol;
+
+    const auto& qCol = *(const Microsoft::MSR::CNTK::QuantizedColumn<ElemType>*) &qBatch[segment.offset + segment.qColSize * j];
+    Microsoft::MSR::CNTK::ColumnQuantizer<ElemType> q(ldNbits, qCol.lower, qCol.upper);
+    q.UnquantizeOneQWord(segment.us, segment.numRows, iQWord, segment.numRows, segment.numQWordsPerCol, j, qCol.bits[iQWord], add);
+}
+
 //maybe should move out into another class?
 template <class ElemType>
 void _QuantizeMatrix(
@@ -302,6 +364,41 @@ void _UnquantizeMatrix(const char* gpuBuffer, size_t gpuBufferSize,
     ParallelizeOverRangeDim(totalQWords, griddim, blockdim, 256);
     UnquantizeStripejOneQWord<<<griddim, blockdim, 0, stream>>>(us, M, N, gpuBuffer, colsize, numQWordsPerCol, ldNbits, add);
 }
+
+// quantize all matrices of a batch; 'segments' is the table of the non-empty matrices in GPU memory
+template <class ElemType>
+void _QuantizeMatrixBatch(const QuantizedBatchSegment<ElemType>* segments, size_t numSegments, size_t totalNumCols,
+                          char* qBatch, size_t nBits, cudaStream_t stream, bool zeroThresholdFor1Bit)
+{
+    if (totalNumCols == 0) // launch would fail with 0 blocks
+        return;
+
+    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
+    dim3 griddim = (unsigned int) totalNumCols;
+    dim3 blockdim = REDUCTION_BLOCK_SIZE;
+    if (zeroThresholdFor1Bit)
+    {
+        _QuantizeBatchColumnj<ElemType, true><<<griddim, blockdim, 0, stream>>>(segments, numSegments, ldNbits, qBatch);
+    }
+    else
+    {
+        _QuantizeBatchColumnj<ElemType, false><<<griddim, blockdim, 0, stream>>>(segments, numSegments, ldNbits, qBatch);
+    }
+}
+
+// unquantize all matrices of a batch
+template <class ElemType>
+void _UnquantizeMatrixBatch(const QuantizedBatchSegment<ElemType>* segments, size_t numSegments, size_t totalQWords,
+                            const char* qBatch, size_t nBits, bool add, cudaStream_t stream)
+{
+    if (totalQWords == 0)
+        return;
+
+    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
+    dim3 griddim, blockdim;
+    ParallelizeOverRangeDim(totalQWords, griddim, blockdim, 256);
+    _UnquantizeBatchOneQWord<ElemType><<<griddim, blockdim, 0, stream>>>(segments, numSegments, totalQWords, ldNbits, qBatch, add);
+}
 }
 }
 }
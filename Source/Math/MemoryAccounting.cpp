@@ -0,0 +1,307 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "MemoryAccounting.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+static std::atomic<bool> s_enabled(false);
+
+// innermost Context of the calling thread
+#ifdef _WIN32
+static __declspec(thread) MemoryAccounting::Context* t_context = nullptr;
+#else
+static __thread MemoryAccounting::Context* t_context = nullptr;
+#endif
+
+namespace {
+struct OwnerKey
+{
+    int m_deviceId;
+    std::wstring m_nodeName; // empty if not attributed to a node
+    MemoryAccounting::Role m_role;
+
+    bool operator<(const OwnerKey& other) const
+    {
+        return std::tie(m_deviceId, m_nodeName, m_role) < std::tie(other.m_deviceId, other.m_nodeName, other.m_role);
+    }
+};
+struct Usage
+{
+    size_t m_bytes;
+    size_t m_peakBytes;
+    size_t m_numAllocations;
+    Usage()
+        : m_bytes(0), m_peakBytes(0), m_numAllocations(0)
+    {
+    }
+    void Add(size_t bytes)
+    {
+        m_bytes += bytes;
+        m_peakBytes = std::max(m_peakBytes, m_bytes);
+        m_numAllocations++;
+    }
+    void Remove(size_t bytes)
+    {
+        m_bytes -= std::min(m_bytes, bytes);
+    }
+    void StartPeriod()
+    {
+        m_peakBytes = m_bytes;
+        m_numAllocations = 0;
+    }
+};
+typedef std::map<OwnerKey, Usage> OwnerMap;
+struct Allocation
+{
+    OwnerMap::iterator m_owner;
+    size_t m_bytes;
+};
+}
+
+// all protected by s_mutex
+static std::mutex s_mutex;
+static OwnerMap s_owners;                                   // [device, node, role]
+static std::map<std::pair<int, int>, Usage> s_roles;        // [device, role]
+static std::map<int, Usage> s_devices;                      // [device]
+static std::unordered_map<const void*, Allocation> s_allocations; // the live buffers
+
+static std::string DeviceName(int deviceId)
+{
+    return deviceId < 0 ? std::string("CPU") : "GPU" + std::to_string(deviceId);
+}
+
+static double MegaBytes(size_t bytes)
+{
+    return bytes / (double) (1 << 20);
+}
+
+/*static*/ const char* MemoryAccounting::RoleName(Role role)
+{
+    switch (role)
+    {
+    case other:          return "other";
+    case value:          return "value";
+    case gradient:       return "gradient";
+    case workspace:      return "workspace";
+    case optimizerState: return "optimizerState";
+    case readerBuffer:   return "readerBuffer";
+    default:             LogicError("MemoryAccounting: Invalid role %d.", (int) role);
+    }
+}
+
+/*static*/ void MemoryAccounting::SetEnabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+/*static*/ bool MemoryAccounting::IsEnabled()
+{
+    return s_enabled.load();
+}
+
+void MemoryAccounting::Context::Begin(const std::wstring* nodeName, Role role)
+{
+    if (nodeName)
+        m_nodeName = *nodeName;
+    else if (t_context)
+        m_nodeName = t_context->m_nodeName;
+    m_role = role;
+    m_outer = t_context;
+    m_active = true;
+    t_context = this;
+}
+
+MemoryAccounting::Context::~Context()
+{
+    if (m_active)
+        t_context = m_outer;
+}
+
+// remove a live buffer from the statistics; caller holds s_mutex
+static void RemoveAllocationNoLock(std::unordered_map<const void*, Allocation>::iterator iter)
+{
+    const Allocation& allocation = iter->second;
+    const OwnerKey& key = allocation.m_owner->first;
+    allocation.m_owner->second.Remove(allocation.m_bytes);
+    s_roles[std::make_pair(key.m_deviceId, (int) key.m_role)].Remove(allocation.m_bytes);
+    s_devices[key.m_deviceId].Remove(allocation.m_bytes);
+    s_allocations.erase(iter);
+}
+
+/*static*/ void MemoryAccounting::RecordAllocation(int deviceId, const void* p, size_t bytes)
+{
+    if (!IsEnabled() || !p)
+        return;
+
+    OwnerKey key;
+    key.m_deviceId = deviceId < 0 ? -1 : deviceId;
+    key.m_role = other;
+    if (t_context)
+    {
+        key.m_nodeName = t_context->m_nodeName;
+        key.m_role = t_context->m_role;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto existing = s_allocations.find(p);
+    if (existing != s_allocations.end()) // freed without our knowledge (e.g. while accounting was off)
+        RemoveAllocationNoLock(existing);
+
+    auto owner = s_owners.insert(std::make_pair(key, Usage())).first;
+    owner->second.Add(bytes);
+    s_roles[std::make_pair(key.m_deviceId, (int) key.m_role)].Add(bytes);
+    s_devices[key.m_deviceId].Add(bytes);
+    Allocation allocation;
+    allocation.m_owner = owner;
+    allocation.m_bytes = bytes;
+    s_allocations[p] = allocation;
+}
+
+/*static*/ void MemoryAccounting::RecordFree(const void* p)
+{
+    if (!IsEnabled() || !p)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto iter = s_allocations.find(p);
+    if (iter != s_allocations.end())
+        RemoveAllocationNoLock(iter);
+}
+
+/*static*/ void MemoryAccounting::ReportOutOfMemory(int deviceId, size_t bytes)
+{
+    if (!IsEnabled())
+        return;
+
+    const Context* context = t_context;
+    fprintf(stderr, "\nMemoryAccounting: Out of memory allocating %.1f MB on %s for %ls (%s).\n",
+            MegaBytes(bytes), DeviceName(deviceId).c_str(), context && !context->m_nodeName.empty() ? context->m_nodeName.c_str() : L"(no node)",
+            RoleName(context ? context->m_role : other));
+    PrintSnapshot(stderr, "Out of memory");
+}
+
+/*static*/ size_t MemoryAccounting::GetBytesInUse(int deviceId, Role role)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto iter = s_roles.find(std::make_pair(deviceId < 0 ? -1 : deviceId, (int) role));
+    return iter != s_roles.end() ? iter->second.m_bytes : 0;
+}
+
+/*static*/ size_t MemoryAccounting::GetPeakBytes(int deviceId, Role role)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto iter = s_roles.find(std::make_pair(deviceId < 0 ? -1 : deviceId, (int) role));
+    return iter != s_roles.end() ? iter->second.m_peakBytes : 0;
+}
+
+// one line per device: "GPU0 1234.5 MB, CPU 12.3 MB"; caller holds s_mutex
+static std::string DeviceTotalsNoLock(bool peak)
+{
+    std::string totals;
+    for (const auto& device : s_devices)
+    {
+        if (!totals.empty())
+            totals += ", ";
+        totals += msra::strfun::strprintf("%s %.1f MB", DeviceName(device.first).c_str(), MegaBytes(peak ? device.second.m_peakBytes : device.second.m_bytes));
+    }
+    return totals.empty() ? "none" : totals;
+}
+
+static std::wstring NodeNameOrNone(const OwnerKey& key)
+{
+    return key.m_nodeName.empty() ? L"(no node)" : key.m_nodeName;
+}
+
+/*static*/ void MemoryAccounting::PrintSummary(FILE* f, const std::string& title, size_t maxEntries)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    fprintf(f, "%s: Memory high-water marks: %s\n", title.c_str(), DeviceTotalsNoLock(/*peak=*/true).c_str());
+    if (s_owners.empty())
+        return;
+
+    fprintf(f, "    %-6s %-15s %12s %12s\n", "device", "role", "peak MB", "current MB");
+    for (const auto& role : s_roles)
+    {
+        if (role.second.m_peakBytes > 0)
+            fprintf(f, "    %-6s %-15s %12.3f %12.3f\n", DeviceName(role.first.first).c_str(), RoleName((Role) role.first.second),
+                    MegaBytes(role.second.m_peakBytes), MegaBytes(role.second.m_bytes));
+    }
+
+    std::vector<OwnerMap::const_iterator> owners;
+    for (auto iter = s_owners.begin(); iter != s_owners.end(); ++iter)
+        if (iter->second.m_peakBytes > 0)
+            owners.push_back(iter);
+    std::sort(owners.begin(), owners.end(), [](OwnerMap::const_iterator a, OwnerMap::const_iterator b)
+              {
+                  return a->second.m_peakBytes > b->second.m_peakBytes;
+              });
+    fprintf(f, "    %-6s %-15s %12s %12s %12s  %s\n", "device", "role", "peak MB", "current MB", "allocations", "node");
+    for (size_t i = 0; i < owners.size() && i < maxEntries; i++)
+    {
+        const OwnerKey& key = owners[i]->first;
+        const Usage& usage = owners[i]->second;
+        fprintf(f, "    %-6s %-15s %12.3f %12.3f %12d  %ls\n", DeviceName(key.m_deviceId).c_str(), RoleName(key.m_role),
+                MegaBytes(usage.m_peakBytes), MegaBytes(usage.m_bytes), (int) usage.m_numAllocations, NodeNameOrNone(key).c_str());
+    }
+    if (owners.size() > maxEntries)
+        fprintf(f, "    ... %d more\n", (int) (owners.size() - maxEntries));
+}
+
+/*static*/ void MemoryAccounting::PrintSnapshot(FILE* f, const std::string& title, size_t maxEntries)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    fprintf(f, "%s: Memory in use: %s\n", title.c_str(), DeviceTotalsNoLock(/*peak=*/false).c_str());
+
+    std::vector<OwnerMap::const_iterator> owners;
+    for (auto iter = s_owners.begin(); iter != s_owners.end(); ++iter)
+        if (iter->second.m_bytes > 0)
+            owners.push_back(iter);
+    if (owners.empty())
+        return;
+    std::sort(owners.begin(), owners.end(), [](OwnerMap::const_iterator a, OwnerMap::const_iterator b)
+              {
+                  return a->second.m_bytes > b->second.m_bytes;
+              });
+    fprintf(f, "    %-6s %-15s %12s  %s\n", "device", "role", "MB", "node");
+    for (size_t i = 0; i < owners.size() && i < maxEntries; i++)
+    {
+        const OwnerKey& key = owners[i]->first;
+        fprintf(f, "    %-6s %-15s %12.3f  %ls\n", DeviceName(key.m_deviceId).c_str(), RoleName(key.m_role), MegaBytes(owners[i]->second.m_bytes), NodeNameOrNone(key).c_str());
+    }
+    if (owners.size() > maxEntries)
+        fprintf(f, "    ... %d more\n", (int) (owners.size() - maxEntries));
+}
+
+/*static*/ void MemoryAccounting::ResetPeaks()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto& owner : s_owners)
+        owner.second.StartPeriod();
+    for (auto& role : s_roles)
+        role.second.StartPeriod();
+    for (auto& device : s_devices)
+        device.second.StartPeriod();
+}
+
+/*static*/ void MemoryAccounting::Reset()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_allocations.clear();
+    s_owners.clear();
+    s_roles.clear();
+    s_devices.clear();
+}
+
+} } }
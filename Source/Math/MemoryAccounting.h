@@ -0,0 +1,127 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MemoryAccounting.h -- attributes the memory of dense CPU matrices and of all GPU allocations to nodes and roles
+//
+// GPUWatcher only tells how much device memory is free. With accounting enabled, every buffer that CPUMatrix allocates,
+// and every buffer allocated on a GPU (through TracingGPUMemoryAllocator, i.e. dense and sparse matrices and workspaces),
+// is tagged with the node and role of the innermost Context on the calling thread, and its size is added to the usage of
+// that (device, node, role). High-water marks are kept per device and role and per node; PrintSummary() shows them, and
+// ResetPeaks() starts a new measurement period (SGD does both once per epoch). When an allocation fails, a snapshot of the
+// memory that is currently in use is printed before the error propagates.
+// Roles nest: a Context that only gives a role keeps the node of the enclosing one. ComputationNetwork attributes what is
+// allocated during a node's ForwardProp() and Backprop() to the node as workspace, and overrides that with 'value' and
+// 'gradient' where the node's own matrices are sized; SGD does so for optimizer state and reader buffers.
+// Buffers allocated before accounting was enabled are not known and not counted, not even when they are freed.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class MATH_API MemoryAccounting
+{
+public:
+    enum Role
+    {
+        other,          // outside of any Context
+        value,          // a node's output
+        gradient,       // a node's gradient
+        workspace,      // temporaries of a node's ForwardProp() and Backprop()
+        optimizerState, // e.g. smoothed gradients
+        readerBuffer,   // minibatch data filled in by a reader
+        numRoles
+    };
+    static const char* RoleName(Role role);
+
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled();
+
+    // the node and role that the allocations on this thread are attributed to while the Context exists
+    // Does nothing if accounting is off.
+    class MATH_API Context
+    {
+    public:
+        Context(const std::wstring& nodeName, Role role)
+            : m_outer(nullptr), m_active(false)
+        {
+            if (IsEnabled())
+                Begin(&nodeName, role);
+        }
+        Context(const wchar_t* nodeName, Role role)
+            : m_outer(nullptr), m_active(false)
+        {
+            if (IsEnabled())
+            {
+                const std::wstring name(nodeName);
+                Begin(&name, role);
+            }
+        }
+        // keeps the node of the enclosing Context
+        explicit Context(Role role)
+            : m_outer(nullptr), m_active(false)
+        {
+            if (IsEnabled())
+                Begin(nullptr, role);
+        }
+        // for a ComputationNode; NodeName() is only called if accounting is on
+        template <class Node>
+        Context(const Node& node, Role role)
+            : m_outer(nullptr), m_active(false)
+        {
+            if (IsEnabled())
+                Begin(&node.NodeName(), role);
+        }
+        ~Context();
+
+    private:
+        void Begin(const std::wstring* nodeName, Role role);
+
+        std::wstring m_nodeName;
+        Role m_role;
+        Context* m_outer;
+        bool m_active;
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        friend class MemoryAccounting;
+    };
+
+    // called by the allocators; device ids < 0 denote the CPU
+    static void RecordAllocation(int deviceId, const void* p, size_t bytes);
+    static void RecordFree(const void* p);
+    // called when an allocation of 'bytes' failed, before the error is raised; prints the snapshot if accounting is on
+    static void ReportOutOfMemory(int deviceId, size_t bytes);
+
+    // bytes of the given role in use on the device now, and at most since the last ResetPeaks()
+    static size_t GetBytesInUse(int deviceId, Role role);
+    static size_t GetPeakBytes(int deviceId, Role role);
+
+    // prints the high-water marks per device and role, and the 'maxEntries' nodes with the highest ones
+    // 'title' goes into the header line, e.g. "Epoch[3]".
+    static void PrintSummary(FILE* f, const std::string& title, size_t maxEntries = 30);
+    // prints the memory in use right now, by device, node, and role
+    static void PrintSnapshot(FILE* f, const std::string& title, size_t maxEntries = 50);
+    // sets all high-water marks to the current usage, and the allocation counts to 0
+    static void ResetPeaks();
+    // forgets all allocations
+    static void Reset();
+};
+
+} } }
@@ -23,7 +23,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 // the reset below are dummy implementations
 
-void PrepareDevice(DEVICEID_TYPE deviceId);
+void PrepareDevice(DEVICEID_TYPE deviceId)
+{
+}
 
 template <class ElemType>
 GPUSPARSE_INDEX_TYPE GPUSparseMatrix<ElemType>::SecondaryIndexValueAt(size_t idx) const
@@ -195,6 +197,17 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSpars
 {
 }
 
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxForward(const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& columnLoss)
+{
+}
+
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(const GPUMatrix<ElemType>& alpha, const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp,
+                                                                GPUMatrix<ElemType>& gradient)
+{
+}
+
 template <class ElemType>
 GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::InplaceTruncate(const ElemType threshold)
 {
@@ -211,8 +224,20 @@ ElemType GPUSparseMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& c, const bool n
 {
     return 1;
 }
-//template<class ElemType>
-//void GPUSparseMatrix<ElemType>::FSAdagrad(CPUMatrix<ElemType>& gradients, CPUMatrix<ElemType>&, ElemType, ElemType, ElemType, ElemType) { }
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::FSAdagrad(GPUMatrix<ElemType>& c, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul)
+{
+}
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::Adam(GPUMatrix<ElemType>& c, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+                              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+}
+template <class ElemType>
+ElemType GPUSparseMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& c, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier)
+{
+    return 1;
+}
 
 #ifdef NO_SYNC
 template <class ElemType>
@@ -651,6 +676,16 @@ template <class ElemType>
 void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat)
 {
 }
+
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& columnValues) const
+{
+}
+
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& columnValues)
+{
+}
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat, GPUSparseMatrix<ElemType>& outMatrix) const
 {
@@ -734,6 +769,15 @@ DeviceBoundNumber<ElemType>::~DeviceBoundNumber()
 template <class ElemType>
 void GPUMatrix<ElemType>::SetDevice(DEVICEID_TYPE deviceId){};
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetFP16GEMMEnabled(bool enabled){};
+
+template <class ElemType>
+bool GPUMatrix<ElemType>::IsFP16GEMMEnabled()
+{
+    return false;
+}
+
 // PrepareDevice - Setup the correct cuda context for an operation
 // deviceId - the device on which the operation will take place
 //            defaults to -1, which means use matrices current device
@@ -754,6 +798,16 @@ void GPUMatrix<ElemType>::CopySection(size_t numRows, size_t numCols, ElemType*
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::RecordStreamUse(cudaStream_t) const
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::PrefetchManaged(bool) const
+{
+}
+
 //memory will be allocated by the callee if not enough but need to be deleted by the caller after it's done
 //return number of elements copied
 template <class ElemType>
@@ -901,6 +955,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddToRowRepeatValuesOf(const GPUMatrix
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedImages(const void* /*packedImages*/)
+{
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPositiveAndShiftedNegSample(const GPUMatrix<ElemType>& a, const size_t posNumber, const size_t negNumber, const size_t shiftNumber)
 {
@@ -963,6 +1023,36 @@ template <class ElemType>
 void GPUMatrix<ElemType>::CopyColumnsStrided(const GPUMatrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride)
 {
 }
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignGatheredColumnsOf(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& columnIndices)
+{
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddScatteredColumnsOf(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& columnIndices)
+{
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedHalfOf(const GPUMatrix<ElemType>& a, HalfFormat format)
+{
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignUnpackedHalfOf(const GPUMatrix<ElemType>& packed, size_t numRows, HalfFormat format)
+{
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignAliasSamplesOf(const GPUMatrix<ElemType>& aliasTable, const GPUMatrix<ElemType>& uniforms)
+{
+    return *this;
+}
 template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(const GPUMatrix<ElemType>& deepCopyFrom)
 {
@@ -973,6 +1063,11 @@ void GPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, i
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetValueFromPeer(const GPUMatrix<ElemType>& deepCopyFrom)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1000,6 +1095,17 @@ void GPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetPhiloxRandomValue(const bool gaussian, const ElemType a, const ElemType b, unsigned long seed)
+{
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::ScaleAndAddDropoutOf(const ElemType beta, const GPUMatrix<ElemType>& a, const ElemType dropoutRate, unsigned long seed, size_t stream, size_t offset)
+{
+    return *this;
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1009,6 +1115,11 @@ template <class ElemType>
 void GPUMatrix<ElemType>::FSAdagrad(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul)
 {
 }
+template <class ElemType>
+void GPUMatrix<ElemType>::Adam(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType beta1, ElemType beta2, ElemType epsilon,
+                              ElemType biasCorrection1, ElemType biasCorrection2, ElemType weightDecay, bool directionOnly)
+{
+}
 
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier)
@@ -1752,6 +1863,21 @@ void GPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix
 {
 }
 template <class ElemType>
+void GPUMatrix<ElemType>::MultiplyAndWeightedAddBatched(ElemType alpha, const std::vector<const GPUMatrix<ElemType>*>& /*a*/, const bool transposeA, const std::vector<const GPUMatrix<ElemType>*>& /*b*/, const bool transposeB,
+                                                        ElemType beta, const std::vector<GPUMatrix<ElemType>*>& c)
+{
+}
+template <class ElemType>
+void GPUMatrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const GPUMatrix<ElemType>*>& /*matrices*/, std::vector<double>& /*sumsOfSquares*/)
+{
+}
+template <class ElemType>
+void GPUMatrix<ElemType>::MultiTensorSGDUpdate(const std::vector<GPUMatrix<ElemType>*>& /*weights*/, const std::vector<const GPUMatrix<ElemType>*>& /*gradients*/, const std::vector<GPUMatrix<ElemType>*>& /*smoothedGradients*/,
+                                               const std::vector<ElemType>& /*gradientScales*/, const ElemType truncation, const ElemType l2RegWeight, const ElemType learnRatePerSample,
+                                               const ElemType momentum, const bool useNesterovMomentum, const bool useAdaGrad)
+{
+}
+template <class ElemType>
 void GPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const GPUMatrix<ElemType>& rhs, ElemType beta, GPUMatrix<ElemType>& c)
 {
 }
@@ -1900,6 +2026,97 @@ void GPUMatrix<ElemType>::TensorShuffleScaleAndAdd(ElemType keepWeight, const GP
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMPointwiseForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& prevCell, const GPUMatrix<ElemType>* peepholes, GPUMatrix<ElemType>& cell, GPUMatrix<ElemType>& output)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::LSTMPointwiseBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& cell, const GPUMatrix<ElemType>& prevCell, const GPUMatrix<ElemType>* peepholes, const GPUMatrix<ElemType>& outputGradient,
+                                                GPUMatrix<ElemType>& cellGradient, GPUMatrix<ElemType>& gatesGradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::GRUPointwiseForward(GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& recurrent, const GPUMatrix<ElemType>& prevOutput, GPUMatrix<ElemType>& output)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::GRUPointwiseBackward(const GPUMatrix<ElemType>& gates, const GPUMatrix<ElemType>& recurrent, const GPUMatrix<ElemType>& prevOutput, GPUMatrix<ElemType>& outputGradient,
+                                               GPUMatrix<ElemType>& gatesGradient, GPUMatrix<ElemType>& recurrentGradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamples(const GPUMatrix<ElemType>& left, const GPUMatrix<ElemType>& right, size_t shift,
+                                                         GPUMatrix<ElemType>& invNormLeft, GPUMatrix<ElemType>& invNormRight, GPUMatrix<ElemType>& cosDistance)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(const GPUMatrix<ElemType>& left, const GPUMatrix<ElemType>& right, const GPUMatrix<ElemType>& invNormLeft, const GPUMatrix<ElemType>& invNormRight,
+                                                                 const GPUMatrix<ElemType>& cosDistance, const GPUMatrix<ElemType>& gradient, size_t shift, bool wrtRight, GPUMatrix<ElemType>& inputGradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AttentionForward(const GPUMatrix<ElemType>& query, const GPUMatrix<ElemType>& keys, const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                           GPUMatrix<ElemType>& context, GPUMatrix<ElemType>& logSumExp)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AttentionBackward(const GPUMatrix<ElemType>& query, const GPUMatrix<ElemType>& keys, const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& keyRanges, size_t keyStride, ElemType scale,
+                                            const GPUMatrix<ElemType>& context, const GPUMatrix<ElemType>& logSumExp, const GPUMatrix<ElemType>& contextGradient,
+                                            GPUMatrix<ElemType>* queryGradient, GPUMatrix<ElemType>* keysGradient, GPUMatrix<ElemType>* valuesGradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CrossEntropyWithSoftmaxForward(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& columnLoss)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CrossEntropyWithSoftmaxBackward(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp,
+                                                          GPUMatrix<ElemType>& gradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SegmentedLogSoftmax(const GPUMatrix<ElemType>& values, const GPUMatrix<ElemType>& segments, GPUMatrix<ElemType>& logProbs, GPUMatrix<ElemType>& loss)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SegmentedSoftmaxGradient(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& logProbs, const GPUMatrix<ElemType>& segments, ElemType beta, GPUMatrix<ElemType>& gradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::NoiseContrastiveLoss(const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& loss, GPUMatrix<ElemType>& gradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFForward(const GPUMatrix<ElemType>& labelIds, const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                                     GPUMatrix<ElemType>& logAlpha, GPUMatrix<ElemType>& logPartition, GPUMatrix<ElemType>& loss)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFBackward(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labelIds, const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                                      const GPUMatrix<ElemType>& logAlpha, const GPUMatrix<ElemType>& logPartition, GPUMatrix<ElemType>& logBeta, GPUMatrix<ElemType>* scoresGradient, GPUMatrix<ElemType>* transitionsGradient)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFViterbi(const GPUMatrix<ElemType>& scores, const GPUMatrix<ElemType>& transitions, const GPUMatrix<ElemType>& sequences, size_t stride,
+                                     GPUMatrix<ElemType>& bestScores, GPUMatrix<ElemType>& backpointers, GPUMatrix<ElemType>& path)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::TensorOp(ElemType beta, const GPUMatrix<ElemType>& a, ElemType alpha, ElementWiseOperator op,
                                    const array<size_t, 2>& offsets,
@@ -2052,6 +2269,16 @@ void MatrixQuantizerGPU<ElemType>::WaitUnquantizeAsyncDone()
 {
 }
 
+template <class ElemType>
+void MatrixQuantizerGPU<ElemType>::QuantizeBatchAsync(const std::vector<const Matrix<ElemType>*>& inMatrices, const std::vector<const Matrix<ElemType>*>& inResiduals, QuantizedMatrixBatch<ElemType>& outQBatch, const std::vector<Matrix<ElemType>*>& outResiduals, bool zeroThresholdFor1Bit)
+{
+}
+
+template <class ElemType>
+void MatrixQuantizerGPU<ElemType>::UnquantizeBatchAsync(QuantizedMatrixBatch<ElemType>& inQBatch, const std::vector<Matrix<ElemType>*>& outMatrices, bool add /*= false*/)
+{
+}
+
 #pragma endregion MatrixQuantizerGPU functions
 
 #pragma region GPUMatrixComputeStreamEvent functions
@@ -2071,6 +2298,10 @@ template <>
 void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent<float>(){};
 template <>
 void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent<double>(){};
+template <>
+void GPUMatrixComputeStreamEvent::SynchronizeDataTransferAssignStreamWithEvent<float>(){};
+template <>
+void GPUMatrixComputeStreamEvent::SynchronizeDataTransferAssignStreamWithEvent<double>(){};
 
 #pragma endregion GPUMatrixComputeStreamEvent functions
 
@@ -2106,6 +2337,11 @@ void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsync()
 {
 }
 
+template <class ElemType>
+void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsyncOnComputeStream()
+{
+}
+
 #pragma endregion GPUDataTransferer functions
 
 template class GPUMatrix<char>;
@@ -2141,7 +2377,7 @@ typename CuDnnConvolutionEngineFactory<ElemType>::FilterPtr CuDnnConvolutionEngi
 
 template <class ElemType>
 typename CuDnnConvolutionEngineFactory<ElemType>::ConvDescPtr CuDnnConvolutionEngineFactory<ElemType>::CreateConvDescriptor(
-    const Tensor4D&, const Filter&, size_t, size_t, bool)
+    const Tensor4D&, const Filter&, size_t, size_t, bool, size_t)
 {
     RuntimeError("The code is compiled with CPUONLY macro.");
 }
@@ -2188,6 +2424,17 @@ float CudaTimer::Elapsed()
     return 0;
 }
 
+void CuDnnAlgorithmCache::SetFile(const std::wstring&)
+{
+}
+bool CuDnnAlgorithmCache::Find(const std::string&, int&, size_t&)
+{
+    return false;
+}
+void CuDnnAlgorithmCache::Add(const std::string&, int, size_t)
+{
+}
+
 } } }
 
 // define a dummy GPUWatcher class too
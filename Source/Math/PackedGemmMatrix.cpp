@@ -0,0 +1,85 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "PackedGemmMatrix.h"
+#include "Basics.h"
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+const size_t PackedGemmMatrix<ElemType>::panelRows;
+template <class ElemType>
+const size_t PackedGemmMatrix<ElemType>::panelCols;
+template <class ElemType>
+const size_t PackedGemmMatrix<ElemType>::maxPackedColumns;
+
+template <class ElemType>
+PackedGemmMatrix<ElemType>::PackedGemmMatrix(const ElemType* data, size_t numRows, size_t numCols, bool transpose)
+{
+    m_numRows = transpose ? numCols : numRows;
+    m_numCols = transpose ? numRows : numCols;
+
+    const size_t numPanels = (m_numRows + panelRows - 1) / panelRows;
+    m_panels.assign(numPanels * m_numCols * panelRows, 0);
+
+    // element (i, k) of the represented matrix is data[i + k * numRows], or data[k + i * numRows] if transposed
+#pragma omp parallel for
+    for (long p = 0; p < (long) numPanels; p++)
+    {
+        ElemType* panel = m_panels.data() + p * m_numCols * panelRows;
+        const size_t rowBegin = p * panelRows;
+        const size_t rows = std::min(panelRows, m_numRows - rowBegin);
+        for (size_t k = 0; k < m_numCols; k++)
+        {
+            for (size_t r = 0; r < rows; r++)
+                panel[k * panelRows + r] = transpose ? data[k + (rowBegin + r) * numRows] : data[rowBegin + r + k * numRows];
+        }
+    }
+}
+
+template <class ElemType>
+void PackedGemmMatrix<ElemType>::Multiply(const ElemType* b, size_t numColsB, ElemType* c) const
+{
+    const size_t K = m_numCols;
+    const size_t M = m_numRows;
+    const long numPanels = (long) ((M + panelRows - 1) / panelRows);
+
+    // the panels are independent; for a small product, the threads would cost more than they save
+#pragma omp parallel for if (M * K * numColsB >= 65536)
+    for (long p = 0; p < numPanels; p++)
+    {
+        const ElemType* panel = m_panels.data() + p * K * panelRows;
+        const size_t rowBegin = p * panelRows;
+        const size_t rows = std::min(panelRows, M - rowBegin);
+        for (size_t j0 = 0; j0 < numColsB; j0 += panelCols)
+        {
+            const size_t cols = std::min(panelCols, numColsB - j0);
+            ElemType sums[panelCols][panelRows] = {};
+            for (size_t k = 0; k < K; k++)
+            {
+                // the loop over the rows of the panel is contiguous and of constant length, which the compiler vectorizes
+                const ElemType* a = panel + k * panelRows;
+                for (size_t jj = 0; jj < cols; jj++)
+                {
+                    const ElemType bkj = b[k + (j0 + jj) * K];
+                    for (size_t r = 0; r < panelRows; r++)
+                        sums[jj][r] += a[r] * bkj;
+                }
+            }
+            for (size_t jj = 0; jj < cols; jj++)
+            {
+                for (size_t r = 0; r < rows; r++)
+                    c[rowBegin + r + (j0 + jj) * M] = sums[jj][r];
+            }
+        }
+    }
+}
+
+// Explicit instantiation
+template class PackedGemmMatrix<float>;
+template class PackedGemmMatrix<double>;
+} } }
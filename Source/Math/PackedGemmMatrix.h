@@ -0,0 +1,59 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PackedGemmMatrix.h -- a constant weight matrix packed once for small-batch products on the CPU
+//
+// cblas_?gemm repacks its operands into panels on every call, which dominates the cost of the products of inference with a
+// few columns (the batch of a latency-critical request). PackedGemmMatrix keeps the weights W in that panel format from
+// the start: rows are grouped into panels of 'panelRows', each stored k-major, so that W * B accumulates a panel's rows for
+// a few columns of B in registers while streaming through the panel once. Products with more than 'maxPackedColumns'
+// columns are better left to the BLAS, whose repacking is then amortized.
+//
+
+#pragma once
+
+#include "CommonMatrix.h" // for MATH_API
+#include <vector>
+#include <cstddef>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class MATH_API PackedGemmMatrix
+{
+public:
+    static const size_t panelRows = 8;         // rows of W per panel (zero-padded at the end)
+    static const size_t panelCols = 4;         // columns of B accumulated together
+    static const size_t maxPackedColumns = 32; // the largest product that Multiply() is meant for
+
+    // Pack the column-major numRows x numCols matrix 'data'. If 'transpose' is set, the matrix represented is its transpose.
+    PackedGemmMatrix(const ElemType* data, size_t numRows, size_t numCols, bool transpose);
+
+    // dimensions of the represented (possibly transposed) matrix
+    size_t GetNumRows() const
+    {
+        return m_numRows;
+    }
+
+    size_t GetNumCols() const
+    {
+        return m_numCols;
+    }
+
+    // memory held by the packed copy
+    size_t GetSizeInBytes() const
+    {
+        return m_panels.size() * sizeof(ElemType);
+    }
+
+    // c = this * b, where b is column-major GetNumCols() x numColsB and c is column-major GetNumRows() x numColsB
+    // Thread-safe; any numColsB works, but beyond maxPackedColumns a BLAS gemm on the original matrix is faster.
+    void Multiply(const ElemType* b, size_t numColsB, ElemType* c) const;
+
+private:
+    size_t m_numRows;
+    size_t m_numCols;
+    std::vector<ElemType> m_panels; // [panel][k][row within the panel]
+};
+} } }
@@ -0,0 +1,74 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Philox.h -- the counter-based random number generator Philox4x32-10
+//
+// J. K. Salmon, M. A. Moraes, R. O. Dror, D. E. Shaw, "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011
+//
+// The random numbers are a pure function of a key (the seed) and a counter (the index of the number), so each element
+// of a random matrix can be computed on its own, in any order, by any thread, with the same result on the CPU and the
+// GPU. That way a dropout mask need not be stored: backprop regenerates it from the seed.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <math.h>
+
+#pragma push_macro("PHILOX_DECL")
+#ifndef PHILOX_DECL // to make these accessible to CUDA kernels, say '#define PHILOX_DECL __device__ __host__'
+#define PHILOX_DECL
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct Philox4x32
+{
+    uint32_t v[4];
+};
+
+// the four random words for a 128-bit counter (c0 = lowest) and a 64-bit key
+static inline PHILOX_DECL Philox4x32 Philox4x32_10(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        const uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+        const uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+        const uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        const uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t) p1;
+        c3 = (uint32_t) p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9; // the Weyl sequence of the key schedule
+        k1 += 0xBB67AE85;
+    }
+    Philox4x32 r = {{c0, c1, c2, c3}};
+    return r;
+}
+
+// the four random words at 'index' (a multiple of 4) of random stream 'stream' of 'seed'
+static inline PHILOX_DECL Philox4x32 PhiloxRandomAt(uint64_t seed, uint64_t stream, uint64_t index)
+{
+    const uint64_t block = index / 4;
+    return Philox4x32_10((uint32_t) block, (uint32_t)(block >> 32), (uint32_t) stream, (uint32_t)(stream >> 32), (uint32_t) seed, (uint32_t)(seed >> 32));
+}
+
+// uniform in [0, 1), with 24 bits so that it does not round up to 1 in float
+static inline PHILOX_DECL double PhiloxUniform(uint32_t word)
+{
+    return (word >> 8) * (1.0 / 16777216.0);
+}
+
+// the 'slot'-th (0..3) of four standard normal numbers by Box-Muller, two from each pair of words
+static inline PHILOX_DECL double PhiloxNormal(const Philox4x32& r, int slot)
+{
+    const int pair = slot / 2 * 2;
+    const double radius = sqrt(-2 * log(1 - PhiloxUniform(r.v[pair]))); // 1 - u is in (0, 1]
+    const double angle = 6.283185307179586 * PhiloxUniform(r.v[pair + 1]);
+    return radius * (slot % 2 == 0 ? cos(angle) : sin(angle));
+}
+} } }
+
+#pragma pop_macro("PHILOX_DECL")
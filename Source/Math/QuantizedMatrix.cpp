@@ -179,7 +179,75 @@ void QuantizedMatrix<ElemType>::Print(const char* matrixName, size_t rowStart, s
     }
 }
 
+template <class ElemType>
+QuantizedMatrixBatch<ElemType>::QuantizedMatrixBatch(const std::vector<std::pair<size_t, size_t>>& dims, const size_t nbits, DEVICEID_TYPE deviceId, MemAllocator* allocator /* = nullptr */)
+    : m_numBits(nbits), m_allocator(allocator)
+{
+    if (((QWordNumBits / m_numBits) * m_numBits) != QWordNumBits)
+    {
+        LogicError("Quantization: 'nbits' must be a divisor of 64");
+    }
+
+    m_offsets.push_back(0);
+    m_firstColumns.push_back(0);
+    for (const auto& dim : dims)
+    {
+        const size_t qColSize = QuantizedColumn<ElemType>::QuantizedColumnSize(m_numBits, dim.first);
+        m_numRows.push_back(dim.first);
+        m_numCols.push_back(dim.second);
+        m_qColSizes.push_back(qColSize);
+        m_offsets.push_back(m_offsets.back() + qColSize * dim.second);
+        m_firstColumns.push_back(m_firstColumns.back() + dim.second);
+    }
+
+    if (m_allocator == nullptr)
+    {
+        m_quantizedData = new Matrix<char>(GetSize(), 1, deviceId);
+    }
+    else
+    {
+        m_quantizedData = new Matrix<char>(GetSize(), 1, (char*) m_allocator->Malloc(GetSize()), deviceId, matrixFlagDontOwnBuffer);
+    }
+}
+
+template <class ElemType>
+QuantizedMatrixBatch<ElemType>::~QuantizedMatrixBatch()
+{
+    if (nullptr != m_quantizedData)
+    {
+        // If we used an external allocator, lets free the backing buffer of the matrix
+        if (m_allocator != nullptr)
+        {
+            assert(!m_quantizedData->OwnBuffer());
+            m_allocator->Free(m_quantizedData->BufferPointer());
+        }
+
+        delete m_quantizedData;
+        m_quantizedData = nullptr;
+    }
+}
+
+template <class ElemType>
+int QuantizedMatrixBatch<ElemType>::GetDeviceId() const
+{
+    return m_quantizedData->GetDeviceId();
+}
+
+template <class ElemType>
+char* QuantizedMatrixBatch<ElemType>::GetArray() const
+{
+    return m_quantizedData->BufferPointer();
+}
+
+template <class ElemType>
+bool QuantizedMatrixBatch<ElemType>::HasSameLayout(const QuantizedMatrixBatch<ElemType>& other) const
+{
+    return (m_numBits == other.m_numBits) && (m_numRows == other.m_numRows) && (m_numCols == other.m_numCols);
+}
+
 // Explicit instantiation
 template class QuantizedMatrix<float>;
 template class QuantizedMatrix<double>;
+template class QuantizedMatrixBatch<float>;
+template class QuantizedMatrixBatch<double>;
 } } }
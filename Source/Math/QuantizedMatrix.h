@@ -3,6 +3,8 @@
 #include "Matrix.h"
 #include "MemAllocator.h"
 #include "ValueQuantizer.h"
+#include <vector>
+#include <utility>
 
 #ifdef _WIN32
 #ifdef MATH_EXPORTS
@@ -119,4 +121,95 @@ private:
     template <typename T>
     friend class MatrixQuantizer;
 };
+
+// A QuantizedMatrixBatch holds several matrices of possibly different shapes, quantized into one contiguous buffer.
+// The matrices are stored back to back, and the part of matrix i is byte-identical to a QuantizedMatrix of the same
+// shape, so the whole batch can be quantized in one kernel launch and sent or received with a single transfer.
+template <class ElemType>
+class MATH_API QuantizedMatrixBatch
+{
+    static const size_t QWordNumBits = ValueQuantizer<ElemType>::QWordNumBits;
+
+public:
+    // 'dims' holds the (rows, columns) of each matrix
+    QuantizedMatrixBatch(const std::vector<std::pair<size_t, size_t>>& dims, const size_t nbits, DEVICEID_TYPE deviceId, MemAllocator* allocator = nullptr);
+    ~QuantizedMatrixBatch();
+
+    int GetDeviceId() const;
+
+    size_t GetNumBits() const
+    {
+        return m_numBits;
+    }
+
+    size_t GetNumMatrices() const
+    {
+        return m_numRows.size();
+    }
+
+    size_t GetNumRows(size_t i) const
+    {
+        return m_numRows[i];
+    }
+
+    size_t GetNumCols(size_t i) const
+    {
+        return m_numCols[i];
+    }
+
+    // number of bytes in a quantized column of matrix i
+    size_t GetQuantizedColumnSize(size_t i) const
+    {
+        return m_qColSizes[i];
+    }
+
+    // byte offset of matrix i in the buffer
+    size_t GetOffset(size_t i) const
+    {
+        return m_offsets[i];
+    }
+
+    // index of the first column of matrix i when counting the columns of all matrices in order
+    size_t GetFirstColumn(size_t i) const
+    {
+        return m_firstColumns[i];
+    }
+
+    size_t GetTotalNumCols() const
+    {
+        return m_firstColumns.back();
+    }
+
+    // size of the buffer in bytes
+    size_t GetSize() const
+    {
+        return m_offsets.back();
+    }
+
+    char* GetArray() const;
+
+    QuantizedColumn<ElemType>* GetQuantizedColumn(size_t i, size_t colIdx)
+    {
+        return (QuantizedColumn<ElemType>*) (&((this->GetArray())[m_offsets[i] + m_qColSizes[i] * colIdx]));
+    }
+
+    // true if 'other' has the same matrix shapes and number of bits, i.e. the buffers are interchangeable
+    bool HasSameLayout(const QuantizedMatrixBatch<ElemType>& other) const;
+
+private:
+    // Disallow copy construction and assignment
+    QuantizedMatrixBatch(const QuantizedMatrixBatch<ElemType>&) = delete;
+    QuantizedMatrixBatch<ElemType>& operator=(const QuantizedMatrixBatch<ElemType>&) = delete;
+
+private:
+    Matrix<char>* m_quantizedData; // (GetSize() x 1)
+    MemAllocator* m_allocator;
+
+    size_t m_numBits;
+    std::vector<size_t> m_numRows;
+    std::vector<size_t> m_numCols;
+    std::vector<size_t> m_qColSizes;
+    std::vector<size_t> m_offsets;      // GetNumMatrices() + 1 entries, the last one is the total size
+    std::vector<size_t> m_firstColumns; // GetNumMatrices() + 1 entries, the last one is the total number of columns
+};
 } } }
@@ -163,6 +163,89 @@ private:
                                                     logEframescorrecttotal, totalfwscore);
     }
 
+    void forwardbackwardlatticebatch(const size_t *batchsizeforward, const size_t *batchsizebackward,
+                                     const size_t numlaunchforward, const size_t numlaunchbackward,
+                                     const uintvector &edgeorderforward, const uintvector &edgeorderbackward,
+                                     const uintvector &edgelattice, const uintvector &latticenodeoffsets,
+                                     const size_t spalignunitid, const size_t silalignunitid,
+                                     const floatvector &edgeacscores, const edgeinfowithscoresvector &edges,
+                                     const nodeinfovector &nodes, const aligninfovector &aligns,
+                                     const ushortvector &alignments, const uintvector &alignoffsets,
+                                     doublevector &logpps, doublevector &logalphas, doublevector &logbetas,
+                                     const float lmf, const float wp, const float amf, const float boostingfactor, const bool returnEframescorrect,
+                                     const ushortvector &uids, const ushortvector &senone2classmap, doublevector &logaccalphas,
+                                     doublevector &logaccbetas, doublevector &logframescorrectedge, doublevector &logEframescorrect,
+                                     doublevector &totalfwscores, doublevector &totalbwscores,
+                                     doublevector &totalfwaccs, doublevector &logEframescorrecttotals)
+    {
+        ondevice no(deviceid);
+        latticefunctionsops::forwardbackwardlatticebatch(batchsizeforward, batchsizebackward, numlaunchforward, numlaunchbackward,
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgeorderforward),
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgeorderbackward),
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgelattice),
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(latticenodeoffsets),
+                                                         spalignunitid, silalignunitid,
+                                                         dynamic_cast<const vectorbaseimpl<floatvector, vectorref<float>> &>(edgeacscores),
+                                                         dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                                         dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                                         dynamic_cast<const vectorbaseimpl<aligninfovector, vectorref<msra::lattices::aligninfo>> &>(aligns),
+                                                         dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(alignments),
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(alignoffsets),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logpps),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logalphas),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logbetas),
+                                                         lmf, wp, amf, boostingfactor, returnEframescorrect,
+                                                         dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(uids),
+                                                         dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(senone2classmap),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logaccalphas),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logaccbetas),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logframescorrectedge),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logEframescorrect),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(totalfwscores),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(totalbwscores),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(totalfwaccs),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logEframescorrecttotals));
+    }
+
+    void prunelattice(const size_t *batchsizeforward, const size_t *batchsizebackward,
+                      const size_t numlaunchforward, const size_t numlaunchbackward,
+                      floatvector &edgeacscores, const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
+                      doublevector &logbestalphas, doublevector &logbestbetas,
+                      const float lmf, const float wp, const float amf, const float beam)
+    {
+        ondevice no(deviceid);
+        latticefunctionsops::prunelattice(batchsizeforward, batchsizebackward, numlaunchforward, numlaunchbackward,
+                                          vectorref<unsigned int>(), vectorref<unsigned int>(), vectorref<unsigned int>(), vectorref<unsigned int>(),
+                                          dynamic_cast<vectorbaseimpl<floatvector, vectorref<float>> &>(edgeacscores),
+                                          dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                          dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                          dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logbestalphas),
+                                          dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logbestbetas),
+                                          lmf, wp, amf, beam);
+    }
+
+    void prunelatticebatch(const size_t *batchsizeforward, const size_t *batchsizebackward,
+                           const size_t numlaunchforward, const size_t numlaunchbackward,
+                           const uintvector &edgeorderforward, const uintvector &edgeorderbackward,
+                           const uintvector &edgelattice, const uintvector &latticenodeoffsets,
+                           floatvector &edgeacscores, const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
+                           doublevector &logbestalphas, doublevector &logbestbetas,
+                           const float lmf, const float wp, const float amf, const float beam)
+    {
+        ondevice no(deviceid);
+        latticefunctionsops::prunelattice(batchsizeforward, batchsizebackward, numlaunchforward, numlaunchbackward,
+                                          dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgeorderforward),
+                                          dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgeorderbackward),
+                                          dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgelattice),
+                                          dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(latticenodeoffsets),
+                                          dynamic_cast<vectorbaseimpl<floatvector, vectorref<float>> &>(edgeacscores),
+                                          dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                          dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                          dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logbestalphas),
+                                          dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logbestbetas),
+                                          lmf, wp, amf, beam);
+    }
+
     void sMBRerrorsignal(const ushortvector &alignstateids,
                          const uintvector &alignoffsets,
                          const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
@@ -183,6 +266,28 @@ private:
                                              logEframescorrecttotal, dengammasMatrixRef, dengammasbufMatrixRef);
     }
 
+    void sMBRerrorsignalbatch(const ushortvector &alignstateids, const uintvector &alignoffsets,
+                              const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
+                              const doublevector &logpps, const float amf, const doublevector &logEframescorrect,
+                              const uintvector &edgelattice, const doublevector &logEframescorrecttotals,
+                              Microsoft::MSR::CNTK::Matrix<float> &dengammas, Microsoft::MSR::CNTK::Matrix<float> &dengammasbuf)
+    {
+        ondevice no(deviceid);
+
+        matrixref<float> dengammasMatrixRef = tomatrixref(dengammas);
+        matrixref<float> dengammasbufMatrixRef = tomatrixref(dengammasbuf);
+        latticefunctionsops::sMBRerrorsignalbatch(dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(alignstateids),
+                                                  dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(alignoffsets),
+                                                  dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                                  dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                                  dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logpps),
+                                                  amf,
+                                                  dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logEframescorrect),
+                                                  dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(edgelattice),
+                                                  dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logEframescorrecttotals),
+                                                  dengammasMatrixRef, dengammasbufMatrixRef);
+    }
+
     void mmierrorsignal(const ushortvector &alignstateids, const uintvector &alignoffsets,
                         const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
                         const doublevector &logpps, Microsoft::MSR::CNTK::Matrix<float> &dengammas)
@@ -212,6 +317,16 @@ private:
                                              dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logqs),
                                              logaccMatrixRef);
     }
+
+    void uidlogllsum(const ushortvector &uids, const Microsoft::MSR::CNTK::Matrix<float> &logLLs, doublevector &logllsum)
+    {
+        ondevice no(deviceid);
+
+        matrixref<float> logLLsMatrixRef = tomatrixref(logLLs);
+        latticefunctionsops::uidlogllsum(dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(uids),
+                                         logLLsMatrixRef,
+                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logllsum));
+    }
 };
 
 latticefunctions *newlatticefunctions(size_t deviceid)
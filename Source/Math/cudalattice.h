@@ -99,16 +99,53 @@ struct latticefunctions : public vectorbase<msra::lattices::empty>
                                         doublevector& logaccalphas, doublevector& logaccbetas,
                                         doublevector& logframescorrectedge, doublevector& logEframescorrect,
                                         doublevector& Eframescorrectbuf, double& logEframescorrecttotal, double& totalfwscore) = 0;
+    // all lattices of a minibatch concatenated into one node/edge/align array (see cudalatticeops.cu.h); results are per lattice
+    virtual void forwardbackwardlatticebatch(const size_t* batchsizeforward, const size_t* batchsizebackward,
+                                             const size_t numlaunchforward, const size_t numlaunchbackward,
+                                             const uintvector& edgeorderforward, const uintvector& edgeorderbackward,
+                                             const uintvector& edgelattice, const uintvector& latticenodeoffsets,
+                                             const size_t spalignunitid, const size_t silalignunitid,
+                                             const floatvector& edgeacscores, const edgeinfowithscoresvector& edges,
+                                             const nodeinfovector& nodes, const aligninfovector& aligns,
+                                             const ushortvector& alignoutput, const uintvector& alignoffsets,
+                                             doublevector& logpps, doublevector& logalphas, doublevector& logbetas,
+                                             const float lmf, const float wp, const float amf, const float boostingfactor, const bool returnEframescorrect,
+                                             const ushortvector& uids, const ushortvector& senone2classmap,
+                                             doublevector& logaccalphas, doublevector& logaccbetas,
+                                             doublevector& logframescorrectedge, doublevector& logEframescorrect,
+                                             doublevector& totalfwscores, doublevector& totalbwscores,
+                                             doublevector& totalfwaccs, doublevector& logEframescorrecttotals) = 0;
+    // beam pruning before forwardbackwardlattice{,batch}(): sets the AC scores of the edges whose best path is more than 'beam'
+    // below the best path of their lattice to LOGZERO; logbestalphas/logbestbetas are work buffers of nodes.size() elements
+    virtual void prunelattice(const size_t* batchsizeforward, const size_t* batchsizebackward,
+                              const size_t numlaunchforward, const size_t numlaunchbackward,
+                              floatvector& edgeacscores, const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
+                              doublevector& logbestalphas, doublevector& logbestbetas,
+                              const float lmf, const float wp, const float amf, const float beam) = 0;
+    virtual void prunelatticebatch(const size_t* batchsizeforward, const size_t* batchsizebackward,
+                                   const size_t numlaunchforward, const size_t numlaunchbackward,
+                                   const uintvector& edgeorderforward, const uintvector& edgeorderbackward,
+                                   const uintvector& edgelattice, const uintvector& latticenodeoffsets,
+                                   floatvector& edgeacscores, const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
+                                   doublevector& logbestalphas, doublevector& logbestbetas,
+                                   const float lmf, const float wp, const float amf, const float beam) = 0;
     virtual void sMBRerrorsignal(const ushortvector& alignstateids, const uintvector& alignoffsets,
                                  const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
                                  const doublevector& logpps, const float amf, const doublevector& logEframescorrect,
                                  const double logEframescorrecttotal, Microsoft::MSR::CNTK::Matrix<float>& dengammas, Microsoft::MSR::CNTK::Matrix<float>& dengammasbuf) = 0;
+    virtual void sMBRerrorsignalbatch(const ushortvector& alignstateids, const uintvector& alignoffsets,
+                                      const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
+                                      const doublevector& logpps, const float amf, const doublevector& logEframescorrect,
+                                      const uintvector& edgelattice, const doublevector& logEframescorrecttotals,
+                                      Microsoft::MSR::CNTK::Matrix<float>& dengammas, Microsoft::MSR::CNTK::Matrix<float>& dengammasbuf) = 0;
     virtual void mmierrorsignal(const ushortvector& alignstateids, const uintvector& alignoffsets,
                                 const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
                                 const doublevector& logpps, Microsoft::MSR::CNTK::Matrix<float>& dengammas) = 0;
     virtual void stateposteriors(const ushortvector& alignstateids, const uintvector& alignoffsets,
                                  const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
                                  const doublevector& logqs, Microsoft::MSR::CNTK::Matrix<float>& logacc) = 0;
+    // logllsum[0] = sum over t of logLLs(uids[t],t), for the numerator of sequence training without copying the LLs to the CPU
+    virtual void uidlogllsum(const ushortvector& uids, const Microsoft::MSR::CNTK::Matrix<float>& logLLs, doublevector& logllsum) = 0;
 };
 
 // ---------------------------------------------------------------------------
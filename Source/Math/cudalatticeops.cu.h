@@ -201,7 +201,8 @@ __global__ void forwardlatticej(const size_t batchsize, const size_t startindex,
     if (j < batchsize) // note: will cause issues if we ever use __synctreads()
     {
         msra::lattices::latticefunctionskernels::forwardlatticej(j + startindex, edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns, alignments, alignmentoffsets,
-                                                                 logalphas, lmf, wp, amf, boostingfactor, uids, senone2classmap, returnEframescorrect, logframescorrectedge, logaccalphas);
+                                                                 logalphas, lmf, wp, amf, boostingfactor, uids, senone2classmap, returnEframescorrect, logframescorrectedge, logaccalphas,
+                                                                 0, nodes.size() - 1);
     }
 }
 
@@ -223,7 +224,7 @@ __global__ void backwardlatticej(const size_t batchsize, const size_t startindex
                                                                   edges, nodes, aligns, totalfwscore, logpps, logalphas, logbetas,
                                                                   lmf, wp, amf, boostingfactor, returnEframescorrect,
                                                                   logframescorrectedge, logaccalphas,
-                                                                  logEframescorrect, logaccbetas);
+                                                                  logEframescorrect, logaccbetas, 0, nodes.size() - 1);
     }
 }
 
@@ -326,6 +327,280 @@ void latticefunctionsops::forwardbackwardlattice(const size_t *batchsizeforward,
     }
 }
 
+// -----------------------------------------------------------------------
+// forwardbackwardlatticebatch --forwardbackwardlattice() for all lattices of a minibatch at once
+// The lattices are concatenated into one set of node/edge/align arrays, with node indices, node times, and alignment
+// offsets shifted to be global. edgelattice[j] is the lattice of edge j, and lattice l owns the nodes
+// [latticenodeoffsets[l], latticenodeoffsets[l+1]). Each launch processes one dependency level of all lattices;
+// edgeorderforward/edgeorderbackward hold the edge indices of the levels in launch order.
+// Per-lattice results go into totalfwscores etc. [lattice index].
+// -----------------------------------------------------------------------
+
+__global__ void setinitialtokensbatchj(const vectorref<unsigned int> latticenodeoffsets, vectorref<double> logalphas, vectorref<double> logbetas)
+{
+    const size_t l = threadIdx.x + (blockIdx.x * blockDim.x);
+    if (l + 1 < latticenodeoffsets.size())
+    {
+        logalphas[latticenodeoffsets[l]] = 0.0;
+        logbetas[latticenodeoffsets[l + 1] - 1] = 0.0;
+    }
+}
+
+__global__ void forwardlatticebatchj(const size_t batchsize, const size_t startindex, const vectorref<unsigned int> edgeorder,
+                                     const vectorref<unsigned int> edgelattice, const vectorref<unsigned int> latticenodeoffsets,
+                                     const vectorref<float> edgeacscores, const size_t spalignunitid, const size_t silalignunitid,
+                                     vectorref<msra::lattices::edgeinfowithscores> edges, vectorref<msra::lattices::nodeinfo> nodes,
+                                     const vectorref<msra::lattices::aligninfo> aligns, vectorref<unsigned short> alignments,
+                                     vectorref<unsigned int> alignmentoffsets, vectorref<double> logalphas, float lmf, float wp, float amf,
+                                     const float boostingfactor, const vectorref<unsigned short> uids, const vectorref<unsigned short> senone2classmap,
+                                     const bool returnEframescorrect, vectorref<double> logframescorrectedge, vectorref<double> logaccalphas)
+{
+    const size_t shufflemode = 1;
+    const size_t i = msra::lattices::latticefunctionskernels::shuffle(threadIdx.x, blockDim.x, threadIdx.y, blockDim.y, blockIdx.x, gridDim.x, shufflemode);
+    if (i < batchsize) // note: will cause issues if we ever use __synctreads()
+    {
+        const size_t j = edgeorder[i + startindex];
+        const size_t l = edgelattice[j];
+        msra::lattices::latticefunctionskernels::forwardlatticej(j, edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns, alignments, alignmentoffsets,
+                                                                 logalphas, lmf, wp, amf, boostingfactor, uids, senone2classmap, returnEframescorrect, logframescorrectedge, logaccalphas,
+                                                                 latticenodeoffsets[l], latticenodeoffsets[l + 1] - 1);
+    }
+}
+
+__global__ void backwardlatticebatchj(const size_t batchsize, const size_t startindex, const vectorref<unsigned int> edgeorder,
+                                      const vectorref<unsigned int> edgelattice, const vectorref<unsigned int> latticenodeoffsets,
+                                      const vectorref<float> edgeacscores, const size_t spalignunitid, const size_t silalignunitid,
+                                      vectorref<msra::lattices::edgeinfowithscores> edges, vectorref<msra::lattices::nodeinfo> nodes,
+                                      vectorref<msra::lattices::aligninfo> aligns, const vectorref<double> totalfwscores,
+                                      vectorref<double> logpps, vectorref<double> logalphas, vectorref<double> logbetas,
+                                      float lmf, float wp, float amf, const float boostingfactor, const bool returnEframescorrect,
+                                      vectorref<double> logframescorrectedge, vectorref<double> logaccalphas,
+                                      vectorref<double> logEframescorrect, vectorref<double> logaccbetas)
+{
+    const size_t tpb = blockDim.x * blockDim.y; // total #threads in a block
+    const size_t jinblock = threadIdx.x + threadIdx.y * blockDim.x;
+    const size_t i = jinblock + blockIdx.x * tpb;
+    if (i < batchsize) // note: will cause issues if we ever use __synctreads()
+    {
+        const size_t j = edgeorder[i + startindex];
+        const size_t l = edgelattice[j];
+        msra::lattices::latticefunctionskernels::backwardlatticej(j, edgeacscores, spalignunitid, silalignunitid,
+                                                                  edges, nodes, aligns, totalfwscores[l], logpps, logalphas, logbetas,
+                                                                  lmf, wp, amf, boostingfactor, returnEframescorrect,
+                                                                  logframescorrectedge, logaccalphas,
+                                                                  logEframescorrect, logaccbetas,
+                                                                  latticenodeoffsets[l], latticenodeoffsets[l + 1] - 1);
+    }
+}
+
+// read off the forward scores (and expected frames-correct counts) at the end node of each lattice
+__global__ void forwardtotalsbatchj(const vectorref<unsigned int> latticenodeoffsets, const vectorref<double> logalphas, const vectorref<double> logaccalphas,
+                                    const bool returnEframescorrect, vectorref<double> totalfwscores, vectorref<double> totalfwaccs)
+{
+    const size_t l = threadIdx.x + (blockIdx.x * blockDim.x);
+    if (l + 1 < latticenodeoffsets.size())
+    {
+        const size_t lastnode = latticenodeoffsets[l + 1] - 1;
+        totalfwscores[l] = logalphas[lastnode];
+        if (returnEframescorrect)
+            totalfwaccs[l] = logaccalphas[lastnode] - logalphas[lastnode];
+    }
+}
+
+// read off the backward scores (and expected frames-correct counts) at the start node of each lattice
+__global__ void backwardtotalsbatchj(const vectorref<unsigned int> latticenodeoffsets, const vectorref<double> logbetas, const vectorref<double> logaccbetas,
+                                     const bool returnEframescorrect, vectorref<double> totalbwscores, vectorref<double> logEframescorrecttotals)
+{
+    const size_t l = threadIdx.x + (blockIdx.x * blockDim.x);
+    if (l + 1 < latticenodeoffsets.size())
+    {
+        const size_t firstnode = latticenodeoffsets[l];
+        totalbwscores[l] = logbetas[firstnode];
+        if (returnEframescorrect)
+            logEframescorrecttotals[l] = logaccbetas[firstnode] - logbetas[firstnode];
+    }
+}
+
+void latticefunctionsops::forwardbackwardlatticebatch(const size_t *batchsizeforward, const size_t *batchsizebackward,
+                                                      const size_t numlaunchforward, const size_t numlaunchbackward,
+                                                      const vectorref<unsigned int> &edgeorderforward, const vectorref<unsigned int> &edgeorderbackward,
+                                                      const vectorref<unsigned int> &edgelattice, const vectorref<unsigned int> &latticenodeoffsets,
+                                                      const size_t spalignunitid, const size_t silalignunitid,
+                                                      const vectorref<float> &edgeacscores,
+                                                      const vectorref<msra::lattices::edgeinfowithscores> &edges,
+                                                      const vectorref<msra::lattices::nodeinfo> &nodes,
+                                                      const vectorref<msra::lattices::aligninfo> &aligns,
+                                                      const vectorref<unsigned short> &alignments,
+                                                      const vectorref<unsigned int> &aligmentoffsets,
+                                                      vectorref<double> &logpps, vectorref<double> &logalphas, vectorref<double> &logbetas,
+                                                      const float lmf, const float wp, const float amf, const float boostingfactor,
+                                                      const bool returnEframescorrect, const vectorref<unsigned short> &uids,
+                                                      const vectorref<unsigned short> &senone2classmap, vectorref<double> &logaccalphas,
+                                                      vectorref<double> &logaccbetas, vectorref<double> &logframescorrectedge,
+                                                      vectorref<double> &logEframescorrect,
+                                                      vectorref<double> &totalfwscores, vectorref<double> &totalbwscores,
+                                                      vectorref<double> &totalfwaccs, vectorref<double> &logEframescorrecttotals) const
+{
+    // initialize log{,acc}(alhas/betas)
+    dim3 t(32, 8);
+    const size_t tpb = t.x * t.y;
+    dim3 b((unsigned int) ((logalphas.size() + tpb - 1) / tpb));
+
+    setvaluej<<<b, t, 0, GetCurrentStream()>>>(logalphas, LOGZERO, logalphas.size());
+    checklaunch("setvaluej");
+    setvaluej<<<b, t, 0, GetCurrentStream()>>>(logbetas, LOGZERO, logalphas.size());
+    checklaunch("setvaluej");
+    if (returnEframescorrect)
+    {
+        setvaluej<<<b, t, 0, GetCurrentStream()>>>(logaccalphas, LOGZERO, logalphas.size());
+        checklaunch("setvaluej");
+        setvaluej<<<b, t, 0, GetCurrentStream()>>>(logaccbetas, LOGZERO, logalphas.size());
+        checklaunch("setvaluej");
+    }
+    // set initial tokens of each lattice to probability 1 (0 in log)
+    const size_t numlattices = latticenodeoffsets.size() - 1;
+    dim3 bl((unsigned int) ((numlattices + 31) / 32));
+    setinitialtokensbatchj<<<bl, 32, 0, GetCurrentStream()>>>(latticenodeoffsets, logalphas, logbetas);
+    checklaunch("setinitialtokensbatchj");
+
+    // forward pass
+    size_t startindex = 0;
+    for (size_t i = 0; i < numlaunchforward; i++)
+    {
+        dim3 b((unsigned int) ((batchsizeforward[i] + tpb - 1) / tpb));
+        forwardlatticebatchj<<<b, t, 0, GetCurrentStream()>>>(batchsizeforward[i], startindex, edgeorderforward, edgelattice, latticenodeoffsets,
+                                                              edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns,
+                                                              alignments, aligmentoffsets, logalphas, lmf, wp, amf,
+                                                              boostingfactor, uids, senone2classmap, returnEframescorrect,
+                                                              logframescorrectedge, logaccalphas);
+        checklaunch("forwardlatticebatchj");
+        startindex += batchsizeforward[i];
+    }
+    forwardtotalsbatchj<<<bl, 32, 0, GetCurrentStream()>>>(latticenodeoffsets, logalphas, logaccalphas, returnEframescorrect, totalfwscores, totalfwaccs);
+    checklaunch("forwardtotalsbatchj");
+
+    // backward pass
+    startindex = 0;
+    for (size_t i = 0; i < numlaunchbackward; i++)
+    {
+        dim3 b((unsigned int) ((batchsizebackward[i] + tpb - 1) / tpb));
+        backwardlatticebatchj<<<b, t, 0, GetCurrentStream()>>>(batchsizebackward[i], startindex, edgeorderbackward, edgelattice, latticenodeoffsets,
+                                                               edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns,
+                                                               totalfwscores, logpps, logalphas, logbetas,
+                                                               lmf, wp, amf, boostingfactor, returnEframescorrect, logframescorrectedge,
+                                                               logaccalphas, logEframescorrect, logaccbetas);
+        checklaunch("backwardlatticebatchj");
+        startindex += batchsizebackward[i];
+    }
+    backwardtotalsbatchj<<<bl, 32, 0, GetCurrentStream()>>>(latticenodeoffsets, logbetas, logaccbetas, returnEframescorrect, totalbwscores, logEframescorrecttotals);
+    checklaunch("backwardtotalsbatchj");
+}
+
+// -----------------------------------------------------------------------
+// prunelattice --beam pruning before the forward-backward (see latticefunctionskernels::pruneedgej())
+// Sets the AC scores of the pruned edges to LOGZERO. Works on a single lattice (edgeorder*, edgelattice and
+// latticenodeoffsets empty; edges in level order) or on batched lattices (see forwardbackwardlatticebatch()).
+// logbestalphas/logbestbetas are work buffers of at least nodes.size() elements.
+// -----------------------------------------------------------------------
+
+__global__ void bestforwardlatticej(const size_t batchsize, const size_t startindex, const vectorref<unsigned int> edgeorder,
+                                    const vectorref<float> edgeacscores, const vectorref<msra::lattices::edgeinfowithscores> edges,
+                                    vectorref<double> logbestalphas, float lmf, float wp, float amf)
+{
+    const size_t i = threadIdx.x + (blockIdx.x * blockDim.x);
+    if (i < batchsize)
+    {
+        const size_t j = edgeorder.size() > 0 ? edgeorder[i + startindex] : i + startindex;
+        msra::lattices::latticefunctionskernels::bestforwardlatticej(j, edgeacscores, edges, logbestalphas, lmf, wp, amf);
+    }
+}
+
+__global__ void bestbackwardlatticej(const size_t batchsize, const size_t startindex, const vectorref<unsigned int> edgeorder,
+                                     const vectorref<float> edgeacscores, const vectorref<msra::lattices::edgeinfowithscores> edges,
+                                     vectorref<double> logbestbetas, float lmf, float wp, float amf)
+{
+    const size_t i = threadIdx.x + (blockIdx.x * blockDim.x);
+    if (i < batchsize)
+    {
+        const size_t j = edgeorder.size() > 0 ? edgeorder[i + startindex] : i + startindex;
+        msra::lattices::latticefunctionskernels::bestbackwardlatticej(j, edgeacscores, edges, logbestbetas, lmf, wp, amf);
+    }
+}
+
+__global__ void pruneedgesj(const vectorref<unsigned int> edgelattice, const vectorref<unsigned int> latticenodeoffsets,
+                            vectorref<float> edgeacscores, const vectorref<msra::lattices::edgeinfowithscores> edges, const size_t numnodes,
+                            const vectorref<double> logbestalphas, const vectorref<double> logbestbetas,
+                            float lmf, float wp, float amf, const float beam)
+{
+    const size_t j = threadIdx.x + (blockIdx.x * blockDim.x);
+    if (j < edges.size())
+    {
+        const size_t lastnode = edgelattice.size() > 0 ? latticenodeoffsets[edgelattice[j] + 1] - 1 : numnodes - 1;
+        msra::lattices::latticefunctionskernels::pruneedgej(j, edgeacscores, edges, logbestalphas, logbestbetas, lastnode, lmf, wp, amf, beam);
+    }
+}
+
+void latticefunctionsops::prunelattice(const size_t *batchsizeforward, const size_t *batchsizebackward,
+                                       const size_t numlaunchforward, const size_t numlaunchbackward,
+                                       const vectorref<unsigned int> &edgeorderforward, const vectorref<unsigned int> &edgeorderbackward,
+                                       const vectorref<unsigned int> &edgelattice, const vectorref<unsigned int> &latticenodeoffsets,
+                                       vectorref<float> &edgeacscores, const vectorref<msra::lattices::edgeinfowithscores> &edges,
+                                       const vectorref<msra::lattices::nodeinfo> &nodes,
+                                       vectorref<double> &logbestalphas, vectorref<double> &logbestbetas,
+                                       const float lmf, const float wp, const float amf, const float beam) const
+{
+    const size_t tpb = 256;
+    dim3 b((unsigned int) ((nodes.size() + tpb - 1) / tpb));
+    setvaluej<<<b, tpb, 0, GetCurrentStream()>>>(logbestalphas, LOGZERO, nodes.size());
+    checklaunch("setvaluej");
+    setvaluej<<<b, tpb, 0, GetCurrentStream()>>>(logbestbetas, LOGZERO, nodes.size());
+    checklaunch("setvaluej");
+    const bool batched = latticenodeoffsets.size() > 0;
+    if (batched)
+    {
+        const size_t numlattices = latticenodeoffsets.size() - 1;
+        dim3 bl((unsigned int) ((numlattices + 31) / 32));
+        setinitialtokensbatchj<<<bl, 32, 0, GetCurrentStream()>>>(latticenodeoffsets, logbestalphas, logbestbetas);
+        checklaunch("setinitialtokensbatchj");
+    }
+    else
+    {
+        double log1 = 0.0;
+        memcpy(logbestalphas.get(), 0, &log1, 1);
+        memcpy(logbestbetas.get(), nodes.size() - 1, &log1, 1);
+    }
+
+    // best paths into the nodes, in the launch order of the forward pass
+    size_t startindex = 0;
+    for (size_t i = 0; i < numlaunchforward; i++)
+    {
+        dim3 b((unsigned int) ((batchsizeforward[i] + tpb - 1) / tpb));
+        bestforwardlatticej<<<b, tpb, 0, GetCurrentStream()>>>(batchsizeforward[i], startindex, edgeorderforward,
+                                                                edgeacscores, edges, logbestalphas, lmf, wp, amf);
+        checklaunch("bestforwardlatticej");
+        startindex += batchsizeforward[i];
+    }
+
+    // best paths out of the nodes, in the launch order of the backward pass (a single lattice is walked from its end)
+    startindex = batched ? 0 : edges.size();
+    for (size_t i = 0; i < numlaunchbackward; i++)
+    {
+        if (!batched)
+            startindex -= batchsizebackward[i];
+        dim3 b((unsigned int) ((batchsizebackward[i] + tpb - 1) / tpb));
+        bestbackwardlatticej<<<b, tpb, 0, GetCurrentStream()>>>(batchsizebackward[i], startindex, edgeorderbackward,
+                                                                 edgeacscores, edges, logbestbetas, lmf, wp, amf);
+        checklaunch("bestbackwardlatticej");
+        if (batched)
+            startindex += batchsizebackward[i];
+    }
+
+    dim3 be((unsigned int) ((edges.size() + tpb - 1) / tpb));
+    pruneedgesj<<<be, tpb, 0, GetCurrentStream()>>>(edgelattice, latticenodeoffsets, edgeacscores, edges, nodes.size(),
+                                                     logbestalphas, logbestbetas, lmf, wp, amf, beam);
+    checklaunch("pruneedgesj");
+}
+
 // -----------------------------------------------------------------------
 // sMBRerrorsignal -- accumulate difference of logEframescorrect and logEframescorrecttotal into errorsignal
 // -----------------------------------------------------------------------
@@ -343,6 +618,52 @@ __global__ void sMBRerrorsignalj(const vectorref<unsigned short> alignstateids,
     }
 }
 
+// batched version: logEframescorrecttotal is taken from the lattice of the edge
+__global__ void sMBRerrorsignalbatchj(const vectorref<unsigned short> alignstateids, const vectorref<unsigned int> alignoffsets,
+                                      const vectorref<msra::lattices::edgeinfowithscores> edges, const vectorref<msra::lattices::nodeinfo> nodes,
+                                      vectorref<double> logpps, const float amf, const vectorref<double> logEframescorrect,
+                                      const vectorref<unsigned int> edgelattice, const vectorref<double> logEframescorrecttotals,
+                                      matrixref<float> errorsignal, matrixref<float> errorsignalneg)
+{
+    const size_t shufflemode = 1;
+    const size_t j = msra::lattices::latticefunctionskernels::shuffle(threadIdx.x, blockDim.x, threadIdx.y, blockDim.y, blockIdx.x, gridDim.x, shufflemode);
+    if (j < edges.size()) // note: will cause issues if we ever use __synctreads()
+    {
+        msra::lattices::latticefunctionskernels::sMBRerrorsignalj(j, alignstateids, alignoffsets, edges, nodes, logpps, amf, logEframescorrect, logEframescorrecttotals[edgelattice[j]], errorsignal, errorsignalneg);
+    }
+}
+
+// -----------------------------------------------------------------------
+// uidlogllsum --sum of logLLs(uids[t],t) over all frames t, i.e. the acoustic score of the reference alignment
+// One thread block; each thread sums every blockDim.x-th frame, then the block adds up the partial sums.
+// -----------------------------------------------------------------------
+
+#define UIDLOGLLSUMTHREADS 512
+
+__global__ void uidlogllsumj(const vectorref<unsigned short> uids, const matrixref<float> logLLs, vectorref<double> logllsum)
+{
+    __shared__ double partialsums[UIDLOGLLSUMTHREADS];
+    double partialsum = 0.0;
+    for (size_t t = threadIdx.x; t < uids.size(); t += blockDim.x)
+        partialsum += logLLs(uids[t], t);
+    partialsums[threadIdx.x] = partialsum;
+    __syncthreads();
+    for (unsigned int n = blockDim.x / 2; n > 0; n /= 2)
+    {
+        if (threadIdx.x < n)
+            partialsums[threadIdx.x] += partialsums[threadIdx.x + n];
+        __syncthreads();
+    }
+    if (threadIdx.x == 0)
+        logllsum[0] = partialsums[0];
+}
+
+void latticefunctionsops::uidlogllsum(const vectorref<unsigned short> &uids, const matrixref<float> &logLLs, vectorref<double> &logllsum) const
+{
+    uidlogllsumj<<<1, UIDLOGLLSUMTHREADS, 0, GetCurrentStream()>>>(uids, logLLs, logllsum);
+    checklaunch("uidlogllsum");
+}
+
 // -----------------------------------------------------------------------
 // stateposteriors --accumulate a per-edge quantity into the states that the edge is aligned with
 // -----------------------------------------------------------------------
@@ -433,6 +754,33 @@ void latticefunctionsops::sMBRerrorsignal(const vectorref<unsigned short> &align
 #endif
 }
 
+// batched lattices (see forwardbackwardlatticebatch()); errorsignal spans the frames of all lattices
+// Only the default (non-DIRECT_MODE) computation is supported, since DIRECT_MODE needs a single logEframescorrecttotal.
+void latticefunctionsops::sMBRerrorsignalbatch(const vectorref<unsigned short> &alignstateids, const vectorref<unsigned int> &alignoffsets,
+                                               const vectorref<msra::lattices::edgeinfowithscores> &edges, const vectorref<msra::lattices::nodeinfo> &nodes,
+                                               const vectorref<double> &logpps, const float amf, const vectorref<double> &logEframescorrect,
+                                               const vectorref<unsigned int> &edgelattice, const vectorref<double> &logEframescorrecttotals,
+                                               matrixref<float> &errorsignal, matrixref<float> &errorsignalauxbuf) const
+{
+    const size_t numedges = edges.size();
+    dim3 t(32, 8);
+    const size_t tpb = t.x * t.y;
+    dim3 b((unsigned int) ((numedges + tpb - 1) / tpb));
+
+    setvaluei<<<dim3((((unsigned int) errorsignal.rows()) + 31) / 32), 32, 0, GetCurrentStream()>>>(errorsignal, LOGZERO);
+    checklaunch("setvaluei");
+    setvaluei<<<dim3((((unsigned int) errorsignalauxbuf.rows()) + 31) / 32), 32, 0, GetCurrentStream()>>>(errorsignalauxbuf, LOGZERO);
+    checklaunch("setvaluei");
+    sMBRerrorsignalbatchj<<<b, t, 0, GetCurrentStream()>>>(alignstateids, alignoffsets, edges, nodes, logpps, amf, logEframescorrect, edgelattice, logEframescorrecttotals, errorsignal, errorsignalauxbuf);
+    checklaunch("sMBRerrorsignalbatch");
+
+    setunseeni<<<dim3((((unsigned int) errorsignal.rows()) + 31) / 32), 32, 0, GetCurrentStream()>>>(errorsignal, errorsignalauxbuf);
+    checklaunch("setunseenj");
+
+    errorcomputationi<<<dim3((((unsigned int) errorsignal.rows()) + 31) / 32), 32, 0, GetCurrentStream()>>>(errorsignal, errorsignalauxbuf, amf);
+    checklaunch("errorcomputationj");
+}
+
 void latticefunctionsops::mmierrorsignal(const vectorref<unsigned short> &alignstateids, const vectorref<unsigned int> &alignoffsets,
                                          const vectorref<msra::lattices::edgeinfowithscores> &edges, const vectorref<msra::lattices::nodeinfo> &nodes,
                                          const vectorref<double> &logpps, matrixref<float> &errorsignal) const
@@ -53,15 +53,49 @@ protected:
                                 vectorref<double>& logframescorrectedge, vectorref<double>& logEframescorrect, vectorref<double>& Eframescorrectbuf,
                                 double& logEframescorrecttotal, double& totalfwscore) const;
 
+    void forwardbackwardlatticebatch(const size_t* batchsizeforward, const size_t* batchsizebackward,
+                                     const size_t numlaunchforward, const size_t numlaunchbackward,
+                                     const vectorref<unsigned int>& edgeorderforward, const vectorref<unsigned int>& edgeorderbackward,
+                                     const vectorref<unsigned int>& edgelattice, const vectorref<unsigned int>& latticenodeoffsets,
+                                     const size_t spalignunitid, const size_t silalignunitid,
+                                     const vectorref<float>& edgeacscores, const vectorref<msra::lattices::edgeinfowithscores>& edges,
+                                     const vectorref<msra::lattices::nodeinfo>& nodes,
+                                     const vectorref<msra::lattices::aligninfo>& aligns, const vectorref<unsigned short>& aligments,
+                                     const vectorref<unsigned int>& aligmentoffsets,
+                                     vectorref<double>& logpps, vectorref<double>& logalphas, vectorref<double>& logbetas,
+                                     const float lmf, const float wp, const float amf, const float boostingfactor, const bool returnEframescorrect,
+                                     const vectorref<unsigned short>& uids, const vectorref<unsigned short>& senone2classmap,
+                                     vectorref<double>& logaccalphas, vectorref<double>& logaccbetas,
+                                     vectorref<double>& logframescorrectedge, vectorref<double>& logEframescorrect,
+                                     vectorref<double>& totalfwscores, vectorref<double>& totalbwscores,
+                                     vectorref<double>& totalfwaccs, vectorref<double>& logEframescorrecttotals) const;
+
+    void prunelattice(const size_t* batchsizeforward, const size_t* batchsizebackward,
+                      const size_t numlaunchforward, const size_t numlaunchbackward,
+                      const vectorref<unsigned int>& edgeorderforward, const vectorref<unsigned int>& edgeorderbackward,
+                      const vectorref<unsigned int>& edgelattice, const vectorref<unsigned int>& latticenodeoffsets,
+                      vectorref<float>& edgeacscores, const vectorref<msra::lattices::edgeinfowithscores>& edges,
+                      const vectorref<msra::lattices::nodeinfo>& nodes,
+                      vectorref<double>& logbestalphas, vectorref<double>& logbestbetas,
+                      const float lmf, const float wp, const float amf, const float beam) const;
+
     void sMBRerrorsignal(const vectorref<unsigned short>& alignstateids, const vectorref<unsigned int>& alignoffsets,
                          const vectorref<msra::lattices::edgeinfowithscores>& edges, const vectorref<msra::lattices::nodeinfo>& nodes,
                          const vectorref<double>& logpps, const float amf, const vectorref<double>& logEframescorrect, const double logEframescorrecttotal,
                          matrixref<float>& errorsignal, matrixref<float>& errorsignalneg) const;
 
+    void sMBRerrorsignalbatch(const vectorref<unsigned short>& alignstateids, const vectorref<unsigned int>& alignoffsets,
+                              const vectorref<msra::lattices::edgeinfowithscores>& edges, const vectorref<msra::lattices::nodeinfo>& nodes,
+                              const vectorref<double>& logpps, const float amf, const vectorref<double>& logEframescorrect,
+                              const vectorref<unsigned int>& edgelattice, const vectorref<double>& logEframescorrecttotals,
+                              matrixref<float>& errorsignal, matrixref<float>& errorsignalneg) const;
+
     void mmierrorsignal(const vectorref<unsigned short>& alignstateids, const vectorref<unsigned int>& alignoffsets,
                         const vectorref<msra::lattices::edgeinfowithscores>& edges, const vectorref<msra::lattices::nodeinfo>& nodes,
                         const vectorref<double>& logpps, matrixref<float>& errorsignal) const;
 
+    void uidlogllsum(const vectorref<unsigned short>& uids, const matrixref<float>& logLLs, vectorref<double>& logllsum) const;
+
     void stateposteriors(const vectorref<unsigned short>& alignstateids, const vectorref<unsigned int>& alignoffsets,
                          const vectorref<msra::lattices::edgeinfowithscores>& edges, const vectorref<msra::lattices::nodeinfo>& nodes,
                          const vectorref<double>& logqs, matrixref<float>& logacc) const;
@@ -324,6 +324,23 @@ struct latticefunctionskernels
     }
 #endif
 
+    // same pattern as atomicLogAdd(), but keeping the larger value (Viterbi instead of sum)
+    template <typename FLOAT>
+    static __device__ FLOAT atomicLogMax(FLOAT *address, FLOAT val)
+    {
+        typedef decltype(floatasbits(val)) bitstype;
+        bitstype *address_as_ull = (bitstype *) address;
+        bitstype old = *address_as_ull, assumed;
+        do
+        {
+            assumed = old;
+            if (bitsasfloat(assumed) >= val)
+                break;
+            old = atomicCAS(address_as_ull, assumed, floatasbits(val));
+        } while (assumed != old);
+        return bitsasfloat(old);
+    }
+
     // [v-hansu] shuffling accessing order for a item in cubic(Ni, Nj, Nk) with index i, j, k according to shufflemode
     static inline __device__ size_t shuffle(size_t i, size_t Ni, size_t j, size_t Nj, size_t k, size_t Nk, size_t shufflemode)
     {
@@ -652,8 +669,57 @@ struct latticefunctionskernels
             return senone2classmap[statea] == senone2classmap[stateb];
     }
 
+    // Beam pruning, before the forward-backward:
+    // bestforwardlatticej() and bestbackwardlatticej() are the Viterbi versions of the forward and backward passes (same launch
+    // order), giving the score of the best path into and out of each node; pruneedgej() then sets the AC score of every edge whose
+    // best path through it is more than 'beam' below the best path of its lattice to LOGZERO, which the passes below skip.
+    // The scores do not include the boosting term of boosted MMI, i.e. the beam is relative to the unboosted best path.
+    template <typename edgeinforvector>
+    static inline __device__ double edgepathscore(const edgeinforvector &edges, const size_t j, const float acscore, float lmf, float wp, float amf)
+    {
+        const edgeinfowithscores &e = edges[j];
+        if (e.l < -200.0f) // (as in forwardlatticej())
+            return (wp + acscore) / amf;
+        return (e.l * lmf + wp + acscore) / amf;
+    }
+
+    template <typename edgeinforvector, typename floatvector, typename doublevector>
+    static inline __device__ void bestforwardlatticej(const size_t j, const floatvector &edgeacscores, const edgeinforvector &edges,
+                                                      doublevector &logbestalphas, float lmf, float wp, float amf)
+    {
+        const edgeinfowithscores &e = edges[j];
+        if (edgeacscores[j] <= LOGZERO / 2 || logbestalphas[e.S] <= LOGZERO / 2) // pruned already, or start node not reached
+            return;
+        atomicLogMax(&logbestalphas[e.E], logbestalphas[e.S] + edgepathscore(edges, j, edgeacscores[j], lmf, wp, amf));
+    }
+
+    template <typename edgeinforvector, typename floatvector, typename doublevector>
+    static inline __device__ void bestbackwardlatticej(const size_t j, const floatvector &edgeacscores, const edgeinforvector &edges,
+                                                       doublevector &logbestbetas, float lmf, float wp, float amf)
+    {
+        const edgeinfowithscores &e = edges[j];
+        if (edgeacscores[j] <= LOGZERO / 2 || logbestbetas[e.E] <= LOGZERO / 2)
+            return;
+        atomicLogMax(&logbestbetas[e.S], logbestbetas[e.E] + edgepathscore(edges, j, edgeacscores[j], lmf, wp, amf));
+    }
+
+    // lastnode = end node of the lattice of edge j, whose best alpha is the score of the best path
+    template <typename edgeinforvector, typename floatvector, typename doublevector>
+    static inline __device__ void pruneedgej(const size_t j, floatvector &edgeacscores, const edgeinforvector &edges,
+                                             const doublevector &logbestalphas, const doublevector &logbestbetas,
+                                             const size_t lastnode, float lmf, float wp, float amf, const float beam)
+    {
+        const edgeinfowithscores &e = edges[j];
+        if (edgeacscores[j] <= LOGZERO / 2)
+            return;
+        const double bestpathscore = logbestalphas[e.S] + edgepathscore(edges, j, edgeacscores[j], lmf, wp, amf) + logbestbetas[e.E];
+        if (bestpathscore < logbestalphas[lastnode] - beam) // (includes edges not on any complete path)
+            edgeacscores[j] = LOGZERO;
+    }
+
     // Phase 1 of forwardbackward algorithm
     // returnEframescorrect means sMBR mode
+    // firstnode and lastnode are the start and end node of the lattice of edge j (0 and nodes.size()-1, unless several lattices are batched into one node array)
     template <typename edgeinforvector, typename nodeinfovector, typename aligninfovector, typename ushortvector, typename uintvector, typename floatvector, typename doublevector>
     static inline __device__ void forwardlatticej(const size_t j, const floatvector &edgeacscores,
                                                   const size_t /*spalignunitid --unused*/, const size_t silalignunitid,
@@ -661,15 +727,23 @@ struct latticefunctionskernels
                                                   const ushortvector &alignments, const uintvector &alignmentoffsets,
                                                   doublevector &logalphas, float lmf, float wp, float amf, const float boostingfactor,
                                                   const ushortvector &uids, const ushortvector senone2classmap, const bool returnEframescorrect,
-                                                  doublevector &logframescorrectedge, doublevector &logaccalphas)
+                                                  doublevector &logframescorrectedge, doublevector &logaccalphas,
+                                                  const size_t firstnode, const size_t lastnode)
     {
+        const bool boostmmi = (boostingfactor != 0.0f);
+        if (edgeacscores[j] <= LOGZERO / 2) // pruned edge: on no path (adding it would mark an unreached end node as seen)
+        {
+            if (returnEframescorrect || boostmmi)
+                logframescorrectedge[j] = LOGZERO;
+            return;
+        }
+
         // edge info
         const edgeinfowithscores &e = edges[j];
-        double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf; // note: edgeacscores[j] == LOGZERO if edge was pruned
+        double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf;
         // zhaorui to deal with the abnormal score for sent start.
         if (e.l < -200.0f)
             edgescore = (0.0 * lmf + wp + edgeacscores[j]) / amf;
-        const bool boostmmi = (boostingfactor != 0.0f);
         // compute the frames-correct count for this edge
         double logframescorrectedgej = LOGZERO;
         const size_t numsenones = 9304; // WARNING: this is a hack, please fix this once smbr or bmmi is working! [v-hansu]
@@ -732,7 +806,7 @@ struct latticefunctionskernels
 
 #ifdef FORBID_INVALID_SIL_PATHS
         // silence edge or second speech edge
-        if ((isaddedsil && e.E != nodes.size() - 1) || (forbidinvalidsilpath && e.S != 0))
+        if ((isaddedsil && e.E != lastnode) || (forbidinvalidsilpath && e.S != firstnode))
         {
             const size_t S = (size_t)(!isaddedsil ? e.S + nodes.size() : e.S); // second speech edge comes from special 'silence state' node
             const size_t E = (size_t)(isaddedsil ? e.E + nodes.size() : e.E);  // silence edge goes into special 'silence state' node
@@ -760,13 +834,22 @@ struct latticefunctionskernels
                                                    doublevector &logalphas, doublevector &logbetas, float lmf, float wp,
                                                    float amf, const float boostingfactor, const bool returnEframescorrect,
                                                    doublevector &logframescorrectedge, doublevector &logaccalphas,
-                                                   doublevector &logEframescorrect, doublevector &logaccbetas)
+                                                   doublevector &logEframescorrect, doublevector &logaccbetas,
+                                                   const size_t firstnode, const size_t lastnode)
     {
         // output values
         double logpp = LOGZERO;
         double logEframescorrectj = LOGZERO;
         const bool boostmmi = (boostingfactor != 0.0f);
 
+        if (edgeacscores[j] <= LOGZERO / 2) // pruned edge: posterior 0
+        {
+            logpps[j] = LOGZERO;
+            if (returnEframescorrect)
+                logEframescorrect[j] = LOGZERO;
+            return;
+        }
+
         // edge info
         const edgeinfowithscores &e = edges[j];
         double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf;
@@ -837,7 +920,7 @@ struct latticefunctionskernels
         double logEframescorrectj2 = LOGZERO;
 
         // silence edge or second speech edge
-        if ((isaddedsil && e.E != nodes.size() - 1) || (forbidinvalidsilpath && e.S != 0))
+        if ((isaddedsil && e.E != lastnode) || (forbidinvalidsilpath && e.S != firstnode))
         {
             const size_t S = (size_t)(!isaddedsil ? e.S + nodes.size() : e.S); // second speech edge comes from special 'silence state' node
             const size_t E = (size_t)(isaddedsil ? e.E + nodes.size() : e.E);  // silence edge goes into special 'silence state' node
@@ -882,6 +965,8 @@ struct latticefunctionskernels
         }
 #else
         nodes;
+        firstnode;
+        lastnode;
 #endif
 
         // write back return values
@@ -899,6 +984,8 @@ struct latticefunctionskernels
                                                    const doublevector &logEframescorrect, const double logEframescorrecttotal,
                                                    matrix &errorsignal, matrix &errorsignalneg)
     {
+        if (logpps[j] <= LOGZERO / 2) // pruned edge
+            return;
         size_t ts = nodes[edges[j].S].t;
         size_t te = nodes[edges[j].E].t;
         if (ts != te)
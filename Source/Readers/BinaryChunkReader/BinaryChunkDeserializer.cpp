@@ -0,0 +1,283 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "BinaryChunkDeserializer.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Read-only memory mapping of the container.
+class BinaryChunkDeserializer::MappedFile
+{
+public:
+    explicit MappedFile(const std::wstring& path) : m_data(nullptr), m_size(0)
+    {
+#ifdef _WIN32
+        m_fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        if (m_fileHandle == INVALID_HANDLE_VALUE)
+            RuntimeError("Cannot open file '%ls'", path.c_str());
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_fileHandle, &size) || size.QuadPart == 0)
+            RuntimeError("Cannot get the size of file '%ls' or file is empty", path.c_str());
+        m_mappingHandle = CreateFileMapping(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mappingHandle == NULL)
+            RuntimeError("Cannot map file '%ls'", path.c_str());
+        m_data = reinterpret_cast<const char*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (m_data == nullptr)
+            RuntimeError("Cannot map file '%ls'", path.c_str());
+        m_size = (size_t) size.QuadPart;
+#else
+        std::string narrowPath = msra::strfun::utf8(path);
+        m_fileDescriptor = open(narrowPath.c_str(), O_RDONLY);
+        if (m_fileDescriptor == -1)
+            RuntimeError("Cannot open file '%ls'", path.c_str());
+        struct stat sb;
+        if (fstat(m_fileDescriptor, &sb) == -1 || sb.st_size == 0)
+            RuntimeError("Cannot get the size of file '%ls' or file is empty", path.c_str());
+        void* data = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, m_fileDescriptor, 0);
+        if (data == MAP_FAILED)
+            RuntimeError("Cannot map file '%ls'", path.c_str());
+        m_data = reinterpret_cast<const char*>(data);
+        m_size = sb.st_size;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+            UnmapViewOfFile(m_data);
+        if (m_mappingHandle != NULL)
+            CloseHandle(m_mappingHandle);
+        if (m_fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(m_fileHandle);
+#else
+        if (m_data != nullptr)
+            munmap(const_cast<char*>(m_data), m_size);
+        if (m_fileDescriptor != -1)
+            close(m_fileDescriptor);
+#endif
+    }
+
+    // pointer to 'size' bytes at 'offset', with a bounds check
+    const char* At(uint64_t offset, uint64_t size) const
+    {
+        if (offset > m_size || size > m_size - offset)
+            RuntimeError("Unexpected end of the binary chunk file (offset %lu, size %lu), the file is corrupt.", (unsigned long) offset, (unsigned long) size);
+        return m_data + offset;
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE m_mappingHandle = NULL;
+#else
+    int m_fileDescriptor = -1;
+#endif
+};
+
+// A chunk of the container. Sequences point straight into the mapped payload.
+class BinaryChunkDeserializer::BinaryChunk : public Chunk, public std::enable_shared_from_this<BinaryChunk>
+{
+    const BinaryChunkDeserializer& m_parent;
+    MappedFilePtr m_file; // keeps the mapping alive as long as any sequence of the chunk is in use
+    size_t m_chunkId;
+
+public:
+    BinaryChunk(const BinaryChunkDeserializer& parent, size_t chunkId)
+        : m_parent(parent), m_file(parent.m_file), m_chunkId(chunkId)
+    {
+    }
+
+    std::vector<SequenceDataPtr> GetSequence(const size_t& sequenceId) override
+    {
+        assert(m_parent.m_sequenceDescriptions[sequenceId].m_chunkId == m_chunkId);
+        const auto& location = m_parent.m_sequenceLocations[sequenceId];
+        const auto& chunk = *m_parent.m_chunks[m_chunkId];
+        const char* payload = m_file->At(chunk.m_offset, chunk.m_size);
+        const uint64_t storedSamples = location.m_record[0];
+
+        std::vector<SequenceDataPtr> result;
+        result.reserve(m_parent.m_streams.size());
+        for (size_t streamId = 0; streamId < m_parent.m_streams.size(); ++streamId)
+        {
+            const auto& stream = m_parent.m_streams[streamId];
+            const size_t elementSize = m_parent.m_elementSizes[streamId];
+            const char* data = payload + location.m_record[1 + streamId];
+            if (stream->m_storageType == StorageType::dense)
+            {
+                auto sequence = std::make_shared<DenseSequenceData>();
+                const size_t sampleSize = stream->m_sampleLayout->GetNumElements() * elementSize;
+                sequence->m_data = const_cast<char*>(data + location.m_firstSample * sampleSize);
+                sequence->m_numberOfSamples = location.m_numberOfSamples;
+                sequence->m_sampleLayout = stream->m_sampleLayout;
+                sequence->m_chunk = shared_from_this();
+                result.push_back(sequence);
+            }
+            else
+            {
+                const uint32_t* columnStarts = reinterpret_cast<const uint32_t*>(data);
+                const uint32_t* rowIndices = columnStarts + storedSamples + 1;
+                const size_t numberOfNonZeros = columnStarts[storedSamples];
+                const char* values = data + BinaryChunkAlign(sizeof(uint32_t) * (storedSamples + 1 + numberOfNonZeros));
+
+                auto sequence = std::make_shared<SparseSequenceData>();
+                sequence->m_indices.resize(location.m_numberOfSamples);
+                for (size_t i = 0; i < location.m_numberOfSamples; ++i)
+                {
+                    size_t sample = location.m_firstSample + i;
+                    sequence->m_indices[i].assign(rowIndices + columnStarts[sample], rowIndices + columnStarts[sample + 1]);
+                }
+                sequence->m_data = const_cast<char*>(values + columnStarts[location.m_firstSample] * elementSize);
+                sequence->m_chunk = shared_from_this();
+                result.push_back(sequence);
+            }
+        }
+        return result;
+    }
+};
+
+BinaryChunkDeserializer::BinaryChunkDeserializer(const ConfigParameters& config)
+{
+    std::wstring path = config(L"file");
+    bool frameMode = config(L"frameMode", true);
+
+    m_file = std::make_shared<MappedFile>(path);
+    const auto& header = *reinterpret_cast<const BinaryChunkFileHeader*>(m_file->At(0, sizeof(BinaryChunkFileHeader)));
+    if (header.m_magic != BinaryChunkFileMagic)
+        RuntimeError("'%ls' is not a binary chunk file.", path.c_str());
+    if (header.m_version != BinaryChunkFileVersion)
+        RuntimeError("Unsupported version %d of binary chunk file '%ls', expected %d.", (int) header.m_version, path.c_str(), (int) BinaryChunkFileVersion);
+
+    size_t offset = sizeof(BinaryChunkFileHeader);
+    ReadStreamHeaders(header, offset);
+
+    // the element type is fixed at conversion time and has to match the precision of the network
+    std::string precision = config.Find("precision", "float");
+    ElementType expectedElementType;
+    if (AreEqualIgnoreCase(precision, "float"))
+        expectedElementType = ElementType::tfloat;
+    else if (AreEqualIgnoreCase(precision, "double"))
+        expectedElementType = ElementType::tdouble;
+    else
+        RuntimeError("Not supported precision '%s'. Expected 'double' or 'float'.", precision.c_str());
+    for (const auto& stream : m_streams)
+    {
+        if (stream->m_elementType != expectedElementType)
+            RuntimeError("Stream '%ls' of '%ls' was converted with a different precision than '%s'; please convert the data again.",
+                         stream->m_name.c_str(), path.c_str(), precision.c_str());
+    }
+
+    CreateSequenceDescriptions(header, frameMode);
+}
+
+void BinaryChunkDeserializer::ReadStreamHeaders(const BinaryChunkFileHeader& header, size_t& offset)
+{
+    for (size_t i = 0; i < header.m_numberOfStreams; ++i)
+    {
+        const auto& streamHeader = *reinterpret_cast<const BinaryChunkStreamHeader*>(m_file->At(offset, sizeof(BinaryChunkStreamHeader)));
+        offset += sizeof(BinaryChunkStreamHeader);
+        std::string name(m_file->At(offset, streamHeader.m_nameLength), streamHeader.m_nameLength);
+        offset += BinaryChunkAlign(streamHeader.m_nameLength);
+
+        auto stream = std::make_shared<StreamDescription>();
+        stream->m_id = i;
+        stream->m_name = msra::strfun::utf16(name);
+        stream->m_sampleLayout = std::make_shared<TensorShape>((size_t) streamHeader.m_sampleDimension);
+        switch (streamHeader.m_storageType)
+        {
+        case BinaryChunkStorageType::dense:      stream->m_storageType = StorageType::dense; break;
+        case BinaryChunkStorageType::sparse_csc: stream->m_storageType = StorageType::sparse_csc; break;
+        default: RuntimeError("Unsupported storage type %d of stream '%s'.", (int) streamHeader.m_storageType, name.c_str());
+        }
+        switch (streamHeader.m_elementType)
+        {
+        case BinaryChunkElementType::tfloat:  stream->m_elementType = ElementType::tfloat; break;
+        case BinaryChunkElementType::tdouble: stream->m_elementType = ElementType::tdouble; break;
+        default: RuntimeError("Unsupported element type %d of stream '%s'.", (int) streamHeader.m_elementType, name.c_str());
+        }
+        m_streams.push_back(stream);
+        m_elementSizes.push_back(GetSizeByType(stream->m_elementType));
+    }
+}
+
+// Walks the chunk table and the sequence records of all chunks. Only these pages of the file are touched here.
+void BinaryChunkDeserializer::CreateSequenceDescriptions(const BinaryChunkFileHeader& header, bool frameMode)
+{
+    const size_t recordSize = BinaryChunkSequenceRecordSize(m_streams.size());
+    const auto* chunkTable = reinterpret_cast<const BinaryChunkDescriptor*>(
+        m_file->At(header.m_chunkTableOffset, header.m_numberOfChunks * sizeof(BinaryChunkDescriptor)));
+
+    size_t numberOfExposedSequences = frameMode ? header.m_numberOfSamples : header.m_numberOfSequences;
+    m_sequenceDescriptions.reserve(numberOfExposedSequences);
+    m_sequenceLocations.reserve(numberOfExposedSequences);
+    for (size_t chunkId = 0; chunkId < header.m_numberOfChunks; ++chunkId)
+    {
+        const auto& chunk = chunkTable[chunkId];
+        m_chunks.push_back(&chunk);
+        const char* records = m_file->At(chunk.m_offset, chunk.m_numberOfSequences * recordSize);
+        m_file->At(chunk.m_offset, chunk.m_size); // validates the extent of the payload once, GetSequence() relies on it
+        for (size_t i = 0; i < chunk.m_numberOfSequences; ++i)
+        {
+            const auto* record = reinterpret_cast<const uint64_t*>(records + i * recordSize);
+            const size_t numberOfSamples = record[0];
+            for (size_t streamId = 0; streamId < m_streams.size(); ++streamId)
+            {
+                if (record[1 + streamId] >= chunk.m_size)
+                    RuntimeError("Sequence %d of chunk %d points outside of the chunk, the file is corrupt.", (int) i, (int) chunkId);
+            }
+
+            size_t step = frameMode ? 1 : numberOfSamples;
+            for (size_t firstSample = 0; firstSample < numberOfSamples; firstSample += step)
+            {
+                SequenceDescription description;
+                description.m_id = m_sequenceDescriptions.size();
+                description.m_numberOfSamples = step;
+                description.m_chunkId = chunkId;
+                description.m_isValid = true;
+                m_sequenceDescriptions.push_back(description);
+                m_sequenceLocations.push_back(SequenceLocation{ record, firstSample, step });
+            }
+        }
+    }
+}
+
+std::vector<StreamDescriptionPtr> BinaryChunkDeserializer::GetStreamDescriptions() const
+{
+    return m_streams;
+}
+
+void BinaryChunkDeserializer::FillSequenceDescriptions(SequenceDescriptions& timeline) const
+{
+    timeline.resize(m_sequenceDescriptions.size());
+    std::transform(
+        m_sequenceDescriptions.begin(),
+        m_sequenceDescriptions.end(),
+        timeline.begin(),
+        [](const SequenceDescription& desc)
+        {
+            return &desc;
+        });
+}
+
+ChunkPtr BinaryChunkDeserializer::GetChunk(size_t chunkId)
+{
+    if (chunkId >= m_chunks.size())
+        LogicError("Invalid chunk id %d, the file has %d chunks.", (int) chunkId, (int) m_chunks.size());
+    return std::make_shared<BinaryChunk>(*this, chunkId);
+}
+
+} } }
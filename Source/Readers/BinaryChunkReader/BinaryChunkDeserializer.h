@@ -0,0 +1,57 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "BinaryChunkFormat.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer for the binary chunked container (see BinaryChunkFormat.h).
+// The container is mapped into memory, and the sequences handed out by its chunks point directly into the mapping,
+// so no parsing or copying happens on the reading side. The streams (names, storage and element types, dimensions)
+// are taken from the container itself.
+// In frame mode (the default, as required by the SampleModePacker) every sample of a stored sequence is exposed as a sequence of its own.
+// Otherwise the stored sequences are exposed as they are, for the SequencePacker.
+class BinaryChunkDeserializer : public DataDeserializerBase
+{
+public:
+    explicit BinaryChunkDeserializer(const ConfigParameters& config);
+
+    // Description of streams that this data deserializer provides.
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override;
+
+    // Gets a chunk. The chunk keeps the mapping alive.
+    ChunkPtr GetChunk(size_t chunkId) override;
+
+protected:
+    void FillSequenceDescriptions(SequenceDescriptions& timeline) const override;
+
+private:
+    class MappedFile;
+    typedef std::shared_ptr<MappedFile> MappedFilePtr;
+    class BinaryChunk;
+
+    void ReadStreamHeaders(const BinaryChunkFileHeader& header, size_t& offset);
+    void CreateSequenceDescriptions(const BinaryChunkFileHeader& header, bool frameMode);
+
+    // Where the data of an exposed sequence lives.
+    struct SequenceLocation
+    {
+        const uint64_t* m_record; // sequence record at the start of the chunk payload
+        size_t m_firstSample;     // first sample of the stored sequence that belongs to this one
+        size_t m_numberOfSamples;
+    };
+
+    MappedFilePtr m_file;
+    std::vector<const BinaryChunkDescriptor*> m_chunks;
+    std::vector<SequenceDescription> m_sequenceDescriptions;
+    std::vector<SequenceLocation> m_sequenceLocations; // [sequence id]
+    std::vector<size_t> m_elementSizes;                // [stream id]
+};
+
+} } }
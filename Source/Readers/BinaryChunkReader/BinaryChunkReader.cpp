@@ -0,0 +1,119 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "BinaryChunkReader.h"
+#include "BinaryChunkDeserializer.h"
+#include "BlockRandomizer.h"
+#include "NoRandomizer.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+BinaryChunkReader::BinaryChunkReader(MemoryProviderPtr provider,
+                                     const ConfigParameters& config)
+    : m_provider(provider), m_numberOfBuffers(1)
+{
+    auto deserializer = std::make_shared<BinaryChunkDeserializer>(config);
+
+    m_frameMode = config(L"frameMode", true);
+    m_truncationLength = config(L"truncationLength", (size_t) 0);
+    m_numParallelSequences = config(L"numParallelSequences", (size_t) 0);
+    m_bucketingWindow = config(L"bucketingWindow", (size_t) 8);
+
+    // The sample mode packer can deliver sparse streams as they are; the sequence packer unpacks them to dense.
+    bool densify = !m_frameMode || config(L"densify", true);
+    for (const auto& stream : deserializer->GetStreamDescriptions())
+    {
+        auto output = std::make_shared<StreamDescription>(*stream);
+        if (densify)
+        {
+            output->m_storageType = StorageType::dense;
+        }
+        m_streams.push_back(output);
+    }
+
+    std::string randomize = config(L"randomize", "auto");
+    TransformerPtr randomizer;
+    if (AreEqualIgnoreCase(randomize, "auto"))
+    {
+        size_t randomizationWindow = config(L"randomizationWindow", (size_t) SIZE_MAX);
+        randomizer = std::make_shared<BlockRandomizer>(0, randomizationWindow, deserializer);
+    }
+    else if (AreEqualIgnoreCase(randomize, "none"))
+    {
+        randomizer = std::make_shared<NoRandomizer>(deserializer);
+    }
+    else
+    {
+        RuntimeError("'randomize' parameter must be set to 'auto' or 'none'");
+    }
+
+    randomizer->Initialize(nullptr, config);
+    m_transformer = randomizer;
+}
+
+std::vector<StreamDescriptionPtr> BinaryChunkReader::GetStreamDescriptions()
+{
+    assert(!m_streams.empty());
+    return m_streams;
+}
+
+void BinaryChunkReader::StartEpoch(const EpochConfiguration& config)
+{
+    if (config.m_totalEpochSizeInSamples <= 0)
+    {
+        RuntimeError("Unsupported minibatch size '%u'.", (int)config.m_totalEpochSizeInSamples);
+    }
+
+    m_transformer->StartEpoch(config);
+    if (m_frameMode)
+    {
+        m_packer = std::make_shared<SampleModePacker>(
+            m_provider,
+            m_transformer,
+            config.m_minibatchSizeInSamples,
+            m_streams,
+            m_numberOfBuffers);
+    }
+    else
+    {
+        m_sequencePacker = std::make_shared<SequencePacker>(
+            m_provider,
+            m_transformer,
+            config.m_minibatchSizeInSamples,
+            m_streams,
+            m_truncationLength,
+            m_numParallelSequences,
+            m_bucketingWindow,
+            m_numberOfBuffers);
+    }
+}
+
+bool BinaryChunkReader::SetMemoryProvider(MemoryProviderPtr provider, size_t numberOfBuffers)
+{
+    m_provider = provider;
+    m_numberOfBuffers = numberOfBuffers;
+    if (m_packer != nullptr)
+    {
+        m_packer->SetMemoryProvider(provider, numberOfBuffers);
+    }
+    if (m_sequencePacker != nullptr)
+    {
+        m_sequencePacker->SetMemoryProvider(provider, numberOfBuffers);
+    }
+    return true;
+}
+
+Minibatch BinaryChunkReader::ReadMinibatch()
+{
+    if (m_sequencePacker != nullptr)
+    {
+        return m_sequencePacker->ReadMinibatch();
+    }
+    assert(m_packer != nullptr);
+    return m_packer->ReadMinibatch();
+}
+} } }
@@ -0,0 +1,66 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "Reader.h"
+#include "SampleModePacker.h"
+#include "SequencePacker.h"
+#include "Config.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Reader for the binary chunked container written by the "convertToBinaryChunks" action.
+// Connects the BinaryChunkDeserializer, a randomizer and the packer together.
+class BinaryChunkReader : public Reader
+{
+public:
+    BinaryChunkReader(MemoryProviderPtr provider,
+                      const ConfigParameters& parameters);
+
+    // Description of streams that this reader provides.
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() override;
+
+    // Starts a new epoch with the provided configuration.
+    void StartEpoch(const EpochConfiguration& config) override;
+
+    // Reads a single minibatch.
+    Minibatch ReadMinibatch() override;
+
+    // Lets the packer allocate its buffers from the provider, keeping numberOfBuffers minibatches.
+    bool SetMemoryProvider(MemoryProviderPtr provider, size_t numberOfBuffers) override;
+
+    // The counters of the transformers, the randomizer and the deserializer.
+    void GetStatistics(std::map<std::string, double>& stats) const override
+    {
+        m_transformer->GetStatistics(stats);
+    }
+
+private:
+    // All streams this reader provides. Sparse streams of the container are unpacked to dense by the packer,
+    // unless 'densify' is false in frame mode, in which case they are delivered sparse (for sparse inputs).
+    std::vector<StreamDescriptionPtr> m_streams;
+
+    // A head transformer in a list of transformers.
+    TransformerPtr m_transformer;
+
+    // Packer, for frame mode or (if frameMode=false) for whole sequences.
+    SampleModePackerPtr m_packer;
+    SequencePackerPtr m_sequencePacker;
+
+    // Sequence packer configuration, see SequencePacker.
+    bool m_frameMode;
+    size_t m_truncationLength;
+    size_t m_numParallelSequences;
+    size_t m_bucketingWindow;
+
+    // Memory provider (TODO: this will possibly change in the near future.)
+    MemoryProviderPtr m_provider;
+
+    // Number of minibatches whose data the packer keeps valid, see Reader::SetMemoryProvider().
+    size_t m_numberOfBuffers;
+};
+
+}}}
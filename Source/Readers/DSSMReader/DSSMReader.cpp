@@ -13,6 +13,7 @@
 #include <vld.h> // leak detection
 #endif
 #include "fileutil.h" // for fexists()
+#include "CUDAPageLockedMemAllocator.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -173,6 +174,7 @@ void DSSMReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig)
     m_labelType = labelCategory;
     m_readNextSample = 0;
     m_traceLevel = readerConfig(L"traceLevel", 0);
+    m_prefetch = readerConfig(L"prefetch", true);
 
     if (readerConfig.Exists(L"randomize"))
     {
@@ -234,6 +236,9 @@ void DSSMReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig)
 template <class ElemType>
 DSSMReader<ElemType>::~DSSMReader()
 {
+    // the prefetch thread uses the inputs
+    if (m_pendingPrefetch.valid())
+        m_pendingPrefetch.wait();
     ReleaseMemory();
 }
 
@@ -293,8 +298,7 @@ void DSSMReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_
     m_epochStartSample = m_mbStartSample = mbStartSample;
     m_mbSize = mbSize;
     m_epochSize = requestedEpochSamples;
-    dssm_queryInput.SetupEpoch(mbSize);
-    dssm_docInput.SetupEpoch(mbSize);
+    WaitForPrefetch(0, 0); // a pending prefetch is for the previous loop
     if (m_epochSize > (size_t) dssm_queryInput.numRows)
     {
         m_epochSize = (size_t) dssm_queryInput.numRows;
@@ -343,12 +347,33 @@ bool DSSMReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*
     featuresD.Resize(dssm_docInput.numRows, actualMBSize);
     */
 
-    // fprintf(stderr, "featuresQ\n");
-    dssm_queryInput.Next_Batch(featuresQ, m_readNextSample, actualMBSize, read_order);
-    // fprintf(stderr, "\n\n\nfeaturesD\n");
-    dssm_docInput.Next_Batch(featuresD, m_readNextSample, actualMBSize, read_order);
-    // fprintf(stderr, "\n\n\n\n\n");
+    // the features are normally gathered already, by the prefetch started in the previous call
+    size_t slot = m_stagingSlot;
+    if (!WaitForPrefetch(m_readNextSample, actualMBSize))
+    {
+        dssm_queryInput.GatherBatch(slot, m_readNextSample, actualMBSize, featuresQ.GetDeviceId());
+        dssm_docInput.GatherBatch(slot, m_readNextSample, actualMBSize, featuresD.GetDeviceId());
+    }
     m_readNextSample += actualMBSize;
+
+    // start gathering the next minibatch into the other staging buffer before transferring this one
+    if (m_prefetch && m_readNextSample < m_totalSamples)
+    {
+        size_t nextSlot = 1 - slot;
+        m_prefetchStart = m_readNextSample;
+        m_prefetchSize = min(m_mbSize, m_totalSamples - m_readNextSample);
+        int deviceIdQ = featuresQ.GetDeviceId();
+        int deviceIdD = featuresD.GetDeviceId();
+        m_pendingPrefetch = std::async(std::launch::async, [this, nextSlot, deviceIdQ, deviceIdD]()
+                                       {
+                                           dssm_queryInput.GatherBatch(nextSlot, m_prefetchStart, m_prefetchSize, deviceIdQ);
+                                           dssm_docInput.GatherBatch(nextSlot, m_prefetchStart, m_prefetchSize, deviceIdD);
+                                       });
+        m_stagingSlot = nextSlot;
+    }
+
+    dssm_queryInput.FillMatrix(slot, featuresQ);
+    dssm_docInput.FillMatrix(slot, featuresD);
     /*
                 featuresQ.Print("featuresQ");
                 fprintf(stderr, "\n");
@@ -415,6 +440,17 @@ bool DSSMReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*
     return true;
 }
 
+// WaitForPrefetch - wait for a pending prefetch to complete
+// returns - true if it has gathered the records [start, start + size) into the staging buffers m_stagingSlot
+template <class ElemType>
+bool DSSMReader<ElemType>::WaitForPrefetch(size_t start, size_t size)
+{
+    if (!m_pendingPrefetch.valid())
+        return false;
+    m_pendingPrefetch.get(); // rethrows an exception of the prefetch thread
+    return m_prefetchStart == start && m_prefetchSize == size;
+}
+
 // GetLabelMapping - Gets the label mapping from integer index to label type
 // returns - a map from numeric datatype to native label type
 template <class ElemType>
@@ -450,6 +486,8 @@ bool DSSMReader<ElemType>::DataEnd() { return true; }
 
 template <class ElemType>
 DSSM_BinaryInput<ElemType>::DSSM_BinaryInput()
+    : m_hndl(INVALID_HANDLE_VALUE), m_filemap(NULL), offsets_orig(NULL), data_orig(NULL), header_buffer(NULL), offsets_buffer(NULL), data_buffer(NULL),
+      m_dim(0), offsets(NULL), numRows(0), numCols(0), totalNNz(0)
 {
 }
 template <class ElemType>
@@ -462,7 +500,6 @@ void DSSM_BinaryInput<ElemType>::Init(wstring fileName, size_t dim)
 {
 
     m_dim = dim;
-    mbSize = 0;
     /*
     m_hndl = CreateFileA(fileName.c_str(), GENERIC_READ,
         FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -502,7 +539,7 @@ void DSSM_BinaryInput<ElemType>::Init(wstring fileName, size_t dim)
 
     int64_t header_size = numRows * sizeof(int64_t) + offsets_padding;
 
-    void* offsets_orig = MapViewOfFile(m_filemap,     // handle to map object
+    offsets_orig = MapViewOfFile(m_filemap,     // handle to map object
                                        FILE_MAP_READ, // get correct permissions
                                        HIDWORD(base_offset),
                                        LODWORD(base_offset),
@@ -522,7 +559,7 @@ void DSSM_BinaryInput<ElemType>::Init(wstring fileName, size_t dim)
     int64_t data_padding = header_offset % sysGran;
     header_offset -= data_padding;
 
-    void* data_orig = MapViewOfFile(m_filemap,     // handle to map object
+    data_orig = MapViewOfFile(m_filemap,     // handle to map object
                                     FILE_MAP_READ, // get correct permissions
                                     HIDWORD(header_offset),
                                     LODWORD(header_offset),
@@ -530,99 +567,74 @@ void DSSM_BinaryInput<ElemType>::Init(wstring fileName, size_t dim)
     data_buffer = (char*) data_orig + data_padding;
 }
 template <class ElemType>
-bool DSSM_BinaryInput<ElemType>::SetupEpoch(size_t minibatchSize)
+template <class T>
+std::shared_ptr<T> DSSM_BinaryInput<ElemType>::AllocateStagingBuffer(int deviceId, size_t numElements)
 {
-    if (values == NULL || mbSize < minibatchSize)
+    if (deviceId >= 0)
     {
-        if (values != NULL)
-        {
-            free(values);
-            free(colIndices);
-            free(rowIndices);
-        }
-
-        values = (ElemType*) malloc(sizeof(ElemType) * MAX_BUFFER * minibatchSize);
-        colIndices = (int32_t*) malloc(sizeof(int32_t) * (minibatchSize + 1));
-        rowIndices = (int32_t*) malloc(sizeof(int32_t) * MAX_BUFFER * minibatchSize);
-        // fprintf(stderr, "values  size: %d",sizeof(ElemType)*MAX_BUFFER*minibatchSize);
-        // fprintf(stderr, "colindi size: %d",sizeof(int32_t)*MAX_BUFFER*(1+minibatchSize));
-        // fprintf(stderr, "rowindi size: %d",sizeof(int32_t)*MAX_BUFFER*minibatchSize);
+        // pinned, so that the transfer to the GPU does not go through another copy; pooled, since the buffers are reallocated whenever a minibatch has more non-zeros
+        return std::shared_ptr<T>((T*) CUDAPageLockedMemAllocator::MallocFromPool(sizeof(T) * numElements, deviceId), [](T* p)
+                                  {
+                                      CUDAPageLockedMemAllocator::FreeToPool(p);
+                                  });
     }
-    if (minibatchSize > mbSize)
+    else
     {
-        mbSize = minibatchSize;
+        return std::shared_ptr<T>(new T[numElements], [](T* p)
+                                  {
+                                      delete[] p;
+                                  });
     }
-
-    return true;
 }
+
 template <class ElemType>
-bool DSSM_BinaryInput<ElemType>::Next_Batch(Matrix<ElemType>& matrices, size_t cur, size_t numToRead, int* /*ordering*/)
+void DSSM_BinaryInput<ElemType>::GatherBatch(size_t slot, size_t cur, size_t numToRead, int deviceId)
 {
-    /*
-    int devId = matrices.GetDeviceId();
-    matrices.TransferFromDeviceToDevice(devId, -1);
-    */
+    StagingBuffer& staging = m_staging[slot];
 
-    int32_t cur_index = 0;
-
-    for (int c = 0; c < numToRead; c++, cur++)
-    {
-        // int64_t cur_offset = offsets[ordering[cur]];
-        int64_t cur_offset = offsets[cur];
-        // int64_t cur_offset = offsets[ordering[c]];
-        // int32_t nnz;
-        colIndices[c] = cur_index;
-        int32_t nnz = *(int32_t*) ((char*) data_buffer + cur_offset);
-        // memcpy(&nnz, (char*)data_buffer + cur_offset, sizeof(int32_t));
-        memcpy(values + cur_index, (char*) data_buffer + cur_offset + sizeof(int32_t), sizeof(ElemType) * nnz);
-        memcpy(rowIndices + cur_index, (char*) data_buffer + cur_offset + sizeof(int32_t) + sizeof(ElemType) * nnz, sizeof(int32_t) * nnz);
-        /**
-        fprintf(stderr, "%4d (%3d, %6d): ", c, nnz, cur_index + nnz);
-        for (int i = 0; i < nnz; i++)
-        {
-            fprintf(stderr, "%d:%.f ", rowIndices[cur_index+i], values[cur_index+i]);
-            // matrices.SetValue(rowIndices[cur_index + i], c, values[cur_index + i]);
-        }
-        fprintf(stderr, "\n");
-        **/
+    // the column offsets first, from the record headers; they give the size of the minibatch
+    if (staging.maxCols < numToRead + 1 || staging.deviceId != deviceId)
+    {
+        staging.colIndices.reset(); // back into the pool first, so that it can be picked up again
+        staging.colIndices = AllocateStagingBuffer<int32_t>(deviceId, numToRead + 1);
+        staging.maxCols = numToRead + 1;
+    }
+    int32_t* colIndices = staging.colIndices.get();
+    size_t nnz = 0;
+    for (size_t c = 0; c < numToRead; c++)
+    {
+        colIndices[c] = (int32_t) nnz;
+        nnz += *(int32_t*) ((char*) data_buffer + offsets[cur + c]);
+    }
+    colIndices[numToRead] = (int32_t) nnz;
 
-        cur_index += nnz;
+    if (staging.maxNNz < nnz || staging.deviceId != deviceId)
+    {
+        size_t maxNNz = max(nnz + nnz / 4, (size_t) 1); // some headroom, so that the next minibatches are likely to fit
+        staging.values.reset();
+        staging.rowIndices.reset();
+        staging.values = AllocateStagingBuffer<ElemType>(deviceId, maxNNz);
+        staging.rowIndices = AllocateStagingBuffer<int32_t>(deviceId, maxNNz);
+        staging.maxNNz = maxNNz;
     }
-    colIndices[numToRead] = cur_index;
-    /*
-    int col = 0;
-    for (int c = 0; c < cur_index; c++)
+    staging.deviceId = deviceId;
+
+    for (size_t c = 0; c < numToRead; c++)
     {
-        if (colIndices[col] == c)
-        {
-            fprintf(stderr, "\n%4d: ", col);
-            col++;
-        }
-        fprintf(stderr, "%d:%.f ", rowIndices[c], values[c]);
+        const char* record = (const char*) data_buffer + offsets[cur + c];
+        int32_t recordNNz = *(const int32_t*) record;
+        memcpy(staging.values.get() + colIndices[c], record + sizeof(int32_t), sizeof(ElemType) * recordNNz);
+        memcpy(staging.rowIndices.get() + colIndices[c], record + sizeof(int32_t) + sizeof(ElemType) * recordNNz, sizeof(int32_t) * recordNNz);
     }
-    */
-    /*
-    fprintf(stderr, "\nXXXX nnz: %d\n", cur_index);
-    fprintf(stderr, "XXXX max values read: %d vs %d\n", sizeof(ElemType)*cur_index, sizeof(ElemType)*MAX_BUFFER*numToRead);
-    fprintf(stderr, "XXXX max indices read: %d vs %d\n", sizeof(int32_t)*cur_index, sizeof(int32_t)*MAX_BUFFER*numToRead);
-    fprintf(stderr, "XXXX sizeof(int32_t) = %d, sizeof(int) = %d\n", sizeof(int32_t), sizeof(int));
-    */
-    /*
-        values = (ElemType*)malloc(sizeof(ElemType)*MAX_BUFFER*minibatchSize);
-        colIndices = (int32_t*)malloc(sizeof(int32_t)*MAX_BUFFER*(minibatchSize+1));
-        rowIndices = (int32_t*)malloc(sizeof(int32_t)*MAX_BUFFER*minibatchSize);
-        */
-
-    matrices.SetMatrixFromCSCFormat(colIndices, rowIndices, values, cur_index, m_dim, numToRead);
-    // matrices.Print("actual values");
-    // exit(1);
-    /*
-    matrices.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense);
-    matrices.Print("featuresQ");
-    exit(1);
-    matrices.TransferFromDeviceToDevice(-1,devId);
-    */
-    return true;
+    staging.nnz = nnz;
+    staging.numCols = numToRead;
+}
+
+template <class ElemType>
+void DSSM_BinaryInput<ElemType>::FillMatrix(size_t slot, Matrix<ElemType>& matrix)
+{
+    const StagingBuffer& staging = m_staging[slot];
+    matrix.SetMatrixFromCSCFormat(staging.colIndices.get(), staging.rowIndices.get(), staging.values.get(), staging.nnz, m_dim, staging.numCols);
 }
 
 template <class ElemType>
@@ -637,21 +649,17 @@ void DSSM_BinaryInput<ElemType>::Dispose()
         UnmapViewOfFile(data_orig);
     }
 
+    offsets_orig = NULL;
+    data_orig = NULL;
+
     if (offsets != NULL)
     {
         free(offsets); // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
     }
-    if (values != NULL)
-    {
-        free(values); // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
-    }
-    if (rowIndices != NULL)
-    {
-        free(rowIndices); // = (int*)malloc(sizeof(float)* 230 * 1024);
-    }
-    if (colIndices != NULL)
+    offsets = NULL;
+    for (auto& staging : m_staging)
     {
-        free(colIndices); // = (int*)malloc(sizeof(float)* 230 * 1024);
+        staging = StagingBuffer();
     }
 }
 
@@ -12,6 +12,8 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <memory>
+#include <future>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -42,13 +44,33 @@ private:
     void* data_buffer;
 
     size_t m_dim;
-    size_t mbSize;
-    size_t MAX_BUFFER = 300;
 
-    ElemType* values;    // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
-    int64_t* offsets;    // = (int*)malloc(sizeof(int)* 230 * 1024);
-    int32_t* colIndices; // = (int*)malloc(sizeof(int)* (batchsize + 1));
-    int32_t* rowIndices; // = (int*)malloc(sizeof(int)* MAX_BUFFER * batchsize);
+    int64_t* offsets; // = (int*)malloc(sizeof(int)* 230 * 1024);
+
+    // A minibatch gathered into CSC arrays, in page-locked memory if the matrix is on a GPU, so that it is
+    // transferred without another copy. A record on disk is [nnz][values][row indices], i.e. the values and
+    // the row indices of consecutive records are interleaved, so they cannot be handed to the matrix in place;
+    // gathering is one memcpy() of each out of the mapped file, plus the column offsets.
+    struct StagingBuffer
+    {
+        std::shared_ptr<ElemType> values;
+        std::shared_ptr<int32_t> rowIndices;
+        std::shared_ptr<int32_t> colIndices;
+        size_t maxNNz;
+        size_t maxCols;
+        int deviceId;
+        size_t nnz;
+        size_t numCols;
+        StagingBuffer()
+            : maxNNz(0), maxCols(0), deviceId(CPUDEVICE), nnz(0), numCols(0)
+        {
+        }
+    };
+    // a ring of two: one is transferred to the matrix while the next minibatch is gathered into the other
+    StagingBuffer m_staging[2];
+
+    template <class T>
+    static std::shared_ptr<T> AllocateStagingBuffer(int deviceId, size_t numElements);
 
 public:
     int64_t numRows;
@@ -58,8 +80,10 @@ public:
     DSSM_BinaryInput();
     ~DSSM_BinaryInput();
     void Init(std::wstring fileName, size_t dim);
-    bool SetupEpoch(size_t minibatchSize);
-    bool Next_Batch(Matrix<ElemType>& matrices, size_t cur, size_t numToRead, int* ordering);
+    // gathers the records [cur, cur + numToRead) into staging buffer 'slot'; may run on a background thread
+    void GatherBatch(size_t slot, size_t cur, size_t numToRead, int deviceId);
+    // sets 'matrix' from staging buffer 'slot'
+    void FillMatrix(size_t slot, Matrix<ElemType>& matrix);
     void Dispose();
 };
 
@@ -95,6 +119,15 @@ private:
     RandomOrdering m_randomordering; // randomizing class
     MBLayoutPtr m_pMBLayout;
 
+    // With prefetching (config 'prefetch', default true) the features of the next minibatch are gathered on a
+    // background thread into the other staging buffer while the current one is transferred and trained on.
+    bool m_prefetch;
+    std::future<void> m_pendingPrefetch;
+    size_t m_prefetchStart;  // records gathered by m_pendingPrefetch
+    size_t m_prefetchSize;
+    size_t m_stagingSlot;    // staging buffer of the next minibatch
+    bool WaitForPrefetch(size_t start, size_t size);
+
     std::wstring m_labelsName;
     std::wstring m_featuresName;
     std::wstring m_labelsCategoryName;
@@ -150,7 +183,7 @@ public:
     }
     virtual void Destroy();
     DSSMReader()
-        : m_pMBLayout(make_shared<MBLayout>())
+        : m_pMBLayout(make_shared<MBLayout>()), m_prefetch(true), m_prefetchStart(0), m_prefetchSize(0), m_stagingSlot(0)
     {
         m_qfeaturesBuffer = NULL;
         m_dfeaturesBuffer = NULL;
@@ -51,6 +51,7 @@ namespace msra { namespace lm {
 namespace msra { namespace asr {
     /*static*/ std::unordered_map<std::wstring, unsigned int> htkfeatreader::parsedpath::archivePathStringMap;
     /*static*/ std::vector<std::wstring> htkfeatreader::parsedpath::archivePathStringVector;
+    /*static*/ std::mutex htkfeatreader::parsedpath::archivePathStringMutex;
 }}
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -65,6 +66,12 @@ void HTKMLFReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig
     m_truncated = readerConfig(L"truncated", false);
     m_convertLabelsToTargets = false;
 
+    // frameSkip: models that run at a reduced frame rate see the frames 0, N, 2N, ... of each utterance, each with the
+    // context window around it stacked into it, and labels of the same frames; the MBLayout then has the decimated length
+    m_frameSkip = readerConfig(L"frameSkip", (size_t) 1);
+    if (m_frameSkip < 1)
+        InvalidArgument("'frameSkip' cannot be less than 1.");
+
     intargvector numberOfuttsPerMinibatchForAllEpochs = readerConfig(L"nbruttsineachrecurrentiter", ConfigRecordType::Array(intargvector(vector<int>{1})));
     m_numSeqsPerMBForAllEpochs = numberOfuttsPerMinibatchForAllEpochs;
 
@@ -109,6 +116,8 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
     vector<wstring> scriptpaths;
     vector<wstring> RootPathInScripts;
     wstring RootPathInLatticeTocs;
+    size_t latticePrefetchMB = 1024; // memory for lattices loaded ahead on a background thread (0 = no prefetching)
+    bool compactLattices = false;    // keep lattices in compact form until they are used
     vector<wstring> mlfpaths;
     vector<vector<wstring>> mlfpathsmulti;
     size_t firstfilesonly = SIZE_MAX; // set to a lower value for testing
@@ -158,6 +167,20 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
         {
             InvalidArgument("contextFrames must have 1 or 2 values specified, found %d", (int) contextWindow.size());
         }
+        // spliceOnDevice: the frame source delivers the raw frames, and the context window is expanded by SpliceOnDevice()
+        // on the device of the minibatch, so that only the raw frames are transferred
+        if (thisFeature(L"spliceOnDevice", false) && numContextLeft[i] + numContextRight[i] > 0)
+        {
+            m_deviceSpliceLeft.push_back(numContextLeft[i]);
+            m_deviceSpliceRight.push_back(numContextRight[i]);
+            numContextLeft[i] = 0;
+            numContextRight[i] = 0;
+        }
+        else
+        {
+            m_deviceSpliceLeft.push_back(0);
+            m_deviceSpliceRight.push_back(0);
+        }
         // update m_featDims to reflect the total input dimension (featDim x contextWindow), not the native feature dimension
         // that is what the lower level feature readers expect
         m_featDims[i] = m_featDims[i] * (1 + numContextLeft[i] + numContextRight[i]);
@@ -272,6 +295,8 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
             latticetocs.first.insert(latticetocs.first.end(), paths.begin(), paths.end());
         }
         RootPathInLatticeTocs = (wstring) thisLattice(L"prefixPathInToc", L"");
+        latticePrefetchMB = thisLattice(L"prefetchMemoryMB", latticePrefetchMB);
+        compactLattices = thisLattice(L"compactLattices", compactLattices);
     }
 
     // get HMM related file names
@@ -307,6 +332,24 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
         InvalidArgument("'Truncated' cannot be 'true' in frameMode (i.e. when 'frameMode' is 'true')");
     }
 
+    // decimation is per utterance; the lattices of sequence training and the splicing on the device refer to all frames
+    if (m_frameSkip > 1 && m_frameMode)
+        InvalidArgument("'frameSkip' requires 'frameMode' to be 'false'");
+    if (m_frameSkip > 1 && latticetocs.second.size() > 0)
+        InvalidArgument("'frameSkip' cannot be used with lattices");
+    for (size_t id = 0; id < m_deviceSpliceLeft.size(); id++)
+    {
+        if (m_frameSkip > 1 && m_deviceSpliceLeft[id] + m_deviceSpliceRight[id] > 0)
+            InvalidArgument("'frameSkip' cannot be used with 'spliceOnDevice'");
+    }
+
+    // splicing on the device needs the neighbor frames of every frame in the minibatch, i.e. complete utterances
+    for (size_t id = 0; id < m_deviceSpliceLeft.size(); id++)
+    {
+        if (m_deviceSpliceLeft[id] + m_deviceSpliceRight[id] > 0 && (m_frameMode || m_truncated))
+            InvalidArgument("'spliceOnDevice' requires 'frameMode' and 'Truncated' to be 'false'");
+    }
+
     // determine if we partial minibatches are desired
     wstring minibatchMode(readerConfig(L"minibatchMode", L"partial"));
     m_partialMinibatch = EqualCI(minibatchMode, L"partial");
@@ -464,8 +507,49 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
     // std::vector<msra::asr::htkmlfreader<msra::asr::htkmlfentry,msra::lattices::lattice::htkmlfwordsequence>> labelsmulti;
     std::vector<std::map<std::wstring, std::vector<msra::asr::htkmlfentry>>> labelsmulti;
     // std::vector<std::wstring> pagepath;
+
+    // featureCacheDir: cache the parsed labels and, with blockRandomize, the features of each chunk in this directory
+    std::wstring featureCacheDir = readerConfig(L"featureCacheDir", L"");
+    // shareFeatureCache: map the chunk cache files instead of reading them, so that jobs on the same host share one copy of the features
+    // (put featureCacheDir on a RAM disk such as /dev/shm)
+    bool shareFeatureCache = readerConfig(L"shareFeatureCache", false);
+    if (shareFeatureCache && featureCacheDir.empty())
+        InvalidArgument("'shareFeatureCache' requires 'featureCacheDir'");
+    // featureCompression: keep the chunks of the randomization window in RAM as 'float16' or 'int8' (per-dimension linear quantization)
+    // instead of 'none' (float), to afford a larger randomizationRange in the same memory (see compressedframes.h)
+    std::wstring featureCompressionName = readerConfig(L"featureCompression", L"none");
+    msra::dbn::compressedframes::kind featureCompression = msra::dbn::compressedframes::parsekind(featureCompressionName);
+    if (featureCompression != msra::dbn::compressedframes::none && shareFeatureCache)
+        InvalidArgument("'featureCompression' cannot be used with 'shareFeatureCache', whose chunks are shared in float form");
+
     foreach_index (i, mlfpathsmulti)
     {
+        // labels from the cache, if it was created from the same MLFs and options
+        std::wstring labelsCachePath;
+        uint64_t labelsSignature = 0;
+        if (!featureCacheDir.empty())
+        {
+            msra::dbn::utterancecache::signature sig;
+            std::vector<std::wstring> inputs = mlfpathsmulti[i];
+            inputs.push_back(statelistpaths[i]);
+            for (const auto& input : inputs)
+                sig.add(input);
+            for (const auto& key : restrictmlftokeys)
+                sig.add(key);
+            sig.add(unigrampath);
+            sig.add((uint64_t) htktimetoframe);
+            labelsSignature = sig;
+            labelsCachePath = msra::dbn::utterancecache::labelspath(featureCacheDir, i);
+
+            std::map<std::wstring, std::vector<msra::asr::htkmlfentry>> cachedLabels;
+            if (msra::dbn::utterancecache::readlabels(labelsCachePath, labelsSignature, inputs, cachedLabels))
+            {
+                fprintf(stderr, "read %d label sequences from cache '%ls'\n", (int) cachedLabels.size(), labelsCachePath.c_str());
+                labelsmulti.push_back(std::move(cachedLabels));
+                continue;
+            }
+        }
+
         const msra::lm::CSymbolSet* wordmap = unigram ? &unigramsymbols : NULL;
         msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence>
         labels(mlfpathsmulti[i], restrictmlftokeys, statelistpaths[i], wordmap, (map<string, size_t>*) NULL, htktimetoframe); // label MLF
@@ -476,25 +560,40 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
                       "Type 'msra::asr::htkmlfreader' should be move constructible!");
 
         labelsmulti.push_back(std::move(labels));
+        if (!labelsCachePath.empty())
+            msra::dbn::utterancecache::writelabels(labelsCachePath, labelsSignature, labelsmulti.back());
     }
 
     if (EqualCI(readMethod, L"blockRandomize"))
     {
         // construct all the parameters we don't need, but need to be passed to the constructor...
 
-        m_lattices.reset(new msra::dbn::latticesource(latticetocs, m_hset.getsymmap(), RootPathInLatticeTocs));
+        m_lattices.reset(new msra::dbn::latticesource(latticetocs, m_hset.getsymmap(), RootPathInLatticeTocs, latticePrefetchMB * 1024 * 1024, compactLattices));
         m_lattices->setverbosity(m_verbosity);
 
         // now get the frame source. This has better randomization and doesn't create temp files
         bool minimizeReaderMemoryFootprint = readerConfig(L"minimizeReaderMemoryFootprint", true);
-        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode, minimizeReaderMemoryFootprint));
+        // randomizationMethod: 'swap' randomizes by random swaps within the window, stored per frame (frame mode) or utterance;
+        // 'permutation' by keyed permutations of groups of chunks, computed on the fly, which needs no memory per frame
+        std::wstring randomizationMethod = readerConfig(L"randomizationMethod", L"swap");
+        if (!EqualCI(randomizationMethod, L"swap") && !EqualCI(randomizationMethod, L"permutation"))
+            InvalidArgument("'randomizationMethod' must be 'swap' or 'permutation', not '%ls'", randomizationMethod.c_str());
+        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode, minimizeReaderMemoryFootprint, featureCacheDir, shareFeatureCache, featureCompression,
+                                                                         EqualCI(randomizationMethod, L"permutation")));
         m_frameSource->setverbosity(m_verbosity);
     }
     else if (EqualCI(readMethod, L"rollingWindow"))
     {
         std::wstring pageFilePath;
         std::vector<std::wstring> pagePaths;
-        if (readerConfig.Exists(L"pageFilePath"))
+        // featureStorePath: keep the feature stores as <featureStorePath>.<i>.features, and reuse them in the next job over the same files
+        std::wstring featureStorePath = readerConfig(L"featureStorePath", L"");
+        if (!featureStorePath.empty())
+        {
+            foreach_index (i, infilesmulti)
+                pagePaths.push_back(msra::strfun::wstrprintf(L"%ls.%d.features", featureStorePath.c_str(), i));
+        }
+        else if (readerConfig.Exists(L"pageFilePath"))
         {
             pageFilePath = (const wstring&) readerConfig(L"pageFilePath");
 
@@ -533,27 +632,28 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
         if (pageFilePath.size() > PATH_MAX - 14) // max length of input to GetTempFileName is PATH_MAX-14
             RuntimeError("pageFilePath must be less than %d characters", PATH_MAX - 14);
 #endif
-        foreach_index (i, infilesmulti)
-        {
+        if (featureStorePath.empty()) // temporary page files
+            foreach_index (i, infilesmulti)
+            {
 #ifdef _WIN32
-            wchar_t tempFile[MAX_PATH];
-            GetTempFileName(pageFilePath.c_str(), L"CNTK", 0, tempFile);
-            pagePaths.push_back(tempFile);
+                wchar_t tempFile[MAX_PATH];
+                GetTempFileName(pageFilePath.c_str(), L"CNTK", 0, tempFile);
+                pagePaths.push_back(tempFile);
 #endif
 #ifdef __unix__
-            char tempFile[PATH_MAX];
-            strcpy(tempFile, msra::strfun::utf8(pageFilePath).c_str());
-            int fid = mkstemp(tempFile);
-            unlink(tempFile);
-            close(fid);
-            pagePaths.push_back(GetWC(tempFile));
+                char tempFile[PATH_MAX];
+                strcpy(tempFile, msra::strfun::utf8(pageFilePath).c_str());
+                int fid = mkstemp(tempFile);
+                unlink(tempFile);
+                close(fid);
+                pagePaths.push_back(GetWC(tempFile));
 #endif
-        }
+            }
 
         const bool mayhavenoframe = false;
         int addEnergy = 0;
 
-        m_frameSource.reset(new msra::dbn::minibatchframesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, pagePaths, mayhavenoframe, addEnergy));
+        m_frameSource.reset(new msra::dbn::minibatchframesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, pagePaths, mayhavenoframe, addEnergy, !featureStorePath.empty()));
         m_frameSource->setverbosity(m_verbosity);
     }
     else
@@ -1085,13 +1185,16 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
                     {
                         id = m_featureNameToIdMap[iter->first];
                         dim = m_featureNameToDimMap[iter->first];
-                        data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
+                        if (m_deviceSpliceLeft[id] + m_deviceSpliceRight[id] > 0)
+                            SpliceOnDevice(id, dim, data);
+                        else
+                            data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
                     }
                     else if (m_nameToTypeMap[iter->first] == InputOutputTypes::category)
                     {
                         id = m_labelNameToIdMap[iter->first];
                         dim = m_labelNameToDimMap[iter->first];
-                        data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_labelsBufferMultiIO[id].get(), matrixFlagNormal);
+                        SetLabelMatrix(id, dim, data);
                     }
                 }
             }
@@ -1366,7 +1469,7 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
                 {
                     id = m_labelNameToIdMap[iter->first];
                     dim = m_labelNameToDimMap[iter->first];
-                    data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_labelsBufferMultiIO[id].get(), matrixFlagNormal);
+                    SetLabelMatrix(id, dim, data);
                 }
             }
             skip = false;
@@ -1385,6 +1488,89 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
 
 // copy an utterance into the minibatch given a location (parallel-sequence index, start frame)
 // TODO: This should use DataFor(). But for that, DataFor() will have to move out from ComputationNode. Ah, it has!
+// Expands the raw frames of feature 'id' by their context window on the device of 'data' (spliceOnDevice).
+// Column (t, s) of 'data' becomes the stack of the raw frames t - left ... t + right of its utterance, where frames
+// beyond the utterance boundaries repeat its first or last frame, as augmentneighbors() does for the frame source.
+// Only the raw frames and one column index per output frame and window position are transferred.
+template <class ElemType>
+void HTKMLFReader<ElemType>::SpliceOnDevice(size_t id, size_t rawDim, Matrix<ElemType>& data)
+{
+    const size_t left = m_deviceSpliceLeft[id];
+    const size_t window = left + 1 + m_deviceSpliceRight[id];
+    const size_t numSeqs = m_numSeqsPerMB;
+    const size_t numCols = m_mbNumTimeSteps * numSeqs;
+
+    // gap columns gather themselves
+    m_spliceIndexBuffer.resize(numCols * window);
+    for (size_t j = 0; j < numCols; j++)
+        for (size_t k = 0; k < window; k++)
+            m_spliceIndexBuffer[j * window + k] = (ElemType) j;
+
+    for (const auto& seq : m_pMBLayout->GetAllSequences())
+    {
+        if (seq.seqId == GAP_SEQUENCE_ID)
+            continue;
+        // not truncated, hence the utterance lies within the minibatch
+        const ptrdiff_t tBegin = seq.tBegin;
+        const ptrdiff_t tLast = (ptrdiff_t) seq.tEnd - 1;
+        for (ptrdiff_t t = tBegin; t <= tLast; t++)
+        {
+            ElemType* indices = &m_spliceIndexBuffer[(t * numSeqs + seq.s) * window];
+            for (size_t k = 0; k < window; k++)
+            {
+                const ptrdiff_t tSource = min(max(t + (ptrdiff_t) k - (ptrdiff_t) left, tBegin), tLast);
+                indices[k] = (ElemType) (tSource * numSeqs + seq.s);
+            }
+        }
+    }
+
+    const DEVICEID_TYPE deviceId = data.GetDeviceId();
+    if (!m_spliceRawFrames || m_spliceRawFrames->GetDeviceId() != deviceId)
+    {
+        m_spliceRawFrames.reset(new Matrix<ElemType>(deviceId));
+        m_spliceIndices.reset(new Matrix<ElemType>(deviceId));
+    }
+    m_spliceRawFrames->SetValue(rawDim, numCols, deviceId, m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
+    m_spliceIndices->SetValue(1, numCols * window, deviceId, m_spliceIndexBuffer.data(), matrixFlagNormal);
+
+    // gather into (rawDim x window*numCols); column j * window + k is window position k of output column j
+    data.AssignGatheredColumnsOf(*m_spliceRawFrames, *m_spliceIndices);
+    data.Reshape(rawDim * window, numCols);
+}
+
+// Sets 'data' from the labels of label 'id' in the minibatch. If the label input is declared sparse, only the non-zeros
+// (one per frame for a one-hot label) are transferred, in CSC format, instead of a dense dim x frames matrix.
+template <class ElemType>
+void HTKMLFReader<ElemType>::SetLabelMatrix(size_t id, size_t dim, Matrix<ElemType>& data)
+{
+    const size_t numCols = m_mbNumTimeSteps * m_numSeqsPerMB;
+    const ElemType* labels = m_labelsBufferMultiIO[id].get();
+    if (data.GetMatrixType() != SPARSE)
+    {
+        data.SetValue(dim, numCols, data.GetDeviceId(), const_cast<ElemType*>(labels), matrixFlagNormal);
+        return;
+    }
+
+    m_labelColStarts.resize(numCols + 1);
+    m_labelRows.clear();
+    m_labelValues.clear();
+    for (size_t j = 0; j < numCols; j++)
+    {
+        m_labelColStarts[j] = (CPUSPARSE_INDEX_TYPE) m_labelRows.size();
+        const ElemType* column = labels + j * dim;
+        for (size_t i = 0; i < dim; i++)
+        {
+            if (column[i] != 0)
+            {
+                m_labelRows.push_back((CPUSPARSE_INDEX_TYPE) i);
+                m_labelValues.push_back(column[i]);
+            }
+        }
+    }
+    m_labelColStarts[numCols] = (CPUSPARSE_INDEX_TYPE) m_labelRows.size();
+    data.SetMatrixFromCSCFormat(m_labelColStarts.data(), m_labelRows.data(), m_labelValues.data(), m_labelValues.size(), dim, numCols);
+}
+
 template <class ElemType>
 void HTKMLFReader<ElemType>::fillOneUttDataforParallelmode(std::map<std::wstring, Matrix<ElemType>*>& matrices, size_t startFr,
                                                            size_t framenum, size_t channelIndex, size_t sourceChannelIndex)
@@ -1519,12 +1705,13 @@ bool HTKMLFReader<ElemType>::GetMinibatchToWrite(std::map<std::wstring, Matrix<E
                 size_t dim = m_featureNameToDimMap[iter->first];
 
                 const msra::dbn::matrix feat = m_fileEvalSource->ChunkOfFrames(id);
+                const size_t numFrames = (feat.cols() + m_frameSkip - 1) / m_frameSkip; // (column j is frame j * m_frameSkip)
 
                 // update the MBLayout
                 if (first)
                 {
-                    m_pMBLayout->Init(1, feat.cols());
-                    m_pMBLayout->AddSequence(NEW_SEQUENCE_ID, 0, 0, feat.cols()); // feat.cols() == number of time steps here since we only have one parallel sequence
+                    m_pMBLayout->Init(1, numFrames);
+                    m_pMBLayout->AddSequence(NEW_SEQUENCE_ID, 0, 0, numFrames); // numFrames == number of time steps here since we only have one parallel sequence
                     // m_pMBLayout->Set(0, 0, MinibatchPackingFlags::SequenceStart);
                     // m_pMBLayout->SetWithoutOr(0, feat.cols() - 1, MinibatchPackingFlags::SequenceEnd);  // BUGBUG: using SetWithoutOr() because original code did; but that seems inconsistent
                     first = false;
@@ -1535,31 +1722,31 @@ bool HTKMLFReader<ElemType>::GetMinibatchToWrite(std::map<std::wstring, Matrix<E
                 dim; // check feature dimension matches what's expected
 
                 if ((m_featuresBufferMultiIO[id] == nullptr) ||
-                    (m_featuresBufferAllocatedMultiIO[id] < (feat.rows() * feat.cols())) /*buffer size changed. can be partial minibatch*/)
+                    (m_featuresBufferAllocatedMultiIO[id] < (feat.rows() * numFrames)) /*buffer size changed. can be partial minibatch*/)
                 {
-                    m_featuresBufferMultiIO[id] = AllocateIntermediateBuffer(data.GetDeviceId(), feat.rows() * feat.cols());
-                    m_featuresBufferAllocatedMultiIO[id] = feat.rows() * feat.cols();
+                    m_featuresBufferMultiIO[id] = AllocateIntermediateBuffer(data.GetDeviceId(), feat.rows() * numFrames);
+                    m_featuresBufferAllocatedMultiIO[id] = feat.rows() * numFrames;
                 }
 
                 if (sizeof(ElemType) == sizeof(float))
                 {
-                    for (int j = 0; j < feat.cols(); j++) // column major, so iterate columns
+                    for (int j = 0; j < numFrames; j++) // column major, so iterate columns
                     {
                         // copy over the entire column at once, need to do this because SSEMatrix may have gaps at the end of the columns
-                        memcpy_s(&m_featuresBufferMultiIO[id].get()[j * feat.rows()], sizeof(ElemType) * feat.rows(), &feat(0, j), sizeof(ElemType) * feat.rows());
+                        memcpy_s(&m_featuresBufferMultiIO[id].get()[j * feat.rows()], sizeof(ElemType) * feat.rows(), &feat(0, j * m_frameSkip), sizeof(ElemType) * feat.rows());
                     }
                 }
                 else
                 {
-                    for (int j = 0; j < feat.cols(); j++) // column major, so iterate columns in outside loop
+                    for (int j = 0; j < numFrames; j++) // column major, so iterate columns in outside loop
                     {
                         for (int i = 0; i < feat.rows(); i++)
                         {
-                            m_featuresBufferMultiIO[id].get()[j * feat.rows() + i] = feat(i, j);
+                            m_featuresBufferMultiIO[id].get()[j * feat.rows() + i] = feat(i, j * m_frameSkip);
                         }
                     }
                 }
-                data.SetValue(feat.rows(), feat.cols(), data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
+                data.SetValue(feat.rows(), numFrames, data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
             }
         }
         return true;
@@ -1583,12 +1770,14 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
     size_t numOfFea = m_featuresBufferMultiIO.size();
     size_t numOfLabel = m_labelsBufferMultiIO.size();
 
+    // with frameSkip, column k of the buffers is frame k * m_frameSkip of the utterance
+    const size_t frameSkip = m_frameSkip;
     size_t totalFeatNum = 0;
     foreach_index (id, m_featuresBufferAllocatedMultiIO)
     {
         const msra::dbn::matrixstripe featOri = m_mbiter->frames(id);
         size_t fdim = featOri.rows();
-        const size_t actualmbsizeOri = featOri.cols();
+        const size_t actualmbsizeOri = (featOri.cols() + frameSkip - 1) / frameSkip;
         m_featuresStartIndexMultiUtt[id + i * numOfFea] = totalFeatNum;
         totalFeatNum = fdim * actualmbsizeOri + m_featuresStartIndexMultiUtt[id + i * numOfFea];
     }
@@ -1605,7 +1794,7 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
         size_t dim = m_labelNameToDimMap[it->first];
 
         const vector<size_t>& uids = m_mbiter->labels(id);
-        size_t actualmbsizeOri = uids.size();
+        size_t actualmbsizeOri = (uids.size() + frameSkip - 1) / frameSkip;
         m_labelsStartIndexMultiUtt[id + i * numOfLabel] = totalLabelsNum;
         totalLabelsNum = m_labelsStartIndexMultiUtt[id + i * numOfLabel] + dim * actualmbsizeOri;
     }
@@ -1622,7 +1811,7 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
     foreach_index (id, m_featuresBufferMultiIO)
     {
         const msra::dbn::matrixstripe featOri = m_mbiter->frames(id);
-        const size_t actualmbsizeOri = featOri.cols();
+        const size_t actualmbsizeOri = (featOri.cols() + frameSkip - 1) / frameSkip;
         size_t fdim = featOri.rows();
         if (first)
         {
@@ -1636,14 +1825,14 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
                 RuntimeError("The multi-IO features has inconsistent number of frames!");
             }
         }
-        assert(actualmbsizeOri == m_mbiter->currentmbframes());
+        assert(featOri.cols() == m_mbiter->currentmbframes());
 
         if (sizeof(ElemType) == sizeof(float))
         {
             for (int k = 0; k < actualmbsizeOri; k++) // column major, so iterate columns
             {
                 // copy over the entire column at once, need to do this because SSEMatrix may have gaps at the end of the columns
-                memcpy_s(&m_featuresBufferMultiUtt[i].get()[k * fdim + m_featuresStartIndexMultiUtt[id + i * numOfFea]], sizeof(ElemType) * fdim, &featOri(0, k), sizeof(ElemType) * fdim);
+                memcpy_s(&m_featuresBufferMultiUtt[i].get()[k * fdim + m_featuresStartIndexMultiUtt[id + i * numOfFea]], sizeof(ElemType) * fdim, &featOri(0, k * frameSkip), sizeof(ElemType) * fdim);
             }
         }
         else
@@ -1652,7 +1841,7 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
             {
                 for (int d = 0; d < featOri.rows(); d++)
                 {
-                    m_featuresBufferMultiUtt[i].get()[k * featOri.rows() + d + m_featuresStartIndexMultiUtt[id + i * numOfFea]] = featOri(d, k);
+                    m_featuresBufferMultiUtt[i].get()[k * featOri.rows() + d + m_featuresStartIndexMultiUtt[id + i * numOfFea]] = featOri(d, k * frameSkip);
                 }
             }
         }
@@ -1664,16 +1853,16 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
         size_t dim = m_labelNameToDimMap[it->first];
 
         const vector<size_t>& uids = m_mbiter->labels(id);
-        size_t actualmbsizeOri = uids.size();
+        size_t actualmbsizeOri = (uids.size() + frameSkip - 1) / frameSkip;
 
         if (m_convertLabelsToTargetsMultiIO[id])
         {
             size_t labelDim = m_labelToTargetMapMultiIO[id].size();
             for (int k = 0; k < actualmbsizeOri; k++)
             {
-                assert(uids[k] < labelDim);
+                assert(uids[k * frameSkip] < labelDim);
                 labelDim;
-                size_t labelId = uids[k];
+                size_t labelId = uids[k * frameSkip];
                 for (int j = 0; j < dim; j++)
                 {
                     m_labelsBufferMultiUtt[i].get()[k * dim + j + m_labelsStartIndexMultiUtt[id + i * numOfLabel]] = m_labelToTargetMapMultiIO[id][labelId][j];
@@ -1686,8 +1875,8 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
             // in the future we want to use a sparse matrix here
             for (int k = 0; k < actualmbsizeOri; k++)
             {
-                assert(uids[k] < dim);
-                m_labelsBufferMultiUtt[i].get()[k * dim + uids[k] + m_labelsStartIndexMultiUtt[id + i * numOfLabel]] = (ElemType) 1;
+                assert(uids[k * frameSkip] < dim);
+                m_labelsBufferMultiUtt[i].get()[k * dim + uids[k * frameSkip] + m_labelsStartIndexMultiUtt[id + i * numOfLabel]] = (ElemType) 1;
             }
         }
     }
@@ -1907,35 +2096,16 @@ void HTKMLFReader<ElemType>::ExpandDotDotDot(wstring& featPath, const wstring& s
         featPath = featPath.substr(0, pos) + scpDirCached + featPath.substr(pos + 3);
 }
 
-template <class ElemType>
-unique_ptr<CUDAPageLockedMemAllocator>& HTKMLFReader<ElemType>::GetCUDAAllocator(int deviceID)
-{
-    if (m_cudaAllocator != nullptr)
-    {
-        if (m_cudaAllocator->GetDeviceId() != deviceID)
-        {
-            m_cudaAllocator.reset(nullptr);
-        }
-    }
-
-    if (m_cudaAllocator == nullptr)
-    {
-        m_cudaAllocator.reset(new CUDAPageLockedMemAllocator(deviceID));
-    }
-
-    return m_cudaAllocator;
-}
-
 template <class ElemType>
 std::shared_ptr<ElemType> HTKMLFReader<ElemType>::AllocateIntermediateBuffer(int deviceID, size_t numElements)
 {
     if (deviceID >= 0)
     {
-        // Use pinned memory for GPU devices for better copy performance
+        // Use pinned memory for GPU devices for better copy performance; pooled, since the buffers are reallocated whenever the minibatch size grows
         size_t totalSize = sizeof(ElemType) * numElements;
-        return std::shared_ptr<ElemType>((ElemType*) GetCUDAAllocator(deviceID)->Malloc(totalSize), [this, deviceID](ElemType* p)
+        return std::shared_ptr<ElemType>((ElemType*) CUDAPageLockedMemAllocator::MallocFromPool(totalSize, deviceID), [](ElemType* p)
                                          {
-                                             this->GetCUDAAllocator(deviceID)->Free((char*) p);
+                                             CUDAPageLockedMemAllocator::FreeToPool(p);
                                          });
     }
     else
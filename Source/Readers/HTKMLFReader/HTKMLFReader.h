@@ -27,6 +27,7 @@ private:
     vector<bool> m_sentenceEnd;
     bool m_truncated;
     bool m_frameMode;
+    size_t m_frameSkip;              // only every m_frameSkip-th frame of an utterance is delivered (for low-frame-rate models)
     vector<size_t> m_processedFrame; // [seq index] (truncated BPTT only) current time step (cursor)
     intargvector m_numSeqsPerMBForAllEpochs;
     size_t m_numSeqsPerMB;      // requested number of parallel sequences
@@ -55,7 +56,6 @@ private:
     std::vector<size_t> m_featuresStartIndexMultiUtt;
     std::vector<size_t> m_labelsStartIndexMultiUtt;
 
-    unique_ptr<CUDAPageLockedMemAllocator> m_cudaAllocator;
     std::vector<std::shared_ptr<ElemType>> m_featuresBufferMultiIO;
     std::vector<size_t> m_featuresBufferAllocatedMultiIO;
     std::vector<std::shared_ptr<ElemType>> m_labelsBufferMultiIO;
@@ -88,6 +88,19 @@ private:
     std::vector<size_t> m_featDims;
     std::vector<size_t> m_labelDims;
 
+    // context window expanded on the device of the minibatch instead of by the frame source (spliceOnDevice), per feature id
+    // Only the raw frames are copied into the minibatch; both are 0 for features that the frame source splices.
+    std::vector<size_t> m_deviceSpliceLeft;
+    std::vector<size_t> m_deviceSpliceRight;
+    std::vector<ElemType> m_spliceIndexBuffer;                // [(t * numSeqs + s) * window + k] -> column of the raw frame
+    std::unique_ptr<Matrix<ElemType>> m_spliceRawFrames;       // raw frames of the minibatch, on the device of the minibatch
+    std::unique_ptr<Matrix<ElemType>> m_spliceIndices;         // m_spliceIndexBuffer, on the device of the minibatch
+
+    // labels of the minibatch in CSC format, for label inputs that are declared sparse (see SetLabelMatrix())
+    std::vector<CPUSPARSE_INDEX_TYPE> m_labelColStarts;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_labelRows;
+    std::vector<ElemType> m_labelValues;
+
     std::vector<std::vector<std::vector<ElemType>>> m_labelToTargetMapMultiIO;
 
     int m_verbosity;
@@ -106,6 +119,8 @@ private:
     void StartMinibatchLoopToWrite(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize);
 
     bool ReNewBufferForMultiIO(size_t i);
+    void SpliceOnDevice(size_t id, size_t rawDim, Matrix<ElemType>& data);
+    void SetLabelMatrix(size_t id, size_t dim, Matrix<ElemType>& data);
 
     size_t GetNumParallelSequences();
     void SetNumParallelSequences(const size_t){};
@@ -126,7 +141,6 @@ private:
 
 private:
     // Helper functions
-    unique_ptr<CUDAPageLockedMemAllocator>& GetCUDAAllocator(int deviceID);
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements);
 
 public:
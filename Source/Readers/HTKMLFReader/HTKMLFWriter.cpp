@@ -95,11 +95,38 @@ void HTKMLFWriter<ElemType>::InitFromConfig(const ConfigRecordType& writerConfig
     }
     outputFileIndex = 0;
     sampPeriod = 100000;
+
+    m_compress = writerConfig(L"compress", false);
+
+    // frameSkip: for a model evaluated at a reduced frame rate (see the reader's frameSkip), bring the outputs back to the
+    // full rate by repeating each frame, or (repeatFrames=false) write them at the reduced rate, with the longer sample period
+    m_frameSkip = writerConfig(L"frameSkip", (size_t) 1);
+    if (m_frameSkip < 1)
+        InvalidArgument("HTKMLFWriter::Init: 'frameSkip' cannot be less than 1.");
+    m_repeatFrames = writerConfig(L"repeatFrames", true);
+
+    // writerThreads=0 writes each output synchronously inside SaveData()
+    size_t writerThreads = writerConfig(L"writerThreads", (size_t) 1);
+    size_t writeQueueDepth = writerConfig(L"writeQueueDepth", 2 * writerThreads);
+    m_maxPendingWrites = max(writeQueueDepth, (size_t) 1);
+    if (writerThreads > 0)
+        m_writers.reset(new WorkerPool(writerThreads, m_maxPendingWrites));
 }
 
 template <class ElemType>
 void HTKMLFWriter<ElemType>::Destroy()
 {
+    // Flush() reports errors of the background writes; here we can only log them
+    try
+    {
+        WaitForWrites(0);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "HTKMLFWriter::Destroy: writing output failed: %s\n", e.what());
+    }
+    m_writers.reset();
+
     delete[] m_tempArray;
     m_tempArray = nullptr;
     m_tempArraySize = 0;
@@ -129,7 +156,24 @@ bool HTKMLFWriter<ElemType>::SaveData(size_t /*recordStart*/, const std::map<std
         assert(outputData.GetNumRows() == dim);
         dim;
 
-        Save(outFile, outputData);
+        const size_t numRows = outputData.GetNumRows();
+        const size_t numCols = outputData.GetNumCols();
+        if (m_writers)
+        {
+            // the matrix is overwritten by the next minibatch, so copy it now; the rest happens in the background
+            std::shared_ptr<ElemType> buffer = AllocateHostBuffer(outputData.GetDeviceId(), numRows * numCols);
+            outputData.CopySection(numRows, numCols, buffer.get(), numRows);
+            WaitForWrites(m_maxPendingWrites - 1);
+            m_pendingWrites.push_back(m_writers->Submit([this, outFile, buffer, numRows, numCols]()
+                                                        {
+                                                            Save(outFile, buffer.get(), numRows, numCols);
+                                                        }));
+        }
+        else
+        {
+            outputData.CopyToArray(m_tempArray, m_tempArraySize);
+            Save(outFile, m_tempArray, numRows, numCols);
+        }
     }
 
     outputFileIndex++;
@@ -138,18 +182,60 @@ bool HTKMLFWriter<ElemType>::SaveData(size_t /*recordStart*/, const std::map<std
 }
 
 template <class ElemType>
-void HTKMLFWriter<ElemType>::Save(std::wstring& outputFile, Matrix<ElemType>& outputData)
+void HTKMLFWriter<ElemType>::Flush()
+{
+    WaitForWrites(0);
+}
+
+// wait for the oldest background writes until at most 'maxPending' are left; rethrows their errors
+template <class ElemType>
+void HTKMLFWriter<ElemType>::WaitForWrites(size_t maxPending)
+{
+    while (m_pendingWrites.size() > maxPending)
+    {
+        std::future<void> write = std::move(m_pendingWrites.front());
+        m_pendingWrites.pop_front();
+        write.get();
+    }
+}
+
+template <class ElemType>
+std::shared_ptr<ElemType> HTKMLFWriter<ElemType>::AllocateHostBuffer(int deviceId, size_t numElements)
+{
+    if (deviceId >= 0)
+    {
+        // pinned memory for fast copies from the GPU; pooled, since a buffer is needed for every output of every minibatch
+        return std::shared_ptr<ElemType>((ElemType*) CUDAPageLockedMemAllocator::MallocFromPool(sizeof(ElemType) * numElements, deviceId), [](ElemType* p)
+                                         {
+                                             CUDAPageLockedMemAllocator::FreeToPool(p);
+                                         });
+    }
+    else
+    {
+        return std::shared_ptr<ElemType>(new ElemType[numElements], [](ElemType* p)
+                                         {
+                                             delete[] p;
+                                         });
+    }
+}
+
+// convert and write one output; may run on several threads at once
+template <class ElemType>
+void HTKMLFWriter<ElemType>::Save(const std::wstring& outputFile, const ElemType* pValue, size_t numRows, size_t numCols) const
 {
+    // with repeated frames, an utterance of T frames gets frameSkip * ceil(T / frameSkip) frames back, up to frameSkip - 1 more
+    const size_t repeat = m_repeatFrames ? m_frameSkip : 1;
+    const unsigned int sampPeriod = m_repeatFrames ? this->sampPeriod : (unsigned int) (this->sampPeriod * m_frameSkip);
     msra::dbn::matrix output;
-    output.resize(outputData.GetNumRows(), outputData.GetNumCols());
-    outputData.CopyToArray(m_tempArray, m_tempArraySize);
-    ElemType* pValue = m_tempArray;
+    output.resize(numRows, numCols * repeat);
 
-    for (int j = 0; j < outputData.GetNumCols(); j++)
+    for (size_t j = 0; j < numCols; j++)
     {
-        for (int i = 0; i < outputData.GetNumRows(); i++)
+        for (size_t i = 0; i < numRows; i++)
         {
-            output(i, j) = (float) *pValue++;
+            for (size_t r = 0; r < repeat; r++)
+                output(i, j * repeat + r) = (float) *pValue;
+            pValue++;
         }
     }
 
@@ -160,7 +246,7 @@ void HTKMLFWriter<ElemType>::Save(std::wstring& outputFile, Matrix<ElemType>& ou
     msra::files::make_intermediate_dirs(outputFile);
     msra::util::attempt(5, [&]()
                         {
-                            msra::asr::htkfeatwriter::write(outputFile, "USER", this->sampPeriod, output);
+                            msra::asr::htkfeatwriter::write(outputFile, "USER", sampPeriod, output, m_compress);
                         });
 
     fprintf(stderr, "evaluate: writing %d frames of %ls\n", (int) output.cols(), outputFile.c_str());
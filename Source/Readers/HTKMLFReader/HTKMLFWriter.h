@@ -6,9 +6,14 @@
 //
 #pragma once
 #include "DataWriter.h"
+#include "CUDAPageLockedMemAllocator.h"
 #include "ScriptableObjects.h"
+#include "WorkerPool.h"
 #include <map>
 #include <vector>
+#include <deque>
+#include <future>
+#include <memory>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -25,10 +30,21 @@ private:
     std::map<std::wstring, size_t> outputNameToTypeMap;
     unsigned int sampPeriod;
     size_t outputFileIndex;
-    void Save(std::wstring& outputFile, Matrix<ElemType>& outputData);
+    bool m_compress; // write 16-bit compressed features (HTK _C)
+    size_t m_frameSkip;  // the outputs are at 1/m_frameSkip of the frame rate (of a reader with frameSkip)
+    bool m_repeatFrames; // if so, write each output frame m_frameSkip times, else write the reduced rate as is
+    void Save(const std::wstring& outputFile, const ElemType* pValue, size_t numRows, size_t numCols) const;
     ElemType* m_tempArray;
     size_t m_tempArraySize;
 
+    // background writing (writerThreads > 0): SaveData() copies the outputs to host buffers, and the worker
+    // threads convert them and write the files, while the network computes the next minibatch
+    std::unique_ptr<WorkerPool> m_writers;
+    std::deque<std::future<void>> m_pendingWrites; // in order of submission
+    size_t m_maxPendingWrites;                     // bounds the memory held by the host buffers
+    std::shared_ptr<ElemType> AllocateHostBuffer(int deviceId, size_t numElements);
+    void WaitForWrites(size_t maxPending);
+
     enum OutputTypes
     {
         outputReal,
@@ -52,6 +68,7 @@ public:
     virtual void GetSections(std::map<std::wstring, SectionType, nocase_compare>& sections);
     virtual bool SaveData(size_t recordStart, const std::map<std::wstring, void*, nocase_compare>& matrices, size_t numRecords, size_t datasetSize, size_t byteVariableSized);
     virtual void SaveMapping(std::wstring saveId, const std::map<LabelIdType, LabelType>& labelMapping);
+    virtual void Flush() override;
     virtual bool SupportMultiUtterances() const { return false; };
 };
 } } }
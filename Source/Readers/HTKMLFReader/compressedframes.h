@@ -0,0 +1,216 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// compressedframes.h -- compact in-RAM storage of the feature frames of a chunk
+//
+// minibatchutterancesourcemulti keeps all chunks of the randomization window in RAM as float matrices, which for a window of many
+// hours of audio takes tens of GB per process. With a compression kind other than 'none' (reader option featureCompression), a chunk's
+// frames are converted once when it is paged in, and expanded back to float only for the frames that go into a minibatch:
+//  - float16: IEEE half precision, 2 bytes per value (11 significant bits; exact for the usual range of acoustic features)
+//  - int8:    linear quantization to 256 levels between the minimum and maximum of each feature dimension over the chunk, 1 byte per value
+// Frames are stored contiguously without SSE padding. The expansion loops run over a frame's dimensions and are written for the
+// compiler to vectorize; with F16C (-mf16c or /arch:AVX2) half precision is converted in hardware.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ssematrix.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace msra { namespace dbn {
+
+class compressedframes
+{
+public:
+    enum kind
+    {
+        none,
+        float16,
+        int8
+    };
+
+    static kind parsekind(const std::wstring &name)
+    {
+        if (name == L"none")
+            return none;
+        else if (name == L"float16")
+            return float16;
+        else if (name == L"int8")
+            return int8;
+        InvalidArgument("compressedframes: featureCompression must be 'none', 'float16', or 'int8', not '%ls'", name.c_str());
+    }
+
+    compressedframes()
+        : k(none), numrows(0), numcols(0)
+    {
+    }
+
+    bool empty() const
+    {
+        return numrows * numcols == 0;
+    }
+    size_t rows() const
+    {
+        return numrows;
+    }
+    size_t cols() const
+    {
+        return numcols;
+    }
+    size_t sizeinbytes() const
+    {
+        return halfs.size() * sizeof(uint16_t) + bytes.size() + (offset.size() + scale.size()) * sizeof(float);
+    }
+
+    // store 'frames' in compressed form
+    void compress(const msra::dbn::matrixbase &frames, kind newkind)
+    {
+        if (newkind == none)
+            LogicError("compressedframes: compress called without a compression kind");
+        clear();
+        k = newkind;
+        numrows = frames.rows();
+        numcols = frames.cols();
+        if (k == float16)
+        {
+            halfs.resize(numrows * numcols);
+            for (size_t t = 0; t < numcols; t++)
+                for (size_t i = 0; i < numrows; i++)
+                    halfs[t * numrows + i] = floattohalf(frames(i, t));
+        }
+        else
+        {
+            // per dimension, the levels 0..255 span [min, max] over the chunk
+            offset.assign(numrows, 0.0f);
+            scale.assign(numrows, 0.0f);
+            std::vector<float> maxval(numrows, 0.0f);
+            for (size_t i = 0; i < numrows; i++)
+                offset[i] = maxval[i] = numcols > 0 ? frames(i, 0) : 0.0f;
+            for (size_t t = 1; t < numcols; t++)
+                for (size_t i = 0; i < numrows; i++)
+                {
+                    offset[i] = std::min(offset[i], frames(i, t));
+                    maxval[i] = std::max(maxval[i], frames(i, t));
+                }
+            std::vector<float> invscale(numrows, 0.0f);
+            for (size_t i = 0; i < numrows; i++)
+            {
+                scale[i] = (maxval[i] - offset[i]) / 255.0f;
+                invscale[i] = scale[i] > 0 ? 1.0f / scale[i] : 0.0f; // (constant dimension: all levels 0)
+            }
+            bytes.resize(numrows * numcols);
+            for (size_t t = 0; t < numcols; t++)
+                for (size_t i = 0; i < numrows; i++)
+                {
+                    const float level = floorf((frames(i, t) - offset[i]) * invscale[i] + 0.5f);
+                    bytes[t * numrows + i] = (uint8_t) std::max(0.0f, std::min(255.0f, level));
+                }
+        }
+    }
+
+    void clear()
+    {
+        k = none;
+        numrows = numcols = 0;
+        halfs = std::vector<uint16_t>();
+        bytes = std::vector<uint8_t>();
+        offset = std::vector<float>();
+        scale = std::vector<float>();
+    }
+
+    // expand frames [ts, te) into 'out', which is resized to rows() x (te - ts)
+    void expand(size_t ts, size_t te, msra::dbn::matrix &out) const
+    {
+        if (ts > te || te > numcols)
+            LogicError("compressedframes: expand called with frame range [%d, %d) outside of %d frames", (int) ts, (int) te, (int) numcols);
+        out.resize(numrows, te - ts);
+        for (size_t t = ts; t < te; t++)
+        {
+            float *dst = &out(0, t - ts);
+            if (k == float16)
+                halftofloat(&halfs[t * numrows], dst, numrows);
+            else
+            {
+                const uint8_t *src = &bytes[t * numrows];
+                const float *a = offset.data();
+                const float *b = scale.data();
+                for (size_t i = 0; i < numrows; i++)
+                    dst[i] = a[i] + b[i] * (float) src[i];
+            }
+        }
+    }
+
+    // IEEE half precision conversions, rounding to nearest even; overflow gives infinity
+    static uint16_t floattohalf(float value)
+    {
+        uint32_t f;
+        memcpy(&f, &value, sizeof(f));
+        const uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+        uint32_t h;
+        if (f >= 0x47800000u) // (exponent beyond half range, or infinity, or NaN)
+            h = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+        else if (f < 0x38800000u) // (half subnormal or zero: let a float addition do the rounding)
+        {
+            const uint32_t denormmagicbits = ((127 - 15) + (23 - 10) + 1) << 23;
+            float denormmagic, g;
+            memcpy(&denormmagic, &denormmagicbits, sizeof(denormmagic));
+            memcpy(&g, &f, sizeof(g));
+            g += denormmagic;
+            memcpy(&f, &g, sizeof(f));
+            h = f - denormmagicbits;
+        }
+        else
+        {
+            const uint32_t mantissaodd = (f >> 13) & 1;
+            f += ((uint32_t)(15 - 127) << 23) + 0xfff + mantissaodd;
+            h = f >> 13;
+        }
+        return (uint16_t)(h | (sign >> 16));
+    }
+    static void halftofloat(const uint16_t *src, float *dst, size_t n)
+    {
+        size_t i = 0;
+#ifdef __F16C__
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + i))));
+#endif
+        // branch-free, so that it vectorizes: move exponent and mantissa into place and rebias the exponent by a multiplication,
+        // which also normalizes subnormals; then restore infinity and NaN, and the sign
+        const uint32_t magicbits = (254 - 15) << 23;
+        const uint32_t infnanbits = (127 + 16) << 23;
+        float magic, infnan;
+        memcpy(&magic, &magicbits, sizeof(magic));
+        memcpy(&infnan, &infnanbits, sizeof(infnan));
+        for (; i < n; i++)
+        {
+            const uint32_t h = src[i];
+            uint32_t bits = (h & 0x7fff) << 13;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            f *= magic;
+            memcpy(&bits, &f, sizeof(bits));
+            bits |= f >= infnan ? 0x7f800000u : 0;
+            bits |= (h & 0x8000) << 16;
+            memcpy(&dst[i], &bits, sizeof(bits));
+        }
+    }
+
+private:
+    kind k;
+    size_t numrows, numcols;
+    std::vector<uint16_t> halfs; // float16: [t * numrows + i]
+    std::vector<uint8_t> bytes;  // int8: [t * numrows + i], standing for offset[i] + scale[i] * bytes[.]
+    std::vector<float> offset;
+    std::vector<float> scale;
+};
+} }
@@ -21,6 +21,8 @@
 #include <wchar.h>
 #include "simplesenonehmm.h"
 #include <array>
+#include <mutex>
+#include <exception>
 #include "minibatchsourcehelpers.h"
 
 namespace msra { namespace asr {
@@ -142,12 +144,16 @@ protected:
 // ===========================================================================
 // htkfeatwriter -- write HTK feature file
 // This is designed to write a single file only (no archive mode support).
+// Optionally the values are compressed to 16 bits per value (HTK's _C), which halves the file size.
 // ===========================================================================
 
 class htkfeatwriter : protected htkfeatio
 {
     size_t curframe;
     vector<float> tmp;
+    bool compressed;        // values are written as (short) (a[k] * v[k] - b[k])
+    vector<float> a, b;     // for compression
+    vector<short> tmpshort; // for compression
 
 public:
     short parsekind(const string& str)
@@ -205,30 +211,69 @@ public:
         return sampkind;
     }
 
-public:
-    // open the file for writing
-    htkfeatwriter(wstring path, string kind, size_t dim, unsigned int period)
+    void open(const wstring& path, const string& kind, size_t dim, unsigned int period)
     {
         setkind(kind, dim, period, path);
         // write header
         fileheader H;
         H.nsamples = 0; // unknown for now, updated in close()
         H.sampperiod = period;
-        const int bytesPerValue = sizeof(float); // we do not support compression for now
+        const int bytesPerValue = compressed ? sizeof(short) : sizeof(float);
         H.sampsize = (short) featdim * bytesPerValue;
         H.sampkind = parsekind(kind);
+        if (compressed)
+            H.sampkind |= HASCOMPX;
         if (needbyteswapping)
             H.byteswap();
         f = fopenOrDie(path, L"wbS");
         H.write(f);
+        // the values for decompressing; counted as 4 frames in the header
+        if (compressed)
+        {
+            vector<float> ab[2] = {a, b};
+            for (auto& v : ab)
+            {
+                if (needbyteswapping)
+                    msra::util::byteswap(v);
+                fwriteOrDie(v, f);
+            }
+        }
         curframe = 0;
     }
+
+public:
+    // open the file for writing
+    htkfeatwriter(wstring path, string kind, size_t dim, unsigned int period)
+        : compressed(false)
+    {
+        open(path, kind, dim, period);
+    }
+    // open the file for writing compressed values; a value v is stored as the 16-bit integer a * v - b
+    htkfeatwriter(wstring path, string kind, size_t dim, unsigned int period, const vector<float>& a, const vector<float>& b)
+        : compressed(true), a(a), b(b)
+    {
+        if (a.size() != dim || b.size() != dim)
+            LogicError("htkfeatwriter: compression parameters do not match the feature dimension");
+        open(path, kind, dim, period);
+    }
     // write a frame
     void write(const vector<float>& v)
     {
         if (v.size() != featdim)
             LogicError("htkfeatwriter: inconsistent feature dimension");
-        if (needbyteswapping)
+        if (compressed)
+        {
+            tmpshort.resize(v.size());
+            foreach_index (k, v)
+            {
+                const float value = floorf(a[k] * v[k] - b[k] + 0.5f);
+                tmpshort[k] = (short) max(-32767.0f, min(value, 32767.0f));
+            }
+            if (needbyteswapping)
+                msra::util::byteswap(tmpshort);
+            fwriteOrDie(tmpshort, f);
+        }
+        else if (needbyteswapping)
         {
             tmp.resize(v.size());
             foreach_index (k, v)
@@ -250,7 +295,7 @@ public:
             LogicError("htkfeatwriter: inconsistent number of frames passed to close()");
         fflushOrDie(f);
         // now implant the length field; it's at offset 0
-        int nSamplesFile = (int) numframes;
+        int nSamplesFile = (int) numframes + (compressed ? 4 : 0);
         if (needbyteswapping)
             nSamplesFile = swapint(nSamplesFile);
         fseekOrDie(f, 0);
@@ -258,11 +303,12 @@ public:
         fflushOrDie(f);
         f = NULL; // this triggers an fclose() on auto_file_ptr
     }
-    // read an entire utterance into a matrix
-    // Matrix type needs to have operator(i,j) and resize(n,m).
+    // write an entire utterance from a matrix
+    // Matrix type needs to have operator(i,j), rows() and cols().
     // We write to a tmp file first to ensure we don't leave broken files that would confuse make mode.
+    // If 'compress', each dimension is mapped linearly from its range in this utterance onto 16-bit integers.
     template <class MATRIX>
-    static void write(const wstring& path, const string& kindstr, unsigned int period, const MATRIX& feat)
+    static void write(const wstring& path, const string& kindstr, unsigned int period, const MATRIX& feat, bool compress = false)
     {
         wstring tmppath = path + L"$$"; // tmp path for make-mode compliant
         unlinkOrDie(path);              // delete if old file is already there
@@ -270,7 +316,35 @@ public:
         size_t featdim = feat.rows();
         size_t numframes = feat.cols();
         vector<float> v(featdim);
-        htkfeatwriter W(tmppath, kindstr, feat.rows(), period);
+        unique_ptr<htkfeatwriter> pW;
+        if (compress)
+        {
+            vector<float> a(featdim), b(featdim);
+            for (size_t k = 0; k < featdim; k++)
+            {
+                float xmin = numframes > 0 ? (float) feat(k, 0) : 0.0f;
+                float xmax = xmin;
+                for (size_t i = 1; i < numframes; i++)
+                {
+                    xmin = min(xmin, (float) feat(k, i));
+                    xmax = max(xmax, (float) feat(k, i));
+                }
+                if (xmax > xmin)
+                {
+                    a[k] = 2 * 32767.0f / (xmax - xmin);
+                    b[k] = (xmax + xmin) * 32767.0f / (xmax - xmin);
+                }
+                else // constant: all values map to 0
+                {
+                    a[k] = 1.0f;
+                    b[k] = xmin;
+                }
+            }
+            pW.reset(new htkfeatwriter(tmppath, kindstr, featdim, period, a, b));
+        }
+        else
+            pW.reset(new htkfeatwriter(tmppath, kindstr, featdim, period));
+        htkfeatwriter& W = *pW;
 #ifdef SAMPLING_EXPERIMENT
         for (size_t i = 0; i < numframes; i++)
         {
@@ -341,9 +415,11 @@ public:
     // parser for complex a=b[s,e] syntax
     struct parsedpath
     {
-        // Note: This is not thread-safe
+        // Archive paths are interned here. Constructing parsedpaths concurrently is thread-safe (so SCP files can be parsed in parallel),
+        // but archivepath() must not be called while others are being constructed.
         static std::unordered_map<std::wstring, unsigned int> archivePathStringMap;
         static std::vector<std::wstring> archivePathStringVector;
+        static std::mutex archivePathStringMutex;
 
     protected:
         friend class htkfeatreader;
@@ -423,6 +499,7 @@ public:
                 }
             }
 
+            std::lock_guard<std::mutex> lock(archivePathStringMutex);
             auto iter = archivePathStringMap.find(archivepath);
             if (iter != archivePathStringMap.end())
             {
@@ -846,7 +923,7 @@ class htkmlfreader : public map<wstring, vector<ENTRY>> // [key][i] the data
     map<wstring, WORDSEQUENCE> wordsequences;        // [key] word sequences (if we are building word entries as well, for MMI)
     std::unordered_map<std::string, size_t> symmap;
 
-    void strtok(char* s, const char* delim, vector<char*>& toks)
+    static void strtok(char* s, const char* delim, vector<char*>& toks)
     {
         toks.resize(0);
         char* context = nullptr;
@@ -874,11 +951,9 @@ class htkmlfreader : public map<wstring, vector<ENTRY>> // [key][i] the data
         return lines;
     }
 
-    template <typename WORDSYMBOLTABLE, typename UNITSYMBOLTABLE>
-    void parseentry(const vector<std::string>& lines, size_t line, const set<wstring>& restricttokeys,
-                    const WORDSYMBOLTABLE* wordmap, const UNITSYMBOLTABLE* unitmap,
-                    vector<typename WORDSEQUENCE::word>& wordseqbuffer, vector<typename WORDSEQUENCE::aligninfo>& alignseqbuffer,
-                    const double htkTimeToFrame)
+    // parse the key of an MLF entry; returns false if the entry is to be skipped
+    // On success, [s,e) is the range of its label lines. This does not modify the reader, so it may be called concurrently.
+    bool parsekey(const vector<std::string>& lines, size_t line, const set<wstring>& restricttokeys, wstring& key, size_t& s, size_t& e) const
     {
         size_t idx = 0;
         string filename = lines[idx++];
@@ -890,25 +965,95 @@ class htkmlfreader : public map<wstring, vector<ENTRY>> // [key][i] the data
         {
             fprintf(stderr, "warning: filename entry (%s)\n", filename.c_str());
             fprintf(stderr, "skip current mlf entry from line (%lu) until line (%lu).\n", line + idx, line + lines.size());
-            return;
+            return false;
         }
 
         filename = filename.substr(1, filename.length() - 2); // strip quotes
         if (filename.find("*/") == 0)
             filename = filename.substr(2);
 #ifdef _MSC_VER
-        wstring key = msra::strfun::utf16(regex_replace(filename, regex("\\.[^\\.\\\\/:]*$"), string())); // delete extension (or not if none)
+        key = msra::strfun::utf16(regex_replace(filename, regex("\\.[^\\.\\\\/:]*$"), string())); // delete extension (or not if none)
 #else
-        wstring key = msra::strfun::utf16(msra::dbn::removeExtension(filename)); // note that c++ 4.8 is incomplete for supporting regex
+        key = msra::strfun::utf16(msra::dbn::removeExtension(filename)); // note that c++ 4.8 is incomplete for supporting regex
 #endif
 
         // determine lines range
-        size_t s = idx;
-        size_t e = lines.size() - 1;
+        s = idx;
+        e = lines.size() - 1;
         // lines range: [s,e)
 
         // don't parse unused entries (this is supposed to be used for very small debugging setups with huge MLFs)
-        if (!restricttokeys.empty() && restricttokeys.find(key) == restricttokeys.end())
+        return restricttokeys.empty() || restricttokeys.find(key) != restricttokeys.end();
+    }
+
+    // parse the label lines [s,e) of an MLF entry (without word sequences); may be called concurrently
+    void parselabels(const vector<std::string>& lines, size_t s, size_t e, vector<ENTRY>& entries, const double htkTimeToFrame)
+    {
+        entries.resize(e - s);
+        vector<char*> toks;
+        for (size_t i = s; i < e; i++)
+        {
+            // We can mutate the original string as it is no longer needed after tokenization
+            strtok(const_cast<char*>(lines[i].c_str()), " \t", toks);
+            if (statelistmap.size() == 0)
+                entries[i - s].parse(toks, htkTimeToFrame);
+            else
+                entries[i - s].parsewithstatelist(toks, statelistmap, htkTimeToFrame, symmap); // (only looks up statelistmap and symmap)
+        }
+    }
+
+    // parse a batch of complete MLF entries without word sequences, in parallel, and add them in file order
+    // Adding them in order keeps the result, including duplicate detection and the restricttokeys cut-off, identical to parsing one by one.
+    void parseentries(const vector<vector<std::string>>& batch, const vector<size_t>& batchlines, const set<wstring>& restricttokeys, const double htkTimeToFrame)
+    {
+        vector<wstring> keys(batch.size());
+        vector<vector<ENTRY>> entries(batch.size());
+        vector<char> parsed(batch.size(), 0);
+        std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 64)
+        for (long k = 0; k < (long) batch.size(); k++)
+        {
+            try
+            {
+                size_t s, e;
+                if (parsekey(batch[k], batchlines[k], restricttokeys, keys[k], s, e))
+                {
+                    parselabels(batch[k], s, e, entries[k], htkTimeToFrame);
+                    parsed[k] = 1;
+                }
+            }
+            catch (...) // exceptions must not leave the parallel region
+            {
+#pragma omp critical
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+
+        for (size_t k = 0; k < batch.size(); k++)
+        {
+            if (!restricttokeys.empty() && this->size() >= restricttokeys.size())
+                break;
+            if (!parsed[k])
+                continue;
+            vector<ENTRY>& e = (*this)[keys[k]]; // this creates a new entry
+            if (!e.empty())
+                malformed(msra::strfun::strprintf("duplicate entry '%ls'", keys[k].c_str()));
+            e.swap(entries[k]);
+        }
+    }
+
+    template <typename WORDSYMBOLTABLE, typename UNITSYMBOLTABLE>
+    void parseentry(const vector<std::string>& lines, size_t line, const set<wstring>& restricttokeys,
+                    const WORDSYMBOLTABLE* wordmap, const UNITSYMBOLTABLE* unitmap,
+                    vector<typename WORDSEQUENCE::word>& wordseqbuffer, vector<typename WORDSEQUENCE::aligninfo>& alignseqbuffer,
+                    const double htkTimeToFrame)
+    {
+        wstring key;
+        size_t s, e;
+        if (!parsekey(lines, line, restricttokeys, key, s, e))
             return;
 
         vector<ENTRY>& entries = (*this)[key]; // this creates a new entry
@@ -1064,6 +1209,18 @@ public:
         std::vector<char> currBlockBuf(readBlockSize + 1);
         size_t currLineNum = 1;
         std::vector<string> currMLFLines;
+        // Without word sequences, entries do not depend on each other and are parsed in parallel, a batch at a time.
+        // Word sequences (MMI) are parsed one by one, since looking up the word map may modify it.
+        const bool parallel = (wordmap == NULL);
+        const size_t batchSize = 16384; // entries
+        std::vector<std::vector<string>> batch;
+        std::vector<size_t> batchLines;
+        auto flushBatch = [&]()
+        {
+            parseentries(batch, batchLines, restricttokeys, htkTimeToFrame);
+            batch.clear();
+            batchLines.clear();
+        };
         bool reachedEOF = (feof(f) != 0);
         char* nextReadPtr = currBlockBuf.data();
         size_t nextReadSize = readBlockSize;
@@ -1089,7 +1246,15 @@ public:
                 {
                     if (restricttokeys.empty() || (this->size() < restricttokeys.size()))
                     {
-                        parseentry(currMLFLines, currLineNum - currMLFLines.size(), restricttokeys, wordmap, unitmap, wordsequencebuffer, alignsequencebuffer, htkTimeToFrame);
+                        if (parallel)
+                        {
+                            batchLines.push_back(currLineNum - currMLFLines.size());
+                            batch.push_back(std::move(currMLFLines));
+                            if (batch.size() >= batchSize)
+                                flushBatch();
+                        }
+                        else
+                            parseentry(currMLFLines, currLineNum - currMLFLines.size(), restricttokeys, wordmap, unitmap, wordsequencebuffer, alignsequencebuffer, htkTimeToFrame);
                     }
 
                     currMLFLines.clear();
@@ -1125,6 +1290,8 @@ public:
             }
         }
 
+        if (!batch.empty())
+            flushBatch();
         if (!currMLFLines.empty())
             malformed("unexpected end in mid-utterance");
 
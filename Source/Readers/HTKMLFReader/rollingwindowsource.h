@@ -2,7 +2,7 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
-// rollingwindowsource.h -- implementation of a rolling-window minibatch source ('minibatchframesource') with a disk page file
+// rollingwindowsource.h -- implementation of a rolling-window minibatch source ('minibatchframesource') with a memory-mapped feature store
 //
 
 #pragma once
@@ -15,24 +15,74 @@
 #include "minibatchiterator.h"
 #include "biggrowablevectors.h"
 #include "ssematrix.h"
+#include "fileutil.h"
+#include <memory>
 
 namespace msra { namespace dbn {
 
 // ---------------------------------------------------------------------------
 // biggrowablevectorarray -- a big array of vectors for features, growable (push_back)
 // Data is striped across NUMA nodes, as to not clog them up.
-// This also supports paging to disk, which is used for the old minibatchframesource.
+// With a page path (used for the old minibatchframesource), the frames are instead written to a feature store
+// file while they are pushed, and the file is memory-mapped read-only once population is done. Paging is then left
+// to the OS page cache; require() only passes prefetch/release hints for the frame range of the randomization window.
+// A persistent store is kept after the job and reused by the next job over the same input files, which then does not
+// read the features at all. The per-file frame counts kept in the store allow the caller to replay its file selection.
 // ---------------------------------------------------------------------------
+
+// layout of a feature store file: this header, padded to featurestoredataoffset; then the frames, each 'colstride' floats
+// (written in blocks of 'elementsperblock' frames); then the table of per-file frame counts and flags at 'tableoffset'
+struct featurestoreheader
+{
+    char magic[8];          // featurestoremagic
+    uint64_t signature;     // hash of the input file list and reader options the store was created from
+    uint64_t numframes;
+    uint64_t dim;
+    uint64_t colstride;     // floats per frame (dim rounded up for SSE)
+    uint64_t tableoffset;   // byte offset of numutterances uint64_t frame counts, followed by numutterances char 'stored' flags
+    uint64_t numutterances; // number of input files, including those whose frames are not stored
+    uint32_t sampperiod;
+    char featkind[20];
+};
+static const char featurestoremagic[8] = {'C', 'N', 'T', 'K', 'F', 'S', 'T', '1'};
+static const size_t featurestoredataoffset = 4096; // frames start page-aligned, which keeps every column SSE-aligned
+
+// one frame of the mapped feature store, viewed as a matrix so that it can be referenced by a matrixstripe
+class mappedfeatureframe : public msra::dbn::matrixbase
+{
+public:
+    mappedfeatureframe(const float *data, size_t dim, size_t colstride)
+    {
+        this->p = const_cast<float *>(data); // (read-only mapping: the stripes handed out are const)
+        this->numrows = dim;
+        this->numcols = 1;
+        this->colstride = colstride;
+    }
+};
+
 class biggrowablevectorarray : public growablevectorbase<msra::dbn::matrix>
 {
     size_t m; // dim
 
-    size_t inmembegin; // range we have in memory, rounded to enclosing blocks (not rounded at end)
+    size_t inmembegin; // range we have declared as needed, rounded to enclosing blocks (not rounded at end)
     size_t inmemend;
 
-    wstring pagepath; // path for paging, empty if no paging
-    auto_file_ptr f;  // file handle for paging
-    bool reading;     // have we begun reading?
+    wstring pagepath;  // path of the feature store, empty if no paging
+    bool keepstore;    // persistent store: keep it after the job, reuse it if it matches
+    uint64_t signature;
+    bool reused;       // the store was created by an earlier job; nothing gets pushed
+    auto_file_ptr f;   // file handle while populating the store
+    bool reading;      // have we begun reading?
+
+    // per input file: frames read, and whether they are in the store (see addutterance())
+    std::vector<size_t> utterancelengths;
+    std::vector<char> utterancestored;
+    string featkind;
+    unsigned int sampperiod;
+
+    // the mapped store
+    std::unique_ptr<msra::files::mappedfile> mapped;
+    size_t colstride;
 
     // allocate a block
     msra::dbn::matrix *newblock() const
@@ -48,48 +98,25 @@ class biggrowablevectorarray : public growablevectorbase<msra::dbn::matrix>
         return res;
     }
 
-    // handling of page file
+    // handling of the feature store
     bool paging() const
     {
         return !pagepath.empty();
     }
-    void openpagefile(bool wantread)
+    // a persistent store is written under a temporary name and renamed when complete, so that an aborted job leaves no partial store
+    wstring writepath() const
+    {
+        return keepstore ? pagepath + L".tmp" : pagepath;
+    }
+    void createpagefile()
     {
         if (!paging())
             return;
         msra::files::make_intermediate_dirs(pagepath);
-
-        if (!wantread)
-        {
-            FILE *ftry = NULL;
-            wstring pathname(pagepath);
-            ftry = _wfopen(pathname.c_str(), L"wbS");
-            if (ftry)
-                fclose(ftry);
-        }
-
-        /*
-                code below to cycle through a-z appended to file name is no longer necessary
-                since caller guarantees unique file names via HTKMLFReader
-                and we want the pagepath logged to the user to be the actual one used by the code
-
-            // try to open the pagepath from a to z
-            if (!wantread)
-            {
-                FILE *ftry = NULL;
-                char trynum = 'a';
-                while (!ftry && trynum <= 'z')
-                {
-                    wstring pathname (pagepath);
-                    pathname += trynum++;
-                    ftry = _wfopen (pathname.c_str(), L"wbS");
-                }
-                if (ftry) fclose (ftry);
-                pagepath += --trynum;
-            }
-            */
-        f = fopenOrDie(pagepath, wantread ? L"rbS" : L"wbS");
-        reading = wantread;
+        f = fopenOrDie(writepath(), L"wbS");
+        std::vector<char> placeholder(featurestoredataoffset, 0); // header is written at the end
+        fwriteOrDie(placeholder, f);
+        reading = false;
     }
     void flushlastblock() // during population phase, must be called once per block in sequence
     {
@@ -100,52 +127,135 @@ class biggrowablevectorarray : public growablevectorbase<msra::dbn::matrix>
             return;
         const size_t blockid = blocks.size() - 1;
         msra::dbn::matrix &block = *blocks[blockid];
-        assert(fgetpos(f) == blockid * block.sizeinpagefile());
+        assert(fgetpos(f) == featurestoredataoffset + blockid * block.sizeinpagefile());
         block.topagefile(f);
         blocks[blockid].reset(); // free the memory
         assert(blockid * elementsperblock == inmembegin);
         inmembegin = inmemend; // empty range
     }
-    void releaseblock(size_t t0) // t0=block start time
+
+    // read and check the header of an existing store; returns false if it cannot be used
+    bool openstore()
     {
-        assert(paging() && reading);
-        size_t blockid = t0 / elementsperblock;
-        assert(blockid * elementsperblock == t0);
-        assert(blocks[blockid]);
-        fprintf(stderr, "recoverblock: releasing feature block %d [%d..%d)\n", (int) blockid, (int) t0, (int) (t0 + elementsperblock - 1));
-        blocks[blockid].reset(); // free the memory
+        if (!fexists(pagepath))
+            return false;
+        featurestoreheader header;
+        {
+            auto_file_ptr fstore(fopenOrDie(pagepath, L"rbS"));
+            if (fread(&header, sizeof(header), 1, fstore) != 1 || memcmp(header.magic, featurestoremagic, sizeof(header.magic)) != 0)
+            {
+                fprintf(stderr, "biggrowablevectorarray: ignoring invalid feature store '%ls'\n", pagepath.c_str());
+                return false;
+            }
+            if (header.signature != signature)
+            {
+                fprintf(stderr, "biggrowablevectorarray: feature store '%ls' was created from different input files, recreating it\n", pagepath.c_str());
+                return false;
+            }
+            utterancelengths.resize((size_t) header.numutterances);
+            utterancestored.resize((size_t) header.numutterances);
+            fsetpos(fstore, header.tableoffset);
+            for (auto &length : utterancelengths)
+            {
+                uint64_t length64;
+                freadOrDie(&length64, sizeof(length64), 1, fstore);
+                length = (size_t) length64;
+            }
+            if (!utterancestored.empty())
+                freadOrDie(&utterancestored[0], sizeof(char), utterancestored.size(), fstore);
+        }
+        n = (size_t) header.numframes;
+        m = (size_t) header.dim;
+        colstride = (size_t) header.colstride;
+        sampperiod = header.sampperiod;
+        header.featkind[sizeof(header.featkind) - 1] = 0;
+        featkind = header.featkind;
+        mapstore(pagepath);
+        if (mapped->size() < featurestoredataoffset + n * colstride * sizeof(float))
+            RuntimeError("biggrowablevectorarray: feature store '%ls' is truncated", pagepath.c_str());
+        return true;
     }
-    void recoverblock(size_t t0) // t0=block start time
+
+    // write table and header, and switch to the mapped file
+    void finishstore()
     {
-        assert(paging() && reading);
-        size_t blockid = t0 / elementsperblock;
-        assert(blockid * elementsperblock == t0);
-        assert(!blocks[blockid]);
-        fprintf(stderr, "recoverblock: recovering feature block %d [%d..%d)\n", (int) blockid, (int) t0, (int) (t0 + elementsperblock - 1));
-        blocks[blockid].reset(newblock());
-        msra::dbn::matrix &block = *blocks[blockid];
-        fsetpos(f, blockid * block.sizeinpagefile());
-        block.frompagefile(f);
+        const uint64_t tableoffset = fgetpos(f);
+        for (auto length : utterancelengths)
+        {
+            uint64_t length64 = length;
+            fwriteOrDie(&length64, sizeof(length64), 1, f);
+        }
+        fwriteOrDie(utterancestored, f);
+
+        featurestoreheader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, featurestoremagic, sizeof(header.magic));
+        header.signature = signature;
+        header.numframes = n;
+        header.dim = m;
+        header.colstride = (m + 3) & ~3; // same padding as msra::dbn::matrix
+        header.tableoffset = tableoffset;
+        header.numutterances = utterancestored.size();
+        header.sampperiod = sampperiod;
+        strncpy(header.featkind, featkind.c_str(), sizeof(header.featkind) - 1);
+        fsetpos(f, (uint64_t) 0);
+        fwriteOrDie(&header, sizeof(header), 1, f);
+        fflushOrDie(f);
+        fprintf(stderr, "biggrowablevectorarray: feature store created, %d frames, %lu bytes\n", (int) n, (unsigned long) tableoffset);
+        fclose(f);
+
+        if (keepstore)
+        {
+            if (fexists(pagepath))
+                unlinkOrDie(pagepath);
+            renameOrDie(writepath(), pagepath);
+        }
+        colstride = (size_t) header.colstride;
+        mapstore(pagepath);
+    }
+
+    void mapstore(const wstring &path)
+    {
+        mapped.reset(new msra::files::mappedfile(path));
+        reading = true;
+    }
+
+    void unmapstore()
+    {
+        mapped.reset();
+    }
+
+    const float *mappedframe(size_t t) const
+    {
+        return (const float *) (mapped->data() + featurestoredataoffset + t * colstride * sizeof(float));
+    }
+
+    // tell the OS that frames [t0, t1) will be needed soon (prefetch) or not anymore (may be evicted from the page cache)
+    void advise(size_t t0, size_t t1, bool willneed) const
+    {
+        if (t0 < t1)
+            mapped->advise((const char *) mappedframe(t0) - mapped->data(), (const char *) mappedframe(t1) - mapped->data(), willneed);
     }
 
 public:
-    biggrowablevectorarray(const wstring &pagepath)
-        : growablevectorbase(65536), m(0), inmembegin(0), inmemend(0), pagepath(pagepath), reading(false)
+    // keepstore: if a store created from the same 'signature' exists at 'pagepath', use it; otherwise create it and keep it after the job
+    biggrowablevectorarray(const wstring &pagepath, bool keepstore = false, uint64_t signature = 0)
+        : growablevectorbase(65536), m(0), inmembegin(0), inmemend(0), pagepath(pagepath), keepstore(keepstore && !pagepath.empty()), signature(signature),
+          reused(false), reading(false), sampperiod(0), colstride(0)
     {
-        openpagefile(false);
+        if (this->keepstore && openstore())
+        {
+            reused = true;
+            fprintf(stderr, "biggrowablevectorarray: reusing feature store '%ls', %d frames\n", pagepath.c_str(), (int) n);
+            return;
+        }
+        createpagefile();
         if (paging())
-            fprintf(stderr, "biggrowablevectorarray: creating disk backup store at '%ls'\n", pagepath.c_str());
+            fprintf(stderr, "biggrowablevectorarray: creating feature store at '%ls'\n", pagepath.c_str());
     }
     ~biggrowablevectorarray()
-    { // clean up the big temp file
-        if (paging())
-        {
-            fclose(f);
-            if (_wunlink(pagepath.c_str()) == 0)
-                fprintf(stderr, "biggrowablevectorarray: deleted disk backup store at '%ls'\n", pagepath.c_str());
-            else
-                fprintf(stderr, "biggrowablevectorarray: unable to delete disk backup store at '%ls'\n", pagepath.c_str());
-        }
+    {
+        cleanuppagefile();
     }
 
     size_t dim() const
@@ -153,9 +263,16 @@ public:
         return m;
     } // dimension of a frame
 
+    // the store was created by an earlier job: the caller must not push_back(), and gets the frame counts from utterancelength()
+    bool isreused() const
+    {
+        return reused;
+    }
+
     // reading phase
     void push_back(const std::vector<float> &in)
     {
+        assert(!reused);
         assert(!in.empty());
         assert(m == 0 || m == in.size());
         m = in.size();
@@ -173,52 +290,72 @@ public:
         n++;
         inmemend = n;
     }
+    // record input file i: 'numframes' frames read from it, which were pushed if 'stored'; must be called for each file in order
+    void addutterance(size_t numframes, bool stored)
+    {
+        assert(!reused);
+        utterancelengths.push_back(numframes);
+        utterancestored.push_back(stored ? 1 : 0);
+    }
+    size_t numutterances() const
+    {
+        return utterancelengths.size();
+    }
+    size_t utterancelength(size_t i) const
+    {
+        return utterancelengths[i];
+    }
+    bool utteranceisstored(size_t i) const
+    {
+        return utterancestored[i] != 0;
+    }
+    void setfeatureinfo(const string &kind, unsigned int period)
+    {
+        featkind = kind;
+        sampperiod = period;
+    }
+    void getfeatureinfo(string &kind, unsigned int &period) const
+    {
+        kind = featkind;
+        period = sampperiod;
+    }
     void no_more_push_back() // done pushing --switch to consumption mode
     {
-        if (!paging())
+        if (!paging() || reused)
             return;
         // finish off last block
         flushlastblock();
-        fflushOrDie(f);
-        fprintf(stderr, "biggrowablevectorarray: disk backup store created, %d frames, %lu bytes\n", (int) n, fgetpos(f));
-        fclose(f);
         foreach_index (i, blocks)
             assert(!blocks[i]);         // ensure we flushed
         assert(inmembegin == inmemend); // nothing in cache
         // switch to reading mode
-        openpagefile(true);
+        finishstore();
+        inmembegin = inmemend = 0;
     }
 
     // access phase
-    // Returns 'true' if data was actually read from disk.
+    // Returns 'true' if the range reaches beyond the previously required one, i.e. data may have to be read from disk.
     bool require(pair<size_t, size_t> bounds) // we require this range of frames
     {
-        bool readfromdisk = false;
+        assert(paging() && reading);
 
         // get bounds rounded to block boundaries
         const size_t ts = bounds.first / elementsperblock * elementsperblock;
         const size_t te = min(n, (bounds.second + elementsperblock - 1) / elementsperblock * elementsperblock);
-        assert(paging());
-        // free all the memmory
-        for (size_t t = inmembegin; t < inmemend; t += elementsperblock)
+        if (ts == inmembegin && te == inmemend)
+            return false;
+        // release what is no longer needed, and prefetch what is newly needed
+        advise(inmembegin, min(inmemend, ts), false);
+        advise(max(inmembegin, te), inmemend, false);
+        const bool overlap = ts < inmemend && inmembegin < te;
+        if (overlap)
         {
-            if (t >= ts && t < te) // if in wanted range then skip to end of it
-                t = te - elementsperblock;
-            else
-                releaseblock(t);
+            advise(ts, inmembegin, true);
+            advise(inmemend, te, true);
         }
-        // page in all required blocks
-        for (size_t t = ts; t < te; t += elementsperblock)
-        {
-            if (t >= inmembegin && t < inmemend) // if in memory already then skip to end of it
-                t = inmemend - elementsperblock;
-            else
-            {
-                recoverblock(t);
-                readfromdisk = true; // tell caller we did something expensive
-            }
-        }
-        // got it
+        else
+            advise(ts, te, true);
+        const bool readfromdisk = !overlap || ts < inmembegin || te > inmemend;
         inmembegin = ts;
         inmemend = te;
         return readfromdisk;
@@ -227,6 +364,11 @@ public:
     {
         if (t < inmembegin || t >= inmemend)
             LogicError("biggrowablevectorarray: attempt to access vector without requesting to page it in first");
+        if (mapped)
+        {
+            mappedfeatureframe frame(mappedframe(t), m, colstride);
+            return msra::dbn::matrixstripe(frame, 0, 1);
+        }
         const size_t blockt = getblockt(t);
         /*const*/ msra::dbn::matrix &block = getblock(t);
         return msra::dbn::matrixstripe(block, blockt, 1);
@@ -237,18 +379,18 @@ public:
     }
     void cleanuppagefile()
     {
-        if (paging())
-        {
+        unmapstore();
+        if (!paging())
+            return;
+        if (f)
             fclose(f);
-            if (_wunlink(pagepath.c_str()) == 0)
-            {
-                fprintf(stderr, "biggrowablevectorarray: deleted disk backup store at '%ls'\n", pagepath.c_str());
-            }
-            else
-            {
-                fprintf(stderr, "biggrowablevectorarray: could NOT delete disk backup store at '%ls'\n", pagepath.c_str());
-            }
-        }
+        if (keepstore && reading)
+            return; // complete persistent store: keep for the next job
+        if (_wunlink(writepath().c_str()) == 0)
+            fprintf(stderr, "biggrowablevectorarray: deleted feature store '%ls'\n", writepath().c_str());
+        else
+            fprintf(stderr, "biggrowablevectorarray: could NOT delete feature store '%ls'\n", writepath().c_str());
+        pagepath.clear();
     }
 };
 
@@ -557,11 +699,31 @@ class minibatchframesourcemulti : public minibatchsource
     double timegetbatch;
     int verbosity;
 
+    // identifies the features a store holds: FNV-1a hash of the input file list and the options that affect the features read
+    static uint64_t featurestoresignature(const std::vector<wstring> &infiles, int addEnergy)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](uint64_t value)
+        {
+            hash = (hash ^ value) * 1099511628211ull;
+        };
+        for (const auto &infile : infiles)
+        {
+            for (auto c : infile)
+                add((uint32_t) c); // (wchar_t differs in size across platforms)
+            add(0);
+        }
+        add((uint64_t) addEnergy);
+        return hash;
+    }
+
 public:
     // constructor
     // Pass empty labels to denote unsupervised training (so getbatch() will not return uids).
+    // With keepfeaturestores, the page files are persistent feature stores that are reused if they were created from the same input files.
     minibatchframesourcemulti(const std::vector<std::vector<wstring>> &infiles, const std::vector<map<std::wstring, std::vector<msra::asr::htkmlfentry>>> &labels,
-                              std::vector<size_t> vdim, std::vector<size_t> udim, std::vector<size_t> leftcontext, std::vector<size_t> rightcontext, size_t randomizationrange, const std::vector<wstring> &pagepath, const bool mayhavenoframe = false, int addEnergy = 0)
+                              std::vector<size_t> vdim, std::vector<size_t> udim, std::vector<size_t> leftcontext, std::vector<size_t> rightcontext, size_t randomizationrange, const std::vector<wstring> &pagepath, const bool mayhavenoframe = false, int addEnergy = 0,
+                              bool keepfeaturestores = false)
         : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), numframes(0), timegetbatch(0), verbosity(2), maxvdim(0)
     {
 
@@ -588,7 +750,7 @@ public:
 
         foreach_index (i, infiles)
         {
-            pframes.push_back(unique_ptr<biggrowablevectorarray>(new biggrowablevectorarray(pagepath[i])));
+            pframes.push_back(unique_ptr<biggrowablevectorarray>(new biggrowablevectorarray(pagepath[i], keepfeaturestores, featurestoresignature(infiles[i], addEnergy))));
 
             if (vdim[i] > maxvdim)
                 maxvdim = vdim[i];
@@ -611,6 +773,21 @@ public:
             msra::asr::htkfeatreader reader; // feature reader
             reader.AddEnergy(addEnergy);
 
+            // a reused feature store must have been created with the same selection of files as the current labels give
+            biggrowablevectorarray &store = *pframes[m];
+            const bool reused = store.isreused();
+            if (reused)
+            {
+                if (store.numutterances() != infiles[m].size())
+                    RuntimeError("minibatchframesourcemulti: feature store '%ls' is inconsistent with the input file list", store.pagepathname().c_str());
+                featdim = store.dim();
+                store.getfeatureinfo(featkind, sampperiod);
+            }
+            auto storemismatch = [&store]()
+            {
+                RuntimeError("minibatchframesourcemulti: feature store '%ls' was created with a different label set; delete it to recreate it", store.pagepathname().c_str());
+            };
+
             foreach_index (i, infiles[m]) // read each feature file in set m
             {
                 if (i % (infiles[m].size() / 100 + 1) == 0)
@@ -638,6 +815,13 @@ public:
                             if (notfound < 5)
                                 fprintf(stderr, "\nminibatchframesourcemulti: %d-th file not found in MLF label set: %ls", i, key.c_str());
                             notfound++;
+                            if (vdim[m] != 0)
+                            {
+                                if (!reused)
+                                    store.addutterance(0, false);
+                                else if (store.utteranceisstored(i))
+                                    storemismatch();
+                            }
                             continue; // skip this utterance at all
                         }
                     }
@@ -645,40 +829,61 @@ public:
                 // get feature frames
                 if (vdim[m] != 0) // (vdim == special mode to not read features at all)
                 {
-                    msra::util::attempt(5, [&]()
-                                        {
-                                            reader.read(ppath, featkind, sampperiod, feat); // whole file read as columns of feature vectors
-                                        });
-                    if (featdim == 0) // first time
-                        featdim = feat.rows();
-                    else if (featdim != feat.rows())
-                        RuntimeError("minibatchframesourcemulti: inconsistent feature dimension across files");
+                    size_t uttframes; // number of frames of this file
+                    if (reused)       // frames are already in the store
+                    {
+                        uttframes = store.utterancelength(i);
+                        if (uttframes == 0) // (the file was not read when the store was created)
+                            storemismatch();
+                    }
+                    else
+                    {
+                        msra::util::attempt(5, [&]()
+                                            {
+                                                reader.read(ppath, featkind, sampperiod, feat); // whole file read as columns of feature vectors
+                                            });
+                        if (featdim == 0) // first time
+                            featdim = feat.rows();
+                        else if (featdim != feat.rows())
+                            RuntimeError("minibatchframesourcemulti: inconsistent feature dimension across files");
+                        uttframes = feat.cols();
+                    }
                     // HVite occasionally generates mismatching output --skip such files
                     if (!key.empty()) // (we have a key if supervised mode)
                     {
                         const auto &labseq = labels[0].find(key)->second; // (we already checked above that it exists)
                         size_t labframes = labseq.empty() ? 0 : (labseq[labseq.size() - 1].firstframe + labseq[labseq.size() - 1].numframes);
-                        if (abs((int) labframes - (int) feat.cols()) > 0)
+                        if (abs((int) labframes - (int) uttframes) > 0)
                         {
-                            fprintf(stderr, "\nminibatchframesourcemulti: %d-th file has small duration mismatch (%d in label vs. %d in feat file), skipping: %ls", i, (int) labframes, (int) feat.cols(), key.c_str());
+                            fprintf(stderr, "\nminibatchframesourcemulti: %d-th file has small duration mismatch (%d in label vs. %d in feat file), skipping: %ls", i, (int) labframes, (int) uttframes, key.c_str());
                             notfound++;
+                            if (!reused)
+                                store.addutterance(uttframes, false);
+                            else if (store.utteranceisstored(i))
+                                storemismatch();
                             continue; // skip this utterance at all
                         }
                     }
+                    if (reused && !store.utteranceisstored(i))
+                        storemismatch();
                     // append to cache
                     frame.resize(featdim);
-                    if (feat.cols() < 2) // (2 frames needed for boundary markers)
+                    if (uttframes < 2) // (2 frames needed for boundary markers)
                         RuntimeError("minibatchframesourcemulti: utterances < 2 frames not supported");
-                    foreach_column (t, feat)
+                    for (size_t t = 0; t < uttframes; t++)
                     {
-                        foreach_index (k, frame)
-                            frame[k] = feat(k, t);
-
-                        pframes[m]->push_back(frame);
+                        if (!reused)
+                        {
+                            foreach_index (k, frame)
+                                frame[k] = feat(k, t);
+                            store.push_back(frame);
+                        }
                         numframes++;
                         if (m == 0)
-                            boundaryflags.push_back((t == 0) ? -1 : (t == feat.cols() - 1) ? +1 : 0);
+                            boundaryflags.push_back((t == 0) ? -1 : (t == uttframes - 1) ? +1 : 0);
                     }
+                    if (!reused)
+                        store.addutterance(uttframes, true);
                     if (m == 0)
                         framesaccum.push_back(numframes);
                     else
@@ -745,7 +950,9 @@ public:
                     RuntimeError("minibatchframesourcemulti: too many files not found in label set--assuming broken configuration\n");
             }
             // notify frames source to switch from population to consumption mode
-            pframes[m]->no_more_push_back();
+            if (!reused)
+                store.setfeatureinfo(featkind, sampperiod);
+            store.no_more_push_back();
         }
 
         if (numframes == 0 && !mayhavenoframe)
@@ -0,0 +1,365 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// utterancecache.h -- persistent cache of preprocessed features and parsed labels for the utterance source
+//
+// minibatchutterancesourcemulti pages in features chunk by chunk, and each page-in re-opens the HTK files of the chunk and converts
+// their frames again. With a cache directory, the frames of a chunk are written to one cache file the first time they are read,
+// exactly as they are held in memory (converted to float, SSE-padded columns). Later page-ins, in this or later jobs, read that
+// file with one sequential read. In the same way, the label maps parsed from the MLF files are cached in binary form, which saves
+// MLF parsing and state-list lookup at startup.
+// Every cache file carries a signature of what it was created from and must be newer than its input files; otherwise it is recreated.
+//
+// Shared mode (shareFeatureCache): several jobs on one host that train on the same corpus can share the chunk cache files in memory
+// instead of each holding a private copy of the frames. Chunk files are then mapped read-only (mapchunk()), so all processes that
+// map the same file share its pages; with the cache directory on a RAM disk such as /dev/shm the frames live in RAM exactly once.
+// The first job that needs a chunk creates its file while holding a cross-process lock for it (chunklock); the others wait and map it.
+// The operating system counts the mappings of each file; a chunk's pages can be reclaimed once no job has it paged in.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "fileutil.h"
+#include "ssematrix.h"
+#include "CrossProcessMutex.h"
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace msra { namespace dbn {
+
+class utterancecache
+{
+    struct chunkheader
+    {
+        char magic[8]; // "CNTKUCH2"
+        uint64_t signature;
+        uint64_t rows;
+        uint64_t cols;
+        uint32_t sampperiod;
+        char featkind[20];
+        char reserved[8]; // pads the header to 64 bytes, so that the frames of a mapped file are SSE-aligned
+    };
+    static_assert(sizeof(chunkheader) == 64, "utterancecache: chunk header must keep mapped frames SSE-aligned");
+    struct labelsheader
+    {
+        char magic[8]; // "CNTKULB1"
+        uint64_t signature;
+        uint64_t numkeys;
+        uint64_t entrysize; // sizeof (ENTRY), to reject caches written with different label types
+    };
+
+    static bool hasmagic(const char *magic, const char *expected)
+    {
+        return memcmp(magic, expected, 8) == 0;
+    }
+
+    // a cache is only used if it is at least as new as all of its inputs
+    static bool isuptodate(const wstring &path, const std::vector<wstring> &inputs)
+    {
+        for (const auto &input : inputs)
+        {
+            if (!input.empty() && !msra::files::fuptodate(path, input))
+                return false;
+        }
+        return true;
+    }
+
+    // cache files are written under a temporary name and renamed when complete, so that concurrent or aborted jobs leave no partial caches
+    template <typename WRITEFUNCTION>
+    static void writeatomically(const wstring &path, const WRITEFUNCTION &write)
+    {
+        const wstring tmppath = path + L".tmp";
+        try
+        {
+            msra::files::make_intermediate_dirs(path);
+            {
+                auto_file_ptr f(fopenOrDie(tmppath, L"wbS"));
+                write(f);
+                fflushOrDie(f);
+            }
+            if (fexists(path))
+                unlinkOrDie(path);
+            renameOrDie(tmppath, path);
+        }
+        catch (const std::exception &e) // a failing cache must not fail the job
+        {
+            fprintf(stderr, "utterancecache: could not write cache file '%ls': %s\n", path.c_str(), e.what());
+            _wunlink(tmppath.c_str());
+        }
+    }
+
+    // reads and validates the header of a chunk cache file
+    static bool readchunkheader(FILE *f, uint64_t sig, const string &featkind, size_t featdim, chunkheader &header)
+    {
+        if (fread(&header, sizeof(header), 1, f) != 1 || !hasmagic(header.magic, "CNTKUCH2") || header.signature != sig)
+            return false;
+        header.featkind[sizeof(header.featkind) - 1] = 0;
+        return featdim == 0 || (featdim == header.rows && featkind == header.featkind);
+    }
+
+public:
+    // FNV-1a hash for cache signatures
+    class signature
+    {
+        uint64_t value;
+
+    public:
+        signature()
+            : value(14695981039346656037ull)
+        {
+        }
+        void add(uint64_t x)
+        {
+            value = (value ^ x) * 1099511628211ull;
+        }
+        void add(const wstring &s)
+        {
+            for (auto c : s)
+                add((uint32_t) c); // (wchar_t differs in size across platforms)
+            add(s.size());
+        }
+        operator uint64_t() const
+        {
+            return value;
+        }
+    };
+
+    static wstring chunkpath(const wstring &cachedir, size_t featureset, size_t chunkindex)
+    {
+        return msra::strfun::wstrprintf(L"%ls/features%d.chunk%d.cache", cachedir.c_str(), (int) featureset, (int) chunkindex);
+    }
+
+    static wstring labelspath(const wstring &cachedir, size_t labelset)
+    {
+        return msra::strfun::wstrprintf(L"%ls/labels%d.cache", cachedir.c_str(), (int) labelset);
+    }
+
+    // read the frames of a chunk from the cache; returns false if there is no valid cache file
+    // If featdim is 0 (no features read yet), featkind, featdim, and sampperiod are taken from the cache file.
+    static bool readchunk(const wstring &path, uint64_t sig, const std::vector<wstring> &inputs, msra::dbn::matrix &frames,
+                          string &featkind, size_t &featdim, unsigned int &sampperiod)
+    {
+        if (!fexists(path) || !isuptodate(path, inputs))
+            return false;
+        auto_file_ptr f(fopenOrDie(path, L"rbS"));
+        chunkheader header;
+        if (!readchunkheader(f, sig, featkind, featdim, header))
+            return false;
+        frames.resize((size_t) header.rows, (size_t) header.cols);
+        frames.frompagefile(f);
+        if (featdim == 0)
+        {
+            featkind = header.featkind;
+            featdim = (size_t) header.rows;
+            sampperiod = header.sampperiod;
+        }
+        return true;
+    }
+
+    static void writechunk(const wstring &path, uint64_t sig, const msra::dbn::matrix &frames, const string &featkind, unsigned int sampperiod)
+    {
+        writeatomically(path, [&](FILE *f)
+                        {
+                            chunkheader header;
+                            memset(&header, 0, sizeof(header));
+                            memcpy(header.magic, "CNTKUCH2", sizeof(header.magic));
+                            header.signature = sig;
+                            header.rows = frames.rows();
+                            header.cols = frames.cols();
+                            header.sampperiod = sampperiod;
+                            strncpy(header.featkind, featkind.c_str(), sizeof(header.featkind) - 1);
+                            fwriteOrDie(&header, sizeof(header), 1, f);
+                            frames.topagefile(f);
+                        });
+    }
+
+    // a chunk cache file mapped read-only into memory, with a matrix view on its frames
+    class mappedchunk
+    {
+        char *data;
+        size_t size;
+#ifdef _WIN32
+        HANDLE filehandle;
+        HANDLE mappinghandle;
+#else
+        int fd;
+#endif
+        std::unique_ptr<msra::math::ssematrixfrombuffer> view;
+
+        mappedchunk(const mappedchunk &);
+        void operator=(const mappedchunk &);
+
+    public:
+        mappedchunk(const wstring &path, size_t rows, size_t cols)
+            : data(NULL), size(sizeof(chunkheader) + msra::math::ssematrixfrombuffer::elementsneeded(rows, cols) * sizeof(float))
+        {
+#ifdef _WIN32
+            mappinghandle = NULL;
+            filehandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+            LARGE_INTEGER filesize;
+            if (filehandle != INVALID_HANDLE_VALUE && GetFileSizeEx(filehandle, &filesize) && (uint64_t) filesize.QuadPart >= size)
+            {
+                mappinghandle = CreateFileMapping(filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (mappinghandle != NULL)
+                    data = (char *) MapViewOfFile(mappinghandle, FILE_MAP_READ, 0, 0, size);
+            }
+#else
+            fd = open(wtocharpath(path).c_str(), O_RDONLY);
+            struct stat sb;
+            if (fd != -1 && fstat(fd, &sb) == 0 && (uint64_t) sb.st_size >= size)
+            {
+                void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+                if (p != MAP_FAILED)
+                    data = (char *) p;
+            }
+#endif
+            if (data == NULL)
+            {
+                release();
+                RuntimeError("utterancecache: cannot map cache file '%ls'", path.c_str());
+            }
+            // the view is read-only in practice: chunk frames are never modified after paging in
+            array_ref<float> buffer((float *) (data + sizeof(chunkheader)), msra::math::ssematrixfrombuffer::elementsneeded(rows, cols));
+            view.reset(new msra::math::ssematrixfrombuffer(buffer, rows, cols));
+        }
+        ~mappedchunk()
+        {
+            release();
+        }
+        void release()
+        {
+#ifdef _WIN32
+            if (data != NULL)
+                UnmapViewOfFile(data);
+            if (mappinghandle != NULL)
+                CloseHandle(mappinghandle);
+            if (filehandle != INVALID_HANDLE_VALUE)
+                CloseHandle(filehandle);
+            mappinghandle = NULL;
+            filehandle = INVALID_HANDLE_VALUE;
+#else
+            if (data != NULL)
+                munmap(data, size);
+            if (fd != -1)
+                close(fd);
+            fd = -1;
+#endif
+            data = NULL;
+        }
+        matrixbase &frames()
+        {
+            return *view;
+        }
+    };
+
+    // map the frames of a chunk from the cache (shared mode); returns nullptr if there is no valid cache file
+    // If featdim is 0 (no features read yet), featkind, featdim, and sampperiod are taken from the cache file.
+    static std::shared_ptr<mappedchunk> mapchunk(const wstring &path, uint64_t sig, const std::vector<wstring> &inputs,
+                                                 string &featkind, size_t &featdim, unsigned int &sampperiod)
+    {
+        if (!fexists(path) || !isuptodate(path, inputs))
+            return nullptr;
+        chunkheader header;
+        {
+            auto_file_ptr f(fopenOrDie(path, L"rbS"));
+            if (!readchunkheader(f, sig, featkind, featdim, header))
+                return nullptr;
+        }
+        auto chunk = std::make_shared<mappedchunk>(path, (size_t) header.rows, (size_t) header.cols);
+        if (featdim == 0)
+        {
+            featkind = header.featkind;
+            featdim = (size_t) header.rows;
+            sampperiod = header.sampperiod;
+        }
+        return chunk;
+    }
+
+    // cross-process lock on one chunk cache file, held while it is created (shared mode)
+    // Failing to get the lock (e.g. no permission to create the lock file) is not an error; at worst two jobs create the same file.
+    class chunklock
+    {
+        std::unique_ptr<CrossProcessMutex> mutex;
+
+    public:
+        chunklock(const wstring &path)
+        {
+            signature sig;
+            sig.add(path);
+            try
+            {
+                mutex.reset(new CrossProcessMutex(msra::strfun::strprintf("CNTK.utterancecache.%016llx", (unsigned long long) (uint64_t) sig)));
+                if (!mutex->Acquire(/*wait=*/true))
+                    mutex.reset();
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "utterancecache: could not lock cache file '%ls', proceeding without lock: %s\n", path.c_str(), e.what());
+                mutex.reset();
+            }
+        }
+    };
+
+    // read a label map ([key] -> label sequence) from the cache; returns false if there is no valid cache file
+    template <class ENTRY>
+    static bool readlabels(const wstring &path, uint64_t sig, const std::vector<wstring> &inputs, std::map<wstring, std::vector<ENTRY>> &labels)
+    {
+        if (!fexists(path) || !isuptodate(path, inputs))
+            return false;
+        auto_file_ptr f(fopenOrDie(path, L"rbS"));
+        labelsheader header;
+        if (fread(&header, sizeof(header), 1, f) != 1 || !hasmagic(header.magic, "CNTKULB1") || header.signature != sig || header.entrysize != sizeof(ENTRY))
+            return false;
+        labels.clear();
+        std::vector<uint32_t> keychars;
+        for (uint64_t k = 0; k < header.numkeys; k++)
+        {
+            uint64_t sizes[2]; // key length, number of entries
+            freadOrDie(sizes, sizeof(sizes[0]), 2, f);
+            keychars.resize((size_t) sizes[0]);
+            if (!keychars.empty())
+                freadOrDie(&keychars[0], sizeof(keychars[0]), keychars.size(), f);
+            auto &entries = labels[wstring(keychars.begin(), keychars.end())];
+            entries.resize((size_t) sizes[1]);
+            if (!entries.empty())
+                freadOrDie(&entries[0], sizeof(ENTRY), entries.size(), f);
+        }
+        return true;
+    }
+
+    template <class ENTRY>
+    static void writelabels(const wstring &path, uint64_t sig, const std::map<wstring, std::vector<ENTRY>> &labels)
+    {
+        writeatomically(path, [&](FILE *f)
+                        {
+                            labelsheader header;
+                            memset(&header, 0, sizeof(header));
+                            memcpy(header.magic, "CNTKULB1", sizeof(header.magic));
+                            header.signature = sig;
+                            header.numkeys = labels.size();
+                            header.entrysize = sizeof(ENTRY);
+                            fwriteOrDie(&header, sizeof(header), 1, f);
+                            for (const auto &label : labels)
+                            {
+                                const std::vector<uint32_t> keychars(label.first.begin(), label.first.end()); // (wchar_t differs in size across platforms)
+                                const uint64_t sizes[2] = {keychars.size(), label.second.size()};
+                                fwriteOrDie(sizes, sizeof(sizes[0]), 2, f);
+                                if (!keychars.empty())
+                                    fwriteOrDie(&keychars[0], sizeof(keychars[0]), keychars.size(), f);
+                                if (!label.second.empty())
+                                    fwriteOrDie(&label.second[0], sizeof(ENTRY), label.second.size(), f);
+                            }
+                        });
+    }
+};
+} }
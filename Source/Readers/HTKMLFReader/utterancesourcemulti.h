@@ -12,6 +12,9 @@
 #include "latticearchive.h" // for reading HTK phoneme lattices (MMI training)
 #include "minibatchsourcehelpers.h"
 #include "minibatchiterator.h"
+#include "utterancecache.h"
+#include "compressedframes.h"
+#include "RandomOrdering.h" // for KeyedPermutation
 #include "unordered_set"
 
 namespace msra { namespace dbn {
@@ -85,6 +88,8 @@ class minibatchutterancesourcemulti : public minibatchsource
 
         std::vector<size_t> firstframes;                                            // [utteranceindex] first frame for given utterance
         mutable msra::dbn::matrix frames;                                           // stores all frames consecutively (mutable since this is a cache)
+        mutable std::shared_ptr<utterancecache::mappedchunk> sharedframes;          // instead of 'frames': the frames mapped from a shared cache file
+        mutable compressedframes packedframes;                                      // instead of 'frames': the frames in compressed form (see compressedframes.h)
         size_t totalframes;                                                         // total #frames for all utterances in this chunk
         mutable std::vector<shared_ptr<const latticesource::latticepair>> lattices; // (may be empty if none)
 
@@ -115,14 +120,36 @@ class minibatchutterancesourcemulti : public minibatchsource
         {
             if (!isinram())
                 LogicError("getutteranceframes: called when data have not been paged in");
+            if (!packedframes.empty())
+                LogicError("getutteranceframes: frames are compressed, must be expanded into a buffer");
             const size_t ts = firstframes[i];
             const size_t n = numframes(i);
+            if (sharedframes)
+                return msra::dbn::matrixstripe(sharedframes->frames(), ts, n);
             return msra::dbn::matrixstripe(frames, ts, n);
         }
+        // return frames [ts, te) of a given utterance; if they are stored compressed, they are expanded into 'buffer', which the result refers to
+        msra::dbn::matrixstripe getutteranceframes(size_t i, size_t ts, size_t te, msra::dbn::matrix &buffer) const
+        {
+            if (!isinram())
+                LogicError("getutteranceframes: called when data have not been paged in");
+            if (ts > te || te > numframes(i))
+                LogicError("getutteranceframes: frame range outside of utterance");
+            if (!packedframes.empty())
+            {
+                packedframes.expand(firstframes[i] + ts, firstframes[i] + te, buffer);
+                return msra::dbn::matrixstripe(buffer, 0, te - ts);
+            }
+            if (sharedframes)
+                return msra::dbn::matrixstripe(sharedframes->frames(), firstframes[i] + ts, te - ts);
+            return msra::dbn::matrixstripe(frames, firstframes[i] + ts, te - ts);
+        }
         shared_ptr<const latticesource::latticepair> getutterancelattice(size_t i) const // return the frame set for a given utterance
         {
             if (!isinram())
                 LogicError("getutteranceframes: called when data have not been paged in");
+            if (lattices[i]->iscompact()) // (see latticesource)
+                return lattices[i]->expanded();
             return lattices[i];
         }
 
@@ -130,11 +157,84 @@ class minibatchutterancesourcemulti : public minibatchsource
         // test if data is in memory at the moment
         bool isinram() const
         {
-            return !frames.empty();
+            return !frames.empty() || sharedframes || !packedframes.empty();
+        }
+        // identifies the data of this chunk in the utterance cache
+        uint64_t cachesignature() const
+        {
+            utterancecache::signature sig;
+            for (const auto &utt : utteranceset)
+            {
+                sig.add(utt.logicalpath());
+                sig.add(utt.parsedpath.physicallocation());
+                sig.add(utt.numframes());
+            }
+            return sig;
+        }
+        // the archive files the frames of this chunk come from (consecutive duplicates removed)
+        std::vector<wstring> archivepaths() const
+        {
+            std::vector<wstring> paths;
+            for (const auto &utt : utteranceset)
+            {
+                wstring path = utt.parsedpath.physicallocation();
+                if (paths.empty() || paths.back() != path)
+                    paths.push_back(std::move(path));
+            }
+            return paths;
+        }
+        // read the frames of all utterances of this chunk from their feature files into 'frames'
+        void readframes(string &featkind, size_t &featdim, unsigned int &sampperiod, int verbosity) const
+        {
+            msra::asr::htkfeatreader reader; // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
+            // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
+            if (featdim == 0)
+            {
+                reader.getinfo(utteranceset[0].parsedpath, featkind, featdim, sampperiod);
+                fprintf(stderr, "requiredata: determined feature kind as %d-dimensional '%s' with frame shift %.1f ms\n", (int) featdim, featkind.c_str(), sampperiod / 1e4);
+            }
+            // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
+            frames.resize(featdim, totalframes);
+            foreach_index (i, utteranceset)
+            {
+                // fprintf (stderr, ".");
+                // read features for this file
+                auto uttframes = getutteranceframes(i);                                                    // matrix stripe for this utterance (currently unfilled)
+                reader.read(utteranceset[i].parsedpath, (const string &) featkind, sampperiod, uttframes); // note: file info here used for checkuing only
+            }
+            // fprintf (stderr, "\n");
+            if (verbosity)
+                fprintf(stderr, "requiredata: %d utterances read\n", (int) utteranceset.size());
+        }
+        // page in the frames of this chunk by mapping its shared cache file, creating the file first if no other job has yet
+        void mapframes(string &featkind, size_t &featdim, unsigned int &sampperiod, int verbosity, const wstring &cachepath) const
+        {
+            sharedframes = utterancecache::mapchunk(cachepath, cachesignature(), archivepaths(), featkind, featdim, sampperiod);
+            if (!sharedframes)
+            {
+                utterancecache::chunklock lock(cachepath);
+                // another job may have created the file while we waited for the lock
+                sharedframes = utterancecache::mapchunk(cachepath, cachesignature(), archivepaths(), featkind, featdim, sampperiod);
+                if (!sharedframes)
+                {
+                    readframes(featkind, featdim, sampperiod, verbosity);
+                    utterancecache::writechunk(cachepath, cachesignature(), frames, featkind, sampperiod);
+                    sharedframes = utterancecache::mapchunk(cachepath, cachesignature(), archivepaths(), featkind, featdim, sampperiod);
+                    if (!sharedframes) // could not write the cache file: keep the private copy
+                        return;
+                    frames.resize(0, 0);
+                }
+            }
+            if (verbosity)
+                fprintf(stderr, "requiredata: %d utterances mapped from shared cache\n", (int) utteranceset.size());
         }
         // page in data for this chunk
         // We pass in the feature info variables by ref which will be filled lazily upon first read
-        void requiredata(string &featkind, size_t &featdim, unsigned int &sampperiod, const latticesource &latticesource, int verbosity = 0) const
+        // If 'cachepath' is given, the frames are read from that cache file if it is valid, and written to it otherwise.
+        // If in addition 'sharedcache', the cache file is mapped instead of read, sharing its memory with other jobs (see utterancecache.h).
+        // Otherwise, the frames are kept in the given 'compression' (see compressedframes.h).
+        void requiredata(string &featkind, size_t &featdim, unsigned int &sampperiod, const latticesource &latticesource, int verbosity = 0, const wstring &cachepath = wstring(), bool sharedcache = false,
+                         compressedframes::kind compression = compressedframes::none) const
         {
             if (numutterances() == 0)
                 LogicError("requiredata: cannot page in virgin block");
@@ -142,30 +242,33 @@ class minibatchutterancesourcemulti : public minibatchsource
                 LogicError("requiredata: called when data is already in memory");
             try // this function supports retrying since we read from the unrealible network, i.e. do not return in a broken state
             {
-                msra::asr::htkfeatreader reader; // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
-                // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
-                if (featdim == 0)
+                if (!cachepath.empty() && sharedcache)
+                {
+                    mapframes(featkind, featdim, sampperiod, verbosity, cachepath);
+                }
+                else if (!cachepath.empty() && utterancecache::readchunk(cachepath, cachesignature(), archivepaths(), frames, featkind, featdim, sampperiod))
+                {
+                    if (verbosity)
+                        fprintf(stderr, "requiredata: %d utterances read from cache\n", (int) utteranceset.size());
+                }
+                else
                 {
-                    reader.getinfo(utteranceset[0].parsedpath, featkind, featdim, sampperiod);
-                    fprintf(stderr, "requiredata: determined feature kind as %d-dimensional '%s' with frame shift %.1f ms\n", (int) featdim, featkind.c_str(), sampperiod / 1e4);
+                    readframes(featkind, featdim, sampperiod, verbosity);
+                    if (!cachepath.empty())
+                        utterancecache::writechunk(cachepath, cachesignature(), frames, featkind, sampperiod);
                 }
-                // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
-                frames.resize(featdim, totalframes);
+                if (compression != compressedframes::none && !sharedframes)
+                {
+                    packedframes.compress(frames, compression);
+                    frames.resize(0, 0);
+                }
+                // page in lattice data
                 if (!latticesource.empty())
-                    lattices.resize(utteranceset.size());
-                foreach_index (i, utteranceset)
                 {
-                    // fprintf (stderr, ".");
-                    // read features for this file
-                    auto uttframes = getutteranceframes(i);                                                    // matrix stripe for this utterance (currently unfilled)
-                    reader.read(utteranceset[i].parsedpath, (const string &) featkind, sampperiod, uttframes); // note: file info here used for checkuing only
-                    // page in lattice data
-                    if (!latticesource.empty())
-                        latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols());
+                    lattices.resize(utteranceset.size());
+                    foreach_index (i, utteranceset)
+                        latticesource.getlattices(utteranceset[i].key(), lattices[i], numframes(i));
                 }
-                // fprintf (stderr, "\n");
-                if (verbosity)
-                    fprintf(stderr, "requiredata: %d utterances read\n", (int) utteranceset.size());
             }
             catch (...)
             {
@@ -173,6 +276,15 @@ class minibatchutterancesourcemulti : public minibatchsource
                 throw;
             }
         }
+        // start loading the lattices of this chunk in the background, ahead of requiredata()
+        void prefetchlattices(const latticesource &latticesource) const
+        {
+            std::vector<std::pair<wstring, size_t>> requests;
+            requests.reserve(utteranceset.size());
+            foreach_index (i, utteranceset)
+                requests.push_back(std::make_pair(utteranceset[i].key(), numframes(i)));
+            latticesource.prefetch(requests);
+        }
         // page out data for this chunk
         void releasedata() const
         {
@@ -182,11 +294,16 @@ class minibatchutterancesourcemulti : public minibatchsource
                 LogicError("releasedata: called when data is not memory");
             // release frames
             frames.resize(0, 0);
+            sharedframes.reset();
+            packedframes.clear();
             // release lattice data
             lattices.clear();
         }
     };
     std::vector<std::vector<utterancechunkdata>> allchunks;           // set of utterances organized in chunks, referred to by an iterator (not an index)
+    const wstring cachedir;                                           // directory of the utterance cache (empty if none)
+    const bool sharedcache;                                           // map the chunk cache files, sharing them with other jobs on this host
+    const compressedframes::kind compression;                         // how the frames of the chunks in RAM are stored
     std::vector<unique_ptr<biggrowablevector<CLASSIDTYPE>>> classids; // [classidsbegin+t] concatenation of all state sequences
 
     bool m_generatePhoneBoundaries;
@@ -200,6 +317,7 @@ class minibatchutterancesourcemulti : public minibatchsource
     double timegetbatch;  // [v-hansu] for time measurement
     // sequence in random order of actual use (randomized, where randomization is cached)
     const size_t randomizationrange; // parameter remembered; this is the full window (e.g. 48 hours), not the half window
+    const bool randomizebypermutation; // randomize within groups of chunks by keyed permutations instead of swaps (see permutationgroups())
     size_t currentsweep;             // randomization is currently cached for this sweep; if it changes, rebuild all below
     struct chunk                     // chunk as used in actual processing order (randomized sequence)
     {
@@ -242,6 +360,9 @@ class minibatchutterancesourcemulti : public minibatchsource
     };
     std::vector<std::vector<chunk>> randomizedchunks; // utterance chunks after being brought into random order (we randomize within a rolling window over them)
     size_t chunksinram;                               // (for diagnostics messages)
+    size_t latticeprefetchsweep, latticeprefetchchunk; // randomized chunk whose lattices were last prefetched
+    std::vector<size_t> randomizedchunksubsets;         // [randomized chunk index] subset (data-parallel reading) that loads the chunk
+    size_t chunksubsetssweep, chunksubsetsnumsubsets;   // randomizedchunksubsets is for this sweep and number of subsets
     struct utteranceref                               // describes the underlying random utterance associated with an utterance position
     {
         size_t chunkindex;     // lives in this chunk (index into randomizedchunks[])
@@ -294,6 +415,31 @@ class minibatchutterancesourcemulti : public minibatchsource
     };
     std::vector<positionchunkwindow> positionchunkwindows; // [utterance position] -> [windowbegin, windowend) for controlling paging
 
+    // Randomization by permutation: the randomized chunks are cut into groups of consecutive chunks such that each chunk of a
+    // group has the whole group in its window; then the utterances (or frames) of a group can be put in any order among
+    // the positions of the group without leaving the window of their position. Each group is shuffled by a KeyedPermutation,
+    // which maps a position to its utterance (or frame) on the fly. Since windowbegin and windowend grow monotonically with
+    // the chunk index, a group [b, e) qualifies if windowbegin of e-1 is at most b and windowend of b is at least e.
+    // Returns the first chunk of each group, followed by the number of chunks.
+    static std::vector<size_t> permutationgroups(const std::vector<chunk> &chunks)
+    {
+        std::vector<size_t> groupbegins;
+        for (size_t b = 0; b < chunks.size();)
+        {
+            groupbegins.push_back(b);
+            size_t e = b + 1; // (a chunk by itself is always a group)
+            while (e < chunks.size() && chunks[e].windowbegin <= b && e < chunks[b].windowend)
+                e++;
+            b = e;
+        }
+        groupbegins.push_back(chunks.size());
+        return groupbegins;
+    }
+    static uint64_t permutationkey(unsigned int seed, size_t group)
+    {
+        return ((uint64_t) seed << 32) ^ group;
+    }
+
     // frame-level randomization layered on top of utterance chunking (randomized, where randomization is cached)
     #pragma pack(push)
     #pragma pack(1)
@@ -392,14 +538,24 @@ class minibatchutterancesourcemulti : public minibatchsource
         size_t m_currentRangeEndChunkIdx;
         size_t m_nextFramePosNotYetRandomized;
 
+        // When true, nothing is stored: the frame at a position is computed on the fly by the keyed permutation
+        // of the position's group of chunks (see permutationgroups()), so that memory does not grow with the corpus
+        // and re-randomizing for a new sweep is instantaneous
+        const bool m_permute;
+        std::vector<size_t> m_groupBeginChunks; // [group] first chunk of the group, followed by the number of chunks
+        unsigned int m_seed;
+
     public:
-        framerandomizer(const std::vector<std::vector<chunk>>& randomizedChunks, bool minimizeMemoryFootprint)
-            : m_randomizedChunks(randomizedChunks), m_minimizeMemoryFootprint(minimizeMemoryFootprint), m_currentRangeBeginChunkIdx(0), m_currentRangeEndChunkIdx(0), m_nextFramePosNotYetRandomized(0)
+        framerandomizer(const std::vector<std::vector<chunk>>& randomizedChunks, bool minimizeMemoryFootprint, bool permute)
+            : m_randomizedChunks(randomizedChunks), m_minimizeMemoryFootprint(minimizeMemoryFootprint), m_currentRangeBeginChunkIdx(0), m_currentRangeEndChunkIdx(0), m_nextFramePosNotYetRandomized(0), m_permute(permute), m_seed(0)
         {
         }
 
         void randomizeFrameRange(size_t globalts, size_t globalte)
         {
+            if (m_permute) // (nothing to precompute)
+                return;
+
             if (m_nextFramePosNotYetRandomized == m_randomizedChunks[0].back().globalte())
                 return;
 
@@ -464,11 +620,11 @@ class minibatchutterancesourcemulti : public minibatchsource
                     //  - Both may have been swapped before.
                     //  - Both must stay within the randomization window of their respective position.
                     // check admissibility of where the element at 'tswap' gets swapped to 't' (range = [windowbegin,windowend))
-                    size_t tswapchunkindex = randomizedframeref(tswap).chunkindex;
+                    size_t tswapchunkindex = storedframeref(tswap).chunkindex;
                     if (tswapchunkindex < chunkWindowBegin || tswapchunkindex >= chunkWindowEnd)
                         continue;
                     // check admissibility of where the element at t gets swapped to (which is frame position 'tswap')
-                    const size_t sourcechunkindex = randomizedframeref(t).chunkindex;
+                    const size_t sourcechunkindex = storedframeref(t).chunkindex;
                     size_t targetchunkindex = ttochunk(tswap); // chunk associated with this frame position defines value range
                     const auto &targetchunk = m_randomizedChunks[0][targetchunkindex];
                     const size_t targetwindowbegin = targetchunk.windowbegin;
@@ -476,13 +632,13 @@ class minibatchutterancesourcemulti : public minibatchsource
                     if (sourcechunkindex < targetwindowbegin || sourcechunkindex >= targetwindowend)
                         continue;
                     // admissible--swap the two
-                    ::swap(randomizedframeref(t), randomizedframeref(tswap));
+                    ::swap(storedframeref(t), storedframeref(tswap));
 
                     // do a post-check if we got it right  --we seem not to
                     if (isframepositionvalid(t) && isframepositionvalid(tswap))
                         break;
                     // not valid: swap them back and try again  --we actually discovered a bug in the code above
-                    ::swap(randomizedframeref(t), randomizedframeref(tswap));
+                    ::swap(storedframeref(t), storedframeref(tswap));
                     fprintf(stderr, "randomizeFrameRange: BUGBUG --invalid swapping condition detected\n");
                 }
             }
@@ -497,7 +653,7 @@ class minibatchutterancesourcemulti : public minibatchsource
                 const size_t poswindowbegin = chunk.windowbegin;
                 const size_t poswindowend = chunk.windowend;
 
-                const size_t randomizedchunkindex = randomizedframeref(t).chunkindex;
+                const size_t randomizedchunkindex = storedframeref(t).chunkindex;
                 if (randomizedchunkindex < poswindowbegin || randomizedchunkindex >= poswindowend)
                     LogicError("randomizeFrameRange: nope, you got frame randomization wrong, dude");
             }
@@ -508,7 +664,13 @@ class minibatchutterancesourcemulti : public minibatchsource
             srand(randSeed);
             size_t sweepts = m_randomizedChunks[0][0].globalts;
             size_t totalFrames = m_randomizedChunks[0].back().globalte() - sweepts;
-            if (m_minimizeMemoryFootprint)
+            if (m_permute)
+            {
+                m_seed = randSeed;
+                m_groupBeginChunks = permutationgroups(m_randomizedChunks[0]);
+                m_currentRangeBeginChunkIdx = 0; // (for chunkIdx())
+            }
+            else if (m_minimizeMemoryFootprint)
             {
                 m_randomizedframerefsWindow.clear();
                 m_currentRangeBeginChunkIdx = m_randomizedChunks[0][0].windowbegin;
@@ -624,7 +786,16 @@ class minibatchutterancesourcemulti : public minibatchsource
             }
         }
 
-        frameref& randomizedframeref(size_t globalts)
+        frameref randomizedframeref(size_t globalts)
+        {
+            if (m_permute)
+                return permutedframeref(globalts);
+            else
+                return storedframeref(globalts);
+        }
+
+    private:
+        frameref& storedframeref(size_t globalts)
         {
             if (m_minimizeMemoryFootprint)
                 return randomizedframeentry(globalts).second;
@@ -635,7 +806,27 @@ class minibatchutterancesourcemulti : public minibatchsource
             }
         }
 
-    private:
+        // the frame at a position, through the keyed permutation of its group of chunks
+        frameref permutedframeref(size_t globalts)
+        {
+            const auto &chunks = m_randomizedChunks[0];
+            const size_t group = std::upper_bound(m_groupBeginChunks.begin(), m_groupBeginChunks.end(), chunkIdx(globalts)) - m_groupBeginChunks.begin() - 1;
+            const size_t groupbegin = m_groupBeginChunks[group];
+            const size_t groupend = m_groupBeginChunks[group + 1];
+            const size_t groupts = chunks[groupbegin].globalts;
+            const Microsoft::MSR::CNTK::KeyedPermutation permutation(chunks[groupend - 1].globalte() - groupts, permutationkey(m_seed, group));
+            const size_t t = groupts + permutation[globalts - groupts]; // the frame on the timeline of the (unshuffled) chunks
+
+            const size_t chunkindex = std::upper_bound(chunks.begin() + groupbegin, chunks.begin() + groupend, t, [](size_t t, const chunk &chunk)
+                                                       {
+                                                           return t < chunk.globalts;
+                                                       }) - chunks.begin() - 1;
+            const auto &firstframes = chunks[chunkindex].getchunkdata().firstframes;
+            const size_t offset = t - chunks[chunkindex].globalts;
+            const size_t utteranceindex = std::upper_bound(firstframes.begin(), firstframes.end(), offset) - firstframes.begin() - 1;
+            return frameref(chunkindex, utteranceindex, offset - firstframes[utteranceindex]);
+        }
+
         void addRandomizedFramesForChunk(size_t chunkIdx)
         {
             assert(m_minimizeMemoryFootprint);
@@ -705,7 +896,7 @@ class minibatchutterancesourcemulti : public minibatchsource
             // Chunk implies that if we are at position 't', we are guaranteed to have chunks [poswindowbegin, poswindowend) in RAM.
 
             // now see if the randomized location is within that window
-            const size_t actualchunkindexforpos = randomizedframeref(t).chunkindex; // where this frame pos has been mapped to
+            const size_t actualchunkindexforpos = storedframeref(t).chunkindex; // where this frame pos has been mapped to
             return actualchunkindexforpos >= poswindowbegin && actualchunkindexforpos < poswindowend;
             // We only need to test the chunk index. Utterance and frame can be randomized within a chunk as we want, as long it is in RAM.
         }
@@ -829,10 +1020,13 @@ public:
     // constructor
     // Pass empty labels to denote unsupervised training (so getbatch() will not return uids).
     // This mode requires utterances with time stamps.
+    // If 'cachedir' is given, chunks are read through the utterance cache in that directory (see utterancecache.h);
+    // 'sharedcache' selects its shared mode. Chunks in RAM are kept in the given 'compression' (see compressedframes.h).
     minibatchutterancesourcemulti(const std::vector<std::vector<wstring>> &infiles, const std::vector<map<wstring, std::vector<msra::asr::htkmlfentry>>> &labels,
                                   std::vector<size_t> vdim, std::vector<size_t> udim, std::vector<size_t> leftcontext, std::vector<size_t> rightcontext, size_t randomizationrange,
-                                  const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode, bool minimizeMemoryFootprint)
-                                  : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), timegetbatch(0), verbosity(2), m_generatePhoneBoundaries(!lattices.empty()), m_frameRandomizer(randomizedchunks, minimizeMemoryFootprint)
+                                  const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode, bool minimizeMemoryFootprint,
+                                  const wstring &cachedir = wstring(), bool sharedcache = false, compressedframes::kind compression = compressedframes::none, bool randomizebypermutation = false)
+                                  : vdim(vdim), cachedir(cachedir), sharedcache(sharedcache), compression(compression), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), randomizebypermutation(randomizebypermutation), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), latticeprefetchsweep(SIZE_MAX), latticeprefetchchunk(SIZE_MAX), chunksubsetssweep(SIZE_MAX), chunksubsetsnumsubsets(0), timegetbatch(0), verbosity(2), m_generatePhoneBoundaries(!lattices.empty()), m_frameRandomizer(randomizedchunks, minimizeMemoryFootprint, randomizebypermutation)
     // [v-hansu] change framemode (lattices.empty()) into framemode (false) to run utterance mode without lattice
     // you also need to change another line, search : [v-hansu] comment out to run utterance mode without lattice
     {
@@ -874,6 +1068,29 @@ public:
         // If not, we'll plan to ignore the utterance, and inform the user
         // m indexes the feature stream
         // i indexes the files within a stream, i.e. in the SCP file)
+        // The SCP entries are parsed here once, in parallel, and reused when building the utterance sets below.
+        std::vector<std::vector<std::unique_ptr<msra::asr::htkfeatreader::parsedpath>>> parsedpaths(infiles.size());
+        foreach_index (m, infiles)
+        {
+            parsedpaths[m].resize(infiles[m].size());
+            std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (long i = 0; i < (long) infiles[m].size(); i++)
+            {
+                try
+                {
+                    parsedpaths[m][i].reset(new msra::asr::htkfeatreader::parsedpath(infiles[m][i]));
+                }
+                catch (...) // exceptions must not leave the parallel region
+                {
+#pragma omp critical
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
         foreach_index (m, infiles)
         {
             if (m == 0)
@@ -887,8 +1104,7 @@ public:
 
             foreach_index (i, infiles[m])
             {
-                utterancedesc utterance(msra::asr::htkfeatreader::parsedpath(infiles[m][i]), 0); // mseltzer - is this foolproof for multiio? is classids always non-empty?
-                const size_t uttframes = utterance.numframes();                                  // will throw if frame bounds not given --required to be given in this mode
+                const size_t uttframes = parsedpaths[m][i]->numframes(); // will throw if frame bounds not given --required to be given in this mode
                 // we need at least 2 frames for boundary markers to work
                 if (uttframes < 2)
                     RuntimeError("minibatchutterancesource: utterances < 2 frames not supported");
@@ -952,7 +1168,7 @@ public:
 
                 if (uttisvalid[i])
                 {
-                    utterancedesc utterance(msra::asr::htkfeatreader::parsedpath(infiles[m][i]), labels.empty() ? 0 : classidsbegin[i]); // mseltzer - is this foolproof for multiio? is classids always non-empty?
+                    utterancedesc utterance(std::move(*parsedpaths[m][i]), labels.empty() ? 0 : classidsbegin[i]); // mseltzer - is this foolproof for multiio? is classids always non-empty?
                     const size_t uttframes = utterance.numframes();                                                                      // will throw if frame bounds not given --required to be given in this mode
                     assert(uttframes == uttduration[i]);                                                                                 // ensure nothing funky happened
                     // already performed these checks above
@@ -1299,40 +1515,58 @@ private:
             // check we got those setup right
 
             // we now randomly shuffle randomizedutterancerefs[pos], while considering the constraints of what chunk range needs to be in memory
-            srand((unsigned int) sweep + 1);
-            for (size_t i = 0; i < randomizedutterancerefs.size(); i++)
+            if (randomizebypermutation) // permute the utterances within each group of chunks (see permutationgroups())
+            {
+                const std::vector<size_t> groupbegins = permutationgroups(randomizedchunks[0]);
+                std::vector<utteranceref> permutedutterancerefs;
+                permutedutterancerefs.reserve(numutterances);
+                for (size_t group = 0; group + 1 < groupbegins.size(); group++)
+                {
+                    const size_t posbegin = randomizedchunks[0][groupbegins[group]].utteranceposbegin;
+                    const size_t posend = randomizedchunks[0][groupbegins[group + 1] - 1].utteranceposend();
+                    const Microsoft::MSR::CNTK::KeyedPermutation permutation(posend - posbegin, permutationkey((unsigned int) sweep + 1, group));
+                    for (size_t i = posbegin; i < posend; i++)
+                        permutedutterancerefs.push_back(randomizedutterancerefs[posbegin + permutation[i - posbegin]]);
+                }
+                randomizedutterancerefs.swap(permutedutterancerefs);
+            }
+            else
             {
-                // get valid randomization range, expressed in chunks
-                const size_t windowbegin = positionchunkwindows[i].windowbegin();
-                const size_t windowend = positionchunkwindows[i].windowend();
+                srand((unsigned int) sweep + 1);
+                for (size_t i = 0; i < randomizedutterancerefs.size(); i++)
+                {
+                    // get valid randomization range, expressed in chunks
+                    const size_t windowbegin = positionchunkwindows[i].windowbegin();
+                    const size_t windowend = positionchunkwindows[i].windowend();
 
-                // get valid randomization range, expressed in utterance positions
-                // Remember, utterance positions are defined by chunks.
-                const size_t posbegin = randomizedchunks[0][windowbegin].utteranceposbegin;
-                const size_t posend = randomizedchunks[0][windowend - 1].utteranceposend();
+                    // get valid randomization range, expressed in utterance positions
+                    // Remember, utterance positions are defined by chunks.
+                    const size_t posbegin = randomizedchunks[0][windowbegin].utteranceposbegin;
+                    const size_t posend = randomizedchunks[0][windowend - 1].utteranceposend();
 
-                // randomization range for this utterance position is [posbegin, posend)
-                for (;;)
-                {
-                    // pick a random location
-                    const size_t j = msra::dbn::rand(posbegin, posend); // a random number within the window
-                    if (i == j)
-                        break; // the random gods say "this one points to its original position"... nothing wrong about that, but better not try to swap
+                    // randomization range for this utterance position is [posbegin, posend)
+                    for (;;)
+                    {
+                        // pick a random location
+                        const size_t j = msra::dbn::rand(posbegin, posend); // a random number within the window
+                        if (i == j)
+                            break; // the random gods say "this one points to its original position"... nothing wrong about that, but better not try to swap
 
-                    // We want to swap utterances at i and j, but need to make sure they remain in their allowed range.
-                    // This is guaranteed for a so-far untouched utterance, but both i and j may have been touched by a previous swap.
+                        // We want to swap utterances at i and j, but need to make sure they remain in their allowed range.
+                        // This is guaranteed for a so-far untouched utterance, but both i and j may have been touched by a previous swap.
 
-                    // We want to use the utterance previously referenced at utterance position j at position i. Is that allowed?
-                    if (!positionchunkwindows[i].isvalidforthisposition(randomizedutterancerefs[j]))
-                        continue; // nope --try another
+                        // We want to use the utterance previously referenced at utterance position j at position i. Is that allowed?
+                        if (!positionchunkwindows[i].isvalidforthisposition(randomizedutterancerefs[j]))
+                            continue; // nope --try another
 
-                    // Likewise may we use the utterance previously referenced at utterance position i at position j?
-                    if (!positionchunkwindows[j].isvalidforthisposition(randomizedutterancerefs[i]))
-                        continue; // nope --try another
+                        // Likewise may we use the utterance previously referenced at utterance position i at position j?
+                        if (!positionchunkwindows[j].isvalidforthisposition(randomizedutterancerefs[i]))
+                            continue; // nope --try another
 
-                    // yep--swap them
-                    randomizedutterancerefs[i].swap(randomizedutterancerefs[j]);
-                    break;
+                        // yep--swap them
+                        randomizedutterancerefs[i].swap(randomizedutterancerefs[j]);
+                        break;
+                    }
                 }
             }
 
@@ -1427,9 +1661,10 @@ private:
                 auto &chunkdata = chunk.getchunkdata();
                 if (verbosity)
                     fprintf(stderr, "feature set %d: requirerandomizedchunk: paging in randomized chunk %d (frame range [%d..%d]), %d resident in RAM\n", m, (int) chunkindex, (int) chunk.globalts, (int) (chunk.globalte() - 1), (int) (chunksinram + 1));
+                const wstring cachepath = cachedir.empty() ? wstring() : utterancecache::chunkpath(cachedir, m, chunk.uttchunkdata - allchunks[m].begin());
                 msra::util::attempt(5, [&]() // (reading from network)
                                     {
-                                        chunkdata.requiredata(featkind[m], featdim[m], sampperiod[m], this->lattices, verbosity);
+                                        chunkdata.requiredata(featkind[m], featdim[m], sampperiod[m], this->lattices, verbosity, cachepath, sharedcache, compression);
                                     });
             }
             chunksinram++;
@@ -1441,6 +1676,45 @@ private:
         }
     }
 
+    // helper to assign the randomized chunks of the current sweep to the subsets of data-parallel reading
+    // Each subset loads only its own chunks. In randomized order, every chunk goes to the subset with the fewest frames so far
+    // (ties to the lowest). All subsets compute the same assignment from the same randomization, and the frames of any run of
+    // consecutive chunks (e.g. a randomization window) are split evenly up to about two chunks, also when chunk sizes vary.
+    void assignchunkstosubsets(const size_t numsubsets)
+    {
+        if (chunksubsetssweep == currentsweep && chunksubsetsnumsubsets == numsubsets)
+            return;
+        const auto &chunks = randomizedchunks[0];
+        randomizedchunksubsets.resize(chunks.size());
+        std::vector<size_t> subsetframes(numsubsets, 0);
+        for (size_t k = 0; k < chunks.size(); k++)
+        {
+            const size_t subset = std::min_element(subsetframes.begin(), subsetframes.end()) - subsetframes.begin();
+            randomizedchunksubsets[k] = subset;
+            subsetframes[subset] += chunks[k].numframes();
+        }
+        chunksubsetssweep = currentsweep;
+        chunksubsetsnumsubsets = numsubsets;
+    }
+
+    // helper to start loading the lattices of the next chunk that will be paged in (the first one from 'windowbegin' not in RAM yet)
+    void prefetchnextlattices(const size_t windowbegin, const size_t subsetnum)
+    {
+        for (size_t k = windowbegin; k < randomizedchunks[0].size(); k++)
+        {
+            const auto &chunkdata = randomizedchunks[0][k].getchunkdata();
+            if (randomizedchunksubsets[k] != subsetnum || chunkdata.isinram())
+                continue;
+            if (k != latticeprefetchchunk || currentsweep != latticeprefetchsweep)
+            {
+                chunkdata.prefetchlattices(lattices);
+                latticeprefetchsweep = currentsweep;
+                latticeprefetchchunk = k;
+            }
+            return;
+        }
+    }
+
     class matrixasvectorofvectors // wrapper around a matrix that views it as a vector of column vectors
     {
         void operator=(const matrixasvectorofvectors &); // non-assignable
@@ -1488,7 +1762,7 @@ public:
     // This is efficient since getbatch() is called with sequential 'globalts' except at epoch start.
     // Note that the start of an epoch does not necessarily fall onto an utterance boundary. The caller must use firstvalidglobalts() to find the first valid globalts at or after a given time.
     // Support for data parallelism:  If mpinodes > 1 then we will
-    //  - load only a subset of blocks from the disk
+    //  - load only a subset of blocks from the disk (see assignchunkstosubsets())
     //  - skip frames/utterances in not-loaded blocks in the returned data
     //  - 'framesadvanced' will still return the logical #frames; that is, by how much the global time index is advanced
     bool getbatch(const size_t globalts, const size_t framesrequested,
@@ -1505,9 +1779,11 @@ public:
 
         // update randomization if a new sweep is entered  --this is a complex operation that updates many of the data members used below
         const size_t sweep = lazyrandomization(globalts);
+        assignchunkstosubsets(numsubsets);
 
         size_t mbframes = 0;
         const std::vector<char> noboundaryflags; // dummy
+        msra::dbn::matrix expandedframes;        // frames of compressed chunks, expanded for the utterance or frame being copied
         if (!framemode)                          // regular utterance mode
         {
             // find utterance position for globalts
@@ -1534,19 +1810,26 @@ public:
                 releaserandomizedchunk(k);
             for (size_t k = windowend; k < randomizedchunks[0].size(); k++)
                 releaserandomizedchunk(k);
+            for (size_t k = windowbegin; k < windowend; k++)
+                if (randomizedchunksubsets[k] != subsetnum) // (paged in under a different number of subsets)
+                    releaserandomizedchunk(k);
             for (size_t pos = spos; pos < epos; pos++)
-                if ((randomizedutterancerefs[pos].chunkindex % numsubsets) == subsetnum)
+                if (randomizedchunksubsets[randomizedutterancerefs[pos].chunkindex] == subsetnum)
                     readfromdisk |= requirerandomizedchunk(randomizedutterancerefs[pos].chunkindex, windowbegin, windowend); // (window range passed in for checking only)
 
             // Note that the above loop loops over all chunks incl. those that we already should have.
             // This has an effect, e.g., if 'numsubsets' has changed (we will fill gaps).
 
+            // load the lattices for the next page-in while this minibatch is being processed
+            if (!lattices.empty())
+                prefetchnextlattices(windowbegin, subsetnum);
+
             // determine the true #frames we return, for allocation--it is less than mbframes in the case of MPI/data-parallel sub-set mode
             size_t tspos = 0;
             for (size_t pos = spos; pos < epos; pos++)
             {
                 const auto &uttref = randomizedutterancerefs[pos];
-                if ((uttref.chunkindex % numsubsets) != subsetnum) // chunk not to be returned for this MPI node
+                if (randomizedchunksubsets[uttref.chunkindex] != subsetnum) // chunk not to be returned for this MPI node
                     continue;
 
                 tspos += uttref.numframes;
@@ -1596,7 +1879,7 @@ public:
             for (size_t pos = spos; pos < epos; pos++)
             {
                 const auto &uttref = randomizedutterancerefs[pos];
-                if ((uttref.chunkindex % numsubsets) != subsetnum) // chunk not to be returned for this MPI node
+                if (randomizedchunksubsets[uttref.chunkindex] != subsetnum) // chunk not to be returned for this MPI node
                     continue;
 
                 size_t n = 0;
@@ -1605,7 +1888,7 @@ public:
                     const auto &chunk = randomizedchunks[i][uttref.chunkindex];
                     const auto &chunkdata = chunk.getchunkdata();
                     assert((numsubsets > 1) || (uttref.globalts == globalts + tspos));
-                    auto uttframes = chunkdata.getutteranceframes(uttref.utteranceindex());
+                    auto uttframes = chunkdata.getutteranceframes(uttref.utteranceindex(), 0, chunkdata.numframes(uttref.utteranceindex()), expandedframes);
                     matrixasvectorofvectors uttframevectors(uttframes); // (wrapper that allows m[j].size() and m[j][i] as required by augmentneighbors())
                     n = uttframevectors.size();
                     sentendmark[i].push_back(n + tspos);
@@ -1694,8 +1977,10 @@ public:
             for (size_t k = 0; k < windowbegin; k++)
                 releaserandomizedchunk(k);
             for (size_t k = windowbegin; k < windowend; k++)
-                if ((k % numsubsets) == subsetnum)                                     // in MPI mode, we skip chunks this way
+                if (randomizedchunksubsets[k] == subsetnum)                            // in MPI mode, we skip chunks this way
                     readfromdisk |= requirerandomizedchunk(k, windowbegin, windowend); // (window range passed in for checking only, redundant here)
+                else
+                    releaserandomizedchunk(k); // (paged in under a different number of subsets)
             for (size_t k = windowend; k < randomizedchunks[0].size(); k++)
                 releaserandomizedchunk(k);
 
@@ -1706,7 +1991,7 @@ public:
             for (size_t i = 0; i < mbframes; i++) // i is input frame index; j < i in case of MPI/data-parallel sub-set mode
             {
                 const frameref &frameref = m_frameRandomizer.randomizedframeref(globalts + i);
-                subsetsizes[frameref.chunkindex % numsubsets]++;
+                subsetsizes[randomizedchunksubsets[frameref.chunkindex]]++;
             }
             size_t j = subsetsizes[subsetnum];                                           // return what we have  --TODO: we can remove the above full computation again now
             const size_t allocframes = max(j, (mbframes + numsubsets - 1) / numsubsets); // we leave space for the desired #frames, assuming caller will try to pad them later
@@ -1746,7 +2031,7 @@ public:
                 const frameref &frameref = m_frameRandomizer.randomizedframeref(globalts + j);
 
                 // in MPI/data-parallel mode, skip frames that are not in chunks loaded for this MPI node
-                if ((frameref.chunkindex % numsubsets) != subsetnum)
+                if (randomizedchunksubsets[frameref.chunkindex] != subsetnum)
                     continue;
 
                 // random utterance
@@ -1756,11 +2041,7 @@ public:
                 {
                     const auto &chunk = randomizedchunks[i][frameref.chunkindex];
                     const auto &chunkdata = chunk.getchunkdata();
-                    auto uttframes = chunkdata.getutteranceframes(frameref.utteranceindex());
-                    matrixasvectorofvectors uttframevectors(uttframes); // (wrapper that allows m[.].size() and m[.][.] as required by augmentneighbors())
-                    const size_t n = uttframevectors.size();
-                    assert(n == uttframes.cols() && chunkdata.numframes(frameref.utteranceindex()) == n);
-                    n;
+                    const size_t n = chunkdata.numframes(frameref.utteranceindex());
 
                     // copy frame and class labels
                     const size_t t = frameref.frameindex();
@@ -1769,14 +2050,21 @@ public:
                     // page in the needed range of frames
                     if (leftcontext[i] == 0 && rightcontext[i] == 0)
                     {
-                        leftextent = rightextent = augmentationextent(uttframevectors[t].size(), vdim[i]);
+                        leftextent = rightextent = augmentationextent(featdim[i], vdim[i]);
                     }
                     else
                     {
                         leftextent = leftcontext[i];
                         rightextent = rightcontext[i];
                     }
-                    augmentneighbors(uttframevectors, noboundaryflags, t, leftextent, rightextent, feat[i], currmpinodeframecount);
+                    // get only the frames of the context window (which is all that is expanded if the chunk is compressed);
+                    // augmentneighbors() does not move beyond the utterance boundaries, which are the window's where they cut it off
+                    const size_t ts = t > leftextent ? t - leftextent : 0;
+                    const size_t te = min(n, t + rightextent + 1);
+                    auto uttframes = chunkdata.getutteranceframes(frameref.utteranceindex(), ts, te, expandedframes);
+                    matrixasvectorofvectors uttframevectors(uttframes); // (wrapper that allows m[.].size() and m[.][.] as required by augmentneighbors())
+                    assert(uttframevectors.size() == te - ts && uttframes.rows() == featdim[i]);
+                    augmentneighbors(uttframevectors, noboundaryflags, t - ts, leftextent, rightextent, feat[i], currmpinodeframecount);
 
                     if (issupervised() && i == 0)
                     {
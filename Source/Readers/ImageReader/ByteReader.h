@@ -35,10 +35,15 @@ public:
 };
 
 #ifdef USE_ZIP
+// Reads images from a .zip container.
+// The archive is memory-mapped, and its central directory is indexed once when the reader is created.
+// Stored (uncompressed) entries are decoded straight from the mapped file without any copy;
+// compressed entries go through libzip.
 class ZipByteReader : public ByteReader
 {
 public:
     ZipByteReader(const std::string& zipPath);
+    ~ZipByteReader();
 
     void Register(size_t seqId, const std::string& path) override;
     cv::Mat Read(size_t seqId, const std::string& path) override;
@@ -47,10 +52,36 @@ private:
     using ZipPtr = std::unique_ptr<zip_t, void(*)(zip_t*)>;
     ZipPtr OpenZip();
 
+    // an entry of the central directory
+    struct Entry
+    {
+        zip_uint64_t m_index;             // index of the entry for libzip
+        zip_uint64_t m_size;              // uncompressed size
+        zip_uint64_t m_compressedSize;
+        zip_uint64_t m_localHeaderOffset; // position of the local file header within the archive
+        zip_uint16_t m_method;            // compression method (ZIP_CM_STORE for uncompressed)
+        bool m_encrypted;
+    };
+
+    void MapArchive();
+    void UnmapArchive();
+    bool IndexCentralDirectory();
+    const unsigned char* GetStoredData(const Entry& entry, const std::string& path) const;
+    cv::Mat ReadWithLibzip(size_t seqId, const Entry& entry, const std::string& path);
+
     std::string m_zipPath;
-    conc_stack<ZipPtr> m_zips;
-    std::unordered_map<size_t, std::pair<zip_uint64_t, zip_uint64_t>> m_seqIdToIndex;
-    conc_stack<std::vector<unsigned char>> m_workspace;
+    conc_pool<ZipPtr> m_zips;
+    std::unordered_map<size_t, Entry> m_seqIdToEntry;
+    conc_pool<std::vector<unsigned char>> m_workspace;
+
+    // memory mapping of the archive, and index of its central directory by entry name
+    const unsigned char* m_mappedData;
+    size_t m_mappedSize;
+    void* m_fileHandle;        // (HANDLE on Windows)
+    void* m_fileMappingHandle; // (Windows only)
+    int m_fileDescriptor;      // (Linux only)
+    bool m_indexed;            // true if the central directory was indexed (otherwise we fall back to looking up entries via libzip)
+    std::unordered_map<std::string, Entry> m_nameToEntry;
 };
 #endif
 
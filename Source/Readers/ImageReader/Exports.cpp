@@ -10,6 +10,7 @@
 #include "DataReader.h"
 #include "ReaderShim.h"
 #include "ImageReader.h"
+#include "ImageDataDeserializer.h"
 #include "HeapMemoryProvider.h"
 #include "CudaMemoryProvider.h"
 
@@ -31,4 +32,10 @@ extern "C" DATAREADER_API void GetReaderD(IDataReader<double>** preader)
 {
     *preader = new ReaderShim<double>(factory);
 }
+
+// Implements the "convertImageRecords" action, see DoConvertImageRecords().
+extern "C" DATAREADER_API void ConvertImageRecords(const ConfigParameters& config)
+{
+    ImageDataDeserializer::WriteRecordFile(config);
+}
 } } }
@@ -71,9 +71,18 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         labelSection->m_id = 1;
         labelSection->m_name = msra::strfun::utf16(label.ConfigName());
         labelSection->m_sampleLayout = std::make_shared<TensorShape>(labelDimension);
+        // sparse=true: pass the one-hot labels on as they are generated, in CSC format, to a sparse input
+        // (instead of a dense labelDim x minibatch matrix)
+        labelSection->m_storageType = label(L"sparse", false) ? StorageType::sparse_csc : StorageType::dense;
         m_streams.push_back(labelSection);
 
-        m_mapPath = config(L"file");
+        // a record file (see ImageRecordFormat.h) takes the place of the map file
+        std::wstring recordPath = config(L"recordFile", L"");
+        m_recordPath = recordPath;
+        if (m_recordPath.empty())
+        {
+            m_mapPath = config(L"file");
+        }
 
         std::string rand = config(L"randomize", "auto");
 
@@ -108,6 +117,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         }
 
         m_cpuThreadCount = config(L"numCPUThreads", 0);
+        m_gpuAugmentation = config(L"gpuAugmentation", false);
     }
 
     std::vector<StreamDescriptionPtr> ImageConfigHelper::GetStreams() const
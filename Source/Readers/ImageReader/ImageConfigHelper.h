@@ -31,6 +31,12 @@ public:
     // Get the map file path that describes mapping of images into their labels.
     std::string GetMapPath() const;
 
+    // Get the path of the image record file to read instead of the map file; empty if none.
+    std::wstring GetRecordPath() const
+    {
+        return m_recordPath;
+    }
+
     ImageLayoutKind GetDataFormat() const
     {
         return m_dataFormat;
@@ -46,15 +52,23 @@ public:
         return m_randomize;
     }
 
+    // leave crop, scale, mean subtraction and transposition to the consumer of the minibatch (see PackedImageTransformer)
+    bool UseGpuAugmentation() const
+    {
+        return m_gpuAugmentation;
+    }
+
 private:
     ImageConfigHelper(const ImageConfigHelper&) = delete;
     ImageConfigHelper& operator=(const ImageConfigHelper&) = delete;
 
     std::string m_mapPath;
+    std::wstring m_recordPath;
     std::vector<StreamDescriptionPtr> m_streams;
     ImageLayoutKind m_dataFormat;
     int m_cpuThreadCount;
     bool m_randomize;
+    bool m_gpuAugmentation;
 };
 
 typedef std::shared_ptr<ImageConfigHelper> ImageConfigHelperPtr;
@@ -7,6 +7,15 @@
 #include <opencv2/opencv.hpp>
 #include "ImageDataDeserializer.h"
 #include "ImageConfigHelper.h"
+#include "fileutil.h"
+#include "StringUtil.h"
+#include <omp.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -65,41 +74,164 @@ public:
         UNUSED(sequenceId);
         const auto& imageSequence = m_description;
 
-        auto image = std::make_shared<DeserializedImage>();
-        image->m_image = std::move(m_parent.ReadImage(m_description.m_id, imageSequence.m_path));
-        auto& cvImage = image->m_image;
-
-        if (!cvImage.data)
+        cv::Mat image = m_parent.ReadImage(m_description.m_id, imageSequence.m_path);
+        if (!image.data)
         {
             RuntimeError("Cannot open file '%s'", imageSequence.m_path.c_str());
         }
+        return m_parent.CreateSequence(image, imageSequence, shared_from_this());
+    }
+};
+
+// Read-only memory mapping of an image record file.
+class ImageDataDeserializer::MappedFile
+{
+public:
+    explicit MappedFile(const std::wstring& path) : m_data(nullptr), m_size(0)
+    {
+#ifdef _WIN32
+        m_fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        if (m_fileHandle == INVALID_HANDLE_VALUE)
+            RuntimeError("Cannot open file '%ls'", path.c_str());
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_fileHandle, &size) || size.QuadPart == 0)
+            RuntimeError("Cannot get the size of file '%ls' or file is empty", path.c_str());
+        m_mappingHandle = CreateFileMapping(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mappingHandle == NULL)
+            RuntimeError("Cannot map file '%ls'", path.c_str());
+        m_data = reinterpret_cast<const char*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (m_data == nullptr)
+            RuntimeError("Cannot map file '%ls'", path.c_str());
+        m_size = (size_t) size.QuadPart;
+#else
+        std::string narrowPath = msra::strfun::utf8(path);
+        m_fileDescriptor = open(narrowPath.c_str(), O_RDONLY);
+        if (m_fileDescriptor == -1)
+            RuntimeError("Cannot open file '%ls'", path.c_str());
+        struct stat sb;
+        if (fstat(m_fileDescriptor, &sb) == -1 || sb.st_size == 0)
+            RuntimeError("Cannot get the size of file '%ls' or file is empty", path.c_str());
+        void* data = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, m_fileDescriptor, 0);
+        if (data == MAP_FAILED)
+            RuntimeError("Cannot map file '%ls'", path.c_str());
+        m_data = reinterpret_cast<const char*>(data);
+        m_size = sb.st_size;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+            UnmapViewOfFile(m_data);
+        if (m_mappingHandle != NULL)
+            CloseHandle(m_mappingHandle);
+        if (m_fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(m_fileHandle);
+#else
+        if (m_data != nullptr)
+            munmap(const_cast<char*>(m_data), m_size);
+        if (m_fileDescriptor != -1)
+            close(m_fileDescriptor);
+#endif
+    }
+
+    // pointer to 'size' bytes at 'offset', with a bounds check
+    const char* At(uint64_t offset, uint64_t size) const
+    {
+        if (offset > m_size || size > m_size - offset)
+            RuntimeError("Unexpected end of the image record file (offset %lu, size %lu), the file is corrupt.", (unsigned long) offset, (unsigned long) size);
+        return m_data + offset;
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE m_mappingHandle = NULL;
+#else
+    int m_fileDescriptor = -1;
+#endif
+};
+
+// A chunk of an image record file. Raw images are used where they are in the mapping.
+class ImageDataDeserializer::ImageRecordChunk : public Chunk, public std::enable_shared_from_this<ImageRecordChunk>
+{
+    ImageDataDeserializer& m_parent;
+    MappedFilePtr m_file; // keeps the mapping alive as long as any sequence of the chunk is in use
+    size_t m_chunkId;
 
-        // Convert element type.
-        int dataType = m_parent.m_featureElementType == ElementType::tfloat ? CV_32F : CV_64F;
-        if (cvImage.type() != CV_MAKETYPE(dataType, cvImage.channels()))
+public:
+    ImageRecordChunk(ImageDataDeserializer& parent, size_t chunkId)
+        : m_parent(parent), m_file(parent.m_recordFile), m_chunkId(chunkId)
+    {
+    }
+
+    virtual std::vector<SequenceDataPtr> GetSequence(const size_t& sequenceId) override
+    {
+        const auto& imageSequence = m_parent.m_imageSequences[sequenceId];
+        assert(imageSequence.m_chunkId == m_chunkId);
+        const auto& chunk = *m_parent.m_recordChunks[m_chunkId];
+        const auto& record = *m_parent.m_records[sequenceId];
+        if (record.m_offset > chunk.m_size || record.m_size > chunk.m_size - record.m_offset)
+            RuntimeError("Image '%s' lies outside of its chunk, the image record file is corrupt.", imageSequence.m_path.c_str());
+        char* data = const_cast<char*>(m_file->At(chunk.m_offset + record.m_offset, record.m_size));
+
+        cv::Mat image;
+        if (m_parent.m_recordEncoding == ImageRecordEncoding::raw)
         {
-            cvImage.convertTo(cvImage, dataType);
+            if (record.m_size != (uint64_t) record.m_width * record.m_height * m_parent.m_recordChannels)
+                RuntimeError("Image '%s' has an unexpected size, the image record file is corrupt.", imageSequence.m_path.c_str());
+            image = cv::Mat(record.m_height, record.m_width, CV_MAKETYPE(CV_8U, (int) m_parent.m_recordChannels), data);
         }
-
-        if (!cvImage.isContinuous())
+        else
         {
-            cvImage = cvImage.clone();
+            image = cv::imdecode(cv::Mat(1, (int) record.m_size, CV_8U, data), cv::IMREAD_COLOR);
+            if (!image.data)
+                RuntimeError("Cannot decode image '%s'", imageSequence.m_path.c_str());
         }
-        assert(cvImage.isContinuous());
-
-        image->m_data = image->m_image.data;
-        ImageDimensions dimensions(cvImage.cols, cvImage.rows, cvImage.channels());
-        image->m_sampleLayout = std::make_shared<TensorShape>(dimensions.AsTensorShape(HWC));
-        image->m_numberOfSamples = 1;
-        image->m_chunk = shared_from_this();
-
-        SparseSequenceDataPtr label = std::make_shared<SparseSequenceData>();
-        label->m_chunk = shared_from_this();
-        m_parent.m_labelGenerator->CreateLabelFor(imageSequence.m_classId, *label);
-        return std::vector<SequenceDataPtr> { image, label };
+        return m_parent.CreateSequence(image, imageSequence, shared_from_this());
     }
 };
 
+std::vector<SequenceDataPtr> ImageDataDeserializer::CreateSequence(cv::Mat cvImage, const ImageSequenceDescription& imageSequence, const ChunkPtr& chunk)
+{
+    auto image = std::make_shared<DeserializedImage>();
+
+    // Convert element type.
+    int dataType = m_featureElementType == ElementType::tfloat ? CV_32F : CV_64F;
+    if (m_keepDecodedImages)
+    {
+        if (cvImage.depth() != CV_8U)
+        {
+            RuntimeError("Image '%s' does not have 8 bits per value, as required by gpuAugmentation.", imageSequence.m_path.c_str());
+        }
+    }
+    else if (cvImage.type() != CV_MAKETYPE(dataType, cvImage.channels()))
+    {
+        cvImage.convertTo(cvImage, dataType);
+    }
+
+    if (!cvImage.isContinuous())
+    {
+        cvImage = cvImage.clone();
+    }
+    assert(cvImage.isContinuous());
+
+    image->m_image = cvImage;
+    image->m_data = image->m_image.data;
+    ImageDimensions dimensions(cvImage.cols, cvImage.rows, cvImage.channels());
+    image->m_sampleLayout = std::make_shared<TensorShape>(dimensions.AsTensorShape(HWC));
+    image->m_numberOfSamples = 1;
+    image->m_chunk = chunk;
+
+    SparseSequenceDataPtr label = std::make_shared<SparseSequenceData>();
+    label->m_chunk = chunk;
+    m_labelGenerator->CreateLabelFor(imageSequence.m_classId, *label);
+    return std::vector<SequenceDataPtr> { image, label };
+}
+
 ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
 {
     ImageConfigHelper configHelper(config);
@@ -116,6 +248,7 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
     feature->m_storageType = StorageType::dense;
 
     m_featureElementType = feature->m_elementType;
+    m_keepDecodedImages = configHelper.UseGpuAugmentation();
     size_t labelDimension = label->m_sampleLayout->GetDim(0);
 
     if (label->m_elementType == ElementType::tfloat)
@@ -131,7 +264,20 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
         RuntimeError("Unsupported label element type '%d'.", (int)label->m_elementType);
     }
 
-    CreateSequenceDescriptions(configHelper.GetMapPath(), labelDimension);
+    if (configHelper.GetRecordPath().empty())
+    {
+        CreateSequenceDescriptions(configHelper.GetMapPath(), labelDimension);
+    }
+    else
+    {
+        CreateSequenceDescriptionsFromRecords(configHelper.GetRecordPath(), labelDimension);
+        if (m_recordChannels != dimensions.m_numChannels)
+        {
+            RuntimeError("The images of the record file have %d channels, the feature stream expects %d.",
+                         static_cast<int>(m_recordChannels),
+                         static_cast<int>(dimensions.m_numChannels));
+        }
+    }
 }
 
 void ImageDataDeserializer::CreateSequenceDescriptions(std::string mapPath, size_t labelDimension)
@@ -179,6 +325,65 @@ void ImageDataDeserializer::CreateSequenceDescriptions(std::string mapPath, size
     }
 }
 
+void ImageDataDeserializer::CreateSequenceDescriptionsFromRecords(const std::wstring& recordPath, size_t labelDimension)
+{
+    m_recordFile = std::make_shared<MappedFile>(recordPath);
+    const auto& header = *reinterpret_cast<const ImageRecordFileHeader*>(m_recordFile->At(0, sizeof(ImageRecordFileHeader)));
+    if (header.m_magic != ImageRecordFileMagic)
+    {
+        RuntimeError("File '%ls' is not an image record file.", recordPath.c_str());
+    }
+    if (header.m_version != ImageRecordFileVersion)
+    {
+        RuntimeError("Image record file '%ls' has version %d, only version %d is supported.",
+                     recordPath.c_str(),
+                     static_cast<int>(header.m_version),
+                     static_cast<int>(ImageRecordFileVersion));
+    }
+    m_recordEncoding = header.m_encoding;
+    m_recordChannels = header.m_channels;
+
+    auto chunks = reinterpret_cast<const ImageRecordChunkDescriptor*>(
+        m_recordFile->At(header.m_chunkTableOffset, header.m_numberOfChunks * sizeof(ImageRecordChunkDescriptor)));
+    std::string path = msra::strfun::utf8(recordPath);
+    ImageSequenceDescription description;
+    description.m_numberOfSamples = 1;
+    description.m_isValid = true;
+    for (size_t chunkId = 0; chunkId < header.m_numberOfChunks; ++chunkId)
+    {
+        m_recordChunks.push_back(&chunks[chunkId]);
+        auto records = reinterpret_cast<const ImageRecord*>(
+            m_recordFile->At(chunks[chunkId].m_offset, chunks[chunkId].m_numberOfImages * sizeof(ImageRecord)));
+        for (size_t i = 0; i < chunks[chunkId].m_numberOfImages; ++i)
+        {
+            description.m_id = m_imageSequences.size();
+            description.m_chunkId = chunkId;
+            description.m_path = path + "[" + std::to_string(description.m_id) + "]"; // (for messages only)
+            description.m_classId = records[i].m_classId;
+            if (description.m_classId >= labelDimension)
+            {
+                RuntimeError(
+                    "Image '%s' has invalid class id '%d'. Expected label dimension is '%d'.",
+                    description.m_path.c_str(),
+                    static_cast<int>(description.m_classId),
+                    static_cast<int>(labelDimension));
+            }
+            m_imageSequences.push_back(description);
+            m_records.push_back(&records[i]);
+        }
+    }
+
+    if (m_imageSequences.size() != header.m_numberOfImages)
+    {
+        RuntimeError("Image record file '%ls' holds %d images instead of %d, the file is corrupt.",
+                     recordPath.c_str(),
+                     static_cast<int>(m_imageSequences.size()),
+                     static_cast<int>(header.m_numberOfImages));
+    }
+    fprintf(stderr, "ImageDataDeserializer: %d images in %d chunks from record file '%ls'.\n",
+            static_cast<int>(m_imageSequences.size()), static_cast<int>(m_recordChunks.size()), recordPath.c_str());
+}
+
 std::vector<StreamDescriptionPtr> ImageDataDeserializer::GetStreamDescriptions() const
 {
     return m_streams;
@@ -199,6 +404,11 @@ void ImageDataDeserializer::FillSequenceDescriptions(SequenceDescriptions& timel
 
 ChunkPtr ImageDataDeserializer::GetChunk(size_t chunkId)
 {
+    if (m_recordFile)
+    {
+        return std::make_shared<ImageRecordChunk>(*this, chunkId);
+    }
+
     auto sequenceDescription = m_imageSequences[chunkId];
     return std::make_shared<ImageChunk>(sequenceDescription, *this);
 }
@@ -250,6 +460,142 @@ cv::Mat ImageDataDeserializer::ReadImage(size_t seqId, const std::string& path)
     return (*r).second->Read(seqId, path);
 }
 
+void ImageDataDeserializer::WriteRecordFile(const ConfigParameters& config)
+{
+    std::wstring outputPath = config(L"outputPath");
+    size_t shorterSide = config(L"shorterSide", "256"); // 0: keep the size
+    std::string encoding = config(L"encoding", "raw");  // raw, or the extension of the format to re-encode to (jpg, png)
+    int quality = config(L"quality", "90");             // of jpg
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", "33554432");
+
+    ConfigParameters readerConfig(config(L"reader"));
+    if (!ImageConfigHelper(readerConfig).GetRecordPath().empty())
+    {
+        InvalidArgument("convertImageRecords: The reader must read the map file to convert, not a record file.");
+    }
+    ImageDataDeserializer deserializer(readerConfig);
+    const bool raw = AreEqualIgnoreCase(encoding, "raw");
+    const std::string extension = "." + encoding;
+    std::vector<int> encodingParameters;
+    if (AreEqualIgnoreCase(encoding, "jpg") || AreEqualIgnoreCase(encoding, "jpeg"))
+    {
+        encodingParameters = std::vector<int>{ cv::IMWRITE_JPEG_QUALITY, quality };
+    }
+
+    auto file = fopenOrDie(outputPath, L"wb");
+    ImageRecordFileHeader header = {};
+    fwriteOrDie(&header, sizeof(header), 1, file);
+    uint64_t offset = sizeof(header);
+    std::vector<ImageRecordChunkDescriptor> chunkTable;
+
+    // current chunk
+    std::vector<ImageRecord> records;
+    std::vector<char> payload;
+    auto flushChunk = [&]()
+    {
+        if (records.empty())
+        {
+            return;
+        }
+        size_t recordsSize = records.size() * sizeof(ImageRecord);
+        for (auto& record : records)
+        {
+            record.m_offset += recordsSize;
+        }
+        fwriteOrDie(records.data(), sizeof(ImageRecord), records.size(), file);
+        fwriteOrDie(payload.data(), 1, payload.size(), file);
+        chunkTable.push_back(ImageRecordChunkDescriptor{ offset, recordsSize + payload.size(), records.size() });
+        offset += recordsSize + payload.size();
+        records.clear();
+        payload.clear();
+    };
+
+    // Images are decoded, scaled and encoded in parallel, a batch at a time, and written in the order of the map file.
+    const auto& images = deserializer.m_imageSequences;
+    const size_t batchSize = 256;
+    std::vector<std::vector<unsigned char>> batchData(batchSize);
+    std::vector<ImageRecord> batchRecords(batchSize);
+    std::vector<char> batchFailed(batchSize);
+    for (size_t first = 0; first < images.size(); first += batchSize)
+    {
+        const int count = static_cast<int>(std::min(batchSize, images.size() - first));
+#pragma omp parallel for
+        for (int i = 0; i < count; i++)
+        {
+            const auto& description = images[first + i];
+            batchFailed[i] = true;
+            try // (no exception must leave the parallel loop)
+            {
+                cv::Mat image = deserializer.ReadImage(description.m_id, description.m_path);
+                if (!image.data || image.depth() != CV_8U)
+                {
+                    continue;
+                }
+                int side = std::min(image.rows, image.cols);
+                if (shorterSide > 0 && side > (int) shorterSide)
+                {
+                    cv::Size size(static_cast<int>(std::lround((double) image.cols * shorterSide / side)),
+                                  static_cast<int>(std::lround((double) image.rows * shorterSide / side)));
+                    cv::resize(image, image, size, 0, 0, cv::INTER_AREA);
+                }
+                if (raw)
+                {
+                    if (!image.isContinuous())
+                    {
+                        image = image.clone();
+                    }
+                    batchData[i].assign(image.data, image.data + image.total() * image.elemSize());
+                }
+                else if (!cv::imencode(extension, image, batchData[i], encodingParameters))
+                {
+                    continue;
+                }
+                batchRecords[i] = ImageRecord{ 0, batchData[i].size(), (uint32_t) image.cols, (uint32_t) image.rows, description.m_classId };
+                batchFailed[i] = image.channels() != 3;
+            }
+            catch (...)
+            {
+            }
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (batchFailed[i])
+            {
+                RuntimeError("convertImageRecords: Cannot read image '%s'.", images[first + i].m_path.c_str());
+            }
+            batchRecords[i].m_offset = payload.size();
+            records.push_back(batchRecords[i]);
+            payload.insert(payload.end(), batchData[i].begin(), batchData[i].end());
+            payload.resize(ImageRecordAlign(payload.size()));
+            if (records.size() * sizeof(ImageRecord) + payload.size() >= chunkSizeInBytes)
+            {
+                flushChunk();
+            }
+        }
+    }
+    flushChunk();
+
+    header.m_magic = ImageRecordFileMagic;
+    header.m_version = ImageRecordFileVersion;
+    header.m_encoding = raw ? ImageRecordEncoding::raw : ImageRecordEncoding::encoded;
+    header.m_channels = 3; // (decoded as cv::IMREAD_COLOR)
+    header.m_shorterSide = static_cast<uint32_t>(shorterSide);
+    header.m_numberOfChunks = chunkTable.size();
+    header.m_numberOfImages = images.size();
+    header.m_chunkTableOffset = offset;
+    if (!chunkTable.empty())
+    {
+        fwriteOrDie(chunkTable.data(), sizeof(ImageRecordChunkDescriptor), chunkTable.size(), file);
+    }
+    fseekOrDie(file, 0);
+    fwriteOrDie(&header, sizeof(header), 1, file);
+    fcloseOrDie(file);
+
+    fprintf(stderr, "convertImageRecords: Wrote %d images in %d chunks (%.1f MB) to '%ls'.\n",
+            static_cast<int>(images.size()), static_cast<int>(chunkTable.size()), offset / 1e6, outputPath.c_str());
+}
+
 cv::Mat FileByteReader::Read(size_t, const std::string& path)
 {
     assert(!path.empty());
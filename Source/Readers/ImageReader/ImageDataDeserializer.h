@@ -8,6 +8,7 @@
 #include "DataDeserializerBase.h"
 #include "Config.h"
 #include "ByteReader.h"
+#include "ImageRecordFormat.h"
 #include <unordered_map>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -17,6 +18,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // All sequences consist only of a single sample (image/label).
 // For features it uses dense storage format with different layout (dimensions) per sequence.
 // For labels it uses the csc sparse storage format.
+// The images either come from the files listed in a map file, one chunk per image, or from an image record file
+// (see ImageRecordFormat.h), which is mapped into memory and whose chunks are taken as they are.
 class ImageDataDeserializer : public DataDeserializerBase
 {
 public:
@@ -28,12 +31,17 @@ public:
     // Get sequences by specified ids. Order of returned sequences corresponds to the order of provided ids.
     virtual ChunkPtr GetChunk(size_t chunkId) override;
 
+    // Decodes the images of the map file of config(L"reader") once, scales them down to the size they are trained at,
+    // and writes them to an image record file. Implements the "convertImageRecords" action.
+    static void WriteRecordFile(const ConfigParameters& config);
+
 protected:
     void FillSequenceDescriptions(SequenceDescriptions& timeline) const override;
 
 private:
     // Creates a set of sequence descriptions.
     void CreateSequenceDescriptions(std::string mapPath, size_t labelDimension);
+    void CreateSequenceDescriptionsFromRecords(const std::wstring& recordPath, size_t labelDimension);
 
     // Image sequence descriptions. Currently, a sequence contains a single sample only.
     struct ImageSequenceDescription : public SequenceDescription
@@ -43,6 +51,12 @@ private:
     };
 
     class ImageChunk;
+    class ImageRecordChunk;
+    class MappedFile;
+    typedef std::shared_ptr<MappedFile> MappedFilePtr;
+
+    // Turns a decoded image into the sequences of the feature and the label stream.
+    std::vector<SequenceDataPtr> CreateSequence(cv::Mat image, const ImageSequenceDescription& description, const ChunkPtr& chunk);
 
     // A helper class for generation of type specific labels (currently float/double only).
     class LabelGenerator;
@@ -55,6 +69,9 @@ private:
     // Element type of the feature/label stream (currently float/double only).
     ElementType m_featureElementType;
 
+    // Images are passed on as decoded (8 bit) instead of converted to the element type, see PackedImageTransformer.
+    bool m_keepDecodedImages;
+
     // Not using nocase_compare here as it's not correct on Linux.
     using PathReaderMap = std::unordered_map<std::string, std::shared_ptr<ByteReader>>;
     void RegisterByteReader(size_t seqId, const std::string& path, PathReaderMap& knownReaders);
@@ -65,6 +82,13 @@ private:
     SeqReaderMap m_readers;
 
     FileByteReader m_defaultReader;
+
+    // Image record file, if the images come from one.
+    MappedFilePtr m_recordFile;
+    std::vector<const ImageRecordChunkDescriptor*> m_recordChunks;
+    std::vector<const ImageRecord*> m_records; // [sequence id]
+    ImageRecordEncoding m_recordEncoding;
+    size_t m_recordChannels;
 };
 
 }}}
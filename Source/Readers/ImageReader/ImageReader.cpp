@@ -17,7 +17,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 ImageReader::ImageReader(MemoryProviderPtr provider,
                          const ConfigParameters& config)
-    : m_seed(0), m_provider(provider)
+    : m_seed(0), m_provider(provider), m_numberOfBuffers(1)
 {
     // In the future, deserializers and transformers will be dynamically loaded
     // from external libraries based on the configuration/brain script.
@@ -48,6 +48,15 @@ ImageReader::ImageReader(MemoryProviderPtr provider,
 
     randomizer->Initialize(nullptr, config);
 
+    if (configHelper.UseGpuAugmentation())
+    {
+        // Crop, scale, mean and transpose are done by the consumer of the minibatch, on the device of its input.
+        m_streams[configHelper.GetFeatureStreamId()]->m_storageType = StorageType::packed_images;
+        m_transformer = std::make_shared<PackedImageTransformer>();
+        m_transformer->Initialize(randomizer, config);
+        return;
+    }
+
     auto cropper = std::make_shared<CropTransformer>();
     cropper->Initialize(randomizer, config);
 
@@ -57,6 +66,8 @@ ImageReader::ImageReader(MemoryProviderPtr provider,
     auto mean = std::make_shared<MeanTransformer>();
     mean->Initialize(scaler, config);
 
+    // HWC data is passed on as decoded, without a copy; convolution, pooling and batch normalization
+    // handle that layout directly (on the GPU with cuDNN if cudnnForHWC is set).
     TransformerPtr last = mean;
     if (configHelper.GetDataFormat() == CHW)
     {
@@ -85,7 +96,19 @@ void ImageReader::StartEpoch(const EpochConfiguration& config)
         m_provider,
         m_transformer,
         config.m_minibatchSizeInSamples,
-        m_streams);
+        m_streams,
+        m_numberOfBuffers);
+}
+
+bool ImageReader::SetMemoryProvider(MemoryProviderPtr provider, size_t numberOfBuffers)
+{
+    m_provider = provider;
+    m_numberOfBuffers = numberOfBuffers;
+    if (m_packer != nullptr)
+    {
+        m_packer->SetMemoryProvider(provider, numberOfBuffers);
+    }
+    return true;
 }
 
 Minibatch ImageReader::ReadMinibatch()
@@ -29,6 +29,15 @@ public:
     // Reads a single minibatch.
     Minibatch ReadMinibatch() override;
 
+    // Lets the packer allocate its buffers from the provider, keeping numberOfBuffers minibatches.
+    bool SetMemoryProvider(MemoryProviderPtr provider, size_t numberOfBuffers) override;
+
+    // The counters of the transformers, the randomizer and the deserializer.
+    void GetStatistics(std::map<std::string, double>& stats) const override
+    {
+        m_transformer->GetStatistics(stats);
+    }
+
 private:
     // All streams this reader provides.
     std::vector<StreamDescriptionPtr> m_streams;
@@ -44,6 +53,9 @@ private:
 
     // Memory provider (TODO: this will possibly change in the near future.)
     MemoryProviderPtr m_provider;
+
+    // Number of minibatches whose data the packer keeps valid, see Reader::SetMemoryProvider().
+    size_t m_numberOfBuffers;
 };
 
 }}}
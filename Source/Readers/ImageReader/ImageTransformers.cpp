@@ -141,6 +141,18 @@ void CropTransformer::Apply(cv::Mat &mat)
             return std::make_unique<std::mt19937>(seed);
         });
 
+    bool flip;
+    mat = mat(ChooseCrop(mat.rows, mat.cols, *rng, flip));
+    if (flip)
+    {
+        cv::flip(mat, mat, 1);
+    }
+
+    m_rngs.push(std::move(rng));
+}
+
+cv::Rect CropTransformer::ChooseCrop(int rows, int cols, std::mt19937 &rng, bool &flip)
+{
     double ratio = 1;
     switch (m_jitterType)
     {
@@ -154,7 +166,7 @@ void CropTransformer::Apply(cv::Mat &mat)
         }
         else
         {
-            ratio = UniRealT(m_cropRatioMin, m_cropRatioMax)(*rng);
+            ratio = UniRealT(m_cropRatioMin, m_cropRatioMax)(rng);
             assert(m_cropRatioMin <= ratio && ratio < m_cropRatioMax);
         }
         break;
@@ -162,13 +174,9 @@ void CropTransformer::Apply(cv::Mat &mat)
         RuntimeError("Jitter type currently not implemented.");
     }
 
-    mat = mat(GetCropRect(m_cropType, mat.rows, mat.cols, ratio, *rng));
-    if (m_hFlip && std::bernoulli_distribution()(*rng))
-    {
-        cv::flip(mat, mat, 1);
-    }
-
-    m_rngs.push(std::move(rng));
+    cv::Rect rect = GetCropRect(m_cropType, rows, cols, ratio, rng);
+    flip = m_hFlip && std::bernoulli_distribution()(rng);
+    return rect;
 }
 
 CropTransformer::CropType
@@ -339,10 +347,14 @@ void MeanTransformer::Initialize(TransformerPtr next,
 
 void MeanTransformer::InitFromConfig(const ConfigParameters &config)
 {
+    m_meanImg = ReadMeanImage(config);
+}
+
+cv::Mat MeanTransformer::ReadMeanImage(const ConfigParameters &config)
+{
+    cv::Mat meanImg;
     std::wstring meanFile = config(L"meanFile", L"");
-    if (meanFile.empty())
-        m_meanImg.release();
-    else
+    if (!meanFile.empty())
     {
         cv::FileStorage fs;
         // REVIEW alexeyk: this sort of defeats the purpose of using wstring at
@@ -350,7 +362,7 @@ void MeanTransformer::InitFromConfig(const ConfigParameters &config)
         fs.open(msra::strfun::utf8(meanFile).c_str(), cv::FileStorage::READ);
         if (!fs.isOpened())
             RuntimeError("Could not open file: %ls", meanFile.c_str());
-        fs["MeanImg"] >> m_meanImg;
+        fs["MeanImg"] >> meanImg;
         int cchan;
         fs["Channel"] >> cchan;
         int crow;
@@ -358,11 +370,12 @@ void MeanTransformer::InitFromConfig(const ConfigParameters &config)
         int ccol;
         fs["Col"] >> ccol;
         if (cchan * crow * ccol !=
-            m_meanImg.channels() * m_meanImg.rows * m_meanImg.cols)
+            meanImg.channels() * meanImg.rows * meanImg.cols)
             RuntimeError("Invalid data in file: %ls", meanFile.c_str());
         fs.release();
-        m_meanImg = m_meanImg.reshape(cchan, crow);
+        meanImg = meanImg.reshape(cchan, crow);
     }
+    return meanImg;
 }
 
 void MeanTransformer::Apply(cv::Mat &mat)
@@ -471,4 +484,99 @@ TransposeTransformer::TypedApply(SequenceDataPtr sequence,
     return result;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The decoded image; its pixels stay where the deserializer put them until the packer has copied them.
+struct PackedImageSequence : PackedImageSequenceData
+{
+    SequenceDataPtr m_original;
+};
+
+void PackedImageTransformer::Initialize(TransformerPtr next,
+                                        const ConfigParameters &readerConfig)
+{
+    CropTransformer::Initialize(next, readerConfig);
+
+    ImageConfigHelper configHelper(readerConfig);
+    auto featureStreamId = GetAppliedStreamIds()[0];
+    const auto &feature = GetInputStreams()[featureStreamId];
+    const ConfigParameters &config = readerConfig(feature->m_name);
+
+    auto parameters = std::make_shared<PackedImagesParameters>();
+    parameters->m_width = config(L"width");
+    parameters->m_height = config(L"height");
+    parameters->m_channels = config(L"channels");
+    parameters->m_transpose = configHelper.GetDataFormat() == CHW;
+    size_t size = parameters->m_width * parameters->m_height * parameters->m_channels;
+    if (size == 0 || size > std::numeric_limits<uint32_t>::max())
+        RuntimeError("Invalid image dimensions.");
+
+    cv::Mat mean = MeanTransformer::ReadMeanImage(config);
+    if (!mean.empty())
+    {
+        if (mean.cols != parameters->m_width || mean.rows != parameters->m_height || mean.channels() != parameters->m_channels)
+            RuntimeError("The mean image does not have the dimensions of the output images.");
+        mean.convertTo(mean, CV_MAKETYPE(CV_32F, mean.channels()));
+        mean = mean.clone(); // (continuous)
+        parameters->m_mean.assign(mean.ptr<float>(), mean.ptr<float>() + size);
+    }
+    m_parameters = parameters;
+
+    std::stringstream ss{config(L"interpolations", "")};
+    for (std::string token = ""; std::getline(ss, token, ':');)
+    {
+        if (AreEqualIgnoreCase(token, "nearest"))
+            m_interpolations.push_back(packedImageNearest);
+        else if (AreEqualIgnoreCase(token, "linear"))
+            m_interpolations.push_back(packedImageLinear);
+        else
+            InvalidArgument("Interpolation '%s' is not supported with gpuAugmentation, only 'nearest' and 'linear' are.", token.c_str());
+    }
+    if (m_interpolations.empty())
+        m_interpolations.push_back(packedImageLinear);
+
+    auto output = std::make_shared<StreamDescription>(*feature);
+    output->m_storageType = StorageType::packed_images;
+    output->m_sampleLayout = std::make_shared<TensorShape>(
+        ImageDimensions(parameters->m_width, parameters->m_height, parameters->m_channels).AsTensorShape(configHelper.GetDataFormat()));
+    m_outputStreams[featureStreamId] = output;
+}
+
+SequenceDataPtr PackedImageTransformer::Apply(SequenceDataPtr sequence,
+                                              const StreamDescription & /*inputStream*/,
+                                              const StreamDescription & /*outputStream*/)
+{
+    const auto &inputSequence = static_cast<const DenseSequenceData&>(*sequence);
+    ImageDimensions dimensions(*inputSequence.m_sampleLayout, HWC);
+    if (dimensions.m_numChannels != m_parameters->m_channels)
+        RuntimeError("Image has %d channels, the output images %d.", (int)dimensions.m_numChannels, (int)m_parameters->m_channels);
+
+    auto seed = GetSeed();
+    auto rng = m_rngs.pop_or_create(
+        [seed]()
+        {
+            return std::make_unique<std::mt19937>(seed);
+        });
+
+    bool flip;
+    cv::Rect crop = ChooseCrop(static_cast<int>(dimensions.m_height), static_cast<int>(dimensions.m_width), *rng, flip);
+    auto interpolation = m_interpolations[UniIntT(0, static_cast<int>(m_interpolations.size()) - 1)(*rng)];
+    m_rngs.push(std::move(rng));
+
+    auto result = std::make_shared<PackedImageSequence>();
+    result->m_image.m_offset = 0; // (set by the packer)
+    result->m_image.m_width = static_cast<uint32_t>(dimensions.m_width);
+    result->m_image.m_height = static_cast<uint32_t>(dimensions.m_height);
+    result->m_image.m_cropX = crop.x;
+    result->m_image.m_cropY = crop.y;
+    result->m_image.m_cropWidth = crop.width;
+    result->m_image.m_cropHeight = crop.height;
+    result->m_image.m_flip = flip ? 1 : 0;
+    result->m_image.m_interpolation = interpolation;
+    result->m_parameters = m_parameters;
+    result->m_data = inputSequence.m_data;
+    result->m_original = sequence;
+    return result;
+}
+
 }}}
@@ -56,8 +56,9 @@ protected:
     // The only function that should be redefined by the inherited classes.
     virtual void Apply(cv::Mat &from) = 0;
 
-private:
     std::vector<StreamDescriptionPtr> m_outputStreams;
+
+private:
     std::vector<StreamId> m_appliedStreamIds;
     unsigned int m_seed;
 };
@@ -72,6 +73,15 @@ public:
 
 protected:
     virtual void Apply(cv::Mat &mat) override;
+    virtual std::string GetStageName() const override
+    {
+        return "crop";
+    }
+
+    // Chooses the region of an image of the given size to crop, and whether to mirror it.
+    cv::Rect ChooseCrop(int rows, int cols, std::mt19937 &rng, bool &flip);
+
+    conc_pool<std::unique_ptr<std::mt19937>> m_rngs;
 
 private:
     enum class CropType
@@ -93,7 +103,6 @@ private:
     cv::Rect GetCropRect(CropType type, int crow, int ccol, double cropRatio,
                          std::mt19937 &rng);
 
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
     CropType m_cropType;
     double m_cropRatioMin;
     double m_cropRatioMax;
@@ -109,6 +118,12 @@ public:
     virtual void Initialize(TransformerPtr next,
                             const ConfigParameters &readerConfig) override;
 
+protected:
+    virtual std::string GetStageName() const override
+    {
+        return "scale";
+    }
+
 private:
     void InitFromConfig(const ConfigParameters &config);
     virtual void Apply(cv::Mat &mat) override;
@@ -117,7 +132,7 @@ private:
     StrToIntMapT m_interpMap;
     std::vector<int> m_interp;
 
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
+    conc_pool<std::unique_ptr<std::mt19937>> m_rngs;
     int m_dataType;
     size_t m_imgWidth;
     size_t m_imgHeight;
@@ -131,6 +146,15 @@ public:
     virtual void Initialize(TransformerPtr next,
                             const ConfigParameters &readerConfig) override;
 
+    // Reads the mean image given by 'meanFile'; empty if none is given.
+    static cv::Mat ReadMeanImage(const ConfigParameters &config);
+
+protected:
+    virtual std::string GetStageName() const override
+    {
+        return "mean";
+    }
+
 private:
     virtual void Apply(cv::Mat &mat) override;
     void InitFromConfig(const ConfigParameters &config);
@@ -160,6 +184,11 @@ protected:
                           const StreamDescription &inputStream,
                           const StreamDescription &outputStream) override;
 
+    virtual std::string GetStageName() const override
+    {
+        return "transpose";
+    }
+
 private:
     template <class TElement>
     SequenceDataPtr TypedApply(SequenceDataPtr inputSequence,
@@ -170,4 +199,29 @@ private:
     std::vector<StreamId> m_appliedStreamIds;
 };
 
+// Takes the place of crop, scale, mean and transpose when the consumer of the minibatch does all of that on the device
+// of its input (gpuAugmentation, see PackedImages.h): the images are passed on as decoded, each with the crop, mirroring
+// and interpolation chosen for it. Takes the options of the transformers it replaces; only the 'nearest' and 'linear'
+// interpolations are supported.
+class PackedImageTransformer : public CropTransformer
+{
+public:
+    virtual void Initialize(TransformerPtr next,
+                            const ConfigParameters &readerConfig) override;
+
+protected:
+    SequenceDataPtr Apply(SequenceDataPtr inputSequence,
+                          const StreamDescription &inputStream,
+                          const StreamDescription &outputStream) override;
+
+    virtual std::string GetStageName() const override
+    {
+        return "pack images";
+    }
+
+private:
+    std::shared_ptr<const PackedImagesParameters> m_parameters;
+    std::vector<PackedImageInterpolation> m_interpolations;
+};
+
 }}}
@@ -9,6 +9,14 @@
 
 #ifdef USE_ZIP
 
+#include <cstring>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 std::string GetZipError(int err)
@@ -21,9 +29,193 @@ std::string GetZipError(int err)
 }
 
 ZipByteReader::ZipByteReader(const std::string& zipPath)
-    : m_zipPath(zipPath)
+    : m_zipPath(zipPath), m_mappedData(nullptr), m_mappedSize(0), m_fileHandle(nullptr), m_fileMappingHandle(nullptr), m_fileDescriptor(-1), m_indexed(false)
 {
     assert(!m_zipPath.empty());
+    MapArchive();
+    m_indexed = m_mappedData != nullptr && IndexCentralDirectory();
+    if (!m_indexed)
+        fprintf(stderr, "WARNING: Could not index %s directly, falling back to looking up its entries through the zip library.\n", m_zipPath.c_str());
+}
+
+ZipByteReader::~ZipByteReader()
+{
+    UnmapArchive();
+}
+
+// Map the entire archive into memory. Failure is not fatal, we then read everything through libzip.
+void ZipByteReader::MapArchive()
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(m_zipPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    m_fileHandle = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return;
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+        return;
+    m_fileMappingHandle = mapping;
+    m_mappedData = reinterpret_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_mappedData != nullptr)
+        m_mappedSize = (size_t) size.QuadPart;
+#else
+    m_fileDescriptor = open(m_zipPath.c_str(), O_RDONLY);
+    if (m_fileDescriptor == -1)
+        return;
+    struct stat sb;
+    if (fstat(m_fileDescriptor, &sb) == -1 || sb.st_size == 0)
+        return;
+    void* data = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, m_fileDescriptor, 0);
+    if (data == MAP_FAILED)
+        return;
+    // Images are read in randomized order, so read-ahead around each access would mostly fetch pages we do not need (yet).
+    madvise(data, sb.st_size, MADV_RANDOM);
+    m_mappedData = reinterpret_cast<const unsigned char*>(data);
+    m_mappedSize = sb.st_size;
+#endif
+}
+
+void ZipByteReader::UnmapArchive()
+{
+#ifdef _WIN32
+    if (m_mappedData != nullptr)
+        UnmapViewOfFile(m_mappedData);
+    if (m_fileMappingHandle != nullptr)
+        CloseHandle(m_fileMappingHandle);
+    if (m_fileHandle != nullptr)
+        CloseHandle(m_fileHandle);
+#else
+    if (m_mappedData != nullptr)
+        munmap(const_cast<unsigned char*>(m_mappedData), m_mappedSize);
+    if (m_fileDescriptor != -1)
+        close(m_fileDescriptor);
+#endif
+    m_mappedData = nullptr;
+    m_mappedSize = 0;
+    m_fileHandle = nullptr;
+    m_fileMappingHandle = nullptr;
+    m_fileDescriptor = -1;
+}
+
+// helpers to read little-endian values from the mapped archive
+template <class T>
+static T ReadLittleEndian(const unsigned char* p)
+{
+    T value = 0;
+    for (size_t i = sizeof(T); i-- > 0;)
+        value = (T) ((value << 8) | p[i]);
+    return value;
+}
+
+// Parse the central directory of the mapped archive (including ZIP64 extensions) into m_nameToEntry.
+// Returns false if the archive does not look like something we can index; the caller then falls back to libzip.
+bool ZipByteReader::IndexCentralDirectory()
+{
+    const size_t endOfCentralDirSize = 22;
+    const size_t zip64LocatorSize = 20;
+    const size_t centralDirHeaderSize = 46;
+    if (m_mappedSize < endOfCentralDirSize)
+        return false;
+
+    // find the end-of-central-directory record, which is followed by a comment of up to 64K
+    const unsigned char* data = m_mappedData;
+    size_t searchStart = m_mappedSize > endOfCentralDirSize + 0xffff ? m_mappedSize - endOfCentralDirSize - 0xffff : 0;
+    size_t eocd = SIZE_MAX;
+    for (size_t pos = m_mappedSize - endOfCentralDirSize + 1; pos-- > searchStart;)
+    {
+        if (ReadLittleEndian<uint32_t>(data + pos) == 0x06054b50)
+        {
+            eocd = pos;
+            break;
+        }
+    }
+    if (eocd == SIZE_MAX)
+        return false;
+
+    uint64_t numEntries = ReadLittleEndian<uint16_t>(data + eocd + 10);
+    uint64_t centralDirSize = ReadLittleEndian<uint32_t>(data + eocd + 12);
+    uint64_t centralDirOffset = ReadLittleEndian<uint32_t>(data + eocd + 16);
+
+    // ZIP64: the real values live in the ZIP64 end-of-central-directory record
+    if (eocd >= zip64LocatorSize && ReadLittleEndian<uint32_t>(data + eocd - zip64LocatorSize) == 0x07064b50)
+    {
+        uint64_t zip64Eocd = ReadLittleEndian<uint64_t>(data + eocd - zip64LocatorSize + 8);
+        if (zip64Eocd + 56 > m_mappedSize || ReadLittleEndian<uint32_t>(data + zip64Eocd) != 0x06064b50)
+            return false;
+        numEntries = ReadLittleEndian<uint64_t>(data + zip64Eocd + 32);
+        centralDirSize = ReadLittleEndian<uint64_t>(data + zip64Eocd + 40);
+        centralDirOffset = ReadLittleEndian<uint64_t>(data + zip64Eocd + 48);
+    }
+    if (centralDirOffset + centralDirSize > m_mappedSize)
+        return false;
+
+    const unsigned char* p = data + centralDirOffset;
+    const unsigned char* end = p + centralDirSize;
+    m_nameToEntry.reserve((size_t) numEntries);
+    for (uint64_t index = 0; index < numEntries; index++)
+    {
+        if (p + centralDirHeaderSize > end || ReadLittleEndian<uint32_t>(p) != 0x02014b50)
+            return false;
+
+        Entry entry;
+        entry.m_index = index;
+        entry.m_encrypted = (ReadLittleEndian<uint16_t>(p + 8) & 1) != 0;
+        entry.m_method = ReadLittleEndian<uint16_t>(p + 10);
+        entry.m_compressedSize = ReadLittleEndian<uint32_t>(p + 20);
+        entry.m_size = ReadLittleEndian<uint32_t>(p + 24);
+        size_t nameLength = ReadLittleEndian<uint16_t>(p + 28);
+        size_t extraLength = ReadLittleEndian<uint16_t>(p + 30);
+        size_t commentLength = ReadLittleEndian<uint16_t>(p + 32);
+        entry.m_localHeaderOffset = ReadLittleEndian<uint32_t>(p + 42);
+        if (p + centralDirHeaderSize + nameLength + extraLength + commentLength > end)
+            return false;
+
+        // ZIP64 extended information: 64-bit versions of the fields above that are saturated, in this order
+        const unsigned char* extra = p + centralDirHeaderSize + nameLength;
+        const unsigned char* extraEnd = extra + extraLength;
+        while (extra + 4 <= extraEnd)
+        {
+            uint16_t id = ReadLittleEndian<uint16_t>(extra);
+            uint16_t size = ReadLittleEndian<uint16_t>(extra + 2);
+            const unsigned char* field = extra + 4;
+            const unsigned char* fieldEnd = field + size;
+            if (fieldEnd > extraEnd)
+                return false;
+            if (id == 0x0001)
+            {
+                if (entry.m_size == 0xffffffff && field + 8 <= fieldEnd)
+                    entry.m_size = ReadLittleEndian<uint64_t>(field), field += 8;
+                if (entry.m_compressedSize == 0xffffffff && field + 8 <= fieldEnd)
+                    entry.m_compressedSize = ReadLittleEndian<uint64_t>(field), field += 8;
+                if (entry.m_localHeaderOffset == 0xffffffff && field + 8 <= fieldEnd)
+                    entry.m_localHeaderOffset = ReadLittleEndian<uint64_t>(field), field += 8;
+            }
+            extra = fieldEnd;
+        }
+
+        m_nameToEntry[std::string(reinterpret_cast<const char*>(p + centralDirHeaderSize), nameLength)] = entry;
+        p += centralDirHeaderSize + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+// get a pointer to the contents of a stored entry in the mapped archive
+const unsigned char* ZipByteReader::GetStoredData(const Entry& entry, const std::string& path) const
+{
+    const size_t localHeaderSize = 30;
+    assert(m_indexed && entry.m_method == ZIP_CM_STORE);
+    const unsigned char* header = m_mappedData + entry.m_localHeaderOffset;
+    if (entry.m_localHeaderOffset + localHeaderSize > m_mappedSize || ReadLittleEndian<uint32_t>(header) != 0x04034b50)
+        RuntimeError("Invalid local file header for %s in %s", path.c_str(), m_zipPath.c_str());
+
+    // Note: The name and extra field lengths of the local header may differ from those in the central directory.
+    uint64_t dataOffset = entry.m_localHeaderOffset + localHeaderSize + ReadLittleEndian<uint16_t>(header + 26) + ReadLittleEndian<uint16_t>(header + 28);
+    if (dataOffset + entry.m_size > m_mappedSize)
+        RuntimeError("File %s extends beyond the end of %s", path.c_str(), m_zipPath.c_str());
+    return m_mappedData + dataOffset;
 }
 
 ZipByteReader::ZipPtr ZipByteReader::OpenZip()
@@ -46,25 +238,56 @@ ZipByteReader::ZipPtr ZipByteReader::OpenZip()
 
 void ZipByteReader::Register(size_t seqId, const std::string& path)
 {
+    if (m_indexed)
+    {
+        auto entry = m_nameToEntry.find(path);
+        if (entry == m_nameToEntry.end())
+            RuntimeError("Could not find file %s in the zip file %s", path.c_str(), m_zipPath.c_str());
+        m_seqIdToEntry[seqId] = entry->second;
+        return;
+    }
+
     auto zipFile = m_zips.pop_or_create([this]() { return OpenZip(); });
     zip_stat_t stat;
     zip_stat_init(&stat);
     int err = zip_stat(zipFile.get(), path.c_str(), 0, &stat);
     if (ZIP_ER_OK != err)
         RuntimeError("Failed to get file info of %s, zip library error: %s", path.c_str(), GetZipError(err).c_str());
-    m_seqIdToIndex[seqId] = std::make_pair(stat.index, stat.size);
+    Entry entry;
+    entry.m_index = stat.index;
+    entry.m_size = stat.size;
+    entry.m_compressedSize = stat.comp_size;
+    entry.m_localHeaderOffset = 0; // (unknown, only used when indexed)
+    entry.m_method = stat.comp_method;
+    entry.m_encrypted = stat.encryption_method != ZIP_EM_NONE;
+    m_seqIdToEntry[seqId] = entry;
     m_zips.push(std::move(zipFile));
 }
 
 cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path)
 {
     // Find index of the file in .zip file.
-    auto r = m_seqIdToIndex.find(seqId);
-    if (r == m_seqIdToIndex.end())
+    auto r = m_seqIdToEntry.find(seqId);
+    if (r == m_seqIdToEntry.end())
         RuntimeError("Could not find file %s in the zip file, sequence id = %lu", path.c_str(), (long)seqId);
+    const Entry& entry = r->second;
 
-    zip_uint64_t index = std::get<0>((*r).second);
-    zip_uint64_t size = std::get<1>((*r).second);
+    // stored entries: decode directly from the mapped archive
+    if (m_indexed && entry.m_method == ZIP_CM_STORE && !entry.m_encrypted)
+    {
+        const unsigned char* data = GetStoredData(entry, path);
+        cv::Mat img = cv::imdecode(cv::Mat(1, (int)entry.m_size, CV_8UC1, const_cast<unsigned char*>(data)), cv::IMREAD_COLOR);
+        assert(nullptr != img.data);
+        return img;
+    }
+
+    return ReadWithLibzip(seqId, entry, path);
+}
+
+cv::Mat ZipByteReader::ReadWithLibzip(size_t seqId, const Entry& entry, const std::string& path)
+{
+    zip_uint64_t index = entry.m_index;
+    zip_uint64_t size = entry.m_size;
 
     auto contents = m_workspace.pop_or_create([size]() { return vector<unsigned char>(size); });
     if (contents.size() < size)
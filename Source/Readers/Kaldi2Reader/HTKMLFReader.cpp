@@ -13,9 +13,6 @@
 
 #include "rollingwindowsource.h" // minibatch sources
 #include "utterancesourcemulti.h"
-#ifdef _WIN32
-#include "readaheadsource.h"
-#endif
 #include "chunkevalsource.h"
 #include "minibatchiterator.h"
 #define DATAREADER_EXPORTS // creating the exports here
@@ -51,6 +48,8 @@ void HTKMLFReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig
     m_uttDerivBuffer = NULL;
     m_minibatchBuffer.resize(0);
     m_minibatchBufferIndex = 0;
+    m_derivativeLookahead = 0;
+    m_numLookaheadChunks = 0;
     m_noData = false;
     m_convertLabelsToTargets = false;
     m_doSeqTrain = false;
@@ -89,6 +88,21 @@ void HTKMLFReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig
     m_currentBufferFrames.assign(m_numberOfuttsPerMinibatch, 0);
     m_uttInfo.resize(m_numberOfuttsPerMinibatch);
 
+    // m_readAhead:
+    //     If true, utterances are read and prepared by the read-ahead
+    //     pipeline while the network trains on the current minibatch.
+    // m_readAheadDepth:
+    //     Number of prepared utterances the pipeline may hold.
+    // m_readAheadThreads:
+    //     Number of workers that align labels and look up lattices.
+    m_readAhead = readerConfig(L"readAhead", true);
+    m_readAheadDepth = readerConfig(L"readAheadDepth", 2 * m_numberOfuttsPerMinibatch);
+    m_readAheadThreads = readerConfig(L"readAheadThreads", 2);
+    if (m_readAhead && (m_readAheadDepth < 1 || m_readAheadThreads < 1))
+    {
+        LogicError("readAheadDepth and readAheadThreads cannot be less than 1.\n");
+    }
+
     // Checks if we need to do sequence training.
     if (readerConfig.Exists(L"seqTrainCriterion"))
     {
@@ -226,8 +240,22 @@ void HTKMLFReader<ElemType>::PrepareForSequenceTraining(const ConfigRecordType&
                    "sequence with some other metric that using derivative "
                    "buffering?\n");
     }
+    // Derivatives of finished utterances are computed by
+    // <derivativeThreads> workers while the network moves on.
+    size_t derivativeThreads = readerConfig(L"derivativeThreads", 2);
+    if (derivativeThreads < 1)
+    {
+        LogicError("derivativeThreads cannot be less than 1.\n");
+    }
     m_uttDerivBuffer = new UtteranceDerivativeBuffer<ElemType>(
-        m_numberOfuttsPerMinibatch, m_seqTrainDeriv);
+        m_numberOfuttsPerMinibatch, m_seqTrainDeriv, derivativeThreads);
+
+    // Staleness bound of the derivatives: the likelihoods of the next
+    // utterances may be computed up to <derivativeLookahead> model updates
+    // before they would be otherwise, so that their derivatives are computed
+    // while the current minibatches are trained. 0 computes them only once
+    // they are needed.
+    m_derivativeLookahead = readerConfig(L"derivativeLookahead", 0);
 }
 
 // Loads input and output data for training and testing. Below we list the
@@ -673,6 +701,7 @@ void HTKMLFReader<ElemType>::PrepareForWriting(const ConfigRecordType& readerCon
 template <class ElemType>
 HTKMLFReader<ElemType>::~HTKMLFReader()
 {
+    StopReadAhead();
     delete m_mbiter;
     delete m_frameSource;
     delete m_lattices;
@@ -753,6 +782,7 @@ void HTKMLFReader<ElemType>::StartMinibatchLoopToTrainOrTest(size_t mbSize, size
     }
 
     // Gets a new minibatch iterator.
+    StopReadAhead();
     if (m_mbiter != NULL)
     {
         delete m_mbiter;
@@ -773,6 +803,7 @@ void HTKMLFReader<ElemType>::StartMinibatchLoopToTrainOrTest(size_t mbSize, size
     m_minibatchBuffer.clear();
     m_getMinibatchCopy = false;
     m_minibatchBufferIndex = 0;
+    m_numLookaheadChunks = 0;
     m_uttInfo.clear();
     m_minibatchUttInfo.clear();
 
@@ -802,6 +833,7 @@ void HTKMLFReader<ElemType>::StartMinibatchLoopToTrainOrTest(size_t mbSize, size
         }
     }
     m_noData = false;
+    StartReadAhead();
     m_featuresStartIndexMultiUtt.assign(m_featuresBufferMultiIO.size() * m_numberOfuttsPerMinibatch, 0);
     m_labelsStartIndexMultiUtt.assign(m_labelsBufferMultiIO.size() * m_numberOfuttsPerMinibatch, 0);
     for (size_t u = 0; u < m_numberOfuttsPerMinibatch; u++)
@@ -1435,6 +1467,13 @@ void HTKMLFReader<ElemType>::CopyMinibatchFromBufferToMatrix(
     {
         assert(index == 0);
         m_minibatchBuffer.pop_front();
+
+        // Once the current minibatches are trained, the ones read ahead
+        // become the current ones.
+        if (m_minibatchBuffer.size() <= m_numLookaheadChunks)
+        {
+            m_numLookaheadChunks = 0;
+        }
     }
 }
 
@@ -1504,10 +1543,17 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(
         {
             if (m_getMinibatchCopy)
             {
-                assert(m_minibatchBuffer.size() == 0);
+                // Minibatches that are read while there are still current
+                // ones to train are read ahead.
+                size_t first = m_minibatchBuffer.size();
+                bool lookahead = first > m_numLookaheadChunks;
                 CopyMinibatchToBuffer();
-                CopyMinibatchFromBufferToMatrix(0, matrices);
-                m_minibatchBufferIndex = 0;
+                if (lookahead)
+                {
+                    m_numLookaheadChunks += m_minibatchBuffer.size() - first;
+                }
+                CopyMinibatchFromBufferToMatrix(first, matrices);
+                m_minibatchBufferIndex = first;
             }
             else
             {
@@ -1655,179 +1701,132 @@ bool HTKMLFReader<ElemType>::GetMinibatchToWrite(std::map<std::wstring, Matrix<E
     }
 }
 
+// Read stage of the pipeline: takes the next utterance (or, in frame mode,
+// the next minibatch) from the minibatch iterator and copies its features out
+// of the frame source, whose buffers are only valid until the iterator moves
+// on. Returns NULL at the end of the data.
 template <class ElemType>
-bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
+typename HTKMLFReader<ElemType>::UtteranceUnitPtr HTKMLFReader<ElemType>::ReadUtterance()
 {
-    if (m_noData)
+    if (!(*m_mbiter))
     {
-        m_currentBufferFrames[i] = 0;
-        m_processedFrame[i] = 0;
-        m_toProcess[i] = 0;
-        m_uttInfo[i].clear();
-        return false;
+        return UtteranceUnitPtr();
     }
 
-    size_t numOfFea = m_featuresBufferMultiIO.size();
-    size_t numOfLabel = m_labelsBufferMultiIO.size();
-
-    // Number of frames we get from minibatch iterator.
-    m_currentBufferFrames[i] = m_mbiter->currentmbframes();
-
-    // If we operate at utterance level, we get the utterance information.
+    UtteranceUnitPtr unit = make_shared<UtteranceUnit>();
+    unit->numFrames = m_mbiter->currentmbframes();
     if (!m_framemode)
     {
-        m_uttInfo[i] = m_mbiter->getutteranceinfo();
-        assert(m_uttInfo[i].size() > 0);
-        // For now, let's just assume that the utterance length will be
-        // larger than the minibatch size. We can handle this more
-        // gracefully later, e.g., remove the utterance in the reader.
-        if (m_uttInfo[i].size() > 1)
+        unit->uttInfo = m_mbiter->getutteranceinfo();
+        assert(unit->uttInfo.size() > 0);
+        unit->tooLong = !m_truncated && (unit->numFrames > m_maxUtteranceLength);
+    }
+
+    // Utterances that will be skipped are not copied.
+    if (!unit->tooLong)
+    {
+        // Sets up feature buffer.
+        size_t totalFeatNum = 0;
+        unit->featuresStartIndex.assign(m_featuresBufferMultiIO.size(), 0);
+        for (auto it = m_featureNameToIdMap.begin(); it != m_featureNameToIdMap.end(); ++it)
         {
-            fprintf(stderr, "WARNING: Utterance length is smaller than the "
-                            "minibatch size, you may want to remove the utterance or "
-                            "reduce the minibatch size.\n");
+            size_t id = it->second;
+            const msra::dbn::matrixstripe featOri = m_mbiter->frames(id);
+            unit->featuresStartIndex[id] = totalFeatNum;
+            totalFeatNum += featOri.rows() * featOri.cols();
         }
+        unit->features = new ElemType[totalFeatNum];
+        unit->featuresAllocated = totalFeatNum;
 
-        if (!m_truncated && (m_currentBufferFrames[i] > m_maxUtteranceLength))
+        // Copies features to buffer.
+        for (auto it = m_featureNameToIdMap.begin(); it != m_featureNameToIdMap.end(); ++it)
         {
-            (*m_mbiter)++;
-            if (!(*m_mbiter))
+            size_t id = it->second;
+            const msra::dbn::matrixstripe featOri = m_mbiter->frames(id);
+            const size_t actualmbsizeOri = featOri.cols();
+            size_t fdim = featOri.rows();
+            if (actualmbsizeOri != unit->numFrames)
             {
-                m_noData = true;
+                throw std::runtime_error("The multi-IO features has inconsistent number of frames!");
             }
-            fprintf(stderr, "WARNING: Utterance \"%S\" has length longer "
-                            "than the %zd, skipping it.\n",
-                    m_uttInfo[i][0].first.c_str(), m_maxUtteranceLength);
-            return ReNewBufferForMultiIO(i);
-        }
 
-        if (m_doMinibatchBuffering && !m_uttDerivBuffer->HasResourceForDerivative(m_uttInfo[i][0].first))
-        {
-            (*m_mbiter)++;
-            if (!(*m_mbiter))
+            ElemType* featuresBuffer = unit->features + unit->featuresStartIndex[id];
+            if (sizeof(ElemType) == sizeof(float))
             {
-                m_noData = true;
+                for (int k = 0; k < actualmbsizeOri; k++) // column major, so iterate columns
+                {
+                    // copy over the entire column at once, need to do this because SSEMatrix may have gaps at the end of the columns
+                    memcpy_s(&featuresBuffer[k * fdim], sizeof(ElemType) * fdim, &featOri(0, k), sizeof(ElemType) * fdim);
+                }
+            }
+            else
+            {
+                for (int k = 0; k < actualmbsizeOri; k++) // column major, so iterate columns in outside loop
+                {
+                    for (int d = 0; d < featOri.rows(); d++)
+                    {
+                        featuresBuffer[k * fdim + d] = featOri(d, k);
+                    }
+                }
             }
-            fprintf(stderr, "WARNING: Utterance \"%S\" does not have "
-                            "resource to compute derivative, skipping it.\n",
-                    m_uttInfo[i][0].first.c_str());
-            return ReNewBufferForMultiIO(i);
         }
 
-        // We don't support having two utterances in the same buffer.
-        if (m_doMinibatchBuffering && m_hasUttInCurrentMinibatch.find(m_uttInfo[i][0].first) != m_hasUttInCurrentMinibatch.end())
+        // Keeps the label ids, AlignLabels() expands them.
+        unit->labelIds.resize(m_labelsBufferMultiIO.size());
+        for (auto it = m_labelNameToIdMap.begin(); it != m_labelNameToIdMap.end(); ++it)
         {
-            (*m_mbiter)++;
-            if (!(*m_mbiter))
-            {
-                m_noData = true;
-            }
-            fprintf(stderr, "WARNING: Utterance \"%S\" already exists in "
-                            "the minibatch, skipping it.\n",
-                    m_uttInfo[i][0].first.c_str());
-            return ReNewBufferForMultiIO(i);
+            size_t id = it->second;
+            unit->labelIds[id] = m_mbiter->labels(id);
         }
     }
 
-    // Sets up feature buffers.
-    // foreach_index(id, m_featuresBufferAllocatedMultiIO)
-    size_t totalFeatNum = 0;
-    for (auto it = m_featureNameToIdMap.begin(); it != m_featureNameToIdMap.end(); ++it)
-    {
-        size_t id = m_featureNameToIdMap[it->first];
-        const msra::dbn::matrixstripe featOri = m_mbiter->frames(id);
-        size_t fdim = featOri.rows();
-        const size_t actualmbsizeOri = featOri.cols();
-        m_featuresStartIndexMultiUtt[id + i * numOfFea] = totalFeatNum;
-        totalFeatNum = fdim * actualmbsizeOri + m_featuresStartIndexMultiUtt[id + i * numOfFea];
-    }
-    if (m_featuresBufferMultiUtt[i] == NULL)
+    (*m_mbiter)++;
+    unit->isLast = !(*m_mbiter);
+    return unit;
+}
+
+// Alignment stage of the pipeline: checks that the alignment and the
+// denominator lattice of the utterance are available for sequence training,
+// and expands its label ids into one-hot or target vectors. Runs on the
+// <m_alignmentWorkers>, several utterances at once.
+template <class ElemType>
+void HTKMLFReader<ElemType>::AlignLabels(UtteranceUnit& unit) const
+{
+    if (unit.tooLong)
     {
-        m_featuresBufferMultiUtt[i] = new ElemType[totalFeatNum];
-        m_featuresBufferAllocatedMultiUtt[i] = totalFeatNum;
+        return;
     }
-    else if (m_featuresBufferAllocatedMultiUtt[i] < totalFeatNum) // buffer size changed. can be partial minibatch
+    if (m_doMinibatchBuffering && !m_framemode)
     {
-        delete[] m_featuresBufferMultiUtt[i];
-        m_featuresBufferMultiUtt[i] = new ElemType[totalFeatNum];
-        m_featuresBufferAllocatedMultiUtt[i] = totalFeatNum;
+        unit.hasResourceForDerivative = m_uttDerivBuffer->HasResourceForDerivative(unit.uttInfo[0].first);
+        if (!unit.hasResourceForDerivative)
+        {
+            return;
+        }
     }
 
-    // Sets up label buffers.
+    // Sets up label buffer.
     size_t totalLabelsNum = 0;
+    unit.labelsStartIndex.assign(m_labelsBufferMultiIO.size(), 0);
     for (auto it = m_labelNameToIdMap.begin(); it != m_labelNameToIdMap.end(); ++it)
     {
-        size_t id = m_labelNameToIdMap[it->first];
-        size_t dim = m_labelNameToDimMap[it->first];
-
-        const vector<size_t>& uids = m_mbiter->labels(id);
-        size_t actualmbsizeOri = uids.size();
-        m_labelsStartIndexMultiUtt[id + i * numOfLabel] = totalLabelsNum;
-        totalLabelsNum = m_labelsStartIndexMultiUtt[id + i * numOfLabel] + dim * actualmbsizeOri;
-    }
-    if (m_labelsBufferMultiUtt[i] == NULL)
-    {
-        m_labelsBufferMultiUtt[i] = new ElemType[totalLabelsNum];
-        m_labelsBufferAllocatedMultiUtt[i] = totalLabelsNum;
-    }
-    else if (m_labelsBufferAllocatedMultiUtt[i] < totalLabelsNum)
-    {
-        delete[] m_labelsBufferMultiUtt[i];
-        m_labelsBufferMultiUtt[i] = new ElemType[totalLabelsNum];
-        m_labelsBufferAllocatedMultiUtt[i] = totalLabelsNum;
-    }
-    memset(m_labelsBufferMultiUtt[i], 0, sizeof(ElemType) * totalLabelsNum);
-
-    // Copies features to buffer.
-    // foreach_index(id, m_featuresBufferMultiIO)
-    bool first = true;
-    for (auto it = m_featureNameToIdMap.begin(); it != m_featureNameToIdMap.end(); ++it)
-    {
-        size_t id = m_featureNameToIdMap[it->first];
-        const msra::dbn::matrixstripe featOri = m_mbiter->frames(id);
-        const size_t actualmbsizeOri = featOri.cols();
-        size_t fdim = featOri.rows();
-        if (first)
-        {
-            m_toProcess[i] = actualmbsizeOri;
-            first = false;
-        }
-        else
-        {
-            if (m_toProcess[i] != actualmbsizeOri)
-            {
-                throw std::runtime_error("The multi-IO features has inconsistent number of frames!");
-            }
-        }
-        assert(actualmbsizeOri == m_mbiter->currentmbframes());
-
-        if (sizeof(ElemType) == sizeof(float))
-        {
-            for (int k = 0; k < actualmbsizeOri; k++) // column major, so iterate columns
-            {
-                // copy over the entire column at once, need to do this because SSEMatrix may have gaps at the end of the columns
-                memcpy_s(&m_featuresBufferMultiUtt[i][k * fdim + m_featuresStartIndexMultiUtt[id + i * numOfFea]], sizeof(ElemType) * fdim, &featOri(0, k), sizeof(ElemType) * fdim);
-            }
-        }
-        else
-        {
-            for (int k = 0; k < actualmbsizeOri; k++) // column major, so iterate columns in outside loop
-            {
-                for (int d = 0; d < featOri.rows(); d++)
-                {
-                    m_featuresBufferMultiUtt[i][k * fdim + d + m_featuresStartIndexMultiUtt[id + i * numOfFea]] = featOri(d, k);
-                }
-            }
-        }
+        size_t id = it->second;
+        size_t dim = m_labelNameToDimMap.at(it->first);
+        unit.labelsStartIndex[id] = totalLabelsNum;
+        totalLabelsNum += dim * unit.labelIds[id].size();
     }
+    unit.labels = new ElemType[totalLabelsNum];
+    unit.labelsAllocated = totalLabelsNum;
+    memset(unit.labels, 0, sizeof(ElemType) * totalLabelsNum);
 
     for (auto it = m_labelNameToIdMap.begin(); it != m_labelNameToIdMap.end(); ++it)
     {
-        size_t id = m_labelNameToIdMap[it->first];
-        size_t dim = m_labelNameToDimMap[it->first];
+        size_t id = it->second;
+        size_t dim = m_labelNameToDimMap.at(it->first);
 
-        const vector<size_t>& uids = m_mbiter->labels(id);
+        const vector<size_t>& uids = unit.labelIds[id];
         size_t actualmbsizeOri = uids.size();
+        ElemType* labelsBuffer = unit.labels + unit.labelsStartIndex[id];
 
         if (m_convertLabelsToTargetsMultiIO[id])
         {
@@ -1839,7 +1838,7 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
                 size_t labelId = uids[k];
                 for (int j = 0; j < dim; j++)
                 {
-                    m_labelsBufferMultiUtt[i][k * dim + j + m_labelsStartIndexMultiUtt[id + i * numOfLabel]] = m_labelToTargetMapMultiIO[id][labelId][j];
+                    labelsBuffer[k * dim + j] = m_labelToTargetMapMultiIO[id][labelId][j];
                 }
             }
         }
@@ -1850,16 +1849,216 @@ bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
             for (int k = 0; k < actualmbsizeOri; k++)
             {
                 assert(uids[k] < dim);
-                // labels(uids[i], i) = (ElemType)1;
-                m_labelsBufferMultiUtt[i][k * dim + uids[k] + m_labelsStartIndexMultiUtt[id + i * numOfLabel]] = (ElemType) 1;
+                labelsBuffer[k * dim + uids[k]] = (ElemType) 1;
             }
         }
     }
-    m_processedFrame[i] = 0;
+}
 
-    (*m_mbiter)++;
-    if (!(*m_mbiter))
+// Takes the next utterance from the read-ahead pipeline, or reads it right
+// away if read-ahead is off. Returns NULL at the end of the data.
+template <class ElemType>
+typename HTKMLFReader<ElemType>::UtteranceUnitPtr HTKMLFReader<ElemType>::NextUtterance()
+{
+    if (!m_readAheadQueue)
+    {
+        UtteranceUnitPtr unit = ReadUtterance();
+        if (unit)
+        {
+            AlignLabels(*unit);
+        }
+        return unit;
+    }
+
+    PendingUtterance pending;
+    if (!m_readAheadQueue->Pop(pending))
+    {
+        LogicError("NextUtterance: the read-ahead thread has stopped before the end of the data.\n");
+    }
+    if (pending.error)
+    {
+        std::rethrow_exception(pending.error);
+    }
+    if (pending.unit)
+    {
+        pending.labelsDone.get();
+    }
+    return pending.unit;
+}
+
+// Starts the read-ahead thread on <m_mbiter>, which it owns until
+// StopReadAhead().
+template <class ElemType>
+void HTKMLFReader<ElemType>::StartReadAhead()
+{
+    if (!m_readAhead)
+    {
+        return;
+    }
+    assert(!m_readAheadQueue);
+
+    if (!m_alignmentWorkers)
+    {
+        m_alignmentWorkers.reset(new WorkerPool(m_readAheadThreads, m_readAheadDepth));
+    }
+    m_readAheadQueue.reset(new BoundedQueue<PendingUtterance>(m_readAheadDepth));
+    BoundedQueue<PendingUtterance>* queue = m_readAheadQueue.get();
+    m_readAheadThread = std::thread([this, queue]()
+                                    {
+                                        for (;;)
+                                        {
+                                            PendingUtterance pending;
+                                            try
+                                            {
+                                                pending.unit = ReadUtterance();
+                                                if (pending.unit)
+                                                {
+                                                    UtteranceUnitPtr unit = pending.unit;
+                                                    pending.labelsDone = m_alignmentWorkers->Submit([this, unit]()
+                                                                                                    {
+                                                                                                        AlignLabels(*unit);
+                                                                                                    }).share();
+                                                }
+                                            }
+                                            catch (...)
+                                            {
+                                                pending.unit.reset();
+                                                pending.error = std::current_exception();
+                                            }
+
+                                            // Stops at the end of the data, on errors, and when the reader shuts the queue.
+                                            bool last = !pending.unit;
+                                            std::shared_future<void> labelsDone = pending.labelsDone;
+                                            if (!queue->Push(std::move(pending)))
+                                            {
+                                                if (labelsDone.valid())
+                                                {
+                                                    labelsDone.wait();
+                                                }
+                                                break;
+                                            }
+                                            if (last)
+                                            {
+                                                break;
+                                            }
+                                        }
+                                        queue->Close();
+                                    });
+}
+
+// Stops the read-ahead thread and discards the utterances it has prepared.
+template <class ElemType>
+void HTKMLFReader<ElemType>::StopReadAhead()
+{
+    if (!m_readAheadQueue)
+    {
+        return;
+    }
+
+    m_readAheadQueue->Close();
+    if (m_readAheadThread.joinable())
+    {
+        m_readAheadThread.join();
+    }
+
+    // The alignment workers must be done with the discarded utterances.
+    PendingUtterance pending;
+    while (m_readAheadQueue->Pop(pending))
+    {
+        if (pending.labelsDone.valid())
+        {
+            pending.labelsDone.wait();
+        }
+    }
+    m_readAheadQueue.reset();
+}
+
+template <class ElemType>
+bool HTKMLFReader<ElemType>::ReNewBufferForMultiIO(size_t i)
+{
+    if (m_noData)
+    {
+        m_currentBufferFrames[i] = 0;
+        m_processedFrame[i] = 0;
+        m_toProcess[i] = 0;
+        m_uttInfo[i].clear();
+        return false;
+    }
+
+    UtteranceUnitPtr unit = NextUtterance();
+    if (!unit)
+    {
         m_noData = true;
+        return ReNewBufferForMultiIO(i);
+    }
+    m_noData = unit->isLast;
+
+    size_t numOfFea = m_featuresBufferMultiIO.size();
+    size_t numOfLabel = m_labelsBufferMultiIO.size();
+
+    // Number of frames we get from minibatch iterator.
+    m_currentBufferFrames[i] = unit->numFrames;
+
+    // If we operate at utterance level, we get the utterance information.
+    if (!m_framemode)
+    {
+        m_uttInfo[i] = unit->uttInfo;
+        assert(m_uttInfo[i].size() > 0);
+        // For now, let's just assume that the utterance length will be
+        // larger than the minibatch size. We can handle this more
+        // gracefully later, e.g., remove the utterance in the reader.
+        if (m_uttInfo[i].size() > 1)
+        {
+            fprintf(stderr, "WARNING: Utterance length is smaller than the "
+                            "minibatch size, you may want to remove the utterance or "
+                            "reduce the minibatch size.\n");
+        }
+
+        if (unit->tooLong)
+        {
+            fprintf(stderr, "WARNING: Utterance \"%S\" has length longer "
+                            "than the %zd, skipping it.\n",
+                    m_uttInfo[i][0].first.c_str(), m_maxUtteranceLength);
+            return ReNewBufferForMultiIO(i);
+        }
+
+        if (m_doMinibatchBuffering && !unit->hasResourceForDerivative)
+        {
+            fprintf(stderr, "WARNING: Utterance \"%S\" does not have "
+                            "resource to compute derivative, skipping it.\n",
+                    m_uttInfo[i][0].first.c_str());
+            return ReNewBufferForMultiIO(i);
+        }
+
+        // We don't support having two utterances in the same buffer, nor
+        // one that is still waiting for its derivatives to be handed out
+        // (after reading ahead).
+        if (m_doMinibatchBuffering && (m_hasUttInCurrentMinibatch.find(m_uttInfo[i][0].first) != m_hasUttInCurrentMinibatch.end() ||
+                                       m_uttDerivBuffer->HasUtterance(m_uttInfo[i][0].first)))
+        {
+            fprintf(stderr, "WARNING: Utterance \"%S\" already exists in "
+                            "the minibatch, skipping it.\n",
+                    m_uttInfo[i][0].first.c_str());
+            return ReNewBufferForMultiIO(i);
+        }
+    }
+
+    // Takes over the feature and label buffers of the utterance; our old
+    // buffers go away with it.
+    std::swap(m_featuresBufferMultiUtt[i], unit->features);
+    std::swap(m_featuresBufferAllocatedMultiUtt[i], unit->featuresAllocated);
+    std::swap(m_labelsBufferMultiUtt[i], unit->labels);
+    std::swap(m_labelsBufferAllocatedMultiUtt[i], unit->labelsAllocated);
+    for (size_t id = 0; id < numOfFea; id++)
+    {
+        m_featuresStartIndexMultiUtt[id + i * numOfFea] = unit->featuresStartIndex[id];
+    }
+    for (size_t id = 0; id < numOfLabel; id++)
+    {
+        m_labelsStartIndexMultiUtt[id + i * numOfLabel] = unit->labelsStartIndex[id];
+    }
+    m_toProcess[i] = unit->numFrames;
+    m_processedFrame[i] = 0;
 
     return true;
 }
@@ -1877,6 +2076,16 @@ bool HTKMLFReader<ElemType>::GetMinibatchCopy(
     if (m_doMinibatchBuffering)
     {
         assert(m_framemode == false);
+        // Starts reading ahead if few enough minibatches are left to train.
+        if (m_derivativeLookahead > 0 && m_numLookaheadChunks == 0 &&
+            m_minibatchBuffer.size() > 0 && m_minibatchBuffer.size() <= m_derivativeLookahead &&
+            !m_uttDerivBuffer->NeedLikelihoodToComputeDerivative() &&
+            m_uttDerivBuffer->StartLookahead())
+        {
+            // The minibatches in the buffer have been forwarded already.
+            m_minibatchBufferIndex = m_minibatchBuffer.size() - 1;
+        }
+
         if (m_uttDerivBuffer->NeedLikelihoodToComputeDerivative())
         {
             m_getMinibatchCopy = true;
@@ -8,7 +8,9 @@
 #include "DataReader.h"
 #include "KaldiSequenceTrainingDerivative.h"
 #include "UtteranceDerivativeBuffer.h"
+#include "WorkerPool.h"
 #include "Config.h" // for intargvector
+#include <thread>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -19,7 +21,6 @@ private:
     msra::dbn::minibatchiterator* m_mbiter;
     msra::dbn::minibatchsource* m_frameSource;
     vector<msra::asr::FeatureSection*> m_trainingOrTestingFeatureSections;
-    // msra::dbn::minibatchreadaheadsource* m_readAheadSource;
     msra::dbn::FileEvalSource* m_fileEvalSource;
     vector<msra::asr::FeatureSection*> m_writingFeatureSections;
     msra::dbn::latticesource* m_lattices;
@@ -48,6 +49,13 @@ private:
     bool m_doMinibatchBufferTruncation;
     size_t m_minibatchBufferIndex;
     std::deque<MinibatchBufferUnit> m_minibatchBuffer;
+    // Likelihoods of the next minibatch are computed once no more than
+    // <m_derivativeLookahead> minibatches are left to train in
+    // <m_minibatchBuffer>, so that its derivatives are computed while they
+    // are trained. The last <m_numLookaheadChunks> minibatches of
+    // <m_minibatchBuffer> are those read ahead.
+    size_t m_derivativeLookahead;
+    size_t m_numLookaheadChunks;
     UtteranceDerivativeBuffer<ElemType>* m_uttDerivBuffer;
     unordered_map<wstring, bool> m_hasUttInCurrentMinibatch;
 
@@ -55,8 +63,52 @@ private:
     std::vector<std::vector<std::pair<wstring, size_t>>> m_uttInfo;
     std::vector<std::vector<std::pair<wstring, size_t>>> m_minibatchUttInfo;
 
-    vector<bool> m_sentenceEnd;
+    // Read-ahead pipeline. One thread advances <m_mbiter> and copies the
+    // features of each utterance out of the frame source (ReadUtterance());
+    // a pool of workers looks up the alignment and lattice of the utterance
+    // and expands its labels (AlignLabels()). Finished utterances wait in a
+    // queue of <m_readAheadDepth> entries, in the order of the iterator,
+    // until ReNewBufferForMultiIO() takes them.
+    struct UtteranceUnit
+    {
+        std::vector<std::pair<wstring, size_t>> uttInfo;
+        size_t numFrames;
+        bool isLast; // no more data after this one
+        bool tooLong;
+        bool hasResourceForDerivative;
+        std::vector<size_t> featuresStartIndex; // by feature id
+        ElemType* features;
+        size_t featuresAllocated;
+        std::vector<size_t> labelsStartIndex; // by label id
+        std::vector<std::vector<size_t>> labelIds;
+        ElemType* labels;
+        size_t labelsAllocated;
+
+        UtteranceUnit()
+            : numFrames(0), isLast(false), tooLong(false), hasResourceForDerivative(true), features(NULL), featuresAllocated(0), labels(NULL), labelsAllocated(0)
+        {
+        }
+        ~UtteranceUnit()
+        {
+            delete[] features;
+            delete[] labels;
+        }
+    };
+    typedef std::shared_ptr<UtteranceUnit> UtteranceUnitPtr;
+    struct PendingUtterance
+    {
+        UtteranceUnitPtr unit; // NULL at the end of the data
+        std::shared_future<void> labelsDone;
+        std::exception_ptr error;
+    };
     bool m_readAhead;
+    size_t m_readAheadDepth;
+    size_t m_readAheadThreads;
+    std::unique_ptr<WorkerPool> m_alignmentWorkers;
+    std::unique_ptr<BoundedQueue<PendingUtterance>> m_readAheadQueue;
+    std::thread m_readAheadThread;
+
+    vector<bool> m_sentenceEnd;
     bool m_truncated;
     bool m_framemode;
     vector<size_t> m_processedFrame;
@@ -139,6 +191,13 @@ private:
 
     bool ReNewBufferForMultiIO(size_t i);
 
+    // Stages of the read-ahead pipeline.
+    UtteranceUnitPtr ReadUtterance();
+    void AlignLabels(UtteranceUnit& unit) const;
+    UtteranceUnitPtr NextUtterance();
+    void StartReadAhead();
+    void StopReadAhead();
+
     size_t NumberSlicesInEachRecurrentIter()
     {
         return m_numberOfuttsPerMinibatch;
@@ -63,13 +63,22 @@ bool KaldiSequenceTrainingDerivative<ElemType>::ComputeDerivative(
                      (int) m_transModel.NumPdfs());
     }
 
-    // Reads alignment.
+    // Reads alignment and denominator lattice.
+    std::unique_lock<std::mutex> readerLock(m_readerMutex);
     if (!m_aliReader->HasKey(uttIDStr))
     {
         RuntimeError("Alignment not found for utterance %s\n",
                      uttIDStr.c_str());
     }
     const std::vector<int32> ali = m_aliReader->Value(uttIDStr);
+    if (!m_denlatReader->HasKey(uttIDStr))
+    {
+        RuntimeError("Denominator lattice not found for utterance %S\n",
+                     uttID.c_str());
+    }
+    kaldi::CompactLattice clat = m_denlatReader->Value(uttIDStr);
+    readerLock.unlock();
+
     if (ali.size() != logLikelihood.GetNumCols())
     {
         RuntimeError("Number of frames in logLikelihood does not match that"
@@ -77,13 +86,6 @@ bool KaldiSequenceTrainingDerivative<ElemType>::ComputeDerivative(
                      uttID.c_str(), (int) logLikelihood.GetNumCols(), (int) ali.size());
     }
 
-    // Reads denominator lattice.
-    if (!m_denlatReader->HasKey(uttIDStr))
-    {
-        RuntimeError("Denominator lattice not found for utterance %S\n",
-                     uttID.c_str());
-    }
-    kaldi::CompactLattice clat = m_denlatReader->Value(uttIDStr);
     fst::CreateSuperFinal(&clat); /* One final state with weight One() */
     kaldi::Lattice lat;
     fst::ConvertLattice(clat, &lat);
@@ -233,6 +235,7 @@ bool KaldiSequenceTrainingDerivative<ElemType>::HasResourceForDerivative(
     }
 
     std::string uttIDStr = msra::asr::toStr(uttID);
+    std::lock_guard<std::mutex> readerLock(m_readerMutex);
     if (!m_aliReader->HasKey(uttIDStr) || !m_denlatReader->HasKey(uttIDStr))
     {
         return false;
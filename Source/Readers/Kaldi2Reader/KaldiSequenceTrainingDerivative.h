@@ -4,11 +4,15 @@
 #include "Matrix.h"
 #include "basetypes.h"
 #include "UtteranceDerivativeComputationInterface.h"
+#include <mutex>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This class deals with the interaction with Kaldi in order to do sequence
-// in CNTK.
+// in CNTK. ComputeDerivative() and HasResourceForDerivative() may be called
+// from several threads; the Kaldi archive readers are not thread-safe, so
+// their lookups are serialized, while the lattice computation runs in
+// parallel.
 template <class ElemType>
 class KaldiSequenceTrainingDerivative : public UtteranceDerivativeComputationInterface<ElemType>
 {
@@ -22,6 +26,7 @@ private:
     kaldi::TransitionModel m_transModel;
     kaldi::RandomAccessCompactLatticeReader* m_denlatReader;
     kaldi::RandomAccessInt32VectorReader* m_aliReader;
+    mutable std::mutex m_readerMutex; // guards <m_denlatReader> and <m_aliReader>
 
     // Rescores the lattice with the lastest posteriors from the neural network.
     void LatticeAcousticRescore(const wstring& uttID,
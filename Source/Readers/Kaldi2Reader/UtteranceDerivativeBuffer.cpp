@@ -8,10 +8,12 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 template <class ElemType>
 UtteranceDerivativeBuffer<ElemType>::UtteranceDerivativeBuffer(
     size_t numberOfuttsPerMinibatch,
-    UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface)
+    UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface,
+    size_t numDerivativeThreads)
 {
     assert(derivativeInterface != NULL);
     m_derivativeInterface = derivativeInterface;
+    m_derivativeWorkers.reset(new WorkerPool(numDerivativeThreads, 2 * numberOfuttsPerMinibatch));
     m_numUttsPerMinibatch = numberOfuttsPerMinibatch;
     m_needLikelihood = true;
     m_currentObj = 0;
@@ -138,11 +140,20 @@ bool UtteranceDerivativeBuffer<ElemType>::SetLikelihood(
                 m_uttPool[uttID].progress += numFrames;
                 if (m_uttPool[uttID].progress == m_uttPool[uttID].uttLength)
                 {
-                    m_derivativeInterface->ComputeDerivative(
-                        uttID,
-                        m_uttPool[uttID].logLikelihood,
-                        &m_uttPool[uttID].derivative,
-                        &m_uttPool[uttID].objective);
+                    // Computes the derivative in the background. References
+                    // to the elements of <m_uttPool> stay valid when other
+                    // utterances are added or erased, and the unit is not
+                    // touched again before GetDerivative() has waited for it.
+                    UtteranceDerivativeUnit* unit = &m_uttPool[uttID];
+                    UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface = m_derivativeInterface;
+                    unit->computation = m_derivativeWorkers->Submit([derivativeInterface, uttID, unit]()
+                                                                    {
+                                                                        return derivativeInterface->ComputeDerivative(
+                                                                            uttID,
+                                                                            unit->logLikelihood,
+                                                                            &unit->derivative,
+                                                                            &unit->objective);
+                                                                    }).share();
                     m_uttPool[uttID].hasDerivative = true;
                     m_uttPool[uttID].progress = 0;
                     m_uttReady[m_uttPool[uttID].streamID] = true;
@@ -161,6 +172,7 @@ bool UtteranceDerivativeBuffer<ElemType>::SetLikelihood(
             break;
         }
     }
+    return true;
 }
 
 // Suppose we have a, b, c 3 streams, the <derivativesOut> should be in the
@@ -198,6 +210,12 @@ bool UtteranceDerivativeBuffer<ElemType>::GetDerivative(
                              uttID.c_str());
             }
 
+            // Waits for the derivative computation; rethrows its errors.
+            if (m_uttPool[uttID].computation.valid())
+            {
+                m_uttPool[uttID].computation.get();
+            }
+
             // Assign the derivatives.
             assert(uttID == uttInfoInMinibatch[i][j].first);
             size_t startFrame = uttInfoInMinibatch[i][j].second.first;
@@ -264,6 +282,22 @@ bool UtteranceDerivativeBuffer<ElemType>::GetObjective(
     return true;
 }
 
+template <class ElemType>
+bool UtteranceDerivativeBuffer<ElemType>::StartLookahead()
+{
+    assert(m_needLikelihood == false);
+    if (m_epochEnd)
+    {
+        return false;
+    }
+
+    // Utterances of the current minibatches stay in <m_uttPool> until they
+    // are handed out; the next ones are added as their likelihoods arrive.
+    m_needLikelihood = true;
+    m_uttReady.assign(m_numUttsPerMinibatch, false);
+    return true;
+}
+
 template <class ElemType>
 bool UtteranceDerivativeBuffer<ElemType>::HasResourceForDerivative(
     const wstring& uttID) const
@@ -304,9 +338,22 @@ bool UtteranceDerivativeBuffer<ElemType>::CompareUttInfo(
     return match;
 }
 
+template <class ElemType>
+void UtteranceDerivativeBuffer<ElemType>::WaitForDerivatives()
+{
+    for (auto it = m_uttPool.begin(); it != m_uttPool.end(); ++it)
+    {
+        if (it->second.computation.valid())
+        {
+            it->second.computation.wait();
+        }
+    }
+}
+
 template <class ElemType>
 void UtteranceDerivativeBuffer<ElemType>::ResetEpoch()
 {
+    WaitForDerivatives();
     m_needLikelihood = true;
     m_currentObj = 0;
     m_epochEnd = false;
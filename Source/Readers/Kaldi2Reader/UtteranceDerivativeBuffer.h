@@ -4,12 +4,16 @@
 #include "basetypes.h"
 #include "Sequences.h"
 #include "UtteranceDerivativeComputationInterface.h"
+#include "WorkerPool.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This class "gules" together the log-likelihood from different minibatches,
 // and then calls <UtteranceDerivativeComputationInterface> class to compute
-// the derivative for given utterance.
+// the derivative for given utterance. The derivatives are computed on a pool
+// of worker threads, so that the lattice computation of one utterance
+// overlaps with the network's forward pass over the next minibatches; they
+// are waited for only when they are handed out in GetDerivative().
 template <class ElemType>
 class UtteranceDerivativeBuffer
 {
@@ -23,6 +27,7 @@ private:
         Matrix<ElemType> logLikelihood;
         Matrix<ElemType> derivative;
         ElemType objective;
+        std::shared_future<bool> computation; // pending ComputeDerivative()
 
         UtteranceDerivativeUnit()
             : logLikelihood(CPUDEVICE), derivative(CPUDEVICE)
@@ -43,6 +48,7 @@ private:
     std::vector<std::vector<std::pair<wstring, size_t>>> m_currentUttInfo;
     unordered_map<wstring, UtteranceDerivativeUnit> m_uttPool;
     UtteranceDerivativeComputationInterface<ElemType>* m_derivativeInterface;
+    std::unique_ptr<WorkerPool> m_derivativeWorkers;
 
     // <uttInfoInMinibatch> is a vector of vector of the following:
     //     uttID startFrameIndexInMinibatch numFrames
@@ -56,16 +62,22 @@ private:
         const std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo1,
         const std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo2);
 
+    // Waits for all derivative computations that are still running.
+    void WaitForDerivatives();
+
 public:
     // Constructor.
-    // Does not take ownership of <derivativeInterface>.
+    // Does not take ownership of <derivativeInterface>, which must be safe to
+    // call from <numDerivativeThreads> threads at once.
     UtteranceDerivativeBuffer(
         size_t numberOfuttsPerMinibatch,
-        UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface);
+        UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface,
+        size_t numDerivativeThreads = 1);
 
     // Destructor.
     ~UtteranceDerivativeBuffer()
     {
+        WaitForDerivatives();
     }
 
     bool NeedLikelihoodToComputeDerivative() const
@@ -96,6 +108,12 @@ public:
         return (m_uttPool.find(uttID) != m_uttPool.end());
     }
 
+    // Starts taking the likelihoods of the next utterances while the
+    // derivatives of the current ones are still being handed out, so that
+    // they are computed in the meantime. Returns false at the end of the
+    // epoch.
+    bool StartLookahead();
+
     void SetEpochEnd()
     {
         m_epochEnd = true;
@@ -22,6 +22,7 @@
 //#include <iostream>
 
 #include "htkfeatio_utils.h"
+#include "kaldiarchive.h"
 #include "kaldi.h"
 
 namespace msra { namespace asr {
@@ -35,9 +36,33 @@ public:
 
 private:
     kaldi::RandomAccessBaseFloatMatrixReader *feature_reader;
+    std::unique_ptr<kaldiarchivereader> archive_reader; // in-process reader, if rx allows it; replaces feature_reader
     kaldi::nnet1::Nnet nnet_transf;
     kaldi::CuMatrix<kaldi::BaseFloat> feats_transf;
     kaldi::Matrix<kaldi::BaseFloat> buf;
+    kaldi::Matrix<kaldi::BaseFloat> archive_buf; // features decoded by archive_reader, before the transform
+
+    // presents a (row-major, one row per frame) Kaldi matrix the way kaldiarchivereader::read() expects CNTK matrices
+    struct kaldimatrixview
+    {
+        kaldi::Matrix<kaldi::BaseFloat> &m;
+        kaldimatrixview(kaldi::Matrix<kaldi::BaseFloat> &m)
+            : m(m)
+        {
+        }
+        size_t rows() const
+        {
+            return m.NumCols();
+        }
+        size_t cols() const
+        {
+            return m.NumRows();
+        }
+        kaldi::BaseFloat &operator()(size_t d, size_t t)
+        {
+            return m.RowData((kaldi::MatrixIndexT) t)[d];
+        }
+    };
 
 public:
     FeatureSection(wstring scpFile, wstring rx_file, wstring feature_transform)
@@ -46,7 +71,14 @@ public:
         this->rx = trimmed(fileToStr(toStr(rx_file)));
         this->feature_transform = toStr(feature_transform);
 
-        feature_reader = new kaldi::RandomAccessBaseFloatMatrixReader(rx);
+        // Binary archives are read in process if rx names them directly;
+        // otherwise (pipes, text archives) Kaldi's table reader does it.
+        feature_reader = NULL;
+        archive_reader.reset(kaldiarchivereader::tryopen(rx));
+        if (archive_reader)
+            fprintf(stderr, "FeatureSection: reading %d utterances of '%s' from memory-mapped archives\n", (int) archive_reader->size(), rx.c_str());
+        else
+            feature_reader = new kaldi::RandomAccessBaseFloatMatrixReader(rx);
 
         // std::wcout << "Kaldi2Reader: created feature reader " << feature_reader << " [" << rx.c_str() << "]" << std::endl;
 
@@ -61,26 +93,61 @@ public:
         }
     }
 
+    // true if the features can be decoded straight into CNTK matrices with
+    // readdirect(), also on several threads at once
+    bool candecodedirectly() const
+    {
+        return archive_reader && feature_transform.empty();
+    }
+
+    template <class MATRIX>
+    void readdirect(const wstring &wkey, MATRIX &feat) const
+    {
+        archive_reader->read(toStr(wkey), feat);
+    }
+
+    // dimensions of the features of an utterance, for candecodedirectly() sections
+    void getdims(const wstring &wkey, size_t &numframes, size_t &featdim) const
+    {
+        archive_reader->getdims(toStr(wkey), numframes, featdim);
+    }
+
     kaldi::Matrix<kaldi::BaseFloat> &read(wstring wkey)
     {
         string key = toStr(wkey);
 
-        if (!feature_reader->HasKey(key))
+        const kaldi::Matrix<kaldi::BaseFloat> *value;
+        if (archive_reader)
         {
-            fprintf(stderr, "Missing features for: %s", key.c_str());
-            throw std::runtime_error(msra::strfun::strprintf("Missing features for: %s", key.c_str()));
+            // decode into the result right away if there is no transform
+            kaldi::Matrix<kaldi::BaseFloat> &decoded = this->feature_transform.empty() ? buf : archive_buf;
+            size_t numframes, featdim;
+            archive_reader->getdims(key, numframes, featdim);
+            decoded.Resize(numframes, featdim, kaldi::kUndefined);
+            kaldimatrixview view(decoded);
+            archive_reader->read(key, view);
+            if (this->feature_transform.empty())
+                return buf;
+            value = &decoded;
+        }
+        else
+        {
+            if (!feature_reader->HasKey(key))
+            {
+                fprintf(stderr, "Missing features for: %s", key.c_str());
+                throw std::runtime_error(msra::strfun::strprintf("Missing features for: %s", key.c_str()));
+            }
+            value = &feature_reader->Value(key);
         }
-
-        const kaldi::Matrix<kaldi::BaseFloat> &value = feature_reader->Value(key);
 
         if (this->feature_transform.empty())
         {
-            buf.Resize(value.NumRows(), value.NumCols());
-            buf.CopyFromMat(value);
+            buf.Resize(value->NumRows(), value->NumCols());
+            buf.CopyFromMat(*value);
         }
         else
         {
-            nnet_transf.Feedforward(kaldi::CuMatrix<kaldi::BaseFloat>(value), &feats_transf);
+            nnet_transf.Feedforward(kaldi::CuMatrix<kaldi::BaseFloat>(*value), &feats_transf);
             buf.Resize(feats_transf.NumRows(), feats_transf.NumCols());
             feats_transf.CopyToMat(&buf);
         }
@@ -331,6 +398,12 @@ public:
 
     void getinfo(const parsedpath &ppath, size_t &featdim)
     {
+        if (ppath.featuresection->candecodedirectly())
+        {
+            size_t numframes;
+            ppath.featuresection->getdims(ppath, numframes, featdim);
+            return;
+        }
         kaldi::Matrix<kaldi::BaseFloat> &kaldifeat = ppath.featuresection->read(ppath);
         featdim = kaldifeat.NumCols();
     }
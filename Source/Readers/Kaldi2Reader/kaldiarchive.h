@@ -0,0 +1,480 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// kaldiarchive.h -- in-process reader for binary Kaldi feature archives
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "basetypes.h"
+#include "htkfeatio_utils.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace msra { namespace asr {
+
+// ===========================================================================
+// mappedarchive -- read-only memory mapping of one archive file
+// ===========================================================================
+
+class mappedarchive
+{
+    const char *data;
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE filehandle;
+    HANDLE mappinghandle;
+#else
+    int fd;
+#endif
+
+    mappedarchive(const mappedarchive &);
+    void operator=(const mappedarchive &);
+
+public:
+    mappedarchive(const std::string &path)
+        : data(NULL), size(0)
+    {
+#ifdef _WIN32
+        mappinghandle = NULL;
+        filehandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        LARGE_INTEGER filesize;
+        if (filehandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(filehandle, &filesize))
+            throw std::runtime_error(msra::strfun::strprintf("mappedarchive: cannot open '%s'", path.c_str()));
+        size = (uint64_t) filesize.QuadPart;
+        if (size > 0)
+        {
+            mappinghandle = CreateFileMapping(filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mappinghandle != NULL)
+                data = (const char *) MapViewOfFile(mappinghandle, FILE_MAP_READ, 0, 0, 0);
+            if (data == NULL)
+                throw std::runtime_error(msra::strfun::strprintf("mappedarchive: cannot map '%s'", path.c_str()));
+        }
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        struct stat sb;
+        if (fd == -1 || fstat(fd, &sb) == -1)
+            throw std::runtime_error(msra::strfun::strprintf("mappedarchive: cannot open '%s'", path.c_str()));
+        size = (uint64_t) sb.st_size;
+        if (size > 0)
+        {
+            void *p = mmap(NULL, (size_t) size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+                throw std::runtime_error(msra::strfun::strprintf("mappedarchive: cannot map '%s'", path.c_str()));
+            data = (const char *) p;
+        }
+#endif
+    }
+
+    ~mappedarchive()
+    {
+#ifdef _WIN32
+        if (data != NULL)
+            UnmapViewOfFile(data);
+        if (mappinghandle != NULL)
+            CloseHandle(mappinghandle);
+        if (filehandle != INVALID_HANDLE_VALUE)
+            CloseHandle(filehandle);
+#else
+        if (data != NULL)
+            munmap((void *) data, (size_t) size);
+        if (fd != -1)
+            close(fd);
+#endif
+    }
+
+    uint64_t filesize() const
+    {
+        return size;
+    }
+
+    // pointer to 'n' bytes at 'offset', with a bounds check
+    const char *at(uint64_t offset, uint64_t n) const
+    {
+        if (offset > size || n > size - offset)
+            throw std::runtime_error("mappedarchive: unexpected end of archive, the file is truncated or corrupt");
+        return data + offset;
+    }
+};
+
+// ===========================================================================
+// kaldiarchivereader -- reads feature matrices straight out of memory-mapped
+// binary Kaldi archives, without Kaldi's table readers and the processes they
+// spawn for piped specifiers.
+//
+// The utterances are indexed from an 'scp:' specifier (whose entries must be
+// plain 'archive:offset' locations) or, for an 'ark:' specifier, by a single
+// scan over the archive that reads only the matrix headers. Full float and
+// double matrices and all three CompressedMatrix formats are decoded.
+// Reading is const and can run on several threads at once.
+// ===========================================================================
+
+class kaldiarchivereader
+{
+    enum matrixkind
+    {
+        fullfloat,   // "FM"
+        fulldouble,  // "DM"
+        compressed,  // "CM": 8-bit, piecewise linear per column, column major
+        compressed2, // "CM2": 16-bit, linear, row major
+        compressed3  // "CM3": 8-bit, linear, row major
+    };
+
+    // a matrix in the archive
+    struct matrixheader
+    {
+        matrixkind kind;
+        size_t rows; // frames
+        size_t cols; // feature dimension
+        float minvalue, range; // compressed kinds only
+        const unsigned char *payload;
+        uint64_t size; // bytes of the whole object, from the binary marker on
+    };
+
+    struct location
+    {
+        size_t file;
+        uint64_t offset; // of the binary marker "\0B"
+    };
+
+    std::vector<std::unique_ptr<mappedarchive>> archives;
+    std::unordered_map<std::string, size_t> archiveindex; // path -> index into 'archives'
+    std::unordered_map<std::string, location> utterances;
+
+    template <class T>
+    static T load(const unsigned char *p)
+    {
+        T value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    // Kaldi's WriteBasicType() for int32: a size byte, then the value
+    static size_t loadint32(const mappedarchive &archive, uint64_t &offset)
+    {
+        const unsigned char *p = (const unsigned char *) archive.at(offset, 5);
+        if (p[0] != 4)
+            throw std::runtime_error("kaldiarchivereader: malformed matrix dimension");
+        offset += 5;
+        int32_t value = load<int32_t>(p + 1);
+        if (value < 0)
+            throw std::runtime_error("kaldiarchivereader: negative matrix dimension");
+        return (size_t) value;
+    }
+
+    static matrixheader parseheader(const mappedarchive &archive, uint64_t offset)
+    {
+        const uint64_t start = offset;
+        const char *marker = archive.at(offset, 2);
+        if (marker[0] != '\0' || marker[1] != 'B')
+            throw std::runtime_error("kaldiarchivereader: not a binary archive entry (text archives are not supported)");
+        offset += 2;
+
+        // token, terminated by a space
+        std::string token;
+        for (;;)
+        {
+            char c = *archive.at(offset++, 1);
+            if (c == ' ')
+                break;
+            if (token.size() > 4)
+                throw std::runtime_error("kaldiarchivereader: unexpected object in archive, expected a feature matrix");
+            token.push_back(c);
+        }
+
+        matrixheader h;
+        h.minvalue = h.range = 0;
+        uint64_t payloadsize;
+        if (token == "FM" || token == "DM")
+        {
+            h.kind = token == "FM" ? fullfloat : fulldouble;
+            h.rows = loadint32(archive, offset);
+            h.cols = loadint32(archive, offset);
+            payloadsize = (uint64_t) h.rows * h.cols * (h.kind == fullfloat ? sizeof(float) : sizeof(double));
+        }
+        else if (token == "CM" || token == "CM2" || token == "CM3")
+        {
+            // global header: min value, range, rows, columns
+            const unsigned char *p = (const unsigned char *) archive.at(offset, 16);
+            h.minvalue = load<float>(p);
+            h.range = load<float>(p + 4);
+            int32_t rows = load<int32_t>(p + 8);
+            int32_t cols = load<int32_t>(p + 12);
+            if (rows < 0 || cols < 0)
+                throw std::runtime_error("kaldiarchivereader: negative matrix dimension");
+            h.rows = (size_t) rows;
+            h.cols = (size_t) cols;
+            offset += 16;
+            if (token == "CM")
+            {
+                h.kind = compressed;
+                payloadsize = (uint64_t) h.cols * 8 /*column headers*/ + (uint64_t) h.rows * h.cols;
+            }
+            else if (token == "CM2")
+            {
+                h.kind = compressed2;
+                payloadsize = (uint64_t) h.rows * h.cols * 2;
+            }
+            else
+            {
+                h.kind = compressed3;
+                payloadsize = (uint64_t) h.rows * h.cols;
+            }
+        }
+        else
+            throw std::runtime_error(msra::strfun::strprintf("kaldiarchivereader: unsupported object '%s' in archive, expected a feature matrix", token.c_str()));
+
+        h.payload = (const unsigned char *) archive.at(offset, payloadsize);
+        h.size = offset + payloadsize - start;
+        return h;
+    }
+
+    size_t openarchive(const std::string &path)
+    {
+        auto iter = archiveindex.find(path);
+        if (iter != archiveindex.end())
+            return iter->second;
+        archives.push_back(std::unique_ptr<mappedarchive>(new mappedarchive(path)));
+        archiveindex[path] = archives.size() - 1;
+        return archives.size() - 1;
+    }
+
+    // indexes all entries of an archive by scanning over it
+    void scanarchive(const std::string &path)
+    {
+        const size_t file = openarchive(path);
+        const mappedarchive &archive = *archives[file];
+        uint64_t offset = 0;
+        while (offset < archive.filesize())
+        {
+            std::string key;
+            for (char c; (c = *archive.at(offset++, 1)) != ' ';)
+            {
+                if (c == '\n' || c == '\0')
+                    throw std::runtime_error(msra::strfun::strprintf("kaldiarchivereader: malformed key in archive '%s'", path.c_str()));
+                key.push_back(c);
+            }
+            location loc = {file, offset};
+            utterances[key] = loc;
+            offset += parseheader(archive, offset).size;
+        }
+    }
+
+    // Indexes the entries of an scp file. Returns false if an entry is not a
+    // plain archive location (pipes, matrix ranges), which needs Kaldi.
+    bool readscp(const std::string &path)
+    {
+        std::ifstream scp(path.c_str());
+        if (!scp)
+            return false;
+        std::string line;
+        while (std::getline(scp, line))
+        {
+            line = trimmed(line);
+            if (line.empty())
+                continue;
+            size_t space = line.find_first_of(" \t");
+            if (space == std::string::npos)
+                throw std::runtime_error(msra::strfun::strprintf("kaldiarchivereader: malformed line in '%s': %s", path.c_str(), line.c_str()));
+            std::string key = line.substr(0, space);
+            std::string rxfilename = trimmed(line.substr(space + 1));
+            if (rxfilename.empty() || rxfilename.back() == '|' || rxfilename.back() == ']' || rxfilename == "-")
+                return false;
+
+            // "archive:offset", or a file that holds a single matrix
+            uint64_t offset = 0;
+            size_t colon = rxfilename.rfind(':');
+            if (colon != std::string::npos && colon + 1 < rxfilename.size() && rxfilename.find_first_not_of("0123456789", colon + 1) == std::string::npos)
+            {
+                offset = strtoull(rxfilename.c_str() + colon + 1, NULL, 10);
+                rxfilename.resize(colon);
+            }
+            location loc = {openarchive(rxfilename), offset};
+            utterances[key] = loc;
+        }
+        return true;
+    }
+
+    const location &find(const std::string &key) const
+    {
+        auto iter = utterances.find(key);
+        if (iter == utterances.end())
+            throw std::runtime_error(msra::strfun::strprintf("Missing features for: %s", key.c_str()));
+        return iter->second;
+    }
+
+    kaldiarchivereader()
+    {
+    }
+
+public:
+    // Opens the archives behind a Kaldi rspecifier. Returns NULL if the
+    // specifier needs Kaldi's own readers: piped commands, text archives,
+    // matrix ranges, standard input.
+    static kaldiarchivereader *tryopen(const std::string &rspecifier)
+    {
+        size_t colon = rspecifier.find(':');
+        if (colon == std::string::npos)
+            return NULL;
+        std::string type = trimmed(rspecifier.substr(0, colon));
+        type = type.substr(0, type.find(',')); // options such as "scp,p:" do not matter here
+        std::string path = trimmed(rspecifier.substr(colon + 1));
+        if (path.empty() || path == "-" || path.back() == '|' || path.front() == '|')
+            return NULL;
+
+        std::unique_ptr<kaldiarchivereader> reader(new kaldiarchivereader());
+        try
+        {
+            if (type == "scp")
+            {
+                if (!reader->readscp(path))
+                    return NULL;
+            }
+            else if (type == "ark")
+                reader->scanarchive(path);
+            else
+                return NULL;
+
+            // make sure the entries are binary matrices, which only Kaldi could read otherwise
+            if (!reader->utterances.empty())
+            {
+                const location &first = reader->utterances.begin()->second;
+                parseheader(*reader->archives[first.file], first.offset);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            fprintf(stderr, "kaldiarchivereader: falling back to Kaldi's readers for '%s': %s\n", rspecifier.c_str(), e.what());
+            return NULL;
+        }
+        return reader.release();
+    }
+
+    size_t size() const
+    {
+        return utterances.size();
+    }
+
+    bool haskey(const std::string &key) const
+    {
+        return utterances.find(key) != utterances.end();
+    }
+
+    // dimensions of a matrix without decoding it
+    void getdims(const std::string &key, size_t &numframes, size_t &featdim) const
+    {
+        const location &loc = find(key);
+        matrixheader h = parseheader(*archives[loc.file], loc.offset);
+        numframes = h.rows;
+        featdim = h.cols;
+    }
+
+    // Decodes the matrix of 'key' into 'feat', where feat(d, t) is dimension
+    // d of frame t and &feat(0, t) points to the contiguous frame t, i.e. the
+    // transpose of Kaldi's row-major layout. 'feat' must have the dimensions
+    // of the matrix.
+    template <class MATRIX>
+    void read(const std::string &key, MATRIX &feat) const
+    {
+        const location &loc = find(key);
+        const matrixheader h = parseheader(*archives[loc.file], loc.offset);
+        if (feat.cols() != h.rows || feat.rows() != h.cols)
+            throw std::logic_error(msra::strfun::strprintf("kaldiarchivereader: matrix of '%s' has dimensions %d x %d, expected %d x %d",
+                                                           key.c_str(), (int) h.rows, (int) h.cols, (int) feat.cols(), (int) feat.rows()));
+
+        const size_t rows = h.rows, cols = h.cols;
+        switch (h.kind)
+        {
+        case fullfloat:
+            for (size_t t = 0; t < rows; t++)
+                memcpy(&feat(0, t), h.payload + t * cols * sizeof(float), cols * sizeof(float));
+            break;
+        case fulldouble:
+            for (size_t t = 0; t < rows; t++)
+            {
+                const unsigned char *src = h.payload + t * cols * sizeof(double);
+                for (size_t d = 0; d < cols; d++)
+                    feat(d, t) = (float) load<double>(src + d * sizeof(double));
+            }
+            break;
+        case compressed2:
+        case compressed3:
+        {
+            // linear quantization over the whole matrix, row major; the inner loops vectorize
+            const bool twobytes = h.kind == compressed2;
+            const float increment = h.range * (twobytes ? 1.0f / 65535.0f : 1.0f / 255.0f);
+            const float minvalue = h.minvalue;
+            for (size_t t = 0; t < rows; t++)
+            {
+                float *dst = &feat(0, t);
+                if (twobytes)
+                {
+                    const unsigned char *src = h.payload + t * cols * 2;
+                    for (size_t d = 0; d < cols; d++)
+                        dst[d] = minvalue + increment * (float) (src[2 * d] | (src[2 * d + 1] << 8));
+                }
+                else
+                {
+                    const unsigned char *src = h.payload + t * cols;
+                    for (size_t d = 0; d < cols; d++)
+                        dst[d] = minvalue + increment * (float) src[d];
+                }
+            }
+            break;
+        }
+        case compressed:
+        {
+            // Each column has four 16-bit percentiles that define a piecewise
+            // linear map of the byte codes 0..64, 64..192, 192..255. The map
+            // is tabulated per column, so that decoding is one lookup per
+            // value; the data are column major, the output frame major.
+            const float increment = h.range * (1.0f / 65535.0f);
+            std::vector<float> tables(cols * 256);
+            for (size_t d = 0; d < cols; d++)
+            {
+                const unsigned char *colheader = h.payload + d * 8;
+                float p0 = h.minvalue + increment * load<uint16_t>(colheader);
+                float p25 = h.minvalue + increment * load<uint16_t>(colheader + 2);
+                float p75 = h.minvalue + increment * load<uint16_t>(colheader + 4);
+                float p100 = h.minvalue + increment * load<uint16_t>(colheader + 6);
+                float *table = &tables[d * 256];
+                for (int v = 0; v < 256; v++)
+                {
+                    if (v <= 64)
+                        table[v] = p0 + (p25 - p0) * v * (1.0f / 64.0f);
+                    else if (v <= 192)
+                        table[v] = p25 + (p75 - p25) * (v - 64) * (1.0f / 128.0f);
+                    else
+                        table[v] = p75 + (p100 - p75) * (v - 192) * (1.0f / 63.0f);
+                }
+            }
+            const unsigned char *bytes = h.payload + cols * 8;
+            for (size_t t = 0; t < rows; t++)
+            {
+                float *dst = &feat(0, t);
+                for (size_t d = 0; d < cols; d++)
+                    dst[d] = tables[d * 256 + bytes[d * rows + t]];
+            }
+            break;
+        }
+        }
+    }
+};
+} }
@@ -150,15 +150,46 @@ class minibatchutterancesourcemulti : public minibatchsource
                 frames.resize(featdim, totalframes);
                 if (!latticesource.empty())
                     lattices.resize(utteranceset.size());
-                foreach_index (i, utteranceset)
+                const msra::asr::FeatureSection *featuresection = utteranceset[0].parsedpath.featuresection;
+                if (featuresection->candecodedirectly())
                 {
-                    // fprintf (stderr, ".");
-                    // read features for this file
-                    auto uttframes = getutteranceframes(i);                                                           // matrix stripe for this utterance (currently unfilled)
-                    reader.readNoAlloc(utteranceset[i].parsedpath, (const string &) featkind, sampperiod, uttframes); // note: file info here used for checkuing only
-                    // page in lattice data
+                    // decode the utterances straight out of the memory-mapped archives, in parallel;
+                    // exceptions must not leave the parallel region, the first error is rethrown after it
+                    std::string error;
+                    const int numutts = (int) utteranceset.size();
+#pragma omp parallel for schedule(dynamic, 1)
+                    for (int i = 0; i < numutts; i++)
+                    {
+                        try
+                        {
+                            auto uttframes = getutteranceframes(i);
+                            featuresection->readdirect(utteranceset[i].parsedpath, uttframes);
+                        }
+                        catch (const std::exception &e)
+                        {
+#pragma omp critical
+                            if (error.empty())
+                                error = e.what();
+                        }
+                    }
+                    if (!error.empty())
+                        throw std::runtime_error(error);
                     if (!latticesource.empty())
-                        latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols());
+                        foreach_index (i, utteranceset)
+                            latticesource.getlattices(utteranceset[i].key(), lattices[i], numframes(i));
+                }
+                else
+                {
+                    foreach_index (i, utteranceset)
+                    {
+                        // fprintf (stderr, ".");
+                        // read features for this file
+                        auto uttframes = getutteranceframes(i);                                                           // matrix stripe for this utterance (currently unfilled)
+                        reader.readNoAlloc(utteranceset[i].parsedpath, (const string &) featkind, sampperiod, uttframes); // note: file info here used for checkuing only
+                        // page in lattice data
+                        if (!latticesource.empty())
+                            latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols());
+                    }
                 }
                 // fprintf (stderr, "\n");
                 if (verbosity)
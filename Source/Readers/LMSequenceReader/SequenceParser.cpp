@@ -567,10 +567,18 @@ long LMBatchSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, s
 {
     size_t linecnt = (size_t) ::LMSequenceParser<NumType, LabelType>::Parse(recordsRequested, labels, numbers, seqPos);
 
-    // create array of SentenceInfo structures, one per read input line
+    AddSentenceInfo(*seqPos);
+
+    assert(mSentenceIndex2SentenceInfo.size() == linecnt);
+    return (long) linecnt; // TODO: change to size_t
+}
+
+// create array of SentenceInfo structures, one per read input line
+template <typename NumType, typename LabelType>
+void LMBatchSequenceParser<NumType, LabelType>::AddSentenceInfo(const std::vector<SequencePosition>& seqPos)
+{
     size_t prvat = 0;
-    size_t i = 0;
-    for (auto ptr = seqPos->begin(); ptr != seqPos->end(); ptr++, i++)
+    for (auto ptr = seqPos.begin(); ptr != seqPos.end(); ptr++)
     {
         SentenceInfo stinfo;
         stinfo.sBegin = prvat;
@@ -580,9 +588,243 @@ long LMBatchSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, s
 
         prvat = ptr->labelPos;
     }
+}
+
+template <typename NumType, typename LabelType>
+long LMBatchSequenceParser<NumType, LabelType>::ParseIds(size_t recordsRequested, std::vector<int32_t> *tokens, std::vector<SequencePosition> *seqPos)
+{
+    assert(IsCorpusLoaded());
+    const auto orgRecordCount = tokens->size();
+
+    size_t lineCount = 0;
+    while (tokens->size() - orgRecordCount < recordsRequested && mNextSentence < mSentenceEnds.size())
+    {
+        size_t sBegin = mNextSentence == 0 ? 0 : mSentenceEnds[mNextSentence - 1];
+        size_t sEnd = mSentenceEnds[mNextSentence];
+        tokens->insert(tokens->end(), mTokens.begin() + sBegin, mTokens.begin() + sEnd);
+        seqPos->push_back(SequencePosition(0, tokens->size(), seqFlagLineBreak));
+        mNextSentence++;
+        lineCount++;
+    }
 
-    assert(mSentenceIndex2SentenceInfo.size() == linecnt);
-    return (long) linecnt; // TODO: change to size_t
+    AddSentenceInfo(*seqPos);
+    return (long) lineCount;
+}
+
+template <typename NumType, typename LabelType>
+void LMBatchSequenceParser<NumType, LabelType>::LoadCorpus(const std::wstring& cacheFile, size_t chunkSizeInBytes)
+{
+    if (IsCorpusLoaded())
+        return;
+
+    if (!cacheFile.empty() && ReadCorpusCache(cacheFile))
+    {
+        fprintf(stderr, "LMSequenceReader: Read %d sentences with %d tokens of %d word types from '%ls'.\n",
+                (int) mSentenceEnds.size(), (int) mTokens.size(), (int) mWordTypes.size(), cacheFile.c_str());
+        return;
+    }
+
+    long TickStart = GetTickCount();
+    ParseCorpus(chunkSizeInBytes);
+    fprintf(stderr, "LMSequenceReader: Parsed %d sentences with %d tokens of %d word types in %d ms.\n",
+            (int) mSentenceEnds.size(), (int) mTokens.size(), (int) mWordTypes.size(), (int) (GetTickCount() - TickStart));
+
+    if (!cacheFile.empty())
+        WriteCorpusCache(cacheFile);
+}
+
+// tokenize the file into mWordTypes, mTokens and mSentenceEnds
+// Each line-aligned chunk is tokenized on its own thread into a chunk-local vocabulary; the local vocabularies are
+// then merged in chunk order, so the result does not depend on the number of threads.
+template <typename NumType, typename LabelType>
+void LMBatchSequenceParser<NumType, LabelType>::ParseCorpus(size_t chunkSizeInBytes)
+{
+    // --- find line-aligned chunk boundaries
+    const uint64_t fileSize = (uint64_t) filesize64(mFileName.c_str());
+    std::vector<uint64_t> chunkBegin(1, 0);
+    {
+        FILE* f = fopenOrDie(mFileName, L"rb");
+        std::vector<char> buffer(64 * 1024);
+        uint64_t pos = chunkSizeInBytes;
+        while (pos < fileSize)
+        {
+            // the chunk ends after the first line end at or after 'pos'
+            fsetpos(f, pos);
+            bool found = false;
+            while (!found && pos < fileSize)
+            {
+                size_t n = (size_t) std::min<uint64_t>(buffer.size(), fileSize - pos);
+                freadOrDie(buffer.data(), 1, n, f);
+                const char* eol = (const char*) memchr(buffer.data(), '\n', n);
+                found = eol != nullptr;
+                pos += found ? (eol - buffer.data()) + 1 : n;
+            }
+            if (pos < fileSize)
+                chunkBegin.push_back(pos);
+            pos += chunkSizeInBytes;
+        }
+        fclose(f);
+    }
+    chunkBegin.push_back(fileSize);
+    const int numChunks = (int) chunkBegin.size() - 1;
+
+    // --- tokenize the chunks in parallel
+    // Lines are split at blanks, tabs and CRs, and lines with fewer than 3 tokens are skipped, as in LMSequenceParser::Parse().
+    struct Chunk
+    {
+        Microsoft::MSR::CNTK::FlatVocabulary<std::string, int32_t> vocabulary; // chunk-local word types
+        std::vector<int32_t> tokens;                                           // as chunk-local word-type ids
+        std::vector<size_t> sentenceEnds;
+    };
+    std::vector<Chunk> chunks(numChunks);
+    // exceptions must not leave the parallel region; the first error is rethrown after it
+    std::string error;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < numChunks; c++)
+    {
+        try
+        {
+            Chunk& chunk = chunks[c];
+            std::vector<char> text((size_t) (chunkBegin[c + 1] - chunkBegin[c]));
+            FILE* f = fopenOrDie(mFileName, L"rb");
+            fsetpos(f, chunkBegin[c]);
+            freadOrDie(text.data(), 1, text.size(), f);
+            fclose(f);
+
+            const char* p = text.data();
+            const char* end = p + text.size();
+            while (p < end)
+            {
+                const char* eol = (const char*) memchr(p, '\n', end - p);
+                if (!eol)
+                    eol = end;
+                const size_t lineBegin = chunk.tokens.size();
+                while (p < eol)
+                {
+                    while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+                        p++;
+                    const char* word = p;
+                    while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+                        p++;
+                    if (p > word)
+                        chunk.tokens.push_back(chunk.vocabulary.Insert(word, p - word, (int32_t) chunk.vocabulary.size()));
+                }
+                if (chunk.tokens.size() - lineBegin < 3)
+                    chunk.tokens.resize(lineBegin); // (its words stay in the local vocabulary, which is harmless)
+                else
+                    chunk.sentenceEnds.push_back(chunk.tokens.size());
+                p = eol + 1;
+            }
+        }
+        catch (const std::exception& e)
+        {
+#pragma omp critical
+            if (error.empty())
+                error = e.what();
+        }
+    }
+    if (!error.empty())
+        RuntimeError("LMBatchSequenceParser: Failed to parse '%ls': %s", mFileName.c_str(), error.c_str());
+
+    // --- merge the chunk vocabularies in chunk order and map the tokens to global word-type ids
+    mWordTypes.clear();
+    std::vector<std::vector<int32_t>> localToGlobal(numChunks);
+    std::vector<size_t> tokenBegin(numChunks + 1, 0);
+    size_t numSentences = 0;
+    for (int c = 0; c < numChunks; c++)
+    {
+        const auto& vocabulary = chunks[c].vocabulary;
+        localToGlobal[c].resize(vocabulary.size());
+        for (size_t i = 0; i < vocabulary.size(); i++)
+            localToGlobal[c][i] = mWordTypes.Insert(vocabulary.Word(i).data(), vocabulary.Word(i).size(), (int32_t) mWordTypes.size());
+        tokenBegin[c + 1] = tokenBegin[c] + chunks[c].tokens.size();
+        numSentences += chunks[c].sentenceEnds.size();
+    }
+    if (tokenBegin[numChunks] > (size_t) INT32_MAX || mWordTypes.size() > (size_t) INT32_MAX)
+        RuntimeError("LMBatchSequenceParser: '%ls' has too many tokens to be loaded as a whole.", mFileName.c_str());
+
+    mTokens.resize(tokenBegin[numChunks]);
+    mSentenceEnds.clear();
+    mSentenceEnds.reserve(numSentences);
+    for (int c = 0; c < numChunks; c++)
+        for (size_t sEnd : chunks[c].sentenceEnds)
+            mSentenceEnds.push_back(tokenBegin[c] + sEnd);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < numChunks; c++)
+    {
+        const auto& tokens = chunks[c].tokens;
+        const auto& map = localToGlobal[c];
+        for (size_t i = 0; i < tokens.size(); i++)
+            mTokens[tokenBegin[c] + i] = map[tokens[i]];
+    }
+    mNextSentence = 0;
+}
+
+// The cache holds the word types and the id stream. It is considered up to date if it is newer than the
+// input file and was made from a file of the same size; otherwise it is rebuilt.
+static const int s_corpusCacheVersion = 1;
+
+template <typename NumType, typename LabelType>
+bool LMBatchSequenceParser<NumType, LabelType>::ReadCorpusCache(const std::wstring& cacheFile)
+{
+    if (!fexists(cacheFile) || !msra::files::fuptodate(cacheFile, mFileName, true))
+        return false;
+
+    FILE* f = fopenOrDie(cacheFile, L"rb");
+    char tag[4];
+    uint64_t fileSize = 0;
+    if (fread(tag, 1, 4, f) != 4 || memcmp(tag, "LMID", 4) != 0 || fgetint(f) != s_corpusCacheVersion ||
+        fread(&fileSize, sizeof(fileSize), 1, f) != 1 || fileSize != (uint64_t) filesize64(mFileName.c_str()))
+    {
+        fclose(f);
+        fprintf(stderr, "LMSequenceReader: Ignoring outdated id cache '%ls'.\n", cacheFile.c_str());
+        return false;
+    }
+
+    uint64_t n;
+    freadOrDie(&n, sizeof(n), 1, f);
+    mWordTypes.clear();
+    mWordTypes.Reserve((size_t) n);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        std::string word = fgetstring(f);
+        mWordTypes.Insert(word.data(), word.size(), (int32_t) i);
+    }
+    freadOrDie(&n, sizeof(n), 1, f);
+    freadOrDie(mTokens, (size_t) n, f);
+    freadOrDie(&n, sizeof(n), 1, f);
+    std::vector<uint64_t> sentenceEnds;
+    freadOrDie(sentenceEnds, (size_t) n, f);
+    fclose(f);
+
+    mSentenceEnds.assign(sentenceEnds.begin(), sentenceEnds.end());
+    mNextSentence = 0;
+    return true;
+}
+
+template <typename NumType, typename LabelType>
+void LMBatchSequenceParser<NumType, LabelType>::WriteCorpusCache(const std::wstring& cacheFile) const
+{
+    // write to a temp file and rename it, so that an interrupted write never leaves a truncated cache behind
+    const std::wstring tmpFile = cacheFile + L".tmp";
+    FILE* f = fopenOrDie(tmpFile, L"wb");
+    fputTag(f, "LMID");
+    fputint(f, s_corpusCacheVersion);
+    uint64_t n = (uint64_t) filesize64(mFileName.c_str());
+    fwriteOrDie(&n, sizeof(n), 1, f);
+    n = mWordTypes.size();
+    fwriteOrDie(&n, sizeof(n), 1, f);
+    for (size_t i = 0; i < mWordTypes.size(); i++)
+        fputstring(f, mWordTypes.Word(i));
+    n = mTokens.size();
+    fwriteOrDie(&n, sizeof(n), 1, f);
+    fwriteOrDie(mTokens, f);
+    n = mSentenceEnds.size();
+    fwriteOrDie(&n, sizeof(n), 1, f);
+    fwriteOrDie(std::vector<uint64_t>(mSentenceEnds.begin(), mSentenceEnds.end()), f);
+    fcloseOrDie(f);
+    renameOrDie(tmpFile, cacheFile);
+    fprintf(stderr, "LMSequenceReader: Wrote id cache '%ls'.\n", cacheFile.c_str());
 }
 
 template class LMBatchSequenceParser<float, std::string>;
@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include "Basics.h"
 #include "fileutil.h"
+#include "FlatVocabulary.h"
 
 using namespace std;
 
@@ -625,8 +626,23 @@ class LMBatchSequenceParser : public LMSequenceParser<NumType, LabelType>
 public:
     vector<SentenceInfo> mSentenceIndex2SentenceInfo;
 
+    using LMSequenceParser<NumType, LabelType>::mFileName;
+
+protected:
+    // the corpus as word-type ids, for ParseIds() (see LoadCorpus())
+    Microsoft::MSR::CNTK::FlatVocabulary<std::string, int32_t> mWordTypes; // distinct words of the corpus; the id of a word type is its entry index
+    std::vector<int32_t> mTokens;                                           // all sentences, concatenated, as word-type ids
+    std::vector<size_t> mSentenceEnds;                                      // [i] end of sentence i in mTokens
+    size_t mNextSentence;                                                   // next sentence to be returned by ParseIds()
+
+    void ParseCorpus(size_t chunkSizeInBytes);
+    bool ReadCorpusCache(const std::wstring& cacheFile);
+    void WriteCorpusCache(const std::wstring& cacheFile) const;
+    void AddSentenceInfo(const std::vector<SequencePosition>& seqPos);
+
 public:
-    LMBatchSequenceParser(){};
+    LMBatchSequenceParser()
+        : mNextSentence(0){};
     ~LMBatchSequenceParser()
     {
     }
@@ -641,4 +657,23 @@ public:
     // returns - number of records actually read, if the end of file is reached the return value will be < requested records
     //   TODO: can return value be negative? If not, use size_t
     long Parse(size_t recordsRequested, std::vector<LabelType> *labels, std::vector<NumType> *numbers, std::vector<SequencePosition> *seqPos);
+
+    // LoadCorpus - tokenize the whole file once, on all cores, into a stream of word-type ids that ParseIds() serves from memory
+    // The file is split into line-aligned chunks of about 'chunkSizeInBytes' which are tokenized in parallel.
+    // If 'cacheFile' is given, the id stream is read from it if it is up to date w.r.t. the input file, and written to it otherwise.
+    void LoadCorpus(const std::wstring& cacheFile, size_t chunkSizeInBytes = 64 * 1024 * 1024);
+    bool IsCorpusLoaded() const { return !mSentenceEnds.empty(); }
+
+    // ParseIds - like Parse(), but returns the tokens as word-type ids of the corpus loaded by LoadCorpus()
+    // Sentences are returned with exactly the same boundaries and filtering as Parse() would.
+    // WordOfType() maps the ids back to words.
+    long ParseIds(size_t recordsRequested, std::vector<int32_t> *tokens, std::vector<SequencePosition> *seqPos);
+    const std::string &WordOfType(int32_t type) const { return mWordTypes.Word(type); }
+    size_t NumWordTypes() const { return mWordTypes.size(); }
+
+    void ParseReset()
+    {
+        mNextSentence = 0;
+        LMSequenceParser<NumType, LabelType>::ParseReset();
+    }
 };
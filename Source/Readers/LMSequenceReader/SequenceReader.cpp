@@ -1561,6 +1561,11 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
     const LabelInfo& labelOut = m_labelInfo[labelInfoOut];
     m_parser.ParseInit(pathName.c_str(), m_featureDim, labelIn.dim, labelOut.dim, labelIn.beginSequence, labelIn.endSequence, labelOut.beginSequence, labelOut.endSequence);
 
+    // parallelParsing: tokenize the whole corpus once, on all cores, into word-type ids, and serve all cache blocks and
+    // epochs from that id stream instead of re-parsing the text. idCacheFile: persist the id stream across runs (implies parallelParsing).
+    m_idCacheFile = (const wstring&) readerConfig(L"idCacheFile", L"");
+    m_parseToIds = readerConfig(L"parallelParsing", !m_idCacheFile.empty());
+
     mRequestedNumParallelSequences = readerConfig(L"nbruttsineachrecurrentiter", (size_t) 1); // 0 indicates auto-fill mbSize
     // TODO: ^^ This should depend on the sequences themselves.
 }
@@ -1579,12 +1584,43 @@ void BatchSequenceReader<ElemType>::Reset()
         m_labelTemp.clear();
     if (m_featureTemp.size() > 0)
         m_featureTemp.clear();
+    m_tokenTemp.clear();
     m_parser.mSentenceIndex2SentenceInfo.clear();
 }
 
+// GetIdFromToken - get the label id of token 'pos' of m_tokenTemp[], i.e. of a word type of the parsed corpus
+// Same as GetIdFromLabel() on the word, but memoized per word type in 'typeToId', so that each distinct word
+// is looked up only once. With 'mapEndSequence', words that match the end-of-sequence label case-insensitively map to it.
+template <class ElemType>
+typename BatchSequenceReader<ElemType>::LabelIdType BatchSequenceReader<ElemType>::GetIdFromToken(size_t pos, LabelInfo& labelInfo, std::vector<LabelIdType>& typeToId, bool mapEndSequence)
+{
+    const LabelIdType notMapped = (LabelIdType) -1;
+    const int32_t type = m_tokenTemp[pos];
+    if (typeToId.size() <= (size_t) type)
+        typeToId.resize(m_parser.NumWordTypes(), notMapped);
+
+    LabelIdType& labelId = typeToId[type];
+    if (labelId == notMapped)
+    {
+        const std::string& word = m_parser.WordOfType(type);
+        if (mapEndSequence && EqualCI(word, labelInfo.endSequence))
+            labelId = GetIdFromLabel(labelInfo.endSequence, labelInfo);
+        else
+            labelId = GetIdFromLabel(word, labelInfo);
+    }
+    return labelId;
+}
+
 template <class ElemType>
-void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples)
+void BatchSequenceReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
 {
+    if (subsetNum >= numSubsets)
+        InvalidArgument("StartDistributedMinibatchLoop: Invalid subset %d of %d.", (int) subsetNum, (int) numSubsets);
+    if ((numSubsets > 1) && (mRequestedNumParallelSequences > 0) && (mRequestedNumParallelSequences < numSubsets))
+        LogicError("Insufficient value of 'nbruttsineachrecurrentiter'=%d for distributed reading with %d subsets", (int) mRequestedNumParallelSequences, (int) numSubsets);
+    m_subsetNum = subsetNum;
+    m_numSubsets = numSubsets;
+
     // if we aren't currently caching, see if we can use a cache
     if (!m_cachingReader && !m_cachingWriter)
     {
@@ -1596,7 +1632,7 @@ void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epo
     // if we are reading from the cache, do so now and return
     if (m_cachingReader)
     {
-        m_cachingReader->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+        m_cachingReader->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
         return;
     }
 
@@ -1715,8 +1751,8 @@ size_t BatchSequenceReader<ElemType>::DetermineSequencesToProcess()
 
     // mToProcess[] is empty: fill it up with at most mRequestedNumParallelSequences entries of the same length
     size_t sln = 0;
-    size_t maxToProcess = mRequestedNumParallelSequences > 0 ? mRequestedNumParallelSequences : SIZE_MAX; // if mRequestedNumParallelSequences is 0 then we go by MB size
-    size_t maxTokens    = mRequestedNumParallelSequences > 0 ?                       SIZE_MAX : m_mbSize;
+    size_t maxToProcess = mRequestedNumParallelSequences > 0 ? SubsetShare(mRequestedNumParallelSequences) : SIZE_MAX; // if mRequestedNumParallelSequences is 0 then we go by MB size
+    size_t maxTokens    = mRequestedNumParallelSequences > 0 ?                                    SIZE_MAX : SubsetShare(m_mbSize);
     size_t numTokens = 0;  // token counter
     for (size_t seq = mLastProcssedSentenceId;
          seq < mNumRead &&                 // hit end of buffer
@@ -1749,6 +1785,28 @@ size_t BatchSequenceReader<ElemType>::DetermineSequencesToProcess()
     return sln;
 }
 
+// keep only the sequences of the current cache block that this subset returns in distributed reading, and return their number
+// All subsets parse and shuffle the block alike. Dealing out the sequences of each length to the subsets in turn gives every
+// subset the same lengths up to one sequence per length, so that the minibatches, which take sequences of one length,
+// cost about the same on all subsets and none of them waits for the others.
+template <class ElemType>
+size_t BatchSequenceReader<ElemType>::SelectSubsetSequences()
+{
+    auto& sentenceInfos = m_parser.mSentenceIndex2SentenceInfo;
+    if (m_numSubsets == 1)
+        return sentenceInfos.size();
+
+    std::map<size_t, size_t> numOfLength; // [sLen] number of sequences of that length dealt out so far
+    size_t numSelected = 0;
+    for (size_t seq = 0; seq < sentenceInfos.size(); seq++)
+    {
+        if (numOfLength[sentenceInfos[seq].sLen]++ % m_numSubsets == m_subsetNum)
+            sentenceInfos[numSelected++] = sentenceInfos[seq];
+    }
+    sentenceInfos.resize(numSelected);
+    return numSelected;
+}
+
 // fill the buffer with the next one or more sequences to process
 // Advances mLastPosInSentence, which is the cursor into the sentence(s).
 // Returns the previous value of mLastPosInSentence, which is needed in creating the MB layout.
@@ -1762,7 +1820,7 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
     //  - the parser will start over, to cacheBlockSize must be >= corpus size, and all gets (re-)loaded into RAM each epoch
     // The alternative, set cacheBlockSize == epoch size, is not good since it will have very few utterances of the same length to batch.
     // We will not fix much more than this since the soon-to-come new reader API will solve these issues.
-    if (m_epochSamplesReturned > m_epochSize)
+    if (m_epochSamplesReturned > SubsetShare(m_epochSize))
         return false;
 
     m_featureData.clear();
@@ -1776,14 +1834,19 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
         Reset();
 
         std::vector<SequencePosition> seqPos;
+        if (m_parseToIds)
+            m_parser.LoadCorpus(m_idCacheFile); // (only parses on first call)
         fprintf(stderr, "LMSequenceReader: Reading epoch data..."), fflush(stderr);
-        mNumRead = m_parser.Parse(m_cacheBlockSize, &m_labelTemp, &m_featureTemp, &seqPos);
+        if (m_parseToIds)
+            mNumRead = m_parser.ParseIds(m_cacheBlockSize, &m_tokenTemp, &seqPos);
+        else
+            mNumRead = m_parser.Parse(m_cacheBlockSize, &m_labelTemp, &m_featureTemp, &seqPos);
         fprintf(stderr, " %d sequences read.\n", (int) mNumRead);
         firstPosInSentence = mLastPosInSentence;
         if (mNumRead == 0)
             return false; // end
 
-        if (m_cacheBlockSize == 50000) // back compat--this used to be a constant
+        if (m_cacheBlockSize == 50000 && m_numSubsets == 1) // back compat--this used to be a constant (distributed reading needs the seeded shuffle, which all subsets do alike)
         {
             // this uses rand(), which maxes out at 32767  --BUGBUG?
             std::random_shuffle(m_parser.mSentenceIndex2SentenceInfo.begin(), m_parser.mSentenceIndex2SentenceInfo.end());
@@ -1797,6 +1860,7 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
         }
 
         m_readNextSampleLine += mNumRead;
+        mNumRead = SelectSubsetSequences();
         sLn = DetermineSequencesToProcess();
     }
 
@@ -1822,13 +1886,14 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
             size_t pos = m_parser.mSentenceIndex2SentenceInfo[seq].sBegin + i;
 
             // labelIn should be a category label
-            const auto& labelValue = m_labelTemp[pos];
+            const size_t labelPos = pos;
             pos++; // consume it
 
             // generate the feature token
             if (labelIn.type == labelCategory)
             {
-                LabelIdType labelId = GetIdFromLabel(labelValue, labelIn);
+                LabelIdType labelId = m_parseToIds ? GetIdFromToken(labelPos, labelIn, m_typeToInputId, false)
+                                                   : GetIdFromLabel(m_labelTemp[labelPos], labelIn);
 
                 // use the found value, and set the appropriate location to a 1.0
                 assert(labelIn.dim > labelId); // if this goes off labelOut dimension is too small
@@ -1840,20 +1905,22 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
             // generate the output label token
             if (labelOut.type != labelNone)
             {
-                const auto& labelValue = m_labelTemp[pos];
                 LabelIdType labelId;
                 if (labelOut.type == labelCategory)
                 {
+                    labelId = m_parseToIds ? GetIdFromToken(pos, labelOut, m_typeToOutputId, false)
+                                           : GetIdFromLabel(m_labelTemp[pos], labelOut);
                     pos++; // consume it   --TODO: value is not used after this
-                    labelId = GetIdFromLabel(labelValue, labelOut);
                 }
                 else if (nextWord)
                 {
-                    // this is the next word (pos was already incremented above when reading out labelValue)
-                    if (EqualCI(labelValue, labelIn.endSequence)) // end symbol may differ between input and output
+                    // this is the next word (pos was already incremented above when reading out the input label)
+                    if (m_parseToIds)
+                        labelId = GetIdFromToken(pos, labelIn, m_typeToNextWordId, true);
+                    else if (EqualCI(m_labelTemp[pos], labelIn.endSequence)) // end symbol may differ between input and output
                         labelId = GetIdFromLabel(labelIn.endSequence, labelIn);
                     else
-                        labelId = GetIdFromLabel(labelValue, labelIn);
+                        labelId = GetIdFromLabel(m_labelTemp[pos], labelIn);
                 }
                 else
                     LogicError("Unexpected output label type."); // should never get here
@@ -374,9 +374,21 @@ private:
     std::vector<ElemType> m_featureTemp;
     std::vector<LabelType> m_labelTemp;
 
+    // parallelParsing: the corpus is parsed once into word-type ids (LMBatchSequenceParser::LoadCorpus())
+    bool m_parseToIds;
+    std::wstring m_idCacheFile;
+    std::vector<int32_t> m_tokenTemp;          // word-type ids of the current cache block, used instead of m_labelTemp
+    std::vector<LabelIdType> m_typeToInputId;  // [word type] memoized label ids, see GetIdFromToken()
+    std::vector<LabelIdType> m_typeToOutputId;
+    std::vector<LabelIdType> m_typeToNextWordId;
+
     bool mSentenceEnd;
     //bool mSentenceBegin;
 
+    // distributed reading (StartDistributedMinibatchLoop()): this reader returns the sequences of subset m_subsetNum only
+    size_t m_subsetNum;
+    size_t m_numSubsets;
+
     MBLayoutPtr m_pMBLayout;
 
 public:
@@ -389,6 +401,9 @@ public:
         mLastPosInSentence = 0;
         mNumRead = 0;
         mSentenceEnd = false;
+        m_parseToIds = false;
+        m_subsetNum = 0;
+        m_numSubsets = 1;
     }
 
     template <class ConfigRecordType>
@@ -403,13 +418,29 @@ public:
     }
 private:
     void Reset();
+    LabelIdType GetIdFromToken(size_t pos, LabelInfo& labelInfo, std::vector<LabelIdType>& typeToId, bool mapEndSequence);
     size_t DetermineSequencesToProcess();
+    size_t SelectSubsetSequences();
+    size_t SubsetShare(size_t total) const
+    {
+        return total / m_numSubsets + ((m_subsetNum < total % m_numSubsets) ? 1 : 0);
+    }
     bool GetMinibatchData(size_t& firstPosInSentence);
     void GetLabelOutput(std::map<std::wstring, Matrix<ElemType>*>& matrices,
                         size_t m_mbStartSample, size_t actualmbsize);
 
 public:
-    void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override;
+    void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override
+    {
+        return StartDistributedMinibatchLoop(mbSize, epoch, 0, 1, requestedEpochSamples);
+    }
+    bool SupportsDistributedMBRead() const override
+    {
+        return ((m_cachingReader == nullptr) || m_cachingReader->SupportsDistributedMBRead());
+    }
+    // Each subset returns the sequences of every cache block that SelectSubsetSequences() selects for it, and its share
+    // of 'nbruttsineachrecurrentiter' (or of 'mbSize' tokens if that is 0) per minibatch.
+    void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override;
     bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override;
     bool DataEnd() override;
 
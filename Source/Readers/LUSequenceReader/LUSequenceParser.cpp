@@ -53,6 +53,17 @@ long BatchLUSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, s
     m_inputs = input;
     m_labels = labels;
 
+    if (mInputVocabularySource != &inputlabel2id || mInputVocabulary.size() != inputlabel2id.size())
+    {
+        mInputVocabulary.Build(inputlabel2id);
+        mInputVocabularySource = &inputlabel2id;
+    }
+    if (mOutputVocabularySource != &outputlabel2id || mOutputVocabulary.size() != outputlabel2id.size())
+    {
+        mOutputVocabulary.Build(outputlabel2id);
+        mOutputVocabularySource = &outputlabel2id;
+    }
+
     long recordCount = 0;
     long orgRecordCount = (long) labels->size();
     long lineCount = 0;
@@ -95,28 +106,11 @@ long BatchLUSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, s
 
         bAtEOS = false;
         vector<long> vtmp;
+        vtmp.reserve(vstr.size() - 1);
         for (size_t i = 0; i < vstr.size() - 1; i++)
-        {
-            if (inputlabel2id.find(vstr[i]) == inputlabel2id.end())
-            {
-                if (inputlabel2id.find(mUnkStr) == inputlabel2id.end())
-                {
-                    LogicError("cannot find item %ls and unk str %ls in input label", vstr[i].c_str(), mUnkStr.c_str());
-                }
-                vtmp.push_back(inputlabel2id.find(mUnkStr)->second);
-            }
-            else
-                vtmp.push_back(inputlabel2id.find(vstr[i])->second);
-        }
-        if (outputlabel2id.find(vstr[vstr.size() - 1]) == outputlabel2id.end())
-        {
-            if (outputlabel2id.find(mUnkStr) == outputlabel2id.end())
-                LogicError("cannot find item %ls and unk str %ls in output label", vstr[vstr.size() - 1].c_str(), mUnkStr.c_str());
-            labels->push_back(outputlabel2id.find(mUnkStr)->second);
-        }
-        else
-            labels->push_back(outputlabel2id.find(vstr[vstr.size() - 1])->second);
-        input->push_back(vtmp);
+            vtmp.push_back(GetTokenId(mInputVocabulary, vstr[i], "input"));
+        labels->push_back(GetTokenId(mOutputVocabulary, vstr[vstr.size() - 1], "output"));
+        input->push_back(std::move(vtmp));
         if ((vstr[vstr.size() - 1] == m_endSequenceOut ||
              // below is for backward support
              vstr[0] == m_endTag) &&
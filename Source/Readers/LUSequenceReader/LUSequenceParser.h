@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include "Platform.h"
 #include "DataReader.h"
+#include "FlatVocabulary.h"
 
 using namespace std;
 
@@ -141,6 +142,27 @@ public:
     std::wstring mFileName;
     vector<SentenceInfo> mSentenceIndex2SentenceInfo;
 
+protected:
+    // flat hash copies of the label maps passed to Parse(), which are looked up for every token
+    // They are built on the first call and rebuilt only if Parse() is passed different maps.
+    FlatVocabulary<wstring, long> mInputVocabulary;
+    FlatVocabulary<wstring, long> mOutputVocabulary;
+    const map<wstring, long>* mInputVocabularySource;
+    const map<wstring, long>* mOutputVocabularySource;
+
+    // look up a token, falling back to mUnkStr; 'what' names the vocabulary for the error message
+    long GetTokenId(const FlatVocabulary<wstring, long>& vocabulary, const wstring& token, const char* what) const
+    {
+        long id = vocabulary.Find(token, -1);
+        if (id < 0)
+        {
+            id = vocabulary.Find(mUnkStr, -1);
+            if (id < 0)
+                LogicError("cannot find item %ls and unk str %ls in %s label", token.c_str(), mUnkStr.c_str(), what);
+        }
+        return id;
+    }
+
 public:
     using LUSequenceParser<NumType, LabelType>::m_dimFeatures;
     using LUSequenceParser<NumType, LabelType>::m_dimLabelsIn;
@@ -157,7 +179,8 @@ public:
     using LUSequenceParser<NumType, LabelType>::m_labels;
     using LUSequenceParser<NumType, LabelType>::m_beginSequence;
     using LUSequenceParser<NumType, LabelType>::m_endSequence;
-    BatchLUSequenceParser(){};
+    BatchLUSequenceParser()
+        : mInputVocabularySource(nullptr), mOutputVocabularySource(nullptr){};
     ~BatchLUSequenceParser()
     {
         mFile.close();
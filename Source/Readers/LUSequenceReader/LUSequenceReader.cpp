@@ -459,8 +459,15 @@ void BatchLUSequenceReader<ElemType>::Reset()
 }
 
 template <class ElemType>
-void BatchLUSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples)
+void BatchLUSequenceReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
 {
+    if (subsetNum >= numSubsets)
+        InvalidArgument("StartDistributedMinibatchLoop: Invalid subset %d of %d.", (int) subsetNum, (int) numSubsets);
+    if ((numSubsets > 1) && (mRequestedNumParallelSequences < numSubsets))
+        LogicError("Insufficient value of 'nbruttsineachrecurrentiter'=%d for distributed reading with %d subsets", (int) mRequestedNumParallelSequences, (int) numSubsets);
+    m_subsetNum = subsetNum;
+    m_numSubsets = numSubsets;
+
     if (m_featuresBuffer == NULL)
     {
         const LabelInfo& labelInfo = m_labelInfo[(m_labelInfo[labelInfoOut].type == labelNextWord) ? labelInfoIn : labelInfoOut];
@@ -563,6 +570,7 @@ size_t BatchLUSequenceReader<ElemType>::FindNextSentences(size_t numRead)
         return 0;
 
     // form mToProcess[] array for this minibatch
+    const size_t numParallelSequences = SubsetShare(mRequestedNumParallelSequences);
     vector<size_t> sln; // (value of mSentenceLengths is first formed here and later moved over)
     size_t iNumber = min(numRead, mProcessed.size());
     int previousLn = -1;
@@ -573,7 +581,7 @@ size_t BatchLUSequenceReader<ElemType>::FindNextSentences(size_t numRead)
 
         if (mEqualLengthOutput)
         {
-            if (mProcessed[seq] == false && mToProcess.size() < mRequestedNumParallelSequences)
+            if (mProcessed[seq] == false && mToProcess.size() < numParallelSequences)
             {
                 int ln = (int) m_parser.mSentenceIndex2SentenceInfo[seq].sLen;
                 if (ln == previousLn || previousLn == -1)
@@ -587,13 +595,13 @@ size_t BatchLUSequenceReader<ElemType>::FindNextSentences(size_t numRead)
                 }
             }
 
-            if (mToProcess.size() == mRequestedNumParallelSequences)
+            if (mToProcess.size() == numParallelSequences)
                 break;
             inbrReader++;
         }
         else
         {
-            if (mProcessed[seq] == false && mToProcess.size() < mRequestedNumParallelSequences)
+            if (mProcessed[seq] == false && mToProcess.size() < numParallelSequences)
             {
                 size_t len = m_parser.mSentenceIndex2SentenceInfo[seq].sLen;
                 sln.push_back(len);
@@ -601,7 +609,7 @@ size_t BatchLUSequenceReader<ElemType>::FindNextSentences(size_t numRead)
                 mMaxSentenceLength = max(mMaxSentenceLength, len);
             }
 
-            if (mToProcess.size() == mRequestedNumParallelSequences)
+            if (mToProcess.size() == numParallelSequences)
                 break;
             inbrReader++;
         }
@@ -616,6 +624,28 @@ size_t BatchLUSequenceReader<ElemType>::FindNextSentences(size_t numRead)
     return mToProcess.size();
 }
 
+// keep only the sentences of the current cache block that this subset returns in distributed reading, and return their number
+// All subsets parse and shuffle the block alike. Dealing out the sentences of each length to the subsets in turn gives every
+// subset the same lengths up to one sentence per length, so that with 'equalLength' the minibatches cost about the same on
+// all subsets and none of them waits for the others.
+template <class ElemType>
+size_t BatchLUSequenceReader<ElemType>::SelectSubsetSequences()
+{
+    auto& sentenceInfos = m_parser.mSentenceIndex2SentenceInfo;
+    if (m_numSubsets == 1)
+        return sentenceInfos.size();
+
+    std::map<size_t, size_t> numOfLength; // [sLen] number of sentences of that length dealt out so far
+    size_t numSelected = 0;
+    for (size_t seq = 0; seq < sentenceInfos.size(); seq++)
+    {
+        if (numOfLength[sentenceInfos[seq].sLen]++ % m_numSubsets == m_subsetNum)
+            sentenceInfos[numSelected++] = sentenceInfos[seq];
+    }
+    sentenceInfos.resize(numSelected);
+    return numSelected;
+}
+
 // fetch the next minibatch
 // Returns result in m_labelIdData and m_featureWordContext.
 template <class ElemType>
@@ -632,7 +662,7 @@ bool BatchLUSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample
     // see how many we already read
     std::vector<SequencePosition> seqPos;
 
-    if (mTotalSentenceSofar > m_epochSize)
+    if (mTotalSentenceSofar > SubsetShare(m_epochSize))
     {
         m_pMBLayout->Init(1, 0);
         return false;
@@ -640,7 +670,7 @@ bool BatchLUSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample
     else
     {
         size_t nbrSentenceRead = FindNextSentences(mRequestedNumParallelSequences);
-        if (mAllowMultPassData && nbrSentenceRead == 0 && mTotalSentenceSofar > 0 && m_totalSamples < m_epochSize)
+        if (mAllowMultPassData && nbrSentenceRead == 0 && mTotalSentenceSofar > 0 && m_totalSamples < SubsetShare(m_epochSize))
         {
             // restart for the next pass of the data
             mProcessed.assign(mProcessed.size(), false);
@@ -659,7 +689,6 @@ bool BatchLUSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample
                 m_pMBLayout->Init(1, 0);
                 return false;
             }
-            mProcessed.assign(mNumRead, false);
 
 #ifndef DEBUG_READER
             if (mRandomize)
@@ -671,6 +700,8 @@ bool BatchLUSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample
 #endif
 
             m_readNextSampleLine += mNumRead;
+            mNumRead = SelectSubsetSequences();
+            mProcessed.assign(mNumRead, false);
             nbrSentenceRead = FindNextSentences(mRequestedNumParallelSequences);
             if (nbrSentenceRead == 0)
             {
@@ -264,6 +264,16 @@ private:
     bool mSentenceEnd;
     bool mSentenceBegin;
 
+    // distributed reading (StartDistributedMinibatchLoop()): this reader returns the sentences of subset m_subsetNum only
+    size_t m_subsetNum;
+    size_t m_numSubsets;
+
+    size_t SelectSubsetSequences();
+    size_t SubsetShare(size_t total) const
+    {
+        return total / m_numSubsets + ((m_subsetNum < total % m_numSubsets) ? 1 : 0);
+    }
+
 public:
     vector<bool> mProcessed;
     BatchLUSequenceParser<ElemType, LabelType> m_parser;
@@ -277,6 +287,8 @@ public:
         mSentenceEnd = false;
         mSentenceBegin = true;
         mIgnoreSentenceBeginTag = false;
+        m_subsetNum = 0;
+        m_numSubsets = 1;
     }
 
     ~BatchLUSequenceReader();
@@ -319,7 +331,17 @@ public:
                                    Matrix<ElemType>*>& matrices,
                           LabelInfo& labelInfo, size_t actualmbsize);
 
-    void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize);
+    void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize)
+    {
+        return StartDistributedMinibatchLoop(mbSize, epoch, 0, 1, requestedEpochSamples);
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return true;
+    }
+    // Each subset returns the sentences of every cache block that SelectSubsetSequences() selects for it, and its share
+    // of 'nbruttsineachrecurrentiter' per minibatch.
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override;
     bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices);
 
     bool EnsureDataAvailable(size_t mbStartSample);
@@ -416,6 +438,18 @@ public:
 
     void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples);
 
+    // not distributed: the streams are aligned by sentence, which the selection of each reader by sentence length would break
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return false;
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override
+    {
+        if ((numSubsets != 1) || (subsetNum != 0))
+            LogicError("This reader does not support distributed reading of mini-batches");
+        StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+    }
+
     void CopyMBLayoutTo(MBLayoutPtr pMBLayout);
 
     size_t GetNumParallelSequences();
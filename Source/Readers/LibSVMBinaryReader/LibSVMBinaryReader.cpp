@@ -39,7 +39,7 @@ DWORD LODWORD(size_t size)
 
 template <class ElemType>
 DenseBinaryMatrix<ElemType>::DenseBinaryMatrix(wstring name, int deviceID, size_t numRows, size_t numCols)
-    : BinaryMatrix<ElemType>(name, deviceID, numRows, numCols)
+    : BinaryMatrix<ElemType>(name, deviceID, numRows, numCols), m_borrowedValues(nullptr)
 {
     // this->m_values = (ElemType*)malloc(sizeof(ElemType)*numRows*numCols);
     this->m_values = (ElemType*) CUDAPageLockedMemAllocator::Malloc(sizeof(ElemType) * numRows * numCols, deviceID);
@@ -49,6 +49,7 @@ template <class ElemType>
 void DenseBinaryMatrix<ElemType>::Clear()
 {
     this->m_numRows = 0;
+    m_borrowedValues = nullptr;
 }
 
 template <class ElemType>
@@ -65,7 +66,8 @@ void DenseBinaryMatrix<ElemType>::Dispose()
 template <class ElemType>
 void DenseBinaryMatrix<ElemType>::Fill(Matrix<ElemType>* matrix)
 {
-    matrix->SetValue(this->m_maxNumCols, this->m_numRows, matrix->GetDeviceId(), this->m_values, matrixFlagNormal);
+    ElemType* values = m_borrowedValues ? m_borrowedValues : this->m_values;
+    matrix->SetValue(this->m_maxNumCols, this->m_numRows, matrix->GetDeviceId(), values, matrixFlagNormal);
 #if DEBUG
     matrix->Print("testname");
 #endif
@@ -99,9 +101,17 @@ void DenseBinaryMatrix<ElemType>::AddValues(void* values, size_t numRows)
     this->m_numRows += numRows;
 }
 
+template <class ElemType>
+void DenseBinaryMatrix<ElemType>::Borrow(void* values, void* /*rowIndices*/, void* /*colIndices*/, size_t /*nnz*/, size_t numRows)
+{
+    m_borrowedValues = (ElemType*) values;
+    this->m_numRows = numRows;
+}
+
 template <class ElemType>
 SparseBinaryMatrix<ElemType>::SparseBinaryMatrix(wstring name, int deviceId, size_t numRows, size_t numCols)
-    : BinaryMatrix<ElemType>(name, deviceId, numRows, numCols), m_rowIndices(nullptr), m_colIndices(nullptr), m_nnz(0), m_maxNNz(0)
+    : BinaryMatrix<ElemType>(name, deviceId, numRows, numCols), m_rowIndices(nullptr), m_colIndices(nullptr), m_nnz(0), m_maxNNz(0),
+      m_borrowedValues(nullptr), m_borrowedRowIndices(nullptr), m_borrowedColIndices(nullptr)
 {
     // m_colIndices = (int32_t*)malloc(sizeof(int32_t)*(numRows + 1));
     m_colIndices = (int32_t*) CUDAPageLockedMemAllocator::Malloc(sizeof(int32_t) * (numRows + 1), deviceId);
@@ -191,6 +201,21 @@ void SparseBinaryMatrix<ElemType>::Clear()
 {
     m_numRows = 0;
     m_nnz = 0;
+    m_borrowedValues = nullptr;
+    m_borrowedRowIndices = nullptr;
+    m_borrowedColIndices = nullptr;
+}
+
+// The microbatch arrays on disk are already in CSC format, with column offsets starting at 0; so a minibatch that
+// consists of a single microbatch can be handed to the matrix as it is in the read buffer.
+template <class ElemType>
+void SparseBinaryMatrix<ElemType>::Borrow(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows)
+{
+    m_borrowedValues = (ElemType*) values;
+    m_borrowedRowIndices = (int32_t*) rowIndices;
+    m_borrowedColIndices = (int32_t*) colIndices;
+    m_nnz = nnz;
+    this->m_numRows = numRows;
 }
 
 template <class ElemType>
@@ -218,7 +243,10 @@ void SparseBinaryMatrix<ElemType>::AddRowIndices(void* rowIndices, size_t nnz)
 template <class ElemType>
 void SparseBinaryMatrix<ElemType>::Fill(Matrix<ElemType>* matrix)
 {
-    matrix->SetMatrixFromCSCFormat(m_colIndices, m_rowIndices, this->m_values, this->m_nnz, this->m_maxNumCols, this->m_numRows);
+    if (m_borrowedValues)
+        matrix->SetMatrixFromCSCFormat(m_borrowedColIndices, m_borrowedRowIndices, m_borrowedValues, m_nnz, this->m_maxNumCols, this->m_numRows);
+    else
+        matrix->SetMatrixFromCSCFormat(m_colIndices, m_rowIndices, this->m_values, this->m_nnz, this->m_maxNumCols, this->m_numRows);
 #if DEBUG
     matrix->Print("testname");
 #endif
@@ -226,7 +254,7 @@ void SparseBinaryMatrix<ElemType>::Fill(Matrix<ElemType>* matrix)
 
 template <class ElemType>
 SparseBinaryInput<ElemType>::SparseBinaryInput(std::wstring fileName)
-    : m_fileName(fileName), m_readOrder(nullptr), m_readOrderLength(0), m_randomize(false), m_tempValues(nullptr), m_tempValuesSize(0), m_offsets(nullptr), m_offsetsStart(0), m_startMB(0), m_endMB(0)
+    : m_fileName(fileName), m_readOrder(nullptr), m_readOrderLength(0), m_randomize(false), m_tempValues(nullptr), m_tempValuesSize(0), m_offsets(nullptr), m_offsetsStart(0), m_startMB(0), m_endMB(0), m_maxMBSize(0), m_deviceId(CPUDEVICE)
 {
     std::string name = msra::strfun::utf8(m_fileName);
     m_inFile.open(name, ifstream::binary | ifstream::in);
@@ -235,6 +263,13 @@ SparseBinaryInput<ElemType>::SparseBinaryInput(std::wstring fileName)
 template <class ElemType>
 SparseBinaryInput<ElemType>::~SparseBinaryInput()
 {
+    for (void* dataBuffer : m_dataBuffers)
+    {
+        if (m_deviceId >= 0)
+            CUDAPageLockedMemAllocator::FreeToPool(dataBuffer);
+        else
+            free(dataBuffer);
+    }
 }
 
 template <class ElemType>
@@ -335,6 +370,25 @@ void SparseBinaryInput<ElemType>::Init(std::map<std::wstring, std::wstring> rena
 
     m_inFile.seekg(0, ios::end);
     m_fileSize = (size_t) m_inFile.tellg();
+
+    ComputeMaxMBSize();
+}
+
+// the read buffers hold any microbatch of the file, so that they can be allocated once, whatever the data window
+template <class ElemType>
+void SparseBinaryInput<ElemType>::ComputeMaxMBSize()
+{
+    std::vector<int64_t> offsets(m_numBatches + 1);
+    m_inFile.clear();
+    m_inFile.seekg(m_offsetsStart, ios::beg);
+    m_inFile.read((char*) offsets.data(), sizeof(int64_t) * m_numBatches);
+    offsets[m_numBatches] = m_fileSize - m_dataStart;
+
+    m_maxMBSize = 0;
+    for (size_t c = 0; c < m_numBatches; c++)
+    {
+        m_maxMBSize = max(m_maxMBSize, (size_t)(offsets[c + 1] - offsets[c]));
+    }
 }
 
 template <class ElemType>
@@ -384,7 +438,7 @@ void SparseBinaryInput<ElemType>::ReadOffsets(size_t startMB, size_t numMBs)
     }
     else
     {
-        m_offsets[numMBs] = m_fileSize;
+        m_offsets[numMBs] = m_fileSize - m_dataStart; // offsets are relative to the data start
     }
     m_startMB = startMB;
     m_endMB = startMB + numMBs;
@@ -436,27 +490,28 @@ void SparseBinaryInput<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, s
 
     ReadOffsets(startMB, m_windowSize);
 
-    m_maxMBSize = 0;
-    for (size_t c = 0; c < m_windowSize; c++)
-    {
-        m_maxMBSize = max(m_maxMBSize, (size_t)(m_offsets[c + 1] - m_offsets[c]));
-        // fprintf(stderr, "m_offsets[%lu] = %lu\n", c, m_offsets[c]);
-    }
-    // fprintf(stderr, "max mb size: %ld\n", m_maxMBSize);
-    size_t maxMem = 1024 * 1024 * 1024; // 1GB
-    size_t maxPointers = maxMem / m_maxMBSize;
-    for (size_t c = 0; c < maxPointers; c++)
-    {
-        void* dataBuffer = malloc(m_maxMBSize);
-        m_dataToProduce.push(dataBuffer);
-    }
-
+    // the read buffers are allocated by FillMatrices(), once the device of the matrices is known; until then the reading thread waits
     std::thread readData([this]
                          {
                              this->ReadMinibatches(m_readOrder, m_readOrderLength);
                          });
     readData.detach();
 }
+// Adds read buffers up to 'numBuffers' in total. Two minibatches' worth are enough to keep the reading thread ahead:
+// one minibatch is being filled while the previous one may still be borrowed by the matrices.
+template <class ElemType>
+void SparseBinaryInput<ElemType>::AllocateDataBuffers(size_t numBuffers)
+{
+    const size_t maxMem = 1024 * 1024 * 1024; // 1GB
+    numBuffers = min(numBuffers, max(maxMem / max(m_maxMBSize, (size_t) 1), (size_t) 2));
+    while (m_dataBuffers.size() < numBuffers)
+    {
+        void* dataBuffer = m_deviceId >= 0 ? CUDAPageLockedMemAllocator::MallocFromPool(m_maxMBSize, m_deviceId) : malloc(m_maxMBSize);
+        m_dataBuffers.push_back(dataBuffer);
+        m_dataToProduce.push(dataBuffer);
+    }
+}
+
 template <class ElemType>
 void* SparseBinaryInput<ElemType>::GetTempDataPointer(size_t numBytes)
 {
@@ -476,6 +531,10 @@ template <class ElemType>
 shared_ptr<BinaryMatrix<ElemType>> SparseBinaryInput<ElemType>::CreateMatrix(std::wstring matName, int deviceId)
 {
     shared_ptr<BinaryMatrix<ElemType>> retVal; // = nullptr;
+    if (m_dataBuffers.empty())
+    {
+        m_deviceId = deviceId;
+    }
 
     // if (m_features.find(matName) != m_features.end()) {
     if (std::find(m_features.begin(), m_features.end(), matName) != m_features.end())
@@ -540,7 +599,7 @@ void SparseBinaryInput<ElemType>::ReadMinibatches(size_t* read_order, size_t num
 }
 
 template <class ElemType>
-size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices)
+size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices, bool borrow)
 {
 
     // fprintf(stderr, "start read minibatch.\n");
@@ -582,11 +641,18 @@ size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<st
         if (findMat != matrices.end())
         {
             auto mat = findMat->second;
-            mat->ResizeArrays(nnz);
-            mat->AddValues(vals, nnz);
-            mat->AddRowIndices(rowIndices, nnz);
-            mat->AddColIndices(colIndices, curMBSize + 1);
-            mat->UpdateNNz(nnz);
+            if (borrow)
+            {
+                mat->Borrow(vals, rowIndices, colIndices, nnz, curMBSize);
+            }
+            else
+            {
+                mat->ResizeArrays(nnz);
+                mat->AddValues(vals, nnz);
+                mat->AddRowIndices(rowIndices, nnz);
+                mat->AddColIndices(colIndices, curMBSize + 1);
+                mat->UpdateNNz(nnz);
+            }
 #ifdef DEBUG
             mat->Print("features");
 #endif
@@ -605,7 +671,14 @@ size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<st
         if (findMat != matrices.end())
         {
             auto mat = findMat->second;
-            mat->AddValues(vals, curMBSize);
+            if (borrow)
+            {
+                mat->Borrow(vals, nullptr, nullptr, 0, curMBSize);
+            }
+            else
+            {
+                mat->AddValues(vals, curMBSize);
+            }
 #ifdef DEBUG
             mat->Print("labels");
 #endif
@@ -619,6 +692,19 @@ size_t SparseBinaryInput<ElemType>::FillMatrices(std::map<std::wstring, shared_p
 {
 
     // fprintf(stderr, "start fill matrices\n");
+    // the caller has filled its matrices from the previous minibatch, so borrowed buffers can be read into again
+    for (void* dataBuffer : m_borrowedBuffers)
+    {
+        m_dataToProduce.push(dataBuffer);
+    }
+    m_borrowedBuffers.clear();
+
+    size_t microBatchesPerMB = max(m_mbSize / m_microBatchSize, (size_t) 1);
+    if (m_dataBuffers.size() < 2 * microBatchesPerMB + 2)
+    {
+        AllocateDataBuffers(2 * microBatchesPerMB + 2);
+    }
+
     size_t curSize = 0;
     for (auto mat : matrices)
     {
@@ -637,10 +723,19 @@ size_t SparseBinaryInput<ElemType>::FillMatrices(std::map<std::wstring, shared_p
         // fprintf(stderr, "start read mb\tIt took me %d clicks (%f seconds).\n", start_w, ((float)start_w) / CLOCKS_PER_SEC);
         // start_w = in_w;
         // fprintf(stderr, "start read mb\n");
-        curSize += ReadMinibatch(data_buffer, matrices);
+        // a minibatch of a single microbatch is handed out in place
+        bool borrow = curSize == 0 && (2 * (size_t) m_microBatchSize > m_mbSize || m_nextMB + 1 >= m_epochSize);
+        curSize += ReadMinibatch(data_buffer, matrices, borrow);
         // fprintf(stderr, "end read mb\n");
         m_nextMB++;
-        m_dataToProduce.push(data_buffer);
+        if (borrow)
+        {
+            m_borrowedBuffers.push_back(data_buffer);
+        }
+        else
+        {
+            m_dataToProduce.push(data_buffer);
+        }
     }
     // fprintf(stderr, "end fill matrices\n");
     return curSize;
@@ -75,6 +75,9 @@ public:
     }
     virtual void ResizeArrays(size_t) = 0;
     virtual void SetMaxRows(size_t maxRows) = 0;
+    // Points the matrix at the arrays of a single microbatch in a read buffer instead of copying them.
+    // The buffer must stay valid until Fill(); Clear() switches back to the matrix's own arrays.
+    virtual void Borrow(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows) = 0;
 
 protected:
     wstring m_matrixName;
@@ -113,8 +116,10 @@ public:
         NOT_IMPLEMENTED
     }
     virtual void SetMaxRows(size_t maxRows) override;
+    virtual void Borrow(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows) override;
 
 protected:
+    ElemType* m_borrowedValues; // if not null, the values of the current minibatch (in a read buffer)
 };
 
 template <class ElemType>
@@ -137,12 +142,18 @@ public:
     }
     virtual void ResizeArrays(size_t newMaxNNz) override;
     virtual void SetMaxRows(size_t maxRows) override;
+    virtual void Borrow(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows) override;
 
 protected:
     int32_t* m_rowIndices;
     int32_t* m_colIndices;
     size_t m_nnz;
     size_t m_maxNNz;
+
+    // if not null, the CSC arrays of the current minibatch (in a read buffer)
+    ElemType* m_borrowedValues;
+    int32_t* m_borrowedRowIndices;
+    int32_t* m_borrowedColIndices;
 };
 
 template <class ElemType>
@@ -154,7 +165,7 @@ public:
     void Init(std::map<std::wstring, std::wstring> rename);
     void StartDistributedMinibatchLoop(size_t mbSize, size_t subsetNum, size_t numSubsets);
     void ReadMinibatches(size_t* read_order, size_t numToRead);
-    size_t ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices);
+    size_t ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices, bool borrow);
     // void GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices);
     size_t FillMatrices(std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices);
     size_t GetMBSize()
@@ -172,6 +183,8 @@ public:
 
 private:
     void ReadOffsets(size_t startMB, size_t numMBs);
+    void ComputeMaxMBSize();
+    void AllocateDataBuffers(size_t numBuffers);
     void FillReadOrder(size_t windowSize);
     void* GetTempDataPointer(size_t numVals);
     bool Randomize();
@@ -224,6 +237,14 @@ private:
 #endif
     BlockingQueue<void*> m_dataToProduce;
     BlockingQueue<void*> m_dataToConsume;
+
+    // Read buffers of m_maxMBSize bytes each, circulating between m_dataToProduce and m_dataToConsume.
+    // They are page-locked if the matrices are on a GPU, so that borrowed arrays (BinaryMatrix::Borrow()) are
+    // transferred without a staging copy. Buffers whose arrays are borrowed by the matrices are kept in
+    // m_borrowedBuffers until the next FillMatrices(), by which time the reader has filled the caller's matrices from them.
+    int m_deviceId; // device of the matrices (from CreateMatrix())
+    std::vector<void*> m_dataBuffers;
+    std::vector<void*> m_borrowedBuffers;
 };
 
 template <class ElemType>
@@ -0,0 +1,168 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <string.h>
+#include <map>
+
+#include "Transformer.h"
+#include "ElementTypeUtils.h"
+#include "StageTimer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The samples of one dense stream of all sequences of a minibatch, in one contiguous array.
+// Sample s is m_data[s * m_sampleSize ... (s + 1) * m_sampleSize - 1], and the samples of sequence i are
+// m_sequenceStarts[i] ... m_sequenceStarts[i + 1] - 1.
+struct DenseBatch
+{
+    ElementType m_elementType;
+    size_t m_sampleSize;              // in elements
+    size_t m_numberOfSamples;         // over all sequences
+    size_t m_numberOfSequences;
+    void* m_data;                     // m_numberOfSamples x m_sampleSize elements
+    const size_t* m_sequenceStarts;   // m_numberOfSequences + 1 entries, the last being m_numberOfSamples
+
+    template <class ElemType>
+    ElemType* Data() const
+    {
+        return reinterpret_cast<ElemType*>(m_data);
+    }
+};
+
+// A transformer that works on whole minibatches rather than on single sequences (compare TransformerBase), so that it can
+// vectorize across the samples (e.g. subtracting a mean from all frames in one loop) and allocates once per minibatch instead
+// of once per sequence, which matters for small samples such as speech frames.
+// The sequences of each applied stream are gathered into one contiguous DenseBatch, which ApplyToBatch() transforms in place;
+// the output sequences then point into it. The batch buffers are reused for every minibatch, so the output is valid until the
+// next call, as for any transformer.
+// Batch and per-sequence transformers chain through the Transformer interface: the per-sequence work of the transformers below
+// a batch transformer (see GetNextSequencesDeferred()) is carried out in one parallel loop before the batch is formed.
+class BatchTransformerBase : public Transformer
+{
+public:
+    virtual void Initialize(TransformerPtr next, const ConfigParameters&) override
+    {
+        m_next = next;
+        m_inputStreams = m_next->GetStreamDescriptions();
+    }
+
+    virtual void StartEpoch(const EpochConfiguration& config) override
+    {
+        assert(m_next != nullptr);
+        m_next->StartEpoch(config);
+    }
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_inputStreams;
+    }
+
+    virtual Sequences GetNextSequences(size_t sampleCount) override
+    {
+        assert(m_next != nullptr);
+        Sequences sequences = m_next->GetNextSequences(sampleCount);
+        if (sequences.m_data.empty())
+            return sequences;
+
+        m_applyTimer.Time([&]()
+                          {
+                              for (auto id : GetAppliedStreamIds())
+                                  ApplyToStream(sequences, id);
+                          });
+        return sequences;
+    }
+
+    // Adds the time spent in gathering and ApplyToBatch() as stage "transform:<GetStageName()>".
+    virtual void GetStatistics(std::map<std::string, double>& stats) const override
+    {
+        m_applyTimer.AddTo(stats, "transform:" + GetStageName());
+        m_next->GetStatistics(stats);
+    }
+
+protected:
+    // Name of the transformation in the statistics.
+    virtual std::string GetStageName() const
+    {
+        return "batchTransform";
+    }
+
+    // The streams the transformation applies to; they must be dense.
+    virtual const std::vector<StreamId>& GetAppliedStreamIds() const = 0;
+
+    // Transforms the samples of a stream in place.
+    virtual void ApplyToBatch(DenseBatch& batch, const StreamDescription& stream) = 0;
+
+    const std::vector<StreamDescriptionPtr>& GetInputStreams() const
+    {
+        return m_inputStreams;
+    }
+
+private:
+    // the memory of a stream's batches, reused for every minibatch
+    struct BatchBuffer
+    {
+        std::vector<char> m_data;
+        std::vector<size_t> m_sequenceStarts;
+    };
+
+    void ApplyToStream(Sequences& sequences, StreamId id)
+    {
+        const auto& stream = *m_inputStreams[id];
+        if (stream.m_storageType != StorageType::dense)
+            RuntimeError("%s: Stream '%ls' must be dense.", GetStageName().c_str(), stream.m_name.c_str());
+
+        const size_t numberOfSequences = sequences.m_data.size();
+        const size_t elementSize = GetSizeByType(stream.m_elementType);
+        const size_t sampleSize = stream.m_sampleLayout->GetNumElements();
+        const size_t sampleBytes = sampleSize * elementSize;
+
+        auto& buffer = m_buffers[id];
+        buffer.m_sequenceStarts.resize(numberOfSequences + 1);
+        size_t numberOfSamples = 0;
+        for (size_t i = 0; i < numberOfSequences; i++)
+        {
+            buffer.m_sequenceStarts[i] = numberOfSamples;
+            numberOfSamples += static_cast<const DenseSequenceData&>(*sequences.m_data[i][id]).m_numberOfSamples;
+        }
+        buffer.m_sequenceStarts[numberOfSequences] = numberOfSamples;
+        if (buffer.m_data.size() < numberOfSamples * sampleBytes)
+            buffer.m_data.resize(numberOfSamples * sampleBytes);
+
+        for (size_t i = 0; i < numberOfSequences; i++)
+        {
+            const auto& input = static_cast<const DenseSequenceData&>(*sequences.m_data[i][id]);
+            memcpy(buffer.m_data.data() + buffer.m_sequenceStarts[i] * sampleBytes, input.m_data, input.m_numberOfSamples * sampleBytes);
+        }
+
+        DenseBatch batch;
+        batch.m_elementType = stream.m_elementType;
+        batch.m_sampleSize = sampleSize;
+        batch.m_numberOfSamples = numberOfSamples;
+        batch.m_numberOfSequences = numberOfSequences;
+        batch.m_data = buffer.m_data.data();
+        batch.m_sequenceStarts = buffer.m_sequenceStarts.data();
+        ApplyToBatch(batch, stream);
+
+        // one allocation for the output sequences of the whole batch; each is a pointer into it that shares its ownership
+        auto outputs = std::make_shared<std::vector<DenseSequenceData>>(numberOfSequences);
+        for (size_t i = 0; i < numberOfSequences; i++)
+        {
+            auto& output = (*outputs)[i];
+            const auto& input = static_cast<const DenseSequenceData&>(*sequences.m_data[i][id]);
+            output.m_data = buffer.m_data.data() + buffer.m_sequenceStarts[i] * sampleBytes;
+            output.m_numberOfSamples = input.m_numberOfSamples;
+            output.m_sampleLayout = input.m_sampleLayout;
+            sequences.m_data[i][id] = SequenceDataPtr(outputs, &output);
+        }
+    }
+
+    TransformerPtr m_next;
+    std::vector<StreamDescriptionPtr> m_inputStreams;
+    std::map<StreamId, BatchBuffer> m_buffers;
+    StageTimer m_applyTimer;
+};
+} } }
@@ -12,6 +12,7 @@
 
 #include "DataReader.h"
 #include <random>
+#include <map>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -23,6 +24,15 @@ static inline size_t rand(const size_t begin, const size_t end)
     return begin + randomNumber % (end - begin);
 }
 
+// the finalizer of splitmix64, a 64-bit mixing function
+static inline uint64_t Mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
 bool BlockRandomizer::TimelineIsValidForRandomization(const SequenceDescriptions& timeline) const
 {
     SequenceDescription previous = { SIZE_MAX, 0, 0, true };
@@ -76,6 +86,13 @@ void BlockRandomizer::RandomizeChunks()
     // Add sentinel
     m_randomizedChunks.push_back(RandomizedChunk { sequencePosition, samplePosition, SIZE_MAX });
 
+    m_originalToRandomizedChunk.resize(m_numChunks);
+    for (chunkId = 0; chunkId < m_numChunks; chunkId++)
+    {
+        m_originalToRandomizedChunk[m_randomizedChunks[chunkId].m_originalChunkIndex] = chunkId;
+    }
+    m_prefetchPosition = 0;
+
     // For each chunk, compute the randomization range (w.r.t. the randomized chunk sequence)
     size_t halfWindowRange = m_randomizationRangeInSamples / 2;
     for (size_t chunkId = 0; chunkId < m_numChunks; chunkId++)
@@ -116,6 +133,36 @@ void BlockRandomizer::RandomizeChunks()
     assert(m_sequencePositionToChunkIndex.size() == m_numSequences);
 }
 
+// Rendezvous hashing: a shard belongs to the worker with the highest hash of (shard, worker). All workers compute the
+// same assignment from the shared chunk descriptions, and if the number of workers changes, only the shards of the
+// added or removed workers move.
+void BlockRandomizer::AssignChunksToWorkers()
+{
+    m_isLocalChunk.assign(m_numChunks, false);
+    size_t numLocalChunks = 0;
+    for (size_t chunk = 0; chunk < m_numChunks; chunk++)
+    {
+        const uint64_t shardHash = Mix(m_deserializer->GetChunkShard(chunk));
+        size_t owner = 0;
+        uint64_t maxWeight = 0;
+        for (size_t worker = 0; worker < m_numberOfWorkers; worker++)
+        {
+            const uint64_t weight = Mix(shardHash ^ Mix(worker));
+            if (worker == 0 || weight > maxWeight)
+            {
+                maxWeight = weight;
+                owner = worker;
+            }
+        }
+        m_isLocalChunk[chunk] = owner == m_workerRank;
+        numLocalChunks += owner == m_workerRank ? 1 : 0;
+    }
+
+    if (m_verbosity > 0)
+        std::cerr << __FUNCTION__ << ": worker " << m_workerRank << " of " << m_numberOfWorkers
+                  << " reads " << numLocalChunks << " of " << m_numChunks << " chunks" << endl;
+}
+
 bool BlockRandomizer::IsValidForPosition(size_t targetPosition, const SequenceDescription& seqDesc) const
 {
     const auto& chunk = m_randomizedChunks[m_sequencePositionToChunkIndex[targetPosition]];
@@ -221,7 +268,20 @@ void BlockRandomizer::RandomizeForGlobalSamplePosition(const size_t samplePositi
         m_sweepStartInSamples = sweep * m_numSamples;
         Randomize();
     }
-    m_sequencePositionInSweep = samplePosition % m_numSamples; // TODO only for m_frameMode
+    const size_t sampleOffsetInSweep = samplePosition % m_numSamples;
+    if (m_frameMode)
+    {
+        m_sequencePositionInSweep = sampleOffsetInSweep;
+        return;
+    }
+
+    // first sequence that does not start before the offset
+    size_t position = 0;
+    for (size_t samples = 0; position < m_randomTimeline.size() && samples < sampleOffsetInSweep; position++)
+    {
+        samples += m_randomTimeline[position].m_numberOfSamples;
+    }
+    m_sequencePositionInSweep = position;
 };
 
 //
@@ -233,10 +293,14 @@ BlockRandomizer::BlockRandomizer(int verbosity, size_t randomizationRangeInSampl
       m_randomizationRangeInSamples(randomizationRangeInSamples),
       m_distributionMode(DistributionMode::sequences_strides),
       m_deserializer(deserializer),
+      m_workerRank(0),
+      m_numberOfWorkers(1),
       m_sweep(SIZE_MAX),
       m_sequencePositionInSweep(SIZE_MAX),
       m_samplePositionInEpoch(SIZE_MAX),
-      m_epochSize(SIZE_MAX)
+      m_epochSize(SIZE_MAX),
+      m_chunkPrefetchDepth(0),
+      m_prefetchPosition(0)
 {
     assert(deserializer != nullptr);
     const SequenceDescriptions& timeline = m_deserializer->GetSequenceDescriptions();
@@ -287,13 +351,40 @@ void BlockRandomizer::Initialize(TransformerPtr next, const ConfigParameters& re
 {
     // Not used for the block randomizer.
     UNUSED(next);
-    UNUSED(readerConfig);
+
+    std::string distributionMode = readerConfig(L"distributionMode", "sequences");
+    if (distributionMode == "chunks")
+        m_distributionMode = DistributionMode::chunks;
+    else if (distributionMode == "sequences")
+        m_distributionMode = DistributionMode::sequences_strides;
+    else
+        InvalidArgument("BlockRandomizer: distributionMode must be 'sequences' or 'chunks', not '%s'.", distributionMode.c_str());
+
+    m_chunkPrefetchDepth = readerConfig(L"chunkPrefetchDepth", "2");
+    size_t cacheSizeInMB = readerConfig(L"chunkCacheSizeInMB", "1024");
+    if (cacheSizeInMB == 0 || m_numChunks == 0)
+    {
+        m_chunkCache.reset(); // chunks are requested from the deserializer whenever a sequence is needed
+        return;
+    }
+
+    std::vector<size_t> samplesPerChunk(m_numChunks);
+    for (size_t i = 0; i < m_numChunks; i++)
+    {
+        samplesPerChunk[i] = m_chunkInformation[i + 1].m_samplePositionStart - m_chunkInformation[i].m_samplePositionStart;
+    }
+    auto chunkSizesInBytes = ChunkCache::EstimateChunkSizes(m_deserializer->GetStreamDescriptions(), samplesPerChunk);
+    m_chunkCache = std::make_shared<ChunkCache>(m_deserializer, std::move(chunkSizesInBytes), cacheSizeInMB * 1024 * 1024);
+    m_chunkSweep.assign(m_numChunks, SIZE_MAX);
 }
 
 void BlockRandomizer::StartEpoch(const EpochConfiguration& config)
 {
+    const bool workersChanged = m_workerRank != config.m_workerRank || m_numberOfWorkers != config.m_numberOfWorkers;
     m_workerRank = config.m_workerRank;
     m_numberOfWorkers = config.m_numberOfWorkers;
+    if (m_distributionMode == DistributionMode::chunks && (workersChanged || m_isLocalChunk.empty()))
+        AssignChunksToWorkers();
 
     // eldak: check partial minibatches.
     if (config.m_totalEpochSizeInSamples == requestDataSize)
@@ -308,38 +399,56 @@ void BlockRandomizer::StartEpoch(const EpochConfiguration& config)
     // TODO add some asserts on EpochConfiguration
     m_samplePositionInEpoch = 0;
     size_t timeframe = m_epochSize * config.m_epochIndex;
-    assert(m_frameMode); // TODO !m_frameMode needs fixes
     assert(timeframe != SIZE_MAX); // used as special value for init
     RandomizeForGlobalSamplePosition(timeframe);
 };
 
 bool BlockRandomizer::GetNextSequenceDescriptions(size_t sampleCount, SequenceDescriptions& sequenceDescriptions)
 {
-    assert(m_frameMode); // TODO !m_frameMode not implemented yet
     assert(sequenceDescriptions.size() == 0);
-    assert(sampleCount <= m_numSamples);
+    assert(!m_frameMode || sampleCount <= m_numSamples); // (the sequence packer asks for several minibatches at once)
 
     if (m_samplePositionInEpoch < m_epochSize)
     {
-        if (m_distributionMode == DistributionMode::chunk_modulus)
+        if (m_distributionMode == DistributionMode::chunks)
         {
-            assert(m_numberOfWorkers == 1); // TODO needs implementation
-
-            while (m_samplePositionInEpoch < m_epochSize &&
-                   sequenceDescriptions.size() < sampleCount)
+            // All workers walk the same timeline in step, through the sequences that start within the next 'sampleCount'
+            // samples (at least one); each worker takes those of its own chunks.
+            const size_t endPosition = std::min(m_epochSize, m_samplePositionInEpoch + sampleCount);
+            do
             {
                 RandomizeIfNewSweepIsEntered();
+                const auto& seqDesc = m_randomTimeline[m_sequencePositionInSweep];
+                if (m_isLocalChunk[m_randomizedChunks[seqDesc.m_chunkId].m_originalChunkIndex]) // (m_chunkId is randomized here)
+                {
+                    sequenceDescriptions.push_back(m_deserializer->GetSequenceDescriptions()[seqDesc.m_id]);
+                }
 
+                m_samplePositionInEpoch += seqDesc.m_numberOfSamples;
+                m_sequencePositionInSweep++;
+            } while (m_samplePositionInEpoch < endPosition);
+        }
+        else if (!m_frameMode)
+        {
+            assert(m_distributionMode == DistributionMode::sequences_strides);
+
+            // Sequences are not split, so this takes the sequences that start within the next 'sampleCount' samples
+            // (at least one), and deals them out to the workers in turn.
+            const size_t endPosition = std::min(m_epochSize, m_samplePositionInEpoch + sampleCount);
+            size_t i = 0;
+            do
+            {
+                RandomizeIfNewSweepIsEntered();
                 const auto& seqDesc = m_randomTimeline[m_sequencePositionInSweep];
-                if ((seqDesc.m_chunkId % m_numberOfWorkers) == m_workerRank)
+                if (i % m_numberOfWorkers == m_workerRank)
                 {
-                    // Got one, collect it
                     sequenceDescriptions.push_back(m_deserializer->GetSequenceDescriptions()[seqDesc.m_id]);
                 }
 
                 m_samplePositionInEpoch += seqDesc.m_numberOfSamples;
                 m_sequencePositionInSweep++;
-            }
+                i++;
+            } while (m_samplePositionInEpoch < endPosition);
         }
         else
         {
@@ -366,38 +475,124 @@ bool BlockRandomizer::GetNextSequenceDescriptions(size_t sampleCount, SequenceDe
     return m_epochSize <= m_samplePositionInEpoch;
 }
 
+void BlockRandomizer::RequireWindow(size_t chunk)
+{
+    const auto& randomizedChunk = m_randomizedChunks[chunk];
+    for (size_t k = randomizedChunk.m_windowBegin; k < randomizedChunk.m_windowEnd; k++)
+    {
+        const size_t originalChunkIndex = m_randomizedChunks[k].m_originalChunkIndex;
+        if (m_distributionMode == DistributionMode::chunks && !m_isLocalChunk[originalChunkIndex])
+            continue;
+        m_chunkCache->Require(originalChunkIndex);
+        m_chunkSweep[originalChunkIndex] = m_sweep;
+    }
+}
+
+void BlockRandomizer::ReleaseChunks(size_t firstChunk)
+{
+    assert(m_chunkCache);
+
+    // Windows only move forward within a sweep, so once a chunk is before the window of the first sequence of the minibatch,
+    // no later sequence of the sweep can take from it. This also releases the chunks of the previous sweep that are not
+    // in the new window. (The sequences of the previous minibatch have been materialized by now.)
+    RequireWindow(firstChunk);
+    const size_t windowBegin = m_randomizedChunks[firstChunk].m_windowBegin;
+    m_chunkCache->Evict([this, windowBegin](size_t originalChunkIndex)
+                        {
+                            return m_chunkSweep[originalChunkIndex] == m_sweep &&
+                                   m_originalToRandomizedChunk[originalChunkIndex] >= windowBegin;
+                        });
+}
+
+void BlockRandomizer::PrefetchChunks(size_t lastChunk)
+{
+    assert(m_chunkCache);
+
+    // The window of the last sequence is live up to its end; the next chunks in randomized order (only this worker's, if chunks
+    // are distributed) are loaded ahead as far as the budget allows.
+    RequireWindow(lastChunk);
+    const size_t windowEnd = m_randomizedChunks[lastChunk].m_windowEnd;
+    const size_t end = std::min(m_numChunks, windowEnd + m_chunkPrefetchDepth);
+    m_prefetchPosition = std::max(m_prefetchPosition, windowEnd);
+    for (; m_prefetchPosition < end; m_prefetchPosition++)
+    {
+        const size_t originalChunkIndex = m_randomizedChunks[m_prefetchPosition].m_originalChunkIndex;
+        if (m_distributionMode == DistributionMode::chunks && !m_isLocalChunk[originalChunkIndex])
+            continue;
+        if (!m_chunkCache->Prefetch(originalChunkIndex))
+            break;
+        m_chunkSweep[originalChunkIndex] = m_sweep;
+    }
+}
+
 Sequences BlockRandomizer::GetNextSequences(size_t sampleCount)
 {
-    assert(m_samplePositionInEpoch != SIZE_MAX); // SetEpochConfiguration() must be called first
+    return MaterializeSequences(GetNextSequencesDeferred(sampleCount));
+}
 
-    Sequences result;
-    assert(m_frameMode); // TODO sequence mode not implemented yet
+DeferredSequences BlockRandomizer::GetNextSequencesDeferred(size_t sampleCount)
+{
+    assert(m_samplePositionInEpoch != SIZE_MAX); // SetEpochConfiguration() must be called first
 
-    SequenceDescriptions sequenceDescriptions;
-    result.m_endOfEpoch = GetNextSequenceDescriptions(sampleCount, sequenceDescriptions);
+    DeferredSequences result;
 
-    if (sequenceDescriptions.size() == 0)
+    // The chunk cache keeps the chunks (of this worker) from the window of the first sequence of the minibatch to the window of
+    // the last one.
+    const bool hasSequences = m_samplePositionInEpoch < m_epochSize;
+    if (m_chunkCache && hasSequences)
     {
-        return result;
+        RandomizeIfNewSweepIsEntered();
+        ReleaseChunks(m_sequencePositionToChunkIndex[m_sequencePositionInSweep]);
     }
 
-    // TODO implement require and release chunks from the data deserializer, but only for this worker
-    //      (probably in GetNextSequenceIds())
+    auto sequenceDescriptions = std::make_shared<SequenceDescriptions>();
+    result.m_endOfEpoch = GetNextSequenceDescriptions(sampleCount, *sequenceDescriptions);
+    result.m_numberOfSequences = sequenceDescriptions->size();
 
-    // TODO: Currenlty simply releasing the chunk. Should preserve them for complete window and release only when they are not needed.
-    // For current implementation of image reader it does no matter because chunk = image.
-    // We have to reassamble the exposed result from sequences drawn from diffrent chunks.
-    result.m_data.resize(sequenceDescriptions.size());
+    if (m_chunkCache && hasSequences)
+    {
+        assert(m_sequencePositionInSweep > 0);
+        PrefetchChunks(m_sequencePositionToChunkIndex[m_sequencePositionInSweep - 1]);
+    }
 
-    // TODO: Should prefetching be done on a single thread?
-#pragma omp parallel for ordered schedule(dynamic)
-    for (int i = 0; i < sequenceDescriptions.size(); ++i)
+    // We have to reassamble the exposed result from sequences drawn from diffrent chunks.
+    // Note: This gets called concurrently for different sequences, see MaterializeSequences().
+    if (m_chunkCache)
     {
-        ChunkPtr chunk = m_deserializer->GetChunk(sequenceDescriptions[i]->m_chunkId);
-        result.m_data[i] = chunk->GetSequence(sequenceDescriptions[i]->m_id);
+        std::shared_ptr<ChunkCache> cache = m_chunkCache;
+        StageTimer* timer = &m_deserializeTimer;
+        result.m_fill = [cache, sequenceDescriptions, timer](size_t sequenceIndex, std::vector<SequenceDataPtr>& sequence)
+        {
+            const auto& description = *(*sequenceDescriptions)[sequenceIndex];
+            timer->Time([&]() { sequence = cache->Get(description.m_chunkId)->GetSequence(description.m_id); });
+        };
+        return result;
     }
 
+    IDataDeserializerPtr deserializer = m_deserializer;
+    StageTimer* timer = &m_deserializeTimer;
+    result.m_fill = [deserializer, sequenceDescriptions, timer](size_t sequenceIndex, std::vector<SequenceDataPtr>& sequence)
+    {
+        const auto& description = *(*sequenceDescriptions)[sequenceIndex];
+        timer->Time([&]()
+                    {
+                        ChunkPtr chunk = deserializer->GetChunk(description.m_chunkId);
+                        sequence = chunk->GetSequence(description.m_id);
+                    });
+    };
+
     return result;
-};
+}
+
+void BlockRandomizer::GetStatistics(std::map<std::string, double>& stats) const
+{
+    m_deserializeTimer.AddTo(stats, "deserialize");
+    stats["randomizer:timelineBytes"] += (double) (m_randomTimeline.capacity() * sizeof(SequenceDescription) +
+                                                   m_sequencePositionToChunkIndex.capacity() * sizeof(size_t) +
+                                                   m_randomizedChunks.capacity() * sizeof(RandomizedChunk) +
+                                                   m_originalToRandomizedChunk.capacity() * sizeof(size_t));
+    if (m_chunkCache)
+        m_chunkCache->GetStatistics(stats, "randomizer");
+}
 
 } } }
@@ -6,16 +6,30 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 
 #include "Transformer.h"
 #include "DataDeserializer.h"
+#include "StageTimer.h"
+#include "ChunkCache.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // The class represents a randomizer that does randomization based on chunks/sequences inside a set of chunk.
 // TODO: currently this code moved from the old block randomizer.
 // The class will be further refactored and common based will be extracted with NoRandomizer.
-// Currently works only for frame mode (numberOfSample in sequence == 1)
+// Works in frame mode (numberOfSample in sequence == 1) and in sequence mode, where sequences are never split:
+// each minibatch gets the sequences that start within its sample range.
+// Since the randomized chunk order is known upfront, chunks are requested from the deserializer on a background thread
+// before their sequences are needed (see ChunkCache): the chunks of the current randomization window are held for as long as
+// the window covers them, so that each chunk is deserialized once per sweep, and are released as soon as it has moved past
+// them. The next 'chunkPrefetchDepth' chunks are loaded ahead as long as the (estimated) size of the chunks held stays within
+// 'chunkCacheSizeInMB' (0 disables the cache: chunks are then requested whenever a sequence is needed).
+// With several workers, the data is distributed according to 'distributionMode':
+// - "sequences" (default): the sequences of each minibatch are dealt out to the workers in turn, so every worker reads every chunk.
+// - "chunks": every chunk belongs to one worker, by a consistent hash of its shard (IDataDeserializer::GetChunkShard()) over
+//   the workers, and each worker takes the sequences of its own chunks from each minibatch. All workers compute the same
+//   randomization from the shared sequence descriptions, but each one loads only its own chunks, i.e. about 1/N of the data.
 class BlockRandomizer : public Transformer
 {
 public:
@@ -27,16 +41,20 @@ public:
     virtual void Initialize(TransformerPtr next, const ConfigParameters& readerConfig) override;
     virtual void StartEpoch(const EpochConfiguration& config) override;
     virtual Sequences GetNextSequences(size_t sampleCount) override;
+    virtual DeferredSequences GetNextSequencesDeferred(size_t sampleCount) override;
     virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
     {
         return m_deserializer->GetStreamDescriptions();
     }
 
+    // Stage "deserialize" (getting each sequence from its chunk, i.e. reading and decoding), "chunkLoad", and the memory
+    // of the randomized timeline and of the chunk cache.
+    virtual void GetStatistics(std::map<std::string, double>& stats) const override;
+
 private:
     enum class DistributionMode {
-        // TODO better names, description
-        chunk_modulus,
-        sequences_strides
+        chunks,           // every chunk is read by one worker only
+        sequences_strides // the sequences of every minibatch are dealt out to all workers
     };
 
     // Structure for per-chunk information
@@ -70,6 +88,7 @@ private:
     size_t m_numSamples;
     bool m_frameMode;                                 // true iff only single-sample sequences
     std::vector<ChunkInformation> m_chunkInformation; // (includes a sentinel)
+    std::vector<bool> m_isLocalChunk;                 // [original chunk index] chunk belongs to this worker (DistributionMode::chunks)
 
     // Per-epoch configuration
     size_t m_workerRank;
@@ -84,6 +103,15 @@ private:
     std::vector<RandomizedChunk> m_randomizedChunks;    // (includes a sentinel)
     std::vector<size_t> m_sequencePositionToChunkIndex; // TODO find on m_randomizedChunks instead?
     std::vector<SequenceDescription> m_randomTimeline;
+    std::vector<size_t> m_originalToRandomizedChunk;    // [original chunk index] -> randomized chunk index
+
+    // Chunk prefetching
+    std::shared_ptr<ChunkCache> m_chunkCache;           // (null if disabled)
+    size_t m_chunkPrefetchDepth;                        // number of chunks to load beyond the current window
+    size_t m_prefetchPosition;                          // randomized chunk index up to which chunks were requested in this sweep
+    std::vector<size_t> m_chunkSweep;                   // [original chunk index] the sweep in which the chunk was last requested
+
+    StageTimer m_deserializeTimer;
 
     // Check that timeline has only valid sequences of non-zero length
     // with incrementing IDs and non-decreasing chunk identifiers.
@@ -91,6 +119,9 @@ private:
 
     void RandomizeChunks();
 
+    // Assigns the chunks to the workers for DistributionMode::chunks (sets m_isLocalChunk).
+    void AssignChunksToWorkers();
+
     bool IsValidForPosition(size_t targetPosition, const SequenceDescription& seqDesc) const;
 
     void Randomize();
@@ -100,5 +131,14 @@ private:
     void RandomizeIfNewSweepIsEntered();
 
     bool GetNextSequenceDescriptions(size_t sampleCount, SequenceDescriptions& sequences);
+
+    // Requests the chunks of the window of the given randomized chunk from the chunk cache.
+    void RequireWindow(size_t chunk);
+
+    // Releases the chunks before the window of the first sequence of the minibatch.
+    void ReleaseChunks(size_t firstChunk);
+
+    // Requests the window of the last sequence of the minibatch, and the chunks after it that are about to be needed.
+    void PrefetchChunks(size_t lastChunk);
 };
 } } }
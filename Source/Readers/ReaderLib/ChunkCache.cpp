@@ -0,0 +1,173 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ChunkCache.h"
+#include <algorithm>
+#include <iostream>
+
+#include "ElementTypeUtils.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+ChunkCache::ChunkCache(IDataDeserializerPtr deserializer, std::vector<size_t>&& chunkSizesInBytes, size_t budgetInBytes)
+    : m_deserializer(deserializer), m_chunkSizesInBytes(std::move(chunkSizesInBytes)), m_budgetInBytes(budgetInBytes),
+      m_bytesInUse(0), m_peakBytesInUse(0), m_numberOfLoads(0), m_reportedOverBudget(false), m_stop(false)
+{
+    m_thread = std::thread([this]() { LoaderLoop(); });
+}
+
+ChunkCache::~ChunkCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    m_thread.join();
+}
+
+void ChunkCache::Require(size_t chunkId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_chunks.find(chunkId) != m_chunks.end())
+        return;
+    Reserve(chunkId);
+    if (m_bytesInUse > m_budgetInBytes && !m_reportedOverBudget)
+    {
+        m_reportedOverBudget = true;
+        std::cerr << "ChunkCache: the chunks of the randomization window take about " << m_bytesInUse / (1024 * 1024)
+                  << " MB, more than the cache size of " << m_budgetInBytes / (1024 * 1024) << " MB; nothing is loaded ahead of time." << std::endl;
+    }
+}
+
+bool ChunkCache::Prefetch(size_t chunkId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_chunks.find(chunkId) != m_chunks.end())
+        return true;
+    if (m_bytesInUse + m_chunkSizesInBytes[chunkId] > m_budgetInBytes)
+        return false;
+    Reserve(chunkId);
+    return true;
+}
+
+ChunkPtr ChunkCache::Get(size_t chunkId)
+{
+    std::shared_ptr<std::promise<ChunkPtr>> loadHere;
+    std::shared_future<ChunkPtr> chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_chunks.find(chunkId);
+        if (entry == m_chunks.end())
+        {
+            // not announced by the randomizer: hold it like a required chunk, rather than loading it for every sequence
+            Reserve(chunkId);
+            entry = m_chunks.find(chunkId);
+        }
+        if (entry->second.m_promise)
+            loadHere = std::move(entry->second.m_promise); // not picked up by the loader yet
+        chunk = entry->second.m_chunk;
+    }
+
+    if (loadHere)
+        Load(chunkId, *loadHere);
+    return chunk.get();
+}
+
+void ChunkCache::Evict(const std::function<bool(size_t)>& isNeeded)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto entry = m_chunks.begin(); entry != m_chunks.end();)
+    {
+        if (isNeeded(entry->first))
+        {
+            ++entry;
+            continue;
+        }
+        m_bytesInUse -= m_chunkSizesInBytes[entry->first];
+        entry = m_chunks.erase(entry); // (a chunk still being loaded stays alive through its promise)
+    }
+}
+
+void ChunkCache::GetStatistics(std::map<std::string, double>& stats, const std::string& prefix) const
+{
+    m_loadTimer.AddTo(stats, "chunkLoad");
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats[prefix + ":chunkCacheBytes"] += (double) m_bytesInUse; // (as estimated from the sequence sizes)
+    stats[prefix + ":chunkCachePeakBytes"] += (double) m_peakBytesInUse;
+    stats[prefix + ":chunkCacheBudgetBytes"] += (double) m_budgetInBytes;
+    stats[prefix + ":chunkCacheChunks"] += (double) m_chunks.size();
+    stats[prefix + ":chunkLoads"] += (double) m_numberOfLoads;
+}
+
+std::vector<size_t> ChunkCache::EstimateChunkSizes(const std::vector<StreamDescriptionPtr>& streams, const std::vector<size_t>& samplesPerChunk)
+{
+    size_t bytesPerSample = 0;
+    for (const auto& stream : streams)
+    {
+        if (stream->m_sampleLayout)
+            bytesPerSample += stream->m_sampleLayout->GetNumElements() * GetSizeByType(stream->m_elementType);
+    }
+    bytesPerSample = std::max(bytesPerSample, (size_t) 1);
+
+    std::vector<size_t> chunkSizesInBytes(samplesPerChunk.size());
+    for (size_t i = 0; i < samplesPerChunk.size(); i++)
+        chunkSizesInBytes[i] = samplesPerChunk[i] * bytesPerSample;
+    return chunkSizesInBytes;
+}
+
+void ChunkCache::Reserve(size_t chunkId)
+{
+    auto& entry = m_chunks[chunkId];
+    entry.m_promise = std::make_shared<std::promise<ChunkPtr>>();
+    entry.m_chunk = entry.m_promise->get_future().share();
+    m_bytesInUse += m_chunkSizesInBytes[chunkId];
+    m_peakBytesInUse = std::max(m_peakBytesInUse, m_bytesInUse);
+    m_queue.push_back(chunkId);
+    m_wakeUp.notify_one();
+}
+
+void ChunkCache::Load(size_t chunkId, std::promise<ChunkPtr>& promise)
+{
+    try
+    {
+        ChunkPtr chunk;
+        m_loadTimer.Time([&]() { chunk = m_deserializer->GetChunk(chunkId); });
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_numberOfLoads++;
+        }
+        promise.set_value(chunk);
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception()); // rethrown to the consumer by Get()
+    }
+}
+
+void ChunkCache::LoaderLoop()
+{
+    for (;;)
+    {
+        size_t chunkId;
+        std::shared_ptr<std::promise<ChunkPtr>> promise;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                return;
+            chunkId = m_queue.front();
+            m_queue.pop_front();
+            auto entry = m_chunks.find(chunkId);
+            if (entry == m_chunks.end() || !entry->second.m_promise)
+                continue; // evicted, or already loaded by Get()
+            promise = std::move(entry->second.m_promise);
+        }
+        Load(chunkId, *promise);
+    }
+}
+} } }
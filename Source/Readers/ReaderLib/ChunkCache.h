@@ -0,0 +1,89 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ChunkCache.h -- the chunks a randomizer holds on to, with chunk loading on a background thread
+//
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <deque>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "DataDeserializer.h"
+#include "StageTimer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Holds the chunks in use by a randomizer, and loads chunks ahead of time on a background thread.
+// A randomizer knows for each chunk the range of positions that can take sequences from it (the randomization window), and
+// tells the cache:
+// - Require(): the chunk is live, i.e. sequences will be taken from it. It is kept until Evict() drops it, whatever the budget,
+//   so that it is deserialized once for the whole range rather than again for every visit.
+// - Prefetch(): the chunk will be live soon. It is loaded only if it fits into the budget next to the chunks held already.
+// - Evict(): releases the chunks that are no longer live.
+// Get() is called concurrently for the sequences of a minibatch (see MaterializeSequences()): it waits for a chunk that is
+// being loaded, and loads a chunk inline if the background thread did not get to it yet.
+// The budget is checked against estimated chunk sizes (see EstimateChunkSizes()). The memory in use is bounded by the larger of
+// the budget and the chunks of the window; the latter exceeding the budget is reported once.
+class ChunkCache
+{
+public:
+    ChunkCache(IDataDeserializerPtr deserializer, std::vector<size_t>&& chunkSizesInBytes, size_t budgetInBytes);
+    ~ChunkCache();
+
+    // Queues the live chunk for loading, if it is not held yet.
+    void Require(size_t chunkId);
+
+    // Queues the chunk for loading if it fits into the budget. Returns false if it does not.
+    bool Prefetch(size_t chunkId);
+
+    // Returns the chunk, which must have been required (or fit into the budget).
+    ChunkPtr Get(size_t chunkId);
+
+    // Releases all chunks for which isNeeded() returns false.
+    void Evict(const std::function<bool(size_t)>& isNeeded);
+
+    // Stage "chunkLoad", and "<prefix>:chunkCache..." for the memory in use and the number of chunk loads.
+    void GetStatistics(std::map<std::string, double>& stats, const std::string& prefix) const;
+
+    // Estimated in-memory size of each chunk, from the number of samples in it and the sample layouts of the streams.
+    static std::vector<size_t> EstimateChunkSizes(const std::vector<StreamDescriptionPtr>& streams, const std::vector<size_t>& samplesPerChunk);
+
+private:
+    struct Entry
+    {
+        std::shared_future<ChunkPtr> m_chunk;
+        std::shared_ptr<std::promise<ChunkPtr>> m_promise; // set as long as nobody started to load the chunk
+    };
+
+    // Adds a not yet loaded entry for the chunk, and queues it for the loader. Must be called with the lock held.
+    void Reserve(size_t chunkId);
+
+    void Load(size_t chunkId, std::promise<ChunkPtr>& promise);
+
+    void LoaderLoop();
+
+    IDataDeserializerPtr m_deserializer;
+    const std::vector<size_t> m_chunkSizesInBytes; // [chunk id] estimated size
+    const size_t m_budgetInBytes;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::map<size_t, Entry> m_chunks; // [chunk id]
+    std::deque<size_t> m_queue;       // chunks to be loaded by the background thread, in the order they were asked for
+    size_t m_bytesInUse;
+    size_t m_peakBytesInUse;
+    size_t m_numberOfLoads;
+    bool m_reportedOverBudget;
+    StageTimer m_loadTimer;
+    bool m_stop;
+    std::thread m_thread;
+};
+} } }
@@ -7,27 +7,33 @@
 
 #include <memory>
 #include <CUDAPageLockedMemAllocator.h>
+#include "Basics.h"
 
 #include "MemoryProvider.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// Page-locked host memory, from which the GPU copies directly (asynchronously). The memory comes from the process-wide pool
+// of CUDAPageLockedMemAllocator, since cudaHostAlloc() is slow and cudaFreeHost() synchronizes the device.
 /// TODO: Memory provider should reside on the matrix. It is responsibility of the network
 /// to decide what memory to use per stream. This class will be moved in the near future.
 class CudaMemoryProvider : public MemoryProvider
 {
-    std::unique_ptr<CUDAPageLockedMemAllocator> m_allocator;
+    int m_deviceId;
 
 public:
     CudaMemoryProvider(int deviceId)
+        : m_deviceId(deviceId)
     {
-        m_allocator = std::make_unique<CUDAPageLockedMemAllocator>(deviceId);
     }
 
     virtual void* Alloc(size_t elementSize, size_t numberOfElements) override
     {
         size_t totalSize = elementSize * numberOfElements;
-        return m_allocator->Malloc(totalSize);
+        void* p = CUDAPageLockedMemAllocator::MallocFromPool(totalSize, m_deviceId);
+        if (!p && totalSize > 0)
+            RuntimeError("CudaMemoryProvider: Failed to allocate %d bytes of page-locked memory.", (int) totalSize);
+        return p;
     }
 
     virtual void Free(void* p) override
@@ -37,7 +43,7 @@ public:
             return;
         }
 
-        m_allocator->Free(reinterpret_cast<char*>(p));
+        CUDAPageLockedMemAllocator::FreeToPool(p);
     }
 };
 } } }
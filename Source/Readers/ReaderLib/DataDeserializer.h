@@ -7,6 +7,7 @@
 
 #include <vector>
 #include "Reader.h"
+#include "PackedImages.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -82,6 +83,27 @@ struct SparseSequenceData : SequenceDataBase
 };
 typedef std::shared_ptr<SparseSequenceData> SparseSequenceDataPtr;
 
+// How the images of a stream with storage type StorageType::packed_images are expanded (see PackedImages.h);
+// shared by all sequences of the stream.
+struct PackedImagesParameters
+{
+    size_t m_width;            // of the output images
+    size_t m_height;
+    size_t m_channels;
+    bool m_transpose;          // output CHW instead of HWC
+    std::vector<float> m_mean; // HWC; empty for none
+};
+
+// Image sequence for streams with storage type StorageType::packed_images.
+// The 'data' member holds the values of a single decoded image (8 bit, HWC, of any size with the channels of the output),
+// 'image' its size and what to cut out of it (m_offset is not used).
+struct PackedImageSequenceData : SequenceDataBase
+{
+    PackedImage m_image;
+    std::shared_ptr<const PackedImagesParameters> m_parameters;
+};
+typedef std::shared_ptr<PackedImageSequenceData> PackedImageSequenceDataPtr;
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // Interface all data deserializers should implement.
 // Data deserializers are intimately familiar with a particular input formats and responsible for bringing 
@@ -103,6 +125,14 @@ public:
     // Gets a chunk.
     virtual ChunkPtr GetChunk(size_t chunkId) = 0;
 
+    // Gets the shard a chunk is stored in, i.e. chunks that are stored together (in the same file, or on the same
+    // node of a cluster file system) have the same shard id. When chunks are distributed among workers
+    // (see BlockRandomizer), all chunks of a shard go to the same worker. By default every chunk is a shard of its own.
+    virtual size_t GetChunkShard(size_t chunkId) const
+    {
+        return chunkId;
+    }
+
     virtual ~IDataDeserializer() = default;
 };
 
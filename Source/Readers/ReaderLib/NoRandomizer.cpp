@@ -5,6 +5,7 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 #include <algorithm>
+#include <set>
 
 #include "NoRandomizer.h"
 #include "DataReader.h"
@@ -14,7 +15,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 NoRandomizer::NoRandomizer(IDataDeserializerPtr deserializer)
     : m_deserializer(deserializer),
       m_samplePositionInEpoch(0),
-      m_sequencePosition(0)
+      m_sequencePosition(0),
+      m_numChunks(0),
+      m_chunkPrefetchDepth(0)
 {
     assert(deserializer != nullptr);
 
@@ -29,8 +32,21 @@ NoRandomizer::NoRandomizer(IDataDeserializerPtr deserializer)
     }
 }
 
-void NoRandomizer::Initialize(TransformerPtr, const ConfigParameters&)
+void NoRandomizer::Initialize(TransformerPtr, const ConfigParameters& readerConfig)
 {
+    m_chunkPrefetchDepth = readerConfig(L"chunkPrefetchDepth", "2");
+    size_t cacheSizeInMB = readerConfig(L"chunkCacheSizeInMB", "1024");
+
+    std::vector<size_t> samplesPerChunk;
+    for (const auto& sequence : m_timeline)
+    {
+        if (sequence->m_chunkId >= samplesPerChunk.size())
+            samplesPerChunk.resize(sequence->m_chunkId + 1);
+        samplesPerChunk[sequence->m_chunkId] += sequence->m_numberOfSamples;
+    }
+    m_numChunks = samplesPerChunk.size();
+    auto chunkSizesInBytes = ChunkCache::EstimateChunkSizes(m_deserializer->GetStreamDescriptions(), samplesPerChunk);
+    m_chunkCache = std::make_shared<ChunkCache>(m_deserializer, std::move(chunkSizesInBytes), cacheSizeInMB * 1024 * 1024);
 }
 
 void NoRandomizer::StartEpoch(const EpochConfiguration& config)
@@ -49,7 +65,12 @@ void NoRandomizer::StartEpoch(const EpochConfiguration& config)
 
 Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
 {
-    Sequences result;
+    return MaterializeSequences(GetNextSequencesDeferred(sampleCount));
+}
+
+DeferredSequences NoRandomizer::GetNextSequencesDeferred(size_t sampleCount)
+{
+    DeferredSequences result;
     if(m_config.m_totalEpochSizeInSamples <= m_samplePositionInEpoch)
     {
         result.m_endOfEpoch = true;
@@ -62,7 +83,8 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
     size_t subsetSize = end - start;
 
     std::vector<size_t> chunkIds;
-    SequenceDescriptions sequences;
+    auto sequencesPtr = std::make_shared<SequenceDescriptions>();
+    auto& sequences = *sequencesPtr;
     sequences.reserve(subsetSize);
     size_t previousChunk = SIZE_MAX;
     for (size_t i = start; i < end; ++i)
@@ -86,32 +108,31 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
         return result;
     }
 
-    // TODO: Currently we preserve chunks not for the complete window, only for minibatch
-    // Should be changed
-    std::map<size_t, ChunkPtr> chunks;
+    // The timeline is walked in order, so the chunks that are live are the ones of this minibatch; the chunks of the previous
+    // one are released unless this one continues them (its sequences have been materialized by now).
+    assert(m_chunkCache); // Initialize() must be called first
     for (size_t id : chunkIds)
+        m_chunkCache->Require(id);
+    std::set<size_t> live(chunkIds.begin(), chunkIds.end());
+    for (size_t i = 1; i <= m_chunkPrefetchDepth && i < m_numChunks; i++)
+        live.insert((chunkIds.back() + i) % m_numChunks);
+    m_chunkCache->Evict([&live](size_t id) { return live.find(id) != live.end(); });
+    for (size_t i = 1; i <= m_chunkPrefetchDepth && i < m_numChunks; i++)
     {
-        auto chunk = m_chunks.find(id);
-        if (chunk == m_chunks.end())
-        {
-            chunks[id] = m_deserializer->GetChunk(id);
-        }
-        else
-        {
-            chunks[id] = chunk->second;
-        }
+        if (!m_chunkCache->Prefetch((chunkIds.back() + i) % m_numChunks))
+            break;
     }
 
-    m_chunks.swap(chunks);
-
     // TODO: Not clear whether batching will make sense for this.
     // We have to re-assemble the exposed result from sequences from different chunks.
-    result.m_data.resize(sequences.size());
-#pragma omp parallel for ordered schedule(dynamic)
-    for (int i = 0; i < sequences.size(); ++i)
+    // Note: This gets called concurrently for different sequences, see MaterializeSequences().
+    result.m_numberOfSequences = sequences.size();
+    std::shared_ptr<ChunkCache> cache = m_chunkCache;
+    result.m_fill = [this, cache, sequencesPtr](size_t sequenceIndex, std::vector<SequenceDataPtr>& sequence)
     {
-        result.m_data[i] = m_chunks[sequences[i]->m_chunkId]->GetSequence(sequences[i]->m_id);
-    }
+        const auto& description = *(*sequencesPtr)[sequenceIndex];
+        m_deserializeTimer.Time([&]() { sequence = cache->Get(description.m_chunkId)->GetSequence(description.m_id); });
+    };
     return result;
 }
 
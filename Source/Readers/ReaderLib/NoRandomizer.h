@@ -8,7 +8,9 @@
 #include <vector>
 #include <map>
 #include "Transformer.h"
+#include "StageTimer.h"
 #include "DataDeserializer.h"
+#include "ChunkCache.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -16,7 +18,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // This class is used for inference and for training where the training data has already been pre - randomized.
 // TODO: currently this code moved from the old block randomizer.
 // The class will be further refactored and common based will be extracted with BlockRandomizer.
-// Currently works only for frame mode (numberOfSample in sequence == 1) and without chunking
+// Currently works only for frame mode (numberOfSample in sequence == 1).
+// The chunks of the current minibatch are held in a ChunkCache until the timeline has moved past them, and the next
+// 'chunkPrefetchDepth' chunks are loaded ahead on a background thread within 'chunkCacheSizeInMB'.
 class NoRandomizer : public Transformer
 {
 public:
@@ -25,11 +29,21 @@ public:
     virtual void Initialize(TransformerPtr next, const ConfigParameters& readerConfig) override;
     virtual void StartEpoch(const EpochConfiguration& config) override;
     virtual Sequences GetNextSequences(size_t sampleCount) override;
+    virtual DeferredSequences GetNextSequencesDeferred(size_t sampleCount) override;
     virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
     {
         return m_deserializer->GetStreamDescriptions();
     }
 
+    // Stage "deserialize" (getting each sequence from its chunk, i.e. reading and decoding), and the memory of the timeline.
+    virtual void GetStatistics(std::map<std::string, double>& stats) const override
+    {
+        m_deserializeTimer.AddTo(stats, "deserialize");
+        stats["randomizer:timelineBytes"] += (double) (m_timeline.capacity() * sizeof(SequenceDescriptions::value_type));
+        if (m_chunkCache)
+            m_chunkCache->GetStatistics(stats, "randomizer");
+    }
+
 private:
     // Deserializer and information on the original timeline
     IDataDeserializerPtr m_deserializer;
@@ -42,7 +56,11 @@ private:
     size_t m_samplePositionInEpoch;
     size_t m_sequencePosition;
 
-    std::map<size_t, ChunkPtr> m_chunks;
+    std::shared_ptr<ChunkCache> m_chunkCache;
+    size_t m_numChunks;
+    size_t m_chunkPrefetchDepth; // number of chunks to load beyond the current minibatch
+
+    StageTimer m_deserializeTimer;
 };
 
 }}}
@@ -6,9 +6,12 @@
 #pragma once
 
 #include <vector>
+#include <map>
 #include <memory>
+#include <string>
 #include "Sequences.h"
 #include "TensorShape.h"
+#include "MemoryProvider.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -42,10 +45,14 @@ enum class StorageType
 {
     dense,
     sparse_csc,
+    packed_images, // decoded images to be cropped, scaled and normalized by the consumer, see PackedImages.h
 };
 
 typedef size_t StreamId;
 
+// Index type of the row indices and column offsets of sparse minibatch data, as expected by Matrix::SetMatrixFromCSCFormat().
+typedef int SparseIndexType;
+
 // This class describes a particular stream: its name, element type, storage, etc.
 struct StreamDescription
 {
@@ -60,12 +67,23 @@ typedef std::shared_ptr<StreamDescription> StreamDescriptionPtr;
 
 // Represent a minibatch date for a single stream formatted in according to the minibatch layout.
 // This data is returned per stream as a part of Minibatch from the ReadMinibatch function.
-// All raw non owned pointers are valid till the next call to the ReadMinibatch function.
+// All raw non owned pointers are valid till the next call to the ReadMinibatch function (or, after
+// Reader::SetMemoryProvider(), for as many calls as the reader keeps buffers for).
+// Streams with StorageType::sparse_csc are in compressed sparse column format: m_data holds the m_numberOfNonZeros values,
+// followed by their m_numberOfNonZeros row indices and then the (number of columns + 1) column start offsets,
+// both of SparseIndexType.
+// Streams with StorageType::packed_images hold a block of packed images as described in PackedImages.h, one image per column;
+// the sample layout of the stream is that of the images the block expands to.
 struct StreamMinibatch
 {
-    void* m_data;         // Contiguous array of data. Can be encoded in dense or sparse formats depending on the stream description.
-    size_t m_dataSize;    // Data size in bytes.
-    MBLayoutPtr m_layout; // Layout of the data
+    void* m_data;               // Contiguous array of data. Can be encoded in dense or sparse formats depending on the stream description.
+    size_t m_dataSize;          // Data size in bytes.
+    size_t m_numberOfNonZeros;  // Number of non zero values of sparse data.
+    MBLayoutPtr m_layout;       // Layout of the data
+
+    StreamMinibatch() : m_data(nullptr), m_dataSize(0), m_numberOfNonZeros(0)
+    {
+    }
 };
 typedef std::shared_ptr<StreamMinibatch> StreamMinibatchPtr;
 
@@ -101,6 +119,19 @@ public:
     // Reads a minibatch that contains data across all streams.
     virtual Minibatch ReadMinibatch() = 0;
 
+    // Lets the reader allocate the data it returns from the given provider from now on (e.g. from page-locked memory, from which
+    // the GPU copies directly), and keep the data of a minibatch valid for the next numberOfBuffers - 1 calls of ReadMinibatch().
+    // Returns false if the reader does not support it, in which case nothing changes.
+    virtual bool SetMemoryProvider(MemoryProviderPtr /*provider*/, size_t /*numberOfBuffers*/)
+    {
+        return false;
+    }
+
+    // Adds the counters of the pipeline, see IDataReader::GetStatistics().
+    virtual void GetStatistics(std::map<std::string, double>& /*stats*/) const
+    {
+    }
+
     virtual ~Reader() {};
 };
 
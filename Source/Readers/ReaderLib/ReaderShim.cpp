@@ -16,25 +16,45 @@
 #include "DataReader.h"
 //#include "commandArgUtil.h"
 #include "ReaderShim.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include "MatrixQuantizerImpl.h" // for MatrixComputeStreamEvent
+#include "PackedImages.h"
+#include "HeapMemoryProvider.h"
+#include "CudaMemoryProvider.h"
+#include "Instrumentation.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 template <class ElemType>
 ReaderShim<ElemType>::ReaderShim(ReaderFactory factory)
-    : m_layout(make_shared<MBLayout>()), m_factory(factory)
+    : m_layout(make_shared<MBLayout>()), m_factory(factory), m_endOfEpoch(false),
+      m_prefetch(true), m_prefetchDepth(1), m_asyncCopy(true), m_readerBuffersPageLocked(false),
+      m_prefetchDeviceId(CPUDEVICE - 1), m_stopPrefetching(false)
 {
 }
 
+template <class ElemType>
+ReaderShim<ElemType>::~ReaderShim()
+{
+    StopPrefetching();
+}
+
 template <class ElemType>
 void ReaderShim<ElemType>::Init(const ConfigParameters& config)
 {
     intargvector numberOfuttsPerMinibatchForAllEpochs =
         config(L"nbruttsineachrecurrentiter", ConfigParameters::Array(intargvector(vector<int> { 1 })));
 
-    bool prefetch = config(L"prefetch", true);
-    // if prefetch - launching asynchronously,
-    // otherwise deferring - synchronous execution during .get() call
-    m_launchType = prefetch ? launch::async : launch::deferred;
+    // if prefetch - minibatches are read, packed and copied to the device on a background thread,
+    // up to prefetchDepth minibatches ahead of the training thread;
+    // otherwise - synchronous execution inside GetMinibatch()
+    m_prefetch = config(L"prefetch", true);
+    m_prefetchDepth = config(L"prefetchDepth", (size_t) 1);
+    if (m_prefetchDepth == 0)
+        InvalidArgument("ReaderShim: prefetchDepth must be at least 1.");
+    // if asyncCopy - prefetched minibatches go to the GPU through page-locked staging memory, on a copy stream
+    // that runs concurrently with the computation; otherwise - a synchronous copy from the reader's buffers
+    m_asyncCopy = config(L"asyncCopy", true);
 
     auto numSeqsPerMBForAllEpochs = numberOfuttsPerMinibatchForAllEpochs;
     m_layout->Init(numSeqsPerMBForAllEpochs[0], 0);
@@ -68,15 +88,299 @@ void ReaderShim<ElemType>::StartDistributedMinibatchLoop(
     config.m_totalEpochSizeInSamples = requestedEpochSamples;
     config.m_epochIndex = epoch;
 
+    // the reader must not be touched while the prefetch thread is still working on the previous epoch
+    StopPrefetching();
+
     m_reader->StartEpoch(config);
     m_endOfEpoch = false;
 
-    m_prefetchTask = std::async(m_launchType, [this]()
+    // If we already know which matrices to fill (i.e. from the previous epoch), start reading ahead right away.
+    // Otherwise, prefetching starts with the first GetMinibatch() call.
+    if (m_prefetch && !m_prefetchNames.empty())
+    {
+        StartPrefetching();
+    }
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::CopyMinibatchToMatrices(const Minibatch& minibatch, const std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    for (const auto& mx : matrices)
+    {
+        auto streamIdIter = m_nameToStreamId.find(mx.first);
+        if (streamIdIter == m_nameToStreamId.end())
+            RuntimeError("ReaderShim: the reader does not provide an input stream named '%ls'.", mx.first.c_str());
+        size_t streamId = streamIdIter->second;
+
+        const auto& stream = minibatch.m_data[streamId];
+        size_t columnNumber = stream->m_layout->GetNumCols();
+        size_t rowNumber = m_streams[streamId]->m_sampleLayout->GetNumElements();
+
+        if (m_streams[streamId]->m_storageType == StorageType::sparse_csc)
+        {
+            SetSparseMatrix(*mx.second, mx.first, *stream, rowNumber, columnNumber);
+            continue;
+        }
+        if (m_streams[streamId]->m_storageType == StorageType::packed_images)
+        {
+            SetPackedImages(*mx.second, mx.first, *stream, rowNumber, columnNumber);
+            continue;
+        }
+
+        auto data = reinterpret_cast<const ElemType*>(stream->m_data);
+        mx.second->SetValue(rowNumber, columnNumber, mx.second->GetDeviceId(), const_cast<ElemType*>(data), matrixFlagNormal);
+    }
+}
+
+// Sets a sparse input matrix from the compressed sparse column arrays of a sparse stream (see StreamMinibatch).
+// The arrays are passed on as they are; the data is never densified.
+template <class ElemType>
+void ReaderShim<ElemType>::SetSparseMatrix(Matrix<ElemType>& matrix, const std::wstring& name, const StreamMinibatch& stream, size_t rowNumber, size_t columnNumber)
+{
+    if (matrix.GetMatrixType() != MatrixType::SPARSE)
+        RuntimeError("ReaderShim: the reader delivers '%ls' as sparse data, so it must be declared as a sparse input.", name.c_str());
+
+    auto values = reinterpret_cast<const ElemType*>(stream.m_data);
+    auto rowIndices = reinterpret_cast<const SparseIndexType*>(values + stream.m_numberOfNonZeros);
+    auto columnOffsets = rowIndices + stream.m_numberOfNonZeros;
+    matrix.SetMatrixFromCSCFormat(columnOffsets, rowIndices, values, stream.m_numberOfNonZeros, rowNumber, columnNumber);
+}
+
+// Sets a dense input matrix from a block of packed images (see PackedImages.h). They are cropped, scaled and normalized
+// where the matrix lives, so on the GPU only the decoded images are transferred.
+template <class ElemType>
+void ReaderShim<ElemType>::SetPackedImages(Matrix<ElemType>& matrix, const std::wstring& name, const StreamMinibatch& stream, size_t rowNumber, size_t columnNumber)
+{
+    if (matrix.GetMatrixType() != MatrixType::DENSE)
+        RuntimeError("ReaderShim: the reader delivers '%ls' as images, so it must be declared as a dense input.", name.c_str());
+
+    auto header = reinterpret_cast<const PackedImagesHeader*>(stream.m_data);
+    if ((size_t) header->m_width * header->m_height * header->m_channels != rowNumber || header->m_numImages != columnNumber)
+        LogicError("ReaderShim: the packed images of '%ls' do not match the %d x %d layout of the stream.", name.c_str(), (int) rowNumber, (int) columnNumber);
+    matrix.AssignPackedImages(stream.m_data);
+}
+
+// Starts the copies of the dense streams to the GPU. If the reader packs into page-locked memory, they are copied right out
+// of the reader's buffers: the reader keeps m_prefetchDepth + 1 minibatches, and the copy of this minibatch is complete before
+// the reader packs into its buffers again (the next copy into this PrefetchBuffer waits for it, and that is before the next
+// m_prefetchDepth + 1 minibatches are read). Otherwise, they are staged in the buffer's page-locked memory first, which is reused
+// once the previous copy out of it is complete, which is long before the buffer comes round again.
+template <class ElemType>
+void ReaderShim<ElemType>::CopyMinibatchToBufferAsync(const Minibatch& minibatch, PrefetchBuffer& buffer)
+{
+    buffer.m_transferer->WaitForCopyCPUToGPUAsync();
+
+    struct Copy
+    {
+        ElemType* m_source;
+        size_t m_numElements;
+        ElemType* m_target;
+    };
+    std::vector<Copy> copies;
+    for (const auto& mx : buffer.m_matrices)
+    {
+        auto streamIdIter = m_nameToStreamId.find(mx.first);
+        if (streamIdIter == m_nameToStreamId.end())
+            RuntimeError("ReaderShim: the reader does not provide an input stream named '%ls'.", mx.first.c_str());
+        size_t streamId = streamIdIter->second;
+
+        const auto& stream = minibatch.m_data[streamId];
+        size_t columnNumber = stream->m_layout->GetNumCols();
+        size_t rowNumber = m_streams[streamId]->m_sampleLayout->GetNumElements();
+        auto data = reinterpret_cast<const ElemType*>(stream->m_data);
+
+        Matrix<ElemType>& matrix = *mx.second;
+        if (m_streams[streamId]->m_storageType == StorageType::sparse_csc)
+        {
+            SetSparseMatrix(matrix, mx.first, *stream, rowNumber, columnNumber);
+            continue;
+        }
+        if (m_streams[streamId]->m_storageType == StorageType::packed_images) // (expanded by a kernel on the compute stream)
+        {
+            SetPackedImages(matrix, mx.first, *stream, rowNumber, columnNumber);
+            continue;
+        }
+        if (matrix.GetMatrixType() != MatrixType::DENSE || matrix.GetCurrentMatrixLocation() != CurrentDataLocation::GPU)
+        {
+            matrix.SetValue(rowNumber, columnNumber, matrix.GetDeviceId(), const_cast<ElemType*>(data), matrixFlagNormal);
+            continue;
+        }
+
+        size_t numElements = rowNumber * columnNumber;
+        matrix.Resize(rowNumber, columnNumber);
+        if (numElements == 0)
+            continue;
+        if (m_readerBuffersPageLocked)
+        {
+            copies.push_back(Copy{ const_cast<ElemType*>(data), numElements, matrix.BufferPointer() });
+            continue;
+        }
+        auto& staging = buffer.m_stagingBuffers[mx.first];
+        auto& stagingSize = buffer.m_stagingBufferSizes[mx.first];
+        if (!staging || stagingSize < numElements)
+        {
+            staging.reset(); // back into the pool first, so that it can be picked up again
+            staging = std::shared_ptr<ElemType>((ElemType*) CUDAPageLockedMemAllocator::MallocFromPool(numElements * sizeof(ElemType), m_prefetchDeviceId),
+                                                [](ElemType* p) { CUDAPageLockedMemAllocator::FreeToPool(p); });
+            stagingSize = numElements;
+        }
+        memcpy(staging.get(), data, numElements * sizeof(ElemType));
+        copies.push_back(Copy{ staging.get(), numElements, matrix.BufferPointer() });
+    }
+    if (copies.empty())
+        return;
+
+    // The matrices were the caller's for an earlier minibatch, and Resize() may have handed out memory released on the
+    // compute stream; so the copies must wait for the work queued on the compute stream so far.
+    std::unique_ptr<MatrixComputeStreamEvent> computeEvent(MatrixComputeStreamEvent::Create(m_prefetchDeviceId));
+    computeEvent->SynchronizeDataTransferAssignStreamWithEvent<ElemType>();
+    for (const auto& copy : copies)
+        buffer.m_transferer->CopyCPUToGPUAsync(copy.m_source, copy.m_numElements, copy.m_target);
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::StartPrefetching()
+{
+    assert(!m_prefetchThread.joinable());
+    assert(m_readyBuffers.empty());
+
+    m_stopPrefetching = false;
+    m_prefetchError = nullptr;
+
+    // The packer reuses its buffers (and layout) for every minibatch, so each minibatch in flight gets its own set of matrices.
+    m_freeBuffers.clear();
+    for (size_t i = 0; i < m_prefetchDepth; i++)
+    {
+        auto buffer = make_shared<PrefetchBuffer>();
+        // the matrices are swapped with the caller's, so they must be of the same type (sparse inputs stay sparse)
+        for (size_t k = 0; k < m_prefetchNames.size(); k++)
+        {
+            if (m_prefetchMatrixTypes[k] == MatrixType::SPARSE)
+                buffer->m_matrices[m_prefetchNames[k]] = make_shared<Matrix<ElemType>>(0, 0, m_prefetchDeviceId, MatrixType::SPARSE, matrixFormatSparseCSC);
+            else
+                buffer->m_matrices[m_prefetchNames[k]] = make_shared<Matrix<ElemType>>(m_prefetchDeviceId);
+        }
+        buffer->m_layout = make_shared<MBLayout>();
+        buffer->m_hasData = false;
+        buffer->m_endOfEpoch = false;
+        if (m_asyncCopy && m_prefetchDeviceId >= 0)
+            buffer->m_transferer.reset(new GPUDataTransferer<ElemType>(m_prefetchDeviceId, true /*useConcurrentStreams*/));
+        m_freeBuffers.push_back(buffer);
+    }
+
+    // With asyncCopy, the reader packs into page-locked memory, so that a minibatch goes from the packer to the GPU in one
+    // transfer, without staging; it keeps the minibatches that may still be in flight (see CopyMinibatchToBufferAsync()).
+    bool pageLocked = m_asyncCopy && m_prefetchDeviceId >= 0;
+    if (pageLocked != m_readerBuffersPageLocked)
+    {
+        MemoryProviderPtr provider;
+        if (pageLocked)
+            provider = make_shared<CudaMemoryProvider>(m_prefetchDeviceId);
+        else
+            provider = make_shared<HeapMemoryProvider>();
+        bool supported = m_reader->SetMemoryProvider(provider, pageLocked ? m_prefetchDepth + 1 : 1);
+        m_readerBuffersPageLocked = pageLocked && supported;
+    }
+
+    m_prefetchThread = std::thread([this]()
     {
-        return m_reader->ReadMinibatch();
+        PrefetchLoop();
     });
 }
 
+template <class ElemType>
+void ReaderShim<ElemType>::StopPrefetching()
+{
+    if (m_prefetchThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_prefetchMutex);
+            m_stopPrefetching = true;
+        }
+        m_prefetchCondition.notify_all();
+        m_prefetchThread.join(); // (this waits for a minibatch read that is currently in progress)
+    }
+    // copies into the buffers may still be in flight; the memory must not be released under them
+    for (const auto* buffers : { &m_readyBuffers, &m_freeBuffers })
+    {
+        for (const auto& buffer : *buffers)
+        {
+            if (buffer->m_transferer)
+                buffer->m_transferer->WaitForCopyCPUToGPUAsync();
+        }
+    }
+    m_readyBuffers.clear();
+    m_freeBuffers.clear();
+    m_prefetchError = nullptr;
+}
+
+// body of the prefetch thread: read minibatches into free buffers until the end of the epoch
+template <class ElemType>
+void ReaderShim<ElemType>::PrefetchLoop()
+{
+    try
+    {
+        // Set the device since this will execute on a new thread
+        if (m_prefetchDeviceId != CPUDEVICE)
+            Matrix<ElemType>::SetDevice(m_prefetchDeviceId);
+
+        for (;;)
+        {
+            PrefetchBufferPtr buffer;
+            {
+                std::unique_lock<std::mutex> lock(m_prefetchMutex);
+                m_prefetchCondition.wait(lock, [this]() { return m_stopPrefetching || !m_freeBuffers.empty(); });
+                if (m_stopPrefetching)
+                    return;
+                buffer = m_freeBuffers.front();
+                m_freeBuffers.pop_front();
+            }
+
+            Minibatch minibatch;
+            {
+                CNTK_RANGE("reader.read");
+                m_readTimer.Time([&]() { minibatch = m_reader->ReadMinibatch(); });
+            }
+            CNTK_COUNTER_ADD("reader.minibatches", 1);
+            buffer->m_endOfEpoch = minibatch.m_endOfEpoch;
+            buffer->m_hasData = !minibatch.m_data.empty();
+            if (buffer->m_hasData)
+            {
+                CNTK_RANGE("reader.copy");
+                if (buffer->m_transferer)
+                {
+                    m_copyTimer.Time([&]() { CopyMinibatchToBufferAsync(minibatch, *buffer); });
+                }
+                else
+                {
+                    std::map<std::wstring, Matrix<ElemType>*> matrices;
+                    for (const auto& mx : buffer->m_matrices)
+                        matrices[mx.first] = mx.second.get();
+                    m_copyTimer.Time([&]() { CopyMinibatchToMatrices(minibatch, matrices); });
+                }
+                buffer->m_layout->CopyFrom(minibatch.m_data.front()->m_layout);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_prefetchMutex);
+                m_readyBuffers.push_back(buffer);
+            }
+            m_prefetchCondition.notify_all();
+
+            if (buffer->m_endOfEpoch)
+                return;
+        }
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_prefetchMutex);
+            m_prefetchError = std::current_exception();
+        }
+        m_prefetchCondition.notify_all();
+    }
+}
+
 template <class ElemType>
 bool ReaderShim<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices)
 {
@@ -96,43 +400,99 @@ bool ReaderShim<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*
         }
     }
 
-    assert(m_prefetchTask.valid());
-
-    Minibatch minibatch = m_prefetchTask.get();
-    if (minibatch.m_endOfEpoch)
+    if (!m_prefetch)
     {
-        m_endOfEpoch = true;
+        Minibatch minibatch;
+        m_readTimer.Time([&]() { minibatch = m_reader->ReadMinibatch(); });
+        m_endOfEpoch = minibatch.m_endOfEpoch;
         if (minibatch.m_data.empty())
         {
             return false;
         }
+        m_copyTimer.Time([&]() { CopyMinibatchToMatrices(minibatch, matrices); });
+        m_layout->CopyFrom(minibatch.m_data.front()->m_layout);
+        return true;
     }
 
-    if (!minibatch.m_data.empty())
+    // (re-)start prefetching if this is the first call or the caller now asks for different matrices
+    std::vector<std::wstring> names;
+    std::vector<MatrixType> types;
+    for (const auto& mx : matrices)
     {
-        // Copy returned minibatch to the matrices.
-        for (const auto& mx : matrices)
-        {
-            assert(m_nameToStreamId.find(mx.first) != m_nameToStreamId.end());
-            size_t streamId = m_nameToStreamId[mx.first];
+        names.push_back(mx.first);
+        types.push_back(mx.second->GetMatrixType());
+    }
+    if (names != m_prefetchNames || types != m_prefetchMatrixTypes || deviceId != m_prefetchDeviceId)
+    {
+        if (m_prefetchThread.joinable())
+            LogicError("ReaderShim: the set of input matrices or their device must not change in the middle of an epoch.");
+        m_prefetchNames = names;
+        m_prefetchMatrixTypes = types;
+        m_prefetchDeviceId = deviceId;
+        StartPrefetching();
+    }
 
-            const auto& stream = minibatch.m_data[streamId];
-            m_layout = stream->m_layout;
+    PrefetchBufferPtr buffer;
+    m_waitTimer.Time([&]()
+                     {
+                         CNTK_RANGE("reader.wait");
+                         std::unique_lock<std::mutex> lock(m_prefetchMutex);
+                         m_prefetchCondition.wait(lock, [this]() { return !m_readyBuffers.empty() || m_prefetchError; });
+                         if (!m_readyBuffers.empty())
+                         {
+                             buffer = m_readyBuffers.front();
+                             m_readyBuffers.pop_front();
+                         }
+                     });
+    if (!buffer)
+        std::rethrow_exception(m_prefetchError);
 
-            size_t columnNumber = m_layout->GetNumCols();
-            size_t rowNumber = m_streams[streamId]->m_sampleLayout->GetNumElements();
+    m_endOfEpoch = buffer->m_endOfEpoch;
+    const bool hasData = buffer->m_hasData; // (the prefetch thread reuses the buffer as soon as it is released below)
+    if (hasData)
+    {
+        // hand the prefetched matrices to the caller; the caller's previous matrices become the buffers for a later minibatch
+        for (const auto& mx : matrices)
+            std::swap(*mx.second, *buffer->m_matrices[mx.first]);
+        m_layout->CopyFrom(buffer->m_layout);
+        if (buffer->m_transferer)
+            buffer->m_transferer->WaitForCopyCPUToGPUAsyncOnComputeStream(); // the computation must not read the inputs before they have arrived
+    }
 
-            auto data = reinterpret_cast<const ElemType*>(stream->m_data);
-            mx.second->SetValue(rowNumber, columnNumber, mx.second->GetDeviceId(), const_cast<ElemType*>(data), matrixFlagNormal);
-        }
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        m_freeBuffers.push_back(buffer);
     }
+    m_prefetchCondition.notify_all();
 
-    m_prefetchTask = std::async(m_launchType, [this]()
+    if (m_endOfEpoch)
     {
-        return m_reader->ReadMinibatch();
-    });
+        // the prefetch thread ends itself after the last minibatch of the epoch
+        m_prefetchThread.join();
+    }
 
-    return !minibatch.m_data.empty();
+    return hasData;
+}
+
+// Right after the start of an epoch, before any prefetching, the minibatches are read through the whole pipeline (so the
+// randomizer and the transformers end up in the same state as if they had been trained on), but not copied into matrices.
+template <class ElemType>
+size_t ReaderShim<ElemType>::SkipMinibatches(size_t numMinibatches, std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    if (m_prefetchThread.joinable())
+        return IDataReader<ElemType>::SkipMinibatches(numMinibatches, matrices);
+
+    size_t numSkipped = 0;
+    while ((numSkipped < numMinibatches) && !m_endOfEpoch)
+    {
+        Minibatch minibatch;
+        m_readTimer.Time([&]() { minibatch = m_reader->ReadMinibatch(); });
+        m_endOfEpoch = minibatch.m_endOfEpoch;
+        if (minibatch.m_data.empty())
+            break;
+        numSkipped++;
+    }
+    return numSkipped;
 }
 
 template <class ElemType>
@@ -144,6 +504,19 @@ void ReaderShim<ElemType>::CopyMBLayoutTo(MBLayoutPtr layout)
     layout->CopyFrom(m_layout);
 }
 
+// Stages "readMinibatch" (the whole pipeline: randomizer, deserializer, transformers, packer) and "copyToMatrices"
+// (including the transfer to the GPU, or with asyncCopy the staging and starting it), on the prefetch thread if prefetching; and "waitForPrefetch", the time
+// GetMinibatch() waited for the prefetch thread, which is what the training sees.
+template <class ElemType>
+void ReaderShim<ElemType>::GetStatistics(std::map<std::string, double>& stats)
+{
+    m_readTimer.AddTo(stats, "readMinibatch");
+    m_copyTimer.AddTo(stats, "copyToMatrices");
+    if (m_prefetch)
+        m_waitTimer.AddTo(stats, "waitForPrefetch");
+    m_reader->GetStatistics(stats);
+}
+
 template <class ElemType>
 size_t ReaderShim<ElemType>::GetNumParallelSequences()
 {
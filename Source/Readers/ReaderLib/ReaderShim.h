@@ -10,9 +10,15 @@
 
 #include <map>
 #include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include "DataReader.h"
-#include <future>
 #include "Reader.h"
+#include "StageTimer.h"
+#include "GPUDataTransferer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -23,7 +29,7 @@ class ReaderShim : public IDataReader<ElemType>
 {
 public:
     explicit ReaderShim(ReaderFactory factory);
-    virtual ~ReaderShim() { }
+    virtual ~ReaderShim();
 
     virtual void Init(const ScriptableObjects::IConfigRecord& /*config*/) override
     {
@@ -45,6 +51,7 @@ public:
     }
 
     virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override;
+    virtual size_t SkipMinibatches(size_t numMinibatches, std::map<std::wstring, Matrix<ElemType>*>& matrices) override;
 
     virtual bool DataEnd() override;
 
@@ -52,8 +59,36 @@ public:
 
     virtual size_t GetNumParallelSequences() override;
 
+    virtual void GetStatistics(std::map<std::string, double>& stats) override;
+
 private:
-    std::future<Minibatch> m_prefetchTask;
+    // A minibatch that the prefetch thread has already read, packed and copied into matrices on the target device.
+    // GetMinibatch() swaps these into the caller's matrices, and the buffers are then handed back for reuse.
+    struct PrefetchBuffer
+    {
+        std::map<std::wstring, std::shared_ptr<Matrix<ElemType>>> m_matrices;
+        MBLayoutPtr m_layout;
+        bool m_hasData;
+        bool m_endOfEpoch;
+
+        // with m_asyncCopy: the data is copied from page-locked memory on the transfer stream, which the compute stream
+        // waits for when GetMinibatch() hands the matrices out; unless the reader packs into page-locked memory itself
+        // (m_readerBuffersPageLocked), the data is staged in the buffers below first
+        std::unique_ptr<GPUDataTransferer<ElemType>> m_transferer;
+        std::map<std::wstring, std::shared_ptr<ElemType>> m_stagingBuffers; // [name] from CUDAPageLockedMemAllocator::MallocFromPool()
+        std::map<std::wstring, size_t> m_stagingBufferSizes;                // [name] in elements
+    };
+    typedef std::shared_ptr<PrefetchBuffer> PrefetchBufferPtr;
+
+    void CopyMinibatchToMatrices(const Minibatch& minibatch, const std::map<std::wstring, Matrix<ElemType>*>& matrices);
+    void CopyMinibatchToBufferAsync(const Minibatch& minibatch, PrefetchBuffer& buffer);
+    void SetSparseMatrix(Matrix<ElemType>& matrix, const std::wstring& name, const StreamMinibatch& stream, size_t rowNumber, size_t columnNumber);
+    void SetPackedImages(Matrix<ElemType>& matrix, const std::wstring& name, const StreamMinibatch& stream, size_t rowNumber, size_t columnNumber);
+
+    void StartPrefetching();
+    void StopPrefetching();
+    void PrefetchLoop();
+
     ReaderPtr m_reader;
     ReaderFactory m_factory;
     bool m_endOfEpoch;
@@ -62,7 +97,27 @@ private:
 
     std::map<std::wstring, size_t> m_nameToStreamId;
     std::vector<StreamDescriptionPtr> m_streams;
-    launch m_launchType;
+
+    // prefetching
+    bool m_prefetch;        // read minibatches on a background thread
+    size_t m_prefetchDepth; // max number of minibatches read ahead
+    bool m_asyncCopy;       // copy prefetched minibatches to the GPU on a separate stream, through page-locked memory
+    bool m_readerBuffersPageLocked; // the reader packs minibatches into page-locked memory, from which they are copied to the GPU directly
+    int m_prefetchDeviceId; // device of the matrices the prefetched data goes into (known after the first GetMinibatch())
+    std::vector<std::wstring> m_prefetchNames; // names of the matrices to prefetch
+    std::vector<MatrixType> m_prefetchMatrixTypes; // [i] type of matrix m_prefetchNames[i]
+    std::thread m_prefetchThread;
+    std::mutex m_prefetchMutex;
+    std::condition_variable m_prefetchCondition;       // signaled whenever one of the queues below changes or prefetching is stopped
+    std::deque<PrefetchBufferPtr> m_readyBuffers;      // filled by the prefetch thread, in minibatch order
+    std::deque<PrefetchBufferPtr> m_freeBuffers;       // available to the prefetch thread
+    bool m_stopPrefetching;
+    std::exception_ptr m_prefetchError;                // exception thrown on the prefetch thread, rethrown by GetMinibatch()
+
+    // statistics
+    StageTimer m_readTimer;
+    StageTimer m_copyTimer;
+    StageTimer m_waitTimer;
 };
 
 }}}
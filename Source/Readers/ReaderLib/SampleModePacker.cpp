@@ -15,22 +15,16 @@ SampleModePacker::SampleModePacker(
     MemoryProviderPtr memoryProvider,
     TransformerPtr transformer,
     size_t minibatchSize,
-    const std::vector<StreamDescriptionPtr>& streams) : m_transformer(transformer),
-                                                        m_minibatchSize(minibatchSize),
-                                                        m_outputStreams(streams),
-                                                        m_minibatchLayout(std::make_shared<MBLayout>()),
-                                                        m_memoryProvider(memoryProvider)
+    const std::vector<StreamDescriptionPtr>& streams,
+    size_t numberOfBuffers) : m_transformer(transformer),
+                              m_minibatchSize(minibatchSize),
+                              m_outputStreams(streams),
+                              m_minibatchLayout(std::make_shared<MBLayout>()),
+                              m_memoryProvider(memoryProvider),
+                              m_numberOfBuffers(numberOfBuffers)
 {
     m_inputStreams = m_transformer->GetStreamDescriptions();
     assert(m_inputStreams.size() == m_outputStreams.size());
-    assert(
-        std::find_if(
-            m_outputStreams.begin(),
-            m_outputStreams.end(),
-            [](const StreamDescriptionPtr& s)
-            {
-                return s->m_storageType == StorageType::sparse_csc;
-            }) == m_outputStreams.end());
 
     assert(m_minibatchSize > 0);
     for (int i = 0; i < m_outputStreams.size(); ++i)
@@ -42,8 +36,43 @@ SampleModePacker::SampleModePacker(
         assert(stream->m_id == m_inputStreams[i]->m_id);
         assert(GetSampleSize(m_inputStreams[i]) == GetSampleSize(stream));
 
-        m_streamBuffers.push_back(
-            AllocateBuffer(m_minibatchSize * stream->m_sampleLayout->GetNumElements(), GetSizeByType(stream->m_elementType)));
+        if (stream->m_storageType == StorageType::sparse_csc && m_inputStreams[i]->m_storageType != StorageType::sparse_csc)
+            LogicError("SampleModePacker: Stream '%ls' can only be packed as sparse if its input is sparse.", stream->m_name.c_str());
+        if (stream->m_storageType == StorageType::packed_images && m_inputStreams[i]->m_storageType != StorageType::packed_images)
+            LogicError("SampleModePacker: Stream '%ls' can only be packed as images if its input are packed images.", stream->m_name.c_str());
+    }
+
+    // all buffers are allocated on first use: dense ones for the whole minibatch, sparse ones when the number of non zeros
+    // is known, and image ones when the sizes of the images are known
+    m_streamBuffers.resize(m_outputStreams.size());
+    m_streamBufferSizes.resize(m_outputStreams.size(), 0);
+}
+
+void SampleModePacker::SetMemoryProvider(MemoryProviderPtr memoryProvider, size_t numberOfBuffers)
+{
+    m_memoryProvider = memoryProvider;
+    m_numberOfBuffers = numberOfBuffers;
+    m_previousBuffers.clear();
+    m_streamBuffers.assign(m_outputStreams.size(), nullptr);
+    m_streamBufferSizes.assign(m_outputStreams.size(), 0);
+}
+
+void SampleModePacker::NextBuffers()
+{
+    if (m_numberOfBuffers <= 1)
+        return;
+
+    m_previousBuffers.push_back(std::make_pair(std::move(m_streamBuffers), std::move(m_streamBufferSizes)));
+    if (m_previousBuffers.size() < m_numberOfBuffers)
+    {
+        m_streamBuffers.assign(m_outputStreams.size(), nullptr);
+        m_streamBufferSizes.assign(m_outputStreams.size(), 0);
+    }
+    else
+    {
+        m_streamBuffers = std::move(m_previousBuffers.front().first);
+        m_streamBufferSizes = std::move(m_previousBuffers.front().second);
+        m_previousBuffers.pop_front();
     }
 }
 
@@ -53,6 +82,17 @@ Minibatch SampleModePacker::ReadMinibatch()
 
     Minibatch minibatch;
     minibatch.m_endOfEpoch = sequences.m_endOfEpoch;
+    if (sequences.m_data.empty())
+    {
+        return minibatch;
+    }
+
+    NextBuffers();
+    for (size_t i = 0; i < m_outputStreams.size(); ++i)
+    {
+        if (m_outputStreams[i]->m_storageType == StorageType::dense)
+            ReserveBuffer(i, m_minibatchSize * GetSampleSize(m_outputStreams[i]));
+    }
 
     // Iterating for sequences inside the batch of sequences.
     for (size_t sequenceIndex = 0; sequenceIndex < sequences.m_data.size(); sequenceIndex++)
@@ -61,22 +101,33 @@ Minibatch SampleModePacker::ReadMinibatch()
         assert(m_streamBuffers.size() == sequences.m_data[sequenceIndex].size());
         for (int streamIndex = 0; streamIndex < sequences.m_data[sequenceIndex].size(); ++streamIndex)
         {
-            CopySequenceToBuffer(sequenceIndex, streamIndex, sequences.m_data);
+            if (m_outputStreams[streamIndex]->m_storageType == StorageType::dense)
+            {
+                CopySequenceToBuffer(sequenceIndex, streamIndex, sequences.m_data);
+            }
         }
     }
 
-    if (sequences.m_data.size() == 0)
-    {
-        return minibatch;
-    }
-
     // Creating output minibatch with shared layout between all streams.
     m_minibatchLayout->InitAsFrameMode(sequences.m_data.size());
     for (int i = 0; i < m_outputStreams.size(); ++i)
     {
         auto stream = std::make_shared<StreamMinibatch>();
+        if (m_outputStreams[i]->m_storageType == StorageType::sparse_csc)
+        {
+            stream->m_numberOfNonZeros = PackSparseStream(i, sequences.m_data);
+            stream->m_dataSize = stream->m_numberOfNonZeros * (GetSizeByType(m_outputStreams[i]->m_elementType) + sizeof(SparseIndexType)) +
+                                 (sequences.m_data.size() + 1) * sizeof(SparseIndexType);
+        }
+        else if (m_outputStreams[i]->m_storageType == StorageType::packed_images)
+        {
+            stream->m_dataSize = PackImagesStream(i, sequences.m_data);
+        }
+        else
+        {
+            stream->m_dataSize = sequences.m_data.size() * GetSampleSize(m_outputStreams[i]);
+        }
         stream->m_data = m_streamBuffers[i].get();
-        stream->m_dataSize = sequences.m_data.size() * GetSampleSize(m_outputStreams[i]);
         stream->m_layout = m_minibatchLayout;
 
         minibatch.m_data.push_back(stream);
@@ -139,13 +190,111 @@ void SampleModePacker::CopySequenceToBuffer(size_t sampleIndex, size_t streamInd
     }
 }
 
+size_t SampleModePacker::PackSparseStream(size_t streamIndex, const std::vector<std::vector<SequenceDataPtr>>& sequences)
+{
+    const auto& stream = m_outputStreams[streamIndex];
+    auto elementSize = GetSizeByType(stream->m_elementType);
+    size_t numberOfSamples = sequences.size();
+
+    size_t nonZeroCount = 0;
+    for (size_t sampleIndex = 0; sampleIndex < numberOfSamples; ++sampleIndex)
+    {
+        const auto& data = static_cast<const SparseSequenceData&>(*sequences[sampleIndex][streamIndex]);
+        // Expect single sample.
+        assert(data.m_indices.size() == 1);
+        nonZeroCount += data.m_indices[0].size();
+    }
+
+    // Values first, so that they are aligned, then row indices, then column offsets.
+    size_t size = nonZeroCount * (elementSize + sizeof(SparseIndexType)) + (numberOfSamples + 1) * sizeof(SparseIndexType);
+    ReserveBuffer(streamIndex, size);
+
+    char* values = m_streamBuffers[streamIndex].get();
+    auto rowIndices = reinterpret_cast<SparseIndexType*>(values + nonZeroCount * elementSize);
+    auto columnOffsets = rowIndices + nonZeroCount;
+
+    size_t offset = 0;
+    for (size_t sampleIndex = 0; sampleIndex < numberOfSamples; ++sampleIndex)
+    {
+        const auto& sample = sequences[sampleIndex][streamIndex];
+        const auto& indices = static_cast<const SparseSequenceData&>(*sample).m_indices[0];
+        auto sampleData = reinterpret_cast<const char*>(sample->m_data);
+
+        columnOffsets[sampleIndex] = static_cast<SparseIndexType>(offset);
+        std::copy(sampleData, sampleData + indices.size() * elementSize, values + offset * elementSize);
+        for (size_t nonZeroIndex = 0; nonZeroIndex < indices.size(); ++nonZeroIndex)
+        {
+            rowIndices[offset + nonZeroIndex] = static_cast<SparseIndexType>(indices[nonZeroIndex]);
+        }
+        offset += indices.size();
+    }
+    columnOffsets[numberOfSamples] = static_cast<SparseIndexType>(offset);
+
+    return nonZeroCount;
+}
+
+size_t SampleModePacker::PackImagesStream(size_t streamIndex, const std::vector<std::vector<SequenceDataPtr>>& sequences)
+{
+    size_t numberOfSamples = sequences.size();
+    const auto& parameters = *static_cast<const PackedImageSequenceData&>(*sequences[0][streamIndex]).m_parameters;
+
+    size_t numPixelBytes = 0;
+    for (size_t sampleIndex = 0; sampleIndex < numberOfSamples; ++sampleIndex)
+    {
+        const auto& image = static_cast<const PackedImageSequenceData&>(*sequences[sampleIndex][streamIndex]).m_image;
+        numPixelBytes += (size_t) image.m_width * image.m_height * parameters.m_channels;
+    }
+
+    size_t size = PackedImagesSize(numberOfSamples, parameters.m_mean.size(), numPixelBytes);
+    ReserveBuffer(streamIndex, size);
+
+    auto header = reinterpret_cast<PackedImagesHeader*>(m_streamBuffers[streamIndex].get());
+    header->m_totalSize = size;
+    header->m_numImages = static_cast<uint32_t>(numberOfSamples);
+    header->m_width = static_cast<uint32_t>(parameters.m_width);
+    header->m_height = static_cast<uint32_t>(parameters.m_height);
+    header->m_channels = static_cast<uint32_t>(parameters.m_channels);
+    header->m_transpose = parameters.m_transpose ? 1 : 0;
+    header->m_meanSize = static_cast<uint32_t>(parameters.m_mean.size());
+    std::copy(parameters.m_mean.begin(), parameters.m_mean.end(), const_cast<float*>(PackedImagesMean(header)));
+
+    auto images = const_cast<PackedImage*>(PackedImagesImages(header));
+    auto pixels = const_cast<unsigned char*>(PackedImagesPixels(header));
+    size_t offset = 0;
+    for (size_t sampleIndex = 0; sampleIndex < numberOfSamples; ++sampleIndex)
+    {
+        const auto& sample = static_cast<const PackedImageSequenceData&>(*sequences[sampleIndex][streamIndex]);
+        size_t imageSize = (size_t) sample.m_image.m_width * sample.m_image.m_height * parameters.m_channels;
+        images[sampleIndex] = sample.m_image;
+        images[sampleIndex].m_offset = offset;
+        auto sampleData = reinterpret_cast<const unsigned char*>(sample.m_data);
+        std::copy(sampleData, sampleData + imageSize, pixels + offset);
+        offset += imageSize;
+    }
+
+    return size;
+}
+
+void SampleModePacker::ReserveBuffer(size_t streamIndex, size_t size)
+{
+    if (m_streamBufferSizes[streamIndex] < size)
+    {
+        m_streamBuffers[streamIndex].reset();
+        size_t capacity = std::max(size, 2 * m_streamBufferSizes[streamIndex]);
+        m_streamBuffers[streamIndex] = AllocateBuffer(capacity, 1);
+        m_streamBufferSizes[streamIndex] = capacity;
+    }
+}
+
 std::shared_ptr<char> SampleModePacker::AllocateBuffer(size_t numElements, size_t elementSize)
 {
+    // (the buffer may outlive a change of the memory provider)
+    MemoryProviderPtr memoryProvider = m_memoryProvider;
     return std::shared_ptr<char>(
-        reinterpret_cast<char*>(m_memoryProvider->Alloc(elementSize, numElements)),
-        [this](char* p)
+        reinterpret_cast<char*>(memoryProvider->Alloc(elementSize, numElements)),
+        [memoryProvider](char* p)
         {
-            m_memoryProvider->Free(p);
+            memoryProvider->Free(p);
         });
 }
 } } }
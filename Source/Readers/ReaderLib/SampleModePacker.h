@@ -5,13 +5,21 @@
 
 #pragma once
 
+#include <deque>
 #include "Reader.h"
 #include "MemoryProvider.h"
 #include "Transformer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-// A sample packer that densely packs samples in parallel for GPU consumptions.
+// A sample packer that packs samples in parallel for GPU consumptions.
+// Output streams with StorageType::dense are packed densely, with sparse input samples unpacked into zeros.
+// Output streams with StorageType::sparse_csc (whose input must be sparse) are packed into the compressed sparse column
+// format described at StreamMinibatch, without ever densifying them; their buffers grow with the number of non zeros.
+// Output streams with StorageType::packed_images (whose input must be such images) are packed into the block described in
+// PackedImages.h; their buffers grow with the size of the images.
+// With numberOfBuffers > 1 the packer cycles through as many sets of buffers, so that the data of a minibatch stays valid
+// for the next numberOfBuffers - 1 calls of ReadMinibatch() (e.g. while it is being copied to the GPU).
 class SampleModePacker
 {
 public:
@@ -19,20 +27,41 @@ public:
         MemoryProviderPtr memoryProvider,
         TransformerPtr transformer,
         size_t minibatchSize,
-        const std::vector<StreamDescriptionPtr>& streams);
+        const std::vector<StreamDescriptionPtr>& streams,
+        size_t numberOfBuffers = 1);
 
     Minibatch ReadMinibatch();
 
+    // allocates the buffers from 'memoryProvider' from now on (see Reader::SetMemoryProvider())
+    void SetMemoryProvider(MemoryProviderPtr memoryProvider, size_t numberOfBuffers);
+
 private:
     std::shared_ptr<char> AllocateBuffer(size_t numElements, size_t elementSize);
     size_t GetSampleSize(StreamDescriptionPtr stream);
     void CopySequenceToBuffer(size_t sequenceIndex, size_t streamIndex, const std::vector<std::vector<SequenceDataPtr>>& sequences);
 
+    // packs the samples of a sparse output stream into its buffer; returns the number of non zeros
+    size_t PackSparseStream(size_t streamIndex, const std::vector<std::vector<SequenceDataPtr>>& sequences);
+
+    // packs the images of a packed image stream into its buffer; returns the size of the block
+    size_t PackImagesStream(size_t streamIndex, const std::vector<std::vector<SequenceDataPtr>>& sequences);
+
+    // lets the buffer of a stream, which is allocated on first use, hold at least 'size' bytes
+    void ReserveBuffer(size_t streamIndex, size_t size);
+
+    // switches to the next set of buffers, with numberOfBuffers > 1
+    void NextBuffers();
+
     MemoryProviderPtr m_memoryProvider;
     TransformerPtr m_transformer;
     std::vector<StreamDescriptionPtr> m_outputStreams;
     std::vector<StreamDescriptionPtr> m_inputStreams;
-    std::vector<std::shared_ptr<char>> m_streamBuffers;
+    std::vector<std::shared_ptr<char>> m_streamBuffers; // the current set
+    std::vector<size_t> m_streamBufferSizes; // in bytes
+
+    // the sets of buffers of the previous minibatches, oldest first
+    std::deque<std::pair<std::vector<std::shared_ptr<char>>, std::vector<size_t>>> m_previousBuffers;
+    size_t m_numberOfBuffers;
 
     MBLayoutPtr m_minibatchLayout;
     size_t m_minibatchSize;
@@ -0,0 +1,414 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _SCL_SECURE_NO_WARNINGS
+
+#include "SequencePacker.h"
+#include "ElementTypeUtils.h"
+#include <algorithm>
+#include <functional>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+SequencePacker::SequencePacker(
+    MemoryProviderPtr memoryProvider,
+    TransformerPtr transformer,
+    size_t minibatchSize,
+    const std::vector<StreamDescriptionPtr>& streams,
+    size_t truncationLength,
+    size_t numParallelSequences,
+    size_t bucketingWindow,
+    size_t numberOfBuffers) : m_memoryProvider(memoryProvider),
+                              m_transformer(transformer),
+                              m_outputStreams(streams),
+                              m_numberOfBuffers(numberOfBuffers),
+                              m_minibatchLayout(std::make_shared<MBLayout>()),
+                              m_minibatchSize(minibatchSize),
+                              m_truncationLength(truncationLength),
+                              m_numParallelSequences(numParallelSequences),
+                              m_bucketingWindow(std::max(bucketingWindow, (size_t) 1)),
+                              m_endOfInput(false),
+                              m_nextSequenceId(0),
+                              m_rng(0),
+                              m_currentTime(0)
+{
+    m_inputStreams = m_transformer->GetStreamDescriptions();
+    assert(m_inputStreams.size() == m_outputStreams.size());
+    assert(m_minibatchSize > 0);
+
+    for (int i = 0; i < m_outputStreams.size(); ++i)
+    {
+        const auto& stream = m_outputStreams[i];
+        assert(stream->m_storageType == StorageType::dense);
+        assert(stream->m_elementType == ElementType::tfloat || stream->m_elementType == ElementType::tdouble);
+        assert(stream->m_name == m_inputStreams[i]->m_name);
+        assert(stream->m_id == m_inputStreams[i]->m_id);
+        assert(GetSampleSize(m_inputStreams[i]) == GetSampleSize(stream));
+        UNUSED(stream);
+    }
+    m_streamBuffers.resize(m_outputStreams.size());
+    m_streamBufferCapacities.resize(m_outputStreams.size(), 0);
+
+    if (m_truncationLength > 0)
+    {
+        if (m_numParallelSequences == 0)
+            m_numParallelSequences = std::max(m_minibatchSize / m_truncationLength, (size_t) 1);
+        m_parallelSequences.resize(m_numParallelSequences);
+    }
+}
+
+Minibatch SequencePacker::ReadMinibatch()
+{
+    return m_truncationLength > 0 ? ReadTruncated() : ReadWholeSequences();
+}
+
+bool SequencePacker::FetchSequences()
+{
+    if (m_endOfInput)
+    {
+        return false;
+    }
+
+    auto sequences = m_transformer->GetNextSequences(m_minibatchSize * m_bucketingWindow);
+    m_endOfInput = sequences.m_endOfEpoch;
+    for (auto& data : sequences.m_data)
+    {
+        PackedSequence sequence;
+        sequence.m_numberOfSamples = GetNumberOfSamples(data);
+        sequence.m_data = std::move(data);
+        sequence.m_id = m_nextSequenceId++;
+        sequence.m_begin = 0;
+        m_pool.push_back(std::move(sequence));
+    }
+    return !sequences.m_data.empty();
+}
+
+size_t SequencePacker::GetNumberOfSamples(const std::vector<SequenceDataPtr>& sequence) const
+{
+    assert(sequence.size() == m_inputStreams.size());
+    size_t result = SIZE_MAX;
+    for (size_t i = 0; i < sequence.size(); ++i)
+    {
+        size_t numberOfSamples = m_inputStreams[i]->m_storageType == StorageType::dense
+                                     ? static_cast<const DenseSequenceData&>(*sequence[i]).m_numberOfSamples
+                                     : static_cast<const SparseSequenceData&>(*sequence[i]).m_indices.size();
+        if (result != SIZE_MAX && numberOfSamples != result)
+        {
+            RuntimeError("SequencePacker: the streams of a sequence must have the same number of samples, got %d and %d.",
+                         (int) result, (int) numberOfSamples);
+        }
+        result = numberOfSamples;
+    }
+    if (result == 0 || result == SIZE_MAX)
+    {
+        RuntimeError("SequencePacker: empty sequences are not supported.");
+    }
+    return result;
+}
+
+Minibatch SequencePacker::ReadWholeSequences()
+{
+    if (m_pendingMinibatches.empty() && FetchSequences())
+    {
+        // Minibatches of sequences of similar lengths, returned in random order so that the lengths do not trend within the window.
+        std::stable_sort(m_pool.begin(), m_pool.end(), [](const PackedSequence& a, const PackedSequence& b)
+                         {
+                             return a.m_numberOfSamples > b.m_numberOfSamples;
+                         });
+        std::vector<std::vector<PackedSequence>> minibatches;
+        size_t numberOfSamples = 0;
+        for (auto& sequence : m_pool)
+        {
+            if (minibatches.empty() || numberOfSamples + sequence.m_numberOfSamples > m_minibatchSize)
+            {
+                minibatches.push_back(std::vector<PackedSequence>());
+                numberOfSamples = 0;
+            }
+            numberOfSamples += sequence.m_numberOfSamples;
+            minibatches.back().push_back(std::move(sequence));
+        }
+        m_pool.clear();
+        std::shuffle(minibatches.begin(), minibatches.end(), m_rng);
+        for (auto& minibatch : minibatches)
+        {
+            m_pendingMinibatches.push_back(std::move(minibatch));
+        }
+    }
+
+    if (m_pendingMinibatches.empty())
+    {
+        Minibatch minibatch;
+        minibatch.m_endOfEpoch = true;
+        return minibatch;
+    }
+
+    std::vector<PackedSequence> sequences = std::move(m_pendingMinibatches.front());
+    m_pendingMinibatches.pop_front();
+
+    // First fit, longest first: each sequence goes into the first parallel sequence it fits in.
+    const size_t numTimeSteps = sequences.front().m_numberOfSamples;
+    std::vector<size_t> used; // [parallel sequence] -> number of time steps taken
+    std::vector<size_t> placement(sequences.size());
+    for (size_t i = 0; i < sequences.size(); ++i)
+    {
+        size_t s = 0;
+        while (s < used.size() && used[s] + sequences[i].m_numberOfSamples > numTimeSteps)
+            s++;
+        if (s == used.size())
+            used.push_back(0);
+        placement[i] = s;
+        sequences[i].m_begin = used[s];
+        used[s] += sequences[i].m_numberOfSamples;
+    }
+
+    // Number the parallel sequences by decreasing length, so that the ones that have ended form a suffix at every time step,
+    // which a recurrent loop can skip (see MBLayout::GetNumActiveSequences()).
+    std::vector<size_t> order(used.size()); // [new index] -> parallel sequence
+    for (size_t s = 0; s < order.size(); ++s)
+        order[s] = s;
+    std::stable_sort(order.begin(), order.end(), [&used](size_t a, size_t b)
+                     {
+                         return used[a] > used[b];
+                     });
+    std::vector<size_t> rank(used.size()); // [parallel sequence] -> new index
+    for (size_t s = 0; s < order.size(); ++s)
+        rank[order[s]] = s;
+    for (auto& s : placement)
+        s = rank[s];
+    std::sort(used.begin(), used.end(), std::greater<size_t>());
+
+    m_minibatchLayout->Init(used.size(), numTimeSteps);
+    PrepareBuffers(used.size(), numTimeSteps);
+    for (size_t i = 0; i < sequences.size(); ++i)
+    {
+        const auto& sequence = sequences[i];
+        m_minibatchLayout->AddSequence(sequence.m_id, placement[i], sequence.m_begin, sequence.m_begin + sequence.m_numberOfSamples);
+        CopySamples(sequence, 0, sequence.m_numberOfSamples, placement[i], sequence.m_begin);
+    }
+    for (size_t s = 0; s < used.size(); ++s)
+    {
+        AddGap(s, used[s], numTimeSteps);
+    }
+
+    return CreateMinibatch(m_endOfInput && m_pendingMinibatches.empty());
+}
+
+Minibatch SequencePacker::ReadTruncated()
+{
+    const size_t S = m_numParallelSequences;
+    auto endOf = [this](size_t s) -> size_t
+    {
+        const auto& parallelSequence = m_parallelSequences[s];
+        return parallelSequence.empty() ? m_currentTime : parallelSequence.back().m_begin + parallelSequence.back().m_numberOfSamples;
+    };
+
+    // Append sequences to the parallel sequence that ends first, until all of them reach beyond this minibatch.
+    const size_t end = m_currentTime + m_truncationLength;
+    for (;;)
+    {
+        size_t first = 0;
+        for (size_t s = 1; s < S; ++s)
+        {
+            if (endOf(s) < endOf(first))
+                first = s;
+        }
+        if (endOf(first) >= end || (m_pool.empty() && !FetchSequences()))
+            break;
+
+        PackedSequence sequence = std::move(m_pool.front());
+        m_pool.pop_front();
+        sequence.m_begin = endOf(first);
+        m_parallelSequences[first].push_back(std::move(sequence));
+    }
+
+    // The last minibatch of the epoch is only as long as the longest parallel sequence.
+    size_t numTimeSteps = 0;
+    for (size_t s = 0; s < S; ++s)
+    {
+        numTimeSteps = std::max(numTimeSteps, std::min(endOf(s), end) - m_currentTime);
+    }
+    if (numTimeSteps == 0)
+    {
+        Minibatch minibatch;
+        minibatch.m_endOfEpoch = true;
+        return minibatch;
+    }
+
+    m_minibatchLayout->Init(S, numTimeSteps);
+    PrepareBuffers(S, numTimeSteps);
+    const size_t minibatchEnd = m_currentTime + numTimeSteps;
+    for (size_t s = 0; s < S; ++s)
+    {
+        for (const auto& sequence : m_parallelSequences[s])
+        {
+            const size_t sequenceEnd = sequence.m_begin + sequence.m_numberOfSamples;
+            if (sequence.m_begin >= minibatchEnd)
+                break;
+            m_minibatchLayout->AddSequence(sequence.m_id, s, (ptrdiff_t) sequence.m_begin - (ptrdiff_t) m_currentTime, sequenceEnd - m_currentTime);
+
+            const size_t copyBegin = std::max(sequence.m_begin, m_currentTime);
+            const size_t copyEnd = std::min(sequenceEnd, minibatchEnd);
+            CopySamples(sequence, copyBegin - sequence.m_begin, copyEnd - copyBegin, s, copyBegin - m_currentTime);
+        }
+        AddGap(s, std::min(endOf(s), minibatchEnd) - m_currentTime, numTimeSteps);
+    }
+
+    // Sequences that end within this minibatch are done.
+    m_currentTime = minibatchEnd;
+    bool empty = true;
+    for (auto& parallelSequence : m_parallelSequences)
+    {
+        while (!parallelSequence.empty() && parallelSequence.front().m_begin + parallelSequence.front().m_numberOfSamples <= m_currentTime)
+            parallelSequence.pop_front();
+        empty = empty && parallelSequence.empty();
+    }
+
+    return CreateMinibatch(m_endOfInput && m_pool.empty() && empty);
+}
+
+void SequencePacker::SetMemoryProvider(MemoryProviderPtr memoryProvider, size_t numberOfBuffers)
+{
+    m_memoryProvider = memoryProvider;
+    m_numberOfBuffers = numberOfBuffers;
+    m_previousBuffers.clear();
+    m_streamBuffers.assign(m_outputStreams.size(), nullptr);
+    m_streamBufferCapacities.assign(m_outputStreams.size(), 0);
+}
+
+void SequencePacker::PrepareBuffers(size_t numParallelSequences, size_t numTimeSteps)
+{
+    if (m_numberOfBuffers > 1)
+    {
+        m_previousBuffers.push_back(std::make_pair(std::move(m_streamBuffers), std::move(m_streamBufferCapacities)));
+        if (m_previousBuffers.size() < m_numberOfBuffers)
+        {
+            m_streamBuffers.assign(m_outputStreams.size(), nullptr);
+            m_streamBufferCapacities.assign(m_outputStreams.size(), 0);
+        }
+        else
+        {
+            m_streamBuffers = std::move(m_previousBuffers.front().first);
+            m_streamBufferCapacities = std::move(m_previousBuffers.front().second);
+            m_previousBuffers.pop_front();
+        }
+    }
+
+    const size_t numberOfSamples = numParallelSequences * numTimeSteps;
+    for (size_t i = 0; i < m_outputStreams.size(); ++i)
+    {
+        const auto& stream = m_outputStreams[i];
+        if (m_streamBufferCapacities[i] < numberOfSamples)
+        {
+            m_streamBuffers[i] = AllocateBuffer(numberOfSamples * stream->m_sampleLayout->GetNumElements(), GetSizeByType(stream->m_elementType));
+            m_streamBufferCapacities[i] = numberOfSamples;
+        }
+
+        // sparse samples are unpacked into zeros
+        if (m_inputStreams[i]->m_storageType != StorageType::dense)
+        {
+            char* buffer = m_streamBuffers[i].get();
+            std::fill(buffer, buffer + numberOfSamples * GetSampleSize(stream), 0);
+        }
+    }
+}
+
+void SequencePacker::AddGap(size_t s, size_t t, size_t numTimeSteps)
+{
+    if (t >= numTimeSteps)
+        return;
+    m_minibatchLayout->AddGap(s, t, numTimeSteps);
+
+    // gap frames are masked, but should still not contain garbage
+    const size_t S = m_minibatchLayout->GetNumParallelSequences();
+    for (size_t i = 0; i < m_inputStreams.size(); ++i)
+    {
+        if (m_inputStreams[i]->m_storageType != StorageType::dense)
+            continue;
+        const size_t sampleSize = GetSampleSize(m_inputStreams[i]);
+        char* buffer = m_streamBuffers[i].get();
+        for (size_t j = t; j < numTimeSteps; ++j)
+            std::fill(buffer + (j * S + s) * sampleSize, buffer + (j * S + s + 1) * sampleSize, 0);
+    }
+}
+
+void SequencePacker::CopySamples(const PackedSequence& sequence, size_t firstSample, size_t numberOfSamples, size_t s, size_t t)
+{
+    const size_t S = m_minibatchLayout->GetNumParallelSequences();
+    for (size_t i = 0; i < m_inputStreams.size(); ++i)
+    {
+        const auto& stream = m_inputStreams[i];
+        const size_t sampleSize = GetSampleSize(stream);
+        const size_t elementSize = GetSizeByType(stream->m_elementType);
+        const auto& data = sequence.m_data[i];
+        const char* source = reinterpret_cast<const char*>(data->m_data);
+        char* buffer = m_streamBuffers[i].get();
+
+        if (stream->m_storageType == StorageType::dense)
+        {
+            // Samples of all parallel sequences are interleaved: column (t * S + s) holds time t of parallel sequence s.
+            for (size_t j = 0; j < numberOfSamples; ++j)
+            {
+                const char* sample = source + (firstSample + j) * sampleSize;
+                std::copy(sample, sample + sampleSize, buffer + ((t + j) * S + s) * sampleSize);
+            }
+        }
+        else if (stream->m_storageType == StorageType::sparse_csc)
+        {
+            const auto& indices = static_cast<const SparseSequenceData&>(*data).m_indices;
+            size_t nonZeroIndex = 0;
+            for (size_t j = 0; j < firstSample; ++j)
+                nonZeroIndex += indices[j].size();
+
+            for (size_t j = 0; j < numberOfSamples; ++j)
+            {
+                char* column = buffer + ((t + j) * S + s) * sampleSize;
+                for (size_t rowIndex : indices[firstSample + j])
+                {
+                    std::copy(source + nonZeroIndex * elementSize, source + (nonZeroIndex + 1) * elementSize, column + rowIndex * elementSize);
+                    nonZeroIndex++;
+                }
+            }
+        }
+        else
+        {
+            RuntimeError("Storage type %d is not supported.", (int) stream->m_storageType);
+        }
+    }
+}
+
+Minibatch SequencePacker::CreateMinibatch(bool endOfEpoch)
+{
+    Minibatch minibatch;
+    minibatch.m_endOfEpoch = endOfEpoch;
+    for (size_t i = 0; i < m_outputStreams.size(); ++i)
+    {
+        auto stream = std::make_shared<StreamMinibatch>();
+        stream->m_data = m_streamBuffers[i].get();
+        stream->m_dataSize = m_minibatchLayout->GetNumCols() * GetSampleSize(m_outputStreams[i]);
+        stream->m_layout = m_minibatchLayout;
+        minibatch.m_data.push_back(stream);
+    }
+    return minibatch;
+}
+
+size_t SequencePacker::GetSampleSize(StreamDescriptionPtr stream) const
+{
+    assert(stream != nullptr);
+    return stream->m_sampleLayout->GetNumElements() * GetSizeByType(stream->m_elementType);
+}
+
+std::shared_ptr<char> SequencePacker::AllocateBuffer(size_t numElements, size_t elementSize)
+{
+    // (the buffer may outlive a change of the memory provider)
+    MemoryProviderPtr memoryProvider = m_memoryProvider;
+    return std::shared_ptr<char>(
+        reinterpret_cast<char*>(memoryProvider->Alloc(elementSize, numElements)),
+        [memoryProvider](char* p)
+        {
+            memoryProvider->Free(p);
+        });
+}
+} } }
@@ -0,0 +1,109 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <deque>
+#include <random>
+#include "Reader.h"
+#include "MemoryProvider.h"
+#include "Transformer.h"
+#include "Sequences.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A packer for sequences of different lengths (e.g. utterances) that keeps the gap frames of the minibatch layout to a minimum.
+//
+// Sequences are requested from the transformer 'bucketingWindow' minibatches at a time. When the transformer is a randomizer,
+// these sequences come from its randomization window, so the packer only reorders data that is randomized together anyway.
+// - With truncationLength == 0, every minibatch holds whole sequences. The requested sequences are sorted by length and cut
+//   into minibatches of similar lengths, which are returned in random order. Within a minibatch, the sequences are placed
+//   into as few parallel sequences as possible (first fit, longest first), so that short sequences share a parallel sequence.
+// - With truncationLength > 0 (truncated BPTT), every parallel sequence is a concatenation of sequences, and a minibatch holds
+//   the next truncationLength frames of numParallelSequences of them. A sequence starts right after the previous one in its
+//   parallel sequence has ended, so gaps only occur at the end of the epoch. Sequences that span minibatches are declared
+//   in the MBLayout as starting before or ending after the minibatch.
+// Sparse input is unpacked to dense, as in the SampleModePacker. As there, numberOfBuffers > 1 keeps the data of a minibatch
+// valid for the next numberOfBuffers - 1 calls of ReadMinibatch().
+class SequencePacker
+{
+public:
+    // numParallelSequences == 0 means minibatchSize / truncationLength (truncated BPTT only)
+    SequencePacker(
+        MemoryProviderPtr memoryProvider,
+        TransformerPtr transformer,
+        size_t minibatchSize,
+        const std::vector<StreamDescriptionPtr>& streams,
+        size_t truncationLength,
+        size_t numParallelSequences,
+        size_t bucketingWindow,
+        size_t numberOfBuffers = 1);
+
+    Minibatch ReadMinibatch();
+
+    // allocates the buffers from 'memoryProvider' from now on (see Reader::SetMemoryProvider())
+    void SetMemoryProvider(MemoryProviderPtr memoryProvider, size_t numberOfBuffers);
+
+private:
+    struct PackedSequence
+    {
+        std::vector<SequenceDataPtr> m_data; // [stream id]
+        size_t m_numberOfSamples;
+        UniqueSequenceId m_id;
+        size_t m_begin; // time of the first sample within the parallel sequence
+    };
+
+    // requests the next sequences from the transformer into m_pool; returns false if there are none left
+    bool FetchSequences();
+    size_t GetNumberOfSamples(const std::vector<SequenceDataPtr>& sequence) const;
+
+    Minibatch ReadWholeSequences();
+    Minibatch ReadTruncated();
+
+    // switches to the next set of buffers and sets it up for 'numParallelSequences' x 'numTimeSteps' samples
+    void PrepareBuffers(size_t numParallelSequences, size_t numTimeSteps);
+
+    // declares (and zeroes) the time steps from 't' to the end of the minibatch of parallel sequence 's' as a gap
+    void AddGap(size_t s, size_t t, size_t numTimeSteps);
+
+    // copies 'numberOfSamples' samples, starting at 'firstSample', to time 't' of parallel sequence 's' and consecutive time steps
+    void CopySamples(const PackedSequence& sequence, size_t firstSample, size_t numberOfSamples, size_t s, size_t t);
+    Minibatch CreateMinibatch(bool endOfEpoch);
+
+    size_t GetSampleSize(StreamDescriptionPtr stream) const;
+    std::shared_ptr<char> AllocateBuffer(size_t numElements, size_t elementSize);
+
+    MemoryProviderPtr m_memoryProvider;
+    TransformerPtr m_transformer;
+    std::vector<StreamDescriptionPtr> m_outputStreams;
+    std::vector<StreamDescriptionPtr> m_inputStreams;
+    std::vector<std::shared_ptr<char>> m_streamBuffers; // the current set
+    std::vector<size_t> m_streamBufferCapacities; // in samples
+
+    // the sets of buffers of the previous minibatches, oldest first
+    std::deque<std::pair<std::vector<std::shared_ptr<char>>, std::vector<size_t>>> m_previousBuffers;
+    size_t m_numberOfBuffers;
+
+    MBLayoutPtr m_minibatchLayout;
+    size_t m_minibatchSize;
+    size_t m_truncationLength;
+    size_t m_numParallelSequences;
+    size_t m_bucketingWindow;
+
+    std::deque<PackedSequence> m_pool; // sequences requested from the transformer, but not placed yet
+    bool m_endOfInput;                 // the transformer has returned the last sequences of the epoch
+    UniqueSequenceId m_nextSequenceId;
+
+    // whole sequences: the sequences of the next minibatches, longest first within each minibatch
+    std::deque<std::vector<PackedSequence>> m_pendingMinibatches;
+    std::mt19937 m_rng;
+
+    // truncated BPTT: the sequences of each parallel sequence that reach into the next minibatch, and the time the next minibatch starts at
+    std::vector<std::deque<PackedSequence>> m_parallelSequences;
+    size_t m_currentTime;
+};
+
+typedef std::shared_ptr<SequencePacker> SequencePackerPtr;
+} } }
@@ -0,0 +1,52 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// StageTimer.h -- time spent in one stage of the reader pipeline, for IDataReader::GetStatistics()
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Accumulates the time of all calls of a stage. The calls may run concurrently (e.g. the per-sequence work of
+// MaterializeSequences()), so the sum is in thread-seconds and can exceed the elapsed time.
+class StageTimer
+{
+public:
+    StageTimer()
+        : m_ticks(0), m_calls(0)
+    {
+    }
+
+    template <class F>
+    void Time(F&& f)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        f();
+        m_ticks += (std::chrono::high_resolution_clock::now() - begin).count();
+        m_calls++;
+    }
+
+    // Adds "stage:<name>:seconds" and "stage:<name>:calls".
+    void AddTo(std::map<std::string, double>& stats, const std::string& name) const
+    {
+        typedef std::chrono::high_resolution_clock::period Period;
+        stats["stage:" + name + ":seconds"] += (double) m_ticks * Period::num / Period::den;
+        stats["stage:" + name + ":calls"] += (double) m_calls;
+    }
+
+private:
+    std::atomic<long long> m_ticks; // of high_resolution_clock
+    std::atomic<size_t> m_calls;
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+}}}
@@ -6,6 +6,10 @@
 #pragma once
 
 #include <vector>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
 #include "DataDeserializer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -29,6 +33,40 @@ struct Sequences
     bool m_endOfEpoch;
 };
 
+// Defines a set of sequences whose data is not materialized yet.
+// The data of sequence i is produced by calling m_fill(i, ...), which does all of the per-sequence work
+// (reading and decoding, then every transformation) in one go. Calls for different sequences may run
+// concurrently and in any order, so that one expensive sequence does not hold up the others,
+// and no stage has to wait for the previous stage to finish all sequences of the minibatch.
+struct DeferredSequences
+{
+    DeferredSequences()
+        : m_numberOfSequences(0), m_endOfEpoch(false)
+    {
+    }
+
+    size_t m_numberOfSequences;
+    std::function<void(size_t sequenceIndex, std::vector<SequenceDataPtr>& sequence)> m_fill;
+
+    // Indicates whether the epoch ends with the data returned.
+    bool m_endOfEpoch;
+};
+
+// Materializes all sequences of a DeferredSequences, in parallel.
+// Each result gets written into its preassigned slot, so completion order does not matter.
+inline Sequences MaterializeSequences(const DeferredSequences& deferred)
+{
+    Sequences result;
+    result.m_endOfEpoch = deferred.m_endOfEpoch;
+    result.m_data.resize(deferred.m_numberOfSequences);
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int) deferred.m_numberOfSequences; ++i)
+    {
+        deferred.m_fill(i, result.m_data[i]);
+    }
+    return result;
+}
+
 class Transformer;
 typedef std::shared_ptr<Transformer> TransformerPtr;
 
@@ -54,6 +92,28 @@ public:
     // The return value can be used until the next call to GetNextSequences.
     virtual Sequences GetNextSequences(size_t sampleCount) = 0;
 
+    // Same as GetNextSequences(), but leaves the per-sequence work to the caller, see DeferredSequences.
+    // This lets a chain of transformers process each sequence end-to-end on one thread.
+    // The return value can be used until the next call to GetNextSequences() or GetNextSequencesDeferred().
+    // The default implementation materializes all sequences upfront.
+    virtual DeferredSequences GetNextSequencesDeferred(size_t sampleCount)
+    {
+        auto sequences = std::make_shared<Sequences>(GetNextSequences(sampleCount));
+        DeferredSequences result;
+        result.m_numberOfSequences = sequences->m_data.size();
+        result.m_endOfEpoch = sequences->m_endOfEpoch;
+        result.m_fill = [sequences](size_t sequenceIndex, std::vector<SequenceDataPtr>& sequence)
+        {
+            sequence = sequences->m_data[sequenceIndex];
+        };
+        return result;
+    }
+
+    // Adds the counters of this transformer and of the ones it pulls from, see IDataReader::GetStatistics().
+    virtual void GetStatistics(std::map<std::string, double>& /*stats*/) const
+    {
+    }
+
     virtual ~Transformer()
     {
     }
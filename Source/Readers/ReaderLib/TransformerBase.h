@@ -9,6 +9,7 @@
 #include <set>
 
 #include "Transformer.h"
+#include "StageTimer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -38,32 +39,42 @@ public:
 
     // Gets next sequences up to a maximum count of samples.
     // Sequences contains data for all streams.
+    // Reading, decoding and all transformations of a sequence run back to back on one thread
+    // (see GetNextSequencesDeferred()), with a single parallel loop over the sequences of the minibatch.
     virtual Sequences GetNextSequences(size_t sampleCount) override
     {
-        assert(m_next != nullptr);
-        Sequences samples = m_next->GetNextSequences(sampleCount);
+        return MaterializeSequences(GetNextSequencesDeferred(sampleCount));
+    }
 
-        const auto &appliedStreamIds = GetAppliedStreamIds();
-        const auto &outputStreams = GetOutputStreams();
-        assert(m_inputStreams.size() == outputStreams.size());
+    // Chains this transformer's Apply() behind the per-sequence work of the transformers below.
+    virtual DeferredSequences GetNextSequencesDeferred(size_t sampleCount) override
+    {
+        assert(m_next != nullptr);
+        DeferredSequences samples = m_next->GetNextSequencesDeferred(sampleCount);
 
-#pragma omp parallel for ordered schedule(static)
-        for (int i = 0; i < samples.m_data.size(); ++i)
+        auto fillInput = samples.m_fill;
+        samples.m_fill = [this, fillInput](size_t sequenceIndex, std::vector<SequenceDataPtr>& sample)
         {
-            auto &sample = samples.m_data[i];
-            assert(sample.size() == m_inputStreams.size());
-
-            for (int j = 0; j < appliedStreamIds.size(); ++j)
-            {
-                size_t id = appliedStreamIds[j];
-                sample[id] = Apply(sample[id], *m_inputStreams[id], *outputStreams[id]);
-            }
-        }
-
+            fillInput(sequenceIndex, sample);
+            m_applyTimer.Time([&]() { ApplyToSample(sample); });
+        };
         return samples;
     }
 
+    // Adds the time spent in Apply() as stage "transform:<GetStageName()>".
+    virtual void GetStatistics(std::map<std::string, double>& stats) const override
+    {
+        m_applyTimer.AddTo(stats, "transform:" + GetStageName());
+        m_next->GetStatistics(stats);
+    }
+
 protected:
+    // Name of the transformation in the statistics.
+    virtual std::string GetStageName() const
+    {
+        return "transform";
+    }
+
     virtual const std::vector<StreamId> &GetAppliedStreamIds() const = 0;
     virtual const std::vector<StreamDescriptionPtr> &GetOutputStreams() const
     {
@@ -76,6 +87,21 @@ protected:
     }
 
 private:
+    // Applies the transformation to all applied streams of a single sample.
+    void ApplyToSample(std::vector<SequenceDataPtr> &sample)
+    {
+        const auto &appliedStreamIds = GetAppliedStreamIds();
+        const auto &outputStreams = GetOutputStreams();
+        assert(m_inputStreams.size() == outputStreams.size());
+        assert(sample.size() == m_inputStreams.size());
+
+        for (int j = 0; j < appliedStreamIds.size(); ++j)
+        {
+            size_t id = appliedStreamIds[j];
+            sample[id] = Apply(sample[id], *m_inputStreams[id], *outputStreams[id]);
+        }
+    }
+
     // Applies transformation to the sequence.
     virtual SequenceDataPtr Apply(SequenceDataPtr inputSequence,
                                   const StreamDescription &inputStream,
@@ -84,6 +110,7 @@ private:
     TransformerPtr m_next;
     std::vector<StreamId> m_featureStreamIds;
     std::vector<StreamDescriptionPtr> m_inputStreams;
+    StageTimer m_applyTimer;
 };
 
 }}}
@@ -1075,35 +1075,16 @@ bool UCIFastReader<ElemType>::DataEnd()
         return true;
 }
 
-template <class ElemType>
-unique_ptr<CUDAPageLockedMemAllocator>& UCIFastReader<ElemType>::GetCUDAAllocator(int deviceID)
-{
-    if (m_cudaAllocator != nullptr)
-    {
-        if (m_cudaAllocator->GetDeviceId() != deviceID)
-        {
-            m_cudaAllocator.reset(nullptr);
-        }
-    }
-
-    if (m_cudaAllocator == nullptr)
-    {
-        m_cudaAllocator.reset(new CUDAPageLockedMemAllocator(deviceID));
-    }
-
-    return m_cudaAllocator;
-}
-
 template <class ElemType>
 std::shared_ptr<ElemType> UCIFastReader<ElemType>::AllocateIntermediateBuffer(int deviceID, size_t numElements)
 {
     if (deviceID >= 0)
     {
-        // Use pinned memory for GPU devices for better copy performance
+        // Use pinned memory for GPU devices for better copy performance; pooled, since the buffers are reallocated whenever the minibatch size grows
         size_t totalSize = sizeof(ElemType) * numElements;
-        return std::shared_ptr<ElemType>((ElemType*) GetCUDAAllocator(deviceID)->Malloc(totalSize), [this, deviceID](ElemType* p)
+        return std::shared_ptr<ElemType>((ElemType*) CUDAPageLockedMemAllocator::MallocFromPool(totalSize, deviceID), [](ElemType* p)
                                          {
-                                             this->GetCUDAAllocator(deviceID)->Free((char*) p);
+                                             CUDAPageLockedMemAllocator::FreeToPool(p);
                                          });
     }
     else
@@ -99,8 +99,6 @@ private:
         */
     bool mOneLinePerFile;
 
-    unique_ptr<CUDAPageLockedMemAllocator> m_cudaAllocator;
-
     // caching support
     DataReader<ElemType>* m_cachingReader;
     DataWriter<ElemType>* m_cachingWriter;
@@ -124,7 +122,6 @@ private:
     virtual bool ReadRecord(size_t readSample);
 
     // Helper functions
-    unique_ptr<CUDAPageLockedMemAllocator>& GetCUDAAllocator(int deviceID);
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements);
 
 public:
@@ -0,0 +1,470 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "UCIDataDeserializer.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+#include "fileutil.h"
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ---------------------------------------------------------------------------
+// number parsing
+// Text numbers are converted as mantissa * 10^exponent with an integer mantissa, which is exact (correctly rounded)
+// for up to 19 digits, a mantissa below 2^53 and |exponent| <= 22; anything else goes to strtod().
+// Runs of 8 digits are converted at once within a 64-bit register (SWAR), which covers the long fractions
+// typical of tabular features with a few multiplications instead of a multiply-add per digit.
+// ---------------------------------------------------------------------------
+
+static const double s_powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// true if the 8 bytes are all ASCII digits
+static inline bool AreEightDigits(uint64_t chars)
+{
+    return (((chars & 0xF0F0F0F0F0F0F0F0ULL) | (((chars + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+// the value of 8 ASCII digits, the first one in the lowest byte (little endian)
+static inline uint32_t ParseEightDigits(uint64_t chars)
+{
+    chars -= 0x3030303030303030ULL;
+    chars = (chars * 10) + (chars >> 8); // pairs of digits
+    chars = (((chars & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+             (((chars >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return (uint32_t) chars;
+}
+
+// accumulates the digits at 'p' into 'mantissa'; returns the end of the digits
+// 'numDigits' counts all digits, also those beyond 19 that no longer fit (the caller then falls back to strtod())
+static inline const char* ParseDigits(const char* p, const char* end, uint64_t& mantissa, int& numDigits)
+{
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__) // (little endian, unaligned loads are fine)
+    while (end - p >= 8 && numDigits + 8 <= 19)
+    {
+        uint64_t chars;
+        memcpy(&chars, p, sizeof(chars));
+        if (!AreEightDigits(chars))
+            break;
+        mantissa = mantissa * 100000000ULL + ParseEightDigits(chars);
+        numDigits += 8;
+        p += 8;
+    }
+#endif
+    for (; p < end && (unsigned char) (*p - '0') < 10; p++, numDigits++)
+    {
+        if (numDigits < 19)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+    return p;
+}
+
+// parses the number that starts at 'p', up to 'end' at most; returns the end of the number, or nullptr if there is none
+static const char* ParseNumber(const char* p, const char* end, char decimalPoint, double& value)
+{
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int numDigits = 0;
+    p = ParseDigits(p, end, mantissa, numDigits);
+    int exponent = 0;
+    if (p < end && *p == decimalPoint)
+    {
+        const char* fraction = ++p;
+        p = ParseDigits(p, end, mantissa, numDigits);
+        exponent -= (int) (p - fraction);
+    }
+    if (numDigits == 0)
+        return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        int explicitExponent = 0;
+        const char* exponentDigits = q;
+        for (; q < end && (unsigned char) (*q - '0') < 10; q++)
+            explicitExponent = std::min(explicitExponent * 10 + (*q - '0'), 100000);
+        if (q == exponentDigits)
+            return nullptr;
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        p = q;
+    }
+
+    if (numDigits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double result = (double) mantissa;
+        result = exponent < 0 ? result / s_powersOf10[-exponent] : result * s_powersOf10[exponent];
+        value = negative ? -result : result;
+        return p;
+    }
+
+    // the slow path: strtod() on a copy, in which the decimal point is the C locale's
+    std::string token(start, p);
+    if (decimalPoint != '.')
+        std::replace(token.begin(), token.end(), decimalPoint, '.');
+    value = strtod(token.c_str(), nullptr);
+    return p;
+}
+
+// ---------------------------------------------------------------------------
+// UCIChunk -- the parsed samples of a chunk
+// ---------------------------------------------------------------------------
+
+class UCIDataDeserializer::UCIChunk : public Chunk, public std::enable_shared_from_this<UCIChunk>
+{
+    const UCIDataDeserializer& m_parent;
+    size_t m_chunkId;
+    std::vector<std::vector<char>> m_data; // [stream id] the samples of the chunk, one after the other
+    std::vector<size_t> m_sampleSizes;     // [stream id] in bytes
+
+public:
+    UCIChunk(const UCIDataDeserializer& parent, size_t chunkId)
+        : m_parent(parent), m_chunkId(chunkId)
+    {
+        const auto& chunk = m_parent.m_chunks[m_chunkId];
+
+        // read the chunk's bytes
+        std::vector<char> text(chunk.m_size);
+        FILE* f = fopenOrDie(m_parent.m_fileName, L"rb");
+        fsetpos(f, chunk.m_offset);
+        freadOrDie(text.data(), sizeof(char), chunk.m_size, f);
+        fclose(f);
+
+        // find the lines (sequentially; this is a fraction of the cost of parsing them)
+        const char* end = text.data() + chunk.m_size;
+        std::vector<std::pair<const char*, const char*>> lines;
+        lines.reserve(chunk.m_numberOfSequences);
+        for (const char* p = text.data(); p < end;)
+        {
+            const char* lineEnd = (const char*) memchr(p, '\n', end - p);
+            if (lineEnd == nullptr)
+                lineEnd = end;
+            const char* q = p;
+            while (q < lineEnd && m_parent.IsDelimiter(*q))
+                q++;
+            if (q < lineEnd) // (blank lines were not counted by CreateChunks())
+                lines.push_back(std::make_pair(q, lineEnd));
+            p = lineEnd + 1;
+        }
+        if (lines.size() != chunk.m_numberOfSequences)
+            RuntimeError("UCIDataDeserializer: '%ls' has changed since it was opened.", m_parent.m_fileName.c_str());
+
+        for (const auto& stream : m_parent.m_streams)
+        {
+            m_sampleSizes.push_back(stream->m_sampleLayout->GetNumElements() * GetSizeByType(stream->m_elementType));
+            m_data.push_back(std::vector<char>(m_sampleSizes.back() * lines.size()));
+        }
+
+        if (m_parent.m_streams.front()->m_elementType == ElementType::tfloat)
+            ParseLines<float>(lines);
+        else
+            ParseLines<double>(lines);
+    }
+
+    std::vector<SequenceDataPtr> GetSequence(const size_t& sequenceId) override
+    {
+        const auto& chunk = m_parent.m_chunks[m_chunkId];
+        assert(sequenceId >= chunk.m_firstSequence && sequenceId < chunk.m_firstSequence + chunk.m_numberOfSequences);
+        const size_t line = sequenceId - chunk.m_firstSequence;
+
+        std::vector<SequenceDataPtr> result;
+        result.reserve(m_parent.m_streams.size());
+        for (size_t streamId = 0; streamId < m_parent.m_streams.size(); ++streamId)
+        {
+            auto sequence = std::make_shared<DenseSequenceData>();
+            sequence->m_data = &m_data[streamId][line * m_sampleSizes[streamId]];
+            sequence->m_numberOfSamples = 1;
+            sequence->m_sampleLayout = m_parent.m_streams[streamId]->m_sampleLayout;
+            sequence->m_chunk = shared_from_this();
+            result.push_back(sequence);
+        }
+        return result;
+    }
+
+private:
+    template <class ElemType>
+    void ParseLines(const std::vector<std::pair<const char*, const char*>>& lines)
+    {
+        const auto& chunk = m_parent.m_chunks[m_chunkId];
+        ElemType* features = reinterpret_cast<ElemType*>(m_data[0].data());
+        ElemType* labels = m_data.size() > 1 ? reinterpret_cast<ElemType*>(m_data[1].data()) : nullptr;
+        const size_t featureDim = m_parent.m_dimFeatures;
+        const size_t labelDim = m_parent.m_labelDimension;
+
+        // exceptions must not leave the parallel region; the first error is rethrown after it
+        std::string error;
+        const int numLines = (int) lines.size();
+#pragma omp parallel for schedule(static, 256)
+        for (int i = 0; i < numLines; i++)
+        {
+            try
+            {
+                m_parent.ParseLine<ElemType>(lines[i].first, lines[i].second, chunk.m_firstSequence + i,
+                                             features + i * featureDim, labels ? labels + i * labelDim : nullptr);
+            }
+            catch (const std::exception& e)
+            {
+#pragma omp critical
+                if (error.empty())
+                    error = e.what();
+            }
+        }
+        if (!error.empty())
+            RuntimeError("%s", error.c_str());
+    }
+};
+
+// ---------------------------------------------------------------------------
+// UCIDataDeserializer
+// ---------------------------------------------------------------------------
+
+UCIDataDeserializer::UCIDataDeserializer(const ConfigParameters& config)
+{
+    std::string customDelimiter = config(L"customDelimiter", "");
+    m_customDelimiter = customDelimiter.empty() ? ' ' : customDelimiter[0];
+    std::string customDecimalPoint = config(L"customDecimalPoint", "");
+    m_decimalPoint = customDecimalPoint.empty() ? '.' : customDecimalPoint[0];
+    if (m_customDelimiter == m_decimalPoint)
+        InvalidArgument("UCIDataDeserializer: customDelimiter and customDecimalPoint must be different.");
+
+    std::string precision = config.Find("precision", "float");
+    ElementType elementType;
+    if (AreEqualIgnoreCase(precision, "float"))
+        elementType = ElementType::tfloat;
+    else if (AreEqualIgnoreCase(precision, "double"))
+        elementType = ElementType::tdouble;
+    else
+        RuntimeError("Not supported precision '%s'. Expected 'double' or 'float'.", precision.c_str());
+
+    std::vector<std::wstring> featureNames;
+    std::vector<std::wstring> labelNames;
+    GetFileConfigNames(config, featureNames, labelNames);
+    if (featureNames.empty() || !config.Exists(featureNames[0]))
+        RuntimeError("features file not found, required in configuration: i.e. 'features=[file=c:\\myfile.txt;start=1;dim=123]'");
+    const ConfigParameters& configFeatures = config(featureNames[0].c_str(), ConfigParameters::Record());
+    m_fileName = (const std::wstring&) configFeatures(L"file");
+    m_startFeatures = configFeatures(L"start", (size_t) 0);
+    m_dimFeatures = configFeatures(L"dim");
+
+    auto features = std::make_shared<StreamDescription>();
+    features->m_id = 0;
+    features->m_name = featureNames[0];
+    features->m_storageType = StorageType::dense;
+    features->m_elementType = elementType;
+    features->m_sampleLayout = std::make_shared<TensorShape>(m_dimFeatures);
+    m_streams.push_back(features);
+
+    m_startLabels = m_dimLabels = m_labelDimension = 0;
+    m_categoryLabels = false;
+    std::wstring labelType = L"none";
+    if (!labelNames.empty() && config.Exists(labelNames[0]))
+    {
+        const ConfigParameters& configLabels = config(labelNames[0].c_str(), ConfigParameters::Record());
+        labelType = (const std::wstring&) configLabels(L"labelType", L"category");
+        if (!EqualCI(labelType, L"none"))
+        {
+            if ((const std::wstring&) configLabels(L"file", L"") != m_fileName)
+                RuntimeError("features and label files must be the same file, use separate readers to define single use files");
+            m_startLabels = configLabels(L"start", (size_t) 0);
+            m_dimLabels = configLabels(L"dim", (size_t) 1);
+        }
+        if (EqualCI(labelType, L"category"))
+        {
+            if (m_dimLabels != 1)
+                InvalidArgument("UCIDataDeserializer: category labels must be a single column (dim=1).");
+            m_categoryLabels = true;
+            LoadLabelMapping((const std::wstring&) configLabels(L"labelMappingFile"));
+            m_labelDimension = std::max((size_t) configLabels(L"labelDim", (size_t) 0), m_labelToId.size());
+        }
+        else if (EqualCI(labelType, L"regression"))
+        {
+            m_labelDimension = m_dimLabels;
+        }
+        else if (!EqualCI(labelType, L"none"))
+        {
+            InvalidArgument("UCIDataDeserializer: labelType must be 'category', 'regression' or 'none'.");
+        }
+
+        if (m_labelDimension > 0)
+        {
+            auto labels = std::make_shared<StreamDescription>();
+            labels->m_id = 1;
+            labels->m_name = labelNames[0];
+            labels->m_storageType = StorageType::dense;
+            labels->m_elementType = elementType;
+            labels->m_sampleLayout = std::make_shared<TensorShape>(m_labelDimension);
+            m_streams.push_back(labels);
+        }
+    }
+
+    CreateChunks(config(L"chunkSizeInBytes", (size_t) 32 * 1024 * 1024));
+}
+
+void UCIDataDeserializer::LoadLabelMapping(const std::wstring& labelMappingFile)
+{
+    if (!fexists(labelMappingFile))
+        RuntimeError("label mapping file %ls not found, can be created with a 'createLabelMap' command/action\n", labelMappingFile.c_str());
+    for (const auto& line : msra::files::fgetfilelines(labelMappingFile))
+    {
+        std::string label = line;
+        label.erase(std::remove_if(label.begin(), label.end(), [](char c) { return c == '\r' || c == ' ' || c == '\t'; }), label.end());
+        if (!label.empty())
+            m_labelToId.insert(std::make_pair(label, m_labelToId.size()));
+    }
+}
+
+// Scans the file once for the line ends. Chunks are cut at the first line end after 'chunkSizeInBytes'.
+// Blank lines are skipped here and by UCIChunk alike.
+void UCIDataDeserializer::CreateChunks(size_t chunkSizeInBytes)
+{
+    FILE* f = fopenOrDie(m_fileName, L"rb");
+    std::vector<char> buffer(16 * 1024 * 1024);
+
+    uint64_t offset = 0;     // of the buffer in the file
+    uint64_t chunkStart = 0; // of the current chunk in the file
+    size_t chunkLines = 0;
+    bool lineHasContent = false;
+    auto addChunk = [&](uint64_t chunkEnd)
+    {
+        if (chunkLines > 0)
+        {
+            ChunkDescriptor chunk = { chunkStart, (size_t) (chunkEnd - chunkStart), m_sequenceDescriptions.size(), chunkLines };
+            for (size_t i = 0; i < chunkLines; i++)
+            {
+                SequenceDescription description;
+                description.m_id = m_sequenceDescriptions.size();
+                description.m_numberOfSamples = 1;
+                description.m_chunkId = m_chunks.size();
+                description.m_isValid = true;
+                m_sequenceDescriptions.push_back(description);
+            }
+            m_chunks.push_back(chunk);
+        }
+        chunkStart = chunkEnd;
+        chunkLines = 0;
+    };
+
+    for (;;)
+    {
+        size_t bytesRead = fread(buffer.data(), sizeof(char), buffer.size(), f);
+        if (bytesRead == 0)
+            break;
+        const char* p = buffer.data();
+        const char* end = p + bytesRead;
+        while (p < end)
+        {
+            if (!lineHasContent)
+            {
+                while (p < end && IsDelimiter(*p))
+                    p++;
+                lineHasContent = p < end && *p != '\n';
+            }
+            const char* lineEnd = (const char*) memchr(p, '\n', end - p);
+            if (lineEnd == nullptr)
+                break; // the line continues in the next buffer
+            if (lineHasContent)
+                chunkLines++;
+            lineHasContent = false;
+            p = lineEnd + 1;
+            uint64_t lineEndOffset = offset + (p - buffer.data());
+            if (lineEndOffset - chunkStart >= chunkSizeInBytes)
+                addChunk(lineEndOffset);
+        }
+        offset += bytesRead;
+    }
+    fclose(f);
+    if (lineHasContent) // last line without line end
+        chunkLines++;
+    addChunk(offset);
+
+    if (m_sequenceDescriptions.empty())
+        RuntimeError("UCIDataDeserializer: '%ls' contains no samples.", m_fileName.c_str());
+    fprintf(stderr, "UCIDataDeserializer: %d samples in %d chunks in '%ls'.\n", (int) m_sequenceDescriptions.size(), (int) m_chunks.size(), m_fileName.c_str());
+}
+
+template <class ElemType>
+void UCIDataDeserializer::ParseLine(const char* begin, const char* end, size_t lineNumber, ElemType* features, ElemType* labels) const
+{
+    const size_t featureEnd = m_startFeatures + m_dimFeatures;
+    const size_t labelEnd = m_startLabels + m_dimLabels;
+    const size_t lastColumn = std::max(featureEnd, labels ? labelEnd : 0);
+    if (labels && m_categoryLabels)
+        std::fill(labels, labels + m_labelDimension, (ElemType) 0);
+
+    const char* p = begin;
+    for (size_t column = 0; column < lastColumn; column++)
+    {
+        while (p < end && IsDelimiter(*p))
+            p++;
+        if (p == end)
+            RuntimeError("UCIDataDeserializer: Line %d of '%ls' has %d columns, expected at least %d.", (int) lineNumber + 1, m_fileName.c_str(), (int) column, (int) lastColumn);
+
+        const char* tokenEnd;
+        if (labels && m_categoryLabels && column == m_startLabels)
+        {
+            tokenEnd = p;
+            while (tokenEnd < end && !IsDelimiter(*tokenEnd))
+                tokenEnd++;
+            auto label = m_labelToId.find(std::string(p, tokenEnd));
+            if (label == m_labelToId.end())
+                RuntimeError("UCIDataDeserializer: Line %d of '%ls' has the label '%s', which is not in the label mapping file.", (int) lineNumber + 1, m_fileName.c_str(), std::string(p, tokenEnd).c_str());
+            labels[label->second] = 1;
+        }
+        else if ((column >= m_startFeatures && column < featureEnd) || (labels && column >= m_startLabels && column < labelEnd))
+        {
+            double value;
+            tokenEnd = ParseNumber(p, end, m_decimalPoint, value);
+            if (tokenEnd == nullptr || (tokenEnd < end && !IsDelimiter(*tokenEnd)))
+                RuntimeError("UCIDataDeserializer: Column %d in line %d of '%ls' is not a number.", (int) column, (int) lineNumber + 1, m_fileName.c_str());
+            if (column >= m_startFeatures && column < featureEnd)
+                features[column - m_startFeatures] = (ElemType) value;
+            else
+                labels[column - m_startLabels] = (ElemType) value;
+        }
+        else // a column that is not used
+        {
+            tokenEnd = p;
+            while (tokenEnd < end && !IsDelimiter(*tokenEnd))
+                tokenEnd++;
+        }
+        p = tokenEnd;
+    }
+}
+
+std::vector<StreamDescriptionPtr> UCIDataDeserializer::GetStreamDescriptions() const
+{
+    return m_streams;
+}
+
+void UCIDataDeserializer::FillSequenceDescriptions(SequenceDescriptions& timeline) const
+{
+    timeline.resize(m_sequenceDescriptions.size());
+    std::transform(
+        m_sequenceDescriptions.begin(),
+        m_sequenceDescriptions.end(),
+        timeline.begin(),
+        [](const SequenceDescription& desc)
+        {
+            return &desc;
+        });
+}
+
+ChunkPtr UCIDataDeserializer::GetChunk(size_t chunkId)
+{
+    if (chunkId >= m_chunks.size())
+        LogicError("Invalid chunk id %d, the file has %d chunks.", (int) chunkId, (int) m_chunks.size());
+    return std::make_shared<UCIChunk>(*this, chunkId);
+}
+
+} } }
@@ -0,0 +1,75 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include <unordered_map>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer for the UCI text format of the UCIFastReader: one sample per line, columns separated by blanks
+// (or 'customDelimiter'), with the features in columns [start, start + dim) and, optionally, a label column
+// (labelType=category, mapped through 'labelMappingFile' to a one-hot vector of 'labelDim') or label columns
+// (labelType=regression). The configuration is that of the UCIFastReader.
+// The file is split into chunks of about 'chunkSizeInBytes' at line boundaries by a single scan on construction,
+// which only counts lines. A chunk is parsed when it is requested, with its lines distributed over the cores.
+// Every line is a sequence of one sample, as required by the SampleModePacker.
+class UCIDataDeserializer : public DataDeserializerBase
+{
+public:
+    explicit UCIDataDeserializer(const ConfigParameters& config);
+
+    // Description of streams that this data deserializer provides.
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override;
+
+    // Gets a chunk; reads and parses its byte range of the file.
+    ChunkPtr GetChunk(size_t chunkId) override;
+
+protected:
+    void FillSequenceDescriptions(SequenceDescriptions& timeline) const override;
+
+private:
+    class UCIChunk;
+
+    // A byte range of the file that holds complete lines.
+    struct ChunkDescriptor
+    {
+        uint64_t m_offset;
+        size_t m_size;
+        size_t m_firstSequence;
+        size_t m_numberOfSequences;
+    };
+
+    void CreateChunks(size_t chunkSizeInBytes);
+    void LoadLabelMapping(const std::wstring& labelMappingFile);
+
+    // parses the line [begin, end) into 'features' and 'labels'; 'lineNumber' is for error messages
+    template <class ElemType>
+    void ParseLine(const char* begin, const char* end, size_t lineNumber, ElemType* features, ElemType* labels) const;
+
+    bool IsDelimiter(char c) const
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == m_customDelimiter;
+    }
+
+    std::wstring m_fileName;
+    char m_customDelimiter;
+    char m_decimalPoint;
+
+    size_t m_startFeatures;
+    size_t m_dimFeatures;
+    size_t m_startLabels;
+    size_t m_dimLabels;        // columns of the labels in the file
+    size_t m_labelDimension;   // elements of a label sample (the one-hot dimension for category labels)
+    bool m_categoryLabels;
+    std::unordered_map<std::string, size_t> m_labelToId;
+
+    std::vector<ChunkDescriptor> m_chunks;
+    std::vector<SequenceDescription> m_sequenceDescriptions;
+};
+
+} } }
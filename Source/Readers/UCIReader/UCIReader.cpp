@@ -0,0 +1,82 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "UCIReader.h"
+#include "UCIDataDeserializer.h"
+#include "BlockRandomizer.h"
+#include "NoRandomizer.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+UCIReader::UCIReader(MemoryProviderPtr provider,
+                     const ConfigParameters& config)
+    : m_provider(provider), m_numberOfBuffers(1)
+{
+    auto deserializer = std::make_shared<UCIDataDeserializer>(config);
+    m_streams = deserializer->GetStreamDescriptions();
+
+    // 'randomize' of the UCIFastReader: 'auto', 'none', or a randomization window in samples
+    std::string randomize = config(L"randomize", "auto");
+    TransformerPtr randomizer;
+    if (AreEqualIgnoreCase(randomize, "auto"))
+    {
+        size_t randomizationWindow = config(L"randomizationWindow", (size_t) SIZE_MAX);
+        randomizer = std::make_shared<BlockRandomizer>(0, randomizationWindow, deserializer);
+    }
+    else if (AreEqualIgnoreCase(randomize, "none"))
+    {
+        randomizer = std::make_shared<NoRandomizer>(deserializer);
+    }
+    else
+    {
+        size_t randomizationWindow = config(L"randomize");
+        randomizer = std::make_shared<BlockRandomizer>(0, randomizationWindow, deserializer);
+    }
+
+    randomizer->Initialize(nullptr, config);
+    m_transformer = randomizer;
+}
+
+std::vector<StreamDescriptionPtr> UCIReader::GetStreamDescriptions()
+{
+    assert(!m_streams.empty());
+    return m_streams;
+}
+
+void UCIReader::StartEpoch(const EpochConfiguration& config)
+{
+    if (config.m_totalEpochSizeInSamples <= 0)
+    {
+        RuntimeError("Unsupported minibatch size '%u'.", (int)config.m_totalEpochSizeInSamples);
+    }
+
+    m_transformer->StartEpoch(config);
+    m_packer = std::make_shared<SampleModePacker>(
+        m_provider,
+        m_transformer,
+        config.m_minibatchSizeInSamples,
+        m_streams,
+        m_numberOfBuffers);
+}
+
+bool UCIReader::SetMemoryProvider(MemoryProviderPtr provider, size_t numberOfBuffers)
+{
+    m_provider = provider;
+    m_numberOfBuffers = numberOfBuffers;
+    if (m_packer != nullptr)
+    {
+        m_packer->SetMemoryProvider(provider, numberOfBuffers);
+    }
+    return true;
+}
+
+Minibatch UCIReader::ReadMinibatch()
+{
+    assert(m_packer != nullptr);
+    return m_packer->ReadMinibatch();
+}
+} } }
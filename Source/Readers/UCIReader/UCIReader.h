@@ -0,0 +1,58 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "Reader.h"
+#include "SampleModePacker.h"
+#include "Config.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Reader for UCI format text files on the ReaderLib pipeline, as an alternative to the UCIFastReader with the same configuration.
+// Connects the UCIDataDeserializer, a randomizer and the packer together, which brings distributed reading
+// and chunk prefetching; randomization replaces the cache files of the UCIFastReader.
+class UCIReader : public Reader
+{
+public:
+    UCIReader(MemoryProviderPtr provider,
+              const ConfigParameters& parameters);
+
+    // Description of streams that this reader provides.
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() override;
+
+    // Starts a new epoch with the provided configuration.
+    void StartEpoch(const EpochConfiguration& config) override;
+
+    // Reads a single minibatch.
+    Minibatch ReadMinibatch() override;
+
+    // Lets the packer allocate its buffers from the provider, keeping numberOfBuffers minibatches.
+    bool SetMemoryProvider(MemoryProviderPtr provider, size_t numberOfBuffers) override;
+
+    // The counters of the transformers, the randomizer and the deserializer.
+    void GetStatistics(std::map<std::string, double>& stats) const override
+    {
+        m_transformer->GetStatistics(stats);
+    }
+
+private:
+    // All streams this reader provides.
+    std::vector<StreamDescriptionPtr> m_streams;
+
+    // A head transformer in a list of transformers.
+    TransformerPtr m_transformer;
+
+    // Packer (every line is a sample).
+    SampleModePackerPtr m_packer;
+
+    // Memory provider (TODO: this will possibly change in the near future.)
+    MemoryProviderPtr m_provider;
+
+    // Number of minibatches whose data the packer keeps valid, see Reader::SetMemoryProvider().
+    size_t m_numberOfBuffers;
+};
+
+}}}
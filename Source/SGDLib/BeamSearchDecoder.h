@@ -0,0 +1,323 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// BeamSearchDecoder.h -- beam search over a recurrent model that is fed its own previous output token
+//
+// The network has an input node that receives the previous token (one-hot, dense or sparse) and an output node that
+// scores the next one ([V]: log-probabilities, or unnormalized scores that are log-softmax-normalized here).
+// The network is driven one step at a time: each step is a minibatch of a single time step, in which each live hypothesis
+// of all decodes is one parallel sequence. The recurrences (PastValue nodes) carry their state from one step to the next
+// the same way they carry it across minibatches in truncated BPTT. After each step, the best 'beamSize' extensions of each
+// decode survive, and the carried state of the stateful nodes is permuted so that every survivor continues from the state
+// of the hypothesis it extends. The top-k candidates of each hypothesis are found on the device, so only k scores per
+// hypothesis are copied back; the state and candidate buffers are kept from one step to the next.
+//
+// Each decode first feeds the start token and then its prompt tokens (teacher-forced), and then searches until all of its
+// hypotheses have produced the end token or 'maxLength' tokens. The score of a hypothesis is the log-probability of the
+// tokens after the prompt.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "ComputationNode.h"
+#include "RecurrentNodes.h"
+#include "Sequences.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class BeamSearchDecoder
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+
+public:
+    struct Hypothesis
+    {
+        std::vector<size_t> m_tokens; // generated after the prompt, including the end token if it was reached
+        double m_score;               // log-probability of m_tokens
+    };
+
+    BeamSearchDecoder(ComputationNetworkPtr net, const std::wstring& inputNodeName, const std::wstring& outputNodeName,
+                      size_t beamSize, size_t maxLength, size_t startToken, size_t endToken, bool normalize)
+        : m_net(net), m_beamSize(beamSize), m_maxLength(maxLength), m_startToken(startToken), m_endToken(endToken), m_normalize(normalize),
+          m_logProbs(net->GetDeviceId()), m_topIndexes(net->GetDeviceId()), m_topValues(net->GetDeviceId())
+    {
+        if (m_beamSize == 0)
+            InvalidArgument("BeamSearchDecoder: beamSize must be at least 1.");
+        m_inputNode = dynamic_pointer_cast<ComputationNode<ElemType>>(m_net->GetNodeFromName(inputNodeName));
+        m_outputNode = dynamic_pointer_cast<ComputationNode<ElemType>>(m_net->GetNodeFromName(outputNodeName));
+        if (!m_inputNode || !m_outputNode)
+            InvalidArgument("BeamSearchDecoder: Input node '%ls' or output node '%ls' has the wrong element type.", inputNodeName.c_str(), outputNodeName.c_str());
+
+        // the token input must be the only minibatch input the output depends on, since nothing else is fed
+        bool feedsOutput = false;
+        for (const auto& node : m_net->InputNodes(m_outputNode))
+        {
+            if (node == m_inputNode)
+                feedsOutput = true;
+            else if (node->HasMBLayout())
+                InvalidArgument("BeamSearchDecoder: Output node '%ls' depends on input '%ls', but only the token input '%ls' is fed.",
+                                outputNodeName.c_str(), node->NodeName().c_str(), inputNodeName.c_str());
+        }
+        if (!feedsOutput)
+            InvalidArgument("BeamSearchDecoder: Output node '%ls' does not depend on input node '%ls'.", outputNodeName.c_str(), inputNodeName.c_str());
+        if (m_outputNode->GetSampleMatrixNumRows() > m_inputNode->GetSampleMatrixNumRows())
+            InvalidArgument("BeamSearchDecoder: Output node '%ls' scores more tokens than input node '%ls' can take.", outputNodeName.c_str(), inputNodeName.c_str());
+        if (m_startToken >= m_inputNode->GetSampleMatrixNumRows())
+            InvalidArgument("BeamSearchDecoder: startToken %d is out of the range of input node '%ls'.", (int) m_startToken, inputNodeName.c_str());
+
+        // the state of these nodes is permuted along with the hypotheses
+        for (const auto& node : m_outputNode->EnumerateNodes())
+        {
+            if (node->OperationName() == L"FutureValue" || node->OperationName() == L"LSTMCell" || node->OperationName() == L"GRUCell")
+                InvalidArgument("BeamSearchDecoder: %ls %ls operation cannot be decoded step by step.", node->NodeName().c_str(), node->OperationName().c_str());
+            auto statefulNode = dynamic_pointer_cast<IStatefulNode>(node);
+            if (statefulNode)
+                m_statefulNodes[node->NodeName()] = statefulNode;
+        }
+
+        m_net->AllocateAllMatrices({}, std::vector<ComputationNodeBasePtr>{m_outputNode}, nullptr);
+    }
+
+    // decodes all prompts together; for each, returns up to beamSize hypotheses, best first
+    std::vector<std::vector<Hypothesis>> Decode(const std::vector<std::vector<size_t>>& prompts)
+    {
+        const size_t numDecodes = prompts.size();
+        const size_t inputDim = m_inputNode->GetSampleMatrixNumRows();
+        for (const auto& prompt : prompts)
+        {
+            for (size_t token : prompt)
+                if (token >= inputDim)
+                    InvalidArgument("BeamSearchDecoder: Prompt token %d is out of the range of input node '%ls'.", (int) token, m_inputNode->NodeName().c_str());
+        }
+
+        // the live hypotheses, in the order of the parallel sequences of the next step
+        std::vector<LiveHypothesis> live(numDecodes);
+        for (size_t d = 0; d < numDecodes; d++)
+        {
+            live[d].m_decode = d;
+            live[d].m_score = 0;
+        }
+        std::vector<size_t> tokens(numDecodes, m_startToken);
+        std::vector<std::vector<Hypothesis>> finished(numDecodes);
+
+        m_net->StartEvaluateMinibatchLoop(ComputationNodeBasePtr(m_outputNode));
+        for (size_t step = 0; !live.empty(); step++)
+        {
+            RunStep(tokens, step);
+
+            // the best next tokens of each live hypothesis
+            const Matrix<ElemType>& scores = m_outputNode->Value();
+            const Matrix<ElemType>* logProbs = &scores;
+            if (m_normalize)
+            {
+                m_logProbs.AssignLogSoftmaxOf(scores, true);
+                logProbs = &m_logProbs;
+            }
+            const size_t k = std::min(m_beamSize, logProbs->GetNumRows());
+            logProbs->VectorMax(m_topIndexes, m_topValues, true, (int) k);
+            m_topIndexesHost.resize(k * live.size());
+            m_topValuesHost.resize(k * live.size());
+            ElemType* pIndexes = m_topIndexesHost.data();
+            ElemType* pValues = m_topValuesHost.data();
+            size_t numIndexes = m_topIndexesHost.size(), numValues = m_topValuesHost.size();
+            m_topIndexes.CopyToArray(pIndexes, numIndexes);
+            m_topValues.CopyToArray(pValues, numValues);
+
+            // extend the hypotheses of each decode; those still in their prompt take the next prompt token
+            std::vector<LiveHypothesis> next;
+            std::vector<size_t> parents;
+            std::vector<size_t> nextTokens;
+            std::vector<Candidate> candidates;
+            size_t begin = 0;
+            while (begin < live.size())
+            {
+                const size_t d = live[begin].m_decode;
+                size_t end = begin;
+                while (end < live.size() && live[end].m_decode == d)
+                    end++;
+
+                if (step < prompts[d].size())
+                {
+                    next.push_back(live[begin]);
+                    parents.push_back(begin);
+                    nextTokens.push_back(prompts[d][step]);
+                    begin = end;
+                    continue;
+                }
+
+                candidates.clear();
+                for (size_t s = begin; s < end; s++)
+                {
+                    for (size_t i = 0; i < k; i++)
+                        candidates.push_back(Candidate{live[s].m_score + (double) m_topValuesHost[s * k + i], s, (size_t) m_topIndexesHost[s * k + i]});
+                }
+                std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+                          {
+                              return a.m_score > b.m_score;
+                          });
+                if (candidates.size() > m_beamSize)
+                    candidates.resize(m_beamSize);
+
+                const size_t length = step + 1 - prompts[d].size(); // of the extended hypotheses
+                for (const auto& candidate : candidates)
+                {
+                    // (with normalized scores, a hypothesis can only get worse, so it is dropped once the beam is full of better finished ones)
+                    auto& done = finished[d];
+                    if (m_normalize && done.size() >= m_beamSize && done.back().m_score >= candidate.m_score)
+                        continue;
+                    LiveHypothesis extended = live[candidate.m_parent];
+                    extended.m_tokens.push_back(candidate.m_token);
+                    extended.m_score = candidate.m_score;
+                    if (candidate.m_token == m_endToken || length >= m_maxLength)
+                        AddFinished(done, extended);
+                    else
+                    {
+                        next.push_back(extended);
+                        parents.push_back(candidate.m_parent);
+                        nextTokens.push_back(candidate.m_token);
+                    }
+                }
+                begin = end;
+            }
+            tokens.swap(nextTokens);
+
+            if (!next.empty())
+                PermuteState(parents, live.size());
+            live.swap(next);
+        }
+        return finished;
+    }
+
+private:
+    struct LiveHypothesis : Hypothesis
+    {
+        size_t m_decode; // index into the prompts
+    };
+
+    struct Candidate
+    {
+        double m_score;
+        size_t m_parent; // parallel sequence of the hypothesis it extends
+        size_t m_token;
+    };
+
+    // insert 'h' into the finished hypotheses of a decode, which are kept sorted best first and no more than beamSize
+    void AddFinished(std::vector<Hypothesis>& done, const Hypothesis& h)
+    {
+        auto pos = std::upper_bound(done.begin(), done.end(), h, [](const Hypothesis& a, const Hypothesis& b)
+                                    {
+                                        return a.m_score > b.m_score;
+                                    });
+        done.insert(pos, h);
+        if (done.size() > m_beamSize)
+            done.pop_back();
+    }
+
+    // runs one time step, with one parallel sequence per token; all but the first step continue the sequences of the previous one
+    void RunStep(const std::vector<size_t>& tokens, size_t step)
+    {
+        const size_t numSequences = tokens.size();
+        const size_t inputDim = m_inputNode->GetSampleMatrixNumRows();
+        auto pMBLayout = m_net->GetMBLayoutPtr();
+        pMBLayout->Init(numSequences, 1);
+        for (size_t s = 0; s < numSequences; s++)
+            pMBLayout->AddSequence(NEW_SEQUENCE_ID, s, step == 0 ? 0 : -1, 2); // (the sequences always extend beyond the step, so that the state is carried over)
+
+        Matrix<ElemType>& input = m_inputNode->Value();
+        if (input.GetMatrixType() == MatrixType::SPARSE)
+        {
+            m_colStarts.resize(numSequences + 1);
+            m_rowIndices.resize(numSequences);
+            m_ones.assign(numSequences, 1);
+            for (size_t s = 0; s < numSequences; s++)
+            {
+                m_colStarts[s] = (CPUSPARSE_INDEX_TYPE) s;
+                m_rowIndices[s] = (CPUSPARSE_INDEX_TYPE) tokens[s];
+            }
+            m_colStarts[numSequences] = (CPUSPARSE_INDEX_TYPE) numSequences;
+            input.SetMatrixFromCSCFormat(m_colStarts.data(), m_rowIndices.data(), m_ones.data(), numSequences, inputDim, numSequences);
+        }
+        else
+        {
+            m_oneHot.assign(inputDim * numSequences, 0);
+            for (size_t s = 0; s < numSequences; s++)
+                m_oneHot[s * inputDim + tokens[s]] = 1;
+            input.SetValue(inputDim, numSequences, input.GetDeviceId(), m_oneHot.data(), matrixFlagNormal);
+        }
+        m_inputNode->NotifyFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(std::vector<ComputationNodeBasePtr>{m_inputNode});
+
+        m_net->ForwardProp(ComputationNodeBasePtr(m_outputNode));
+    }
+
+    // let the hypotheses of the next step continue from the state of their parents (parallel sequences of the last step)
+    void PermuteState(const std::vector<size_t>& parents, size_t numPrevSequences)
+    {
+        bool isIdentity = parents.size() == numPrevSequences;
+        for (size_t s = 0; s < parents.size() && isIdentity; s++)
+            isIdentity = parents[s] == s;
+        if (isIdentity)
+            return;
+
+        auto pMBLayout = make_shared<MBLayout>();
+        pMBLayout->Init(parents.size(), 1);
+        for (size_t s = 0; s < parents.size(); s++)
+            pMBLayout->AddSequence(NEW_SEQUENCE_ID, s, -1, 2);
+        for (const auto& iter : m_statefulNodes)
+        {
+            auto state = dynamic_pointer_cast<DelayedValueNodeState<ElemType>>(iter.second->ExportState());
+            if (!state)
+                RuntimeError("BeamSearchDecoder: The state of node %ls cannot be permuted.", iter.first.c_str());
+            auto& permutedState = m_permutedStates[iter.first];
+            if (!permutedState)
+                permutedState = make_shared<DelayedValueNodeState<ElemType>>(m_net->GetDeviceId());
+            if (!state->IsEmpty())
+            {
+                const Matrix<ElemType>& activity = state->ExportCachedActivity(); // [rows x numPrevSequences]
+                auto& buffer = m_permuteBuffers[iter.first];
+                if (!buffer)
+                    buffer = make_shared<Matrix<ElemType>>(m_net->GetDeviceId());
+                buffer->Resize(activity.GetNumRows(), parents.size());
+                for (size_t s = 0; s < parents.size(); s++)
+                    buffer->SetColumnSlice(activity.ColumnSlice(parents[s], 1), s, 1);
+                permutedState->CacheState(*buffer);
+            }
+            permutedState->CacheDelayedMBLayout(pMBLayout);
+            iter.second->ImportState(permutedState);
+        }
+    }
+
+    ComputationNetworkPtr m_net;
+    ComputationNodePtr m_inputNode;
+    ComputationNodePtr m_outputNode;
+    size_t m_beamSize;
+    size_t m_maxLength;
+    size_t m_startToken;
+    size_t m_endToken;
+    bool m_normalize; // apply log-softmax to the output
+
+    std::map<std::wstring, shared_ptr<IStatefulNode>> m_statefulNodes;
+    std::map<std::wstring, shared_ptr<DelayedValueNodeState<ElemType>>> m_permutedStates; // [node name] reused from step to step
+    std::map<std::wstring, shared_ptr<Matrix<ElemType>>> m_permuteBuffers;
+
+    // per-step buffers
+    Matrix<ElemType> m_logProbs;
+    Matrix<ElemType> m_topIndexes; // [k x numSequences]
+    Matrix<ElemType> m_topValues;
+    std::vector<ElemType> m_topIndexesHost;
+    std::vector<ElemType> m_topValuesHost;
+    std::vector<ElemType> m_oneHot;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_colStarts;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_rowIndices;
+    std::vector<ElemType> m_ones;
+};
+} } }
@@ -0,0 +1,108 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "CheckpointWriter.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+CheckpointWriter::CheckpointWriter(DEVICEID_TYPE deviceId, double maxBytesPerSecond)
+    : m_deviceId(deviceId),
+      m_maxBytesPerSecond(maxBytesPerSecond),
+      m_bytesWritten(0)
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    try
+    {
+        Wait();
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "CheckpointWriter: Writing the last checkpoint failed: %s\n", e.what());
+    }
+}
+
+void* CheckpointWriter::GetHostBuffer(const wstring& key, size_t bytes)
+{
+    auto& buffer = m_hostBuffers[key];
+    auto& bufferBytes = m_hostBufferBytes[key];
+    if (!buffer || bufferBytes < bytes)
+    {
+        buffer.reset(); // free before allocating, page-locked memory is precious
+        const DEVICEID_TYPE deviceId = m_deviceId;
+        void* p = deviceId >= 0 ? CUDAPageLockedMemAllocator::Malloc(bytes, deviceId) : nullptr;
+        if (p)
+            buffer = shared_ptr<void>(p, [deviceId](void* q) { CUDAPageLockedMemAllocator::Free(q, deviceId); });
+        else if ((p = malloc(bytes)) != nullptr) // CPU, or a CPU-only build
+            buffer = shared_ptr<void>(p, [](void* q) { free(q); });
+        else
+            RuntimeError("CheckpointWriter: Out of host memory for the snapshot of '%ls' (%d MB).", key.c_str(), (int) (bytes >> 20));
+        bufferBytes = bytes;
+    }
+    return buffer.get();
+}
+
+void CheckpointWriter::Start(const function<void()>& write)
+{
+    Wait();
+    m_writeTimer.Restart();
+    m_bytesWritten = 0;
+    m_thread = thread([this, write]()
+                      {
+                          try
+                          {
+                              write();
+                          }
+                          catch (...)
+                          {
+                              m_error = current_exception();
+                          }
+                      });
+}
+
+void CheckpointWriter::Wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+    if (m_error)
+    {
+        exception_ptr error = m_error;
+        m_error = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+function<void(File&)> CheckpointWriter::ThrottleFile()
+{
+    auto lastPosition = make_shared<uint64_t>(0);
+    return [this, lastPosition](File& file)
+    {
+        uint64_t position = file.GetPosition();
+        Throttle(position - *lastPosition);
+        *lastPosition = position;
+    };
+}
+
+// sleeps until the bytes written so far are within the bandwidth limit
+void CheckpointWriter::Throttle(uint64_t bytes)
+{
+    m_bytesWritten += bytes;
+    if (m_maxBytesPerSecond <= 0)
+        return;
+    double ahead = m_bytesWritten / m_maxBytesPerSecond - m_writeTimer.ElapsedSeconds();
+    if (ahead > 0)
+        this_thread::sleep_for(chrono::duration<double>(ahead));
+}
+} } }
@@ -0,0 +1,84 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CheckpointWriter.h -- writes models and checkpoints on a background thread, so that training resumes right away
+//
+// The training thread takes a snapshot of everything to be written into host memory (SnapshotToHost(); the buffers are
+// page-locked for a GPU, so the copy runs at full PCIe speed, and are reused from one checkpoint to the next), and then
+// hands a function that writes the snapshot to Start(). Files are written under a temporary name and renamed when
+// complete (ComputationNetwork::Save() and SGD::SaveCheckPointInfo() do that), so a crash never leaves a partial file.
+// With a bandwidth limit, Throttle() paces the writing to spare the I/O of the training (readers, other jobs).
+// There is at most one write in flight; Start() and SnapshotToHost() wait for the previous one, and Wait() must be
+// called before reading back any file written here, which rethrows the exception of a failed write.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "File.h"
+#include "Matrix.h"
+#include "TimerUtility.h"
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class CheckpointWriter
+{
+public:
+    // 'maxBytesPerSecond' = 0: not throttled
+    CheckpointWriter(DEVICEID_TYPE deviceId, double maxBytesPerSecond);
+    ~CheckpointWriter();
+
+    // copies 'matrix' into host memory kept under 'key' for the next write
+    template <class ElemType>
+    shared_ptr<Matrix<ElemType>> SnapshotToHost(const std::wstring& key, const Matrix<ElemType>& matrix);
+
+    // runs 'write' on the background thread
+    void Start(const std::function<void()>& write);
+    void Wait();
+    bool IsWriting() const
+    {
+        return m_thread.joinable();
+    }
+
+    // a progress callback for ComputationNetwork::Save() and the like, which throttles the writing of one file
+    std::function<void(File&)> ThrottleFile();
+
+private:
+    void* GetHostBuffer(const std::wstring& key, size_t bytes);
+    void Throttle(uint64_t bytes);
+
+    DEVICEID_TYPE m_deviceId;
+    double m_maxBytesPerSecond;
+    std::map<std::wstring, std::shared_ptr<void>> m_hostBuffers; // [key] page-locked (GPU) or plain host memory
+    std::map<std::wstring, size_t> m_hostBufferBytes;
+
+    std::thread m_thread;
+    std::exception_ptr m_error;
+    Timer m_writeTimer;   // since Start()
+    uint64_t m_bytesWritten; // since Start()
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+};
+
+template <class ElemType>
+shared_ptr<Matrix<ElemType>> CheckpointWriter::SnapshotToHost(const std::wstring& key, const Matrix<ElemType>& matrix)
+{
+    Wait(); // the previous write may still use the buffer
+    if (matrix.GetMatrixType() == MatrixType::SPARSE || matrix.GetNumElements() == 0)
+        return make_shared<Matrix<ElemType>>(matrix, CPUDEVICE);
+
+    size_t numElements = matrix.GetNumElements();
+    ElemType* buffer = (ElemType*) GetHostBuffer(key, numElements * sizeof(ElemType));
+    auto snapshot = make_shared<Matrix<ElemType>>(matrix.GetNumRows(), matrix.GetNumCols(), buffer, CPUDEVICE, matrixFlagDontOwnBuffer);
+    matrix.CopyToArray(buffer, numElements);
+    return snapshot;
+}
+} } }
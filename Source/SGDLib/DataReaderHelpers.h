@@ -6,6 +6,7 @@
 #include "DataReader.h"
 #include "ComputationNetwork.h"
 #include "MPIWrapper.h"
+#include "MemoryAccounting.h"
 #include "SpecialPurposeNodes.h"        // for SequenceWithSoftmaxNode
 #include <string>
 #include <map>
@@ -40,7 +41,11 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         //  - CopyMBLayoutTo()   --copies the MBLayout from Reader to Network
         // with the special twist that in presence of parallelization, there is some decimation involved.
 
-        bool wasDataRead = trainSetDataReader.GetMinibatch(inputMatrices); // fill in the minibatch data into the Input nodes' buffers directly
+        bool wasDataRead;
+        {
+            MemoryAccounting::Context memory(MemoryAccounting::readerBuffer);
+            wasDataRead = trainSetDataReader.GetMinibatch(inputMatrices); // fill in the minibatch data into the Input nodes' buffers directly
+        }
         // If this returns false, the matrices may contain garbage or not sized to 0 columns.
         // On the other hand, if it returns a 0-column matrix, that would be a perfectly cromulent minibatch (in case of data parallelism with distributed reading).
         // If a passed matrix does not match a reader section, that is an error.
@@ -92,6 +97,44 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     // -------------------------------------------------------------------
     // DecimateMinibatch - decimate minibatch for parallelization
     // -------------------------------------------------------------------
+    // decimation of the MBLayout alone, e.g. when the matrices are sliced by reference instead
+    // returns the subset of parallel sequences selected for 'rank'
+    static pair<size_t, size_t> DecimateMBLayout(MBLayoutPtr pMBLayout,          // input MBLayout
+                                                 MBLayoutPtr& pDecimateMBLayout, // output decimated MBLayout (note: cannot work in-place)
+                                                 int numWorker, int rank)
+    {
+        size_t numParallelSequences = pMBLayout->GetNumParallelSequences();
+        size_t nT = pMBLayout->GetNumTimeSteps();
+
+        // decide start column and end column
+        size_t st = numParallelSequences * (size_t) rank / numWorker;
+        size_t en = numParallelSequences * (size_t)(rank + 1) / numWorker;
+        en = en > numParallelSequences ? numParallelSequences : en; // TODO: why are these two tests necessary?
+        en = (rank == numWorker - 1) ? numParallelSequences : en;
+        size_t numNewParallelSequence = en - st;
+
+        pDecimateMBLayout = make_shared<MBLayout>(numNewParallelSequence, nT);
+#if 1
+        // now copy over all sequence info records that are inside the range, with adjusted 's'
+        const auto& sequences = pMBLayout->GetAllSequences();
+        for (const auto& seq : sequences)
+        {
+            if (seq.s >= st && seq.s < en)
+            {
+                auto shiftedSeq = seq;
+                shiftedSeq.s -= st; // these sequences have shifted up by 'st' sequences
+                pDecimateMBLayout->AddSequence(shiftedSeq);
+            }
+        }
+#else
+        for (size_t t = 0; t < nT; t++)
+            for (size_t id = 0; id < numNewParallelSequence; id++)
+                pDecimateMBLayout->Set(id, t, pMBLayout->Get(id + st, t));
+#endif
+
+        return pair<size_t, size_t>(st, en);
+    }
+
     // non-inplace decimation , to be used in subminibatch implementation
     // returns a subset of parallel sequences
     template <class ElemType>
@@ -104,11 +147,10 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         size_t numParallelSequences = pMBLayout->GetNumParallelSequences();
         size_t nT = pMBLayout->GetNumTimeSteps();
 
-        // decide start column and end column
-        size_t st = numParallelSequences * (size_t) rank / numWorker;
-        size_t en = numParallelSequences * (size_t)(rank + 1) / numWorker;
-        en = en > numParallelSequences ? numParallelSequences : en; // TODO: why are these two tests necessary?
-        en = (rank == numWorker - 1) ? numParallelSequences : en;
+        // decimate MBLayout, which also decides start column and end column
+        pair<size_t, size_t> selected = DecimateMBLayout(pMBLayout, pDecimateMBLayout, numWorker, rank);
+        size_t st = selected.first;
+        size_t en = selected.second;
         size_t numNewParallelSequence = en - st;
 
         // begin decimate matrices
@@ -135,27 +177,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             // If we had a RowSlice function, we would like to write in this way
             // decimatedMB[name]->SetValue(mat.Reshaped(nRows*nSequence, nT).RowSlice( st*nRows , (en-st)*nRows).Reshaped(nRows, nNewParallelSequence*nT));
         }
-        // decimate MBLayout as well
-        pDecimateMBLayout = make_shared<MBLayout>(numNewParallelSequence, nT);
-#if 1
-        // now copy over all sequence info records that are inside the range, with adjusted 's'
-        const auto& sequences = pMBLayout->GetAllSequences();
-        for (const auto& seq : sequences)
-        {
-            if (seq.s >= st && seq.s < en)
-            {
-                auto shiftedSeq = seq;
-                shiftedSeq.s -= st; // these sequences have shifted up by 'st' sequences
-                pDecimateMBLayout->AddSequence(shiftedSeq);
-            }
-        }
-#else
-        for (size_t t = 0; t < nT; t++)
-            for (size_t id = 0; id < numNewParallelSequence; id++)
-                pDecimateMBLayout->Set(id, t, pMBLayout->Get(id + st, t));
-#endif
 
-        return pair<size_t, size_t>(st, en);
+        return selected;
     }
 
     // in-place decimation, for use with data-parallel processing
@@ -205,6 +228,11 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     //            }
     //            UpdateWeights(...);
     //        }
+    //
+    // In frame mode (one time step per parallel sequence), the parallel sequences of dense inputs are contiguous columns,
+    // so each sub-minibatch is a column view into the full minibatch rather than a copy. Otherwise the inputs are copied per sub-minibatch.
+    // Dense parameter gradients accumulate in place across the sub-minibatches (Backprop() with accumulateParameterGradients);
+    // only parameters with sparse gradients are summed up in a separate buffer.
 
     template <class ElemType>
     class SubminibatchDispatcher
@@ -232,8 +260,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         shared_ptr<Matrix<ElemType>> m_NetEvaluationAccumulator;
         std::map<wstring, vector<shared_ptr<INodeState>>> m_NetStates; // m_NetStatefulNodes[node][i] caches the state of i-th subminibatch of node
         bool m_hasLattices;
+        bool m_sliceInputsInPlace; // m_inputMatricesCache owns the full inputs, and the net's input matrices are column views into them
 
-        Matrices m_cachedGradient;
+        Matrices m_cachedGradient; // only for parameters whose gradient cannot accumulate in place
         // we also need to remember where to put into the net
         MBLayoutPtr m_NetMBLayoutPtr;
         std::map<wstring, shared_ptr<ComputationNode<ElemType>>> m_LearnableNodePtr;
@@ -287,7 +316,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
     public:
         SubminibatchDispatcher()
-            : m_MBLayoutCache(nullptr), m_NetLatticePtr(nullptr), m_NetExtrauttMapPtr(nullptr), m_NetUidPtr(nullptr), m_NetBoundariesPtr(nullptr)
+            : m_MBLayoutCache(nullptr), m_NetLatticePtr(nullptr), m_NetExtrauttMapPtr(nullptr), m_NetUidPtr(nullptr), m_NetBoundariesPtr(nullptr), m_sliceInputsInPlace(false)
         {
         }
 
@@ -371,23 +400,25 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             m_NetInputMatrixPtr = inputMatrices;
 
             // second, get data from reader, stored it in cache
-            // 1. for each key, allocate the specific matrix on device
+            // 1. MBlayout
+            m_MBLayoutCache->CopyFrom(net.GetMBLayoutPtr());
+            size_t nParallelSequences = m_MBLayoutCache->GetNumParallelSequences();
+
+            // 2. for each key, take over the matrix (frame mode, dense) or allocate the specific matrix on device
+            m_sliceInputsInPlace = m_MBLayoutCache->GetNumTimeSteps() == 1;
+            for (auto pa : inputMatrices)
+                m_sliceInputsInPlace &= pa.second->GetMatrixType() == DENSE;
             for (auto pa : inputMatrices)
             {
                 wstring name = pa.first;
                 Matrix<ElemType>* M = pa.second;
                 if (m_inputMatricesCache.find(name) == m_inputMatricesCache.end())
-                {
-                    m_inputMatricesCache[name] = new Matrix<ElemType>(*M, M->GetDeviceId()); // deep copy from M
-                }
+                    m_inputMatricesCache[name] = new Matrix<ElemType>(M->GetDeviceId());
+                if (m_sliceInputsInPlace)
+                    *m_inputMatricesCache[name] = std::move(*M); // shallow; M becomes a view into it in GetSubMinibatchToNet()
                 else
-                {
-                    m_inputMatricesCache[name]->SetValue(*M);
-                }
+                    m_inputMatricesCache[name]->SetValue(*M); // deep copy from M
             }
-            // 2. MBlayout
-            m_MBLayoutCache->CopyFrom(net.GetMBLayoutPtr());
-            size_t nParallelSequences = m_MBLayoutCache->GetNumParallelSequences();
 
             // 3. for bits in seq. training
             if (m_hasLattices)
@@ -408,25 +439,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             // we cannot split further; instead, each subsequence become a subminibatch
             size_t actualnumSubminibatches = requestedSubminibatches > nParallelSequences ? nParallelSequences : requestedSubminibatches;
 
-            // 4. third, allocate space for accumulated gradient
-            for (auto& n : m_LearnableNodePtr)
-            {
-                auto node = n.second;
-                if (node->IsParameterUpdateRequired())
-                {
-                    wstring nodeName = node->GetName();
-                    shared_ptr<ComputationNode<ElemType>> pLearnableNode = node;
-                    auto funvalue = pLearnableNode->Value(); // gradient may not be allocated when this function is first called
-                    size_t nrow = funvalue.GetNumRows();
-                    size_t ncol = funvalue.GetNumCols();
-                    if (m_cachedGradient.find(nodeName) == m_cachedGradient.end())
-                    {
-                        // not allocated yet
-                        m_cachedGradient[nodeName] = new Matrix<ElemType>(nrow, ncol, funvalue.GetDeviceId());
-                        m_cachedGradient[nodeName]->SetValue((ElemType) 0);
-                    }
-                }
-            }
+            // 4. (space for accumulated sparse gradients is allocated in DoneWithCurrentSubMinibatch(), once the gradients exist)
             // 5. for stateful node
             for (auto x : m_NetStatefulNodes)
             {
@@ -482,7 +495,16 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         {
             Matrices decimatedMatrices;
             MBLayoutPtr decimatedLayout;
-            pair<size_t, size_t> seqRange = DataReaderHelpers::DecimateMinibatch(m_inputMatricesCache, decimatedMatrices, m_MBLayoutCache, decimatedLayout, m_numSubminibatches, iSubminibatch);
+            pair<size_t, size_t> seqRange;
+            if (m_sliceInputsInPlace)
+            {
+                // one column per parallel sequence: point the net's inputs at the columns of this sub-minibatch
+                seqRange = DataReaderHelpers::DecimateMBLayout(m_MBLayoutCache, decimatedLayout, m_numSubminibatches, iSubminibatch);
+                for (auto& x : m_inputMatricesCache)
+                    m_NetInputMatrixPtr[x.first]->AssignColumnSlice(*x.second, seqRange.first, seqRange.second - seqRange.first);
+            }
+            else
+                seqRange = DataReaderHelpers::DecimateMinibatch(m_inputMatricesCache, decimatedMatrices, m_MBLayoutCache, decimatedLayout, m_numSubminibatches, iSubminibatch);
             //  NOTE: deimatedMatrices must be released by caller
 
             // base on the seqRange, we do the decimation for lattices and related variables
@@ -520,15 +542,19 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         // TODO: encapsulate it into a destructor? Note: Cannot throw exceptions in destructor.
         void DoneWithCurrentSubMinibatch(size_t iSubminibatch)
         {
-            // accumulate gradient here
-            for (auto x : m_cachedGradient)
+            // accumulate the gradients that Backprop() does not accumulate in place (see ComputationNode::ResumeGradientAccumulation())
+            for (auto& x : m_LearnableNodePtr)
             {
                 wstring nodename = x.first;
-                if (m_LearnableNodePtr.find(nodename) == m_LearnableNodePtr.end())
+                shared_ptr<ComputationNode<ElemType>> pNode = x.second;
+                if (!pNode->IsParameterUpdateRequired() || pNode->Gradient().GetMatrixType() == DENSE)
+                    continue;
+                if (m_cachedGradient.find(nodename) == m_cachedGradient.end())
                 {
-                    RuntimeError("ERROR: in DoneWithCurrentSubMinibatch: node %ls not found in LeanrableNode", nodename.c_str());
+                    // not allocated yet
+                    m_cachedGradient[nodename] = new Matrix<ElemType>(pNode->Value().GetNumRows(), pNode->Value().GetNumCols(), pNode->Value().GetDeviceId());
+                    m_cachedGradient[nodename]->SetValue((ElemType) 0);
                 }
-                shared_ptr<ComputationNode<ElemType>> pNode = m_LearnableNodePtr[nodename];
                 m_cachedGradient[nodename]->operator+=(pNode->Gradient());
                 pNode->Gradient().SetValue((ElemType) 0);
             }
@@ -567,8 +593,14 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                 m_LearnableNodePtr[name]->Gradient().SetValue(*accumulategrad);
                 x.second->SetValue((ElemType) 0);
             }
-            // also revert net.m_MBLayoutPtr
+            // also revert net.m_MBLayoutPtr, and hand the full inputs back to the net
             m_NetMBLayoutPtr->CopyFrom(m_MBLayoutCache);
+            if (m_sliceInputsInPlace)
+            {
+                for (auto& x : m_inputMatricesCache)
+                    *m_NetInputMatrixPtr[x.first] = std::move(*x.second);
+                m_sliceInputsInPlace = false;
+            }
 
             // m_NetCriterionNodes[0]->Value().SetValue((ElemType)0);
             Matrix<ElemType>::AddElementToElement(*m_NetCriterionAccumulator, 0, 0,
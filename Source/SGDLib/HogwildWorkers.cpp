@@ -0,0 +1,253 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "HogwildWorkers.h"
+#include "DataReaderHelpers.h"
+#include "PreComputeNodes.h"
+#include "CPUThreading.h"
+#include <omp.h>
+#include <thread>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+HogwildWorkers<ElemType>::HogwildWorkers(ComputationNetworkPtr net, size_t numWorkers,
+                                         const vector<ComputationNodeBasePtr>& criterionNodes,
+                                         const vector<ComputationNodeBasePtr>& evaluationNodes,
+                                         const vector<ComputationNodeBasePtr>& additionalNodesToEvaluate)
+    : m_failed(false)
+{
+    if (numWorkers < 2)
+        InvalidArgument("HogwildWorkers: At least two threads are needed.");
+    if (net->GetDeviceId() != CPUDEVICE)
+        InvalidArgument("HogwildWorkers: HogwildSGD trains on the CPU; the network is on device %d.", (int) net->GetDeviceId());
+
+    // the replicas' nodes are found by name
+    auto findNodes = [](const ComputationNetworkPtr& workerNet, const vector<ComputationNodeBasePtr>& nodes)
+    {
+        vector<ComputationNodeBasePtr> workerNodes;
+        for (const auto& node : nodes)
+            workerNodes.push_back(workerNet->GetNodeFromName(node->NodeName()));
+        return workerNodes;
+    };
+
+    vector<wstring> parameterNames, modelNodeNames;
+    for (const auto& node : net->LearnableParameterNodes(criterionNodes[0]))
+    {
+        if (node->IsParameterUpdateRequired())
+            parameterNames.push_back(node->NodeName());
+    }
+    for (const auto& node : net->GetAllNodes())
+    {
+        if (node->OperationName() == OperationNameOf(LearnableParameter) || node->RequiresPreCompute())
+            modelNodeNames.push_back(node->NodeName());
+    }
+
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        Worker worker;
+        worker.m_net = (w == 0) ? net : net->CloneForDevice(CPUDEVICE);
+        worker.m_criterionNodes = findNodes(worker.m_net, criterionNodes);
+        worker.m_evaluationNodes = findNodes(worker.m_net, evaluationNodes);
+        worker.m_featureNodes = worker.m_net->FeatureNodes();
+        worker.m_labelNodes = worker.m_net->LabelNodes();
+        for (const auto& name : parameterNames)
+        {
+            worker.m_parameters.push_back(dynamic_pointer_cast<ComputationNode<ElemType>>(worker.m_net->GetNodeFromName(name)));
+            worker.m_ownSmoothedGradients.push_back(w == 0 ? nullptr : make_shared<Matrix<ElemType>>(CPUDEVICE));
+        }
+        for (const auto& name : modelNodeNames)
+            worker.m_modelNodes.push_back(dynamic_pointer_cast<ComputationNode<ElemType>>(worker.m_net->GetNodeFromName(name)));
+        worker.m_numOptimizerSteps = 0;
+        worker.m_prevDropoutRate = 0;
+
+        // (the main network is allocated by the caller)
+        if (w > 0)
+        {
+            worker.m_net->AllocateAllMatrices(worker.m_evaluationNodes, findNodes(worker.m_net, additionalNodesToEvaluate), worker.m_criterionNodes[0]);
+            for (size_t pass = 0; pass < 2; pass++)
+            {
+                for (const auto& node : (pass == 0) ? worker.m_featureNodes : worker.m_labelNodes)
+                    worker.m_inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+            }
+        }
+        m_workers.push_back(worker);
+    }
+    // the main network's inputs exist only once it is allocated; they are looked up in TrainEpoch()
+
+    fprintf(stderr, "HogwildWorkers: Training on %d CPU threads, %d parameters shared without locks.\n", (int) numWorkers, (int) parameterNames.size());
+}
+
+template <class ElemType>
+void HogwildWorkers<ElemType>::SetDropoutRate(double dropoutRate, unsigned long& dropOutSeed)
+{
+    for (size_t w = 1; w < m_workers.size(); w++)
+    {
+        Worker& worker = m_workers[w];
+        ComputationNetwork::SetDropoutRate<ElemType>(worker.m_net, worker.m_criterionNodes[0], dropoutRate, worker.m_prevDropoutRate, dropOutSeed);
+    }
+}
+
+template <class ElemType>
+size_t HogwildWorkers<ElemType>::TrainEpoch(IDataReader<ElemType>& reader, bool computeGradient,
+                                            const list<ComputationNodeBasePtr>& learnableNodes, list<Matrix<ElemType>>& smoothedGradients,
+                                            const UpdateFunction& update,
+                                            double& criterion, vector<double>& evalErrors, size_t& numSamplesWithLabel)
+{
+    // worker 0 updates with SGD's optimizer state
+    Worker& main = m_workers[0];
+    main.m_smoothedGradients.assign(main.m_parameters.size(), nullptr);
+    auto smoothedGradientIter = smoothedGradients.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+    {
+        for (size_t i = 0; i < main.m_parameters.size(); i++)
+        {
+            if (main.m_parameters[i] == *nodeIter)
+                main.m_smoothedGradients[i] = &*smoothedGradientIter;
+        }
+    }
+    for (size_t i = 0; i < main.m_parameters.size(); i++)
+    {
+        if (!main.m_smoothedGradients[i])
+            LogicError("HogwildWorkers: Parameter %ls is not among the learnable nodes.", main.m_parameters[i]->NodeName().c_str());
+    }
+    if (main.m_inputMatrices.empty())
+    {
+        for (size_t pass = 0; pass < 2; pass++)
+        {
+            for (const auto& node : (pass == 0) ? main.m_featureNodes : main.m_labelNodes)
+                main.m_inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        }
+    }
+
+    for (size_t w = 0; w < m_workers.size(); w++)
+    {
+        Worker& worker = m_workers[w];
+        if (w > 0)
+        {
+            // the parameters are shared again, which also picks up a model that was reloaded (e.g. during a learning-rate search);
+            // the precomputed values (SGD::PreCompute() runs on the main network only) are copied
+            for (size_t i = 0; i < worker.m_modelNodes.size(); i++)
+            {
+                const auto& mainNode = main.m_modelNodes[i];
+                auto preComputedNode = dynamic_pointer_cast<PreComputedNodeBase<ElemType>>(mainNode);
+                if (!preComputedNode)
+                    worker.m_modelNodes[i]->ShareValue(mainNode->ValuePtr());
+                else
+                {
+                    worker.m_modelNodes[i]->Value().SetValue(mainNode->Value());
+                    dynamic_pointer_cast<PreComputedNodeBase<ElemType>>(worker.m_modelNodes[i])->m_hasComputed = preComputedNode->HasComputed();
+                }
+            }
+            worker.m_smoothedGradients.clear();
+            for (size_t i = 0; i < worker.m_parameters.size(); i++)
+            {
+                auto& smoothedGradient = *worker.m_ownSmoothedGradients[i];
+                if (smoothedGradient.GetNumElements() != main.m_smoothedGradients[i]->GetNumElements())
+                {
+                    smoothedGradient.Resize(main.m_smoothedGradients[i]->GetNumRows(), main.m_smoothedGradients[i]->GetNumCols());
+                    smoothedGradient.SetValue(0);
+                }
+                worker.m_smoothedGradients.push_back(&smoothedGradient);
+            }
+            worker.m_net->StartEvaluateMinibatchLoop(worker.m_evaluationNodes);
+            worker.m_net->StartEvaluateMinibatchLoop(worker.m_criterionNodes);
+        }
+        worker.m_criterion = 0;
+        worker.m_evalErrors.assign(evalErrors.size(), 0);
+        worker.m_numSamples = 0;
+        worker.m_numSamplesWithLabel = 0;
+    }
+
+    // the OpenMP threads are divided between the workers, so that together they do not oversubscribe the cores
+    const int intraOpThreads = max(1, omp_get_max_threads() / (int) m_workers.size());
+    m_failed = false;
+    m_failure = nullptr;
+    vector<thread> threads;
+    for (size_t w = 1; w < m_workers.size(); w++)
+        threads.push_back(thread([this, w, &reader, computeGradient, &update, intraOpThreads]()
+                                 {
+                                     TrainWorker(m_workers[w], reader, computeGradient, update, intraOpThreads);
+                                 }));
+    TrainWorker(main, reader, computeGradient, update, intraOpThreads);
+    for (auto& t : threads)
+        t.join();
+    if (m_failure)
+        rethrow_exception(m_failure);
+
+    size_t numSamples = 0;
+    criterion = 0;
+    evalErrors.assign(evalErrors.size(), 0);
+    numSamplesWithLabel = 0;
+    for (const auto& worker : m_workers)
+    {
+        numSamples += worker.m_numSamples;
+        numSamplesWithLabel += worker.m_numSamplesWithLabel;
+        criterion += worker.m_criterion;
+        for (size_t i = 0; i < evalErrors.size(); i++)
+            evalErrors[i] += worker.m_evalErrors[i];
+    }
+    return numSamples;
+}
+
+template <class ElemType>
+void HogwildWorkers<ElemType>::TrainWorker(Worker& worker, IDataReader<ElemType>& reader, bool computeGradient, const UpdateFunction& update, int intraOpThreads)
+{
+    try
+    {
+        CPUThreading::Options options;
+        options.m_intraOpThreads = intraOpThreads;
+        CPUThreading::Scope threadingScope(options);
+        for (;;)
+        {
+            size_t actualMBSize = 0;
+            {
+                lock_guard<mutex> lock(m_readerMutex);
+                if (m_failed)
+                    return;
+                if (!DataReaderHelpers::GetMinibatchIntoNetwork(reader, worker.m_net, worker.m_criterionNodes[0], false, false, worker.m_inputMatrices, actualMBSize))
+                    return; // end of epoch
+            }
+            ComputationNetwork::BumpEvalTimeStamp(worker.m_featureNodes);
+            ComputationNetwork::BumpEvalTimeStamp(worker.m_labelNodes);
+            if (actualMBSize == 0)
+                continue;
+
+            worker.m_net->ForwardProp(worker.m_evaluationNodes);
+            worker.m_net->ForwardProp(worker.m_criterionNodes[0]);
+            if (computeGradient)
+            {
+                worker.m_net->Backprop(worker.m_criterionNodes[0]);
+                // no lock: the other workers update the same parameters at the same time
+                worker.m_numOptimizerSteps++;
+                for (size_t i = 0; i < worker.m_parameters.size(); i++)
+                    update(worker.m_parameters[i]->Value(), worker.m_parameters[i]->Gradient(), *worker.m_smoothedGradients[i], actualMBSize, worker.m_numOptimizerSteps);
+            }
+
+            worker.m_criterion += worker.m_criterionNodes[0]->Get00Element();
+            for (size_t i = 0; i < worker.m_evaluationNodes.size(); i++)
+                worker.m_evalErrors[i] += worker.m_evaluationNodes[i]->Get00Element();
+            worker.m_numSamples += actualMBSize;
+            worker.m_numSamplesWithLabel += worker.m_net->GetNumSamplesWithLabel(actualMBSize);
+        }
+    }
+    catch (...)
+    {
+        lock_guard<mutex> lock(m_readerMutex);
+        if (!m_failed)
+            m_failure = current_exception();
+        m_failed = true;
+    }
+}
+
+template class HogwildWorkers<float>;
+template class HogwildWorkers<double>;
+
+} } }
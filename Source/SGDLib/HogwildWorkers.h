@@ -0,0 +1,101 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// HogwildWorkers.h -- lock-free multi-threaded training on the CPU (HogwildSGD)
+//
+// For sparse models with small dense layers (e.g. DSSM, or logistic regression on LibSVM data), a single training thread
+// scales poorly, even though its matrix operations run on several OpenMP threads: each operation is too small to be split.
+// With HogwildSGD, several threads train at the same time instead. Each one has a replica of the network, with activations
+// and gradients of its own, whose parameters share the value matrices of the main network. A thread takes the next minibatch
+// from the reader (one thread at a time, since readers are not thread-safe), runs forward and backward on it, and updates the
+// shared parameters with an optimizer state of its own, without any locks (Hogwild!, Niu et al. 2011): the updates of a
+// sparse model touch few columns each, so that they rarely collide, and a collision only loses part of an update. The
+// OpenMP threads are divided between the workers.
+// The main network is worker 0; its optimizer state is the one SGD keeps (and checkpoints), those of the others start at 0.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "ComputationNode.h"
+#include "DataReader.h"
+#include "Matrix.h"
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class HogwildWorkers
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+
+public:
+    // the update of one parameter by one worker (SGD::UpdateWeightsS()); 'optimizerStep' counts the updates of that worker
+    typedef std::function<void(Matrix<ElemType>& value, Matrix<ElemType>& gradient, Matrix<ElemType>& smoothedGradient, size_t actualMBSize, size_t optimizerStep)> UpdateFunction;
+
+    // 'net' must be compiled, be on the CPU, and not have its matrices allocated yet.
+    // The replicas are created here and get their matrices allocated; the main network is allocated by the caller.
+    HogwildWorkers(ComputationNetworkPtr net, size_t numWorkers,
+                   const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                   const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                   const std::vector<ComputationNodeBasePtr>& additionalNodesToEvaluate);
+
+    size_t NumWorkers() const
+    {
+        return m_workers.size();
+    }
+
+    // settings that SGD makes on the main network, repeated on the replicas
+    void SetDropoutRate(double dropoutRate, unsigned long& dropOutSeed);
+
+    // trains on all minibatches that the reader delivers in this epoch (the reader's minibatch loop must have been started)
+    // 'learnableNodes' and 'smoothedGradients' are SGD's, for worker 0. Returns the number of samples; 'criterion' and
+    // 'evalErrors' get the sums of the criteria over all workers.
+    size_t TrainEpoch(IDataReader<ElemType>& reader, bool computeGradient,
+                      const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients,
+                      const UpdateFunction& update,
+                      /*out*/ double& criterion, /*out*/ std::vector<double>& evalErrors, /*out*/ size_t& numSamplesWithLabel);
+
+private:
+    struct Worker
+    {
+        ComputationNetworkPtr m_net;
+        std::vector<ComputationNodeBasePtr> m_criterionNodes;
+        std::vector<ComputationNodeBasePtr> m_evaluationNodes;
+        std::vector<ComputationNodeBasePtr> m_featureNodes;
+        std::vector<ComputationNodeBasePtr> m_labelNodes;
+        std::map<std::wstring, Matrix<ElemType>*> m_inputMatrices;
+        std::vector<ComputationNodePtr> m_parameters;                        // parameters to update, in the order of those of the main worker
+        std::vector<ComputationNodePtr> m_modelNodes;                        // all parameters and precomputed nodes, likewise
+        std::vector<shared_ptr<Matrix<ElemType>>> m_ownSmoothedGradients;    // [parameter] the optimizer state of a replica
+        std::vector<Matrix<ElemType>*> m_smoothedGradients;                  // [parameter] the optimizer state in use
+        size_t m_numOptimizerSteps;
+        double m_prevDropoutRate;
+
+        // of the current epoch
+        double m_criterion;
+        std::vector<double> m_evalErrors;
+        size_t m_numSamples;
+        size_t m_numSamplesWithLabel;
+    };
+
+    // (on a thread of its own) trains on minibatches until the reader has no more
+    void TrainWorker(Worker& worker, IDataReader<ElemType>& reader, bool computeGradient, const UpdateFunction& update, int intraOpThreads);
+
+    std::vector<Worker> m_workers; // [0] is the main network
+
+    std::mutex m_readerMutex;      // held while a worker reads a minibatch
+    bool m_failed;                 // a worker failed; the others stop at their next minibatch
+    std::exception_ptr m_failure;  // the first failure, rethrown by TrainEpoch()
+};
+
+} } }
@@ -2,15 +2,33 @@
 
 #include "DistGradHeader.h"
 #include "MPIWrapper.h"
+#include "TrainingTimeline.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// How the gradients are all-reduced across the workers
+enum class AllReduceAlgorithm : int
+{
+    Auto,         // chosen from the topology of the job
+    MPI,          // MPI_Iallreduce, the MPI implementation picks the traffic pattern
+    Ring,         // bandwidth-optimal ring all-reduce over all workers
+    Hierarchical, // reduce within each host first, then all-reduce across hosts, then broadcast within the host
+};
+
+// How dense gradients are compressed before they are exchanged (with error feedback, see SimpleDistGradAggregator)
+enum class GradientCompression : int
+{
+    None,
+    TopK,      // the largest fraction (compression ratio) of the elements of each gradient, as index/value pairs
+    Threshold, // the elements of at least (compression threshold) times the RMS of their gradient, as index/value pairs
+};
+
 template <class ElemType>
 class IDistGradAggregator
 {
 public:
     IDistGradAggregator(MPIWrapper* mpi)
-        : m_mpi(mpi)
+        : m_mpi(mpi), m_timeline(nullptr)
     {
     }
 
@@ -21,6 +39,25 @@ public:
     // Returns a boolean indicating if any samples were processed
     virtual bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int epochNumber) = 0;
 
+    // Overlapping the aggregation with backprop (optional):
+    // Before backprop, StartOverlappedAggregation() announces the gradients (the same vector that is later passed to AggregateGradients())
+    // together with the order in which backprop finalizes them. GradientReady() is then called with the index of each gradient
+    // as soon as it is final, and AggregateGradients() completes the aggregation, including of gradients that were never reported.
+    virtual bool SupportsOverlappedAggregation() const
+    {
+        return false;
+    }
+
+    virtual void StartOverlappedAggregation(const std::vector<Matrix<ElemType>*>& /*gradients*/, const std::vector<size_t>& /*finalizationOrder*/, int /*numEvalNode*/, int /*epochNumber*/)
+    {
+        LogicError("This gradient aggregator does not support overlapping the aggregation with backprop.");
+    }
+
+    virtual void GradientReady(size_t /*gradientIndex*/)
+    {
+        LogicError("This gradient aggregator does not support overlapping the aggregation with backprop.");
+    }
+
     size_t NumProc()
     {
         return m_mpi->NumNodesInUse();
@@ -36,14 +73,22 @@ public:
         m_mpi->WaitAll();
     }
 
+    // Aggregators report the parts of AggregateGradients() to 'timeline' (may be nullptr) when they run on the calling thread.
+    void SetTimeline(TrainingTimeline* timeline)
+    {
+        m_timeline = timeline;
+    }
+
 protected:
     MPIWrapper* m_mpi;
+    TrainingTimeline* m_timeline;
 };
 
-#define UsingIDistGradAggregatorMembers           \
+#define UsingIDistGradAggregatorMembers              \
     \
-protected:                                        \
-    using IDistGradAggregator<ElemType>::m_mpi;   \
-    using IDistGradAggregator<ElemType>::NumProc; \
+protected:                                           \
+    using IDistGradAggregator<ElemType>::m_mpi;      \
+    using IDistGradAggregator<ElemType>::m_timeline; \
+    using IDistGradAggregator<ElemType>::NumProc;    \
     using IDistGradAggregator<ElemType>::MyRank
 } } }
@@ -0,0 +1,340 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "LocalDataParallelReplicas.h"
+#include "DataReaderHelpers.h"
+#include "PreComputeNodes.h"
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+LocalDataParallelReplicas<ElemType>::LocalDataParallelReplicas(ComputationNetworkPtr net, const vector<DEVICEID_TYPE>& deviceIds,
+                                                               const vector<ComputationNodeBasePtr>& criterionNodes,
+                                                               const vector<ComputationNodeBasePtr>& evaluationNodes,
+                                                               const vector<ComputationNodeBasePtr>& additionalNodesToEvaluate)
+    : m_criterionBuffer(net->GetDeviceId())
+{
+    if (deviceIds.size() < 2)
+        InvalidArgument("LocalDataParallelReplicas: At least two devices are needed.");
+    if (deviceIds[0] != net->GetDeviceId())
+        InvalidArgument("LocalDataParallelReplicas: The first device (%d) must be the one the network is on (%d).", (int) deviceIds[0], (int) net->GetDeviceId());
+    for (size_t i = 0; i < deviceIds.size(); i++)
+    {
+        if (deviceIds[i] < 0)
+            InvalidArgument("LocalDataParallelReplicas: Device %d is not a GPU.", (int) deviceIds[i]);
+        for (size_t j = 0; j < i; j++)
+        {
+            if (deviceIds[j] == deviceIds[i])
+                InvalidArgument("LocalDataParallelReplicas: Device %d is given more than once.", (int) deviceIds[i]);
+        }
+    }
+
+    // the replicas' nodes are found by name
+    auto findNodes = [](const ComputationNetworkPtr& workerNet, const vector<ComputationNodeBasePtr>& nodes)
+    {
+        vector<ComputationNodeBasePtr> workerNodes;
+        for (const auto& node : nodes)
+            workerNodes.push_back(workerNet->GetNodeFromName(node->NodeName()));
+        return workerNodes;
+    };
+
+    vector<wstring> parameterNames, modelNodeNames;
+    for (const auto& node : net->LearnableParameterNodes(criterionNodes[0]))
+    {
+        if (node->IsParameterUpdateRequired())
+            parameterNames.push_back(node->NodeName());
+    }
+    for (const auto& node : net->GetAllNodes())
+    {
+        if (node->OperationName() == OperationNameOf(LearnableParameter) || node->RequiresPreCompute())
+            modelNodeNames.push_back(node->NodeName());
+    }
+
+    for (size_t w = 0; w < deviceIds.size(); w++)
+    {
+        Worker worker;
+        worker.m_net = (w == 0) ? net : net->CloneForDevice(deviceIds[w]);
+        worker.m_criterionNodes = findNodes(worker.m_net, criterionNodes);
+        worker.m_evaluationNodes = findNodes(worker.m_net, evaluationNodes);
+        worker.m_featureNodes = worker.m_net->FeatureNodes();
+        worker.m_labelNodes = worker.m_net->LabelNodes();
+        for (const auto& name : parameterNames)
+        {
+            worker.m_parameters.push_back(dynamic_pointer_cast<ComputationNode<ElemType>>(worker.m_net->GetNodeFromName(name)));
+            worker.m_gradientBuffers.push_back(make_shared<Matrix<ElemType>>(deviceIds[w]));
+        }
+        for (const auto& name : modelNodeNames)
+            worker.m_modelNodes.push_back(dynamic_pointer_cast<ComputationNode<ElemType>>(worker.m_net->GetNodeFromName(name)));
+        worker.m_actualMBSize = 0;
+        worker.m_prevDropoutRate = 0;
+
+        // (the main network is allocated by the caller)
+        if (w > 0)
+            worker.m_net->AllocateAllMatrices(worker.m_evaluationNodes, findNodes(worker.m_net, additionalNodesToEvaluate), worker.m_criterionNodes[0]);
+        m_workers.push_back(worker);
+    }
+
+    fprintf(stderr, "LocalDataParallelReplicas: Training on %d devices (", (int) deviceIds.size());
+    for (size_t w = 0; w < deviceIds.size(); w++)
+        fprintf(stderr, "%sGPU %d", w > 0 ? ", " : "", (int) deviceIds[w]);
+    fprintf(stderr, "), %d parameters reduced by peer-to-peer copies.\n", (int) parameterNames.size());
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::SetDropoutRate(double dropoutRate, unsigned long& dropOutSeed)
+{
+    // the replicas get the seeds of the main network, so that their shares of the minibatch get the same masks as on one device
+    for (size_t w = 1; w < m_workers.size(); w++)
+    {
+        Worker& worker = m_workers[w];
+        unsigned long workerDropOutSeed = dropOutSeed;
+        ComputationNetwork::SetDropoutRate<ElemType>(worker.m_net, worker.m_criterionNodes[0], dropoutRate, worker.m_prevDropoutRate, workerDropOutSeed);
+    }
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::SetMaxTempMemSizeForCNN(size_t maxTempMemSizeInSamples)
+{
+    for (size_t w = 1; w < m_workers.size(); w++)
+        ComputationNetwork::SetMaxTempMemSizeForCNN(m_workers[w].m_net, m_workers[w].m_criterionNodes[0], maxTempMemSizeInSamples);
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::StartEpoch()
+{
+    BroadcastValues(&Worker::m_modelNodes);
+    for (size_t w = 1; w < m_workers.size(); w++)
+    {
+        Worker& worker = m_workers[w];
+
+        // the precomputation (SGD::PreCompute()) runs on the main network only, after the replicas were created
+        for (size_t i = 0; i < worker.m_modelNodes.size(); i++)
+        {
+            auto preComputedNode = dynamic_pointer_cast<PreComputedNodeBase<ElemType>>(m_workers[0].m_modelNodes[i]);
+            if (preComputedNode)
+                dynamic_pointer_cast<PreComputedNodeBase<ElemType>>(worker.m_modelNodes[i])->m_hasComputed = preComputedNode->HasComputed();
+        }
+        worker.m_net->StartEvaluateMinibatchLoop(worker.m_evaluationNodes);
+        worker.m_net->StartEvaluateMinibatchLoop(worker.m_criterionNodes);
+        worker.m_actualMBSize = 0;
+    }
+}
+
+template <class ElemType>
+size_t LocalDataParallelReplicas<ElemType>::DistributeMinibatch(const map<wstring, Matrix<ElemType>*>& inputMatrices)
+{
+    const size_t numWorkers = m_workers.size();
+    MBLayoutPtr pMBLayout = m_workers[0].m_net->GetMBLayoutPtr();
+    const size_t numParallelSequences = pMBLayout->GetNumParallelSequences();
+    const size_t nT = pMBLayout->GetNumTimeSteps();
+
+    // each worker gets a contiguous range of parallel sequences, as an MPI worker would
+    vector<MBLayoutPtr> layouts(numWorkers);
+    vector<pair<size_t, size_t>> selected(numWorkers);
+    for (size_t w = 0; w < numWorkers; w++)
+        selected[w] = DataReaderHelpers::DecimateMBLayout(pMBLayout, layouts[w], (int) numWorkers, (int) w);
+
+    for (const auto& input : inputMatrices)
+    {
+        Matrix<ElemType>& mat = *input.second;
+        if (mat.GetMatrixType() != MatrixType::DENSE)
+            InvalidArgument("LocalDataParallelReplicas: Input %ls is sparse; only dense inputs can be split between devices.", input.first.c_str());
+        const size_t numRows = mat.GetNumRows();
+        if (mat.GetNumCols() != numParallelSequences * nT)
+            LogicError("LocalDataParallelReplicas: Input %ls has %d columns, but the minibatch layout %d.", input.first.c_str(), (int) mat.GetNumCols(), (int) (numParallelSequences * nT));
+
+        // the main network last, since its share replaces the input in place
+        for (size_t w = numWorkers; w-- > 0;)
+        {
+            Worker& worker = m_workers[w];
+            Matrix<ElemType>& value = (w == 0) ? mat : worker.m_net->GetNodeFromName(input.first)->template As<ComputationNode<ElemType>>()->Value();
+            const size_t numSequences = selected[w].second - selected[w].first;
+            if (numSequences == 0)
+            {
+                value.Resize(numRows, 0);
+                continue;
+            }
+
+            // the share is cut out on the main device, into a buffer that is kept, and then copied to the worker's device
+            auto& buffer = worker.m_inputBuffers[input.first];
+            if (!buffer)
+                buffer = make_shared<Matrix<ElemType>>(mat.GetDeviceId());
+            buffer->AssignRowSliceValuesOf(mat.Reshaped(numRows * numParallelSequences, nT), selected[w].first * numRows, numSequences * numRows);
+            buffer->Reshape(numRows, numSequences * nT);
+            if (w == 0)
+                mat.SetValue(*buffer);
+            else
+                value.SetValueAcrossDevices(*buffer);
+        }
+    }
+
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        Worker& worker = m_workers[w];
+        if (w == 0)
+            pMBLayout->MoveFrom(layouts[0]);
+        else
+            worker.m_net->GetMBLayoutPtr()->CopyFrom(layouts[w]);
+
+        // the input nodes must be told about their new size (see DataReaderHelpers::GetMinibatchIntoNetwork())
+        for (size_t pass = 0; pass < 2; pass++)
+        {
+            for (const auto& node : (pass == 0) ? worker.m_featureNodes : worker.m_labelNodes)
+            {
+                if (inputMatrices.find(node->NodeName()) != inputMatrices.end())
+                    node->NotifyFunctionValuesMBSizeModified();
+            }
+        }
+        worker.m_actualMBSize = worker.m_net->DetermineActualMBSizeFromFeatures();
+        ComputationNetwork::SetDropoutMinibatchShare<ElemType>(worker.m_net, worker.m_criterionNodes[0], selected[w].first, numParallelSequences);
+        if (w > 0)
+        {
+            ComputationNetwork::BumpEvalTimeStamp(worker.m_featureNodes);
+            ComputationNetwork::BumpEvalTimeStamp(worker.m_labelNodes);
+        }
+    }
+    return m_workers[0].m_actualMBSize;
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::ForwardBackward(bool computeGradient, double lossScale)
+{
+    for (size_t w = 1; w < m_workers.size(); w++)
+    {
+        Worker& worker = m_workers[w];
+        if (worker.m_actualMBSize == 0)
+            continue;
+        worker.m_net->ForwardProp(worker.m_evaluationNodes);
+        worker.m_net->ForwardProp(worker.m_criterionNodes[0]);
+        if (computeGradient)
+            worker.m_net->Backprop(worker.m_criterionNodes[0], nullptr, lossScale);
+    }
+}
+
+// deep copy of 'from' into 'to' on to's device
+// A sparse gradient goes through SetValue() and an explicit transfer, and is made dense, so that it can be added to a dense one.
+template <class ElemType>
+static void CopyGradientAcrossDevices(Matrix<ElemType>& to, const Matrix<ElemType>& from)
+{
+    if (from.GetMatrixType() == MatrixType::DENSE)
+        return to.SetValueAcrossDevices(from);
+    const DEVICEID_TYPE deviceId = to.GetDeviceId();
+    to.SetValue(from);
+    to.TransferToDeviceIfNotThere(deviceId, true);
+    to.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, true);
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::ReduceGradients(bool mainHasGradient)
+{
+    const size_t numWorkers = m_workers.size();
+    m_hasGradient.assign(numWorkers, false);
+    m_hasGradient[0] = mainHasGradient;
+    for (size_t w = 1; w < numWorkers; w++)
+        m_hasGradient[w] = m_workers[w].m_actualMBSize > 0;
+
+    // binary tree: in each round, worker w adds the sum that worker w + step has gathered so far
+    for (size_t step = 1; step < numWorkers; step *= 2)
+    {
+        for (size_t w = 0; w + step < numWorkers; w += 2 * step)
+        {
+            if (!m_hasGradient[w + step])
+                continue;
+            Worker& to = m_workers[w];
+            const Worker& from = m_workers[w + step];
+            for (size_t i = 0; i < to.m_parameters.size(); i++)
+            {
+                Matrix<ElemType>& gradient = to.m_parameters[i]->Gradient();
+                const Matrix<ElemType>& fromGradient = from.m_parameters[i]->Gradient();
+                if (!m_hasGradient[w]) // (our own is stale)
+                {
+                    CopyGradientAcrossDevices(gradient, fromGradient);
+                    continue;
+                }
+                if (gradient.GetMatrixType() != MatrixType::DENSE)
+                    gradient.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, true);
+                Matrix<ElemType>& buffer = *to.m_gradientBuffers[i];
+                CopyGradientAcrossDevices(buffer, fromGradient);
+                gradient += buffer;
+            }
+            m_hasGradient[w] = true;
+        }
+    }
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::BroadcastParameters()
+{
+    BroadcastValues(&Worker::m_parameters);
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::BroadcastValues(vector<ComputationNodePtr> Worker::*nodes)
+{
+    // the reduction tree in reverse: in each round, worker w sends to worker w + step
+    const size_t numWorkers = m_workers.size();
+    size_t step = 1;
+    while (2 * step < numWorkers)
+        step *= 2;
+    for (; step > 0; step /= 2)
+    {
+        for (size_t w = 0; w + step < numWorkers; w += 2 * step)
+        {
+            const auto& fromNodes = m_workers[w].*nodes;
+            const auto& toNodes = m_workers[w + step].*nodes;
+            for (size_t i = 0; i < fromNodes.size(); i++)
+                toNodes[i]->Value().SetValueAcrossDevices(fromNodes[i]->Value());
+        }
+    }
+}
+
+template <class ElemType>
+void LocalDataParallelReplicas<ElemType>::AccumulateCriteria(Matrix<ElemType>& localEpochCriterion, Matrix<ElemType>& localEpochEvalErrors)
+{
+    for (size_t w = 1; w < m_workers.size(); w++)
+    {
+        const Worker& worker = m_workers[w];
+        if (worker.m_actualMBSize == 0)
+            continue;
+        m_criterionBuffer.SetValueAcrossDevices(worker.m_criterionNodes[0]->template As<ComputationNode<ElemType>>()->Value());
+        Matrix<ElemType>::AddElementToElement(m_criterionBuffer, 0, 0, localEpochCriterion, 0, 0);
+        for (size_t i = 0; i < worker.m_evaluationNodes.size(); i++)
+        {
+            m_criterionBuffer.SetValueAcrossDevices(worker.m_evaluationNodes[i]->template As<ComputationNode<ElemType>>()->Value());
+            Matrix<ElemType>::AddElementToElement(m_criterionBuffer, 0, 0, localEpochEvalErrors, 0, i);
+        }
+    }
+}
+
+template <class ElemType>
+size_t LocalDataParallelReplicas<ElemType>::GetNumReplicaSamples() const
+{
+    size_t numSamples = 0;
+    for (size_t w = 1; w < m_workers.size(); w++)
+        numSamples += m_workers[w].m_actualMBSize;
+    return numSamples;
+}
+
+template <class ElemType>
+size_t LocalDataParallelReplicas<ElemType>::GetNumReplicaSamplesWithLabel() const
+{
+    size_t numSamples = 0;
+    for (size_t w = 1; w < m_workers.size(); w++)
+    {
+        if (m_workers[w].m_actualMBSize > 0)
+            numSamples += m_workers[w].m_net->GetNumSamplesWithLabel(m_workers[w].m_actualMBSize);
+    }
+    return numSamples;
+}
+
+template class LocalDataParallelReplicas<float>;
+template class LocalDataParallelReplicas<double>;
+
+} } }
@@ -0,0 +1,103 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// LocalDataParallelReplicas.h -- data-parallel training over the GPUs of a single process, without MPI
+//
+// The network that SGD trains (the main network, on the first device) gets a replica on each of the other devices. The
+// reader fills the main network's inputs once per minibatch; DistributeMinibatch() splits them by parallel sequences, like
+// DataReaderHelpers::DecimateMinibatch() does for MPI workers, and copies each replica's share straight to its device.
+// Each replica then runs forward and backward on its share; the kernels of all devices run concurrently, since they are
+// issued from the training thread without waiting for any of them. ReduceGradients() sums the gradients into the main
+// network's by a binary tree of peer-to-peer copies (log2 of the number of devices rounds, the copies of a round running
+// in parallel on different links), after which SGD updates the main network's parameters as usual, and
+// BroadcastParameters() copies them back down the tree. All copies are ordered on the devices' streams by events (see
+// Matrix::SetValueAcrossDevices()), so the host never waits for a device.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "ComputationNode.h"
+#include "Matrix.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class LocalDataParallelReplicas
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+
+public:
+    // 'net' must be compiled, be on deviceIds[0], and not have its matrices allocated yet.
+    // The replicas are created on deviceIds[1..] and get their matrices allocated here.
+    LocalDataParallelReplicas(ComputationNetworkPtr net, const std::vector<DEVICEID_TYPE>& deviceIds,
+                              const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                              const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                              const std::vector<ComputationNodeBasePtr>& additionalNodesToEvaluate);
+
+    size_t NumWorkers() const
+    {
+        return m_workers.size();
+    }
+
+    // settings that SGD makes on the main network, repeated on the replicas
+    void SetDropoutRate(double dropoutRate, unsigned long& dropOutSeed);
+    void SetMaxTempMemSizeForCNN(size_t maxTempMemSizeInSamples);
+
+    // at the start of an epoch: copies all parameters and precomputed values of the main network to the replicas
+    // (which also picks up a model that was reloaded, e.g. during a learning-rate search)
+    void StartEpoch();
+
+    // splits the minibatch the reader put into 'inputMatrices' (those of the main network) between the workers, leaving
+    // the main network's share in place; returns the new number of columns of the main network's minibatch
+    size_t DistributeMinibatch(const std::map<std::wstring, Matrix<ElemType>*>& inputMatrices);
+
+    // forward and (if 'computeGradient') backward on the replicas that got samples
+    void ForwardBackward(bool computeGradient, double lossScale);
+
+    // sums the replicas' gradients into those of the main network; 'mainHasGradient' tells whether the main network
+    // computed one in this minibatch, or whether its gradients are stale and must be overwritten
+    void ReduceGradients(bool mainHasGradient);
+
+    // copies the main network's parameters, after an update, to the replicas
+    void BroadcastParameters();
+
+    // adds the replicas' criteria of this minibatch to the accumulators (on the main device)
+    void AccumulateCriteria(Matrix<ElemType>& localEpochCriterion, Matrix<ElemType>& localEpochEvalErrors);
+
+    // samples processed by the replicas in this minibatch (in addition to those of the main network)
+    size_t GetNumReplicaSamples() const;
+    size_t GetNumReplicaSamplesWithLabel() const;
+
+private:
+    struct Worker
+    {
+        ComputationNetworkPtr m_net;
+        std::vector<ComputationNodeBasePtr> m_criterionNodes;
+        std::vector<ComputationNodeBasePtr> m_evaluationNodes;
+        std::vector<ComputationNodeBasePtr> m_featureNodes;
+        std::vector<ComputationNodeBasePtr> m_labelNodes;
+        std::vector<ComputationNodePtr> m_parameters;      // parameters to update, in the order of m_parameters of the main worker
+        std::vector<ComputationNodePtr> m_modelNodes;      // all parameters and precomputed nodes, likewise
+        std::vector<shared_ptr<Matrix<ElemType>>> m_gradientBuffers;          // [parameter] a gradient received from another worker
+        std::map<std::wstring, shared_ptr<Matrix<ElemType>>> m_inputBuffers; // [input] this worker's share, on the main device
+        size_t m_actualMBSize;
+        double m_prevDropoutRate;
+    };
+
+    // copies the values of 'nodes' from the main worker to all others, down the reduction tree
+    void BroadcastValues(std::vector<ComputationNodePtr> Worker::*nodes);
+
+    std::vector<Worker> m_workers; // [0] is the main network
+    std::vector<bool> m_hasGradient; // [worker] during ReduceGradients()
+    Matrix<ElemType> m_criterionBuffer; // a replica's criterion, copied to the main device
+};
+
+} } }
@@ -0,0 +1,172 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "OptimizerStateOffload.h"
+#include "MemoryAccounting.h"
+#include <exception>
+#include <limits>
+#include <string.h>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+OptimizerStateOffload<ElemType>::Parameter::Parameter(const ComputationNodePtr& node)
+    : m_node(node),
+      m_value(CPUDEVICE),
+      m_gradient(CPUDEVICE),
+      m_deviceColumns(node->GetDeviceId()),
+      m_deviceColumnIndices(node->GetDeviceId()),
+      m_deviceCurrentColumns(node->GetDeviceId()),
+      m_uploadColumnsOnly(false)
+{
+}
+
+template <class ElemType>
+OptimizerStateOffload<ElemType>::OptimizerStateOffload(const list<ComputationNodeBasePtr>& learnableNodes, size_t minElements)
+{
+    for (const auto& nodeBase : learnableNodes)
+    {
+        ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodeBase);
+        if (!node || !node->IsParameterUpdateRequired() || node->GetDeviceId() < 0 ||
+            node->Value().GetMatrixType() != MatrixType::DENSE || node->Value().GetNumElements() < minElements)
+            continue;
+
+        MemoryAccounting::Context memory(*node, MemoryAccounting::optimizerState);
+        unique_ptr<Parameter> parameter(new Parameter(node));
+        parameter->m_value.Resize(node->Value().GetNumRows(), node->Value().GetNumCols());
+        m_parameters[node.get()] = move(parameter);
+    }
+}
+
+template <class ElemType>
+OptimizerStateOffload<ElemType>::~OptimizerStateOffload()
+{
+    // the updates refer to the host copies, which must outlive them
+    for (auto* parameter : m_pendingParameters)
+    {
+        if (parameter->m_pendingUpdate.valid())
+            parameter->m_pendingUpdate.wait();
+    }
+}
+
+template <class ElemType>
+size_t OptimizerStateOffload<ElemType>::NumOffloadedElements() const
+{
+    size_t numElements = 0;
+    for (const auto& parameter : m_parameters)
+        numElements += parameter.second->m_value.GetNumElements();
+    return numElements;
+}
+
+template <class ElemType>
+void OptimizerStateOffload<ElemType>::StartEpoch()
+{
+    Finish();
+    for (auto& parameter : m_parameters)
+        parameter.second->m_value.SetValueAcrossDevices(parameter.second->m_node->Value());
+}
+
+template <class ElemType>
+void OptimizerStateOffload<ElemType>::BeginUpdate(const ComputationNodeBasePtr& node, bool sparseUpdate, const UpdateFunction& update)
+{
+    auto iter = m_parameters.find(node.get());
+    if (iter == m_parameters.end())
+        LogicError("OptimizerStateOffload: %ls %ls operation is not offloaded.", node->NodeName().c_str(), node->OperationName().c_str());
+    Parameter& parameter = *iter->second;
+    if (parameter.m_pendingUpdate.valid())
+        LogicError("OptimizerStateOffload: The previous update of %ls %ls operation has not been finished.", node->NodeName().c_str(), node->OperationName().c_str());
+
+    // download the gradient; a block-sparse one as its columns only
+    const Matrix<ElemType>& gradient = parameter.m_node->Gradient();
+    if (gradient.GetMatrixType() == MatrixType::SPARSE && gradient.GetFormat() == matrixFormatSparseBlockCol)
+    {
+        gradient.GetSparseBlockColumns(parameter.m_columnIds, parameter.m_columnValues);
+        parameter.m_gradient.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseBlockCol, false);
+        parameter.m_gradient.SetSparseBlockColumns(gradient.GetNumRows(), gradient.GetNumCols(), parameter.m_columnIds, parameter.m_columnValues);
+        // (the column indices are uploaded as ElemType, which holds integers exactly only up to 2^digits)
+        parameter.m_uploadColumnsOnly = sparseUpdate && gradient.GetNumCols() <= ((size_t) 1 << numeric_limits<ElemType>::digits);
+    }
+    else
+    {
+        parameter.m_gradient.SetValueAcrossDevices(gradient);
+        parameter.m_columnIds.clear();
+        parameter.m_uploadColumnsOnly = false;
+    }
+
+    Parameter* p = &parameter;
+    parameter.m_pendingUpdate = async(launch::async, [p, update]()
+                                      {
+                                          MemoryAccounting::Context memory(*p->m_node, MemoryAccounting::optimizerState); // (optimizers may size their state lazily)
+                                          update(p->m_value, p->m_gradient);
+                                      });
+    m_pendingParameters.push_back(p);
+}
+
+template <class ElemType>
+void OptimizerStateOffload<ElemType>::Finish()
+{
+    exception_ptr error;
+    for (auto* parameter : m_pendingParameters)
+    {
+        try
+        {
+            parameter->m_pendingUpdate.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = current_exception();
+            continue;
+        }
+        if (parameter->m_uploadColumnsOnly)
+            UploadColumns(*parameter);
+        else
+            parameter->m_node->Value().SetValueAcrossDevices(parameter->m_value);
+        parameter->m_node->BumpEvalTimeStamp();
+    }
+    m_pendingParameters.clear();
+    if (error)
+        rethrow_exception(error);
+}
+
+// The device has no assignment by column indices, only a gather and an adding scatter. Adding the negated current columns
+// first clears them exactly, so that the device value ends up identical to the host copy.
+template <class ElemType>
+void OptimizerStateOffload<ElemType>::UploadColumns(Parameter& parameter)
+{
+    const size_t numColumns = parameter.m_columnIds.size();
+    if (numColumns == 0)
+        return;
+
+    const size_t numRows = parameter.m_value.GetNumRows();
+    const ElemType* value = parameter.m_value.BufferPointer();
+    vector<ElemType> columnIndices(numColumns);
+    parameter.m_columnValues.resize(numColumns * numRows);
+    for (size_t j = 0; j < numColumns; j++)
+    {
+        columnIndices[j] = (ElemType) parameter.m_columnIds[j];
+        memcpy(&parameter.m_columnValues[j * numRows], value + parameter.m_columnIds[j] * numRows, sizeof(ElemType) * numRows);
+    }
+
+    const DEVICEID_TYPE deviceId = parameter.m_node->GetDeviceId();
+    parameter.m_deviceColumns.SetValue(numRows, numColumns, deviceId, parameter.m_columnValues.data(), matrixFlagNormal);
+    parameter.m_deviceColumnIndices.SetValue(1, numColumns, deviceId, columnIndices.data(), matrixFlagNormal);
+
+    Matrix<ElemType>& deviceValue = parameter.m_node->Value();
+    parameter.m_deviceCurrentColumns.AssignGatheredColumnsOf(deviceValue, parameter.m_deviceColumnIndices);
+    parameter.m_deviceCurrentColumns *= (ElemType) -1;
+    deviceValue.AddScatteredColumnsOf(parameter.m_deviceCurrentColumns, parameter.m_deviceColumnIndices);
+    deviceValue.AddScatteredColumnsOf(parameter.m_deviceColumns, parameter.m_deviceColumnIndices);
+}
+
+template class OptimizerStateOffload<float>;
+template class OptimizerStateOffload<double>;
+
+} } }
@@ -0,0 +1,92 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// OptimizerStateOffload.h -- keeps the optimizer state of large parameters in host memory and updates them on the CPU
+//
+// The smoothed gradient of a parameter (momentum, AdaGrad and Adam accumulators) is as large as the parameter itself, or
+// twice as large for Adam. For the large GPU parameters selected here, SGD allocates it on the CPU instead, and the update
+// runs there, against a host copy of the parameter: BeginUpdate() downloads the gradient and starts the update on a
+// background thread, whose matrix operations use the vectorized and multi-threaded CPU kernels; Finish() waits for it and
+// uploads the updated parameter. SGD calls Finish() only right before the parameters are needed again, i.e. after the
+// reader has delivered the next minibatch, so that the CPU update overlaps with the GPU updates of the other parameters,
+// the logging, and the reading.
+// A block-sparse gradient (e.g. that of an embedding applied to a sparse input) is downloaded as its columns only, and if
+// the update touches only those columns (momentum SGD or AdaGrad without regularization and noise), only they are
+// uploaded again. The columns of the rest of the table, which are not used in the minibatch, do not move at all.
+// The host copy is authoritative while an epoch runs; StartEpoch() refreshes it from the device, which picks up a model
+// that was reloaded in between.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "Matrix.h"
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class OptimizerStateOffload
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+
+public:
+    // the update that BeginUpdate() runs on the host copies of a parameter and its gradient
+    typedef std::function<void(Matrix<ElemType>& value, Matrix<ElemType>& gradient)> UpdateFunction;
+
+    // offloads those of 'learnableNodes' that are on a GPU and have at least 'minElements' elements
+    OptimizerStateOffload(const std::list<ComputationNodeBasePtr>& learnableNodes, size_t minElements);
+    ~OptimizerStateOffload();
+
+    bool IsOffloaded(const ComputationNodeBasePtr& node) const
+    {
+        return m_parameters.find(node.get()) != m_parameters.end();
+    }
+    size_t NumOffloaded() const
+    {
+        return m_parameters.size();
+    }
+    size_t NumOffloadedElements() const;
+
+    // copies the offloaded parameters to their host copies; waits for pending updates first
+    void StartEpoch();
+
+    // downloads the gradient of 'node' and starts 'update' on the host copies; the node's Value() must not be used until Finish()
+    // 'sparseUpdate' tells that the update changes only the columns present in a block-sparse gradient.
+    void BeginUpdate(const ComputationNodeBasePtr& node, bool sparseUpdate, const UpdateFunction& update);
+
+    // waits for the updates begun since the last call and uploads the updated parameters; rethrows an error of an update
+    void Finish();
+
+private:
+    struct Parameter
+    {
+        ComputationNodePtr m_node;
+        Matrix<ElemType> m_value;           // host copy of m_node->Value()
+        Matrix<ElemType> m_gradient;        // host copy of the gradient, dense or block-sparse like the device one
+        std::vector<size_t> m_columnIds;    // columns of a block-sparse gradient
+        std::vector<ElemType> m_columnValues;
+        Matrix<ElemType> m_deviceColumns;        // for UploadColumns(), on the node's device
+        Matrix<ElemType> m_deviceColumnIndices;
+        Matrix<ElemType> m_deviceCurrentColumns;
+        bool m_uploadColumnsOnly;           // only m_columnIds changed
+        std::future<void> m_pendingUpdate;
+
+        Parameter(const ComputationNodePtr& node);
+    };
+
+    // copies the columns m_columnIds of the host copy into the node's value on the device
+    void UploadColumns(Parameter& parameter);
+
+    std::map<const ComputationNodeBase*, std::unique_ptr<Parameter>> m_parameters;
+    std::vector<Parameter*> m_pendingParameters; // those begun since the last Finish(), in that order
+};
+
+} } }
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include "Profiler.h"
 #include "BestGpu.h" // for CPUONLY flag only
+#include "ComputationNetwork.h"
+#include "NodeProfiler.h"
 
 #ifndef CPUONLY
 #include <cuda_profiler_api.h>
@@ -21,7 +23,8 @@ void cudaProfilerStop()
 
 Profiler::Profiler(int numSamples)
     : m_numSamples(numSamples),
-      m_isProfilingActive(false)
+      m_isProfilingActive(false),
+      m_numNodeProfilingSamples(0)
 {
 }
 
@@ -29,6 +32,8 @@ Profiler::~Profiler()
 {
     if (m_isProfilingActive)
         Stop();
+    if (m_profiledNetwork)
+        m_profiledNetwork->SetNodeProfiler(nullptr);
 }
 
 void Profiler::Start()
@@ -41,6 +46,9 @@ void Profiler::Start()
 
 void Profiler::NextSample()
 {
+    if (m_nodeProfiler)
+        m_numNodeProfilingSamples++;
+
     if (m_isProfilingActive)
     {
         if (--m_numSamples == 0)
@@ -60,3 +68,30 @@ void Profiler::Stop()
     fprintf(stderr, "Stopping profiling\n");
     m_isProfilingActive = false;
 }
+
+void Profiler::BeginNodeProfiling(const std::shared_ptr<Microsoft::MSR::CNTK::ComputationNetwork>& net, bool useCudaEvents)
+{
+    if (m_profiledNetwork)
+        m_profiledNetwork->SetNodeProfiler(nullptr);
+    m_profiledNetwork = net;
+    m_nodeProfiler = std::make_shared<Microsoft::MSR::CNTK::NodeProfiler>(useCudaEvents);
+    m_numNodeProfilingSamples = 0;
+    m_profiledNetwork->SetNodeProfiler(m_nodeProfiler);
+}
+
+void Profiler::EndNodeProfiling(const std::string& title, const std::wstring& traceFile)
+{
+    if (!m_profiledNetwork)
+        return;
+    m_profiledNetwork->SetNodeProfiler(nullptr);
+    m_profiledNetwork = nullptr;
+
+    fprintf(stderr, "%s: %d minibatches profiled per node.\n", title.c_str(), (int) m_numNodeProfilingSamples);
+    m_nodeProfiler->PrintSummary(stderr, title);
+    if (!traceFile.empty())
+    {
+        m_nodeProfiler->WriteChromeTrace(traceFile);
+        fprintf(stderr, "%s: Node profile trace written to %ls\n", title.c_str(), traceFile.c_str());
+    }
+    m_nodeProfiler = nullptr;
+}
@@ -4,6 +4,14 @@
 //
 #pragma once
 
+#include <memory>
+#include <string>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+class ComputationNetwork;
+class NodeProfiler;
+} } }
+
 class Profiler
 {
 public:
@@ -13,10 +21,20 @@ public:
     // Notifies transition to the next sample
     void NextSample();
 
+    // per-node profiling of all ForwardProp() and Backprop() calls on 'net' (see NodeProfiler.h)
+    // This is independent of the CUDA profiler's sample window, and lasts until EndNodeProfiling() or destruction.
+    void BeginNodeProfiling(const std::shared_ptr<Microsoft::MSR::CNTK::ComputationNetwork>& net, bool useCudaEvents);
+    // prints the summary to stderr and, if 'traceFile' is not empty, writes the Chrome trace to it
+    void EndNodeProfiling(const std::string& title, const std::wstring& traceFile);
+
 private:
     void Start();
     void Stop();
 
     int m_numSamples;
     bool m_isProfilingActive;
+
+    std::shared_ptr<Microsoft::MSR::CNTK::ComputationNetwork> m_profiledNetwork;
+    std::shared_ptr<Microsoft::MSR::CNTK::NodeProfiler> m_nodeProfiler;
+    size_t m_numNodeProfilingSamples;
 };
@@ -6,6 +6,7 @@
 #include "SGD.h"
 #include "NonlinearityNodes.h"          // for DropoutNode
 #include "SpecialPurposeNodes.h"        // for SequenceWithSoftmaxNode
+#include "PreComputeNodes.h"            // for MeanInvStdDevNodeBase
 #include "DataReaderHelpers.h"
 #include "MatrixQuantizerImpl.h"
 #ifdef QUANTIZED_GRADIENT_AGGREGATION
@@ -13,9 +14,17 @@
 #endif
 #include "SimpleDistGradAggregator.h"
 #include "ProgressTracing.h"
+#include "TrainingTimeline.h"
+#include "GPUWatcher.h"
+#include "CheckpointWriter.h"
+#include "LocalDataParallelReplicas.h"
+#include "HogwildWorkers.h"
+#include "OptimizerStateOffload.h"
 
 #include <map>
 #include <set>
+#include <cmath>
+#include <thread>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -52,12 +61,20 @@ void SGD<ElemType>::Train(function<ComputationNetworkPtr(DEVICEID_TYPE)> createN
     bool loadNetworkFromCheckpoint = false;
     if (startEpoch >= 0)
     {
+        // an epoch that was interrupted after a mid-epoch checkpoint continues from there
+        MidEpochCheckpoint midEpochCheckpoint;
+        if (LoadMidEpochCheckPoint(startEpoch, midEpochCheckpoint))
+            modelFileName = midEpochCheckpoint.m_modelFileName;
         loadNetworkFromCheckpoint = true;
         fprintf(stderr, "Starting from checkpoint. Loading network from '%ls'.\n", modelFileName.c_str());
     }
 
+    // (enabled before the network is created, so that its parameters are accounted for)
+    MemoryAccounting::SetEnabled(m_memoryAccounting);
+
     // create or load from checkpoint
-    shared_ptr<ComputationNetwork> net = !loadNetworkFromCheckpoint ? createNetworkFn(deviceId) : ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+    shared_ptr<ComputationNetwork> net = !loadNetworkFromCheckpoint ? createNetworkFn(deviceId) : ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName, m_networkOptions);
+    net->SetOptions(m_networkOptions); // (a created network has been compiled already, and is compiled anew if the options matter for that)
 
     // log the device we are computing on
     if (net->GetDeviceId() < 0)
@@ -84,6 +101,8 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
                           IDataReader<ElemType>* validationSetDataReader,
                           const DEVICEID_TYPE deviceId, const bool makeMode)
 {
+    MemoryAccounting::SetEnabled(m_memoryAccounting);
+
     int startEpoch = DetermineStartEpoch(makeMode);
     if (startEpoch == m_maxEpochs)
     {
@@ -96,14 +115,17 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
     if (startEpoch >= 0)
     {
         wstring modelFileName = GetModelNameForEpoch(int(startEpoch) - 1);
+        MidEpochCheckpoint midEpochCheckpoint;
+        if (LoadMidEpochCheckPoint(startEpoch, midEpochCheckpoint))
+            modelFileName = midEpochCheckpoint.m_modelFileName;
         fprintf(stderr, "Starting from checkpoint. Loading network from '%ls'.\n", modelFileName.c_str());
-        net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+        net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName, m_networkOptions);
         networkLoadedFromCheckpoint = true;
     }
     else
     {
         fprintf(stderr, "Load Network From the original model file %ls.\n", origModelFileName.c_str());
-        net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, origModelFileName);
+        net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, origModelFileName, m_networkOptions);
     }
 
     startEpoch = max(startEpoch, 0);
@@ -113,7 +135,7 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
     if (m_needAdaptRegularization)
     {
         fprintf(stderr, "Load reference Network From the original model file %ls.\n", origModelFileName.c_str());
-        refNet = ComputationNetwork::CreateFromFile<ElemType>(deviceId, origModelFileName);
+        refNet = ComputationNetwork::CreateFromFile<ElemType>(deviceId, origModelFileName, m_networkOptions);
     }
 
     ComputationNodeBasePtr refNode;
@@ -177,7 +199,57 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     auto preComputeNodesList = net->GetNodesRequiringPreComputation();
     additionalNodesToEvaluate.insert(additionalNodesToEvaluate.end(), preComputeNodesList.cbegin(), preComputeNodesList.cend());
 
+    // model parallelism: spread the network over the devices before any matrices are allocated
+    if (m_parallelizationMethod == ParallelizationMethod::ModelParallelSGD)
+    {
+        std::vector<ComputationNodeBasePtr> lastStageNodes(criterionNodes.begin(), criterionNodes.end());
+        lastStageNodes.insert(lastStageNodes.end(), evaluationNodes.begin(), evaluationNodes.end());
+        net->PlaceOnDevices<ElemType>(m_modelParallelDeviceIds, m_modelParallelStageStarts, lastStageNodes);
+    }
+
+    // heterogeneous placement: selected nodes and large embedding lookups on the CPU, before any matrices are allocated
+    if (!m_cpuNodes.empty() || m_cpuParameterThresholdMB > 0)
+    {
+        if (m_parallelizationMethod == ParallelizationMethod::ModelParallelSGD || m_parallelizationMethod == ParallelizationMethod::LocalDataParallelSGD)
+            InvalidArgument("cpuNodes and cpuParameterThresholdMB do not combine with ModelParallelSGD or LocalDataParallelSGD.");
+        std::map<std::wstring, DEVICEID_TYPE> nodeDevices;
+        for (const auto& nodeName : m_cpuNodes)
+            nodeDevices[nodeName] = CPUDEVICE;
+        net->PlaceNodesOnDevices<ElemType>(nodeDevices, (size_t) (m_cpuParameterThresholdMB * 1024 * 1024));
+    }
+
+    // half-precision storage of saved activations; requested before the replicas copy the nodes, and decided on by AllocateAllMatrices()
+    if (!m_halfPrecisionActivations.empty())
+    {
+        const size_t numNodes = net->SetStoreValuesInHalf(m_halfPrecisionActivations, m_halfPrecisionActivationFormat);
+        fprintf(stderr, "halfPrecisionActivations: Requested %s storage of the saved values of %d nodes.\n",
+                m_halfPrecisionActivationFormat == HalfFormat::fp16 ? "fp16" : "bfloat16", (int) numNodes);
+    }
+
+    // data parallelism within the process: replicas of the network on the other devices, created before the matrices are allocated
+    if (m_parallelizationMethod == ParallelizationMethod::LocalDataParallelSGD)
+    {
+        if (criterionNodes[0]->OperationName() == L"SequenceWithSoftmax")
+            InvalidArgument("LocalDataParallelSGD does not support sequence training, whose lattices are read into the criterion node of one network only.");
+        if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
+            InvalidArgument("LocalDataParallelSGD does not support KL-regularized adaptation.");
+        m_localReplicas = make_shared<LocalDataParallelReplicas<ElemType>>(net, m_localDataParallelDeviceIds, criterionNodes, evaluationNodes, additionalNodesToEvaluate);
+    }
+
+    // lock-free training by several CPU threads: replicas of the network that share its parameters
+    if (m_parallelizationMethod == ParallelizationMethod::HogwildSGD)
+    {
+        if (criterionNodes[0]->OperationName() == L"SequenceWithSoftmax")
+            InvalidArgument("HogwildSGD does not support sequence training, whose lattices are read into the criterion node of one network only.");
+        if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
+            InvalidArgument("HogwildSGD does not support KL-regularized adaptation.");
+        if (m_offloadOptimizerState)
+            InvalidArgument("HogwildSGD does not combine with offloadOptimizerState.");
+        m_hogwildWorkers = make_shared<HogwildWorkers<ElemType>>(net, m_hogwildNumThreads, criterionNodes, evaluationNodes, additionalNodesToEvaluate);
+    }
+
     // allocate memory for forward and backward computation
+    net->SetTraceLevel(m_traceLevel);
     net->AllocateAllMatrices(evaluationNodes, additionalNodesToEvaluate, criterionNodes[0]);
 
     // get feature and label nodes into an array of matrices that will be passed to GetMinibatch()
@@ -224,17 +296,39 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         refNet->AllocateAllMatrices({refNode}, {}, nullptr);
     }
 
+    Matrix<ElemType>::SetFP16GEMMEnabled(m_useFP16GEMM);
+    m_lossScale = m_initialLossScale;
+    m_numMBsSinceLossScaleChange = 0;
+    if (m_useFP16GEMM || m_lossScale != 1 || m_dynamicLossScaling)
+        fprintf(stderr, "\nMixed precision: FP16 GEMM %ls, loss scale %.9g (%ls).\n", m_useFP16GEMM ? L"on" : L"off", m_lossScale, m_dynamicLossScaling ? L"dynamic" : L"static");
+
     // initializing weights and gradient holder
     // only one criterion so far TODO: support multiple ones?
     auto& learnableNodes = net->LearnableParameterNodes(criterionNodes[0]);
     std::list<Matrix<ElemType>> smoothedGradients;
 
+    // the smoothed gradients of offloaded parameters live on the CPU
+    m_optimizerStateOffload.reset();
+    if (m_offloadOptimizerState)
+    {
+        if (m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD || m_parallelizationMethod == ParallelizationMethod::BlockMomentumSGD)
+            fprintf(stderr, "WARNING: offloadOptimizerState is ignored with model averaging, which modifies the parameters on their devices.\n");
+        else
+        {
+            m_optimizerStateOffload = make_shared<OptimizerStateOffload<ElemType>>(learnableNodes, m_offloadOptimizerStateMinElements);
+            fprintf(stderr, "Offloading the optimizer state of %d parameters (%.1f M elements) to the CPU.\n",
+                    (int) m_optimizerStateOffload->NumOffloaded(), m_optimizerStateOffload->NumOffloadedElements() / 1e6);
+        }
+    }
+
     for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
     {
         ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
+        MemoryAccounting::Context memory(*node, MemoryAccounting::optimizerState);
+        const bool isOffloaded = m_optimizerStateOffload && m_optimizerStateOffload->IsOffloaded(node);
         smoothedGradients.push_back(Matrix<ElemType>(node->Value().GetNumRows(),
                                                      node->Value().GetNumCols(),
-                                                     net->GetDeviceId()));
+                                                     isOffloaded ? CPUDEVICE : node->GetDeviceId()));
     }
 
     double epochCriterion, avgCriterion, prevCriterion, lrControlCriterion;
@@ -280,7 +374,19 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     }
 
     bool learnRateInitialized = false;
-    if (startEpoch > 0)
+    MidEpochCheckpoint midEpochCheckpoint; // of the epoch in progress
+    if (networkLoadedFromCheckpoint && LoadMidEpochCheckPoint(startEpoch, midEpochCheckpoint))
+    {
+        learnRateInitialized = LoadCheckPointInfo(startEpoch,
+                                                  /*out*/ totalSamplesSeen,
+                                                  /*out*/ learnRatePerSample,
+                                                  smoothedGradients,
+                                                  /*out*/ prevCriterion,
+                                                  /*out*/ m_prevChosenMinibatchSize,
+                                                  /*out*/ &midEpochCheckpoint);
+        prevLearnRates[startEpoch % m_numPrevLearnRates] = learnRatePerSample;
+    }
+    else if (startEpoch > 0)
     {
         learnRateInitialized = LoadCheckPointInfo(startEpoch - 1,
                                                   /*out*/ totalSamplesSeen,
@@ -307,6 +413,8 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
 
     // pass user config on memory allocation for convolution operations to the Network
     ComputationNetwork::SetMaxTempMemSizeForCNN(net, criterionNodes[0], m_maxTempMemSizeInSamplesForCNN);
+    if (m_localReplicas)
+        m_localReplicas->SetMaxTempMemSizeForCNN(m_maxTempMemSizeInSamplesForCNN);
     if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
     {
         ComputationNetwork::SetMaxTempMemSizeForCNN(refNet, refNode, m_maxTempMemSizeInSamplesForCNN);
@@ -316,7 +424,26 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     if (isSequenceTrainingCriterion)
     {
         ComputationNetwork::SetSeqParam<ElemType>(net, criterionNodes[0], m_hSmoothingWeight, m_frameDropThresh, m_doReferenceAlign,
-                                                  m_seqGammarCalcAMF, m_seqGammarCalcLMF, m_seqGammarCalcWP, m_seqGammarCalcbMMIFactor, m_seqGammarCalcUsesMBR);
+                                                  m_seqGammarCalcAMF, m_seqGammarCalcLMF, m_seqGammarCalcWP, m_seqGammarCalcbMMIFactor, m_seqGammarCalcUsesMBR,
+                                                  m_seqGammarCalcPruningBeam);
+    }
+
+    // The reader is skipped over the minibatches before a mid-epoch checkpoint, and the few that were buffered in the
+    // gradient aggregator or are needed for sequence training along with the lattices would be lost, so no mid-epoch
+    // checkpoints with these.
+    // With HogwildSGD, the threads do not stop at a common minibatch.
+    if ((m_numMBsPerCheckpoint > 0) && (isSequenceTrainingCriterion || m_bufferedAsyncGradientAggregation || m_hogwildWorkers))
+    {
+        fprintf(stderr, "WARNING: numMBsPerCheckpoint is not supported with sequence training, bufferedAsyncGradientAggregation or HogwildSGD; checkpointing at the end of each epoch only.\n");
+        m_numMBsPerCheckpoint = 0;
+    }
+
+    // elastic training: survive the failure of workers (see RecoverFromWorkerFailure())
+    const bool elasticTraining = m_elasticTraining && (g_mpi != nullptr) && (m_parallelizationMethod != ParallelizationMethod::None);
+    if (elasticTraining)
+    {
+        g_mpi->EnableFaultTolerance();
+        BroadcastTrainingState(learnableNodes, smoothedGradients, totalSamplesSeen);
     }
 
     // --- MAIN EPOCH LOOP
@@ -333,10 +460,21 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         timer.Start();
 
         // set dropout rate for this epoch
+        if (m_localReplicas) // (before the main network, which updates prevDropoutRate)
+            m_localReplicas->SetDropoutRate(m_dropoutRates[i], dropOutSeed);
+        if (m_hogwildWorkers)
+            m_hogwildWorkers->SetDropoutRate(m_dropoutRates[i], dropOutSeed);
         ComputationNetwork::SetDropoutRate<ElemType>(net, criterionNodes[0], m_dropoutRates[i], prevDropoutRate, dropOutSeed);
 
+        // when resuming an epoch, its learning rate and minibatch size come from the mid-epoch checkpoint
+        const bool resumingEpoch = (midEpochCheckpoint.m_epoch == i);
+
         // learning rate adjustment
-        if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::None || i < m_learningRatesParam.size())
+        if (resumingEpoch)
+        {
+            learnRatePerSample = midEpochCheckpoint.m_learnRatePerSample;
+        }
+        else if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::None || i < m_learningRatesParam.size())
         {
             // BUGBUG: GetNumParallelSequences() returns 1 under certain situations; it seems when restarting from checkpoint
             learnRatePerSample = GetLearningRatePerSample(i /*BUGBUG workaround:*/, trainSetDataReader->GetNumParallelSequences());
@@ -382,7 +520,11 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // basis for a set number of epochs.  For epochs after that point, m_mbSize.size(), either
         // we just keep using
         // the last minibatch size, or we use tuning to try and find a better one.
-        if (m_autoAdjustMinibatch && i >= m_mbSize.size())
+        if (resumingEpoch)
+        {
+            chosenMinibatchSize = midEpochCheckpoint.m_minibatchSize;
+        }
+        else if (m_autoAdjustMinibatch && i >= m_mbSize.size())
         {
             size_t numFramesToUseInSearch = m_numMiniBatch4LRSearch[i] * m_mbSize[i];
             if (m_epochSize != requestDataSize)
@@ -417,21 +559,52 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         fprintf(stderr, "Starting Epoch %d: learning rate per sample = %f  effective momentum = %f  momentum as time constant = %.1f samples\n",
                 i + 1, learnRatePerSample, MomentumPerMB(momentumPerSample, actualMinibatchSize), momentumAsTimeConstant);
 
-        TrainOneEpoch(net,
-                      refNet,
-                      refNode,
-                      i,
-                      m_epochSize,
-                      trainSetDataReader,
-                      learnRatePerSample,
-                      chosenMinibatchSize,
-                      featureNodes,
-                      labelNodes,
-                      criterionNodes,
-                      evaluationNodes,
-                      inputMatrices,
-                      learnableNodes, smoothedGradients,
-                      epochCriterion, epochEvalErrors, totalSamplesSeen);
+        if (!resumingEpoch)
+        {
+            midEpochCheckpoint = MidEpochCheckpoint();
+            midEpochCheckpoint.m_epoch = i;
+            midEpochCheckpoint.m_learnRatePerSample = learnRatePerSample;
+            midEpochCheckpoint.m_minibatchSize = chosenMinibatchSize;
+            midEpochCheckpoint.m_prevCriterion = prevCriterion;
+        }
+
+        // with elastic training, the epoch is redone from this in-memory state by the workers that survive a failure
+        std::unique_ptr<SearchSnapshot> epochStartState;
+        const MidEpochCheckpoint epochStartCheckpoint = midEpochCheckpoint;
+        if (elasticTraining)
+            epochStartState = SnapshotTrainingState(learnableNodes, smoothedGradients, totalSamplesSeen);
+
+        for (;;)
+        {
+            try
+            {
+                TrainOneEpoch(net,
+                              refNet,
+                              refNode,
+                              i,
+                              m_epochSize,
+                              trainSetDataReader,
+                              learnRatePerSample,
+                              chosenMinibatchSize,
+                              featureNodes,
+                              labelNodes,
+                              criterionNodes,
+                              evaluationNodes,
+                              inputMatrices,
+                              learnableNodes, smoothedGradients,
+                              epochCriterion, epochEvalErrors, totalSamplesSeen,
+                              "", &midEpochCheckpoint);
+                break;
+            }
+            catch (const MPIProcessFailure& failure)
+            {
+                if (!epochStartState)
+                    throw;
+                RecoverFromWorkerFailure(failure, evaluationNodes.size());
+                RestoreTrainingState(*epochStartState, learnableNodes, smoothedGradients, totalSamplesSeen);
+                midEpochCheckpoint = epochStartCheckpoint;
+            }
+        }
 
         timer.Stop();
         double epochTime = timer.ElapsedSeconds();
@@ -483,11 +656,13 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             }
         }
 
-        if ((g_mpi == nullptr) || g_mpi->IsMainNode())
+        // the validation set is evaluated by the main worker, by all workers together (m_distributedCV),
+        // or by the main worker in the background during the next epoch (m_asyncCV; then the score is the previous epoch's)
+        const bool useDistributedCV = m_distributedCV && (g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1);
+        if (((g_mpi == nullptr) || g_mpi->IsMainNode()) || useDistributedCV)
         {
             if (validationSetDataReader != trainSetDataReader && validationSetDataReader != nullptr)
             {
-                SimpleEvaluator<ElemType> evalforvalidation(net);
                 vector<wstring> cvSetTrainAndEvalNodes;
                 if (criterionNodes.size() > 0)
                 {
@@ -498,34 +673,54 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                     cvSetTrainAndEvalNodes.push_back(evaluationNodes[0]->NodeName());
                 }
 
-                vector<double> vScore = evalforvalidation.Evaluate(validationSetDataReader, cvSetTrainAndEvalNodes, m_mbSize[i]);
-                fprintf(stderr, "Finished Epoch[%2d of %d]: [Validation Set] TrainLossPerSample = %.8g", i + 1, (int) m_maxEpochs, vScore[0]);
-                if (vScore.size() > 1)
+                vector<double> vScore;
+                int cvEpoch = i;
+                bool haveCVScore = true;
+                if (m_asyncCV)
                 {
-                    fprintf(stderr, "; EvalErrPerSample = %.8g", vScore[1]);
+                    haveCVScore = FinishAsyncValidation(vScore, cvEpoch);
+                    StartAsyncValidation(net, learnableNodes, validationSetDataReader, cvSetTrainAndEvalNodes, m_mbSize[i], i);
                 }
-                fprintf(stderr, "\n");
-
-                if (m_useCVSetControlLRIfCVExists)
+                else
+                {
+                    SimpleEvaluator<ElemType> evalforvalidation(net, 100, 0, useDistributedCV ? g_mpi : nullptr);
+                    vScore = evalforvalidation.Evaluate(validationSetDataReader, cvSetTrainAndEvalNodes, m_mbSize[i]);
+                }
+                if (haveCVScore)
                 {
-                    if (m_useEvalCriterionControlLR && vScore.size() > 1)
+                    fprintf(stderr, "Finished Epoch[%2d of %d]: [Validation Set] TrainLossPerSample = %.8g", cvEpoch + 1, (int) m_maxEpochs, vScore[0]);
+                    if (vScore.size() > 1)
                     {
-                        lrControlCriterion = vScore[1];
+                        fprintf(stderr, "; EvalErrPerSample = %.8g", vScore[1]);
                     }
-                    else
+                    fprintf(stderr, "\n");
+
+                    if (m_useCVSetControlLRIfCVExists)
                     {
-                        lrControlCriterion = vScore[0]; // the first one is the training criterion
+                        if (m_useEvalCriterionControlLR && vScore.size() > 1)
+                        {
+                            lrControlCriterion = vScore[1];
+                        }
+                        else
+                        {
+                            lrControlCriterion = vScore[0]; // the first one is the training criterion
+                        }
                     }
                 }
             }
         }
 
         // broadcast epochCriterion to make sure each processor will have the same learning rate schedule
-        if ((m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD) && (g_mpi->NumNodesInUse() > 1))
+        if (((m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD) || (m_parallelizationMethod == ParallelizationMethod::BlockMomentumSGD)) &&
+            (g_mpi->NumNodesInUse() > 1))
         {
             g_mpi->Bcast(&epochCriterion, 1, g_mpi->MainNodeRank());
             g_mpi->Bcast(&lrControlCriterion, 1, g_mpi->MainNodeRank());
         }
+        else if (m_asyncCV && (g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1))
+        {
+            g_mpi->Bcast(&lrControlCriterion, 1, g_mpi->MainNodeRank()); // only the main worker knows the background evaluation
+        }
 
         bool loadedPrevModel = false;
         size_t epochsSinceLastLearnRateAdjust = i % m_learnRateAdjustInterval + 1;
@@ -549,6 +744,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 if (m_loadBestModel)
                 {
                     auto bestModelPath = GetModelNameForEpoch(i - m_learnRateAdjustInterval);
+                    WaitForCheckPoint();
                     fprintf(stderr, "Loading previous model with best training-criterion value: %ls.\n", bestModelPath.c_str());
                     net->RereadPersistableParameters<ElemType>(bestModelPath);
                     LoadCheckPointInfo(i - m_learnRateAdjustInterval,
@@ -628,29 +824,50 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // persist model and check-point info
         if ((g_mpi == nullptr) || g_mpi->IsMainNode())
         {
-            SaveCheckPointInfo(i, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
-            auto modelName = GetModelNameForEpoch(i);
-            fprintf(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
-            net->Save(modelName);
+            // delete previous checkpoint files to save space, once the new ones are written
+            vector<wstring> oldCheckPointFiles;
             if (!m_keepCheckPointFiles)
             {
-                // delete previous checkpoint file to save space
                 if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch && m_loadBestModel)
                 {
                     if (epochsSinceLastLearnRateAdjust != 1)
                     {
-                        _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                        oldCheckPointFiles.push_back(GetCheckPointFileNameForEpoch(i - 1));
                     }
                     if (epochsSinceLastLearnRateAdjust == m_learnRateAdjustInterval)
                     {
-                        _wunlink(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval).c_str());
+                        oldCheckPointFiles.push_back(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval));
                     }
                 }
                 else
                 {
-                    _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                    oldCheckPointFiles.push_back(GetCheckPointFileNameForEpoch(i - 1));
                 }
             }
+            // the mid-epoch checkpoint of this epoch is superseded in any case
+            if (!midEpochCheckpoint.m_modelFileName.empty())
+            {
+                oldCheckPointFiles.push_back(GetMidEpochCheckPointFileName(i));
+                oldCheckPointFiles.push_back(midEpochCheckpoint.m_modelFileName);
+            }
+            auto deleteOldCheckPointFiles = [oldCheckPointFiles]()
+            {
+                for (const auto& fileName : oldCheckPointFiles)
+                    _wunlink(fileName.c_str());
+            };
+
+            if (m_asyncCheckpoint)
+            {
+                SaveCheckPointAsync(net, i, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize, deleteOldCheckPointFiles);
+            }
+            else
+            {
+                SaveCheckPointInfo(i, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
+                auto modelName = GetModelNameForEpoch(i);
+                fprintf(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
+                net->Save(modelName);
+                deleteOldCheckPointFiles();
+            }
         }
 
         if (learnRatePerSample < 1e-12)
@@ -661,6 +878,20 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     }
     // --- END OF MAIN EPOCH LOOP
 
+    // the evaluation of the last model comes too late for the learning-rate control, but is reported
+    vector<double> lastCVScore;
+    int lastCVEpoch;
+    if (FinishAsyncValidation(lastCVScore, lastCVEpoch))
+    {
+        fprintf(stderr, "Finished Epoch[%2d of %d]: [Validation Set] TrainLossPerSample = %.8g", lastCVEpoch + 1, (int) m_maxEpochs, lastCVScore[0]);
+        if (lastCVScore.size() > 1)
+            fprintf(stderr, "; EvalErrPerSample = %.8g", lastCVScore[1]);
+        fprintf(stderr, "\n");
+    }
+
+    if (m_checkpointWriter)
+        m_checkpointWriter->Wait();
+
     // Synchronize all ranks before proceeding to ensure that
     // rank 0 has finished writing the model file
     if (g_mpi != nullptr)
@@ -710,8 +941,13 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                                     /*out*/ double& epochCriterion,
                                     /*out*/ std::vector<double>& epochEvalErrors,
                                     /*out*/ size_t& totalSamplesSeen,
-                                    std::string prefixMsg)
+                                    std::string prefixMsg,
+                                    MidEpochCheckpoint* midEpochCheckpoint)
 {
+    if (m_hogwildWorkers)
+        return TrainOneEpochHogwild(epochNumber, epochSize, trainSetDataReader, learnRatePerSample, tunedMBSize,
+                                    learnableNodes, smoothedGradients, epochCriterion, epochEvalErrors, totalSamplesSeen);
+
     double totalTimeInMBs = 0; // use double since timer has sub-microsecond time resolution
     double epochCriterionLastMBs = 0;
 
@@ -723,20 +959,34 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
     int numMBsRun = 0;
 
-    // NOTE: the following two local matrices are not used in distGradAgg path
     // assume only one training criterion node for each epoch.
-    // The criterion values are accumulated here over the minibatches (without having to pull them off the GPU).
+    // The criterion values are accumulated here over the minibatches (without having to pull them off the GPU). They are
+    // fetched only for progress tracing, checkpoints and at the end of the epoch; with several workers, the workers'
+    // accumulators are then summed (see GetEpochCriteria below).
     Matrix<ElemType> localEpochCriterion(1, 1, net->GetDeviceId());
     Matrix<ElemType> localEpochEvalErrors(1, epochEvalErrors.size(), net->GetDeviceId());
+    // with buffered async aggregation, the criteria of the last minibatch (see delayCriteria below)
+    Matrix<ElemType> delayedCriterion(1, 1, net->GetDeviceId());
+    Matrix<ElemType> delayedEvalErrors(1, epochEvalErrors.size(), net->GetDeviceId());
 
     localEpochCriterion.SetValue(0);
     localEpochEvalErrors.SetValue(0);
+    delayedCriterion.SetValue(0);
+    delayedEvalErrors.SetValue(0);
 
+    // during a parallel search (see EvaluateSearchCandidates()), every worker trains its own candidate
     bool useGradientAggregation = ((m_parallelizationMethod == ParallelizationMethod::DataParallelSGD) &&
-                                   (epochNumber >= m_parallelizationStartEpochNum));
-    bool useModelAveraging = ((m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD) &&
-                              (epochNumber >= m_parallelizationStartEpochNum));
+                                   (epochNumber >= m_parallelizationStartEpochNum) && !m_searchingLocally);
+    // block momentum is model averaging followed by a filter, at the same sync points
+    bool useBlockMomentum = ((m_parallelizationMethod == ParallelizationMethod::BlockMomentumSGD) &&
+                             (epochNumber >= m_parallelizationStartEpochNum) && !m_searchingLocally);
+    bool useModelAveraging = (((m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD) || useBlockMomentum) &&
+                              (epochNumber >= m_parallelizationStartEpochNum) && !m_searchingLocally);
     bool useParallelTrain = useGradientAggregation || useModelAveraging;
+    // With buffered async aggregation, the sample counts in the header come back one minibatch late, so the criteria are
+    // held back for one minibatch as well; that way, criteria and counts always cover the same minibatches.
+    bool delayCriteria = useGradientAggregation && m_bufferedAsyncGradientAggregation;
+    bool shareDropoutMasks = useGradientAggregation && (g_mpi->NumNodesInUse() > 1) && (m_dropoutRates[epochNumber] > 0);
 
     // MA-related variables
     size_t nSamplesSinceLastModelSync = 0;
@@ -751,11 +1001,26 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         epochEvalErrors.assign(epochEvalErrors.size(), double(0.0));
     }
 
+    if (useBlockMomentum && (g_mpi->NumNodesInUse() > 1))
+        InitializeBlockMomentum(learnableNodes);
+    if (useModelAveraging && (g_mpi->NumNodesInUse() > 1) && (m_numModelSyncBits < 8 * sizeof(ElemType)))
+        StartQuantizedModelAveraging(learnableNodes);
+
     Profiler profiler(m_numMBsToCUDAProfile);
 
     // resetting this, so profiling is performed for one epoch only
     m_numMBsToCUDAProfile = 0;
 
+    // per-node profiling covers every epoch; on the GPU, it synchronizes after each node to measure it
+    const bool profileNodes = m_profileNodes && ((g_mpi == nullptr) || g_mpi->IsMainNode());
+    if (profileNodes)
+        profiler.BeginNodeProfiling(net, net->GetDeviceId() != CPUDEVICE);
+
+    // the monitor is process-wide; its summary is printed on the main node only
+    DeviceTransferMonitor::SetMode(m_deviceTransferMode);
+    DeviceTransferMonitor::Reset();
+    MemoryAccounting::ResetPeaks();
+
     bool useDistributedMBReading = useParallelTrain &&
                                    m_enableDistributedMBReading &&
                                    trainSetDataReader->SupportsDistributedMBRead();
@@ -769,12 +1034,61 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         trainSetDataReader->StartMinibatchLoop(tunedMBSize, epochNumber, epochSize);
     }
 
+    // resume from a mid-epoch checkpoint: skip the minibatches trained before it, and continue the statistics
+    // With model averaging, the criteria are summed over the workers at the end, so the main worker continues the sums of all.
+    if (midEpochCheckpoint && (midEpochCheckpoint->m_numMBsRun > 0))
+    {
+        fprintf(stderr, "Resuming Epoch[%2d of %d] after minibatch %d from the mid-epoch checkpoint.\n",
+                epochNumber + 1, (int) m_maxEpochs, (int) midEpochCheckpoint->m_numMBsRun);
+        size_t numSkipped = trainSetDataReader->SkipMinibatches(midEpochCheckpoint->m_numMBsRun, *inputMatrices);
+        if (numSkipped < midEpochCheckpoint->m_numMBsRun)
+            fprintf(stderr, "WARNING: The reader has only %d minibatches before the end of the epoch.\n", (int) numSkipped);
+
+        numMBsRun = (int) midEpochCheckpoint->m_numMBsRun;
+        totalEpochSamples = midEpochCheckpoint->m_totalEpochSamples;
+        m_lossScale = midEpochCheckpoint->m_lossScale;
+        m_numMBsSinceLossScaleChange = midEpochCheckpoint->m_numMBsSinceLossScaleChange;
+        if (midEpochCheckpoint->m_epochEvalErrors.size() != epochEvalErrors.size())
+            RuntimeError("The mid-epoch checkpoint has %d evaluation criteria, but the network %d.", (int) midEpochCheckpoint->m_epochEvalErrors.size(), (int) epochEvalErrors.size());
+        // the criteria so far (summed over the workers) go into the main node's accumulators, since the workers' are summed when fetched
+        if ((!useGradientAggregation && !useModelAveraging) || g_mpi->IsMainNode())
+        {
+            localEpochCriterion.SetValue((ElemType) midEpochCheckpoint->m_epochCriterion);
+            std::vector<ElemType> evalErrors(midEpochCheckpoint->m_epochEvalErrors.begin(), midEpochCheckpoint->m_epochEvalErrors.end());
+            if (!evalErrors.empty())
+                localEpochEvalErrors.SetValue(1, evalErrors.size(), localEpochEvalErrors.GetDeviceId(), evalErrors.data());
+        }
+        if (!useModelAveraging || g_mpi->IsMainNode())
+        {
+            epochCriterionLastMBs = midEpochCheckpoint->m_epochCriterion;
+            epochEvalErrorsLastMBs = midEpochCheckpoint->m_epochEvalErrors;
+        }
+    }
+    int numMBsAtLastCheckpoint = numMBsRun;
+
+    // fetches the accumulated criteria; with gradient aggregation, summed over the workers (all workers call this after the same minibatch)
+    auto GetEpochCriteria = [&](double& criterion, std::vector<double>& evalErrors)
+    {
+        criterion = localEpochCriterion.Get00Element();
+        for (size_t i = 0; i < evalErrors.size(); i++)
+            evalErrors[i] = localEpochEvalErrors(0, i);
+        if (useGradientAggregation && (g_mpi->NumNodesInUse() > 1))
+        {
+            g_mpi->AllReduce(&criterion, 1);
+            g_mpi->AllReduce(evalErrors);
+        }
+    };
+
     net->StartEvaluateMinibatchLoop(evaluationNodes);
     net->StartEvaluateMinibatchLoop(criterionNodes);
     if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
     {
         refNet->StartEvaluateMinibatchLoop(refNode);
     }
+    if (m_localReplicas)
+        m_localReplicas->StartEpoch();
+    if (m_optimizerStateOffload)
+        m_optimizerStateOffload->StartEpoch();
 
     // prepare for sub-minibatching
     // Sub-minibatching is used if a single minibatch is too large to fit into GPU RAM.
@@ -796,6 +1110,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         }
     }
     // this is non-trivial, we need a manager object to handle this
+    if (numSubminibatchesNeeded > 1 && m_localReplicas)
+        InvalidArgument("Sub-minibatches (maxSamplesInRAM, numSubminibatches) are not supported with LocalDataParallelSGD; the minibatch is already split between the devices.");
     if (numSubminibatchesNeeded > 1)
         smbDispatcher.Init(net, learnableNodes, criterionNodes, evaluationNodes);
 
@@ -817,6 +1133,10 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             fprintf(stderr, ", BufferedAsyncGradientAggregation is ENABLED");
         }
     }
+    if (m_localReplicas)
+    {
+        fprintf(stderr, ", LocalDataParallelSGD training (NumDevices = %d)", (int) m_localReplicas->NumWorkers());
+    }
     if (useDistributedMBReading)
     {
         fprintf(stderr, ", distributed reading is ENABLED");
@@ -830,6 +1150,72 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     }
     fprintf(stderr, ".\n");
 
+    // distributed gradient aggregation: collect the gradients of the parameters to update
+    // With overlapped aggregation, we also need the order in which backprop finalizes them, which is the reverse evaluation order.
+    bool overlapGradientAggregation = useGradientAggregation && m_distGradAgg->SupportsOverlappedAggregation();
+    std::map<ComputationNodeBasePtr, size_t> gradientIndexOfNode;
+    std::vector<size_t> gradientFinalizationOrder;
+    if (useGradientAggregation)
+    {
+        learnParamsGradients.reserve(learnableNodes.size());
+        for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
+        {
+            ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
+            if (node->IsParameterUpdateRequired())
+            {
+                Matrix<ElemType>* currParamsGradient = &(node->Gradient());
+
+                // Sometimes, in parallel training, the current node may not get any samples to process
+                // In this case, the gradient matrix may not have been sized yet. If so, lets size it.
+                if (currParamsGradient->GetNumCols() == 0)
+                {
+                    Matrix<ElemType>* currParamsValues = &(node->Value());
+                    currParamsGradient->Resize(currParamsValues->GetNumRows(), currParamsValues->GetNumCols());
+                }
+
+                gradientIndexOfNode[*nodeIter] = learnParamsGradients.size();
+                learnParamsGradients.push_back(currParamsGradient);
+            }
+        }
+
+        if (overlapGradientAggregation)
+        {
+            const auto& evalOrder = net->GetEvalOrder(criterionNodes[0]);
+            std::vector<bool> isOrdered(learnParamsGradients.size(), false);
+            for (auto nodeIter = evalOrder.rbegin(); nodeIter != evalOrder.rend(); nodeIter++)
+            {
+                auto indexIter = gradientIndexOfNode.find(*nodeIter);
+                if (indexIter != gradientIndexOfNode.end() && !isOrdered[indexIter->second])
+                {
+                    gradientFinalizationOrder.push_back(indexIter->second);
+                    isOrdered[indexIter->second] = true;
+                }
+            }
+
+            // parameters the criterion does not depend on are never reported by backprop; they go last
+            for (size_t i = 0; i < learnParamsGradients.size(); i++)
+            {
+                if (!isOrdered[i])
+                    gradientFinalizationOrder.push_back(i);
+            }
+        }
+    }
+
+    // phase timing of each minibatch; every worker measures (and writes its own trace), the main one prints the statistics
+    if (m_profilePhases && !m_trainingTimeline)
+    {
+        int rank = (g_mpi == nullptr) ? 0 : (int) g_mpi->CurrentNodeRank();
+        wstring traceFile = m_phaseProfileTraceFile;
+        if (!traceFile.empty() && (g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1))
+            traceFile += L".rank" + std::to_wstring(rank);
+        m_trainingTimeline = make_shared<TrainingTimeline>(net->GetDeviceId(), m_phaseProfileSyncGPU, traceFile, rank);
+    }
+    TrainingTimeline* timeline = m_trainingTimeline.get();
+    if (timeline)
+        timeline->BeginEpoch(epochNumber);
+    if (m_distGradAgg)
+        m_distGradAgg->SetTimeline(timeline);
+
     Timer timer;
     timer.Start();
 
@@ -838,14 +1224,45 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     bool noMoreSamplesToProcess = false;
     for (;;)
     {
+        if (timeline)
+            timeline->BeginMinibatch();
+
         // get minibatch
         // TODO: is it guaranteed that the GPU is already completed at this point, is it safe to overwrite the buffers?
         size_t actualMBSize = 0;
-        bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, criterionNodes[0],
-                                                                      useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize);
+        bool wasDataRead;
+        {
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::readerPhase);
+            wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, criterionNodes[0],
+                                                                     useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize);
+            // dropout masks are laid out over the aggregate minibatch of all workers, in rank order (as DecimateMinibatch()
+            // assigns the sequences), so that they do not depend on the number of workers
+            if (shareDropoutMasks)
+            {
+                std::vector<size_t> numSequences(g_mpi->NumNodesInUse(), 0);
+                if (wasDataRead)
+                    numSequences[g_mpi->CurrentNodeRank()] = net->GetMBLayoutPtr()->GetNumParallelSequences();
+                g_mpi->AllReduce(numSequences);
+                size_t firstSequence = 0, totalSequences = 0;
+                for (size_t rank = 0; rank < numSequences.size(); rank++)
+                {
+                    if (rank < g_mpi->CurrentNodeRank())
+                        firstSequence += numSequences[rank];
+                    totalSequences += numSequences[rank];
+                }
+                ComputationNetwork::SetDropoutMinibatchShare<ElemType>(net, criterionNodes[0], firstSequence, totalSequences);
+            }
+            // the reader fills the main network only; each replica gets its share of the parallel sequences
+            if (wasDataRead && m_localReplicas)
+                actualMBSize = m_localReplicas->DistributeMinibatch(*inputMatrices);
+        }
         if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) // in case of distributed reading, we do a few more loops until all ranks have completed
             break;                                                                // end of epoch
 
+        // the offloaded updates of the previous minibatch ran while it was read; the forward pass needs their results
+        if (m_optimizerStateOffload)
+            m_optimizerStateOffload->Finish();
+
         // Note: If !wasDataRead then the data that GetMinibatchIntoNetwork() was supposed to full in are undefined.
         // Must not touch them.
 
@@ -862,6 +1279,18 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         ComputationNetwork::BumpEvalTimeStamp(featureNodes);
         ComputationNetwork::BumpEvalTimeStamp(labelNodes);
 
+        // With overlapped aggregation, backprop hands each gradient to the aggregator as soon as it is final.
+        // This must happen on all workers, also those without samples, so that they all issue the same all-reduces.
+        if (overlapGradientAggregation)
+            m_distGradAgg->StartOverlappedAggregation(learnParamsGradients, gradientFinalizationOrder, (int) evaluationNodes.size(), epochNumber);
+
+        // the replicas' work is queued first, so that their devices are busy while the main network's is issued
+        if (wasDataRead && m_localReplicas)
+        {
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::forwardPhase);
+            m_localReplicas->ForwardBackward(learnRatePerSample > 0.01 * m_minLearnRate, m_lossScale);
+        }
+
         if (actualMBSize > 0)
         {
             assert(wasDataRead);
@@ -905,20 +1334,38 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
                 // compute eval node first since when gradient is computed the forward function values
                 // may be changed and need to be recomputed when gradient and function value share the same matrix
-                net->ForwardProp(evaluationNodes); // the bulk of this evaluation is reused in ComputeGradient() below
+                {
+                    TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::forwardPhase);
+                    net->ForwardProp(evaluationNodes); // the bulk of this evaluation is reused in ComputeGradient() below
 
-                // ===========================================================
-                // forward prop for training criterion
-                // ===========================================================
+                    // ===========================================================
+                    // forward prop for training criterion
+                    // ===========================================================
 
-                net->ForwardProp(criterionNodes[0]);
+                    net->ForwardProp(criterionNodes[0]);
+                }
 
                 // ===========================================================
                 // backprop
                 // ===========================================================
 
                 if (learnRatePerSample > 0.01 * m_minLearnRate) // only compute gradient when learning rate is large enough
-                    net->Backprop(criterionNodes[0]);
+                {
+                    TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::backpropPhase);
+
+                    // with sub-minibatches, the gradients are only final after DoneWithCurrentMinibatch() has accumulated them
+                    if (overlapGradientAggregation && (actualNumSubminibatches == 1))
+                    {
+                        net->Backprop(criterionNodes[0], [&](const ComputationNodeBasePtr& node)
+                                      {
+                                          auto indexIter = gradientIndexOfNode.find(node);
+                                          if (indexIter != gradientIndexOfNode.end())
+                                              m_distGradAgg->GradientReady(indexIter->second);
+                                      }, m_lossScale);
+                    }
+                    else // after the first sub-minibatch, parameter gradients add up in place
+                        net->Backprop(criterionNodes[0], nullptr, m_lossScale, /*accumulateParameterGradients=*/ismb > 0);
+                }
 
                 // house-keeping for sub-minibatching
                 if (actualNumSubminibatches > 1)
@@ -935,69 +1382,77 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         size_t aggregateNumSamples = actualMBSize;
         size_t aggregateNumSamplesWithLabel = numSamplesWithLabel;
 
+        // accumulate criterion values (objective, eval)
+        if (delayCriteria)
+        {
+            // those of the previous minibatch go in, those of this one wait for its sample counts (an empty minibatch has none)
+            localEpochCriterion += delayedCriterion;
+            delayedCriterion.SetValue(0);
+            if (!evaluationNodes.empty())
+            {
+                localEpochEvalErrors += delayedEvalErrors;
+                delayedEvalErrors.SetValue(0);
+            }
+        }
+        if (actualMBSize != 0)
+        {
+            assert(wasDataRead);
+            // criteria are in Value()(0,0), we accumulate into another 1x1 Matrix (to avoid having to pull the values off the GPU)
+            Matrix<ElemType>::AddElementToElement(dynamic_pointer_cast<ComputationNode<ElemType>>(criterionNodes[0])->Value(),
+                                                  0, 0, delayCriteria ? delayedCriterion : localEpochCriterion, 0, 0);
+            for (size_t i = 0; i < evaluationNodes.size(); i++)
+            {
+                Matrix<ElemType>::AddElementToElement(dynamic_pointer_cast<ComputationNode<ElemType>>(evaluationNodes[i])->Value(),
+                                                      0, 0, delayCriteria ? delayedEvalErrors : localEpochEvalErrors, 0, i);
+            }
+        }
+
         if (!useGradientAggregation)
         {
-            // accumulate criterion values (objective, eval)
-            if (actualMBSize != 0)
+            // data parallelism within the process: the replicas' criteria and gradients are summed into the main network's
+            if (wasDataRead && m_localReplicas)
             {
-                assert(wasDataRead);
-                // criteria are in Value()(0,0), we accumulate into another 1x1 Matrix (to avoid having to pull the values off the GPU)
-                Matrix<ElemType>::AddElementToElement(dynamic_pointer_cast<ComputationNode<ElemType>>(criterionNodes[0])->Value(),
-                                                      0, 0, localEpochCriterion, 0, 0);
-                for (size_t i = 0; i < evaluationNodes.size(); i++)
+                m_localReplicas->AccumulateCriteria(localEpochCriterion, localEpochEvalErrors);
+                aggregateNumSamples += m_localReplicas->GetNumReplicaSamples();
+                aggregateNumSamplesWithLabel += m_localReplicas->GetNumReplicaSamplesWithLabel();
+                if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
                 {
-                    Matrix<ElemType>::AddElementToElement(dynamic_pointer_cast<ComputationNode<ElemType>>(evaluationNodes[i])->Value(),
-                                                          0, 0, localEpochEvalErrors, 0, i);
+                    TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::aggregationPhase);
+                    m_localReplicas->ReduceGradients(actualMBSize > 0);
                 }
             }
         }
         else
         {
             // distributed gradient aggregation
-            if (learnParamsGradients.size() == 0)
-            {
-                learnParamsGradients.reserve(learnableNodes.size());
-                for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
-                {
-                    ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
-                    if (node->IsParameterUpdateRequired())
-                    {
-                        Matrix<ElemType>* currParamsGradient = &(node->Gradient());
-
-                        // Sometimes, in parallel training, the current node may not get any samples to process
-                        // In this case, the gradient matrix may not have been sized yet. If so, lets size it.
-                        if (currParamsGradient->GetNumCols() == 0)
-                        {
-                            Matrix<ElemType>* currParamsValues = &(node->Value());
-                            currParamsGradient->Resize(currParamsValues->GetNumRows(), currParamsValues->GetNumCols());
-                        }
-
-                        learnParamsGradients.push_back(currParamsGradient);
-                    }
-                }
-            }
-
             // prepare the header
+            // The criteria stay in the accumulators on the device, and are summed over the workers only when fetched, since reading
+            // them here would wait for the device after every minibatch. The header carries just the sample counts.
+            m_gradHeader->Clear();
             m_gradHeader->numEvalNode = evaluationNodes.size();
             m_gradHeader->numSamples = actualMBSize;
             m_gradHeader->numSamplesWithLabel = numSamplesWithLabel;
-            m_gradHeader->criterion = actualMBSize > 0 ? criterionNodes[0]->Get00Element() : 0.0;
-            for (size_t i = 0; i < evaluationNodes.size(); i++)
-                m_gradHeader->evalErrors[i] = actualMBSize > 0 ? evaluationNodes[i]->Get00Element() : 0.0;
 
-            bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader, epochNumber);
+            bool samplesProcessed;
+            {
+                TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::aggregationPhase);
+                samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader, epochNumber);
+            }
             noMoreSamplesToProcess = !samplesProcessed;
 
             aggregateNumSamples = m_gradHeader->numSamples;
             aggregateNumSamplesWithLabel = m_gradHeader->numSamplesWithLabel;
-            epochCriterion += m_gradHeader->criterion;
-            for (size_t i = 0; i < epochEvalErrors.size(); i++)
-                epochEvalErrors[i] += m_gradHeader->evalErrors[i];
         }
 
         // update model parameters
-        if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
+        // (With gradient aggregation, all workers see the same gradients, so they all agree on skipping an update due to loss scaling.)
+        if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01) && UnscaleGradients(learnableNodes))
         {
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::updatePhase);
+            const double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtr()->GetNumParallelSequences());
+            const double globalClippingFactor = GlobalGradientClippingFactor(learnableNodes, aggregateNumSamples);
+            vector<ComputationNodeBasePtr> multiTensorNodes; // those updated together after the loop
+            vector<Matrix<ElemType>*> multiTensorSmoothedGradients;
             auto smoothedGradientIter = smoothedGradients.begin();
             for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
             {
@@ -1009,8 +1464,33 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                     if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
                         LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
 #endif
+                    if (m_optimizerStateOffload && m_optimizerStateOffload->IsOffloaded(node))
+                    {
+                        if (globalClippingFactor != 1)
+                            dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient() *= (ElemType) globalClippingFactor;
+                        // whether a block-sparse gradient changes only its own columns of the parameter
+                        const bool sparseUpdate = ((GradUpdateType() == GradientsUpdateType::None && !m_useNesterovMomentum) || GradUpdateType() == GradientsUpdateType::AdaGrad) &&
+                                                  m_L2RegWeight == 0 && m_L1RegWeight == 0 && GradientUpdateNoiseStd() == 0;
+                        const size_t optimizerStep = m_numOptimizerSteps + 1;
+                        m_optimizerStateOffload->BeginUpdate(node, sparseUpdate, [=, &smoothedGradient](Matrix<ElemType>& value, Matrix<ElemType>& gradient)
+                                                             {
+                                                                 UpdateWeightsS(this, value, gradient, smoothedGradient, learnRatePerSample, momentumPerSample,
+                                                                                aggregateNumSamples, m_L2RegWeight, m_L1RegWeight,
+                                                                                m_needAveMultiplier, m_useNesterovMomentum, optimizerStep);
+                                                             });
+                        continue;
+                    }
+                    if (m_multiTensorUpdate && IsMultiTensorUpdatable(node, smoothedGradient))
+                    {
+                        multiTensorNodes.push_back(node);
+                        multiTensorSmoothedGradients.push_back(&smoothedGradient);
+                        continue;
+                    }
+                    if (globalClippingFactor != 1)
+                        dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient() *= (ElemType) globalClippingFactor;
+                    MemoryAccounting::Context memory(*node, MemoryAccounting::optimizerState); // (optimizers may size their state lazily)
                     UpdateWeights(node, smoothedGradient, learnRatePerSample,
-                                  GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtr()->GetNumParallelSequences()), aggregateNumSamples,
+                                  momentumPerSample, aggregateNumSamples,
                                   m_L2RegWeight, m_L1RegWeight,
                                   m_needAveMultiplier, m_useNesterovMomentum);
 #ifdef _DEBUG
@@ -1019,11 +1499,26 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 #endif
                 }
             }
+            {
+                MemoryAccounting::Context memory(MemoryAccounting::optimizerState);
+                MultiTensorUpdateWeights(multiTensorNodes, multiTensorSmoothedGradients, globalClippingFactor, learnRatePerSample, momentumPerSample, aggregateNumSamples);
+            }
+            m_numOptimizerSteps++;
+
+            if (m_localReplicas)
+            {
+                if (m_optimizerStateOffload)
+                    m_optimizerStateOffload->Finish();
+                m_localReplicas->BroadcastParameters();
+            }
         }
 
         // aggregation by model averaging
+        bool modelAveragingSynced = false;
         if (useModelAveraging)
         {
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::modelAveragingPhase);
+
             // Determine if any samples were processed across any of the ranks
             if (useDistributedMBReading)
             {
@@ -1046,6 +1541,14 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                     // if a sync happens, do some extra work
                     nSamplesSinceLastModelSync = 0;
                     nSynced++;
+                    modelAveragingSynced = true;
+
+                    // the local momentum does not carry over into the block that starts from the filtered model
+                    if (useBlockMomentum && m_resetSGDMomentumAfterSync)
+                    {
+                        for (auto& smoothedGradient : smoothedGradients)
+                            smoothedGradient.SetValue(0);
+                    }
 
                     nSecondsOnMASync += secondsSpentOnSync;
                     nSecondsSinceLastMAPerfReport += secondsSinceLastSyncFinished;
@@ -1078,19 +1581,12 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             numMBsRun % m_numMBsToShowResult == 0)
         {
             // get the epoch Values updated
-            if (!useGradientAggregation)
-            {
-                timer.Restart();
-                epochCriterion = localEpochCriterion.Get00Element();
-                for (size_t i = 0; i < epochEvalErrors.size(); i++)
-                {
-                    epochEvalErrors[i] = localEpochEvalErrors(0, i);
-                }
-                timer.Stop();
+            timer.Restart();
+            GetEpochCriteria(epochCriterion, epochEvalErrors);
+            timer.Stop();
 
-                // Add the last trailing compute
-                totalTimeInMBs += timer.ElapsedSeconds();
-            }
+            // Add the last trailing compute
+            totalTimeInMBs += timer.ElapsedSeconds();
 
             double trainLossPerSample = (numSamplesLastMBs != 0) ? ((epochCriterion - epochCriterionLastMBs) / numSamplesLastMBs) : 0.0;
             bool wasProgressPrinted = false;
@@ -1160,7 +1656,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 epochEvalErrorsLastMBs[i] = epochEvalErrors[i];
             }
 
-            if (std::isnan(epochCriterion))
+            if (std::isnan(epochCriterion) && (m_searchEarlyExitCriterion == std::numeric_limits<double>::infinity())) // (a search stops the candidate below instead)
             {
                 RuntimeError("The training criterion is not a number (NAN).");
             }
@@ -1170,6 +1666,20 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         totalEpochSamples += aggregateNumSamplesWithLabel;
         totalSamplesSeen += aggregateNumSamplesWithLabel;
 
+        // a search candidate that is clearly worse than the base is not trained to the end
+        // The criterion is only looked at where it has been fetched above; with model averaging it differs between the workers.
+        if ((m_searchEarlyExitCriterion < std::numeric_limits<double>::infinity()) && (numMBsRun % m_numMBsToShowResult == 0) &&
+            (useGradientAggregation || !useParallelTrain) && (totalEpochSamples > 0))
+        {
+            double criterionPerSample = epochCriterion / totalEpochSamples;
+            if (std::isnan(criterionPerSample) || (criterionPerSample > m_searchEarlyExitCriterion))
+            {
+                fprintf(stderr, "%s Stopping early after %d minibatches: TrainLossPerSample = %.8g exceeds %.8g.\n",
+                        prefixMsg.c_str(), numMBsRun, criterionPerSample, m_searchEarlyExitCriterion);
+                break;
+            }
+        }
+
         // call DataEnd function
         // This signals something from SGD to the reader.
         // DataEnd does reader specific process if sentence ending is reached
@@ -1182,11 +1692,43 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // TODO: move the two-forward-pass support out of the reader.
         AttemptUtteranceDerivativeFeatures(net, trainSetDataReader, featureNodes, inputMatrices);
 
+        // mid-epoch checkpoint
+        // All workers take it after the same minibatch; with model averaging, after the first sync due, when they all have the same model.
+        if (midEpochCheckpoint && (m_numMBsPerCheckpoint > 0) && !noMoreSamplesToProcess &&
+            (numMBsRun - numMBsAtLastCheckpoint >= (int) m_numMBsPerCheckpoint) &&
+            (!useModelAveraging || (g_mpi->NumNodesInUse() == 1) || modelAveragingSynced))
+        {
+            double criterion;
+            std::vector<double> evalErrors(epochEvalErrors.size());
+            GetEpochCriteria(criterion, evalErrors);
+            if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
+            {
+                g_mpi->AllReduce(&criterion, 1);
+                g_mpi->AllReduce(evalErrors);
+            }
+            midEpochCheckpoint->m_numMBsRun = numMBsRun;
+            midEpochCheckpoint->m_totalEpochSamples = totalEpochSamples;
+            midEpochCheckpoint->m_epochCriterion = criterion;
+            midEpochCheckpoint->m_epochEvalErrors = evalErrors;
+            midEpochCheckpoint->m_lossScale = m_lossScale;
+            midEpochCheckpoint->m_numMBsSinceLossScaleChange = m_numMBsSinceLossScaleChange;
+            if (m_optimizerStateOffload)
+                m_optimizerStateOffload->Finish();
+            SaveMidEpochCheckPoint(net, totalSamplesSeen, smoothedGradients, *midEpochCheckpoint);
+            numMBsAtLastCheckpoint = numMBsRun;
+        }
+
         profiler.NextSample();
+
+        if (timeline)
+            timeline->EndMinibatch(aggregateNumSamplesWithLabel);
     }
 
     // --- END MAIN MINIBATCH LOOP
 
+    if (m_optimizerStateOffload)
+        m_optimizerStateOffload->Finish();
+
     if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
     {
         // may not be synced after epoch finished, so do the sync here
@@ -1194,33 +1736,25 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         g_mpi->AllReduce(&residualSampels, 1);
         totalSamplesSeen += residualSampels;
         totalEpochSamples += residualSampels;
-        ModelAveragingSync(nSamplesSinceLastModelSync, learnableNodes);
+        FinishPendingModelAverage(); // the final sync is a blocking one, so that all workers end the epoch with the same model
+        if (m_quantizedModelAverage)
+            ModelAveragingSyncQuantized(nSamplesSinceLastModelSync, learnableNodes);
+        else
+            ModelAveragingSync(nSamplesSinceLastModelSync, learnableNodes);
         nSynced++;
         nSamplesSinceLastModelSync = 0;
-    }
-
-    // compute final criterion values
-    if (useGradientAggregation)
-    {
-        // with parallelization, we have them in regular variables
-        epochCriterion /= float(totalEpochSamples);
-        for (size_t i = 0; i < epochEvalErrors.size(); i++)
+        if (useBlockMomentum && m_resetSGDMomentumAfterSync)
         {
-            epochEvalErrors[i] /= totalEpochSamples;
+            for (auto& smoothedGradient : smoothedGradients)
+                smoothedGradient.SetValue(0);
         }
     }
-    else
-    {
-        // without, we have them in Matrix objects that possibly live on the GPU--get them over now
-        localEpochCriterion /= float(totalEpochSamples);
-        localEpochEvalErrors /= float(totalEpochSamples);
 
-        epochCriterion = localEpochCriterion.Get00Element();
-        for (size_t i = 0; i < epochEvalErrors.size(); i++)
-        {
-            epochEvalErrors[i] = localEpochEvalErrors(0, i);
-        }
-    }
+    // compute final criterion values
+    // We have them in Matrix objects that possibly live on the GPU--get them over now (with gradient aggregation, summed over the workers).
+    localEpochCriterion /= float(totalEpochSamples);
+    localEpochEvalErrors /= float(totalEpochSamples);
+    GetEpochCriteria(epochCriterion, epochEvalErrors);
 
     // in case of model averaging, do one more final aggregation of criteria
     if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
@@ -1229,6 +1763,60 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         g_mpi->AllReduce(&epochCriterion, 1);
         g_mpi->AllReduce(epochEvalErrors);
     }
+
+    if (timeline && ((g_mpi == nullptr) || g_mpi->IsMainNode()))
+        timeline->PrintSummary(stderr, msra::strfun::strprintf("Epoch[%2d of %d]", epochNumber + 1, (int) m_maxEpochs));
+    if (profileNodes)
+        profiler.EndNodeProfiling(msra::strfun::strprintf("Epoch[%2d of %d]", epochNumber + 1, (int) m_maxEpochs),
+                                  m_nodeProfileTraceFile.empty() ? L"" : m_nodeProfileTraceFile + L"." + std::to_wstring(epochNumber + 1));
+    if (m_deviceTransferMode != DeviceTransferMonitor::off && ((g_mpi == nullptr) || g_mpi->IsMainNode()))
+        DeviceTransferMonitor::PrintSummary(stderr, msra::strfun::strprintf("Epoch[%2d of %d]", epochNumber + 1, (int) m_maxEpochs));
+    if (m_memoryAccounting && ((g_mpi == nullptr) || g_mpi->IsMainNode()))
+        MemoryAccounting::PrintSummary(stderr, msra::strfun::strprintf("Epoch[%2d of %d]", epochNumber + 1, (int) m_maxEpochs));
+    return totalEpochSamples;
+}
+
+// TrainOneEpoch() with HogwildSGD: the worker threads take the minibatches from the reader until the end of the epoch, and
+// update the parameters each after its own minibatches (see HogwildWorkers.h). There is no progress tracing within the epoch.
+template <class ElemType>
+size_t SGD<ElemType>::TrainOneEpochHogwild(const int epochNumber,
+                                           const size_t epochSize,
+                                           IDataReader<ElemType>* trainSetDataReader,
+                                           const double learnRatePerSample,
+                                           size_t tunedMBSize,
+                                           const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                           std::list<Matrix<ElemType>>& smoothedGradients,
+                                           /*out*/ double& epochCriterion,
+                                           /*out*/ std::vector<double>& epochEvalErrors,
+                                           /*out*/ size_t& totalSamplesSeen)
+{
+    trainSetDataReader->StartMinibatchLoop(tunedMBSize, epochNumber, epochSize);
+    const double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, trainSetDataReader->GetNumParallelSequences());
+    fprintf(stderr, "\nStarting minibatch loop, HogwildSGD training (NumThreads = %d).\n", (int) m_hogwildWorkers->NumWorkers());
+
+    Timer timer;
+    timer.Start();
+    size_t numSamplesWithLabel = 0;
+    const size_t totalEpochSamples = m_hogwildWorkers->TrainEpoch(*trainSetDataReader, learnRatePerSample > 0.01 * m_minLearnRate, learnableNodes, smoothedGradients,
+                                                                  [=](Matrix<ElemType>& value, Matrix<ElemType>& gradient, Matrix<ElemType>& smoothedGradient, size_t actualMBSize, size_t optimizerStep)
+                                                                  {
+                                                                      UpdateWeightsS(this, value, gradient, smoothedGradient, learnRatePerSample, momentumPerSample,
+                                                                                     actualMBSize, m_L2RegWeight, m_L1RegWeight,
+                                                                                     m_needAveMultiplier, m_useNesterovMomentum, optimizerStep);
+                                                                  },
+                                                                  epochCriterion, epochEvalErrors, numSamplesWithLabel);
+    timer.Stop();
+    totalSamplesSeen += numSamplesWithLabel;
+
+    if (totalEpochSamples > 0)
+    {
+        epochCriterion /= totalEpochSamples;
+        for (auto& evalError : epochEvalErrors)
+            evalError /= totalEpochSamples;
+    }
+    const double seconds = timer.ElapsedSeconds();
+    fprintf(stderr, "HogwildSGD: Epoch[%2d of %d]: %d samples in %.3fs; samplesPerSecond = %.1f\n",
+            epochNumber + 1, (int) m_maxEpochs, (int) totalEpochSamples, seconds, seconds > 0 ? totalEpochSamples / seconds : 0.0);
     return totalEpochSamples;
 }
 
@@ -1273,6 +1861,11 @@ std::vector<ComputationNodeBasePtr>& SGD<ElemType>::GetEvalCriterionNodes(Comput
 
 // execute PreComputeNodes
 // Returns true if precomputation was executed.
+// With several workers, each one reads its share of the data (or of each minibatch, if the reader cannot read distributed),
+// and the accumulators are combined at the end. With 'preComputeSampleFraction', only a random subset of blocks of
+// minibatches is read; the others are skipped with SkipMinibatches(), which the ReaderLib readers do without copying the data.
+// With 'preComputeCacheFile', the combined accumulators are saved, and a later run with the same reader configuration
+// and PreCompute settings restores them instead of reading the data.
 template <class ElemType>
 bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
                                IDataReader<ElemType>* trainSetDataReader,
@@ -1292,26 +1885,87 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     for (const auto & node : nodes)
         fprintf(stderr, "\tNodeName: %ls\n", (node->NodeName()).c_str());
 
+    // only Mean and InvStdDev expose accumulators that can be combined or cached
+    bool canCombine = true;
+    for (const auto& node : nodes)
+        canCombine &= (dynamic_pointer_cast<MeanInvStdDevNodeBase<ElemType>>(node) != nullptr);
+
+    // the cache is used only if every worker can read it, so that all take the same path
+    std::vector<PreComputeAccumulators> accumulators;
+    if (canCombine && !m_preComputeCacheFile.empty())
+    {
+        size_t numWorkersWithCache = LoadPreComputeCache(nodes, accumulators) ? 1 : 0;
+        size_t numWorkers = 1;
+        if (g_mpi != nullptr)
+        {
+            g_mpi->AllReduce(&numWorkersWithCache, 1);
+            numWorkers = g_mpi->NumNodesInUse();
+        }
+        if (numWorkersWithCache == numWorkers)
+        {
+            for (auto& node : nodes)
+                dynamic_pointer_cast<IPreComputeNode>(node)->MarkComputed(false /*begin accumulating*/);
+            SetPreComputeAccumulators(nodes, accumulators);
+            for (auto& node : nodes)
+                dynamic_pointer_cast<IPreComputeNode>(node)->MarkComputed(true /*done accumulating*/);
+            fprintf(stderr, "\nPrecomputing --> Restored from cache file %ls.\n\n", m_preComputeCacheFile.c_str());
+            return true;
+        }
+        accumulators.clear();
+    }
+
+    // split the data across the workers
+    bool useParallelPreCompute = canCombine && m_distributedPreCompute && (g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1);
+    bool useDistributedMBReading = useParallelPreCompute && trainSetDataReader->SupportsDistributedMBRead();
+
     // compute
     // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , requestDataSize);
     // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
     // [1/12/2015 erw] to support large dataset, we usually partition whole dataset into several epoch's,
     // so we need to use all the data to do precomputing
-    if (m_useAllDataForPreComputedNode) // using all the data
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0);
-    else // using only one epoch
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, m_epochSize);
+    size_t requestedSamples = m_useAllDataForPreComputedNode ? requestDataSize : m_epochSize; // using all the data, or only one epoch
+    if (useDistributedMBReading)
+        trainSetDataReader->StartDistributedMinibatchLoop(m_mbSize[0], 0, g_mpi->CurrentNodeRank(), g_mpi->NumNodesInUse(), requestedSamples);
+    else
+        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, requestedSamples);
     net->StartEvaluateMinibatchLoop(nodes);
 
+    if (useParallelPreCompute)
+        fprintf(stderr, "Precomputing --> Distributed over %d workers (%s).\n", (int) g_mpi->NumNodesInUse(),
+                useDistributedMBReading ? "distributed reading" : "decimated minibatches");
+
     // initialize
     for (auto & node : nodes)
         dynamic_pointer_cast<IPreComputeNode>(node)->MarkComputed(false /*begin accumulating*/);
 
+    // blocks to sample; the first one is always read, so that there is data even for a tiny fraction
+    bool sampleBlocks = (m_preComputeSampleFraction < 1);
+    std::mt19937 sampleRng(/*seed=*/0);
+    std::bernoulli_distribution sampleBlock(m_preComputeSampleFraction);
+    size_t numMBsRead = 0;
+    size_t numMBsSkipped = 0;
+
     const size_t numIterationsBeforePrintingProgress = 100;
     size_t numItersSinceLastPrintOfProgress = 0;
-    size_t actualMBSizeDummy;
-    while (DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, nullptr, false, false, *inputMatrices, actualMBSizeDummy))
+    size_t actualMBSize;
+    for (size_t mbIndex = 0;; mbIndex++)
     {
+        if (sampleBlocks && (mbIndex > 0) && (mbIndex % m_preComputeSampleBlockSize == 0) && !sampleBlock(sampleRng))
+        {
+            size_t numSkipped = trainSetDataReader->SkipMinibatches(m_preComputeSampleBlockSize, *inputMatrices);
+            numMBsSkipped += numSkipped;
+            if (numSkipped < m_preComputeSampleBlockSize)
+                break; // end of data
+            mbIndex += m_preComputeSampleBlockSize - 1;
+            continue;
+        }
+
+        if (!DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, nullptr, useDistributedMBReading, useParallelPreCompute, *inputMatrices, actualMBSize))
+            break;
+        numMBsRead++;
+        if (actualMBSize == 0)
+            continue; // this worker got no share of this minibatch
+
         // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
         ComputationNetwork::BumpEvalTimeStamp(featureNodes);
         ComputationNetwork::BumpEvalTimeStamp(labelNodes);
@@ -1330,6 +1984,41 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
         }
     }
 
+    if (sampleBlocks)
+        fprintf(stderr, "Precomputing --> Sampled %d minibatches, skipped %d.\n", (int) numMBsRead, (int) numMBsSkipped);
+
+    // combine the workers' accumulators, and cache them
+    if (useParallelPreCompute || !m_preComputeCacheFile.empty())
+    {
+        for (const auto& node : nodes)
+        {
+            auto meanVarNode = dynamic_pointer_cast<MeanInvStdDevNodeBase<ElemType>>(node);
+            Matrix<ElemType> mean(CPUDEVICE), var(CPUDEVICE);
+            meanVarNode->GetAccumulators(mean, var);
+
+            PreComputeAccumulators acc;
+            acc.m_nodeName = node->NodeName();
+            acc.m_numSamples = meanVarNode->GetNumAccumulatedSamples();
+            std::unique_ptr<ElemType[]> meanValues(mean.CopyToArray());
+            acc.m_mean.assign(meanValues.get(), meanValues.get() + mean.GetNumElements());
+            if (var.GetNumElements() > 0)
+            {
+                std::unique_ptr<ElemType[]> varValues(var.CopyToArray());
+                acc.m_var.assign(varValues.get(), varValues.get() + var.GetNumElements());
+            }
+            accumulators.push_back(std::move(acc));
+        }
+
+        if (useParallelPreCompute)
+        {
+            AggregatePreComputeAccumulators(accumulators);
+            SetPreComputeAccumulators(nodes, accumulators);
+        }
+
+        if (!m_preComputeCacheFile.empty() && ((g_mpi == nullptr) || g_mpi->IsMainNode()))
+            SavePreComputeCache(accumulators);
+    }
+
     // finalize
     for (auto & node : nodes)
         dynamic_pointer_cast<IPreComputeNode>(node)->MarkComputed(true /*done accumulating*/);
@@ -1339,9 +2028,144 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     return true;
 }
 
-// return a reasonable initial learning rate based on the initial mbsize
+// Combines the statistics of the workers with the parallel form of Chan et al.'s update: with n = sum_i n_i,
+// mean = sum_i n_i mean_i / n, and var = sum_i n_i (var_i + (mean_i - mean)^2) / n. Unlike the sums of x and x^2, this
+// does not cancel catastrophically. Each of the three sums is one AllReduce over all nodes, in double precision.
 template <class ElemType>
-double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
+void SGD<ElemType>::AggregatePreComputeAccumulators(std::vector<PreComputeAccumulators>& accumulators)
+{
+    std::vector<double> numSamples;
+    std::vector<double> weightedMeans;
+    for (const auto& acc : accumulators)
+    {
+        numSamples.push_back((double) acc.m_numSamples);
+        for (auto mean : acc.m_mean)
+            weightedMeans.push_back(acc.m_numSamples * mean);
+    }
+    g_mpi->AllReduce(numSamples);
+    g_mpi->AllReduce(weightedMeans);
+
+    std::vector<double> sumsOfSquares;
+    size_t k = 0;
+    for (size_t i = 0; i < accumulators.size(); i++)
+    {
+        auto& acc = accumulators[i];
+        for (size_t j = 0; j < acc.m_mean.size(); j++, k++)
+        {
+            double globalMean = numSamples[i] > 0 ? weightedMeans[k] / numSamples[i] : 0;
+            if (!acc.m_var.empty())
+            {
+                double delta = acc.m_mean[j] - globalMean;
+                sumsOfSquares.push_back(acc.m_numSamples * (acc.m_var[j] + delta * delta));
+            }
+            acc.m_mean[j] = globalMean;
+        }
+    }
+    g_mpi->AllReduce(sumsOfSquares);
+
+    k = 0;
+    for (size_t i = 0; i < accumulators.size(); i++)
+    {
+        auto& acc = accumulators[i];
+        for (auto& var : acc.m_var)
+            var = numSamples[i] > 0 ? sumsOfSquares[k++] / numSamples[i] : 0;
+        acc.m_numSamples = (size_t) numSamples[i];
+    }
+}
+
+// hands the accumulators (in the order of 'nodes') back to the nodes, which must be accumulating
+template <class ElemType>
+void SGD<ElemType>::SetPreComputeAccumulators(const std::list<ComputationNodeBasePtr>& nodes, const std::vector<PreComputeAccumulators>& accumulators)
+{
+    auto acc = accumulators.begin();
+    for (auto& node : nodes)
+    {
+        auto meanVarNode = dynamic_pointer_cast<MeanInvStdDevNodeBase<ElemType>>(node);
+        DEVICEID_TYPE deviceId = meanVarNode->Value().GetDeviceId();
+        std::vector<ElemType> mean(acc->m_mean.begin(), acc->m_mean.end());
+        std::vector<ElemType> var(acc->m_var.begin(), acc->m_var.end());
+        Matrix<ElemType> meanMatrix(mean.size(), 1, mean.data(), deviceId);
+        Matrix<ElemType> varMatrix(deviceId);
+        if (!var.empty())
+            varMatrix.SetValue(var.size(), 1, deviceId, var.data());
+        meanVarNode->SetAccumulators(acc->m_numSamples, meanMatrix, varMatrix);
+        acc++;
+    }
+}
+
+template <class ElemType>
+std::wstring SGD<ElemType>::GetPreComputeCacheKey() const
+{
+    return msra::strfun::wstrprintf(L"%ls;useAllData=%d;epochSize=%llu;mbSize=%llu;sampleFraction=%.17g;sampleBlockSize=%llu;precision=%d",
+                                    m_preComputeCacheKey.c_str(), (int) m_useAllDataForPreComputedNode,
+                                    (unsigned long long) (m_useAllDataForPreComputedNode ? 0 : m_epochSize), (unsigned long long) m_mbSize[0],
+                                    m_preComputeSampleFraction, (unsigned long long) m_preComputeSampleBlockSize, (int) sizeof(ElemType));
+}
+
+template <class ElemType>
+bool SGD<ElemType>::LoadPreComputeCache(const std::list<ComputationNodeBasePtr>& nodes, /*out*/ std::vector<PreComputeAccumulators>& accumulators)
+{
+    if (!fexists(m_preComputeCacheFile.c_str()))
+        return false;
+
+    File fstream(m_preComputeCacheFile, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+    std::wstring key;
+    fstream >> key;
+    if (key != GetPreComputeCacheKey())
+    {
+        fprintf(stderr, "PreCompute cache file %ls was made for different data or settings, ignoring it.\n", m_preComputeCacheFile.c_str());
+        return false;
+    }
+
+    std::map<std::wstring, PreComputeAccumulators> cached;
+    size_t numNodes;
+    fstream >> numNodes;
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        PreComputeAccumulators acc;
+        fstream >> acc.m_nodeName >> acc.m_numSamples >> acc.m_mean >> acc.m_var;
+        cached[acc.m_nodeName] = std::move(acc);
+    }
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+
+    // all nodes must be covered, with their current dimensions
+    accumulators.clear();
+    for (const auto& node : nodes)
+    {
+        auto iter = cached.find(node->NodeName());
+        if ((iter == cached.end()) || (iter->second.m_mean.size() != node->GetSampleMatrixNumRows()))
+        {
+            fprintf(stderr, "PreCompute cache file %ls does not match node %ls, ignoring it.\n", m_preComputeCacheFile.c_str(), node->NodeName().c_str());
+            return false;
+        }
+        accumulators.push_back(iter->second);
+    }
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::SavePreComputeCache(const std::vector<PreComputeAccumulators>& accumulators)
+{
+    // same write-then-rename as for checkpoints, so that an interrupted run does not leave a truncated cache behind
+    wstring tempFileName = m_preComputeCacheFile + L".tmp";
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+        fstream << GetPreComputeCacheKey();
+        fstream << accumulators.size();
+        for (const auto& acc : accumulators)
+            fstream << acc.m_nodeName << acc.m_numSamples << acc.m_mean << acc.m_var;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+        fstream.Flush();
+    }
+    renameOrDie(tempFileName, m_preComputeCacheFile);
+    fprintf(stderr, "Precomputing --> Saved to cache file %ls.\n", m_preComputeCacheFile.c_str());
+}
+
+// return a reasonable initial learning rate based on the initial mbsize
+template <class ElemType>
+double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                                              ComputationNetworkPtr refNet,
                                              const ComputationNodeBasePtr& refNode, const int epochNumber,
                                              const double curLearnRate,
@@ -1382,6 +2206,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
     }
 
     int baseModelEpoch = epochNumber - 1;
+    WaitForCheckPoint();
     net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
 
     double learnRate = learnRatePerSample;
@@ -1393,42 +2218,61 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                        /*out*/ prevCriterion,
                        /*out*/ dummyMinibatchSize);
 
-    // if model is not changed this is what we will get
-    TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                    numFramesToUseInSearch, trainSetDataReader, 0, m_mbSize[epochNumber],
-                                    featureNodes, labelNodes,
-                                    criterionNodes, evaluationNodes,
-                                    inputMatrices, learnableNodes,
-                                    smoothedGradients, /*out*/ baseCriterion,
-                                    /*out*/ epochEvalErrors, /*out*/ totalSamplesSeen,
-                                    "BaseAdaptiveLearnRateSearch:");
+    // the trials start from this state in memory, instead of rereading it
+    TakeSearchSnapshot(learnableNodes, smoothedGradients, totalSamplesSeen);
 
-    if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::SearchBeforeEpoch)
+    // Decrease the learning rate until the criterion is no worse than with learning rate 0 (the model not changed).
+    // The candidates are evaluated in rounds of one per search worker; the first round includes the base.
+    const size_t numSearchWorkers = NumSearchWorkers();
+    std::vector<SearchCandidate> candidates(1, SearchCandidate(0, m_mbSize[epochNumber], "BaseAdaptiveLearnRateSearch:"));
+    bool isFirstRound = true;
+    bool found = false;
+    while (!found)
     {
-        if (prevCriterion == std::numeric_limits<double>::infinity())
-            prevCriterion = baseCriterion;
+        double candidateLearnRatePerSample = learnRatePerSample;
+        while (candidates.size() < numSearchWorkers)
+        {
+            candidateLearnRatePerSample *= 0.618;
+            candidates.push_back(SearchCandidate(candidateLearnRatePerSample, m_mbSize[epochNumber], "AdaptiveLearnRateSearch:"));
+        }
 
-        double ratio = 0.3;
+        double earlyExitCriterion = (!isFirstRound && m_searchEarlyExitFactor > 0) ? baseCriterion * m_searchEarlyExitFactor : std::numeric_limits<double>::infinity();
+        std::vector<double> criteria = EvaluateSearchCandidates(candidates, earlyExitCriterion,
+                                                                net, refNet, refNode, epochNumber,
+                                                                numFramesToUseInSearch, trainSetDataReader,
+                                                                featureNodes, labelNodes,
+                                                                criterionNodes, evaluationNodes,
+                                                                inputMatrices, learnableNodes, smoothedGradients);
+        size_t k = 0;
+        if (isFirstRound)
+        {
+            // if model is not changed this is what we will get
+            baseCriterion = criteria[k++];
 
-        if (m_epochSize != requestDataSize)
-            ratio = pow(((double) numFramesToUseInSearch) / m_epochSize, 1.0f / 2);
+            if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::SearchBeforeEpoch)
+            {
+                if (prevCriterion == std::numeric_limits<double>::infinity())
+                    prevCriterion = baseCriterion;
 
-        baseCriterion = max(ratio * prevCriterion + (1 - ratio) * baseCriterion, baseCriterion);
-    }
+                double ratio = 0.3;
 
-    do
-    {
-        learnRatePerSample *= 0.618;
-        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                        numFramesToUseInSearch, trainSetDataReader,
-                                        learnRatePerSample, m_mbSize[epochNumber], featureNodes,
-                                        labelNodes, criterionNodes,
-                                        evaluationNodes, inputMatrices,
-                                        learnableNodes, smoothedGradients,
-                                        /*out*/ epochCriterion, /*out*/ epochEvalErrors,
-                                        /*out*/ totalSamplesSeen, "AdaptiveLearnRateSearch:");
+                if (m_epochSize != requestDataSize)
+                    ratio = pow(((double) numFramesToUseInSearch) / m_epochSize, 1.0f / 2);
+
+                baseCriterion = max(ratio * prevCriterion + (1 - ratio) * baseCriterion, baseCriterion);
+            }
+            isFirstRound = false;
+        }
 
-    } while (std::isnan(epochCriterion) || (epochCriterion > baseCriterion && learnRatePerSample > minLearnRate));
+        // the first (largest) candidate that is good enough, as the sequential search would stop there
+        for (; k < candidates.size() && !found; k++)
+        {
+            learnRatePerSample = candidates[k].m_learnRatePerSample;
+            epochCriterion = criteria[k];
+            found = !std::isnan(epochCriterion) && !(epochCriterion > baseCriterion && learnRatePerSample > minLearnRate);
+        }
+        candidates.clear();
+    }
 
     bestLearnRatePerSample = learnRatePerSample;
 
@@ -1494,6 +2338,8 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
         bestLearnRatePerSample = (leftCriterion < rightCriterion) ? leftLearnRatePerSample : rightLearnRatePerSample;
     }
 
+    m_searchSnapshot.reset();
+
     fprintf(stderr, "Best Learn Rate Per Sample for Epoch[%d] = %.10g  baseCriterion=%.10g\n",
             epochNumber + 1, bestLearnRatePerSample, baseCriterion);
 
@@ -1588,6 +2434,10 @@ size_t SGD<ElemType>::AdaptiveMinibatchSizing(ComputationNetworkPtr net,
             maxMinibatchSize = min(maxMinibatchSize, m_prevChosenMinibatchSize * 2);
         }
 
+        // don't try sizes that would run out of GPU memory
+        if (net->GetDeviceId() >= 0 && m_minibatchSizeTuningMemoryFraction > 0)
+            maxMinibatchSize = GetMaxMinibatchSizeForDeviceMemory(net, maxMinibatchSize);
+
         chosenMinibatchSize = SearchForBestMinibatchSize(net, refNet, refNode, epochNumber,
                                                          numFramesToUseInSearch, trainSetDataReader,
                                                          learnRatePerSample, featureNodes,
@@ -1600,6 +2450,46 @@ size_t SGD<ElemType>::AdaptiveMinibatchSizing(ComputationNetworkPtr net,
     return chosenMinibatchSize;
 }
 
+// Predicts the memory of the node matrices from the memory sharing plan as a function of the number of minibatch columns
+// (see ComputationNetwork::EstimateDeviceMemory()), and returns the largest minibatch size up to 'maxMinibatchSize' for which
+// it stays within m_minibatchSizeTuningMemoryFraction of what is available: the free device memory plus what the node
+// matrices hold already. Minibatch sizes count samples; in sequence mode, the columns per sample (padding) are taken from the
+// last minibatch.
+template <class ElemType>
+size_t SGD<ElemType>::GetMaxMinibatchSizeForDeviceMemory(ComputationNetworkPtr net, size_t maxMinibatchSize)
+{
+    const DEVICEID_TYPE deviceId = net->GetDeviceId();
+    const double budget = m_minibatchSizeTuningMemoryFraction * (GPUWatcher::GetFreeMemoryOnCUDADevice(deviceId) + net->GetAllocatedDeviceMemory(deviceId));
+    double columnsPerSample = 1;
+    const MBLayoutPtr& pMBLayout = net->GetMBLayoutPtr();
+    if (pMBLayout && pMBLayout->GetActualNumSamples() > 0)
+        columnsPerSample = (double) pMBLayout->GetNumCols() / pMBLayout->GetActualNumSamples();
+
+    auto estimate = [&](size_t minibatchSize)
+    {
+        return (double) net->EstimateDeviceMemory(deviceId, 1, (size_t) ceil(minibatchSize * columnsPerSample));
+    };
+    if (budget <= 0 || estimate(maxMinibatchSize) <= budget)
+        return maxMinibatchSize;
+
+    // the estimate grows monotonically with the minibatch size
+    size_t fits = 0;
+    size_t exceeds = maxMinibatchSize;
+    while (exceeds - fits > 1)
+    {
+        size_t middle = fits + (exceeds - fits) / 2;
+        if (estimate(middle) <= budget)
+            fits = middle;
+        else
+            exceeds = middle;
+    }
+    const double fixedBytes = estimate(0);
+    fprintf(stderr, "AdaptiveMinibatchSearch: Limiting maxMinibatchSize to %d, the largest that fits into %.1f MB of GPU memory "
+                    "(estimated %.1f MB + %.3f MB per sample).\n",
+            (int) fits, budget / 1e6, fixedBytes / 1e6, (estimate(1000) - fixedBytes) / 1e9);
+    return max(fits, (size_t) 1);
+}
+
 static size_t RoundToMultipleOf64(float val)
 {
     return 64 * (size_t)((val + 32) / 64);
@@ -1635,73 +2525,81 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
         return maxMinibatchSize;
     }
 
-    size_t trialMinibatchSize = 0;
-    bool isFirstIteration = true;
-    double baseCriterion = 0;
+    // the trials start from the current state in memory, instead of rereading it
+    TakeSearchSnapshot(learnableNodes, smoothedGradients, 0);
 
     // increase the minibatch size by a factor of sqrt(2) in each step.
     const float minibatchSizeTuningFactor = sqrtf(2.0f);
-
-    size_t lastTriedTrialMinibatchSize = 0;
-    double lastTriedTrialEpochCriterion = 0;
+    std::vector<size_t> trialMinibatchSizes;
     for (float trialMinibatchSizeFloat = (float) minMinibatchSize;
          trialMinibatchSizeFloat <= maxMinibatchSize;
          trialMinibatchSizeFloat *= minibatchSizeTuningFactor)
     {
         // round mbsize to something meaningful
-        trialMinibatchSize = RoundToMultipleOf64(trialMinibatchSizeFloat);
-
-        fprintf(stderr, "\nAdaptiveMinibatchSearch: Evaluating trial minibatchSize=%zd out of range %zd..%zd ...\n\n",
-                trialMinibatchSize, RoundToMultipleOf64(minMinibatchSize), RoundToMultipleOf64(maxMinibatchSize));
+        trialMinibatchSizes.push_back(RoundToMultipleOf64(trialMinibatchSizeFloat));
+    }
 
-        size_t totalSamplesSeen;
-        std::vector<double> epochEvalErrors(evaluationNodes.size(), std::numeric_limits<double>::infinity());
-        double epochCriterion = std::numeric_limits<double>::infinity();
+    // The sizes are evaluated in rounds of one per search worker; the first one is the base.
+    const size_t numSearchWorkers = NumSearchWorkers();
+    const double maxCriterionFactor = 1.0 + (m_minibatchSearchCriterionErrorMargin / 100.0);
+    double baseCriterion = 0;
+    size_t lastTriedTrialMinibatchSize = 0;
+    double lastTriedTrialEpochCriterion = 0;
+    bool stop = false;
+    for (size_t first = 0; first < trialMinibatchSizes.size() && !stop; first += numSearchWorkers)
+    {
+        std::vector<SearchCandidate> candidates;
+        for (size_t i = first; i < min(first + numSearchWorkers, trialMinibatchSizes.size()); i++)
+        {
+            fprintf(stderr, "\nAdaptiveMinibatchSearch: Evaluating trial minibatchSize=%zd out of range %zd..%zd ...\n\n",
+                    trialMinibatchSizes[i], RoundToMultipleOf64(minMinibatchSize), RoundToMultipleOf64(maxMinibatchSize));
+            candidates.push_back(SearchCandidate(learnRatePerSample, trialMinibatchSizes[i], i == 0 ? "BaseAdaptiveMinibatchSearch:" : "AdaptiveMinibatchSearch:"));
+        }
 
         // Train on a few minibatches and so we can observe the epochCriterion as we try increasing
         // minibatches with iteration of this loop.
-        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                        numFramesToUseInSearch, trainSetDataReader,
-                                        learnRatePerSample, trialMinibatchSize, featureNodes,
-                                        labelNodes, criterionNodes,
-                                        evaluationNodes, inputMatrices,
-                                        learnableNodes, smoothedGradients,
-                                        /*out*/ epochCriterion, /*out*/ epochEvalErrors,
-                                        /*out*/ totalSamplesSeen,
-                                        isFirstIteration ? "BaseAdaptiveMinibatchSearch:" : "AdaptiveMinibatchSearch:");
-
-        if (isFirstIteration)
-        {
-            // for the first iteration of the loop only, set baseCriterion
-            // to the result we got from TrainOneMiniEpochAndReloadModel().
-            baseCriterion = epochCriterion;
-            lastTriedTrialMinibatchSize = trialMinibatchSize;
-            lastTriedTrialEpochCriterion = baseCriterion;
-            isFirstIteration = false;
-
-            fprintf(stderr, "AdaptiveMinibatchSearch: Computed BaseCriterion %.10g\n", baseCriterion);
-        }
-        else if (!std::isnan(epochCriterion) &&
-                 (epochCriterion > (baseCriterion * (1.0 + (m_minibatchSearchCriterionErrorMargin / 100.0)))))
-        {
-            // As soon as we see the Criterion (a measure of error) start to get larger than the
-            // Criterion we started with, we stop.
-            // TODO: if this is too sensitive, we can add a margin on the bases of percentage of
-            // baseCriterion.
-            break;
-        }
-        else
+        double earlyExitCriterion = (first > 0 && m_searchEarlyExitFactor > 0) ? baseCriterion * maxCriterionFactor * m_searchEarlyExitFactor : std::numeric_limits<double>::infinity();
+        std::vector<double> criteria = EvaluateSearchCandidates(candidates, earlyExitCriterion,
+                                                                net, refNet, refNode, epochNumber,
+                                                                numFramesToUseInSearch, trainSetDataReader,
+                                                                featureNodes, labelNodes,
+                                                                criterionNodes, evaluationNodes,
+                                                                inputMatrices, learnableNodes, smoothedGradients);
+
+        for (size_t k = 0; k < candidates.size() && !stop; k++)
         {
-            lastTriedTrialMinibatchSize = trialMinibatchSize;
-            lastTriedTrialEpochCriterion = epochCriterion;
-            if (trialMinibatchSizeFloat * minibatchSizeTuningFactor <= maxMinibatchSize)
+            size_t trialMinibatchSize = candidates[k].m_minibatchSize;
+            double epochCriterion = criteria[k];
+            if (first + k == 0)
             {
-                fprintf(stderr, "AdaptiveMinibatchSearch: Keep searching... "
-                                "EpochCriterion = %.10g vs BaseCriterion = %.10g\n",
-                        epochCriterion, baseCriterion);
+                // for the first trial only, set baseCriterion
+                baseCriterion = epochCriterion;
+                lastTriedTrialMinibatchSize = trialMinibatchSize;
+                lastTriedTrialEpochCriterion = baseCriterion;
+
+                fprintf(stderr, "AdaptiveMinibatchSearch: Computed BaseCriterion %.10g\n", baseCriterion);
+            }
+            else if (!std::isnan(epochCriterion) && (epochCriterion > baseCriterion * maxCriterionFactor))
+            {
+                // As soon as we see the Criterion (a measure of error) start to get larger than the
+                // Criterion we started with, we stop.
+                stop = true;
+            }
+            else
+            {
+                lastTriedTrialMinibatchSize = trialMinibatchSize;
+                lastTriedTrialEpochCriterion = epochCriterion;
+                if (first + k + 1 < trialMinibatchSizes.size())
+                {
+                    fprintf(stderr, "AdaptiveMinibatchSearch: Keep searching... "
+                                    "EpochCriterion = %.10g vs BaseCriterion = %.10g\n",
+                            epochCriterion, baseCriterion);
+                }
             }
         }
     }
+    m_searchSnapshot.reset();
+
     fprintf(stderr, "AdaptiveMinibatchSearch: Search successful!!! Chose new minibatchSize of %d. "
                     "EpochCriterion = %.10g vs BaseCriterion = %.10g\n\n",
             (int) lastTriedTrialMinibatchSize, lastTriedTrialEpochCriterion, baseCriterion);
@@ -1750,7 +2648,14 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
         fprintf(stderr, "AvgLearningRatePerSample = %.8g\n", learnRatePerSample);
     }
 
+    if (m_searchSnapshot)
+    {
+        RestoreSearchSnapshot(learnableNodes, smoothedGradients, totalSamplesSeen);
+        return;
+    }
+
     int baseModelEpoch = epochNumber - 1;
+    WaitForCheckPoint();
     net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
 
     double dummyLearnRate;
@@ -1764,6 +2669,152 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
                        /*out*/ dummyMinibatchSize);
 }
 
+template <class ElemType>
+void SGD<ElemType>::TakeSearchSnapshot(const std::list<ComputationNodeBasePtr>& learnableNodes, const std::list<Matrix<ElemType>>& smoothedGradients, const size_t totalSamplesSeen)
+{
+    m_searchSnapshot = SnapshotTrainingState(learnableNodes, smoothedGradients, totalSamplesSeen);
+}
+
+template <class ElemType>
+void SGD<ElemType>::RestoreSearchSnapshot(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, /*out*/ size_t& totalSamplesSeen)
+{
+    RestoreTrainingState(*m_searchSnapshot, learnableNodes, smoothedGradients, totalSamplesSeen);
+}
+
+template <class ElemType>
+std::unique_ptr<typename SGD<ElemType>::SearchSnapshot> SGD<ElemType>::SnapshotTrainingState(const std::list<ComputationNodeBasePtr>& learnableNodes, const std::list<Matrix<ElemType>>& smoothedGradients, const size_t totalSamplesSeen)
+{
+    std::unique_ptr<SearchSnapshot> snapshot(new SearchSnapshot());
+    for (const auto& node : learnableNodes)
+    {
+        const Matrix<ElemType>& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        snapshot->m_values.push_back(Matrix<ElemType>(value.GetDeviceId()));
+        snapshot->m_values.back().SetValue(value);
+    }
+    for (const auto& smoothedGradient : smoothedGradients)
+    {
+        snapshot->m_smoothedGradients.push_back(Matrix<ElemType>(smoothedGradient.GetDeviceId()));
+        snapshot->m_smoothedGradients.back().SetValue(smoothedGradient);
+    }
+    snapshot->m_totalSamplesSeen = totalSamplesSeen;
+    snapshot->m_numOptimizerSteps = m_numOptimizerSteps;
+    snapshot->m_lossScale = m_lossScale;
+    snapshot->m_numMBsSinceLossScaleChange = m_numMBsSinceLossScaleChange;
+    return snapshot;
+}
+
+template <class ElemType>
+void SGD<ElemType>::RestoreTrainingState(const SearchSnapshot& snapshot, const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, /*out*/ size_t& totalSamplesSeen)
+{
+    auto value = snapshot.m_values.begin();
+    for (const auto& node : learnableNodes)
+        dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().SetValue(*value++);
+    auto smoothedGradient = snapshot.m_smoothedGradients.begin();
+    for (auto& target : smoothedGradients)
+        target.SetValue(*smoothedGradient++);
+    totalSamplesSeen = snapshot.m_totalSamplesSeen;
+    m_numOptimizerSteps = snapshot.m_numOptimizerSteps;
+    m_lossScale = snapshot.m_lossScale;
+    m_numMBsSinceLossScaleChange = snapshot.m_numMBsSinceLossScaleChange;
+}
+
+// elastic training: all workers continue from the main node's model, smoothed gradients and sample count,
+// so that a worker that (re)joined the job from an older (or no) checkpoint is in step with the others
+template <class ElemType>
+void SGD<ElemType>::BroadcastTrainingState(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, size_t& totalSamplesSeen)
+{
+    std::vector<Matrix<ElemType>*> matrices;
+    for (const auto& node : learnableNodes)
+        matrices.push_back(&dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value());
+    for (auto& smoothedGradient : smoothedGradients)
+        matrices.push_back(&smoothedGradient);
+
+    for (auto mat : matrices)
+    {
+        ElemType* px = mat->CopyToArray();
+        g_mpi->Bcast(px, mat->GetNumElements(), g_mpi->MainNodeRank());
+        mat->SetValue(mat->GetNumRows(), mat->GetNumCols(), mat->GetDeviceId(), px);
+        delete[] px;
+    }
+
+    std::array<size_t, 2> counters = {totalSamplesSeen, m_numOptimizerSteps};
+    g_mpi->Bcast(counters.data(), counters.size(), g_mpi->MainNodeRank());
+    totalSamplesSeen = counters[0];
+    m_numOptimizerSteps = counters[1];
+}
+
+// elastic training: after a worker failed during an epoch, continue with the survivors, which redo the epoch
+// The reader subsets follow from the new ranks when the epoch restarts (StartDistributedMinibatchLoop()).
+template <class ElemType>
+void SGD<ElemType>::RecoverFromWorkerFailure(const std::exception& failure, size_t numEvalNodes)
+{
+    fprintf(stderr, "WARNING: A worker failed (%s). Continuing with the surviving workers from the start of the epoch.\n", failure.what());
+    g_mpi->ShrinkAfterFailure();
+
+    // whatever was in flight refers to the old communicator
+    m_pendingModelAverage.reset();
+    if (m_distGradAgg != nullptr)
+    {
+        delete m_distGradAgg;
+        m_distGradAgg = nullptr;
+        InitDistGradAgg((int) numEvalNodes, m_traceLevel);
+    }
+}
+
+template <class ElemType>
+size_t SGD<ElemType>::NumSearchWorkers() const
+{
+    return (m_parallelSearch && (g_mpi != nullptr) && (g_mpi->NumNodesInUse() > 1)) ? g_mpi->NumNodesInUse() : 1;
+}
+
+// In a parallel search, the candidates are dealt out round-robin, and every worker trains its own ones without gradient
+// aggregation or model averaging, reading the same data as all others; the criteria are then summed over the workers
+// with one AllReduce, where every worker contributes those of its own candidates. This takes the same time per round as
+// one trial alone, but each trial runs on a single worker.
+template <class ElemType>
+std::vector<double> SGD<ElemType>::EvaluateSearchCandidates(const std::vector<SearchCandidate>& candidates,
+                                                            const double earlyExitCriterion,
+                                                            ComputationNetworkPtr net,
+                                                            ComputationNetworkPtr refNet,
+                                                            const ComputationNodeBasePtr& refNode, const int epochNumber,
+                                                            const size_t numFramesToUseInSearch,
+                                                            IDataReader<ElemType>* trainSetDataReader,
+                                                            const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                                            const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                                            const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                                            const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                                            std::map<std::wstring, Matrix<ElemType>*>* inputMatrices,
+                                                            const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                            std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    const size_t numSearchWorkers = NumSearchWorkers();
+    const size_t rank = (numSearchWorkers > 1) ? g_mpi->CurrentNodeRank() : 0;
+
+    std::vector<double> criteria(candidates.size(), 0.0);
+    m_searchingLocally = (numSearchWorkers > 1);
+    m_searchEarlyExitCriterion = earlyExitCriterion;
+    for (size_t i = rank; i < candidates.size(); i += numSearchWorkers)
+    {
+        std::vector<double> epochEvalErrors(evaluationNodes.size(), std::numeric_limits<double>::infinity());
+        size_t totalSamplesSeen = m_searchSnapshot ? m_searchSnapshot->m_totalSamplesSeen : 0;
+        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
+                                        numFramesToUseInSearch, trainSetDataReader,
+                                        candidates[i].m_learnRatePerSample, candidates[i].m_minibatchSize,
+                                        featureNodes, labelNodes,
+                                        criterionNodes, evaluationNodes,
+                                        inputMatrices, learnableNodes,
+                                        smoothedGradients, /*out*/ criteria[i],
+                                        /*out*/ epochEvalErrors, /*out*/ totalSamplesSeen,
+                                        candidates[i].m_prefixMsg);
+    }
+    m_searchingLocally = false;
+    m_searchEarlyExitCriterion = std::numeric_limits<double>::infinity();
+
+    if (numSearchWorkers > 1)
+        g_mpi->AllReduce(criteria);
+    return criteria;
+}
+
 // Attemps to compute the error signal for the whole utterance, which will
 // be fed to the neural network as features. Currently it is a workaround
 // for the two-forward-pass sequence and ctc training, which allows
@@ -1781,6 +2832,8 @@ void SGD<ElemType>::AttemptUtteranceDerivativeFeatures(ComputationNetworkPtr net
     // TODO: use GetMinibatchIntoNetwork().
     while (trainSetDataReader->GetMinibatchCopy(uttInfo, *inputMatrices, pMBLayout))
     {
+        if (m_optimizerStateOffload) // the forward pass needs the updated parameters
+            m_optimizerStateOffload->Finish();
         ComputationNetwork::BumpEvalTimeStamp(featureNodes);
 
         auto& outputNodes = net->OutputNodes();
@@ -1845,7 +2898,9 @@ void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int traceLevel)
                 RuntimeError("Gradient quantization is unsupported in CNTK binaries built without quantized gradient aggregation support!");
             }
 
-            m_distGradAgg = new SimpleDistGradAggregator<ElemType>(g_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace);
+            m_distGradAgg = new SimpleDistGradAggregator<ElemType>(g_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace, m_allReduceAlgorithm,
+                                                                   (size_t) (m_gradientBucketSizeInMB * 1024 * 1024), m_useGPUDirect,
+                                                                   m_gradientCompression, m_gradientCompressionRatio, m_gradientCompressionThreshold);
 #endif // !QUANTIZED_GRADIENT_AGGREGATION
         }
 
@@ -1888,7 +2943,12 @@ bool SGD<ElemType>::ModelAveragingProcessing(size_t nSamplesSinceLastSync, const
         double elapsedsec = MAtimer.ElapsedSeconds();
         SecondsSinceLastSyncFinished = first ? 0 : (float) elapsedsec;
         MAtimer.Start();
-        nProcessedFrames = ModelAveragingSync((int) nSamplesSinceLastSync, learnableNodes);
+        if (m_overlapModelAveraging)
+            nProcessedFrames = ModelAveragingSyncOverlapped((int) nSamplesSinceLastSync, learnableNodes);
+        else if (m_quantizedModelAverage)
+            nProcessedFrames = ModelAveragingSyncQuantized((int) nSamplesSinceLastSync, learnableNodes);
+        else
+            nProcessedFrames = ModelAveragingSync((int) nSamplesSinceLastSync, learnableNodes);
         MAtimer.Stop();
         SecondsSpentOnSync = (float) MAtimer.ElapsedSeconds();
 
@@ -1913,18 +2973,8 @@ size_t SGD<ElemType>::ModelAveragingSync(int nSamplesSinceLastSync, const std::l
     // ========================================
     // Sec. 1 calculate factor
     // ========================================
-    float factor = 0;
-    int nTotalSamples = nSamplesSinceLastSync;
-    g_mpi->AllReduce(&nTotalSamples, 1);
-    if (nTotalSamples <= 0)
-    {
-        // prepare for overflow
-        factor = 1.0f / g_mpi->NumNodesInUse();
-    }
-    else
-    {
-        factor = (nSamplesSinceLastSync + 0.0f) / nTotalSamples;
-    }
+    int nTotalSamples;
+    float factor = ModelAveragingFactor(nSamplesSinceLastSync, nTotalSamples);
 
     // ========================================
     // Sec. 2 sync models based on factor
@@ -1954,11 +3004,340 @@ size_t SGD<ElemType>::ModelAveragingSync(int nSamplesSinceLastSync, const std::l
         mat.SetValue(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId(), px);
         // 4. clean up
         delete[] px;
+
+        // 5. with block momentum, the averaged model is just the input to the block-level update
+        if (m_parallelizationMethod == ParallelizationMethod::BlockMomentumSGD)
+            BlockMomentumUpdate(pNode, mat);
+    }
+
+    return nTotalSamples;
+}
+
+// weight of this worker's model in the average, by its share of the samples since the last sync
+template <class ElemType>
+float SGD<ElemType>::ModelAveragingFactor(int nSamplesSinceLastSync, int& nTotalSamples)
+{
+    nTotalSamples = nSamplesSinceLastSync;
+    g_mpi->AllReduce(&nTotalSamples, 1);
+    if (nTotalSamples <= 0)
+    {
+        // prepare for overflow
+        return 1.0f / g_mpi->NumNodesInUse();
     }
+    return (nSamplesSinceLastSync + 0.0f) / nTotalSamples;
+}
+
+template <class ElemType>
+struct SGD<ElemType>::PendingModelAverage
+{
+    std::vector<ComputationNodeBasePtr> m_nodes;
+    std::vector<shared_ptr<Matrix<ElemType>>> m_snapshots; // the models that went into the average
+    std::vector<std::vector<ElemType>> m_buffers;          // their weighted sum across workers, once m_requests are done
+    std::vector<MPI_Request> m_requests;
+    bool m_inFlight = false;
+};
+
+// model averaging that overlaps with training (overlapSync): applies the average that was started at the previous sync,
+// then snapshots the current models and starts averaging them with non-blocking MPI, to be applied at the next sync.
+// As the average is one sync period old when it arrives, it is applied as a delta against the snapshot it was computed from,
+// which keeps the progress each worker has made since:
+//     model += average(snapshots) - snapshot
+// Unlike ModelAveragingSync(), the workers do not end up with identical models.
+template <class ElemType>
+size_t SGD<ElemType>::ModelAveragingSyncOverlapped(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    if (g_mpi->NumNodesInUse() <= 1)
+    {
+        return nSamplesSinceLastSync;
+    }
+
+    int nTotalSamples;
+    float factor = ModelAveragingFactor(nSamplesSinceLastSync, nTotalSamples);
+
+    FinishPendingModelAverage();
+
+    if (!m_pendingModelAverage)
+        m_pendingModelAverage = make_shared<PendingModelAverage>();
+    PendingModelAverage& pending = *m_pendingModelAverage;
+    pending.m_nodes.clear();
+    for (auto& pNode : learnableNodes)
+    {
+        if (pNode->IsParameterUpdateRequired())
+            pending.m_nodes.push_back(pNode);
+    }
+    pending.m_snapshots.resize(pending.m_nodes.size());
+    pending.m_buffers.resize(pending.m_nodes.size());
+
+    // the snapshot and its host copy are taken here; only the reduction runs in the background
+    for (size_t i = 0; i < pending.m_nodes.size(); i++)
+    {
+        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(pending.m_nodes[i])->Value();
+        if (!pending.m_snapshots[i])
+            pending.m_snapshots[i] = make_shared<Matrix<ElemType>>(mat.GetDeviceId());
+        pending.m_snapshots[i]->SetValue(mat);
+
+        std::vector<ElemType>& buffer = pending.m_buffers[i];
+        buffer.resize(mat.GetNumElements());
+        mat.CopySection(mat.GetNumRows(), mat.GetNumCols(), buffer.data(), mat.GetNumRows());
+        for (auto& x : buffer)
+            x *= (ElemType) factor;
+        pending.m_requests.push_back(g_mpi->AllReduceAsync(buffer.data(), buffer.size()));
+    }
+    pending.m_inFlight = true;
 
     return nTotalSamples;
 }
 
+// wait for the average started by ModelAveragingSyncOverlapped(), and apply it to the models
+template <class ElemType>
+void SGD<ElemType>::FinishPendingModelAverage()
+{
+    if (!m_pendingModelAverage || !m_pendingModelAverage->m_inFlight)
+        return;
+
+    PendingModelAverage& pending = *m_pendingModelAverage;
+    g_mpi->Wait(pending.m_requests);
+    for (size_t i = 0; i < pending.m_nodes.size(); i++)
+    {
+        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(pending.m_nodes[i])->Value();
+        Matrix<ElemType>& snapshot = *pending.m_snapshots[i];
+        Matrix<ElemType>::ScaleAndAdd((ElemType) -1, snapshot, mat);
+        snapshot.SetValue(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId(), pending.m_buffers[i].data()); // now the average
+        Matrix<ElemType>::ScaleAndAdd((ElemType) 1, snapshot, mat);
+    }
+    pending.m_inFlight = false;
+}
+
+template <class ElemType>
+struct SGD<ElemType>::QuantizedModelAverage
+{
+    std::vector<ComputationNodeBasePtr> m_nodes;
+    std::vector<shared_ptr<Matrix<ElemType>>> m_references; // [node] the common model after the last sync (on the CPU)
+    std::vector<shared_ptr<Matrix<ElemType>>> m_residuals;  // [node] what this worker has not sent yet (error feedback)
+    std::vector<shared_ptr<Matrix<ElemType>>> m_deltas;     // [node] this worker's weighted delta, then the sum over the workers
+    unique_ptr<MatrixQuantizerImpl<ElemType>> m_quantizer;
+    unique_ptr<QuantizedMatrixBatch<ElemType>> m_quantized; // the deltas of one worker
+    std::vector<char> m_gathered;                           // the quantized deltas of all workers, by rank
+};
+
+// set up the compressed model averaging of an epoch: the reference models start out as the average of the workers' models
+// (one full-precision sync per epoch, which also picks up a model that was reloaded), and the residuals at 0
+template <class ElemType>
+void SGD<ElemType>::StartQuantizedModelAveraging(const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    if (!m_quantizedModelAverage)
+        m_quantizedModelAverage = make_shared<QuantizedModelAverage>();
+    QuantizedModelAverage& state = *m_quantizedModelAverage;
+    state.m_nodes.clear();
+    for (auto& pNode : learnableNodes)
+    {
+        if (pNode->IsParameterUpdateRequired())
+            state.m_nodes.push_back(pNode);
+    }
+
+    std::vector<std::pair<size_t, size_t>> dims;
+    state.m_references.resize(state.m_nodes.size());
+    state.m_residuals.resize(state.m_nodes.size());
+    state.m_deltas.resize(state.m_nodes.size());
+    for (size_t i = 0; i < state.m_nodes.size(); i++)
+    {
+        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(state.m_nodes[i])->Value();
+        const size_t rows = mat.GetNumRows(), cols = mat.GetNumCols();
+        dims.push_back(make_pair(rows, cols));
+        state.m_references[i] = make_shared<Matrix<ElemType>>(rows, cols, CPUDEVICE);
+        state.m_residuals[i] = make_shared<Matrix<ElemType>>(rows, cols, CPUDEVICE);
+        state.m_deltas[i] = make_shared<Matrix<ElemType>>(rows, cols, CPUDEVICE);
+        state.m_residuals[i]->SetValue(0);
+
+        Matrix<ElemType>& reference = *state.m_references[i];
+        mat.CopySection(rows, cols, reference.BufferPointer(), rows);
+        g_mpi->AllReduce(reference.BufferPointer(), reference.GetNumElements());
+        Matrix<ElemType>::Scale((ElemType) (1.0 / g_mpi->NumNodesInUse()), reference);
+        mat.SetValue(rows, cols, mat.GetDeviceId(), reference.BufferPointer());
+    }
+    if (!state.m_quantizer)
+        state.m_quantizer.reset(MatrixQuantizerImpl<ElemType>::Create(CPUDEVICE, false));
+    state.m_quantized.reset(new QuantizedMatrixBatch<ElemType>(dims, m_numModelSyncBits, CPUDEVICE));
+    state.m_gathered.resize(state.m_quantized->GetSize() * g_mpi->NumNodesInUse());
+}
+
+// model averaging with compressed communication (syncBits): every worker sends its model delta since the last sync, weighted
+// by its share of the samples, quantized with the 1-bit SGD quantizer, and keeps what the quantization left out as a
+// residual for the next sync. The quantized deltas of all workers are gathered, and each worker adds all of them, in the
+// order of the ranks, to the common model of the last sync. So the workers end up with identical models, as with
+// ModelAveragingSync(), while each sends only syncBits per element.
+template <class ElemType>
+size_t SGD<ElemType>::ModelAveragingSyncQuantized(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    if (g_mpi->NumNodesInUse() <= 1)
+    {
+        return nSamplesSinceLastSync;
+    }
+
+    int nTotalSamples;
+    float factor = ModelAveragingFactor(nSamplesSinceLastSync, nTotalSamples);
+
+    QuantizedModelAverage& state = *m_quantizedModelAverage;
+    if (state.m_nodes.size() != (size_t) count_if(learnableNodes.begin(), learnableNodes.end(), [](const ComputationNodeBasePtr& node) { return node->IsParameterUpdateRequired(); }))
+        LogicError("ModelAveragingSyncQuantized: The set of parameters changed since StartQuantizedModelAveraging().");
+
+    // 1. delta = factor * (model - reference), quantized together with the residual
+    std::vector<const Matrix<ElemType>*> deltas, residuals;
+    std::vector<Matrix<ElemType>*> outResiduals, sums;
+    for (size_t i = 0; i < state.m_nodes.size(); i++)
+    {
+        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(state.m_nodes[i])->Value();
+        Matrix<ElemType>& delta = *state.m_deltas[i];
+        mat.CopySection(mat.GetNumRows(), mat.GetNumCols(), delta.BufferPointer(), mat.GetNumRows());
+        Matrix<ElemType>::ScaleAndAdd((ElemType) -1, *state.m_references[i], delta);
+        Matrix<ElemType>::Scale((ElemType) factor, delta);
+        deltas.push_back(&delta);
+        residuals.push_back(state.m_residuals[i].get());
+        outResiduals.push_back(state.m_residuals[i].get());
+        sums.push_back(&delta);
+    }
+    state.m_quantizer->QuantizeBatchAsync(deltas, residuals, *state.m_quantized, outResiduals, m_zeroThresholdFor1Bit);
+    state.m_quantizer->WaitQuantizeAsyncDone();
+
+    // 2. gather the quantized deltas of all workers
+    const size_t size = state.m_quantized->GetSize();
+    memcpy(state.m_gathered.data() + g_mpi->CurrentNodeRank() * size, state.m_quantized->GetArray(), size);
+    std::vector<MPI_Request> requests(1, g_mpi->AllGatherAsync(state.m_gathered.data(), size));
+    g_mpi->Wait(requests);
+
+    // 3. reference += sum of the deltas, which becomes the model
+    for (auto* sum : sums)
+        sum->SetValue(0);
+    for (size_t rank = 0; rank < g_mpi->NumNodesInUse(); rank++)
+    {
+        memcpy(state.m_quantized->GetArray(), state.m_gathered.data() + rank * size, size);
+        state.m_quantizer->UnquantizeBatchAsync(*state.m_quantized, sums, true /*add*/);
+        state.m_quantizer->WaitUnquantizeAsyncDone();
+    }
+    for (size_t i = 0; i < state.m_nodes.size(); i++)
+    {
+        ComputationNodeBasePtr pNode = state.m_nodes[i];
+        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(pNode)->Value();
+        Matrix<ElemType>& reference = *state.m_references[i];
+        Matrix<ElemType>::ScaleAndAdd((ElemType) 1, *sums[i], reference);
+        mat.SetValue(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId(), reference.BufferPointer());
+
+        // with block momentum, the averaged model is just the input to the block-level update, whose result is the new reference
+        if (m_parallelizationMethod == ParallelizationMethod::BlockMomentumSGD)
+        {
+            BlockMomentumUpdate(pNode, mat);
+            mat.CopySection(mat.GetNumRows(), mat.GetNumCols(), reference.BufferPointer(), mat.GetNumRows());
+        }
+    }
+
+    return nTotalSamples;
+}
+
+// set up the global model of block momentum, unless it is known already (from an earlier epoch or a checkpoint)
+// It starts out as the average of the workers' models, which are all identical unless the workers trained on their own before.
+// Loss scaling: divides the gradients by the loss scale they were computed with. With dynamic loss scaling, gradients that are
+// not finite (the FP16 range was exceeded) make us halve the loss scale and return false to skip the update, while after
+// m_lossScaleGrowthInterval minibatches without overflow the loss scale is doubled, to use as much of the FP16 range as we can.
+template <class ElemType>
+bool SGD<ElemType>::UnscaleGradients(const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    if (m_lossScale == 1 && !m_dynamicLossScaling)
+        return true;
+
+    std::vector<Matrix<ElemType>*> gradients;
+    for (const auto& node : learnableNodes)
+    {
+        if (node->IsParameterUpdateRequired())
+            gradients.push_back(&dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient());
+    }
+
+    if (m_dynamicLossScaling)
+    {
+        for (auto gradient : gradients)
+        {
+            if (!std::isfinite((double) gradient->SumOfAbsElements()))
+            {
+                m_lossScale /= 2;
+                m_numMBsSinceLossScaleChange = 0;
+                fprintf(stderr, "Loss scaling: Gradients overflowed, skipping the update and reducing the loss scale to %.9g.\n", m_lossScale);
+                return false;
+            }
+        }
+    }
+
+    if (m_lossScale != 1)
+    {
+        for (auto gradient : gradients)
+            Matrix<ElemType>::Scale((ElemType) (1.0 / m_lossScale), *gradient);
+    }
+
+    if (m_dynamicLossScaling && ++m_numMBsSinceLossScaleChange >= m_lossScaleGrowthInterval)
+    {
+        m_lossScale *= 2;
+        m_numMBsSinceLossScaleChange = 0;
+        if (m_traceLevel > 0)
+            fprintf(stderr, "Loss scaling: Increasing the loss scale to %.9g.\n", m_lossScale);
+    }
+
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::InitializeBlockMomentum(const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    for (auto iter = learnableNodes.begin(); iter != learnableNodes.end(); iter++)
+    {
+        ComputationNodeBasePtr pNode = *iter;
+        if (!pNode->IsParameterUpdateRequired())
+            continue;
+
+        BlockMomentumState& state = m_blockMomentumStates[pNode->NodeName()];
+        if (state.m_globalModel)
+            continue;
+
+        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(pNode)->Value();
+        ElemType* px = mat.CopyToArray();
+        size_t nx = mat.GetNumElements();
+        g_mpi->AllReduce(px, nx);
+        for (size_t i = 0; i < nx; i++)
+            px[i] /= (ElemType) g_mpi->NumNodesInUse();
+        mat.SetValue(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId(), px);
+        delete[] px;
+
+        state.m_globalModel = make_shared<Matrix<ElemType>>(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId());
+        state.m_globalModel->SetValue(mat);
+        state.m_blockMomentum = make_shared<Matrix<ElemType>>(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId());
+        state.m_blockMomentum->SetValue(0);
+    }
+}
+
+// block-wise model-update filtering (Chen and Huo, 2016)
+// The averaged model minus the global model is the update of the block. It is filtered with the block momentum
+//     blockMomentum = momentum * blockMomentum + blockLearningRate * (averagedModel - globalModel)
+//     globalModel += blockMomentum
+// and the next block starts from the global model, or with Nesterov momentum, from globalModel + momentum * blockMomentum.
+template <class ElemType>
+void SGD<ElemType>::BlockMomentumUpdate(const ComputationNodeBasePtr& node, Matrix<ElemType>& averagedModel)
+{
+    auto stateIter = m_blockMomentumStates.find(node->NodeName());
+    if (stateIter == m_blockMomentumStates.end() || !stateIter->second.m_globalModel)
+        LogicError("BlockMomentumUpdate: No block momentum state for %ls %ls operation.", node->NodeName().c_str(), node->OperationName().c_str());
+
+    Matrix<ElemType>& globalModel = *stateIter->second.m_globalModel;
+    Matrix<ElemType>& blockMomentum = *stateIter->second.m_blockMomentum;
+    const ElemType momentum = (ElemType) (m_blockMomentumPerSync >= 0 ? m_blockMomentumPerSync : 1.0 - 1.0 / g_mpi->NumNodesInUse());
+    const ElemType blockLearningRate = (ElemType) m_blockLearningRate;
+
+    Matrix<ElemType>::Scale(momentum, blockMomentum);
+    Matrix<ElemType>::ScaleAndAdd(blockLearningRate, averagedModel, blockMomentum);
+    Matrix<ElemType>::ScaleAndAdd(-blockLearningRate, globalModel, blockMomentum);
+    Matrix<ElemType>::ScaleAndAdd((ElemType) 1, blockMomentum, globalModel);
+
+    averagedModel.SetValue(globalModel);
+    if (m_useNesterovBlockMomentum)
+        Matrix<ElemType>::ScaleAndAdd(momentum, blockMomentum, averagedModel);
+}
+
 // public:
 // UpdateWeightsS - static version of UpdateWeights()
 // not static since it wants to access protected methods on the SGD object
@@ -1972,7 +3351,8 @@ template <class ElemType>
                                               const double L2RegWeight,
                                               const double L1RegWeight,
                                               const bool needAveMultiplier,
-                                              const bool useNesterovMomentum)
+                                              const bool useNesterovMomentum,
+                                              const size_t optimizerStep)
 {
     // we use simple linear (instead of log linear) scaling here
     const double momentum = MomentumPerMB(momentumPerSample, actualMBSize);
@@ -2015,12 +3395,9 @@ template <class ElemType>
         smoothedGradient.NormalGrad(gradientValues, functionValues,
                                     (ElemType) learnRatePerSample, (ElemType) momentum, useNesterovMomentum);
     }
-    else if (adpType == GradientsUpdateType::AdaGrad ||
-             (adpType == GradientsUpdateType::RmsProp && gradientValues.GetMatrixType() == MatrixType::SPARSE) ||
-             (adpType == GradientsUpdateType::FSAdaGrad && gradientValues.GetMatrixType() == MatrixType::SPARSE))
+    else if (adpType == GradientsUpdateType::AdaGrad)
     {
-        // rmsprop for sparse is not implemented yet, delegate it with adagrad
-
+        // for block-sparse gradients (e.g. of an embedding applied to a sparse input) this and the following updates only touch the columns present in the minibatch
         double aveMultiplier = smoothedGradient.Adagrad(gradientValues, needAveMultiplier);
         Matrix<ElemType>::ScaleAndAdd((ElemType)(-learnRatePerSample / aveMultiplier), gradientValues, functionValues);
     }
@@ -2028,6 +3405,16 @@ template <class ElemType>
     {
         smoothedGradient.FSAdagrad(actualMBSize, gradientValues, functionValues, (ElemType) learnRatePerSample, (ElemType) momentum);
     }
+    else if (adpType == GradientsUpdateType::Adam)
+    {
+        smoothedGradient.Adam(gradientValues, functionValues, (ElemType) learnRatePerSample, (ElemType) sgd->m_adamInfo.beta1,
+                              (ElemType) sgd->m_adamInfo.beta2, (ElemType) sgd->m_adamInfo.epsilon, optimizerStep);
+    }
+    else if (adpType == GradientsUpdateType::Lamb)
+    {
+        smoothedGradient.Lamb(gradientValues, functionValues, (ElemType) learnRatePerSample, (ElemType) sgd->m_adamInfo.beta1,
+                              (ElemType) sgd->m_adamInfo.beta2, (ElemType) sgd->m_adamInfo.epsilon, (ElemType) sgd->m_adamInfo.lambWeightDecay, optimizerStep);
+    }
     else if (adpType == GradientsUpdateType::RmsProp)
     {
         double aveMultiplier = smoothedGradient.RmsProp(gradientValues, (ElemType) sgd->m_rpi.gamma,
@@ -2075,14 +3462,14 @@ void SGD<ElemType>::UpdateWeights(const ComputationNodeBasePtr& node,
     UpdateWeightsS(this, dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value(), dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient(),
                    smoothedGradient, learnRatePerSample, momentumPerSample,
                    actualMBSize, L2RegWeight, L1RegWeight,
-                   needAveMultiplier, m_useNesterovMomentum);
+                   needAveMultiplier, m_useNesterovMomentum, m_numOptimizerSteps + 1);
     node->BumpEvalTimeStamp();
 }
 
 template <class ElemType>
 void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const
 {
-    if (m_clippingThresholdPerSample != std::numeric_limits<double>::infinity())
+    if (m_clippingThresholdPerSample != std::numeric_limits<double>::infinity() && !m_gradientClippingGlobalNorm) // (else done for all by GlobalGradientClippingFactor())
     {
         double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
         if (m_gradientClippingWithTruncation)
@@ -2100,52 +3487,399 @@ void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actual
     }
 }
 
+// for gradientClippingGlobalNorm, the factor that brings the norm of all gradients together down to the threshold;
+// the norms of the dense gradients of each device are computed in a single reduction
+template <class ElemType>
+double SGD<ElemType>::GlobalGradientClippingFactor(const std::list<ComputationNodeBasePtr>& learnableNodes, const size_t actualMBSize) const
+{
+    if (!m_gradientClippingGlobalNorm || m_clippingThresholdPerSample == std::numeric_limits<double>::infinity())
+        return 1;
+
+    double sumOfSquares = 0;
+    map<DEVICEID_TYPE, vector<const Matrix<ElemType>*>> denseGradients; // [deviceId]
+    for (const auto& node : learnableNodes)
+    {
+        if (!node->IsParameterUpdateRequired())
+            continue;
+        const Matrix<ElemType>& gradient = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient();
+        if (gradient.GetMatrixType() == MatrixType::DENSE)
+            denseGradients[gradient.GetDeviceId()].push_back(&gradient);
+        else
+        {
+            double norm = gradient.FrobeniusNorm();
+            sumOfSquares += norm * norm;
+        }
+    }
+    for (const auto& deviceGradients : denseGradients)
+    {
+        vector<double> sumsOfSquares;
+        Matrix<ElemType>::MultiTensorSumOfSquares(deviceGradients.second, sumsOfSquares);
+        for (double sum : sumsOfSquares)
+            sumOfSquares += sum;
+    }
+
+    const double gradientNorm = sqrt(sumOfSquares);
+    const double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
+    return gradientNorm > maxGradientPerMB ? maxGradientPerMB / gradientNorm : 1;
+}
+
+// whether MultiTensorUpdateWeights() can do the update of 'node' that UpdateWeightsS() would do:
+// dense, with momentum SGD or AdaGrad (without the average multiplier), and without noise or L1 regularization
+template <class ElemType>
+bool SGD<ElemType>::IsMultiTensorUpdatable(const ComputationNodeBasePtr& node, const Matrix<ElemType>& smoothedGradient) const
+{
+    const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+    const auto& gradient = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient();
+    const GradientsUpdateType adpType = GradUpdateType();
+    return (adpType == GradientsUpdateType::None || (adpType == GradientsUpdateType::AdaGrad && !m_needAveMultiplier)) &&
+           GradientUpdateNoiseStd() <= 0 && m_L1RegWeight <= 0 &&
+           value.GetMatrixType() == MatrixType::DENSE && gradient.GetMatrixType() == MatrixType::DENSE && smoothedGradient.GetMatrixType() == MatrixType::DENSE &&
+           gradient.GetNumElements() == value.GetNumElements() && smoothedGradient.GetNumElements() == value.GetNumElements() &&
+           value.GetNumElements() <= (size_t) INT_MAX;
+}
+
+// the update of UpdateWeights() for all 'nodes' together, with the gradients scaled by 'gradientScale' first:
+// per device, one reduction for the norms of the gradient clipping and one launch for the clipping, the L2 term and the update
+template <class ElemType>
+void SGD<ElemType>::MultiTensorUpdateWeights(const std::vector<ComputationNodeBasePtr>& nodes,
+                                             const std::vector<Matrix<ElemType>*>& smoothedGradients,
+                                             const double gradientScale,
+                                             const double learnRatePerSample,
+                                             const double momentumPerSample,
+                                             const size_t actualMBSize) const
+{
+    assert(actualMBSize > 0);
+    const double momentum = MomentumPerMB(momentumPerSample, actualMBSize);
+    const bool isClipping = m_clippingThresholdPerSample != std::numeric_limits<double>::infinity() && !m_gradientClippingGlobalNorm;
+    const double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
+
+    map<DEVICEID_TYPE, vector<size_t>> nodesOnDevice; // [deviceId] indices into 'nodes'
+    for (size_t i = 0; i < nodes.size(); i++)
+        nodesOnDevice[nodes[i]->GetDeviceId()].push_back(i);
+
+    for (const auto& deviceNodes : nodesOnDevice)
+    {
+        vector<Matrix<ElemType>*> weights, deviceSmoothedGradients;
+        vector<const Matrix<ElemType>*> gradients;
+        for (size_t i : deviceNodes.second)
+        {
+            auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodes[i]);
+            if (!node->IsParameterUpdateRequired())
+                LogicError("MultiTensorUpdateWeights() called for a learnable ComputationNode which has m_parameterUpdateRequired == false!");
+            weights.push_back(&node->Value());
+            gradients.push_back(&node->Gradient());
+            deviceSmoothedGradients.push_back(smoothedGradients[i]);
+        }
+
+        // clipping by the norm of each gradient, as ClipGradient()
+        vector<ElemType> gradientScales(weights.size(), (ElemType) gradientScale);
+        if (isClipping && !m_gradientClippingWithTruncation)
+        {
+            vector<double> sumsOfSquares;
+            Matrix<ElemType>::MultiTensorSumOfSquares(gradients, sumsOfSquares);
+            for (size_t k = 0; k < gradients.size(); k++)
+            {
+                double gradientNorm = sqrt(sumsOfSquares[k]);
+                if (gradientNorm > maxGradientPerMB)
+                    gradientScales[k] = (ElemType) (maxGradientPerMB / gradientNorm);
+            }
+        }
+        const ElemType truncation = isClipping && m_gradientClippingWithTruncation ? (ElemType) maxGradientPerMB : 0;
+
+        // multiply by actualMBSize so that it's invariant to minibatch size since learning rate is per sample
+        Matrix<ElemType>::MultiTensorSGDUpdate(weights, gradients, deviceSmoothedGradients, gradientScales, truncation,
+                                               (ElemType) (m_L2RegWeight > 0 ? m_L2RegWeight * actualMBSize : 0), (ElemType) learnRatePerSample,
+                                               (ElemType) momentum, m_useNesterovMomentum, GradUpdateType() == GradientsUpdateType::AdaGrad);
+    }
+
+    for (const auto& node : nodes)
+        node->BumpEvalTimeStamp();
+}
+
 template <class ElemType>
 void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen,
                                        const double learnRatePerSample,
                                        const std::list<Matrix<ElemType>>& smoothedGradients,
                                        const double prevCriterion,
-                                       const size_t minibatchSize)
+                                       const size_t minibatchSize,
+                                       const MidEpochCheckpoint* midEpochCheckpoint)
 {
     // In case of parallel training only the main node should we saving the checkpoint to prevent
     // the parallel training nodes from colliding to write the same file
     if ((g_mpi == nullptr) || g_mpi->IsMainNode())
     {
-        wstring checkPointFileName = GetCheckPointFileNameForEpoch(int(epoch));
-        // Saving into temporary file and then renaming it to the checkPointFileName
-        // This is a standard trick to avoid havign corrupted checkpoints files if process dies during writing
-        wstring tempFileName = checkPointFileName + L".tmp";
+        vector<const Matrix<ElemType>*> smoothedGradientPtrs;
+        for (const auto& smoothedGradient : smoothedGradients)
+            smoothedGradientPtrs.push_back(&smoothedGradient);
+        WriteCheckPointInfo(midEpochCheckpoint ? GetMidEpochCheckPointFileName(int(epoch)) : GetCheckPointFileNameForEpoch(int(epoch)),
+                            totalSamplesSeen, learnRatePerSample, smoothedGradientPtrs,
+                            prevCriterion, minibatchSize, m_blockMomentumStates, m_numOptimizerSteps, midEpochCheckpoint, nullptr);
+    }
+}
 
-        {
-            File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
-            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCKP");
+// the section of a mid-epoch checkpoint; it comes first, so that LoadMidEpochCheckPoint() does not read the rest
+static void PutMidEpochSection(File& fstream, const MidEpochCheckpoint& midEpochCheckpoint)
+{
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BMidEpoch");
+    fstream << midEpochCheckpoint.m_epoch << midEpochCheckpoint.m_modelFileName;
+    fstream << midEpochCheckpoint.m_numMBsRun << midEpochCheckpoint.m_totalEpochSamples;
+    fstream << midEpochCheckpoint.m_epochCriterion << midEpochCheckpoint.m_epochEvalErrors;
+    fstream << midEpochCheckpoint.m_lossScale << midEpochCheckpoint.m_numMBsSinceLossScaleChange;
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMidEpoch");
+}
+
+static void GetMidEpochSection(File& fstream, MidEpochCheckpoint& midEpochCheckpoint)
+{
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BMidEpoch");
+    fstream >> midEpochCheckpoint.m_epoch >> midEpochCheckpoint.m_modelFileName;
+    fstream >> midEpochCheckpoint.m_numMBsRun >> midEpochCheckpoint.m_totalEpochSamples;
+    fstream >> midEpochCheckpoint.m_epochCriterion >> midEpochCheckpoint.m_epochEvalErrors;
+    fstream >> midEpochCheckpoint.m_lossScale >> midEpochCheckpoint.m_numMBsSinceLossScaleChange;
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EMidEpoch");
+}
+
+template <class ElemType>
+/*static*/ void SGD<ElemType>::WriteCheckPointInfo(const wstring& checkPointFileName, const size_t totalSamplesSeen,
+                                                   const double learnRatePerSample,
+                                                   const std::vector<const Matrix<ElemType>*>& smoothedGradients,
+                                                   const double prevCriterion,
+                                                   const size_t minibatchSize,
+                                                   const std::map<std::wstring, BlockMomentumState>& blockMomentumStates,
+                                                   const size_t numOptimizerSteps,
+                                                   const MidEpochCheckpoint* midEpochCheckpoint,
+                                                   const std::function<void(File&)>& progress)
+{
+    // Saving into temporary file and then renaming it to the checkPointFileName
+    // This is a standard trick to avoid havign corrupted checkpoints files if process dies during writing
+    wstring tempFileName = checkPointFileName + L".tmp";
+
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCKP");
+
+        if (midEpochCheckpoint)
+            PutMidEpochSection(fstream, *midEpochCheckpoint);
+
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BLearnRate");
+        fstream << totalSamplesSeen << learnRatePerSample << prevCriterion;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ELearnRate");
 
-            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BLearnRate");
-            fstream << totalSamplesSeen << learnRatePerSample << prevCriterion;
-            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ELearnRate");
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BMinibatchSize");
+        fstream << minibatchSize;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMinibatchSize");
 
-            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BMinibatchSize");
-            fstream << minibatchSize;
-            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMinibatchSize");
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
 
-            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+        for (const auto& smoothedGradient : smoothedGradients)
+        {
+            fstream << *smoothedGradient;
+            if (progress)
+                progress(fstream);
+        }
 
-            for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+
+        if (!blockMomentumStates.empty())
+        {
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BBlockMomentum");
+            fstream << blockMomentumStates.size();
+            for (const auto& state : blockMomentumStates)
             {
-                const Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
-                fstream << smoothedGradient;
+                fstream << state.first << *state.second.m_globalModel << *state.second.m_blockMomentum;
+                if (progress)
+                    progress(fstream);
             }
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EBlockMomentum");
+        }
 
-            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+        if (numOptimizerSteps > 0)
+        {
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BOptimizerSteps");
+            fstream << numOptimizerSteps;
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EOptimizerSteps");
+        }
 
-            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECKP");
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECKP");
 
-            // Ensuring that data is written
-            fstream.Flush();
-        }
+        // Ensuring that data is written
+        fstream.Flush();
+    }
+
+    renameOrDie(tempFileName, checkPointFileName);
+}
+
+// Only the main worker writes. The snapshot (model parameters, smoothed gradients, BMUF state) is copied to host memory
+// here, which is all the training waits for; the files are then written in the same order as by the synchronous path.
+template <class ElemType>
+void SGD<ElemType>::SaveCheckPointAsync(ComputationNetworkPtr net, const size_t epoch, const size_t totalSamplesSeen,
+                                        const double learnRatePerSample,
+                                        const std::list<Matrix<ElemType>>& smoothedGradients,
+                                        const double prevCriterion,
+                                        const size_t minibatchSize,
+                                        const std::function<void()>& deleteOldFiles,
+                                        const MidEpochCheckpoint* midEpochCheckpoint)
+{
+    if ((g_mpi != nullptr) && !g_mpi->IsMainNode())
+        return;
+    if (!m_checkpointWriter)
+        m_checkpointWriter = make_shared<CheckpointWriter>(net->GetDeviceId(), m_checkpointMaxMBPerSecond * 1e6);
+    CheckpointWriter* writer = m_checkpointWriter.get(); // outlives the write, as its destructor waits for it
+
+    Timer snapshotTimer;
+    snapshotTimer.Start();
+    auto snapshotNet = net->CloneForSaving<ElemType>([&](const wstring& nodeName, const Matrix<ElemType>& value)
+                                                     {
+                                                         return writer->SnapshotToHost(L"node:" + nodeName, value);
+                                                     });
+    vector<shared_ptr<Matrix<ElemType>>> snapshotGradients;
+    for (const auto& smoothedGradient : smoothedGradients)
+        snapshotGradients.push_back(writer->SnapshotToHost(L"smoothedGradient:" + std::to_wstring(snapshotGradients.size()), smoothedGradient));
+    auto snapshotBlockMomentumStates = make_shared<std::map<std::wstring, BlockMomentumState>>();
+    for (const auto& state : m_blockMomentumStates)
+    {
+        BlockMomentumState& snapshotState = (*snapshotBlockMomentumStates)[state.first];
+        snapshotState.m_globalModel = writer->SnapshotToHost(L"globalModel:" + state.first, *state.second.m_globalModel);
+        snapshotState.m_blockMomentum = writer->SnapshotToHost(L"blockMomentum:" + state.first, *state.second.m_blockMomentum);
+    }
+    snapshotTimer.Stop();
+
+    // a mid-epoch checkpoint refers to its model, which is therefore written first
+    auto snapshotMidEpochCheckpoint = midEpochCheckpoint ? make_shared<MidEpochCheckpoint>(*midEpochCheckpoint) : nullptr;
+    const wstring checkPointFileName = midEpochCheckpoint ? GetMidEpochCheckPointFileName(int(epoch)) : GetCheckPointFileNameForEpoch(int(epoch));
+    const wstring modelName = midEpochCheckpoint ? midEpochCheckpoint->m_modelFileName : GetModelNameForEpoch(int(epoch));
+    fprintf(stderr, "SGD: Saving %scheckpoint model '%ls' in the background (snapshot took %.3f seconds)\n",
+            midEpochCheckpoint ? "mid-epoch " : "", modelName.c_str(), snapshotTimer.ElapsedSeconds());
+    const size_t numOptimizerSteps = m_numOptimizerSteps;
+    writer->Start([=]()
+                  {
+                      vector<const Matrix<ElemType>*> smoothedGradientPtrs;
+                      for (const auto& smoothedGradient : snapshotGradients)
+                          smoothedGradientPtrs.push_back(smoothedGradient.get());
+                      if (snapshotMidEpochCheckpoint)
+                          snapshotNet->Save(modelName, FileOptions::fileOptionsBinary, writer->ThrottleFile());
+                      WriteCheckPointInfo(checkPointFileName, totalSamplesSeen, learnRatePerSample, smoothedGradientPtrs,
+                                          prevCriterion, minibatchSize, *snapshotBlockMomentumStates, numOptimizerSteps, snapshotMidEpochCheckpoint.get(), writer->ThrottleFile());
+                      if (!snapshotMidEpochCheckpoint)
+                          snapshotNet->Save(modelName, FileOptions::fileOptionsBinary, writer->ThrottleFile());
+                      deleteOldFiles();
+                  });
+}
+
+// Each mid-epoch checkpoint saves the model under a new name, so that the previous checkpoint stays intact until the new
+// one is complete; its model is deleted after that.
+template <class ElemType>
+void SGD<ElemType>::SaveMidEpochCheckPoint(ComputationNetworkPtr net, const size_t totalSamplesSeen,
+                                           const std::list<Matrix<ElemType>>& smoothedGradients,
+                                           MidEpochCheckpoint& midEpochCheckpoint)
+{
+    const wstring previousModelFileName = midEpochCheckpoint.m_modelFileName;
+    midEpochCheckpoint.m_modelFileName = msra::strfun::wstrprintf(L"%ls.mb%d", GetModelNameForEpoch(midEpochCheckpoint.m_epoch).c_str(), (int) midEpochCheckpoint.m_numMBsRun);
+    if ((g_mpi != nullptr) && !g_mpi->IsMainNode())
+        return;
+
+    auto deletePreviousModel = [previousModelFileName]()
+    {
+        if (!previousModelFileName.empty())
+            _wunlink(previousModelFileName.c_str());
+    };
+    if (m_asyncCheckpoint)
+    {
+        SaveCheckPointAsync(net, midEpochCheckpoint.m_epoch, totalSamplesSeen, midEpochCheckpoint.m_learnRatePerSample, smoothedGradients,
+                            midEpochCheckpoint.m_prevCriterion, midEpochCheckpoint.m_minibatchSize, deletePreviousModel, &midEpochCheckpoint);
+    }
+    else
+    {
+        fprintf(stderr, "SGD: Saving mid-epoch checkpoint model '%ls'\n", midEpochCheckpoint.m_modelFileName.c_str());
+        net->Save(midEpochCheckpoint.m_modelFileName);
+        SaveCheckPointInfo(midEpochCheckpoint.m_epoch, totalSamplesSeen, midEpochCheckpoint.m_learnRatePerSample, smoothedGradients,
+                           midEpochCheckpoint.m_prevCriterion, midEpochCheckpoint.m_minibatchSize, &midEpochCheckpoint);
+        deletePreviousModel();
+    }
+}
+
+template <class ElemType>
+void SGD<ElemType>::WaitForCheckPoint()
+{
+    if (!m_asyncCheckpoint)
+        return;
+    if (m_checkpointWriter)
+        m_checkpointWriter->Wait();
+    // the other workers wait for the main worker
+    if (g_mpi != nullptr)
+        g_mpi->WaitAll();
+}
 
-        renameOrDie(tempFileName, checkPointFileName);
+// the model copy of m_asyncCV lives on its own device (m_cvDeviceId), so that the evaluation neither touches
+// the nodes of the training network nor competes for its memory; only the parameters are copied each epoch
+template <class ElemType>
+struct SGD<ElemType>::PendingValidation
+{
+    ComputationNetworkPtr m_net;
+    std::thread m_thread;
+    std::exception_ptr m_error;
+    vector<double> m_scores;
+    int m_epoch;
+
+    ~PendingValidation()
+    {
+        if (m_thread.joinable())
+            m_thread.join();
     }
+};
+
+template <class ElemType>
+void SGD<ElemType>::StartAsyncValidation(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                         IDataReader<ElemType>* validationSetDataReader, const vector<wstring>& evalNodeNames,
+                                         const size_t mbSize, const int epoch)
+{
+    if (!m_pendingValidation)
+    {
+        // the first time, clone the whole network onto the evaluation device through a file
+        DEVICEID_TYPE deviceId = (m_cvDeviceId == DEVICEID_NOTYETDETERMINED) ? net->GetDeviceId() : m_cvDeviceId;
+        wstring cloneFileName = m_modelPath + L".cv.tmp";
+        net->Save(cloneFileName);
+        m_pendingValidation = make_shared<PendingValidation>();
+        m_pendingValidation->m_net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, cloneFileName, net->GetOptions());
+        _wunlink(cloneFileName.c_str());
+        fprintf(stderr, "SGD: Evaluating the validation set in the background on device %d.\n", (int) deviceId);
+    }
+    else
+    {
+        for (const auto& node : learnableNodes)
+        {
+            auto cvNode = dynamic_pointer_cast<ComputationNode<ElemType>>(m_pendingValidation->m_net->GetNodeFromName(node->NodeName()));
+            cvNode->Value().SetValueAcrossDevices(dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value());
+        }
+    }
+
+    PendingValidation& pending = *m_pendingValidation;
+    pending.m_epoch = epoch;
+    pending.m_error = nullptr;
+    pending.m_thread = std::thread([&pending, validationSetDataReader, evalNodeNames, mbSize]()
+    {
+        try
+        {
+            SimpleEvaluator<ElemType> evalforvalidation(pending.m_net);
+            pending.m_scores = evalforvalidation.Evaluate(validationSetDataReader, evalNodeNames, mbSize);
+        }
+        catch (...)
+        {
+            pending.m_error = std::current_exception();
+        }
+    });
+}
+
+template <class ElemType>
+bool SGD<ElemType>::FinishAsyncValidation(/*out*/ vector<double>& scores, /*out*/ int& epoch)
+{
+    if (!m_pendingValidation || !m_pendingValidation->m_thread.joinable())
+        return false;
+    m_pendingValidation->m_thread.join();
+    if (m_pendingValidation->m_error)
+        std::rethrow_exception(m_pendingValidation->m_error);
+    scores = m_pendingValidation->m_scores;
+    epoch = m_pendingValidation->m_epoch;
+    return true;
 }
 
 template <class ElemType>
@@ -2154,9 +3888,10 @@ bool SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
                                        /*out*/ double& learnRatePerSample,
                                        std::list<Matrix<ElemType>>& smoothedGradients,
                                        /*out*/ double& prevCriterion,
-                                       /*out*/ size_t& minibatchSize)
+                                       /*out*/ size_t& minibatchSize,
+                                       /*out*/ MidEpochCheckpoint* midEpochCheckpoint)
 {
-    wstring checkPointFileName = GetCheckPointFileNameForEpoch(int(epochNumber));
+    wstring checkPointFileName = midEpochCheckpoint ? GetMidEpochCheckPointFileName(int(epochNumber)) : GetCheckPointFileNameForEpoch(int(epochNumber));
     if (!fexists(checkPointFileName.c_str()))
     {
         fprintf(stderr, "Warning: checkpoint file is missing. learning parameters will be initialized from 0\n");
@@ -2167,6 +3902,9 @@ bool SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
                  FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
     fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BCKP");
 
+    if (midEpochCheckpoint)
+        GetMidEpochSection(fstream, *midEpochCheckpoint);
+
     fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BLearnRate");
     fstream >> totalSamplesSeen >> learnRatePerSample >> prevCriterion;
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ELearnRate");
@@ -2190,8 +3928,62 @@ bool SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
     }
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradient");
 
+    // block momentum state (optional, only written by BlockMomentumSGD)
+    m_blockMomentumStates.clear();
+    if (fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BBlockMomentum"))
+    {
+        DEVICEID_TYPE deviceId = smoothedGradients.empty() ? CPUDEVICE : smoothedGradients.front().GetDeviceId();
+        size_t numStates;
+        fstream >> numStates;
+        for (size_t i = 0; i < numStates; i++)
+        {
+            std::wstring nodeName;
+            fstream >> nodeName;
+            BlockMomentumState& state = m_blockMomentumStates[nodeName];
+            state.m_globalModel = make_shared<Matrix<ElemType>>(deviceId);
+            state.m_blockMomentum = make_shared<Matrix<ElemType>>(deviceId);
+            fstream >> *state.m_globalModel >> *state.m_blockMomentum;
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EBlockMomentum");
+    }
+
+    // number of model updates (optional, for Adam and LAMB)
+    m_numOptimizerSteps = 0;
+    if (fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BOptimizerSteps"))
+    {
+        fstream >> m_numOptimizerSteps;
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EOptimizerSteps");
+    }
+
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ECKP");
 
+    if (midEpochCheckpoint)
+    {
+        midEpochCheckpoint->m_learnRatePerSample = learnRatePerSample;
+        midEpochCheckpoint->m_minibatchSize = minibatchSize;
+        midEpochCheckpoint->m_prevCriterion = prevCriterion;
+    }
+
+    return true;
+}
+
+template <class ElemType>
+bool SGD<ElemType>::LoadMidEpochCheckPoint(const int epoch, /*out*/ MidEpochCheckpoint& midEpochCheckpoint)
+{
+    wstring checkPointFileName = GetMidEpochCheckPointFileName(epoch);
+    if (!fexists(checkPointFileName.c_str()))
+        return false;
+
+    File fstream(checkPointFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BCKP");
+    GetMidEpochSection(fstream, midEpochCheckpoint);
+    // (left over from an older run if its model precedes that of the previous epoch)
+    if ((midEpochCheckpoint.m_epoch != epoch) || !msra::files::fuptodate(midEpochCheckpoint.m_modelFileName, GetModelNameForEpoch(epoch - 1), false))
+    {
+        fprintf(stderr, "Warning: ignoring the mid-epoch checkpoint '%ls', which does not match the epoch or its model.\n", checkPointFileName.c_str());
+        midEpochCheckpoint = MidEpochCheckpoint();
+        return false;
+    }
     return true;
 }
 
@@ -2201,6 +3993,12 @@ wstring SGD<ElemType>::GetCheckPointFileNameForEpoch(const int epoch)
     return GetModelNameForEpoch(epoch) + L".ckp";
 }
 
+template <class ElemType>
+wstring SGD<ElemType>::GetMidEpochCheckPointFileName(const int epoch)
+{
+    return GetModelNameForEpoch(epoch) + L".mid.ckp";
+}
+
 template <class ElemType>
 wstring SGD<ElemType>::GetModelNameForEpoch(const int epoch, bool bLastModel)
 {
@@ -2279,7 +4077,7 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
             fprintf(stderr, "\n###### d%ls######\n", node->NodeName().c_str());
 
             double eOrg = node->Value()(irow, icol);
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             node->BumpEvalTimeStamp();
 
@@ -2296,13 +4094,13 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
             // TODO: why is this value not used?
             criterionNodes[npos]->Get00Element();
             double eGradErr = node->Gradient()(irow, icol);
-            node->Gradient().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Gradient().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             double ePos = eOrg + EPSILON;
             double eNeg = eOrg - EPSILON;
 
             node->Value()(irow, icol) = (ElemType) ePos;
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             node->BumpEvalTimeStamp();
             net->ForwardProp(criterionNodes[npos]);
@@ -2311,7 +4109,7 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
             double mbEvalCriPos = criterionNodes[npos]->Get00Element(); // TODO: make Get00Element() a function of ComputationNodeBase
 
             node->Value()(irow, icol) = (ElemType) eNeg;
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             node->BumpEvalTimeStamp();
             net->ForwardProp(criterionNodes[npos]);
@@ -2321,7 +4119,7 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
 
             // back to its original parameter value
             node->Value()(irow, icol) = (ElemType) eOrg;
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             // check if they are consistent
             double eGradNum = ((mbEvalCriPos - mbEvalCriNeg) / (ePos - eNeg));
@@ -2367,9 +4165,11 @@ static GradientsUpdateType ParseGradUpdateType(const wstring& s)
     else if (EqualCI(s, L"adagrad"))                 return GradientsUpdateType::AdaGrad;
     else if (EqualCI(s, L"rmsProp"))                 return GradientsUpdateType::RmsProp;
     else if (EqualCI(s, L"fsAdagrad"))               return GradientsUpdateType::FSAdaGrad;
+    else if (EqualCI(s, L"adam"))                    return GradientsUpdateType::Adam;
+    else if (EqualCI(s, L"lamb"))                    return GradientsUpdateType::Lamb;
     // legacy, deprecated
     else if (EqualCI(s, L"normal") || EqualCI(s, L"simple")) return GradientsUpdateType::None;
-    else InvalidArgument("ParseGradUpdateType: Invalid Gradient Updating Type. Valid values are (none | adagrad | rmsProp | fsAdagrad )");
+    else InvalidArgument("ParseGradUpdateType: Invalid Gradient Updating Type. Valid values are (none | adagrad | rmsProp | fsAdagrad | adam | lamb )");
 }
 
 static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
@@ -2377,7 +4177,28 @@ static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
     if      (EqualCI(s, L"") || EqualCI(s, L"none")) return ParallelizationMethod::None;
     else if (EqualCI(s, L"DataParallelSGD"))         return ParallelizationMethod::DataParallelSGD;
     else if (EqualCI(s, L"ModelAveragingSGD"))       return ParallelizationMethod::ModelAveragingSGD;
-    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | dataParallelSGD | modelAveragingSGD)");
+    else if (EqualCI(s, L"BlockMomentumSGD"))        return ParallelizationMethod::BlockMomentumSGD;
+    else if (EqualCI(s, L"ModelParallelSGD"))        return ParallelizationMethod::ModelParallelSGD;
+    else if (EqualCI(s, L"LocalDataParallelSGD"))    return ParallelizationMethod::LocalDataParallelSGD;
+    else if (EqualCI(s, L"HogwildSGD"))              return ParallelizationMethod::HogwildSGD;
+    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | dataParallelSGD | modelAveragingSGD | blockMomentumSGD | modelParallelSGD | localDataParallelSGD | hogwildSGD)");
+}
+
+static AllReduceAlgorithm ParseAllReduceAlgorithm(const wstring& s)
+{
+    if      (EqualCI(s, L"") || EqualCI(s, L"auto")) return AllReduceAlgorithm::Auto;
+    else if (EqualCI(s, L"mpi"))                     return AllReduceAlgorithm::MPI;
+    else if (EqualCI(s, L"ring"))                    return AllReduceAlgorithm::Ring;
+    else if (EqualCI(s, L"hierarchical"))            return AllReduceAlgorithm::Hierarchical;
+    else InvalidArgument("allReduceAlgorithm: Invalid all-reduce algorithm. Valid values are (auto | mpi | ring | hierarchical)");
+}
+
+static GradientCompression ParseGradientCompression(const wstring& s)
+{
+    if      (EqualCI(s, L"") || EqualCI(s, L"none")) return GradientCompression::None;
+    else if (EqualCI(s, L"topK"))                    return GradientCompression::TopK;
+    else if (EqualCI(s, L"threshold"))               return GradientCompression::Threshold;
+    else InvalidArgument("gradientCompression: Invalid gradient compression. Valid values are (none | topK | threshold)");
 }
 
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
@@ -2415,7 +4236,10 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_autoAdjustMinibatch = configAALR(L"autoAdjustMinibatch", false);
     m_minibatchSizeTuningFrequency = configAALR(L"minibatchSizeTuningFrequency", (size_t) 1);
     m_minibatchSizeTuningMax = configAALR(L"minibatchSizeTuningMax", (size_t) 1048576);
+    m_minibatchSizeTuningMemoryFraction = configAALR(L"minibatchSizeTuningMemoryFraction", 0.9);
     m_minibatchSearchCriterionErrorMargin = configAALR(L"minibatchSearchCriterionErrorMargin", (size_t) 1);
+    m_parallelSearch = configAALR(L"parallelSearch", false);
+    m_searchEarlyExitFactor = configAALR(L"searchEarlyExitFactor", 0.0);
 
     // the number of minibatches used to search
     // the learning rate. Its typically set to 10-20% of
@@ -2461,9 +4285,44 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_traceLevel = configSGD(L"traceLevel", (int) 0);
     m_numMBsToShowResult = configSGD(L"numMBsToShowResult", (size_t) 10);
     m_numMBsToCUDAProfile = configSGD(L"numMBsToCUDAProfile", (size_t) 0);
+    m_profileNodes = configSGD(L"profileNodes", false);
+    m_nodeProfileTraceFile = (const wstring&) configSGD(L"nodeProfileTraceFile", L"");
+    m_profilePhases = configSGD(L"profilePhases", false);
+    m_phaseProfileTraceFile = (const wstring&) configSGD(L"phaseProfileTraceFile", L"");
+    m_phaseProfileSyncGPU = configSGD(L"phaseProfileSyncGPU", true);
+    m_deviceTransferMode = DeviceTransferMonitor::ParseMode((const wstring&) configSGD(L"deviceTransfers", L"off"));
+    m_memoryAccounting = configSGD(L"memoryAccounting", false);
+    m_networkOptions = ComputationNetworkOptions(configSGD);
 
     m_gradientClippingWithTruncation = configSGD(L"gradientClippingWithTruncation", true);
     m_clippingThresholdPerSample = configSGD(L"clippingThresholdPerSample", numeric_limits<double>::infinity());
+    m_gradientClippingGlobalNorm = configSGD(L"gradientClippingGlobalNorm", false);
+    if (m_gradientClippingGlobalNorm && m_gradientClippingWithTruncation)
+        InvalidArgument("gradientClippingGlobalNorm requires gradientClippingWithTruncation = false.");
+    m_multiTensorUpdate = configSGD(L"multiTensorUpdate", false);
+    m_offloadOptimizerState = configSGD(L"offloadOptimizerState", false);
+    m_offloadOptimizerStateMinElements = configSGD(L"offloadOptimizerStateMinElements", (size_t) 1 << 20);
+    m_cpuNodes = configSGD(L"cpuNodes", ConfigRecordType::Array(stringargvector()));
+    m_cpuParameterThresholdMB = configSGD(L"cpuParameterThresholdMB", 0.0);
+    if (m_cpuParameterThresholdMB < 0)
+        InvalidArgument("cpuParameterThresholdMB must not be negative.");
+    m_halfPrecisionActivations = configSGD(L"halfPrecisionActivations", ConfigRecordType::Array(stringargvector()));
+    const wstring halfPrecisionActivationFormat = (const wstring&) configSGD(L"halfPrecisionActivationFormat", L"fp16");
+    if (halfPrecisionActivationFormat == L"fp16")
+        m_halfPrecisionActivationFormat = HalfFormat::fp16;
+    else if (halfPrecisionActivationFormat == L"bfloat16")
+        m_halfPrecisionActivationFormat = HalfFormat::bfloat16;
+    else
+        InvalidArgument("halfPrecisionActivationFormat: Invalid value '%ls'. Must be 'fp16' or 'bfloat16'.", halfPrecisionActivationFormat.c_str());
+
+    m_useFP16GEMM = configSGD(L"useFP16GEMM", false);
+    m_dynamicLossScaling = configSGD(L"dynamicLossScaling", m_useFP16GEMM);
+    m_initialLossScale = configSGD(L"lossScale", m_dynamicLossScaling ? 32768.0 : 1.0);
+    m_lossScaleGrowthInterval = configSGD(L"lossScaleGrowthInterval", (size_t) 2000);
+    if (m_useFP16GEMM && sizeofElemType != sizeof(float))
+        InvalidArgument("useFP16GEMM requires precision = 'float'.");
+    if (m_initialLossScale <= 0)
+        InvalidArgument("lossScale must be positive.");
 
     // sequence-training parameters
     m_hSmoothingWeight = configSGD(L"hSmoothingWeight", 0.95);
@@ -2474,6 +4333,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_seqGammarCalcLMF = configSGD(L"seqGammarLMF", 14.0);
     m_seqGammarCalcbMMIFactor = configSGD(L"seqGammarBMMIFactor", 0.0);
     m_seqGammarCalcWP = configSGD(L"seqGammarWordPen", 0.0);
+    m_seqGammarCalcPruningBeam = configSGD(L"seqGammarPruningBeam", 0.0); // GPU only; 0 = no lattice pruning
 
     m_dropoutRates = configSGD(L"dropoutRate", ConfigRecordType::Array(floatargvector(vector<float>{0.0f})));
 
@@ -2489,6 +4349,12 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_rpi.max = configSGD(L"rms_wgt_max", 10.0);
     m_rpi.gamma = configSGD(L"rms_gamma", 0.99);
 
+    // Adam and LAMB parameters
+    m_adamInfo.beta1 = configSGD(L"adamBeta1", 0.9);
+    m_adamInfo.beta2 = configSGD(L"adamBeta2", 0.999);
+    m_adamInfo.epsilon = configSGD(L"adamEpsilon", 1e-8);
+    m_adamInfo.lambWeightDecay = configSGD(L"lambWeightDecay", 0.0);
+
     m_needAveMultiplier = configSGD(L"normWithAveMultiplier", true);
     m_L2RegWeight = configSGD(L"L2RegWeight", 0.0);
     m_L1RegWeight = configSGD(L"L1RegWeight", 0.0);
@@ -2515,6 +4381,19 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     }
 
     m_useAllDataForPreComputedNode = configSGD(L"UseAllDataForPreComputedNode", true);
+    m_distributedPreCompute = configSGD(L"distributedPreCompute", true);
+    m_distributedCV = configSGD(L"distributedCV", false);
+    m_asyncCV = configSGD(L"asyncCV", false);
+    m_cvDeviceId = configSGD(L"cvDeviceId", (int) DEVICEID_NOTYETDETERMINED);
+    if (m_distributedCV && m_asyncCV)
+        InvalidArgument("distributedCV and asyncCV cannot be combined.");
+    m_preComputeSampleFraction = configSGD(L"preComputeSampleFraction", 1.0);
+    m_preComputeSampleBlockSize = configSGD(L"preComputeSampleBlockSize", (size_t) 100);
+    m_preComputeCacheFile = (const wstring&) configSGD(L"preComputeCacheFile", L"");
+    if (m_preComputeSampleFraction <= 0 || m_preComputeSampleFraction > 1)
+        InvalidArgument("preComputeSampleFraction must be in (0, 1].");
+    if (m_preComputeSampleBlockSize == 0)
+        InvalidArgument("preComputeSampleBlockSize must be at least 1.");
 
     // consistency checks
     for (size_t i = 0; i < m_mbSize.size(); i++)
@@ -2614,12 +4493,26 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
 
     // parallel training
     m_parallelizationMethod = ParallelizationMethod::None;
+    m_hogwildNumThreads = 0;
     m_numGradientBits = 32;
     m_zeroThresholdFor1Bit = true;
     m_bufferedAsyncGradientAggregation = false;
+    m_allReduceAlgorithm = AllReduceAlgorithm::Auto;
+    m_gradientBucketSizeInMB = 0;
+    m_useGPUDirect = true;
+    m_gradientCompression = GradientCompression::None;
+    m_gradientCompressionRatio = 0.01;
+    m_gradientCompressionThreshold = 3.0;
     m_enableDistributedMBReading = false;
+    m_elasticTraining = false;
     m_parallelizationStartEpochNum = 0;
     m_nFramesBetweenMASync = 40000; // default 40k frames
+    m_overlapModelAveraging = false;
+    m_numModelSyncBits = 8 * sizeofElemType;
+    m_blockMomentumPerSync = -1;     // default 1 - 1/#workers
+    m_blockLearningRate = 1.0;
+    m_useNesterovBlockMomentum = true;
+    m_resetSGDMomentumAfterSync = true;
 
     if ((g_mpi != nullptr) && configSGD.Exists(L"ParallelTrain"))
     {
@@ -2627,6 +4520,9 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         m_parallelizationMethod = ParseParallelizationMethod(configParallelTrain(L"parallelizationMethod", L"none"));
         m_parallelizationStartEpochNum = configParallelTrain(L"parallelizationStartEpoch", (int) 1) - 1; // Epoch numbers internally are 0 based
         m_enableDistributedMBReading = configParallelTrain(L"distributedMBReading", false);
+        m_elasticTraining = configParallelTrain(L"elastic", false);
+        if (m_elasticTraining && (m_parallelizationMethod != ParallelizationMethod::DataParallelSGD) && (m_parallelizationMethod != ParallelizationMethod::ModelAveragingSGD))
+            InvalidArgument("elastic training is only supported with DataParallelSGD and ModelAveragingSGD.");
         m_syncStatsTrace = configParallelTrain(L"syncPerfStats", (int) 0);
 
         if (configParallelTrain.Exists(L"DataParallelSGD"))
@@ -2636,6 +4532,18 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_numGradientBits = configDataParallelSGD(L"gradientBits", defaultGradientBits);
             m_zeroThresholdFor1Bit = configDataParallelSGD(L"useZeroThresholdFor1BitQuantization", true);
             m_bufferedAsyncGradientAggregation = configDataParallelSGD(L"useBufferedAsyncGradientAggregation", false);
+            m_allReduceAlgorithm = ParseAllReduceAlgorithm(configDataParallelSGD(L"allReduceAlgorithm", L"auto"));
+            m_gradientBucketSizeInMB = configDataParallelSGD(L"gradientBucketSizeInMB", 0.0);
+            m_useGPUDirect = configDataParallelSGD(L"useGPUDirect", true);
+            m_gradientCompression = ParseGradientCompression(configDataParallelSGD(L"gradientCompression", L"none"));
+            m_gradientCompressionRatio = configDataParallelSGD(L"gradientCompressionRatio", 0.01);
+            m_gradientCompressionThreshold = configDataParallelSGD(L"gradientCompressionThreshold", 3.0);
+            if ((m_gradientCompressionRatio <= 0) || (m_gradientCompressionRatio > 1))
+                InvalidArgument("gradientCompressionRatio must be in the range (0, 1].");
+            if (m_gradientCompressionThreshold < 0)
+                InvalidArgument("gradientCompressionThreshold must not be negative.");
+            if ((m_gradientCompression != GradientCompression::None) && (m_numGradientBits != (8 * sizeofElemType)))
+                InvalidArgument("gradientCompression cannot be combined with gradientBits < %d.", (int) (8 * sizeofElemType));
             if ((m_numGradientBits < 1) || (m_numGradientBits > (8 * sizeofElemType)))
             {
                 InvalidArgument("gradientBits must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double!");
@@ -2646,6 +4554,66 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         {
             const ConfigRecordType& configMASGD(configParallelTrain(L"ModelAveragingSGD", ConfigRecordType::Record()));
             m_nFramesBetweenMASync = configMASGD(L"syncFrequencyInFrames", (size_t) 40000);
+            m_overlapModelAveraging = configMASGD(L"overlapSync", false) && (m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD);
+            if (m_parallelizationMethod == ParallelizationMethod::ModelAveragingSGD)
+                m_numModelSyncBits = configMASGD(L"syncBits", (size_t) (8 * sizeofElemType));
+        }
+
+        if (configParallelTrain.Exists(L"BlockMomentumSGD"))
+        {
+            const ConfigRecordType& configBMSGD(configParallelTrain(L"BlockMomentumSGD", ConfigRecordType::Record()));
+            m_nFramesBetweenMASync = configBMSGD(L"syncPeriod", (size_t) 120000);
+            m_blockMomentumPerSync = configBMSGD(L"blockMomentumPerSync", -1.0);
+            m_blockLearningRate = configBMSGD(L"blockLearningRate", 1.0);
+            m_useNesterovBlockMomentum = configBMSGD(L"useNesterovMomentum", true);
+            m_resetSGDMomentumAfterSync = configBMSGD(L"resetSGDMomentum", true);
+            if (m_parallelizationMethod == ParallelizationMethod::BlockMomentumSGD)
+                m_numModelSyncBits = configBMSGD(L"syncBits", (size_t) (8 * sizeofElemType));
+            if (m_blockMomentumPerSync >= 1.0)
+                InvalidArgument("blockMomentumPerSync must be less than 1.");
+            if (m_blockLearningRate <= 0.0)
+                InvalidArgument("blockLearningRate must be positive.");
+        }
+
+        if ((m_numModelSyncBits < 1) || (m_numModelSyncBits > (8 * sizeofElemType)))
+            InvalidArgument("syncBits must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double!");
+        if ((m_numModelSyncBits < (8 * sizeofElemType)) && m_overlapModelAveraging)
+            InvalidArgument("syncBits cannot be combined with overlapSync.");
+
+        if (m_parallelizationMethod == ParallelizationMethod::ModelParallelSGD)
+        {
+            if (g_mpi->NumNodesInUse() > 1)
+                InvalidArgument("ModelParallelSGD splits the network over the devices of a single process; it does not combine with multiple MPI workers.");
+            const ConfigRecordType& configMPSGD(configParallelTrain(L"ModelParallelSGD", ConfigRecordType::Record()));
+            intargvector deviceIds = configMPSGD(L"deviceIds", ConfigRecordType::Array(intargvector()));
+            for (size_t i = 0; i < deviceIds.size(); i++)
+                m_modelParallelDeviceIds.push_back((DEVICEID_TYPE) deviceIds[i]);
+            if (m_modelParallelDeviceIds.size() < 2)
+                InvalidArgument("ModelParallelSGD requires at least two entries in deviceIds.");
+            vector<wstring> stageStarts = configMPSGD(L"stageStartNodes", ConfigRecordType::Array(stringargvector()));
+            m_modelParallelStageStarts = stageStarts;
+        }
+
+        if (m_parallelizationMethod == ParallelizationMethod::LocalDataParallelSGD)
+        {
+            if (g_mpi->NumNodesInUse() > 1)
+                InvalidArgument("LocalDataParallelSGD trains on the devices of a single process; it does not combine with multiple MPI workers.");
+            const ConfigRecordType& configLDPSGD(configParallelTrain(L"LocalDataParallelSGD", ConfigRecordType::Record()));
+            intargvector deviceIds = configLDPSGD(L"deviceIds", ConfigRecordType::Array(intargvector()));
+            for (size_t i = 0; i < deviceIds.size(); i++)
+                m_localDataParallelDeviceIds.push_back((DEVICEID_TYPE) deviceIds[i]);
+            if (m_localDataParallelDeviceIds.size() < 2)
+                InvalidArgument("LocalDataParallelSGD requires at least two entries in deviceIds; the first one must be the deviceId of the training.");
+        }
+
+        if (m_parallelizationMethod == ParallelizationMethod::HogwildSGD)
+        {
+            if (g_mpi->NumNodesInUse() > 1)
+                InvalidArgument("HogwildSGD trains on the CPU threads of a single process; it does not combine with multiple MPI workers.");
+            const ConfigRecordType& configHogwildSGD(configParallelTrain(L"HogwildSGD", ConfigRecordType::Record()));
+            m_hogwildNumThreads = configHogwildSGD(L"numThreads", (size_t) 0);
+            if (m_hogwildNumThreads < 2)
+                InvalidArgument("HogwildSGD requires numThreads >= 2.");
         }
     }
 }
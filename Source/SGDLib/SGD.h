@@ -17,6 +17,8 @@
 #include <chrono>
 #include <random>
 #include "Profiler.h"
+#include "DeviceTransferMonitor.h"
+#include "MemoryAccounting.h"
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
@@ -40,7 +42,9 @@ enum class GradientsUpdateType : int
     None,
     AdaGrad,
     RmsProp,
-    FSAdaGrad
+    FSAdaGrad,
+    Adam,
+    Lamb // Adam with a layer-wise trust ratio, for large minibatches
 };
 
 // TODO: While currently combining these methods is not supported,
@@ -51,9 +55,15 @@ enum class ParallelizationMethod : int
     None = 0,
     DataParallelSGD = 1,
     ModelAveragingSGD = (1 << 1),
-    ModelParallelSGD = (1 << 2), // Currently unsupported
+    ModelParallelSGD = (1 << 2), // network split into stages on several devices of one process (see ComputationNetwork::PlaceOnDevices())
+    BlockMomentumSGD = (1 << 3), // model averaging with block-wise model-update filtering (BMUF)
+    LocalDataParallelSGD = (1 << 4), // a replica of the network on each of several GPUs of one process (see LocalDataParallelReplicas.h)
+    HogwildSGD = (1 << 5),           // lock-free updates of the parameters by several CPU threads of one process (see HogwildWorkers.h)
 };
 
+enum class AllReduceAlgorithm : int; // (defined in IDistGradAggregator.h)
+enum class GradientCompression : int; // (defined in IDistGradAggregator.h)
+
 // configuration parameters associated with RMSProp learning algorithm
 struct RMSPropInfo
 {
@@ -73,6 +83,23 @@ struct RMSPropInfo
     }
 };
 
+// configuration parameters associated with the Adam and LAMB learning algorithms
+struct AdamInfo
+{
+    double beta1;
+    double beta2;
+    double epsilon;
+    double lambWeightDecay; // decoupled, inside the trust ratio
+
+    AdamInfo()
+    {
+        beta1 = 0.9;
+        beta2 = 0.999;
+        epsilon = 1e-8;
+        lambWeightDecay = 0;
+    }
+};
+
 struct GradientUpdateInfo
 {
     GradientsUpdateType mType;
@@ -169,6 +196,32 @@ protected:
 
     bool m_gradientClippingWithTruncation;
     double m_clippingThresholdPerSample;
+    bool m_gradientClippingGlobalNorm; // clip by the norm of all gradients together instead of that of each
+
+    // update the dense parameters in a few launches for all (Matrix::MultiTensorSGDUpdate()) instead of several per parameter
+    bool m_multiTensorUpdate;
+
+    // keep the optimizer state of GPU parameters with at least m_offloadOptimizerStateMinElements elements in host memory,
+    // and update those parameters on the CPU, overlapped with reading the next minibatch (see OptimizerStateOffload.h)
+    bool m_offloadOptimizerState;
+    size_t m_offloadOptimizerStateMinElements;
+
+    // heterogeneous placement: run these nodes, and the lookups into parameters of at least m_cpuParameterThresholdMB MB, on the CPU
+    // next to the training device (see ComputationNetwork::PlaceNodesOnDevices())
+    std::vector<std::wstring> m_cpuNodes;
+    double m_cpuParameterThresholdMB; // 0: off
+
+    // keep the values that nodes of these operation types save for backprop in 16 bits (see ComputationNodeBase::SetStoreValueInHalf())
+    std::vector<std::wstring> m_halfPrecisionActivations;
+    HalfFormat m_halfPrecisionActivationFormat;
+
+    // Mixed precision: GEMMs in FP16 while the weights, their updates and all other computation stay in FP32.
+    // Loss scaling keeps small gradients from flushing to zero in FP16: backprop starts with the loss scale instead of 1,
+    // and the gradients are divided by it before the update.
+    bool m_useFP16GEMM;
+    double m_initialLossScale;
+    bool m_dynamicLossScaling;        // upon inf/nan gradients skip the update and halve the loss scale; double it after m_lossScaleGrowthInterval good minibatches
+    size_t m_lossScaleGrowthInterval;
 
     intargvector m_numMiniBatch4LRSearch;
     size_t m_numBestSearchEpoch;
@@ -188,6 +241,9 @@ protected:
 
     bool m_useCVSetControlLRIfCVExists;
     bool m_useEvalCriterionControlLR;
+    bool m_distributedCV;       // with several workers, each evaluates its share of the validation set, instead of the main worker all of it
+    bool m_asyncCV;             // evaluate the validation set on a background thread while the next epoch trains; the learning-rate control then lags one epoch
+    DEVICEID_TYPE m_cvDeviceId; // with m_asyncCV: device of the model copy that is evaluated; DEVICEID_NOTYETDETERMINED = the training device
 
     double m_increaseLearnRateIfImproveMoreThan;
     double m_learnRateIncreaseFactor;
@@ -196,6 +252,9 @@ protected:
     size_t m_minibatchSearchCriterionErrorMargin;
     size_t m_minibatchSizeTuningFrequency;
     size_t m_minibatchSizeTuningMax;
+    double m_minibatchSizeTuningMemoryFraction; // of the available GPU memory that tuned minibatches may use; 0 to not check
+    bool m_parallelSearch;          // with several workers, the learning-rate and minibatch-size candidates are trained on different workers at once
+    double m_searchEarlyExitFactor; // > 0: a candidate stops once its criterion exceeds this factor times the base criterion; 0 to always train to the end
 
     floatargvector m_dropoutRates;
     size_t m_maxTempMemSizeInSamplesForCNN;
@@ -208,9 +267,18 @@ protected:
 
     GradientUpdateInfo m_gradType;
     RMSPropInfo m_rpi;
+    AdamInfo m_adamInfo;
 
     int m_numMBsToShowResult;
     int m_numMBsToCUDAProfile;
+    bool m_profileNodes;                  // print per-node forward/backprop timing at the end of every epoch
+    std::wstring m_nodeProfileTraceFile;  // if not empty, the Chrome trace of each epoch is written to this path plus "." and the epoch number
+    bool m_profilePhases;                 // print percentiles of the reader, compute, aggregation, and update time per minibatch at the end of every epoch
+    std::wstring m_phaseProfileTraceFile; // if not empty, every phase of every minibatch is streamed to this path (plus ".rank" and the rank if parallel)
+    bool m_phaseProfileSyncGPU;           // synchronize the GPU at the phase boundaries, so that the kernels are attributed to their phase
+    DeviceTransferMonitor::Mode m_deviceTransferMode; // count (and in strict mode, forbid) implicit CPU/GPU transfers inside nodes, printed at the end of every epoch
+    bool m_memoryAccounting;                          // attribute allocations to nodes and roles; high-water marks printed at the end of every epoch, snapshot on out-of-memory
+    ComputationNetworkOptions m_networkOptions;       // optimizations of the networks that are trained and validated
 
     bool m_doGradientCheck;
     double m_gradientCheckSigDigit;
@@ -218,10 +286,15 @@ protected:
     bool m_doUnitTest;
 
     bool m_useAllDataForPreComputedNode;
+    bool m_distributedPreCompute;       // with several workers, each accumulates the PreCompute statistics over its share of the data, which are then combined
+    double m_preComputeSampleFraction;  // < 1: PreCompute reads only about this fraction of the blocks of m_preComputeSampleBlockSize minibatches
+    size_t m_preComputeSampleBlockSize;
+    std::wstring m_preComputeCacheFile; // if not empty, the PreCompute statistics are kept here and reused by later runs on the same data
 
     // Parallel training
     ParallelizationMethod m_parallelizationMethod;
     bool m_enableDistributedMBReading;
+    bool m_elasticTraining; // continue with the surviving workers when one fails (requires an MPI with ULFM)
     int m_parallelizationStartEpochNum;
 
     // decide if/how often we measure and show sync performance stats (seconds spend on sync, seconds since last sync etc.) ?
@@ -234,9 +307,32 @@ protected:
     int m_numGradientBits;
     bool m_bufferedAsyncGradientAggregation;
     bool m_zeroThresholdFor1Bit;
+    AllReduceAlgorithm m_allReduceAlgorithm;
+    double m_gradientBucketSizeInMB; // > 0: aggregate the gradients in buckets of this size while backprop is still running
+    bool m_useGPUDirect;             // hand GPU gradients to MPI directly if it is CUDA-aware
+    GradientCompression m_gradientCompression;
+    double m_gradientCompressionRatio;     // GradientCompression::TopK: fraction of the elements sent
+    double m_gradientCompressionThreshold; // GradientCompression::Threshold: in units of the RMS of the gradient
 
     // Parallel training related with MA
     size_t m_nFramesBetweenMASync;
+    bool m_overlapModelAveraging; // average in the background while training goes on, and apply the average (delay-compensated) at the next sync
+    size_t m_numModelSyncBits;    // < 8 * sizeof(ElemType): exchange the model deltas since the last sync quantized to this many bits (see ModelAveragingSyncQuantized())
+
+    // Block momentum (BMUF): at every sync, the averaged model is filtered through a momentum on the level of blocks
+    double m_blockMomentumPerSync;   // block momentum; < 0 means 1 - 1/#workers
+    double m_blockLearningRate;
+    bool m_useNesterovBlockMomentum; // start each block from the global model plus the block momentum
+    bool m_resetSGDMomentumAfterSync;
+
+    // Model parallelism: stage s of the network lives on m_modelParallelDeviceIds[s]
+    std::vector<DEVICEID_TYPE> m_modelParallelDeviceIds;
+    std::vector<std::wstring> m_modelParallelStageStarts; // first node of each stage but the first; empty: balance automatically
+
+    // Data parallelism within the process: the network is trained on m_localDataParallelDeviceIds[0], with replicas on the others
+    std::vector<DEVICEID_TYPE> m_localDataParallelDeviceIds;
+    // HogwildSGD: the number of CPU threads that train the shared parameters
+    size_t m_hogwildNumThreads;
 
     bool m_needAveMultiplier;
     double m_L2RegWeight;
@@ -250,11 +346,62 @@ protected:
     double m_seqGammarCalcLMF;
     double m_seqGammarCalcWP;
     double m_seqGammarCalcbMMIFactor;
+    double m_seqGammarCalcPruningBeam;
     bool m_seqGammarCalcUsesMBR;
 };
 
 template <class ElemType>
 class IDistGradAggregator;
+class TrainingTimeline;
+class CheckpointWriter;
+template <class ElemType>
+class LocalDataParallelReplicas;
+template <class ElemType>
+class HogwildWorkers;
+template <class ElemType>
+class OptimizerStateOffload;
+
+// The state of a partially trained epoch (see SGD's 'numMBsPerCheckpoint'), written into a mid-epoch checkpoint, besides
+// what a per-epoch checkpoint holds, and restored by TrainOneEpoch() to resume the epoch where it stopped.
+struct MidEpochCheckpoint
+{
+    int m_epoch;                 // -1: none
+    std::wstring m_modelFileName; // the model saved with the checkpoint
+
+    // chosen before the epoch, and not searched again when resuming it
+    double m_learnRatePerSample;
+    size_t m_minibatchSize;
+    double m_prevCriterion; // of the previous epoch, for the learning-rate control after this one
+
+    // progress within the epoch
+    size_t m_numMBsRun;        // minibatches trained, which the reader skips when resuming
+    size_t m_totalEpochSamples;
+    double m_epochCriterion;   // sums (not yet divided by the samples) over all workers
+    std::vector<double> m_epochEvalErrors;
+    double m_lossScale;
+    size_t m_numMBsSinceLossScaleChange;
+
+    MidEpochCheckpoint()
+        : m_epoch(-1), m_learnRatePerSample(0), m_minibatchSize(0), m_prevCriterion(0), m_numMBsRun(0), m_totalEpochSamples(0),
+          m_epochCriterion(0), m_lossScale(1), m_numMBsSinceLossScaleChange(0)
+    {
+    }
+};
+
+// The accumulated statistics of one MeanNode or InvStdDevNode (see MeanInvStdDevNodeBase::GetAccumulators()), as combined
+// across the workers and stored in the PreCompute cache file. 'var' is empty for MeanNode.
+struct PreComputeAccumulators
+{
+    std::wstring m_nodeName;
+    size_t m_numSamples;
+    std::vector<double> m_mean;
+    std::vector<double> m_var;
+
+    PreComputeAccumulators()
+        : m_numSamples(0)
+    {
+    }
+};
 
 // -----------------------------------------------------------------------
 // class SGD
@@ -277,11 +424,19 @@ public:
           // TODO: The next few do not belong into SGD any more than the network or reader we operate on. Either move network and reader in here, or move these out.
           m_modelPath((const wstring&) configSGD(L"modelPath")),
           m_keepCheckPointFiles(configSGD(L"keepCheckPointFiles", false)),
+          m_asyncCheckpoint(configSGD(L"asyncCheckpoint", false)),
+          m_checkpointMaxMBPerSecond(configSGD(L"checkpointMaxMBPerSecond", 0.0)),
+          m_numMBsPerCheckpoint(configSGD(L"numMBsPerCheckpoint", (size_t) 0)),
           // m_validateAfterModelReloading(configSGD(L"validateAfterModelReloading", true)),
           m_trainCriterionNodeName((const wstring&) configSGD(L"trainCriterionNodeName", L"")),
           m_evalCriterionNodeName((const wstring&) configSGD(L"evalCriterionNodeName", L"")),
           m_prevChosenMinibatchSize(0),
           m_lastFinishedEpochTrainLoss(0.0),
+          m_lossScale(1.0),
+          m_numMBsSinceLossScaleChange(0),
+          m_numOptimizerSteps(0),
+          m_searchingLocally(false),
+          m_searchEarlyExitCriterion(std::numeric_limits<double>::infinity()),
           m_distGradAgg(nullptr),
           m_gradHeader(nullptr)
     {
@@ -304,6 +459,12 @@ public:
                IDataReader<ElemType>* validationSetDataReader,
                const DEVICEID_TYPE deviceID, const bool makeMode = true);
 
+    // identifies the training data for the PreCompute cache (see 'preComputeCacheFile'); set from the reader configuration
+    void SetPreComputeCacheKey(const std::wstring& key)
+    {
+        m_preComputeCacheKey = key;
+    }
+
 protected:
 
     std::vector<ComputationNodeBasePtr>& GetTrainCriterionNodes(ComputationNetworkPtr net);
@@ -325,6 +486,15 @@ protected:
                     std::vector<ComputationNodeBasePtr>& labelNodes,
                     std::map<std::wstring, Matrix<ElemType>*>* inputMatrices);
 
+    // combines the accumulators of the PreCompute nodes of all workers into those of the whole data, on every worker
+    void AggregatePreComputeAccumulators(std::vector<PreComputeAccumulators>& accumulators);
+    void SetPreComputeAccumulators(const std::list<ComputationNodeBasePtr>& nodes, const std::vector<PreComputeAccumulators>& accumulators);
+    // the cache key of the current PreCompute settings, on top of the reader's (m_preComputeCacheKey)
+    std::wstring GetPreComputeCacheKey() const;
+    // reads the PreCompute cache; false if it is missing, stale, or does not cover 'nodes'
+    bool LoadPreComputeCache(const std::list<ComputationNodeBasePtr>& nodes, /*out*/ std::vector<PreComputeAccumulators>& accumulators);
+    void SavePreComputeCache(const std::vector<PreComputeAccumulators>& accumulators);
+
     // return a reasonable initial learning rate based on the initial mbsize
     double SearchForBestLearnRate(ComputationNetworkPtr net,
                                   ComputationNetworkPtr refNet,
@@ -376,6 +546,63 @@ protected:
                                    std::list<Matrix<ElemType>>& smoothedGradients,
                                    const double learningRateAdjustmentFactor);
 
+    // One trial of the learning-rate or minibatch-size search: a mini-epoch with these settings from the model before the search.
+    struct SearchCandidate
+    {
+        double m_learnRatePerSample;
+        size_t m_minibatchSize;
+        std::string m_prefixMsg;
+        SearchCandidate(double learnRatePerSample, size_t minibatchSize, const std::string& prefixMsg)
+            : m_learnRatePerSample(learnRatePerSample), m_minibatchSize(minibatchSize), m_prefixMsg(prefixMsg)
+        {
+        }
+    };
+
+    // the number of candidates evaluated at once (see m_parallelSearch)
+    size_t NumSearchWorkers() const;
+
+    // Trains all candidates and returns their criteria, on every worker. With m_parallelSearch, worker i trains candidate i
+    // (and i + #workers, ...) on its own, all on the same data; otherwise they are trained one after another as configured.
+    // Candidates whose criterion per sample exceeds 'earlyExitCriterion' are stopped early (and report what they have so far).
+    std::vector<double> EvaluateSearchCandidates(const std::vector<SearchCandidate>& candidates,
+                                                 const double earlyExitCriterion,
+                                                 ComputationNetworkPtr net,
+                                                 ComputationNetworkPtr refNet,
+                                                 const ComputationNodeBasePtr& refNode, const int epochNumber,
+                                                 const size_t numFramesToUseInSearch,
+                                                 IDataReader<ElemType>* trainSetDataReader,
+                                                 const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                                 const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                                 const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                                 const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                                 std::map<std::wstring, Matrix<ElemType>*>* inputMatrices,
+                                                 const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                 std::list<Matrix<ElemType>>& smoothedGradients);
+
+    // The state that the trials of a search start from, kept in device memory, so that TrainOneMiniEpochAndReloadModel()
+    // restores it from there instead of rereading the model and checkpoint of the previous epoch.
+    // Elastic training keeps one of the start of the epoch, to redo the epoch from when a worker fails.
+    struct SearchSnapshot
+    {
+        std::vector<Matrix<ElemType>> m_values; // of the learnable nodes, in their order
+        std::list<Matrix<ElemType>> m_smoothedGradients;
+        size_t m_totalSamplesSeen;
+        size_t m_numOptimizerSteps;
+        double m_lossScale;
+        size_t m_numMBsSinceLossScaleChange;
+    };
+    void TakeSearchSnapshot(const std::list<ComputationNodeBasePtr>& learnableNodes, const std::list<Matrix<ElemType>>& smoothedGradients, const size_t totalSamplesSeen);
+    void RestoreSearchSnapshot(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, /*out*/ size_t& totalSamplesSeen);
+    std::unique_ptr<SearchSnapshot> SnapshotTrainingState(const std::list<ComputationNodeBasePtr>& learnableNodes, const std::list<Matrix<ElemType>>& smoothedGradients, const size_t totalSamplesSeen);
+    void RestoreTrainingState(const SearchSnapshot& snapshot, const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, /*out*/ size_t& totalSamplesSeen);
+
+    // elastic training
+    void BroadcastTrainingState(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, size_t& totalSamplesSeen);
+    void RecoverFromWorkerFailure(const std::exception& failure, size_t numEvalNodes);
+
+    // the largest minibatch size whose predicted memory fits into the device memory
+    size_t GetMaxMinibatchSizeForDeviceMemory(ComputationNetworkPtr net, size_t maxMinibatchSize);
+
     // uses a small percentage of training data of minibatch to
     // speculatively train with various MB sizes; then picks the best
     size_t SearchForBestMinibatchSize(ComputationNetworkPtr net,
@@ -422,7 +649,20 @@ protected:
                          /*out*/ double& epochCriterion,
                          /*out*/ std::vector<double>& epochEvalErrors,
                          /*out*/ size_t& totalSamplesSeen,
-                         std::string prefixMsg = "");
+                         std::string prefixMsg = "",
+                         MidEpochCheckpoint* midEpochCheckpoint = nullptr);
+
+    // TrainOneEpoch() with HogwildSGD
+    size_t TrainOneEpochHogwild(const int epochNumber,
+                                const size_t epochSize,
+                                IDataReader<ElemType>* trainSetDataReader,
+                                const double learnRatePerSample,
+                                size_t tunedMBSize,
+                                const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                std::list<Matrix<ElemType>>& smoothedGradients,
+                                /*out*/ double& epochCriterion,
+                                /*out*/ std::vector<double>& epochEvalErrors,
+                                /*out*/ size_t& totalSamplesSeen);
 
     void InitDistGradAgg(int numEvalNodes, int traceLevel);
 
@@ -430,6 +670,16 @@ protected:
                                   float& SecondsSinceLastSyncFinished, float& SecondsSpentOnSync);
 
     size_t ModelAveragingSync(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
+    float ModelAveragingFactor(int nSamplesSinceLastSync, int& nTotalSamples);
+    size_t ModelAveragingSyncOverlapped(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
+    void FinishPendingModelAverage();
+    size_t ModelAveragingSyncQuantized(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
+    void StartQuantizedModelAveraging(const std::list<ComputationNodeBasePtr>& learnableNodes);
+
+    void InitializeBlockMomentum(const std::list<ComputationNodeBasePtr>& learnableNodes);
+    void BlockMomentumUpdate(const ComputationNodeBasePtr& node, Matrix<ElemType>& averagedModel);
+
+    bool UnscaleGradients(const std::list<ComputationNodeBasePtr>& learnableNodes);
 
 public:
     // UpdateWeightsS - static version of UpdateWeights()
@@ -442,7 +692,8 @@ public:
                                const double L2RegWeight,
                                const double L1RegWeight,
                                const bool needAveMultiplier,
-                               const bool useNesterovMomentum);
+                               const bool useNesterovMomentum,
+                               const size_t optimizerStep); // 1-based number of this update, for Adam's bias correction
 
 protected:
     // UpdateWeights - update the weights in
@@ -456,21 +707,59 @@ protected:
                        const bool useNesterovMomentum) const;
 
     void ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const;
+    double GlobalGradientClippingFactor(const std::list<ComputationNodeBasePtr>& learnableNodes, const size_t actualMBSize) const;
+
+    bool IsMultiTensorUpdatable(const ComputationNodeBasePtr& node, const Matrix<ElemType>& smoothedGradient) const;
+    void MultiTensorUpdateWeights(const std::vector<ComputationNodeBasePtr>& nodes,
+                                  const std::vector<Matrix<ElemType>*>& smoothedGradients,
+                                  const double gradientScale,
+                                  const double learnRatePerSample,
+                                  const double momentumPerSample,
+                                  const size_t actualMBSize) const;
 
     void SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen,
                             const double learnRatePerSample,
                             const std::list<Matrix<ElemType>>& smoothedGradients,
                             const double prevCriterion,
-                            const size_t minibatchSize);
+                            const size_t minibatchSize,
+                            const MidEpochCheckpoint* midEpochCheckpoint = nullptr);
+
+    // saves the model and checkpoint of 'epoch' like SaveCheckPointInfo() and ComputationNetwork::Save(), but from a
+    // snapshot in host memory on a background thread; 'deleteOldFiles' runs there once they are written
+    void SaveCheckPointAsync(ComputationNetworkPtr net, const size_t epoch, const size_t totalSamplesSeen,
+                             const double learnRatePerSample,
+                             const std::list<Matrix<ElemType>>& smoothedGradients,
+                             const double prevCriterion,
+                             const size_t minibatchSize,
+                             const std::function<void()>& deleteOldFiles,
+                             const MidEpochCheckpoint* midEpochCheckpoint = nullptr);
+    // saves the model and a mid-epoch checkpoint of the epoch in progress, synchronously or in the background as configured
+    // (the model under a new name, recorded in the checkpoint, which replaces the previous one once both are written)
+    void SaveMidEpochCheckPoint(ComputationNetworkPtr net, const size_t totalSamplesSeen,
+                                const std::list<Matrix<ElemType>>& smoothedGradients,
+                                MidEpochCheckpoint& midEpochCheckpoint);
+    // waits until the files of SaveCheckPointAsync() are complete, on all workers; call before reading any of them
+    void WaitForCheckPoint();
+
+    // m_asyncCV: evaluates the current model of 'epoch' on a copy on m_cvDeviceId, on a background thread
+    void StartAsyncValidation(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                              IDataReader<ElemType>* validationSetDataReader, const vector<wstring>& evalNodeNames,
+                              const size_t mbSize, const int epoch);
+    // waits for the evaluation of StartAsyncValidation(); false if none was started
+    bool FinishAsyncValidation(/*out*/ vector<double>& scores, /*out*/ int& epoch);
 
     bool LoadCheckPointInfo(const size_t epochNumber,
                             /*out*/ size_t& totalSamplesSeen,
                             /*out*/ double& learnRatePerSample,
                             std::list<Matrix<ElemType>>& smoothedGradients,
                             /*out*/ double& prevCriterion,
-                            /*out*/ size_t& minibatchSize);
+                            /*out*/ size_t& minibatchSize,
+                            /*out*/ MidEpochCheckpoint* midEpochCheckpoint = nullptr);
+    // reads only the MidEpochCheckpoint of the mid-epoch checkpoint of 'epoch'; false if there is none
+    bool LoadMidEpochCheckPoint(const int epoch, /*out*/ MidEpochCheckpoint& midEpochCheckpoint);
 
     wstring GetCheckPointFileNameForEpoch(const int epoch);
+    wstring GetMidEpochCheckPointFileName(const int epoch);
     wstring GetModelNameForEpoch(const int epoch, bool bLastModel = false);
 
     // return -1 if nothing exists
@@ -496,17 +785,80 @@ public:
 protected:
     wstring m_modelPath;
     bool m_keepCheckPointFiles;
+    bool m_asyncCheckpoint;            // write the per-epoch model and checkpoint on a background thread (see CheckpointWriter.h)
+    double m_checkpointMaxMBPerSecond; // with m_asyncCheckpoint: bandwidth limit of the writing; 0 = none
+    size_t m_numMBsPerCheckpoint;      // > 0: also checkpoint within the epoch, every this many minibatches (see MidEpochCheckpoint)
     // bool m_validateAfterModelReloading; // TODO: remove this. Why would one not validate a model?
 
     wstring m_trainCriterionNodeName;
     wstring m_evalCriterionNodeName;
 
+    std::wstring m_preComputeCacheKey;
+
     size_t m_prevChosenMinibatchSize;
     double m_lastFinishedEpochTrainLoss;
 
+    // current loss scale (see m_initialLossScale)
+    double m_lossScale;
+    size_t m_numMBsSinceLossScaleChange;
+
+    // number of model updates so far, for the bias correction of Adam and LAMB; kept in the checkpoints
+    size_t m_numOptimizerSteps;
+
+    // state of the learning-rate and minibatch-size search
+    bool m_searchingLocally;           // TrainOneEpoch() trains on this worker only (a candidate of a parallel search)
+    double m_searchEarlyExitCriterion; // TrainOneEpoch() stops once the criterion per sample exceeds this
+    std::unique_ptr<SearchSnapshot> m_searchSnapshot;
+
     IDistGradAggregator<ElemType>* m_distGradAgg;
     struct DistGradHeader* m_gradHeader;
 
+    // phase timing across epochs (see m_profilePhases); created by the first TrainOneEpoch()
+    shared_ptr<TrainingTimeline> m_trainingTimeline;
+
+    // with m_asyncCheckpoint, on the main worker; created by the first SaveCheckPointAsync()
+    shared_ptr<CheckpointWriter> m_checkpointWriter;
+
+    // with LocalDataParallelSGD; created by TrainOrAdaptModel()
+    shared_ptr<LocalDataParallelReplicas<ElemType>> m_localReplicas;
+
+    // with HogwildSGD; created by TrainOrAdaptModel()
+    shared_ptr<HogwildWorkers<ElemType>> m_hogwildWorkers;
+
+    // with m_offloadOptimizerState; created by TrainOrAdaptModel()
+    shared_ptr<OptimizerStateOffload<ElemType>> m_optimizerStateOffload;
+
+    // BMUF state of each learnable node, keyed by node name; identical on all workers, and saved in the checkpoint
+    struct BlockMomentumState
+    {
+        shared_ptr<Matrix<ElemType>> m_globalModel;   // the model after the last sync
+        shared_ptr<Matrix<ElemType>> m_blockMomentum; // the filtered model update of the last sync
+    };
+    std::map<std::wstring, BlockMomentumState> m_blockMomentumStates;
+
+    // with m_overlapModelAveraging, the model average that is in flight between two syncs (defined in SGD.cpp, to keep MPI out of here)
+    struct PendingModelAverage;
+    shared_ptr<PendingModelAverage> m_pendingModelAverage;
+
+    // with m_numModelSyncBits, the common model after the last sync and this worker's residuals (defined in SGD.cpp)
+    struct QuantizedModelAverage;
+    shared_ptr<QuantizedModelAverage> m_quantizedModelAverage;
+
+    // with m_asyncCV, on the main worker: the model copy and the evaluation in flight (defined in SGD.cpp)
+    struct PendingValidation;
+    shared_ptr<PendingValidation> m_pendingValidation;
+
+    // the checkpoint file of SaveCheckPointInfo(); 'progress', if given, is called after each matrix
+    static void WriteCheckPointInfo(const wstring& fileName, const size_t totalSamplesSeen,
+                                    const double learnRatePerSample,
+                                    const std::vector<const Matrix<ElemType>*>& smoothedGradients,
+                                    const double prevCriterion,
+                                    const size_t minibatchSize,
+                                    const std::map<std::wstring, BlockMomentumState>& blockMomentumStates,
+                                    const size_t numOptimizerSteps,
+                                    const MidEpochCheckpoint* midEpochCheckpoint,
+                                    const std::function<void(File&)>& progress);
+
 private:
     int SGDTrace(FILE* __restrict __stream, const char* __restrict __format, ...);
 };
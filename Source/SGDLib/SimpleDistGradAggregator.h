@@ -5,6 +5,10 @@
 #include <future>
 #include "GPUDataTransferer.h"
 #include "TimerUtility.h"
+#include <map>
+#include <string>
+#include <climits>
+#include <cmath>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -14,13 +18,30 @@ class SimpleDistGradAggregator : public IDistGradAggregator<ElemType>
     UsingIDistGradAggregatorMembers;
 
 public:
-    SimpleDistGradAggregator(MPIWrapper* mpi, bool useAsyncAggregation, int syncStatsTrace)
-        : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_currentEpochNumber(-1), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0)
+    // A 'bucketSizeInBytes' > 0 enables overlapping the aggregation with backprop, in buckets of about that size (see StartOverlappedAggregation()).
+    // With 'allowGPUDirect', GPU gradients are handed to MPI directly if it is CUDA-aware, instead of being staged through pinned host buffers.
+    // 'compression' selects a sparsifying compression of dense gradients (see AggregateCompressedGradients()), which is done on the host.
+    SimpleDistGradAggregator(MPIWrapper* mpi, bool useAsyncAggregation, int syncStatsTrace, AllReduceAlgorithm allReduceAlgorithm = AllReduceAlgorithm::Auto, size_t bucketSizeInBytes = 0, bool allowGPUDirect = true,
+                             GradientCompression compression = GradientCompression::None, double compressionRatio = 0.01, double compressionThreshold = 3.0)
+        : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_currentEpochNumber(-1), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0),
+          m_localComm(MPI_COMM_NULL), m_crossComm(MPI_COMM_NULL), m_bucketSizeInBytes(bucketSizeInBytes), m_overlapInProgress(false), m_numBucketsStarted(0),
+          m_hasSparseGradients(false), m_allowGPUDirect(allowGPUDirect && (compression == GradientCompression::None)), m_useGPUDirect(false), m_allReduceAlgorithmRequested(allReduceAlgorithm),
+          m_compression(compression), m_compressionRatio(compressionRatio), m_compressionThreshold(compressionThreshold)
     {
+        InitializeAllReduce(allReduceAlgorithm);
     }
 
     ~SimpleDistGradAggregator()
     {
+        // the bucket aggregations refer to our buffers
+        if (m_lastBucketAggregation.valid())
+            m_lastBucketAggregation.wait();
+
+        if (m_localComm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_localComm);
+        if (m_crossComm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_crossComm);
+
         for (size_t i = 0; i < m_recvHeaders.size(); ++i)
         {
             DistGradHeader::Destroy(m_recvHeaders[i]);
@@ -35,6 +56,9 @@ public:
     // Aggregate the gradient matrices across all nodes
     bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int epochNumber) override
     {
+        if (m_overlapInProgress)
+            return CompleteOverlappedAggregation(gradients, headerCPU);
+
         bool isNewEpoch = ResetCurrentEpoch(gradients, headerCPU->numEvalNode, epochNumber);
         bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
         m_iterationCount++;
@@ -102,8 +126,12 @@ public:
                                                            Matrix<ElemType>::SetDevice(deviceId);
 
                                                            // Synchronize the Quantization compute stream with the completion of
-                                                           // compute of the gradient matrices on the main compute stream
-                                                           mainStreamSyncEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
+                                                           // compute of the gradient matrices on the main compute stream.
+                                                           // MPI reads device memory directly with GPUDirect, so then we wait for it on the host instead.
+                                                           if (m_useGPUDirect)
+                                                               mainStreamSyncEvent->SynchronizeEvent();
+                                                           else
+                                                               mainStreamSyncEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
                                                            delete mainStreamSyncEvent;
 
                                                            AggregateGradientsImpl(newGradients, newGradHeader, showSyncPerfStats);
@@ -121,7 +149,358 @@ public:
         }
     }
 
+    // With buffered async aggregation, the whole aggregation already runs in parallel to the next minibatch.
+    // Compressed gradients are exchanged together, once backprop is done, as the workers first vote on their encoding.
+    bool SupportsOverlappedAggregation() const override
+    {
+        return m_bucketSizeInBytes > 0 && !m_useAsyncAggregation && (m_compression == GradientCompression::None);
+    }
+
+    // The gradients are grouped into buckets of about m_bucketSizeInBytes, in the order in which backprop finalizes them.
+    // The buckets are formed once, from the matrix sizes, so that all workers issue the same all-reduces even if some of them
+    // did not get any samples (and hence never report a gradient as ready).
+    void StartOverlappedAggregation(const std::vector<Matrix<ElemType>*>& gradients, const std::vector<size_t>& finalizationOrder, int numEvalNode, int epochNumber) override
+    {
+        if (!SupportsOverlappedAggregation())
+            LogicError("StartOverlappedAggregation: Overlapped aggregation is not enabled.");
+        if (m_overlapInProgress)
+            LogicError("StartOverlappedAggregation: The previous aggregation has not been completed.");
+        if (finalizationOrder.size() != gradients.size())
+            LogicError("StartOverlappedAggregation: The finalization order must list each gradient exactly once.");
+
+        ResetCurrentEpoch(gradients, numEvalNode, epochNumber);
+
+        // Sparse gradients are not put into buckets; they are exchanged once backprop is done (see CompleteOverlappedAggregation()).
+        if (m_bucketOfGradient.empty())
+        {
+            m_bucketOfGradient.assign(gradients.size(), SIZE_MAX);
+            std::vector<bool> listed(gradients.size(), false);
+            size_t bucketSize = 0;
+            for (size_t i : finalizationOrder)
+            {
+                if (i >= gradients.size() || listed[i])
+                    LogicError("StartOverlappedAggregation: The finalization order must list each gradient exactly once.");
+                listed[i] = true;
+                if (m_isSparseGradient[i])
+                    continue;
+
+                if (m_buckets.empty() || bucketSize >= m_bucketSizeInBytes)
+                {
+                    m_buckets.push_back(std::vector<size_t>());
+                    bucketSize = 0;
+                }
+
+                m_buckets.back().push_back(i);
+                m_bucketOfGradient[i] = m_buckets.size() - 1;
+                bucketSize += gradients[i]->GetNumElements() * sizeof(ElemType);
+            }
+
+            if (m_mpi->IsMainNode())
+                fprintf(stderr, "SimpleDistGradAggregator: Overlapping gradient aggregation with backprop, %d gradients in %d buckets.\n", (int) gradients.size(), (int) m_buckets.size());
+        }
+
+        m_overlappedGradients = gradients;
+        m_numPendingInBucket.resize(m_buckets.size());
+        for (size_t b = 0; b < m_buckets.size(); b++)
+            m_numPendingInBucket[b] = m_buckets[b].size();
+        m_numBucketsStarted = 0;
+        m_overlapInProgress = true;
+    }
+
+    // Called from backprop once gradient 'gradientIndex' is final. Buckets are started strictly in order, so that all workers
+    // issue the same sequence of all-reduces.
+    void GradientReady(size_t gradientIndex) override
+    {
+        if (!m_overlapInProgress)
+            LogicError("GradientReady: Called without prior call to StartOverlappedAggregation().");
+
+        if (m_bucketOfGradient[gradientIndex] == SIZE_MAX) // sparse
+            return;
+
+        m_numPendingInBucket[m_bucketOfGradient[gradientIndex]]--;
+        while ((m_numBucketsStarted < m_buckets.size()) && (m_numPendingInBucket[m_numBucketsStarted] == 0))
+            StartBucketAggregation(m_numBucketsStarted++);
+    }
+
 private:
+    // Copies the gradients of a bucket to the CPU and starts their aggregation on a separate thread.
+    // The copies are issued from the calling thread right away, which orders them after the computation of the gradients.
+    // With GPUDirect, we instead record an event on the compute stream that the thread waits for before handing the gradients to MPI.
+    // Each bucket's thread first waits for its predecessor, which keeps the MPI calls serialized (we run with MPI_THREAD_SERIALIZED).
+    void StartBucketAggregation(size_t bucket)
+    {
+        int deviceId = m_overlappedGradients[0]->GetDeviceId();
+        if (StageThroughHost(deviceId))
+        {
+            for (size_t i : m_buckets[bucket])
+                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(m_overlappedGradients[i]->BufferPointer(), m_overlappedGradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+        }
+
+        std::shared_ptr<MatrixComputeStreamEvent> gradientsComputedEvent;
+        if (m_useGPUDirect)
+            gradientsComputedEvent.reset(MatrixComputeStreamEvent::Create(deviceId));
+
+        std::shared_future<void> previousBucketAggregation = m_lastBucketAggregation;
+        m_lastBucketAggregation = std::async(std::launch::async, [this, bucket, deviceId, previousBucketAggregation, gradientsComputedEvent]
+                                             {
+                                                 if (previousBucketAggregation.valid())
+                                                     previousBucketAggregation.get(); // (rethrows failures of earlier buckets)
+
+                                                 if (deviceId >= 0)
+                                                     Matrix<ElemType>::SetDevice(deviceId);
+
+                                                 if (gradientsComputedEvent)
+                                                     gradientsComputedEvent->SynchronizeEvent();
+
+                                                 AggregateBucket(m_buckets[bucket], deviceId);
+                                             }).share();
+    }
+
+    void AggregateBucket(const std::vector<size_t>& bucket, int deviceId)
+    {
+        size_t numGradMatrices = m_overlappedGradients.size();
+        std::vector<MPI_Request> allReduceRequests;
+        for (size_t i : bucket)
+        {
+            ElemType* reductionBuffer = m_overlappedGradients[i]->BufferPointer();
+            if (StageThroughHost(deviceId))
+            {
+                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                reductionBuffer = m_intermediateCPUBuffers[i].get();
+            }
+
+            allReduceRequests.push_back(AllReduceGradient(reductionBuffer, m_overlappedGradients[i]->GetNumElements(), i, numGradMatrices));
+        }
+
+        MPI_Waitall(allReduceRequests.size(), allReduceRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+        if (StageThroughHost(deviceId))
+        {
+            for (size_t i : bucket)
+                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), m_overlappedGradients[i]->GetNumElements(), m_overlappedGradients[i]->BufferPointer());
+        }
+    }
+
+    // Starts the buckets that backprop did not complete (e.g. because this worker had no samples), waits for all of them,
+    // and aggregates the headers.
+    bool CompleteOverlappedAggregation(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU)
+    {
+        if (gradients != m_overlappedGradients)
+            LogicError("AggregateGradients: The gradients differ from the ones passed to StartOverlappedAggregation().");
+
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+            aggregationTimer.Start();
+
+        if (headerCPU->numSamples == 0)
+        {
+            // If the current node did not process any samples, the gradients should be zero'd. Without samples there was no backprop,
+            // so none of the buckets has been started yet.
+            assert(m_numBucketsStarted == 0);
+            for (size_t i = 0; i < gradients.size(); ++i)
+            {
+                if (!m_isSparseGradient[i])
+                    gradients[i]->SetValue(0);
+            }
+        }
+
+        while (m_numBucketsStarted < m_buckets.size())
+            StartBucketAggregation(m_numBucketsStarted++);
+
+        m_overlapInProgress = false;
+        std::shared_future<void> lastBucketAggregation = std::move(m_lastBucketAggregation);
+        m_lastBucketAggregation = std::shared_future<void>();
+        lastBucketAggregation.get();
+
+        if (m_hasSparseGradients)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(gradients[0]->GetDeviceId()));
+            mainStreamSyncEvent->SynchronizeEvent();
+            for (size_t i = 0; i < gradients.size(); ++i)
+            {
+                if (m_isSparseGradient[i])
+                    AggregateSparseGradient(*gradients[i], headerCPU->numSamples != 0);
+            }
+        }
+
+        ExchangeHeaders(headerCPU, gradients.size());
+
+        if (StageThroughHost(gradients[0]->GetDeviceId()))
+        {
+            for (size_t i = 0; i < gradients.size(); ++i)
+            {
+                if (!m_isSparseGradient[i])
+                    m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+            }
+        }
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            double epochTime = aggregationTimer.ElapsedSeconds();
+            fprintf(stderr, "Gradient aggregation wait time after backprop: %.6g\n", epochTime);
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+    static const char* AllReduceAlgorithmName(AllReduceAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case AllReduceAlgorithm::MPI:          return "MPI";
+        case AllReduceAlgorithm::Ring:         return "ring";
+        case AllReduceAlgorithm::Hierarchical: return "hierarchical";
+        default:                               return "auto";
+        }
+    }
+
+    // Detects which workers share a host (by processor name), and picks the all-reduce algorithm accordingly.
+    // For the hierarchical all-reduce we create a communicator for the workers of each host, and one for the workers
+    // with the same local rank across hosts. Hosts must run the same number of workers for that.
+    // Note: This is a collective call, all workers take the same decisions based on the gathered names.
+    void InitializeAllReduce(AllReduceAlgorithm requested)
+    {
+        m_allReduceAlgorithm = requested;
+        if (NumProc() <= 1)
+        {
+            m_allReduceAlgorithm = AllReduceAlgorithm::MPI;
+            return;
+        }
+
+        char name[MPI_MAX_PROCESSOR_NAME + 1] = {0};
+        int nameLength;
+        MPI_Get_processor_name(name, &nameLength) || MpiFail("MPI_Get_processor_name");
+        std::vector<char> allNames(NumProc() * (MPI_MAX_PROCESSOR_NAME + 1));
+        MPI_Allgather(name, MPI_MAX_PROCESSOR_NAME + 1, MPI_CHAR, allNames.data(), MPI_MAX_PROCESSOR_NAME + 1, MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+
+        std::map<std::string, std::vector<int>> hosts; // [host name] -> ranks on that host
+        for (size_t rank = 0; rank < NumProc(); rank++)
+            hosts[std::string(&allNames[rank * (MPI_MAX_PROCESSOR_NAME + 1)])].push_back((int) rank);
+
+        const auto myHost = hosts.find(name);
+        const int hostIndex = (int) std::distance(hosts.begin(), myHost);
+        const int localRank = (int) (std::find(myHost->second.begin(), myHost->second.end(), (int) MyRank()) - myHost->second.begin());
+        const size_t workersPerHost = myHost->second.size();
+        bool uniform = std::all_of(hosts.begin(), hosts.end(), [workersPerHost](const std::pair<const std::string, std::vector<int>>& host)
+                                   {
+                                       return host.second.size() == workersPerHost;
+                                   });
+        bool hierarchyHelps = hosts.size() > 1 && workersPerHost > 1;
+
+        if (m_allReduceAlgorithm == AllReduceAlgorithm::Auto)
+        {
+            if (uniform && hierarchyHelps)
+                m_allReduceAlgorithm = AllReduceAlgorithm::Hierarchical;
+            else
+                m_allReduceAlgorithm = NumProc() > 2 ? AllReduceAlgorithm::Ring : AllReduceAlgorithm::MPI;
+        }
+        else if (m_allReduceAlgorithm == AllReduceAlgorithm::Hierarchical && !uniform)
+        {
+            if (m_mpi->IsMainNode())
+                fprintf(stderr, "WARNING: Hierarchical all-reduce requires the same number of workers on every host, falling back to ring all-reduce.\n");
+            m_allReduceAlgorithm = AllReduceAlgorithm::Ring;
+        }
+
+        if (m_allReduceAlgorithm == AllReduceAlgorithm::Hierarchical)
+        {
+            MPI_Comm_split(m_mpi->Communicator(), hostIndex, localRank, &m_localComm) || MpiFail("MPI_Comm_split");
+            MPI_Comm_split(m_mpi->Communicator(), localRank, hostIndex, &m_crossComm) || MpiFail("MPI_Comm_split");
+        }
+
+        if (m_mpi->IsMainNode())
+            fprintf(stderr, "SimpleDistGradAggregator: %d workers on %d hosts, using %s all-reduce.\n", (int) NumProc(), (int) hosts.size(), AllReduceAlgorithmName(m_allReduceAlgorithm));
+    }
+
+    // start of the i-th of n segments of a buffer of 'count' elements
+    static size_t SegmentBegin(size_t count, size_t n, size_t i)
+    {
+        return count * i / n;
+    }
+
+    // Ring reduce-scatter: in size - 1 steps, every worker passes one segment to its right neighbor and adds the one
+    // coming from its left neighbor. Afterwards, segment (rank + 1) % size holds the sum over all workers of 'comm'.
+    void RingReduceScatter(ElemType* data, size_t count, MPI_Comm comm, int tag)
+    {
+        int rank, size;
+        MPI_Comm_rank(comm, &rank) || MpiFail("MPI_Comm_rank");
+        MPI_Comm_size(comm, &size) || MpiFail("MPI_Comm_size");
+        if (size == 1)
+            return;
+
+        const int right = (rank + 1) % size;
+        const int left = (rank + size - 1) % size;
+        m_ringBuffer.resize(count / size + 1);
+        for (int step = 0; step < size - 1; step++)
+        {
+            size_t sendSegment = (rank + size - step) % size;
+            size_t recvSegment = (rank + size - step - 1) % size;
+            size_t sendBegin = SegmentBegin(count, size, sendSegment);
+            size_t recvBegin = SegmentBegin(count, size, recvSegment);
+            size_t sendCount = SegmentBegin(count, size, sendSegment + 1) - sendBegin;
+            size_t recvCount = SegmentBegin(count, size, recvSegment + 1) - recvBegin;
+            MPI_Sendrecv(data + sendBegin, (int) sendCount, MPIWrapper::GetDataType(data), right, tag,
+                         m_ringBuffer.data(), (int) recvCount, MPIWrapper::GetDataType(data), left, tag,
+                         comm, MPI_STATUS_IGNORE) || MpiFail("MPI_Sendrecv");
+
+            ElemType* target = data + recvBegin;
+            for (size_t k = 0; k < recvCount; k++)
+                target[k] += m_ringBuffer[k];
+        }
+    }
+
+    // Ring all-gather: the counterpart of RingReduceScatter(), which circulates the reduced segments until every worker has all of them.
+    void RingAllGather(ElemType* data, size_t count, MPI_Comm comm, int tag)
+    {
+        int rank, size;
+        MPI_Comm_rank(comm, &rank) || MpiFail("MPI_Comm_rank");
+        MPI_Comm_size(comm, &size) || MpiFail("MPI_Comm_size");
+        if (size == 1)
+            return;
+
+        const int right = (rank + 1) % size;
+        const int left = (rank + size - 1) % size;
+        for (int step = 0; step < size - 1; step++)
+        {
+            size_t sendSegment = (rank + size - step + 1) % size;
+            size_t recvSegment = (rank + size - step) % size;
+            size_t sendBegin = SegmentBegin(count, size, sendSegment);
+            size_t recvBegin = SegmentBegin(count, size, recvSegment);
+            size_t sendCount = SegmentBegin(count, size, sendSegment + 1) - sendBegin;
+            size_t recvCount = SegmentBegin(count, size, recvSegment + 1) - recvBegin;
+            MPI_Sendrecv(data + sendBegin, (int) sendCount, MPIWrapper::GetDataType(data), right, tag,
+                         data + recvBegin, (int) recvCount, MPIWrapper::GetDataType(data), left, tag,
+                         comm, MPI_STATUS_IGNORE) || MpiFail("MPI_Sendrecv");
+        }
+    }
+
+    // In-place sum of 'data' over all workers. Each worker sends and receives 2 * (size - 1) / size of the buffer,
+    // independent of the number of workers.
+    void RingAllReduce(ElemType* data, size_t count, MPI_Comm comm, int tag)
+    {
+        RingReduceScatter(data, count, comm, tag);
+        RingAllGather(data, count, comm, tag);
+    }
+
+    // Reduce-scatter within the host, ring all-reduce of the segment this worker owns across hosts, all-gather within the host.
+    // Only 1 / workersPerHost of the buffer crosses the host boundary per worker, and all workers of a host use the network in parallel.
+    void HierarchicalAllReduce(ElemType* data, size_t count, int tag)
+    {
+        int localRank, localSize;
+        MPI_Comm_rank(m_localComm, &localRank) || MpiFail("MPI_Comm_rank");
+        MPI_Comm_size(m_localComm, &localSize) || MpiFail("MPI_Comm_size");
+
+        RingReduceScatter(data, count, m_localComm, tag);
+
+        size_t ownedSegment = (localRank + 1) % localSize;
+        size_t begin = SegmentBegin(count, localSize, ownedSegment);
+        size_t end = SegmentBegin(count, localSize, ownedSegment + 1);
+        RingAllReduce(data + begin, end - begin, m_crossComm, tag);
+
+        RingAllGather(data, count, m_localComm, tag);
+    }
+
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements)
     {
         assert(deviceID >= 0);
@@ -142,21 +521,22 @@ private:
         if (m_currentEpochNumber == -1)
         {
             int deviceId = gradients[0]->GetDeviceId();
-            if (deviceId != CPUDEVICE)
+            InitializeGPUDirect(deviceId);
+            if (StageThroughHost(deviceId))
             {
                 m_allocator.reset(new CUDAPageLockedMemAllocator(deviceId));
             }
 
+            InitializeSparseGradients(gradients);
+            InitializeCompressedGradients(gradients);
             for (size_t i = 0; i < gradients.size(); i++)
             {
-                // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
-                if (gradients[i]->GetMatrixType() != DENSE)
-                    RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
-
-                if (deviceId != CPUDEVICE)
+                // Sparse gradients are exchanged by AggregateSparseGradient(), and need neither transferers nor intermediate buffers.
+                // We still add (empty) entries for them, to keep these indexed by gradient.
+                if (StageThroughHost(deviceId))
                 {
-                    m_gpuDataTransferers.push_back(std::unique_ptr<GPUDataTransferer<ElemType>>(new GPUDataTransferer<ElemType>(deviceId, m_useAsyncAggregation)));
-                    m_intermediateCPUBuffers.push_back(AllocateIntermediateBuffer(deviceId, gradients[i]->GetNumElements()));
+                    m_gpuDataTransferers.push_back(m_isSparseGradient[i] ? nullptr : std::unique_ptr<GPUDataTransferer<ElemType>>(new GPUDataTransferer<ElemType>(deviceId, m_useAsyncAggregation)));
+                    m_intermediateCPUBuffers.push_back(m_isSparseGradient[i] ? nullptr : AllocateIntermediateBuffer(deviceId, gradients[i]->GetNumElements()));
                 }
 
                 if (m_useAsyncAggregation)
@@ -205,49 +585,292 @@ private:
         return isNewEpoch;
     }
 
-    void AggregateGradientsImpl(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool showSyncPerfStats)
+    // Only gradients in sparse block-column format (those of embeddings applied to sparse inputs, see TimesNode) can be aggregated
+    // in sparse form. A worker that did not get any samples in the first minibatch did not run backprop, so its gradients may
+    // still be dense; hence the workers vote, which keeps their exchanges in step.
+    void InitializeSparseGradients(const std::vector<Matrix<ElemType>*>& gradients)
     {
-        Timer aggregationTimer;
-        int deviceId = gradients[0]->GetDeviceId();
-        if (showSyncPerfStats)
+        std::vector<int> isSparse(gradients.size());
+        for (size_t i = 0; i < gradients.size(); i++)
         {
-            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
-            mainStreamSyncEvent->SynchronizeEvent();
-            aggregationTimer.Start();
+            if (gradients[i]->GetMatrixType() != DENSE)
+            {
+                if (gradients[i]->GetFormat() != matrixFormatSparseBlockCol)
+                    RuntimeError("Gradient aggregation for sparse gradient matrices is only supported for the sparse block-column format!");
+                isSparse[i] = 1;
+            }
         }
 
-        size_t numGradMatrices = gradients.size();
+        if (!isSparse.empty())
+            MPI_Allreduce(MPI_IN_PLACE, isSparse.data(), (int) isSparse.size(), MPI_INT, MPI_MAX, m_mpi->Communicator()) || MpiFail("MPI_Allreduce");
 
-        if (headerCPU->numSamples == 0)
+        m_isSparseGradient.assign(isSparse.begin(), isSparse.end());
+        m_hasSparseGradients = std::find(m_isSparseGradient.begin(), m_isSparseGradient.end(), true) != m_isSparseGradient.end();
+        if (m_hasSparseGradients && m_useAsyncAggregation)
+            RuntimeError("Gradient aggregation for sparse gradient matrices is not supported with buffered async gradient aggregation!");
+
+        if (m_hasSparseGradients && m_mpi->IsMainNode())
+            fprintf(stderr, "SimpleDistGradAggregator: Aggregating %d of %d gradients in sparse form.\n",
+                    (int) std::count(m_isSparseGradient.begin(), m_isSparseGradient.end(), true), (int) m_isSparseGradient.size());
+    }
+
+    // All dense gradients are compressed (their size permitting index/value pairs with 32-bit indices).
+    void InitializeCompressedGradients(const std::vector<Matrix<ElemType>*>& gradients)
+    {
+        m_isCompressedGradient.assign(gradients.size(), false);
+        m_residuals.resize(gradients.size());
+        if (m_compression == GradientCompression::None)
+            return;
+
+        for (size_t i = 0; i < gradients.size(); i++)
+            m_isCompressedGradient[i] = !m_isSparseGradient[i] && (gradients[i]->GetNumElements() <= UINT_MAX);
+
+        if (m_mpi->IsMainNode())
         {
-            assert(headerCPU->criterion == 0);
-            for (int i = 0; i < headerCPU->numEvalNode; ++i)
+            if (m_compression == GradientCompression::TopK)
+                fprintf(stderr, "SimpleDistGradAggregator: Compressing %d of %d gradients to their top %.3g%% elements, with error feedback.\n",
+                        (int) std::count(m_isCompressedGradient.begin(), m_isCompressedGradient.end(), true), (int) gradients.size(), 100 * m_compressionRatio);
+            else
+                fprintf(stderr, "SimpleDistGradAggregator: Compressing %d of %d gradients to their elements above %.3g times their RMS, with error feedback.\n",
+                        (int) std::count(m_isCompressedGradient.begin(), m_isCompressedGradient.end(), true), (int) gradients.size(), m_compressionThreshold);
+        }
+    }
+
+    // the magnitude from which on an element of 'values' is sent
+    ElemType CompressionThreshold(const std::vector<ElemType>& values)
+    {
+        size_t n = values.size();
+        if (m_compression == GradientCompression::TopK)
+        {
+            size_t k = std::max((size_t) 1, (size_t) std::ceil(m_compressionRatio * n));
+            if (k >= n)
+                return 0;
+            m_magnitudes.resize(n);
+            for (size_t j = 0; j < n; j++)
+                m_magnitudes[j] = std::abs(values[j]);
+            std::nth_element(m_magnitudes.begin(), m_magnitudes.begin() + (n - k), m_magnitudes.end());
+            return m_magnitudes[n - k];
+        }
+        else
+        {
+            double sumOfSquares = 0;
+            for (size_t j = 0; j < n; j++)
+                sumOfSquares += (double) values[j] * values[j];
+            return (ElemType) (m_compressionThreshold * std::sqrt(sumOfSquares / std::max(n, (size_t) 1)));
+        }
+    }
+
+    // Sparsifying gradient compression with error feedback. Each worker adds its residual (what it left out before) to the gradient,
+    // sends the elements above CompressionThreshold() as index/value pairs, and keeps the others as the new residual. The pairs of all
+    // workers are gathered and summed up in rank order, so all workers end up with the same gradient.
+    // The encoding is decided per gradient from the number of selected elements, which the workers exchange first: when the pairs of all
+    // workers would be more traffic than a dense all-reduce (small or dense layers), the gradient including its residual is all-reduced densely.
+    // 'hostBuffers[i]' holds compressed gradient i on the host; dense all-reduces are started into 'allReduceRequests'.
+    void AggregateCompressedGradients(const std::vector<Matrix<ElemType>*>& gradients, const std::vector<ElemType*>& hostBuffers, std::vector<MPI_Request>& allReduceRequests, bool showSyncPerfStats)
+    {
+        std::vector<size_t> compressed;
+        for (size_t i = 0; i < gradients.size(); i++)
+        {
+            if (m_isCompressedGradient[i])
+                compressed.push_back(i);
+        }
+        if (compressed.empty())
+            return;
+
+        // gradient + residual -> residual, and select the elements to send
+        std::vector<std::vector<unsigned int>> selected(compressed.size());
+        std::vector<int> numSelected(compressed.size());
+        for (size_t c = 0; c < compressed.size(); c++)
+        {
+            size_t i = compressed[c];
+            const ElemType* data = hostBuffers[i];
+            size_t n = gradients[i]->GetNumElements();
+            std::vector<ElemType>& residual = m_residuals[i];
+            if (residual.size() != n)
+                residual.assign(n, 0);
+            for (size_t j = 0; j < n; j++)
+                residual[j] += data[j];
+
+            ElemType threshold = CompressionThreshold(residual);
+            for (size_t j = 0; j < n; j++)
             {
-                assert(headerCPU->evalErrors[i] == 0);
+                if ((residual[j] != 0) && (std::abs(residual[j]) >= threshold))
+                    selected[c].push_back((unsigned int) j);
             }
+            numSelected[c] = (int) std::min(selected[c].size(), (size_t) INT_MAX);
+        }
 
-            // If the current node did not process any samples, the gradients should be zero'd
-            for (size_t i = 0; i < numGradMatrices; ++i)
+        std::vector<int> numSelectedOfRank(NumProc() * compressed.size());
+        MPI_Allgather(numSelected.data(), (int) compressed.size(), MPI_INT, numSelectedOfRank.data(), (int) compressed.size(), MPI_INT, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+
+        size_t numElements = 0, numElementsSent = 0;
+        for (size_t c = 0; c < compressed.size(); c++)
+        {
+            size_t i = compressed[c];
+            ElemType* data = hostBuffers[i];
+            size_t n = gradients[i]->GetNumElements();
+            std::vector<ElemType>& residual = m_residuals[i];
+
+            std::vector<int> counts(NumProc()), offsets(NumProc());
+            size_t total = 0;
+            for (size_t rank = 0; rank < NumProc(); rank++)
             {
-                gradients[i]->SetValue(0);
+                counts[rank] = numSelectedOfRank[rank * compressed.size() + c];
+                offsets[rank] = (int) std::min(total, (size_t) INT_MAX);
+                total += counts[rank];
             }
 
-            if (m_useAsyncAggregation)
+            numElements += n;
+            if ((total * (sizeof(unsigned int) + sizeof(ElemType)) >= 2 * n * sizeof(ElemType)) || (total > INT_MAX))
             {
-                std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
-                mainStreamSyncEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
+                // dense: all of the residual goes out
+                std::copy(residual.begin(), residual.end(), data);
+                std::fill(residual.begin(), residual.end(), (ElemType) 0);
+                allReduceRequests[i] = AllReduceGradient(data, n, i, gradients.size());
+                numElementsSent += n;
+                continue;
             }
-        }
 
-        // Initiate transfer of the gradient matrices to the CPU if needed
-        if (deviceId >= 0)
-        {
-            for (size_t i = 0; i < numGradMatrices; ++i)
+            std::vector<ElemType> values(selected[c].size());
+            for (size_t k = 0; k < selected[c].size(); k++)
             {
-                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->BufferPointer(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+                values[k] = residual[selected[c][k]];
+                residual[selected[c][k]] = 0;
             }
+
+            std::vector<unsigned int> allIndices(total);
+            std::vector<ElemType> allValues(total);
+            MPI_Allgatherv(selected[c].data(), numSelected[c], MPI_UNSIGNED, allIndices.data(), counts.data(), offsets.data(), MPI_UNSIGNED, m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+            MPI_Allgatherv(values.data(), numSelected[c], MPIWrapper::GetDataType(data), allValues.data(), counts.data(), offsets.data(), MPIWrapper::GetDataType(data), m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+
+            std::fill(data, data + n, (ElemType) 0);
+            for (size_t k = 0; k < total; k++)
+                data[allIndices[k]] += allValues[k];
+            numElementsSent += selected[c].size();
+        }
+
+        if (showSyncPerfStats)
+            fprintf(stderr, "Gradient compression: Sent %.3g%% of the elements of the compressed gradients.\n", 100.0 * numElementsSent / std::max(numElements, (size_t) 1));
+    }
+
+    // A sparse block-column gradient only holds the columns that the minibatch touched. Instead of densifying it, each worker contributes
+    // its columns, the columns of all workers are gathered, and every worker sums them up by column id in rank order. This way all workers
+    // end up with the same gradient, holding the union of the touched columns, and the traffic is proportional to the number of touched
+    // columns rather than to the size of the embedding.
+    void AggregateSparseGradient(Matrix<ElemType>& gradient, bool hasSamples)
+    {
+        std::vector<size_t> columnIds;
+        std::vector<ElemType> columnValues;
+        if (hasSamples)
+            gradient.GetSparseBlockColumns(columnIds, columnValues);
+        else if (gradient.GetMatrixType() == DENSE)
+            gradient.SwitchToMatrixType(SPARSE, matrixFormatSparseBlockCol, false);
+
+        const size_t numRows = gradient.GetNumRows();
+        int numColumns = (int) columnIds.size();
+        std::vector<int> numColumnsOfRank(NumProc());
+        MPI_Allgather(&numColumns, 1, MPI_INT, numColumnsOfRank.data(), 1, MPI_INT, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+
+        std::vector<int> columnOffsets(NumProc()), numValuesOfRank(NumProc()), valueOffsets(NumProc());
+        size_t totalColumns = 0;
+        for (size_t rank = 0; rank < NumProc(); rank++)
+        {
+            if ((totalColumns + numColumnsOfRank[rank]) * numRows > INT_MAX)
+                RuntimeError("AggregateSparseGradient: Too many columns (%d of %d rows) for a single exchange.", (int) (totalColumns + numColumnsOfRank[rank]), (int) numRows);
+            columnOffsets[rank] = (int) totalColumns;
+            valueOffsets[rank] = (int) (totalColumns * numRows);
+            numValuesOfRank[rank] = (int) (numColumnsOfRank[rank] * numRows);
+            totalColumns += numColumnsOfRank[rank];
+        }
+
+        std::vector<unsigned long long> myIds(columnIds.begin(), columnIds.end());
+        std::vector<unsigned long long> allIds(totalColumns);
+        std::vector<ElemType> allValues(totalColumns * numRows);
+        MPI_Allgatherv(myIds.data(), numColumns, MPI_UNSIGNED_LONG_LONG, allIds.data(), numColumnsOfRank.data(), columnOffsets.data(), MPI_UNSIGNED_LONG_LONG, m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+        MPI_Allgatherv(columnValues.data(), (int) columnValues.size(), MPIWrapper::GetDataType(allValues.data()), allValues.data(), numValuesOfRank.data(), valueOffsets.data(), MPIWrapper::GetDataType(allValues.data()), m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+
+        // the union of the columns, in ascending order
+        std::map<size_t, size_t> blockOfColumn;
+        for (size_t k = 0; k < totalColumns; k++)
+            blockOfColumn[(size_t) allIds[k]] = 0;
+        columnIds.clear();
+        for (auto& column : blockOfColumn)
+        {
+            column.second = columnIds.size();
+            columnIds.push_back(column.first);
+        }
+
+        columnValues.assign(columnIds.size() * numRows, 0);
+        for (size_t k = 0; k < totalColumns; k++)
+        {
+            ElemType* target = columnValues.data() + blockOfColumn[(size_t) allIds[k]] * numRows;
+            const ElemType* source = allValues.data() + k * numRows;
+            for (size_t r = 0; r < numRows; r++)
+                target[r] += source[r];
+        }
+
+        gradient.SetSparseBlockColumns(numRows, gradient.GetNumCols(), columnIds, columnValues);
+    }
+
+    // GPUDirect: a CUDA-aware MPI reads and writes the gradients in device memory, saving the two PCIe copies through the pinned
+    // host buffers. The ring based algorithms add up segments on the host, so GPUDirect implies MPI_Iallreduce; if the algorithm
+    // was picked automatically, we switch to that. Since this may change the algorithm, all workers must agree, hence the vote.
+    void InitializeGPUDirect(int deviceId)
+    {
+        m_useGPUDirect = false;
+        if (NumProc() <= 1)
+            return;
+
+        int canUseGPUDirect = (m_allowGPUDirect && (deviceId != CPUDEVICE) && MPIWrapper::IsCudaAware()) ? 1 : 0;
+        MPI_Allreduce(MPI_IN_PLACE, &canUseGPUDirect, 1, MPI_INT, MPI_MIN, m_mpi->Communicator()) || MpiFail("MPI_Allreduce");
+        if (!canUseGPUDirect)
+            return;
+
+        if (m_allReduceAlgorithm != AllReduceAlgorithm::MPI && m_allReduceAlgorithmRequested != AllReduceAlgorithm::Auto)
+        {
+            if (m_mpi->IsMainNode())
+                fprintf(stderr, "SimpleDistGradAggregator: MPI is CUDA-aware, but GPUDirect is not used with the explicitly requested %s all-reduce.\n", AllReduceAlgorithmName(m_allReduceAlgorithm));
+            return;
         }
 
+        m_allReduceAlgorithm = AllReduceAlgorithm::MPI;
+        m_useGPUDirect = true;
+        if (m_mpi->IsMainNode())
+            fprintf(stderr, "SimpleDistGradAggregator: MPI is CUDA-aware, aggregating the gradients directly in GPU memory.\n");
+    }
+
+    // whether gradients on the GPU take the detour through the pinned host buffers
+    bool StageThroughHost(int deviceId) const
+    {
+        return (deviceId >= 0) && !m_useGPUDirect;
+    }
+
+    // Starts summing up gradient 'i' (held in 'buffer') across all workers. MPI_Iallreduce returns a request to wait for, while the
+    // ring based algorithms are blocking and return MPI_REQUEST_NULL; they use the tags between the ones of the two header messages.
+    MPI_Request AllReduceGradient(ElemType* buffer, size_t numElements, size_t i, size_t numGradMatrices)
+    {
+        MPI_Request request = MPI_REQUEST_NULL;
+        int tag = (int) (numGradMatrices + 1 + i);
+        if (m_allReduceAlgorithm == AllReduceAlgorithm::Ring)
+        {
+            RingAllReduce(buffer, numElements, m_mpi->Communicator(), tag);
+        }
+        else if (m_allReduceAlgorithm == AllReduceAlgorithm::Hierarchical)
+        {
+            HierarchicalAllReduce(buffer, numElements, tag);
+        }
+        else
+        {
+            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
+            request = m_mpi->AllReduceAsync(buffer, numElements, m_mpi->Communicator());
+        }
+
+        return request;
+    }
+
+    // The main node collects the headers of all nodes, aggregates them and sends the aggregate back.
+    void ExchangeHeaders(DistGradHeader* headerCPU, size_t numGradMatrices)
+    {
         // Initiate receive of the header on the main node
         std::vector<MPI_Request> recvHeaderRequests(NumProc() - 1);
         if (m_mpi->IsMainNode())
@@ -267,21 +890,6 @@ private:
             MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices, m_mpi->Communicator(), &sendHeaderRequest) || MpiFail("MPI_Isend");
         }
 
-        // Perform MPI async allreduce on the gradient data
-        std::vector<MPI_Request> allReduceRequests(numGradMatrices);
-        for (size_t i = 0; i < numGradMatrices; ++i)
-        {
-            ElemType* reductionBuffer = gradients[i]->BufferPointer();
-            if (deviceId >= 0)
-            {
-                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
-                reductionBuffer = m_intermediateCPUBuffers[i].get();
-            }
-
-            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
-            MPI_Iallreduce(MPI_IN_PLACE, reductionBuffer, gradients[i]->GetNumElements(), MPIWrapper::GetDataType(reductionBuffer), MPI_SUM, m_mpi->Communicator(), &allReduceRequests[i]) || MpiFail("MPI_Iallreduce");
-        }
-
         // On the main node wait for the headers to arrive and aggregate
         if (m_mpi->IsMainNode())
         {
@@ -322,39 +930,149 @@ private:
             }
         }
 
-        // Wait for the allreduce operations to finish and initiate transfer back to the GPU if needed
-        for (size_t i = 0; i < numGradMatrices; ++i)
+        // Wait to receive aggregate header, and for completion of the async send requests
+        if (!m_mpi->IsMainNode())
+        {
+            MPI_Wait(&recvAggHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            MPI_Wait(&sendHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        }
+        else
+        {
+            MPI_Waitall(sendAggHeaderRequests.size(), sendAggHeaderRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+        }
+    }
+
+    void AggregateGradientsImpl(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool showSyncPerfStats)
+    {
+        Timer aggregationTimer;
+        int deviceId = gradients[0]->GetDeviceId();
+        if (showSyncPerfStats)
         {
-            MPI_Wait(&allReduceRequests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
-            if (deviceId >= 0)
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
+            aggregationTimer.Start();
+        }
+
+        size_t numGradMatrices = gradients.size();
+
+        // (the async aggregation runs on its own thread and overlaps with the next minibatch, so it is not split into phases)
+        TrainingTimeline* timeline = m_useAsyncAggregation ? nullptr : m_timeline;
+
+        if (headerCPU->numSamples == 0)
+        {
+            assert(headerCPU->criterion == 0);
+            for (int i = 0; i < headerCPU->numEvalNode; ++i)
+            {
+                assert(headerCPU->evalErrors[i] == 0);
+            }
+
+            // If the current node did not process any samples, the gradients should be zero'd (sparse ones just contribute no columns)
+            for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->BufferPointer());
+                if (!m_isSparseGradient[i])
+                    gradients[i]->SetValue(0);
+            }
+
+            if (m_useAsyncAggregation && !m_useGPUDirect)
+            {
+                std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+                mainStreamSyncEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
             }
         }
 
-        // Wait to receive aggregate header
-        if (!m_mpi->IsMainNode())
+        // With GPUDirect, MPI reads the gradients from device memory, so they must have been computed (or zero'd) by now.
+        // The same holds for sparse gradients, which we copy to the host outside of the compute stream.
+        // (With async aggregation, the caller has already waited for the computation.)
+        if ((m_useGPUDirect || m_hasSparseGradients) && (!m_useAsyncAggregation || (headerCPU->numSamples == 0)))
         {
-            MPI_Wait(&recvAggHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
         }
 
-        // Wait for all the transfers to finish
-        if (deviceId >= 0)
+        // The phases reported to the timeline overlap somewhat: the first all-reduces are started while later gradients
+        // are still being copied to the host, and the copies back start as soon as their all-reduce is done.
+        std::vector<MPI_Request> allReduceRequests(numGradMatrices, MPI_REQUEST_NULL);
         {
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::aggregationPackPhase);
+
+            // Initiate transfer of the gradient matrices to the CPU if needed
+            if (StageThroughHost(deviceId))
+            {
+                for (size_t i = 0; i < numGradMatrices; ++i)
+                {
+                    if (!m_isSparseGradient[i])
+                        m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->BufferPointer(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+                }
+            }
+
+            // Perform MPI async allreduce on the gradient data (compressed gradients follow once all are on the host)
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+                if (m_isSparseGradient[i] || m_isCompressedGradient[i])
+                    continue;
+
+                ElemType* reductionBuffer = gradients[i]->BufferPointer();
+                if (StageThroughHost(deviceId))
+                {
+                    m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                    reductionBuffer = m_intermediateCPUBuffers[i].get();
+                }
+
+                allReduceRequests[i] = AllReduceGradient(reductionBuffer, gradients[i]->GetNumElements(), i, numGradMatrices);
             }
         }
 
-        // Wait for completion of the async send requests
-        if (!m_mpi->IsMainNode())
         {
-            MPI_Wait(&sendHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::aggregationExchangePhase);
+
+            // While the allreduce operations are in flight, exchange the compressed and sparse gradients and aggregate the headers
+            if (m_compression != GradientCompression::None)
+            {
+                std::vector<ElemType*> hostBuffers(numGradMatrices, nullptr);
+                for (size_t i = 0; i < numGradMatrices; ++i)
+                {
+                    if (!m_isCompressedGradient[i])
+                        continue;
+
+                    hostBuffers[i] = gradients[i]->BufferPointer();
+                    if (StageThroughHost(deviceId))
+                    {
+                        m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                        hostBuffers[i] = m_intermediateCPUBuffers[i].get();
+                    }
+                }
+
+                AggregateCompressedGradients(gradients, hostBuffers, allReduceRequests, showSyncPerfStats);
+            }
+
+            for (size_t i = 0; i < numGradMatrices; ++i)
+            {
+                if (m_isSparseGradient[i])
+                    AggregateSparseGradient(*gradients[i], headerCPU->numSamples != 0);
+            }
+
+            ExchangeHeaders(headerCPU, numGradMatrices);
+
+            // Wait for the allreduce operations to finish and initiate transfer back to the GPU if needed
+            for (size_t i = 0; i < numGradMatrices; ++i)
+            {
+                MPI_Wait(&allReduceRequests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+                if (StageThroughHost(deviceId) && !m_isSparseGradient[i])
+                {
+                    m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->BufferPointer());
+                }
+            }
         }
-        else
+
+        // Wait for all the transfers to finish
+        if (StageThroughHost(deviceId))
         {
-            MPI_Waitall(sendAggHeaderRequests.size(), sendAggHeaderRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+            TrainingTimeline::Scope timelineScope(timeline, TrainingTimeline::aggregationUnpackPhase);
+            for (size_t i = 0; i < numGradMatrices; ++i)
+            {
+                if (!m_isSparseGradient[i])
+                    m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+            }
         }
 
         if (showSyncPerfStats)
@@ -389,5 +1107,38 @@ private:
     size_t m_iterationCount;
 
     int m_currentEpochNumber;
+
+    // All-reduce algorithm and the communicators used by the hierarchical one
+    AllReduceAlgorithm m_allReduceAlgorithm;
+    MPI_Comm m_localComm; // workers on this host
+    MPI_Comm m_crossComm; // workers with the same local rank on all hosts
+    std::vector<ElemType> m_ringBuffer;
+
+    // Overlapping the aggregation with backprop
+    size_t m_bucketSizeInBytes;                       // 0 if disabled
+    std::vector<std::vector<size_t>> m_buckets;       // gradient indices of each bucket, in finalization order
+    std::vector<size_t> m_bucketOfGradient;           // [gradient index] -> bucket
+    std::vector<size_t> m_numPendingInBucket;         // [bucket] -> number of its gradients not yet reported ready
+    std::vector<Matrix<ElemType>*> m_overlappedGradients;
+    bool m_overlapInProgress;
+    size_t m_numBucketsStarted;
+    std::shared_future<void> m_lastBucketAggregation; // the aggregation of the last started bucket; each one waits for its predecessor
+
+    // Gradients aggregated in sparse form (see AggregateSparseGradient())
+    std::vector<bool> m_isSparseGradient; // [gradient index]
+    bool m_hasSparseGradients;
+
+    // Gradients compressed before they are exchanged (see AggregateCompressedGradients())
+    GradientCompression m_compression;
+    double m_compressionRatio;
+    double m_compressionThreshold;
+    std::vector<bool> m_isCompressedGradient;        // [gradient index]
+    std::vector<std::vector<ElemType>> m_residuals;  // [gradient index] -> what this worker has not sent yet (error feedback)
+    std::vector<ElemType> m_magnitudes;              // scratch space for the top-k selection
+
+    // GPUDirect (CUDA-aware MPI)
+    bool m_allowGPUDirect;
+    bool m_useGPUDirect;
+    AllReduceAlgorithm m_allReduceAlgorithmRequested;
 };
 } } }
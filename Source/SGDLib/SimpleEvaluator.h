@@ -20,12 +20,15 @@ using namespace std;
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // TODO: get rid of dependency on ElemType
+// With 'mpi', the evaluation is distributed: each worker evaluates its share of the data (a reader subset if the
+// reader supports distributed reading, otherwise its share of each minibatch), and the criteria are all-reduced,
+// so that every worker returns the result over the whole data. All workers must call Evaluate() together.
 template <class ElemType>
 class SimpleEvaluator
 {
 public:
-    SimpleEvaluator(ComputationNetworkPtr net, const size_t numMBsToShowResult = 100, const int traceLevel = 0)
-        : m_net(net), m_numMBsToShowResult(numMBsToShowResult), m_traceLevel(traceLevel)
+    SimpleEvaluator(ComputationNetworkPtr net, const size_t numMBsToShowResult = 100, const int traceLevel = 0, MPIWrapper* mpi = nullptr)
+        : m_net(net), m_numMBsToShowResult(numMBsToShowResult), m_traceLevel(traceLevel), m_mpi(mpi)
     {
     }
 
@@ -92,11 +95,22 @@ public:
         for (int i = 0; i < evalResults.size(); i++)
             evalResultsLastMBs.push_back((ElemType) 0);
 
-        dataReader->StartMinibatchLoop(mbSize, 0, testSize);
+        const bool useDistributedEvaluation = (m_mpi != nullptr) && (m_mpi->NumNodesInUse() > 1);
+        const bool useDistributedMBReading = useDistributedEvaluation && dataReader->SupportsDistributedMBRead();
+        if (useDistributedMBReading)
+            dataReader->StartDistributedMinibatchLoop(mbSize, 0, m_mpi->CurrentNodeRank(), m_mpi->NumNodesInUse(), testSize);
+        else
+            dataReader->StartMinibatchLoop(mbSize, 0, testSize);
         m_net->StartEvaluateMinibatchLoop(evalNodes);
 
-        while (DataReaderHelpers::GetMinibatchIntoNetwork(*dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize))
+        while (DataReaderHelpers::GetMinibatchIntoNetwork(*dataReader, m_net, nullptr, useDistributedMBReading, useDistributedEvaluation, inputMatrices, actualMBSize))
         {
+            if (actualMBSize == 0) // this worker got no share of this minibatch
+            {
+                dataReader->DataEnd();
+                continue;
+            }
+
             ComputationNetwork::BumpEvalTimeStamp(featureNodes);
             ComputationNetwork::BumpEvalTimeStamp(labelNodes);
 
@@ -104,11 +118,9 @@ public:
             // Later, when we apply different labels on different nodes
             // we need to add code to call this function multiple times, one for each criteria node
             size_t numSamplesWithLabel = m_net->GetNumSamplesWithLabel(actualMBSize);
+            m_net->ForwardProp(evalNodes);
             for (int i = 0; i < evalNodes.size(); i++)
-            {
-                m_net->ForwardProp(evalNodes[i]);
                 evalResults[i] += (double) evalNodes[i]->Get00Element(); // criterionNode should be a scalar
-            }
 
             totalEpochSamples += numSamplesWithLabel;
             numMBsRun++;
@@ -141,6 +153,17 @@ public:
             DisplayEvalStatistics(lastMBsRun + 1, numMBsRun, numSamplesLastMBs, evalNodes, evalResults, evalResultsLastMBs);
         }
 
+        // combine the workers' shares (the sample count travels as the last element)
+        if (useDistributedEvaluation)
+        {
+            std::vector<double> aggregate(evalResults);
+            aggregate.push_back((double) totalEpochSamples);
+            m_mpi->AllReduce(aggregate);
+            totalEpochSamples = (size_t) aggregate.back();
+            aggregate.pop_back();
+            evalResults = aggregate;
+        }
+
         // final statistics
         for (int i = 0; i < evalResultsLastMBs.size(); i++)
         {
@@ -199,6 +222,7 @@ protected:
     ComputationNetworkPtr m_net;
     size_t m_numMBsToShowResult;
     int m_traceLevel;
+    MPIWrapper* m_mpi;
     void operator=(const SimpleEvaluator&); // (not assignable)
 };
 } } }
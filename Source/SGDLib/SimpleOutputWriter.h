@@ -11,16 +11,23 @@
 #include "Helpers.h"
 #include "File.h"
 #include "fileutil.h"
+#include "MPIWrapper.h"
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <fstream>
 #include <cstdio>
+#include <numeric>
 
 using namespace std;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// With 'mpi', the output to files (WriteOutput() to an output path) is distributed: each worker reads its subset of the
+// data and writes it into its own shard, <outputPath>.<node>.rank<k>, and the main worker writes a manifest,
+// <outputPath>.manifest, that lists the shards and their sample counts. The prologue goes into the first shard and the
+// epilogue into the last, so that concatenating the shards in rank order gives a complete file; the sequences are in the
+// order of the reader subsets, not in the order of the data. All workers must call WriteOutput() together.
 template <class ElemType>
 class SimpleOutputWriter
 {
@@ -77,8 +84,8 @@ private:
     }
 
 public:
-    SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0)
-        : m_net(net), m_verbosity(verbosity)
+    SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0, MPIWrapper* mpi = nullptr)
+        : m_net(net), m_verbosity(verbosity), m_mpi(mpi)
     {
     }
 
@@ -106,11 +113,9 @@ public:
         {
             ComputationNetwork::BumpEvalTimeStamp(inputNodes);
 
+            m_net->ForwardProp(outputNodes);
             for (int i = 0; i < outputNodes.size(); i++)
-            {
-                m_net->ForwardProp(outputNodes[i]);
                 outputMatrices[outputNodes[i]->NodeName()] = (void*) (&dynamic_pointer_cast<ComputationNode<ElemType>>(outputNodes[i])->Value());
-            }
 
             if (doUnitTest)
             {
@@ -129,6 +134,9 @@ public:
             dataReader.DataEnd();
         }
 
+        // the writer may still be writing in the background
+        dataWriter.Flush();
+
         if (m_verbosity > 0)
             fprintf(stderr, "Total Samples Evaluated = %lu\n", totalEpochSamples);
 
@@ -140,6 +148,7 @@ public:
     {
         // How to interpret the data:
         bool isCategoryLabel;          // true: find max value in column and output the index instead of the entire vector
+        size_t nBest;                  // category labels: output the indices of this many largest values, best first
         std::wstring labelMappingFile; // optional dictionary for pretty-printing category labels
         bool transpose;                // true: one line per sample, each sample (column vector) forms one line; false: one column per sample
         // The following strings are interspersed with the data:
@@ -157,7 +166,7 @@ public:
         std::string precisionFormat;        // printf precision, e.g. ".2" to get a "%.2f"
 
         WriteFormattingOptions() :
-            isCategoryLabel(false), transpose(true), sequenceEpilogue("\n"), elementSeparator(" "), sampleSeparator("\n")
+            isCategoryLabel(false), nBest(1), transpose(true), sequenceEpilogue("\n"), elementSeparator(" "), sampleSeparator("\n")
         { }
 
         // Process -- replace newlines and all %s by the given string
@@ -174,6 +183,17 @@ public:
     // TODO: Remove code dup with above function by creating a fake Writer object and then calling the other function.
     void WriteOutput(IDataReader<ElemType>& dataReader, size_t mbSize, std::wstring outputPath, const std::vector<std::wstring>& outputNodeNames, const WriteFormattingOptions & formattingOptions, size_t numOutputSamples = requestDataSize)
     {
+        const bool useDistributedOutput = (m_mpi != nullptr) && (m_mpi->NumNodesInUse() > 1);
+        if (useDistributedOutput)
+        {
+            if (outputPath == L"-")
+                InvalidArgument("write: Distributed output needs an output path; it cannot go to stdout.");
+            if (!dataReader.SupportsDistributedMBRead())
+                InvalidArgument("write: Distributed output needs a reader that supports distributed minibatch reading.");
+        }
+        const size_t rank = useDistributedOutput ? m_mpi->CurrentNodeRank() : 0;
+        const size_t numRanks = useDistributedOutput ? m_mpi->NumNodesInUse() : 1;
+
         std::vector<ComputationNodeBasePtr> outputNodes = DetermineOutputNodes(outputNodeNames);
         std::vector<ComputationNodeBasePtr> inputNodes = DetermineInputNodes(outputNodes);
 
@@ -195,12 +215,17 @@ public:
             std::wstring nodeOutputPath = outputPath;
             if (nodeOutputPath != L"-")
                 nodeOutputPath += L"." + onode->NodeName();
+            if (useDistributedOutput)
+                nodeOutputPath += msra::strfun::wstrprintf(L".rank%d", (int) rank);
             auto f = make_shared<File>(nodeOutputPath, fileOptionsWrite | fileOptionsText);
             outputStreams[onode] = f;
         }
 
         // evaluate with minibatches
-        dataReader.StartMinibatchLoop(mbSize, 0, numOutputSamples);
+        if (useDistributedOutput)
+            dataReader.StartDistributedMinibatchLoop(mbSize, 0, rank, numRanks, numOutputSamples);
+        else
+            dataReader.StartMinibatchLoop(mbSize, 0, numOutputSamples);
 
         m_net->StartEvaluateMinibatchLoop(outputNodes);
 
@@ -208,19 +233,27 @@ public:
         size_t numMBsRun = 0;
         size_t tempArraySize = 0;
         ElemType* tempArray = nullptr;
+        Matrix<ElemType> topIndexes(m_net->GetDeviceId()); // category labels: the n best of each column, found on the device
+        Matrix<ElemType> topValues(m_net->GetDeviceId());
 
-        for (auto & onode : outputNodes)
+        if (rank == 0)
         {
-            FILE * f = *outputStreams[onode];
-            fprintfOrDie(f, "%s", formattingOptions.prologue.c_str());
+            for (auto & onode : outputNodes)
+            {
+                FILE * f = *outputStreams[onode];
+                fprintfOrDie(f, "%s", formattingOptions.prologue.c_str());
+            }
         }
 
         char formatChar = !formattingOptions.isCategoryLabel ? 'f' : !formattingOptions.labelMappingFile.empty() ? 's' : 'u';
         std::string valueFormatString = "%" + formattingOptions.precisionFormat + formatChar; // format string used in fprintf() for formatting the values
 
         size_t actualMBSize;
-        while (DataReaderHelpers::GetMinibatchIntoNetwork(dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize))
+        while (DataReaderHelpers::GetMinibatchIntoNetwork(dataReader, m_net, nullptr, useDistributedOutput, false, inputMatrices, actualMBSize))
         {
+            if (actualMBSize == 0) // (a distributed reader may have no data for this worker in a minibatch)
+                continue;
+
             ComputationNetwork::BumpEvalTimeStamp(inputNodes);
 
             for (auto & onode : outputNodes)
@@ -230,8 +263,25 @@ public:
                 m_net->ForwardProp(onode);
 
                 // get it (into a flat CPU-side vector)
+                // For category labels, only the indices of the n best values are transferred, not the entire posteriors.
                 Matrix<ElemType>& outputValues = dynamic_pointer_cast<ComputationNode<ElemType>>(onode)->Value();
-                outputValues.CopyToArray(tempArray, tempArraySize);
+                size_t T   = outputValues.GetNumCols();
+                size_t dim = outputValues.GetNumRows();
+                if (formattingOptions.isCategoryLabel)
+                {
+                    if (formatChar == 's') // verify label dimension
+                    {
+                        if (dim != labelMapping.size())
+                            InvalidArgument("write: Row dimension %d does not match number of entries %d in labelMappingFile '%ls'", (int)dim, (int)labelMapping.size(), formattingOptions.labelMappingFile.c_str());
+                    }
+                    if (formattingOptions.nBest == 0 || formattingOptions.nBest > dim)
+                        InvalidArgument("write: nBest must be between 1 and the row dimension %d of node '%ls'", (int)dim, onode->NodeName().c_str());
+                    outputValues.VectorMax(topIndexes, topValues, true, (int)formattingOptions.nBest);
+                    topIndexes.CopyToArray(tempArray, tempArraySize);
+                    dim = formattingOptions.nBest;
+                }
+                else
+                    outputValues.CopyToArray(tempArray, tempArraySize);
                 ElemType* pCurValue = tempArray;
 
                 // sequence separator
@@ -242,39 +292,11 @@ public:
                 const auto elementSeparator  = formattingOptions.Processed(onode->NodeName(), formattingOptions.elementSeparator);
                 const auto sampleSeparator   = formattingOptions.Processed(onode->NodeName(), formattingOptions.sampleSeparator);
 
-                if (numMBsRun > 0 && !sequenceSeparator.empty())
+                if ((numMBsRun > 0 || rank > 0) && !sequenceSeparator.empty()) // (a shard continues the previous one)
                     fprintfOrDie(f, "%s", sequenceSeparator.c_str());
                 fprintfOrDie(f, "%s", sequencePrologue.c_str());
 
                 // output it according to our format specification
-                size_t T   = outputValues.GetNumCols();
-                size_t dim = outputValues.GetNumRows();
-                if (formattingOptions.isCategoryLabel)
-                {
-                    if (formatChar == 's') // verify label dimension
-                    {
-                        if (dim != labelMapping.size())
-                            InvalidArgument("write: Row dimension %d does not match number of entries %d in labelMappingFile '%ls'", (int)dim, (int)labelMapping.size(), formattingOptions.labelMappingFile.c_str());
-                    }
-                    // update the matrix in-place from one-hot (or max) to index
-                    // find the max in each column
-                    foreach_column(j, outputValues)
-                    {
-                        double maxPos = -1;
-                        double maxVal = 0;
-                        foreach_row(i, outputValues)
-                        {
-                            double val = pCurValue[i + j * dim];
-                            if (maxPos < 0 || val >= maxVal)
-                            {
-                                maxPos = (double)i;
-                                maxVal = val;
-                            }
-                        }
-                        pCurValue[j] = (ElemType) maxPos; // overwrite in-place, assuming a flat vector
-                    }
-                    dim = 1;
-                }
                 size_t iend    = formattingOptions.transpose ? dim  : T;
                 size_t jend    = formattingOptions.transpose ? T    : dim;
                 size_t istride = formattingOptions.transpose ? 1    : jend;
@@ -314,10 +336,13 @@ public:
             fprintf(stderr, "Minibatch[%lu]: ActualMBSize = %lu\n", ++numMBsRun, actualMBSize);
         }
 
-        for (auto & onode : outputNodes)
+        if (rank + 1 == numRanks)
         {
-            FILE * f = *outputStreams[onode];
-            fprintfOrDie(f, "%s", formattingOptions.epilogue.c_str());
+            for (auto & onode : outputNodes)
+            {
+                FILE * f = *outputStreams[onode];
+                fprintfOrDie(f, "%s", formattingOptions.epilogue.c_str());
+            }
         }
 
         delete[] tempArray;
@@ -327,11 +352,40 @@ public:
         // flush all files (where we can catch errors) so that we can then destruct the handle cleanly without error
         for (auto & iter : outputStreams)
             iter.second->Flush();
+
+        if (useDistributedOutput)
+            WriteShardManifest(outputPath, outputNodes, totalEpochSamples);
     }
 
 private:
+    // gathers the workers' sample counts, and lets the main worker write <outputPath>.manifest:
+    // one line per output node and shard, "<node>\t<rank>\t<shard path>\t<number of samples>", in rank order
+    void WriteShardManifest(const std::wstring& outputPath, const std::vector<ComputationNodeBasePtr>& outputNodes, size_t numSamples)
+    {
+        std::vector<double> shardSamples(m_mpi->NumNodesInUse(), 0);
+        shardSamples[m_mpi->CurrentNodeRank()] = (double) numSamples;
+        m_mpi->AllReduce(shardSamples);
+
+        if (m_mpi->IsMainNode())
+        {
+            const std::wstring manifestPath = outputPath + L".manifest";
+            File manifest(manifestPath, fileOptionsWrite | fileOptionsText);
+            FILE* f = manifest;
+            for (auto& onode : outputNodes)
+            {
+                for (size_t k = 0; k < shardSamples.size(); k++)
+                    fprintfOrDie(f, "%ls\t%d\t%ls.%ls.rank%d\t%lu\n", onode->NodeName().c_str(), (int) k, outputPath.c_str(), onode->NodeName().c_str(), (int) k, (size_t) shardSamples[k]);
+            }
+            manifest.Flush();
+            fprintf(stderr, "Wrote %d output shards per node, %lu samples in total; manifest: %ls\n", (int) shardSamples.size(),
+                    (size_t) std::accumulate(shardSamples.begin(), shardSamples.end(), 0.0), manifestPath.c_str());
+        }
+        m_mpi->WaitAll(); // (the shards are complete when the action returns on any worker)
+    }
+
     ComputationNetworkPtr m_net;
     int m_verbosity;
+    MPIWrapper* m_mpi;
     void operator=(const SimpleOutputWriter&); // (not assignable)
 };
 
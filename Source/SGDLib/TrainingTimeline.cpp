@@ -0,0 +1,213 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "TrainingTimeline.h"
+#include "MatrixQuantizerImpl.h" // for MatrixComputeStreamEvent
+#include "fileutil.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// rows ("threads") of the trace
+static const int phaseRow = 0;
+static const int minibatchRow = 1;
+
+TrainingTimeline::TrainingTimeline(int deviceId, bool synchronizeDevice, const std::wstring& traceFile, int rank)
+    : m_deviceId(deviceId),
+      m_synchronizeDevice(synchronizeDevice && (deviceId >= 0)),
+      m_epochNumber(0),
+      m_inMinibatch(false),
+      m_minibatchBeginSeconds(0),
+      m_numSamples(0),
+      m_traceFile(nullptr),
+      m_rank(rank)
+{
+    m_clock.Start();
+    m_currentSeconds.fill(0);
+
+    // The JSON array format of the trace-event format may lack the closing bracket, so the trace stays readable if training is aborted.
+    if (!traceFile.empty())
+    {
+        m_traceFile = fopenOrDie(traceFile, L"wb");
+        fprintf(m_traceFile, "[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"Phases\"}},\n", m_rank, phaseRow);
+        fprintf(m_traceFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"Minibatches\"}}", m_rank, minibatchRow);
+    }
+}
+
+TrainingTimeline::~TrainingTimeline()
+{
+    if (m_traceFile)
+    {
+        fprintf(m_traceFile, "\n]\n");
+        fclose(m_traceFile); // (no fcloseOrDie() in a destructor)
+    }
+}
+
+/*static*/ const char* TrainingTimeline::PhaseName(Phase phase)
+{
+    switch (phase)
+    {
+    case readerPhase:              return "reader";
+    case forwardPhase:             return "ForwardProp";
+    case backpropPhase:            return "Backprop";
+    case aggregationPhase:         return "aggregation";
+    case aggregationPackPhase:     return "quantize/copy to host";
+    case aggregationExchangePhase: return "MPI exchange";
+    case aggregationUnpackPhase:   return "unquantize/copy back";
+    case updatePhase:              return "UpdateWeights";
+    case modelAveragingPhase:      return "model averaging";
+    default:                       LogicError("TrainingTimeline: Invalid phase %d.", (int) phase);
+    }
+}
+
+// -----------------------------------------------------------------------
+// measuring
+// -----------------------------------------------------------------------
+
+void TrainingTimeline::SynchronizeDevice()
+{
+    if (m_synchronizeDevice)
+    {
+        unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(m_deviceId));
+        mainStreamSyncEvent->SynchronizeEvent();
+    }
+}
+
+TrainingTimeline::Scope::Scope(TrainingTimeline* timeline, Phase phase)
+    : m_timeline((timeline && timeline->m_inMinibatch) ? timeline : nullptr),
+      m_phase(phase),
+      m_beginSeconds(0)
+{
+    if (!m_timeline)
+        return;
+    m_timeline->SynchronizeDevice();
+    m_beginSeconds = m_timeline->Now();
+}
+
+TrainingTimeline::Scope::~Scope()
+{
+    // an exception ends training anyway, and the device may be in a failed state
+    if (!m_timeline || std::uncaught_exception())
+        return;
+    m_timeline->SynchronizeDevice();
+    double seconds = m_timeline->Now() - m_beginSeconds;
+    m_timeline->m_currentSeconds[m_phase] += seconds;
+    if (m_timeline->m_traceFile)
+        m_timeline->WriteTraceEvent(phaseRow, PhaseName(m_phase), m_beginSeconds, seconds, "");
+}
+
+void TrainingTimeline::BeginEpoch(int epochNumber)
+{
+    m_epochNumber = epochNumber;
+    m_inMinibatch = false;
+    m_seconds.clear();
+    m_minibatchSeconds.clear();
+    m_numSamples = 0;
+}
+
+void TrainingTimeline::BeginMinibatch()
+{
+    // (the previous minibatch, if not ended, is discarded)
+    SynchronizeDevice();
+    m_inMinibatch = true;
+    m_currentSeconds.fill(0);
+    m_minibatchBeginSeconds = Now();
+}
+
+void TrainingTimeline::EndMinibatch(size_t numSamples)
+{
+    if (!m_inMinibatch)
+        return;
+    SynchronizeDevice();
+    m_inMinibatch = false;
+    double seconds = Now() - m_minibatchBeginSeconds;
+    m_seconds.push_back(m_currentSeconds);
+    m_minibatchSeconds.push_back(seconds);
+    m_numSamples += numSamples;
+
+    if (m_traceFile)
+    {
+        char name[32];
+        sprintf(name, "minibatch %d", (int) m_minibatchSeconds.size());
+        WriteTraceEvent(minibatchRow, name, m_minibatchBeginSeconds, seconds,
+                        msra::strfun::strprintf("\"epoch\":%d,\"samples\":%d", m_epochNumber + 1, (int) numSamples));
+    }
+}
+
+// The trace-event format: complete events ("ph": "X") with timestamps and durations in microseconds.
+void TrainingTimeline::WriteTraceEvent(int row, const char* name, double beginSeconds, double seconds, const std::string& args)
+{
+    fprintf(m_traceFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,\"args\":{%s}}",
+            name, m_rank, row, beginSeconds * 1e6, seconds * 1e6, args.c_str());
+}
+
+// -----------------------------------------------------------------------
+// reporting
+// -----------------------------------------------------------------------
+
+// nearest-rank percentile of the sorted 'values'
+static double Percentile(const vector<double>& values, double p)
+{
+    size_t rank = (size_t) ceil(p * values.size());
+    return values[rank > 0 ? min(rank, values.size()) - 1 : 0];
+}
+
+void TrainingTimeline::PrintSummary(FILE* f, const std::string& title) const
+{
+    const size_t numMinibatches = m_minibatchSeconds.size();
+    if (numMinibatches == 0)
+        return;
+
+    double totalSeconds = 0;
+    for (double seconds : m_minibatchSeconds)
+        totalSeconds += seconds;
+
+    fprintf(f, "%s: Training timeline over %d minibatches, %d samples, %.3f seconds%s (milliseconds per minibatch):\n",
+            title.c_str(), (int) numMinibatches, (int) m_numSamples, totalSeconds, m_synchronizeDevice ? ", GPU synchronized at each phase" : "");
+    fprintf(f, "    %-24s %9s %9s %9s %9s %9s %7s\n", "phase", "mean", "p50", "p90", "p99", "max", "share");
+
+    auto printRow = [&](const char* name, vector<double>& seconds)
+    {
+        double sum = 0;
+        for (double s : seconds)
+            sum += s;
+        sort(seconds.begin(), seconds.end());
+        fprintf(f, "    %-24s %9.3f %9.3f %9.3f %9.3f %9.3f %6.1f%%\n", name,
+                1e3 * sum / seconds.size(), 1e3 * Percentile(seconds, 0.5), 1e3 * Percentile(seconds, 0.9), 1e3 * Percentile(seconds, 0.99), 1e3 * seconds.back(),
+                totalSeconds > 0 ? 100 * sum / totalSeconds : 0.0);
+    };
+
+    // phases that never ran (e.g. aggregation without parallel training) are omitted; the parts of the aggregation are indented below it
+    vector<double> seconds(numMinibatches);
+    vector<double> otherSeconds = m_minibatchSeconds; // not within any top-level phase
+    for (int phase = 0; phase < numPhases; phase++)
+    {
+        bool isPart = (phase == aggregationPackPhase) || (phase == aggregationExchangePhase) || (phase == aggregationUnpackPhase);
+        bool hasRun = false;
+        for (size_t i = 0; i < numMinibatches; i++)
+        {
+            seconds[i] = m_seconds[i][phase];
+            hasRun |= seconds[i] > 0;
+            if (!isPart)
+                otherSeconds[i] = max(0.0, otherSeconds[i] - seconds[i]);
+        }
+        if (hasRun)
+            printRow((string(isPart ? "  " : "") + PhaseName((Phase) phase)).c_str(), seconds);
+    }
+    printRow("other", otherSeconds);
+    seconds = m_minibatchSeconds;
+    printRow("minibatch", seconds);
+
+    if (m_traceFile)
+        fflush(m_traceFile);
+}
+} } }
@@ -0,0 +1,95 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TrainingTimeline.h -- per-minibatch timing of the phases of SGD::TrainOneEpoch()
+//
+// SGD brackets each minibatch with BeginMinibatch()/EndMinibatch(), and each phase (reading, ForwardProp(), Backprop(),
+// gradient aggregation, parameter update, model averaging) with a Scope. The gradient aggregator reports the parts of
+// the aggregation itself (preparing the gradients for the exchange, i.e. quantizing them or copying them to the host;
+// the exchange over MPI; and unquantizing or copying back), if it runs on the training thread.
+// With synchronizeDevice, the GPU compute stream is synchronized at the phase boundaries, so that the kernels are
+// attributed to the phase that launched them (this costs the overlap of the CPU with the GPU). Without it, a GPU phase
+// measures mostly the launch overhead, and its kernels show up in whatever phase next waits for the GPU.
+// PrintSummary() prints percentiles of the time per minibatch for each phase. If a trace file is given, every phase
+// is streamed to it as it completes, in the Chrome trace-event format (open in chrome://tracing).
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "TimerUtility.h"
+#include <array>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class TrainingTimeline
+{
+public:
+    enum Phase
+    {
+        readerPhase,              // GetMinibatchIntoNetwork(): waiting for the reader, and moving the minibatch into the network
+        forwardPhase,             // ForwardProp() of the criterion and evaluation nodes
+        backpropPhase,            // Backprop()
+        aggregationPhase,         // IDistGradAggregator::AggregateGradients(), including the following three
+        aggregationPackPhase,     //  - quantizing the gradients, or copying them to the host
+        aggregationExchangePhase, //  - waiting for MPI
+        aggregationUnpackPhase,   //  - unquantizing the aggregate, or copying it back to the device
+        updatePhase,              // UpdateWeights() of all parameters
+        modelAveragingPhase,      // model averaging or block momentum sync
+        numPhases
+    };
+
+    // no trace is written if 'traceFile' is empty; 'rank' is the process id of the events in the trace
+    TrainingTimeline(int deviceId, bool synchronizeDevice, const std::wstring& traceFile, int rank);
+    ~TrainingTimeline();
+
+    // measures the phase in its scope; does nothing if 'timeline' is nullptr or no minibatch is open
+    class Scope
+    {
+    public:
+        Scope(TrainingTimeline* timeline, Phase phase);
+        ~Scope();
+
+    private:
+        TrainingTimeline* m_timeline;
+        Phase m_phase;
+        double m_beginSeconds;
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    void BeginEpoch(int epochNumber);
+    void BeginMinibatch();
+    // A minibatch that is begun but never ended (e.g. the reader found the end of the epoch) is not counted.
+    void EndMinibatch(size_t numSamples);
+
+    // prints the statistics of the minibatches since BeginEpoch(); 'title' goes into the header line, e.g. "Epoch[3]"
+    void PrintSummary(FILE* f, const std::string& title) const;
+
+private:
+    void SynchronizeDevice();
+    void WriteTraceEvent(int row, const char* name, double beginSeconds, double seconds, const std::string& args);
+    double Now() { return m_clock.ElapsedSeconds(); }
+
+    static const char* PhaseName(Phase phase);
+
+    int m_deviceId;
+    bool m_synchronizeDevice;
+    Timer m_clock; // started at construction, never stopped
+
+    int m_epochNumber;
+    bool m_inMinibatch;
+    double m_minibatchBeginSeconds;
+    std::array<double, numPhases> m_currentSeconds;       // [phase] of the open minibatch
+    std::vector<std::array<double, numPhases>> m_seconds; // [minibatch][phase] of this epoch
+    std::vector<double> m_minibatchSeconds;               // [minibatch] wall time, from BeginMinibatch() to EndMinibatch()
+    size_t m_numSamples;
+
+    FILE* m_traceFile;
+    int m_rank;
+};
+} } }
@@ -19,6 +19,7 @@ struct SeqGammarCalParam
     double wp;
     double bMMIfactor;
     bool sMBRmode;
+    double pruningbeam; // GPU only: beam for pruning the lattices before the forward-backward (lattice::parallelstate::setpruningbeam()); 0 = off
     SeqGammarCalParam()
     {
         amf = 14.0;
@@ -26,6 +27,7 @@ struct SeqGammarCalParam
         wp = 0.0;
         bMMIfactor = 0.0;
         sMBRmode = false;
+        pruningbeam = 0.0;
     }
 };
 
@@ -79,6 +81,7 @@ public:
         wp = (float) gammarParam.wp;
         seqsMBRmode = gammarParam.sMBRmode;
         boostmmifactor = (float) gammarParam.bMMIfactor;
+        parallellattice.setpruningbeam((float) gammarParam.pruningbeam);
     }
 
     // ========================================
@@ -95,6 +98,11 @@ public:
                        std::vector<size_t>& extrauttmap,
                        bool doreferencealign)
     {
+        // on the GPU, all lattices of the minibatch are processed together if possible
+        if (m_deviceid != CPUDEVICE && !doreferencealign && lattices.size() > 1 &&
+            calgammaformbbatch(functionValues, lattices, loglikelihood, gammafromlattice, uids, samplesInRecurrentStep, pMBLayout, extrauttmap))
+            return;
+
         // check total frame number to be added ?
         // int deviceid = loglikelihood.GetDeviceId();
         size_t boundaryframenum;
@@ -102,6 +110,9 @@ public:
         validframes.assign(samplesInRecurrentStep, 0);
         ElemType objectValue = 0.0;
         // convert from Microsoft::MSR::CNTK::Matrix to  msra::math::ssematrixbase
+        // On the GPU, the LLs stay on the device, and pred/dengammas only provide the dimensions; only the reference
+        // alignment reads the LLs on the CPU.
+        const bool loglikelihoodoncpu = m_deviceid == CPUDEVICE || doreferencealign;
         size_t numrows = loglikelihood.GetNumRows();
         size_t numcols = loglikelihood.GetNumCols();
         Microsoft::MSR::CNTK::Matrix<ElemType> tempmatrix(m_deviceid);
@@ -136,10 +147,8 @@ public:
             if (samplesInRecurrentStep == 1) // no sequence parallelism
             {
                 tempmatrix = loglikelihood.ColumnSlice(ts, numframes);
-                // if (m_deviceid == CPUDEVICE)
-                {
+                if (loglikelihoodoncpu)
                     CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
 
                 if (m_deviceid != CPUDEVICE)
                     parallellattice.setloglls(tempmatrix);
@@ -172,10 +181,8 @@ public:
                 Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
                 tempmatrix.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
 
-                // if (doreferencealign || m_deviceid == CPUDEVICE)
-                {
+                if (loglikelihoodoncpu)
                     CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
 
                 if (m_deviceid != CPUDEVICE)
                 {
@@ -194,11 +201,16 @@ public:
             array_ref<size_t> boundariesstripe(&boundaries[ts], boundaryframenum);
 
             double numavlogp = 0;
-            foreach_column (t, dengammasstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
+            if (loglikelihoodoncpu)
             {
-                const size_t s = uidsstripe[t];
-                numavlogp += predstripe(s, t) / amf;
+                foreach_column (t, dengammasstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
+                {
+                    const size_t s = uidsstripe[t];
+                    numavlogp += predstripe(s, t) / amf;
+                }
             }
+            else
+                numavlogp = GetLogLLSumOnDevice(&uids[ts], numframes) / amf;
             numavlogp /= numframes;
 
             // auto_timer dengammatimer;
@@ -248,6 +260,126 @@ public:
     }
 
 private:
+    // calgammaformb() for all utterances at once with lattice::forwardbackwardbatch(), GPU only
+    // Returns false if the lattices cannot be batched, in which case nothing has been set.
+    bool calgammaformbbatch(Microsoft::MSR::CNTK::Matrix<ElemType>& functionValues,
+                            std::vector<shared_ptr<const msra::dbn::latticepair>>& lattices,
+                            const Microsoft::MSR::CNTK::Matrix<ElemType>& loglikelihood,
+                            Microsoft::MSR::CNTK::Matrix<ElemType>& gammafromlattice,
+                            std::vector<size_t>& uids,
+                            size_t samplesInRecurrentStep,
+                            std::shared_ptr<Microsoft::MSR::CNTK::MBLayout> pMBLayout,
+                            std::vector<size_t>& extrauttmap)
+    {
+        size_t numrows = loglikelihood.GetNumRows();
+        size_t numcols = loglikelihood.GetNumCols();
+        size_t T = numcols / samplesInRecurrentStep; // number of time steps in minibatch
+
+        // locate the utterances within the minibatch
+        std::vector<size_t> validframes; // [s] cursor pointing to next utterance begin within a single parallel sequence [s]
+        validframes.assign(samplesInRecurrentStep, 0);
+        std::vector<size_t> firstframes(lattices.size(), 0); // [i] time step of first frame of utterance [i] within its parallel sequence
+        std::vector<const msra::lattices::lattice*> batchlattices(lattices.size());
+        size_t totalframes = 0;
+        for (size_t i = 0; i < lattices.size(); i++)
+        {
+            const size_t numframes = lattices[i]->getnumframes();
+            if (samplesInRecurrentStep > 1)
+            {
+                const size_t mapi = extrauttmap[i];
+                size_t mapframenum = SIZE_MAX; // duration of utterance [i] as determined from MBLayout
+                for (size_t t = validframes[mapi]; t < T; t++)
+                {
+                    if (pMBLayout->IsEnd(mapi, t))
+                    {
+                        mapframenum = t - validframes[mapi] + 1;
+                        break;
+                    }
+                }
+                if (numframes != mapframenum)
+                    LogicError("gammacalculation: IsEnd() not working, numframes (%d) vs. mapframenum (%d)", (int) numframes, (int) mapframenum);
+                firstframes[i] = validframes[mapi];
+                validframes[mapi] += numframes;
+            }
+            batchlattices[i] = &lattices[i]->second;
+            totalframes += numframes;
+        }
+
+        if (numcols > pred.cols())
+        {
+            pred.resize(numrows, numcols);
+            dengammas.resize(numrows, numcols);
+        }
+        msra::dbn::matrixstripe predstripe(pred, 0, totalframes);           // logLLs of all utterances, in utterance order
+        msra::dbn::matrixstripe dengammasstripe(dengammas, 0, totalframes); // denominator gammas
+
+        // de-interleave the parallel sequences of loglikelihood on the GPU; pred only provides the dimensions
+        Microsoft::MSR::CNTK::Matrix<ElemType> batchmatrix(m_deviceid);
+        if (samplesInRecurrentStep == 1)
+            batchmatrix = loglikelihood.ColumnSlice(0, totalframes);
+        else
+        {
+            batchmatrix.Resize(numrows, totalframes);
+            size_t ts = 0;
+            for (size_t i = 0; i < lattices.size(); i++)
+            {
+                const size_t numframes = lattices[i]->getnumframes();
+                const size_t mapi = extrauttmap[i];
+                Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (firstframes[i] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+                Microsoft::MSR::CNTK::Matrix<ElemType> batchslice = batchmatrix.ColumnSlice(ts, numframes);
+                batchslice.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
+                ts += numframes;
+            }
+        }
+        parallellattice.setloglls(batchmatrix);
+
+        std::vector<double> denavlogps; // [i]
+        const_array_ref<size_t> uidsstripe(&uids[0], totalframes);
+        if (!msra::lattices::lattice::forwardbackwardbatch(parallellattice, batchlattices,
+                                                          (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
+                                                          (const msra::math::ssematrixbase&) dengammasstripe,
+                                                          lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, denavlogps))
+            return false;
+
+        // the numerator scores of all utterances add up to that of the reference alignment of the whole minibatch
+        double objective = GetLogLLSumOnDevice(&uids[0], totalframes) / amf;
+        for (size_t i = 0; i < lattices.size(); i++)
+        {
+            objective -= denavlogps[i] * lattices[i]->getnumframes();
+            fprintf(stderr, "dengamma value %f\n", denavlogps[i]);
+        }
+        ElemType objectValue = (ElemType) objective;
+
+        // copy gammas back, re-interleaving the parallel sequences
+        if (samplesInRecurrentStep == 1)
+        {
+            Microsoft::MSR::CNTK::Matrix<ElemType> tempmatrix = gammafromlattice.ColumnSlice(0, totalframes);
+            parallellattice.getgamma(tempmatrix);
+        }
+        else
+        {
+            parallellattice.getgamma(batchmatrix);
+            size_t ts = 0;
+            for (size_t i = 0; i < lattices.size(); i++)
+            {
+                const size_t numframes = lattices[i]->getnumframes();
+                const size_t mapi = extrauttmap[i];
+                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (firstframes[i] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+                gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(batchmatrix.ColumnSlice(ts, numframes), numframes, 1, samplesInRecurrentStep);
+                ts += numframes;
+            }
+        }
+        functionValues.SetValue(objectValue);
+        return true;
+    }
+
+    // sum over t of logLLs(uids[t],t) of the LLs last passed to parallellattice.setloglls(), computed on the GPU
+    double GetLogLLSumOnDevice(const size_t* uids, size_t numframes)
+    {
+        m_uidsbuffer.assign(uids, uids + numframes);
+        return parallellattice.getlogllsum(m_uidsbuffer);
+    }
+
     // Helper methods for copying between ssematrix objects and CNTK matrices
     void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
     {
@@ -378,5 +510,6 @@ private:
     std::unique_ptr<Microsoft::MSR::CNTK::CUDAPageLockedMemAllocator> m_cudaAllocator;
     std::shared_ptr<ElemType> m_intermediateCUDACopyBuffer;
     size_t m_intermediateCUDACopyBufferSize;
+    std::vector<unsigned short> m_uidsbuffer; // (GetLogLLSumOnDevice())
 };
 } }
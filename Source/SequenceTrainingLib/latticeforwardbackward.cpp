@@ -131,6 +131,9 @@ static bool islogzero(FLOAT v)
     return v < LOGZERO / 2;
 } // is this number to be considered 0
 
+// granularity of the parallel error-signal accumulation on the CPU
+static const size_t framesperblock = 32;
+
 // ---------------------------------------------------------------------------
 // other helpers go here
 // ---------------------------------------------------------------------------
@@ -794,17 +797,12 @@ double lattice::bestpathlattice(const std::vector<float> &edgeacscores, std::vec
 //
 // Outputs:
 // ---------------------------------------------------------------------------
-void lattice::forwardbackwardalign(parallelstate &parallelstate,
-                                   const msra::asr::simplesenonehmm &hset, const bool softalignstates,
-                                   const double minlogpp, const std::vector<double> &origlogpps,
-                                   std::vector<msra::math::ssematrixbase *> &abcs, littlematrixheap &matrixheap,
-                                   const bool returnsenoneids,
-                                   std::vector<float> &edgeacscores, const msra::math::ssematrixbase &logLLs,
-                                   edgealignments &thisedgealignments, backpointers &thisbackpointers, array_ref<size_t> &uids, const_array_ref<size_t> bounds) const
-{ // NOTE: this will be removed and replaced by a proper representation of alignments someday
-    // do forward-backward or alignment on a per-edge basis. This gives us:
-    //  - per-edge gamma[j,t] = P(s(t)==s_j|edge) if forwardbackward, per-edge alignment thisedgealignments[j] if alignment
-    //  - per-edge acoustic scores
+// phases 1 and 2 of forwardbackwardalign(), also used by the batched version forwardbackwardbatch()
+void lattice::alignedgesoncpu(parallelstate &parallelstate, const msra::asr::simplesenonehmm &hset, const bool softalignstates,
+                              const double minlogpp, const std::vector<double> &origlogpps,
+                              std::vector<msra::math::ssematrixbase *> &abcs, littlematrixheap &matrixheap,
+                              std::vector<float> &edgeacscores, const msra::math::ssematrixbase &logLLs, edgealignments &thisedgealignments) const
+{
     const size_t silunitid = hset.gethmmid("sil"); // shall be the same as parallelstate.getsilunitid()
     bool parallelsil = true;
     bool cpuverification = false;
@@ -892,6 +890,36 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
             edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, true, thisedgealignments[j]);
         }
     }
+}
+
+void lattice::alignedgesoncpu(parallelstate &parallelstate, const msra::asr::simplesenonehmm &hset,
+                              std::vector<float> &edgeacscores, const msra::math::ssematrixbase &logLLs, edgealignments &thisedgealignments) const
+{
+    littlematrixheap matrixheap(info.numedges); // for abcs
+    std::vector<msra::math::ssematrixbase *> abcs;
+    const std::vector<double> origlogpps; // (no pruning)
+    alignedgesoncpu(parallelstate, hset, false /*softalignstates*/, LOGZERO /*minlogpp*/, origlogpps, abcs, matrixheap, edgeacscores, logLLs, thisedgealignments);
+}
+
+void lattice::forwardbackwardalign(parallelstate &parallelstate,
+                                   const msra::asr::simplesenonehmm &hset, const bool softalignstates,
+                                   const double minlogpp, const std::vector<double> &origlogpps,
+                                   std::vector<msra::math::ssematrixbase *> &abcs, littlematrixheap &matrixheap,
+                                   const bool returnsenoneids,
+                                   std::vector<float> &edgeacscores, const msra::math::ssematrixbase &logLLs,
+                                   edgealignments &thisedgealignments, backpointers &thisbackpointers, array_ref<size_t> &uids, const_array_ref<size_t> bounds) const
+{ // NOTE: this will be removed and replaced by a proper representation of alignments someday
+    // do forward-backward or alignment on a per-edge basis. This gives us:
+    //  - per-edge gamma[j,t] = P(s(t)==s_j|edge) if forwardbackward, per-edge alignment thisedgealignments[j] if alignment
+    //  - per-edge acoustic scores
+    const size_t silunitid = hset.gethmmid("sil"); // shall be the same as parallelstate.getsilunitid()
+    bool cpuverification = false;
+#ifdef CPU_VERIFICATION
+    cpuverification = true;
+#endif
+
+    // Phases 1 and 2: abcs allocate, and alignment on CPU
+    alignedgesoncpu(parallelstate, hset, softalignstates, minlogpp, origlogpps, abcs, matrixheap, edgeacscores, logLLs, thisedgealignments);
 
     // Phase 3: alignment on GPU
     if (parallelstate.enabled())
@@ -952,50 +980,68 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
             parallelstate.getedgeacscores(edgeacscoresgpu);
             parallelstate.copyalignments(thisedgealignmentsgpu);
         }
-        foreach_index (j, edges)
+        if (!edges.empty())
+            thisedgealignments[edges.size() - 1]; // (allocates the alignment buffer, which must not happen inside the parallel loop)
+
+        // the edges are independent, and their cost varies with their duration, hence dynamic scheduling
+        // With cpuverification, we run serially to keep the diagnostic messages in order.
+        std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 16) if (!cpuverification)
+        for (int j = 0; j < (int) edges.size(); j++)
         {
-            const edgeinfowithscores &e = edges[j];
-            const size_t ts = nodes[e.S].t;
-            const size_t te = nodes[e.E].t;
-            if (ts == te) // dummy !NULL edge at end
-                edgeacscores[j] = 0.0f;
-            else
+            try
             {
-                const auto &aligntokens = getaligninfo(j); // get alignment tokens
-                const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
-                if (minlogpp > LOGZERO && origlogpps[j] < minlogpp)
-                    edgeacscores[j] = LOGZERO; // will kill word level forwardbackward hypothesis
-                else if (softalignstates)
-                    edgeacscores[j] = forwardbackwardedge(aligntokens, hset, edgeLLs, *abcs[j], j);
+                const edgeinfowithscores &e = edges[j];
+                const size_t ts = nodes[e.S].t;
+                const size_t te = nodes[e.E].t;
+                if (ts == te) // dummy !NULL edge at end
+                    edgeacscores[j] = 0.0f;
                 else
-                    edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
-            }
-            if (cpuverification)
-            {
-                const auto &aligntokens = getaligninfo(j); // get alignment tokens
-                bool edgehassil = false;
-                foreach_index (i, aligntokens)
                 {
-                    if (aligntokens[i].unit == silunitid)
-                        edgehassil = true;
+                    const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                    const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
+                    if (minlogpp > LOGZERO && origlogpps[j] < minlogpp)
+                        edgeacscores[j] = LOGZERO; // will kill word level forwardbackward hypothesis
+                    else if (softalignstates)
+                        edgeacscores[j] = forwardbackwardedge(aligntokens, hset, edgeLLs, *abcs[j], j);
+                    else
+                        edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
                 }
-                if (fabs(edgeacscores[j] - edgeacscoresgpu[j]) > 1e-3)
+                if (cpuverification)
                 {
-                    fprintf(stderr, "edge %d, sil ? %d, edgeacscores / edgeacscoresgpu MISMATCH %f v.s. %f, diff %e\n",
-                            j, edgehassil ? 1 : 0, (float) edgeacscores[j], (float) edgeacscoresgpu[j],
-                            (float) (edgeacscores[j] - edgeacscoresgpu[j]));
-                    fprintf(stderr, "aligntokens: ");
+                    const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                    bool edgehassil = false;
                     foreach_index (i, aligntokens)
-                        fprintf(stderr, "%d %d; ", i, aligntokens[i].unit);
-                    fprintf(stderr, "\n");
-                }
-                for (size_t t = ts; t < te; t++)
-                {
-                    if (thisedgealignments[j][t - ts] != thisedgealignmentsgpu[j][t - ts])
-                        fprintf(stderr, "edge %d, sil ? %d, time %d, alignment / alignmentgpu MISMATCH %d v.s. %d\n", j, edgehassil ? 1 : 0, (int) (t - ts), thisedgealignments[j][t - ts], thisedgealignmentsgpu[j][t - ts]);
+                    {
+                        if (aligntokens[i].unit == silunitid)
+                            edgehassil = true;
+                    }
+                    if (fabs(edgeacscores[j] - edgeacscoresgpu[j]) > 1e-3)
+                    {
+                        fprintf(stderr, "edge %d, sil ? %d, edgeacscores / edgeacscoresgpu MISMATCH %f v.s. %f, diff %e\n",
+                                j, edgehassil ? 1 : 0, (float) edgeacscores[j], (float) edgeacscoresgpu[j],
+                                (float) (edgeacscores[j] - edgeacscoresgpu[j]));
+                        fprintf(stderr, "aligntokens: ");
+                        foreach_index (i, aligntokens)
+                            fprintf(stderr, "%d %d; ", i, aligntokens[i].unit);
+                        fprintf(stderr, "\n");
+                    }
+                    for (size_t t = ts; t < te; t++)
+                    {
+                        if (thisedgealignments[j][t - ts] != thisedgealignmentsgpu[j][t - ts])
+                            fprintf(stderr, "edge %d, sil ? %d, time %d, alignment / alignmentgpu MISMATCH %d v.s. %d\n", j, edgehassil ? 1 : 0, (int) (t - ts), thisedgealignments[j][t - ts], thisedgealignmentsgpu[j][t - ts]);
+                    }
                 }
             }
+            catch (...) // exceptions must not leave the parallel region
+            {
+#pragma omp critical
+                if (!error)
+                    error = std::current_exception();
+            }
         }
+        if (error)
+            std::rethrow_exception(error);
     }
 }
 
@@ -1017,28 +1063,38 @@ void lattice::sMBRerrorsignal(parallelstate &parallelstate,
     }
 
     //  linear mode
-    foreach_coord (i, j, errorsignal)
-        errorsignal(i, j) = 0.0f; // Note: we don't actually put anything into the numgammas
-    foreach_index (j, edges)
+    // Edges overlap in time, so we parallelize over blocks of frames instead of edges: each block accumulates the edges into its own frames only.
+    const int numframes = (int) errorsignal.cols();
+#pragma omp parallel for schedule(dynamic)
+    for (int tb = 0; tb < numframes; tb += (int) framesperblock)
     {
-        const auto &e = edges[j];
-        if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
-            continue;
-        if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
-            continue;
-
-        size_t ts = nodes[e.S].t;
-        size_t te = nodes[e.E].t;
-
-        const double diff = logEframescorrect[j] - logEframescorrecttotal;
-        // Note: the contribution of the states of an edge to their senones is the same for all states
-        // so we compute it once and add it to all; this will not be the case without hard alignments.
-        const double pp = exp(logpps[j]); // edge posterior
-        const float edgecorrect = (float) (pp * diff) / amf;
-        for (size_t t = ts; t < te; t++)
+        const size_t tbegin = tb;
+        const size_t tend = std::min(tbegin + framesperblock, (size_t) numframes);
+        for (size_t t = tbegin; t < tend; t++)
+            for (size_t i = 0; i < errorsignal.rows(); i++)
+                errorsignal(i, t) = 0.0f; // Note: we don't actually put anything into the numgammas
+        foreach_index (j, edges)
         {
-            const size_t s = thisedgealignments[j][t - ts];
-            errorsignal(s, t) += edgecorrect;
+            const auto &e = edges[j];
+            size_t ts = nodes[e.S].t;
+            size_t te = nodes[e.E].t;
+            if (ts == te) // this happens for dummy !NULL edge at end of file
+                continue;
+            if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
+                continue;
+            if (te <= tbegin || ts >= tend) // edge not in this block
+                continue;
+
+            const double diff = logEframescorrect[j] - logEframescorrecttotal;
+            // Note: the contribution of the states of an edge to their senones is the same for all states
+            // so we compute it once and add it to all; this will not be the case without hard alignments.
+            const double pp = exp(logpps[j]); // edge posterior
+            const float edgecorrect = (float) (pp * diff) / amf;
+            for (size_t t = std::max(ts, tbegin); t < std::min(te, tend); t++)
+            {
+                const size_t s = thisedgealignments[j][t - ts];
+                errorsignal(s, t) += edgecorrect;
+            }
         }
     }
 }
@@ -1059,55 +1115,67 @@ void lattice::mmierrorsignal(parallelstate &parallelstate, double minlogpp, cons
         return;
     }
 
-    for (size_t j = 0; j < (errorsignal).cols(); j++)
-        for (size_t i = 0; i < (errorsignal).rows(); i++)
-            errorsignal(i, j) = VIRGINLOGZERO; // set to zero  --note: may be in-place with logLLs, which now get overwritten
-
-    // size_t warnings = 0;   // [v-hansu] check code for mmi; search this comment to see all related codes
-    foreach_index (j, edges)
+    // Edges overlap in time, so we parallelize over blocks of frames instead of edges: each block accumulates the edges into its own frames only.
+    const int numframes = (int) errorsignal.cols();
+#pragma omp parallel for schedule(dynamic)
+    for (int tb = 0; tb < numframes; tb += (int) framesperblock)
     {
-        const auto &e = edges[j];
-        if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
-            continue;
-        if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
-            continue;
+        const size_t tbegin = tb;
+        const size_t tend = std::min(tbegin + framesperblock, (size_t) numframes);
+        for (size_t t = tbegin; t < tend; t++)
+            for (size_t i = 0; i < errorsignal.rows(); i++)
+                errorsignal(i, t) = VIRGINLOGZERO; // set to zero  --note: may be in-place with logLLs, which now get overwritten
 
-        const auto &aligntokens = getaligninfo(j); // get alignment tokens
-        auto &loggammas = *abcs[j];
+        // size_t warnings = 0;   // [v-hansu] check code for mmi; search this comment to see all related codes
+        foreach_index (j, edges)
+        {
+            const auto &e = edges[j];
+            if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
+                continue;
+            if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
+                continue;
+            if (nodes[e.E].t <= tbegin || nodes[e.S].t >= tend) // edge not in this block
+                continue;
 
-        const float edgelogP = (float) logpps[j];
-        // if (islogzero (edgelogP))               // we had a 0 prob
-        //    continue;
+            const auto &aligntokens = getaligninfo(j); // get alignment tokens
+            auto &loggammas = *abcs[j];
 
-        // accumulate this edge's gamma matrix into target posteriors
-        const size_t tedge = nodes[e.S].t;
-        size_t ts = 0;                 // time index into gamma matrix
-        size_t js = 0;                 // state index into gamma matrix
-        foreach_index (k, aligntokens) // we exploit that units have fixed boundaries
-        {
-            const auto &unit = aligntokens[k];
-            const size_t te = ts + unit.frames;
-            const auto &hmm = hset.gethmm(unit.unit); // TODO: inline these expressions
-            const size_t n = hmm.getnumstates();
-            const size_t je = js + n;
-            // P(s) = P(s|e) * P(e)
-            for (size_t t = ts; t < te; t++)
+            const float edgelogP = (float) logpps[j];
+            // if (islogzero (edgelogP))               // we had a 0 prob
+            //    continue;
+
+            // accumulate this edge's gamma matrix into target posteriors
+            const size_t tedge = nodes[e.S].t;
+            size_t ts = 0;                 // time index into gamma matrix
+            size_t js = 0;                 // state index into gamma matrix
+            foreach_index (k, aligntokens) // we exploit that units have fixed boundaries
             {
-                const size_t tutt = t + tedge; // time index w.r.t. utterance
-                // double logsum = LOGZERO;         // [v-hansu] check code for mmi; search this comment to see all related codes
-                for (size_t i = 0; i < n; i++)
+                const auto &unit = aligntokens[k];
+                const size_t te = ts + unit.frames;
+                const auto &hmm = hset.gethmm(unit.unit); // TODO: inline these expressions
+                const size_t n = hmm.getnumstates();
+                const size_t je = js + n;
+                // P(s) = P(s|e) * P(e)
+                for (size_t t = ts; t < te; t++)
                 {
-                    const size_t j = js + i;             // state index for this unit in matrix
-                    const size_t s = hmm.getsenoneid(i); // state class index
-                    const float gammajt = loggammas(j, t);
-                    const float statelogP = edgelogP + gammajt;
-                    logadd(errorsignal(s, tutt), statelogP);
+                    const size_t tutt = t + tedge; // time index w.r.t. utterance
+                    if (tutt < tbegin || tutt >= tend)
+                        continue;
+                    // double logsum = LOGZERO;         // [v-hansu] check code for mmi; search this comment to see all related codes
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        const size_t j = js + i;             // state index for this unit in matrix
+                        const size_t s = hmm.getsenoneid(i); // state class index
+                        const float gammajt = loggammas(j, t);
+                        const float statelogP = edgelogP + gammajt;
+                        logadd(errorsignal(s, tutt), statelogP);
+                    }
                 }
+                ts = te;
+                js = je;
             }
-            ts = te;
-            js = je;
+            assert(ts + 2 == loggammas.cols() && js == loggammas.rows());
         }
-        assert(ts + 2 == loggammas.cols() && js == loggammas.rows());
     }
 
     // check normalizedness (is that an actual English word?)
@@ -1130,8 +1198,10 @@ void lattice::mmierrorsignal(parallelstate &parallelstate, double minlogpp, cons
     fprintf(stderr, "forwardbackward: %.3f%% non-zero state posteriors\n", 100.0f - nonzerostates * 100.0f / errorsignal.rows() / errorsignal.cols());
 
     // convert to non-log posterior  --that's what we return
-    foreach_coord (i, j, errorsignal)
-        errorsignal(i, j) = expf(errorsignal(i, j));
+#pragma omp parallel for
+    for (int j = 0; j < numframes; j++)
+        for (size_t i = 0; i < errorsignal.rows(); i++)
+            errorsignal(i, j) = expf(errorsignal(i, j));
 }
 
 // compute ground truth's score
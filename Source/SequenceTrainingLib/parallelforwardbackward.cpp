@@ -105,7 +105,8 @@ void forwardlatticej(const size_t batchsize, const size_t startindex, const std:
     if (j < batchsize) // note: will cause issues if we ever use __synctreads() in forwardlatticej
     {
         msra::lattices::latticefunctionskernels::forwardlatticej(j + startindex, edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns, alignments, alignmentoffsets,
-                                                                 logalphas, lmf, wp, amf, boostingfactor, uids, senone2classmap, returnEframescorrect, logframescorrectedge, logaccalphas);
+                                                                 logalphas, lmf, wp, amf, boostingfactor, uids, senone2classmap, returnEframescorrect, logframescorrectedge, logaccalphas,
+                                                                 0, nodes.size() - 1);
     }
 }
 
@@ -126,7 +127,7 @@ void backwardlatticej(const size_t batchsize, const size_t startindex, const std
         msra::lattices::latticefunctionskernels::backwardlatticej(j + startindex, edgeacscores, spalignunitid, silalignunitid,
                                                                   edges, nodes, aligns, totalfwscore, logpps, logalphas,
                                                                   logbetas, lmf, wp, amf, boostingfactor, returnEframescorrect, logframescorrectedge,
-                                                                  logaccalphas, Eframescorrectbuf, logaccbetas);
+                                                                  logaccalphas, Eframescorrectbuf, logaccbetas, 0, nodes.size() - 1);
     }
 }
 
@@ -397,7 +398,23 @@ struct parallelstateimpl
           errorsignalgpustorage(new Microsoft::MSR::CNTK::Matrix<float>((int) deviceid)),
           errorsignalneggpustorage(new Microsoft::MSR::CNTK::Matrix<float>((int) deviceid)),
           backptrstoragegpu(msra::cuda::newushortvector(deviceid)),
-          backptroffsetsgpu(msra::cuda::newsizetvector(deviceid))
+          backptroffsetsgpu(msra::cuda::newsizetvector(deviceid)),
+          // batched lattices
+          edgelatticegpu(msra::cuda::newuintvector(deviceid)),
+          latticenodeoffsetsgpu(msra::cuda::newuintvector(deviceid)),
+          edgeorderforwardgpu(msra::cuda::newuintvector(deviceid)),
+          edgeorderbackwardgpu(msra::cuda::newuintvector(deviceid)),
+          totalfwscoresgpu(msra::cuda::newdoublevector(deviceid)),
+          totalbwscoresgpu(msra::cuda::newdoublevector(deviceid)),
+          totalfwaccsgpu(msra::cuda::newdoublevector(deviceid)),
+          logEframescorrecttotalsgpu(msra::cuda::newdoublevector(deviceid)),
+          // pruning
+          logbestalphasgpu(msra::cuda::newdoublevector(deviceid)),
+          logbestbetasgpu(msra::cuda::newdoublevector(deviceid)),
+          // reference scores
+          logllsumuidsgpu(msra::cuda::newushortvector(deviceid)),
+          logllsumgpu(msra::cuda::newdoublevector(deviceid)),
+          latticefunctionsgpu(msra::cuda::newlatticefunctions(deviceid))
     {
     }
 
@@ -542,6 +559,27 @@ struct parallelstateimpl
     std::unique_ptr<Microsoft::MSR::CNTK::Matrix<float>> errorsignalgpu;
     std::unique_ptr<Microsoft::MSR::CNTK::Matrix<float>> errorsignalneggpu;
 
+    // batched lattices (forwardbackwardbatch()): the above hold all lattices of the minibatch, concatenated
+    std::unique_ptr<msra::cuda::uintvector> edgelatticegpu;        // [global edge index] -> lattice index
+    std::unique_ptr<msra::cuda::uintvector> latticenodeoffsetsgpu; // [lattice index] -> global index of its first node; one extra element for the end
+    std::unique_ptr<msra::cuda::uintvector> edgeorderforwardgpu;   // global edge indices in the order of the forward launches
+    std::unique_ptr<msra::cuda::uintvector> edgeorderbackwardgpu;  // ... and of the backward launches
+    std::unique_ptr<doublevector> totalfwscoresgpu;                // [lattice index]
+    std::unique_ptr<doublevector> totalbwscoresgpu;
+    std::unique_ptr<doublevector> totalfwaccsgpu;
+    std::unique_ptr<doublevector> logEframescorrecttotalsgpu;
+
+    // beam pruning (parallelstate::setpruningbeam()): best path scores into/out of each node
+    std::unique_ptr<doublevector> logbestalphasgpu;
+    std::unique_ptr<doublevector> logbestbetasgpu;
+
+    // reference scores (getlogllsum()); separate from uidsgpu, which holds the uids of the current lattice
+    std::unique_ptr<ushortvector> logllsumuidsgpu;
+    std::unique_ptr<doublevector> logllsumgpu;
+
+    // the kernel launchers; all device buffers above persist across utterances and minibatches, and only grow
+    std::unique_ptr<latticefunctions> latticefunctionsgpu;
+
     // cache current lattice
     // This is a weird mix of const/non-const and private lattice data... :(
     template <class edgestype, class nodestype, class aligntype, class edgealignments, class backpointers>
@@ -571,6 +609,37 @@ struct parallelstateimpl
         /*cudalogLLs->allocate (logLLs.rows(), logLLs.cols());
             cudalogLLs->assign(0, logLLs.rows(), 0, logLLs.cols(), &logLLs(0,0), logLLs.getcolstride(), true);  // doing this last with 'true' so we can measure time better; maybe remove later*/
     }
+    // cache the concatenated lattices of a minibatch
+    void setbatchdata(const std::vector<msra::lattices::edgeinfowithscores>& edges, const std::vector<msra::lattices::nodeinfo>& nodes,
+                      const std::vector<msra::lattices::aligninfo>& align, const std::vector<unsigned int>& alignoffsets,
+                      const std::vector<unsigned short>& alignments, const std::vector<float>& edgeacscores, const std::vector<size_t>& backptroffsets,
+                      const std::vector<unsigned int>& edgelattice, const std::vector<unsigned int>& latticenodeoffsets,
+                      const std::vector<unsigned int>& edgeorderforward, const std::vector<unsigned int>& edgeorderbackward)
+    {
+        edgesgpu->assign(edges, false);
+        nodesgpu->assign(nodes, false);
+        aligngpu->assign(align, false);
+        alignoffsetsgpu->assign(alignoffsets, false);
+        backptrstoragegpu->allocate(backptroffsets.back());
+        backptroffsetsgpu->assign(backptroffsets, false);
+#ifndef PARALLEL_SIL
+        alignresult->assign(alignments, false);
+        edgeacscoresgpu->assign(edgeacscores, false);
+#else
+        alignresult->allocate(alignments.size());
+        edgeacscoresgpu->allocate(edges.size());
+#endif
+        edgelatticegpu->assign(edgelattice, false);
+        latticenodeoffsetsgpu->assign(latticenodeoffsets, false);
+        edgeorderforwardgpu->assign(edgeorderforward, false);
+        edgeorderbackwardgpu->assign(edgeorderbackward, false);
+
+        const size_t numlattices = latticenodeoffsets.size() - 1;
+        totalfwscoresgpu->allocate(numlattices);
+        totalbwscoresgpu->allocate(numlattices);
+        totalfwaccsgpu->allocate(numlattices);
+        logEframescorrecttotalsgpu->allocate(numlattices);
+    }
     // template<class ElemType>
     void setloglls(const Microsoft::MSR::CNTK::Matrix<float>& loglls)
     {
@@ -580,6 +649,19 @@ struct parallelstateimpl
     {
         loglls = *errorsignalgpu;
     }
+    double getlogllsum(const std::vector<unsigned short>& uids)
+    {
+        if (uids.size() != cudalogLLs->GetNumCols())
+            LogicError("getlogllsum: %d uids for %d frames of LLs", (int) uids.size(), (int) cudalogLLs->GetNumCols());
+        if (uids.empty())
+            return 0.0;
+        logllsumuidsgpu->assign(uids, false);
+        logllsumgpu->allocate(1);
+        latticefunctionsgpu->uidlogllsum(*logllsumuidsgpu, *cudalogLLs, *logllsumgpu);
+        std::vector<double> logllsum(1);
+        logllsumgpu->fetch(logllsum, true);
+        return logllsum[0];
+    }
     template <class edgealignments>
     void copyalignments(edgealignments& edgeAlignments)
     {
@@ -683,6 +765,7 @@ void lattice::parallelstate::release(bool pcpumode)
 lattice::parallelstate::parallelstate()
 {
     pimpl = nullptr;
+    pruningbeam = 0.0f;
 }
 lattice::parallelstate::~parallelstate()
 {
@@ -731,6 +814,11 @@ void lattice::parallelstate::getgamma(Microsoft::MSR::CNTK::Matrix<double>& /*lo
     throw ::logic_error("Double precision not supported for sequence training");
 }
 
+double lattice::parallelstate::getlogllsum(const std::vector<unsigned short>& uids)
+{
+    return pimpl->getlogllsum(uids);
+}
+
 // -----------------------------------------------------------------------
 // parallel implementations of key processing steps
 // -----------------------------------------------------------------------
@@ -749,8 +837,7 @@ void lattice::parallelforwardbackwardalign(parallelstate& parallelstate,
                                         edgeacscores, edgealignments, backpointers); // inouts
 
         // launch the kernel
-        std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice()));
-        latticefunctions->edgealignment(*parallelstate->hmmsgpu.get(), *parallelstate->lr3transPgpu.get(),
+        parallelstate->latticefunctionsgpu->edgealignment(*parallelstate->hmmsgpu.get(), *parallelstate->lr3transPgpu.get(),
                                         parallelstate->spalignunitid, parallelstate->silalignunitid,
                                         *parallelstate->cudalogLLs.get(), *parallelstate->nodesgpu.get(),
                                         *parallelstate->edgesgpu.get(), *parallelstate->aligngpu.get(),
@@ -774,16 +861,11 @@ void lattice::parallelforwardbackwardalign(parallelstate& parallelstate,
     }
 }
 
-// parallelforwardbackwardlattice() -- compute the latticelevel logpps using forwardbackward
-double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, const std::vector<float>& edgeacscores,
-                                               const edgealignments& thisedgealignments, const float lmf, const float wp,
-                                               const float amf, const float boostingfactor, std::vector<double>& logpps,
-                                               std::vector<double>& logalphas, std::vector<double>& logbetas, const bool returnEframescorrect,
-                                               const_array_ref<size_t>& uids, std::vector<double>& logEframescorrect,
-                                               std::vector<double>& Eframescorrectbuf, double& logEframescorrecttotal) const
-{                                     // ^^ TODO: remove this
-    vector<size_t> batchsizeforward;  // record the batch size that exclude the data dependency for forward
-    vector<size_t> batchsizebackward; // record the batch size that exclude the data dependency for backward
+// getlaunchbatches() -- determine the batch sizes that exclude the data dependency for the forward and backward launches
+void lattice::getlaunchbatches(std::vector<size_t>& batchsizeforward, std::vector<size_t>& batchsizebackward) const
+{
+    batchsizeforward.clear();
+    batchsizebackward.clear();
 
     size_t endindexforward = edges[0].E;
     size_t countbatchforward = 0;
@@ -816,6 +898,19 @@ double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, con
     }
     batchsizeforward.push_back(countbatchforward);
     batchsizebackward.push_back(countbatchbackward);
+}
+
+// parallelforwardbackwardlattice() -- compute the latticelevel logpps using forwardbackward
+double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, const std::vector<float>& edgeacscores,
+                                               const edgealignments& thisedgealignments, const float lmf, const float wp,
+                                               const float amf, const float boostingfactor, std::vector<double>& logpps,
+                                               std::vector<double>& logalphas, std::vector<double>& logbetas, const bool returnEframescorrect,
+                                               const_array_ref<size_t>& uids, std::vector<double>& logEframescorrect,
+                                               std::vector<double>& Eframescorrectbuf, double& logEframescorrecttotal) const
+{                                     // ^^ TODO: remove this
+    vector<size_t> batchsizeforward;  // record the batch size that exclude the data dependency for forward
+    vector<size_t> batchsizebackward; // record the batch size that exclude the data dependency for backward
+    getlaunchbatches(batchsizeforward, batchsizebackward);
 
     std::vector<unsigned short> uidsuint(uids.size()); // actually we shall not do this, but as it will not take much time, let us just leave it here now.
     foreach_index (i, uidsuint)
@@ -832,8 +927,17 @@ double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, con
         const bool allocateaccvectors = returnEframescorrect;
         parallelstate->allocfwbwvectors(edges, nodes, uidsuint, allocateframescorrect, copyuids, allocateaccvectors);
 
-        std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice())); // final CUDA call
-        latticefunctions->forwardbackwardlattice(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
+        if (parallelstate.getpruningbeam() > 0.0f)
+        {
+            parallelstate->logbestalphasgpu->allocate(nodes.size());
+            parallelstate->logbestbetasgpu->allocate(nodes.size());
+            parallelstate->latticefunctionsgpu->prunelattice(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
+                                                             *parallelstate->edgeacscoresgpu.get(), *parallelstate->edgesgpu.get(), *parallelstate->nodesgpu.get(),
+                                                             *parallelstate->logbestalphasgpu.get(), *parallelstate->logbestbetasgpu.get(),
+                                                             lmf, wp, amf, parallelstate.getpruningbeam());
+        }
+
+        parallelstate->latticefunctionsgpu->forwardbackwardlattice(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
                                                  parallelstate->spalignunitid, parallelstate->silalignunitid,
                                                  *parallelstate->edgeacscoresgpu.get(), *parallelstate->edgesgpu.get(),
                                                  *parallelstate->nodesgpu.get(), *parallelstate->aligngpu.get(),
@@ -904,16 +1008,12 @@ void lattice::parallelsMBRerrorsignal(parallelstate& parallelstate, const edgeal
         const bool cacheerrorsignalneg = true;
         parallelstate->cacheerrorsignal(errorsignal, cacheerrorsignalneg);
 
-        std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice()));
-        latticefunctions->sMBRerrorsignal(*parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(), *parallelstate->edgesgpu.get(),
+        parallelstate->latticefunctionsgpu->sMBRerrorsignal(*parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(), *parallelstate->edgesgpu.get(),
                                           *parallelstate->nodesgpu.get(), *parallelstate->logppsgpu.get(), amf, *parallelstate->logEframescorrectgpu.get(),
                                           logEframescorrecttotal,
                                           *parallelstate->errorsignalgpu.get(), *parallelstate->errorsignalneggpu.get());
 
-        if (errorsignal.rows() > 0 && errorsignal.cols() > 0)
-        {
-            parallelstate->errorsignalgpu->CopySection(errorsignal.rows(), errorsignal.cols(), &errorsignal(0, 0), errorsignal.getcolstride());
-        }
+        // the error signal stays on the GPU, where getgamma() picks it up; 'errorsignal' only provides its dimensions
     }
     else
     {
@@ -932,8 +1032,7 @@ void lattice::parallelmmierrorsignal(parallelstate& parallelstate, const edgeali
         const bool cacheerrorsignalneg = false; // we do not need it in mmi mode
         parallelstate->cacheerrorsignal(errorsignal, cacheerrorsignalneg);
 
-        std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice()));
-        latticefunctions->mmierrorsignal(*parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(), *parallelstate->edgesgpu.get(),
+        parallelstate->latticefunctionsgpu->mmierrorsignal(*parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(), *parallelstate->edgesgpu.get(),
                                          *parallelstate->nodesgpu.get(), *parallelstate->logppsgpu.get(), *parallelstate->errorsignalgpu.get());
 
         // parallelstate->errorsignalgpu->fetch (0, errorsignal.rows(), 0, errorsignal.cols(), &errorsignal(0, 0), errorsignal.getcolstride(), true);
@@ -943,5 +1042,234 @@ void lattice::parallelmmierrorsignal(parallelstate& parallelstate, const edgeali
         emulatemmierrorsignal(thisedgealignments.getalignmentsbuffer(), thisedgealignments.getalignoffsets(), edges, nodes, logpps, errorsignal);
     }
 }
+
+// ------------------------------------------------------------------------
+// batched forward-backward for all lattices of a minibatch
+// ------------------------------------------------------------------------
+
+// The lattices are concatenated into one set of lattice arrays: node indices, alignment indices, and alignment/backpointer
+// offsets are shifted by the sizes of the preceding lattices, and node times by their frames, so that lattice i refers to the
+// columns of logLLs that belong to utterance i. Since the lattices are independent of each other, launch k of the forward (backward)
+// pass processes level k of all lattices; the global edge indices of each launch are passed to the kernels in edgeorderforward (-backward).
+// Everything that is per utterance in the single-lattice version (total forward score, expected frames correct) is kept per lattice.
+/*static*/ bool lattice::forwardbackwardbatch(parallelstate& parallelstate, const std::vector<const lattice*>& lattices,
+                                               const msra::math::ssematrixbase& logLLs, const msra::asr::simplesenonehmm& hset,
+                                               const msra::math::ssematrixbase& result, const float lmf, const float wp, const float amf,
+                                               const float boostingfactor, const bool sMBRmode, const_array_ref<size_t> uids, std::vector<double>& avlogps)
+{
+    if (!parallelstate.enabled() || parallelstate->emulation || lattices.empty())
+        return false;
+
+    size_t numnodes = 0;
+    size_t numaligns = 0;
+    size_t numframes = 0;
+    foreach_index (i, lattices)
+    {
+        numnodes += lattices[i]->nodes.size();
+        numaligns += lattices[i]->align.size();
+        numframes += lattices[i]->info.numframes;
+    }
+    if (numframes != logLLs.cols() || numframes != uids.size())
+        LogicError("forwardbackwardbatch: #frames mismatch between lattices (%d) and LLs (%d) or uids (%d)", (int) numframes, (int) logLLs.cols(), (int) uids.size());
+    // global indices must fit into the bit fields of edgeinfo (S, E: 19 bits; firstalign: 24 bits) and nodeinfo (t: 16 bits)
+    if (numnodes > (1 << 19) || numaligns >= (1 << 24) || numframes > 0xffff)
+        return false;
+
+    parallelstate->validatehset(hset); // ensure the models have been correctly cached on the GPU already
+
+    // concatenate the lattices
+    const size_t numlattices = lattices.size();
+    std::vector<msra::lattices::edgeinfowithscores> alledges;
+    std::vector<msra::lattices::nodeinfo> allnodes;
+    std::vector<msra::lattices::aligninfo> allalign;
+    std::vector<unsigned int> alignoffsets; // [global edge index] -> offset into alignments; one extra element for the end
+    std::vector<unsigned short> alignments; // all edge alignments concatenated
+    std::vector<float> edgeacscores;        // [global edge index]
+    std::vector<size_t> backptroffsets;     // [global edge index] -> offset into the GPU-side backpointer buffer; one extra element for the end
+    std::vector<unsigned int> edgelattice;  // [global edge index] -> lattice index
+    std::vector<unsigned int> latticenodeoffsets(1, 0);
+    std::vector<size_t> latticeedgeoffsets(1, 0);
+    std::vector<std::vector<size_t>> latticebatchsizesforward(numlattices);
+    std::vector<std::vector<size_t>> latticebatchsizesbackward(numlattices);
+    allnodes.reserve(numnodes);
+    allalign.reserve(numaligns);
+    size_t backptrbufsize = 0;
+    size_t ts = 0; // first frame of current lattice
+    for (size_t i = 0; i < numlattices; i++)
+    {
+        const lattice& L = *lattices[i];
+
+        // align the edges that the GPU does not handle, as in forwardbackwardalign()
+        edgealignments thisedgealignments(L);
+        backpointers thisbackpointers(L, hset);
+        std::vector<float> thisedgeacscores;
+        const auto latticeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase&>(logLLs), ts, L.info.numframes);
+        L.alignedgesoncpu(parallelstate, hset, thisedgeacscores, latticeLLs, thisedgealignments);
+        thisedgeacscores.resize(L.edges.size());
+
+        const size_t nodebase = allnodes.size();
+        const size_t alignbase = allalign.size();
+        const size_t alignmentbase = alignments.size();
+        foreach_index (j, L.edges)
+        {
+            msra::lattices::edgeinfowithscores e = L.edges[j];
+            e.S = e.S + nodebase;
+            e.E = e.E + nodebase;
+            e.firstalign = e.firstalign + alignbase;
+            alledges.push_back(e);
+            edgelattice.push_back((unsigned int) i);
+            alignoffsets.push_back((unsigned int) (thisedgealignments.getalignoffsets()[j] + alignmentbase));
+            backptroffsets.push_back(thisbackpointers.getbackptroffsets()[j] + backptrbufsize);
+        }
+        foreach_index (k, L.nodes)
+        {
+            msra::lattices::nodeinfo node = L.nodes[k];
+            node.t = (unsigned short) (node.t + ts);
+            allnodes.push_back(node);
+        }
+        allalign.insert(allalign.end(), L.align.begin(), L.align.end());
+        const auto& thisalignments = thisedgealignments.getalignmentsbuffer();
+        alignments.insert(alignments.end(), thisalignments.begin(), thisalignments.end());
+        edgeacscores.insert(edgeacscores.end(), thisedgeacscores.begin(), thisedgeacscores.end());
+        backptrbufsize += thisbackpointers.getbackptrstoragesize();
+
+        latticenodeoffsets.push_back((unsigned int) allnodes.size());
+        latticeedgeoffsets.push_back(alledges.size());
+        L.getlaunchbatches(latticebatchsizesforward[i], latticebatchsizesbackward[i]);
+        ts += L.info.numframes;
+    }
+    alignoffsets.push_back((unsigned int) alignments.size());
+    backptroffsets.push_back(backptrbufsize);
+
+    // merge level k of all lattices into launch k
+    std::vector<size_t> batchsizeforward;
+    std::vector<size_t> batchsizebackward;
+    std::vector<unsigned int> edgeorderforward;
+    std::vector<unsigned int> edgeorderbackward;
+    edgeorderforward.reserve(alledges.size());
+    edgeorderbackward.reserve(alledges.size());
+    std::vector<size_t> forwardcursor(latticeedgeoffsets.begin(), latticeedgeoffsets.end() - 1);  // forward launches go through the edges of a lattice from its start
+    std::vector<size_t> backwardcursor(latticeedgeoffsets.begin() + 1, latticeedgeoffsets.end()); // backward launches from its end
+    for (size_t k = 0;; k++)
+    {
+        const size_t forwardbegin = edgeorderforward.size();
+        const size_t backwardbegin = edgeorderbackward.size();
+        bool done = true;
+        for (size_t i = 0; i < numlattices; i++)
+        {
+            if (k < latticebatchsizesforward[i].size())
+            {
+                for (size_t n = 0; n < latticebatchsizesforward[i][k]; n++)
+                    edgeorderforward.push_back((unsigned int) forwardcursor[i]++);
+                done = false;
+            }
+            if (k < latticebatchsizesbackward[i].size())
+            {
+                for (size_t n = 0; n < latticebatchsizesbackward[i][k]; n++)
+                    edgeorderbackward.push_back((unsigned int) --backwardcursor[i]);
+                done = false;
+            }
+        }
+        if (done)
+            break;
+        if (edgeorderforward.size() > forwardbegin)
+            batchsizeforward.push_back(edgeorderforward.size() - forwardbegin);
+        if (edgeorderbackward.size() > backwardbegin)
+            batchsizebackward.push_back(edgeorderbackward.size() - backwardbegin);
+    }
+
+    std::vector<unsigned short> uidsuint(uids.size());
+    foreach_index (i, uidsuint)
+        uidsuint[i] = (unsigned short) uids[i];
+
+    // move the lattices to the GPU
+    parallelstate->setbatchdata(alledges, allnodes, allalign, alignoffsets, alignments, edgeacscores, backptroffsets,
+                                edgelattice, latticenodeoffsets, edgeorderforward, edgeorderbackward);
+
+    // PHASE 1: per-edge alignment of all lattices
+    auto& latticefunctions = parallelstate->latticefunctionsgpu;
+    latticefunctions->edgealignment(*parallelstate->hmmsgpu.get(), *parallelstate->lr3transPgpu.get(),
+                                    parallelstate->spalignunitid, parallelstate->silalignunitid,
+                                    *parallelstate->cudalogLLs.get(), *parallelstate->nodesgpu.get(),
+                                    *parallelstate->edgesgpu.get(), *parallelstate->aligngpu.get(),
+                                    *parallelstate->alignoffsetsgpu.get(),
+                                    *parallelstate->backptrstoragegpu.get(), *parallelstate->backptroffsetsgpu.get(),
+                                    *parallelstate->alignresult.get(), *parallelstate->edgeacscoresgpu.get());
+
+    // PHASE 2: lattice-level forward backward of all lattices, after pruning each against its own best path
+    if (parallelstate.getpruningbeam() > 0.0f)
+    {
+        parallelstate->logbestalphasgpu->allocate(allnodes.size());
+        parallelstate->logbestbetasgpu->allocate(allnodes.size());
+        latticefunctions->prunelatticebatch(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
+                                            *parallelstate->edgeorderforwardgpu.get(), *parallelstate->edgeorderbackwardgpu.get(),
+                                            *parallelstate->edgelatticegpu.get(), *parallelstate->latticenodeoffsetsgpu.get(),
+                                            *parallelstate->edgeacscoresgpu.get(), *parallelstate->edgesgpu.get(), *parallelstate->nodesgpu.get(),
+                                            *parallelstate->logbestalphasgpu.get(), *parallelstate->logbestbetasgpu.get(),
+                                            lmf, wp, amf, parallelstate.getpruningbeam());
+    }
+    const bool allocateframescorrect = (sMBRmode || boostingfactor != 0.0f);
+    parallelstate->allocfwbwvectors(alledges, allnodes, uidsuint, allocateframescorrect, allocateframescorrect /*copyuids*/, sMBRmode /*allocateaccvectors*/);
+    latticefunctions->forwardbackwardlatticebatch(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
+                                                  *parallelstate->edgeorderforwardgpu.get(), *parallelstate->edgeorderbackwardgpu.get(),
+                                                  *parallelstate->edgelatticegpu.get(), *parallelstate->latticenodeoffsetsgpu.get(),
+                                                  parallelstate->spalignunitid, parallelstate->silalignunitid,
+                                                  *parallelstate->edgeacscoresgpu.get(), *parallelstate->edgesgpu.get(),
+                                                  *parallelstate->nodesgpu.get(), *parallelstate->aligngpu.get(),
+                                                  *parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(),
+                                                  *parallelstate->logppsgpu.get(), *parallelstate->logalphasgpu.get(),
+                                                  *parallelstate->logbetasgpu.get(), lmf, wp, amf, boostingfactor,
+                                                  sMBRmode, *parallelstate->uidsgpu.get(), *parallelstate->senone2classmapgpu.get(),
+                                                  *parallelstate->logaccalphasgpu.get(), *parallelstate->logaccbetasgpu.get(),
+                                                  *parallelstate->logframescorrectedgegpu.get(), *parallelstate->logEframescorrectgpu.get(),
+                                                  *parallelstate->totalfwscoresgpu.get(), *parallelstate->totalbwscoresgpu.get(),
+                                                  *parallelstate->totalfwaccsgpu.get(), *parallelstate->logEframescorrecttotalsgpu.get());
+
+    // PHASE 3: state-level posteriors (MMI) or error signal (sMBR) for all frames
+    if (!sMBRmode)
+    {
+        parallelstate->cacheerrorsignal(result, false /*cacheerrorsignalneg*/);
+        latticefunctions->mmierrorsignal(*parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(), *parallelstate->edgesgpu.get(),
+                                         *parallelstate->nodesgpu.get(), *parallelstate->logppsgpu.get(), *parallelstate->errorsignalgpu.get());
+    }
+    else
+    {
+        parallelstate->cacheerrorsignal(result, true /*cacheerrorsignalneg*/);
+        latticefunctions->sMBRerrorsignalbatch(*parallelstate->alignresult.get(), *parallelstate->alignoffsetsgpu.get(), *parallelstate->edgesgpu.get(),
+                                               *parallelstate->nodesgpu.get(), *parallelstate->logppsgpu.get(), amf, *parallelstate->logEframescorrectgpu.get(),
+                                               *parallelstate->edgelatticegpu.get(), *parallelstate->logEframescorrecttotalsgpu.get(),
+                                               *parallelstate->errorsignalgpu.get(), *parallelstate->errorsignalneggpu.get());
+    }
+
+    // per-lattice return values, as forwardbackward() computes them
+    std::vector<double> totalfwscores, totalbwscores, totalfwaccs, logEframescorrecttotals;
+    parallelstate->totalfwscoresgpu->fetch(totalfwscores, true);
+    parallelstate->totalbwscoresgpu->fetch(totalbwscores, true);
+    if (sMBRmode)
+    {
+        parallelstate->totalfwaccsgpu->fetch(totalfwaccs, true);
+        parallelstate->logEframescorrecttotalsgpu->fetch(logEframescorrecttotals, true);
+    }
+    avlogps.resize(numlattices);
+    for (size_t i = 0; i < numlattices; i++)
+    {
+        const lattice& L = *lattices[i];
+        if (fabs(totalfwscores[i] - totalbwscores[i]) / L.nodes.size() > 1e-4)
+            fprintf(stderr, "forwardbackward: WARNING: lattice fw and bw scores %.10f vs. %.10f (%d nodes/%d edges)\n", (float) totalfwscores[i], (float) totalbwscores[i], (int) L.nodes.size(), (int) L.edges.size());
+        if (sMBRmode && fabs(totalfwaccs[i] - logEframescorrecttotals[i]) / L.nodes.size() > 1e-4)
+            fprintf(stderr, "forwardbackward: WARNING: lattice fw and bw acc %.10f vs. %.10f (%d nodes/%d edges)\n", (float) totalfwaccs[i], (float) logEframescorrecttotals[i], (int) L.nodes.size(), (int) L.edges.size());
+
+        if (totalfwscores[i] < LOGZERO / 2)
+        {
+            fprintf(stderr, "forwardbackward: WARNING: no path found in lattice (%d nodes/%d edges)\n", (int) L.nodes.size(), (int) L.edges.size());
+            avlogps[i] = LOGZERO; // failed, do not use resulting matrix
+        }
+        else if (!sMBRmode)
+            avlogps[i] = totalfwscores[i] / L.info.numframes; // av. posterior
+        else
+            avlogps[i] = exp(logEframescorrecttotals[i]) / L.info.numframes; // av. expected frame-correct count
+    }
+    return true;
+}
 };
 };
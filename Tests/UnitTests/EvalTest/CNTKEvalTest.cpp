@@ -5,6 +5,7 @@
 #include "Eval.h"
 #include "DataReader.h"
 #include "Config.h"
+#include "EvalBenchmark.h"
 using namespace Microsoft::MSR::CNTK;
 
 // process the command
@@ -13,6 +14,15 @@ void DoCommand(const ConfigParameters& configRoot)
 {
     ConfigArray command = configRoot("command", "train");
     ConfigParameters config = configRoot(command[0]);
+
+    // action=benchmark measures the latency and throughput of a model instead (see EvalBenchmark.h)
+    std::string action = config("action", "");
+    if (action == "benchmark")
+    {
+        DoBenchmark<ElemType>(config);
+        return;
+    }
+
     ConfigParameters readerConfig(config("reader"));
     readerConfig.Insert("traceLevel", config("traceLevel", "0"));
 
@@ -0,0 +1,299 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBenchmark.cpp -- latency and throughput of a model served through the EvalDll API (see EvalBenchmark.h)
+//
+
+#include "stdafx.h"
+#include "Eval.h"
+#include "Config.h"
+#include "fileutil.h"
+#include "EvalBenchmark.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <exception>
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// resident memory of the process, in bytes (0 if unknown)
+static size_t GetResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#else
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == nullptr)
+        return 0;
+    long pages = 0, residentPages = 0;
+    if (fscanf(f, "%ld %ld", &pages, &residentPages) != 2)
+        residentPages = 0;
+    fclose(f);
+    return (size_t) residentPages * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static double ToMB(size_t bytes0, size_t bytes1)
+{
+    return ((double) bytes1 - (double) bytes0) / (1024 * 1024);
+}
+
+// nearest-rank percentile of sorted values
+static double Percentile(const vector<double>& sorted, double percent)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t) ceil(percent / 100 * sorted.size());
+    return sorted[max(rank, (size_t) 1) - 1];
+}
+
+static string JsonString(const string& s)
+{
+    string escaped = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+struct BenchmarkRequest
+{
+    double m_arrivalMs; // since the start of the measurement; < 0 if sent as soon as a client is free (closed loop)
+    size_t m_numSamples;
+};
+
+// the requests to measure, from the trace file or synthetic
+static vector<BenchmarkRequest> GetRequests(const ConfigParameters& config)
+{
+    vector<BenchmarkRequest> requests;
+    wstring traceFile = config(L"traceFile", L"");
+    if (!traceFile.empty())
+    {
+        for (msra::files::textreader reader(traceFile); reader;)
+        {
+            string line = reader.getline();
+            if (line.empty() || line[0] == '#')
+                continue;
+            BenchmarkRequest request;
+            unsigned long numSamples = 0;
+            if (sscanf(line.c_str(), "%lf %lu", &request.m_arrivalMs, &numSamples) != 2 || request.m_arrivalMs < 0 || numSamples == 0)
+                InvalidArgument("traceFile: '%s' is not '<arrival time in ms> <number of samples>'.", line.c_str());
+            request.m_numSamples = numSamples;
+            requests.push_back(request);
+        }
+        sort(requests.begin(), requests.end(), [](const BenchmarkRequest& a, const BenchmarkRequest& b)
+             {
+                 return a.m_arrivalMs < b.m_arrivalMs;
+             });
+    }
+    else
+    {
+        ConfigArray samplesPerRequest = config("samplesPerRequest", "1");
+        size_t numRequests = config(L"numRequests", (size_t) 1000);
+        double requestRate = config(L"requestRate", 0.0);
+        mt19937 rng((unsigned int) config(L"randomSeed", (size_t) 1));
+        exponential_distribution<double> interArrivalSeconds(requestRate > 0 ? requestRate : 1);
+        double arrivalMs = 0;
+        for (size_t i = 0; i < numRequests; i++)
+        {
+            BenchmarkRequest request;
+            request.m_numSamples = samplesPerRequest[i % samplesPerRequest.size()];
+            if (request.m_numSamples == 0)
+                InvalidArgument("samplesPerRequest: The numbers of samples must be positive.");
+            request.m_arrivalMs = -1;
+            if (requestRate > 0)
+            {
+                arrivalMs += interArrivalSeconds(rng) * 1000;
+                request.m_arrivalMs = arrivalMs;
+            }
+            requests.push_back(request);
+        }
+    }
+    if (requests.empty())
+        InvalidArgument("benchmark: There are no requests to send.");
+    return requests;
+}
+
+// one client thread's evaluator, and its buffers for each request size
+template <typename ElemType>
+struct BenchmarkClient
+{
+    IEvaluateModel<ElemType>* m_eval;
+    map<size_t, map<wstring, vector<ElemType>>> m_inputValues;  // [numSamples][input node name]
+    map<size_t, vector<ElemType>> m_outputValues;                // [numSamples]
+    map<size_t, map<wstring, vector<ElemType>*>> m_inputs;      // (pointers to the above, as Evaluate() takes them)
+    map<size_t, map<wstring, vector<ElemType>*>> m_outputs;
+
+    void Evaluate(size_t numSamples)
+    {
+        m_eval->Evaluate(m_inputs[numSamples], m_outputs[numSamples]);
+    }
+};
+
+template <typename ElemType>
+void DoBenchmark(const ConfigParameters& config)
+{
+    vector<BenchmarkRequest> requests = GetRequests(config);
+    set<size_t> sizes;
+    for (const auto& request : requests)
+        sizes.insert(request.m_numSamples);
+    size_t concurrency = max(config(L"concurrency", (size_t) 1), (size_t) 1);
+    bool shareEvaluator = config(L"shareEvaluator", false);
+    if (shareEvaluator && config(L"maxBatchSize", (size_t) 0) == 0)
+        InvalidArgument("shareEvaluator: Concurrent requests to one evaluator require maxBatchSize > 0.");
+    size_t warmupRequests = config(L"warmupRequests", (size_t) 10);
+    if (!config.Exists("modelPath"))
+        InvalidArgument("benchmark: modelPath is required.");
+
+    // load the model (the evaluator reads all settings, including modelPath, from this section) and create the instances
+    ConfigParameters evalConfig(config);
+    size_t memoryBefore = GetResidentMemory();
+    Eval<ElemType> eval(evalConfig);
+    size_t memoryLoaded = GetResidentMemory();
+    vector<BenchmarkClient<ElemType>> clients(concurrency);
+    for (size_t c = 0; c < concurrency; c++)
+        clients[c].m_eval = (c == 0 || shareEvaluator) ? &eval : eval.CloneEvaluator();
+    size_t memoryCloned = GetResidentMemory();
+    const size_t numInstances = shareEvaluator ? 1 : concurrency;
+
+    map<wstring, size_t> inputDimensions, outputDimensions;
+    eval.GetNodeDimensions(inputDimensions, nodeInput);
+    eval.GetNodeDimensions(outputDimensions, nodeOutput);
+    wstring outputNodeName = config(L"outputNodeName", outputDimensions.empty() ? L"" : outputDimensions.begin()->first);
+    if (outputDimensions.find(outputNodeName) == outputDimensions.end())
+        InvalidArgument("outputNodeName: '%ls' is not an output node of the model.", outputNodeName.c_str());
+
+    // (after all clones were made, see CloneEvaluator())
+    for (size_t c = 0; c < numInstances; c++)
+        clients[c].m_eval->StartEvaluateMinibatchLoop(outputNodeName);
+    mt19937 rng((unsigned int) config(L"randomSeed", (size_t) 1));
+    uniform_real_distribution<double> uniform(-1, 1);
+    for (auto& client : clients)
+    {
+        for (size_t n : sizes)
+        {
+            for (const auto& input : inputDimensions)
+            {
+                auto& values = client.m_inputValues[n][input.first];
+                values.resize(input.second * n);
+                for (auto& value : values)
+                    value = (ElemType) uniform(rng);
+                client.m_inputs[n][input.first] = &values;
+            }
+            client.m_outputs[n][outputNodeName] = &client.m_outputValues[n];
+        }
+    }
+
+    // warm up each instance with all sizes, the first one on its own to tell its memory from that of the clones
+    size_t memoryFirstWarm = 0;
+    for (size_t c = 0; c < numInstances; c++)
+    {
+        for (size_t w = 0; w < warmupRequests; w++)
+            for (size_t n : sizes)
+                clients[c].Evaluate(n);
+        if (c == 0)
+            memoryFirstWarm = GetResidentMemory();
+    }
+    size_t memoryWarm = GetResidentMemory();
+
+    // measure: each client takes the next request, waits for its arrival time (if any), and sends it
+    vector<double> latenciesMs(requests.size());
+    atomic<size_t> nextRequest(0);
+    atomic<bool> failed(false); // the other clients stop at their next request
+    mutex failureMutex;
+    exception_ptr failure;
+    auto start = chrono::steady_clock::now();
+    auto runClient = [&](BenchmarkClient<ElemType>& client)
+    {
+        try
+        {
+            for (size_t i = nextRequest++; i < requests.size() && !failed; i = nextRequest++)
+            {
+                const auto& request = requests[i];
+                auto sent = chrono::steady_clock::now();
+                if (request.m_arrivalMs >= 0)
+                {
+                    sent = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(request.m_arrivalMs));
+                    this_thread::sleep_until(sent);
+                }
+                client.Evaluate(request.m_numSamples);
+                latenciesMs[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - sent).count();
+            }
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(failureMutex);
+            if (!failed)
+                failure = current_exception();
+            failed = true;
+        }
+    };
+    vector<thread> threads;
+    for (size_t c = 1; c < concurrency; c++)
+        threads.push_back(thread(runClient, ref(clients[c])));
+    runClient(clients[0]);
+    for (auto& t : threads)
+        t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (size_t c = 1; c < concurrency; c++)
+    {
+        if (clients[c].m_eval != &eval)
+            clients[c].m_eval->Destroy();
+    }
+    if (failure)
+        rethrow_exception(failure);
+
+    // report
+    size_t numSamples = 0;
+    for (const auto& request : requests)
+        numSamples += request.m_numSamples;
+    vector<double> sorted(latenciesMs);
+    sort(sorted.begin(), sorted.end());
+    double meanMs = 0;
+    for (double latency : sorted)
+        meanMs += latency / sorted.size();
+    const double firstInstanceMB = ToMB(memoryBefore, memoryLoaded) + ToMB(memoryCloned, memoryFirstWarm);
+    const double perCloneMB = numInstances > 1 ? (ToMB(memoryLoaded, memoryCloned) + ToMB(memoryFirstWarm, memoryWarm)) / (numInstances - 1) : 0;
+
+    string result = msra::strfun::strprintf("{\"label\": %s, \"model\": %s, \"precision\": %s, \"deviceId\": %s, \"concurrency\": %d, \"instances\": %d, "
+                                            "\"requests\": %d, \"samples\": %d, \"seconds\": %.3f, \"requestsPerSecond\": %.2f, \"samplesPerSecond\": %.2f, "
+                                            "\"latencyMs\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+                                            "\"memoryMB\": {\"firstInstance\": %.1f, \"perClone\": %.1f, \"total\": %.1f}}",
+                                            JsonString(config("label", "")).c_str(), JsonString(config("modelPath")).c_str(),
+                                            JsonString(sizeof(ElemType) == sizeof(float) ? "float" : "double").c_str(), JsonString(config("deviceId", "auto")).c_str(),
+                                            (int) concurrency, (int) numInstances, (int) requests.size(), (int) numSamples, seconds,
+                                            requests.size() / seconds, numSamples / seconds,
+                                            meanMs, Percentile(sorted, 50), Percentile(sorted, 90), Percentile(sorted, 99), sorted.back(),
+                                            firstInstanceMB, perCloneMB, ToMB(memoryBefore, memoryWarm));
+    fprintf(stderr, "benchmark: %d requests in %.3f s, latency p50 %.3f ms, p90 %.3f ms, p99 %.3f ms\n",
+            (int) requests.size(), seconds, Percentile(sorted, 50), Percentile(sorted, 90), Percentile(sorted, 99));
+    printf("%s\n", result.c_str());
+    fflush(stdout);
+
+    wstring resultFile = config(L"resultFile", L"");
+    if (!resultFile.empty())
+    {
+        FILE* f = fopenOrDie(resultFile, L"a");
+        fprintf(f, "%s\n", result.c_str());
+        fclose(f);
+    }
+}
+
+template void DoBenchmark<float>(const ConfigParameters& config);
+template void DoBenchmark<double>(const ConfigParameters& config);
+} } }
@@ -0,0 +1,39 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBenchmark.h -- latency and throughput of a model served through the EvalDll API (action=benchmark)
+//
+// The benchmark loads a model, sends it requests of a given number of samples each from 'concurrency' client threads, and
+// reports the latency percentiles, the throughput, and the memory per evaluator instance, as one JSON line (also appended to
+// 'resultFile'), so that runs with different evaluator settings can be compared and tracked over time.
+// All keys of the command section are also passed to the evaluator, so that the serving options under test (deviceId,
+// maxBatchSize, quantizeWeightsToInt8, packWeightsForInference, warmupNumSamples, ...) are set there.
+//
+// modelPath - the model to evaluate
+// outputNodeName - the node to evaluate (default: the first output node)
+// samplesPerRequest - numbers of samples of the synthetic requests, used in turn (default 1), e.g. 1:4:16
+// numRequests - number of synthetic requests to measure (default 1000)
+// requestRate - synthetic requests per second, arriving at random (Poisson); 0 (default) sends each client's next
+//               request as soon as its previous one has returned (closed loop)
+// traceFile - replay recorded requests instead: one line per request, "<arrival time in ms> <number of samples>", sent at
+//             their arrival times; the latency includes the time a request waits for a free client
+// concurrency - number of client threads (default 1)
+// shareEvaluator - all clients send to one evaluator, which merges their requests (requires maxBatchSize > 0);
+//                  otherwise (default) each client has an evaluator cloned from the first one
+// warmupRequests - requests per client before the measurement, not measured (default 10)
+// label - a name of the run, written into the result (e.g. the setting under test)
+// resultFile - file the result line is appended to
+//
+// The inputs are random; only their sizes matter for the latency of models without data-dependent control flow.
+//
+
+#pragma once
+
+#include "Config.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <typename ElemType>
+void DoBenchmark(const ConfigParameters& config);
+} } }
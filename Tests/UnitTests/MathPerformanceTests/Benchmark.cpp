@@ -0,0 +1,233 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "Basics.h"
+#include "MatrixQuantizerImpl.h" // for MatrixComputeStreamEvent
+#include "TimerUtility.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static void SynchronizeDevice(DEVICEID_TYPE deviceId)
+{
+    if (deviceId >= 0)
+    {
+        std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+        mainStreamSyncEvent->SynchronizeEvent();
+    }
+}
+
+static std::string DeviceName(DEVICEID_TYPE deviceId)
+{
+    return deviceId < 0 ? "CPU" : msra::strfun::strprintf("GPU%d", (int) deviceId);
+}
+
+// two-sided 95% quantile of Student's t distribution with 'df' degrees of freedom
+static double StudentT95(size_t df)
+{
+    static const double quantiles[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                       2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                       2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    const size_t numQuantiles = sizeof(quantiles) / sizeof(*quantiles);
+    if (df == 0)
+        return 0; // (a single sample has no interval)
+    if (df <= numQuantiles)
+        return quantiles[df - 1];
+    return 1.960 + (quantiles[numQuantiles - 1] - 1.960) * numQuantiles / df; // close enough to the exact values beyond 30
+}
+
+BenchmarkRunner::BenchmarkRunner(const BenchmarkOptions& options)
+    : m_options(options)
+{
+}
+
+bool BenchmarkRunner::IsSelected(const std::string& name) const
+{
+    if (m_options.m_filters.empty())
+        return true;
+    for (const auto& filter : m_options.m_filters)
+    {
+        if (name.find(filter) != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+void BenchmarkRunner::Run(const std::string& name, DEVICEID_TYPE deviceId, BenchmarkUnit unit, double work, const std::function<void()>& body)
+{
+    if (!IsSelected(name))
+        return;
+
+    try
+    {
+        Timer timer;
+        auto timeCalls = [&](size_t numCalls)
+        {
+            SynchronizeDevice(deviceId);
+            timer.Restart();
+            for (size_t i = 0; i < numCalls; i++)
+                body();
+            SynchronizeDevice(deviceId);
+            timer.Stop();
+            return timer.ElapsedSeconds();
+        };
+
+        // the first call warms up, the second one tells how many calls make a sample
+        timeCalls(1);
+        double secondsPerCall = std::max(timeCalls(1), 1e-7);
+        size_t numCallsPerSample = (size_t) std::min(1e6, std::max(1.0, ceil(m_options.m_minSampleSeconds / secondsPerCall)));
+
+        std::vector<double> samples; // [seconds per call]
+        double totalSeconds = 0;
+        while ((samples.size() < m_options.m_maxSamples) && ((samples.size() < m_options.m_minSamples) || (totalSeconds < m_options.m_minSeconds)))
+        {
+            double seconds = timeCalls(numCallsPerSample);
+            samples.push_back(seconds / numCallsPerSample);
+            totalSeconds += seconds;
+        }
+
+        const size_t n = samples.size();
+        double mean = 0;
+        for (double s : samples)
+            mean += s;
+        mean /= n;
+        double variance = 0;
+        for (double s : samples)
+            variance += (s - mean) * (s - mean);
+        variance = n > 1 ? variance / (n - 1) : 0;
+        double halfWidth = StudentT95(n - 1) * sqrt(variance / n);
+        std::sort(samples.begin(), samples.end());
+
+        BenchmarkResult result;
+        result.m_name = name;
+        result.m_device = DeviceName(deviceId);
+        result.m_unit = unit == BenchmarkUnit::GFlops ? "GFLOP/s" : "GB/s";
+        result.m_throughput = work / mean * 1e-9;
+        result.m_throughputLow = work / (mean + halfWidth) * 1e-9;
+        result.m_throughputHigh = halfWidth < mean ? work / (mean - halfWidth) * 1e-9 : HUGE_VAL;
+        result.m_meanSeconds = mean;
+        result.m_medianSeconds = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+        result.m_numSamples = n;
+        result.m_numCallsPerSample = numCallsPerSample;
+        m_results.push_back(result);
+
+        printf("%-48s %-5s %10.2f %-7s [%.2f, %.2f]  %10.4f ms/call  (%d x %d calls)\n",
+               result.m_name.c_str(), result.m_device.c_str(), result.m_throughput, result.m_unit.c_str(),
+               result.m_throughputLow, result.m_throughputHigh, 1e3 * result.m_meanSeconds, (int) n, (int) numCallsPerSample);
+        fflush(stdout);
+    }
+    catch (const std::exception& e)
+    {
+        Skip(name, deviceId, std::string("failed: ") + e.what());
+    }
+}
+
+void BenchmarkRunner::Skip(const std::string& name, DEVICEID_TYPE deviceId, const std::string& reason)
+{
+    if (IsSelected(name))
+        printf("%-48s %-5s skipped (%s)\n", name.c_str(), DeviceName(deviceId).c_str(), reason.c_str());
+}
+
+// -----------------------------------------------------------------------
+// machine-readable results, and the comparison with an earlier run
+// -----------------------------------------------------------------------
+
+static const char* s_header = "# name\tdevice\tunit\tthroughput\tlow\thigh\tmeanSeconds\tmedianSeconds\tsamples\tcallsPerSample";
+
+void BenchmarkRunner::WriteResults(const std::string& path) const
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        RuntimeError("WriteResults: Cannot create '%s'.", path.c_str());
+    fprintf(f, "%s\n", s_header);
+    for (const auto& result : m_results)
+    {
+        fprintf(f, "%s\t%s\t%s\t%.6g\t%.6g\t%.6g\t%.6g\t%.6g\t%d\t%d\n",
+                result.m_name.c_str(), result.m_device.c_str(), result.m_unit.c_str(),
+                result.m_throughput, result.m_throughputLow, result.m_throughputHigh,
+                result.m_meanSeconds, result.m_medianSeconds, (int) result.m_numSamples, (int) result.m_numCallsPerSample);
+    }
+    if (fclose(f) != 0)
+        RuntimeError("WriteResults: Error writing '%s'.", path.c_str());
+}
+
+static std::vector<std::string> SplitTabs(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t begin = 0;
+    for (;;)
+    {
+        size_t end = line.find('\t', begin);
+        fields.push_back(line.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        if (end == std::string::npos)
+            return fields;
+        begin = end + 1;
+    }
+}
+
+size_t BenchmarkRunner::CompareWithBaseline(const std::string& path, double tolerance) const
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f)
+        RuntimeError("CompareWithBaseline: Cannot open '%s'.", path.c_str());
+    std::map<std::string, BenchmarkResult> baseline; // [name + '\t' + device]
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), f))
+    {
+        std::string line(buffer);
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        auto fields = SplitTabs(line);
+        if (fields.size() < 6)
+        {
+            fclose(f);
+            RuntimeError("CompareWithBaseline: '%s' is not a benchmark result file.", path.c_str());
+        }
+        BenchmarkResult& result = baseline[fields[0] + '\t' + fields[1]];
+        result.m_name = fields[0];
+        result.m_device = fields[1];
+        result.m_unit = fields[2];
+        result.m_throughput = atof(fields[3].c_str());
+        result.m_throughputLow = atof(fields[4].c_str());
+        result.m_throughputHigh = atof(fields[5].c_str());
+    }
+    fclose(f);
+
+    printf("\nComparison with %s (tolerance %.1f%%):\n", path.c_str(), 100 * tolerance);
+    printf("%-48s %-5s %12s %12s %8s\n", "benchmark", "", "baseline", "current", "change");
+    size_t numRegressions = 0;
+    for (const auto& result : m_results)
+    {
+        auto iter = baseline.find(result.m_name + '\t' + result.m_device);
+        if (iter == baseline.end())
+        {
+            printf("%-48s %-5s %12s %12.2f %8s\n", result.m_name.c_str(), result.m_device.c_str(), "-", result.m_throughput, "new");
+            continue;
+        }
+        const BenchmarkResult& old = iter->second;
+        double change = old.m_throughput > 0 ? result.m_throughput / old.m_throughput - 1 : 0;
+        // a change must exceed the tolerance and the measuring noise
+        const char* verdict = "";
+        if ((change < -tolerance) && (result.m_throughputHigh < old.m_throughputLow))
+        {
+            verdict = "REGRESSION";
+            numRegressions++;
+        }
+        else if ((change > tolerance) && (result.m_throughputLow > old.m_throughputHigh))
+            verdict = "faster";
+        printf("%-48s %-5s %12.2f %12.2f %+7.1f%% %s\n", result.m_name.c_str(), result.m_device.c_str(),
+               old.m_throughput, result.m_throughput, 100 * change, verdict);
+    }
+    printf("%d regression%s\n", (int) numRegressions, numRegressions == 1 ? "" : "s");
+    return numRegressions;
+}
+} } } }
@@ -0,0 +1,90 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Benchmark.h -- micro-benchmark harness for the Math library
+//
+// A benchmark is a callable that performs a known amount of work (floating-point operations or bytes moved).
+// BenchmarkRunner::Run() calls it once to warm up (allocations, cuBLAS/cuDNN initialization, caches), then takes samples
+// of as many calls as fill at least m_minSampleSeconds, until m_minSeconds have passed and at least m_minSamples (at most
+// m_maxSamples) were taken. The GPU compute stream is synchronized around each sample, so a sample includes the execution
+// of all kernels it launched.
+// The result is the throughput at the mean time per call, with the 95% confidence interval of that mean (Student's t).
+// WriteResults() writes the results as tab-separated values; CompareWithBaseline() reads such a file of an earlier build
+// and reports every benchmark that got slower by more than the tolerance, beyond both confidence intervals.
+//
+
+#pragma once
+
+#include "CommonMatrix.h" // for DEVICEID_TYPE
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+enum class BenchmarkUnit
+{
+    GFlops, // 1e9 floating-point operations per second
+    GBytes  // 1e9 bytes per second
+};
+
+struct BenchmarkResult
+{
+    std::string m_name;   // e.g. "gemm/NN/2048x2048x256/float"
+    std::string m_device; // "CPU" or "GPU<id>"
+    std::string m_unit;
+    double m_throughput; // at the mean time per call
+    double m_throughputLow;
+    double m_throughputHigh; // 95% confidence interval
+    double m_meanSeconds;    // per call
+    double m_medianSeconds;
+    size_t m_numSamples;
+    size_t m_numCallsPerSample;
+};
+
+struct BenchmarkOptions
+{
+    BenchmarkOptions()
+        : m_minSeconds(1.0), m_minSampleSeconds(0.01), m_minSamples(10), m_maxSamples(200)
+    {
+    }
+
+    double m_minSeconds;       // total measuring time per benchmark
+    double m_minSampleSeconds; // calls are batched into samples of at least this duration
+    size_t m_minSamples;
+    size_t m_maxSamples;
+    std::vector<std::string> m_filters; // run only benchmarks whose name contains one of these; all if empty
+};
+
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(const BenchmarkOptions& options);
+
+    // whether the filter selects a benchmark; check this before allocating its data
+    bool IsSelected(const std::string& name) const;
+
+    // 'work' is the number of floating-point operations resp. bytes per call of 'body'
+    void Run(const std::string& name, DEVICEID_TYPE deviceId, BenchmarkUnit unit, double work, const std::function<void()>& body);
+    // for benchmarks that cannot run in this build or on this device
+    void Skip(const std::string& name, DEVICEID_TYPE deviceId, const std::string& reason);
+
+    const std::vector<BenchmarkResult>& GetResults() const
+    {
+        return m_results;
+    }
+
+    void WriteResults(const std::string& path) const;
+    // prints the comparison; returns the number of regressions
+    size_t CompareWithBaseline(const std::string& path, double tolerance) const;
+
+private:
+    BenchmarkOptions m_options;
+    std::vector<BenchmarkResult> m_results;
+};
+
+// defined in MathBenchmarks.cpp
+template <class ElemType>
+void RunMathBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId);
+} } } }
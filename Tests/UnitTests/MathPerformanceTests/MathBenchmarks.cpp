@@ -0,0 +1,462 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MathBenchmarks.cpp -- the benchmarks of MathPerformanceTests
+//
+// The shapes are those of typical models: fully connected and recurrent layers of speech and language models (with
+// minibatches of 256 frames, or 32 parallel sequences for one time step of a recurrent layer), the senone output layer of
+// an acoustic model, embeddings of one-hot or bag-of-words input, and small image convolutions.
+// Names are "<group>/<variant>/<shape>/<element type>", so that a filter can select a group or an element type.
+//
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "Basics.h"
+#include "Matrix.h"
+#include "TensorView.h"
+#include "ConvolutionEngine.h"
+#include "QuantizedMatrix.h"
+#include "MatrixQuantizerImpl.h"
+#include "GPUDataTransferer.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include <memory>
+#include <vector>
+
+using msra::strfun::strprintf;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+template <class ElemType>
+static const char* ElemTypeName()
+{
+    return sizeof(ElemType) == sizeof(float) ? "float" : "double";
+}
+
+// a dense matrix on 'deviceId' with values uniform in [-1, 1]
+template <class ElemType>
+static Matrix<ElemType> RandomMatrix(size_t rows, size_t cols, DEVICEID_TYPE deviceId, unsigned long seed)
+{
+    Matrix<ElemType> m(rows, cols, deviceId);
+    m.SetUniformRandomValue(-1, 1, seed);
+    return m;
+}
+
+// -----------------------------------------------------------------------
+// dense products
+// -----------------------------------------------------------------------
+
+// For a layer with weights W [m x k] and input X [k x n]: forward Y = W X ("NN"), backprop to the input dX = W' dY ("TN"),
+// and the gradient dW += dY X' ("NT").
+template <class ElemType>
+static void GemmBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    struct Shape
+    {
+        size_t m, k, n;
+    };
+    const Shape shapes[] = {
+        {512, 512, 256},    // small hidden layer
+        {2048, 2048, 256},  // DNN or LSTM hidden layer
+        {2048, 512, 32},    // LSTM: 4 gates of 512 cells, one time step of 32 parallel sequences
+        {8192, 2048, 32},   // LSTM: 4 gates of 2048 cells, one time step
+        {9304, 2048, 256},  // senone output layer of an acoustic model
+        {1024, 1024, 1024}, // square, for comparison with vendor numbers
+    };
+    for (const auto& s : shapes)
+    {
+        const std::string shape = strprintf("%dx%dx%d/%s", (int) s.m, (int) s.k, (int) s.n, ElemTypeName<ElemType>());
+        const std::string nn = "gemm/NN/" + shape, tn = "gemm/TN/" + shape, nt = "gemm/NT/" + shape;
+        if (!runner.IsSelected(nn) && !runner.IsSelected(tn) && !runner.IsSelected(nt))
+            continue;
+
+        Matrix<ElemType> W = RandomMatrix<ElemType>(s.m, s.k, deviceId, 1);
+        Matrix<ElemType> X = RandomMatrix<ElemType>(s.k, s.n, deviceId, 2);
+        Matrix<ElemType> Y = RandomMatrix<ElemType>(s.m, s.n, deviceId, 3);
+        Matrix<ElemType> dX(s.k, s.n, deviceId);
+        Matrix<ElemType> dW(s.m, s.k, deviceId);
+        dW.SetValue(0);
+
+        const double flops = 2.0 * s.m * s.k * s.n;
+        runner.Run(nn, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       Matrix<ElemType>::MultiplyAndWeightedAdd(1, W, false, X, false, 0, Y);
+                   });
+        runner.Run(tn, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       Matrix<ElemType>::MultiplyAndWeightedAdd(1, W, true, Y, false, 0, dX);
+                   });
+        runner.Run(nt, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       Matrix<ElemType>::MultiplyAndWeightedAdd(1, Y, false, X, true, 1, dW);
+                   });
+    }
+}
+
+// -----------------------------------------------------------------------
+// dense x sparse products
+// -----------------------------------------------------------------------
+
+// Embedding E [dim x vocab] of sparse input X [vocab x n] (CSC): forward E X, and the gradient dE += dY X' into a dense matrix.
+// The throughput counts only the multiply-adds with the non-zero elements.
+template <class ElemType>
+static void SparseBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    struct Shape
+    {
+        size_t dim, vocab, nnzPerCol, n;
+    };
+    const Shape shapes[] = {
+        {512, 10000, 1, 256},  // one-hot word input
+        {512, 100000, 1, 256}, // one-hot input with a large vocabulary
+        {512, 50000, 20, 256}, // bag of words, or letter trigrams
+    };
+    for (const auto& s : shapes)
+    {
+        const std::string shape = strprintf("%dx%d(nnz=%d)x%d/%s", (int) s.dim, (int) s.vocab, (int) s.nnzPerCol, (int) s.n, ElemTypeName<ElemType>());
+        const std::string forward = "sparse/dense*sparse/" + shape, gradient = "sparse/dense*sparse'/" + shape;
+        if (!runner.IsSelected(forward) && !runner.IsSelected(gradient))
+            continue;
+
+        // the rows of each column are spread over the vocabulary, in increasing order
+        const size_t nz = s.nnzPerCol * s.n;
+        const size_t stride = s.vocab / s.nnzPerCol;
+        std::vector<CPUSPARSE_INDEX_TYPE> colStarts(s.n + 1), rows(nz);
+        std::vector<ElemType> values(nz, 1);
+        for (size_t j = 0; j < s.n; j++)
+        {
+            colStarts[j] = (CPUSPARSE_INDEX_TYPE) (j * s.nnzPerCol);
+            for (size_t i = 0; i < s.nnzPerCol; i++)
+                rows[j * s.nnzPerCol + i] = (CPUSPARSE_INDEX_TYPE) (i * stride + (j * 7919) % stride);
+        }
+        colStarts[s.n] = (CPUSPARSE_INDEX_TYPE) nz;
+        Matrix<ElemType> X(s.vocab, s.n, deviceId, MatrixType::SPARSE, matrixFormatSparseCSC);
+        X.SetMatrixFromCSCFormat(colStarts.data(), rows.data(), values.data(), nz, s.vocab, s.n);
+
+        Matrix<ElemType> E = RandomMatrix<ElemType>(s.dim, s.vocab, deviceId, 1);
+        Matrix<ElemType> Y = RandomMatrix<ElemType>(s.dim, s.n, deviceId, 2);
+        Matrix<ElemType> dE(s.dim, s.vocab, deviceId);
+        dE.SetValue(0);
+
+        const double flops = 2.0 * s.dim * nz;
+        runner.Run(forward, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       Matrix<ElemType>::MultiplyAndWeightedAdd(1, E, false, X, false, 0, Y);
+                   });
+        runner.Run(gradient, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       Matrix<ElemType>::MultiplyAndWeightedAdd(1, Y, false, X, true, 1, dE);
+                   });
+    }
+}
+
+// -----------------------------------------------------------------------
+// TensorView elementwise ops with broadcasting and reduction
+// -----------------------------------------------------------------------
+
+// The throughput counts the bytes of all inputs and the output once.
+template <class ElemType>
+static void TensorBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    const size_t shapes[][2] = {{512, 256}, {2048, 256}, {9304, 256}};
+    for (const auto& s : shapes)
+    {
+        const size_t rows = s[0], cols = s[1];
+        const std::string shape = strprintf("%dx%d/%s", (int) rows, (int) cols, ElemTypeName<ElemType>());
+        const std::string names[] = {"tensor/sigmoid/" + shape, "tensor/product/" + shape, "tensor/plus-column/" + shape,
+                                     "tensor/times-row/" + shape, "tensor/sum-columns/" + shape};
+        bool anySelected = false;
+        for (const auto& name : names)
+            anySelected |= runner.IsSelected(name);
+        if (!anySelected)
+            continue;
+
+        Matrix<ElemType> a = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+        Matrix<ElemType> b = RandomMatrix<ElemType>(rows, cols, deviceId, 2);
+        Matrix<ElemType> column = RandomMatrix<ElemType>(rows, 1, deviceId, 3); // e.g. a bias
+        Matrix<ElemType> row = RandomMatrix<ElemType>(1, cols, deviceId, 4);    // e.g. a per-sample weight
+        Matrix<ElemType> c(rows, cols, deviceId);
+        Matrix<ElemType> columnSum(rows, 1, deviceId);
+
+        TensorView<ElemType> aView(a, TensorShape(rows, cols));
+        TensorView<ElemType> bView(b, TensorShape(rows, cols));
+        TensorView<ElemType> columnView(column, TensorShape(rows, 1));
+        TensorView<ElemType> rowView(row, TensorShape(1, cols));
+        TensorView<ElemType> cView(c, TensorShape(rows, cols));
+        TensorView<ElemType> columnSumView(columnSum, TensorShape(rows, 1));
+
+        const double bytes = (double) rows * cols * sizeof(ElemType);
+        runner.Run(names[0], deviceId, BenchmarkUnit::GBytes, 2 * bytes, [&]
+                   {
+                       cView.AssignSigmoidOf(aView);
+                   });
+        runner.Run(names[1], deviceId, BenchmarkUnit::GBytes, 3 * bytes, [&]
+                   {
+                       cView.AssignElementwiseProductOf(aView, bView);
+                   });
+        runner.Run(names[2], deviceId, BenchmarkUnit::GBytes, 2 * bytes + rows * sizeof(ElemType), [&]
+                   {
+                       cView.AssignSumOf(aView, columnView);
+                   });
+        runner.Run(names[3], deviceId, BenchmarkUnit::GBytes, 2 * bytes + cols * sizeof(ElemType), [&]
+                   {
+                       cView.AssignElementwiseProductOf(aView, rowView);
+                   });
+        runner.Run(names[4], deviceId, BenchmarkUnit::GBytes, bytes + rows * sizeof(ElemType), [&]
+                   {
+                       columnSumView.AssignCopyOf(aView); // (reduces over the columns, like the gradient of a bias)
+                   });
+    }
+}
+
+// -----------------------------------------------------------------------
+// softmax
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+static void SoftmaxBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    const size_t shapes[][2] = {{9304, 256}, {10000, 256}, {100000, 32}};
+    for (const auto& s : shapes)
+    {
+        const size_t rows = s[0], cols = s[1];
+        const std::string shape = strprintf("%dx%d/%s", (int) rows, (int) cols, ElemTypeName<ElemType>());
+        const std::string logSoftmax = "softmax/logsoftmax/" + shape, softmax = "softmax/softmax/" + shape;
+        if (!runner.IsSelected(logSoftmax) && !runner.IsSelected(softmax))
+            continue;
+
+        Matrix<ElemType> input = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+        Matrix<ElemType> output(rows, cols, deviceId);
+
+        const double bytes = 2.0 * rows * cols * sizeof(ElemType);
+        runner.Run(logSoftmax, deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       output.AssignLogSoftmaxOf(input, true);
+                   });
+        // as SoftmaxNode computes it
+        runner.Run(softmax, deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       output.AssignLogSoftmaxOf(input, true);
+                       output.InplaceExp();
+                   });
+    }
+}
+
+// -----------------------------------------------------------------------
+// convolution and pooling engines
+// -----------------------------------------------------------------------
+
+// The engines of ConvolutionEngineFactory::EngineType::Auto: cuDNN (CHW) on the GPU, the legacy engine (HWC) on the CPU.
+template <class ElemType>
+static void ConvolutionBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    typedef ConvolutionEngineFactory<ElemType> Factory;
+
+    struct Shape
+    {
+        size_t w, h, cIn, cOut, k, n;
+    };
+    const Shape shapes[] = {
+        {28, 28, 1, 32, 5, 64},  // first layer of an MNIST model
+        {32, 32, 64, 64, 3, 64}, // inner layer of a CIFAR model
+        {14, 14, 256, 256, 3, 32},
+    };
+    const ImageLayoutKind layout = deviceId >= 0 ? ImageLayoutKind::CHW : ImageLayoutKind::HWC;
+    for (const auto& s : shapes)
+    {
+        const std::string shape = strprintf("%dx%dx%d->%d,%dx%d,n=%d/%s", (int) s.w, (int) s.h, (int) s.cIn, (int) s.cOut, (int) s.k, (int) s.k, (int) s.n, ElemTypeName<ElemType>());
+        const std::string forward = "conv/forward/" + shape, backwardData = "conv/backward-data/" + shape, backwardFilter = "conv/backward-filter/" + shape;
+        if (!runner.IsSelected(forward) && !runner.IsSelected(backwardData) && !runner.IsSelected(backwardFilter))
+            continue;
+
+        std::unique_ptr<Factory> factory;
+        try
+        {
+            factory = Factory::Create(deviceId, Factory::EngineType::Auto, layout);
+        }
+        catch (const std::exception& e)
+        {
+            runner.Skip(forward, deviceId, e.what());
+            continue;
+        }
+        auto engine = factory->CreateConvEngine(deviceId, 0);
+        // stride 1, padded: the output has the size of the input
+        auto inT = factory->CreateTensor(s.w, s.h, s.cIn, s.n);
+        auto filterT = factory->CreateFilter(s.k, s.k, s.cIn, s.cOut);
+        auto outT = factory->CreateTensor(s.w, s.h, s.cOut, s.n);
+        auto convT = factory->CreateConvDescriptor(*inT, *filterT, 1, 1, true);
+
+        Matrix<ElemType> in = RandomMatrix<ElemType>(s.w * s.h * s.cIn, s.n, deviceId, 1);
+        Matrix<ElemType> filter = RandomMatrix<ElemType>(s.cOut, s.k * s.k * s.cIn, deviceId, 2);
+        Matrix<ElemType> out = RandomMatrix<ElemType>(s.w * s.h * s.cOut, s.n, deviceId, 3);
+        Matrix<ElemType> inGrad(s.w * s.h * s.cIn, s.n, deviceId);
+        Matrix<ElemType> filterGrad(s.cOut, s.k * s.k * s.cIn, deviceId);
+        Matrix<ElemType> workspace(deviceId);
+
+        const double flops = 2.0 * s.w * s.h * s.cOut * s.k * s.k * s.cIn * s.n;
+        runner.Run(forward, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       engine->Forward(*inT, in, *filterT, filter, *convT, *outT, out, workspace);
+                   });
+        runner.Run(backwardData, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       engine->BackwardData(*outT, out, *filterT, filter, *convT, *inT, inGrad, workspace);
+                   });
+        runner.Run(backwardFilter, deviceId, BenchmarkUnit::GFlops, flops, [&]
+                   {
+                       engine->BackwardFilter(*outT, out, *inT, in, *convT, *filterT, filterGrad, true, workspace);
+                   });
+    }
+
+    // 2x2 max pooling with stride 2
+    const Shape poolShapes[] = {{32, 32, 64, 64, 2, 64}, {56, 56, 128, 128, 2, 32}};
+    for (const auto& s : poolShapes)
+    {
+        const std::string shape = strprintf("%dx%dx%d,%dx%d,n=%d/%s", (int) s.w, (int) s.h, (int) s.cIn, (int) s.k, (int) s.k, (int) s.n, ElemTypeName<ElemType>());
+        const std::string forward = "pool/max-forward/" + shape, backward = "pool/max-backward/" + shape;
+        if (!runner.IsSelected(forward) && !runner.IsSelected(backward))
+            continue;
+
+        std::unique_ptr<Factory> factory;
+        try
+        {
+            factory = Factory::Create(deviceId, Factory::EngineType::Auto, layout);
+        }
+        catch (const std::exception& e)
+        {
+            runner.Skip(forward, deviceId, e.what());
+            continue;
+        }
+        auto engine = factory->CreatePoolEngine(deviceId);
+        const size_t outW = s.w / s.k, outH = s.h / s.k;
+        auto inT = factory->CreateTensor(s.w, s.h, s.cIn, s.n);
+        auto outT = factory->CreateTensor(outW, outH, s.cIn, s.n);
+        auto poolT = factory->CreatePoolDescriptor(PoolingDescriptor::PoolKind::Max, s.k, s.k, s.k, s.k, 0, 0);
+
+        Matrix<ElemType> in = RandomMatrix<ElemType>(s.w * s.h * s.cIn, s.n, deviceId, 1);
+        Matrix<ElemType> out(outW * outH * s.cIn, s.n, deviceId);
+        Matrix<ElemType> outGrad = RandomMatrix<ElemType>(outW * outH * s.cIn, s.n, deviceId, 2);
+        Matrix<ElemType> inGrad(s.w * s.h * s.cIn, s.n, deviceId);
+        engine->Forward(*inT, in, *poolT, *outT, out);
+
+        const double inBytes = (double) s.w * s.h * s.cIn * s.n * sizeof(ElemType);
+        const double outBytes = (double) outW * outH * s.cIn * s.n * sizeof(ElemType);
+        runner.Run(forward, deviceId, BenchmarkUnit::GBytes, inBytes + outBytes, [&]
+                   {
+                       engine->Forward(*inT, in, *poolT, *outT, out);
+                   });
+        runner.Run(backward, deviceId, BenchmarkUnit::GBytes, 2 * inBytes + 2 * outBytes, [&]
+                   {
+                       engine->Backward(*outT, out, outGrad, *poolT, *inT, in, inGrad);
+                   });
+    }
+}
+
+// -----------------------------------------------------------------------
+// gradient quantization
+// -----------------------------------------------------------------------
+
+// The throughput counts the bytes of the full-precision gradient.
+template <class ElemType>
+static void QuantizationBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    const size_t rows = 2048, cols = 2048;
+    for (size_t bits : {1, 8})
+    {
+        const std::string shape = strprintf("%dbit/%dx%d/%s", (int) bits, (int) rows, (int) cols, ElemTypeName<ElemType>());
+        const std::string quantize = "quantize/quantize/" + shape, unquantize = "quantize/unquantize/" + shape;
+        if (!runner.IsSelected(quantize) && !runner.IsSelected(unquantize))
+            continue;
+
+        std::unique_ptr<MatrixQuantizerImpl<ElemType>> quantizer(MatrixQuantizerImpl<ElemType>::Create(deviceId, false));
+        Matrix<ElemType> gradient = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+        Matrix<ElemType> residual(rows, cols, deviceId);
+        residual.SetValue(0);
+        Matrix<ElemType> aggregate(rows, cols, deviceId);
+        aggregate.SetValue(0);
+        QuantizedMatrix<ElemType> quantized(rows, cols, bits, deviceId);
+
+        const double bytes = (double) rows * cols * sizeof(ElemType);
+        runner.Run(quantize, deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       quantizer->QuantizeAsync(gradient, residual, quantized, residual, false);
+                       quantizer->WaitQuantizeAsyncDone();
+                   });
+        runner.Run(unquantize, deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       quantizer->UnquantizeAsync(quantized, aggregate, true);
+                       quantizer->WaitUnquantizeAsyncDone();
+                   });
+    }
+}
+
+// -----------------------------------------------------------------------
+// host <-> device transfers
+// -----------------------------------------------------------------------
+
+// Pinned transfers go through GPUDataTransferer, as the gradient aggregation does; pageable ones through Matrix, as the readers do.
+template <class ElemType>
+static void TransferBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    if (deviceId < 0)
+        return;
+
+    for (size_t megabytes : {1, 64})
+    {
+        const size_t numElements = megabytes * 1024 * 1024 / sizeof(ElemType);
+        const std::string size = strprintf("%dMB/%s", (int) megabytes, ElemTypeName<ElemType>());
+        const std::string names[] = {"transfer/H2D-pinned/" + size, "transfer/D2H-pinned/" + size,
+                                     "transfer/H2D-pageable/" + size, "transfer/D2H-pageable/" + size};
+        bool anySelected = false;
+        for (const auto& name : names)
+            anySelected |= runner.IsSelected(name);
+        if (!anySelected)
+            continue;
+
+        Matrix<ElemType> device = RandomMatrix<ElemType>(numElements, 1, deviceId, 1);
+        std::shared_ptr<ElemType> pinned((ElemType*) CUDAPageLockedMemAllocator::Malloc(numElements * sizeof(ElemType), deviceId),
+                                         [deviceId](ElemType* p)
+                                         {
+                                             CUDAPageLockedMemAllocator::Free(p, deviceId);
+                                         });
+        std::vector<ElemType> pageable(numElements, 0);
+        GPUDataTransferer<ElemType> transferer(deviceId, false);
+
+        const double bytes = (double) numElements * sizeof(ElemType);
+        runner.Run(names[0], deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       transferer.CopyCPUToGPUAsync(pinned.get(), numElements, device.BufferPointer());
+                       transferer.WaitForCopyCPUToGPUAsync();
+                   });
+        runner.Run(names[1], deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       transferer.CopyGPUToCPUAsync(device.BufferPointer(), numElements, pinned.get());
+                       transferer.WaitForCopyGPUToCPUAsync();
+                   });
+        runner.Run(names[2], deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       device.SetValue(numElements, 1, deviceId, pageable.data());
+                   });
+        runner.Run(names[3], deviceId, BenchmarkUnit::GBytes, bytes, [&]
+                   {
+                       ElemType* p = pageable.data();
+                       size_t capacity = pageable.size();
+                       device.CopyToArray(p, capacity);
+                   });
+    }
+}
+
+template <class ElemType>
+void RunMathBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    GemmBenchmarks<ElemType>(runner, deviceId);
+    SparseBenchmarks<ElemType>(runner, deviceId);
+    TensorBenchmarks<ElemType>(runner, deviceId);
+    SoftmaxBenchmarks<ElemType>(runner, deviceId);
+    ConvolutionBenchmarks<ElemType>(runner, deviceId);
+    QuantizationBenchmarks<ElemType>(runner, deviceId);
+    TransferBenchmarks<ElemType>(runner, deviceId);
+}
+
+template void RunMathBenchmarks<float>(BenchmarkRunner& runner, DEVICEID_TYPE deviceId);
+template void RunMathBenchmarks<double>(BenchmarkRunner& runner, DEVICEID_TYPE deviceId);
+} } } }
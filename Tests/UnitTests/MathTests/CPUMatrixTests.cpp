@@ -4,6 +4,15 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/Int8QuantizedMatrix.h"
+#include "../../../Source/Math/PackedGemmMatrix.h"
+#include "../../../Source/Math/CPUVectorKernels.h"
+#include "../../../Source/Math/MemoryAccounting.h"
+#include "../../../Source/Math/CPUThreading.h"
+#include "../../../Source/Common/Include/PackedImages.h"
+#include <omp.h>
+#include <atomic>
+#include <thread>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -898,6 +907,398 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUInt8QuantizedMatrixMultiply, RandomSeedFixture)
+{
+    const size_t M = 32, K = 64, N = 8;
+    SMatrix mA = SMatrix::RandomUniform(M, K, -1, 1, IncrementCounter());
+    SMatrix mAT = SMatrix::RandomUniform(K, M, -1, 1, IncrementCounter());
+    SMatrix mB = SMatrix::RandomUniform(K, N, -1, 1, IncrementCounter());
+
+    // A * B
+    SMatrix mExpected(M, N);
+    SMatrix::MultiplyAndWeightedAdd(1, mA, false, mB, false, 0, mExpected);
+    Int8QuantizedMatrix<float> qA(mA.BufferPointer(), M, K, false);
+    BOOST_CHECK_EQUAL(qA.GetNumRows(), M);
+    BOOST_CHECK_EQUAL(qA.GetNumCols(), K);
+    SMatrix mC(M, N);
+    qA.Multiply(mB.BufferPointer(), N, mC.BufferPointer());
+    BOOST_CHECK(mC.IsEqualTo(mExpected, 0.1f));
+
+    // AT' * B
+    SMatrix::MultiplyAndWeightedAdd(1, mAT, true, mB, false, 0, mExpected);
+    Int8QuantizedMatrix<float> qAT(mAT.BufferPointer(), K, M, true);
+    BOOST_CHECK_EQUAL(qAT.GetNumRows(), M);
+    BOOST_CHECK_EQUAL(qAT.GetNumCols(), K);
+    qAT.Multiply(mB.BufferPointer(), N, mC.BufferPointer());
+    BOOST_CHECK(mC.IsEqualTo(mExpected, 0.1f));
+
+    // an all-zero row quantizes to zero
+    SMatrix mZ(M, K);
+    mZ.SetValue(0);
+    Int8QuantizedMatrix<float> qZ(mZ.BufferPointer(), M, K, false);
+    qZ.Multiply(mB.BufferPointer(), N, mC.BufferPointer());
+    BOOST_CHECK_EQUAL(mC.SumOfAbsElements(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUPackedGemmMatrixMultiply, RandomSeedFixture)
+{
+    // dimensions that are not multiples of the panel sizes, to test the padding
+    const size_t M = 37, K = 53;
+    SMatrix mA = SMatrix::RandomUniform(M, K, -1, 1, IncrementCounter());
+    SMatrix mAT = SMatrix::RandomUniform(K, M, -1, 1, IncrementCounter());
+    PackedGemmMatrix<float> pA(mA.BufferPointer(), M, K, false);
+    PackedGemmMatrix<float> pAT(mAT.BufferPointer(), K, M, true);
+    BOOST_CHECK_EQUAL(pA.GetNumRows(), M);
+    BOOST_CHECK_EQUAL(pA.GetNumCols(), K);
+    BOOST_CHECK_EQUAL(pAT.GetNumRows(), M);
+    BOOST_CHECK_EQUAL(pAT.GetNumCols(), K);
+
+    for (size_t N : {(size_t) 1, (size_t) 6, PackedGemmMatrix<float>::maxPackedColumns + 1})
+    {
+        SMatrix mB = SMatrix::RandomUniform(K, N, -1, 1, IncrementCounter());
+        SMatrix mExpected(M, N);
+        SMatrix mC(M, N);
+
+        // A * B
+        SMatrix::MultiplyAndWeightedAdd(1, mA, false, mB, false, 0, mExpected);
+        pA.Multiply(mB.BufferPointer(), N, mC.BufferPointer());
+        BOOST_CHECK(mC.IsEqualTo(mExpected, 1e-4f));
+
+        // AT' * B
+        SMatrix::MultiplyAndWeightedAdd(1, mAT, true, mB, false, 0, mExpected);
+        pAT.Multiply(mB.BufferPointer(), N, mC.BufferPointer());
+        BOOST_CHECK(mC.IsEqualTo(mExpected, 1e-4f));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUVectorKernelsMatchGeneric, RandomSeedFixture)
+{
+    const CPUVectorKernels* generic = CPUVectorKernels::GetGeneric();
+    BOOST_REQUIRE(generic != nullptr);
+    const CPUVectorKernels* implementations[] = {CPUVectorKernels::GetAVX2(), CPUVectorKernels::GetAVX512()};
+
+    const size_t n = 1000 + 13; // not a multiple of the vector width, to test the tails
+    SMatrix mA = SMatrix::RandomUniform(n, 1, -20, 20, IncrementCounter());
+    SMatrix mPositive = SMatrix::RandomUniform(n, 1, -30, 30, IncrementCounter());
+    mPositive.InplaceExp();
+    mPositive(0, 0) = 1e-38f; // below the floor
+    SMatrix mResidual = SMatrix::RandomUniform(n, 1, -1, 1, IncrementCounter());
+    const float* a = mA.BufferPointer();
+    const float* positive = mPositive.BufferPointer();
+    const float* residual = mResidual.BufferPointer();
+
+    std::vector<float> expected(n), actual(n);
+    std::vector<unsigned int> expectedBits(n), actualBits(n);
+    for (const CPUVectorKernels* kernels : implementations)
+    {
+        if (kernels == nullptr) // not supported by this CPU or compiler
+            continue;
+        BOOST_TEST_MESSAGE(kernels->m_name);
+
+        generic->Exp(a, expected.data(), n);
+        kernels->Exp(a, actual.data(), n);
+        for (size_t k = 0; k < n; k++)
+            BOOST_CHECK_CLOSE(actual[k], expected[k], 1e-4); // (percent)
+
+        generic->Log(positive, EPS_IN_LOG, LOG_OF_EPS_IN_LOG, expected.data(), n);
+        kernels->Log(positive, EPS_IN_LOG, LOG_OF_EPS_IN_LOG, actual.data(), n);
+        BOOST_CHECK_EQUAL(actual[0], LOG_OF_EPS_IN_LOG);
+        for (size_t k = 0; k < n; k++)
+            BOOST_CHECK_SMALL(actual[k] - expected[k], 1e-5f);
+
+        generic->Sigmoid(a, expected.data(), n);
+        kernels->Sigmoid(a, actual.data(), n);
+        for (size_t k = 0; k < n; k++)
+            BOOST_CHECK_SMALL(actual[k] - expected[k], 1e-6f);
+
+        generic->Tanh(a, expected.data(), n);
+        kernels->Tanh(a, actual.data(), n);
+        for (size_t k = 0; k < n; k++)
+            BOOST_CHECK_SMALL(actual[k] - expected[k], 1e-6f);
+
+        generic->Clip(a, -5, 5, expected.data(), n);
+        kernels->Clip(a, -5, 5, actual.data(), n);
+        BOOST_CHECK(expected == actual);
+
+        BOOST_CHECK_SMALL(kernels->Sum(a, n) - generic->Sum(a, n), 1e-2f); // (different summation order)
+        BOOST_CHECK_EQUAL(kernels->Max(a, n), generic->Max(a, n));
+        const float shift = generic->Max(a, n);
+        BOOST_CHECK_CLOSE(kernels->SubtractAndSumExp(a, shift, actual.data(), n), generic->SubtractAndSumExp(a, shift, expected.data(), n), 1e-3);
+        BOOST_CHECK(expected == actual);
+
+        // 1-bit quantization
+        BOOST_CHECK_SMALL(kernels->AddAndSum(a, residual, actual.data(), n) - generic->AddAndSum(a, residual, expected.data(), n), 1e-2f);
+        BOOST_CHECK(expected == actual);
+        float expectedSums[2], actualSums[2];
+        size_t expectedCounts[2], actualCounts[2];
+        generic->SumBelowAndAbove(a, 1.5f, expectedSums, expectedCounts, n);
+        kernels->SumBelowAndAbove(a, 1.5f, actualSums, actualCounts, n);
+        BOOST_CHECK_SMALL(actualSums[0] - expectedSums[0], 1e-2f);
+        BOOST_CHECK_SMALL(actualSums[1] - expectedSums[1], 1e-2f);
+        BOOST_CHECK_EQUAL(actualCounts[0], expectedCounts[0]);
+        BOOST_CHECK_EQUAL(actualCounts[1], expectedCounts[1]);
+        BOOST_CHECK_CLOSE(kernels->SumOfSquaredDeviations(a, 1.5f, n), generic->SumOfSquaredDeviations(a, 1.5f, n), 1e-3);
+
+        std::fill(expectedBits.begin(), expectedBits.end(), 0x5);
+        std::fill(actualBits.begin(), actualBits.end(), 0x5);
+        std::copy(a, a + n, expected.begin());
+        std::copy(a, a + n, actual.begin());
+        generic->Quantize1Bit(expected.data(), 1.5f, -10, 10, 1u << 31, expectedBits.data(), n);
+        kernels->Quantize1Bit(actual.data(), 1.5f, -10, 10, 1u << 31, actualBits.data(), n);
+        BOOST_CHECK(expectedBits == actualBits);
+        BOOST_CHECK(expected == actual);
+        std::copy(a, a + n, expected.begin());
+        std::copy(a, a + n, actual.begin());
+        generic->Unquantize1Bit(expectedBits.data(), 1u << 31, -10, 10, true, expected.data(), n);
+        kernels->Unquantize1Bit(actualBits.data(), 1u << 31, -10, 10, true, actual.data(), n);
+        BOOST_CHECK(expected == actual);
+        kernels->Unquantize1Bit(actualBits.data(), 1u << 2, -10, 10, false, actual.data(), n);
+        BOOST_CHECK(std::all_of(actual.begin(), actual.end(), [](float x) { return x == 10; }));
+
+        // NaN is propagated
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        float result;
+        kernels->Exp(&nan, &result, 1);
+        BOOST_CHECK(std::isnan(result));
+        kernels->Log(&nan, EPS_IN_LOG, LOG_OF_EPS_IN_LOG, &result, 1);
+        BOOST_CHECK(std::isnan(result));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixTensorOpBroadcastAndReduce, RandomSeedFixture)
+{
+    // large enough for the multi-threaded code paths
+    const size_t rows = 257;
+    const size_t cols = 300;
+    SMatrix mA = SMatrix::RandomUniform(rows, cols, -1, 1, IncrementCounter());
+    SMatrix mBias = SMatrix::RandomUniform(rows, 1, -1, 1, IncrementCounter());
+    SMatrix mRow = SMatrix::RandomUniform(1, cols, -1, 1, IncrementCounter());
+    const array<SmallVector<ptrdiff_t>, 3> noReducingStrides3;
+    const array<SmallVector<ptrdiff_t>, 2> noReducingStrides2;
+    const SmallVector<ptrdiff_t> matrixStrides{1, (ptrdiff_t) rows};
+
+    // c = a + bias (bias broadcasting along columns), then c = 2 * c - row (row broadcasting along the innermost dimension)
+    SMatrix mC(rows, cols);
+    mC.TensorOp(0, mA, mBias, 1, ElementWiseOperator::opSum, array<size_t, 3>{0, 0, 0},
+                SmallVector<size_t>{rows, cols}, array<SmallVector<ptrdiff_t>, 3>{matrixStrides, SmallVector<ptrdiff_t>{1, 0}, matrixStrides},
+                SmallVector<size_t>(), noReducingStrides3);
+    mC.TensorOp(2, mRow, -1, ElementWiseOperator::opCopy, array<size_t, 2>{0, 0},
+                SmallVector<size_t>{rows, cols}, array<SmallVector<ptrdiff_t>, 2>{SmallVector<ptrdiff_t>{0, 1}, matrixStrides},
+                SmallVector<size_t>(), noReducingStrides2);
+    for (size_t j = 0; j < cols; j++)
+        for (size_t i = 0; i < rows; i++)
+            BOOST_CHECK_CLOSE(mC(i, j), 2 * (mA(i, j) + mBias(i, 0)) - mRow(0, j), 1e-3);
+
+    // column sums (reduction over the contiguous dimension)
+    SMatrix mColSums(1, cols);
+    mColSums.TensorOp(0, mA, 1, ElementWiseOperator::opCopy, array<size_t, 2>{0, 0},
+                      SmallVector<size_t>{cols}, array<SmallVector<ptrdiff_t>, 2>{SmallVector<ptrdiff_t>{(ptrdiff_t) rows}, SmallVector<ptrdiff_t>{1}},
+                      SmallVector<size_t>{rows}, array<SmallVector<ptrdiff_t>, 2>{SmallVector<ptrdiff_t>{1}, SmallVector<ptrdiff_t>{0}});
+    double total = 0;
+    for (size_t j = 0; j < cols; j++)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < rows; i++)
+            sum += mA(i, j);
+        BOOST_CHECK_SMALL(mColSums(0, j) - (float) sum, 1e-4f);
+        total += sum;
+    }
+
+    // sum over all elements
+    SMatrix mTotal(1, 1);
+    mTotal.TensorOp(0, mA, 1, ElementWiseOperator::opCopy, array<size_t, 2>{0, 0},
+                    SmallVector<size_t>(), noReducingStrides2,
+                    SmallVector<size_t>{rows, cols}, array<SmallVector<ptrdiff_t>, 2>{matrixStrides, SmallVector<ptrdiff_t>{0, 0}});
+    BOOST_CHECK_SMALL(mTotal(0, 0) - (float) total, 1e-3f);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixPackedHalf, RandomSeedFixture)
+{
+    const size_t numRows = 7, numCols = 5; // odd: the last float of each packed column holds one half and padding
+    SMatrix m(numRows, numCols);
+    m.SetUniformRandomValue(-100, 100, IncrementCounter());
+    m(0, 0) = 1.0f;
+    m(1, 0) = -0.0f;
+    m(2, 0) = 70000.0f; // beyond the fp16 range
+    m(3, 0) = 1e-6f;    // fp16 subnormal
+
+    SMatrix packed, unpacked;
+    packed.AssignPackedHalfOf(m, HalfFormat::fp16);
+    BOOST_CHECK_EQUAL(packed.GetNumRows(), 4);
+    BOOST_CHECK_EQUAL(packed.GetNumCols(), numCols);
+    unpacked.AssignUnpackedHalfOf(packed, numRows, HalfFormat::fp16);
+    BOOST_CHECK_EQUAL(unpacked.GetNumRows(), numRows);
+    BOOST_CHECK_EQUAL(unpacked(0, 0), 1.0f);
+    BOOST_CHECK_EQUAL(unpacked(1, 0), 0.0f);
+    BOOST_CHECK(std::isinf(unpacked(2, 0)));
+    BOOST_CHECK_SMALL(unpacked(3, 0) - 1e-6f, 3e-8f); // (subnormal spacing 2^-24)
+    for (size_t j = 1; j < numCols; j++)
+        for (size_t i = 0; i < numRows; i++)
+            BOOST_CHECK_SMALL(unpacked(i, j) - m(i, j), fabs(m(i, j)) / 2048 + 1e-7f); // 11 significant bits
+
+    packed.AssignPackedHalfOf(m, HalfFormat::bfloat16);
+    unpacked.AssignUnpackedHalfOf(packed, numRows, HalfFormat::bfloat16);
+    BOOST_CHECK_EQUAL(unpacked(2, 0), 70144.0f); // in range, 8 significant bits
+    for (size_t j = 1; j < numCols; j++)
+        for (size_t i = 0; i < numRows; i++)
+            BOOST_CHECK_SMALL(unpacked(i, j) - m(i, j), fabs(m(i, j)) / 256 + 1e-7f);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixMemoryAccounting, RandomSeedFixture)
+{
+    MemoryAccounting::Reset();
+    MemoryAccounting::SetEnabled(true);
+    {
+        MemoryAccounting::Context node(L"W", MemoryAccounting::value);
+        SMatrix mValue(100, 10);
+        {
+            MemoryAccounting::Context nested(MemoryAccounting::gradient); // still node "W"
+            SMatrix mGradient(100, 20);
+            BOOST_CHECK_EQUAL(MemoryAccounting::GetBytesInUse(CPUDEVICE, MemoryAccounting::gradient), 100 * 20 * sizeof(float));
+        }
+        BOOST_CHECK_EQUAL(MemoryAccounting::GetBytesInUse(CPUDEVICE, MemoryAccounting::gradient), 0);
+        BOOST_CHECK_EQUAL(MemoryAccounting::GetPeakBytes(CPUDEVICE, MemoryAccounting::gradient), 100 * 20 * sizeof(float));
+
+        // growing frees the old buffer
+        mValue.Resize(100, 30);
+        BOOST_CHECK_EQUAL(MemoryAccounting::GetBytesInUse(CPUDEVICE, MemoryAccounting::value), 100 * 30 * sizeof(float));
+        BOOST_CHECK_EQUAL(MemoryAccounting::GetPeakBytes(CPUDEVICE, MemoryAccounting::value), 100 * 40 * sizeof(float));
+
+        MemoryAccounting::ResetPeaks();
+        BOOST_CHECK_EQUAL(MemoryAccounting::GetPeakBytes(CPUDEVICE, MemoryAccounting::value), 100 * 30 * sizeof(float));
+        BOOST_CHECK_EQUAL(MemoryAccounting::GetPeakBytes(CPUDEVICE, MemoryAccounting::gradient), 0);
+    }
+    BOOST_CHECK_EQUAL(MemoryAccounting::GetBytesInUse(CPUDEVICE, MemoryAccounting::value), 0);
+
+    // outside of a Context
+    SMatrix mOther(10, 10);
+    BOOST_CHECK_EQUAL(MemoryAccounting::GetBytesInUse(CPUDEVICE, MemoryAccounting::other), 10 * 10 * sizeof(float));
+
+    MemoryAccounting::SetEnabled(false);
+    MemoryAccounting::Reset();
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUThreadingScopeAndSlots, RandomSeedFixture)
+{
+    std::vector<int> cpus = CPUThreading::ParseCpuList("4-6,1:2,5");
+    BOOST_CHECK((cpus == std::vector<int>{1, 2, 4, 5, 6}));
+    BOOST_CHECK(CPUThreading::ParseCpuList("").empty());
+    BOOST_CHECK_THROW(CPUThreading::ParseCpuList("3-1"), std::invalid_argument);
+    BOOST_CHECK_THROW(CPUThreading::ParseCpuList("x"), std::invalid_argument);
+
+    // the intra-op thread count applies inside the Scope, on this thread only
+    auto threadsOfNewThread = []
+    {
+        int threads = 0;
+        std::thread other([&threads] { threads = omp_get_max_threads(); });
+        other.join();
+        return threads;
+    };
+    const int numThreads = omp_get_max_threads();
+    const int numThreadsOfNewThread = threadsOfNewThread();
+    {
+        CPUThreading::Options options;
+        options.m_intraOpThreads = 1;
+        CPUThreading::Scope scope(options);
+        BOOST_CHECK_EQUAL(omp_get_max_threads(), 1);
+        BOOST_CHECK_EQUAL(threadsOfNewThread(), numThreadsOfNewThread);
+    }
+    BOOST_CHECK_EQUAL(omp_get_max_threads(), numThreads);
+
+    // at most 2 of 4 evaluations at once
+    CPUThreading::SetMaxConcurrentEvaluations(2);
+    std::atomic<int> running(0), maxRunning(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++)
+    {
+        threads.push_back(std::thread([&running, &maxRunning]
+                                      {
+                                          CPUThreading::ConcurrencySlot slot;
+                                          int now = ++running;
+                                          int seen = maxRunning;
+                                          while (now > seen && !maxRunning.compare_exchange_weak(seen, now))
+                                              ;
+                                          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                                          running--;
+                                      }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    BOOST_CHECK_LE(maxRunning.load(), 2);
+    CPUThreading::SetMaxConcurrentEvaluations(0);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixAssignPackedImages, RandomSeedFixture)
+{
+    // two 2-channel images, scaled to 2 x 2: a 2 x 2 one (nearest), and a 4 x 4 one (linear, each output pixel the mean of 2 x 2 input pixels)
+    const size_t width = 2, height = 2, channels = 2;
+    const size_t numPixelBytes = 2 * 2 * channels + 4 * 4 * channels;
+    auto expected = [](size_t image, bool flip, bool mean, size_t x, size_t y, size_t c)
+    {
+        size_t sourceX = flip ? width - 1 - x : x;
+        float value = image == 0 ? (float) ((y * 2 + sourceX) * 2 + c) : 13.0f + 16 * y + 4 * sourceX + c;
+        return mean ? value - 0.5f * ((y * width + x) * channels + c) : value;
+    };
+
+    for (int transpose = 0; transpose < 2; transpose++)
+    {
+        for (int flipAndMean = 0; flipAndMean < 2; flipAndMean++)
+        {
+            const size_t meanSize = flipAndMean ? width * height * channels : 0;
+            std::vector<uint64_t> block((PackedImagesSize(2, meanSize, numPixelBytes) + 7) / 8);
+            auto header = reinterpret_cast<PackedImagesHeader*>(block.data());
+            header->m_totalSize = PackedImagesSize(2, meanSize, numPixelBytes);
+            header->m_numImages = 2;
+            header->m_width = width;
+            header->m_height = height;
+            header->m_channels = channels;
+            header->m_transpose = transpose;
+            header->m_meanSize = (uint32_t) meanSize;
+            auto images = const_cast<PackedImage*>(PackedImagesImages(header));
+            images[0] = {0, 2, 2, 0, 0, 2, 2, (uint32_t) flipAndMean, packedImageNearest};
+            images[1] = {2 * 2 * channels, 4, 4, 0, 0, 4, 4, (uint32_t) flipAndMean, packedImageLinear};
+            auto mean = const_cast<float*>(PackedImagesMean(header));
+            for (size_t i = 0; i < meanSize; i++)
+                mean[i] = 0.5f * i;
+            auto pixels = const_cast<unsigned char*>(PackedImagesPixels(header));
+            for (size_t i = 0; i < numPixelBytes; i++)
+                pixels[i] = (unsigned char) i;
+
+            SMatrix m;
+            m.AssignPackedImages(block.data());
+            BOOST_CHECK_EQUAL(m.GetNumRows(), width * height * channels);
+            BOOST_CHECK_EQUAL(m.GetNumCols(), 2);
+            for (size_t j = 0; j < 2; j++)
+                for (size_t y = 0; y < height; y++)
+                    for (size_t x = 0; x < width; x++)
+                        for (size_t c = 0; c < channels; c++)
+                        {
+                            size_t row = transpose ? (c * height + y) * width + x : (y * width + x) * channels + c;
+                            BOOST_CHECK_SMALL(m(row, j) - expected(j, flipAndMean != 0, flipAndMean != 0, x, y, c), 1e-4f);
+                        }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixMemoryPlacement, RandomSeedFixture)
+{
+    BOOST_CHECK_THROW(CPUMemoryPlacement::Set("everywhere"), std::invalid_argument);
+    for (const char* policy : {"firstTouch", "interleave"})
+    {
+        CPUMemoryPlacement::Set(policy);
+        BOOST_CHECK(!CPUMemoryPlacement::AppliesTo(4096));
+        // a placed buffer starts out zeroed like any other
+        SMatrix m(1024, 513);
+        BOOST_CHECK(CPUMemoryPlacement::AppliesTo(m.GetNumElements() * sizeof(float)));
+        BOOST_CHECK_EQUAL(m.SumOfAbsElements(), 0.0f);
+        m.SetValue(1.0f);
+        m.Resize(1024, 1025);
+        BOOST_CHECK_EQUAL(m.SumOfAbsElements(), 0.0f);
+    }
+    CPUMemoryPlacement::Set("none");
+    BOOST_CHECK(CPUMemoryPlacement::Get() == CPUMemoryPlacement::none);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
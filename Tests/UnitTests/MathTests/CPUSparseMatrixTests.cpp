@@ -59,6 +59,186 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixCopyColumnSliceToDense, RandomSeedFixture
     BOOST_CHECK(dm1.IsEqualTo(dm2, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixSparseBlockColumns, RandomSeedFixture)
+{
+    const size_t m = 4;
+    const size_t n = 10;
+    const std::vector<size_t> columnIds = {7, 2};
+    std::vector<double> columnValues(m * columnIds.size());
+    for (size_t k = 0; k < columnValues.size(); k++)
+        columnValues[k] = (double) (k + 1);
+
+    SparseMatrix sm0(MatrixFormat::matrixFormatSparseBlockCol, m, n, 0);
+    sm0.SetSparseBlockColumns(m, n, columnIds, columnValues);
+
+    DenseMatrix dm0(m, n);
+    dm0.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, sm0, dm0);
+    foreach_coord (row, col, dm0)
+    {
+        double expected = (col == 7) ? columnValues[row] : (col == 2) ? columnValues[m + row] : 0;
+        BOOST_CHECK_EQUAL(expected, dm0(row, col));
+    }
+
+    std::vector<size_t> ids;
+    std::vector<double> values;
+    sm0.GetSparseBlockColumns(ids, values);
+    BOOST_CHECK(ids == columnIds);
+    BOOST_CHECK(values == columnValues);
+}
+
+// Starting from fresh state, the block-sparse updates must match the dense ones, which leave zero gradients alone.
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixBlockColumnFSAdagradAndRmsProp, RandomSeedFixture)
+{
+    const size_t m = 4;
+    const size_t n = 10;
+    const std::vector<size_t> columnIds = {7, 2};
+    std::vector<double> columnValues(m * columnIds.size());
+    for (size_t k = 0; k < columnValues.size(); k++)
+        columnValues[k] = (k % 2 ? -0.1 : 0.2) * (k + 1);
+
+    SparseMatrix sparseGradient(MatrixFormat::matrixFormatSparseBlockCol, m, n, 0);
+    sparseGradient.SetSparseBlockColumns(m, n, columnIds, columnValues);
+    DenseMatrix denseGradient(m, n);
+    denseGradient.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, sparseGradient, denseGradient);
+
+    // FSAdagrad
+    DenseMatrix denseValues(m, n);
+    denseValues.SetUniformRandomValue(-1, 1, IncrementCounter());
+    DenseMatrix sparseValues(denseValues);
+    DenseMatrix denseState(m, 2 * n), sparseState(m, 2 * n);
+    denseState.SetValue(0);
+    sparseState.SetValue(0);
+    denseState.FSAdagrad(denseGradient, denseValues, 0.1, 0.9, 0.99, 0.0025);
+    sparseGradient.FSAdagrad(sparseState, sparseValues, 0.1, 0.9, 0.99, 0.0025);
+    BOOST_CHECK(denseValues.IsEqualTo(sparseValues, c_epsilonFloatE4));
+    BOOST_CHECK(denseState.IsEqualTo(sparseState, c_epsilonFloatE4));
+
+    // RmsProp scales the gradient in place
+    DenseMatrix denseRmsState, sparseRmsState;
+    denseRmsState.RmsProp(denseGradient, 0.99, 1.2, 10, 0.75, 0.1, false);
+    sparseGradient.RmsProp(sparseRmsState, 0.99, 1.2, 10, 0.75, 0.1, false);
+    DenseMatrix scaledGradient(m, n);
+    scaledGradient.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, sparseGradient, scaledGradient);
+    BOOST_CHECK(denseGradient.IsEqualTo(scaledGradient, c_epsilonFloatE4));
+}
+
+// The first bias-corrected Adam step moves each weight with a nonzero gradient by the learning rate against its sign.
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixBlockColumnAdam, RandomSeedFixture)
+{
+    const size_t m = 4;
+    const size_t n = 10;
+    const double lr = 0.01, beta1 = 0.9, beta2 = 0.999;
+    const std::vector<size_t> columnIds = {7, 2};
+    std::vector<double> columnValues(m * columnIds.size());
+    for (size_t k = 0; k < columnValues.size(); k++)
+        columnValues[k] = (k % 2 ? -0.1 : 0.2) * (k + 1);
+
+    SparseMatrix sparseGradient(MatrixFormat::matrixFormatSparseBlockCol, m, n, 0);
+    sparseGradient.SetSparseBlockColumns(m, n, columnIds, columnValues);
+    DenseMatrix denseGradient(m, n);
+    denseGradient.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, sparseGradient, denseGradient);
+
+    DenseMatrix initialValues(m, n);
+    initialValues.SetUniformRandomValue(-1, 1, IncrementCounter());
+    DenseMatrix denseValues(initialValues), sparseValues(initialValues);
+    DenseMatrix denseState, sparseState;
+    const double biasCorrection1 = 1 / (1 - beta1), biasCorrection2 = 1 / (1 - beta2);
+    denseState.Adam(denseGradient, denseValues, lr, beta1, beta2, 1e-8, biasCorrection1, biasCorrection2, 0, false);
+    sparseGradient.Adam(sparseState, sparseValues, lr, beta1, beta2, 1e-8, biasCorrection1, biasCorrection2, 0, false);
+    BOOST_CHECK(denseValues.IsEqualTo(sparseValues, c_epsilonFloatE4));
+    BOOST_CHECK(denseState.IsEqualTo(sparseState, c_epsilonFloatE4));
+    foreach_coord (row, col, denseValues)
+    {
+        double g = denseGradient(row, col);
+        double expected = initialValues(row, col) - (g > 0 ? lr : g < 0 ? -lr : 0);
+        BOOST_CHECK_SMALL(denseValues(row, col) - expected, 1e-6);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixOneHotMultiplyAndWeightedAdd, RandomSeedFixture)
+{
+    // embedding-style products with a one-hot input, where several columns hit the same row
+    const size_t h = 8;
+    const size_t v = 30;
+    const size_t t = 12;
+    SparseMatrix oneHot(MatrixFormat::matrixFormatSparseCSC, v, t, 0);
+    DenseMatrix oneHotDense(v, t);
+    oneHotDense.SetValue(0);
+    for (size_t col = 0; col < t; col++)
+    {
+        const size_t row = (col * 7) % 6;
+        oneHot.SetValue(row, col, 1);
+        oneHotDense(row, col) = 1;
+    }
+
+    DenseMatrix weights(h, v);
+    weights.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+    // forward: c = 2 * weights * oneHot + 0.5 * c
+    DenseMatrix c(h, t), cExpected(h, t);
+    c.SetUniformRandomValue(-1, 1, IncrementCounter());
+    cExpected.SetValue(c);
+    SparseMatrix::MultiplyAndWeightedAdd(2, weights, false, oneHot, false, 0.5, c);
+    DenseMatrix::MultiplyAndWeightedAdd(2, weights, false, oneHotDense, false, 0.5, cExpected);
+    BOOST_CHECK(c.IsEqualTo(cExpected, c_epsilonFloatE4));
+
+    // gradient: g = -1 * outputGradient * oneHot^T + 1 * g
+    DenseMatrix outputGradient(h, t);
+    outputGradient.SetUniformRandomValue(-1, 1, IncrementCounter());
+    DenseMatrix g(h, v), gExpected(h, v);
+    g.SetUniformRandomValue(-1, 1, IncrementCounter());
+    gExpected.SetValue(g);
+    SparseMatrix::MultiplyAndWeightedAdd(-1, outputGradient, false, oneHot, true, 1, g);
+    DenseMatrix::MultiplyAndWeightedAdd(-1, outputGradient, false, oneHotDense, true, 1, gExpected);
+    BOOST_CHECK(g.IsEqualTo(gExpected, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixConvertToSparseFormat, RandomSeedFixture)
+{
+    const size_t m = 70;
+    const size_t n = 40;
+    DenseMatrix dm(m, n);
+    dm.SetUniformRandomValue(-1, 1, IncrementCounter());
+    SparseMatrix csc(MatrixFormat::matrixFormatSparseCSC, m, n, 0);
+    foreach_coord (row, col, dm)
+    {
+        if (dm(row, col) > 0.5)
+            csc.SetValue(row, col, dm(row, col));
+        else
+            dm(row, col) = 0;
+    }
+
+    SparseMatrix csr(MatrixFormat::matrixFormatSparseCSR);
+    csc.ConvertToSparseFormat(MatrixFormat::matrixFormatSparseCSR, csr);
+    BOOST_CHECK(csr.GetFormat() == MatrixFormat::matrixFormatSparseCSR);
+    BOOST_CHECK_EQUAL(csc.NzCount(), csr.NzCount());
+    for (size_t row = 0; row < m; row++)
+    {
+        for (CPUSPARSE_INDEX_TYPE p = csr.RowLocation()[row]; p < csr.RowLocation()[row + 1]; p++)
+        {
+            if (p > csr.RowLocation()[row])
+                BOOST_CHECK_LT(csr.ColLocation()[p - 1], csr.ColLocation()[p]);
+            BOOST_CHECK_EQUAL(dm(row, csr.ColLocation()[p]), csr.NzValues()[p]);
+        }
+    }
+
+    // products with a CSR lhs must match those with the CSC lhs
+    DenseMatrix rhs(n, 5), c0, c1;
+    rhs.SetUniformRandomValue(-1, 1, IncrementCounter());
+    SparseMatrix::MultiplyAndWeightedAdd(1, csc, false, rhs, false, 0, c0);
+    SparseMatrix::MultiplyAndWeightedAdd(1, csr, false, rhs, false, 0, c1);
+    BOOST_CHECK(c0.IsEqualTo(c1, c_epsilonFloatE4));
+
+    // and back
+    csr.ConvertToSparseFormat(MatrixFormat::matrixFormatSparseCSC);
+    BOOST_CHECK(csr.GetFormat() == MatrixFormat::matrixFormatSparseCSC);
+    BOOST_CHECK(csr.CopyColumnSliceToDense(0, n).IsEqualTo(dm, c_epsilonFloatE4));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -372,6 +372,318 @@ BOOST_AUTO_TEST_CASE(ConvolutionBackwardFilter)
     }
 }
 
+// The CPU engine computes 1x1 and 3x3 stride-1 convolutions directly resp. by Winograd instead of unrolling the input;
+// compare them with a straightforward convolution in the legacy layout [channel, row, column], channel fastest.
+BOOST_AUTO_TEST_CASE(ConvolutionCpuFastPaths)
+{
+    int deviceId = -1;
+    int n = 2;
+    int cmapIn = 3;
+    int cmapOut = 4;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    for (int k : {1, 3})
+    for (bool pad : {false, true})
+    for (int inH : {5, 10}) // F(2x2,3x3) for small and F(4x4,3x3) for larger images
+    {
+        int inW = inH + 1;
+        int outW = GetNumOut(inW, k, 1, pad);
+        int outH = GetNumOut(inH, k, 1, pad);
+        int p = pad ? k / 2 : 0;
+
+        auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Legacy, ImageLayoutKind::HWC);
+        auto eng = fact->CreateConvEngine(deviceId, 0);
+        auto inT = fact->CreateTensor(inW, inH, cmapIn, n);
+        auto filtT = fact->CreateFilter(k, k, cmapIn, cmapOut);
+        auto outT = fact->CreateTensor(outW, outH, cmapOut, n);
+        auto convT = fact->CreateConvDescriptor(*inT, *filtT, 1, 1, pad);
+
+        vec inBuf(inW * inH * cmapIn * n);
+        vec filtBuf(cmapOut * k * k * cmapIn);
+        vec srcGradBuf(outW * outH * cmapOut * n);
+        for (auto* buf : {&inBuf, &filtBuf, &srcGradBuf})
+            std::generate(buf->begin(), buf->end(), [&] { return dist(rng); });
+
+        // reference: out(o, r, c) = sum over (i, kr, kc) of filt(o, (i, kc, kr)) * in(i, r + kr - p, c + kc - p)
+        vec expOut(outW * outH * cmapOut * n, 0);
+        vec expGrad(inW * inH * cmapIn * n, 0);
+        for (int s = 0; s < n; s++)
+        for (int o = 0; o < cmapOut; o++)
+        for (int r = 0; r < outH; r++)
+        for (int c = 0; c < outW; c++)
+        for (int i = 0; i < cmapIn; i++)
+        for (int kr = 0; kr < k; kr++)
+        for (int kc = 0; kc < k; kc++)
+        {
+            int row = r + kr - p;
+            int col = c + kc - p;
+            if (row < 0 || row >= inH || col < 0 || col >= inW)
+                continue;
+            float w = filtBuf[o + cmapOut * (i * k * k + kr + kc * k)];
+            int inIndex = i + cmapIn * (row + inH * col) + s * cmapIn * inH * inW;
+            int outIndex = o + cmapOut * (r + outH * c) + s * cmapOut * outH * outW;
+            expOut[outIndex] += w * inBuf[inIndex];
+            expGrad[inIndex] += w * srcGradBuf[outIndex];
+        }
+
+        SingleMatrix in(inW * inH * cmapIn, n, inBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix filt(cmapOut, k * k * cmapIn, filtBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix out(outW * outH * cmapOut, n, deviceId);
+        SingleMatrix temp(deviceId);
+        eng->Forward(*inT, in, *filtT, filt, *convT, *outT, out, temp);
+
+        std::string emsg;
+        SingleMatrix exp(outW * outH * cmapOut, n, expOut.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(out, exp, emsg, 1e-4f, 1e-4f), "Unexpected convolution output, kernel " << k << ", pad " << pad << ": " << emsg);
+
+        SingleMatrix srcGrad(outW * outH * cmapOut, n, srcGradBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix grad(inW * inH * cmapIn, n, deviceId);
+        grad.SetValue(1);
+        eng->BackwardData(*outT, srcGrad, *filtT, filt, *convT, *inT, grad, temp);
+
+        std::transform(expGrad.begin(), expGrad.end(), expGrad.begin(), [](float g) { return g + 1; }); // gradients are accumulated
+        SingleMatrix expG(inW * inH * cmapIn, n, expGrad.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(grad, expG, emsg, 1e-4f, 1e-4f), "Unexpected convolution gradient, kernel " << k << ", pad " << pad << ": " << emsg);
+    }
+}
+
+// All other kernels and strides are unrolled and multiplied a tile of columns at a time on the CPU. With the 5x5 kernel at
+// stride 1, the minibatch takes several tiles, some of which start in the middle of a sample.
+BOOST_AUTO_TEST_CASE(ConvolutionCpuTiled)
+{
+    int deviceId = -1;
+    int n = 3;
+    int cmapIn = 8;
+    int cmapOut = 4;
+    int inH = 20;
+    int inW = 21;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    for (int k : {2, 5})
+    for (int stride : {1, 2})
+    for (bool pad : {false, true})
+    {
+        int outW = GetNumOut(inW, k, stride, pad);
+        int outH = GetNumOut(inH, k, stride, pad);
+        int p = pad ? k / 2 : 0;
+
+        auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Legacy, ImageLayoutKind::HWC);
+        auto eng = fact->CreateConvEngine(deviceId, 0);
+        auto inT = fact->CreateTensor(inW, inH, cmapIn, n);
+        auto filtT = fact->CreateFilter(k, k, cmapIn, cmapOut);
+        auto outT = fact->CreateTensor(outW, outH, cmapOut, n);
+        auto convT = fact->CreateConvDescriptor(*inT, *filtT, stride, stride, pad);
+
+        vec inBuf(inW * inH * cmapIn * n);
+        vec filtBuf(cmapOut * k * k * cmapIn);
+        vec srcGradBuf(outW * outH * cmapOut * n);
+        for (auto* buf : {&inBuf, &filtBuf, &srcGradBuf})
+            std::generate(buf->begin(), buf->end(), [&] { return dist(rng); });
+
+        // reference as in ConvolutionCpuFastPaths, with input pixel (r * stride + kr - p, c * stride + kc - p)
+        vec expOut(outW * outH * cmapOut * n, 0);
+        vec expGrad(inW * inH * cmapIn * n, 0);
+        vec expFiltGrad(cmapOut * k * k * cmapIn, 0);
+        for (int s = 0; s < n; s++)
+        for (int o = 0; o < cmapOut; o++)
+        for (int r = 0; r < outH; r++)
+        for (int c = 0; c < outW; c++)
+        for (int i = 0; i < cmapIn; i++)
+        for (int kr = 0; kr < k; kr++)
+        for (int kc = 0; kc < k; kc++)
+        {
+            int row = r * stride + kr - p;
+            int col = c * stride + kc - p;
+            if (row < 0 || row >= inH || col < 0 || col >= inW)
+                continue;
+            int filtIndex = o + cmapOut * (i * k * k + kr + kc * k);
+            int inIndex = i + cmapIn * (row + inH * col) + s * cmapIn * inH * inW;
+            int outIndex = o + cmapOut * (r + outH * c) + s * cmapOut * outH * outW;
+            expOut[outIndex] += filtBuf[filtIndex] * inBuf[inIndex];
+            expGrad[inIndex] += filtBuf[filtIndex] * srcGradBuf[outIndex];
+            expFiltGrad[filtIndex] += srcGradBuf[outIndex] * inBuf[inIndex];
+        }
+
+        SingleMatrix in(inW * inH * cmapIn, n, inBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix filt(cmapOut, k * k * cmapIn, filtBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix out(outW * outH * cmapOut, n, deviceId);
+        SingleMatrix temp(deviceId);
+        eng->Forward(*inT, in, *filtT, filt, *convT, *outT, out, temp);
+
+        std::string emsg;
+        SingleMatrix exp(outW * outH * cmapOut, n, expOut.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(out, exp, emsg, 1e-4f, 1e-4f), "Unexpected convolution output, kernel " << k << ", stride " << stride << ", pad " << pad << ": " << emsg);
+
+        SingleMatrix srcGrad(outW * outH * cmapOut, n, srcGradBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix grad(inW * inH * cmapIn, n, deviceId);
+        grad.SetValue(1);
+        eng->BackwardData(*outT, srcGrad, *filtT, filt, *convT, *inT, grad, temp);
+        std::transform(expGrad.begin(), expGrad.end(), expGrad.begin(), [](float g) { return g + 1; }); // gradients are accumulated
+        SingleMatrix expG(inW * inH * cmapIn, n, expGrad.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(grad, expG, emsg, 1e-4f, 1e-4f), "Unexpected convolution gradient, kernel " << k << ", stride " << stride << ", pad " << pad << ": " << emsg);
+
+        SingleMatrix filtGrad(cmapOut, k * k * cmapIn, deviceId);
+        filtGrad.SetValue(1);
+        eng->BackwardFilter(*outT, srcGrad, *inT, in, *convT, *filtT, filtGrad, false, temp);
+        std::transform(expFiltGrad.begin(), expFiltGrad.end(), expFiltGrad.begin(), [](float g) { return g + 1; });
+        SingleMatrix expF(cmapOut, k * k * cmapIn, expFiltGrad.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(filtGrad, expF, emsg, 1e-4f, 1e-4f), "Unexpected filter gradient, kernel " << k << ", stride " << stride << ", pad " << pad << ": " << emsg);
+    }
+}
+
+// Grouped and depthwise convolutions run directly on the CPU, and on cuDNN with a group count on the GPU.
+BOOST_AUTO_TEST_CASE(ConvolutionGrouped)
+{
+    int n = 2;
+    int cmapIn = 8;
+    int inH = 9;
+    int inW = 7;
+    int k = 3;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    std::vector<int> deviceIds = {-1};
+    if (IsCuDnnSupported())
+        deviceIds.push_back(0);
+    for (int deviceId : deviceIds)
+    for (int groups : {2, 8})
+    for (int cmapOut : {8, 16})
+    for (int stride : {1, 2})
+    for (bool pad : {false, true})
+    {
+        int outW = GetNumOut(inW, k, stride, pad);
+        int outH = GetNumOut(inH, k, stride, pad);
+        int p = pad ? k / 2 : 0;
+        int cmapInGroup = cmapIn / groups;
+        int cmapOutGroup = cmapOut / groups;
+
+        auto fact = ConvFact::Create(deviceId, deviceId < 0 ? ConvFact::EngineType::Legacy : ConvFact::EngineType::CuDnn, ImageLayoutKind::HWC);
+        auto eng = fact->CreateConvEngine(deviceId, 0);
+        auto inT = fact->CreateTensor(inW, inH, cmapIn, n);
+        auto filtT = fact->CreateFilter(k, k, cmapInGroup, cmapOut);
+        auto outT = fact->CreateTensor(outW, outH, cmapOut, n);
+        auto convT = fact->CreateConvDescriptor(*inT, *filtT, stride, stride, pad, groups);
+
+        vec inBuf(inW * inH * cmapIn * n);
+        vec filtBuf(cmapOut * k * k * cmapInGroup);
+        vec srcGradBuf(outW * outH * cmapOut * n);
+        for (auto* buf : {&inBuf, &filtBuf, &srcGradBuf})
+            std::generate(buf->begin(), buf->end(), [&] { return dist(rng); });
+
+        // reference as in ConvolutionCpuTiled, with output channel o seeing input channels (o / cmapOutGroup) * cmapInGroup + [0, cmapInGroup)
+        vec expOut(outW * outH * cmapOut * n, 0);
+        vec expGrad(inW * inH * cmapIn * n, 1);
+        vec expFiltGrad(cmapOut * k * k * cmapInGroup, 1);
+        for (int s = 0; s < n; s++)
+        for (int o = 0; o < cmapOut; o++)
+        for (int r = 0; r < outH; r++)
+        for (int c = 0; c < outW; c++)
+        for (int i = 0; i < cmapInGroup; i++)
+        for (int kr = 0; kr < k; kr++)
+        for (int kc = 0; kc < k; kc++)
+        {
+            int row = r * stride + kr - p;
+            int col = c * stride + kc - p;
+            if (row < 0 || row >= inH || col < 0 || col >= inW)
+                continue;
+            int channel = (o / cmapOutGroup) * cmapInGroup + i;
+            int filtIndex = o + cmapOut * (i * k * k + kr + kc * k);
+            int inIndex = channel + cmapIn * (row + inH * col) + s * cmapIn * inH * inW;
+            int outIndex = o + cmapOut * (r + outH * c) + s * cmapOut * outH * outW;
+            expOut[outIndex] += filtBuf[filtIndex] * inBuf[inIndex];
+            expGrad[inIndex] += filtBuf[filtIndex] * srcGradBuf[outIndex];
+            expFiltGrad[filtIndex] += srcGradBuf[outIndex] * inBuf[inIndex];
+        }
+
+        SingleMatrix in(inW * inH * cmapIn, n, inBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix filt(cmapOut, k * k * cmapInGroup, filtBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix srcGrad(outW * outH * cmapOut, n, srcGradBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix out(outW * outH * cmapOut, n, deviceId);
+        SingleMatrix grad(inW * inH * cmapIn, n, deviceId);
+        SingleMatrix filtGrad(cmapOut, k * k * cmapInGroup, deviceId);
+        SingleMatrix temp(deviceId);
+        grad.SetValue(1); // gradients are accumulated
+        filtGrad.SetValue(1);
+        eng->Forward(*inT, in, *filtT, filt, *convT, *outT, out, temp);
+        eng->BackwardData(*outT, srcGrad, *filtT, filt, *convT, *inT, grad, temp);
+        eng->BackwardFilter(*outT, srcGrad, *inT, in, *convT, *filtT, filtGrad, false, temp);
+
+        std::string emsg;
+        SingleMatrix exp(outW * outH * cmapOut, n, expOut.data(), deviceId, matrixFlagNormal);
+        SingleMatrix expG(inW * inH * cmapIn, n, expGrad.data(), deviceId, matrixFlagNormal);
+        SingleMatrix expF(cmapOut, k * k * cmapInGroup, expFiltGrad.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(out, exp, emsg, 1e-4f, 1e-4f), "Unexpected grouped convolution output, device " << deviceId << ", groups " << groups << ", outputs " << cmapOut << ", stride " << stride << ", pad " << pad << ": " << emsg);
+        BOOST_CHECK_MESSAGE(CheckEqual(grad, expG, emsg, 1e-4f, 1e-4f), "Unexpected grouped convolution gradient, device " << deviceId << ", groups " << groups << ", outputs " << cmapOut << ", stride " << stride << ", pad " << pad << ": " << emsg);
+        BOOST_CHECK_MESSAGE(CheckEqual(filtGrad, expF, emsg, 1e-4f, 1e-4f), "Unexpected grouped filter gradient, device " << deviceId << ", groups " << groups << ", outputs " << cmapOut << ", stride " << stride << ", pad " << pad << ": " << emsg);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConvolutionCuDnnHWC)
+{
+    if (!IsCuDnnSupported())
+        return;
+
+    // cuDNN with NHWC tensors must compute exactly what the legacy engine does on the same HWC data and CHWN filter
+    int deviceId = 0;
+    int n = 3;
+    int cmapIn = 3;
+    int cmapOut = 4;
+    int inW = 7;
+    int inH = 6;
+    int k = 3;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    for (bool pad : {false, true})
+    {
+        int sW = 2;
+        int sH = 1;
+        int outW = GetNumOut(inW, k, sW, pad);
+        int outH = GetNumOut(inH, k, sH, pad);
+
+        vec inBuf(inW * inH * cmapIn * n);
+        vec filtBuf(cmapOut * k * k * cmapIn);
+        vec srcGradBuf(outW * outH * cmapOut * n);
+        for (auto* buf : {&inBuf, &filtBuf, &srcGradBuf})
+            std::generate(buf->begin(), buf->end(), [&] { return dist(rng); });
+
+        SingleMatrix in(inW * inH * cmapIn, n, inBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix filt(cmapOut, k * k * cmapIn, filtBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix srcGrad(outW * outH * cmapOut, n, srcGradBuf.data(), deviceId, matrixFlagNormal);
+
+        std::vector<SingleMatrix> outs, grads, filtGrads;
+        for (auto engType : {ConvFact::EngineType::Legacy, ConvFact::EngineType::CuDnn})
+        {
+            auto fact = ConvFact::Create(deviceId, engType, ImageLayoutKind::HWC);
+            auto eng = fact->CreateConvEngine(deviceId, 0);
+            auto inT = fact->CreateTensor(inW, inH, cmapIn, n);
+            auto filtT = fact->CreateFilter(k, k, cmapIn, cmapOut);
+            auto outT = fact->CreateTensor(outW, outH, cmapOut, n);
+            auto convT = fact->CreateConvDescriptor(*inT, *filtT, sW, sH, pad);
+
+            SingleMatrix out(outW * outH * cmapOut, n, deviceId);
+            SingleMatrix grad(inW * inH * cmapIn, n, deviceId);
+            SingleMatrix filtGrad(cmapOut, k * k * cmapIn, deviceId);
+            SingleMatrix temp(deviceId);
+            grad.SetValue(1);
+            filtGrad.SetValue(1);
+            eng->Forward(*inT, in, *filtT, filt, *convT, *outT, out, temp);
+            eng->BackwardData(*outT, srcGrad, *filtT, filt, *convT, *inT, grad, temp);
+            eng->BackwardFilter(*outT, srcGrad, *inT, in, *convT, *filtT, filtGrad, false, temp);
+            outs.push_back(std::move(out));
+            grads.push_back(std::move(grad));
+            filtGrads.push_back(std::move(filtGrad));
+        }
+
+        std::string emsg;
+        BOOST_CHECK_MESSAGE(CheckEqual(outs[1], outs[0], emsg, 1e-4f, 1e-4f), "Unexpected HWC convolution output, pad " << pad << ": " << emsg);
+        BOOST_CHECK_MESSAGE(CheckEqual(grads[1], grads[0], emsg, 1e-4f, 1e-4f), "Unexpected HWC convolution gradient, pad " << pad << ": " << emsg);
+        BOOST_CHECK_MESSAGE(CheckEqual(filtGrads[1], filtGrads[0], emsg, 1e-4f, 1e-4f), "Unexpected HWC filter gradient, pad " << pad << ": " << emsg);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(MaxPoolForward)
 {
     if (!IsCuDnnSupported())
@@ -488,6 +800,80 @@ BOOST_AUTO_TEST_CASE(MaxPoolBackward)
     }
 }
 
+// CPU max pooling with overlapping windows, with and without padding, against a reference
+BOOST_AUTO_TEST_CASE(MaxPoolCpuOverlapping)
+{
+    int deviceId = -1;
+    int n = 3;
+    int cmap = 20;
+    int inH = 11;
+    int inW = 12;
+    std::mt19937 rng(0);
+
+    for (int k : {2, 3})
+    for (bool pad : {false, true})
+    {
+        int stride = 2;
+        int p = pad ? k / 2 : 0;
+        int outW = pad ? (inW - 1) / stride + 1 : GetNumOut(inW, k, stride, false);
+        int outH = pad ? (inH - 1) / stride + 1 : GetNumOut(inH, k, stride, false);
+
+        auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Legacy, ImageLayoutKind::HWC);
+        auto eng = fact->CreatePoolEngine(deviceId);
+        auto inT = fact->CreateTensor(inW, inH, cmap, n);
+        auto outT = fact->CreateTensor(outW, outH, cmap, n);
+        auto poolT = fact->CreatePoolDescriptor(PoolingDescriptor::PoolKind::Max, k, k, stride, stride, p, p);
+
+        // distinct input values, so that each window has one maximum
+        vec inBuf(inW * inH * cmap * n);
+        std::iota(inBuf.begin(), inBuf.end(), 0.0f);
+        std::shuffle(inBuf.begin(), inBuf.end(), rng);
+        vec srcGradBuf(outW * outH * cmap * n);
+        std::uniform_real_distribution<float> dist(-1, 1);
+        std::generate(srcGradBuf.begin(), srcGradBuf.end(), [&] { return dist(rng); });
+
+        // output pixel (r, c) pools input rows r * stride - p + [0, k) and columns c * stride - p + [0, k), clipped to the image
+        vec expOut(outW * outH * cmap * n);
+        vec expGrad(inW * inH * cmap * n, 1); // gradients are accumulated
+        for (int s = 0; s < n; s++)
+        for (int r = 0; r < outH; r++)
+        for (int c = 0; c < outW; c++)
+        for (int i = 0; i < cmap; i++)
+        {
+            int maxIndex = -1;
+            for (int kr = 0; kr < k; kr++)
+            for (int kc = 0; kc < k; kc++)
+            {
+                int row = r * stride + kr - p;
+                int col = c * stride + kc - p;
+                if (row < 0 || row >= inH || col < 0 || col >= inW)
+                    continue;
+                int inIndex = i + cmap * (row + inH * col) + s * cmap * inH * inW;
+                if (maxIndex < 0 || inBuf[inIndex] > inBuf[maxIndex])
+                    maxIndex = inIndex;
+            }
+            int outIndex = i + cmap * (r + outH * c) + s * cmap * outH * outW;
+            expOut[outIndex] = inBuf[maxIndex];
+            expGrad[maxIndex] += srcGradBuf[outIndex];
+        }
+
+        SingleMatrix in(inW * inH * cmap, n, inBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix out(outW * outH * cmap, n, deviceId);
+        eng->Forward(*inT, in, *poolT, *outT, out);
+
+        std::string emsg;
+        SingleMatrix exp(outW * outH * cmap, n, expOut.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(out, exp, emsg, 0.0f, 0.0f), "Unexpected max pooling output, window " << k << ", pad " << pad << ": " << emsg);
+
+        SingleMatrix srcGrad(outW * outH * cmap, n, srcGradBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix grad(inW * inH * cmap, n, deviceId);
+        grad.SetValue(1);
+        eng->Backward(*outT, out, srcGrad, *poolT, *inT, in, grad);
+        SingleMatrix expG(inW * inH * cmap, n, expGrad.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(grad, expG, emsg, 1e-5f, 1e-5f), "Unexpected max pooling gradient, window " << k << ", pad " << pad << ": " << emsg);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(AvgPoolForward)
 {
     if (!IsCuDnnSupported())
@@ -987,6 +1373,94 @@ BOOST_AUTO_TEST_CASE(BatchNormalizationBackward)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpu)
+{
+    int deviceId = -1;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> nd(1, 2);
+
+    auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Legacy, ImageLayoutKind::HWC);
+    auto eng = fact->CreateConvEngine(deviceId, 0);
+    for (bool spatial : {false, true})
+    for (bool relu : {false, true})
+    {
+        const size_t w = 5, h = 3, c = 4, n = 7;
+        auto t = fact->CreateTensor(w, h, c, n);
+        const size_t crow = w * h * c;
+        const size_t spatialSize = spatial ? w * h : 1;
+        const size_t numStats = crow / spatialSize;
+        const size_t m = n * spatialSize;
+
+        vec xBuf(crow * n), dyBuf(crow * n), scaleBuf(numStats), biasBuf(numStats);
+        for (auto* buf : {&xBuf, &dyBuf, &scaleBuf, &biasBuf})
+            std::generate(buf->begin(), buf->end(), [&] { return nd(rng); });
+
+        // reference with two passes for the statistics
+        vec expMean(numStats, 0), expInvStdDev(numStats, 0), expOut(crow * n), expDScale(numStats, 0), expDBias(numStats, 0), expDx(crow * n);
+        for (size_t j = 0; j < n; j++)
+            for (size_t i = 0; i < crow; i++)
+                expMean[i / spatialSize] += xBuf[j * crow + i] / m;
+        for (size_t j = 0; j < n; j++)
+            for (size_t i = 0; i < crow; i++)
+                expInvStdDev[i / spatialSize] += (xBuf[j * crow + i] - expMean[i / spatialSize]) * (xBuf[j * crow + i] - expMean[i / spatialSize]) / m;
+        const double eps = 1e-5;
+        for (auto& v : expInvStdDev)
+            v = (float) (1 / sqrt(v + eps));
+        for (size_t j = 0; j < n; j++)
+            for (size_t i = 0; i < crow; i++)
+            {
+                const size_t s = i / spatialSize;
+                const float xHat = (xBuf[j * crow + i] - expMean[s]) * expInvStdDev[s];
+                expOut[j * crow + i] = std::max(scaleBuf[s] * xHat + biasBuf[s], relu ? 0 : -std::numeric_limits<float>::infinity());
+                expDScale[s] += dyBuf[j * crow + i] * xHat;
+                expDBias[s] += dyBuf[j * crow + i];
+            }
+        for (size_t j = 0; j < n; j++)
+            for (size_t i = 0; i < crow; i++)
+            {
+                const size_t s = i / spatialSize;
+                const float xHat = (xBuf[j * crow + i] - expMean[s]) * expInvStdDev[s];
+                expDx[j * crow + i] = 1 + scaleBuf[s] * expInvStdDev[s] * (dyBuf[j * crow + i] - (xHat * expDScale[s] + expDBias[s]) / m);
+            }
+
+        SingleMatrix x(crow, n, xBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix scale(numStats, 1, scaleBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix bias(numStats, 1, biasBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix runMean(numStats, 1, deviceId);
+        SingleMatrix runInvStdDev(numStats, 1, deviceId);
+        SingleMatrix saveMean(numStats, 1, deviceId);
+        SingleMatrix saveInvStdDev(numStats, 1, deviceId);
+        SingleMatrix out(crow, n, deviceId);
+        auto scaleBiasT = spatial ? fact->CreateTensor(1, 1, c, 1) : fact->CreateTensor(w, h, c, 1);
+        eng->NormalizeBatch(*t, x, *scaleBiasT, scale, bias, spatial, 1, runMean, runInvStdDev, out, eps, saveMean, saveInvStdDev, relu);
+
+        std::string emsg;
+        SingleMatrix exp(crow, n, expOut.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(out, exp, emsg, 1e-4f, 1e-4f), "Unexpected batch normalization output, spatial " << spatial << ", relu " << relu << ": " << emsg);
+        SingleMatrix mean(numStats, 1, expMean.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(runMean, mean, emsg, 1e-4f, 1e-5f), "Unexpected batch mean: " << emsg);
+        SingleMatrix invStdDev(numStats, 1, expInvStdDev.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(saveInvStdDev, invStdDev, emsg, 1e-4f, 1e-5f), "Unexpected batch inverse std dev: " << emsg);
+
+        SingleMatrix inferenceOut(crow, n, deviceId);
+        eng->NormalizeBatchInference(*t, x, *scaleBiasT, scale, bias, spatial, runMean, runInvStdDev, inferenceOut, relu);
+        BOOST_CHECK_MESSAGE(CheckEqual(inferenceOut, exp, emsg, 1e-4f, 1e-4f), "Unexpected batch normalization inference output: " << emsg);
+
+        SingleMatrix dy(crow, n, dyBuf.data(), deviceId, matrixFlagNormal);
+        SingleMatrix dx(crow, n, deviceId);
+        dx.SetValue(1); // gradients are accumulated
+        SingleMatrix dScale(numStats, 1, deviceId);
+        SingleMatrix dBias(numStats, 1, deviceId);
+        eng->BackwardNormalizeBatch(*t, x, dy, dx, *scaleBiasT, scale, spatial, saveMean, saveInvStdDev, dScale, dBias);
+        SingleMatrix expG(crow, n, expDx.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(dx, expG, emsg, 1e-3f, 1e-4f), "Unexpected batch normalization gradient: " << emsg);
+        SingleMatrix expS(numStats, 1, expDScale.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(dScale, expS, emsg, 1e-3f, 1e-4f), "Unexpected scale gradient: " << emsg);
+        SingleMatrix expB(numStats, 1, expDBias.data(), deviceId, matrixFlagNormal);
+        BOOST_CHECK_MESSAGE(CheckEqual(dBias, expB, emsg, 1e-4f, 1e-4f), "Unexpected bias gradient: " << emsg);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 }
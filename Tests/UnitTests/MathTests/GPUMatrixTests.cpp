@@ -6,6 +6,8 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/GPUMatrix.h"
+#include "../../../Source/Math/CUDACachingMemAllocator.h"
+#include "../../../Source/Math/ComputeStreams.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -537,6 +539,62 @@ BOOST_FIXTURE_TEST_CASE(GPUMatrixCurandSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(GPUMatrixCachingMemAllocatorReuse, RandomSeedFixture)
+{
+    BOOST_CHECK_EQUAL(512, CUDACachingMemAllocator::RoundUpToSizeClass(1));
+    BOOST_CHECK_EQUAL(4096, CUDACachingMemAllocator::RoundUpToSizeClass(4000));
+    BOOST_CHECK_EQUAL((1 << 20) + (1 << 18), CUDACachingMemAllocator::RoundUpToSizeClass((1 << 20) + 1));
+
+    CUDACachingMemAllocator allocator(c_deviceIdZero);
+    void* p0 = allocator.Malloc(1000);
+    allocator.Free(p0);
+
+    // a request of the same size class must be served from the cache
+    void* p1 = allocator.Malloc(900);
+    BOOST_CHECK_EQUAL(p0, p1);
+
+    // a request of a different size class must not
+    void* p2 = allocator.Malloc(100000);
+    BOOST_CHECK_NE(p1, p2);
+
+    auto stats = allocator.GetStatistics();
+    BOOST_CHECK_EQUAL(3, stats.numMallocs);
+    BOOST_CHECK_EQUAL(1, stats.numHits);
+    BOOST_CHECK_EQUAL(2, stats.numMisses);
+    BOOST_CHECK_EQUAL(900 + 100000, stats.bytesRequested);
+
+    allocator.Free(p1);
+    allocator.Free(p2);
+    BOOST_CHECK_EQUAL(0, allocator.GetStatistics().bytesInUse);
+}
+
+BOOST_FIXTURE_TEST_CASE(GPUMatrixStreamScopeAndEvents, RandomSeedFixture)
+{
+    const cudaStream_t mainStream = GetStream();
+    ComputeStream stream(c_deviceIdZero);
+    DeviceEvent produced(c_deviceIdZero);
+
+    GPUMatrix<float> a = GPUMatrix<float>::Ones(64, 64, c_deviceIdZero);
+    GPUMatrix<float> b(64, 64, c_deviceIdZero);
+    {
+        StreamScope scope(stream);
+        BOOST_CHECK(GetStream() == stream.GetHandle());
+        b.AssignProductOf(2.0f, a);
+        produced.Record();
+    }
+    BOOST_CHECK(GetStream() == mainStream);
+
+    // the main stream must see the result of the work on the other stream once it waited for the event
+    produced.Wait();
+    b.RecordStreamUse(stream.GetHandle());
+    unique_ptr<float[]> result(b.CopyToArray());
+    BOOST_CHECK_EQUAL(2.0f, result[0]);
+    BOOST_CHECK_EQUAL(2.0f, result[64 * 64 - 1]);
+
+    produced.Synchronize();
+    BOOST_CHECK(produced.IsComplete());
+}
+
 #if 0 // Temporarily disabling
 BOOST_FIXTURE_TEST_CASE(GPUMatrixLargeInequality, RandomSeedFixture)
 {
@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include "../../../Source/Math/Matrix.h"
 #include "../../../Source/Math/Helpers.h"
+#include "../../../Source/Math/DeviceTransferMonitor.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -107,6 +108,29 @@ BOOST_FIXTURE_TEST_CASE(MatrixDataSynchronization_GravitatingTowardsPreferredDev
     BOOST_CHECK_EQUAL(CurrentDataLocation::GPU, matrixC.GetCurrentMatrixLocation());
 }
 
+// Requires GPU
+BOOST_FIXTURE_TEST_CASE(MatrixDataSynchronization_DeviceTransferMonitorStrictMode, RandomSeedFixture)
+{
+    SingleMatrix matrixA = SingleMatrix::RandomGaussian(64, 23, c_deviceIdZero, 0, 2, IncrementCounter());
+    const std::wstring nodeName = L"A";
+    const std::wstring operationName = L"Test";
+
+    DeviceTransferMonitor::SetMode(DeviceTransferMonitor::strict);
+    {
+        DeviceTransferMonitor::Context context(nodeName, operationName);
+        // element access moves the matrix to the CPU behind the caller's back
+        BOOST_CHECK_THROW(matrixA(1, 1), std::logic_error);
+        // requested transfers are fine
+        matrixA.TransferToDeviceIfNotThere(CPUDEVICE, true);
+        matrixA.TransferToDeviceIfNotThere(c_deviceIdZero, true);
+    }
+    // and so is anything outside of a context
+    float x = matrixA(1, 1);
+    x;
+    DeviceTransferMonitor::SetMode(DeviceTransferMonitor::off);
+    DeviceTransferMonitor::Reset();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -392,6 +392,64 @@ static void TestQuantization(int deviceId, size_t numRows, size_t numCols, float
     }
 }
 
+// quantizing a batch of matrices must give the same bytes and residuals as quantizing them one by one
+template <typename ElemType>
+static void TestBatchQuantization(int deviceId, size_t numBits, bool zeroThresholdFor1Bit, int seed)
+{
+    const std::vector<std::pair<size_t, size_t>> dims = {{25, 13}, {1, 135}, {0, 7}, {489, 1}, {89, 23}, {100, 0}, {15, 35}};
+
+    std::unique_ptr<MemAllocator> allocator(deviceId == CPUDEVICE ? nullptr : new CUDAPageLockedMemAllocator(deviceId));
+    std::unique_ptr<MatrixQuantizerImpl<ElemType>> quantizer(MatrixQuantizerImpl<ElemType>::Create(deviceId, false /*useAsync*/));
+
+    std::vector<std::unique_ptr<Matrix<ElemType>>> inMatrices, batchResiduals, singleResiduals, batchOutMatrices, singleOutMatrices;
+    std::vector<const Matrix<ElemType>*> inMatrixPtrs, inResidualPtrs;
+    std::vector<Matrix<ElemType>*> outResidualPtrs, outMatrixPtrs;
+    // (empty matrices cannot be randomized; the constructor initializes to 0)
+    auto randomMatrix = [deviceId](size_t rows, size_t cols, ElemType range, int seed)
+    {
+        return (rows * cols == 0) ? new Matrix<ElemType>(rows, cols, deviceId) : new Matrix<ElemType>(Matrix<ElemType>::RandomUniform(rows, cols, deviceId, -range, range, seed));
+    };
+    for (size_t i = 0; i < dims.size(); i++)
+    {
+        inMatrices.emplace_back(randomMatrix(dims[i].first, dims[i].second, 0.5, seed + (int) i));
+        batchResiduals.emplace_back(randomMatrix(dims[i].first, dims[i].second, 0.1, seed + 100 + (int) i));
+        singleResiduals.emplace_back(new Matrix<ElemType>(*batchResiduals[i]));
+        batchOutMatrices.emplace_back(new Matrix<ElemType>(dims[i].first, dims[i].second, deviceId));
+        singleOutMatrices.emplace_back(new Matrix<ElemType>(dims[i].first, dims[i].second, deviceId));
+        inMatrixPtrs.push_back(inMatrices[i].get());
+        inResidualPtrs.push_back(batchResiduals[i].get());
+        outResidualPtrs.push_back(batchResiduals[i].get());
+        outMatrixPtrs.push_back(batchOutMatrices[i].get());
+    }
+
+    QuantizedMatrixBatch<ElemType> qBatch(dims, numBits, CPUDEVICE, allocator.get());
+    quantizer->QuantizeBatchAsync(inMatrixPtrs, inResidualPtrs, qBatch, outResidualPtrs, zeroThresholdFor1Bit);
+    quantizer->WaitQuantizeAsyncDone();
+    quantizer->UnquantizeBatchAsync(qBatch, outMatrixPtrs);
+    quantizer->WaitUnquantizeAsyncDone();
+
+    for (size_t i = 0; i < dims.size(); i++)
+    {
+        // empty matrices take no space in the batch (and cannot be quantized individually on the GPU)
+        if (dims[i].first * dims[i].second == 0)
+        {
+            BOOST_CHECK_EQUAL(qBatch.GetOffset(i + 1) - qBatch.GetOffset(i), dims[i].second * QuantizedColumn<ElemType>::QuantizedColumnSize(numBits, dims[i].first));
+            continue;
+        }
+
+        QuantizedMatrix<ElemType> qMatrix(dims[i].first, dims[i].second, numBits, CPUDEVICE, allocator.get());
+        quantizer->QuantizeAsync(*inMatrices[i], *singleResiduals[i], qMatrix, *singleResiduals[i], zeroThresholdFor1Bit);
+        quantizer->WaitQuantizeAsyncDone();
+        quantizer->UnquantizeAsync(qMatrix, *singleOutMatrices[i]);
+        quantizer->WaitUnquantizeAsyncDone();
+
+        BOOST_CHECK_EQUAL(qMatrix.GetSize(), qBatch.GetOffset(i + 1) - qBatch.GetOffset(i));
+        BOOST_CHECK(memcmp(qMatrix.GetArray(), qBatch.GetArray() + qBatch.GetOffset(i), qMatrix.GetSize()) == 0);
+        BOOST_CHECK(batchResiduals[i]->IsEqualTo(*singleResiduals[i], 0));
+        BOOST_CHECK(batchOutMatrices[i]->IsEqualTo(*singleOutMatrices[i], 0));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE(GPUMatrixSuite)
 
 BOOST_FIXTURE_TEST_CASE(GPUMatrix1BitQuantizeFloat, RandomSeedFixture)
@@ -426,6 +484,13 @@ BOOST_FIXTURE_TEST_CASE(GPUMatrix1BitQuantizeDouble, RandomSeedFixture)
     TestQuantization<double>(c_deviceIdZero, 100, 50, -0.5f, +0.5f, 2915, 5);
 }
 
+BOOST_FIXTURE_TEST_CASE(GPUMatrixBatchQuantizeFloat, RandomSeedFixture)
+{
+    TestBatchQuantization<float>(c_deviceIdZero, 1, false, 3015);
+    TestBatchQuantization<float>(c_deviceIdZero, 1, true, 3115);
+    TestBatchQuantization<float>(c_deviceIdZero, 4, false, 3215);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(CPUMatrixSuite);
@@ -462,6 +527,13 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrix1BitQuantizeDouble, RandomSeedFixture)
     TestQuantization<double>(CPUDEVICE, 100, 50, -0.5f, +0.5f, 2915, 5);
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixBatchQuantizeFloat, RandomSeedFixture)
+{
+    TestBatchQuantization<float>(CPUDEVICE, 1, false, 3015);
+    TestBatchQuantization<float>(CPUDEVICE, 1, true, 3115);
+    TestBatchQuantization<float>(CPUDEVICE, 4, false, 3215);
+}
+
 /*
         Original test cases were using these parameter:
 
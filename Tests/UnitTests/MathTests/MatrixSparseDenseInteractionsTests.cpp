@@ -125,6 +125,33 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparse, RandomSeedFixture)
     BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixSparseTimesDense, RandomSeedFixture)
+{
+    const size_t rows = 37, cols = 23, numColsB = 5;
+    Matrix<float> mAdense(CPUDEVICE);
+    mAdense.AssignTruncateBottomOf(Matrix<float>::RandomUniform(rows, cols, CPUDEVICE, -3.0f, 0.5f, IncrementCounter()), 0);
+
+    for (auto format : { matrixFormatSparseCSC, matrixFormatSparseCSR })
+    {
+        Matrix<float> mAsparse(mAdense);
+        mAsparse.SwitchToMatrixType(MatrixType::SPARSE, format, true);
+        for (bool transposeA : { false, true })
+        {
+            Matrix<float> mB = Matrix<float>::RandomGaussian(transposeA ? rows : cols, numColsB, CPUDEVICE, 1, 4, IncrementCounter());
+            Matrix<float> mC = Matrix<float>::RandomGaussian(transposeA ? cols : rows, numColsB, CPUDEVICE, 1, 2, IncrementCounter());
+            Matrix<float> mD(mC);
+
+            Matrix<float>::MultiplyAndWeightedAdd(0.3f, mAdense, transposeA, mB, false, 0.0f, mC);
+            Matrix<float>::MultiplyAndWeightedAdd(0.3f, mAsparse, transposeA, mB, false, 0.0f, mD);
+            BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
+
+            Matrix<float>::MultiplyAndWeightedAdd(3.3f, mAdense, transposeA, mB, false, 1.3f, mC);
+            Matrix<float>::MultiplyAndWeightedAdd(3.3f, mAsparse, transposeA, mB, false, 1.3f, mD);
+            BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
+        }
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseAsSparse, RandomSeedFixture)
 {
 #if 0
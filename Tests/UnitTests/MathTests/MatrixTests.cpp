@@ -882,6 +882,30 @@ BOOST_FIXTURE_TEST_CASE(MatrixColumnSlice, RandomSeedFixture)
     BOOST_CHECK(cg.IsEqualTo(dg, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(MatrixObjectCacheRecycling, RandomSeedFixture)
+{
+    // a freed object is handed out again for the next object of the same size class
+    void* first = MatrixObjectCache::Allocate(100);
+    MatrixObjectCache::Free(first);
+    void* second = MatrixObjectCache::Allocate(90);
+    BOOST_CHECK_EQUAL(first, second);
+
+    // objects too large for the cache go to the heap and don't get mixed up with cached ones
+    void* large = MatrixObjectCache::Allocate(100000);
+    BOOST_CHECK(large != second);
+    MatrixObjectCache::Free(large);
+    MatrixObjectCache::Free(second);
+
+    // column slices, whose CPUMatrix objects come from the cache
+    Matrix<float> m0(8, 16, CPUDEVICE);
+    m0.SetUniformRandomValue(-1, 1, IncrementCounter());
+    for (size_t j = 0; j < m0.GetNumCols(); j++)
+    {
+        Matrix<float> slice = m0.ColumnSlice(j, 1);
+        BOOST_CHECK_EQUAL(m0(3, j), slice(3, 0));
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixKhatriRaoProduct, RandomSeedFixture)
 {
     std::array<float, 24> arr =
@@ -1079,6 +1103,29 @@ BOOST_FIXTURE_TEST_CASE(MatrixVectorMax, RandomSeedFixture)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(MatrixVectorMaxTopKLargeColumns, RandomSeedFixture)
+{
+    // a small k is selected without a full sort on the GPU, a large one by sorting; both must agree with the CPU
+    const size_t m = 5000, n = 7;
+    SingleMatrix src = SingleMatrix::RandomUniform(m, n, CPUDEVICE, -1, 1, IncrementCounter());
+    for (int topK : {5, 32, 40})
+    {
+        SingleMatrix expectedIdx(CPUDEVICE);
+        SingleMatrix expectedVal(CPUDEVICE);
+        src.VectorMax(expectedIdx, expectedVal, true, topK);
+        for (size_t j = 0; j < n; j++)
+            for (int i = 1; i < topK; i++)
+                BOOST_CHECK_GE(expectedVal(i - 1, j), expectedVal(i, j));
+
+        SingleMatrix gpuSrc(src, c_deviceIdZero);
+        SingleMatrix actualIdx(c_deviceIdZero);
+        SingleMatrix actualVal(c_deviceIdZero);
+        gpuSrc.VectorMax(actualIdx, actualVal, true, topK);
+        BOOST_CHECK(SingleMatrix(actualIdx, CPUDEVICE).IsEqualTo(expectedIdx));
+        BOOST_CHECK(SingleMatrix(actualVal, CPUDEVICE).IsEqualTo(expectedVal));
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
 {
     float labels[] = {1.0f, 2.0f, 3.0f};
@@ -1101,6 +1148,753 @@ BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
         BOOST_CHECK_EQUAL(expectedDiff, actual.Get00Element());
     }
 }
+BOOST_FIXTURE_TEST_CASE(MatrixLSTMPointwise, RandomSeedFixture)
+{
+    const size_t H = 7, S = 5;
+    auto sigmoid = [](float x) { return 1.0f / (1.0f + exp(-x)); };
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        for (bool withPeepholes : {false, true})
+        {
+            SingleMatrix z = SingleMatrix::RandomUniform(4 * H, S, deviceId, -2.0f, 2.0f, IncrementCounter());
+            SingleMatrix prevCell = SingleMatrix::RandomUniform(H, S, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix outputGradient = SingleMatrix::RandomUniform(H, S, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix cellGradient = SingleMatrix::RandomUniform(H, S, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix peepholes(deviceId);
+            if (withPeepholes)
+                peepholes = SingleMatrix::RandomUniform(3 * H, 1, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix z0(deviceId), dc0(deviceId);
+            z0.SetValue(z);
+            dc0.SetValue(cellGradient);
+
+            SingleMatrix cell(H, S, deviceId), output(H, S, deviceId), gatesGradient(4 * H, S, deviceId);
+            SingleMatrix::LSTMPointwiseForward(z, prevCell, peepholes, cell, output);
+            SingleMatrix::LSTMPointwiseBackward(z, cell, prevCell, peepholes, outputGradient, cellGradient, gatesGradient);
+
+            for (size_t s = 0; s < S; s++)
+            {
+                for (size_t j = 0; j < H; j++)
+                {
+                    float pi = withPeepholes ? peepholes(j, 0) : 0, pf = withPeepholes ? peepholes(H + j, 0) : 0, po = withPeepholes ? peepholes(2 * H + j, 0) : 0;
+                    float cp = prevCell(j, s);
+                    float i = sigmoid(z0(j, s) + pi * cp), f = sigmoid(z0(H + j, s) + pf * cp), g = tanh(z0(3 * H + j, s));
+                    float c = f * cp + i * g;
+                    float o = sigmoid(z0(2 * H + j, s) + po * c);
+                    BOOST_CHECK_SMALL(i - z(j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(o - z(2 * H + j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(g - z(3 * H + j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(c - cell(j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(o * tanh(c) - output(j, s), c_epsilonFloatE4);
+
+                    float dh = outputGradient(j, s);
+                    float dzo = dh * tanh(c) * o * (1 - o);
+                    float dc = dc0(j, s) + dh * o * (1 - tanh(c) * tanh(c)) + dzo * po;
+                    float dzi = dc * g * i * (1 - i), dzf = dc * cp * f * (1 - f);
+                    BOOST_CHECK_SMALL(dzi - gatesGradient(j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(dzf - gatesGradient(H + j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(dzo - gatesGradient(2 * H + j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(dc * i * (1 - g * g) - gatesGradient(3 * H + j, s), c_epsilonFloatE4);
+                    BOOST_CHECK_SMALL(dc * f + dzi * pi + dzf * pf - cellGradient(j, s), c_epsilonFloatE4);
+                }
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixGRUPointwise, RandomSeedFixture)
+{
+    const size_t H = 7, S = 5;
+    auto sigmoid = [](float x) { return 1.0f / (1.0f + exp(-x)); };
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix z = SingleMatrix::RandomUniform(3 * H, S, deviceId, -2.0f, 2.0f, IncrementCounter());
+        SingleMatrix q = SingleMatrix::RandomUniform(3 * H, S, deviceId, -2.0f, 2.0f, IncrementCounter());
+        SingleMatrix prevOutput = SingleMatrix::RandomUniform(H, S, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix outputGradient = SingleMatrix::RandomUniform(H, S, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix z0(deviceId), dh0(deviceId);
+        z0.SetValue(z);
+        dh0.SetValue(outputGradient);
+
+        SingleMatrix output(H, S, deviceId), gatesGradient(3 * H, S, deviceId), recurrentGradient(3 * H, S, deviceId);
+        SingleMatrix::GRUPointwiseForward(z, q, prevOutput, output);
+        SingleMatrix::GRUPointwiseBackward(z, q, prevOutput, outputGradient, gatesGradient, recurrentGradient);
+
+        for (size_t s = 0; s < S; s++)
+        {
+            for (size_t j = 0; j < H; j++)
+            {
+                float r = sigmoid(z0(j, s) + q(j, s)), u = sigmoid(z0(H + j, s) + q(H + j, s));
+                float n = tanh(z0(2 * H + j, s) + r * q(2 * H + j, s));
+                float hp = prevOutput(j, s);
+                BOOST_CHECK_SMALL(r - z(j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(u - z(H + j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(n - z(2 * H + j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL((1 - u) * n + u * hp - output(j, s), c_epsilonFloatE4);
+
+                float dh = dh0(j, s);
+                float dn = dh * (1 - u) * (1 - n * n), du = dh * (hp - n) * u * (1 - u), dr = dn * q(2 * H + j, s) * r * (1 - r);
+                BOOST_CHECK_SMALL(dr - gatesGradient(j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(du - gatesGradient(H + j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(dn - gatesGradient(2 * H + j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(dr - recurrentGradient(j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(du - recurrentGradient(H + j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(dn * r - recurrentGradient(2 * H + j, s), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(dh * u - outputGradient(j, s), c_epsilonFloatE4);
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCosDistanceWithNegativeSamples, RandomSeedFixture)
+{
+    // the shift wraps around the columns; the reference scatters the gradient of each similarity to both of its columns
+    const size_t D = 6, n = 5, shift = 3, negNumber = 3, M = negNumber + 1;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix a = SingleMatrix::RandomUniform(D, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix b = SingleMatrix::RandomUniform(D, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix g = SingleMatrix::RandomUniform(M, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix invNormA(deviceId), invNormB(deviceId), c(M, n, deviceId);
+        SingleMatrix::CosDistanceWithNegativeSamples(a, b, shift, negNumber, invNormA, invNormB, c);
+
+        SingleMatrix da(D, n, deviceId), db(D, n, deviceId);
+        da.SetValue(1.0f);
+        db.SetValue(1.0f);
+        SingleMatrix::CosDistanceWithNegativeSamplesGradient(a, b, invNormA, invNormB, c, g, shift, /*wrtRight=*/false, da);
+        SingleMatrix::CosDistanceWithNegativeSamplesGradient(a, b, invNormA, invNormB, c, g, shift, /*wrtRight=*/true, db);
+
+        vector<float> refDa(D * n, 1.0f), refDb(D * n, 1.0f);
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t m = 0; m < M; m++)
+            {
+                size_t k = m == 0 ? j : (j + shift + m - 1) % n;
+                float aa = 0, bb = 0, ab = 0;
+                for (size_t d = 0; d < D; d++)
+                {
+                    aa += a(d, j) * a(d, j);
+                    bb += b(d, k) * b(d, k);
+                    ab += a(d, j) * b(d, k);
+                }
+                float cos = ab / sqrt(aa * bb);
+                BOOST_CHECK_SMALL(cos - c(m, j), c_epsilonFloatE4);
+                for (size_t d = 0; d < D; d++)
+                {
+                    refDa[j * D + d] += g(m, j) * (b(d, k) / sqrt(aa * bb) - cos * a(d, j) / aa);
+                    refDb[k * D + d] += g(m, j) * (a(d, j) / sqrt(aa * bb) - cos * b(d, k) / bb);
+                }
+            }
+        }
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t d = 0; d < D; d++)
+            {
+                BOOST_CHECK_SMALL(refDa[j * D + d] - da(d, j), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(refDb[j * D + d] - db(d, j), c_epsilonFloatE4);
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCrossEntropyWithSoftmax, RandomSeedFixture)
+{
+    // more rows than threads of a GPU block; soft labels, and a column without labels (as masked in a gap)
+    const size_t M = 300, N = 6;
+    vector<float> labelValues(M * N, 0);
+    for (size_t j = 0; j < N; j++)
+    {
+        if (j == 3)
+            continue;
+        labelValues[j * M + j * 37 % M] = 0.75f;
+        labelValues[j * M + (j * 37 + 1) % M] = 0.25f;
+    }
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix logits = SingleMatrix::RandomUniform(M, N, deviceId, -5.0f, 5.0f, IncrementCounter());
+        SingleMatrix labels(deviceId);
+        labels.SetValue(M, N, deviceId, labelValues.data());
+        SingleMatrix alpha(1, 1, deviceId);
+        alpha.SetValue(2.0f);
+
+        SingleMatrix logSumExp(1, N, deviceId), columnLoss(1, N, deviceId);
+        SingleMatrix gradient = SingleMatrix::Ones(M, N, deviceId);
+        SingleMatrix::CrossEntropyWithSoftmaxForward(labels, logits, logSumExp, columnLoss);
+        SingleMatrix::CrossEntropyWithSoftmaxBackward(alpha, labels, logits, logSumExp, gradient);
+
+        // reference: the unfused log softmax
+        SingleMatrix logSoftmax(deviceId);
+        logSoftmax.AssignLogSoftmaxOf(logits, true);
+        for (size_t j = 0; j < N; j++)
+        {
+            BOOST_CHECK_CLOSE(logits(0, j) - logSoftmax(0, j), logSumExp(0, j), c_epsilonFloatE3);
+            float loss = 0;
+            for (size_t i = 0; i < M; i++)
+            {
+                loss -= labels(i, j) * logSoftmax(i, j);
+                BOOST_CHECK_SMALL(1.0f + 2.0f * (exp(logSoftmax(i, j)) - labels(i, j)) - gradient(i, j), c_epsilonFloatE4);
+            }
+            BOOST_CHECK_SMALL(loss - columnLoss(0, j), c_epsilonFloatE3);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCrossEntropyWithSoftmaxSparseLabels, RandomSeedFixture)
+{
+    // one-hot labels in CSC format, as a reader delivers them to a sparse input, must give the results of the dense labels
+    const size_t M = 300, N = 6;
+    vector<float> labelValues(M * N, 0);
+    for (size_t j = 0; j < N; j++)
+    {
+        if (j != 3)
+            labelValues[j * M + j * 37 % M] = 1.0f;
+    }
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix logits = SingleMatrix::RandomUniform(M, N, deviceId, -5.0f, 5.0f, IncrementCounter());
+        SingleMatrix labels(deviceId);
+        labels.SetValue(M, N, deviceId, labelValues.data());
+        SingleMatrix sparseLabels(deviceId);
+        sparseLabels.SetValue(M, N, deviceId, labelValues.data());
+        sparseLabels.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, true);
+        SingleMatrix alpha(1, 1, deviceId);
+        alpha.SetValue(2.0f);
+
+        SingleMatrix logSumExp(1, N, deviceId), columnLoss(1, N, deviceId);
+        SingleMatrix gradient = SingleMatrix::Ones(M, N, deviceId);
+        SingleMatrix::CrossEntropyWithSoftmaxForward(labels, logits, logSumExp, columnLoss);
+        SingleMatrix::CrossEntropyWithSoftmaxBackward(alpha, labels, logits, logSumExp, gradient);
+
+        SingleMatrix sparseLogSumExp(1, N, deviceId), sparseColumnLoss(1, N, deviceId);
+        SingleMatrix sparseGradient = SingleMatrix::Ones(M, N, deviceId);
+        SingleMatrix::CrossEntropyWithSoftmaxForward(sparseLabels, logits, sparseLogSumExp, sparseColumnLoss);
+        SingleMatrix::CrossEntropyWithSoftmaxBackward(alpha, sparseLabels, logits, sparseLogSumExp, sparseGradient);
+
+        BOOST_CHECK(sparseLogSumExp.IsEqualTo(logSumExp, c_epsilonFloatE4));
+        BOOST_CHECK(sparseColumnLoss.IsEqualTo(columnLoss, c_epsilonFloatE3));
+        BOOST_CHECK(sparseGradient.IsEqualTo(gradient, c_epsilonFloatE4));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixSegmentedLogSoftmax, RandomSeedFixture)
+{
+    // segments of a packed row vector, one longer than a GPU block; element 3 belongs to no segment
+    const size_t numElements = 420;
+    float segmentValues[] = {
+        0.0f, 3.0f, 1.0f,
+        4.0f, 16.0f, 15.0f,
+        20.0f, 400.0f, 123.0f};
+    const size_t S = 3;
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix values = SingleMatrix::RandomUniform(1, numElements, deviceId, -3.0f, 3.0f, IncrementCounter());
+        SingleMatrix segments(3, S, segmentValues, deviceId, matrixFlagNormal);
+        SingleMatrix alpha(1, 1, deviceId);
+        alpha.SetValue(0.5f);
+
+        SingleMatrix logProbs = SingleMatrix::Zeros(1, numElements, deviceId);
+        SingleMatrix loss(1, S, deviceId);
+        SingleMatrix gradient = SingleMatrix::Ones(1, numElements, deviceId);
+        SingleMatrix::SegmentedLogSoftmax(values, segments, logProbs, loss);
+        SingleMatrix::SegmentedSoftmaxGradient(alpha, logProbs, segments, 1, gradient);
+
+        BOOST_CHECK_EQUAL(0.0f, logProbs(0, 3));
+        BOOST_CHECK_EQUAL(1.0f, gradient(0, 3));
+        for (size_t s = 0; s < S; s++)
+        {
+            const size_t offset = (size_t) segmentValues[3 * s], length = (size_t) segmentValues[3 * s + 1], target = (size_t) segmentValues[3 * s + 2];
+            float sum = 0;
+            for (size_t i = 0; i < length; i++)
+                sum += exp(values(0, offset + i));
+            for (size_t i = 0; i < length; i++)
+            {
+                const float p = exp(values(0, offset + i)) / sum;
+                BOOST_CHECK_SMALL(log(p) - logProbs(0, offset + i), c_epsilonFloatE4);
+                BOOST_CHECK_SMALL(1.0f + 0.5f * (p - (i == target ? 1 : 0)) - gradient(0, offset + i), c_epsilonFloatE4);
+            }
+            BOOST_CHECK_SMALL(-logProbs(0, offset + target) - loss(0, s), c_epsilonFloatE4);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixGatherScatterColumns, RandomSeedFixture)
+{
+    float indices[] = {4.0f, 0.0f, 2.0f};
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix a = SingleMatrix::RandomUniform(7, 5, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix columnIndices(1, 3, indices, deviceId, matrixFlagNormal);
+        SingleMatrix gathered(deviceId);
+        gathered.AssignGatheredColumnsOf(a, columnIndices);
+        BOOST_CHECK_EQUAL(7, gathered.GetNumRows());
+        BOOST_CHECK_EQUAL(3, gathered.GetNumCols());
+
+        SingleMatrix b = SingleMatrix::Zeros(7, 5, deviceId);
+        b.AddScatteredColumnsOf(gathered, columnIndices);
+        b.AddScatteredColumnsOf(gathered, columnIndices);
+        for (size_t i = 0; i < 7; i++)
+        {
+            for (size_t j = 0; j < 3; j++)
+                BOOST_CHECK_EQUAL(a(i, (size_t) indices[j]), gathered(i, j));
+            BOOST_CHECK_EQUAL(2 * a(i, 4), b(i, 4));
+            BOOST_CHECK_EQUAL(0.0f, b(i, 1));
+            BOOST_CHECK_EQUAL(0.0f, b(i, 3));
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixAliasSamples, RandomSeedFixture)
+{
+    // alias table of p = (0.5, 0.25, 0.125, 0.125): buckets 2 and 3 are topped up by index 0
+    float table[] = {
+        1.0f, 0.0f,
+        1.0f, 1.0f,
+        0.5f, 0.0f,
+        0.5f, 0.0f};
+    float fixedUniforms[] = {
+        0.6f, 0.3f,
+        0.6f, 0.7f,
+        1.0f, 1.0f,
+        0.3f, 0.99f};
+    float expected[] = {2.0f, 0.0f, 0.0f, 1.0f};
+    const double p[] = {0.5, 0.25, 0.125, 0.125};
+    const size_t numSamples = 100000;
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix aliasTable(2, 4, table, deviceId, matrixFlagNormal);
+        SingleMatrix uniforms(2, 4, fixedUniforms, deviceId, matrixFlagNormal);
+        SingleMatrix samples(deviceId);
+        samples.AssignAliasSamplesOf(aliasTable, uniforms);
+        BOOST_CHECK_EQUAL(1, samples.GetNumRows());
+        BOOST_CHECK_EQUAL(4, samples.GetNumCols());
+        for (size_t j = 0; j < 4; j++)
+            BOOST_CHECK_EQUAL(expected[j], samples(0, j));
+
+        SingleMatrix randomUniforms = SingleMatrix::RandomUniform(2, numSamples, deviceId, 0.0f, 1.0f, IncrementCounter());
+        samples.AssignAliasSamplesOf(aliasTable, randomUniforms);
+        unique_ptr<float[]> ids(samples.CopyToArray());
+        vector<size_t> counts(4, 0);
+        for (size_t j = 0; j < numSamples; j++)
+            counts[(size_t) ids[j]]++;
+        for (size_t k = 0; k < 4; k++)
+            BOOST_CHECK_SMALL((double) counts[k] / numSamples - p[k], 0.01);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixNoiseContrastiveLoss, RandomSeedFixture)
+{
+    // the last column is far in the tails of the sigmoid, where only the target and the third row add 100 each to the loss
+    const size_t M = 4, T = 6;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        vector<float> values(M * T);
+        SingleMatrix random = SingleMatrix::RandomUniform(M, T, deviceId, -5.0f, 5.0f, IncrementCounter());
+        random.CopySection(M, T, values.data(), M);
+        values[M * (T - 1)] = -100;
+        values[M * (T - 1) + 1] = -100;
+        values[M * (T - 1) + 2] = 100;
+        values[M * (T - 1) + 3] = -100;
+        SingleMatrix logits(M, T, values.data(), deviceId, matrixFlagNormal);
+        SingleMatrix loss(deviceId);
+        SingleMatrix gradient(deviceId);
+        SingleMatrix::NoiseContrastiveLoss(logits, loss, gradient);
+
+        for (size_t t = 0; t < T; t++)
+        {
+            double expectedLoss = 0;
+            for (size_t i = 0; i < M; i++)
+            {
+                const double z = values[t * M + i];
+                const double sigmoid = 1 / (1 + exp(-z));
+                expectedLoss += i == 0 ? -log(sigmoid) : -log(1 - sigmoid);
+                BOOST_CHECK_SMALL((float) (i == 0 ? sigmoid - 1 : sigmoid) - gradient(i, t), c_epsilonFloatE4);
+            }
+            if (t < T - 1)
+                BOOST_CHECK_SMALL((float) expectedLoss - loss(0, t), c_epsilonFloatE3);
+        }
+        BOOST_CHECK_SMALL(200.0f - loss(0, T - 1), c_epsilonFloatE4);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixPhiloxDropout, RandomSeedFixture)
+{
+    const size_t M = 7, N = 300;
+    const float rate = 0.25f, scale = 1 / (1 - rate);
+    const unsigned long seed = 12345;
+    const size_t stream = 3;
+    vector<float> expected; // from the first device, to compare the second against
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix ones(M, N, deviceId);
+        ones.SetValue(1);
+        SingleMatrix dropped(deviceId);
+        dropped.AssignDropoutOf(ones, rate, seed, stream, 0);
+
+        // every element is either dropped or scaled, at about the rate
+        size_t numDropped = 0;
+        for (size_t j = 0; j < N; j++)
+        {
+            for (size_t i = 0; i < M; i++)
+            {
+                const float v = dropped(i, j);
+                BOOST_CHECK(v == 0 || fabs(v - scale) < c_epsilonFloatE5);
+                numDropped += v == 0 ? 1 : 0;
+            }
+        }
+        BOOST_CHECK_SMALL((float) numDropped / (M * N) - rate, 0.03f);
+
+        // the backprop regenerates the same mask, also for a slice at its offset
+        SingleMatrix regenerated = SingleMatrix::Zeros(M, N, deviceId);
+        regenerated.AddDropoutOf(ones, rate, seed, stream, 0);
+        BOOST_CHECK(regenerated.IsEqualTo(dropped, c_epsilonFloatE5));
+        const size_t firstCol = 11, numCols = 5;
+        SingleMatrix slice = SingleMatrix::Zeros(M, numCols, deviceId);
+        slice.AddDropoutOf(ones.ColumnSlice(firstCol, numCols), rate, seed, stream, M * firstCol);
+        BOOST_CHECK(slice.IsEqualTo(dropped.ColumnSlice(firstCol, numCols), c_epsilonFloatE5));
+
+        // another stream gives another mask
+        SingleMatrix other(deviceId);
+        other.AssignDropoutOf(ones, rate, seed, stream + 1, 0);
+        BOOST_CHECK(!other.IsEqualTo(dropped, c_epsilonFloatE5));
+
+        // the same numbers on either device
+        SingleMatrix uniform(M, N, deviceId);
+        uniform.SetPhiloxUniformRandomValue(-1, 1, seed);
+        vector<float> values(M * N);
+        uniform.CopySection(M, N, values.data(), M);
+        for (auto v : values)
+            BOOST_CHECK(v >= -1 && v < 1);
+        if (expected.empty())
+            expected = values;
+        else
+        {
+            for (size_t k = 0; k < values.size(); k++)
+                BOOST_CHECK_SMALL(values[k] - expected[k], c_epsilonFloatE5);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixMultiTensorSGDUpdate, RandomSeedFixture)
+{
+    const size_t sizes[][2] = {{13, 7}, {300, 250}, {1, 5}}; // the second spans two chunks
+    const float learnRate = 0.01f, momentum = 0.9f, l2 = 0.002f, maxNorm = 5;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        for (int type = 0; type < 3; type++) // momentum SGD, Nesterov, AdaGrad
+        {
+            vector<SingleMatrix> weights, gradients, smoothed, expectedWeights, expectedSmoothed;
+            for (const auto& size : sizes)
+            {
+                weights.push_back(SingleMatrix::RandomUniform(size[0], size[1], deviceId, -1, 1, IncrementCounter()));
+                gradients.push_back(SingleMatrix::RandomGaussian(size[0], size[1], deviceId, 0, 1, IncrementCounter()));
+                smoothed.push_back(SingleMatrix::RandomUniform(size[0], size[1], deviceId, 0, 1, IncrementCounter()));
+                expectedWeights.push_back(SingleMatrix(weights.back()));
+                expectedSmoothed.push_back(SingleMatrix(smoothed.back()));
+            }
+
+            // the sums of squares in one reduction
+            vector<const SingleMatrix*> gradientPtrs;
+            for (const auto& g : gradients)
+                gradientPtrs.push_back(&g);
+            vector<double> sumsOfSquares;
+            SingleMatrix::MultiTensorSumOfSquares(gradientPtrs, sumsOfSquares);
+            BOOST_REQUIRE_EQUAL(sumsOfSquares.size(), gradients.size());
+
+            // reference: norm clipping, L2, and the update of each matrix separately
+            vector<float> scales;
+            for (size_t i = 0; i < gradients.size(); i++)
+            {
+                const double norm = gradients[i].FrobeniusNorm();
+                BOOST_CHECK_SMALL(sumsOfSquares[i] - norm * norm, 1e-3 * norm * norm);
+                scales.push_back(norm > maxNorm ? (float) (maxNorm / norm) : 1.0f);
+                SingleMatrix g(gradients[i]);
+                g *= scales.back();
+                SingleMatrix::ScaleAndAdd(l2, expectedWeights[i], g);
+                if (type == 2)
+                {
+                    expectedSmoothed[i].Adagrad(g, false);
+                    SingleMatrix::ScaleAndAdd(-learnRate, g, expectedWeights[i]);
+                }
+                else
+                    expectedSmoothed[i].NormalGrad(g, expectedWeights[i], learnRate, momentum, type == 1);
+            }
+
+            vector<SingleMatrix*> weightPtrs, smoothedPtrs;
+            for (size_t i = 0; i < weights.size(); i++)
+            {
+                weightPtrs.push_back(&weights[i]);
+                smoothedPtrs.push_back(&smoothed[i]);
+            }
+            SingleMatrix::MultiTensorSGDUpdate(weightPtrs, gradientPtrs, smoothedPtrs, scales, 0, l2, learnRate, momentum, type == 1, type == 2);
+            for (size_t i = 0; i < weights.size(); i++)
+            {
+                BOOST_CHECK(weights[i].IsEqualTo(expectedWeights[i], c_epsilonFloatE4));
+                BOOST_CHECK(smoothed[i].IsEqualTo(expectedSmoothed[i], c_epsilonFloatE4));
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixLamb, RandomSeedFixture)
+{
+    const size_t M = 30, N = 20;
+    const float lr = 0.01f, weightDecay = 0.1f;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix weights = SingleMatrix::RandomUniform(M, N, deviceId, -1, 1, IncrementCounter());
+        SingleMatrix gradients = SingleMatrix::RandomGaussian(M, N, deviceId, 0, 100, IncrementCounter());
+        SingleMatrix initialWeights(weights), initialGradients(gradients);
+        SingleMatrix state(deviceId);
+        state.Lamb(gradients, weights, lr, 0.9f, 0.999f, 1e-8f, weightDecay, 1);
+
+        // the first step moves the weights by lr ||w|| in the direction sign(g) + weightDecay w, whatever the scale of the gradients
+        SingleMatrix direction(initialWeights);
+        direction *= weightDecay;
+        for (size_t j = 0; j < N; j++)
+            for (size_t i = 0; i < M; i++)
+                direction(i, j) += initialGradients(i, j) > 0 ? 1.0f : -1.0f;
+        SingleMatrix step(initialWeights);
+        step -= weights;
+        BOOST_CHECK_SMALL(step.FrobeniusNorm() - lr * initialWeights.FrobeniusNorm(), c_epsilonFloatE4);
+        SingleMatrix::ScaleAndAdd(-(float) (step.FrobeniusNorm() / direction.FrobeniusNorm()), direction, step);
+        BOOST_CHECK_SMALL(step.FrobeniusNorm(), c_epsilonFloatE4);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCRF, RandomSeedFixture)
+{
+    // two parallel sequences of 3 and 2 frames, with a gap in the last column; checked against enumerating all paths
+    const size_t L = 3, S = 2, N = 6;
+    const vector<vector<size_t>> columns = {{0, 2, 4}, {1, 3}};
+    const vector<float> sequences = {0, 3, 1, 2};
+    const vector<float> labelIds = {2, 0, 1, 1, 2, 0};
+    const float gradientScale = 2;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        vector<float> scoreValues(L * N), transitionValues(L * L);
+        SingleMatrix randomScores = SingleMatrix::RandomUniform(L, N, deviceId, -2.0f, 2.0f, IncrementCounter());
+        randomScores.CopySection(L, N, scoreValues.data(), L);
+        SingleMatrix randomTransitions = SingleMatrix::RandomUniform(L, L, deviceId, -2.0f, 2.0f, IncrementCounter());
+        randomTransitions.CopySection(L, L, transitionValues.data(), L);
+        auto score = [&](size_t k, size_t j) { return (double) scoreValues[j * L + k]; };
+        auto transition = [&](size_t k, size_t i) { return (double) transitionValues[i * L + k]; };
+
+        SingleMatrix scores(L, N, scoreValues.data(), deviceId, matrixFlagNormal);
+        SingleMatrix transitions(L, L, transitionValues.data(), deviceId, matrixFlagNormal);
+        SingleMatrix sequencesMatrix(2, 2, const_cast<float*>(sequences.data()), deviceId, matrixFlagNormal);
+        SingleMatrix labels(1, N, const_cast<float*>(labelIds.data()), deviceId, matrixFlagNormal);
+        SingleMatrix alpha(1, 1, const_cast<float*>(&gradientScale), deviceId, matrixFlagNormal);
+        SingleMatrix logAlpha(deviceId), logBeta(deviceId), logPartition(deviceId), loss(deviceId);
+        SingleMatrix scoresGradient = SingleMatrix::Zeros(L, N, deviceId);
+        SingleMatrix transitionsGradient = SingleMatrix::Zeros(L, L, deviceId);
+        SingleMatrix bestScores(deviceId), backpointers(deviceId), path(deviceId);
+        SingleMatrix::CRFForward(labels, scores, transitions, sequencesMatrix, S, logAlpha, logPartition, loss);
+        SingleMatrix::CRFBackward(alpha, labels, scores, transitions, sequencesMatrix, S, logAlpha, logPartition, logBeta, scoresGradient, transitionsGradient);
+        SingleMatrix::CRFViterbi(scores, transitions, sequencesMatrix, S, bestScores, backpointers, path);
+
+        vector<double> expectedScoresGradient(L * N, 0), expectedTransitionsGradient(L * L, 0);
+        for (size_t s = 0; s < S; s++)
+        {
+            const auto& cols = columns[s];
+            const size_t T = cols.size();
+            auto pathScore = [&](const vector<size_t>& y)
+            {
+                double sum = 0;
+                for (size_t t = 0; t < T; t++)
+                    sum += score(y[t], cols[t]) + (t > 0 ? transition(y[t], y[t - 1]) : 0);
+                return sum;
+            };
+
+            // all L^T paths
+            vector<vector<size_t>> paths;
+            size_t numPaths = 1;
+            for (size_t t = 0; t < T; t++)
+                numPaths *= L;
+            for (size_t p = 0; p < numPaths; p++)
+            {
+                vector<size_t> y(T);
+                for (size_t t = 0, q = p; t < T; t++, q /= L)
+                    y[t] = q % L;
+                paths.push_back(y);
+            }
+            double Z = 0, bestScore = -1e30;
+            vector<size_t> best;
+            for (const auto& y : paths)
+            {
+                Z += exp(pathScore(y));
+                if (pathScore(y) > bestScore)
+                {
+                    bestScore = pathScore(y);
+                    best = y;
+                }
+            }
+            vector<size_t> gold(T);
+            for (size_t t = 0; t < T; t++)
+                gold[t] = (size_t) labelIds[cols[t]];
+            BOOST_CHECK_SMALL((float) (log(Z) - pathScore(gold)) - loss(0, s), c_epsilonFloatE4);
+            BOOST_CHECK_SMALL((float) log(Z) - logPartition(0, s), c_epsilonFloatE4);
+
+            for (const auto& y : paths)
+            {
+                const double p = exp(pathScore(y)) / Z;
+                for (size_t t = 0; t < T; t++)
+                {
+                    expectedScoresGradient[cols[t] * L + y[t]] += gradientScale * p;
+                    if (t > 0)
+                        expectedTransitionsGradient[y[t - 1] * L + y[t]] += gradientScale * p;
+                }
+            }
+            for (size_t t = 0; t < T; t++)
+            {
+                expectedScoresGradient[cols[t] * L + gold[t]] -= gradientScale;
+                if (t > 0)
+                    expectedTransitionsGradient[gold[t - 1] * L + gold[t]] -= gradientScale;
+                for (size_t k = 0; k < L; k++)
+                    BOOST_CHECK_EQUAL(k == best[t] ? 1.0f : 0.0f, path(k, cols[t]));
+            }
+        }
+
+        for (size_t j = 0; j < N; j++)
+        {
+            for (size_t k = 0; k < L; k++)
+                BOOST_CHECK_SMALL((float) expectedScoresGradient[j * L + k] - scoresGradient(k, j), c_epsilonFloatE4);
+        }
+        for (size_t i = 0; i < L; i++)
+        {
+            for (size_t k = 0; k < L; k++)
+                BOOST_CHECK_SMALL((float) expectedTransitionsGradient[i * L + k] - transitionsGradient(k, i), c_epsilonFloatE4);
+        }
+        for (size_t k = 0; k < L; k++)
+            BOOST_CHECK_EQUAL(0.0f, path(k, N - 1));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixAttention, RandomSeedFixture)
+{
+    // two parallel sequences of T frames: the first attends to all of its frames, the second only to the frames so far
+    const size_t D = 4, Dv = 3, S = 2, T = 5, N = S * T;
+    const float scale = 0.5f;
+    vector<float> ranges(2 * N);
+    for (size_t j = 0; j < N; j++)
+    {
+        ranges[2 * j] = (float) (j % S);
+        ranges[2 * j + 1] = (float) (j % S == 0 ? T : j / S + 1);
+    }
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix query = SingleMatrix::RandomUniform(D, N, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix keys = SingleMatrix::RandomUniform(D, N, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix values = SingleMatrix::RandomUniform(Dv, N, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix contextGradient = SingleMatrix::RandomUniform(Dv, N, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix keyRanges(deviceId);
+        keyRanges.SetValue(2, N, deviceId, ranges.data());
+
+        SingleMatrix context(Dv, N, deviceId), logSumExp(1, N, deviceId);
+        SingleMatrix queryGradient = SingleMatrix::Zeros(D, N, deviceId);
+        SingleMatrix keysGradient = SingleMatrix::Zeros(D, N, deviceId);
+        SingleMatrix valuesGradient = SingleMatrix::Zeros(Dv, N, deviceId);
+        SingleMatrix::AttentionForward(query, keys, values, keyRanges, S, scale, context, logSumExp);
+        SingleMatrix::AttentionBackward(query, keys, values, keyRanges, S, scale, context, logSumExp, contextGradient, queryGradient, keysGradient, valuesGradient);
+
+        // reference: explicit softmax over the score vector of each query
+        vector<float> expectedQueryGradient(D * N, 0), expectedKeysGradient(D * N, 0), expectedValuesGradient(Dv * N, 0);
+        for (size_t j = 0; j < N; j++)
+        {
+            const size_t first = (size_t) ranges[2 * j], n = (size_t) ranges[2 * j + 1];
+            vector<float> p(n);
+            float sum = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                float score = 0;
+                for (size_t d = 0; d < D; d++)
+                    score += query(d, j) * keys(d, first + i * S);
+                p[i] = exp(scale * score);
+                sum += p[i];
+            }
+            for (size_t i = 0; i < n; i++)
+                p[i] /= sum;
+            BOOST_CHECK_CLOSE(log(sum), logSumExp(0, j), c_epsilonFloatE1);
+
+            float delta = 0;
+            for (size_t d = 0; d < Dv; d++)
+            {
+                float c = 0;
+                for (size_t i = 0; i < n; i++)
+                    c += p[i] * values(d, first + i * S);
+                BOOST_CHECK_SMALL(c - context(d, j), c_epsilonFloatE3);
+                delta += c * contextGradient(d, j);
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                const size_t col = first + i * S;
+                float dp = 0;
+                for (size_t d = 0; d < Dv; d++)
+                {
+                    dp += contextGradient(d, j) * values(d, col);
+                    expectedValuesGradient[col * Dv + d] += p[i] * contextGradient(d, j);
+                }
+                const float ds = p[i] * (dp - delta);
+                for (size_t d = 0; d < D; d++)
+                {
+                    expectedQueryGradient[j * D + d] += scale * ds * keys(d, col);
+                    expectedKeysGradient[col * D + d] += scale * ds * query(d, j);
+                }
+            }
+        }
+        for (size_t j = 0; j < N; j++)
+        {
+            for (size_t d = 0; d < D; d++)
+            {
+                BOOST_CHECK_SMALL(expectedQueryGradient[j * D + d] - queryGradient(d, j), c_epsilonFloatE3);
+                BOOST_CHECK_SMALL(expectedKeysGradient[j * D + d] - keysGradient(d, j), c_epsilonFloatE3);
+            }
+            for (size_t d = 0; d < Dv; d++)
+                BOOST_CHECK_SMALL(expectedValuesGradient[j * Dv + d] - valuesGradient(d, j), c_epsilonFloatE3);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixTruncatedSVD, RandomSeedFixture)
+{
+    // a matrix of rank 5, decomposed with rank 8: the extra singular values vanish, and the product reproduces it
+    const size_t m = 40, n = 30, trueRank = 5, rank = 8;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix P = SingleMatrix::RandomUniform(m, trueRank, deviceId, -1, 1, IncrementCounter());
+        SingleMatrix Q = SingleMatrix::RandomUniform(trueRank, n, deviceId, -1, 1, IncrementCounter());
+        SingleMatrix A(deviceId), S(deviceId), U(deviceId), VT(deviceId);
+        SingleMatrix::Multiply(P, false, Q, false, A);
+        SingleMatrix::TruncatedSVD(A, rank, /*numPowerIterations=*/2, /*seed=*/IncrementCounter(), S, U, VT);
+        BOOST_CHECK_EQUAL(S.GetNumRows(), rank);
+        BOOST_CHECK_EQUAL(U.GetNumRows(), m);
+        BOOST_CHECK_EQUAL(U.GetNumCols(), rank);
+        BOOST_CHECK_EQUAL(VT.GetNumRows(), rank);
+        BOOST_CHECK_EQUAL(VT.GetNumCols(), n);
+
+        SingleMatrix a(A, CPUDEVICE), s(S, CPUDEVICE), u(U, CPUDEVICE), vt(VT, CPUDEVICE);
+        for (size_t k = 1; k < rank; k++)
+            BOOST_CHECK_GE(s(k - 1, 0), s(k, 0));
+        for (size_t k = trueRank; k < rank; k++)
+            BOOST_CHECK_SMALL(s(k, 0) / s(0, 0), 1e-2f);
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t i = 0; i < m; i++)
+            {
+                float product = 0;
+                for (size_t k = 0; k < rank; k++)
+                    product += u(i, k) * s(k, 0) * vt(k, j);
+                BOOST_CHECK_SMALL(product - a(i, j), c_epsilonFloatE3);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -7,6 +7,16 @@
 
 #include "BlockRandomizer.h"
 #include "DataDeserializer.h"
+#include "SequencePacker.h"
+#include "BatchTransformerBase.h"
+#include "HeapMemoryProvider.h"
+#include "Sequences.h"
+#include "ConcStack.h"
+#include "ChunkCache.h"
+#include "RandomOrdering.h"
+#include <atomic>
+#include <set>
+#include <thread>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -44,6 +54,543 @@ BOOST_AUTO_TEST_CASE(BlockRandomizerInstantiate)
     auto randomizer = std::make_shared<BlockRandomizer>(0, SIZE_MAX, mockDeserializer);
 }
 
+// Has 'numChunks' chunks of 'sequencesPerChunk' single-sample sequences, and records the chunks that were requested.
+class MockChunkedDeserializer : public IDataDeserializer
+{
+public:
+    MockChunkedDeserializer(size_t numChunks, size_t sequencesPerChunk)
+    {
+        for (size_t i = 0; i < numChunks * sequencesPerChunk; i++)
+            m_descriptions.push_back(SequenceDescription{ i, 1, i / sequencesPerChunk, true });
+        for (const auto& description : m_descriptions)
+            m_sequenceDescriptions.push_back(&description);
+    }
+
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return std::vector<StreamDescriptionPtr>();
+    }
+
+    const SequenceDescriptions& GetSequenceDescriptions() const override
+    {
+        return m_sequenceDescriptions;
+    }
+
+    virtual ChunkPtr GetChunk(size_t chunkId) override
+    {
+        m_requestedChunks.insert(chunkId);
+        return std::make_shared<MockChunk>();
+    }
+
+    std::set<size_t> m_requestedChunks;
+
+private:
+    // returns the sequence id as the number of samples
+    class MockChunk : public Chunk
+    {
+    public:
+        std::vector<SequenceDataPtr> GetSequence(const size_t& sequenceId) override
+        {
+            auto sequence = std::make_shared<DenseSequenceData>();
+            sequence->m_numberOfSamples = sequenceId;
+            return std::vector<SequenceDataPtr>{sequence};
+        }
+    };
+
+    std::vector<SequenceDescription> m_descriptions;
+    SequenceDescriptions m_sequenceDescriptions;
+};
+
+BOOST_AUTO_TEST_CASE(BlockRandomizerDistributesChunks)
+{
+    const size_t numChunks = 40, sequencesPerChunk = 5, numWorkers = 3, minibatchSize = 16;
+    ConfigParameters config;
+    config.Parse("distributionMode=chunks;chunkCacheSizeInMB=0");
+
+    // every sequence is read by exactly one worker, every chunk by at most one, and all workers see the same number of minibatches
+    std::vector<size_t> timesRead(numChunks * sequencesPerChunk, 0);
+    std::vector<size_t> chunkReaders(numChunks, 0);
+    std::vector<size_t> numMinibatches(numWorkers, 0);
+    for (size_t worker = 0; worker < numWorkers; worker++)
+    {
+        auto deserializer = std::make_shared<MockChunkedDeserializer>(numChunks, sequencesPerChunk);
+        auto randomizer = std::make_shared<BlockRandomizer>(0, 30, deserializer);
+        randomizer->Initialize(nullptr, config);
+        randomizer->StartEpoch(EpochConfiguration{ numWorkers, worker, minibatchSize, requestDataSize, 0 });
+        for (bool endOfEpoch = false; !endOfEpoch; numMinibatches[worker]++)
+        {
+            Sequences sequences = randomizer->GetNextSequences(minibatchSize);
+            endOfEpoch = sequences.m_endOfEpoch;
+            for (const auto& sequence : sequences.m_data)
+                timesRead[static_cast<DenseSequenceData&>(*sequence[0]).m_numberOfSamples]++;
+        }
+        BOOST_CHECK(deserializer->m_requestedChunks.size() < numChunks);
+        for (size_t chunk : deserializer->m_requestedChunks)
+            chunkReaders[chunk]++;
+    }
+
+    for (size_t count : timesRead)
+        BOOST_CHECK_EQUAL(count, 1);
+    for (size_t count : chunkReaders)
+        BOOST_CHECK(count <= 1);
+    for (size_t worker = 1; worker < numWorkers; worker++)
+        BOOST_CHECK_EQUAL(numMinibatches[worker], numMinibatches[0]);
+}
+
+// Hands out dense one-dimensional sequences of the given lengths, where sample t of sequence i has the value 100 * i + t.
+class MockSequenceTransformer : public Transformer
+{
+public:
+    explicit MockSequenceTransformer(const std::vector<size_t>& lengths)
+        : m_position(0)
+    {
+        auto stream = std::make_shared<StreamDescription>();
+        stream->m_name = L"features";
+        stream->m_id = 0;
+        stream->m_storageType = StorageType::dense;
+        stream->m_elementType = ElementType::tfloat;
+        stream->m_sampleLayout = std::make_shared<TensorShape>(1);
+        m_streams.push_back(stream);
+
+        for (size_t i = 0; i < lengths.size(); i++)
+        {
+            m_values.push_back(std::vector<float>(lengths[i]));
+            for (size_t t = 0; t < lengths[i]; t++)
+                m_values[i][t] = (float) (100 * i + t);
+        }
+    }
+
+    void Initialize(TransformerPtr, const ConfigParameters&) override
+    {
+    }
+
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_streams;
+    }
+
+    void StartEpoch(const EpochConfiguration&) override
+    {
+    }
+
+    // at least one sequence, and as many as fit into 'sampleCount' samples
+    Sequences GetNextSequences(size_t sampleCount) override
+    {
+        Sequences result;
+        size_t numberOfSamples = 0;
+        while (m_position < m_values.size() && (result.m_data.empty() || numberOfSamples + m_values[m_position].size() <= sampleCount))
+        {
+            auto sequence = std::make_shared<DenseSequenceData>();
+            sequence->m_data = m_values[m_position].data();
+            sequence->m_numberOfSamples = m_values[m_position].size();
+            sequence->m_sampleLayout = m_streams[0]->m_sampleLayout;
+            result.m_data.push_back(std::vector<SequenceDataPtr>{sequence});
+            numberOfSamples += m_values[m_position].size();
+            m_position++;
+        }
+        result.m_endOfEpoch = m_position == m_values.size();
+        return result;
+    }
+
+private:
+    std::vector<StreamDescriptionPtr> m_streams;
+    std::vector<std::vector<float>> m_values;
+    size_t m_position;
+};
+
+// Reads all minibatches, checks that every sequence is delivered intact, and returns the number of gap frames.
+static size_t CheckSequencePacker(const std::vector<size_t>& lengths, size_t minibatchSize, size_t truncationLength, size_t numParallelSequences)
+{
+    auto transformer = std::make_shared<MockSequenceTransformer>(lengths);
+    SequencePacker packer(std::make_shared<HeapMemoryProvider>(), transformer, minibatchSize, transformer->GetStreamDescriptions(),
+                          truncationLength, numParallelSequences, 2);
+
+    // The packer numbers the sequences in the order it got them, as the mock transformer does.
+    std::vector<std::vector<float>> received(lengths.size());
+    size_t numGapFrames = 0;
+    for (bool endOfEpoch = false; !endOfEpoch;)
+    {
+        Minibatch minibatch = packer.ReadMinibatch();
+        endOfEpoch = minibatch.m_endOfEpoch;
+        if (minibatch.m_data.empty())
+            break;
+
+        const auto& layout = minibatch.m_data[0]->m_layout;
+        const float* data = reinterpret_cast<const float*>(minibatch.m_data[0]->m_data);
+        const size_t S = layout->GetNumParallelSequences();
+        const size_t T = layout->GetNumTimeSteps();
+        if (truncationLength > 0)
+        {
+            BOOST_CHECK_EQUAL(S, numParallelSequences);
+            BOOST_CHECK(T <= truncationLength);
+        }
+        else
+        {
+            // the parallel sequences are numbered by length, so the ones that have ended form a suffix at every time step
+            for (size_t t = 0; t < T; t++)
+            {
+                const size_t numActiveSequences = layout->GetNumActiveSequences(t);
+                for (size_t s = 0; s < S; s++)
+                    BOOST_CHECK_EQUAL(layout->IsGap(FrameRange(layout, t).Sequence(s)), s >= numActiveSequences);
+            }
+        }
+        for (const auto& sequence : layout->GetAllSequences())
+        {
+            size_t begin = (size_t) std::max(sequence.tBegin, (ptrdiff_t) 0);
+            size_t end = std::min(sequence.tEnd, T);
+            if (sequence.seqId == GAP_SEQUENCE_ID)
+            {
+                numGapFrames += end - begin;
+                continue;
+            }
+            BOOST_REQUIRE(sequence.seqId < lengths.size());
+            auto& values = received[sequence.seqId];
+            BOOST_CHECK_EQUAL(values.size(), begin - sequence.tBegin); // sequences continue where the previous minibatch left off
+            for (size_t t = begin; t < end; t++)
+                values.push_back(data[t * S + sequence.s]);
+        }
+    }
+
+    for (size_t i = 0; i < lengths.size(); i++)
+    {
+        BOOST_REQUIRE_EQUAL(received[i].size(), lengths[i]);
+        for (size_t t = 0; t < lengths[i]; t++)
+            BOOST_CHECK_EQUAL(received[i][t], (float) (100 * i + t));
+    }
+    return numGapFrames;
+}
+
+BOOST_AUTO_TEST_CASE(SequencePackerTruncated)
+{
+    // 40 frames in 2 parallel sequences: sequences are concatenated, so there is no gap except in the last minibatch
+    std::vector<size_t> lengths = {5, 3, 2, 7, 1, 4, 9, 6, 3};
+    size_t numGapFrames = CheckSequencePacker(lengths, 8, 4, 2);
+    BOOST_CHECK(numGapFrames < 2 * 4);
+}
+
+BOOST_AUTO_TEST_CASE(SequencePackerWholeSequences)
+{
+    // short sequences share parallel sequences with others; one sequence per parallel sequence would leave 8 gap frames
+    std::vector<size_t> lengths = {6, 2, 2, 3, 3, 6, 1, 5, 4, 2};
+    size_t numGapFrames = CheckSequencePacker(lengths, 12, 0, 0);
+    BOOST_CHECK(numGapFrames < 8);
+}
+
+BOOST_AUTO_TEST_CASE(SequencePackerKeepsBuffers)
+{
+    // with 3 buffers, a minibatch stays intact while the next 2 are read, and the buffers are then reused
+    const size_t numberOfBuffers = 3;
+    std::vector<size_t> lengths(8, 4);
+    auto transformer = std::make_shared<MockSequenceTransformer>(lengths);
+    SequencePacker packer(std::make_shared<HeapMemoryProvider>(), transformer, 4, transformer->GetStreamDescriptions(), 4, 1, 1, numberOfBuffers);
+
+    std::vector<const float*> buffers;
+    for (bool endOfEpoch = false; !endOfEpoch;)
+    {
+        Minibatch minibatch = packer.ReadMinibatch();
+        endOfEpoch = minibatch.m_endOfEpoch;
+        if (minibatch.m_data.empty())
+            break;
+        buffers.push_back(reinterpret_cast<const float*>(minibatch.m_data[0]->m_data));
+
+        const size_t k = buffers.size() - 1;
+        for (size_t previous = k >= numberOfBuffers - 1 ? k - (numberOfBuffers - 1) : 0; previous <= k; previous++)
+        {
+            for (size_t t = 0; t < 4; t++)
+                BOOST_CHECK_EQUAL(buffers[previous][t], (float) (100 * previous + t));
+        }
+        if (k >= numberOfBuffers)
+            BOOST_CHECK_EQUAL(buffers[k], buffers[k - numberOfBuffers]);
+    }
+    BOOST_CHECK_EQUAL(buffers.size(), lengths.size());
+}
+
+// Scales a float stream and subtracts the mean over the whole batch.
+class MockBatchTransformer : public BatchTransformerBase
+{
+public:
+    MockBatchTransformer()
+        : m_appliedStreamIds(1, 0)
+    {
+    }
+
+private:
+    const std::vector<StreamId>& GetAppliedStreamIds() const override
+    {
+        return m_appliedStreamIds;
+    }
+
+    void ApplyToBatch(DenseBatch& batch, const StreamDescription&) override
+    {
+        float* data = batch.Data<float>();
+        const size_t n = batch.m_numberOfSamples * batch.m_sampleSize;
+        float mean = 0;
+        for (size_t i = 0; i < n; i++)
+            mean += data[i];
+        mean /= n;
+        for (size_t i = 0; i < n; i++)
+            data[i] = 2 * (data[i] - mean);
+    }
+
+    std::vector<StreamId> m_appliedStreamIds;
+};
+
+BOOST_AUTO_TEST_CASE(BatchTransformerContiguousBatch)
+{
+    std::vector<size_t> lengths = {3, 1, 4};
+    auto transformer = std::make_shared<MockBatchTransformer>();
+    transformer->Initialize(std::make_shared<MockSequenceTransformer>(lengths), ConfigParameters());
+
+    Sequences sequences = transformer->GetNextSequences(100);
+    BOOST_REQUIRE_EQUAL(sequences.m_data.size(), lengths.size());
+
+    float mean = 0;
+    for (size_t i = 0; i < lengths.size(); i++)
+        for (size_t t = 0; t < lengths[i]; t++)
+            mean += (float) (100 * i + t);
+    mean /= 8;
+
+    // the sequences follow each other in one buffer
+    const float* first = reinterpret_cast<const float*>(sequences.m_data[0][0]->m_data);
+    size_t offset = 0;
+    for (size_t i = 0; i < lengths.size(); i++)
+    {
+        const auto& sequence = static_cast<const DenseSequenceData&>(*sequences.m_data[i][0]);
+        BOOST_REQUIRE_EQUAL(sequence.m_numberOfSamples, lengths[i]);
+        const float* data = reinterpret_cast<const float*>(sequence.m_data);
+        BOOST_CHECK_EQUAL(data, first + offset);
+        for (size_t t = 0; t < lengths[i]; t++)
+            BOOST_CHECK_CLOSE(data[t], 2 * ((float) (100 * i + t) - mean), 1e-4);
+        offset += lengths[i];
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConcPoolReusesObjects)
+{
+    conc_pool<std::unique_ptr<int>> pool;
+    size_t numCreated = 0;
+    auto factory = [&numCreated]()
+    {
+        return std::make_unique<int>((int) numCreated++);
+    };
+
+    // more objects than slots, so that some go to the overflow list
+    std::vector<std::unique_ptr<int>> objects;
+    for (size_t i = 0; i < 100; i++)
+        objects.push_back(pool.pop_or_create(factory));
+    BOOST_CHECK_EQUAL(numCreated, 100);
+    for (auto& object : objects)
+        pool.push(std::move(object));
+
+    std::set<int> values;
+    for (size_t i = 0; i < 100; i++)
+        values.insert(*pool.pop_or_create(factory));
+    BOOST_CHECK_EQUAL(numCreated, 100);
+    BOOST_CHECK_EQUAL(values.size(), 100);
+    pool.pop_or_create(factory);
+    BOOST_CHECK_EQUAL(numCreated, 101);
+}
+
+BOOST_AUTO_TEST_CASE(ConcPoolConcurrent)
+{
+    // each object is held by one thread at a time
+    conc_pool<std::unique_ptr<std::atomic<int>>> pool;
+    std::atomic<size_t> numCreated(0);
+    std::atomic<bool> shared(false);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 8; t++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (size_t i = 0; i < 10000; i++)
+            {
+                auto object = pool.pop_or_create([&numCreated]()
+                {
+                    numCreated++;
+                    return std::make_unique<std::atomic<int>>(0);
+                });
+                if ((*object)++ != 0)
+                    shared = true;
+                (*object)--;
+                pool.push(std::move(object));
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    BOOST_CHECK(!shared);
+    BOOST_CHECK(numCreated <= 8);
+}
+
+BOOST_AUTO_TEST_CASE(ConcBoundedQueueOrderAndCapacity)
+{
+    conc_bounded_queue<int> queue(5);
+    BOOST_CHECK_EQUAL(queue.capacity(), 8);
+    int item;
+    BOOST_CHECK(!queue.try_pop(item));
+    for (int round = 0; round < 3; round++) // (wraps around)
+    {
+        for (int i = 0; i < 8; i++)
+            BOOST_CHECK(queue.try_push(10 * round + i));
+        BOOST_CHECK(!queue.try_push(-1));
+        for (int i = 0; i < 8; i++)
+        {
+            BOOST_REQUIRE(queue.try_pop(item));
+            BOOST_CHECK_EQUAL(item, 10 * round + i);
+        }
+        BOOST_CHECK(!queue.try_pop(item));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConcBoundedQueueConcurrent)
+{
+    // 4 producers and 4 consumers; every item arrives exactly once, and the items of each producer in order
+    const size_t numProducers = 4, numConsumers = 4, numItems = 20000;
+    conc_bounded_queue<size_t> queue(64);
+    std::vector<std::vector<size_t>> received(numConsumers);
+    std::atomic<size_t> numPopped(0);
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < numProducers; p++)
+    {
+        threads.push_back(std::thread([&, p]()
+        {
+            for (size_t i = 0; i < numItems; i++)
+            {
+                while (!queue.try_push(p * numItems + i))
+                    std::this_thread::yield();
+            }
+        }));
+    }
+    for (size_t c = 0; c < numConsumers; c++)
+    {
+        threads.push_back(std::thread([&, c]()
+        {
+            size_t item;
+            while (numPopped < numProducers * numItems)
+            {
+                if (queue.try_pop(item))
+                {
+                    received[c].push_back(item);
+                    numPopped++;
+                }
+                else
+                    std::this_thread::yield();
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    std::vector<size_t> counts(numProducers * numItems, 0);
+    for (const auto& items : received)
+    {
+        std::vector<size_t> last(numProducers, SIZE_MAX);
+        for (size_t item : items)
+        {
+            counts[item]++;
+            size_t p = item / numItems;
+            BOOST_CHECK(last[p] == SIZE_MAX || last[p] < item);
+            last[p] = item;
+        }
+    }
+    for (size_t count : counts)
+        BOOST_REQUIRE_EQUAL(count, 1);
+}
+
+BOOST_AUTO_TEST_CASE(KeyedPermutationIsBijection)
+{
+    for (size_t size : { 1, 2, 3, 17, 256, 1000, 65537 })
+    {
+        KeyedPermutation permutation(size, 7);
+        BOOST_CHECK_EQUAL(permutation.size(), size);
+        std::vector<bool> seen(size, false);
+        size_t numFixed = 0;
+        for (size_t pos = 0; pos < size; pos++)
+        {
+            size_t index = permutation[pos];
+            BOOST_REQUIRE(index < size);
+            BOOST_REQUIRE(!seen[index]);
+            seen[index] = true;
+            numFixed += index == pos;
+        }
+        if (size >= 1000)
+            BOOST_CHECK(numFixed < size / 100); // (about 1 expected)
+    }
+}
+
+BOOST_AUTO_TEST_CASE(KeyedPermutationDependsOnSeed)
+{
+    const size_t size = 1000;
+    KeyedPermutation a(size, 1), b(size, 1), c(size, 2);
+    size_t numSame = 0;
+    for (size_t pos = 0; pos < size; pos++)
+    {
+        BOOST_CHECK_EQUAL(a[pos], b[pos]);
+        numSame += a[pos] == c[pos];
+    }
+    BOOST_CHECK(numSame < size / 100);
+
+    a.Reset(size, 2);
+    for (size_t pos = 0; pos < size; pos++)
+        BOOST_CHECK_EQUAL(a[pos], c[pos]);
+}
+
+// Counts how often each chunk is loaded.
+class CountingDeserializer : public MockDeserializer
+{
+public:
+    class EmptyChunk : public Chunk
+    {
+    public:
+        std::vector<SequenceDataPtr> GetSequence(const size_t&) override
+        {
+            return std::vector<SequenceDataPtr>();
+        }
+    };
+
+    explicit CountingDeserializer(size_t numChunks)
+        : m_numberOfLoads(numChunks)
+    {
+    }
+
+    ChunkPtr GetChunk(size_t chunkId) override
+    {
+        m_numberOfLoads[chunkId]++;
+        return std::make_shared<EmptyChunk>();
+    }
+
+    std::vector<std::atomic<size_t>> m_numberOfLoads;
+};
+
+BOOST_AUTO_TEST_CASE(ChunkCacheKeepsLiveChunks)
+{
+    // 4 chunks of 100 bytes, budget for 2
+    auto deserializer = std::make_shared<CountingDeserializer>(4);
+    ChunkCache cache(deserializer, std::vector<size_t>(4, 100), 200);
+
+    // live chunks are loaded once, however often they are asked for, and are kept beyond the budget
+    cache.Require(0);
+    cache.Require(1);
+    cache.Require(2);
+    for (size_t i = 0; i < 3; i++)
+        for (size_t chunkId = 0; chunkId < 3; chunkId++)
+            BOOST_CHECK(cache.Get(chunkId) != nullptr);
+    for (size_t chunkId = 0; chunkId < 3; chunkId++)
+        BOOST_CHECK_EQUAL(deserializer->m_numberOfLoads[chunkId].load(), 1);
+
+    // chunks ahead only within the budget
+    BOOST_CHECK(!cache.Prefetch(3));
+    cache.Evict([](size_t chunkId) { return chunkId == 2; });
+    BOOST_CHECK(cache.Prefetch(3));
+    BOOST_CHECK(cache.Get(3) != nullptr);
+    BOOST_CHECK_EQUAL(deserializer->m_numberOfLoads[3].load(), 1);
+
+    // released chunks are loaded again
+    BOOST_CHECK(cache.Get(0) != nullptr);
+    BOOST_CHECK_EQUAL(deserializer->m_numberOfLoads[0].load(), 2);
+    BOOST_CHECK_EQUAL(deserializer->m_numberOfLoads[2].load(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }